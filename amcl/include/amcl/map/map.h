@@ -28,6 +28,7 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -41,6 +42,9 @@ struct _rtk_fig_t;
 // Limits
 #define MAP_WIFI_MAX_LEVELS 8
 
+// Resolution of the compact distance plane, in steps per map cell
+#define MAP_DIST_CODES_PER_CELL 64
+
   
 // Description for a single map cell.
 typedef struct
@@ -72,9 +76,28 @@ typedef struct
   // The map data, stored as a grid
   map_cell_t *cells;
 
+  // Compact storage, used instead of [cells] when [cells] is NULL: one
+  // byte of occupancy and two bytes of distance per cell, the distance
+  // quantized in steps of [occ_dist_step] so that [occ_dist_max_code] is
+  // [max_occ_dist].  Both planes are indexed with MAP_INDEX.
+  int8_t *occ_states;
+  uint16_t *occ_dist_codes;
+  double occ_dist_step;
+  int occ_dist_max_code;
+
+  // Set when [occ_dist_codes] points into a mapped cache file rather than
+  // into malloc'ed memory (see map_cspace_cache_load)
+  void *occ_dist_mapping;
+  size_t occ_dist_mapping_size;
+
   // Max distance at which we care about obstacles, for constructing
   // likelihood field
   double max_occ_dist;
+
+  // Key (see map_cspace_hash) of the likelihood field the map holds, 0 if
+  // it holds none, and the method it was built with
+  uint64_t cspace_key;
+  int cspace_method;
   
 } map_t;
 
@@ -90,6 +113,13 @@ map_t *map_alloc(void);
 // Destroy a map
 void map_free(map_t *map);
 
+// Get the bytes the map holds, a likelihood field mapped from a cache
+// file included
+size_t map_memory_bytes(map_t *map);
+
+// Whether two maps have the same geometry, storage and occupancy
+int map_same_occupancy(map_t *a, map_t *b);
+
 // Get the cell at the given point
 map_cell_t *map_get_cell(map_t *map, double ox, double oy, double oa);
 
@@ -102,6 +132,27 @@ int map_load_occ(map_t *map, const char *filename, double scale, int negate);
 // Update the cspace distances
 void map_update_cspace(map_t *map, double max_occ_dist);
 
+// Update the cspace distances with an exact linear-time distance
+// transform, split over num_threads threads
+void map_update_cspace_edt(map_t *map, double max_occ_dist, int num_threads);
+
+// Repair the cspace distances after the occupancy of the cells in
+// [x0, x0 + width) x [y0, y0 + height) changed; the cspace must already
+// have been computed
+void map_update_cspace_region(map_t *map, int x0, int y0, int width, int height);
+
+// Cache key for the cspace of this map's occupancy grid, built with the
+// given distance transform (method) and max_occ_dist
+uint64_t map_cspace_hash(map_t *map, double max_occ_dist, int method);
+
+// Load the cspace distances from a cache file written for the given key.
+// Compact distance planes are mapped in place rather than copied.
+// Returns 0 on success, -1 if the file is missing or does not match.
+int map_cspace_cache_load(map_t *map, const char *filename, uint64_t key);
+
+// Save the cspace distances to a cache file; returns 0 on success
+int map_cspace_cache_save(map_t *map, const char *filename, uint64_t key);
+
 
 /**************************************************************************
  * Range functions
@@ -143,6 +194,13 @@ void map_draw_wifi(map_t *map, struct _rtk_fig_t *fig, int index);
 // Compute the cell index for the given map coords.
 #define MAP_INDEX(map, i, j) ((i) + (j) * map->size_x)
 
+// Read the occupancy state / obstacle distance of a cell index, whichever
+// storage the map uses.
+#define MAP_OCC_STATE(map, index) ((map)->cells ? (map)->cells[index].occ_state : \
+                                   (map)->occ_states[index])
+#define MAP_OCC_DIST(map, index) ((map)->cells ? (map)->cells[index].occ_dist : \
+                                  (map)->occ_dist_codes[index] * (map)->occ_dist_step)
+
 #ifdef __cplusplus
 }
 #endif
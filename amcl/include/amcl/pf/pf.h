@@ -55,18 +55,6 @@ typedef double (*pf_sensor_model_fn_t) (void *sensor_data,
                                         struct _pf_sample_set_t* set);
 
 
-// Information for a single sample
-typedef struct
-{
-  // Pose represented by this sample
-  pf_vector_t pose;
-
-  // Weight for this pose
-  double weight;
-  
-} pf_sample_t;
-
-
 // Information for a cluster of samples
 typedef struct
 {
@@ -89,9 +77,12 @@ typedef struct
 // Information for a set of samples
 typedef struct _pf_sample_set_t
 {
-  // The samples
+  // The samples, stored as one 32-byte aligned array per component so the
+  // sensor and action models can stream through them.  Use the
+  // PF_SAMPLE_* accessors below rather than indexing directly.
   int sample_count;
-  pf_sample_t *samples;
+  double *x, *y, *theta;
+  double *weight;
 
   // A kdtree encoding the histogram
   pf_kdtree_t *kdtree;
@@ -107,6 +98,44 @@ typedef struct _pf_sample_set_t
 } pf_sample_set_t;
 
 
+// Alignment (bytes) of the per-component sample arrays
+#define PF_SAMPLE_ALIGN 32
+
+// Access the components of sample i in a set
+#define PF_SAMPLE_X(set, i) ((set)->x[i])
+#define PF_SAMPLE_Y(set, i) ((set)->y[i])
+#define PF_SAMPLE_THETA(set, i) ((set)->theta[i])
+#define PF_SAMPLE_WEIGHT(set, i) ((set)->weight[i])
+
+// Gather the pose of sample i
+static inline pf_vector_t pf_sample_get_pose(const pf_sample_set_t *set, int i)
+{
+  pf_vector_t pose;
+  pose.v[0] = set->x[i];
+  pose.v[1] = set->y[i];
+  pose.v[2] = set->theta[i];
+  return pose;
+}
+
+// Scatter a pose into sample i
+static inline void pf_sample_set_pose(pf_sample_set_t *set, int i, pf_vector_t pose)
+{
+  set->x[i] = pose.v[0];
+  set->y[i] = pose.v[1];
+  set->theta[i] = pose.v[2];
+}
+
+
+// How pf_update_resample() draws the new sample set
+typedef enum
+{
+  // Independent draws from the cumulative weights, one sample at a time
+  PF_RESAMPLE_MULTINOMIAL,
+  // Low-variance draws: one pass over the cumulative weights per batch
+  PF_RESAMPLE_SYSTEMATIC
+} pf_resample_model_t;
+
+
 // Information for an entire filter
 typedef struct _pf_t
 {
@@ -133,9 +162,20 @@ typedef struct _pf_t
 
   double dist_threshold; //distance threshold in each axis over which the pf is considered to not be converged
   int converged; 
+
+  // Resampling scheme (PF_RESAMPLE_MULTINOMIAL by default)
+  pf_resample_model_t resample_model;
+
+  // Only resample once the effective sample size 1 / sum(w^2) drops below
+  // this fraction of the sample count; 0 (the default) always resamples
+  double resample_n_eff_ratio;
 } pf_t;
 
 
+// Set the seed that pf_alloc() gives the random number generator, so
+// that runs can be repeated; zero (the default) seeds from the clock
+void pf_set_seed(long seed);
+
 // Create a new filter
 pf_t *pf_alloc(int min_samples, int max_samples,
                double alpha_slow, double alpha_fast,
@@ -156,8 +196,10 @@ void pf_update_action(pf_t *pf, pf_action_model_fn_t action_fn, void *action_dat
 // Update the filter with some new sensor observation
 void pf_update_sensor(pf_t *pf, pf_sensor_model_fn_t sensor_fn, void *sensor_data);
 
-// Resample the distribution
-void pf_update_resample(pf_t *pf);
+// Resample the distribution.  While the effective sample size is above
+// resample_n_eff_ratio, the weighted set is kept and only its cluster
+// statistics are brought up to date.  Returns 1 if the set was resampled.
+int pf_update_resample(pf_t *pf);
 
 // Compute the CEP statistics (mean and variance).
 void pf_get_cep_stats(pf_t *pf, pf_vector_t *mean, double *var);
@@ -167,6 +209,10 @@ void pf_get_cep_stats(pf_t *pf, pf_vector_t *mean, double *var);
 int pf_get_cluster_stats(pf_t *pf, int cluster, double *weight,
                          pf_vector_t *mean, pf_matrix_t *cov);
 
+// Move the samples of the first count clusters rigidly, so that the mean
+// of cluster i lands on means[i], then re-compute the cluster statistics.
+void pf_move_clusters(pf_t *pf, const pf_vector_t *means, int count);
+
 // Display the sample set
 void pf_draw_samples(pf_t *pf, struct _rtk_fig_t *fig, int max_samples);
 
@@ -33,45 +33,45 @@
 #endif
 
 
-// Info for a node in the tree
+// Info for an occupied bin of the histogram.  Despite the name (kept
+// for the API) the histogram is an open-addressing hash grid over the bin
+// keys rather than a tree.
 typedef struct pf_kdtree_node
 {
-  // Depth in the tree
-  int leaf, depth;
-
-  // Pivot dimension and value
-  int pivot_dim;
-  double pivot_value;
-
   // The key for this node
   int key[3];
 
   // The value for this node
   double value;
 
-  // The cluster label (leaf nodes)
+  // The cluster label
   int cluster;
 
-  // Child nodes
-  struct pf_kdtree_node *children[2];
+  // Union-find parent (an index into the node array) used by clustering
+  int parent;
+
+  // Slot of this node in the hash table
+  int slot;
 
 } pf_kdtree_node_t;
 
 
-// A kd tree
+// A histogram over (x, y, theta) bins
 typedef struct
 {
   // Cell size
   double size[3];
 
-  // The root node of the tree
-  pf_kdtree_node_t *root;
-
-  // The number of nodes in the tree
+  // The number of nodes (occupied bins) and the node storage
   int node_count, node_max_count;
   pf_kdtree_node_t *nodes;
 
-  // The number of leaf nodes in the tree
+  // Hash table of node indices (-1 for empty slots); the size is a power
+  // of two of at least twice node_max_count
+  int table_size;
+  int *table;
+
+  // The number of occupied bins; kept equal to node_count
   int leaf_count;
 
 } pf_kdtree_t;
@@ -89,7 +89,7 @@ extern void pf_kdtree_clear(pf_kdtree_t *self);
 // Insert a pose into the tree
 extern void pf_kdtree_insert(pf_kdtree_t *self, pf_vector_t pose, double value);
 
-// Cluster the leaves in the tree
+// Cluster the occupied bins into 26-connected components
 extern void pf_kdtree_cluster(pf_kdtree_t *self);
 
 // Determine the probability estimate for the given pose
@@ -75,6 +75,13 @@ void pf_pdf_gaussian_free(pf_pdf_gaussian_t *pdf);
 //   http://www.taygeta.com/random/gaussian.html
 double pf_ran_gaussian(double sigma);
 
+// Fill z[0..n-1] with independent standard normal draws, by the
+// ziggurat method over a counter-based generator.  The generator is keyed
+// with one drand48() per call, so a batch follows srand48() like
+// pf_ran_gaussian() does, but nearly every draw costs one hash and one
+// multiply instead of two drand48(), a log and a sqrt.
+void pf_ran_gaussian_batch(double *z, int n);
+
 // Generate a sample from the the pdf.
 pf_vector_t pf_pdf_gaussian_sample(pf_pdf_gaussian_t *pdf);
 
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Coarse-to-fine global localization over a map pyramid
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef AMCL_GLOBAL_LOCALIZER_H
+#define AMCL_GLOBAL_LOCALIZER_H
+
+#include <vector>
+
+#include "amcl_laser.h"
+#include "../map/map.h"
+#include "../pf/pf.h"
+
+namespace amcl
+{
+
+// Finds the robot poses that best explain a single scan anywhere on the
+// map.  The map is reduced into a pyramid of coarser levels (each cell
+// twice the size of the one below, occupied if any cell it covers is),
+// each with its own likelihood field.  Every free cell and heading of the
+// coarsest level is scored; then only the best hypotheses are refined one
+// level at a time, down to the full-resolution map, so the cost is set by
+// the size of the coarsest level and the number of hypotheses kept.
+class AMCLGlobalLocalizer
+{
+  // Build the pyramid for the map.  max_levels bounds the number of
+  // coarse levels; fewer are built when the coarse search is already
+  // small enough.  The likelihood field parameters are those of the
+  // laser model, widened on each level by its cell size.
+  public: AMCLGlobalLocalizer(map_t *map, int max_hypotheses, int max_levels,
+                              size_t max_beams, double z_hit, double z_rand,
+                              double sigma_hit, double max_occ_dist,
+                              int num_threads);
+
+  public: ~AMCLGlobalLocalizer();
+
+  // Number of coarse levels above the map itself
+  public: int Levels() const {return (int) this->levels.size() - 1;}
+
+  // Search for the robot poses that best explain the scan, best first.
+  // The full-resolution level is scored with the given laser (and its own
+  // sensor model), which also supplies the laser pose.
+  public: void Search(AMCLLaserData *data, AMCLLaser *laser,
+                      std::vector<pf_vector_t> *poses);
+
+  // Angular resolution of the poses returned by Search()
+  public: double AngleStep() const;
+
+  // One candidate pose and its score
+  private: struct Hypothesis
+  {
+    pf_vector_t pose;
+    double score;
+    bool operator<(const Hypothesis& other) const {return score > other.score;}
+  };
+
+  // Score the hypotheses with the given laser and keep the best ones
+  private: void Score(AMCLLaserData *data, AMCLLaser *laser,
+                      std::vector<Hypothesis> *hyps);
+
+  // Does the cell of level l under (x, y) cover any free space?
+  private: bool IsFree(int l, double x, double y) const;
+
+  private: int max_hypotheses;
+
+  // levels[0] is the map itself (not owned); the others are owned, along
+  // with the lasers that score on them
+  private: std::vector<map_t*> levels;
+  private: std::vector<std::vector<bool> > free_cells;
+  private: std::vector<AMCLLaser*> lasers;
+
+  // Scratch sample storage for scoring
+  private: std::vector<double> x, y, theta, weight;
+};
+
+}
+
+#endif
@@ -29,7 +29,15 @@
 #ifndef AMCL_LASER_H
 #define AMCL_LASER_H
 
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
 #include "amcl_sensor.h"
+#include "amcl_laser_kernel.h"
+#include "amcl_range_table.h"
+#include "amcl_thread_pool.h"
 #include "../map/map.h"
 
 namespace amcl
@@ -46,12 +54,19 @@ typedef enum
 class AMCLLaserData : public AMCLSensorData
 {
   public:
-    AMCLLaserData () {ranges=NULL;};
-    virtual ~AMCLLaserData() {delete [] ranges;};
+    AMCLLaserData () {ranges=NULL; owns_ranges=true; bearing_cos=NULL; bearing_sin=NULL;};
+    virtual ~AMCLLaserData() {if(owns_ranges) delete [] ranges;};
   // Laser range data (range, bearing tuples)
   public: int range_count;
   public: double range_max;
   public: double (*ranges)[2];
+  // Whether ranges is freed with the data, rather than lent by a buffer
+  // that outlives it
+  public: bool owns_ranges;
+  // Cosine and sine of each bearing, or NULL for the sensor model to
+  // work them out once per scan
+  public: const double *bearing_cos;
+  public: const double *bearing_sin;
 };
 
 
@@ -86,14 +101,63 @@ class AMCLLaser : public AMCLSensor
 					   double beam_skip_threshold, 
 					   double beam_skip_error_threshold);
 
+  // Set the number of threads the sample set is split over when
+  // evaluating the sensor model.  Results match the single-threaded path.
+  public: void SetModelThreads(int num_threads);
+
+  // Replace ray casting in the beam model by lookups in a precomputed
+  // range table of at most max_bytes (0 disables it).  Returns the
+  // angular resolution of the table in radians.  Must be called after
+  // SetModelThreads().
+  public: double SetModelBeamRangeTable(size_t max_bytes);
+
+  // Build the likelihood field with the linear-time exact distance
+  // transform (split over the model threads) instead of the brushfire.
+  // Must be called before SetModelLikelihoodField*().
+  public: void SetCspaceEDT(bool use_edt);
+
+  // Look up (and store) the likelihood field in the given directory,
+  // keyed by a hash of the map; an empty string disables the cache.
+  // Must be called before SetModelLikelihoodField*().
+  public: void SetCspaceCacheDir(const std::string& dir);
+
+  // Repair the likelihood field and the range table after the occupancy of
+  // the map cells in [x0, x0 + width) x [y0, y0 + height) changed.  Copies
+  // of this laser share both, so this need only be called once per change.
+  public: void UpdateMapRegion(int x0, int y0, int width, int height);
+
+  // Use the vectorized beam kernel (see amcl_laser_kernel.h) in the
+  // likelihood field model.  Returns false if only the scalar version of
+  // that kernel is available on this machine.
+  public: bool SetModelVectorized(bool vectorized);
+
+  // Choose the beams of the likelihood field model by their information
+  // content instead of with a fixed stride: max range readings, isolated
+  // returns and endpoints that duplicate their neighbour are skipped, and
+  // each of max_beams sectors of the scan keeps the beam that hits the
+  // steepest part of the likelihood field from the mean sample pose.
+  public: void SetModelAdaptiveBeams(bool adaptive);
+
   // Update the filter based on the sensor model.  Returns true if the
   // filter has been updated.
   public: virtual bool UpdateSensor(pf_t *pf, AMCLSensorData *data);
 
+  // Evaluate the sensor model for every sample of the set, scaling each
+  // weight by its likelihood, and return the total weight.  Unlike
+  // UpdateSensor() this leaves the weights unnormalized and touches no
+  // filter, so it can score arbitrary candidate poses.
+  public: double ScoreSamples(AMCLLaserData *data, pf_sample_set_t *set);
+
+  // Change the number of beams considered per scan
+  public: void SetMaxBeams(int max_beams) {this->max_beams = max_beams;}
+
   // Set the laser's pose after construction
   public: void SetLaserPose(pf_vector_t& laser_pose) 
           {this->laser_pose = laser_pose;}
 
+  // Laser offset relative to the robot
+  public: pf_vector_t GetLaserPose() const {return this->laser_pose;}
+
   // Determine the probability for the given pose
   private: static double BeamModel(AMCLLaserData *data, 
                                    pf_sample_set_t* set);
@@ -105,8 +169,40 @@ class AMCLLaser : public AMCLSensor
   private: static double LikelihoodFieldModelProb(AMCLLaserData *data, 
 					     pf_sample_set_t* set);
 
+  // Per-chunk workers for the models above; each one updates the weights
+  // of its own slice of the sample set
+  private: static void BeamModelChunk(AMCLLaserData *data,
+                                      pf_sample_set_t* set,
+                                      int num_chunks, int chunk);
+  private: static void LikelihoodFieldModelChunk(AMCLLaserData *data,
+                                                 pf_sample_set_t* set,
+                                                 int num_chunks, int chunk);
+  private: static void LikelihoodFieldModelProbChunk(AMCLLaserData *data,
+                                                     pf_sample_set_t* set,
+                                                     int step, bool do_beamskip,
+                                                     int *obs_count,
+                                                     int num_chunks, int chunk);
+  private: static void BeamSkipChunk(AMCLLaserData *data,
+                                     pf_sample_set_t* set,
+                                     bool *obs_mask, bool error,
+                                     int num_chunks, int chunk);
+
   private: void reallocTempData(int max_samples, int max_obs);
 
+  // Point the data at a table of the cos and sin of its bearings, if it
+  // came without one
+  private: void PrepareBearings(AMCLLaserData *data);
+
+  // Fill beam_index with the beams of the scan that the likelihood field
+  // model evaluates
+  private: void SelectBeams(AMCLLaserData *data, pf_sample_set_t* set);
+
+  // Compute the map's cspace, then rebuild dist_lut
+  private: void UpdateCspace(double max_occ_dist);
+
+  // Rebuild dist_lut after the cspace has been computed
+  private: void UpdateDistanceTable();
+
   private: laser_model_t model_type;
 
   // Current data timestamp
@@ -134,6 +230,36 @@ class AMCLLaser : public AMCLSensor
   private: int max_obs;
   private: double **temp_obs;
 
+  // Use map_update_cspace_edt() for the likelihood field
+  private: bool cspace_edt;
+
+  // Directory of the likelihood field cache, or empty
+  private: std::string cspace_cache_dir;
+
+  // Hit likelihood exp(-z^2 / (2 sigma_hit^2)) per distance code, used
+  // when the map has compact storage
+  private: std::vector<double> dist_lut;
+
+  // Cos and sin of the bearings of the current scan, when its data has none
+  private: std::vector<double> bearing_cos_buf;
+  private: std::vector<double> bearing_sin_buf;
+
+  // Beams of the current scan used by the likelihood field model
+  private: bool adaptive_beams;
+  private: std::vector<int> beam_index;
+
+  // Beam geometry of the current scan for the vectorized kernel
+  private: bool vectorized;
+  private: std::vector<double> beam_range;
+  private: std::vector<double> beam_cos;
+  private: std::vector<double> beam_sin;
+
+  // Expected ranges for the beam model, or NULL to ray cast
+  private: boost::shared_ptr<AMCLRangeTable> range_table;
+
+  // Workers used to evaluate the sensor models; shared between copies
+  private: boost::shared_ptr<AMCLThreadPool> thread_pool;
+
   // Laser model params
   //
   // Mixture params for the components of the model; must sum to 1
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Vectorized beam kernels for the likelihood field laser model
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef AMCL_LASER_KERNEL_H
+#define AMCL_LASER_KERNEL_H
+
+#include "../map/map.h"
+#include "../pf/pf_vector.h"
+
+namespace amcl
+{
+
+// Beams of one scan that the likelihood field model integrates, with the
+// bearing already reduced to its cosine and sine.  Max-range and NaN
+// readings are dropped when the scan is prepared, not per particle.
+struct LaserBeamSet
+{
+  int count;
+  const double *range;
+  const double *cos_bearing;
+  const double *sin_bearing;
+};
+
+// Returns true if a vector (AVX2 or NEON) implementation of
+// LikelihoodFieldBeams() is available on this machine, and scalar
+// kernels are not forced with ~kernels/force_scalar.  Otherwise the
+// kernel still works, one beam at a time.
+bool LikelihoodFieldKernelVectorized();
+
+// Evaluate the likelihood field model for one laser pose (already in map
+// coordinates) and return 1 + sum(pz^3) over the beams, matching the
+// ad-hoc combination used by AMCLLaser::LikelihoodFieldModel.  The
+// Gaussian is evaluated with a fast exp() approximation in the vector
+// lanes.
+double LikelihoodFieldBeams(const map_t *map, const LaserBeamSet& beams,
+                            pf_vector_t pose, double z_hit,
+                            double z_hit_denom, double z_rand_term);
+
+}
+
+#endif
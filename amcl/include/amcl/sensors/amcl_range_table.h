@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Precomputed expected ranges for the beam model
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef AMCL_RANGE_TABLE_H
+#define AMCL_RANGE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "amcl_thread_pool.h"
+#include "../map/map.h"
+#include "../pf/pf.h"
+
+namespace amcl
+{
+
+// Expected range (as map_calc_range would return it) from the centre of
+// every map cell along a fixed set of evenly spaced directions.  Ranges
+// are quantized to 16 bits of max_range.  The table is split into square
+// tiles which are only built once a particle has visited them, so the
+// memory actually used tracks the part of the map the filter explores.
+class AMCLRangeTable
+{
+  // Size the angular resolution so that a table covering every tile with
+  // free space in it fits into max_bytes
+  public: AMCLRangeTable(map_t *map, size_t max_bytes);
+
+  public: ~AMCLRangeTable();
+
+  // Number of directions per cell
+  public: int AngleCount() const {return angle_count;}
+
+  // Build the tiles that the laser poses of the given samples lie in,
+  // splitting the work over the pool.  Must be called before Lookup()
+  // for those poses; a larger max_range than before discards the table.
+  public: void Prepare(pf_sample_set_t *set, const pf_vector_t& laser_pose,
+                       double max_range, AMCLThreadPool *pool);
+
+  // Expected range from (ox, oy) along oa.  Poses in tiles that have not
+  // been prepared fall back to ray casting.  Safe to call concurrently.
+  public: double Lookup(double ox, double oy, double oa) const;
+
+  // Drop the tiles with a cell within max_range of the given patch of
+  // cells, whose occupancy changed; they are rebuilt when next visited
+  public: void Invalidate(int x0, int y0, int width, int height);
+
+  private: void BuildTiles(const std::vector<int>& todo,
+                           int num_chunks, int chunk);
+
+  // Side of a tile, in cells
+  private: static const int tile_size = 32;
+
+  private: map_t *map;
+  private: int angle_count;
+  private: double angle_step;
+
+  // Range the tiles were built for, and the size of one range code
+  private: double max_range;
+  private: double range_step;
+
+  // Tiles in row-major order; a tile is tile_size^2 cells of angle_count
+  // codes, or NULL if it has not been built yet
+  private: int tiles_x, tiles_y;
+  private: std::vector<uint16_t*> tiles;
+};
+
+}
+
+#endif
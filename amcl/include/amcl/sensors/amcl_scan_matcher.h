@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Local correlative scan matching around a pose estimate
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef AMCL_SCAN_MATCHER_H
+#define AMCL_SCAN_MATCHER_H
+
+#include <vector>
+
+#include "amcl_laser.h"
+#include "../pf/pf.h"
+
+namespace amcl
+{
+
+// Refines a pose by matching a scan against the laser's own model near
+// it.  A grid of poses centred on the best so far, spanning the whole
+// window on the first level, is scored in one batch; each level halves
+// the grid spacing about the best pose of the one before.  A filter that
+// only has to get near the right pose can then do with far fewer
+// particles.
+class AMCLScanMatcher
+{
+  // linear_window (m) and angular_window (rad) bound the correction on
+  // each axis; levels is the number of grids scored
+  public: AMCLScanMatcher(double linear_window, double angular_window,
+                          int levels);
+
+  // Move pose to the best-scoring pose found near it.  Returns false,
+  // leaving pose alone, if nothing scores better than pose itself.
+  public: bool Refine(AMCLLaserData *data, AMCLLaser *laser,
+                      pf_vector_t *pose);
+
+  private: double linear_window, angular_window;
+  private: int levels;
+
+  // Scratch sample storage for scoring
+  private: std::vector<double> x, y, theta, weight;
+};
+
+}
+
+#endif
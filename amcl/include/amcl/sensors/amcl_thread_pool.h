@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Splits sensor model evaluation over the sample set between the
+//       threads of the navigation executor
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef AMCL_THREAD_POOL_H
+#define AMCL_THREAD_POOL_H
+
+#include <boost/function.hpp>
+#include <nav_executor/executor.h>
+
+namespace amcl
+{
+
+// Splits a run into num_threads tasks, run on the workers of the navigation
+// executor shared by the process, in its localization lane.  The calling
+// thread takes part in every run, so a pool of size 1 uses no other thread.
+class AMCLThreadPool
+{
+  public: AMCLThreadPool(int num_threads);
+
+  // Number of tasks executed by each call to Run()
+  public: int Size() const {return num_threads;}
+
+  // Run task(0) .. task(Size() - 1) concurrently and block until all of
+  // them have returned.  Task 0 runs on the calling thread.
+  public: void Run(const boost::function<void (int)>& task);
+
+  private: int num_threads;
+};
+
+}
+
+#endif
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/mman.h>
 
 #include "map.h"
 
@@ -52,6 +53,14 @@ map_t *map_alloc(void)
   
   // Allocate storage for main map
   map->cells = (map_cell_t*) NULL;
+  map->occ_states = (int8_t*) NULL;
+  map->occ_dist_codes = (uint16_t*) NULL;
+  map->occ_dist_step = 0;
+  map->occ_dist_max_code = 0;
+  map->occ_dist_mapping = NULL;
+  map->occ_dist_mapping_size = 0;
+  map->cspace_key = 0;
+  map->cspace_method = 0;
   
   return map;
 }
@@ -61,11 +70,53 @@ map_t *map_alloc(void)
 void map_free(map_t *map)
 {
   free(map->cells);
+  free(map->occ_states);
+  if (map->occ_dist_mapping)
+    munmap(map->occ_dist_mapping, map->occ_dist_mapping_size);
+  else
+    free(map->occ_dist_codes);
   free(map);
   return;
 }
 
 
+// Get the bytes the map holds
+size_t map_memory_bytes(map_t *map)
+{
+  size_t cells = (size_t)map->size_x * map->size_y;
+  size_t bytes = sizeof(map_t);
+  if (map->cells)
+    bytes += cells * sizeof(map_cell_t);
+  if (map->occ_states)
+    bytes += cells * sizeof(int8_t);
+  if (map->occ_dist_mapping)
+    bytes += map->occ_dist_mapping_size;
+  else if (map->occ_dist_codes)
+    bytes += cells * sizeof(uint16_t);
+  return bytes;
+}
+
+
+// Whether two maps have the same geometry, storage and occupancy
+int map_same_occupancy(map_t *a, map_t *b)
+{
+  int i, n;
+
+  if (a->size_x != b->size_x || a->size_y != b->size_y || a->scale != b->scale ||
+      a->origin_x != b->origin_x || a->origin_y != b->origin_y ||
+      (a->cells == NULL) != (b->cells == NULL))
+    return 0;
+
+  n = a->size_x * a->size_y;
+  if (a->cells == NULL)
+    return memcmp(a->occ_states, b->occ_states, n) == 0;
+  for (i = 0; i < n; i++)
+    if (a->cells[i].occ_state != b->cells[i].occ_state)
+      return 0;
+  return 1;
+}
+
+
 // Get the cell at the given point
 map_cell_t *map_get_cell(map_t *map, double ox, double oy, double oa)
 {
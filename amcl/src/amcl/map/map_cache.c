@@ -0,0 +1,238 @@
+/*
+ *  Player - One Hell of a Robot Server
+ *  Copyright (C) 2000  Brian Gerkey   &  Kasper Stoy
+ *                      gerkey@usc.edu    kaspers@robotics.usc.edu
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**************************************************************************
+ * Desc: On-disk cache of the cspace distances
+**************************************************************************/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "map.h"
+
+#define MAP_CACHE_MAGIC 0x464c4d41  // "AMLF"
+#define MAP_CACHE_VERSION 1
+
+// Layout of the distance plane following the header
+#define MAP_CACHE_LAYOUT_DOUBLE 0
+#define MAP_CACHE_LAYOUT_CODES 1
+
+// File header; the distance plane starts right after it, so the header
+// size is kept a multiple of 8.
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  int32_t size_x, size_y;
+  int32_t layout;
+  int32_t occ_dist_max_code;
+  double max_occ_dist;
+  double occ_dist_step;
+} map_cache_header_t;
+
+
+// FNV-1a over a block of bytes
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char*) data;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+
+// Compute the cache key for the map's occupancy grid
+uint64_t map_cspace_hash(map_t *map, double max_occ_dist, int method)
+{
+  uint64_t h = 14695981039346656037ULL;
+  int32_t version = MAP_CACHE_VERSION;
+  int32_t layout = map->cells ? MAP_CACHE_LAYOUT_DOUBLE : MAP_CACHE_LAYOUT_CODES;
+  int8_t state;
+  int i, n;
+
+  h = hash_bytes(h, &version, sizeof(version));
+  h = hash_bytes(h, &layout, sizeof(layout));
+  h = hash_bytes(h, &method, sizeof(method));
+  h = hash_bytes(h, &map->size_x, sizeof(map->size_x));
+  h = hash_bytes(h, &map->size_y, sizeof(map->size_y));
+  h = hash_bytes(h, &map->scale, sizeof(map->scale));
+  h = hash_bytes(h, &max_occ_dist, sizeof(max_occ_dist));
+
+  n = map->size_x * map->size_y;
+  if (map->cells)
+  {
+    for (i = 0; i < n; i++)
+    {
+      state = (int8_t) map->cells[i].occ_state;
+      h = hash_bytes(h, &state, 1);
+    }
+  }
+  else
+    h = hash_bytes(h, map->occ_states, n);
+
+  return h;
+}
+
+
+// Release the compact distance plane, whether allocated or mapped
+static void release_dist_codes(map_t *map)
+{
+  if (map->occ_dist_mapping)
+    munmap(map->occ_dist_mapping, map->occ_dist_mapping_size);
+  else
+    free(map->occ_dist_codes);
+  map->occ_dist_mapping = NULL;
+  map->occ_dist_mapping_size = 0;
+  map->occ_dist_codes = NULL;
+}
+
+
+// Load the cspace distances from a cache file
+int map_cspace_cache_load(map_t *map, const char *filename, uint64_t key)
+{
+  int fd, i, n;
+  struct stat st;
+  void *base;
+  map_cache_header_t header;
+  size_t expected;
+  const double *dist;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(header))
+  {
+    close(fd);
+    return -1;
+  }
+
+  // Map the whole file privately: the compact plane is used in place, and
+  // a later recompute of the cspace only dirties our own copy of the pages.
+  base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return -1;
+
+  memcpy(&header, base, sizeof(header));
+  n = map->size_x * map->size_y;
+  expected = sizeof(header) + (size_t) n *
+    (header.layout == MAP_CACHE_LAYOUT_DOUBLE ? sizeof(double) : sizeof(uint16_t));
+
+  if (header.magic != MAP_CACHE_MAGIC || header.version != MAP_CACHE_VERSION ||
+      header.key != key || header.size_x != map->size_x ||
+      header.size_y != map->size_y ||
+      header.layout != (map->cells ? MAP_CACHE_LAYOUT_DOUBLE : MAP_CACHE_LAYOUT_CODES) ||
+      (size_t) st.st_size != expected)
+  {
+    munmap(base, st.st_size);
+    return -1;
+  }
+
+  map->max_occ_dist = header.max_occ_dist;
+
+  if (map->cells)
+  {
+    // The cells interleave state and distance, so this layout is copied
+    dist = (const double*) ((const char*) base + sizeof(header));
+    for (i = 0; i < n; i++)
+      map->cells[i].occ_dist = dist[i];
+    munmap(base, st.st_size);
+  }
+  else
+  {
+    release_dist_codes(map);
+    map->occ_dist_mapping = base;
+    map->occ_dist_mapping_size = st.st_size;
+    map->occ_dist_codes = (uint16_t*) ((char*) base + sizeof(header));
+    map->occ_dist_step = header.occ_dist_step;
+    map->occ_dist_max_code = header.occ_dist_max_code;
+  }
+
+  return 0;
+}
+
+
+// Save the cspace distances to a cache file
+int map_cspace_cache_save(map_t *map, const char *filename, uint64_t key)
+{
+  FILE *file;
+  char *tmpname;
+  map_cache_header_t header;
+  int i, n, ok;
+  double dist;
+
+  memset(&header, 0, sizeof(header));
+  header.magic = MAP_CACHE_MAGIC;
+  header.version = MAP_CACHE_VERSION;
+  header.key = key;
+  header.size_x = map->size_x;
+  header.size_y = map->size_y;
+  header.layout = map->cells ? MAP_CACHE_LAYOUT_DOUBLE : MAP_CACHE_LAYOUT_CODES;
+  header.occ_dist_max_code = map->occ_dist_max_code;
+  header.max_occ_dist = map->max_occ_dist;
+  header.occ_dist_step = map->occ_dist_step;
+
+  // Write to a temporary name and rename it into place, so that a reader
+  // (possibly another process sharing the cache) never sees a partial file
+  tmpname = (char*) malloc(strlen(filename) + 32);
+  sprintf(tmpname, "%s.%d.tmp", filename, (int) getpid());
+
+  file = fopen(tmpname, "wb");
+  if (file == NULL)
+  {
+    free(tmpname);
+    return -1;
+  }
+
+  n = map->size_x * map->size_y;
+  ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+  if (map->cells)
+  {
+    for (i = 0; ok && i < n; i++)
+    {
+      dist = map->cells[i].occ_dist;
+      ok = (fwrite(&dist, sizeof(dist), 1, file) == 1);
+    }
+  }
+  else if (ok)
+    ok = (fwrite(map->occ_dist_codes, sizeof(uint16_t), n, file) == (size_t) n);
+
+  if (fclose(file) != 0)
+    ok = 0;
+  if (ok)
+    ok = (rename(tmpname, filename) == 0);
+  if (!ok)
+    unlink(tmpname);
+
+  free(tmpname);
+  return ok ? 0 : -1;
+}
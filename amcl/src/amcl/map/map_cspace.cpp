@@ -19,16 +19,24 @@
  *
  */
 
+#include <algorithm>
 #include <queue>
+#include <vector>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <nav_executor/executor.h>
+
 #include "map.h"
 
 class CellData
 {
   public:
     map_t* map_;
+    const double* dist_;
     unsigned int i_, j_;
     unsigned int src_i_, src_j_;
 };
@@ -66,9 +74,18 @@ class CachedDistanceMap
 };
 
 
+// Cells at the same distance leave the queue in the order of their place in
+// the map, so that the brushfire over a window of the map (see
+// map_update_cspace_region) grows the same way as over the whole map
 bool operator<(const CellData& a, const CellData& b)
 {
-  return a.map_->cells[MAP_INDEX(a.map_, a.i_, a.j_)].occ_dist > a.map_->cells[MAP_INDEX(b.map_, b.i_, b.j_)].occ_dist;
+  double da = a.dist_[MAP_INDEX(a.map_, a.i_, a.j_)];
+  double db = b.dist_[MAP_INDEX(b.map_, b.i_, b.j_)];
+  if(da != db)
+    return da > db;
+  if(a.j_ != b.j_)
+    return a.j_ > b.j_;
+  return a.i_ > b.i_;
 }
 
 CachedDistanceMap*
@@ -86,7 +103,7 @@ get_distance_map(double scale, double max_dist)
   return cdm;
 }
 
-void enqueue(map_t* map, unsigned int i, unsigned int j, 
+void enqueue(map_t* map, double* dist, unsigned int i, unsigned int j, 
 	     unsigned int src_i, unsigned int src_j,
 	     std::priority_queue<CellData>& Q,
 	     CachedDistanceMap* cdm,
@@ -102,10 +119,11 @@ void enqueue(map_t* map, unsigned int i, unsigned int j,
   if(distance > cdm->cell_radius_)
     return;
 
-  map->cells[MAP_INDEX(map, i, j)].occ_dist = distance * map->scale;
+  dist[MAP_INDEX(map, i, j)] = distance * map->scale;
 
   CellData cell;
   cell.map_ = map;
+  cell.dist_ = dist;
   cell.i_ = i;
   cell.j_ = j;
   cell.src_i_ = src_i;
@@ -116,8 +134,48 @@ void enqueue(map_t* map, unsigned int i, unsigned int j,
   marked[MAP_INDEX(map, i, j)] = 1;
 }
 
-// Update the cspace distance values
-void map_update_cspace(map_t *map, double max_occ_dist)
+// Store one distance in the map's own layout, quantized with the map's
+// current step if it is compact
+static inline void store_distance(map_t *map, int index, double d)
+{
+  if(map->cells)
+  {
+    map->cells[index].occ_dist = d;
+    return;
+  }
+
+  double code = map->occ_dist_step > 0 ? floor(d / map->occ_dist_step + 0.5) : 0;
+  if(code > map->occ_dist_max_code)
+    code = map->occ_dist_max_code;
+  map->occ_dist_codes[index] = (uint16_t)code;
+}
+
+// Copy the computed distances into the map's own storage, quantizing them
+// for a compact map
+static void store_distances(map_t *map, const double* dist)
+{
+  int n = map->size_x * map->size_y;
+  if(!map->cells)
+  {
+    double max_code = ceil(map->max_occ_dist / map->scale * MAP_DIST_CODES_PER_CELL);
+    if(max_code > UINT16_MAX)
+      max_code = UINT16_MAX;
+    if(max_code < 1)
+      max_code = 1;
+    map->occ_dist_max_code = (int)max_code;
+    map->occ_dist_step = map->max_occ_dist / max_code;
+
+    if(!map->occ_dist_codes)
+      map->occ_dist_codes = (uint16_t*)malloc(n * sizeof(uint16_t));
+  }
+
+  for(int i=0; i<n; i++)
+    store_distance(map, i, dist[i]);
+}
+
+// Fill dist with the distances of the brushfire out of the obstacles of
+// map, cut off at map->max_occ_dist
+static void brushfire(map_t *map, double* dist)
 {
   unsigned char* marked;
   std::priority_queue<CellData> Q;
@@ -125,27 +183,26 @@ void map_update_cspace(map_t *map, double max_occ_dist)
   marked = new unsigned char[map->size_x*map->size_y];
   memset(marked, 0, sizeof(unsigned char) * map->size_x*map->size_y);
 
-  map->max_occ_dist = max_occ_dist;
-
   CachedDistanceMap* cdm = get_distance_map(map->scale, map->max_occ_dist);
 
   // Enqueue all the obstacle cells
   CellData cell;
   cell.map_ = map;
+  cell.dist_ = dist;
   for(int i=0; i<map->size_x; i++)
   {
     cell.src_i_ = cell.i_ = i;
     for(int j=0; j<map->size_y; j++)
     {
-      if(map->cells[MAP_INDEX(map, i, j)].occ_state == +1)
+      if(MAP_OCC_STATE(map, MAP_INDEX(map, i, j)) == +1)
       {
-	map->cells[MAP_INDEX(map, i, j)].occ_dist = 0.0;
+	dist[MAP_INDEX(map, i, j)] = 0.0;
 	cell.src_j_ = cell.j_ = j;
 	marked[MAP_INDEX(map, i, j)] = 1;
 	Q.push(cell);
       }
       else
-	map->cells[MAP_INDEX(map, i, j)].occ_dist = max_occ_dist;
+	dist[MAP_INDEX(map, i, j)] = map->max_occ_dist;
     }
   }
 
@@ -153,19 +210,19 @@ void map_update_cspace(map_t *map, double max_occ_dist)
   {
     CellData current_cell = Q.top();
     if(current_cell.i_ > 0)
-      enqueue(map, current_cell.i_-1, current_cell.j_, 
+      enqueue(map, dist, current_cell.i_-1, current_cell.j_, 
 	      current_cell.src_i_, current_cell.src_j_,
 	      Q, cdm, marked);
     if(current_cell.j_ > 0)
-      enqueue(map, current_cell.i_, current_cell.j_-1, 
+      enqueue(map, dist, current_cell.i_, current_cell.j_-1, 
 	      current_cell.src_i_, current_cell.src_j_,
 	      Q, cdm, marked);
     if((int)current_cell.i_ < map->size_x - 1)
-      enqueue(map, current_cell.i_+1, current_cell.j_, 
+      enqueue(map, dist, current_cell.i_+1, current_cell.j_, 
 	      current_cell.src_i_, current_cell.src_j_,
 	      Q, cdm, marked);
     if((int)current_cell.j_ < map->size_y - 1)
-      enqueue(map, current_cell.i_, current_cell.j_+1, 
+      enqueue(map, dist, current_cell.i_, current_cell.j_+1, 
 	      current_cell.src_i_, current_cell.src_j_,
 	      Q, cdm, marked);
 
@@ -175,6 +232,215 @@ void map_update_cspace(map_t *map, double max_occ_dist)
   delete[] marked;
 }
 
+// Update the cspace distance values
+void map_update_cspace(map_t *map, double max_occ_dist)
+{
+  // Distances are computed in a contiguous scratch plane and then stored
+  // in whichever layout the map uses
+  double* dist = new double[map->size_x*map->size_y];
+
+  map->max_occ_dist = max_occ_dist;
+  map->cspace_method = 0;
+  brushfire(map, dist);
+  store_distances(map, dist);
+
+  delete[] dist;
+}
+
+// Squared distance used for cells with no obstacle in their row/column
+static const double EDT_INF = 1e20;
+
+// One-dimensional squared distance transform of f (Felzenszwalb &
+// Huttenlocher, "Distance Transforms of Sampled Functions").  Samples of f
+// that are EDT_INF contribute no parabola, which keeps the result exact
+// for rows with no obstacle at all.  v and z are scratch of size n and
+// n + 1.
+static void edt_1d(const double* f, int n, double* d, int* v, double* z)
+{
+  int k = -1;
+  for(int q = 0; q < n; q++)
+  {
+    if(f[q] >= EDT_INF)
+      continue;
+    double s = -EDT_INF;
+    while(k >= 0)
+    {
+      s = ((f[q] + (double)q*q) - (f[v[k]] + (double)v[k]*v[k])) / (2.0*q - 2.0*v[k]);
+      if(s > z[k])
+        break;
+      k--;
+    }
+    if(k < 0)
+      s = -EDT_INF;
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = EDT_INF;
+  }
+
+  if(k < 0)
+  {
+    for(int q = 0; q < n; q++)
+      d[q] = EDT_INF;
+    return;
+  }
+
+  int j = 0;
+  for(int q = 0; q < n; q++)
+  {
+    while(z[j+1] < q)
+      j++;
+    d[q] = (double)(q - v[j])*(q - v[j]) + f[v[j]];
+  }
+}
+
+// Transform columns [begin, end) of the squared distance plane in place
+static void edt_columns(map_t* map, double* dist, int begin, int end)
+{
+  int n = map->size_y;
+  std::vector<double> f(n), d(n), z(n + 1);
+  std::vector<int> v(n);
+  for(int i = begin; i < end; i++)
+  {
+    for(int j = 0; j < n; j++)
+      f[j] = dist[MAP_INDEX(map, i, j)];
+    edt_1d(&f[0], n, &d[0], &v[0], &z[0]);
+    for(int j = 0; j < n; j++)
+      dist[MAP_INDEX(map, i, j)] = d[j];
+  }
+}
+
+// Transform rows [begin, end) of the squared distance plane in place and
+// convert them to metric distances, cut off like the brushfire version
+static void edt_rows(map_t* map, double* dist, int begin, int end,
+                     int cell_radius)
+{
+  int n = map->size_x;
+  std::vector<double> d(n), z(n + 1);
+  std::vector<int> v(n);
+  for(int j = begin; j < end; j++)
+  {
+    double* row = dist + MAP_INDEX(map, 0, j);
+    edt_1d(row, n, &d[0], &v[0], &z[0]);
+    for(int i = 0; i < n; i++)
+    {
+      double cells = sqrt(d[i]);
+      row[i] = (cells > cell_radius) ? map->max_occ_dist : cells * map->scale;
+    }
+  }
+}
+
+// Run fn over range t of [0, count) split into num_threads contiguous ranges
+static void edt_range(int count, int num_threads,
+                      const boost::function<void (int, int)>& fn, unsigned int t)
+{
+  int begin = (int)(((long)count * t) / num_threads);
+  int end = (int)(((long)count * (t + 1)) / num_threads);
+  fn(begin, end);
+}
+
+// Run fn over [0, count) split into num_threads contiguous ranges, on the
+// threads of the navigation executor
+static void edt_parallel(int count, int num_threads,
+                         const boost::function<void (int, int)>& fn)
+{
+  if(num_threads > count)
+    num_threads = count;
+  if(num_threads <= 1)
+  {
+    fn(0, count);
+    return;
+  }
+
+  nav_executor::Executor::shared().run(nav_executor::LANE_LOCALIZATION, num_threads,
+                                       boost::bind(&edt_range, count, num_threads, boost::cref(fn), _1));
+}
+
+// Update the cspace distance values with an exact separable Euclidean
+// distance transform; linear in the number of cells
+void map_update_cspace_edt(map_t *map, double max_occ_dist, int num_threads)
+{
+  int n = map->size_x * map->size_y;
+  double* dist = new double[n];
+
+  map->max_occ_dist = max_occ_dist;
+  map->cspace_method = 1;
+  int cell_radius = max_occ_dist / map->scale;
+
+  for(int i = 0; i < n; i++)
+    dist[i] = (MAP_OCC_STATE(map, i) == +1) ? 0.0 : EDT_INF;
+
+  edt_parallel(map->size_x, num_threads,
+               boost::bind(&edt_columns, map, dist, _1, _2));
+  edt_parallel(map->size_y, num_threads,
+               boost::bind(&edt_rows, map, dist, _1, _2, cell_radius));
+
+  store_distances(map, dist);
+
+  delete[] dist;
+}
+
+// Recompute the cspace distances of the cells that a change to the
+// occupancy of [x0, x0 + width) x [y0, y0 + height) can affect.  Only
+// cells within max_occ_dist of the patch can change, and their nearest
+// obstacles lie within max_occ_dist of them, so the exact transform is run
+// on a window around the patch rather than on the whole map.
+void map_update_cspace_region(map_t *map, int x0, int y0, int width, int height)
+{
+  int r = (int)ceil(map->max_occ_dist / map->scale);
+  int cell_radius = map->max_occ_dist / map->scale;
+
+  int x1 = x0 + width;
+  int y1 = y0 + height;
+  if(x0 < 0)
+    x0 = 0;
+  if(y0 < 0)
+    y0 = 0;
+  if(x1 > map->size_x)
+    x1 = map->size_x;
+  if(y1 > map->size_y)
+    y1 = map->size_y;
+  if(x0 >= x1 || y0 >= y1)
+    return;
+
+  // The window the transform runs on, with the geometry and occupancy of a
+  // map of its own
+  map_t window;
+  memset(&window, 0, sizeof(window));
+  int wx0 = std::max(x0 - 2 * r, 0);
+  int wy0 = std::max(y0 - 2 * r, 0);
+  window.size_x = std::min(x1 + 2 * r, map->size_x) - wx0;
+  window.size_y = std::min(y1 + 2 * r, map->size_y) - wy0;
+  window.scale = map->scale;
+  window.max_occ_dist = map->max_occ_dist;
+
+  std::vector<int8_t> occ_states(window.size_x * window.size_y);
+  for(int j = 0; j < window.size_y; j++)
+    for(int i = 0; i < window.size_x; i++)
+      occ_states[i + j * window.size_x] = MAP_OCC_STATE(map, MAP_INDEX(map, wx0 + i, wy0 + j));
+  window.occ_states = &occ_states[0];
+
+  // The same transform the field was built with, so that the repair matches
+  // a rebuild
+  std::vector<double> dist(window.size_x * window.size_y);
+  if(map->cspace_method == 1)
+  {
+    for(size_t i = 0; i < dist.size(); i++)
+      dist[i] = (occ_states[i] == +1) ? 0.0 : EDT_INF;
+    edt_columns(&window, &dist[0], 0, window.size_x);
+    edt_rows(&window, &dist[0], 0, window.size_y, cell_radius);
+  }
+  else
+    brushfire(&window, &dist[0]);
+
+  int sx1 = std::min(x1 + r, map->size_x);
+  int sy1 = std::min(y1 + r, map->size_y);
+  for(int j = std::max(y0 - r, 0); j < sy1; j++)
+    for(int i = std::max(x0 - r, 0); i < sx1; i++)
+      store_distance(map, MAP_INDEX(map, i, j),
+                     dist[(i - wx0) + (j - wy0) * window.size_x]);
+}
+
 #if 0
 // TODO: replace this with a more efficient implementation.  Not crucial,
 // because we only do it once, at startup.
@@ -86,12 +86,12 @@ double map_calc_range(map_t *map, double ox, double oy, double oa, double max_ra
 
   if(steep)
   {
-    if(!MAP_VALID(map,y,x) || map->cells[MAP_INDEX(map,y,x)].occ_state > -1)
+    if(!MAP_VALID(map,y,x) || MAP_OCC_STATE(map, MAP_INDEX(map,y,x)) > -1)
       return sqrt((x-x0)*(x-x0) + (y-y0)*(y-y0)) * map->scale;
   }
   else
   {
-    if(!MAP_VALID(map,x,y) || map->cells[MAP_INDEX(map,x,y)].occ_state > -1)
+    if(!MAP_VALID(map,x,y) || MAP_OCC_STATE(map, MAP_INDEX(map,x,y)) > -1)
       return sqrt((x-x0)*(x-x0) + (y-y0)*(y-y0)) * map->scale;
   }
 
@@ -107,12 +107,12 @@ double map_calc_range(map_t *map, double ox, double oy, double oa, double max_ra
 
     if(steep)
     {
-      if(!MAP_VALID(map,y,x) || map->cells[MAP_INDEX(map,y,x)].occ_state > -1)
+      if(!MAP_VALID(map,y,x) || MAP_OCC_STATE(map, MAP_INDEX(map,y,x)) > -1)
         return sqrt((x-x0)*(x-x0) + (y-y0)*(y-y0)) * map->scale;
     }
     else
     {
-      if(!MAP_VALID(map,x,y) || map->cells[MAP_INDEX(map,x,y)].occ_state > -1)
+      if(!MAP_VALID(map,x,y) || MAP_OCC_STATE(map, MAP_INDEX(map,x,y)) > -1)
         return sqrt((x-x0)*(x-x0) + (y-y0)*(y-y0)) * map->scale;
     }
   }
@@ -28,6 +28,7 @@
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "pf.h"
@@ -42,6 +43,24 @@ static int pf_resample_limit(pf_t *pf, int k);
 // Re-compute the cluster statistics for a sample set
 static void pf_cluster_stats(pf_t *pf, pf_sample_set_t *set);
 
+// Allocate a zeroed array of n doubles aligned to PF_SAMPLE_ALIGN
+static double *pf_alloc_aligned(int n);
+
+// Draw set b from set a with the low-variance sampler; returns the total
+// weight of set b
+static double pf_resample_systematic(pf_t *pf, pf_sample_set_t *set_a,
+                                     pf_sample_set_t *set_b, const double *c,
+                                     double w_diff);
+
+// Draw set b from set a one sample at a time off the cumulative weights c;
+// returns the total weight of set b
+static double pf_resample_multinomial(pf_t *pf, pf_sample_set_t *set_a,
+                                      pf_sample_set_t *set_b, const double *c,
+                                      double w_diff);
+
+// Seed given to the random number generator; zero seeds from the clock
+static long pf_seed = 0;
+
 
 // Create a new filter
 pf_t *pf_alloc(int min_samples, int max_samples,
@@ -51,9 +70,8 @@ pf_t *pf_alloc(int min_samples, int max_samples,
   int i, j;
   pf_t *pf;
   pf_sample_set_t *set;
-  pf_sample_t *sample;
   
-  srand48(time(NULL));
+  srand48(pf_seed ? pf_seed : time(NULL));
 
   pf = calloc(1, sizeof(pf_t));
 
@@ -71,6 +89,7 @@ pf_t *pf_alloc(int min_samples, int max_samples,
   pf->pop_err = 0.01;
   pf->pop_z = 3;
   pf->dist_threshold = 0.5; 
+  pf->resample_model = PF_RESAMPLE_MULTINOMIAL;
   
   pf->current_set = 0;
   for (j = 0; j < 2; j++)
@@ -78,16 +97,13 @@ pf_t *pf_alloc(int min_samples, int max_samples,
     set = pf->sets + j;
       
     set->sample_count = max_samples;
-    set->samples = calloc(max_samples, sizeof(pf_sample_t));
+    set->x = pf_alloc_aligned(max_samples);
+    set->y = pf_alloc_aligned(max_samples);
+    set->theta = pf_alloc_aligned(max_samples);
+    set->weight = pf_alloc_aligned(max_samples);
 
     for (i = 0; i < set->sample_count; i++)
-    {
-      sample = set->samples + i;
-      sample->pose.v[0] = 0.0;
-      sample->pose.v[1] = 0.0;
-      sample->pose.v[2] = 0.0;
-      sample->weight = 1.0 / max_samples;
-    }
+      set->weight[i] = 1.0 / max_samples;
 
     // HACK: is 3 times max_samples enough?
     set->kdtree = pf_kdtree_alloc(3 * max_samples);
@@ -112,6 +128,25 @@ pf_t *pf_alloc(int min_samples, int max_samples,
   return pf;
 }
 
+// Allocate a zeroed array of n doubles aligned to PF_SAMPLE_ALIGN
+double *pf_alloc_aligned(int n)
+{
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, PF_SAMPLE_ALIGN, n * sizeof(double)) != 0)
+    return NULL;
+  memset(ptr, 0, n * sizeof(double));
+  return (double*) ptr;
+}
+
+// Set the random number generator seed for future filters
+void pf_set_seed(long seed)
+{
+  pf_seed = seed;
+  srand48(seed ? seed : time(NULL));
+  return;
+}
+
+
 // Free an existing filter
 void pf_free(pf_t *pf)
 {
@@ -121,7 +156,10 @@ void pf_free(pf_t *pf)
   {
     free(pf->sets[i].clusters);
     pf_kdtree_free(pf->sets[i].kdtree);
-    free(pf->sets[i].samples);
+    free(pf->sets[i].x);
+    free(pf->sets[i].y);
+    free(pf->sets[i].theta);
+    free(pf->sets[i].weight);
   }
   free(pf);
   
@@ -133,7 +171,7 @@ void pf_init(pf_t *pf, pf_vector_t mean, pf_matrix_t cov)
 {
   int i;
   pf_sample_set_t *set;
-  pf_sample_t *sample;
+  pf_vector_t pose;
   pf_pdf_gaussian_t *pdf;
   
   set = pf->sets + pf->current_set;
@@ -148,12 +186,12 @@ void pf_init(pf_t *pf, pf_vector_t mean, pf_matrix_t cov)
   // Compute the new sample poses
   for (i = 0; i < set->sample_count; i++)
   {
-    sample = set->samples + i;
-    sample->weight = 1.0 / pf->max_samples;
-    sample->pose = pf_pdf_gaussian_sample(pdf);
+    pose = pf_pdf_gaussian_sample(pdf);
+    pf_sample_set_pose(set, i, pose);
+    set->weight[i] = 1.0 / pf->max_samples;
 
     // Add sample to histogram
-    pf_kdtree_insert(set->kdtree, sample->pose, sample->weight);
+    pf_kdtree_insert(set->kdtree, pose, set->weight[i]);
   }
 
   pf->w_slow = pf->w_fast = 0.0;
@@ -175,7 +213,7 @@ void pf_init_model(pf_t *pf, pf_init_model_fn_t init_fn, void *init_data)
 {
   int i;
   pf_sample_set_t *set;
-  pf_sample_t *sample;
+  pf_vector_t pose;
 
   set = pf->sets + pf->current_set;
 
@@ -187,12 +225,12 @@ void pf_init_model(pf_t *pf, pf_init_model_fn_t init_fn, void *init_data)
   // Compute the new sample poses
   for (i = 0; i < set->sample_count; i++)
   {
-    sample = set->samples + i;
-    sample->weight = 1.0 / pf->max_samples;
-    sample->pose = (*init_fn) (init_data);
+    pose = (*init_fn) (init_data);
+    pf_sample_set_pose(set, i, pose);
+    set->weight[i] = 1.0 / pf->max_samples;
 
     // Add sample to histogram
-    pf_kdtree_insert(set->kdtree, sample->pose, sample->weight);
+    pf_kdtree_insert(set->kdtree, pose, set->weight[i]);
   }
 
   pf->w_slow = pf->w_fast = 0.0;
@@ -217,25 +255,20 @@ int pf_update_converged(pf_t *pf)
 {
   int i;
   pf_sample_set_t *set;
-  pf_sample_t *sample;
-  double total;
 
   set = pf->sets + pf->current_set;
   double mean_x = 0, mean_y = 0;
 
   for (i = 0; i < set->sample_count; i++){
-    sample = set->samples + i;
-
-    mean_x += sample->pose.v[0];
-    mean_y += sample->pose.v[1];
+    mean_x += set->x[i];
+    mean_y += set->y[i];
   }
   mean_x /= set->sample_count;
   mean_y /= set->sample_count;
   
   for (i = 0; i < set->sample_count; i++){
-    sample = set->samples + i;
-    if(fabs(sample->pose.v[0] - mean_x) > pf->dist_threshold || 
-       fabs(sample->pose.v[1] - mean_y) > pf->dist_threshold){
+    if(fabs(set->x[i] - mean_x) > pf->dist_threshold || 
+       fabs(set->y[i] - mean_y) > pf->dist_threshold){
       set->converged = 0; 
       pf->converged = 0; 
       return 0;
@@ -265,10 +298,11 @@ void pf_update_sensor(pf_t *pf, pf_sensor_model_fn_t sensor_fn, void *sensor_dat
 {
   int i;
   pf_sample_set_t *set;
-  pf_sample_t *sample;
+  double *weight;
   double total;
 
   set = pf->sets + pf->current_set;
+  weight = set->weight;
 
   // Compute the sample weights
   total = (*sensor_fn) (sensor_data, set);
@@ -279,9 +313,8 @@ void pf_update_sensor(pf_t *pf, pf_sensor_model_fn_t sensor_fn, void *sensor_dat
     double w_avg=0.0;
     for (i = 0; i < set->sample_count; i++)
     {
-      sample = set->samples + i;
-      w_avg += sample->weight;
-      sample->weight /= total;
+      w_avg += weight[i];
+      weight[i] /= total;
     }
     // Update running averages of likelihood of samples (Prob Rob p258)
     w_avg /= set->sample_count;
@@ -301,8 +334,7 @@ void pf_update_sensor(pf_t *pf, pf_sensor_model_fn_t sensor_fn, void *sensor_dat
     // Handle zero total
     for (i = 0; i < set->sample_count; i++)
     {
-      sample = set->samples + i;
-      sample->weight = 1.0 / set->sample_count;
+      weight[i] = 1.0 / set->sample_count;
     }
   }
 
@@ -310,17 +342,40 @@ void pf_update_sensor(pf_t *pf, pf_sensor_model_fn_t sensor_fn, void *sensor_dat
 }
 
 
+// Effective sample size of a set with normalized weights
+static double pf_n_eff(pf_sample_set_t *set)
+{
+  int i;
+  double sum_sq = 0.0;
+
+  for (i = 0; i < set->sample_count; i++)
+    sum_sq += set->weight[i] * set->weight[i];
+  return sum_sq > 0.0 ? 1.0 / sum_sq : 0.0;
+}
+
+
+// Keep the weighted set, rebuilding the histogram of its moved samples for
+// the cluster statistics
+static void pf_update_weighted(pf_t *pf, pf_sample_set_t *set)
+{
+  int i;
+
+  pf_kdtree_clear(set->kdtree);
+  for (i = 0; i < set->sample_count; i++)
+    pf_kdtree_insert(set->kdtree, pf_sample_get_pose(set, i), set->weight[i]);
+
+  pf_cluster_stats(pf, set);
+  pf_update_converged(pf);
+}
+
+
 // Resample the distribution
-void pf_update_resample(pf_t *pf)
+int pf_update_resample(pf_t *pf)
 {
   int i;
   double total;
   pf_sample_set_t *set_a, *set_b;
-  pf_sample_t *sample_a, *sample_b;
 
-  //double r,c,U;
-  //int m;
-  //double count_inv;
   double* c;
 
   double w_diff;
@@ -328,13 +383,27 @@ void pf_update_resample(pf_t *pf)
   set_a = pf->sets + pf->current_set;
   set_b = pf->sets + (pf->current_set + 1) % 2;
 
+  // Undefined before the first sensor update, which also means no recovery
+  w_diff = 1.0 - pf->w_fast / pf->w_slow;
+  if(!(w_diff > 0.0))
+    w_diff = 0.0;
+
+  // The weights carry over to the next sensor update, which multiplies
+  // into them; recovery still needs the random poses a resample draws
+  if(pf->resample_n_eff_ratio > 0.0 && w_diff == 0.0 &&
+     pf_n_eff(set_a) >= pf->resample_n_eff_ratio * set_a->sample_count)
+  {
+    pf_update_weighted(pf, set_a);
+    return 0;
+  }
+
   // Build up cumulative probability table for resampling.
   // TODO: Replace this with a more efficient procedure
   // (e.g., http://www.network-theory.co.uk/docs/gslref/GeneralDiscreteDistributions.html)
   c = (double*)malloc(sizeof(double)*(set_a->sample_count+1));
   c[0] = 0.0;
   for(i=0;i<set_a->sample_count;i++)
-    c[i+1] = c[i]+set_a->samples[i].weight;
+    c[i+1] = c[i]+set_a->weight[i];
 
   // Create the kd tree for adaptive sampling
   pf_kdtree_clear(set_b->kdtree);
@@ -343,27 +412,63 @@ void pf_update_resample(pf_t *pf)
   total = 0;
   set_b->sample_count = 0;
 
-  w_diff = 1.0 - pf->w_fast / pf->w_slow;
-  if(w_diff < 0.0)
-    w_diff = 0.0;
   //printf("w_diff: %9.6f\n", w_diff);
 
+  if(pf->resample_model == PF_RESAMPLE_SYSTEMATIC)
+    total = pf_resample_systematic(pf, set_a, set_b, c, w_diff);
+  else
+    total = pf_resample_multinomial(pf, set_a, set_b, c, w_diff);
+  
+  // Reset averages, to avoid spiraling off into complete randomness.
+  if(w_diff > 0.0)
+    pf->w_slow = pf->w_fast = 0.0;
+
+  //fprintf(stderr, "\n\n");
+
+  // Normalize weights
+  for (i = 0; i < set_b->sample_count; i++)
+    set_b->weight[i] /= total;
+  
+  // Re-compute cluster statistics
+  pf_cluster_stats(pf, set_b);
+
+  // Use the newly created sample set
+  pf->current_set = (pf->current_set + 1) % 2; 
+
+  pf_update_converged(pf);
+
+  free(c);
+  return 1;
+}
+
+
+// Draw set b from set a until the KLD limit is met
+static double pf_resample_multinomial(pf_t *pf, pf_sample_set_t *set_a,
+                                      pf_sample_set_t *set_b, const double *c,
+                                      double w_diff)
+{
+  int i;
+  double total = 0;
+  pf_vector_t pose;
+
+  //double r,c,U;
+  //int m;
+  //double count_inv;
+
   // Can't (easily) combine low-variance sampler with KLD adaptive
   // sampling, so we'll take the more traditional route.
   /*
   // Low-variance resampler, taken from Probabilistic Robotics, p110
   count_inv = 1.0/set_a->sample_count;
   r = drand48() * count_inv;
-  c = set_a->samples[0].weight;
+  c = set_a->weight[0];
   i = 0;
   m = 0;
   */
   while(set_b->sample_count < pf->max_samples)
   {
-    sample_b = set_b->samples + set_b->sample_count++;
-
     if(drand48() < w_diff)
-      sample_b->pose = (pf->random_pose_fn)(pf->random_pose_data);
+      pose = (pf->random_pose_fn)(pf->random_pose_data);
     else
     {
       // Can't (easily) combine low-variance sampler with KLD adaptive
@@ -379,13 +484,13 @@ void pf_update_resample(pf_t *pf)
         if(i >= set_a->sample_count)
         {
           r = drand48() * count_inv;
-          c = set_a->samples[0].weight;
+          c = set_a->weight[0];
           i = 0;
           m = 0;
           U = r + m * count_inv;
           continue;
         }
-        c += set_a->samples[i].weight;
+        c += set_a->weight[i];
       }
       m++;
       */
@@ -400,48 +505,91 @@ void pf_update_resample(pf_t *pf)
       }
       assert(i<set_a->sample_count);
 
-      sample_a = set_a->samples + i;
-
-      assert(sample_a->weight > 0);
+      assert(set_a->weight[i] > 0);
 
       // Add sample to list
-      sample_b->pose = sample_a->pose;
+      pose = pf_sample_get_pose(set_a, i);
     }
 
-    sample_b->weight = 1.0;
-    total += sample_b->weight;
+    pf_sample_set_pose(set_b, set_b->sample_count, pose);
+    set_b->weight[set_b->sample_count] = 1.0;
+    total += set_b->weight[set_b->sample_count];
+    set_b->sample_count++;
 
     // Add sample to histogram
-    pf_kdtree_insert(set_b->kdtree, sample_b->pose, sample_b->weight);
+    pf_kdtree_insert(set_b->kdtree, pose, 1.0);
 
     // See if we have enough samples yet
     if (set_b->sample_count > pf_resample_limit(pf, set_b->kdtree->leaf_count))
       break;
   }
-  
-  // Reset averages, to avoid spiraling off into complete randomness.
-  if(w_diff > 0.0)
-    pf->w_slow = pf->w_fast = 0.0;
 
-  //fprintf(stderr, "\n\n");
+  return total;
+}
 
-  // Normalize weights
-  for (i = 0; i < set_b->sample_count; i++)
+
+// Low-variance resampler (Probabilistic Robotics, p110).  The KLD limit is
+// only known once the new histogram is filled in, so the samples are drawn
+// in batches: each batch is one systematic pass over the whole of set a,
+// sized to what the limit computed after the previous batch still needs.
+static double pf_resample_systematic(pf_t *pf, pf_sample_set_t *set_a,
+                                     pf_sample_set_t *set_b, const double *c,
+                                     double w_diff)
+{
+  int i, k, n, limit, random_count;
+  double u, step, total;
+  pf_vector_t pose;
+
+  total = 0;
+  n = pf->min_samples;
+  while(set_b->sample_count < pf->max_samples)
   {
-    sample_b = set_b->samples + i;
-    sample_b->weight /= total;
-  }
-  
-  // Re-compute cluster statistics
-  pf_cluster_stats(pf, set_b);
+    if(n > pf->max_samples - set_b->sample_count)
+      n = pf->max_samples - set_b->sample_count;
+    if(n < 1)
+      n = 1;
+
+    // Share of the batch replaced by random poses, as in the
+    // multinomial sampler
+    random_count = 0;
+    for(k = 0; k < n; k++)
+      if(drand48() < w_diff)
+        random_count++;
+
+    step = 0.0;
+    if(random_count < n)
+      step = c[set_a->sample_count] / (n - random_count);
+    u = drand48() * step;
+    i = 0;
+    for(k = 0; k < n; k++)
+    {
+      if(k < random_count)
+        pose = (pf->random_pose_fn)(pf->random_pose_data);
+      else
+      {
+        double U = u + (k - random_count) * step;
+        while(i < set_a->sample_count - 1 && c[i+1] <= U)
+          i++;
+        pose = pf_sample_get_pose(set_a, i);
+      }
 
-  // Use the newly created sample set
-  pf->current_set = (pf->current_set + 1) % 2; 
+      pf_sample_set_pose(set_b, set_b->sample_count, pose);
+      set_b->weight[set_b->sample_count] = 1.0;
+      total += 1.0;
+      set_b->sample_count++;
 
-  pf_update_converged(pf);
+      // Add sample to histogram
+      pf_kdtree_insert(set_b->kdtree, pose, 1.0);
+    }
 
-  free(c);
-  return;
+    // See if we have enough samples yet
+    limit = pf_resample_limit(pf, set_b->kdtree->leaf_count);
+    if(set_b->sample_count > limit)
+      break;
+    n = limit + 1 - set_b->sample_count;
+  }
+
+  return total;
 }
 
 
@@ -475,7 +623,8 @@ int pf_resample_limit(pf_t *pf, int k)
 void pf_cluster_stats(pf_t *pf, pf_sample_set_t *set)
 {
   int i, j, k, cidx;
-  pf_sample_t *sample;
+  pf_vector_t pose;
+  double w;
   pf_cluster_t *cluster;
   
   // Workspace
@@ -518,12 +667,13 @@ void pf_cluster_stats(pf_t *pf, pf_sample_set_t *set)
   // Compute cluster stats
   for (i = 0; i < set->sample_count; i++)
   {
-    sample = set->samples + i;
+    pose = pf_sample_get_pose(set, i);
+    w = set->weight[i];
 
-    //printf("%d %f %f %f\n", i, sample->pose.v[0], sample->pose.v[1], sample->pose.v[2]);
+    //printf("%d %f %f %f\n", i, pose.v[0], pose.v[1], pose.v[2]);
 
     // Get the cluster label for this sample
-    cidx = pf_kdtree_get_cluster(set->kdtree, sample->pose);
+    cidx = pf_kdtree_get_cluster(set->kdtree, pose);
     assert(cidx >= 0);
     if (cidx >= set->cluster_max_count)
       continue;
@@ -533,28 +683,28 @@ void pf_cluster_stats(pf_t *pf, pf_sample_set_t *set)
     cluster = set->clusters + cidx;
 
     cluster->count += 1;
-    cluster->weight += sample->weight;
+    cluster->weight += w;
 
     count += 1;
-    weight += sample->weight;
+    weight += w;
 
     // Compute mean
-    cluster->m[0] += sample->weight * sample->pose.v[0];
-    cluster->m[1] += sample->weight * sample->pose.v[1];
-    cluster->m[2] += sample->weight * cos(sample->pose.v[2]);
-    cluster->m[3] += sample->weight * sin(sample->pose.v[2]);
+    cluster->m[0] += w * pose.v[0];
+    cluster->m[1] += w * pose.v[1];
+    cluster->m[2] += w * cos(pose.v[2]);
+    cluster->m[3] += w * sin(pose.v[2]);
 
-    m[0] += sample->weight * sample->pose.v[0];
-    m[1] += sample->weight * sample->pose.v[1];
-    m[2] += sample->weight * cos(sample->pose.v[2]);
-    m[3] += sample->weight * sin(sample->pose.v[2]);
+    m[0] += w * pose.v[0];
+    m[1] += w * pose.v[1];
+    m[2] += w * cos(pose.v[2]);
+    m[3] += w * sin(pose.v[2]);
 
     // Compute covariance in linear components
     for (j = 0; j < 2; j++)
       for (k = 0; k < 2; k++)
       {
-        cluster->c[j][k] += sample->weight * sample->pose.v[j] * sample->pose.v[k];
-        c[j][k] += sample->weight * sample->pose.v[j] * sample->pose.v[k];
+        cluster->c[j][k] += w * pose.v[j] * pose.v[k];
+        c[j][k] += w * pose.v[j] * pose.v[k];
       }
   }
 
@@ -609,7 +759,7 @@ void pf_get_cep_stats(pf_t *pf, pf_vector_t *mean, double *var)
   int i;
   double mn, mx, my, mrr;
   pf_sample_set_t *set;
-  pf_sample_t *sample;
+  double w;
   
   set = pf->sets + pf->current_set;
 
@@ -620,13 +770,13 @@ void pf_get_cep_stats(pf_t *pf, pf_vector_t *mean, double *var)
   
   for (i = 0; i < set->sample_count; i++)
   {
-    sample = set->samples + i;
+    w = set->weight[i];
 
-    mn += sample->weight;
-    mx += sample->weight * sample->pose.v[0];
-    my += sample->weight * sample->pose.v[1];
-    mrr += sample->weight * sample->pose.v[0] * sample->pose.v[0];
-    mrr += sample->weight * sample->pose.v[1] * sample->pose.v[1];
+    mn += w;
+    mx += w * set->x[i];
+    my += w * set->y[i];
+    mrr += w * set->x[i] * set->x[i];
+    mrr += w * set->y[i] * set->y[i];
   }
 
   mean->v[0] = mx / mn;
@@ -660,3 +810,38 @@ int pf_get_cluster_stats(pf_t *pf, int clabel, double *weight,
 }
 
 
+// Move whole clusters, each about its own mean
+void pf_move_clusters(pf_t *pf, const pf_vector_t *means, int count)
+{
+  int i, cidx;
+  double dx, dy, dtheta, c, s;
+  pf_vector_t pose, mean;
+  pf_sample_set_t *set;
+
+  set = pf->sets + pf->current_set;
+  if (count > set->cluster_count)
+    count = set->cluster_count;
+
+  for (i = 0; i < set->sample_count; i++)
+  {
+    pose = pf_sample_get_pose(set, i);
+    cidx = pf_kdtree_get_cluster(set->kdtree, pose);
+    if (cidx < 0 || cidx >= count)
+      continue;
+
+    // Turn the sample about the old mean, then carry it to the new one
+    mean = set->clusters[cidx].mean;
+    dtheta = means[cidx].v[2] - mean.v[2];
+    c = cos(dtheta);
+    s = sin(dtheta);
+    dx = pose.v[0] - mean.v[0];
+    dy = pose.v[1] - mean.v[1];
+    set->x[i] = means[cidx].v[0] + c * dx - s * dy;
+    set->y[i] = means[cidx].v[1] + s * dx + c * dy;
+    set->theta[i] = pose.v[2] + dtheta;
+  }
+
+  pf_update_weighted(pf, set);
+}
+
+
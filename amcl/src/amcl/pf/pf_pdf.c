@@ -27,6 +27,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 //#include <gsl/gsl_rng.h>
@@ -145,6 +146,109 @@ double pf_ran_gaussian(double sigma)
   return(sigma * x2 * sqrt(-2.0*log(w)/w));
 }
 
+// Number of layers of the ziggurat, and the start of its tail and the
+// area of each layer (Marsaglia and Tsang, as tabulated by Doornik)
+#define PF_ZIG_LAYERS 128
+#define PF_ZIG_R 3.442619855899
+#define PF_ZIG_V 9.91256303526217e-3
+
+// Layer edges, and the ratio of each layer's width to the next one's
+static double pf_zig_x[PF_ZIG_LAYERS + 1];
+static double pf_zig_ratio[PF_ZIG_LAYERS];
+static int pf_zig_ready = 0;
+
+static void pf_zig_init(void)
+{
+  int i;
+  double f;
+
+  f = exp(-0.5 * PF_ZIG_R * PF_ZIG_R);
+  pf_zig_x[0] = PF_ZIG_V / f;
+  pf_zig_x[1] = PF_ZIG_R;
+  pf_zig_x[PF_ZIG_LAYERS] = 0;
+  for (i = 2; i < PF_ZIG_LAYERS; i++)
+  {
+    pf_zig_x[i] = sqrt(-2 * log(PF_ZIG_V / pf_zig_x[i - 1] + f));
+    f = exp(-0.5 * pf_zig_x[i] * pf_zig_x[i]);
+  }
+  for (i = 0; i < PF_ZIG_LAYERS; i++)
+    pf_zig_ratio[i] = pf_zig_x[i + 1] / pf_zig_x[i];
+  pf_zig_ready = 1;
+}
+
+// The next 64 random bits of a counter-based generator: the SplitMix64
+// output function of key + counter * golden ratio.  Any draw can be made
+// from the key and its counter alone.
+static uint64_t pf_ran_bits(uint64_t key, uint64_t *counter)
+{
+  uint64_t x = key + ++(*counter) * 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Uniform in (0, 1] from the top 53 bits
+static double pf_ran_unit(uint64_t bits)
+{
+  return ((bits >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+// Fill an array with standard normal draws
+void pf_ran_gaussian_batch(double *z, int n)
+{
+  int i, layer;
+  uint64_t key, counter, bits;
+  double u, x, f0, f1;
+
+  if (!pf_zig_ready)
+    pf_zig_init();
+
+  key = (uint64_t) (drand48() * 9007199254740992.0);
+  counter = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    for (;;)
+    {
+      // One draw picks both the layer (low bits) and the point (high bits)
+      bits = pf_ran_bits(key, &counter);
+      u = 2 * pf_ran_unit(bits) - 1;
+      layer = bits & (PF_ZIG_LAYERS - 1);
+
+      // Inside the rectangle of the layer: taken about 99% of the time
+      if (fabs(u) < pf_zig_ratio[layer])
+      {
+        z[i] = u * pf_zig_x[layer];
+        break;
+      }
+
+      // Bottom layer: sample from the tail beyond PF_ZIG_R
+      if (layer == 0)
+      {
+        double tx, ty;
+        do
+        {
+          tx = log(pf_ran_unit(pf_ran_bits(key, &counter))) / PF_ZIG_R;
+          ty = log(pf_ran_unit(pf_ran_bits(key, &counter)));
+        } while (-2 * ty < tx * tx);
+        z[i] = (u < 0) ? tx - PF_ZIG_R : PF_ZIG_R - tx;
+        break;
+      }
+
+      // In the wedge of the layer, under the density
+      x = u * pf_zig_x[layer];
+      f0 = exp(-0.5 * (pf_zig_x[layer] * pf_zig_x[layer] - x * x));
+      f1 = exp(-0.5 * (pf_zig_x[layer + 1] * pf_zig_x[layer + 1] - x * x));
+      if (f1 + pf_ran_unit(pf_ran_bits(key, &counter)) * (f0 - f1) < 1.0)
+      {
+        z[i] = x;
+        break;
+      }
+    }
+  }
+  return;
+}
+
 #if 0
 
 /**************************************************************************
@@ -0,0 +1,267 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Coarse-to-fine global localization over a map pyramid
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "amcl_global_localizer.h"
+
+using namespace amcl;
+
+// Headings tried per cell of the coarsest level; each finer level halves
+// the angular step
+#define GLOBAL_LOC_COARSE_ANGLES 64
+
+// Make a map with cells twice the size of the given one.  A coarse cell
+// is occupied if any cell it covers is, else free if any is, else unknown.
+static map_t *
+downsample_map(const map_t *fine, std::vector<bool> *free_cells,
+               const std::vector<bool>& fine_free)
+{
+  map_t *map = map_alloc();
+  map->size_x = (fine->size_x + 1) / 2;
+  map->size_y = (fine->size_y + 1) / 2;
+  map->scale = fine->scale * 2;
+
+  // Place the coarse cell centres on the middle of the 2x2 blocks
+  map->origin_x = fine->origin_x + (0.5 - fine->size_x / 2) * fine->scale +
+    (map->size_x / 2) * map->scale;
+  map->origin_y = fine->origin_y + (0.5 - fine->size_y / 2) * fine->scale +
+    (map->size_y / 2) * map->scale;
+
+  map->cells = (map_cell_t*) malloc(sizeof(map_cell_t) * map->size_x * map->size_y);
+  free_cells->assign(map->size_x * map->size_y, false);
+
+  for(int j = 0; j < map->size_y; j++)
+  {
+    for(int i = 0; i < map->size_x; i++)
+    {
+      int state = 0;
+      bool any_free = false;
+      for(int dj = 0; dj < 2; dj++)
+      {
+        for(int di = 0; di < 2; di++)
+        {
+          int fi = 2 * i + di;
+          int fj = 2 * j + dj;
+          if(!MAP_VALID(fine, fi, fj))
+            continue;
+          int fine_state = MAP_OCC_STATE(fine, MAP_INDEX(fine, fi, fj));
+          if(fine_state == 1)
+            state = 1;
+          else if(fine_state == -1 && state == 0)
+            state = -1;
+          if(fine_free[MAP_INDEX(fine, fi, fj)])
+            any_free = true;
+        }
+      }
+      map->cells[MAP_INDEX(map, i, j)].occ_state = state;
+      map->cells[MAP_INDEX(map, i, j)].occ_dist = 0;
+      (*free_cells)[MAP_INDEX(map, i, j)] = any_free;
+    }
+  }
+  return map;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Build the pyramid and the likelihood field of each coarse level
+AMCLGlobalLocalizer::AMCLGlobalLocalizer(map_t *map, int max_hypotheses,
+                                         int max_levels, size_t max_beams,
+                                         double z_hit, double z_rand,
+                                         double sigma_hit, double max_occ_dist,
+                                         int num_threads)
+{
+  this->max_hypotheses = std::max(max_hypotheses, 1);
+
+  std::vector<bool> free0(map->size_x * map->size_y);
+  int free_count = 0;
+  for(int i = 0; i < map->size_x * map->size_y; i++)
+  {
+    free0[i] = (MAP_OCC_STATE(map, i) == -1);
+    if(free0[i])
+      free_count++;
+  }
+  this->levels.push_back(map);
+  this->free_cells.push_back(free0);
+  this->lasers.push_back((AMCLLaser*) NULL);
+
+  // Coarsen until the exhaustive search over the top level is about as
+  // large as the set of hypotheses refined below it
+  while((int) this->levels.size() <= max_levels &&
+        free_count > this->max_hypotheses)
+  {
+    std::vector<bool> free_l;
+    map_t *level = downsample_map(this->levels.back(), &free_l,
+                                  this->free_cells.back());
+
+    free_count = 0;
+    for(size_t i = 0; i < free_l.size(); i++)
+      if(free_l[i])
+        free_count++;
+
+    // Blur the model by the cell size, so that hypotheses up to a cell
+    // away from the truth still score well
+    AMCLLaser *laser = new AMCLLaser(max_beams, level);
+    laser->SetModelThreads(num_threads);
+    laser->SetCspaceEDT(true);
+    laser->SetModelLikelihoodField(z_hit, z_rand,
+                                   hypot(sigma_hit, level->scale / 2),
+                                   std::max(max_occ_dist, 2 * level->scale));
+
+    this->levels.push_back(level);
+    this->free_cells.push_back(free_l);
+    this->lasers.push_back(laser);
+  }
+}
+
+AMCLGlobalLocalizer::~AMCLGlobalLocalizer()
+{
+  for(size_t l = 1; l < this->levels.size(); l++)
+  {
+    delete this->lasers[l];
+    map_free(this->levels[l]);
+  }
+}
+
+double AMCLGlobalLocalizer::AngleStep() const
+{
+  return 2 * M_PI / GLOBAL_LOC_COARSE_ANGLES / (1 << this->Levels());
+}
+
+bool AMCLGlobalLocalizer::IsFree(int l, double x, double y) const
+{
+  const map_t *map = this->levels[l];
+  int i = MAP_GXWX(map, x);
+  int j = MAP_GYWY(map, y);
+  return MAP_VALID(map, i, j) && this->free_cells[l][MAP_INDEX(map, i, j)];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Score the hypotheses and keep the best max_hypotheses of them
+void AMCLGlobalLocalizer::Score(AMCLLaserData *data, AMCLLaser *laser,
+                                std::vector<Hypothesis> *hyps)
+{
+  int n = (int) hyps->size();
+  if(n == 0)
+    return;
+
+  this->x.resize(n);
+  this->y.resize(n);
+  this->theta.resize(n);
+  this->weight.resize(n);
+
+  pf_sample_set_t set;
+  memset(&set, 0, sizeof(set));
+  set.sample_count = n;
+  set.x = &this->x[0];
+  set.y = &this->y[0];
+  set.theta = &this->theta[0];
+  set.weight = &this->weight[0];
+
+  for(int i = 0; i < n; i++)
+  {
+    pf_sample_set_pose(&set, i, (*hyps)[i].pose);
+    set.weight[i] = 1.0;
+  }
+
+  laser->ScoreSamples(data, &set);
+
+  for(int i = 0; i < n; i++)
+    (*hyps)[i].score = set.weight[i];
+
+  if(n > this->max_hypotheses)
+  {
+    std::nth_element(hyps->begin(), hyps->begin() + this->max_hypotheses,
+                     hyps->end());
+    hyps->resize(this->max_hypotheses);
+  }
+  std::sort(hyps->begin(), hyps->end());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Exhaustive search on the top level, then refinement level by level
+void AMCLGlobalLocalizer::Search(AMCLLaserData *data, AMCLLaser *laser,
+                                 std::vector<pf_vector_t> *poses)
+{
+  int top = this->Levels();
+  std::vector<Hypothesis> hyps;
+  Hypothesis hyp;
+
+  pf_vector_t laser_pose = laser->GetLaserPose();
+  for(int l = 1; l <= top; l++)
+    this->lasers[l]->SetLaserPose(laser_pose);
+
+  // Every free cell and heading of the top level
+  map_t *map = this->levels[top];
+  double angle_step = 2 * M_PI / GLOBAL_LOC_COARSE_ANGLES;
+  for(int j = 0; j < map->size_y; j++)
+  {
+    for(int i = 0; i < map->size_x; i++)
+    {
+      if(!this->free_cells[top][MAP_INDEX(map, i, j)])
+        continue;
+      for(int k = 0; k < GLOBAL_LOC_COARSE_ANGLES; k++)
+      {
+        hyp.pose.v[0] = MAP_WXGX(map, i);
+        hyp.pose.v[1] = MAP_WYGY(map, j);
+        hyp.pose.v[2] = -M_PI + k * angle_step;
+        hyp.score = 0;
+        hyps.push_back(hyp);
+      }
+    }
+  }
+  Score(data, top > 0 ? this->lasers[top] : laser, &hyps);
+
+  // Split each survivor into the 2x2 cells and 2 headings below it
+  for(int l = top - 1; l >= 0; l--)
+  {
+    double offset = this->levels[l]->scale / 2;
+    double angle_offset = angle_step / 4;
+    std::vector<Hypothesis> children;
+    children.reserve(hyps.size() * 8);
+    for(size_t h = 0; h < hyps.size(); h++)
+    {
+      for(int c = 0; c < 8; c++)
+      {
+        hyp.pose.v[0] = hyps[h].pose.v[0] + ((c & 1) ? offset : -offset);
+        hyp.pose.v[1] = hyps[h].pose.v[1] + ((c & 2) ? offset : -offset);
+        hyp.pose.v[2] = hyps[h].pose.v[2] + ((c & 4) ? angle_offset : -angle_offset);
+        hyp.score = 0;
+        if(IsFree(l, hyp.pose.v[0], hyp.pose.v[1]))
+          children.push_back(hyp);
+      }
+    }
+    hyps.swap(children);
+    angle_step /= 2;
+    Score(data, l > 0 ? this->lasers[l] : laser, &hyps);
+  }
+
+  poses->clear();
+  for(size_t h = 0; h < hyps.size(); h++)
+    poses->push_back(hyps[h].pose);
+}
@@ -29,10 +29,15 @@
 
 #include <sys/types.h> // required by Darwin
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
 #include "amcl_laser.h"
 
 using namespace amcl;
@@ -41,7 +46,11 @@ using namespace amcl;
 // Default constructor
 AMCLLaser::AMCLLaser(size_t max_beams, map_t* map) : AMCLSensor(), 
 						     max_samples(0), max_obs(0), 
-						     temp_obs(NULL)
+						     temp_obs(NULL),
+						     cspace_edt(false),
+						     adaptive_beams(false),
+						     vectorized(false),
+						     thread_pool(new AMCLThreadPool(1))
 {
   this->time = 0.0;
 
@@ -91,7 +100,7 @@ AMCLLaser::SetModelLikelihoodField(double z_hit,
   this->z_rand = z_rand;
   this->sigma_hit = sigma_hit;
 
-  map_update_cspace(this->map, max_occ_dist);
+  UpdateCspace(max_occ_dist);
 }
 
 void 
@@ -112,7 +121,71 @@ AMCLLaser::SetModelLikelihoodFieldProb(double z_hit,
   this->beam_skip_distance = beam_skip_distance;
   this->beam_skip_threshold = beam_skip_threshold;
   this->beam_skip_error_threshold = beam_skip_error_threshold;
-  map_update_cspace(this->map, max_occ_dist);
+  UpdateCspace(max_occ_dist);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Build the likelihood field with the selected distance transform
+void AMCLLaser::UpdateCspace(double max_occ_dist)
+{
+  std::string cache_file;
+  int method = this->cspace_edt ? 1 : 0;
+
+  // A map kept from before, e.g. the floor amcl switched back to, may
+  // already hold the field.  Its cells only change through
+  // UpdateMapRegion(), which keeps the field up to date, so the map is
+  // hashed only when the field has to be built.
+  if(this->map->cspace_key != 0 && this->map->cspace_method == method &&
+     this->map->max_occ_dist == max_occ_dist)
+  {
+    UpdateDistanceTable();
+    return;
+  }
+  uint64_t key = map_cspace_hash(this->map, max_occ_dist, method);
+
+  if(!this->cspace_cache_dir.empty())
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "/likelihood_field_%016llx.bin",
+             (unsigned long long)key);
+    cache_file = this->cspace_cache_dir + name;
+
+    if(map_cspace_cache_load(this->map, cache_file.c_str(), key) == 0)
+    {
+      this->map->cspace_key = key;
+      this->map->cspace_method = method;
+      UpdateDistanceTable();
+      return;
+    }
+  }
+
+  if(this->cspace_edt)
+    map_update_cspace_edt(this->map, max_occ_dist, this->thread_pool->Size());
+  else
+    map_update_cspace(this->map, max_occ_dist);
+  this->map->cspace_key = key;
+  UpdateDistanceTable();
+
+  // A failure to write the cache only costs the next startup its speedup
+  if(!cache_file.empty())
+    map_cspace_cache_save(this->map, cache_file.c_str(), key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tabulate the hit Gaussian over the distance codes of a compact map
+void AMCLLaser::UpdateDistanceTable()
+{
+  this->dist_lut.clear();
+  if(this->map->cells)
+    return;
+
+  double z_hit_denom = 2 * this->sigma_hit * this->sigma_hit;
+  this->dist_lut.resize(this->map->occ_dist_max_code + 1);
+  for(int code = 0; code <= this->map->occ_dist_max_code; code++)
+  {
+    double z = code * this->map->occ_dist_step;
+    this->dist_lut[code] = exp(-(z * z) / z_hit_denom);
+  }
 }
 
 
@@ -137,29 +210,309 @@ bool AMCLLaser::UpdateSensor(pf_t *pf, AMCLSensorData *data)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Apply the sensor model to a sample set outside of any filter
+double AMCLLaser::ScoreSamples(AMCLLaserData *data, pf_sample_set_t *set)
+{
+  double total;
+
+  // The models find their parameters through the data
+  AMCLSensor *sensor = data->sensor;
+  data->sensor = this;
+
+  if(this->model_type == LASER_MODEL_LIKELIHOOD_FIELD)
+    total = LikelihoodFieldModel(data, set);
+  else if(this->model_type == LASER_MODEL_LIKELIHOOD_FIELD_PROB)
+    total = LikelihoodFieldModelProb(data, set);
+  else
+    total = BeamModel(data, set);
+
+  data->sensor = sensor;
+  return total;
+}
+
+
+// Split the sample set evenly into chunks, one per pool thread
+static void
+chunk_bounds(int count, int num_chunks, int chunk, int *begin, int *end)
+{
+  *begin = (int)(((long)count * chunk) / num_chunks);
+  *end = (int)(((long)count * (chunk + 1)) / num_chunks);
+}
+
+// Sum the sample weights in index order; the chunked models rely on this
+// to produce exactly the same total as a single-threaded pass.
+static double
+sum_weights(pf_sample_set_t* set)
+{
+  double total_weight = 0.0;
+  for (int j = 0; j < set->sample_count; j++)
+    total_weight += set->weight[j];
+  return(total_weight);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Set the number of threads used to evaluate the sensor models
+void AMCLLaser::SetModelThreads(int num_threads)
+{
+  if(num_threads < 1)
+    num_threads = 1;
+  if(!this->thread_pool || this->thread_pool->Size() != num_threads)
+    this->thread_pool.reset(new AMCLThreadPool(num_threads));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Set up (or drop) the beam model range table
+double AMCLLaser::SetModelBeamRangeTable(size_t max_bytes)
+{
+  if(max_bytes == 0)
+  {
+    this->range_table.reset();
+    return 0.0;
+  }
+  this->range_table.reset(new AMCLRangeTable(this->map, max_bytes));
+  return 2 * M_PI / this->range_table->AngleCount();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Select the distance transform used by SetModelLikelihoodField*()
+void AMCLLaser::SetCspaceEDT(bool use_edt)
+{
+  this->cspace_edt = use_edt;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Set the directory of the likelihood field cache
+void AMCLLaser::SetCspaceCacheDir(const std::string& dir)
+{
+  this->cspace_cache_dir = dir;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Repair what was derived from the changed cells
+void AMCLLaser::UpdateMapRegion(int x0, int y0, int width, int height)
+{
+  if(this->model_type == LASER_MODEL_LIKELIHOOD_FIELD ||
+     this->model_type == LASER_MODEL_LIKELIHOOD_FIELD_PROB)
+    map_update_cspace_region(this->map, x0, y0, width, height);
+  else
+    this->map->cspace_key = 0;
+  if(this->range_table)
+    this->range_table->Invalidate(x0, y0, width, height);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Select the vectorized likelihood field kernel
+bool AMCLLaser::SetModelVectorized(bool vectorized)
+{
+  this->vectorized = vectorized;
+  return !vectorized || LikelihoodFieldKernelVectorized();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Select how the likelihood field model picks its beams
+void AMCLLaser::SetModelAdaptiveBeams(bool adaptive)
+{
+  this->adaptive_beams = adaptive;
+}
+
+// The likelihood field model ignores max range readings and NaNs
+static bool
+beam_usable(AMCLLaserData *data, int i)
+{
+  double obs_range = data->ranges[i][0];
+  return obs_range < data->range_max && obs_range == obs_range;
+}
+
+// Does beam k continue the surface that beam i hits?  Allow for the
+// spacing of the beams plus a couple of map cells.
+static bool
+beam_supported(AMCLLaserData *data, int i, int k, double scale)
+{
+  if(k < 0 || k >= data->range_count || !beam_usable(data, k))
+    return false;
+
+  double ri = data->ranges[i][0], rk = data->ranges[k][0];
+  double bi = data->ranges[i][1], bk = data->ranges[k][1];
+  double gap = hypot(ri * data->bearing_cos[i] - rk * data->bearing_cos[k],
+                     ri * data->bearing_sin[i] - rk * data->bearing_sin[k]);
+  return gap < 2 * ri * fabs(bk - bi) + 2 * scale;
+}
+
+// Magnitude of the gradient of the hit likelihood at a map cell
+static double
+hit_gradient(map_t *map, double z_hit_denom, int i, int j)
+{
+  double zl, zr, zd, zu;
+
+  if(!MAP_VALID(map, i - 1, j - 1) || !MAP_VALID(map, i + 1, j + 1))
+    return 0.0;
+
+  zl = MAP_OCC_DIST(map, MAP_INDEX(map, i - 1, j));
+  zr = MAP_OCC_DIST(map, MAP_INDEX(map, i + 1, j));
+  zd = MAP_OCC_DIST(map, MAP_INDEX(map, i, j - 1));
+  zu = MAP_OCC_DIST(map, MAP_INDEX(map, i, j + 1));
+
+  double gx = exp(-(zr * zr) / z_hit_denom) - exp(-(zl * zl) / z_hit_denom);
+  double gy = exp(-(zu * zu) / z_hit_denom) - exp(-(zd * zd) / z_hit_denom);
+  return hypot(gx, gy) / (2 * map->scale);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Work out the cos and sin of the bearings, unless the data has them already
+void AMCLLaser::PrepareBearings(AMCLLaserData *data)
+{
+  if(data->bearing_cos)
+    return;
+
+  this->bearing_cos_buf.resize(data->range_count);
+  this->bearing_sin_buf.resize(data->range_count);
+  for (int i = 0; i < data->range_count; i++)
+  {
+    this->bearing_cos_buf[i] = cos(data->ranges[i][1]);
+    this->bearing_sin_buf[i] = sin(data->ranges[i][1]);
+  }
+  data->bearing_cos = data->range_count ? &this->bearing_cos_buf[0] : NULL;
+  data->bearing_sin = data->range_count ? &this->bearing_sin_buf[0] : NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Pick the beams for the likelihood field model
+void AMCLLaser::SelectBeams(AMCLLaserData *data, pf_sample_set_t* set)
+{
+  int i, j, s;
+
+  this->beam_index.clear();
+
+  if(!this->adaptive_beams)
+  {
+    int step = (data->range_count - 1) / (this->max_beams - 1);
+
+    // Step size must be at least 1
+    if(step < 1)
+      step = 1;
+
+    for (i = 0; i < data->range_count; i += step)
+      if(beam_usable(data, i))
+        this->beam_index.push_back(i);
+    return;
+  }
+
+  // Score the beams from the weighted mean of the samples; for a spread
+  // out set this only decides which beam of each sector survives, never
+  // how many do
+  double total = 0.0, mx = 0.0, my = 0.0, mc = 0.0, ms = 0.0;
+  for (j = 0; j < set->sample_count; j++)
+  {
+    double w = set->weight[j];
+    total += w;
+    mx += w * set->x[j];
+    my += w * set->y[j];
+    mc += w * cos(set->theta[j]);
+    ms += w * sin(set->theta[j]);
+  }
+  pf_vector_t mean = pf_vector_zero();
+  if(total > 0.0)
+  {
+    mean.v[0] = mx / total;
+    mean.v[1] = my / total;
+    mean.v[2] = atan2(ms, mc);
+  }
+  pf_vector_t pose = pf_vector_coord_add(this->laser_pose, mean);
+  double pose_cos = cos(pose.v[2]), pose_sin = sin(pose.v[2]);
+
+  double z_hit_denom = 2 * this->sigma_hit * this->sigma_hit;
+
+  double anchor_x = 0.0, anchor_y = 0.0;
+  bool have_anchor = false;
+
+  for (s = 0; s < this->max_beams; s++)
+  {
+    int begin = (int)(((long)data->range_count * s) / this->max_beams);
+    int end = (int)(((long)data->range_count * (s + 1)) / this->max_beams);
+    int best_beam = -1;
+    double best_score = -1.0;
+
+    for (i = begin; i < end; i++)
+    {
+      if(!beam_usable(data, i))
+        continue;
+
+      double obs_range = data->ranges[i][0];
+      double ex = obs_range * data->bearing_cos[i];
+      double ey = obs_range * data->bearing_sin[i];
+
+      // Endpoints (in the laser frame) closer than a map cell to the
+      // first endpoint of their run add nothing to the run's first beam
+      if(have_anchor && hypot(ex - anchor_x, ey - anchor_y) < this->map->scale)
+        continue;
+      anchor_x = ex;
+      anchor_y = ey;
+      have_anchor = true;
+
+      // A return that no neighbouring beam continues is most likely noise
+      // or clutter rather than a surface
+      if(!beam_supported(data, i, i - 1, this->map->scale) &&
+         !beam_supported(data, i, i + 1, this->map->scale))
+        continue;
+
+      int mi = MAP_GXWX(this->map, pose.v[0] + ex * pose_cos - ey * pose_sin);
+      int mj = MAP_GYWY(this->map, pose.v[1] + ex * pose_sin + ey * pose_cos);
+      double score = hit_gradient(this->map, z_hit_denom, mi, mj);
+      if(score > best_score)
+      {
+        best_score = score;
+        best_beam = i;
+      }
+    }
+
+    if(best_beam >= 0)
+      this->beam_index.push_back(best_beam);
+  }
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Determine the probability for the given pose
 double AMCLLaser::BeamModel(AMCLLaserData *data, pf_sample_set_t* set)
+{
+  AMCLLaser *self = (AMCLLaser*) data->sensor;
+  int num_chunks = self->thread_pool->Size();
+
+  // Fill in the parts of the range table this sample set needs first, so
+  // the chunks below only ever read it
+  if(self->range_table)
+    self->range_table->Prepare(set, self->laser_pose, data->range_max,
+                               self->thread_pool.get());
+
+  self->thread_pool->Run(boost::bind(&AMCLLaser::BeamModelChunk,
+                                     data, set, num_chunks, _1));
+
+  return(sum_weights(set));
+}
+
+void AMCLLaser::BeamModelChunk(AMCLLaserData *data, pf_sample_set_t* set,
+                               int num_chunks, int chunk)
 {
   AMCLLaser *self;
   int i, j, step;
+  int begin, end;
   double z, pz;
   double p;
   double map_range;
   double obs_range, obs_bearing;
-  double total_weight;
-  pf_sample_t *sample;
   pf_vector_t pose;
 
   self = (AMCLLaser*) data->sensor;
 
-  total_weight = 0.0;
+  chunk_bounds(set->sample_count, num_chunks, chunk, &begin, &end);
 
   // Compute the sample weights
-  for (j = 0; j < set->sample_count; j++)
+  for (j = begin; j < end; j++)
   {
-    sample = set->samples + j;
-    pose = sample->pose;
+    pose = pf_sample_get_pose(set, j);
 
     // Take account of the laser pose relative to the robot
     pose = pf_vector_coord_add(self->laser_pose, pose);
@@ -173,8 +526,13 @@ double AMCLLaser::BeamModel(AMCLLaserData *data, pf_sample_set_t* set)
       obs_bearing = data->ranges[i][1];
 
       // Compute the range according to the map
-      map_range = map_calc_range(self->map, pose.v[0], pose.v[1],
-                                 pose.v[2] + obs_bearing, data->range_max);
+      if(self->range_table)
+        map_range = std::min(self->range_table->Lookup(pose.v[0], pose.v[1],
+                                                       pose.v[2] + obs_bearing),
+                             data->range_max);
+      else
+        map_range = map_calc_range(self->map, pose.v[0], pose.v[1],
+                                   pose.v[2] + obs_bearing, data->range_max);
       pz = 0.0;
 
       // Part 1: good, but noisy, hit
@@ -203,34 +561,62 @@ double AMCLLaser::BeamModel(AMCLLaserData *data, pf_sample_set_t* set)
       p += pz*pz*pz;
     }
 
-    sample->weight *= p;
-    total_weight += sample->weight;
+    set->weight[j] *= p;
   }
-
-  return(total_weight);
 }
 
 double AMCLLaser::LikelihoodFieldModel(AMCLLaserData *data, pf_sample_set_t* set)
+{
+  AMCLLaser *self = (AMCLLaser*) data->sensor;
+  int num_chunks = self->thread_pool->Size();
+
+  self->PrepareBearings(data);
+  self->SelectBeams(data, set);
+
+  // The vectorized kernel wants the beams of this scan once, with their
+  // bearings already turned into cos/sin
+  if(self->vectorized)
+  {
+    self->beam_range.clear();
+    self->beam_cos.clear();
+    self->beam_sin.clear();
+    for (size_t b = 0; b < self->beam_index.size(); b++)
+    {
+      int i = self->beam_index[b];
+      double obs_range = data->ranges[i][0];
+      self->beam_range.push_back(obs_range);
+      self->beam_cos.push_back(data->bearing_cos[i]);
+      self->beam_sin.push_back(data->bearing_sin[i]);
+    }
+  }
+
+  self->thread_pool->Run(boost::bind(&AMCLLaser::LikelihoodFieldModelChunk,
+                                     data, set, num_chunks, _1));
+
+  return(sum_weights(set));
+}
+
+void AMCLLaser::LikelihoodFieldModelChunk(AMCLLaserData *data, pf_sample_set_t* set,
+                                          int num_chunks, int chunk)
 {
   AMCLLaser *self;
-  int i, j, step;
+  int i, j;
+  size_t b;
+  int begin, end;
   double z, pz;
   double p;
-  double obs_range, obs_bearing;
-  double total_weight;
-  pf_sample_t *sample;
+  double obs_range;
   pf_vector_t pose;
   pf_vector_t hit;
 
   self = (AMCLLaser*) data->sensor;
 
-  total_weight = 0.0;
+  chunk_bounds(set->sample_count, num_chunks, chunk, &begin, &end);
 
   // Compute the sample weights
-  for (j = 0; j < set->sample_count; j++)
+  for (j = begin; j < end; j++)
   {
-    sample = set->samples + j;
-    pose = sample->pose;
+    pose = pf_sample_get_pose(set, j);
 
     // Take account of the laser pose relative to the robot
     pose = pf_vector_coord_add(self->laser_pose, pose);
@@ -241,30 +627,32 @@ double AMCLLaser::LikelihoodFieldModel(AMCLLaserData *data, pf_sample_set_t* set
     double z_hit_denom = 2 * self->sigma_hit * self->sigma_hit;
     double z_rand_mult = 1.0/data->range_max;
 
-    step = (data->range_count - 1) / (self->max_beams - 1);
+    if(self->vectorized)
+    {
+      LaserBeamSet beams;
+      beams.count = self->beam_range.size();
+      beams.range = beams.count ? &self->beam_range[0] : NULL;
+      beams.cos_bearing = beams.count ? &self->beam_cos[0] : NULL;
+      beams.sin_bearing = beams.count ? &self->beam_sin[0] : NULL;
+      set->weight[j] *= LikelihoodFieldBeams(self->map, beams, pose,
+                                             self->z_hit, z_hit_denom,
+                                             self->z_rand * z_rand_mult);
+      continue;
+    }
 
-    // Step size must be at least 1
-    if(step < 1)
-      step = 1;
+    double pose_cos = cos(pose.v[2]), pose_sin = sin(pose.v[2]);
 
-    for (i = 0; i < data->range_count; i += step)
+    // Max range readings and NaNs have already been left out
+    for (b = 0; b < self->beam_index.size(); b++)
     {
+      i = self->beam_index[b];
       obs_range = data->ranges[i][0];
-      obs_bearing = data->ranges[i][1];
-
-      // This model ignores max range readings
-      if(obs_range >= data->range_max)
-        continue;
-
-      // Check for NaN
-      if(obs_range != obs_range)
-        continue;
 
       pz = 0.0;
 
       // Compute the endpoint of the beam
-      hit.v[0] = pose.v[0] + obs_range * cos(pose.v[2] + obs_bearing);
-      hit.v[1] = pose.v[1] + obs_range * sin(pose.v[2] + obs_bearing);
+      hit.v[0] = pose.v[0] + obs_range * (pose_cos * data->bearing_cos[i] - pose_sin * data->bearing_sin[i]);
+      hit.v[1] = pose.v[1] + obs_range * (pose_sin * data->bearing_cos[i] + pose_cos * data->bearing_sin[i]);
 
       // Convert to map grid coords.
       int mi, mj;
@@ -273,13 +661,24 @@ double AMCLLaser::LikelihoodFieldModel(AMCLLaserData *data, pf_sample_set_t* set
       
       // Part 1: Get distance from the hit to closest obstacle.
       // Off-map penalized as max distance
-      if(!MAP_VALID(self->map, mi, mj))
-        z = self->map->max_occ_dist;
+      if(!self->map->cells)
+      {
+        // Compact map: the Gaussian is tabulated per distance code, and
+        // the last code is max_occ_dist
+        int code = MAP_VALID(self->map, mi, mj) ?
+          self->map->occ_dist_codes[MAP_INDEX(self->map,mi,mj)] : self->map->occ_dist_max_code;
+        pz += self->z_hit * self->dist_lut[code];
+      }
       else
-        z = self->map->cells[MAP_INDEX(self->map,mi,mj)].occ_dist;
-      // Gaussian model
-      // NOTE: this should have a normalization of 1/(sqrt(2pi)*sigma)
-      pz += self->z_hit * exp(-(z * z) / z_hit_denom);
+      {
+        if(!MAP_VALID(self->map, mi, mj))
+          z = self->map->max_occ_dist;
+        else
+          z = self->map->cells[MAP_INDEX(self->map,mi,mj)].occ_dist;
+        // Gaussian model
+        // NOTE: this should have a normalization of 1/(sqrt(2pi)*sigma)
+        pz += self->z_hit * exp(-(z * z) / z_hit_denom);
+      }
       // Part 2: random measurements
       pz += self->z_rand * z_rand_mult;
 
@@ -293,28 +692,21 @@ double AMCLLaser::LikelihoodFieldModel(AMCLLaserData *data, pf_sample_set_t* set
       p += pz*pz*pz;
     }
 
-    sample->weight *= p;
-    total_weight += sample->weight;
+    set->weight[j] *= p;
   }
-
-  return(total_weight);
 }
 
 double AMCLLaser::LikelihoodFieldModelProb(AMCLLaserData *data, pf_sample_set_t* set)
 {
   AMCLLaser *self;
-  int i, j, step;
-  double z, pz;
-  double log_p;
-  double obs_range, obs_bearing;
-  double total_weight;
-  pf_sample_t *sample;
-  pf_vector_t pose;
-  pf_vector_t hit;
+  int step;
+  int beam_ind;
 
   self = (AMCLLaser*) data->sensor;
 
-  total_weight = 0.0;
+  int num_chunks = self->thread_pool->Size();
+
+  self->PrepareBearings(data);
 
   step = ceil((data->range_count) / static_cast<double>(self->max_beams)); 
   
@@ -322,19 +714,11 @@ double AMCLLaser::LikelihoodFieldModelProb(AMCLLaserData *data, pf_sample_set_t*
   if(step < 1)
     step = 1;
 
-  // Pre-compute a couple of things
-  double z_hit_denom = 2 * self->sigma_hit * self->sigma_hit;
-  double z_rand_mult = 1.0/data->range_max;
-
-  double max_dist_prob = exp(-(self->map->max_occ_dist * self->map->max_occ_dist) / z_hit_denom);
-
   //Beam skipping - ignores beams for which a majoirty of particles do not agree with the map
   //prevents correct particles from getting down weighted because of unexpected obstacles 
   //such as humans 
 
   bool do_beamskip = self->do_beamskip;
-  double beam_skip_distance = self->beam_skip_distance;
-  double beam_skip_threshold = self->beam_skip_threshold;
   
   //we only do beam skipping if the filter has converged 
   if(do_beamskip && !set->converged){
@@ -342,13 +726,12 @@ double AMCLLaser::LikelihoodFieldModelProb(AMCLLaserData *data, pf_sample_set_t*
   }
 
   //we need a count the no of particles for which the beam agreed with the map 
-  int *obs_count = new int[self->max_beams]();
+  //each chunk counts into its own row, the rows are summed afterwards
+  int *obs_count = new int[num_chunks * self->max_beams]();
 
   //we also need a mask of which observations to integrate (to decide which beams to integrate to all particles) 
   bool *obs_mask = new bool[self->max_beams]();
   
-  int beam_ind = 0;
-  
   //realloc indicates if we need to reallocate the temp data structure needed to do beamskipping 
   bool realloc = false; 
 
@@ -368,13 +751,86 @@ double AMCLLaser::LikelihoodFieldModelProb(AMCLLaserData *data, pf_sample_set_t*
   }
 
   // Compute the sample weights
-  for (j = 0; j < set->sample_count; j++)
+  self->thread_pool->Run(boost::bind(&AMCLLaser::LikelihoodFieldModelProbChunk,
+                                     data, set, step, do_beamskip, obs_count,
+                                     num_chunks, _1));
+
+  if(do_beamskip){
+    for (int chunk = 1; chunk < num_chunks; chunk++){
+      for (beam_ind = 0; beam_ind < self->max_beams; beam_ind++){
+        obs_count[beam_ind] += obs_count[chunk * self->max_beams + beam_ind];
+      }
+    }
+
+    int skipped_beam_count = 0; 
+    for (beam_ind = 0; beam_ind < self->max_beams; beam_ind++){
+      if((obs_count[beam_ind] / static_cast<double>(set->sample_count)) > self->beam_skip_threshold){
+	obs_mask[beam_ind] = true;
+      }
+      else{
+	obs_mask[beam_ind] = false;
+	skipped_beam_count++; 
+      }
+    }
+
+    //we check if there is at least a critical number of beams that agreed with the map 
+    //otherwise it probably indicates that the filter converged to a wrong solution
+    //if that's the case we integrate all the beams and hope the filter might converge to 
+    //the right solution
+    bool error = false; 
+
+    if(skipped_beam_count >= (beam_ind * self->beam_skip_error_threshold)){
+      fprintf(stderr, "Over %f%% of the observations were not in the map - pf may have converged to wrong pose - integrating all observations\n", (100 * self->beam_skip_error_threshold));
+      error = true; 
+    }
+
+    self->thread_pool->Run(boost::bind(&AMCLLaser::BeamSkipChunk,
+                                       data, set, obs_mask, error,
+                                       num_chunks, _1));
+  }
+
+  delete [] obs_count; 
+  delete [] obs_mask;
+  return(sum_weights(set));
+}
+
+void AMCLLaser::LikelihoodFieldModelProbChunk(AMCLLaserData *data, pf_sample_set_t* set,
+                                              int step, bool do_beamskip, int *obs_count,
+                                              int num_chunks, int chunk)
+{
+  AMCLLaser *self;
+  int i, j;
+  int begin, end;
+  double z, pz;
+  double log_p;
+  double obs_range;
+  pf_vector_t pose;
+  pf_vector_t hit;
+
+  self = (AMCLLaser*) data->sensor;
+
+  chunk_bounds(set->sample_count, num_chunks, chunk, &begin, &end);
+
+  // This chunk's row of per-beam agreement counts
+  obs_count += chunk * self->max_beams;
+
+  // Pre-compute a couple of things
+  double z_hit_denom = 2 * self->sigma_hit * self->sigma_hit;
+  double z_rand_mult = 1.0/data->range_max;
+
+  double max_dist_prob = exp(-(self->map->max_occ_dist * self->map->max_occ_dist) / z_hit_denom);
+
+  double beam_skip_distance = self->beam_skip_distance;
+
+  int beam_ind = 0;
+
+  for (j = begin; j < end; j++)
   {
-    sample = set->samples + j;
-    pose = sample->pose;
+    pose = pf_sample_get_pose(set, j);
 
     // Take account of the laser pose relative to the robot
     pose = pf_vector_coord_add(self->laser_pose, pose);
+    double pose_cos = cos(pose.v[2]), pose_sin = sin(pose.v[2]);
 
     log_p = 0;
     
@@ -383,7 +839,6 @@ double AMCLLaser::LikelihoodFieldModelProb(AMCLLaserData *data, pf_sample_set_t*
     for (i = 0; i < data->range_count; i += step, beam_ind++)
     {
       obs_range = data->ranges[i][0];
-      obs_bearing = data->ranges[i][1];
 
       // This model ignores max range readings
       if(obs_range >= data->range_max){
@@ -398,8 +853,8 @@ double AMCLLaser::LikelihoodFieldModelProb(AMCLLaserData *data, pf_sample_set_t*
       pz = 0.0;
 
       // Compute the endpoint of the beam
-      hit.v[0] = pose.v[0] + obs_range * cos(pose.v[2] + obs_bearing);
-      hit.v[1] = pose.v[1] + obs_range * sin(pose.v[2] + obs_bearing);
+      hit.v[0] = pose.v[0] + obs_range * (pose_cos * data->bearing_cos[i] - pose_sin * data->bearing_sin[i]);
+      hit.v[1] = pose.v[1] + obs_range * (pose_sin * data->bearing_cos[i] + pose_cos * data->bearing_sin[i]);
 
       // Convert to map grid coords.
       int mi, mj;
@@ -412,6 +867,13 @@ double AMCLLaser::LikelihoodFieldModelProb(AMCLLaserData *data, pf_sample_set_t*
       if(!MAP_VALID(self->map, mi, mj)){
 	pz += self->z_hit * max_dist_prob;
       }
+      else if(!self->map->cells){
+	int code = self->map->occ_dist_codes[MAP_INDEX(self->map,mi,mj)];
+	if(code * self->map->occ_dist_step < beam_skip_distance){
+	  obs_count[beam_ind] += 1;
+	}
+	pz += self->z_hit * self->dist_lut[code];
+      }
       else{
 	z = self->map->cells[MAP_INDEX(self->map,mi,mj)].occ_dist;
 	if(z < beam_skip_distance){
@@ -439,56 +901,36 @@ double AMCLLaser::LikelihoodFieldModelProb(AMCLLaserData *data, pf_sample_set_t*
       }
     }
     if(!do_beamskip){
-      sample->weight *= exp(log_p);
-      total_weight += sample->weight;
+      set->weight[j] *= exp(log_p);
     }
   }
-  
-  if(do_beamskip){
-    int skipped_beam_count = 0; 
-    for (beam_ind = 0; beam_ind < self->max_beams; beam_ind++){
-      if((obs_count[beam_ind] / static_cast<double>(set->sample_count)) > beam_skip_threshold){
-	obs_mask[beam_ind] = true;
-      }
-      else{
-	obs_mask[beam_ind] = false;
-	skipped_beam_count++; 
-      }
-    }
+}
 
-    //we check if there is at least a critical number of beams that agreed with the map 
-    //otherwise it probably indicates that the filter converged to a wrong solution
-    //if that's the case we integrate all the beams and hope the filter might converge to 
-    //the right solution
-    bool error = false; 
+void AMCLLaser::BeamSkipChunk(AMCLLaserData *data, pf_sample_set_t* set,
+                              bool *obs_mask, bool error,
+                              int num_chunks, int chunk)
+{
+  AMCLLaser *self;
+  int j, beam_ind;
+  int begin, end;
+  double log_p;
 
-    if(skipped_beam_count >= (beam_ind * self->beam_skip_error_threshold)){
-      fprintf(stderr, "Over %f%% of the observations were not in the map - pf may have converged to wrong pose - integrating all observations\n", (100 * self->beam_skip_error_threshold));
-      error = true; 
-    }
+  self = (AMCLLaser*) data->sensor;
 
-    for (j = 0; j < set->sample_count; j++)
-      {
-	sample = set->samples + j;
-	pose = sample->pose;
+  chunk_bounds(set->sample_count, num_chunks, chunk, &begin, &end);
+
+  for (j = begin; j < end; j++)
+  {
+    log_p = 0;
 
-	log_p = 0;
+    for (beam_ind = 0; beam_ind < self->max_beams; beam_ind++){
+      if(error || obs_mask[beam_ind]){
+        log_p += log(self->temp_obs[j][beam_ind]);
+      }
+    }
 
-	for (beam_ind = 0; beam_ind < self->max_beams; beam_ind++){
-	  if(error || obs_mask[beam_ind]){
-	    log_p += log(self->temp_obs[j][beam_ind]);
-	  }
-	}
-	
-	sample->weight *= exp(log_p);
-	
-	total_weight += sample->weight;
-      }      
+    set->weight[j] *= exp(log_p);
   }
-
-  delete [] obs_count; 
-  delete [] obs_mask;
-  return(total_weight);
 }
 
 void AMCLLaser::reallocTempData(int new_max_samples, int new_max_obs){
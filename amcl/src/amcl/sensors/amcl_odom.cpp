@@ -121,6 +121,14 @@ bool AMCLOdom::UpdateAction(pf_t *pf, AMCLSensorData *data)
   set = pf->sets + pf->current_set;
   pf_vector_t old_pose = pf_vector_sub(ndata->pose, ndata->delta);
 
+  // Draw the noise of all three motion components for the whole set at
+  // once; each model scales these by its standard deviations
+  this->noise.resize(3 * std::max(set->sample_count, 1));
+  pf_ran_gaussian_batch(&this->noise[0], 3 * set->sample_count);
+  const double *noise1 = &this->noise[0];
+  const double *noise2 = noise1 + set->sample_count;
+  const double *noise3 = noise2 + set->sample_count;
+
   switch( this->model_type )
   {
   case ODOM_MODEL_OMNI:
@@ -142,23 +150,21 @@ bool AMCLOdom::UpdateAction(pf_t *pf, AMCLSensorData *data)
 
     for (int i = 0; i < set->sample_count; i++)
     {
-      pf_sample_t* sample = set->samples + i;
-
       delta_bearing = angle_diff(atan2(ndata->delta.v[1], ndata->delta.v[0]),
-                                 old_pose.v[2]) + sample->pose.v[2];
+                                 old_pose.v[2]) + set->theta[i];
       double cs_bearing = cos(delta_bearing);
       double sn_bearing = sin(delta_bearing);
 
       // Sample pose differences
-      delta_trans_hat = delta_trans + pf_ran_gaussian(trans_hat_stddev);
-      delta_rot_hat = delta_rot + pf_ran_gaussian(rot_hat_stddev);
-      delta_strafe_hat = 0 + pf_ran_gaussian(strafe_hat_stddev);
+      delta_trans_hat = delta_trans + trans_hat_stddev * noise1[i];
+      delta_rot_hat = delta_rot + rot_hat_stddev * noise2[i];
+      delta_strafe_hat = 0 + strafe_hat_stddev * noise3[i];
       // Apply sampled update to particle pose
-      sample->pose.v[0] += (delta_trans_hat * cs_bearing + 
-                            delta_strafe_hat * sn_bearing);
-      sample->pose.v[1] += (delta_trans_hat * sn_bearing - 
-                            delta_strafe_hat * cs_bearing);
-      sample->pose.v[2] += delta_rot_hat ;
+      set->x[i] += (delta_trans_hat * cs_bearing + 
+                    delta_strafe_hat * sn_bearing);
+      set->y[i] += (delta_trans_hat * sn_bearing - 
+                    delta_strafe_hat * cs_bearing);
+      set->theta[i] += delta_rot_hat ;
     }
   }
   break;
@@ -191,26 +197,24 @@ bool AMCLOdom::UpdateAction(pf_t *pf, AMCLSensorData *data)
 
     for (int i = 0; i < set->sample_count; i++)
     {
-      pf_sample_t* sample = set->samples + i;
-
       // Sample pose differences
       delta_rot1_hat = angle_diff(delta_rot1,
-                                  pf_ran_gaussian(this->alpha1*delta_rot1_noise*delta_rot1_noise +
-                                                  this->alpha2*delta_trans*delta_trans));
+                                  (this->alpha1*delta_rot1_noise*delta_rot1_noise +
+                                   this->alpha2*delta_trans*delta_trans) * noise1[i]);
       delta_trans_hat = delta_trans - 
-              pf_ran_gaussian(this->alpha3*delta_trans*delta_trans +
-                              this->alpha4*delta_rot1_noise*delta_rot1_noise +
-                              this->alpha4*delta_rot2_noise*delta_rot2_noise);
+              (this->alpha3*delta_trans*delta_trans +
+               this->alpha4*delta_rot1_noise*delta_rot1_noise +
+               this->alpha4*delta_rot2_noise*delta_rot2_noise) * noise2[i];
       delta_rot2_hat = angle_diff(delta_rot2,
-                                  pf_ran_gaussian(this->alpha1*delta_rot2_noise*delta_rot2_noise +
-                                                  this->alpha2*delta_trans*delta_trans));
+                                  (this->alpha1*delta_rot2_noise*delta_rot2_noise +
+                                   this->alpha2*delta_trans*delta_trans) * noise3[i]);
 
       // Apply sampled update to particle pose
-      sample->pose.v[0] += delta_trans_hat * 
-              cos(sample->pose.v[2] + delta_rot1_hat);
-      sample->pose.v[1] += delta_trans_hat * 
-              sin(sample->pose.v[2] + delta_rot1_hat);
-      sample->pose.v[2] += delta_rot1_hat + delta_rot2_hat;
+      set->x[i] += delta_trans_hat * 
+              cos(set->theta[i] + delta_rot1_hat);
+      set->y[i] += delta_trans_hat * 
+              sin(set->theta[i] + delta_rot1_hat);
+      set->theta[i] += delta_rot1_hat + delta_rot2_hat;
     }
   }
   break;
@@ -233,23 +237,21 @@ bool AMCLOdom::UpdateAction(pf_t *pf, AMCLSensorData *data)
 
     for (int i = 0; i < set->sample_count; i++)
     {
-      pf_sample_t* sample = set->samples + i;
-
       delta_bearing = angle_diff(atan2(ndata->delta.v[1], ndata->delta.v[0]),
-                                 old_pose.v[2]) + sample->pose.v[2];
+                                 old_pose.v[2]) + set->theta[i];
       double cs_bearing = cos(delta_bearing);
       double sn_bearing = sin(delta_bearing);
 
       // Sample pose differences
-      delta_trans_hat = delta_trans + pf_ran_gaussian(trans_hat_stddev);
-      delta_rot_hat = delta_rot + pf_ran_gaussian(rot_hat_stddev);
-      delta_strafe_hat = 0 + pf_ran_gaussian(strafe_hat_stddev);
+      delta_trans_hat = delta_trans + trans_hat_stddev * noise1[i];
+      delta_rot_hat = delta_rot + rot_hat_stddev * noise2[i];
+      delta_strafe_hat = 0 + strafe_hat_stddev * noise3[i];
       // Apply sampled update to particle pose
-      sample->pose.v[0] += (delta_trans_hat * cs_bearing + 
-                            delta_strafe_hat * sn_bearing);
-      sample->pose.v[1] += (delta_trans_hat * sn_bearing - 
-                            delta_strafe_hat * cs_bearing);
-      sample->pose.v[2] += delta_rot_hat ;
+      set->x[i] += (delta_trans_hat * cs_bearing + 
+                    delta_strafe_hat * sn_bearing);
+      set->y[i] += (delta_trans_hat * sn_bearing - 
+                    delta_strafe_hat * cs_bearing);
+      set->theta[i] += delta_rot_hat ;
     }
   }
   break;
@@ -282,26 +284,24 @@ bool AMCLOdom::UpdateAction(pf_t *pf, AMCLSensorData *data)
 
     for (int i = 0; i < set->sample_count; i++)
     {
-      pf_sample_t* sample = set->samples + i;
-
       // Sample pose differences
       delta_rot1_hat = angle_diff(delta_rot1,
-                                  pf_ran_gaussian(sqrt(this->alpha1*delta_rot1_noise*delta_rot1_noise +
-                                                       this->alpha2*delta_trans*delta_trans)));
+                                  sqrt(this->alpha1*delta_rot1_noise*delta_rot1_noise +
+                                       this->alpha2*delta_trans*delta_trans) * noise1[i]);
       delta_trans_hat = delta_trans - 
-              pf_ran_gaussian(sqrt(this->alpha3*delta_trans*delta_trans +
-                                   this->alpha4*delta_rot1_noise*delta_rot1_noise +
-                                   this->alpha4*delta_rot2_noise*delta_rot2_noise));
+              sqrt(this->alpha3*delta_trans*delta_trans +
+                   this->alpha4*delta_rot1_noise*delta_rot1_noise +
+                   this->alpha4*delta_rot2_noise*delta_rot2_noise) * noise2[i];
       delta_rot2_hat = angle_diff(delta_rot2,
-                                  pf_ran_gaussian(sqrt(this->alpha1*delta_rot2_noise*delta_rot2_noise +
-                                                       this->alpha2*delta_trans*delta_trans)));
+                                  sqrt(this->alpha1*delta_rot2_noise*delta_rot2_noise +
+                                       this->alpha2*delta_trans*delta_trans) * noise3[i]);
 
       // Apply sampled update to particle pose
-      sample->pose.v[0] += delta_trans_hat * 
-              cos(sample->pose.v[2] + delta_rot1_hat);
-      sample->pose.v[1] += delta_trans_hat * 
-              sin(sample->pose.v[2] + delta_rot1_hat);
-      sample->pose.v[2] += delta_rot1_hat + delta_rot2_hat;
+      set->x[i] += delta_trans_hat * 
+              cos(set->theta[i] + delta_rot1_hat);
+      set->y[i] += delta_trans_hat * 
+              sin(set->theta[i] + delta_rot1_hat);
+      set->theta[i] += delta_rot1_hat + delta_rot2_hat;
     }
   }
   break;
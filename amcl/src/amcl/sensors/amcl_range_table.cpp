@@ -0,0 +1,215 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Precomputed expected ranges for the beam model
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include "amcl_range_table.h"
+
+using namespace amcl;
+
+// Bounds on the number of directions per cell
+#define RANGE_TABLE_MIN_ANGLES 8
+#define RANGE_TABLE_MAX_ANGLES 1440
+
+////////////////////////////////////////////////////////////////////////////////
+// Work out the angular resolution from the memory budget
+AMCLRangeTable::AMCLRangeTable(map_t *map, size_t max_bytes) :
+  map(map), max_range(0.0), range_step(0.0)
+{
+  int i, j, ti;
+
+  this->tiles_x = (map->size_x + tile_size - 1) / tile_size;
+  this->tiles_y = (map->size_y + tile_size - 1) / tile_size;
+  this->tiles.assign(this->tiles_x * this->tiles_y, (uint16_t*) NULL);
+
+  // Only tiles with some free space can ever hold a particle
+  std::vector<bool> has_free(this->tiles.size(), false);
+  for (j = 0; j < map->size_y; j++)
+    for (i = 0; i < map->size_x; i++)
+      if (MAP_OCC_STATE(map, MAP_INDEX(map, i, j)) == -1)
+        has_free[(j / tile_size) * this->tiles_x + i / tile_size] = true;
+
+  size_t free_tiles = 0;
+  for (ti = 0; ti < (int) has_free.size(); ti++)
+    if (has_free[ti])
+      free_tiles++;
+  if (free_tiles == 0)
+    free_tiles = 1;
+
+  double angles = (double) max_bytes /
+    ((double) free_tiles * tile_size * tile_size * sizeof(uint16_t));
+  if (angles < RANGE_TABLE_MIN_ANGLES)
+    angles = RANGE_TABLE_MIN_ANGLES;
+  if (angles > RANGE_TABLE_MAX_ANGLES)
+    angles = RANGE_TABLE_MAX_ANGLES;
+
+  this->angle_count = (int) angles;
+  this->angle_step = 2 * M_PI / this->angle_count;
+}
+
+AMCLRangeTable::~AMCLRangeTable()
+{
+  for (size_t t = 0; t < this->tiles.size(); t++)
+    delete[] this->tiles[t];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Build whatever tiles this sample set needs
+void AMCLRangeTable::Prepare(pf_sample_set_t *set, const pf_vector_t& laser_pose,
+                             double max_range, AMCLThreadPool *pool)
+{
+  int j, t;
+  pf_vector_t pose;
+
+  // Codes are relative to max_range, so a longer range invalidates them
+  if (max_range > this->max_range)
+  {
+    for (t = 0; t < (int) this->tiles.size(); t++)
+    {
+      delete[] this->tiles[t];
+      this->tiles[t] = NULL;
+    }
+    this->max_range = max_range;
+    this->range_step = max_range / UINT16_MAX;
+  }
+
+  std::vector<int> todo;
+  for (j = 0; j < set->sample_count; j++)
+  {
+    pose = pf_vector_coord_add(laser_pose, pf_sample_get_pose(set, j));
+    int gi = MAP_GXWX(this->map, pose.v[0]);
+    int gj = MAP_GYWY(this->map, pose.v[1]);
+    if (!MAP_VALID(this->map, gi, gj))
+      continue;
+    t = (gj / tile_size) * this->tiles_x + gi / tile_size;
+    if (this->tiles[t])
+      continue;
+
+    // Allocate here, so that the workers never touch the tile vector
+    this->tiles[t] = new uint16_t[tile_size * tile_size * this->angle_count];
+    todo.push_back(t);
+  }
+
+  if (todo.empty())
+    return;
+
+  pool->Run(boost::bind(&AMCLRangeTable::BuildTiles, this,
+                        boost::cref(todo), pool->Size(), _1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Ray cast every direction from every cell of our share of the tiles
+void AMCLRangeTable::BuildTiles(const std::vector<int>& todo,
+                                int num_chunks, int chunk)
+{
+  int n, i, j, k, ci, cj;
+  double ox, oy, range, code;
+
+  for (n = chunk; n < (int) todo.size(); n += num_chunks)
+  {
+    int t = todo[n];
+    uint16_t *tile = this->tiles[t];
+    int ti = (t % this->tiles_x) * tile_size;
+    int tj = (t / this->tiles_x) * tile_size;
+
+    for (cj = 0; cj < tile_size; cj++)
+    {
+      for (ci = 0; ci < tile_size; ci++)
+      {
+        uint16_t *cell = tile + (cj * tile_size + ci) * this->angle_count;
+        i = ti + ci;
+        j = tj + cj;
+
+        // Rays starting outside the map or in a non-free cell have zero
+        // length, as in map_calc_range()
+        if (!MAP_VALID(this->map, i, j) ||
+            MAP_OCC_STATE(this->map, MAP_INDEX(this->map, i, j)) > -1)
+        {
+          memset(cell, 0, this->angle_count * sizeof(uint16_t));
+          continue;
+        }
+
+        ox = MAP_WXGX(this->map, i);
+        oy = MAP_WYGY(this->map, j);
+        for (k = 0; k < this->angle_count; k++)
+        {
+          range = map_calc_range(this->map, ox, oy, k * this->angle_step,
+                                 this->max_range);
+          code = floor(range / this->range_step + 0.5);
+          if (code > UINT16_MAX)
+            code = UINT16_MAX;
+          cell[k] = (uint16_t) code;
+        }
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Look up the nearest cell and direction
+double AMCLRangeTable::Lookup(double ox, double oy, double oa) const
+{
+  int i = MAP_GXWX(this->map, ox);
+  int j = MAP_GYWY(this->map, oy);
+  if (!MAP_VALID(this->map, i, j))
+    return 0.0;
+
+  const uint16_t *tile = this->tiles[(j / tile_size) * this->tiles_x + i / tile_size];
+  if (!tile)
+    return map_calc_range(this->map, ox, oy, oa, this->max_range);
+
+  int k = (int) floor((oa - 2 * M_PI * floor(oa / (2 * M_PI))) / this->angle_step + 0.5);
+  if (k >= this->angle_count)
+    k -= this->angle_count;
+
+  int cell = (j % tile_size) * tile_size + i % tile_size;
+  return tile[cell * this->angle_count + k] * this->range_step;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Only rays that start within max_range of the patch can cross it
+void AMCLRangeTable::Invalidate(int x0, int y0, int width, int height)
+{
+  int r = (int) ceil(this->max_range / this->map->scale) + 1;
+  int ti0 = std::max(x0 - r, 0) / tile_size;
+  int tj0 = std::max(y0 - r, 0) / tile_size;
+  int ti1 = std::min((x0 + width + r) / tile_size, this->tiles_x - 1);
+  int tj1 = std::min((y0 + height + r) / tile_size, this->tiles_y - 1);
+
+  for (int tj = tj0; tj <= tj1; tj++)
+  {
+    for (int ti = ti0; ti <= ti1; ti++)
+    {
+      int t = tj * this->tiles_x + ti;
+      delete[] this->tiles[t];
+      this->tiles[t] = NULL;
+    }
+  }
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Local correlative scan matching around a pose estimate
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "amcl_scan_matcher.h"
+
+using namespace amcl;
+
+// Grid steps either side of the centre on each axis
+#define SCAN_MATCH_STEPS 2
+#define SCAN_MATCH_SIDE (2 * SCAN_MATCH_STEPS + 1)
+
+AMCLScanMatcher::AMCLScanMatcher(double linear_window, double angular_window,
+                                 int levels)
+{
+  this->linear_window = linear_window;
+  this->angular_window = angular_window;
+  this->levels = std::max(levels, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Score a grid about the best pose so far, then a finer one, and so on
+bool AMCLScanMatcher::Refine(AMCLLaserData *data, AMCLLaser *laser,
+                             pf_vector_t *pose)
+{
+  int n = SCAN_MATCH_SIDE * SCAN_MATCH_SIDE * SCAN_MATCH_SIDE;
+  // Index of the grid centre, which is the best pose so far
+  int centre = n / 2;
+
+  this->x.resize(n);
+  this->y.resize(n);
+  this->theta.resize(n);
+  this->weight.resize(n);
+
+  pf_sample_set_t set;
+  memset(&set, 0, sizeof(set));
+  set.sample_count = n;
+  set.x = &this->x[0];
+  set.y = &this->y[0];
+  set.theta = &this->theta[0];
+  set.weight = &this->weight[0];
+
+  pf_vector_t best = *pose;
+  double start_score = 0.0, best_score = 0.0;
+  double step = this->linear_window / SCAN_MATCH_STEPS;
+  double angle_step = this->angular_window / SCAN_MATCH_STEPS;
+  for(int l = 0; l < this->levels; l++)
+  {
+    int i = 0;
+    for(int dk = -SCAN_MATCH_STEPS; dk <= SCAN_MATCH_STEPS; dk++)
+    {
+      for(int dj = -SCAN_MATCH_STEPS; dj <= SCAN_MATCH_STEPS; dj++)
+      {
+        for(int di = -SCAN_MATCH_STEPS; di <= SCAN_MATCH_STEPS; di++, i++)
+        {
+          set.x[i] = best.v[0] + di * step;
+          set.y[i] = best.v[1] + dj * step;
+          set.theta[i] = best.v[2] + dk * angle_step;
+          set.weight[i] = 1.0;
+        }
+      }
+    }
+
+    laser->ScoreSamples(data, &set);
+
+    // Ties stay with the centre, so a flat score never walks the pose away
+    int best_i = centre;
+    for(i = 0; i < n; i++)
+      if(set.weight[i] > set.weight[best_i])
+        best_i = i;
+    if(l == 0)
+      start_score = set.weight[centre];
+    best_score = set.weight[best_i];
+    best = pf_sample_get_pose(&set, best_i);
+
+    step /= 2;
+    angle_step /= 2;
+  }
+
+  if(!(best_score > start_score))
+    return false;
+  best.v[2] = atan2(sin(best.v[2]), cos(best.v[2]));
+  *pose = best;
+  return true;
+}
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Splits the AMCL sensor models between the executor threads
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include "amcl_thread_pool.h"
+
+using namespace amcl;
+
+////////////////////////////////////////////////////////////////////////////////
+// The tasks share the workers of the executor with the rest of the process
+AMCLThreadPool::AMCLThreadPool(int num_threads)
+{
+  if(num_threads < 1)
+    num_threads = 1;
+  this->num_threads = num_threads;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Run every task, the executor handing to its workers those it can
+void AMCLThreadPool::Run(const boost::function<void (int)>& task)
+{
+  if(num_threads == 1)
+  {
+    task(0);
+    return;
+  }
+
+  nav_executor::Executor::shared().run(nav_executor::LANE_LOCALIZATION,
+                                       num_threads, task);
+}
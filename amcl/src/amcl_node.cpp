@@ -22,33 +22,51 @@
 
 #include <algorithm>
 #include <vector>
+#include <deque>
 #include <map>
 #include <cmath>
 
 #include <boost/bind.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 // Signal handling
 #include <signal.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <time.h>
 
 #include "map/map.h"
 #include "pf/pf.h"
+#include "pf/pf_pdf.h"
 #include "sensors/amcl_odom.h"
 #include "sensors/amcl_laser.h"
+#include "sensors/amcl_global_localizer.h"
+#include "sensors/amcl_scan_matcher.h"
 
 #include "ros/assert.h"
 
 // roscpp
 #include "ros/ros.h"
+#include "ros/callback_queue.h"
+
+// Tracepoints
+#include "nav_executor/memory.h"
+#include "nav_executor/trace.h"
 
 // Messages that I need
 #include "sensor_msgs/LaserScan.h"
 #include "geometry_msgs/PoseWithCovarianceStamped.h"
 #include "geometry_msgs/PoseArray.h"
 #include "geometry_msgs/Pose.h"
+#include "geometry_msgs/PoseStamped.h"
 #include "nav_msgs/GetMap.h"
 #include "nav_msgs/SetMap.h"
+#include "nav_msgs/Odometry.h"
+#include "map_msgs/OccupancyGridUpdate.h"
 #include "std_srvs/Empty.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
 
 // For transform support
 #include "tf/transform_broadcaster.h"
@@ -66,6 +84,11 @@
 #include <rosbag/view.h>
 #include <boost/foreach.hpp>
 
+#ifdef AMCL_NODELET
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#endif
+
 #define NEW_UNIFORM_SAMPLING 1
 
 using namespace amcl;
@@ -107,16 +130,98 @@ angle_diff(double a, double b)
 
 static const std::string scan_topic_ = "scan";
 
+// Stages of laserReceived that are timed when timing is enabled
+enum
+{
+  TIMING_ODOM,
+  TIMING_ACTION,
+  TIMING_SENSOR,
+  TIMING_RESAMPLE,
+  TIMING_SCAN_MATCH,
+  TIMING_CLUSTERS,
+  TIMING_TF,
+  TIMING_TOTAL,
+  TIMING_STAGE_COUNT
+};
+
+static const char* timing_stage_names[TIMING_STAGE_COUNT] =
+{
+  "odometry", "action update", "sensor update", "resample",
+  "scan match", "cluster stats", "tf broadcast", "total"
+};
+
+// Rolling window of the durations of one stage
+class StageTimes
+{
+  public:
+    StageTimes() : next_(0), count_(0) {}
+
+    void add(double seconds)
+    {
+      samples_[next_] = seconds;
+      next_ = (next_ + 1) % window_;
+      if(count_ < window_)
+        count_++;
+    }
+
+    // Median, 95th percentile and maximum over the window, in seconds;
+    // returns false if nothing has been timed yet
+    bool summarize(double* p50, double* p95, double* max) const
+    {
+      if(count_ == 0)
+        return false;
+      std::vector<double> sorted(samples_, samples_ + count_);
+      std::sort(sorted.begin(), sorted.end());
+      *p50 = sorted[(count_ - 1) / 2];
+      *p95 = sorted[(count_ - 1) * 95 / 100];
+      *max = sorted[count_ - 1];
+      return true;
+    }
+
+  private:
+    static const int window_ = 256;
+    double samples_[window_];
+    int next_, count_;
+};
+
+// Adds the lifetime of the enclosing scope to a stage, out of the given
+// array of them; a NULL array (timing disabled) costs one test.  The
+// stage is traced either way (see nav_executor/trace.h).
+class ScopedStageTimer
+{
+  public:
+    ScopedStageTimer(StageTimes* stages, int stage)
+      : stage_(stages ? &stages[stage] : NULL), id_(stage)
+    {
+      NAV_TRACE1(amcl, stage_begin, id_);
+      if(stage_)
+        start_ = ros::WallTime::now();
+    }
+    ~ScopedStageTimer()
+    {
+      if(stage_)
+        stage_->add((ros::WallTime::now() - start_).toSec());
+      NAV_TRACE1(amcl, stage_end, id_);
+    }
+
+  private:
+    StageTimes* stage_;
+    int id_;
+    ros::WallTime start_;
+};
+
 class AmclNode
 {
   public:
-    AmclNode();
+    // A nodelet passes in its own node handles
+    AmclNode(const ros::NodeHandle& nh = ros::NodeHandle(),
+             const ros::NodeHandle& private_nh = ros::NodeHandle("~"));
     ~AmclNode();
 
     /**
      * @brief Uses TF and LaserScan messages from bag file to drive AMCL instead
      */
-    void runFromBag(const std::string &in_bag_fn);
+    void runFromBag(const std::string &in_bag_fn, bool benchmark = false);
 
     int process();
     void savePoseToServer();
@@ -137,12 +242,67 @@ class AmclNode
     tf::Transform latest_tf_;
     bool latest_tf_valid_;
 
+    // Pose at odometry rate: the last filter estimate, through latest_tf_,
+    // composed with each message on extrapolation_odom_topic and published
+    // on amcl_pose_extrapolated.  The messages are taken on a queue and
+    // thread of their own, so they never wait on a filter update.
+    ros::CallbackQueue extrapolation_queue_;
+    ros::AsyncSpinner* extrapolation_spinner_;
+    ros::Subscriber extrapolation_odom_sub_;
+    ros::Publisher extrapolation_pub_;
+    boost::mutex extrapolation_mutex_;
+    tf::Transform extrapolation_tf_;	// copy of latest_tf_, for the thread
+    boost::array<double, 36> extrapolation_cov_;
+    std::string extrapolation_odom_frame_, extrapolation_global_frame_;
+    bool extrapolation_valid_;
+    void extrapolationOdomReceived(const nav_msgs::OdometryConstPtr& odom);
+    // Stop extrapolating until the next filter update, once the estimate
+    // the last one left no longer holds
+    void invalidateExtrapolation();
+
+    // Scan pipeline (pipeline_scans): laserReceived() only looks up where
+    // the robot was for the scan and queues it, and a thread of its own
+    // updates the filter and then publishes the cloud with the
+    // configuration mutex let go.  The lookup for the next scan so overlaps
+    // the update of this one.  At most one scan per laser waits; a newer
+    // one from the same laser replaces it.
+    struct PreparedScan
+    {
+      sensor_msgs::LaserScanConstPtr scan;
+      tf::Stamped<tf::Pose> odom_pose;
+      double odom_seconds;  // the lookup, for the thread to add to the timing
+    };
+    boost::thread* pipeline_thread_;
+    boost::mutex pipeline_mutex_;
+    boost::condition_variable pipeline_cond_;
+    std::deque<PreparedScan> pipeline_queue_;
+    bool pipeline_stop_;
+    bool pipeline_busy_;  // a scan is being processed
+    int pipeline_dropped_;
+    void pipelineLoop();
+    void stopPipeline();
+    // Wait until every queued scan is in the filter
+    void waitForPipeline();
+
     // Pose-generating function used to uniformly distribute particles over
     // the map
     static pf_vector_t uniformPoseGenerator(void* arg);
 #if NEW_UNIFORM_SAMPLING
-    static std::vector<std::pair<int,int> > free_space_indices;
+    // Cell indices (MAP_INDEX) of the free cells of free_space_map, so a
+    // uniform pose is one random draw; rebuilt on first use after the map
+    // changes
+    static std::vector<int> free_space_indices;
+    static map_t* free_space_map;
+    static void updateFreeSpaceIndices(map_t* map);
 #endif
+    // Coarse-to-fine global localization: the request is served from the
+    // next scan, which seeds the filter around the best hypotheses
+    static pf_vector_t hypothesisPoseGenerator(void* arg);
+    void seedGlobalLocalization(AMCLLaserData* ldata, AMCLLaser* laser);
+    AMCLGlobalLocalizer* global_localizer_;
+    std::vector<pf_vector_t> global_hypotheses_;
+    bool global_localization_pending_;
+
     // Callbacks
     bool globalLocalizationCallback(std_srvs::Empty::Request& req,
                                     std_srvs::Empty::Response& res);
@@ -152,9 +312,21 @@ class AmclNode
                         nav_msgs::SetMap::Response& res);
 
     void laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan);
+    // Update the filter with the scan and publish the particle cloud;
+    // prepared has where the robot was for it, or is NULL to look that up
+    void processScan(const sensor_msgs::LaserScanConstPtr& laser_scan,
+                     const PreparedScan* prepared);
+    // Update the filter with the scan, filling cloud with the poses to
+    // publish on particlecloud if it is due
+    void updateFromLaser(const sensor_msgs::LaserScanConstPtr& laser_scan,
+                         const PreparedScan* prepared,
+                         std::vector<pf_vector_t>* cloud, std_msgs::Header* cloud_header);
+    void publishParticleCloud(const std::vector<pf_vector_t>& cloud,
+                              const std_msgs::Header& header);
     void initialPoseReceived(const geometry_msgs::PoseWithCovarianceStampedConstPtr& msg);
     void handleInitialPoseMessage(const geometry_msgs::PoseWithCovarianceStamped& msg);
     void mapReceived(const nav_msgs::OccupancyGridConstPtr& msg);
+    void mapUpdateReceived(const map_msgs::OccupancyGridUpdateConstPtr& msg);
 
     void handleMapMessage(const nav_msgs::OccupancyGrid& msg);
     void freeMapDependentMemory();
@@ -173,9 +345,15 @@ class AmclNode
     //parameter for what base to use
     std::string base_frame_id_;
     std::string global_frame_id_;
+    // Guards odom_frame_id_ and base_frame_id_ for laserReceived(), which
+    // doesn't take configuration_mutex_ with the scan pipeline on
+    boost::mutex frame_ids_mutex_;
 
     bool use_map_topic_;
     bool first_map_only_;
+    // Patch the map from map_updates rather than waiting for a new map
+    bool use_map_updates_;
+    bool compact_map_;
 
     ros::Duration gui_publish_period;
     ros::Time save_pose_last_time;
@@ -184,6 +362,13 @@ class AmclNode
     geometry_msgs::PoseWithCovarianceStamped last_published_pose;
 
     map_t* map_;
+    nav_executor::MemoryCounter map_memory_; // the cells and likelihood fields of map_ and resident_maps_
+    // Maps replaced by a new one, most recent first, kept with their
+    // likelihood fields so that switching back, e.g. to another floor
+    // served by map_server's switch_map, takes no rebuild
+    std::deque<map_t*> resident_maps_;
+    int max_resident_maps_;
+    void accountMapMemory();
     char* mapdata;
     int sx, sy;
     double resolution;
@@ -195,6 +380,19 @@ class AmclNode
     std::vector< bool > lasers_update_;
     std::map< std::string, int > frame_to_laser_;
 
+    // Beam geometry of each laser, kept while the number and angles of its
+    // beams stay the same: the bearings in the base frame with their cos and
+    // sin, and the (range, bearing) pairs lent to the data of each scan
+    struct LaserBeams
+    {
+      LaserBeams() : count(-1), angle_min(0.0f), angle_increment(0.0f) {}
+      int count;
+      float angle_min, angle_increment;
+      std::vector<double> ranges;
+      std::vector<double> bearing_cos, bearing_sin;
+    };
+    std::vector<LaserBeams> laser_beams_;
+
     // Particle filter
     pf_t *pf_;
     double pf_err_, pf_z_;
@@ -212,18 +410,57 @@ class AmclNode
     AMCLOdom* odom_;
     AMCLLaser* laser_;
 
+    // Throttling of the particlecloud topic, which is only published while
+    // it has subscribers: at most once per cloud_pub_interval (0 for every
+    // update), with at most cloud_max_poses_ poses (0 for all) or the
+    // cluster means alone
     ros::Duration cloud_pub_interval;
     ros::Time last_cloud_pub_time;
+    int cloud_max_poses_;
+    bool cloud_clusters_;
 
     // For slowing play-back when reading directly from a bag file
     ros::WallDuration bag_scan_period_;
 
     void requestMap();
 
+    // Fill ldata with the scan, bearings in the base frame and the range
+    // limits applied
+    bool scanToLaserData(const sensor_msgs::LaserScanConstPtr& laser_scan,
+                         int laser_index, AMCLLaserData* ldata);
+
+    // Multi-laser fusion: the scans of all lasers within laser_fusion_window_
+    // of each other are merged into one sensor update (likelihood field
+    // models only), so the particles are weighted and resampled once per
+    // window rather than once per laser
+    struct FusedScan
+    {
+      std::string frame_id;
+      // Odometric pose of the robot when the scan was taken
+      pf_vector_t odom_pose;
+      // Usable beam endpoints in the base frame
+      std::vector<double> x, y;
+      double range_max;
+    };
+    double laser_fusion_window_;
+    std::vector<FusedScan> fused_scans_;
+    ros::Time fused_start_;
+    AMCLLaser* fused_laser_;
+    bool laserFusionEnabled() const
+    {
+      return laser_fusion_window_ > 0.0 && laser_model_type_ != LASER_MODEL_BEAM;
+    }
+    // Add the scan to the window; returns true once the window is complete
+    bool bufferFusedScan(const sensor_msgs::LaserScanConstPtr& laser_scan,
+                         int laser_index);
+    // Merge the window into a single scan from the robot at pose
+    void fuseScans(const pf_vector_t& pose, AMCLLaserData* ldata);
+
     // Helper to get odometric pose from transform system
     bool getOdomPose(tf::Stamped<tf::Pose>& pose,
                      double& x, double& y, double& yaw,
-                     const ros::Time& t, const std::string& f);
+                     const ros::Time& t, const std::string& f,
+                     const std::string& odom_frame);
 
     //time for tolerance on the published transform,
     //basically defines how long a map->odom transform is good for
@@ -233,11 +470,13 @@ class AmclNode
     ros::NodeHandle private_nh_;
     ros::Publisher pose_pub_;
     ros::Publisher particlecloud_pub_;
+    ros::Publisher timing_pub_;
     ros::ServiceServer global_loc_srv_;
     ros::ServiceServer nomotion_update_srv_; //to let amcl update samples without requiring motion
     ros::ServiceServer set_map_srv_;
     ros::Subscriber initial_pose_sub_old_;
     ros::Subscriber map_sub_;
+    ros::Subscriber map_update_sub_;
 
     amcl_hyp_t* initial_pose_hyp_;
     bool first_map_received_;
@@ -256,7 +495,22 @@ class AmclNode
     bool do_beamskip_;
     double beam_skip_distance_, beam_skip_threshold_, beam_skip_error_threshold_;
     double laser_likelihood_max_dist_;
+    int laser_model_threads_;
+    bool laser_model_vectorized_;
+    bool laser_adaptive_beams_;
+    bool laser_likelihood_edt_;
+    std::string likelihood_field_cache_dir_;
+    int laser_beam_range_table_mb_;
+    bool global_localization_coarse_to_fine_;
+    int global_localization_hypotheses_;
+    int global_localization_max_levels_;
+    // Scan-match refinement of the cluster means after each resample
+    bool scan_match_refinement_;
+    double scan_match_linear_window_, scan_match_angular_window_;
+    int scan_match_levels_;
     odom_model_t odom_model_type_;
+    pf_resample_model_t resample_type_;
+    double resample_n_eff_ratio_;
     double init_pose_[3];
     double init_cov_[3];
     laser_model_t laser_model_type_;
@@ -267,12 +521,60 @@ class AmclNode
     ros::Time last_laser_received_ts_;
     ros::Duration laser_check_interval_;
     void checkLaserReceived(const ros::TimerEvent& event);
+
+    // Per-stage timing of laserReceived, published on diagnostics every
+    // timing_publish_period_ seconds (never if it is not positive)
+    double timing_publish_period_;
+    StageTimes timing_[TIMING_STAGE_COUNT];
+    int timing_updates_;
+    ros::Timer timing_timer_;
+    StageTimes* stageTimes()
+    {
+      return timing_publish_period_ > 0.0 ? timing_ : NULL;
+    }
+    void publishTiming(const ros::TimerEvent& event);
 };
 
-std::vector<std::pair<int,int> > AmclNode::free_space_indices;
+#if NEW_UNIFORM_SAMPLING
+std::vector<int> AmclNode::free_space_indices;
+map_t* AmclNode::free_space_map = NULL;
+#endif
 
 #define USAGE "USAGE: amcl"
 
+// Default random seed of --benchmark-from-bag runs (overridden by the
+// random_seed parameter)
+#define BENCHMARK_RANDOM_SEED 1
+
+#ifdef AMCL_NODELET
+namespace amcl
+{
+
+// AMCL as a nodelet, so the map and scans published by nodelets in the same
+// manager are received without a copy; runs from ROS input only
+class AmclNodelet : public nodelet::Nodelet
+{
+  public:
+    virtual ~AmclNodelet()
+    {
+      // Save latest pose as we're unloaded
+      if (node_)
+        node_->savePoseToServer();
+    }
+
+  private:
+    virtual void onInit()
+    {
+      node_.reset(new AmclNode(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    boost::shared_ptr<AmclNode> node_;
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(amcl::AmclNodelet, nodelet::Nodelet)
+#else
 boost::shared_ptr<AmclNode> amcl_node_ptr;
 
 void sigintHandler(int sig)
@@ -291,6 +593,11 @@ main(int argc, char** argv)
   // Override default sigint handler
   signal(SIGINT, sigintHandler);
 
+  // Benchmark runs are repeatable: seed before the filter is created
+  bool benchmark = (argc == 3) && (std::string(argv[1]) == "--benchmark-from-bag");
+  if (benchmark)
+    pf_set_seed(BENCHMARK_RANDOM_SEED);
+
   // Make our node available to sigintHandler
   amcl_node_ptr.reset(new AmclNode());
 
@@ -303,6 +610,10 @@ main(int argc, char** argv)
   {
     amcl_node_ptr->runFromBag(argv[2]);
   }
+  else if (benchmark)
+  {
+    amcl_node_ptr->runFromBag(argv[2], true);
+  }
 
   // Without this, our boost locks are not shut down nicely
   amcl_node_ptr.reset();
@@ -310,16 +621,29 @@ main(int argc, char** argv)
   // To quote Morgan, Hooray!
   return(0);
 }
+#endif
 
-AmclNode::AmclNode() :
+AmclNode::AmclNode(const ros::NodeHandle& nh, const ros::NodeHandle& private_nh) :
         sent_first_transform_(false),
         latest_tf_valid_(false),
+        extrapolation_spinner_(NULL),
+        extrapolation_valid_(false),
+        pipeline_thread_(NULL),
+        pipeline_stop_(false),
+        pipeline_busy_(false),
+        pipeline_dropped_(0),
         map_(NULL),
+        map_memory_("amcl/map"),
         pf_(NULL),
         resample_count_(0),
         odom_(NULL),
         laser_(NULL),
-	      private_nh_("~"),
+        global_localizer_(NULL),
+        global_localization_pending_(false),
+        fused_laser_(NULL),
+        timing_updates_(0),
+        nh_(nh),
+        private_nh_(private_nh),
         initial_pose_hyp_(NULL),
         first_map_received_(false),
         first_reconfigure_call_(true)
@@ -329,6 +653,9 @@ AmclNode::AmclNode() :
   // Grab params off the param server
   private_nh_.param("use_map_topic", use_map_topic_, false);
   private_nh_.param("first_map_only", first_map_only_, false);
+  private_nh_.param("use_map_updates", use_map_updates_, false);
+  private_nh_.param("compact_map", compact_map_, false);
+  private_nh_.param("resident_maps", max_resident_maps_, 0);
 
   double tmp;
   private_nh_.param("gui_publish_rate", tmp, -1.0);
@@ -361,6 +688,21 @@ AmclNode::AmclNode() :
   private_nh_.param("laser_sigma_hit", sigma_hit_, 0.2);
   private_nh_.param("laser_lambda_short", lambda_short_, 0.1);
   private_nh_.param("laser_likelihood_max_dist", laser_likelihood_max_dist_, 2.0);
+  private_nh_.param("laser_model_threads", laser_model_threads_, 1);
+  private_nh_.param("laser_model_vectorized", laser_model_vectorized_, false);
+  private_nh_.param("laser_adaptive_beams", laser_adaptive_beams_, false);
+  private_nh_.param("laser_fusion_window", laser_fusion_window_, 0.0);
+  private_nh_.param("laser_likelihood_edt", laser_likelihood_edt_, false);
+  private_nh_.param("likelihood_field_cache_dir", likelihood_field_cache_dir_, std::string(""));
+  private_nh_.param("laser_beam_range_table_mb", laser_beam_range_table_mb_, 0);
+  private_nh_.param("global_localization_coarse_to_fine", global_localization_coarse_to_fine_, false);
+  private_nh_.param("global_localization_hypotheses", global_localization_hypotheses_, 1000);
+  private_nh_.param("global_localization_max_levels", global_localization_max_levels_, 5);
+  private_nh_.param("scan_match_refinement", scan_match_refinement_, false);
+  private_nh_.param("scan_match_linear_window", scan_match_linear_window_, 0.2);
+  private_nh_.param("scan_match_angular_window", scan_match_angular_window_, 0.1);
+  private_nh_.param("scan_match_levels", scan_match_levels_, 4);
+  private_nh_.param("timing_publish_period", timing_publish_period_, 0.0);
   std::string tmp_model_type;
   private_nh_.param("laser_model_type", tmp_model_type, std::string("likelihood_field"));
   if(tmp_model_type == "beam")
@@ -393,17 +735,35 @@ AmclNode::AmclNode() :
     odom_model_type_ = ODOM_MODEL_DIFF;
   }
 
+  private_nh_.param("resample_type", tmp_model_type, std::string("multinomial"));
+  if(tmp_model_type == "multinomial")
+    resample_type_ = PF_RESAMPLE_MULTINOMIAL;
+  else if(tmp_model_type == "systematic")
+    resample_type_ = PF_RESAMPLE_SYSTEMATIC;
+  else
+  {
+    ROS_WARN("Unknown resample type \"%s\"; defaulting to multinomial",
+             tmp_model_type.c_str());
+    resample_type_ = PF_RESAMPLE_MULTINOMIAL;
+  }
+
   private_nh_.param("update_min_d", d_thresh_, 0.2);
   private_nh_.param("update_min_a", a_thresh_, M_PI/6.0);
   private_nh_.param("odom_frame_id", odom_frame_id_, std::string("odom"));
   private_nh_.param("base_frame_id", base_frame_id_, std::string("base_link"));
   private_nh_.param("global_frame_id", global_frame_id_, std::string("map"));
   private_nh_.param("resample_interval", resample_interval_, 2);
+  private_nh_.param("resample_n_eff_ratio", resample_n_eff_ratio_, 0.0);
   double tmp_tol;
   private_nh_.param("transform_tolerance", tmp_tol, 0.1);
   private_nh_.param("recovery_alpha_slow", alpha_slow_, 0.001);
   private_nh_.param("recovery_alpha_fast", alpha_fast_, 0.1);
   private_nh_.param("tf_broadcast", tf_broadcast_, true);
+  double particlecloud_rate;
+  private_nh_.param("particlecloud_rate", particlecloud_rate, 0.0);
+  cloud_pub_interval = ros::Duration(particlecloud_rate > 0.0 ? 1.0 / particlecloud_rate : 0.0);
+  private_nh_.param("particlecloud_max_poses", cloud_max_poses_, 0);
+  private_nh_.param("particlecloud_clusters", cloud_clusters_, false);
 
   transform_tolerance_.fromSec(tmp_tol);
 
@@ -413,9 +773,14 @@ AmclNode::AmclNode() :
     bag_scan_period_.fromSec(bag_scan_period);
   }
 
+  // A fixed seed makes the filter repeatable; 0 seeds from the clock
+  int random_seed;
+  private_nh_.param("random_seed", random_seed, 0);
+  if (random_seed != 0)
+    pf_set_seed(random_seed);
+
   updatePoseFromServer();
 
-  cloud_pub_interval.fromSec(1.0);
   tfb_ = new tf::TransformBroadcaster();
   tf_ = new TransformListenerWrapper();
 
@@ -440,12 +805,14 @@ AmclNode::AmclNode() :
   if(use_map_topic_) {
     map_sub_ = nh_.subscribe("map", 1, &AmclNode::mapReceived, this);
     ROS_INFO("Subscribed to map topic.");
+    if(use_map_updates_)
+      map_update_sub_ = nh_.subscribe("map_updates", 10, &AmclNode::mapUpdateReceived, this);
   } else {
     requestMap();
   }
   m_force_update = false;
 
-  dsrv_ = new dynamic_reconfigure::Server<amcl::AMCLConfig>(ros::NodeHandle("~"));
+  dsrv_ = new dynamic_reconfigure::Server<amcl::AMCLConfig>(private_nh_);
   dynamic_reconfigure::Server<amcl::AMCLConfig>::CallbackType cb = boost::bind(&AmclNode::reconfigureCB, this, _1, _2);
   dsrv_->setCallback(cb);
 
@@ -453,6 +820,34 @@ AmclNode::AmclNode() :
   laser_check_interval_ = ros::Duration(15.0);
   check_laser_timer_ = nh_.createTimer(laser_check_interval_, 
                                        boost::bind(&AmclNode::checkLaserReceived, this, _1));
+
+  if(timing_publish_period_ > 0.0)
+  {
+    timing_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+    timing_timer_ = nh_.createTimer(ros::Duration(timing_publish_period_),
+                                    boost::bind(&AmclNode::publishTiming, this, _1));
+  }
+
+  std::string extrapolation_odom_topic;
+  private_nh_.param("extrapolation_odom_topic", extrapolation_odom_topic, std::string(""));
+  if(!extrapolation_odom_topic.empty())
+  {
+    extrapolation_pub_ = nh_.advertise<geometry_msgs::PoseWithCovarianceStamped>("amcl_pose_extrapolated", 10);
+    ros::SubscribeOptions ops =
+            ros::SubscribeOptions::create<nav_msgs::Odometry>(extrapolation_odom_topic, 10,
+                                                              boost::bind(&AmclNode::extrapolationOdomReceived,
+                                                                          this, _1),
+                                                              ros::VoidPtr(), &extrapolation_queue_);
+    ops.transport_hints = ros::TransportHints().tcpNoDelay();
+    extrapolation_odom_sub_ = nh_.subscribe(ops);
+    extrapolation_spinner_ = new ros::AsyncSpinner(1, &extrapolation_queue_);
+    extrapolation_spinner_->start();
+  }
+
+  bool pipeline_scans;
+  private_nh_.param("pipeline_scans", pipeline_scans, false);
+  if(pipeline_scans)
+    pipeline_thread_ = new boost::thread(boost::bind(&AmclNode::pipelineLoop, this));
 }
 
 void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
@@ -478,6 +873,7 @@ void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
   a_thresh_ = config.update_min_a;
 
   resample_interval_ = config.resample_interval;
+  resample_n_eff_ratio_ = config.resample_n_eff_ratio;
 
   laser_min_range_ = config.laser_min_range;
   laser_max_range_ = config.laser_max_range;
@@ -501,6 +897,19 @@ void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
   sigma_hit_ = config.laser_sigma_hit;
   lambda_short_ = config.laser_lambda_short;
   laser_likelihood_max_dist_ = config.laser_likelihood_max_dist;
+  laser_model_threads_ = config.laser_model_threads;
+  laser_model_vectorized_ = config.laser_model_vectorized;
+  laser_adaptive_beams_ = config.laser_adaptive_beams;
+  laser_fusion_window_ = config.laser_fusion_window;
+  laser_likelihood_edt_ = config.laser_likelihood_edt;
+  laser_beam_range_table_mb_ = config.laser_beam_range_table_mb;
+  global_localization_coarse_to_fine_ = config.global_localization_coarse_to_fine;
+  global_localization_hypotheses_ = config.global_localization_hypotheses;
+  global_localization_max_levels_ = config.global_localization_max_levels;
+  scan_match_refinement_ = config.scan_match_refinement;
+  scan_match_linear_window_ = config.scan_match_linear_window;
+  scan_match_angular_window_ = config.scan_match_angular_window;
+  scan_match_levels_ = config.scan_match_levels;
 
   if(config.laser_model_type == "beam")
     laser_model_type_ = LASER_MODEL_BEAM;
@@ -518,6 +927,11 @@ void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
   else if(config.odom_model_type == "omni-corrected")
     odom_model_type_ = ODOM_MODEL_OMNI_CORRECTED;
 
+  if(config.resample_type == "multinomial")
+    resample_type_ = PF_RESAMPLE_MULTINOMIAL;
+  else if(config.resample_type == "systematic")
+    resample_type_ = PF_RESAMPLE_SYSTEMATIC;
+
   if(config.min_particles > config.max_particles)
   {
     ROS_WARN("You've set min_particles to be greater than max particles, this isn't allowed so they'll be set to be equal.");
@@ -529,6 +943,9 @@ void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
   alpha_slow_ = config.recovery_alpha_slow;
   alpha_fast_ = config.recovery_alpha_fast;
   tf_broadcast_ = config.tf_broadcast;
+  cloud_pub_interval = ros::Duration(config.particlecloud_rate > 0.0 ? 1.0 / config.particlecloud_rate : 0.0);
+  cloud_max_poses_ = config.particlecloud_max_poses;
+  cloud_clusters_ = config.particlecloud_clusters;
 
   do_beamskip_= config.do_beamskip; 
   beam_skip_distance_ = config.beam_skip_distance; 
@@ -542,6 +959,8 @@ void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
   pf_z_ = config.kld_z; 
   pf_->pop_err = pf_err_;
   pf_->pop_z = pf_z_;
+  pf_->resample_model = resample_type_;
+  pf_->resample_n_eff_ratio = resample_n_eff_ratio_;
 
   // Initialize the filter
   pf_vector_t pf_init_pose_mean = pf_vector_zero();
@@ -564,7 +983,24 @@ void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
   // Laser
   delete laser_;
   laser_ = new AMCLLaser(max_beams_, map_);
+  delete fused_laser_;
+  fused_laser_ = NULL;
+  fused_scans_.clear();
+  // The pyramid mirrors the laser model parameters
+  delete global_localizer_;
+  global_localizer_ = NULL;
   ROS_ASSERT(laser_);
+  laser_->SetModelThreads(laser_model_threads_);
+  if(laser_model_type_ == LASER_MODEL_BEAM && laser_beam_range_table_mb_ > 0)
+  {
+    double resolution = laser_->SetModelBeamRangeTable((size_t)laser_beam_range_table_mb_ << 20);
+    ROS_INFO("Beam model range table at %.2f degree resolution", resolution * 180.0 / M_PI);
+  }
+  laser_->SetCspaceEDT(laser_likelihood_edt_);
+  laser_->SetCspaceCacheDir(likelihood_field_cache_dir_);
+  if(!laser_->SetModelVectorized(laser_model_vectorized_))
+    ROS_WARN("Vector beam kernel unavailable or disabled; using the scalar beam kernel");
+  laser_->SetModelAdaptiveBeams(laser_adaptive_beams_);
   if(laser_model_type_ == LASER_MODEL_BEAM)
     laser_->SetModelBeam(z_hit_, z_short_, z_max_, z_rand_,
                          sigma_hit_, lambda_short_, 0.0);
@@ -582,9 +1018,13 @@ void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
                                     laser_likelihood_max_dist_);
     ROS_INFO("Done initializing likelihood field model.");
   }
+  accountMapMemory();
 
-  odom_frame_id_ = config.odom_frame_id;
-  base_frame_id_ = config.base_frame_id;
+  {
+    boost::mutex::scoped_lock fl(frame_ids_mutex_);
+    odom_frame_id_ = config.odom_frame_id;
+    base_frame_id_ = config.base_frame_id;
+  }
   global_frame_id_ = config.global_frame_id;
 
   delete laser_scan_filter_;
@@ -600,21 +1040,97 @@ void AmclNode::reconfigureCB(AMCLConfig &config, uint32_t level)
 }
 
 
-void AmclNode::runFromBag(const std::string &in_bag_fn)
+// Value at fraction p of the way through a sorted sample
+static double
+percentile(const std::vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0.0;
+  return sorted[std::min(sorted.size() - 1, (size_t) (p * sorted.size()))];
+}
+
+// CPU time of the whole process, workers included, in seconds
+static double
+processCpuTime()
+{
+  timespec t;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Peak resident set size of the process, in kB
+static long
+peakRss()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// A JSON string body for s, with quotes, backslashes and control characters escaped
+static std::string
+jsonEscape(const std::string &s)
+{
+  std::string e;
+  for (size_t i = 0; i < s.size(); i++)
+  {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\')
+    {
+      e += '\\';
+      e += c;
+    }
+    else if (c < 0x20)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      e += buf;
+    }
+    else
+      e += c;
+  }
+  return e;
+}
+
+// FNV-1a over the bytes of value, folded into hash
+static void
+checksum(uint64_t* hash, double value)
 {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+  for (size_t i = 0; i < sizeof(value); i++)
+    *hash = (*hash ^ bytes[i]) * 1099511628211ULL;
+}
+
+void AmclNode::runFromBag(const std::string &in_bag_fn, bool benchmark)
+{
+  // Scans are played back one after the other, each estimate in before
+  // the next scan is read.  A benchmark keeps the scan pipeline, waiting
+  // for it after each scan, so that it can be compared with a serial run.
+  if (!benchmark)
+    stopPipeline();
+
   rosbag::Bag bag;
   bag.open(in_bag_fn, rosbag::bagmode::Read);
   std::vector<std::string> topics;
   topics.push_back(std::string("tf"));
   std::string scan_topic_name = "base_scan"; // TODO determine what topic this actually is from ROS
   topics.push_back(scan_topic_name);
+
+  // In benchmark mode the estimate is compared against a ground truth
+  // pose in the global frame (nav_msgs/Odometry or geometry_msgs/PoseStamped)
+  std::string ground_truth_topic, output_fn;
+  private_nh_.param("benchmark_ground_truth_topic", ground_truth_topic, std::string(""));
+  private_nh_.param("benchmark_output", output_fn, std::string(""));
+  if (benchmark && !ground_truth_topic.empty())
+    topics.push_back(ground_truth_topic);
   rosbag::View view(bag, rosbag::TopicQuery(topics));
 
   ros::Publisher laser_pub = nh_.advertise<sensor_msgs::LaserScan>(scan_topic_name, 100);
   ros::Publisher tf_pub = nh_.advertise<tf2_msgs::TFMessage>("/tf", 100);
 
   // Sleep for a second to let all subscribers connect
-  ros::WallDuration(1.0).sleep();
+  if (!benchmark)
+    ros::WallDuration(1.0).sleep();
 
   ros::WallTime start(ros::WallTime::now());
 
@@ -633,6 +1149,19 @@ void AmclNode::runFromBag(const std::string &in_bag_fn)
     ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration(1.0));
   }
 
+  // Benchmark state: scans waiting for their transforms, the time spent
+  // in each laserReceived() call, and the error of each new estimate
+  // against the latest ground truth pose
+  std::deque<sensor_msgs::LaserScan::ConstPtr> pending_scans;
+  std::vector<double> latencies;
+  std::vector<double> trans_errors, rot_errors;
+  int dropped_scans = 0;
+  double cpu_time = 0.0;
+  uint64_t pose_checksum = 14695981039346656037ULL;
+  bool have_ground_truth = false;
+  geometry_msgs::Pose ground_truth;
+  ros::WallTime bag_start(ros::WallTime::now());
+
   BOOST_FOREACH(rosbag::MessageInstance const msg, view)
   {
     if (!ros::ok())
@@ -640,22 +1169,43 @@ void AmclNode::runFromBag(const std::string &in_bag_fn)
       break;
     }
 
-    // Process any ros messages or callbacks at this point
-    ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration());
+    // Process any ros messages or callbacks at this point.  Benchmark runs
+    // take nothing from outside the bag.
+    if (!benchmark)
+      ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration());
+
+    if (benchmark && msg.getTopic() == ground_truth_topic)
+    {
+      nav_msgs::Odometry::ConstPtr odom_msg = msg.instantiate<nav_msgs::Odometry>();
+      geometry_msgs::PoseStamped::ConstPtr pose_msg = msg.instantiate<geometry_msgs::PoseStamped>();
+      if (odom_msg != NULL)
+        ground_truth = odom_msg->pose.pose;
+      else if (pose_msg != NULL)
+        ground_truth = pose_msg->pose;
+      else
+      {
+        ROS_WARN_STREAM_ONCE("Unsupported ground truth message type " << msg.getDataType());
+        continue;
+      }
+      have_ground_truth = true;
+      continue;
+    }
 
     tf2_msgs::TFMessage::ConstPtr tf_msg = msg.instantiate<tf2_msgs::TFMessage>();
     if (tf_msg != NULL)
     {
-      tf_pub.publish(msg);
+      if (!benchmark)
+        tf_pub.publish(msg);
       for (size_t ii=0; ii<tf_msg->transforms.size(); ++ii)
       {
         tf_->getBuffer().setTransform(tf_msg->transforms[ii], "rosbag_authority");
       }
-      continue;
+      if (!benchmark)
+        continue;
     }
 
     sensor_msgs::LaserScan::ConstPtr base_scan = msg.instantiate<sensor_msgs::LaserScan>();
-    if (base_scan != NULL)
+    if (base_scan != NULL && !benchmark)
     {
       laser_pub.publish(msg);
       laser_scan_filter_->add(base_scan);
@@ -666,8 +1216,66 @@ void AmclNode::runFromBag(const std::string &in_bag_fn)
       continue;
     }
 
-    ROS_WARN_STREAM("Unsupported message type" << msg.getTopic());
+    if (!benchmark)
+    {
+      ROS_WARN_STREAM("Unsupported message type" << msg.getTopic());
+      continue;
+    }
+
+    // Rather than going through the message filter, hand each scan to
+    // laserReceived() directly, in bag order, as soon as the transforms
+    // it needs are in the buffer.  A scan whose transforms never arrive
+    // while a later one's do is dropped, as the filter would.
+    if (base_scan != NULL)
+      pending_scans.push_back(base_scan);
+    while (!pending_scans.empty())
+    {
+      size_t ready = 0;
+      for (; ready < pending_scans.size(); ready++)
+      {
+        const std_msgs::Header& header = pending_scans[ready]->header;
+        if (tf_->canTransform(odom_frame_id_, base_frame_id_, header.stamp) &&
+            tf_->canTransform(base_frame_id_, header.frame_id, ros::Time()))
+          break;
+      }
+      if (ready == pending_scans.size())
+        break;
+      for (; ready > 0; ready--)
+      {
+        pending_scans.pop_front();
+        dropped_scans++;
+      }
+
+      ros::Time last_stamp = last_published_pose.header.stamp;
+      ros::WallTime scan_start = ros::WallTime::now();
+      double cpu_start = processCpuTime();
+      laserReceived(pending_scans.front());
+      waitForPipeline();
+      cpu_time += processCpuTime() - cpu_start;
+      latencies.push_back((ros::WallTime::now() - scan_start).toSec());
+      pending_scans.pop_front();
+
+      // Every estimate goes into the checksum, so that two runs which
+      // localize differently at any point don't compare equal
+      if (last_published_pose.header.stamp != last_stamp)
+      {
+        const geometry_msgs::Pose& est = last_published_pose.pose.pose;
+        checksum(&pose_checksum, est.position.x);
+        checksum(&pose_checksum, est.position.y);
+        checksum(&pose_checksum, tf::getYaw(est.orientation));
+      }
+
+      if (have_ground_truth && last_published_pose.header.stamp != last_stamp)
+      {
+        const geometry_msgs::Pose& est = last_published_pose.pose.pose;
+        trans_errors.push_back(hypot(est.position.x - ground_truth.position.x,
+                                     est.position.y - ground_truth.position.y));
+        rot_errors.push_back(fabs(angle_diff(tf::getYaw(est.orientation),
+                                             tf::getYaw(ground_truth.orientation))));
+      }
+    }
   }
+  dropped_scans += pending_scans.size();
 
   bag.close();
 
@@ -683,6 +1291,72 @@ void AmclNode::runFromBag(const std::string &in_bag_fn)
             yaw, last_published_pose.header.stamp.toSec()
             );
 
+  if (benchmark)
+  {
+    double replay_time = (ros::WallTime::now() - bag_start).toSec();
+    double total = 0.0;
+    for (size_t i = 0; i < latencies.size(); i++)
+      total += latencies[i];
+    std::vector<double> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean_trans = 0.0, mean_rot = 0.0;
+    for (size_t i = 0; i < trans_errors.size(); i++)
+    {
+      mean_trans += trans_errors[i] / trans_errors.size();
+      mean_rot += rot_errors[i] / rot_errors.size();
+    }
+    double final_trans = trans_errors.empty() ? 0.0 : trans_errors.back();
+    double final_rot = rot_errors.empty() ? 0.0 : rot_errors.back();
+    double max_trans = trans_errors.empty() ? 0.0 :
+      *std::max_element(trans_errors.begin(), trans_errors.end());
+
+    ROS_INFO("Benchmark: %d scans (%d dropped) in %.3f s, latency mean %.3f ms, "
+             "p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms",
+             (int) latencies.size(), dropped_scans, replay_time,
+             latencies.empty() ? 0.0 : 1e3 * total / latencies.size(),
+             1e3 * percentile(sorted, 0.5), 1e3 * percentile(sorted, 0.95),
+             1e3 * percentile(sorted, 0.99), 1e3 * percentile(sorted, 1.0));
+    ROS_INFO("Benchmark: %.3f s of CPU in laserReceived(), peak RSS %ld kB, "
+             "pose checksum %016llx", cpu_time, peakRss(),
+             (unsigned long long) pose_checksum);
+    if (!trans_errors.empty())
+      ROS_INFO("Benchmark: final error %.3f m, %.3f rad; mean %.3f m, %.3f rad; "
+               "max %.3f m over %d estimates", final_trans, final_rot,
+               mean_trans, mean_rot, max_trans, (int) trans_errors.size());
+
+    // One JSON object, so that runs can be compared by a script
+    FILE* out = output_fn.empty() ? stdout : fopen(output_fn.c_str(), "w");
+    if (out == NULL)
+    {
+      ROS_ERROR("Couldn't open benchmark output %s", output_fn.c_str());
+    }
+    else
+    {
+      fprintf(out, "{\"bag\": \"%s\", \"scans\": %d, \"dropped_scans\": %d, "
+              "\"replay_time\": %.6f, \"latency_mean\": %.6f, "
+              "\"latency_p50\": %.6f, \"latency_p95\": %.6f, "
+              "\"latency_p99\": %.6f, \"latency_max\": %.6f, "
+              "\"cpu_time\": %.6f, \"max_rss_kb\": %ld, "
+              "\"checksum\": \"%016llx\", "
+              "\"final_pose\": [%.6f, %.6f, %.6f], \"ground_truth\": %s, "
+              "\"estimates\": %d, \"final_trans_error\": %.6f, "
+              "\"final_rot_error\": %.6f, \"mean_trans_error\": %.6f, "
+              "\"mean_rot_error\": %.6f, \"max_trans_error\": %.6f}\n",
+              jsonEscape(in_bag_fn).c_str(), (int) latencies.size(), dropped_scans,
+              replay_time, latencies.empty() ? 0.0 : total / latencies.size(),
+              percentile(sorted, 0.5), percentile(sorted, 0.95),
+              percentile(sorted, 0.99), percentile(sorted, 1.0),
+              cpu_time, peakRss(), (unsigned long long) pose_checksum,
+              last_published_pose.pose.pose.position.x,
+              last_published_pose.pose.pose.position.y, yaw,
+              trans_errors.empty() ? "false" : "true", (int) trans_errors.size(),
+              final_trans, final_rot, mean_trans, mean_rot, max_trans);
+      if (out != stdout)
+        fclose(out);
+    }
+  }
+
   ros::shutdown();
 }
 
@@ -763,6 +1437,55 @@ AmclNode::checkLaserReceived(const ros::TimerEvent& event)
   }
 }
 
+void
+AmclNode::publishTiming(const ros::TimerEvent& event)
+{
+  boost::recursive_mutex::scoped_lock l(configuration_mutex_);
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = ros::this_node::getName() + ": timing";
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = "laserReceived stage times, p50 / p95 / max over recent scans (ms)";
+
+  diagnostic_msgs::KeyValue kv;
+  for(int i = 0; i < TIMING_STAGE_COUNT; i++)
+  {
+    double p50, p95, max;
+    if(!timing_[i].summarize(&p50, &p95, &max))
+      continue;
+    char value[64];
+    snprintf(value, sizeof(value), "%.3f / %.3f / %.3f", p50 * 1e3, p95 * 1e3, max * 1e3);
+    kv.key = timing_stage_names[i];
+    kv.value = value;
+    status.values.push_back(kv);
+  }
+
+  char value[64];
+  snprintf(value, sizeof(value), "%.2f", timing_updates_ / (event.current_real - event.last_real).toSec());
+  kv.key = "sensor updates per second";
+  kv.value = value;
+  if(!event.last_real.isZero())
+    status.values.push_back(kv);
+  timing_updates_ = 0;
+
+  if(pf_ != NULL)
+  {
+    snprintf(value, sizeof(value), "%d", pf_->sets[pf_->current_set].sample_count);
+    kv.key = "particles";
+    kv.value = value;
+    status.values.push_back(kv);
+  }
+  snprintf(value, sizeof(value), "%d", max_beams_);
+  kv.key = "laser_max_beams";
+  kv.value = value;
+  status.values.push_back(kv);
+
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = ros::Time::now();
+  msg.status.push_back(status);
+  timing_pub_.publish(msg);
+}
+
 void
 AmclNode::requestMap()
 {
@@ -793,6 +1516,58 @@ AmclNode::mapReceived(const nav_msgs::OccupancyGridConstPtr& msg)
   first_map_received_ = true;
 }
 
+// Patch the cells of the current map in place.  The particles are left
+// alone; only what was derived from the changed cells is repaired.
+void
+AmclNode::mapUpdateReceived(const map_msgs::OccupancyGridUpdateConstPtr& msg)
+{
+  boost::recursive_mutex::scoped_lock cfl(configuration_mutex_);
+
+  if( map_ == NULL || first_map_only_ )
+    return;
+
+  if(msg->x < 0 || msg->y < 0 ||
+     msg->x + (int)msg->width > map_->size_x ||
+     msg->y + (int)msg->height > map_->size_y ||
+     msg->data.size() != (size_t)msg->width * msg->height)
+  {
+    ROS_WARN("Ignoring a %d X %d map update at (%d, %d) that does not fit the %d X %d map",
+             msg->width, msg->height, msg->x, msg->y, map_->size_x, map_->size_y);
+    return;
+  }
+
+  for(unsigned int j = 0; j < msg->height; j++)
+  {
+    for(unsigned int i = 0; i < msg->width; i++)
+    {
+      int8_t value = msg->data[j * msg->width + i];
+      int8_t state;
+      if(value == 0)
+        state = -1;
+      else if(value == 100)
+        state = +1;
+      else
+        state = 0;
+
+      int index = MAP_INDEX(map_, msg->x + (int)i, msg->y + (int)j);
+      if(map_->cells)
+        map_->cells[index].occ_state = state;
+      else
+        map_->occ_states[index] = state;
+    }
+  }
+
+  if(laser_)
+    laser_->UpdateMapRegion(msg->x, msg->y, msg->width, msg->height);
+
+  // The pyramid and the free space index are rebuilt on their next use
+  delete global_localizer_;
+  global_localizer_ = NULL;
+#if NEW_UNIFORM_SAMPLING
+  free_space_map = NULL;
+#endif
+}
+
 void
 AmclNode::handleMapMessage(const nav_msgs::OccupancyGrid& msg)
 {
@@ -803,23 +1578,37 @@ AmclNode::handleMapMessage(const nav_msgs::OccupancyGrid& msg)
            msg.info.height,
            msg.info.resolution);
 
+  if(map_ && max_resident_maps_ > 0)
+  {
+    resident_maps_.push_front(map_);
+    map_ = NULL;
+  }
   freeMapDependentMemory();
   // Clear queued laser objects because they hold pointers to the existing
   // map, #5202.
   lasers_.clear();
   lasers_update_.clear();
+  laser_beams_.clear();
   frame_to_laser_.clear();
 
   map_ = convertMap(msg);
+  for(std::deque<map_t*>::iterator it = resident_maps_.begin(); it != resident_maps_.end(); ++it)
+  {
+    if(map_same_occupancy(*it, map_))
+    {
+      ROS_INFO("The map is one kept from before, with its likelihood field");
+      map_free(map_);
+      map_ = *it;
+      resident_maps_.erase(it);
+      break;
+    }
+  }
+  while(resident_maps_.size() > (size_t)max_resident_maps_)
+  {
+    map_free(resident_maps_.back());
+    resident_maps_.pop_back();
+  }
 
-#if NEW_UNIFORM_SAMPLING
-  // Index of free space
-  free_space_indices.resize(0);
-  for(int i = 0; i < map_->size_x; i++)
-    for(int j = 0; j < map_->size_y; j++)
-      if(map_->cells[MAP_INDEX(map_,i,j)].occ_state == -1)
-        free_space_indices.push_back(std::make_pair(i,j));
-#endif
   // Create the particle filter
   pf_ = pf_alloc(min_particles_, max_particles_,
                  alpha_slow_, alpha_fast_,
@@ -827,6 +1616,8 @@ AmclNode::handleMapMessage(const nav_msgs::OccupancyGrid& msg)
                  (void *)map_);
   pf_->pop_err = pf_err_;
   pf_->pop_z = pf_z_;
+  pf_->resample_model = resample_type_;
+  pf_->resample_n_eff_ratio = resample_n_eff_ratio_;
 
   // Initialize the filter
   updatePoseFromServer();
@@ -850,7 +1641,24 @@ AmclNode::handleMapMessage(const nav_msgs::OccupancyGrid& msg)
   // Laser
   delete laser_;
   laser_ = new AMCLLaser(max_beams_, map_);
+  delete fused_laser_;
+  fused_laser_ = NULL;
+  fused_scans_.clear();
+  // The pyramid mirrors the laser model parameters
+  delete global_localizer_;
+  global_localizer_ = NULL;
   ROS_ASSERT(laser_);
+  laser_->SetModelThreads(laser_model_threads_);
+  if(laser_model_type_ == LASER_MODEL_BEAM && laser_beam_range_table_mb_ > 0)
+  {
+    double resolution = laser_->SetModelBeamRangeTable((size_t)laser_beam_range_table_mb_ << 20);
+    ROS_INFO("Beam model range table at %.2f degree resolution", resolution * 180.0 / M_PI);
+  }
+  laser_->SetCspaceEDT(laser_likelihood_edt_);
+  laser_->SetCspaceCacheDir(likelihood_field_cache_dir_);
+  if(!laser_->SetModelVectorized(laser_model_vectorized_))
+    ROS_WARN("Vector beam kernel unavailable or disabled; using the scalar beam kernel");
+  laser_->SetModelAdaptiveBeams(laser_adaptive_beams_);
   if(laser_model_type_ == LASER_MODEL_BEAM)
     laser_->SetModelBeam(z_hit_, z_short_, z_max_, z_rand_,
                          sigma_hit_, lambda_short_, 0.0);
@@ -869,6 +1677,7 @@ AmclNode::handleMapMessage(const nav_msgs::OccupancyGrid& msg)
                                     laser_likelihood_max_dist_);
     ROS_INFO("Done initializing likelihood field model.");
   }
+  accountMapMemory();
 
   // In case the initial pose message arrived before the first map,
   // try to apply the initial pose now that the map has arrived.
@@ -879,10 +1688,19 @@ AmclNode::handleMapMessage(const nav_msgs::OccupancyGrid& msg)
 void
 AmclNode::freeMapDependentMemory()
 {
+  // The last estimate was on the map going away
+  invalidateExtrapolation();
+  delete global_localizer_;
+  global_localizer_ = NULL;
   if( map_ != NULL ) {
     map_free( map_ );
     map_ = NULL;
   }
+  accountMapMemory();
+#if NEW_UNIFORM_SAMPLING
+  // The free space index is rebuilt from the next map on first use
+  free_space_map = NULL;
+#endif
   if( pf_ != NULL ) {
     pf_free( pf_ );
     pf_ = NULL;
@@ -891,6 +1709,18 @@ AmclNode::freeMapDependentMemory()
   odom_ = NULL;
   delete laser_;
   laser_ = NULL;
+  delete fused_laser_;
+  fused_laser_ = NULL;
+  fused_scans_.clear();
+}
+
+void
+AmclNode::accountMapMemory()
+{
+  size_t bytes = map_ ? map_memory_bytes(map_) : 0;
+  for(size_t i = 0; i < resident_maps_.size(); i++)
+    bytes += map_memory_bytes(resident_maps_[i]);
+  map_memory_.set(bytes);
 }
 
 /**
@@ -909,6 +1739,23 @@ AmclNode::convertMap( const nav_msgs::OccupancyGrid& map_msg )
   map->origin_x = map_msg.info.origin.position.x + (map->size_x / 2) * map->scale;
   map->origin_y = map_msg.info.origin.position.y + (map->size_y / 2) * map->scale;
   // Convert to player format
+  if(compact_map_)
+  {
+    // One byte per cell; the likelihood field is quantized to match
+    map->occ_states = (int8_t*)malloc(sizeof(int8_t)*map->size_x*map->size_y);
+    ROS_ASSERT(map->occ_states);
+    for(int i=0;i<map->size_x * map->size_y;i++)
+    {
+      if(map_msg.data[i] == 0)
+        map->occ_states[i] = -1;
+      else if(map_msg.data[i] == 100)
+        map->occ_states[i] = +1;
+      else
+        map->occ_states[i] = 0;
+    }
+    return map;
+  }
+
   map->cells = (map_cell_t*)malloc(sizeof(map_cell_t)*map->size_x*map->size_y);
   ROS_ASSERT(map->cells);
   for(int i=0;i<map->size_x * map->size_y;i++)
@@ -926,8 +1773,17 @@ AmclNode::convertMap( const nav_msgs::OccupancyGrid& map_msg )
 
 AmclNode::~AmclNode()
 {
+  stopPipeline();
+  if(extrapolation_spinner_)
+  {
+    extrapolation_spinner_->stop();
+    delete extrapolation_spinner_;
+  }
   delete dsrv_;
   freeMapDependentMemory();
+  for(size_t i = 0; i < resident_maps_.size(); i++)
+    map_free(resident_maps_[i]);
+  resident_maps_.clear();
   delete laser_scan_filter_;
   delete laser_scan_sub_;
   delete tfb_;
@@ -935,17 +1791,51 @@ AmclNode::~AmclNode()
   // TODO: delete everything allocated in constructor
 }
 
+void
+AmclNode::extrapolationOdomReceived(const nav_msgs::OdometryConstPtr& odom)
+{
+  geometry_msgs::PoseWithCovarianceStamped p;
+  {
+    boost::mutex::scoped_lock el(extrapolation_mutex_);
+    if(!extrapolation_valid_)
+      return;
+    if(tf::resolve("", odom->header.frame_id) != tf::resolve("", extrapolation_odom_frame_))
+    {
+      ROS_WARN_THROTTLE(5.0, "Odometry on the extrapolation topic is in the %s frame, not %s; no extrapolated pose",
+                        odom->header.frame_id.c_str(), extrapolation_odom_frame_.c_str());
+      return;
+    }
+    // the map pose of the robot is the map to odom transform of the last
+    // filter update applied to its odometric pose now
+    tf::Pose odom_pose;
+    tf::poseMsgToTF(odom->pose.pose, odom_pose);
+    tf::poseTFToMsg(extrapolation_tf_.inverse() * odom_pose, p.pose.pose);
+    p.pose.covariance = extrapolation_cov_;
+    p.header.frame_id = extrapolation_global_frame_;
+  }
+  p.header.stamp = odom->header.stamp;
+  extrapolation_pub_.publish(p);
+}
+
+void
+AmclNode::invalidateExtrapolation()
+{
+  boost::mutex::scoped_lock el(extrapolation_mutex_);
+  extrapolation_valid_ = false;
+}
+
 bool
 AmclNode::getOdomPose(tf::Stamped<tf::Pose>& odom_pose,
                       double& x, double& y, double& yaw,
-                      const ros::Time& t, const std::string& f)
+                      const ros::Time& t, const std::string& f,
+                      const std::string& odom_frame)
 {
   // Get the robot's pose
   tf::Stamped<tf::Pose> ident (tf::Transform(tf::createIdentityQuaternion(),
                                            tf::Vector3(0,0,0)), t, f);
   try
   {
-    this->tf_->transformPose(odom_frame_id_, ident, odom_pose);
+    this->tf_->transformPose(odom_frame, ident, odom_pose);
   }
   catch(tf::TransformException e)
   {
@@ -966,11 +1856,17 @@ AmclNode::uniformPoseGenerator(void* arg)
 {
   map_t* map = (map_t*)arg;
 #if NEW_UNIFORM_SAMPLING
-  unsigned int rand_index = drand48() * free_space_indices.size();
-  std::pair<int,int> free_point = free_space_indices[rand_index];
-  pf_vector_t p;
-  p.v[0] = MAP_WXGX(map, free_point.first);
-  p.v[1] = MAP_WYGY(map, free_point.second);
+  if(free_space_map != map)
+    updateFreeSpaceIndices(map);
+
+  pf_vector_t p = pf_vector_zero();
+  if(!free_space_indices.empty())
+  {
+    unsigned int rand_index = drand48() * free_space_indices.size();
+    int free_index = free_space_indices[rand_index];
+    p.v[0] = MAP_WXGX(map, free_index % map->size_x);
+    p.v[1] = MAP_WYGY(map, free_index / map->size_x);
+  }
   p.v[2] = drand48() * 2 * M_PI - M_PI;
 #else
   double min_x, max_x, min_y, max_y;
@@ -992,13 +1888,80 @@ AmclNode::uniformPoseGenerator(void* arg)
     int i,j;
     i = MAP_GXWX(map, p.v[0]);
     j = MAP_GYWY(map, p.v[1]);
-    if(MAP_VALID(map,i,j) && (map->cells[MAP_INDEX(map,i,j)].occ_state == -1))
+    if(MAP_VALID(map,i,j) && (MAP_OCC_STATE(map, MAP_INDEX(map,i,j)) == -1))
       break;
   }
 #endif
   return p;
 }
 
+#if NEW_UNIFORM_SAMPLING
+void
+AmclNode::updateFreeSpaceIndices(map_t* map)
+{
+  int n = map->size_x * map->size_y;
+  int count = 0;
+  for(int i = 0; i < n; i++)
+    if(MAP_OCC_STATE(map, i) == -1)
+      count++;
+
+  free_space_indices.clear();
+  free_space_indices.reserve(count);
+  for(int i = 0; i < n; i++)
+    if(MAP_OCC_STATE(map, i) == -1)
+      free_space_indices.push_back(i);
+  free_space_map = map;
+
+  if(free_space_indices.empty())
+    ROS_WARN("The map has no free space to draw uniform poses from");
+}
+#endif
+
+pf_vector_t
+AmclNode::hypothesisPoseGenerator(void* arg)
+{
+  AmclNode* self = (AmclNode*)arg;
+  const std::vector<pf_vector_t>& hyps = self->global_hypotheses_;
+
+  // Spread the particles over the cell and heading step of the search
+  unsigned int index = drand48() * hyps.size();
+  pf_vector_t p = hyps[index];
+  p.v[0] += pf_ran_gaussian(self->map_->scale);
+  p.v[1] += pf_ran_gaussian(self->map_->scale);
+  p.v[2] = normalize(p.v[2] + pf_ran_gaussian(self->global_localizer_->AngleStep()));
+  return p;
+}
+
+void
+AmclNode::seedGlobalLocalization(AMCLLaserData* ldata, AMCLLaser* laser)
+{
+  if(global_localizer_ == NULL)
+  {
+    ROS_INFO("Building the map pyramid for global localization...");
+    global_localizer_ = new AMCLGlobalLocalizer(map_, global_localization_hypotheses_,
+                                                global_localization_max_levels_,
+                                                max_beams_, z_hit_, z_rand_, sigma_hit_,
+                                                laser_likelihood_max_dist_,
+                                                laser_model_threads_);
+  }
+
+  ros::WallTime start = ros::WallTime::now();
+  global_localizer_->Search(ldata, laser, &global_hypotheses_);
+  if(global_hypotheses_.empty())
+  {
+    ROS_WARN("Coarse-to-fine search found no hypothesis; initializing with uniform distribution");
+    pf_init_model(pf_, (pf_init_model_fn_t)AmclNode::uniformPoseGenerator,
+                  (void *)map_);
+    return;
+  }
+
+  pf_init_model(pf_, (pf_init_model_fn_t)AmclNode::hypothesisPoseGenerator,
+                (void *)this);
+  ROS_INFO("Global localization seeded from %d hypotheses over %d pyramid levels in %.3f s",
+           (int)global_hypotheses_.size(), global_localizer_->Levels(),
+           (ros::WallTime::now() - start).toSec());
+}
+
 bool
 AmclNode::globalLocalizationCallback(std_srvs::Empty::Request& req,
                                      std_srvs::Empty::Response& res)
@@ -1007,6 +1970,14 @@ AmclNode::globalLocalizationCallback(std_srvs::Empty::Request& req,
     return true;
   }
   boost::recursive_mutex::scoped_lock gl(configuration_mutex_);
+  invalidateExtrapolation();
+  if(global_localization_coarse_to_fine_)
+  {
+    ROS_INFO("Global localization will be seeded from the next laser scan");
+    global_localization_pending_ = true;
+    pf_init_ = false;
+    return true;
+  }
   ROS_INFO("Initializing with uniform distribution");
   pf_init_model(pf_, (pf_init_model_fn_t)AmclNode::uniformPoseGenerator,
                 (void *)map_);
@@ -1035,14 +2006,324 @@ AmclNode::setMapCallback(nav_msgs::SetMap::Request& req,
   return true;
 }
 
+bool
+AmclNode::scanToLaserData(const sensor_msgs::LaserScanConstPtr& laser_scan,
+                          int laser_index, AMCLLaserData* ldata)
+{
+  ldata->sensor = lasers_[laser_index];
+  ldata->range_count = laser_scan->ranges.size();
+
+  // The bearings only need working out again when the beams change
+  LaserBeams& beams = laser_beams_[laser_index];
+  if(beams.count != ldata->range_count ||
+     beams.angle_min != laser_scan->angle_min ||
+     beams.angle_increment != laser_scan->angle_increment)
+  {
+    // To account for lasers that are mounted upside-down, we determine the
+    // min, max, and increment angles of the laser in the base frame.
+    //
+    // Construct min and max angles of laser, in the base_link frame.
+    tf::Quaternion q;
+    q.setRPY(0.0, 0.0, laser_scan->angle_min);
+    tf::Stamped<tf::Quaternion> min_q(q, laser_scan->header.stamp,
+                                      laser_scan->header.frame_id);
+    q.setRPY(0.0, 0.0, laser_scan->angle_min + laser_scan->angle_increment);
+    tf::Stamped<tf::Quaternion> inc_q(q, laser_scan->header.stamp,
+                                      laser_scan->header.frame_id);
+    try
+    {
+      tf_->transformQuaternion(base_frame_id_, min_q, min_q);
+      tf_->transformQuaternion(base_frame_id_, inc_q, inc_q);
+    }
+    catch(tf::TransformException& e)
+    {
+      ROS_WARN("Unable to transform min/max laser angles into base frame: %s",
+               e.what());
+      return false;
+    }
+
+    double angle_min = tf::getYaw(min_q);
+    double angle_increment = tf::getYaw(inc_q) - angle_min;
+
+    // wrapping angle to [-pi .. pi]
+    angle_increment = fmod(angle_increment + 5*M_PI, 2*M_PI) - M_PI;
+
+    ROS_DEBUG("Laser %d angles in base frame: min: %.3f inc: %.3f", laser_index, angle_min, angle_increment);
+
+    beams.ranges.resize(2 * ldata->range_count);
+    beams.bearing_cos.resize(ldata->range_count);
+    beams.bearing_sin.resize(ldata->range_count);
+    for(int i=0;i<ldata->range_count;i++)
+    {
+      double bearing = angle_min + (i * angle_increment);
+      beams.ranges[2 * i + 1] = bearing;
+      beams.bearing_cos[i] = cos(bearing);
+      beams.bearing_sin[i] = sin(bearing);
+    }
+    beams.count = ldata->range_count;
+    beams.angle_min = laser_scan->angle_min;
+    beams.angle_increment = laser_scan->angle_increment;
+  }
+
+  // Apply range min/max thresholds, if the user supplied them
+  if(laser_max_range_ > 0.0)
+    ldata->range_max = std::min(laser_scan->range_max, (float)laser_max_range_);
+  else
+    ldata->range_max = laser_scan->range_max;
+  double range_min;
+  if(laser_min_range_ > 0.0)
+    range_min = std::max(laser_scan->range_min, (float)laser_min_range_);
+  else
+    range_min = laser_scan->range_min;
+  if(ldata->range_count == 0)
+    return true;
+  // The buffer, bearings included, is lent to the data for this scan only
+  ldata->ranges = reinterpret_cast<double (*)[2]>(&beams.ranges[0]);
+  ldata->owns_ranges = false;
+  ldata->bearing_cos = &beams.bearing_cos[0];
+  ldata->bearing_sin = &beams.bearing_sin[0];
+  for(int i=0;i<ldata->range_count;i++)
+  {
+    // amcl doesn't (yet) have a concept of min range.  So we'll map short
+    // readings to max range.
+    if(laser_scan->ranges[i] <= range_min)
+      ldata->ranges[i][0] = ldata->range_max;
+    else
+      ldata->ranges[i][0] = laser_scan->ranges[i];
+  }
+  return true;
+}
+
+bool
+AmclNode::bufferFusedScan(const sensor_msgs::LaserScanConstPtr& laser_scan,
+                          int laser_index)
+{
+  FusedScan scan;
+  scan.frame_id = laser_scan->header.frame_id;
+
+  tf::Stamped<tf::Pose> odom_pose;
+  if(!getOdomPose(odom_pose, scan.odom_pose.v[0], scan.odom_pose.v[1],
+                  scan.odom_pose.v[2], laser_scan->header.stamp, base_frame_id_,
+                  odom_frame_id_))
+  {
+    ROS_ERROR("Couldn't determine robot's pose associated with laser scan");
+    return false;
+  }
+
+  AMCLLaserData ldata;
+  if(!scanToLaserData(laser_scan, laser_index, &ldata))
+    return false;
+
+  // Only the endpoints matter to the likelihood field, so keep those of
+  // the usable beams, relative to the base
+  pf_vector_t laser_pose = lasers_[laser_index]->GetLaserPose();
+  for(int i = 0; i < ldata.range_count; i++)
+  {
+    double range = ldata.ranges[i][0];
+    if(range >= ldata.range_max || range != range)
+      continue;
+    scan.x.push_back(laser_pose.v[0] + range * ldata.bearing_cos[i]);
+    scan.y.push_back(laser_pose.v[1] + range * ldata.bearing_sin[i]);
+  }
+  scan.range_max = ldata.range_max + hypot(laser_pose.v[0], laser_pose.v[1]);
+
+  // A laser heard from twice within one window replaces its older scan
+  if(fused_scans_.empty())
+    fused_start_ = laser_scan->header.stamp;
+  size_t k = 0;
+  while(k < fused_scans_.size() && fused_scans_[k].frame_id != scan.frame_id)
+    k++;
+  if(k < fused_scans_.size())
+    fused_scans_[k] = scan;
+  else
+    fused_scans_.push_back(scan);
+
+  return fused_scans_.size() >= frame_to_laser_.size() ||
+         (laser_scan->header.stamp - fused_start_).toSec() >= laser_fusion_window_;
+}
+
+void
+AmclNode::fuseScans(const pf_vector_t& pose, AMCLLaserData* ldata)
+{
+  // The fused scan is taken from the base itself
+  if(!fused_laser_)
+  {
+    fused_laser_ = new AMCLLaser(*laser_);
+    pf_vector_t base_pose = pf_vector_zero();
+    fused_laser_->SetLaserPose(base_pose);
+  }
+  fused_laser_->SetMaxBeams(max_beams_ * fused_scans_.size());
+
+  size_t count = 0;
+  ldata->range_max = 0.0;
+  for(size_t k = 0; k < fused_scans_.size(); k++)
+  {
+    count += fused_scans_[k].x.size();
+    ldata->range_max = std::max(ldata->range_max, fused_scans_[k].range_max);
+  }
+
+  ldata->sensor = fused_laser_;
+  ldata->range_count = count;
+  // The AMCLLaserData destructor will free this memory
+  ldata->ranges = new double[count][2];
+
+  int n = 0;
+  for(size_t k = 0; k < fused_scans_.size(); k++)
+  {
+    // Move the endpoints from where the robot was for this scan to where
+    // it is for the last one
+    const FusedScan& scan = fused_scans_[k];
+    pf_vector_t offset = pf_vector_coord_sub(scan.odom_pose, pose);
+    for(size_t i = 0; i < scan.x.size(); i++, n++)
+    {
+      pf_vector_t point = pf_vector_zero();
+      point.v[0] = scan.x[i];
+      point.v[1] = scan.y[i];
+      point = pf_vector_coord_add(point, offset);
+      ldata->ranges[n][0] = hypot(point.v[0], point.v[1]);
+      ldata->ranges[n][1] = atan2(point.v[1], point.v[0]);
+    }
+  }
+}
+
 void
 AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
+{
+  if(!pipeline_thread_)
+  {
+    processScan(laser_scan, NULL);
+    return;
+  }
+
+  // Only the odometry lookup happens here, while the previous scan may
+  // still be updating the filter, with configuration_mutex_ held
+  std::string odom_frame_id, base_frame_id;
+  {
+    boost::mutex::scoped_lock fl(frame_ids_mutex_);
+    odom_frame_id = odom_frame_id_;
+    base_frame_id = base_frame_id_;
+  }
+  PreparedScan prepared;
+  prepared.scan = laser_scan;
+  double x, y, yaw;
+  bool have_odom_pose;
+  ros::WallTime odom_start = ros::WallTime::now();
+  {
+    // traced here, but timed into the stages by the thread, which holds the mutex
+    ScopedStageTimer timer(NULL, TIMING_ODOM);
+    have_odom_pose = getOdomPose(prepared.odom_pose, x, y, yaw,
+                                 laser_scan->header.stamp, base_frame_id, odom_frame_id);
+  }
+  prepared.odom_seconds = (ros::WallTime::now() - odom_start).toSec();
+  if(!have_odom_pose)
+  {
+    ROS_ERROR("Couldn't determine robot's pose associated with laser scan");
+    return;
+  }
+
+  boost::mutex::scoped_lock pl(pipeline_mutex_);
+  size_t k = 0;
+  while(k < pipeline_queue_.size() &&
+        pipeline_queue_[k].scan->header.frame_id != laser_scan->header.frame_id)
+    k++;
+  if(k < pipeline_queue_.size())
+  {
+    pipeline_queue_[k] = prepared;
+    if(!(++pipeline_dropped_ % 100))
+      ROS_WARN("Filter updates are falling behind the scans; %d dropped so far",
+               pipeline_dropped_);
+  }
+  else
+    pipeline_queue_.push_back(prepared);
+  pipeline_cond_.notify_all();
+}
+
+void
+AmclNode::pipelineLoop()
+{
+  boost::mutex::scoped_lock pl(pipeline_mutex_);
+  while(true)
+  {
+    while(pipeline_queue_.empty() && !pipeline_stop_)
+      pipeline_cond_.wait(pl);
+    if(pipeline_stop_)
+      return;
+    PreparedScan prepared = pipeline_queue_.front();
+    pipeline_queue_.pop_front();
+    pipeline_busy_ = true;
+    pl.unlock();
+    processScan(prepared.scan, &prepared);
+    pl.lock();
+    pipeline_busy_ = false;
+    pipeline_cond_.notify_all();
+  }
+}
+
+void
+AmclNode::waitForPipeline()
+{
+  boost::mutex::scoped_lock pl(pipeline_mutex_);
+  while(pipeline_thread_ && (!pipeline_queue_.empty() || pipeline_busy_))
+    pipeline_cond_.wait(pl);
+}
+
+void
+AmclNode::stopPipeline()
+{
+  if(!pipeline_thread_)
+    return;
+  {
+    boost::mutex::scoped_lock pl(pipeline_mutex_);
+    pipeline_stop_ = true;
+    pipeline_queue_.clear();
+  }
+  pipeline_cond_.notify_all();
+  pipeline_thread_->join();
+  delete pipeline_thread_;
+  pipeline_thread_ = NULL;
+}
+
+void
+AmclNode::processScan(const sensor_msgs::LaserScanConstPtr& laser_scan,
+                      const PreparedScan* prepared)
+{
+  // The cloud is turned into a message after the configuration mutex has
+  // been let go
+  std::vector<pf_vector_t> cloud;
+  std_msgs::Header cloud_header;
+  updateFromLaser(laser_scan, prepared, &cloud, &cloud_header);
+  if(!cloud.empty())
+    publishParticleCloud(cloud, cloud_header);
+}
+
+void
+AmclNode::publishParticleCloud(const std::vector<pf_vector_t>& cloud,
+                               const std_msgs::Header& header)
+{
+  geometry_msgs::PoseArray cloud_msg;
+  cloud_msg.header = header;
+  cloud_msg.poses.resize(cloud.size());
+  for(size_t i=0;i<cloud.size();i++)
+  {
+    tf::poseTFToMsg(tf::Pose(tf::createQuaternionFromYaw(cloud[i].v[2]),
+                             tf::Vector3(cloud[i].v[0],
+                                         cloud[i].v[1], 0)),
+                    cloud_msg.poses[i]);
+  }
+  particlecloud_pub_.publish(cloud_msg);
+}
+
+void
+AmclNode::updateFromLaser(const sensor_msgs::LaserScanConstPtr& laser_scan,
+                          const PreparedScan* prepared,
+                          std::vector<pf_vector_t>* cloud, std_msgs::Header* cloud_header)
 {
   last_laser_received_ts_ = ros::Time::now();
   if( map_ == NULL ) {
     return;
   }
   boost::recursive_mutex::scoped_lock lr(configuration_mutex_);
+  ScopedStageTimer total_timer(stageTimes(), TIMING_TOTAL);
   int laser_index = -1;
 
   // Do we have the base->base_laser Tx yet?
@@ -1051,6 +2332,7 @@ AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
     ROS_DEBUG("Setting up laser %d (frame_id=%s)\n", (int)frame_to_laser_.size(), laser_scan->header.frame_id.c_str());
     lasers_.push_back(new AMCLLaser(*laser_));
     lasers_update_.push_back(true);
+    laser_beams_.push_back(LaserBeams());
     laser_index = frame_to_laser_.size();
 
     tf::Stamped<tf::Pose> ident (tf::Transform(tf::createIdentityQuaternion(),
@@ -1087,10 +2369,43 @@ AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
     laser_index = frame_to_laser_[laser_scan->header.frame_id];
   }
 
+  // When fusing, hold the scan back until every laser has reported (or
+  // the window has passed); the last scan of the window then drives the
+  // update for all of them
+  bool fuse = laserFusionEnabled();
+  if(fuse && !bufferFusedScan(laser_scan, laser_index))
+    return;
+
+  // From here on the window is used up, whether or not the filter needed
+  // it, on every way out
+  struct FusedScansClear
+  {
+    std::vector<FusedScan>* scans;
+    ~FusedScansClear() { if(scans) scans->clear(); }
+  } fused_scans_clear = { fuse ? &fused_scans_ : NULL };
+
   // Where was the robot when this scan was taken?
   pf_vector_t pose;
-  if(!getOdomPose(latest_odom_pose_, pose.v[0], pose.v[1], pose.v[2],
-                  laser_scan->header.stamp, base_frame_id_))
+  bool have_odom_pose = true;
+  if(prepared)
+  {
+    // Looked up already, by laserReceived()
+    if(stageTimes())
+      stageTimes()[TIMING_ODOM].add(prepared->odom_seconds);
+    const tf::Stamped<tf::Pose>& odom_pose = prepared->odom_pose;
+    latest_odom_pose_ = odom_pose;
+    pose.v[0] = odom_pose.getOrigin().x();
+    pose.v[1] = odom_pose.getOrigin().y();
+    double pitch, roll;
+    odom_pose.getBasis().getEulerYPR(pose.v[2], pitch, roll);
+  }
+  else
+  {
+    ScopedStageTimer timer(stageTimes(), TIMING_ODOM);
+    have_odom_pose = getOdomPose(latest_odom_pose_, pose.v[0], pose.v[1], pose.v[2],
+                                 laser_scan->header.stamp, base_frame_id_, odom_frame_id_);
+  }
+  if(!have_odom_pose)
   {
     ROS_ERROR("Couldn't determine robot's pose associated with laser scan");
     return;
@@ -1151,7 +2466,10 @@ AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
     odata.delta = delta;
 
     // Use the action data to update the filter
-    odom_->UpdateAction(pf_, (AMCLSensorData*)&odata);
+    {
+      ScopedStageTimer timer(stageTimes(), TIMING_ACTION);
+      odom_->UpdateAction(pf_, (AMCLSensorData*)&odata);
+    }
 
     // Pose at last filter update
     //this->pf_odom_pose = pose;
@@ -1162,97 +2480,93 @@ AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
   if(lasers_update_[laser_index])
   {
     AMCLLaserData ldata;
-    ldata.sensor = lasers_[laser_index];
-    ldata.range_count = laser_scan->ranges.size();
-
-    // To account for lasers that are mounted upside-down, we determine the
-    // min, max, and increment angles of the laser in the base frame.
-    //
-    // Construct min and max angles of laser, in the base_link frame.
-    tf::Quaternion q;
-    q.setRPY(0.0, 0.0, laser_scan->angle_min);
-    tf::Stamped<tf::Quaternion> min_q(q, laser_scan->header.stamp,
-                                      laser_scan->header.frame_id);
-    q.setRPY(0.0, 0.0, laser_scan->angle_min + laser_scan->angle_increment);
-    tf::Stamped<tf::Quaternion> inc_q(q, laser_scan->header.stamp,
-                                      laser_scan->header.frame_id);
-    try
+    AMCLLaser* laser;
+    if(fuse)
     {
-      tf_->transformQuaternion(base_frame_id_, min_q, min_q);
-      tf_->transformQuaternion(base_frame_id_, inc_q, inc_q);
+      fuseScans(pose, &ldata);
+      laser = fused_laser_;
     }
-    catch(tf::TransformException& e)
+    else
     {
-      ROS_WARN("Unable to transform min/max laser angles into base frame: %s",
-               e.what());
-      return;
+      if(!scanToLaserData(laser_scan, laser_index, &ldata))
+        return;
+      laser = lasers_[laser_index];
     }
 
-    double angle_min = tf::getYaw(min_q);
-    double angle_increment = tf::getYaw(inc_q) - angle_min;
-
-    // wrapping angle to [-pi .. pi]
-    angle_increment = fmod(angle_increment + 5*M_PI, 2*M_PI) - M_PI;
-
-    ROS_DEBUG("Laser %d angles in base frame: min: %.3f inc: %.3f", laser_index, angle_min, angle_increment);
-
-    // Apply range min/max thresholds, if the user supplied them
-    if(laser_max_range_ > 0.0)
-      ldata.range_max = std::min(laser_scan->range_max, (float)laser_max_range_);
-    else
-      ldata.range_max = laser_scan->range_max;
-    double range_min;
-    if(laser_min_range_ > 0.0)
-      range_min = std::max(laser_scan->range_min, (float)laser_min_range_);
-    else
-      range_min = laser_scan->range_min;
-    // The AMCLLaserData destructor will free this memory
-    ldata.ranges = new double[ldata.range_count][2];
-    ROS_ASSERT(ldata.ranges);
-    for(int i=0;i<ldata.range_count;i++)
+    if(global_localization_pending_)
     {
-      // amcl doesn't (yet) have a concept of min range.  So we'll map short
-      // readings to max range.
-      if(laser_scan->ranges[i] <= range_min)
-        ldata.ranges[i][0] = ldata.range_max;
-      else
-        ldata.ranges[i][0] = laser_scan->ranges[i];
-      // Compute bearing
-      ldata.ranges[i][1] = angle_min +
-              (i * angle_increment);
+      global_localization_pending_ = false;
+      seedGlobalLocalization(&ldata, laser);
     }
 
-    lasers_[laser_index]->UpdateSensor(pf_, (AMCLSensorData*)&ldata);
+    {
+      ScopedStageTimer timer(stageTimes(), TIMING_SENSOR);
+      laser->UpdateSensor(pf_, (AMCLSensorData*)&ldata);
+    }
+    timing_updates_++;
 
-    lasers_update_[laser_index] = false;
+    // A fused update covers every laser
+    if(fuse)
+      for(unsigned int i=0; i < lasers_update_.size(); i++)
+        lasers_update_[i] = false;
+    else
+      lasers_update_[laser_index] = false;
 
     pf_odom_pose_ = pose;
 
     // Resample the particles
     if(!(++resample_count_ % resample_interval_))
     {
+      ScopedStageTimer timer(stageTimes(), TIMING_RESAMPLE);
       pf_update_resample(pf_);
       resampled = true;
     }
 
+    // Match the scan around each hypothesis, and carry its particles to
+    // the pose found, before the hypotheses are read out below
+    if(resampled && scan_match_refinement_)
+    {
+      ScopedStageTimer timer(stageTimes(), TIMING_SCAN_MATCH);
+      pf_sample_set_t* set = pf_->sets + pf_->current_set;
+      AMCLScanMatcher matcher(scan_match_linear_window_, scan_match_angular_window_,
+                              scan_match_levels_);
+      std::vector<pf_vector_t> means(set->cluster_count);
+      bool moved = false;
+      for(int c = 0; c < set->cluster_count; c++)
+      {
+        means[c] = set->clusters[c].mean;
+        if(matcher.Refine(&ldata, laser, &means[c]))
+          moved = true;
+      }
+      if(moved)
+        pf_move_clusters(pf_, &means[0], set->cluster_count);
+    }
+
     pf_sample_set_t* set = pf_->sets + pf_->current_set;
     ROS_DEBUG("Num samples: %d\n", set->sample_count);
 
-    // Publish the resulting cloud
-    // TODO: set maximum rate for publishing
-    if (!m_force_update) {
-      geometry_msgs::PoseArray cloud_msg;
-      cloud_msg.header.stamp = ros::Time::now();
-      cloud_msg.header.frame_id = global_frame_id_;
-      cloud_msg.poses.resize(set->sample_count);
-      for(int i=0;i<set->sample_count;i++)
+    // Take the poses of the resulting cloud, if anyone is listening and it
+    // is due; laserReceived() publishes them
+    ros::Time now = ros::Time::now();
+    if (!m_force_update && particlecloud_pub_.getNumSubscribers() > 0 &&
+        (cloud_pub_interval.isZero() || now - last_cloud_pub_time >= cloud_pub_interval)) {
+      last_cloud_pub_time = now;
+      cloud_header->stamp = now;
+      cloud_header->frame_id = global_frame_id_;
+      if(cloud_clusters_)
       {
-        tf::poseTFToMsg(tf::Pose(tf::createQuaternionFromYaw(set->samples[i].pose.v[2]),
-                                 tf::Vector3(set->samples[i].pose.v[0],
-                                           set->samples[i].pose.v[1], 0)),
-                        cloud_msg.poses[i]);
+        for(int c=0;c<set->cluster_count;c++)
+          cloud->push_back(set->clusters[c].mean);
+      }
+      else
+      {
+        int step = 1;
+        if(cloud_max_poses_ > 0 && set->sample_count > cloud_max_poses_)
+          step = (set->sample_count + cloud_max_poses_ - 1) / cloud_max_poses_;
+        cloud->reserve(set->sample_count / step + 1);
+        for(int i=0;i<set->sample_count;i+=step)
+          cloud->push_back(pf_sample_get_pose(set, i));
       }
-      particlecloud_pub_.publish(cloud_msg);
     }
   }
 
@@ -1263,26 +2577,29 @@ AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
     int max_weight_hyp = -1;
     std::vector<amcl_hyp_t> hyps;
     hyps.resize(pf_->sets[pf_->current_set].cluster_count);
-    for(int hyp_count = 0;
-        hyp_count < pf_->sets[pf_->current_set].cluster_count; hyp_count++)
     {
-      double weight;
-      pf_vector_t pose_mean;
-      pf_matrix_t pose_cov;
-      if (!pf_get_cluster_stats(pf_, hyp_count, &weight, &pose_mean, &pose_cov))
+      ScopedStageTimer timer(stageTimes(), TIMING_CLUSTERS);
+      for(int hyp_count = 0;
+          hyp_count < pf_->sets[pf_->current_set].cluster_count; hyp_count++)
       {
-        ROS_ERROR("Couldn't get stats on cluster %d", hyp_count);
-        break;
-      }
+        double weight;
+        pf_vector_t pose_mean;
+        pf_matrix_t pose_cov;
+        if (!pf_get_cluster_stats(pf_, hyp_count, &weight, &pose_mean, &pose_cov))
+        {
+          ROS_ERROR("Couldn't get stats on cluster %d", hyp_count);
+          break;
+        }
 
-      hyps[hyp_count].weight = weight;
-      hyps[hyp_count].pf_pose_mean = pose_mean;
-      hyps[hyp_count].pf_pose_cov = pose_cov;
+        hyps[hyp_count].weight = weight;
+        hyps[hyp_count].pf_pose_mean = pose_mean;
+        hyps[hyp_count].pf_pose_cov = pose_cov;
 
-      if(hyps[hyp_count].weight > max_weight)
-      {
-        max_weight = hyps[hyp_count].weight;
-        max_weight_hyp = hyp_count;
+        if(hyps[hyp_count].weight > max_weight)
+        {
+          max_weight = hyps[hyp_count].weight;
+          max_weight_hyp = hyp_count;
+        }
       }
     }
 
@@ -1367,6 +2684,15 @@ AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
       latest_tf_ = tf::Transform(tf::Quaternion(odom_to_map.getRotation()),
                                  tf::Point(odom_to_map.getOrigin()));
       latest_tf_valid_ = true;
+      if(extrapolation_spinner_)
+      {
+        boost::mutex::scoped_lock el(extrapolation_mutex_);
+        extrapolation_tf_ = latest_tf_;
+        extrapolation_cov_ = p.pose.covariance;
+        extrapolation_odom_frame_ = odom_frame_id_;
+        extrapolation_global_frame_ = global_frame_id_;
+        extrapolation_valid_ = true;
+      }
 
       if (tf_broadcast_ == true)
       {
@@ -1377,6 +2703,7 @@ AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
         tf::StampedTransform tmp_tf_stamped(latest_tf_.inverse(),
                                             transform_expiration,
                                             global_frame_id_, odom_frame_id_);
+        ScopedStageTimer timer(stageTimes(), TIMING_TF);
         this->tfb_->sendTransform(tmp_tf_stamped);
         sent_first_transform_ = true;
       }
@@ -1397,6 +2724,7 @@ AmclNode::laserReceived(const sensor_msgs::LaserScanConstPtr& laser_scan)
       tf::StampedTransform tmp_tf_stamped(latest_tf_.inverse(),
                                           transform_expiration,
                                           global_frame_id_, odom_frame_id_);
+      ScopedStageTimer timer(stageTimes(), TIMING_TF);
       this->tfb_->sendTransform(tmp_tf_stamped);
     }
 
@@ -1515,6 +2843,7 @@ AmclNode::applyInitialPose()
   if( initial_pose_hyp_ != NULL && map_ != NULL ) {
     pf_init(pf_, initial_pose_hyp_->pf_pose_mean, initial_pose_hyp_->pf_pose_cov);
     pf_init_ = false;
+    invalidateExtrapolation();
 
     delete initial_pose_hyp_;
     initial_pose_hyp_ = NULL;
@@ -0,0 +1,202 @@
+/*
+ *  Player - One Hell of a Robot Server
+ *  Copyright (C) 2000  Brian Gerkey   &  Kasper Stoy
+ *                      gerkey@usc.edu    kaspers@robotics.usc.edu
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Tests of the map comparisons and likelihood fields
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include "map/map.h"
+#include "sensors/amcl_laser.h"
+
+using namespace amcl;
+
+// A 40 X 30 map at 0.1 m with a box in it, in cells or in compact storage
+static map_t* boxMap(bool compact)
+{
+  map_t* map = map_alloc();
+  map->size_x = 40;
+  map->size_y = 30;
+  map->scale = 0.1;
+  map->origin_x = 2.0;
+  map->origin_y = 1.5;
+  int n = map->size_x * map->size_y;
+  if(compact)
+    map->occ_states = (int8_t*)malloc(n);
+  else
+    map->cells = (map_cell_t*)malloc(n * sizeof(map_cell_t));
+  for(int j = 0; j < map->size_y; j++)
+  {
+    for(int i = 0; i < map->size_x; i++)
+    {
+      bool wall = (i == 10 || i == 30) && j >= 5 && j < 25;
+      int8_t state = wall ? +1 : -1;
+      if(compact)
+        map->occ_states[MAP_INDEX(map, i, j)] = state;
+      else
+        map->cells[MAP_INDEX(map, i, j)].occ_state = state;
+    }
+  }
+  return map;
+}
+
+TEST(Map, sameOccupancy)
+{
+  for(int compact = 0; compact < 2; compact++)
+  {
+    map_t* a = boxMap(compact);
+    map_t* b = boxMap(compact);
+    EXPECT_TRUE(map_same_occupancy(a, b));
+
+    // a changed cell
+    if(compact)
+      b->occ_states[MAP_INDEX(b, 3, 4)] = 0;
+    else
+      b->cells[MAP_INDEX(b, 3, 4)].occ_state = 0;
+    EXPECT_FALSE(map_same_occupancy(a, b));
+    map_free(b);
+
+    // the same cells, placed elsewhere
+    b = boxMap(compact);
+    b->origin_x += b->scale;
+    EXPECT_FALSE(map_same_occupancy(a, b));
+    map_free(b);
+
+    // the same cells at another resolution
+    b = boxMap(compact);
+    b->scale = 0.05;
+    EXPECT_FALSE(map_same_occupancy(a, b));
+    map_free(b);
+    map_free(a);
+  }
+
+  // the same occupancy in the other storage
+  map_t* a = boxMap(false);
+  map_t* b = boxMap(true);
+  EXPECT_FALSE(map_same_occupancy(a, b));
+  map_free(a);
+  map_free(b);
+}
+
+// A map kept with its likelihood field, and handed to a new laser model as
+// amcl does when it switches back to it, keeps the field rather than
+// building it again
+TEST(Map, residentMapKeepsField)
+{
+  map_t* map = boxMap(false);
+  {
+    AMCLLaser laser(30, map);
+    laser.SetModelLikelihoodField(0.95, 0.05, 0.2, 1.0);
+  }
+  ASSERT_NE(0u, map->cspace_key);
+  int index = MAP_INDEX(map, 20, 15);
+  double built = map->cells[index].occ_dist;
+  EXPECT_DOUBLE_EQ(1.0, built);
+
+  // a mark only a rebuild would wipe
+  map->cells[index].occ_dist = 0.5;
+  {
+    AMCLLaser laser(30, map);
+    laser.SetModelLikelihoodField(0.95, 0.05, 0.2, 1.0);
+  }
+  EXPECT_EQ(0.5, map->cells[index].occ_dist);
+
+  // another max_occ_dist needs another field
+  {
+    AMCLLaser laser(30, map);
+    laser.SetModelLikelihoodField(0.95, 0.05, 0.2, 0.8);
+  }
+  EXPECT_DOUBLE_EQ(0.8, map->cells[index].occ_dist);
+  map_free(map);
+}
+
+// Set the occupancy of a cell, in either storage
+static void setOccState(map_t* map, int i, int j, int state)
+{
+  if(map->cells)
+    map->cells[MAP_INDEX(map, i, j)].occ_state = state;
+  else
+    map->occ_states[MAP_INDEX(map, i, j)] = state;
+}
+
+// Build the field with the brushfire or with the exact transform
+static void buildCspace(map_t* map, bool edt, double max_occ_dist)
+{
+  if(edt)
+    map_update_cspace_edt(map, max_occ_dist, 1);
+  else
+    map_update_cspace(map, max_occ_dist);
+}
+
+// A patch of random edits, repaired with map_update_cspace_region(), leaves
+// the same field as a build from scratch with the transform the field came
+// from
+TEST(Map, cspaceRegionMatchesFull)
+{
+  const double max_occ_dist = 0.5;
+  srand(42);
+  for(int run = 0; run < 4; run++)
+  {
+    bool compact = run & 1, edt = run & 2;
+    map_t* patched = boxMap(compact);
+    map_t* full = boxMap(compact);
+    buildCspace(patched, edt, max_occ_dist);
+
+    for(int edit = 0; edit < 50; edit++)
+    {
+      int width = 1 + rand() % 6, height = 1 + rand() % 6;
+      int x0 = rand() % (patched->size_x - width + 1), y0 = rand() % (patched->size_y - height + 1);
+      for(int j = y0; j < y0 + height; j++)
+      {
+        for(int i = x0; i < x0 + width; i++)
+        {
+          int state = rand() % 3 - 1;
+          setOccState(patched, i, j, state);
+          setOccState(full, i, j, state);
+        }
+      }
+      map_update_cspace_region(patched, x0, y0, width, height);
+      buildCspace(full, edt, max_occ_dist);
+
+      for(int j = 0; j < patched->size_y; j++)
+      {
+        for(int i = 0; i < patched->size_x; i++)
+        {
+          int index = MAP_INDEX(patched, i, j);
+          ASSERT_NEAR(MAP_OCC_DIST(full, index), MAP_OCC_DIST(patched, index), 1e-9)
+              << "cell " << i << ", " << j << " after edit " << edit << (compact ? " (compact)" : "") << (edt ? " (edt)" : "");
+        }
+      }
+    }
+    map_free(patched);
+    map_free(full);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
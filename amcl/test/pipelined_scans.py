@@ -0,0 +1,56 @@
+#!/usr/bin/env python
+
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+
+import rospy
+import rostest
+from roslib.packages import find_node
+
+PKG = 'amcl'
+
+# the parameters of basic_localization_stage.xml that differ from the defaults
+PARAMS = ['_laser_max_beams:=30', '_min_particles:=500', '_max_particles:=5000',
+          '_odom_model_type:=omni', '_odom_alpha3:=0.8', '_odom_alpha5:=0.1',
+          '_laser_z_max:=0.05', '_laser_z_rand:=0.5', '_laser_likelihood_max_dist:=2.0',
+          '_initial_pose_x:=47.443', '_initial_pose_y:=21.421', '_initial_pose_a:=-1.003']
+
+
+class TestPipelinedScans(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def benchmark(self, bag, pipeline):
+        nodes = find_node(PKG, 'amcl')
+        self.assertTrue(nodes, 'amcl is not built')
+        output = os.path.join(self.dir, 'pipeline.json' if pipeline else 'serial.json')
+        args = [nodes[0], '--benchmark-from-bag', bag,
+                '_benchmark_output:=' + output,
+                '_pipeline_scans:=' + ('true' if pipeline else 'false')] + PARAMS
+        self.assertEqual(subprocess.call(args), 0)
+        with open(output) as f:
+            return json.load(f)
+
+    def test_same_pose(self):
+        bag = rospy.myargv()[1]
+        serial = self.benchmark(bag, False)
+        pipelined = self.benchmark(bag, True)
+        self.assertGreater(serial['scans'], 0)
+        self.assertEqual(pipelined['scans'], serial['scans'])
+        # every estimate goes into the checksum
+        self.assertEqual(pipelined['checksum'], serial['checksum'])
+        for a, b in zip(pipelined['final_pose'], serial['final_pose']):
+            self.assertAlmostEqual(a, b, places=6)
+
+
+if __name__ == '__main__':
+    rostest.run(PKG, 'pipelined_scans', TestPipelinedScans, sys.argv)
@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+///////////////////////////////////////////////////////////////////////////
+//
+// Desc: Tests of the scan match refinement of the cluster means
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include "map/map.h"
+#include "pf/pf.h"
+#include "sensors/amcl_laser.h"
+#include "sensors/amcl_scan_matcher.h"
+
+using namespace amcl;
+
+// A 3 x 2.5 m room at 0.05 m, centred on the origin, with a pillar off
+// centre so that no pose matches the scan as well as the true one
+static map_t* roomMap()
+{
+  map_t* map = map_alloc();
+  map->size_x = 60;
+  map->size_y = 50;
+  map->scale = 0.05;
+  map->cells = (map_cell_t*)malloc(map->size_x * map->size_y * sizeof(map_cell_t));
+  for(int j = 0; j < map->size_y; j++)
+  {
+    for(int i = 0; i < map->size_x; i++)
+    {
+      bool wall = i == 0 || j == 0 || i == map->size_x - 1 || j == map->size_y - 1;
+      bool pillar = i >= 40 && i < 46 && j >= 10 && j < 14;
+      map->cells[MAP_INDEX(map, i, j)].occ_state = (wall || pillar) ? +1 : -1;
+    }
+  }
+  return map;
+}
+
+// The scan a laser at pose sees of map, over a full turn
+static void castScan(map_t* map, pf_vector_t pose, AMCLLaserData* data)
+{
+  data->range_count = 180;
+  data->range_max = 5.0;
+  data->ranges = new double[data->range_count][2];
+  for(int i = 0; i < data->range_count; i++)
+  {
+    double bearing = -M_PI + i * 2 * M_PI / data->range_count;
+    data->ranges[i][0] = map_calc_range(map, pose.v[0], pose.v[1], pose.v[2] + bearing,
+                                        data->range_max);
+    data->ranges[i][1] = bearing;
+  }
+}
+
+// A cluster of particles set down off the pose a scan was taken from is
+// carried onto that pose, as amcl does after a resample
+TEST(ScanMatcher, movesClusterOntoScan)
+{
+  map_t* map = roomMap();
+  AMCLLaser laser(60, map);
+  laser.SetModelLikelihoodField(0.95, 0.05, 0.1, 0.5);
+
+  pf_vector_t truth = pf_vector_zero();
+  truth.v[0] = 0.2;
+  truth.v[1] = -0.1;
+  truth.v[2] = 0.3;
+  AMCLLaserData data;
+  castScan(map, truth, &data);
+
+  pf_vector_t start = truth;
+  start.v[0] += 0.12;
+  start.v[1] += 0.08;
+  start.v[2] -= 0.08;
+  pf_matrix_t cov = pf_matrix_zero();
+  cov.m[0][0] = cov.m[1][1] = 0.02 * 0.02;
+  cov.m[2][2] = 0.02 * 0.02;
+  pf_set_seed(1);
+  pf_t* pf = pf_alloc(200, 200, 0.0, 0.0, NULL, NULL);
+  pf_init(pf, start, cov);
+  pf_sample_set_t* set = pf->sets + pf->current_set;
+  ASSERT_EQ(1, set->cluster_count);
+  pf_vector_t before = set->clusters[0].mean;
+
+  AMCLScanMatcher matcher(0.25, 0.15, 5);
+  pf_vector_t mean = before;
+  ASSERT_TRUE(matcher.Refine(&data, &laser, &mean));
+  EXPECT_NEAR(truth.v[0], mean.v[0], 0.02);
+  EXPECT_NEAR(truth.v[1], mean.v[1], 0.02);
+  EXPECT_NEAR(truth.v[2], mean.v[2], 0.02);
+
+  // the particles move with their mean, and keep their spread about it
+  pf_vector_t first = pf_sample_get_pose(set, 0);
+  pf_move_clusters(pf, &mean, 1);
+  ASSERT_EQ(1, set->cluster_count);
+  EXPECT_NEAR(mean.v[0], set->clusters[0].mean.v[0], 1e-6);
+  EXPECT_NEAR(mean.v[1], set->clusters[0].mean.v[1], 1e-6);
+  EXPECT_NEAR(mean.v[2], set->clusters[0].mean.v[2], 1e-6);
+  pf_vector_t moved = pf_sample_get_pose(set, 0);
+  EXPECT_NEAR(hypot(first.v[0] - before.v[0], first.v[1] - before.v[1]),
+              hypot(moved.v[0] - mean.v[0], moved.v[1] - mean.v[1]), 1e-9);
+
+  // once there, there is nothing better to move to
+  pf_vector_t settled = mean;
+  EXPECT_FALSE(matcher.Refine(&data, &laser, &settled));
+  EXPECT_EQ(mean.v[0], settled.v[0]);
+
+  pf_free(pf);
+  map_free(map);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
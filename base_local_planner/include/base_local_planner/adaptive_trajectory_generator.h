@@ -0,0 +1,128 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef ADAPTIVE_TRAJECTORY_GENERATOR_H_
+#define ADAPTIVE_TRAJECTORY_GENERATOR_H_
+
+#include <vector>
+
+#include <base_local_planner/simple_trajectory_generator.h>
+#include <Eigen/Core>
+
+namespace base_local_planner {
+
+/**
+ * generates trajectories coarse to fine: a coarse grid over the velocity window first,
+ * then, round by round, the neighbors of the lowest cost samples so far at half the
+ * spacing of the round before, until the spacing is that of the full vsamples grid.
+ * The last best velocity can seed the coarse grid of the next cycle. When no coarse
+ * sample is valid the full grid is sampled instead, so it fails where the full grid fails.
+ *
+ * A round needs the costs of the round before, so the generator reports no more
+ * trajectories until those it generated were passed to setTrajectoryCost(),
+ * as SimpleScoredSamplingPlanner does.
+ */
+class AdaptiveTrajectoryGenerator: public base_local_planner::SimpleTrajectoryGenerator {
+public:
+
+  AdaptiveTrajectoryGenerator();
+
+  ~AdaptiveTrajectoryGenerator() {}
+
+  /**
+   * @param coarse_samples samples per dimension of the coarse grid, at most those of vsamples
+   * @param refine_best how many of the lowest cost samples each round refines around
+   * @param seed_last_best whether to add the last best velocity to the coarse grid
+   */
+  void setAdaptiveParameters(int coarse_samples, int refine_best, bool seed_last_best);
+
+  /**
+   * @param pos current robot position
+   * @param vel current robot velocity
+   * @param limits Current velocity limits
+   * @param vsamples: samples per dimension of the full grid, whose spacing refinement stops at
+   * @param discretize_by_time if true, the trajectory is split according in chunks of the same duration, else of same length
+   */
+  void initialise(
+      const Eigen::Vector3f& pos,
+      const Eigen::Vector3f& vel,
+      const Eigen::Vector3f& goal,
+      base_local_planner::LocalPlannerLimits* limits,
+      const Eigen::Vector3f& vsamples,
+      bool discretize_by_time = false);
+
+  /**
+   * Whether this generator can create more trajectories, false while costs are outstanding
+   */
+  bool hasMoreTrajectories();
+
+  /**
+   * Create and return the next sample trajectory
+   */
+  bool nextTrajectory(Trajectory &traj);
+
+  void setTrajectoryCost(const Trajectory &traj, double cost);
+
+private:
+
+  /**
+   * Queues the next round of samples, returns false when there is none
+   */
+  bool refine();
+
+  /**
+   * Queues the velocity clamped to the window, unless it was sampled already
+   */
+  void addSample(Eigen::Vector3f vel_samp);
+
+  int coarse_samples_, refine_best_;
+  bool seed_last_best_;
+
+  Eigen::Vector3f min_vel_, max_vel_;
+  Eigen::Vector3f step_; ///< @brief sample spacing of the last round
+  Eigen::Vector3f fine_step_; ///< @brief sample spacing of the full grid
+
+  std::vector<Eigen::Vector3f> samples_;
+  std::vector<double> costs_; ///< @brief cost of each sample, negative for invalid or not generated
+  std::vector<unsigned int> pending_; ///< @brief samples generated, in order, to match costs to
+  unsigned int reported_;
+  bool fell_back_, done_;
+
+  Eigen::Vector3f last_best_;
+  bool have_last_best_;
+};
+
+} /* namespace base_local_planner */
+#endif /* ADAPTIVE_TRAJECTORY_GENERATOR_H_ */
@@ -0,0 +1,134 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef BACKGROUND_CLOUD_PUBLISHER_H_
+#define BACKGROUND_CLOUD_PUBLISHER_H_
+
+#include <string>
+
+#include <ros/ros.h>
+#include <pcl_ros/publisher.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+namespace base_local_planner {
+
+/**
+ * @class BackgroundCloudPublisher
+ * @brief Publishes debug point clouds from a thread of its own, so that converting and sending them
+ * stays out of the control loop. The loop asks ready() before building a cloud, which is false
+ * while nobody subscribes or until the rate limit allows the next one, and hands the cloud over
+ * with publish(). A cloud that is handed over before the thread sent the last one replaces it.
+ */
+template <typename PointT>
+class BackgroundCloudPublisher {
+public:
+  BackgroundCloudPublisher() : thread_(NULL), has_pending_(false), period_(0.0) {}
+
+  ~BackgroundCloudPublisher() {
+    if (thread_) {
+      thread_->interrupt();
+      thread_->join();
+      delete thread_;
+    }
+  }
+
+  /**
+   * @brief Advertises the topic and starts the thread
+   * @param max_rate The most clouds per second to publish, or 0 for no limit
+   */
+  void advertise(ros::NodeHandle& nh, const std::string& topic, double max_rate) {
+    pub_.advertise(nh, topic, 1);
+    period_ = max_rate > 0 ? 1.0 / max_rate : 0.0;
+    if (!thread_) {
+      thread_ = new boost::thread(boost::bind(&BackgroundCloudPublisher::publishThread, this));
+    }
+  }
+
+  /**
+   * @brief Whether a cloud handed over now would be published
+   */
+  bool ready() {
+    return thread_ && pub_.getNumSubscribers() > 0 && (ros::WallTime::now() - last_).toSec() >= period_;
+  }
+
+  /**
+   * @brief Hands the points and header of cloud over to the thread, leaving cloud with stale points to be cleared
+   */
+  void publish(pcl::PointCloud<PointT>& cloud) {
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      pending_.points.swap(cloud.points);
+      pending_.header = cloud.header;
+      pending_.width = pending_.points.size();
+      pending_.height = 1;
+      has_pending_ = true;
+    }
+    last_ = ros::WallTime::now();
+    cond_.notify_one();
+  }
+
+private:
+  void publishThread() {
+    pcl::PointCloud<PointT> cloud;
+    while (true) {
+      {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (!has_pending_) {
+          cond_.wait(lock);
+        }
+        cloud.points.swap(pending_.points);
+        cloud.header = pending_.header;
+        cloud.width = pending_.width;
+        cloud.height = pending_.height;
+        has_pending_ = false;
+      }
+      pub_.publish(cloud);
+    }
+  }
+
+  pcl_ros::Publisher<PointT> pub_;
+  boost::thread* thread_;
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  pcl::PointCloud<PointT> pending_; ///< @brief The cloud waiting for the thread
+  bool has_pending_;
+  double period_; ///< @brief The least time between two clouds, in seconds
+  ros::WallTime last_;
+};
+
+};
+
+#endif
@@ -0,0 +1,119 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef CLEARANCE_COST_FUNCTION_H_
+#define CLEARANCE_COST_FUNCTION_H_
+
+#include <vector>
+
+#include <base_local_planner/trajectory_cost_function.h>
+#include <costmap_2d/costmap_2d.h>
+#include <geometry_msgs/Point.h>
+
+namespace base_local_planner {
+
+/**
+ * class ClearanceCostFunction
+ * @brief Scores trajectories by how close the footprint comes to obstacles, from a distance
+ * transform of the costmap that prepare() computes. The footprint is covered by a few circles
+ * along its length, so each point of a trajectory takes a lookup per circle. Lethal and unknown
+ * cells are obstacles, and distances are to their centers.
+ */
+class ClearanceCostFunction : public TrajectoryCostFunction {
+public:
+  struct Circle {
+    double x, y, radius;
+  };
+
+  ClearanceCostFunction(costmap_2d::Costmap2D* costmap);
+
+  /**
+   * Computes the distance transform of the costmap
+   */
+  bool prepare();
+
+  /**
+   * How much the smallest clearance along the trajectory falls short of the max clearance,
+   * -6.0 if a circle of the footprint reaches an obstacle cell and -7.0 if a point is off the map
+   */
+  double scoreTrajectory(Trajectory &traj);
+  bool isThreadSafe() { return true; }
+
+  /**
+   * Covers the footprint by circles, centered along its x axis on slices of equal length,
+   * one per slice as wide as the footprint if circles is 0
+   */
+  void setFootprint(const std::vector<geometry_msgs::Point>& footprint_spec, int circles = 0);
+
+  /**
+   * The clearance, in meters, from which on a trajectory costs nothing
+   */
+  void setMaxClearance(double max_clearance) { max_clearance_ = max_clearance; }
+
+  /**
+   * Splits the distance transform into this many tasks on the shared executor
+   */
+  void setThreads(int threads) { threads_ = threads; }
+
+  /**
+   * The smallest distance from a circle of the footprint at the pose to an obstacle, after prepare(),
+   * false if a circle is off the map
+   */
+  bool pointClearance(double x, double y, double th, double& clearance);
+
+  /**
+   * The distance from the center of the cell to that of the nearest obstacle cell, in cells
+   */
+  float getDistance(unsigned int mx, unsigned int my) const { return distance_[my * size_x_ + mx]; }
+
+  const std::vector<Circle>& getCircles() const { return circles_; }
+
+private:
+  void transformColumnBand(unsigned int tasks, unsigned int t);
+  void transformRowBand(unsigned int tasks, unsigned int t);
+  void transformColumns(unsigned int x0, unsigned int xn);
+  void transformRows(unsigned int y0, unsigned int yn);
+
+  costmap_2d::Costmap2D* costmap_;
+  std::vector<Circle> circles_;
+  double max_clearance_;
+  int threads_;
+
+  unsigned int size_x_, size_y_;
+  std::vector<float> distance_; ///< @brief Squared distances between the passes, distances after them
+};
+
+} /* namespace base_local_planner */
+#endif /* CLEARANCE_COST_FUNCTION_H_ */
@@ -0,0 +1,171 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef TRAJECTORY_ROLLOUT_COMPACT_MAP_GRID_H_
+#define TRAJECTORY_ROLLOUT_COMPACT_MAP_GRID_H_
+
+#include <vector>
+#include <utility>
+
+#include <costmap_2d/costmap_2d.h>
+#include <geometry_msgs/PoseStamped.h>
+
+namespace base_local_planner{
+  /**
+   * @class CompactMapGrid
+   * @brief The path and goal distances of a MapGrid, kept as a float per cell and a byte for whether the
+   * cell was marked, with the coordinates of a cell given by its index rather than stored. Propagating and
+   * reading the distances touches a fraction of the memory of a grid of MapCells. There is no mark for
+   * cells within the robot, which count as obstacles when they are.
+   */
+  class CompactMapGrid{
+    public:
+      /**
+       * @brief  Creates a 0x0 map by default
+       */
+      CompactMapGrid();
+
+      /**
+       * @brief  Creates a map of size_x by size_y
+       * @param size_x The width of the map
+       * @param size_y The height of the map
+       */
+      CompactMapGrid(unsigned int size_x, unsigned int size_y);
+
+      /**
+       * @brief  Returns the distance of a cell accessed by (col, row)
+       */
+      inline float operator() (unsigned int x, unsigned int y) const {
+        return target_dist_[size_x_ * y + x];
+      }
+
+      /**
+       * @brief  Whether the propagation reached a cell, as an obstacle or not
+       */
+      inline bool isMarked(unsigned int x, unsigned int y) const {
+        return target_mark_[size_x_ * y + x] != 0;
+      }
+
+      /**
+       * @brief reset path distance fields for all cells
+       */
+      void resetPathDist();
+
+      /**
+       * @brief  check if we need to resize
+       * @param size_x The desired width
+       * @param size_y The desired height
+       */
+      void sizeCheck(unsigned int size_x, unsigned int size_y);
+
+      /**
+       * @brief  Have setTargetCells() and setLocalGoal() repair the distances they last computed where the
+       * cells they start from, the obstacles or the window of the costmap changed, rather than compute them
+       * over. The callers then leave out resetPathDist(), which makes the next call compute them in full.
+       */
+      void setIncremental(bool incremental) {
+        incremental_ = incremental;
+        have_field_ = false;
+      }
+
+      bool isIncremental() const {
+        return incremental_;
+      }
+
+      /**
+       * return a value that indicates cell is in obstacle
+       */
+      inline double obstacleCosts() {
+        return target_dist_.size();
+      }
+
+      /**
+       * returns a value indicating cell was not reached by wavefront
+       * propagation of set cells. (is behind walls, regarding the region covered by grid)
+       */
+      inline double unreachableCellCosts() {
+        return target_dist_.size() + 1;
+      }
+
+      /**
+       * @brief  Compute the distance from each cell in the grid to the given cells, after resetPathDist()
+       * @param seeds Indices of the cells the distances are measured from, which may repeat
+       */
+      void computeTargetDistance(const std::vector<unsigned int>& seeds, const costmap_2d::Costmap2D& costmap);
+
+      /**
+       * @brief  The distances computeTargetDistance() would give, from those of the last call where
+       * little changed since
+       * @param seeds Indices of the cells the distances are measured from, which may repeat
+       */
+      void updateTargetDistance(const std::vector<unsigned int>& seeds, const costmap_2d::Costmap2D& costmap);
+
+      /**
+       * @brief Update what cells are considered path based on the global plan
+       */
+      void setTargetCells(const costmap_2d::Costmap2D& costmap, const std::vector<geometry_msgs::PoseStamped>& global_plan);
+
+      /**
+       * @brief Update what cell is considered the next local goal
+       */
+      void setLocalGoal(const costmap_2d::Costmap2D& costmap,
+            const std::vector<geometry_msgs::PoseStamped>& global_plan);
+
+      double goal_x_, goal_y_; /**< @brief The goal distance was last computed from */
+
+      unsigned int size_x_, size_y_; ///< @brief The dimensions of the grid
+
+    private:
+      inline void visitCell(unsigned int current, unsigned int check, unsigned int check_x,
+          const unsigned char* costs, unsigned int& tail);
+      inline int neighborsOf(unsigned int index, unsigned int x, unsigned int* neighbors) const;
+      inline void checkSupport(unsigned int index, unsigned int& tail);
+
+      std::vector<float> target_dist_; ///< @brief Distance of each cell to the planner's path or goal
+      std::vector<unsigned char> target_mark_; ///< @brief Marks for computing path/goal distances, a byte each as bits are slower to set
+
+      std::vector<unsigned int> fifo_; ///< @brief Cell indices queued by the distance computations, each at most once
+      std::vector<unsigned int> fifo_x_; ///< @brief Columns of the cells queued by computeTargetDistance()
+      std::vector<unsigned int> seeds_;
+
+      bool incremental_;
+      bool have_field_; ///< @brief Whether dist_ and state_ hold the last distances of updateTargetDistance()
+      double field_origin_x_, field_origin_y_, field_resolution_; ///< @brief The window they were computed in
+      std::vector<unsigned int> dist_; ///< @brief Steps from the nearest initial cell, UINT_MAX where unreached
+      std::vector<unsigned char> state_, next_; ///< @brief Bits of the cells for the last and the current call
+      std::vector<unsigned int> changed_;
+      std::vector<std::pair<unsigned int, unsigned int> > lowered_;
+  };
+};
+
+#endif
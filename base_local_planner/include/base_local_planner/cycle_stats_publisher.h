@@ -0,0 +1,134 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef CYCLE_STATS_PUBLISHER_H_
+#define CYCLE_STATS_PUBLISHER_H_
+
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <base_local_planner/CycleStats.h>
+#include <base_local_planner/simple_scored_sampling_planner.h>
+
+namespace base_local_planner {
+
+/**
+ * @class CycleStatsPublisher
+ * @brief Keeps the times of the stages of the last few local planner cycles and publishes them, with
+ * a histogram per stage, and the trajectories and critics of the latest cycle, so that it shows where
+ * the time of a cycle that missed the controller's rate went.
+ */
+class CycleStatsPublisher {
+public:
+  /**
+   * @brief Times one stage of the current cycle until it goes out of scope
+   */
+  class StageTimer {
+  public:
+    StageTimer(CycleStatsPublisher* stats, unsigned int stage)
+      : stats_(stats), stage_(stage), start_(ros::WallTime::now()) {}
+    ~StageTimer() {
+      stats_->addStageTime(stage_, (ros::WallTime::now() - start_).toSec());
+    }
+  private:
+    CycleStatsPublisher* stats_;
+    unsigned int stage_;
+    ros::WallTime start_;
+  };
+
+  /**
+   * @brief Starts a cycle, and ends it when it goes out of scope, whichever way the cycle returns
+   */
+  class CycleTimer {
+  public:
+    CycleTimer(CycleStatsPublisher* stats) : stats_(stats) {
+      stats_->startCycle();
+    }
+    ~CycleTimer() {
+      stats_->endCycle();
+    }
+  private:
+    CycleStatsPublisher* stats_;
+  };
+
+  /**
+   * @param stage_names The stages of a cycle, which addStageTime() takes the index of
+   * @param window The number of cycles the histograms cover
+   */
+  CycleStatsPublisher(ros::NodeHandle* ros_node, std::string topic_name,
+                      const std::vector<std::string>& stage_names, unsigned int window);
+
+  /**
+   * @brief Whether anyone listens, and so whether it is worth measuring the critics
+   */
+  bool hasSubscribers() const {
+    return stats_pub_.getNumSubscribers() > 0;
+  }
+
+  void startCycle();
+
+  void addStageTime(unsigned int stage, double seconds);
+
+  /**
+   * @brief Takes the trajectories and critics of the planner's last findBestTrajectory
+   * @param critic_names The names of the critics, in the order the planner was given them
+   */
+  void setPlannerStats(const SimpleScoredSamplingPlanner& planner, const std::vector<std::string>& critic_names);
+
+  /**
+   * @brief Add the cycle to the window, and publish it if anyone listens
+   */
+  void endCycle();
+
+private:
+  /** @brief Count the samples of one series that fall into each bin. */
+  void fillHistogram(unsigned int series, std::vector<uint32_t>* histogram) const;
+
+  ros::Publisher stats_pub_;
+  std::vector<double> bin_edges_;
+  unsigned int window_;
+
+  ros::WallTime cycle_start_;
+  CycleStats cycle_; ///< @brief The latest cycle, filled in as it goes
+
+  /** Ring buffers of window_ samples: the cycle time, then the time of each stage */
+  std::vector<std::vector<double> > samples_;
+  unsigned int next_sample_;
+  unsigned int sample_count_;
+};
+
+} /* namespace base_local_planner */
+#endif /* CYCLE_STATS_PUBLISHER_H_ */
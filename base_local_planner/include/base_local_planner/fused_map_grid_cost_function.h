@@ -0,0 +1,94 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef FUSED_MAP_GRID_COST_FUNCTION_H_
+#define FUSED_MAP_GRID_COST_FUNCTION_H_
+
+#include <vector>
+
+#include <base_local_planner/map_grid_cost_function.h>
+
+namespace base_local_planner {
+
+/**
+ * Scores several MapGridCostFunctions on the same costmap in a single pass over the points of a
+ * trajectory. Each point is shifted and converted to a cell once for each distinct shift of the
+ * critics, and every critic reads its grid at that cell, so the critics share one walk of the
+ * trajectory instead of each taking its own. The first critic to reject a point ends the pass.
+ *
+ * The cost is the sum of the costs of the critics, each times its own scale, so the fused critic
+ * itself should keep a scale of 1. It returns the same costs and rejects the same trajectories as
+ * giving the critics to the planner one by one, though the negative cost of a rejected trajectory
+ * may come from another of the critics.
+ */
+class FusedMapGridCostFunction: public base_local_planner::TrajectoryCostFunction {
+public:
+  /// the most critics that can be fused
+  static const unsigned int MAX_CRITICS = 8;
+
+  FusedMapGridCostFunction(costmap_2d::Costmap2D* costmap) : costmap_(costmap) {}
+  ~FusedMapGridCostFunction() {}
+
+  /**
+   * adds a critic to score in the pass, which should not also be given to the planner,
+   * returns false if there are already MAX_CRITICS
+   */
+  bool addCritic(MapGridCostFunction* critic);
+
+  /**
+   * prepares the critics, and groups those with a scale other than 0 by their shift,
+   * so their scales have to be set before
+   */
+  bool prepare();
+
+  double scoreTrajectory(Trajectory &traj);
+
+  bool isThreadSafe() { return true; }
+
+private:
+  /// the critics sharing a shift, which are critics_[begin] to critics_[end - 1] of the active ones
+  struct ShiftGroup {
+    double xshift, yshift;
+    unsigned int begin, end;
+  };
+
+  costmap_2d::Costmap2D* costmap_;
+  std::vector<MapGridCostFunction*> critics_;
+  std::vector<MapGridCostFunction*> active_critics_; ///< the critics with a scale, ordered by group
+  std::vector<ShiftGroup> groups_;
+};
+
+} /* namespace base_local_planner */
+#endif /* FUSED_MAP_GRID_COST_FUNCTION_H_ */
@@ -48,6 +48,7 @@
 #include <tf/transform_listener.h>
 
 #include <string>
+#include <vector>
 #include <cmath>
 
 #include <angles/angles.h>
@@ -106,6 +107,54 @@ namespace base_local_planner {
       const std::string& global_frame,
       std::vector<geometry_msgs::PoseStamped>& transformed_plan);
 
+  /**
+   * @class PlanTransformCache
+   * @brief Gives the same transformed and pruned plan as transformGlobalPlan() and prunePlan(), for a plan
+   * that changes only by being pruned, with less work per cycle. Each plan pose is transformed once for as
+   * long as the transform from the plan frame stays the same, and kept without its header. The search for
+   * the first pose within the costmap window resumes where it stopped the last time, unless the robot has
+   * moved close enough to a pose it skipped that the pose may be within the window again.
+   * The plan itself is never modified, so that it can be shared: pruning moves the index of its first pose.
+   */
+  class PlanTransformCache {
+    public:
+      PlanTransformCache();
+
+      /**
+       * @brief  Forgets the cached poses, to be called whenever the plan is replaced
+       */
+      void reset();
+
+      /**
+       * @brief  See base_local_planner::transformGlobalPlan()
+       * @param first The index of the first pose of global_plan that has not been pruned
+       */
+      bool transformGlobalPlan(const tf::TransformListener& tf,
+          const std::vector<geometry_msgs::PoseStamped>& global_plan,
+          unsigned int first,
+          const tf::Stamped<tf::Pose>& global_robot_pose,
+          const costmap_2d::Costmap2D& costmap,
+          const std::string& global_frame,
+          std::vector<geometry_msgs::PoseStamped>& transformed_plan);
+
+      /**
+       * @brief  See base_local_planner::prunePlan(), which moves first past the poses pruned from the global plan
+       */
+      void prunePlan(const tf::Stamped<tf::Pose>& global_pose, std::vector<geometry_msgs::PoseStamped>& plan,
+          unsigned int& first);
+
+    private:
+      std::vector<geometry_msgs::Pose> poses_; ///< @brief The transformed plan poses, pruned or not
+      std::vector<unsigned int> generations_; ///< @brief The transform each of poses_ was made with
+      unsigned int generation_; ///< @brief The number of the current transform
+      tf::Transform transform_;
+      std::string plan_frame_, global_frame_;
+
+      unsigned int start_; ///< @brief The first pose within the window at the last call
+      double skipped_dist_; ///< @brief A lower bound on the distance of the poses before start_ to (ref_x_, ref_y_)
+      double ref_x_, ref_y_;
+  };
+
   /**
      * @brief  Returns last pose in plan
      * @param tf A reference to a transform listener
@@ -0,0 +1,97 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef IN_PLACE_ROTATION_CHECKER_H_
+#define IN_PLACE_ROTATION_CHECKER_H_
+
+#include <vector>
+
+#include <costmap_2d/costmap_2d.h>
+#include <geometry_msgs/Point.h>
+
+namespace base_local_planner {
+
+/**
+ * @class InPlaceRotationChecker
+ * @brief Checks that the robot can turn in place to a heading, by laying down the outline of its footprint
+ * at every yaw bin it sweeps through. The cells of the outline at each bin are kept for the robot's cell,
+ * so that while it turns in place only the costs under them are looked up again.
+ */
+class InPlaceRotationChecker {
+public:
+  /**
+   * @param yaw_bins The number of headings per turn the footprint is laid down at
+   */
+  InPlaceRotationChecker(int yaw_bins = 72);
+
+  /**
+   * @brief Sets the footprint, dropping the cells kept for the last one if it changed
+   */
+  void setFootprint(const std::vector<geometry_msgs::Point>& footprint_spec);
+
+  bool hasFootprint() const {
+    return !footprint_spec_.empty();
+  }
+
+  /**
+   * @brief Whether the footprint clears lethal and unknown cells, as CostmapModel tells them, turning in
+   * place at (x, y) from yaw to goal_yaw
+   * @param direction The sign of the turn, the shorter way if 0
+   */
+  bool isClear(const costmap_2d::Costmap2D& costmap, double x, double y, double yaw, double goal_yaw,
+               double direction = 0.0);
+
+private:
+  /**
+   * The costmap indices of the outline at a yaw bin, or false if a corner is off the map
+   */
+  bool binCells(const costmap_2d::Costmap2D& costmap, int bin, const std::vector<unsigned int>*& cells);
+  int yawBin(double yaw) const;
+
+  int yaw_bins_;
+  std::vector<geometry_msgs::Point> footprint_spec_;
+
+  // the robot's cell and the costmap window the kept cells are for
+  bool have_cell_;
+  unsigned int cell_index_, size_x_, size_y_;
+  double origin_x_, origin_y_, resolution_;
+  double x_, y_; ///< @brief Where in the cell the outlines were laid down
+
+  std::vector<std::vector<unsigned int> > bin_cells_;
+  std::vector<unsigned char> bin_state_; ///< @brief 0 if not laid down yet, 1 if on the map, 2 if off it
+};
+
+} /* namespace base_local_planner */
+#endif /* IN_PLACE_ROTATION_CHECKER_H_ */
@@ -47,6 +47,7 @@
 #include <tf/transform_listener.h>
 
 #include <base_local_planner/local_planner_limits.h>
+#include <base_local_planner/goal_functions.h>
 
 
 namespace base_local_planner {
@@ -66,13 +67,15 @@ private:
   tf::TransformListener* tf_;
 
 
-  std::vector<geometry_msgs::PoseStamped> global_plan_;
-
+  nav_core::PlanConstPtr global_plan_;
+  unsigned int plan_first_; ///< @brief The first pose of global_plan_ that has not been pruned
+  PlanTransformCache plan_cache_;
 
   boost::mutex limits_configuration_mutex_;
   bool setup_;
   LocalPlannerLimits default_limits_;
   LocalPlannerLimits limits_;
+  double speed_limit_trans_, speed_limit_rot_; ///< @brief Caps on the configured speeds, 0 for none
   bool initialized_;
 
 public:
@@ -82,7 +85,7 @@ public:
    */
   void reconfigureCB(LocalPlannerLimits &config, bool restore_defaults);
 
-  LocalPlannerUtil() : initialized_(false) {}
+  LocalPlannerUtil() : plan_first_(0), speed_limit_trans_(0.0), speed_limit_rot_(0.0), initialized_(false) {}
 
   ~LocalPlannerUtil() {
   }
@@ -95,12 +98,25 @@ public:
 
   bool setPlan(const std::vector<geometry_msgs::PoseStamped>& orig_global_plan);
 
+  /**
+   * @brief  Follow a plan shared with its planner, pruning it without copying or modifying it
+   */
+  bool setSharedPlan(const nav_core::PlanConstPtr& orig_global_plan);
+
   bool getLocalPlan(tf::Stamped<tf::Pose>& global_pose, std::vector<geometry_msgs::PoseStamped>& transformed_plan);
 
   costmap_2d::Costmap2D* getCostmap();
 
+  /**
+   * @brief  The configured limits, with the speed limit applied
+   */
   LocalPlannerLimits getCurrentLimits();
 
+  /**
+   * @brief  Cap max_trans_vel and max_rot_vel of the current limits without reconfiguring them, 0 or less lifting a cap
+   */
+  void setSpeedLimit(double max_trans_vel, double max_rot_vel);
+
   std::string getGlobalFrame(){ return global_frame_; }
 };
 
@@ -41,6 +41,7 @@
 #include <ros/ros.h>
 
 #include <base_local_planner/map_cell.h>
+#include <base_local_planner/compact_map_grid.h>
 #include <costmap_2d/costmap_2d.h>
 #include <geometry_msgs/PoseStamped.h>
 
@@ -110,6 +111,21 @@ namespace base_local_planner{
        */
       void resetPathDist();
 
+      /**
+       * @brief  Have setTargetCells() and setLocalGoal() repair the distances they last computed where the
+       * cells they start from, the obstacles or the window of the costmap changed, rather than compute them
+       * over. The callers then leave out resetPathDist(), which makes the next call compute them in full.
+       * This is done in a CompactMapGrid, which does not tell cells within the robot from obstacles.
+       */
+      void setIncremental(bool incremental) {
+        incremental_ = incremental;
+        compact_.setIncremental(incremental);
+      }
+
+      bool isIncremental() const {
+        return incremental_;
+      }
+
       /**
        * @brief  check if we need to resize
        * @param size_x The desired width
@@ -175,6 +191,13 @@ namespace base_local_planner{
        */
       void computeGoalDistance(std::queue<MapCell*>& dist_queue, const costmap_2d::Costmap2D& costmap);
 
+      /**
+       * @brief  The distances computeTargetDistance() would give, from those of the last call where
+       * little changed since. Only the cells in the queue are read, not the distances of the cells.
+       * @param dist_queue A queue of the initial cells on the path, emptied
+       */
+      void updateTargetDistance(std::queue<MapCell*>& dist_queue, const costmap_2d::Costmap2D& costmap);
+
       /**
        * @brief Update what cells are considered path based on the global plan 
        */
@@ -194,6 +217,12 @@ namespace base_local_planner{
 
       std::vector<MapCell> map_; ///< @brief Storage for the MapCells
 
+      std::vector<unsigned int> fifo_; ///< @brief Cell indices queued by computeTargetDistance(), each at most once
+
+      bool incremental_;
+      CompactMapGrid compact_; ///< @brief Where updateTargetDistance() repairs the distances
+      std::vector<unsigned int> seeds_;
+
   };
 };
 
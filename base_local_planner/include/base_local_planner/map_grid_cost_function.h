@@ -41,7 +41,7 @@
 #include <base_local_planner/trajectory_cost_function.h>
 
 #include <costmap_2d/costmap_2d.h>
-#include <base_local_planner/map_grid.h>
+#include <base_local_planner/compact_map_grid.h>
 
 namespace base_local_planner {
 
@@ -87,12 +87,20 @@ public:
 
   void setXShift(double xshift) {xshift_ = xshift;}
   void setYShift(double yshift) {yshift_ = yshift;}
+  double getXShift() {return xshift_;}
+  double getYShift() {return yshift_;}
 
   /** @brief If true, failures along the path cause the entire path to be rejected.
    *
    * Default is true. */
   void setStopOnFailure(bool stop_on_failure) {stop_on_failure_ = stop_on_failure;}
 
+  /**
+   * repair the distances of the last prepare() where the target poses or the costmap changed,
+   * see CompactMapGrid::setIncremental()
+   */
+  void setIncremental(bool incremental) {map_.setIncremental(incremental);}
+
   /**
    * propagate distances
    */
@@ -100,6 +108,8 @@ public:
 
   double scoreTrajectory(Trajectory &traj);
 
+  bool isThreadSafe() { return true; }
+
   /**
    * return a value that indicates cell is in obstacle
    */
@@ -118,11 +128,49 @@ public:
   // used for easier debugging
   double getCellCosts(unsigned int cx, unsigned int cy);
 
+  /**
+   * the cost of a trajectory before its first point
+   */
+  double initialCost() {
+    return aggregationType_ == Product ? 1.0 : 0.0;
+  }
+
+  /**
+   * folds the distance of cell (cx, cy) into the cost of the points before it,
+   * returns a negative cost if the cell rejects the trajectory
+   */
+  inline double addCellCost(unsigned int cx, unsigned int cy, double cost) {
+    double grid_dist = map_(cx, cy);
+    //if a point on this trajectory has no clear path to the goal... it may be invalid
+    if (stop_on_failure_) {
+      if (grid_dist == map_.obstacleCosts()) {
+        return -3.0;
+      } else if (grid_dist == map_.unreachableCellCosts()) {
+        return -2.0;
+      }
+    }
+
+    switch( aggregationType_ ) {
+    case Last:
+      cost = grid_dist;
+      break;
+    case Sum:
+      cost += grid_dist;
+      break;
+    case Product:
+      if (cost > 0) {
+        cost *= grid_dist;
+      }
+      break;
+    }
+    return cost;
+  }
+
 private:
   std::vector<geometry_msgs::PoseStamped> target_poses_;
   costmap_2d::Costmap2D* costmap_;
 
-  base_local_planner::MapGrid map_;
+  base_local_planner::CompactMapGrid map_;
   CostAggregationType aggregationType_;
   /// xshift and yshift allow scoring for different
   // ooints of robots than center, like fron or back
@@ -38,7 +38,7 @@
 #include <base_local_planner/map_grid.h>
 #include <costmap_2d/costmap_2d.h>
 #include <base_local_planner/map_grid_cost_point.h>
-#include <pcl_ros/publisher.h>
+#include <base_local_planner/background_cloud_publisher.h>
 
 namespace base_local_planner {
     class MapGridVisualizer {
@@ -63,6 +63,7 @@ namespace base_local_planner {
 
             /**
               * @brief Build and publish a PointCloud if the publish_cost_grid_pc parameter was true. Only include points for which the cost_function at (cx,cy) returns true.
+              * Nothing is built while the cloud has no subscribers, or more often than the cost_cloud_rate parameter allows.
               */
             void publishCostCloud(const costmap_2d::Costmap2D* costmap_p_);
 
@@ -71,7 +72,7 @@ namespace base_local_planner {
             boost::function<bool (int cx, int cy, float &path_cost, float &goal_cost, float &occ_cost, float &total_cost)> cost_function_; ///< @brief The function to be used to generate the cost components for the output PointCloud
             ros::NodeHandle ns_nh_;
             pcl::PointCloud<MapGridCostPoint>* cost_cloud_;
-            pcl_ros::Publisher<MapGridCostPoint> pub_;
+            BackgroundCloudPublisher<MapGridCostPoint> pub_;
     };
 };
 
@@ -58,12 +58,36 @@ public:
 
   bool prepare();
   double scoreTrajectory(Trajectory &traj);
+  bool isThreadSafe() { return true; }
 
   void setSumScores(bool score_sums){ sum_scores_=score_sums; }
 
   void setParams(double max_trans_vel, double max_scaling_factor, double scaling_speed);
   void setFootprint(std::vector<geometry_msgs::Point> footprint_spec);
 
+  /**
+   * Rasterizes the footprint outline once for each of this many headings, and a few positions of the
+   * robot within its cell, in prepare() when the footprint or the costmap's resolution or width changed.
+   * Scoring a point then looks up the cells of the nearest of those around the robot's cell instead of
+   * tracing the outline at the exact pose, which may put parts of it one cell off. 0, the default, traces it.
+   */
+  void setFootprintHeadings(int headings) { headings_ = headings; }
+
+  /**
+   * The inflation cost at the circumscribed radius, below which the center cell alone says the footprint
+   * is clear of obstacles, as at or above INSCRIBED_INFLATED_OBSTACLE it says the footprint is in one.
+   * Only points in between are traced. Unknown cells under the outline of a point that isn't traced are
+   * not seen. 0, the default, traces every point.
+   */
+  void setCircumscribedCost(unsigned char cost) { circumscribed_cost_ = cost; }
+
+  /**
+   * Scores every stride-th point back from the last first, where trajectories tend to run into
+   * obstacles, and the points between only if none of those is rejected. A rejected trajectory
+   * may then get the cost of a later point it is rejected at. 0 or 1, the default, scores them in order.
+   */
+  void setCoarseStride(unsigned int stride) { coarse_stride_ = stride; }
+
   // helper functions, made static for easy unit testing
   static double getScalingFactor(Trajectory &traj, double scaling_speed, double max_trans_vel, double max_scaling_factor);
   static double footprintCost(
@@ -71,13 +95,40 @@ public:
       const double& y,
       const double& th,
       double scale,
-      std::vector<geometry_msgs::Point> footprint_spec,
+      const std::vector<geometry_msgs::Point>& footprint_spec,
       costmap_2d::Costmap2D* costmap,
-      base_local_planner::WorldModel* world_model);
+      base_local_planner::WorldModel* world_model,
+      double inscribed_radius = 0.0,
+      double circumscribed_radius = 0.0);
+
+  /**
+   * The cost of the footprint at a point of a trajectory, by whichever way is set, after prepare()
+   */
+  double pointCost(double x, double y, double th, double scale);
 
 private:
+  /**
+   * footprintCost() with the outline of the nearest heading, -6.0 and -7.0 as there
+   */
+  double outlineCost(double x, double y, double th);
+  /**
+   * Whether the center cell settles the cost of a point without tracing, as set by setCircumscribedCost()
+   */
+  bool centerCost(double x, double y, double& cost);
+  void rasterizeOutlines();
+
   costmap_2d::Costmap2D* costmap_;
   std::vector<geometry_msgs::Point> footprint_spec_;
+  double inscribed_radius_, circumscribed_radius_;
+  unsigned char circumscribed_cost_;
+  unsigned int coarse_stride_;
+
+  int headings_;
+  std::vector<std::vector<int> > outlines_; ///< @brief Costmap index offsets of the outline cells, per heading and phase
+  std::vector<int> outline_bounds_; ///< @brief Least and greatest x and y cell offsets of each outline
+  std::vector<geometry_msgs::Point> outline_footprint_; ///< @brief What the outlines were rasterized for
+  double outline_resolution_;
+  unsigned int outline_size_x_;
   base_local_planner::WorldModel* world_model_;
   double max_trans_vel_;
   bool sum_scores_;
@@ -42,6 +42,7 @@
 #include <nav_msgs/Odometry.h>
 #include <ros/ros.h>
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
 
 namespace base_local_planner {
 
@@ -61,6 +62,10 @@ public:
    */
   void odomCallback(const nav_msgs::Odometry::ConstPtr& msg);
 
+  /**
+   * @brief  The twist, stamp and child frame of the last odometry, which neither this nor
+   *         getRobotVel() ever wait for the callback to finish writing
+   */
   void getOdom(nav_msgs::Odometry& base_odom);
 
   void getRobotVel(tf::Stamped<tf::Pose>& robot_vel);
@@ -81,8 +86,21 @@ private:
 
   // we listen on odometry on the odom topic
   ros::Subscriber odom_sub_;
-  nav_msgs::Odometry base_odom_;
-  boost::mutex odom_mutex_;
+
+  // what the controller reads of the odometry, copied in and out as a whole
+  struct OdomSample {
+    double vx, vy, vth;
+    ros::Time stamp;
+    char child_frame_id[128]; ///< truncated, as the string can't be copied while it is written
+  };
+
+  /**
+   * @brief  A copy of the last sample, consistent when odom_seq_ is even and didn't change during it
+   */
+  void readOdom(OdomSample& sample);
+
+  OdomSample odom_; ///< written by the callback alone, between two increments of odom_seq_
+  boost::atomic<unsigned int> odom_seq_; ///< odd while the callback writes odom_
   // global tf frame id
   std::string frame_id_; ///< The frame_id associated this data
 };
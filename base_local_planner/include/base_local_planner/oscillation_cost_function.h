@@ -50,6 +50,8 @@ public:
 
   double scoreTrajectory(Trajectory &traj);
 
+  bool isThreadSafe() { return true; }
+
   bool prepare() {return true;};
 
   /**
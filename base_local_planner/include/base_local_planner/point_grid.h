@@ -37,7 +37,6 @@
 #ifndef POINT_GRID_H_
 #define POINT_GRID_H_
 #include <vector>
-#include <list>
 #include <cfloat>
 #include <geometry_msgs/Point.h>
 #include <costmap_2d/observation.h>
@@ -54,6 +53,10 @@ namespace base_local_planner {
    * stores points binned into a grid and performs point-in-polygon checks when
    * necessary to determine the legality of a footprint at a given
    * position/orientation.
+   *
+   * The points of all cells are packed into one array, cell after cell, so
+   * that range checks read them contiguously. Inserted points wait in a
+   * per-cell chain until the next range search packs them in with the rest.
    */
   class PointGrid : public WorldModel {
     public:
@@ -79,9 +82,25 @@ namespace base_local_planner {
        * @brief  Returns the points that lie within the cells contained in the specified range. Some of these points may be outside the range itself.
        * @param  lower_left The lower left corner of the range search 
        * @param  upper_right The upper right corner of the range search
-       * @param points A vector of pointers to lists of the relevant points
+       * @param cells The indices of the cells in the range that hold points, see cellBegin() and cellEnd()
        */
-      void getPointsInRange(const geometry_msgs::Point& lower_left, const geometry_msgs::Point& upper_right, std::vector< std::list<pcl::PointXYZ>* >& points);
+      void getPointsInRange(const geometry_msgs::Point& lower_left, const geometry_msgs::Point& upper_right, std::vector<unsigned int>& cells);
+
+      /**
+       * @brief  The first packed point of a cell, valid until the next insert or range search
+       * @param  index The index of a cell returned by getPointsInRange()
+       */
+      inline pcl::PointXYZ* cellBegin(unsigned int index) {
+        return &cell_points_[0] + cell_start_[index];
+      }
+
+      /**
+       * @brief  One past the last packed point of a cell
+       * @param  index The index of a cell returned by getPointsInRange()
+       */
+      inline pcl::PointXYZ* cellEnd(unsigned int index) {
+        return &cell_points_[0] + cell_start_[index] + cell_size_[index];
+      }
 
       /**
        * @brief  Checks if any points in the grid lie inside a convex footprint
@@ -343,15 +362,44 @@ namespace base_local_planner {
       void getPoints(pcl::PointCloud<pcl::PointXYZ>& cloud);
 
     private:
+      /**
+       * @brief  Moves the points waiting in the insertion chains into the packed storage
+       */
+      void packCells();
+
+      /**
+       * @brief  Fills the bearing table of a scan, mapping pseudo-angles around the scan origin to the scan segment bounding them
+       * @param  laser_scan The scan to index, which must have points
+       */
+      void indexScan(const PlanarLaserScan& laser_scan);
+
+      /**
+       * @brief  The same check as ptInScan(), answered from the table indexScan() filled for the scan where it can be
+       * @param  pt The point to check
+       * @param  laser_scan The scan last passed to indexScan()
+       * @return True if the point is contained within the scan, false otherwise
+       */
+      bool ptInIndexedScan(const pcl::PointXYZ& pt, const PlanarLaserScan& laser_scan);
+
       double resolution_; ///< @brief The resolution of the grid in meters/cell
       geometry_msgs::Point origin_; ///< @brief The origin point of the grid
       unsigned int width_; ///< @brief The width of the grid in cells
       unsigned int height_; ///< @brief The height of the grid in cells
-      std::vector< std::list<pcl::PointXYZ> > cells_; ///< @brief Storage for the cells in the grid
+      std::vector<pcl::PointXYZ> cell_points_; ///< @brief The points of all cells, packed cell by cell, with free slots after each cell's points
+      std::vector<unsigned int> cell_start_; ///< @brief The index in cell_points_ of the first point of each cell, and the storage end last
+      std::vector<unsigned int> cell_size_; ///< @brief The number of points in each cell
+      std::vector<pcl::PointXYZ> pending_points_; ///< @brief Points inserted into full cells since the last packing
+      std::vector<int> pending_next_; ///< @brief The next pending point of the same cell, or -1
+      std::vector<int> pending_head_; ///< @brief The last pending point of each cell, or -1
+      std::vector<unsigned int> pending_cells_; ///< @brief The cell of each pending point
+      std::vector<pcl::PointXYZ> packed_scratch_; ///< @brief The storage packCells() moves the points into
+      std::vector<unsigned int> packed_start_; ///< @brief The cell starts packCells() computes for packed_scratch_
       double max_z_;  ///< @brief The height cutoff for adding points as obstacles
       double sq_obstacle_range_;  ///< @brief The square distance at which we no longer add obstacles to the grid
       double sq_min_separation_;  ///< @brief The minimum square distance required between points in the grid
-      std::vector< std::list<pcl::PointXYZ>* > points_;  ///< @brief The lists of points returned by a range search, made a member to save on memory allocation
+      std::vector<unsigned int> points_;  ///< @brief The cells returned by a range search, made a member to save on memory allocation
+      std::vector<int> scan_bins_; ///< @brief The scan segment of each pseudo-angle bin of the indexed scan, SCAN_OUTSIDE or SCAN_AMBIGUOUS
+      double scan_v1_x_, scan_v1_y_; ///< @brief The direction of the first point of the indexed scan from its origin
   };
 };
 #endif
@@ -39,6 +39,8 @@
 #define SIMPLE_SCORED_SAMPLING_PLANNER_H_
 
 #include <vector>
+#include <boost/atomic.hpp>
+#include <ros/time.h>
 #include <base_local_planner/trajectory.h>
 #include <base_local_planner/trajectory_cost_function.h>
 #include <base_local_planner/trajectory_sample_generator.h>
@@ -58,9 +60,19 @@ namespace base_local_planner {
 class SimpleScoredSamplingPlanner : public base_local_planner::TrajectorySearch {
 public:
 
+  /**
+   * Time spent in a critic and how often it rejected a trajectory, halved at each
+   * call to findBestTrajectory so that they follow the recent cycles
+   */
+  struct CriticStats {
+    CriticStats() : seconds(0), calls(0), rejections(0) {}
+    double seconds, calls, rejections;
+  };
+
   ~SimpleScoredSamplingPlanner() {}
 
-  SimpleScoredSamplingPlanner() {}
+  SimpleScoredSamplingPlanner() : threads_(1), adaptive_critic_order_(false), measure_critics_(false),
+    last_trajectories_(0), last_generation_time_(0), cut_short_(false) {}
 
   /**
    * Takes a list of generators and critics. Critics return costs > 0, or negative costs for invalid trajectories.
@@ -93,12 +105,139 @@ public:
    */
   bool findBestTrajectory(Trajectory& traj, std::vector<Trajectory>* all_explored = 0);
 
+  /**
+   * Scores each of trajs in full, with the critics as the last findBestTrajectory prepared them,
+   * on the scoring threads when the critics in use are thread safe. Sets costs[i] to the cost of
+   * trajs[i], negative if a critic rejected it, and rejected_by[i] unless NULL to the index of
+   * that critic in the list given, or -1.
+   */
+  void scoreTrajectories(std::vector<Trajectory>& trajs, std::vector<double>& costs,
+                         std::vector<int>* rejected_by = NULL);
+
+  /**
+   * Scores the trajectories on this many threads, the calling one included, when all critics
+   * in use are thread safe, those besides the calling one being the workers of the shared
+   * nav_executor::Executor, in its control lane. The trajectories of a generator are then generated up front and
+   * scored at once, a batch at a time for generators that wait for costs, with the best cost
+   * so far shared for the early-out, and the trajectory found is the one scoring them in turn finds.
+   */
+  void setScoringThreads(int threads) {
+    threads_ = threads;
+  }
+
+  /**
+   * Measures each critic's time and rejections while scoring, and at the start of each
+   * findBestTrajectory runs those spending the least time per rejection first, critics that
+   * never reject last in their given order. Costs are the same in any order, up to the order
+   * they are summed in, but the negative cost of a trajectory is that of the first critic
+   * rejecting it.
+   */
+  void setAdaptiveCriticOrder(bool adaptive) {
+    adaptive_critic_order_ = adaptive;
+  }
+
+  /**
+   * Measures the critics and the generators as with setAdaptiveCriticOrder(), without reordering
+   */
+  void setMeasureCritics(bool measure) {
+    measure_critics_ = measure;
+  }
+
+  /**
+   * Stops findBestTrajectory at this wall time once it has a valid trajectory, returning the best
+   * of those scored by then, which are the first the generators give, so that a generator putting
+   * the likely best first (see SimpleTrajectoryGenerator's warm start) loses little. Trajectories
+   * being scored when the deadline passes are finished. Zero, the default, for no deadline.
+   * Clears lastSearchCutShort() until the next findBestTrajectory.
+   */
+  void setDeadline(const ros::WallTime& deadline) {
+    deadline_ = deadline;
+    cut_short_ = false;
+  }
+
+  /**
+   * @return whether the deadline stopped the last findBestTrajectory, since setDeadline, before it scored every trajectory
+   */
+  bool lastSearchCutShort() const {
+    return cut_short_;
+  }
+
+  /**
+   * @return the measurements of the critics, in the order they were given, empty unless measured
+   */
+  const std::vector<CriticStats>& getCriticStats() const {
+    return stats_;
+  }
+
+  /**
+   * @return the measurements of the critics in the last findBestTrajectory alone, not halved
+   */
+  const std::vector<CriticStats>& getLastCriticStats() const {
+    return last_stats_;
+  }
+
+  /**
+   * @return how many trajectories the last findBestTrajectory generated
+   */
+  unsigned int getLastTrajectoryCount() const {
+    return last_trajectories_;
+  }
+
+  /**
+   * @return the seconds the last findBestTrajectory spent generating trajectories, 0 unless measured
+   */
+  double getLastGenerationTime() const {
+    return last_generation_time_;
+  }
+
+  /**
+   * @return the indices of the critics in the order they are run
+   */
+  const std::vector<unsigned int>& getCriticOrder() const {
+    return order_;
+  }
+
 
 private:
   std::vector<TrajectorySampleGenerator*> gen_list_;
   std::vector<TrajectoryCostFunction*> critics_;
 
   int max_samples_;
+  int threads_;
+
+  bool adaptive_critic_order_, measure_critics_;
+  std::vector<unsigned int> order_; ///< @brief indices into critics_ in the order they run
+  std::vector<CriticStats> stats_, last_stats_;
+  std::vector<std::vector<CriticStats> > thread_stats_; ///< @brief measured by the scoring threads, merged into last_stats_
+  unsigned int last_trajectories_;
+  double last_generation_time_;
+  ros::WallTime deadline_;
+  bool cut_short_;
+
+  Trajectory scratch_[2]; /**< trajectories generated in turn, one of which may hold the best so far */
+  std::vector<Trajectory> batch_; /**< trajectories of a generator scored in parallel, kept for their storage */
+  std::vector<double> batch_costs_;
+
+  /**
+   * scoreTrajectory, adding the time and rejections of each critic run to stats unless NULL,
+   * and setting rejected_by unless NULL to the index of the critic rejecting traj, or -1
+   */
+  double scoreTrajectory(Trajectory& traj, double best_traj_cost, std::vector<CriticStats>* stats,
+                         int* rejected_by = NULL);
+
+  /**
+   * Scores the batch up to count, taking the next one unscored until there are none, as task
+   * of the run on the executor, measuring into stats for task 0 and thread_stats_[task] for the others.
+   * Sets expired and leaves the rest unscored once the deadline has passed with a valid trajectory found
+   */
+  void scoreBatch(unsigned int task, int count, boost::atomic<int>* next, boost::atomic<double>* best_traj_cost,
+                  boost::atomic<bool>* expired, std::vector<CriticStats>* stats);
+
+  /**
+   * Scores trajs in full for scoreTrajectories, taking the next one unscored until there are none
+   */
+  void scoreList(std::vector<Trajectory>* trajs, boost::atomic<int>* next, std::vector<double>* costs,
+                 std::vector<int>* rejected_by);
 };
 
 
@@ -40,6 +40,7 @@
 
 #include <base_local_planner/trajectory_sample_generator.h>
 #include <base_local_planner/local_planner_limits.h>
+#include <base_local_planner/trajectory_library.h>
 #include <Eigen/Core>
 
 namespace base_local_planner {
@@ -63,6 +64,9 @@ public:
 
   SimpleTrajectoryGenerator() {
     limits_ = NULL;
+    warm_start_ = false;
+    have_last_best_ = false;
+    cycle_best_cost_ = -1.0;
   }
 
   ~SimpleTrajectoryGenerator() {}
@@ -115,6 +119,31 @@ public:
       bool use_dwa = false,
       double sim_period = 0.0);
 
+  /**
+   * With warm start, initialise() puts the samples within one step of the last best
+   * velocity first, nearest first, so that their costs bound the scoring of the rest
+   * from the start. Ties between equal costs may then go to another sample.
+   */
+  void setWarmStart(bool warm_start) {
+    warm_start_ = warm_start;
+  }
+
+  /**
+   * With dwa and a resolution above 0, initialise() samples velocities on a lattice of that
+   * spacing, in m/s and rad/s, as many as vsamples asks for at most, and the rollouts of those
+   * velocities are kept in a TrajectoryLibrary, so each is simulated once and then only moved
+   * to the robot's pose. The samples are those of the lattice closest to an even spread, so they
+   * differ from those without it by up to a resolution. 0, the default, for no lattice.
+   */
+  void setPrimitiveResolution(double resolution) {
+    library_.setResolution(resolution);
+  }
+
+  /**
+   * Remembers the best velocity of the cycle for the warm start of the next one
+   */
+  void setTrajectoryCost(const Trajectory &traj, double cost);
+
   /**
    * Whether this generator can create more trajectories
    */
@@ -132,6 +161,15 @@ public:
   static Eigen::Vector3f computeNewVelocities(const Eigen::Vector3f& sample_target_vel,
       const Eigen::Vector3f& vel, Eigen::Vector3f acclimits, double dt);
 
+  /**
+   * Appends num_steps poses of a constant velocity rollout to traj, the same
+   * poses repeated computeNewPositions() calls give, with the heading rotated
+   * by a fixed step instead of taking sin and cos at every point
+   */
+  static void computeArcPositions(const Eigen::Vector3f& pos,
+      const Eigen::Vector3f& vel, double dt, int num_steps,
+      base_local_planner::Trajectory& traj);
+
   bool generateTrajectory(
         Eigen::Vector3f pos,
         Eigen::Vector3f vel,
@@ -140,6 +178,21 @@ public:
 
 protected:
 
+  /**
+   * The velocities reachable from vel_ within the limits, over sim_period_ with dwa
+   * and over sim_time_ short of overshooting the goal without
+   */
+  void computeVelocityWindow(const Eigen::Vector3f& goal,
+      Eigen::Vector3f& min_vel,
+      Eigen::Vector3f& max_vel);
+
+  /**
+   * Moves the samples within one grid step of the last best velocity to the front
+   */
+  void warmStartSamples(const Eigen::Vector3f& min_vel,
+      const Eigen::Vector3f& max_vel,
+      const Eigen::Vector3f& vsamples);
+
   unsigned int next_sample_index_;
   // to store sample params of each sample between init and generation
   std::vector<Eigen::Vector3f> sample_params_;
@@ -154,6 +207,16 @@ protected:
   double sim_time_, sim_granularity_, angular_sim_granularity_;
   bool use_dwa_;
   double sim_period_; // only for dwa
+
+  // rollouts of lattice velocities, with dwa
+  TrajectoryLibrary library_;
+
+  bool warm_start_;
+  bool have_last_best_;
+  Eigen::Vector3f last_best_;
+  // the best velocity of the current cycle, which becomes last_best_ at the next initialise
+  Eigen::Vector3f cycle_best_;
+  double cycle_best_cost_;
 };
 
 } /* namespace base_local_planner */
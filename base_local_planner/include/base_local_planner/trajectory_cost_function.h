@@ -64,6 +64,14 @@ public:
    */
   virtual double scoreTrajectory(Trajectory &traj) = 0;
 
+  /**
+   * Whether scoreTrajectory may run for several trajectories at once, between two prepare calls.
+   * Subclasses whose scoring only reads what prepare set up may overwrite to return true.
+   */
+  virtual bool isThreadSafe() {
+    return false;
+  }
+
   double getScale() {
     return scale_;
   }
@@ -0,0 +1,121 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef TRAJECTORY_LIBRARY_H_
+#define TRAJECTORY_LIBRARY_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include <boost/unordered_map.hpp>
+#include <Eigen/Core>
+
+#include <base_local_planner/trajectory.h>
+
+namespace base_local_planner {
+
+/**
+ * Keeps the poses of constant velocity rollouts from the origin of the robot frame, for velocities
+ * on a lattice of the given resolution, in one flat arena. A rollout only depends on its velocity
+ * and time step, not on where the robot is, so it is simulated the first time a velocity is asked
+ * for, and after that only moved to the robot's pose.
+ *
+ * The lattice spans the velocity limits at the resolution, so the arena holds at most one rollout
+ * per lattice velocity, plus one more per velocity whose number of steps changed.
+ */
+class TrajectoryLibrary {
+public:
+  /// a rollout in the arena
+  struct Primitive {
+    Primitive() : offset(0), num_steps(0), dt(0) {}
+    unsigned int offset; ///< the index of its first x in the arena
+    int num_steps;
+    double dt;
+  };
+
+  TrajectoryLibrary() : resolution_(0) {}
+
+  /**
+   * sets the spacing of the lattice, in m/s and rad/s, and drops the rollouts, 0 to use none
+   */
+  void setResolution(double resolution);
+
+  double getResolution() const {
+    return resolution_;
+  }
+
+  /**
+   * drops the rollouts, which have to be simulated again, as after a change of the time steps
+   */
+  void clear();
+
+  /**
+   * Fills values with up to samples lattice velocities between min and max, ascending, evenly
+   * spread over those there are and including 0 when it lies between. Without a lattice velocity
+   * in the range, gives the same values as a VelocityIterator, which are then not on the lattice.
+   */
+  void latticeValues(double min, double max, int samples, std::vector<float>& values) const;
+
+  /**
+   * @return the rollout of vel over num_steps steps of dt, simulated unless already kept,
+   * or NULL if vel is not on the lattice. The pointer stays valid until the next call.
+   */
+  const Primitive* get(const Eigen::Vector3f& vel, double dt, int num_steps);
+
+  /**
+   * Appends the poses of prim, moved from the origin to pos, to traj
+   */
+  void place(const Primitive& prim, const Eigen::Vector3f& pos, Trajectory& traj) const;
+
+  /**
+   * @return the number of rollouts kept
+   */
+  unsigned int size() const {
+    return index_.size();
+  }
+
+private:
+  /**
+   * sets key to the lattice index of vel, returns false if vel is not on the lattice
+   */
+  bool latticeKey(const Eigen::Vector3f& vel, int64_t& key) const;
+
+  double resolution_;
+  std::vector<float> arena_; ///< x, y and theta of each pose of each rollout, one after the other
+  boost::unordered_map<int64_t, Primitive> index_;
+};
+
+} /* namespace base_local_planner */
+#endif /* TRAJECTORY_LIBRARY_H_ */
@@ -56,10 +56,12 @@
 
 //for some datatypes
 #include <tf/transform_datatypes.h>
+#include <ros/time.h>
 
 //for creating a local cost grid
 #include <base_local_planner/map_cell.h>
 #include <base_local_planner/map_grid.h>
+#include <base_local_planner/obstacle_cost_function.h>
 
 namespace base_local_planner {
   /**
@@ -152,6 +154,19 @@ namespace base_local_planner {
        */
       void updatePlan(const std::vector<geometry_msgs::PoseStamped>& new_plan, bool compute_dists = false);
 
+      /**
+       * @brief  Stops findBestPath at this wall time once it has a legal trajectory, returning the best
+       * sampled by then. With a deadline, the velocity of the last cycle's forward trajectory is sampled first.
+       * Clears lastSearchCutShort until the next findBestPath.
+       * @param deadline The wall time to stop sampling at, zero, the default, for none
+       */
+      void setDeadline(const ros::WallTime& deadline) { deadline_ = deadline; cut_short_ = false; }
+
+      /**
+       * @return Whether the deadline cut the last findBestPath short
+       */
+      bool lastSearchCutShort() const { return cut_short_; }
+
       /**
        * @brief  Accessor for the goal the robot is currently pursuing in world corrdinates
        * @param x Will be set to the x position of the local goal 
@@ -204,7 +219,21 @@ namespace base_local_planner {
       bool getCellCosts(int cx, int cy, float &path_cost, float &goal_cost, float &occ_cost, float &total_cost);
 
       /** @brief Set the footprint specification of the robot. */
-      void setFootprint( std::vector<geometry_msgs::Point> footprint ) { footprint_spec_ = footprint; }
+      void setFootprint( std::vector<geometry_msgs::Point> footprint ) {
+        footprint_spec_ = footprint;
+        obstacle_costs_.setFootprint(footprint);
+      }
+
+      /**
+       * @brief  Checks the footprint with the rasterized outlines of the DWA planner's obstacle critic rather
+       * than the world model, see ObstacleCostFunction::setFootprintHeadings. The world model must see no more
+       * than the costmap does, as a CostmapModel.
+       * @param headings The number of headings to rasterize, 0 to check with the world model
+       */
+      void setFootprintHeadings(int headings) {
+        footprint_headings_ = headings;
+        obstacle_costs_.setFootprintHeadings(headings);
+      }
 
       /** @brief Return the footprint specification of the robot. */
       geometry_msgs::Polygon getFootprintPolygon() const { return costmap_2d::toPolygon(footprint_spec_); }
@@ -257,6 +286,13 @@ namespace base_local_planner {
        */
       double footprintCost(double x_i, double y_i, double theta_i);
 
+      /**
+       * @brief  Checks the deadline during sampling, recording that it cut the search short
+       * @param best The best trajectory so far
+       * @return True if best is legal and the deadline has passed
+       */
+      bool pastDeadline(const Trajectory& best);
+
       base_local_planner::FootprintHelper footprint_helper_;
     
       MapGrid path_map_; ///< @brief The local map grid where we propagate path distance
@@ -265,6 +301,8 @@ namespace base_local_planner {
       WorldModel& world_model_; ///< @brief The world model that the controller uses for collision detection
 
       std::vector<geometry_msgs::Point> footprint_spec_; ///< @brief The footprint specification of the robot
+      ObstacleCostFunction obstacle_costs_; ///< @brief Checks the footprint when footprint_headings_ is set
+      int footprint_headings_;
 
       std::vector<geometry_msgs::PoseStamped> global_plan_; ///< @brief The global path for the robot to follow
 
@@ -275,6 +313,11 @@ namespace base_local_planner {
       bool strafe_right, strafe_left; ///< @brief Booleans to keep track of strafe direction for the robot
 
       bool escaping_; ///< @brief Boolean to keep track of whether we're in escape mode
+
+      ros::WallTime deadline_; ///< @brief When to stop sampling, zero for never
+      bool cut_short_; ///< @brief Whether the deadline stopped the last createTrajectories
+      bool have_warm_start_; ///< @brief Whether warm_vx_ and warm_vtheta_ hold the last cycle's forward trajectory
+      double warm_vx_, warm_vtheta_;
       bool meter_scoring_;
 
       double goal_x_,goal_y_; ///< @brief Storage for the local goal the robot is pursuing
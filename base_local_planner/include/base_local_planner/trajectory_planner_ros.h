@@ -47,6 +47,8 @@
 #include <base_local_planner/voxel_grid_model.h>
 #include <base_local_planner/trajectory_planner.h>
 #include <base_local_planner/map_grid_visualizer.h>
+#include <base_local_planner/cycle_stats_publisher.h>
+#include <base_local_planner/goal_functions.h>
 
 #include <base_local_planner/planar_laser_scan.h>
 
@@ -116,6 +118,15 @@ namespace base_local_planner {
        */
       bool computeVelocityCommands(geometry_msgs::Twist& cmd_vel);
 
+      /**
+       * @brief  computeVelocityCommands, sampling until the deadline at most once a legal trajectory is found
+       * @param cmd_vel Will be filled with the velocity command to be passed to the robot base
+       * @param deadline The wall time by which to return, zero for none
+       * @param degraded Set to true if the deadline cut the sampling short
+       * @return True if a valid trajectory was found, false otherwise
+       */
+      bool computeVelocityCommands(geometry_msgs::Twist& cmd_vel, const ros::WallTime& deadline, bool& degraded);
+
       /**
        * @brief  Set the plan that the controller is following
        * @param orig_global_plan The plan to pass to the controller
@@ -123,6 +134,13 @@ namespace base_local_planner {
        */
       bool setPlan(const std::vector<geometry_msgs::PoseStamped>& orig_global_plan);
 
+      /**
+       * @brief  Set the plan that the controller is following, keeping it without copying it
+       * @param orig_global_plan The plan to pass to the controller
+       * @return True if the plan was updated successfully, false otherwise
+       */
+      bool setSharedPlan(const nav_core::PlanConstPtr& orig_global_plan);
+
       /**
        * @brief  Check if the goal pose has been achieved
        * @return True if achieved, false otherwise
@@ -155,6 +173,16 @@ namespace base_local_planner {
        */
       double scoreTrajectory(double vx_samp, double vy_samp, double vtheta_samp, bool update_map = true);
 
+      /**
+       * @brief  Generate and score a trajectory for each of many commands, looking up the
+       * robot's pose and odometry and updating the map only once for all of them
+       * @param cmds The velocities used to seed the trajectories
+       * @param costs Set to the score of each trajectory, negative if it is not legal
+       * @param update_map Whether or not to update the map for the planner first
+       * @return How many of the trajectories are legal, 0 if the pose of the robot is unknown
+       */
+      unsigned int scoreTrajectories(const std::vector<geometry_msgs::Twist>& cmds, std::vector<double>& costs, bool update_map = true);
+
       bool isInitialized() {
         return initialized_;
       }
@@ -206,7 +234,9 @@ namespace base_local_planner {
       std::string robot_base_frame_; ///< @brief Used as the base frame id of the robot
       double rot_stopped_velocity_, trans_stopped_velocity_;
       double xy_goal_tolerance_, yaw_goal_tolerance_, min_in_place_vel_th_;
-      std::vector<geometry_msgs::PoseStamped> global_plan_;
+      nav_core::PlanConstPtr global_plan_;
+      unsigned int plan_first_; ///< @brief The first pose of global_plan_ that has not been pruned
+      PlanTransformCache plan_cache_; ///< @brief Transforms and prunes global_plan_ from one cycle to the next
       bool prune_plan_;
       boost::recursive_mutex odom_lock_;
 
@@ -218,6 +248,7 @@ namespace base_local_planner {
       bool latch_xy_goal_tolerance_, xy_tolerance_latch_;
 
       ros::Publisher g_plan_pub_, l_plan_pub_;
+      CycleStatsPublisher* cycle_stats_; ///< @brief Times the stages of computeVelocityCommands
 
       dynamic_reconfigure::Server<BaseLocalPlannerConfig> *dsrv_;
       base_local_planner::BaseLocalPlannerConfig default_config_;
@@ -59,6 +59,14 @@ public:
    */
   virtual bool nextTrajectory(Trajectory &traj) = 0;
 
+  /**
+   * Tells the generator the cost of a trajectory it generated, in the order they were
+   * generated, for generators that pick their next samples by the costs of earlier ones.
+   * Costs may be lower bounds when scoring stopped early, and negative for invalid ones.
+   * Such a generator may report no more trajectories until the ones it generated are scored.
+   */
+  virtual void setTrajectoryCost(const Trajectory &traj, double cost) {}
+
   /**
    * @brief  Virtual destructor for the interface
    */
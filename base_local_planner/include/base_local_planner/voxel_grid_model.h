@@ -54,6 +54,8 @@ namespace base_local_planner {
    * @class VoxelGridModel
    * @brief A class that implements the WorldModel interface to provide grid
    * based collision checks for the trajectory controller using a 3D voxel grid.
+   * The collision checks run on a bitmap of the columns that are not free,
+   * which each updateWorld projects from the voxel grid.
    */
   class VoxelGridModel : public WorldModel {
     public:
@@ -114,12 +116,48 @@ namespace base_local_planner {
       double lineCost(int x0, int x1, int y0, int y1);
 
       /**
-       * @brief  Checks the cost of a point in the costmap
-       * @param x The x position of the point in cell coordinates 
-       * @param y The y position of the point in cell coordinates 
-       * @return A positive cost for a legal point... negative otherwise
+       * @brief  Projects the voxel grid into blocked_, as getVoxelColumn() classifies the columns
        */
-      double pointCost(int x, int y);
+      void updateBlocked();
+
+      /**
+       * @brief  Checks if a column is marked or unknown
+       * @param x The x position of the column in cell coordinates
+       * @param y The y position of the column in cell coordinates
+       * @return True if the column is not free, or lies off the grid
+       */
+      inline bool cellBlocked(unsigned int x, unsigned int y) const {
+        if(x >= size_x_ || y >= size_y_)
+          return true;
+        return (blocked_[y * words_per_row_ + (x >> 6)] >> (x & 63)) & 1;
+      }
+
+      /**
+       * @brief  Checks if any column in a run of cells along a row is marked or unknown
+       * @param y The row of the run in cell coordinates
+       * @param x0 The first cell of the run
+       * @param x1 The last cell of the run, not less than x0
+       * @return True if a column in the run is not free, or the run leaves the grid
+       */
+      inline bool rowBlocked(unsigned int y, unsigned int x0, unsigned int x1) const {
+        if(y >= size_y_ || x1 >= size_x_)
+          return true;
+
+        //mask the bits of the run in its first and last words, and look at whole words in between
+        const uint64_t* row = &blocked_[y * words_per_row_];
+        unsigned int w0 = x0 >> 6, w1 = x1 >> 6;
+        uint64_t first = ~(uint64_t)0 << (x0 & 63);
+        uint64_t last = ~(uint64_t)0 >> (63 - (x1 & 63));
+        if(w0 == w1)
+          return (row[w0] & first & last) != 0;
+        if(row[w0] & first)
+          return true;
+        for(unsigned int w = w0 + 1; w < w1; ++w){
+          if(row[w])
+            return true;
+        }
+        return (row[w1] & last) != 0;
+      }
 
       void removePointsInScanBoundry(const PlanarLaserScan& laser_scan, double raytrace_range);
 
@@ -172,6 +210,9 @@ namespace base_local_planner {
       double origin_z_;
       double max_z_;  ///< @brief The height cutoff for adding points as obstacles
       double sq_obstacle_range_;  ///< @brief The square distance at which we no longer add obstacles to the grid
+      unsigned int size_x_, size_y_; ///< @brief The size of the grid in columns
+      unsigned int words_per_row_; ///< @brief The number of 64 bit words each row of blocked_ takes
+      std::vector<uint64_t> blocked_; ///< @brief One bit per column that is marked or unknown, row by row
 
   };
 };
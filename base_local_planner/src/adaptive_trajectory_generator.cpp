@@ -0,0 +1,230 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <base_local_planner/adaptive_trajectory_generator.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <base_local_planner/velocity_iterator.h>
+
+namespace base_local_planner {
+
+namespace {
+
+struct LowerCost {
+  LowerCost(const std::vector<double>& costs) : costs_(costs) {}
+  bool operator()(unsigned int a, unsigned int b) const {
+    return costs_[a] < costs_[b] || (costs_[a] == costs_[b] && a < b);
+  }
+  const std::vector<double>& costs_;
+};
+
+}
+
+AdaptiveTrajectoryGenerator::AdaptiveTrajectoryGenerator()
+  : coarse_samples_(3), refine_best_(3), seed_last_best_(true),
+    reported_(0), fell_back_(false), done_(true), have_last_best_(false) {
+}
+
+void AdaptiveTrajectoryGenerator::setAdaptiveParameters(int coarse_samples, int refine_best, bool seed_last_best) {
+  coarse_samples_ = std::max(2, coarse_samples);
+  refine_best_ = std::max(1, refine_best);
+  seed_last_best_ = seed_last_best;
+}
+
+void AdaptiveTrajectoryGenerator::initialise(
+    const Eigen::Vector3f& pos,
+    const Eigen::Vector3f& vel,
+    const Eigen::Vector3f& goal,
+    base_local_planner::LocalPlannerLimits* limits,
+    const Eigen::Vector3f& vsamples,
+    bool discretize_by_time) {
+  // the full grid stays in sample_params_ to fall back to
+  SimpleTrajectoryGenerator::initialise(pos, vel, goal, limits, vsamples, discretize_by_time);
+  samples_.clear();
+  costs_.clear();
+  pending_.clear();
+  reported_ = 0;
+  fell_back_ = false;
+  done_ = sample_params_.empty();
+  if (done_) {
+    return;
+  }
+
+  computeVelocityWindow(goal, min_vel_, max_vel_);
+  int coarse[3];
+  for (int i = 0; i < 3; ++i) {
+    coarse[i] = std::min(coarse_samples_, int(vsamples[i]));
+    // as VelocityIterator spaces them, at least two samples over a window of any width
+    double width = max_vel_[i] - min_vel_[i];
+    step_[i] = width / (std::max(2, coarse[i]) - 1);
+    fine_step_[i] = width / (std::max(2, int(vsamples[i])) - 1);
+  }
+
+  Eigen::Vector3f vel_samp = Eigen::Vector3f::Zero();
+  VelocityIterator x_it(min_vel_[0], max_vel_[0], coarse[0]);
+  VelocityIterator y_it(min_vel_[1], max_vel_[1], coarse[1]);
+  VelocityIterator th_it(min_vel_[2], max_vel_[2], coarse[2]);
+  for(; !x_it.isFinished(); x_it++) {
+    vel_samp[0] = x_it.getVelocity();
+    for(; !y_it.isFinished(); y_it++) {
+      vel_samp[1] = y_it.getVelocity();
+      for(; !th_it.isFinished(); th_it++) {
+        vel_samp[2] = th_it.getVelocity();
+        addSample(vel_samp);
+      }
+      th_it.reset();
+    }
+    y_it.reset();
+  }
+
+  if (seed_last_best_ && have_last_best_) {
+    addSample(last_best_);
+  }
+}
+
+bool AdaptiveTrajectoryGenerator::hasMoreTrajectories() {
+  if (next_sample_index_ < samples_.size()) {
+    return true;
+  }
+  if (reported_ < pending_.size()) {
+    // the next round depends on the costs of this one
+    return false;
+  }
+  return refine();
+}
+
+bool AdaptiveTrajectoryGenerator::nextTrajectory(Trajectory &comp_traj) {
+  bool result = false;
+  if (next_sample_index_ < samples_.size()) {
+    if (generateTrajectory(pos_, vel_, samples_[next_sample_index_], comp_traj)) {
+      pending_.push_back(next_sample_index_);
+      result = true;
+    }
+  }
+  next_sample_index_++;
+  return result;
+}
+
+void AdaptiveTrajectoryGenerator::setTrajectoryCost(const Trajectory &traj, double cost) {
+  if (reported_ < pending_.size()) {
+    costs_[pending_[reported_++]] = cost;
+  }
+}
+
+bool AdaptiveTrajectoryGenerator::refine() {
+  if (samples_.empty()) {
+    return false;
+  }
+
+  std::vector<unsigned int> best;
+  for (unsigned int i = 0; i < costs_.size(); ++i) {
+    if (costs_[i] >= 0) {
+      best.push_back(i);
+    }
+  }
+  if (best.empty()) {
+    if (done_ || fell_back_) {
+      done_ = true;
+      return false;
+    }
+    // nothing valid to refine around, try every sample of the full grid
+    fell_back_ = true;
+    done_ = true;
+    unsigned int queued = samples_.size();
+    for (unsigned int i = 0; i < sample_params_.size(); ++i) {
+      addSample(sample_params_[i]);
+    }
+    return samples_.size() > queued;
+  }
+
+  unsigned int num_best = std::min((unsigned int)refine_best_, (unsigned int)best.size());
+  std::partial_sort(best.begin(), best.begin() + num_best, best.end(), LowerCost(costs_));
+  last_best_ = samples_[best[0]];
+  have_last_best_ = true;
+  if (done_) {
+    return false;
+  }
+
+  // halve the spacing until a round adds samples, or it is as fine as the full grid
+  unsigned int queued = samples_.size();
+  while (samples_.size() == queued) {
+    Eigen::Vector3f half = Eigen::Vector3f::Zero();
+    int span[3];
+    bool active = false;
+    for (int i = 0; i < 3; ++i) {
+      if (step_[i] > fine_step_[i] * 1.001) {
+        half[i] = step_[i] / 2;
+        step_[i] = half[i];
+        active = true;
+      }
+      span[i] = half[i] > 0 ? 1 : 0;
+    }
+    if (!active) {
+      done_ = true;
+      return false;
+    }
+
+    for (unsigned int k = 0; k < num_best; ++k) {
+      Eigen::Vector3f center = samples_[best[k]];
+      for (int dx = -span[0]; dx <= span[0]; ++dx) {
+        for (int dy = -span[1]; dy <= span[1]; ++dy) {
+          for (int dth = -span[2]; dth <= span[2]; ++dth) {
+            if (dx != 0 || dy != 0 || dth != 0) {
+              addSample(center + Eigen::Vector3f(dx * half[0], dy * half[1], dth * half[2]));
+            }
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void AdaptiveTrajectoryGenerator::addSample(Eigen::Vector3f vel_samp) {
+  for (int i = 0; i < 3; ++i) {
+    vel_samp[i] = std::min(std::max(vel_samp[i], min_vel_[i]), max_vel_[i]);
+  }
+  for (unsigned int i = 0; i < samples_.size(); ++i) {
+    if ((samples_[i] - vel_samp).cwiseAbs().maxCoeff() < 1e-6) {
+      return;
+    }
+  }
+  samples_.push_back(vel_samp);
+  costs_.push_back(-1.0);
+}
+
+} /* namespace base_local_planner */
@@ -0,0 +1,253 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <base_local_planner/clearance_cost_function.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/bind.hpp>
+#include <costmap_2d/cost_values.h>
+#include <nav_executor/executor.h>
+#include <ros/console.h>
+
+namespace base_local_planner {
+
+namespace {
+
+// squared distance of a cell with no obstacle in its column, finite for the envelope's arithmetic
+const float FAR = 1e20f;
+
+// the footprint clipped to x >= bound, or to x <= bound if upper
+std::vector<geometry_msgs::Point> clip(const std::vector<geometry_msgs::Point>& polygon, double bound, bool upper) {
+  std::vector<geometry_msgs::Point> clipped;
+  double sign = upper ? -1.0 : 1.0;
+  for (unsigned int i = 0; i < polygon.size(); ++i) {
+    const geometry_msgs::Point& a = polygon[i];
+    const geometry_msgs::Point& b = polygon[(i + 1) % polygon.size()];
+    bool a_in = sign * (a.x - bound) >= 0, b_in = sign * (b.x - bound) >= 0;
+    if (a_in) {
+      clipped.push_back(a);
+    }
+    if (a_in != b_in) {
+      geometry_msgs::Point p;
+      p.x = bound;
+      p.y = a.y + (b.y - a.y) * (bound - a.x) / (b.x - a.x);
+      clipped.push_back(p);
+    }
+  }
+  return clipped;
+}
+
+}
+
+ClearanceCostFunction::ClearanceCostFunction(costmap_2d::Costmap2D* costmap)
+    : costmap_(costmap), max_clearance_(1.0), threads_(1), size_x_(0), size_y_(0) {
+}
+
+void ClearanceCostFunction::setFootprint(const std::vector<geometry_msgs::Point>& footprint_spec, int circles) {
+  circles_.clear();
+  if (footprint_spec.empty()) {
+    return;
+  }
+  double min_x = footprint_spec[0].x, max_x = min_x, min_y = footprint_spec[0].y, max_y = min_y;
+  for (unsigned int i = 1; i < footprint_spec.size(); ++i) {
+    min_x = std::min(min_x, footprint_spec[i].x);
+    max_x = std::max(max_x, footprint_spec[i].x);
+    min_y = std::min(min_y, footprint_spec[i].y);
+    max_y = std::max(max_y, footprint_spec[i].y);
+  }
+  if (circles <= 0) {
+    circles = max_y > min_y ? std::max(1, (int)floor((max_x - min_x) / (max_y - min_y) + 0.5)) : 1;
+  }
+
+  // each circle reaches the farthest corner of its slice of the footprint, so that they cover it
+  double length = (max_x - min_x) / circles;
+  for (int i = 0; i < circles; ++i) {
+    std::vector<geometry_msgs::Point> slice = clip(clip(footprint_spec, min_x + i * length, false),
+                                                   min_x + (i + 1) * length, true);
+    if (slice.empty()) {
+      continue;
+    }
+    double slice_min_y = slice[0].y, slice_max_y = slice[0].y;
+    for (unsigned int j = 1; j < slice.size(); ++j) {
+      slice_min_y = std::min(slice_min_y, slice[j].y);
+      slice_max_y = std::max(slice_max_y, slice[j].y);
+    }
+    Circle circle;
+    circle.x = min_x + (i + 0.5) * length;
+    circle.y = (slice_min_y + slice_max_y) / 2;
+    circle.radius = 0.0;
+    for (unsigned int j = 0; j < slice.size(); ++j) {
+      circle.radius = std::max(circle.radius, hypot(slice[j].x - circle.x, slice[j].y - circle.y));
+    }
+    circles_.push_back(circle);
+  }
+}
+
+bool ClearanceCostFunction::prepare() {
+  // the planner prepares the critics it doesn't use too
+  if (getScale() == 0) {
+    return true;
+  }
+  size_x_ = costmap_->getSizeInCellsX();
+  size_y_ = costmap_->getSizeInCellsY();
+  distance_.resize(size_x_ * size_y_);
+
+  // the columns, then the rows, split between the tasks
+  unsigned int tasks = std::max(1, std::min(threads_, (int)std::min(size_x_, size_y_)));
+  nav_executor::Executor::shared().run(nav_executor::LANE_CONTROL, tasks,
+      boost::bind(&ClearanceCostFunction::transformColumnBand, this, tasks, _1));
+  nav_executor::Executor::shared().run(nav_executor::LANE_CONTROL, tasks,
+      boost::bind(&ClearanceCostFunction::transformRowBand, this, tasks, _1));
+  return true;
+}
+
+void ClearanceCostFunction::transformColumnBand(unsigned int tasks, unsigned int t) {
+  transformColumns(size_x_ * t / tasks, size_x_ * (t + 1) / tasks);
+}
+
+void ClearanceCostFunction::transformRowBand(unsigned int tasks, unsigned int t) {
+  transformRows(size_y_ * t / tasks, size_y_ * (t + 1) / tasks);
+}
+
+void ClearanceCostFunction::transformColumns(unsigned int x0, unsigned int xn) {
+  const unsigned char* costs = costmap_->getCharMap();
+  for (unsigned int x = x0; x < xn; ++x) {
+    // the squared distance to the nearest obstacle in the column, down and then up
+    float d = FAR;
+    for (unsigned int y = 0; y < size_y_; ++y) {
+      unsigned int i = y * size_x_ + x;
+      unsigned char cost = costs[i];
+      if (cost == costmap_2d::LETHAL_OBSTACLE || cost == costmap_2d::NO_INFORMATION) {
+        d = 0;
+      } else if (d < FAR) {
+        d += 1;
+      }
+      distance_[i] = d;
+    }
+    d = FAR;
+    for (unsigned int y = size_y_; y-- > 0; ) {
+      unsigned int i = y * size_x_ + x;
+      if (distance_[i] == 0) {
+        d = 0;
+      } else if (d < FAR) {
+        d += 1;
+      }
+      distance_[i] = std::min(distance_[i], d);
+    }
+    for (unsigned int y = 0; y < size_y_; ++y) {
+      float& cell = distance_[y * size_x_ + x];
+      if (cell < FAR) {
+        cell *= cell;
+      }
+    }
+  }
+}
+
+void ClearanceCostFunction::transformRows(unsigned int y0, unsigned int yn) {
+  // the lower envelope of the parabolas the column distances make, after Felzenszwalb and Huttenlocher
+  std::vector<float> f(size_x_), z(size_x_ + 1);
+  std::vector<int> v(size_x_);
+  for (unsigned int y = y0; y < yn; ++y) {
+    float* row = &distance_[y * size_x_];
+    std::copy(row, row + size_x_, f.begin());
+
+    int k = 0;
+    v[0] = 0;
+    z[0] = -HUGE_VALF;
+    z[1] = HUGE_VALF;
+    for (int q = 1; q < (int)size_x_; ++q) {
+      float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+      while (s <= z[k]) {
+        k--;
+        s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+      }
+      k++;
+      v[k] = q;
+      z[k] = s;
+      z[k + 1] = HUGE_VALF;
+    }
+
+    k = 0;
+    for (int q = 0; q < (int)size_x_; ++q) {
+      while (z[k + 1] < q) {
+        k++;
+      }
+      float d = (q - v[k]) * (q - v[k]) + f[v[k]];
+      row[q] = d < FAR ? sqrtf(d) : FAR;
+    }
+  }
+}
+
+bool ClearanceCostFunction::pointClearance(double x, double y, double th, double& clearance) {
+  double cos_th = cos(th), sin_th = sin(th);
+  double resolution = costmap_->getResolution();
+  clearance = max_clearance_;
+  for (unsigned int i = 0; i < circles_.size(); ++i) {
+    const Circle& circle = circles_[i];
+    unsigned int mx, my;
+    if (!costmap_->worldToMap(x + circle.x * cos_th - circle.y * sin_th, y + circle.x * sin_th + circle.y * cos_th,
+                              mx, my)) {
+      return false;
+    }
+    clearance = std::min(clearance, getDistance(mx, my) * resolution - circle.radius);
+  }
+  return true;
+}
+
+double ClearanceCostFunction::scoreTrajectory(Trajectory &traj) {
+  if (circles_.empty()) {
+    ROS_ERROR("Footprint spec is empty, maybe missing call to setFootprint?");
+    return -9;
+  }
+
+  double min_clearance = max_clearance_;
+  double px, py, pth;
+  for (unsigned int i = 0; i < traj.getPointsSize(); ++i) {
+    traj.getPoint(i, px, py, pth);
+    double clearance;
+    if (!pointClearance(px, py, pth, clearance)) {
+      return -7.0;
+    }
+    if (clearance < 0) {
+      return -6.0;
+    }
+    min_clearance = std::min(min_clearance, clearance);
+  }
+  return max_clearance_ - min_clearance;
+}
+
+} /* namespace base_local_planner */
@@ -0,0 +1,437 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <base_local_planner/compact_map_grid.h>
+#include <base_local_planner/map_grid.h>
+#include <costmap_2d/cost_values.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <ros/console.h>
+
+namespace base_local_planner{
+
+  // bits of the state of a cell for updateTargetDistance()
+  static const unsigned char PASSABLE = 1; // not an obstacle
+  static const unsigned char SEED = 2; // one of the cells distances are measured from, passable or not
+  static const unsigned char INVALID = 4; // lost what its last distance was measured over
+
+  static const unsigned int UNREACHED = std::numeric_limits<unsigned int>::max();
+
+  // moves what is kept per cell along with a window moved by (dx, dy) cells, filling in what came into it
+  template<typename T>
+  static void shiftCells(std::vector<T>& cells, int size_x, int size_y, int dx, int dy, T fill) {
+    int x_begin = std::max(0, -dx), x_end = std::min(size_x, size_x - dx);
+    // rows are read before they are written over
+    for (int i = 0; i < size_y; ++i) {
+      int y = dy >= 0 ? i : size_y - 1 - i;
+      T* row = &cells[y * size_x];
+      if (y + dy < 0 || y + dy >= size_y) {
+        std::fill(row, row + size_x, fill);
+        continue;
+      }
+      memmove(row + x_begin, &cells[(y + dy) * size_x + x_begin + dx], (x_end - x_begin) * sizeof(T));
+      std::fill(row, row + x_begin, fill);
+      std::fill(row + x_end, row + size_x, fill);
+    }
+  }
+
+  static inline bool isObstacle(unsigned char cost) {
+    return cost == costmap_2d::LETHAL_OBSTACLE || cost == costmap_2d::INSCRIBED_INFLATED_OBSTACLE ||
+        cost == costmap_2d::NO_INFORMATION;
+  }
+
+  CompactMapGrid::CompactMapGrid()
+    : size_x_(0), size_y_(0), incremental_(false), have_field_(false)
+  {
+  }
+
+  CompactMapGrid::CompactMapGrid(unsigned int size_x, unsigned int size_y)
+    : size_x_(0), size_y_(0), incremental_(false), have_field_(false)
+  {
+    sizeCheck(size_x, size_y);
+  }
+
+  void CompactMapGrid::sizeCheck(unsigned int size_x, unsigned int size_y){
+    if(size_x_ != size_x || size_y_ != size_y){
+      have_field_ = false;
+      size_x_ = size_x;
+      size_y_ = size_y;
+      target_dist_.resize(size_x * size_y);
+      target_mark_.resize(size_x * size_y);
+    }
+  }
+
+  void CompactMapGrid::resetPathDist(){
+    std::fill(target_dist_.begin(), target_dist_.end(), unreachableCellCosts());
+    std::fill(target_mark_.begin(), target_mark_.end(), 0);
+    have_field_ = false;
+  }
+
+  //update what map cells are considered path based on the global_plan
+  void CompactMapGrid::setTargetCells(const costmap_2d::Costmap2D& costmap,
+      const std::vector<geometry_msgs::PoseStamped>& global_plan) {
+    sizeCheck(costmap.getSizeInCellsX(), costmap.getSizeInCellsY());
+
+    bool started_path = false;
+
+    seeds_.clear();
+
+    std::vector<geometry_msgs::PoseStamped> adjusted_global_plan;
+    MapGrid::adjustPlanResolution(global_plan, adjusted_global_plan, costmap.getResolution());
+    if (adjusted_global_plan.size() != global_plan.size()) {
+      ROS_DEBUG("Adjusted global plan resolution, added %zu points", adjusted_global_plan.size() - global_plan.size());
+    }
+    unsigned int i;
+    // put global path points into local map until we reach the border of the local map
+    for (i = 0; i < adjusted_global_plan.size(); ++i) {
+      double g_x = adjusted_global_plan[i].pose.position.x;
+      double g_y = adjusted_global_plan[i].pose.position.y;
+      unsigned int map_x, map_y;
+      if (costmap.worldToMap(g_x, g_y, map_x, map_y) && costmap.getCost(map_x, map_y) != costmap_2d::NO_INFORMATION) {
+        seeds_.push_back(size_x_ * map_y + map_x);
+        started_path = true;
+      } else if (started_path) {
+          break;
+      }
+    }
+    if (!started_path) {
+      ROS_ERROR("None of the %d first of %zu (%zu) points of the global plan were in the local costmap and free",
+          i, adjusted_global_plan.size(), global_plan.size());
+      if (incremental_) {
+        resetPathDist();
+      }
+      return;
+    }
+
+    if (incremental_) {
+      updateTargetDistance(seeds_, costmap);
+    } else {
+      computeTargetDistance(seeds_, costmap);
+    }
+  }
+
+  //mark the point of the costmap as local goal where global_plan first leaves the area (or its last point)
+  void CompactMapGrid::setLocalGoal(const costmap_2d::Costmap2D& costmap,
+      const std::vector<geometry_msgs::PoseStamped>& global_plan) {
+    sizeCheck(costmap.getSizeInCellsX(), costmap.getSizeInCellsY());
+
+    int local_goal_x = -1;
+    int local_goal_y = -1;
+    bool started_path = false;
+
+    std::vector<geometry_msgs::PoseStamped> adjusted_global_plan;
+    MapGrid::adjustPlanResolution(global_plan, adjusted_global_plan, costmap.getResolution());
+
+    // skip global path points until we reach the border of the local map
+    for (unsigned int i = 0; i < adjusted_global_plan.size(); ++i) {
+      double g_x = adjusted_global_plan[i].pose.position.x;
+      double g_y = adjusted_global_plan[i].pose.position.y;
+      unsigned int map_x, map_y;
+      if (costmap.worldToMap(g_x, g_y, map_x, map_y) && costmap.getCost(map_x, map_y) != costmap_2d::NO_INFORMATION) {
+        local_goal_x = map_x;
+        local_goal_y = map_y;
+        started_path = true;
+      } else {
+        if (started_path) {
+          break;
+        }// else we might have a non pruned path, so we just continue
+      }
+    }
+    if (!started_path) {
+      ROS_ERROR("None of the points of the global plan were in the local costmap, global plan points too far from robot");
+      if (incremental_) {
+        resetPathDist();
+      }
+      return;
+    }
+
+    seeds_.clear();
+    if (local_goal_x >= 0 && local_goal_y >= 0) {
+      costmap.mapToWorld(local_goal_x, local_goal_y, goal_x_, goal_y_);
+      seeds_.push_back(size_x_ * local_goal_y + local_goal_x);
+    }
+
+    if (incremental_) {
+      updateTargetDistance(seeds_, costmap);
+    } else {
+      computeTargetDistance(seeds_, costmap);
+    }
+  }
+
+  //mark a neighbor of a reached cell, and queue it unless it is an obstacle
+  inline void CompactMapGrid::visitCell(unsigned int current, unsigned int check, unsigned int check_x,
+      const unsigned char* costs, unsigned int& tail){
+    if (target_mark_[check]) {
+      return;
+    }
+    target_mark_[check] = 1;
+    if (isObstacle(costs[check])) {
+      target_dist_[check] = obstacleCosts();
+    } else {
+      target_dist_[check] = target_dist_[current] + 1;
+      fifo_x_[tail] = check_x;
+      fifo_[tail++] = check;
+    }
+  }
+
+  void CompactMapGrid::computeTargetDistance(const std::vector<unsigned int>& seeds, const costmap_2d::Costmap2D& costmap){
+    const unsigned char* costs = costmap.getCharMap();
+    unsigned int n = target_dist_.size();
+
+    // every cell is queued once at most, after the initial ones, along with its column
+    fifo_.resize(n + seeds.size());
+    fifo_x_.resize(fifo_.size());
+    unsigned int head = 0, tail = 0;
+    for (unsigned int i = 0; i < seeds.size(); ++i) {
+      target_dist_[seeds[i]] = 0.0;
+      target_mark_[seeds[i]] = 1;
+      fifo_x_[tail] = seeds[i] % size_x_;
+      fifo_[tail++] = seeds[i];
+    }
+
+    while (head < tail) {
+      unsigned int current = fifo_[head];
+      unsigned int x = fifo_x_[head++];
+      if (x > 0) {
+        visitCell(current, current - 1, x - 1, costs, tail);
+      }
+      if (x < size_x_ - 1) {
+        visitCell(current, current + 1, x + 1, costs, tail);
+      }
+      if (current >= size_x_) {
+        visitCell(current, current - size_x_, x, costs, tail);
+      }
+      if (current + size_x_ < n) {
+        visitCell(current, current + size_x_, x, costs, tail);
+      }
+    }
+  }
+
+  inline int CompactMapGrid::neighborsOf(unsigned int index, unsigned int x, unsigned int* neighbors) const {
+    int count = 0;
+    if (x > 0) {
+      neighbors[count++] = index - 1;
+    }
+    if (x < size_x_ - 1) {
+      neighbors[count++] = index + 1;
+    }
+    if (index >= size_x_) {
+      neighbors[count++] = index - size_x_;
+    }
+    if (index + size_x_ < target_dist_.size()) {
+      neighbors[count++] = index + size_x_;
+    }
+    return count;
+  }
+
+  //invalidate a cell none of whose neighbors still has the distance it was measured from
+  inline void CompactMapGrid::checkSupport(unsigned int index, unsigned int& tail) {
+    if ((next_[index] & (SEED | INVALID)) || dist_[index] == UNREACHED) {
+      return;
+    }
+    unsigned int neighbors[4];
+    int count = neighborsOf(index, index % size_x_, neighbors);
+    for (int k = 0; k < count; ++k) {
+      if (!(next_[neighbors[k]] & INVALID) && dist_[neighbors[k]] == dist_[index] - 1) {
+        return;
+      }
+    }
+    next_[index] |= INVALID;
+    fifo_[tail++] = index;
+  }
+
+  void CompactMapGrid::updateTargetDistance(const std::vector<unsigned int>& seeds, const costmap_2d::Costmap2D& costmap){
+    unsigned int n = target_dist_.size();
+    const unsigned char* costs = costmap.getCharMap();
+    double resolution = costmap.getResolution();
+    unsigned int neighbors[4];
+
+    // the rolling window moves with the robot, keep what is still inside it
+    int shift_x = 0, shift_y = 0;
+    if (have_field_ && dist_.size() == n && field_resolution_ == resolution) {
+      shift_x = (int)floor((costmap.getOriginX() - field_origin_x_) / resolution + 0.5);
+      shift_y = (int)floor((costmap.getOriginY() - field_origin_y_) / resolution + 0.5);
+      have_field_ = abs(shift_x) < (int)size_x_ && abs(shift_y) < (int)size_y_;
+    } else {
+      have_field_ = false;
+    }
+    field_origin_x_ = costmap.getOriginX();
+    field_origin_y_ = costmap.getOriginY();
+    field_resolution_ = resolution;
+    if (have_field_ && (shift_x != 0 || shift_y != 0)) {
+      shiftCells(dist_, size_x_, size_y_, shift_x, shift_y, UNREACHED);
+      shiftCells(state_, size_x_, size_y_, shift_x, shift_y, (unsigned char)0);
+    }
+
+    next_.resize(n);
+    for (unsigned int i = 0; i < n; ++i) {
+      next_[i] = isObstacle(costs[i]) ? 0 : PASSABLE;
+    }
+    for (unsigned int i = 0; i < seeds.size(); ++i) {
+      next_[seeds[i]] |= SEED;
+    }
+
+    // cells that lost their seed or became obstacles, and all whose distance was measured over those
+    fifo_.resize(n);
+    unsigned int tail = 0;
+    changed_.clear();
+    if (have_field_) {
+      for (unsigned int i = 0; i < n; ++i) {
+        if (next_[i] != state_[i]) {
+          changed_.push_back(i);
+          if (dist_[i] != UNREACHED && !(next_[i] & SEED) && ((state_[i] & SEED) || !(next_[i] & PASSABLE))) {
+            next_[i] |= INVALID;
+            fifo_[tail++] = i;
+          }
+        }
+      }
+      // too much changed for a repair to pay off
+      have_field_ = changed_.size() <= n / 4;
+    }
+
+    if (have_field_) {
+      // the cells along the edge the window moved away from lost their neighbors beyond it
+      if (shift_x != 0) {
+        unsigned int x = shift_x > 0 ? 0 : size_x_ - 1;
+        for (unsigned int y = 0; y < size_y_; ++y) {
+          checkSupport(y * size_x_ + x, tail);
+        }
+      }
+      if (shift_y != 0) {
+        unsigned int y = shift_y > 0 ? 0 : size_y_ - 1;
+        for (unsigned int x = 0; x < size_x_; ++x) {
+          checkSupport(y * size_x_ + x, tail);
+        }
+      }
+
+      for (unsigned int head = 0; head < tail; ++head) {
+        unsigned int current = fifo_[head];
+        int count = neighborsOf(current, current % size_x_, neighbors);
+        for (int k = 0; k < count; ++k) {
+          if (dist_[neighbors[k]] == dist_[current] + 1) {
+            checkSupport(neighbors[k], tail);
+          }
+        }
+      }
+      // nor if too much was measured over what changed
+      have_field_ = changed_.size() + tail <= n / 4;
+    }
+
+    for (unsigned int i = 0; i < tail; ++i) {
+      dist_[fifo_[i]] = UNREACHED;
+      next_[fifo_[i]] &= ~INVALID;
+    }
+    if (!have_field_) {
+      dist_.assign(n, UNREACHED);
+      tail = 0;
+      changed_.clear();
+    }
+
+    // cells that may have come nearer, at the distance their neighbors give them, in order of it
+    lowered_.clear();
+    for (unsigned int i = 0; i < seeds.size(); ++i) {
+      dist_[seeds[i]] = 0;
+      lowered_.push_back(std::make_pair(0u, seeds[i]));
+    }
+    for (unsigned int i = 0; i < changed_.size() + tail; ++i) {
+      unsigned int index = i < changed_.size() ? changed_[i] : fifo_[i - changed_.size()];
+      if ((next_[index] & (PASSABLE | SEED)) != PASSABLE) {
+        continue;
+      }
+      int count = neighborsOf(index, index % size_x_, neighbors);
+      for (int k = 0; k < count; ++k) {
+        if (dist_[neighbors[k]] != UNREACHED && dist_[neighbors[k]] + 1 < dist_[index]) {
+          dist_[index] = dist_[neighbors[k]] + 1;
+        }
+      }
+      if (dist_[index] != UNREACHED) {
+        lowered_.push_back(std::make_pair(dist_[index], index));
+      }
+    }
+    std::sort(lowered_.begin(), lowered_.end());
+
+    // breadth first from those, merged with them as they come up
+    unsigned int head = 0, next_lowered = 0;
+    tail = 0;
+    while (true) {
+      unsigned int current;
+      if (next_lowered < lowered_.size() && (head == tail || lowered_[next_lowered].first <= dist_[fifo_[head]])) {
+        current = lowered_[next_lowered].second;
+        if (dist_[current] != lowered_[next_lowered++].first) {
+          continue; // queued again since, nearer
+        }
+      } else if (head < tail) {
+        current = fifo_[head++];
+      } else {
+        break;
+      }
+
+      int count = neighborsOf(current, current % size_x_, neighbors);
+      for (int k = 0; k < count; ++k) {
+        unsigned int check = neighbors[k];
+        if ((next_[check] & (PASSABLE | SEED)) && dist_[current] + 1 < dist_[check]) {
+          dist_[check] = dist_[current] + 1;
+          fifo_[tail++] = check;
+        }
+      }
+    }
+
+    // obstacles next to a reached cell were reached as such, as in computeTargetDistance()
+    for (unsigned int i = 0; i < n; ++i) {
+      if (dist_[i] != UNREACHED) {
+        target_dist_[i] = dist_[i];
+        target_mark_[i] = 1;
+        continue;
+      }
+      target_dist_[i] = unreachableCellCosts();
+      target_mark_[i] = 0;
+      if (!(next_[i] & (PASSABLE | SEED))) {
+        int count = neighborsOf(i, i % size_x_, neighbors);
+        for (int k = 0; k < count; ++k) {
+          if (dist_[neighbors[k]] != UNREACHED) {
+            target_dist_[i] = obstacleCosts();
+            target_mark_[i] = 1;
+            break;
+          }
+        }
+      }
+    }
+
+    state_.swap(next_);
+    have_field_ = true;
+  }
+
+};
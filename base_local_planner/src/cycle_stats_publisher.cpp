@@ -0,0 +1,133 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <base_local_planner/cycle_stats_publisher.h>
+
+#include <algorithm>
+
+namespace base_local_planner {
+
+CycleStatsPublisher::CycleStatsPublisher(ros::NodeHandle* ros_node, std::string topic_name,
+                                         const std::vector<std::string>& stage_names, unsigned int window)
+  : window_(std::max(window, 1u)), next_sample_(0), sample_count_(0) {
+  stats_pub_ = ros_node->advertise<CycleStats>(topic_name, 1);
+
+  // 0.1 ms to 1 s, in 1-2-5 steps
+  for (double decade = 1e-4; decade < 1.0; decade *= 10) {
+    bin_edges_.push_back(decade);
+    bin_edges_.push_back(2 * decade);
+    bin_edges_.push_back(5 * decade);
+  }
+  bin_edges_.push_back(1.0);
+
+  cycle_.stages.resize(stage_names.size());
+  for (unsigned int i = 0; i < stage_names.size(); ++i) {
+    cycle_.stages[i].name = stage_names[i];
+  }
+  samples_.assign(stage_names.size() + 1, std::vector<double>(window_, 0.0));
+}
+
+void CycleStatsPublisher::startCycle() {
+  cycle_start_ = ros::WallTime::now();
+  for (unsigned int i = 0; i < cycle_.stages.size(); ++i) {
+    cycle_.stages[i].time = 0.0;
+  }
+  cycle_.trajectories = 0;
+  cycle_.generation_time = 0.0;
+  cycle_.critics.clear();
+}
+
+void CycleStatsPublisher::addStageTime(unsigned int stage, double seconds) {
+  if (stage < cycle_.stages.size()) {
+    cycle_.stages[stage].time += seconds;
+  }
+}
+
+void CycleStatsPublisher::setPlannerStats(const SimpleScoredSamplingPlanner& planner,
+                                          const std::vector<std::string>& critic_names) {
+  cycle_.trajectories = planner.getLastTrajectoryCount();
+  cycle_.generation_time = planner.getLastGenerationTime();
+  cycle_.critics.clear();
+  const std::vector<SimpleScoredSamplingPlanner::CriticStats>& last_stats = planner.getLastCriticStats();
+  const std::vector<unsigned int>& order = planner.getCriticOrder();
+  for (unsigned int k = 0; k < order.size(); ++k) {
+    unsigned int i = order[k];
+    if (i >= last_stats.size()) {
+      continue;
+    }
+    CriticStats critic;
+    if (i < critic_names.size()) {
+      critic.name = critic_names[i];
+    }
+    critic.time = last_stats[i].seconds;
+    critic.calls = last_stats[i].calls;
+    critic.rejections = last_stats[i].rejections;
+    cycle_.critics.push_back(critic);
+  }
+}
+
+void CycleStatsPublisher::endCycle() {
+  cycle_.cycle_time = (ros::WallTime::now() - cycle_start_).toSec();
+  samples_[0][next_sample_] = cycle_.cycle_time;
+  for (unsigned int i = 0; i < cycle_.stages.size(); ++i) {
+    samples_[i + 1][next_sample_] = cycle_.stages[i].time;
+  }
+  next_sample_ = (next_sample_ + 1) % window_;
+  sample_count_ = std::min(sample_count_ + 1, window_);
+
+  if (stats_pub_.getNumSubscribers() == 0) {
+    return;
+  }
+
+  cycle_.header.stamp = ros::Time::now();
+  cycle_.window = sample_count_;
+  cycle_.bin_edges = bin_edges_;
+  fillHistogram(0, &cycle_.cycle_time_histogram);
+  for (unsigned int i = 0; i < cycle_.stages.size(); ++i) {
+    fillHistogram(i + 1, &cycle_.stages[i].time_histogram);
+  }
+  stats_pub_.publish(cycle_);
+}
+
+void CycleStatsPublisher::fillHistogram(unsigned int series, std::vector<uint32_t>* histogram) const {
+  histogram->assign(bin_edges_.size() + 1, 0);
+  const std::vector<double>& samples = samples_[series];
+  for (unsigned int i = 0; i < sample_count_; ++i) {
+    unsigned int bin = std::upper_bound(bin_edges_.begin(), bin_edges_.end(), samples[i]) - bin_edges_.begin();
+    ++(*histogram)[bin];
+  }
+}
+
+} /* namespace base_local_planner */
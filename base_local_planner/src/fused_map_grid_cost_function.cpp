@@ -0,0 +1,124 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <base_local_planner/fused_map_grid_cost_function.h>
+
+namespace base_local_planner {
+
+bool FusedMapGridCostFunction::addCritic(MapGridCostFunction* critic) {
+  if (critics_.size() >= MAX_CRITICS) {
+    return false;
+  }
+  critics_.push_back(critic);
+  return true;
+}
+
+bool FusedMapGridCostFunction::prepare() {
+  active_critics_.clear();
+  groups_.clear();
+  for (unsigned int i = 0; i < critics_.size(); ++i) {
+    if (critics_[i]->prepare() == false) {
+      return false;
+    }
+    if (critics_[i]->getScale() == 0) {
+      continue;
+    }
+
+    double xshift = critics_[i]->getXShift(), yshift = critics_[i]->getYShift();
+    unsigned int g = 0;
+    while (g < groups_.size() && (groups_[g].xshift != xshift || groups_[g].yshift != yshift)) {
+      ++g;
+    }
+    if (g == groups_.size()) {
+      unsigned int end = active_critics_.size();
+      ShiftGroup group = {xshift, yshift, end, end};
+      groups_.push_back(group);
+    }
+    // keep the critics ordered by group
+    active_critics_.insert(active_critics_.begin() + groups_[g].end, critics_[i]);
+    for (unsigned int k = g; k < groups_.size(); ++k) {
+      if (k > g) {
+        groups_[k].begin++;
+      }
+      groups_[k].end++;
+    }
+  }
+  return true;
+}
+
+double FusedMapGridCostFunction::scoreTrajectory(Trajectory &traj) {
+  double costs[MAX_CRITICS];
+  unsigned int n = active_critics_.size();
+  for (unsigned int c = 0; c < n; ++c) {
+    costs[c] = active_critics_[c]->initialCost();
+  }
+
+  double px, py, pth;
+  unsigned int cell_x, cell_y;
+  for (unsigned int i = 0; i < traj.getPointsSize(); ++i) {
+    traj.getPoint(i, px, py, pth);
+    for (unsigned int g = 0; g < groups_.size(); ++g) {
+      const ShiftGroup& group = groups_[g];
+      double sx = px, sy = py;
+      if (group.xshift != 0.0) {
+        sx = sx + group.xshift * cos(pth);
+        sy = sy + group.xshift * sin(pth);
+      }
+      if (group.yshift != 0.0) {
+        sx = sx + group.yshift * cos(pth + M_PI_2);
+        sy = sy + group.yshift * sin(pth + M_PI_2);
+      }
+
+      if ( ! costmap_->worldToMap(sx, sy, cell_x, cell_y)) {
+        ROS_WARN("Off Map %f, %f", sx, sy);
+        return -4.0;
+      }
+      for (unsigned int c = group.begin; c < group.end; ++c) {
+        costs[c] = active_critics_[c]->addCellCost(cell_x, cell_y, costs[c]);
+        if (costs[c] < 0) {
+          return costs[c];
+        }
+      }
+    }
+  }
+
+  double cost = 0.0;
+  for (unsigned int c = 0; c < n; ++c) {
+    cost += costs[c] * active_critics_[c]->getScale();
+  }
+  return cost;
+}
+
+} /* namespace base_local_planner */
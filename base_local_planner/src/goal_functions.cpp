@@ -36,6 +36,8 @@
 *********************************************************************/
 #include <base_local_planner/goal_functions.h>
 
+#include <limits>
+
 namespace base_local_planner {
 
   double getGoalPositionDistance(const tf::Stamped<tf::Pose>& global_pose, double goal_x, double goal_y) {
@@ -175,6 +177,159 @@ namespace base_local_planner {
     return true;
   }
 
+  PlanTransformCache::PlanTransformCache() : generation_(0) {
+    reset();
+  }
+
+  void PlanTransformCache::reset() {
+    poses_.clear();
+    generations_.clear();
+    // poses are made again even if the transform has not changed
+    generation_++;
+    start_ = 0;
+    skipped_dist_ = 0;
+    ref_x_ = ref_y_ = 0;
+  }
+
+  bool PlanTransformCache::transformGlobalPlan(
+      const tf::TransformListener& tf,
+      const std::vector<geometry_msgs::PoseStamped>& global_plan,
+      unsigned int first,
+      const tf::Stamped<tf::Pose>& global_pose,
+      const costmap_2d::Costmap2D& costmap,
+      const std::string& global_frame,
+      std::vector<geometry_msgs::PoseStamped>& transformed_plan)
+  {
+    transformed_plan.clear();
+
+    if (first >= global_plan.size()) {
+      ROS_ERROR("Received plan with zero length");
+      return false;
+    }
+    if (poses_.size() != global_plan.size()) {
+      reset();
+      poses_.resize(global_plan.size());
+      generations_.resize(global_plan.size(), 0);
+    }
+
+    const geometry_msgs::PoseStamped& plan_pose = global_plan[first];
+    try {
+      // get plan_to_global_transform from plan frame to global_frame
+      tf::StampedTransform plan_to_global_transform;
+      tf.waitForTransform(global_frame, ros::Time::now(),
+                          plan_pose.header.frame_id, plan_pose.header.stamp,
+                          plan_pose.header.frame_id, ros::Duration(0.5));
+      tf.lookupTransform(global_frame, ros::Time(),
+                         plan_pose.header.frame_id, plan_pose.header.stamp,
+                         plan_pose.header.frame_id, plan_to_global_transform);
+
+      if (plan_pose.header.frame_id != plan_frame_ || global_frame != global_frame_ ||
+          !(plan_to_global_transform.getOrigin() == transform_.getOrigin()) ||
+          !(plan_to_global_transform.getBasis() == transform_.getBasis())) {
+        transform_ = plan_to_global_transform;
+        plan_frame_ = plan_pose.header.frame_id;
+        global_frame_ = global_frame;
+        generation_++;
+      }
+
+      //let's get the pose of the robot in the frame of the plan
+      tf::Stamped<tf::Pose> robot_pose;
+      tf.transformPose(plan_pose.header.frame_id, global_pose, robot_pose);
+      double robot_x = robot_pose.getOrigin().x(), robot_y = robot_pose.getOrigin().y();
+
+      //we'll discard points on the plan that are outside the local costmap
+      double dist_threshold = std::max(costmap.getSizeInCellsX() * costmap.getResolution() / 2.0,
+                                       costmap.getSizeInCellsY() * costmap.getResolution() / 2.0);
+      double sq_dist_threshold = dist_threshold * dist_threshold;
+      double sq_dist = 0;
+
+      // the poses skipped before may only be passed over again if none of them can have come within the window
+      unsigned int i = first;
+      double moved = hypot(robot_x - ref_x_, robot_y - ref_y_);
+      if (start_ > first && start_ <= global_plan.size() && skipped_dist_ - moved > dist_threshold + 1e-6) {
+        i = start_;
+      } else {
+        skipped_dist_ = std::numeric_limits<double>::infinity();
+        ref_x_ = robot_x;
+        ref_y_ = robot_y;
+        moved = 0;
+      }
+
+      //we need to loop to a point on the plan that is within a certain distance of the robot
+      while(i < (unsigned int)global_plan.size()) {
+        double x_diff = robot_x - global_plan[i].pose.position.x;
+        double y_diff = robot_y - global_plan[i].pose.position.y;
+        sq_dist = x_diff * x_diff + y_diff * y_diff;
+        if (sq_dist <= sq_dist_threshold) {
+          break;
+        }
+        skipped_dist_ = std::min(skipped_dist_, sqrt(sq_dist) - moved);
+        ++i;
+      }
+      start_ = i;
+
+      tf::Stamped<tf::Pose> tf_pose;
+      geometry_msgs::PoseStamped newer_pose;
+      newer_pose.header.frame_id = global_frame;
+      newer_pose.header.stamp = plan_to_global_transform.stamp_;
+
+      //now we'll transform until points are outside of our distance threshold
+      while(i < (unsigned int)global_plan.size() && sq_dist <= sq_dist_threshold) {
+        if (generations_[i] != generation_) {
+          poseStampedMsgToTF(global_plan[i], tf_pose);
+          tf::poseTFToMsg(plan_to_global_transform * tf_pose, poses_[i]);
+          generations_[i] = generation_;
+        }
+        newer_pose.pose = poses_[i];
+        transformed_plan.push_back(newer_pose);
+
+        double x_diff = robot_x - global_plan[i].pose.position.x;
+        double y_diff = robot_y - global_plan[i].pose.position.y;
+        sq_dist = x_diff * x_diff + y_diff * y_diff;
+
+        ++i;
+      }
+    }
+    catch(tf::LookupException& ex) {
+      ROS_ERROR("No Transform available Error: %s\n", ex.what());
+      return false;
+    }
+    catch(tf::ConnectivityException& ex) {
+      ROS_ERROR("Connectivity Error: %s\n", ex.what());
+      return false;
+    }
+    catch(tf::ExtrapolationException& ex) {
+      ROS_ERROR("Extrapolation Error: %s\n", ex.what());
+      ROS_ERROR("Global Frame: %s Plan Frame size %d: %s\n", global_frame.c_str(), (unsigned int)global_plan.size(), global_plan[0].header.frame_id.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  void PlanTransformCache::prunePlan(const tf::Stamped<tf::Pose>& global_pose, std::vector<geometry_msgs::PoseStamped>& plan,
+      unsigned int& first)
+  {
+    unsigned int n = 0;
+    while (n < plan.size()) {
+      const geometry_msgs::PoseStamped& w = plan[n];
+      double x_diff = global_pose.getOrigin().x() - w.pose.position.x;
+      double y_diff = global_pose.getOrigin().y() - w.pose.position.y;
+      if (x_diff * x_diff + y_diff * y_diff < 1) {
+        ROS_DEBUG("Nearest waypoint to <%f, %f> is <%f, %f>\n", global_pose.getOrigin().x(), global_pose.getOrigin().y(), w.pose.position.x, w.pose.position.y);
+        break;
+      }
+      ++n;
+    }
+    if (n == 0) {
+      return;
+    }
+
+    // the cached poses are indexed by the whole plan, and stay where they are
+    plan.erase(plan.begin(), plan.begin() + n);
+    first += n;
+  }
+
   bool getGoalPose(const tf::TransformListener& tf,
       const std::vector<geometry_msgs::PoseStamped>& global_plan,
       const std::string& global_frame, tf::Stamped<tf::Pose>& goal_pose) {
@@ -0,0 +1,158 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <base_local_planner/in_place_rotation_checker.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <angles/angles.h>
+#include <costmap_2d/cost_values.h>
+
+#include <base_local_planner/line_iterator.h>
+
+namespace base_local_planner {
+
+InPlaceRotationChecker::InPlaceRotationChecker(int yaw_bins)
+  : yaw_bins_(std::max(yaw_bins, 1)), have_cell_(false), cell_index_(0), size_x_(0), size_y_(0),
+    origin_x_(0.0), origin_y_(0.0), resolution_(0.0), x_(0.0), y_(0.0) {}
+
+void InPlaceRotationChecker::setFootprint(const std::vector<geometry_msgs::Point>& footprint_spec) {
+  bool same_footprint = footprint_spec.size() == footprint_spec_.size();
+  for (unsigned int i = 0; same_footprint && i < footprint_spec.size(); ++i) {
+    same_footprint = footprint_spec[i].x == footprint_spec_[i].x && footprint_spec[i].y == footprint_spec_[i].y;
+  }
+  if (!same_footprint) {
+    footprint_spec_ = footprint_spec;
+    have_cell_ = false;
+  }
+}
+
+int InPlaceRotationChecker::yawBin(double yaw) const {
+  int bin = (int)floor(yaw * yaw_bins_ / (2 * M_PI) + 0.5) % yaw_bins_;
+  return bin < 0 ? bin + yaw_bins_ : bin;
+}
+
+bool InPlaceRotationChecker::isClear(const costmap_2d::Costmap2D& costmap, double x, double y,
+                                     double yaw, double goal_yaw, double direction) {
+  unsigned int cell_x, cell_y;
+  if (footprint_spec_.empty() || !costmap.worldToMap(x, y, cell_x, cell_y)) {
+    return false;
+  }
+
+  // the outlines are kept until the robot leaves its cell or the costmap moves
+  unsigned int index = costmap.getIndex(cell_x, cell_y);
+  if (!have_cell_ || index != cell_index_ ||
+      size_x_ != costmap.getSizeInCellsX() || size_y_ != costmap.getSizeInCellsY() ||
+      origin_x_ != costmap.getOriginX() || origin_y_ != costmap.getOriginY() ||
+      resolution_ != costmap.getResolution()) {
+    have_cell_ = true;
+    cell_index_ = index;
+    size_x_ = costmap.getSizeInCellsX();
+    size_y_ = costmap.getSizeInCellsY();
+    origin_x_ = costmap.getOriginX();
+    origin_y_ = costmap.getOriginY();
+    resolution_ = costmap.getResolution();
+    x_ = x;
+    y_ = y;
+    bin_cells_.resize(yaw_bins_);
+    bin_state_.assign(yaw_bins_, 0);
+  }
+
+  if (direction == 0.0) {
+    direction = angles::shortest_angular_distance(yaw, goal_yaw);
+  }
+  int step = direction < 0 ? -1 : 1;
+  int bin = yawBin(yaw), goal_bin = yawBin(goal_yaw);
+  bool circular = footprint_spec_.size() < 3;
+  const unsigned char* costs = costmap.getCharMap();
+  for (;;) {
+    const std::vector<unsigned int>* cells;
+    if (!binCells(costmap, bin, cells)) {
+      return false;
+    }
+    for (unsigned int i = 0; i < cells->size(); ++i) {
+      unsigned char cost = costs[(*cells)[i]];
+      if (cost == costmap_2d::LETHAL_OBSTACLE || cost == costmap_2d::NO_INFORMATION ||
+          (circular && cost == costmap_2d::INSCRIBED_INFLATED_OBSTACLE)) {
+        return false;
+      }
+    }
+    // a circular robot covers the same cell at every heading
+    if (bin == goal_bin || circular) {
+      return true;
+    }
+    bin = (bin + step + yaw_bins_) % yaw_bins_;
+  }
+}
+
+bool InPlaceRotationChecker::binCells(const costmap_2d::Costmap2D& costmap, int bin,
+                                      const std::vector<unsigned int>*& cells) {
+  cells = &bin_cells_[bin];
+  if (bin_state_[bin] != 0) {
+    return bin_state_[bin] == 1;
+  }
+
+  std::vector<unsigned int>& outline = bin_cells_[bin];
+  outline.clear();
+  bin_state_[bin] = 1;
+  if (footprint_spec_.size() < 3) {
+    outline.push_back(cell_index_);
+    return true;
+  }
+
+  // the corners at the middle of the bin, joined as CostmapModel does
+  double th = bin * 2 * M_PI / yaw_bins_;
+  double cos_th = cos(th), sin_th = sin(th);
+  unsigned int n = footprint_spec_.size();
+  std::vector<unsigned int> cx(n), cy(n);
+  for (unsigned int i = 0; i < n; ++i) {
+    double wx = x_ + footprint_spec_[i].x * cos_th - footprint_spec_[i].y * sin_th;
+    double wy = y_ + footprint_spec_[i].x * sin_th + footprint_spec_[i].y * cos_th;
+    if (!costmap.worldToMap(wx, wy, cx[i], cy[i])) {
+      bin_state_[bin] = 2;
+      return false;
+    }
+  }
+  for (unsigned int i = 0; i < n; ++i) {
+    unsigned int j = (i + 1) % n;
+    for (LineIterator line(cx[i], cy[i], cx[j], cy[j]); line.isValid(); line.advance()) {
+      outline.push_back(costmap.getIndex(line.getX(), line.getY()));
+    }
+  }
+  return true;
+}
+
+} /* namespace base_local_planner */
@@ -38,6 +38,7 @@
 #include <base_local_planner/local_planner_util.h>
 
 #include <base_local_planner/goal_functions.h>
+#include <algorithm>
 
 namespace base_local_planner {
 
@@ -76,37 +77,65 @@ costmap_2d::Costmap2D* LocalPlannerUtil::getCostmap() {
 
 LocalPlannerLimits LocalPlannerUtil::getCurrentLimits() {
   boost::mutex::scoped_lock l(limits_configuration_mutex_);
-  return limits_;
+  LocalPlannerLimits limits = limits_;
+  if(speed_limit_trans_ > 0.0) {
+    limits.max_trans_vel = std::min(limits.max_trans_vel, speed_limit_trans_);
+  }
+  if(speed_limit_rot_ > 0.0) {
+    limits.max_rot_vel = std::min(limits.max_rot_vel, speed_limit_rot_);
+  }
+  return limits;
+}
+
+void LocalPlannerUtil::setSpeedLimit(double max_trans_vel, double max_rot_vel) {
+  boost::mutex::scoped_lock l(limits_configuration_mutex_);
+  speed_limit_trans_ = max_trans_vel;
+  speed_limit_rot_ = max_rot_vel;
 }
 
 
 bool LocalPlannerUtil::getGoal(tf::Stamped<tf::Pose>& goal_pose) {
+  if(!global_plan_ || plan_first_ >= global_plan_->size()){
+    ROS_ERROR("Received plan with zero length");
+    return false;
+  }
+
   //we assume the global goal is the last point in the global plan
   return base_local_planner::getGoalPose(*tf_,
-        global_plan_,
+        *global_plan_,
         global_frame_,
         goal_pose);
 }
 
 bool LocalPlannerUtil::setPlan(const std::vector<geometry_msgs::PoseStamped>& orig_global_plan) {
+  return setSharedPlan(nav_core::PlanConstPtr(new std::vector<geometry_msgs::PoseStamped>(orig_global_plan)));
+}
+
+bool LocalPlannerUtil::setSharedPlan(const nav_core::PlanConstPtr& orig_global_plan) {
   if(!initialized_){
     ROS_ERROR("Planner utils have not been initialized, please call initialize() first");
     return false;
   }
 
   //reset the global plan
-  global_plan_.clear();
-
   global_plan_ = orig_global_plan;
+  plan_first_ = 0;
+  plan_cache_.reset();
 
   return true;
 }
 
 bool LocalPlannerUtil::getLocalPlan(tf::Stamped<tf::Pose>& global_pose, std::vector<geometry_msgs::PoseStamped>& transformed_plan) {
+  if(!global_plan_){
+    ROS_ERROR("Received plan with zero length");
+    return false;
+  }
+
   //get the global plan in our frame
-  if(!base_local_planner::transformGlobalPlan(
+  if(!plan_cache_.transformGlobalPlan(
       *tf_,
-      global_plan_,
+      *global_plan_,
+      plan_first_,
       global_pose,
       *costmap_,
       global_frame_,
@@ -117,7 +146,7 @@ bool LocalPlannerUtil::getLocalPlan(tf::Stamped<tf::Pose>& global_pose, std::vec
 
   //now we'll prune the plan based on the position of the robot
   if(limits_.prune_plan) {
-    base_local_planner::prunePlan(global_pose, transformed_plan, global_plan_);
+    plan_cache_.prunePlan(global_pose, transformed_plan, plan_first_);
   }
   return true;
 }
@@ -38,12 +38,12 @@ using namespace std;
 namespace base_local_planner{
 
   MapGrid::MapGrid()
-    : size_x_(0), size_y_(0)
+    : size_x_(0), size_y_(0), incremental_(false)
   {
   }
 
   MapGrid::MapGrid(unsigned int size_x, unsigned int size_y) 
-    : size_x_(size_x), size_y_(size_y)
+    : size_x_(size_x), size_y_(size_y), incremental_(false)
   {
     commonInit();
   }
@@ -52,6 +52,8 @@ namespace base_local_planner{
     size_y_ = mg.size_y_;
     size_x_ = mg.size_x_;
     map_ = mg.map_;
+    incremental_ = mg.incremental_;
+    compact_ = mg.compact_;
   }
 
   void MapGrid::commonInit(){
@@ -78,6 +80,8 @@ namespace base_local_planner{
     size_y_ = mg.size_y_;
     size_x_ = mg.size_x_;
     map_ = mg.map_;
+    incremental_ = mg.incremental_;
+    compact_ = mg.compact_;
     return *this;
   }
 
@@ -128,6 +132,9 @@ namespace base_local_planner{
       map_[i].target_mark = false;
       map_[i].within_robot = false;
     }
+    if (incremental_) {
+      compact_.resetPathDist();
+    }
   }
 
   void MapGrid::adjustPlanResolution(const std::vector<geometry_msgs::PoseStamped>& global_plan_in,
@@ -201,10 +208,17 @@ namespace base_local_planner{
     if (!started_path) {
       ROS_ERROR("None of the %d first of %zu (%zu) points of the global plan were in the local costmap and free",
           i, adjusted_global_plan.size(), global_plan.size());
+      if (incremental_) {
+        resetPathDist();
+      }
       return;
     }
 
-    computeTargetDistance(path_dist_queue, costmap);
+    if (incremental_) {
+      updateTargetDistance(path_dist_queue, costmap);
+    } else {
+      computeTargetDistance(path_dist_queue, costmap);
+    }
   }
 
   //mark the point of the costmap as local goal where global_plan first leaves the area (or its last point)
@@ -236,6 +250,9 @@ namespace base_local_planner{
     }
     if (!started_path) {
       ROS_ERROR("None of the points of the global plan were in the local costmap, global plan points too far from robot");
+      if (incremental_) {
+        resetPathDist();
+      }
       return;
     }
 
@@ -248,7 +265,11 @@ namespace base_local_planner{
       path_dist_queue.push(&current);
     }
 
-    computeTargetDistance(path_dist_queue, costmap);
+    if (incremental_) {
+      updateTargetDistance(path_dist_queue, costmap);
+    } else {
+      computeTargetDistance(path_dist_queue, costmap);
+    }
   }
 
 
@@ -258,11 +279,16 @@ namespace base_local_planner{
     MapCell* check_cell;
     unsigned int last_col = size_x_ - 1;
     unsigned int last_row = size_y_ - 1;
-    while(!dist_queue.empty()){
-      current_cell = dist_queue.front();
 
+    // every cell is queued once at most, after the initial ones
+    fifo_.resize(map_.size() + dist_queue.size());
+    unsigned int head = 0, tail = 0;
+    for (; !dist_queue.empty(); dist_queue.pop()) {
+      fifo_[tail++] = dist_queue.front() - &map_[0];
+    }
 
-      dist_queue.pop();
+    while(head < tail){
+      current_cell = &map_[fifo_[head++]];
 
       if(current_cell->cx > 0){
         check_cell = current_cell - 1;
@@ -270,7 +296,7 @@ namespace base_local_planner{
           //mark the cell as visisted
           check_cell->target_mark = true;
           if(updatePathCell(current_cell, check_cell, costmap)) {
-            dist_queue.push(check_cell);
+            fifo_[tail++] = check_cell - &map_[0];
           }
         }
       }
@@ -280,7 +306,7 @@ namespace base_local_planner{
         if(!check_cell->target_mark){
           check_cell->target_mark = true;
           if(updatePathCell(current_cell, check_cell, costmap)) {
-            dist_queue.push(check_cell);
+            fifo_[tail++] = check_cell - &map_[0];
           }
         }
       }
@@ -290,7 +316,7 @@ namespace base_local_planner{
         if(!check_cell->target_mark){
           check_cell->target_mark = true;
           if(updatePathCell(current_cell, check_cell, costmap)) {
-            dist_queue.push(check_cell);
+            fifo_[tail++] = check_cell - &map_[0];
           }
         }
       }
@@ -300,11 +326,28 @@ namespace base_local_planner{
         if(!check_cell->target_mark){
           check_cell->target_mark = true;
           if(updatePathCell(current_cell, check_cell, costmap)) {
-            dist_queue.push(check_cell);
+            fifo_[tail++] = check_cell - &map_[0];
           }
         }
       }
     }
   }
 
+  void MapGrid::updateTargetDistance(queue<MapCell*>& dist_queue, const costmap_2d::Costmap2D& costmap){
+    seeds_.clear();
+    for (; !dist_queue.empty(); dist_queue.pop()) {
+      seeds_.push_back(dist_queue.front() - &map_[0]);
+    }
+    compact_.sizeCheck(size_x_, size_y_);
+    compact_.updateTargetDistance(seeds_, costmap);
+
+    for (unsigned int i = 0; i < size_y_; ++i) {
+      for (unsigned int j = 0; j < size_x_; ++j) {
+        MapCell& cell = map_[size_x_ * i + j];
+        cell.target_dist = compact_(j, i);
+        cell.target_mark = compact_.isMarked(j, i);
+      }
+    }
+  }
+
 };
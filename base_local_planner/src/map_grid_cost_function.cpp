@@ -57,7 +57,9 @@ void MapGridCostFunction::setTargetPoses(std::vector<geometry_msgs::PoseStamped>
 }
 
 bool MapGridCostFunction::prepare() {
-  map_.resetPathDist();
+  if (!map_.isIncremental()) {
+    map_.resetPathDist();
+  }
 
   if (is_local_goal_function_) {
     map_.setLocalGoal(*costmap_, target_poses_);
@@ -68,18 +70,14 @@ bool MapGridCostFunction::prepare() {
 }
 
 double MapGridCostFunction::getCellCosts(unsigned int px, unsigned int py) {
-  double grid_dist = map_(px, py).target_dist;
+  double grid_dist = map_(px, py);
   return grid_dist;
 }
 
 double MapGridCostFunction::scoreTrajectory(Trajectory &traj) {
-  double cost = 0.0;
-  if (aggregationType_ == Product) {
-    cost = 1.0;
-  }
+  double cost = initialCost();
   double px, py, pth;
   unsigned int cell_x, cell_y;
-  double grid_dist;
 
   for (unsigned int i = 0; i < traj.getPointsSize(); ++i) {
     traj.getPoint(i, px, py, pth);
@@ -101,28 +99,9 @@ double MapGridCostFunction::scoreTrajectory(Trajectory &traj) {
       ROS_WARN("Off Map %f, %f", px, py);
       return -4.0;
     }
-    grid_dist = getCellCosts(cell_x, cell_y);
-    //if a point on this trajectory has no clear path to the goal... it may be invalid
-    if (stop_on_failure_) {
-      if (grid_dist == map_.obstacleCosts()) {
-        return -3.0;
-      } else if (grid_dist == map_.unreachableCellCosts()) {
-        return -2.0;
-      }
-    }
-
-    switch( aggregationType_ ) {
-    case Last:
-      cost = grid_dist;
-      break;
-    case Sum:
-      cost += grid_dist;
-      break;
-    case Product:
-      if (cost > 0) {
-        cost *= grid_dist;
-      }
-      break;
+    cost = addCellCost(cell_x, cell_y, cost);
+    if (cost < 0) {
+      return cost;
     }
   }
   return cost;
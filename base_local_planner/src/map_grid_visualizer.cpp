@@ -38,7 +38,7 @@
 #include <pcl_conversions/pcl_conversions.h>
 
 namespace base_local_planner {
-  MapGridVisualizer::MapGridVisualizer() {}
+  MapGridVisualizer::MapGridVisualizer() : cost_cloud_(NULL) {}
 
 
   void MapGridVisualizer::initialize(const std::string& name, std::string frame_id, boost::function<bool (int cx, int cy, float &path_cost, float &goal_cost, float &occ_cost, float &total_cost)> cost_function) {
@@ -49,10 +49,15 @@ namespace base_local_planner {
 
     cost_cloud_ = new pcl::PointCloud<MapGridCostPoint>;
     cost_cloud_->header.frame_id = frame_id;
-    pub_.advertise(ns_nh_, "cost_cloud", 1);
+    double cost_cloud_rate;
+    ns_nh_.param("cost_cloud_rate", cost_cloud_rate, 0.0);
+    pub_.advertise(ns_nh_, "cost_cloud", cost_cloud_rate);
   }
 
   void MapGridVisualizer::publishCostCloud(const costmap_2d::Costmap2D* costmap_p_) {
+    if (!pub_.ready()) {
+      return;
+    }
     unsigned int x_size = costmap_p_->getSizeInCellsX();
     unsigned int y_size = costmap_p_->getSizeInCellsY();
     double z_coord = 0.0;
@@ -79,6 +84,6 @@ namespace base_local_planner {
       }
     }
     pub_.publish(*cost_cloud_);
-    ROS_DEBUG("Cost PointCloud published");
+    ROS_DEBUG("Cost PointCloud handed to the publishing thread");
   }
 };
@@ -36,14 +36,22 @@
  *********************************************************************/
 
 #include <base_local_planner/obstacle_cost_function.h>
+#include <base_local_planner/line_iterator.h>
+#include <costmap_2d/cost_values.h>
+#include <costmap_2d/footprint.h>
+#include <algorithm>
 #include <cmath>
 #include <Eigen/Core>
 #include <ros/console.h>
 
 namespace base_local_planner {
 
+// positions of the robot within its cell, along each axis, that the outlines are rasterized for
+static const int OUTLINE_PHASES = 4;
+
 ObstacleCostFunction::ObstacleCostFunction(costmap_2d::Costmap2D* costmap) 
-    : costmap_(costmap), sum_scores_(false) {
+    : costmap_(costmap), inscribed_radius_(0.0), circumscribed_radius_(0.0), circumscribed_cost_(0), coarse_stride_(0), headings_(0),
+      outline_resolution_(0.0), outline_size_x_(0), sum_scores_(false) {
   if (costmap != NULL) {
     world_model_ = new base_local_planner::CostmapModel(*costmap_);
   }
@@ -65,12 +73,122 @@ void ObstacleCostFunction::setParams(double max_trans_vel, double max_scaling_fa
 
 void ObstacleCostFunction::setFootprint(std::vector<geometry_msgs::Point> footprint_spec) {
   footprint_spec_ = footprint_spec;
+  // once here, rather than by the world model for every point scored
+  costmap_2d::calculateMinAndMaxDistances(footprint_spec_, inscribed_radius_, circumscribed_radius_);
 }
 
 bool ObstacleCostFunction::prepare() {
+  if (headings_ > 0 && footprint_spec_.size() >= 3) {
+    bool same_footprint = outline_footprint_.size() == footprint_spec_.size();
+    for (unsigned int i = 0; same_footprint && i < footprint_spec_.size(); ++i) {
+      same_footprint = outline_footprint_[i].x == footprint_spec_[i].x && outline_footprint_[i].y == footprint_spec_[i].y;
+    }
+    if (!same_footprint || (int)outlines_.size() != headings_ * OUTLINE_PHASES * OUTLINE_PHASES ||
+        outline_resolution_ != costmap_->getResolution() || outline_size_x_ != costmap_->getSizeInCellsX()) {
+      rasterizeOutlines();
+    }
+  }
   return true;
 }
 
+void ObstacleCostFunction::rasterizeOutlines() {
+  outline_footprint_ = footprint_spec_;
+  outline_resolution_ = costmap_->getResolution();
+  outline_size_x_ = costmap_->getSizeInCellsX();
+  int count = headings_ * OUTLINE_PHASES * OUTLINE_PHASES;
+  outlines_.assign(count, std::vector<int>());
+  outline_bounds_.assign(4 * count, 0);
+
+  // the corners in cells from the robot's cell, for the middle of each phase of its position
+  // in the cell, joined as CostmapModel does
+  unsigned int n = footprint_spec_.size();
+  std::vector<int> cx(n), cy(n);
+  for (int o = 0; o < count; ++o) {
+    double th = 2 * M_PI * (o / (OUTLINE_PHASES * OUTLINE_PHASES)) / headings_;
+    double cos_th = cos(th), sin_th = sin(th);
+    double phase_x = (o % OUTLINE_PHASES + 0.5) / OUTLINE_PHASES;
+    double phase_y = (o / OUTLINE_PHASES % OUTLINE_PHASES + 0.5) / OUTLINE_PHASES;
+    for (unsigned int i = 0; i < n; ++i) {
+      cx[i] = (int)floor(phase_x + (footprint_spec_[i].x * cos_th - footprint_spec_[i].y * sin_th) / outline_resolution_);
+      cy[i] = (int)floor(phase_y + (footprint_spec_[i].x * sin_th + footprint_spec_[i].y * cos_th) / outline_resolution_);
+    }
+    int* bounds = &outline_bounds_[4 * o];
+    bounds[0] = *std::min_element(cx.begin(), cx.end());
+    bounds[1] = *std::max_element(cx.begin(), cx.end());
+    bounds[2] = *std::min_element(cy.begin(), cy.end());
+    bounds[3] = *std::max_element(cy.begin(), cy.end());
+
+    std::vector<int>& outline = outlines_[o];
+    for (unsigned int i = 0; i < n; ++i) {
+      unsigned int j = (i + 1) % n;
+      for (LineIterator line(cx[i], cy[i], cx[j], cy[j]); line.isValid(); line.advance()) {
+        outline.push_back(line.getY() * (int)outline_size_x_ + line.getX());
+      }
+    }
+    std::sort(outline.begin(), outline.end());
+    outline.erase(std::unique(outline.begin(), outline.end()), outline.end());
+  }
+}
+
+double ObstacleCostFunction::outlineCost(double x, double y, double th) {
+  unsigned int cell_x, cell_y;
+  if ( ! costmap_->worldToMap(x, y, cell_x, cell_y)) {
+    return -7.0;
+  }
+
+  int h = (int)floor(th * headings_ / (2 * M_PI) + 0.5) % headings_;
+  if (h < 0) {
+    h += headings_;
+  }
+  double resolution = costmap_->getResolution();
+  int phase_x = std::min((int)(((x - costmap_->getOriginX()) / resolution - cell_x) * OUTLINE_PHASES), OUTLINE_PHASES - 1);
+  int phase_y = std::min((int)(((y - costmap_->getOriginY()) / resolution - cell_y) * OUTLINE_PHASES), OUTLINE_PHASES - 1);
+  int o = (h * OUTLINE_PHASES + phase_y) * OUTLINE_PHASES + phase_x;
+
+  // a corner off the map makes the footprint illegal
+  const int* bounds = &outline_bounds_[4 * o];
+  if ((int)cell_x + bounds[0] < 0 || (int)cell_x + bounds[1] >= (int)costmap_->getSizeInCellsX() ||
+      (int)cell_y + bounds[2] < 0 || (int)cell_y + bounds[3] >= (int)costmap_->getSizeInCellsY()) {
+    return -6.0;
+  }
+
+  const unsigned char* costs = costmap_->getCharMap() + costmap_->getIndex(cell_x, cell_y);
+  const std::vector<int>& outline = outlines_[o];
+  unsigned char footprint_cost = 0;
+  for (unsigned int i = 0; i < outline.size(); ++i) {
+    unsigned char cost = costs[outline[i]];
+    if (cost == costmap_2d::LETHAL_OBSTACLE || cost == costmap_2d::NO_INFORMATION) {
+      return -6.0;
+    }
+    footprint_cost = std::max(footprint_cost, cost);
+  }
+
+  return std::max(footprint_cost, costs[0]);
+}
+
+bool ObstacleCostFunction::centerCost(double x, double y, double& cost) {
+  unsigned int cell_x, cell_y;
+  if ( ! costmap_->worldToMap(x, y, cell_x, cell_y)) {
+    cost = -7.0;
+    return true;
+  }
+
+  unsigned char center = costmap_->getCost(cell_x, cell_y);
+  if (center >= costmap_2d::INSCRIBED_INFLATED_OBSTACLE) {
+    cost = -6.0;
+    return true;
+  }
+
+  // near the edge of the map, a corner may be off it
+  unsigned int r = (unsigned int)ceil(circumscribed_radius_ / costmap_->getResolution());
+  if (center < circumscribed_cost_ && cell_x >= r && cell_x + r < costmap_->getSizeInCellsX() &&
+      cell_y >= r && cell_y + r < costmap_->getSizeInCellsY()) {
+    cost = center;
+    return true;
+  }
+  return false;
+}
+
 double ObstacleCostFunction::scoreTrajectory(Trajectory &traj) {
   double cost = 0;
   double scale = getScalingFactor(traj, scaling_speed_, max_trans_vel_, max_scaling_factor_);
@@ -81,11 +199,32 @@ double ObstacleCostFunction::scoreTrajectory(Trajectory &traj) {
     return -9;
   }
 
-  for (unsigned int i = 0; i < traj.getPointsSize(); ++i) {
+  unsigned int num_points = traj.getPointsSize();
+  unsigned int stride = std::max(coarse_stride_, 1u);
+  if (stride > 1) {
+    for (unsigned int i = num_points; i-- > 0; ) {
+      if ((num_points - 1 - i) % stride != 0) {
+        continue;
+      }
+      traj.getPoint(i, px, py, pth);
+      double f_cost = pointCost(px, py, pth, scale);
+      if (f_cost < 0) {
+        return f_cost;
+      }
+      if (sum_scores_)
+        cost += f_cost;
+      else if (i == num_points - 1)
+        cost = f_cost;
+    }
+  }
+
+  for (unsigned int i = 0; i < num_points; ++i) {
+    if (stride > 1 && (num_points - 1 - i) % stride == 0) {
+      // scored above
+      continue;
+    }
     traj.getPoint(i, px, py, pth);
-    double f_cost = footprintCost(px, py, pth,
-        scale, footprint_spec_,
-        costmap_, world_model_);
+    double f_cost = pointCost(px, py, pth, scale);
 
     if(f_cost < 0){
         return f_cost;
@@ -93,12 +232,26 @@ double ObstacleCostFunction::scoreTrajectory(Trajectory &traj) {
 
     if(sum_scores_)
         cost +=  f_cost;
-    else
+    else if (stride == 1)
         cost = f_cost;
   }
   return cost;
 }
 
+double ObstacleCostFunction::pointCost(double x, double y, double th, double scale) {
+  double f_cost;
+  if (circumscribed_cost_ > 0 && centerCost(x, y, f_cost)) {
+    // settled by the center cell
+  } else if (headings_ > 0 && footprint_spec_.size() >= 3) {
+    f_cost = outlineCost(x, y, th);
+  } else {
+    f_cost = footprintCost(x, y, th,
+        scale, footprint_spec_,
+        costmap_, world_model_, inscribed_radius_, circumscribed_radius_);
+  }
+  return f_cost;
+}
+
 double ObstacleCostFunction::getScalingFactor(Trajectory &traj, double scaling_speed, double max_trans_vel, double max_scaling_factor) {
   double vmag = hypot(traj.xv_, traj.yv_);
 
@@ -118,13 +271,14 @@ double ObstacleCostFunction::footprintCost (
     const double& y,
     const double& th,
     double scale,
-    std::vector<geometry_msgs::Point> footprint_spec,
+    const std::vector<geometry_msgs::Point>& footprint_spec,
     costmap_2d::Costmap2D* costmap,
-    base_local_planner::WorldModel* world_model) {
+    base_local_planner::WorldModel* world_model,
+    double inscribed_radius,
+    double circumscribed_radius) {
 
   //check if the footprint is legal
-  // TODO: Cache inscribed radius
-  double footprint_cost = world_model->footprintCost(x, y, th, footprint_spec);
+  double footprint_cost = world_model->footprintCost(x, y, th, footprint_spec, inscribed_radius, circumscribed_radius);
 
   if (footprint_cost < 0) {
     return -6.0;
@@ -38,7 +38,9 @@
 
 namespace base_local_planner {
 
-OdometryHelperRos::OdometryHelperRos(std::string odom_topic) {
+OdometryHelperRos::OdometryHelperRos(std::string odom_topic) : odom_seq_(0) {
+  odom_.vx = odom_.vy = odom_.vth = 0.0;
+  odom_.child_frame_id[0] = '\0';
   setOdomTopic( odom_topic );
 }
 
@@ -46,33 +48,56 @@ void OdometryHelperRos::odomCallback(const nav_msgs::Odometry::ConstPtr& msg) {
     ROS_INFO_ONCE("odom received!");
 
   //we assume that the odometry is published in the frame of the base
-  boost::mutex::scoped_lock lock(odom_mutex_);
-  base_odom_.twist.twist.linear.x = msg->twist.twist.linear.x;
-  base_odom_.twist.twist.linear.y = msg->twist.twist.linear.y;
-  base_odom_.twist.twist.angular.z = msg->twist.twist.angular.z;
-  base_odom_.child_frame_id = msg->child_frame_id;
+  OdomSample sample;
+  sample.vx = msg->twist.twist.linear.x;
+  sample.vy = msg->twist.twist.linear.y;
+  sample.vth = msg->twist.twist.angular.z;
+  sample.stamp = msg->header.stamp;
+  size_t length = msg->child_frame_id.copy(sample.child_frame_id, sizeof(sample.child_frame_id) - 1);
+  sample.child_frame_id[length] = '\0';
+
+  //a reader that sees the sequence odd, or changed by the time it has copied the sample, copies it again
+  unsigned int seq = odom_seq_.load(boost::memory_order_relaxed);
+  odom_seq_.store(seq + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  odom_ = sample;
+  odom_seq_.store(seq + 2, boost::memory_order_release);
 //  ROS_DEBUG_NAMED("dwa_local_planner", "In the odometry callback with velocity values: (%.2f, %.2f, %.2f)",
 //      base_odom_.twist.twist.linear.x, base_odom_.twist.twist.linear.y, base_odom_.twist.twist.angular.z);
 }
 
+void OdometryHelperRos::readOdom(OdomSample& sample) {
+  unsigned int seq;
+  do {
+    seq = odom_seq_.load(boost::memory_order_acquire);
+    sample = odom_;
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+  } while ((seq & 1) || odom_seq_.load(boost::memory_order_relaxed) != seq);
+}
+
 //copy over the odometry information
 void OdometryHelperRos::getOdom(nav_msgs::Odometry& base_odom) {
-  boost::mutex::scoped_lock lock(odom_mutex_);
-  base_odom = base_odom_;
+  OdomSample sample;
+  readOdom(sample);
+  base_odom = nav_msgs::Odometry();
+  base_odom.header.stamp = sample.stamp;
+  base_odom.child_frame_id = sample.child_frame_id;
+  base_odom.twist.twist.linear.x = sample.vx;
+  base_odom.twist.twist.linear.y = sample.vy;
+  base_odom.twist.twist.angular.z = sample.vth;
 }
 
 
 void OdometryHelperRos::getRobotVel(tf::Stamped<tf::Pose>& robot_vel) {
   // Set current velocities from odometry
   geometry_msgs::Twist global_vel;
-  {
-    boost::mutex::scoped_lock lock(odom_mutex_);
-    global_vel.linear.x = base_odom_.twist.twist.linear.x;
-    global_vel.linear.y = base_odom_.twist.twist.linear.y;
-    global_vel.angular.z = base_odom_.twist.twist.angular.z;
+  OdomSample sample;
+  readOdom(sample);
+  global_vel.linear.x = sample.vx;
+  global_vel.linear.y = sample.vy;
+  global_vel.angular.z = sample.vth;
 
-    robot_vel.frame_id_ = base_odom_.child_frame_id;
-  }
+  robot_vel.frame_id_ = sample.child_frame_id;
   robot_vel.setData(tf::Transform(tf::createQuaternionFromYaw(global_vel.angular.z), tf::Vector3(global_vel.linear.x, global_vel.linear.y, 0)));
   robot_vel.stamp_ = ros::Time();
 }
@@ -40,6 +40,7 @@
 #include <sys/time.h>
 #include <math.h>
 #include <cstdio>
+#include <algorithm>
 
 using namespace std;
 using namespace costmap_2d;
@@ -74,12 +75,65 @@ void printPolygonPS(const std::vector<geometry_msgs::Point>& poly, double line_w
 
 namespace base_local_planner {
 
+  //values of the scan bearing table for bins outside the scan, and for bins straddling two segments
+  static const int SCAN_OUTSIDE = -1;
+  static const int SCAN_AMBIGUOUS = -2;
+
+  //the scan segment at an angle from the first scan point, in [0, 2PI], or SCAN_OUTSIDE
+  static int scanSegment(double vector_angle, const PlanarLaserScan& laser_scan){
+    double total_rads = laser_scan.angle_max - laser_scan.angle_min;
+
+    //if this point lies outside of the scan field of view... it is not in the scan
+    if(vector_angle < 0 || vector_angle >= total_rads)
+      return SCAN_OUTSIDE;
+
+    //compute the index of the point in the scan
+    unsigned int index = (unsigned int) (vector_angle / laser_scan.angle_increment);
+
+    //make sure we have a legal index... we always should at this point, but just in case
+    if(index >= laser_scan.cloud.points.size() - 1)
+      return SCAN_OUTSIDE;
+    return index;
+  }
+
+  //a monotonic stand-in for the angle of (x, y) that needs no trig, going from 0 to 4 over one turn
+  static double pseudoAngle(double x, double y){
+    if(y >= 0)
+      return x >= 0 ? y / (x + y) : 1 - x / (y - x);
+    return x < 0 ? 2 - y / (-x - y) : 3 + x / (x - y);
+  }
+
+  //the angle in [0, 2PI) of a pseudo-angle
+  static double pseudoAngleToAngle(double p){
+    double x, y;
+    if(p < 1){
+      x = 1 - p;
+      y = p;
+    }
+    else if(p < 2){
+      x = 1 - p;
+      y = 2 - p;
+    }
+    else if(p < 3){
+      x = p - 3;
+      y = 2 - p;
+    }
+    else{
+      x = p - 3;
+      y = p - 4;
+    }
+    double angle = atan2(y, x);
+    return angle < 0 ? 2 * M_PI + angle : angle;
+  }
+
 PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_msgs::Point origin, double max_z, double obstacle_range, double min_seperation) :
   resolution_(resolution), origin_(origin), max_z_(max_z), sq_obstacle_range_(obstacle_range * obstacle_range), sq_min_separation_(min_seperation * min_seperation)
   {
     width_ = (int) (size_x / resolution_);
     height_ = (int) (size_y / resolution_);
-    cells_.resize(width_ * height_);
+    cell_start_.resize(width_ * height_ + 1, 0);
+    cell_size_.resize(width_ * height_, 0);
+    pending_head_.resize(width_ * height_, -1);
   }
 
   double PointGrid::footprintCost(const geometry_msgs::Point& position, const std::vector<geometry_msgs::Point>& footprint, 
@@ -116,21 +170,19 @@ PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_m
 
     //if there are points, we have to do a more expensive check
     for(unsigned int i = 0; i < points_.size(); ++i){
-      list<pcl::PointXYZ>* cell_points = points_[i];
-      if(cell_points != NULL){
-        for(list<pcl::PointXYZ>::iterator it = cell_points->begin(); it != cell_points->end(); ++it){
-          const pcl::PointXYZ& pt = *it;
-          //first, we'll check to make sure we're in the outer square
-          //printf("(%.2f, %.2f) ... l(%.2f, %.2f) ... u(%.2f, %.2f)\n", pt.x, pt.y, c_lower_left.x, c_lower_left.y, c_upper_right.x, c_upper_right.y);
-          if(pt.x > c_lower_left.x && pt.x < c_upper_right.x && pt.y > c_lower_left.y && pt.y < c_upper_right.y){
-            //do a quick check to see if the point lies in the inner square of the robot
-            if(pt.x > i_lower_left.x && pt.x < i_upper_right.x && pt.y > i_lower_left.y && pt.y < i_upper_right.y)
-              return -1.0;
-
-            //now we really have to do a full footprint check on the point
-            if(ptInPolygon(pt, footprint))
-              return -1.0;
-          }
+      const pcl::PointXYZ* cell_end = cellEnd(points_[i]);
+      for(const pcl::PointXYZ* it = cellBegin(points_[i]); it != cell_end; ++it){
+        const pcl::PointXYZ& pt = *it;
+        //first, we'll check to make sure we're in the outer square
+        //printf("(%.2f, %.2f) ... l(%.2f, %.2f) ... u(%.2f, %.2f)\n", pt.x, pt.y, c_lower_left.x, c_lower_left.y, c_upper_right.x, c_upper_right.y);
+        if(pt.x > c_lower_left.x && pt.x < c_upper_right.x && pt.y > c_lower_left.y && pt.y < c_upper_right.y){
+          //do a quick check to see if the point lies in the inner square of the robot
+          if(pt.x > i_lower_left.x && pt.x < i_upper_right.x && pt.y > i_lower_left.y && pt.y < i_upper_right.y)
+            return -1.0;
+
+          //now we really have to do a full footprint check on the point
+          if(ptInPolygon(pt, footprint))
+            return -1.0;
         }
       }
     }
@@ -175,8 +227,8 @@ PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_m
     return true;
   }
 
-  void PointGrid::getPointsInRange(const geometry_msgs::Point& lower_left, const geometry_msgs::Point& upper_right, vector< list<pcl::PointXYZ>* >& points){
-    points.clear();
+  void PointGrid::getPointsInRange(const geometry_msgs::Point& lower_left, const geometry_msgs::Point& upper_right, vector<unsigned int>& cells){
+    cells.clear();
 
     //compute the other corners of the box so we can get cells indicies for them
     geometry_msgs::Point upper_left, lower_right;
@@ -214,23 +266,54 @@ PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_m
      *  |                               |
      * (0, height) ----------------- (width, height)
      */
-    //get an iterator
-    vector< list<pcl::PointXYZ> >::iterator cell_iterator = cells_.begin() + lower_left_index;
+    //the points inserted since the last search have to be packed in before we hand out cells
+    packCells();
+
     //printf("Index: %d, Width: %d, x_steps: %d, y_steps: %d\n", lower_left_index, width_, x_steps, y_steps);
+    unsigned int row_index = lower_left_index;
     for(unsigned int i = 0; i < y_steps; ++i){
       for(unsigned int j = 0; j < x_steps; ++j){
-        list<pcl::PointXYZ>& cell = *cell_iterator;
-        //if the cell contains any points... we need to push them back to our list
-        if(!cell.empty()){
-          points.push_back(&cell);
+        //if the cell contains any points... we need to push it back to our list
+        if(cell_size_[row_index + j] > 0){
+          cells.push_back(row_index + j);
         }
-        if(j < x_steps - 1)
-          cell_iterator++; //move a cell in the x direction
       }
-      cell_iterator += width_ - (x_steps - 1); //move down a row
+      row_index += width_; //move down a row
     }
   }
 
+  void PointGrid::packCells(){
+    if(pending_points_.empty())
+      return;
+
+    //count the pending points of each cell, then sum the counts up with the packed points into the new cell starts
+    unsigned int num_cells = cell_size_.size();
+    packed_start_.assign(num_cells + 1, 0);
+    for(unsigned int i = 0; i < pending_cells_.size(); ++i)
+      packed_start_[pending_cells_[i] + 1]++;
+    for(unsigned int i = 0; i < num_cells; ++i)
+      packed_start_[i + 1] += packed_start_[i] + cell_size_[i];
+
+    //copy the packed points over, leaving room after each cell for its pending ones
+    packed_scratch_.resize(packed_start_[num_cells]);
+    for(unsigned int i = 0; i < num_cells; ++i){
+      if(cell_size_[i] > 0)
+        copy(cell_points_.begin() + cell_start_[i], cell_points_.begin() + cell_start_[i] + cell_size_[i],
+            packed_scratch_.begin() + packed_start_[i]);
+    }
+    for(unsigned int i = 0; i < pending_points_.size(); ++i){
+      unsigned int index = pending_cells_[i];
+      packed_scratch_[packed_start_[index] + cell_size_[index]++] = pending_points_[i];
+      pending_head_[index] = -1;
+    }
+
+    cell_points_.swap(packed_scratch_);
+    cell_start_.swap(packed_start_);
+    pending_points_.clear();
+    pending_next_.clear();
+    pending_cells_.clear();
+  }
+
   void PointGrid::insert(pcl::PointXYZ pt){
     //get the grid coordinates of the point
     unsigned int gx, gy;
@@ -246,17 +329,30 @@ PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_m
     //get the associated index
     unsigned int pt_index = gridIndex(gx, gy);
 
-    //insert the point into the grid at the correct location
-    cells_[pt_index].push_back(pt);
-    //printf("Index: %d, size: %d\n", pt_index, cells_[pt_index].size());
+    //insert the point into a free slot of its cell, or chain it to the cell until the next packing
+    unsigned int end = cell_start_[pt_index] + cell_size_[pt_index];
+    if(end < cell_start_[pt_index + 1]){
+      cell_points_[end] = pt;
+      cell_size_[pt_index]++;
+    }
+    else{
+      pending_next_.push_back(pending_head_[pt_index]);
+      pending_head_[pt_index] = pending_points_.size();
+      pending_points_.push_back(pt);
+      pending_cells_.push_back(pt_index);
+    }
+    //printf("Index: %d, size: %d\n", pt_index, cell_size_[pt_index]);
   }
 
   double PointGrid::getNearestInCell(pcl::PointXYZ& pt, unsigned int gx, unsigned int gy){
     unsigned int index = gridIndex(gx, gy);
     double min_sq_dist = DBL_MAX;
-    //loop through the points in the cell and find the minimum distance to the passed point
-    for(list<pcl::PointXYZ>::iterator it = cells_[index].begin(); it != cells_[index].end(); ++it){
-      min_sq_dist = min(min_sq_dist, sq_distance(pt, *it));
+    //loop through the points in the cell, packed and pending, and find the minimum distance to the passed point
+    for(unsigned int i = cell_start_[index]; i < cell_start_[index] + cell_size_[index]; ++i){
+      min_sq_dist = min(min_sq_dist, sq_distance(pt, cell_points_[i]));
+    }
+    for(int i = pending_head_[index]; i >= 0; i = pending_next_[i]){
+      min_sq_dist = min(min_sq_dist, sq_distance(pt, pending_points_[i]));
     }
     return min_sq_dist;
   }
@@ -413,21 +509,19 @@ PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_m
     if(points_.empty())
       return;
 
-    //if there are points, we have to check them against the scan explicitly to remove them
+    //if there are points, we have to check them against the scan explicitly to remove them, looking their bearing up in a table
+    indexScan(laser_scan);
     for(unsigned int i = 0; i < points_.size(); ++i){
-      list<pcl::PointXYZ>* cell_points = points_[i];
-      if(cell_points != NULL){
-        list<pcl::PointXYZ>::iterator it = cell_points->begin();
-        while(it != cell_points->end()){
-          const pcl::PointXYZ& pt = *it;
-
-          //check if the point is in the polygon and if it is, erase it from the grid
-          if(ptInScan(pt, laser_scan)){
-            it = cell_points->erase(it);
-          }
-          else
-            it++;
+      pcl::PointXYZ* cell_points = cellBegin(points_[i]);
+      unsigned int& cell_size = cell_size_[points_[i]];
+      unsigned int j = 0;
+      while(j < cell_size){
+        //check if the point is in the scan and if it is, erase it from the grid by moving the last point of the cell over it
+        if(ptInIndexedScan(cell_points[j], laser_scan)){
+          cell_points[j] = cell_points[--cell_size];
         }
+        else
+          j++;
       }
     }
   }
@@ -450,19 +544,9 @@ PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_m
       if(vector_angle < 0)
         vector_angle = 2 * M_PI + vector_angle;
 
-      double total_rads = laser_scan.angle_max - laser_scan.angle_min; 
-
-      //if this point lies outside of the scan field of view... it is not in the scan
-      if(vector_angle < 0 || vector_angle >= total_rads)
-        return false;
-
-      //compute the index of the point in the scan
-      unsigned int index = (unsigned int) (vector_angle / laser_scan.angle_increment);
-
-      //make sure we have a legal index... we always should at this point, but just in case
-      if(index >= laser_scan.cloud.points.size() - 1){
+      int index = scanSegment(vector_angle, laser_scan);
+      if(index == SCAN_OUTSIDE)
         return false;
-      }
 
       //if the point lies to the left of the line between the two scan points bounding it, it is within the scan
       if(orient(laser_scan.cloud.points[index], laser_scan.cloud.points[index + 1], pt) > 0){
@@ -476,10 +560,56 @@ PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_m
       return false;
   }
 
+  void PointGrid::indexScan(const PlanarLaserScan& laser_scan){
+    scan_v1_x_ = laser_scan.cloud.points[0].x - laser_scan.origin.x;
+    scan_v1_y_ = laser_scan.cloud.points[0].y - laser_scan.origin.y;
+
+    //a few bins per segment, so that most of them lie within one segment
+    unsigned int num_bins = 8 * laser_scan.cloud.points.size();
+    scan_bins_.resize(num_bins);
+
+    //a bin gets the segment of its bounds, widened a little for rounding, if both have the same one
+    const double margin = 1e-9;
+    double lower = 0.0;
+    int lower_segment = scanSegment(0.0, laser_scan);
+    for(unsigned int i = 0; i < num_bins; ++i){
+      double upper = i + 1 < num_bins ? pseudoAngleToAngle(4.0 * (i + 1) / num_bins) : 2 * M_PI;
+      int upper_segment = scanSegment(min(upper + margin, 2 * M_PI), laser_scan);
+      if(lower_segment == upper_segment && lower_segment == scanSegment(max(lower - margin, 0.0), laser_scan))
+        scan_bins_[i] = lower_segment;
+      else
+        scan_bins_[i] = SCAN_AMBIGUOUS;
+      lower = upper;
+      lower_segment = scanSegment(lower, laser_scan);
+    }
+  }
+
+  bool PointGrid::ptInIndexedScan(const pcl::PointXYZ& pt, const PlanarLaserScan& laser_scan){
+    double v2_x = pt.x - laser_scan.origin.x;
+    double v2_y = pt.y - laser_scan.origin.y;
+
+    double perp_dot = scan_v1_x_ * v2_y - scan_v1_y_ * v2_x;
+    double dot = scan_v1_x_ * v2_x + scan_v1_y_ * v2_y;
+    if(perp_dot == 0 && dot == 0)
+      return ptInScan(pt, laser_scan);
+
+    unsigned int bin = (unsigned int) (pseudoAngle(dot, perp_dot) * scan_bins_.size() / 4.0);
+    int index = scan_bins_[min(bin, (unsigned int) scan_bins_.size() - 1)];
+    if(index == SCAN_OUTSIDE)
+      return false;
+    //bins straddling two segments take the exact bearing
+    if(index == SCAN_AMBIGUOUS)
+      return ptInScan(pt, laser_scan);
+
+    //if the point lies to the left of the line between the two scan points bounding it, it is within the scan
+    return orient(laser_scan.cloud.points[index], laser_scan.cloud.points[index + 1], pt) > 0;
+  }
+
   void PointGrid::getPoints(pcl::PointCloud<pcl::PointXYZ>& cloud){
-    for(unsigned int i = 0; i < cells_.size(); ++i){
-      for(list<pcl::PointXYZ>::iterator it = cells_[i].begin(); it != cells_[i].end(); ++it){
-        cloud.push_back(*it);
+    packCells();
+    for(unsigned int i = 0; i < cell_size_.size(); ++i){
+      for(unsigned int j = cell_start_[i]; j < cell_start_[i] + cell_size_[i]; ++j){
+        cloud.push_back(cell_points_[j]);
       }
     }
   }
@@ -511,19 +641,16 @@ PointGrid::PointGrid(double size_x, double size_y, double resolution, geometry_m
 
     //if there are points, we have to check them against the polygon explicitly to remove them
     for(unsigned int i = 0; i < points_.size(); ++i){
-      list<pcl::PointXYZ>* cell_points = points_[i];
-      if(cell_points != NULL){
-        list<pcl::PointXYZ>::iterator it = cell_points->begin();
-        while(it != cell_points->end()){
-          const pcl::PointXYZ& pt = *it;
-
-          //check if the point is in the polygon and if it is, erase it from the grid
-          if(ptInPolygon(pt, poly)){
-            it = cell_points->erase(it);
-          }
-          else
-            it++;
+      pcl::PointXYZ* cell_points = cellBegin(points_[i]);
+      unsigned int& cell_size = cell_size_[points_[i]];
+      unsigned int j = 0;
+      while(j < cell_size){
+        //check if the point is in the polygon and if it is, erase it from the grid by moving the last point of the cell over it
+        if(ptInPolygon(cell_points[j], poly)){
+          cell_points[j] = cell_points[--cell_size];
         }
+        else
+          j++;
       }
     }
   }
@@ -38,28 +38,83 @@
 #include <base_local_planner/simple_scored_sampling_planner.h>
 
 #include <ros/console.h>
+#include <ros/time.h>
+#include <boost/bind.hpp>
+#include <nav_executor/executor.h>
+
+#include <algorithm>
+#include <limits>
 
 // 给推演出来的轨迹进行评分
 namespace base_local_planner {
-  
+
+  namespace {
+
+  // critics spending less time per rejection first, ones that never reject last
+  struct CheaperRejection {
+    CheaperRejection(const std::vector<SimpleScoredSamplingPlanner::CriticStats>& stats) : stats_(stats) {}
+    double key(unsigned int i) const {
+      return stats_[i].rejections > 0 ? stats_[i].seconds / stats_[i].rejections : std::numeric_limits<double>::infinity();
+    }
+    bool operator()(unsigned int a, unsigned int b) const {
+      return key(a) < key(b);
+    }
+    const std::vector<SimpleScoredSamplingPlanner::CriticStats>& stats_;
+  };
+
+  // the cost of a trajectory of a batch left unscored at the deadline, below any a critic gives
+  const double UNSCORED = -std::numeric_limits<double>::infinity();
+
+  }
+
   SimpleScoredSamplingPlanner::SimpleScoredSamplingPlanner(std::vector<TrajectorySampleGenerator*> gen_list, std::vector<TrajectoryCostFunction*>& critics, int max_samples) {
     max_samples_ = max_samples;
+    threads_ = 1;
+    adaptive_critic_order_ = false;
+    measure_critics_ = false;
+    last_trajectories_ = 0;
+    last_generation_time_ = 0;
+    cut_short_ = false;
     gen_list_ = gen_list;
     critics_ = critics;
+    for (unsigned int i = 0; i < critics_.size(); ++i) {
+      order_.push_back(i);
+    }
   }
 
   double SimpleScoredSamplingPlanner::scoreTrajectory(Trajectory& traj, double best_traj_cost) {
+    return scoreTrajectory(traj, best_traj_cost, NULL);
+  }
+
+  double SimpleScoredSamplingPlanner::scoreTrajectory(Trajectory& traj, double best_traj_cost, std::vector<CriticStats>* stats,
+                                                       int* rejected_by) {
     double traj_cost = 0;
-    int gen_id = 0;
-    for(std::vector<TrajectoryCostFunction*>::iterator score_function = critics_.begin(); score_function != critics_.end(); ++score_function) {
-      TrajectoryCostFunction* score_function_p = *score_function;
+    if (rejected_by != NULL) {
+      *rejected_by = -1;
+    }
+    for (unsigned int k = 0; k < order_.size(); ++k) {
+      int gen_id = order_[k];
+      TrajectoryCostFunction* score_function_p = critics_[gen_id];
       if (score_function_p->getScale() == 0) {
         continue;
       }
+      ros::WallTime start;
+      if (stats != NULL) {
+        start = ros::WallTime::now();
+      }
       double cost = score_function_p->scoreTrajectory(traj);
+      if (stats != NULL) {
+        CriticStats& critic_stats = (*stats)[gen_id];
+        critic_stats.seconds += (ros::WallTime::now() - start).toSec();
+        critic_stats.calls += 1;
+        critic_stats.rejections += cost < 0 ? 1 : 0;
+      }
       if (cost < 0) {
         ROS_DEBUG("Velocity %.3lf, %.3lf, %.3lf discarded by cost function  %d with cost: %f", traj.xv_, traj.yv_, traj.thetav_, gen_id, cost);
         traj_cost = cost;
+        if (rejected_by != NULL) {
+          *rejected_by = gen_id;
+        }
         break;
       }
       if (cost != 0) {
@@ -72,7 +127,6 @@ namespace base_local_planner {
           break;
         }
       }
-      gen_id ++;
     }
 
 
@@ -80,67 +134,241 @@ namespace base_local_planner {
   }
 
   bool SimpleScoredSamplingPlanner::findBestTrajectory(Trajectory& traj, std::vector<Trajectory>* all_explored) {
-    Trajectory loop_traj;
-    Trajectory best_traj;
+    // the trajectories are generated into storage kept between calls, and the best is
+    // kept by pointer, so that no points are copied until the result
+    Trajectory* loop_traj = &scratch_[0];
+    const Trajectory* best_traj = NULL;
     double loop_traj_cost, best_traj_cost = -1;
     bool gen_success;
     int count, count_valid;
+    bool parallel = threads_ > 1;
+    last_trajectories_ = 0;
+    last_generation_time_ = 0;
+    cut_short_ = false;
+    last_stats_.clear();
     for (std::vector<TrajectoryCostFunction*>::iterator loop_critic = critics_.begin(); loop_critic != critics_.end(); ++loop_critic) {
       TrajectoryCostFunction* loop_critic_p = *loop_critic;
       if (loop_critic_p->prepare() == false) {
         ROS_WARN("A scoring function failed to prepare");
         return false;
       }
+      if (loop_critic_p->getScale() != 0 && !loop_critic_p->isThreadSafe()) {
+        parallel = false;
+      }
+    }
+    if (threads_ > 1 && !parallel) {
+      ROS_WARN_ONCE("A scoring function is not thread safe, trajectories are scored on one thread");
+    }
+
+    std::vector<CriticStats>* stats = NULL;
+    if (adaptive_critic_order_ || measure_critics_) {
+      stats_.resize(critics_.size());
+      for (unsigned int i = 0; i < stats_.size(); ++i) {
+        stats_[i].seconds *= 0.5;
+        stats_[i].calls *= 0.5;
+        stats_[i].rejections *= 0.5;
+      }
+      if (adaptive_critic_order_) {
+        std::stable_sort(order_.begin(), order_.end(), CheaperRejection(stats_));
+      }
+      last_stats_.assign(critics_.size(), CriticStats());
+      stats = &last_stats_;
+      thread_stats_.resize(threads_);
     }
+    ros::WallTime start;
 
     for (std::vector<TrajectorySampleGenerator*>::iterator loop_gen = gen_list_.begin(); loop_gen != gen_list_.end(); ++loop_gen) {
       count = 0;
       count_valid = 0;
       TrajectorySampleGenerator* gen_ = *loop_gen;
-      while (gen_->hasMoreTrajectories()) {
-        gen_success = gen_->nextTrajectory(loop_traj);
+      if (parallel) {
+        // generate a batch, as many trajectories as would have been scored in turn, and score
+        // it; generators that sample by cost end a batch until they have been told its costs
+        int best_index = -1;
+        while (!cut_short_ && gen_->hasMoreTrajectories() && !(max_samples_ > 0 && count >= max_samples_)) {
+          int first = count;
+          if (stats != NULL) {
+            start = ros::WallTime::now();
+          }
+          while (gen_->hasMoreTrajectories()) {
+            if (count == (int)batch_.size()) {
+              batch_.resize(count + 1);
+            }
+            if (gen_->nextTrajectory(batch_[count]) == false) {
+              continue;
+            }
+            count++;
+            if (max_samples_ > 0 && count >= max_samples_) {
+              break;
+            }
+          }
+          if (stats != NULL) {
+            last_generation_time_ += (ros::WallTime::now() - start).toSec();
+          }
+
+          batch_costs_.assign(count, UNSCORED);
+          boost::atomic<int> next(first);
+          boost::atomic<double> shared_best_cost(best_traj_cost);
+          boost::atomic<bool> expired(false);
+          int tasks = std::max(1, std::min(threads_, count - first));
+          for (int i = 1; stats != NULL && i < tasks; ++i) {
+            thread_stats_[i].assign(critics_.size(), CriticStats());
+          }
+          nav_executor::Executor::shared().run(nav_executor::LANE_CONTROL, tasks,
+              boost::bind(&SimpleScoredSamplingPlanner::scoreBatch, this, _1, count, &next, &shared_best_cost, &expired, stats));
+          if (stats != NULL) {
+            for (int i = 1; i < tasks; ++i) {
+              for (unsigned int j = 0; j < critics_.size(); ++j) {
+                last_stats_[j].seconds += thread_stats_[i][j].seconds;
+                last_stats_[j].calls += thread_stats_[i][j].calls;
+                last_stats_[j].rejections += thread_stats_[i][j].rejections;
+              }
+            }
+          }
+
+          // pick the best in generation order, so that ties go the same way as in turn
+          for (int i = first; i < count; ++i) {
+            if (batch_costs_[i] == UNSCORED) {
+              continue;
+            }
+            gen_->setTrajectoryCost(batch_[i], batch_costs_[i]);
+            if (all_explored != NULL) {
+              batch_[i].cost_ = batch_costs_[i];
+              all_explored->push_back(batch_[i]);
+            }
+            if (batch_costs_[i] >= 0) {
+              count_valid++;
+              if (best_traj_cost < 0 || batch_costs_[i] < best_traj_cost) {
+                best_traj_cost = batch_costs_[i];
+                best_index = i;
+              }
+            }
+          }
+          cut_short_ = expired.load();
+        }
+        // by index, as later batches may have moved the storage
+        if (best_index >= 0) {
+          best_traj = &batch_[best_index];
+        }
+      }
+      while (!parallel && gen_->hasMoreTrajectories()) {
+        if (stats != NULL) {
+          start = ros::WallTime::now();
+        }
+        gen_success = gen_->nextTrajectory(*loop_traj);
+        if (stats != NULL) {
+          last_generation_time_ += (ros::WallTime::now() - start).toSec();
+        }
         if (gen_success == false) {
           // TODO use this for debugging
           continue;
         }
-        loop_traj_cost = scoreTrajectory(loop_traj, best_traj_cost);
+        loop_traj_cost = scoreTrajectory(*loop_traj, best_traj_cost, stats);
+        gen_->setTrajectoryCost(*loop_traj, loop_traj_cost);
         if (all_explored != NULL) {
-          loop_traj.cost_ = loop_traj_cost;
-          all_explored->push_back(loop_traj);
+          loop_traj->cost_ = loop_traj_cost;
+          all_explored->push_back(*loop_traj);
         }
 
         if (loop_traj_cost >= 0) {
           count_valid++;
           if (best_traj_cost < 0 || loop_traj_cost < best_traj_cost) {
             best_traj_cost = loop_traj_cost;
+            // the next trajectory goes into the other storage
             best_traj = loop_traj;
+            loop_traj = &scratch_[loop_traj == &scratch_[0] ? 1 : 0];
           }
         }
         count++;
+        if (best_traj_cost >= 0 && !deadline_.isZero() && ros::WallTime::now() > deadline_) {
+          cut_short_ = true;
+          break;
+        }
         if (max_samples_ > 0 && count >= max_samples_) {
           break;
         }        
       }
       if (best_traj_cost >= 0) {
-        traj.xv_ = best_traj.xv_;
-        traj.yv_ = best_traj.yv_;
-        traj.thetav_ = best_traj.thetav_;
+        traj.xv_ = best_traj->xv_;
+        traj.yv_ = best_traj->yv_;
+        traj.thetav_ = best_traj->thetav_;
         traj.cost_ = best_traj_cost;
         traj.resetPoints();
         double px, py, pth;
-        for (unsigned int i = 0; i < best_traj.getPointsSize(); i++) {
-          best_traj.getPoint(i, px, py, pth);
+        for (unsigned int i = 0; i < best_traj->getPointsSize(); i++) {
+          best_traj->getPoint(i, px, py, pth);
           traj.addPoint(px, py, pth);
         }
       }
-      ROS_DEBUG("Evaluated %d trajectories, found %d valid", count, count_valid);
+      ROS_DEBUG("Evaluated %d trajectories, found %d valid%s", count, count_valid, cut_short_ ? ", stopped at the deadline" : "");
+      last_trajectories_ += count;
       if (best_traj_cost >= 0) {
         // do not try fallback generators
         break;
       }
     }
+    for (unsigned int i = 0; stats != NULL && i < stats_.size(); ++i) {
+      stats_[i].seconds += last_stats_[i].seconds;
+      stats_[i].calls += last_stats_[i].calls;
+      stats_[i].rejections += last_stats_[i].rejections;
+    }
+    for (unsigned int k = 0; stats != NULL && k < order_.size(); ++k) {
+      const CriticStats& critic_stats = stats_[order_[k]];
+      ROS_DEBUG("Cost function %d: %.1f us per trajectory, rejects %.0f%%", order_[k],
+                critic_stats.calls > 0 ? 1e6 * critic_stats.seconds / critic_stats.calls : 0.0,
+                critic_stats.calls > 0 ? 100 * critic_stats.rejections / critic_stats.calls : 0.0);
+    }
     return best_traj_cost >= 0;
   }
 
-  
+  void SimpleScoredSamplingPlanner::scoreBatch(unsigned int task, int count, boost::atomic<int>* next,
+                                               boost::atomic<double>* best_traj_cost, boost::atomic<bool>* expired,
+                                               std::vector<CriticStats>* stats) {
+    if (stats != NULL && task > 0) {
+      stats = &thread_stats_[task];
+    }
+    for (int i = (*next)++; i < count; i = (*next)++) {
+      if (!deadline_.isZero() && best_traj_cost->load() >= 0 && (expired->load() || ros::WallTime::now() > deadline_)) {
+        expired->store(true);
+        break;
+      }
+      double cost = scoreTrajectory(batch_[i], best_traj_cost->load(), stats);
+      batch_costs_[i] = cost;
+      if (cost < 0) {
+        continue;
+      }
+      // lower the shared best, unless another thread lowered it further meanwhile
+      double best = best_traj_cost->load();
+      while ((best < 0 || cost < best) && !best_traj_cost->compare_exchange_weak(best, cost)) {
+      }
+    }
+  }
+
+  void SimpleScoredSamplingPlanner::scoreTrajectories(std::vector<Trajectory>& trajs, std::vector<double>& costs,
+                                                      std::vector<int>* rejected_by) {
+    bool parallel = threads_ > 1;
+    for (unsigned int i = 0; i < critics_.size(); ++i) {
+      if (critics_[i]->getScale() != 0 && !critics_[i]->isThreadSafe()) {
+        parallel = false;
+      }
+    }
+    costs.resize(trajs.size());
+    if (rejected_by != NULL) {
+      rejected_by->resize(trajs.size());
+    }
+
+    boost::atomic<int> next(0);
+    int tasks = parallel ? std::max(1, std::min(threads_, (int)trajs.size())) : 1;
+    nav_executor::Executor::shared().run(nav_executor::LANE_CONTROL, tasks,
+        boost::bind(&SimpleScoredSamplingPlanner::scoreList, this, &trajs, &next, &costs, rejected_by));
+  }
+
+  void SimpleScoredSamplingPlanner::scoreList(std::vector<Trajectory>* trajs, boost::atomic<int>* next, std::vector<double>* costs,
+                                              std::vector<int>* rejected_by) {
+    for (int i = (*next)++; i < (int)trajs->size(); i = (*next)++) {
+      (*costs)[i] = scoreTrajectory((*trajs)[i], -1, NULL, rejected_by != NULL ? &(*rejected_by)[i] : NULL);
+      (*trajs)[i].cost_ = (*costs)[i];
+    }
+  }
+
 }// namespace
@@ -37,7 +37,9 @@
 
 #include <base_local_planner/simple_trajectory_generator.h>
 
+#include <algorithm>
 #include <cmath>
+#include <utility>
 
 #include <base_local_planner/velocity_iterator.h>
 
@@ -67,71 +69,148 @@ void SimpleTrajectoryGenerator::initialise(
   /*
    * We actually generate all velocity sample vectors here, from which to generate trajectories later on
    */
-  double max_vel_th = limits->max_rot_vel;
-  double min_vel_th = -1.0 * max_vel_th;
   discretize_by_time_ = discretize_by_time;
-  Eigen::Vector3f acc_lim = limits->getAccLimits();
   pos_ = pos;
   vel_ = vel;
   limits_ = limits;
   next_sample_index_ = 0;
   sample_params_.clear();
 
-  double min_vel_x = limits->min_vel_x;
-  double max_vel_x = limits->max_vel_x;
-  double min_vel_y = limits->min_vel_y;
-  double max_vel_y = limits->max_vel_y;
+  if (cycle_best_cost_ >= 0) {
+    last_best_ = cycle_best_;
+    have_last_best_ = true;
+  }
+  cycle_best_cost_ = -1.0;
 
   // if sampling number is zero in any dimension, we don't generate samples generically
   if (vsamples[0] * vsamples[1] * vsamples[2] > 0) {
     //compute the feasible velocity space based on the rate at which we run
     Eigen::Vector3f max_vel = Eigen::Vector3f::Zero();
     Eigen::Vector3f min_vel = Eigen::Vector3f::Zero();
+    computeVelocityWindow(goal, min_vel, max_vel);
 
-    if ( ! use_dwa_) {
-      // there is no point in overshooting the goal, and it also may break the
-      // robot behavior, so we limit the velocities to those that do not overshoot in sim_time
-      double dist = hypot(goal[0] - pos[0], goal[1] - pos[1]);
-      max_vel_x = std::max(std::min(max_vel_x, dist / sim_time_), min_vel_x);
-      max_vel_y = std::max(std::min(max_vel_y, dist / sim_time_), min_vel_y);
-
-	  // 通过轨迹模拟最大和最小速度
-      // if we use continous acceleration, we can sample the max velocity we can reach in sim_time_
-      max_vel[0] = std::min(max_vel_x, vel[0] + acc_lim[0] * sim_time_);
-      max_vel[1] = std::min(max_vel_y, vel[1] + acc_lim[1] * sim_time_);
-      max_vel[2] = std::min(max_vel_th, vel[2] + acc_lim[2] * sim_time_);
-
-      min_vel[0] = std::max(min_vel_x, vel[0] - acc_lim[0] * sim_time_);
-      min_vel[1] = std::max(min_vel_y, vel[1] - acc_lim[1] * sim_time_);
-      min_vel[2] = std::max(min_vel_th, vel[2] - acc_lim[2] * sim_time_);
+    if (library_.getResolution() > 0 && !continued_acceleration_) {
+      // velocities on the lattice, whose rollouts the library keeps
+      std::vector<float> xs, ys, ths;
+      library_.latticeValues(min_vel[0], max_vel[0], vsamples[0], xs);
+      library_.latticeValues(min_vel[1], max_vel[1], vsamples[1], ys);
+      library_.latticeValues(min_vel[2], max_vel[2], vsamples[2], ths);
+      for (unsigned int i = 0; i < xs.size(); ++i) {
+        for (unsigned int j = 0; j < ys.size(); ++j) {
+          for (unsigned int k = 0; k < ths.size(); ++k) {
+            sample_params_.push_back(Eigen::Vector3f(xs[i], ys[j], ths[k]));
+          }
+        }
+      }
     } else {
-      // with dwa do not accelerate beyond the first step, we only sample within velocities we reach in sim_period
-      max_vel[0] = std::min(max_vel_x, vel[0] + acc_lim[0] * sim_period_);
-      max_vel[1] = std::min(max_vel_y, vel[1] + acc_lim[1] * sim_period_);
-      max_vel[2] = std::min(max_vel_th, vel[2] + acc_lim[2] * sim_period_);
-
-      min_vel[0] = std::max(min_vel_x, vel[0] - acc_lim[0] * sim_period_);
-      min_vel[1] = std::max(min_vel_y, vel[1] - acc_lim[1] * sim_period_);
-      min_vel[2] = std::max(min_vel_th, vel[2] - acc_lim[2] * sim_period_);
+      Eigen::Vector3f vel_samp = Eigen::Vector3f::Zero();
+      VelocityIterator x_it(min_vel[0], max_vel[0], vsamples[0]);
+      VelocityIterator y_it(min_vel[1], max_vel[1], vsamples[1]);
+      VelocityIterator th_it(min_vel[2], max_vel[2], vsamples[2]);
+      for(; !x_it.isFinished(); x_it++) {
+        vel_samp[0] = x_it.getVelocity();
+        for(; !y_it.isFinished(); y_it++) {
+          vel_samp[1] = y_it.getVelocity();
+          for(; !th_it.isFinished(); th_it++) {
+            vel_samp[2] = th_it.getVelocity();
+            //ROS_DEBUG("Sample %f, %f, %f", vel_samp[0], vel_samp[1], vel_samp[2]);
+            sample_params_.push_back(vel_samp);
+          }
+          th_it.reset();
+        }
+        y_it.reset();
+      }
     }
 
-    Eigen::Vector3f vel_samp = Eigen::Vector3f::Zero();
-    VelocityIterator x_it(min_vel[0], max_vel[0], vsamples[0]);
-    VelocityIterator y_it(min_vel[1], max_vel[1], vsamples[1]);
-    VelocityIterator th_it(min_vel[2], max_vel[2], vsamples[2]);
-    for(; !x_it.isFinished(); x_it++) {
-      vel_samp[0] = x_it.getVelocity();
-      for(; !y_it.isFinished(); y_it++) {
-        vel_samp[1] = y_it.getVelocity();
-        for(; !th_it.isFinished(); th_it++) {
-          vel_samp[2] = th_it.getVelocity();
-          //ROS_DEBUG("Sample %f, %f, %f", vel_samp[0], vel_samp[1], vel_samp[2]);
-          sample_params_.push_back(vel_samp);
-        }
-        th_it.reset();
+    if (warm_start_ && have_last_best_) {
+      warmStartSamples(min_vel, max_vel, vsamples);
+    }
+  }
+}
+
+void SimpleTrajectoryGenerator::warmStartSamples(
+    const Eigen::Vector3f& min_vel,
+    const Eigen::Vector3f& max_vel,
+    const Eigen::Vector3f& vsamples) {
+  // distance from the last best in grid steps, along the dimension it is furthest in
+  std::vector<std::pair<float, unsigned int> > near;
+  for (unsigned int i = 0; i < sample_params_.size(); ++i) {
+    float steps = 0;
+    for (int d = 0; d < 3; ++d) {
+      float step = vsamples[d] > 1 ? (max_vel[d] - min_vel[d]) / (vsamples[d] - 1) : 0;
+      if (step > 0) {
+        steps = std::max(steps, std::fabs(sample_params_[i][d] - last_best_[d]) / step);
       }
-      y_it.reset();
     }
+    if (steps <= 1.001) {
+      near.push_back(std::make_pair(steps, i));
+    }
+  }
+  if (near.empty()) {
+    return;
+  }
+  std::stable_sort(near.begin(), near.end());
+
+  std::vector<Eigen::Vector3f> samples;
+  samples.reserve(sample_params_.size());
+  std::vector<bool> moved(sample_params_.size(), false);
+  for (unsigned int i = 0; i < near.size(); ++i) {
+    samples.push_back(sample_params_[near[i].second]);
+    moved[near[i].second] = true;
+  }
+  for (unsigned int i = 0; i < sample_params_.size(); ++i) {
+    if (!moved[i]) {
+      samples.push_back(sample_params_[i]);
+    }
+  }
+  sample_params_.swap(samples);
+}
+
+void SimpleTrajectoryGenerator::setTrajectoryCost(const Trajectory &traj, double cost) {
+  if (cost >= 0 && (cycle_best_cost_ < 0 || cost < cycle_best_cost_)) {
+    cycle_best_ = Eigen::Vector3f(traj.xv_, traj.yv_, traj.thetav_);
+    cycle_best_cost_ = cost;
+  }
+}
+
+void SimpleTrajectoryGenerator::computeVelocityWindow(
+    const Eigen::Vector3f& goal,
+    Eigen::Vector3f& min_vel,
+    Eigen::Vector3f& max_vel) {
+  double max_vel_th = limits_->max_rot_vel;
+  double min_vel_th = -1.0 * max_vel_th;
+  Eigen::Vector3f acc_lim = limits_->getAccLimits();
+
+  double min_vel_x = limits_->min_vel_x;
+  double max_vel_x = limits_->max_vel_x;
+  double min_vel_y = limits_->min_vel_y;
+  double max_vel_y = limits_->max_vel_y;
+
+  if ( ! use_dwa_) {
+    // there is no point in overshooting the goal, and it also may break the
+    // robot behavior, so we limit the velocities to those that do not overshoot in sim_time
+    double dist = hypot(goal[0] - pos_[0], goal[1] - pos_[1]);
+    max_vel_x = std::max(std::min(max_vel_x, dist / sim_time_), min_vel_x);
+    max_vel_y = std::max(std::min(max_vel_y, dist / sim_time_), min_vel_y);
+
+    // 通过轨迹模拟最大和最小速度
+    // if we use continous acceleration, we can sample the max velocity we can reach in sim_time_
+    max_vel[0] = std::min(max_vel_x, vel_[0] + acc_lim[0] * sim_time_);
+    max_vel[1] = std::min(max_vel_y, vel_[1] + acc_lim[1] * sim_time_);
+    max_vel[2] = std::min(max_vel_th, vel_[2] + acc_lim[2] * sim_time_);
+
+    min_vel[0] = std::max(min_vel_x, vel_[0] - acc_lim[0] * sim_time_);
+    min_vel[1] = std::max(min_vel_y, vel_[1] - acc_lim[1] * sim_time_);
+    min_vel[2] = std::max(min_vel_th, vel_[2] - acc_lim[2] * sim_time_);
+  } else {
+    // with dwa do not accelerate beyond the first step, we only sample within velocities we reach in sim_period
+    max_vel[0] = std::min(max_vel_x, vel_[0] + acc_lim[0] * sim_period_);
+    max_vel[1] = std::min(max_vel_y, vel_[1] + acc_lim[1] * sim_period_);
+    max_vel[2] = std::min(max_vel_th, vel_[2] + acc_lim[2] * sim_period_);
+
+    min_vel[0] = std::max(min_vel_x, vel_[0] - acc_lim[0] * sim_period_);
+    min_vel[1] = std::max(min_vel_y, vel_[1] - acc_lim[1] * sim_period_);
+    min_vel[2] = std::max(min_vel_th, vel_[2] - acc_lim[2] * sim_period_);
   }
 }
 
@@ -147,6 +226,7 @@ void SimpleTrajectoryGenerator::setParameters(
   use_dwa_ = use_dwa;
   continued_acceleration_ = ! use_dwa_;
   sim_period_ = sim_period;
+  library_.clear();
 }
 
 /**
@@ -231,6 +311,18 @@ bool SimpleTrajectoryGenerator::generateTrajectory(
     traj.thetav_ = sample_target_vel[2];
   }
 
+  if (!continued_acceleration_) {
+    // the velocity never changes, so the poses follow directly from the start, or
+    // from the rollout the library keeps of a lattice velocity
+    const TrajectoryLibrary::Primitive* prim = library_.get(loop_vel, dt, num_steps);
+    if (prim != NULL) {
+      library_.place(*prim, pos, traj);
+    } else {
+      computeArcPositions(pos, loop_vel, dt, num_steps, traj);
+    }
+    return num_steps > 0;
+  }
+
   //simulate the trajectory and check for collisions, updating costs along the way
   for (int i = 0; i < num_steps; ++i) {
 
@@ -262,6 +354,24 @@ Eigen::Vector3f SimpleTrajectoryGenerator::computeNewPositions(const Eigen::Vect
   return new_pos;
 }
 
+void SimpleTrajectoryGenerator::computeArcPositions(const Eigen::Vector3f& pos,
+    const Eigen::Vector3f& vel, double dt, int num_steps, Trajectory& traj) {
+  // each step moves along the heading at its start, and the headings are
+  // evenly spaced, so cos and sin of the next one are a rotation of the last
+  double dth = vel[2] * dt;
+  double step_cos = cos(dth), step_sin = sin(dth);
+  double c = cos(pos[2]), s = sin(pos[2]);
+  double x = pos[0], y = pos[1];
+  for (int i = 0; i < num_steps; ++i) {
+    traj.addPoint(x, y, pos[2] + i * dth);
+    x += (vel[0] * c - vel[1] * s) * dt;
+    y += (vel[0] * s + vel[1] * c) * dt;
+    double next_c = c * step_cos - s * step_sin;
+    s = s * step_cos + c * step_sin;
+    c = next_c;
+  }
+}
+
 /**
  * cheange vel using acceleration limits to converge towards sample_target-vel
  * 采样新的速度
@@ -0,0 +1,158 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <base_local_planner/trajectory_library.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <base_local_planner/velocity_iterator.h>
+
+namespace base_local_planner {
+
+namespace {
+
+// lattice indices of each velocity take 21 bits of the key
+const int64_t INDEX_BIAS = 1 << 20;
+
+}
+
+void TrajectoryLibrary::setResolution(double resolution) {
+  resolution_ = std::max(resolution, 0.0);
+  clear();
+}
+
+void TrajectoryLibrary::clear() {
+  arena_.clear();
+  index_.clear();
+}
+
+void TrajectoryLibrary::latticeValues(double min, double max, int samples, std::vector<float>& values) const {
+  values.clear();
+  long lo = 1, hi = 0;
+  if (resolution_ > 0) {
+    lo = (long)ceil(min / resolution_ - 1e-6);
+    hi = (long)floor(max / resolution_ + 1e-6);
+  }
+  if (lo > hi) {
+    for (VelocityIterator it(min, max, samples); !it.isFinished(); it++) {
+      values.push_back(it.getVelocity());
+    }
+    return;
+  }
+
+  std::vector<long> indices;
+  if (hi - lo + 1 <= std::max(samples, 1)) {
+    for (long i = lo; i <= hi; ++i) {
+      indices.push_back(i);
+    }
+  } else {
+    samples = std::max(2, samples);
+    for (int k = 0; k < samples; ++k) {
+      indices.push_back(lo + (long)floor((hi - lo) * (double)k / (samples - 1) + 0.5));
+    }
+    if (lo < 0 && hi > 0) {
+      indices.push_back(0);
+    }
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+  }
+  for (unsigned int i = 0; i < indices.size(); ++i) {
+    values.push_back(indices[i] * resolution_);
+  }
+}
+
+bool TrajectoryLibrary::latticeKey(const Eigen::Vector3f& vel, int64_t& key) const {
+  if (resolution_ <= 0) {
+    return false;
+  }
+  key = 0;
+  for (int d = 0; d < 3; ++d) {
+    double index = floor(vel[d] / resolution_ + 0.5);
+    if (fabs(vel[d] - (float)(index * resolution_)) > 1e-6 || fabs(index) >= INDEX_BIAS) {
+      return false;
+    }
+    key = (key << 21) | ((int64_t)index + INDEX_BIAS);
+  }
+  return true;
+}
+
+const TrajectoryLibrary::Primitive* TrajectoryLibrary::get(const Eigen::Vector3f& vel, double dt, int num_steps) {
+  int64_t key;
+  if (!latticeKey(vel, key)) {
+    return NULL;
+  }
+  Primitive& prim = index_[key];
+  if (prim.num_steps == num_steps && prim.dt == dt && num_steps > 0) {
+    return &prim;
+  }
+
+  // the same poses as SimpleTrajectoryGenerator::computeArcPositions from the origin
+  prim.offset = arena_.size();
+  prim.num_steps = num_steps;
+  prim.dt = dt;
+  if (num_steps <= 0) {
+    return &prim;
+  }
+  arena_.resize(arena_.size() + 3 * num_steps);
+  float* pose = &arena_[0] + prim.offset;
+  double dth = vel[2] * dt;
+  double step_cos = cos(dth), step_sin = sin(dth);
+  double c = 1.0, s = 0.0, x = 0.0, y = 0.0;
+  for (int i = 0; i < num_steps; ++i) {
+    pose[3 * i] = x;
+    pose[3 * i + 1] = y;
+    pose[3 * i + 2] = i * dth;
+    x += (vel[0] * c - vel[1] * s) * dt;
+    y += (vel[0] * s + vel[1] * c) * dt;
+    double next_c = c * step_cos - s * step_sin;
+    s = s * step_cos + c * step_sin;
+    c = next_c;
+  }
+  return &prim;
+}
+
+void TrajectoryLibrary::place(const Primitive& prim, const Eigen::Vector3f& pos, Trajectory& traj) const {
+  if (prim.num_steps <= 0) {
+    return;
+  }
+  double c = cos(pos[2]), s = sin(pos[2]);
+  const float* pose = &arena_[0] + prim.offset;
+  for (int i = 0; i < prim.num_steps; ++i, pose += 3) {
+    traj.addPoint(pos[0] + c * pose[0] - s * pose[1], pos[1] + s * pose[0] + c * pose[1], pos[2] + pose[2]);
+  }
+}
+
+} /* namespace base_local_planner */
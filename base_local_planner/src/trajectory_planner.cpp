@@ -158,6 +158,7 @@ namespace base_local_planner{
       goal_map_(costmap.getSizeInCellsX(), costmap.getSizeInCellsY()),
       costmap_(costmap),
     world_model_(world_model), footprint_spec_(footprint_spec),
+    obstacle_costs_(const_cast<costmap_2d::Costmap2D*>(&costmap)), footprint_headings_(0),
     sim_time_(sim_time), sim_granularity_(sim_granularity), angular_sim_granularity_(angular_sim_granularity),
     vx_samples_(vx_samples), vtheta_samples_(vtheta_samples),
     pdist_scale_(pdist_scale), gdist_scale_(gdist_scale), occdist_scale_(occdist_scale),
@@ -183,9 +184,14 @@ namespace base_local_planner{
 
     escaping_ = false;
     final_goal_position_valid_ = false;
+    cut_short_ = false;
+    have_warm_start_ = false;
+    warm_vx_ = 0.0;
+    warm_vtheta_ = 0.0;
 
 
     costmap_2d::calculateMinAndMaxDistances(footprint_spec_, inscribed_radius_, circumscribed_radius_);
+    obstacle_costs_.setFootprint(footprint_spec_);
   }
 
   TrajectoryPlanner::~TrajectoryPlanner(){}
@@ -232,6 +238,11 @@ namespace base_local_planner{
     vy_i = vy;
     vtheta_i = vtheta;
 
+    //rasterize the outlines again if the footprint or the costmap changed
+    if (footprint_headings_ > 0) {
+      obstacle_costs_.prepare();
+    }
+
     //compute the magnitude of the velocities
     double vmag = hypot(vx_samp, vy_samp);
 
@@ -580,11 +591,24 @@ namespace base_local_planner{
 
     //any cell with a cost greater than the size of the map is impossible
     double impossible_cost = path_map_.obstacleCosts();
+    cut_short_ = false;
 
     //if we're performing an escape we won't allow moving forward
     if (!escaping_) {
+      //with a deadline, the last cycle's velocity goes first, so that stopping early likely keeps a good one
+      if (!deadline_.isZero() && have_warm_start_ && warm_vx_ >= min_vel_x && warm_vx_ <= max_vel_x
+          && warm_vtheta_ >= min_vel_theta && warm_vtheta_ <= max_vel_theta) {
+        generateTrajectory(x, y, theta, vx, vy, vtheta, warm_vx_, vy_samp, warm_vtheta_,
+            acc_x, acc_y, acc_theta, impossible_cost, *comp_traj);
+        if(comp_traj->cost_ >= 0){
+          swap = best_traj;
+          best_traj = comp_traj;
+          comp_traj = swap;
+        }
+      }
+
       //loop through all x velocities
-      for(int i = 0; i < vx_samples_; ++i) {
+      for(int i = 0; i < vx_samples_ && !pastDeadline(*best_traj); ++i) {
         vtheta_samp = 0;
         //first sample the straight trajectory
         generateTrajectory(x, y, theta, vx, vy, vtheta, vx_samp, vy_samp, vtheta_samp,
@@ -599,7 +623,7 @@ namespace base_local_planner{
 
         vtheta_samp = min_vel_theta;
         //next sample all theta trajectories
-        for(int j = 0; j < vtheta_samples_ - 1; ++j){
+        for(int j = 0; j < vtheta_samples_ - 1 && !pastDeadline(*best_traj); ++j){
           generateTrajectory(x, y, theta, vx, vy, vtheta, vx_samp, vy_samp, vtheta_samp,
               acc_x, acc_y, acc_theta, impossible_cost, *comp_traj);
 
@@ -615,7 +639,7 @@ namespace base_local_planner{
       }
 
       //only explore y velocities with holonomic robots
-      if (holonomic_robot_) {
+      if (holonomic_robot_ && !pastDeadline(*best_traj)) {
         //explore trajectories that move forward but also strafe slightly
         vx_samp = 0.1;
         vy_samp = 0.1;
@@ -653,7 +677,7 @@ namespace base_local_planner{
     //let's try to rotate toward open space
     double heading_dist = DBL_MAX;
 
-    for(int i = 0; i < vtheta_samples_; ++i) {
+    for(int i = 0; i < vtheta_samples_ && !pastDeadline(*best_traj); ++i) {
       //enforce a minimum rotational velocity because the base can't handle small in-place rotations
       double vtheta_samp_limited = vtheta_samp > 0 ? max(vtheta_samp, min_in_place_vel_th_)
         : min(vtheta_samp, -1.0 * min_in_place_vel_th_);
@@ -937,7 +961,12 @@ namespace base_local_planner{
     Trajectory best = createTrajectories(pos[0], pos[1], pos[2],
         vel[0], vel[1], vel[2],
         acc_lim_x_, acc_lim_y_, acc_lim_theta_);
-    ROS_DEBUG("Trajectories created");
+    ROS_DEBUG("Trajectories created%s", cut_short_ ? ", stopped at the deadline" : "");
+
+    //remember a forward trajectory to sample first next time
+    have_warm_start_ = best.cost_ >= 0 && best.xv_ > 0 && best.yv_ == 0;
+    warm_vx_ = best.xv_;
+    warm_vtheta_ = best.thetav_;
 
     /*
     //If we want to print a ppm file to draw goal dist
@@ -978,8 +1007,21 @@ namespace base_local_planner{
     return best;
   }
 
+  bool TrajectoryPlanner::pastDeadline(const Trajectory& best) {
+    if (best.cost_ < 0 || deadline_.isZero() || ros::WallTime::now() <= deadline_)
+      return false;
+    cut_short_ = true;
+    return true;
+  }
+
   //we need to take the footprint of the robot into account when we calculate cost to obstacles
   double TrajectoryPlanner::footprintCost(double x_i, double y_i, double theta_i){
+    //the outline of the nearest heading, its cost including that of the center cell as generateTrajectory adds
+    if (footprint_headings_ > 0) {
+      double cost = obstacle_costs_.pointCost(x_i, y_i, theta_i, 1.0);
+      return cost < 0 ? -1.0 : cost;
+    }
+
     //check if the footprint is legal
     return world_model_.footprintCost(x_i, y_i, theta_i, footprint_spec_, inscribed_radius_, circumscribed_radius_);
   }
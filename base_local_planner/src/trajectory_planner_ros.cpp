@@ -41,6 +41,7 @@
 #include <boost/tokenizer.hpp>
 
 #include <Eigen/Core>
+#include <algorithm>
 #include <cmath>
 
 #include <ros/console.h>
@@ -57,6 +58,19 @@ PLUGINLIB_EXPORT_CLASS(base_local_planner::TrajectoryPlannerROS, nav_core::BaseL
 
 namespace base_local_planner {
 
+  // stages of computeVelocityCommands timed for the cycle stats
+  enum {
+    STAGE_TRANSFORM_PLAN,
+    STAGE_UPDATE_PLAN,
+    STAGE_FIND_BEST_PATH,
+    STAGE_PUBLISH,
+    STAGE_COUNT
+  };
+
+  static const char* stage_names[STAGE_COUNT] = {
+    "transform global plan", "update plan", "find best path", "publish"
+  };
+
   void TrajectoryPlannerROS::reconfigureCB(BaseLocalPlannerConfig &config, uint32_t level) {
       if (setup_ && config.restore_defaults) {
         config = default_config_;
@@ -72,10 +86,10 @@ namespace base_local_planner {
   }
 
   TrajectoryPlannerROS::TrajectoryPlannerROS() :
-      world_model_(NULL), tc_(NULL), costmap_ros_(NULL), tf_(NULL), setup_(false), initialized_(false), odom_helper_("odom") {}
+      world_model_(NULL), tc_(NULL), cycle_stats_(NULL), costmap_ros_(NULL), tf_(NULL), plan_first_(0), setup_(false), initialized_(false), odom_helper_("odom") {}
 
   TrajectoryPlannerROS::TrajectoryPlannerROS(std::string name, tf::TransformListener* tf, costmap_2d::Costmap2DROS* costmap_ros) :
-      world_model_(NULL), tc_(NULL), costmap_ros_(NULL), tf_(NULL), setup_(false), initialized_(false), odom_helper_("odom") {
+      world_model_(NULL), tc_(NULL), cycle_stats_(NULL), costmap_ros_(NULL), tf_(NULL), plan_first_(0), setup_(false), initialized_(false), odom_helper_("odom") {
 
       //initialize the planner
       initialize(name, tf, costmap_ros);
@@ -233,7 +247,16 @@ namespace base_local_planner {
           max_vel_x, min_vel_x, max_vel_th_, min_vel_th_, min_in_place_vel_th_, backup_vel,
           dwa, heading_scoring, heading_scoring_timestep, meter_scoring, simple_attractor, y_vels, stop_time_buffer, sim_period_, angular_sim_granularity);
 
+      int footprint_headings;
+      private_nh.param("footprint_headings", footprint_headings, 0);
+      tc_->setFootprintHeadings(footprint_headings);
+
       map_viz_.initialize(name, global_frame_, boost::bind(&TrajectoryPlanner::getCellCosts, tc_, _1, _2, _3, _4, _5, _6));
+
+      int cycle_stats_window;
+      private_nh.param("cycle_stats_window", cycle_stats_window, 100);
+      cycle_stats_ = new CycleStatsPublisher(&private_nh, "cycle_stats",
+          std::vector<std::string>(stage_names, stage_names + STAGE_COUNT), std::max(cycle_stats_window, 1));
       initialized_ = true;
 
       dsrv_ = new dynamic_reconfigure::Server<BaseLocalPlannerConfig>(private_nh);
@@ -278,6 +301,8 @@ namespace base_local_planner {
 
     if(world_model_ != NULL)
       delete world_model_;
+
+    delete cycle_stats_;
   }
 
   bool TrajectoryPlannerROS::stopWithAccLimits(const tf::Stamped<tf::Pose>& global_pose, const tf::Stamped<tf::Pose>& robot_vel, geometry_msgs::Twist& cmd_vel)
@@ -355,14 +380,19 @@ namespace base_local_planner {
   }
 
   bool TrajectoryPlannerROS::setPlan(const std::vector<geometry_msgs::PoseStamped>& orig_global_plan){
+    return setSharedPlan(nav_core::PlanConstPtr(new std::vector<geometry_msgs::PoseStamped>(orig_global_plan)));
+  }
+
+  bool TrajectoryPlannerROS::setSharedPlan(const nav_core::PlanConstPtr& orig_global_plan){
     if (! isInitialized()) {
       ROS_ERROR("This planner has not been initialized, please call initialize() before using this planner");
       return false;
     }
 
     //reset the global plan
-    global_plan_.clear();
     global_plan_ = orig_global_plan;
+    plan_first_ = 0;
+    plan_cache_.reset();
     
     //when we get a new plan, we also want to clear any latch we may have on goal tolerances
     xy_tolerance_latch_ = false;
@@ -383,6 +413,7 @@ namespace base_local_planner {
       ROS_ERROR("This planner has not been initialized, please call initialize() before using this planner");
       return false;
     }
+    CycleStatsPublisher::CycleTimer cycle(cycle_stats_);
 
     std::vector<geometry_msgs::PoseStamped> local_plan;
     tf::Stamped<tf::Pose> global_pose;
@@ -391,16 +422,20 @@ namespace base_local_planner {
     }
 
     std::vector<geometry_msgs::PoseStamped> transformed_plan;
-    //get the global plan in our frame
-    if (!transformGlobalPlan(*tf_, global_plan_, global_pose, *costmap_, global_frame_, transformed_plan)) {
-      ROS_WARN("Could not transform the global plan to the frame of the controller");
-      return false;
-    }
+    {
+      CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_TRANSFORM_PLAN);
+      //get the global plan in our frame
+      if (!global_plan_ ||
+          !plan_cache_.transformGlobalPlan(*tf_, *global_plan_, plan_first_, global_pose, *costmap_, global_frame_, transformed_plan)) {
+        ROS_WARN("Could not transform the global plan to the frame of the controller");
+        return false;
+      }
 
-    //now we'll prune the plan based on the position of the robot
-	// 修剪
-    if(prune_plan_)
-      prunePlan(global_pose, transformed_plan, global_plan_);
+      //now we'll prune the plan based on the position of the robot
+      // 修剪
+      if(prune_plan_)
+        plan_cache_.prunePlan(global_pose, transformed_plan, plan_first_);
+    }
 
     tf::Stamped<tf::Pose> drive_cmds;
     drive_cmds.frame_id_ = robot_base_frame_;
@@ -450,9 +485,18 @@ namespace base_local_planner {
       } else {
         //we need to call the next two lines to make sure that the trajectory
         //planner updates its path distance and goal distance grids
-        tc_->updatePlan(transformed_plan);
-        Trajectory path = tc_->findBestPath(global_pose, robot_vel, drive_cmds);
-        map_viz_.publishCostCloud(costmap_);
+        {
+          CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_UPDATE_PLAN);
+          tc_->updatePlan(transformed_plan);
+        }
+        {
+          CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_FIND_BEST_PATH);
+          tc_->findBestPath(global_pose, robot_vel, drive_cmds);
+        }
+        {
+          CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_PUBLISH);
+          map_viz_.publishCostCloud(costmap_);
+        }
 
         //copy over the odometry information
         nav_msgs::Odometry base_odom;
@@ -476,6 +520,7 @@ namespace base_local_planner {
       }
 
       //publish an empty plan because we've reached our goal position
+      CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_PUBLISH);
       publishPlan(transformed_plan, g_plan_pub_);
       publishPlan(local_plan, l_plan_pub_);
 
@@ -483,12 +528,22 @@ namespace base_local_planner {
       return true;
     }
 
-    tc_->updatePlan(transformed_plan);
+    {
+      CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_UPDATE_PLAN);
+      tc_->updatePlan(transformed_plan);
+    }
 
     //compute what trajectory to drive along
-    Trajectory path = tc_->findBestPath(global_pose, robot_vel, drive_cmds);
+    Trajectory path;
+    {
+      CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_FIND_BEST_PATH);
+      path = tc_->findBestPath(global_pose, robot_vel, drive_cmds);
+    }
 
-    map_viz_.publishCostCloud(costmap_);
+    {
+      CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_PUBLISH);
+      map_viz_.publishCostCloud(costmap_);
+    }
     /* For timing uncomment
     gettimeofday(&end, NULL);
     start_t = start.tv_sec + double(start.tv_usec) / 1e6;
@@ -508,6 +563,7 @@ namespace base_local_planner {
       ROS_DEBUG_NAMED("trajectory_planner_ros",
           "The rollout planner failed to find a valid plan. This means that the footprint of the robot was in collision for all simulated trajectories.");
       local_plan.clear();
+      CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_PUBLISH);
       publishPlan(transformed_plan, g_plan_pub_);
       publishPlan(local_plan, l_plan_pub_);
       return false;
@@ -532,11 +588,25 @@ namespace base_local_planner {
     }
 
     //publish information to the visualizer
+    CycleStatsPublisher::StageTimer timer(cycle_stats_, STAGE_PUBLISH);
     publishPlan(transformed_plan, g_plan_pub_);
     publishPlan(local_plan, l_plan_pub_);
     return true;
   }
 
+  bool TrajectoryPlannerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_vel, const ros::WallTime& deadline, bool& degraded)
+  {
+    degraded = false;
+    if (! isInitialized()) {
+      return computeVelocityCommands(cmd_vel);
+    }
+    tc_->setDeadline(deadline);
+    bool ok = computeVelocityCommands(cmd_vel);
+    degraded = tc_->lastSearchCutShort();
+    tc_->setDeadline(ros::WallTime());
+    return ok;
+  }
+
   bool TrajectoryPlannerROS::checkTrajectory(double vx_samp, double vy_samp, double vtheta_samp, bool update_map){
     tf::Stamped<tf::Pose> global_pose;
     if(costmap_ros_->getRobotPose(global_pose)){
@@ -599,6 +669,43 @@ namespace base_local_planner {
     return -1.0;
   }
 
+  unsigned int TrajectoryPlannerROS::scoreTrajectories(const std::vector<geometry_msgs::Twist>& cmds, std::vector<double>& costs, bool update_map){
+    // scoreTrajectory for many commands, with the map updated once
+    costs.assign(cmds.size(), -1.0);
+    tf::Stamped<tf::Pose> global_pose;
+    if(!costmap_ros_->getRobotPose(global_pose)){
+      ROS_WARN("Failed to get the pose of the robot. No trajectories will pass as legal in this case.");
+      return 0;
+    }
+    if(update_map){
+      std::vector<geometry_msgs::PoseStamped> plan;
+      geometry_msgs::PoseStamped pose_msg;
+      tf::poseStampedTFToMsg(global_pose, pose_msg);
+      plan.push_back(pose_msg);
+      tc_->updatePlan(plan, true);
+    }
+
+    nav_msgs::Odometry base_odom;
+    {
+      boost::recursive_mutex::scoped_lock lock(odom_lock_);
+      base_odom = base_odom_;
+    }
+
+    // one at a time, as the world models are not safe to query from several threads
+    unsigned int legal = 0;
+    double yaw = tf::getYaw(global_pose.getRotation());
+    for(unsigned int i = 0; i < cmds.size(); ++i){
+      costs[i] = tc_->scoreTrajectory(global_pose.getOrigin().x(), global_pose.getOrigin().y(), yaw,
+          base_odom.twist.twist.linear.x,
+          base_odom.twist.twist.linear.y,
+          base_odom.twist.twist.angular.z, cmds[i].linear.x, cmds[i].linear.y, cmds[i].angular.z);
+      if(costs[i] >= 0){
+        legal++;
+      }
+    }
+    return legal;
+  }
+
   bool TrajectoryPlannerROS::isGoalReached() {
     if (! isInitialized()) {
       ROS_ERROR("This planner has not been initialized, please call initialize() before using this planner");
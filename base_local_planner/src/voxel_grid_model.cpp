@@ -35,6 +35,7 @@
 * Author: Eitan Marder-Eppstein
 *********************************************************************/
 #include <base_local_planner/voxel_grid_model.h>
+#include <algorithm>
 
 using namespace std;
 using namespace costmap_2d;
@@ -44,7 +45,9 @@ namespace base_local_planner {
           double origin_x, double origin_y, double origin_z, double max_z, double obstacle_range) :
     obstacle_grid_(size_x, size_y, size_z), xy_resolution_(xy_resolution), z_resolution_(z_resolution), 
     origin_x_(origin_x), origin_y_(origin_y), origin_z_(origin_z),
-    max_z_(max_z), sq_obstacle_range_(obstacle_range * obstacle_range) {}
+    max_z_(max_z), sq_obstacle_range_(obstacle_range * obstacle_range) {
+    updateBlocked();
+  }
 
   double VoxelGridModel::footprintCost(const geometry_msgs::Point& position, const std::vector<geometry_msgs::Point>& footprint, 
       double inscribed_radius, double circumscribed_radius){
@@ -102,9 +105,6 @@ namespace base_local_planner {
     int xinc1, xinc2, yinc1, yinc2;
     int den, num, numadd, numpixels;
 
-    double line_cost = 0.0;
-    double point_cost = -1.0;
-
     if (x1 >= x0)                 // The x-values are increasing
     {
       xinc1 = 1;
@@ -146,15 +146,32 @@ namespace base_local_planner {
       numpixels = deltay;         // There are more y-values than x-values
     }
 
-    for (int curpixel = 0; curpixel <= numpixels; curpixel++)
+    if (2 * deltay <= deltax)
     {
-      point_cost = pointCost(x, y); //Score the current point
+      //the pixels of a row of a flat line form one run, so count the pixels until the numerator overflows and check them together
+      int remaining = numpixels + 1;
+      while (remaining > 0)
+      {
+        int run = numadd > 0 ? min((den - num + numadd - 1) / numadd, remaining) : remaining;
+        int run_end = x + (run - 1) * xinc2;
 
-      if(point_cost < 0)
-        return -1;
+        //if any cell of the run is in an obstacle the path is invalid
+        if (rowBlocked(y, min(x, run_end), max(x, run_end)))
+          return -1;
 
-      if(line_cost < point_cost)
-        line_cost = point_cost;
+        num += run * numadd - den;
+        x = run_end + xinc2;
+        y += yinc1;
+        remaining -= run;
+      }
+      return 1;
+    }
+
+    for (int curpixel = 0; curpixel <= numpixels; curpixel++)
+    {
+      //if the cell is in an obstacle the path is invalid
+      if (cellBlocked(x, y))
+        return -1;
 
       num += numadd;              // Increase the numerator by the top of the fraction
       if (num >= den)             // Check if numerator >= denominator
@@ -167,16 +184,25 @@ namespace base_local_planner {
       y += yinc2;                 // Change the y as appropriate
     }
 
-    return line_cost;
+    return 1;
   }
 
-  double VoxelGridModel::pointCost(int x, int y){
-    //if the cell is in an obstacle the path is invalid
-    if(obstacle_grid_.getVoxelColumn(x, y)){
-      return -1;
+  void VoxelGridModel::updateBlocked(){
+    typedef voxel_grid::VoxelGrid::ColumnType Column;
+    size_x_ = obstacle_grid_.sizeX();
+    size_y_ = obstacle_grid_.sizeY();
+    words_per_row_ = (size_x_ + 63) / 64;
+    blocked_.assign(words_per_row_ * size_y_, 0);
+
+    //a column is blocked as soon as one of its voxels is marked or unknown
+    const Column* col = obstacle_grid_.getData();
+    for(unsigned int y = 0; y < size_y_; ++y){
+      uint64_t* row = &blocked_[y * words_per_row_];
+      for(unsigned int x = 0; x < size_x_; ++x, ++col){
+        if(voxel_grid::VoxelGrid::markedBits(*col) || voxel_grid::VoxelGrid::unknownBits(*col))
+          row[x >> 6] |= (uint64_t)1 << (x & 63);
+      }
     }
-
-    return 1;
   }
 
   void VoxelGridModel::updateWorld(const std::vector<geometry_msgs::Point>& footprint, 
@@ -210,6 +236,8 @@ namespace base_local_planner {
 
     //remove the points that are in the footprint of the robot
     //removePointsInPolygon(footprint);
+
+    updateBlocked();
   }
 
   void VoxelGridModel::removePointsInScanBoundry(const PlanarLaserScan& laser_scan, double raytrace_range){
@@ -224,6 +252,10 @@ namespace base_local_planner {
     if(!worldToMap3D(ox, oy, oz, sensor_x, sensor_y, sensor_z))
       return;
 
+    //neighboring beams often end in the same voxel, and would clear the same line again
+    bool cleared = false;
+    unsigned int last_x = 0, last_y = 0, last_z = 0;
+
     for(unsigned int i = 0; i < laser_scan.cloud.points.size(); ++i){
       double wpx = laser_scan.cloud.points[i].x;
       double wpy = laser_scan.cloud.points[i].y;
@@ -261,7 +293,13 @@ namespace base_local_planner {
 
       unsigned int point_x, point_y, point_z;
       if(worldToMap3D(wpx, wpy, wpz, point_x, point_y, point_z)){
+        if(cleared && point_x == last_x && point_y == last_y && point_z == last_z)
+          continue;
         obstacle_grid_.clearVoxelLine(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z);
+        cleared = true;
+        last_x = point_x;
+        last_y = point_y;
+        last_z = point_z;
       }
     }
   }
@@ -0,0 +1,110 @@
+/*
+ * clearance_cost_function_test.cpp
+ */
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <costmap_2d/cost_values.h>
+#include <costmap_2d/costmap_2d.h>
+
+#include <base_local_planner/clearance_cost_function.h>
+
+namespace base_local_planner {
+
+static std::vector<geometry_msgs::Point> rectangle(double half_length, double half_width) {
+  std::vector<geometry_msgs::Point> footprint(4);
+  footprint[0].x = half_length;  footprint[0].y = half_width;
+  footprint[1].x = half_length;  footprint[1].y = -half_width;
+  footprint[2].x = -half_length; footprint[2].y = -half_width;
+  footprint[3].x = -half_length; footprint[3].y = half_width;
+  return footprint;
+}
+
+TEST(ClearanceCostFunctionTest, exactDistances) {
+  costmap_2d::Costmap2D costmap(37, 23, 0.1, 0.0, 0.0);
+  srand(3);
+  for (int i = 0; i < 12; ++i) {
+    costmap.setCost(rand() % 37, rand() % 23, i % 4 ? costmap_2d::LETHAL_OBSTACLE : costmap_2d::NO_INFORMATION);
+  }
+  // not obstacles
+  costmap.setCost(5, 5, costmap_2d::INSCRIBED_INFLATED_OBSTACLE);
+
+  for (int threads = 1; threads <= 4; threads += 3) {
+    ClearanceCostFunction critic(&costmap);
+    critic.setThreads(threads);
+    critic.prepare();
+    for (unsigned int y = 0; y < 23; ++y) {
+      for (unsigned int x = 0; x < 37; ++x) {
+        double nearest = 1e9;
+        for (unsigned int oy = 0; oy < 23; ++oy) {
+          for (unsigned int ox = 0; ox < 37; ++ox) {
+            unsigned char cost = costmap.getCost(ox, oy);
+            if (cost == costmap_2d::LETHAL_OBSTACLE || cost == costmap_2d::NO_INFORMATION) {
+              nearest = std::min(nearest, hypot((double)ox - x, (double)oy - y));
+            }
+          }
+        }
+        EXPECT_NEAR(nearest, critic.getDistance(x, y), 1e-4) << x << ", " << y << " on " << threads;
+      }
+    }
+  }
+}
+
+TEST(ClearanceCostFunctionTest, circlesCoverFootprint) {
+  costmap_2d::Costmap2D costmap(40, 40, 0.1, 0.0, 0.0);
+  ClearanceCostFunction critic(&costmap);
+  critic.setFootprint(rectangle(0.45, 0.15));
+  ASSERT_EQ(3u, critic.getCircles().size());
+
+  for (double x = -0.45; x <= 0.45; x += 0.01) {
+    for (double y = -0.15; y <= 0.15; y += 0.01) {
+      bool covered = false;
+      for (unsigned int i = 0; i < critic.getCircles().size(); ++i) {
+        const ClearanceCostFunction::Circle& c = critic.getCircles()[i];
+        covered = covered || hypot(x - c.x, y - c.y) <= c.radius + 1e-9;
+      }
+      EXPECT_TRUE(covered) << x << ", " << y;
+    }
+  }
+  // no wider than the footprint needs
+  EXPECT_NEAR(hypot(0.15, 0.15), critic.getCircles()[1].radius, 1e-9);
+}
+
+TEST(ClearanceCostFunctionTest, scoresClearance) {
+  costmap_2d::Costmap2D costmap(60, 60, 0.1, 0.0, 0.0);
+  // a wall along x = 4.05
+  for (unsigned int y = 0; y < 60; ++y) {
+    costmap.setCost(40, y, costmap_2d::LETHAL_OBSTACLE);
+  }
+  ClearanceCostFunction critic(&costmap);
+  critic.setFootprint(rectangle(0.3, 0.1), 1);
+  critic.setMaxClearance(2.0);
+  critic.prepare();
+
+  // the circle reaches 0.32 from the robot's center
+  double clearance;
+  ASSERT_TRUE(critic.pointClearance(2.05, 3.05, 0.0, clearance));
+  EXPECT_NEAR(2.0 - hypot(0.3, 0.1), clearance, 1e-4);
+
+  Trajectory far, near;
+  far.addPoint(1.05, 3.05, 0.0);
+  far.addPoint(1.55, 3.05, 0.0);
+  near.addPoint(2.05, 3.05, 0.0);
+  near.addPoint(3.05, 3.05, 0.0);
+  double far_cost = critic.scoreTrajectory(far), near_cost = critic.scoreTrajectory(near);
+  EXPECT_GE(far_cost, 0.0);
+  EXPECT_GT(near_cost, far_cost);
+  EXPECT_NEAR(2.0 - (1.0 - hypot(0.3, 0.1)), near_cost, 1e-4);
+
+  // into the wall, and off the map
+  near.addPoint(3.85, 3.05, 0.0);
+  EXPECT_EQ(-6.0, critic.scoreTrajectory(near));
+  Trajectory off;
+  off.addPoint(-0.5, 3.05, 0.0);
+  EXPECT_EQ(-7.0, critic.scoreTrajectory(off));
+}
+
+}
@@ -0,0 +1,65 @@
+/*
+ * in_place_rotation_checker_test.cpp
+ */
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <costmap_2d/cost_values.h>
+#include <costmap_2d/costmap_2d.h>
+
+#include <base_local_planner/in_place_rotation_checker.h>
+
+namespace base_local_planner {
+
+static std::vector<geometry_msgs::Point> rectangle(double half_length, double half_width) {
+  std::vector<geometry_msgs::Point> footprint(4);
+  footprint[0].x = half_length;  footprint[0].y = half_width;
+  footprint[1].x = half_length;  footprint[1].y = -half_width;
+  footprint[2].x = -half_length; footprint[2].y = -half_width;
+  footprint[3].x = -half_length; footprint[3].y = half_width;
+  return footprint;
+}
+
+TEST(InPlaceRotationCheckerTest, sweepsToGoal) {
+  costmap_2d::Costmap2D costmap(40, 40, 0.1, 0.0, 0.0);
+  InPlaceRotationChecker checker;
+  EXPECT_FALSE(checker.isClear(costmap, 2.05, 2.05, 0.0, M_PI_2));
+  checker.setFootprint(rectangle(0.3, 0.1));
+  EXPECT_TRUE(checker.isClear(costmap, 2.05, 2.05, 0.0, M_PI_2));
+
+  // ahead of the robot's side, which the long side sweeps over turning left
+  costmap.setCost(20, 23, costmap_2d::LETHAL_OBSTACLE);
+  EXPECT_TRUE(checker.isClear(costmap, 2.05, 2.05, 0.0, 0.0));
+  EXPECT_FALSE(checker.isClear(costmap, 2.05, 2.05, 0.0, M_PI_2));
+  EXPECT_TRUE(checker.isClear(costmap, 2.05, 2.05, 0.0, -M_PI_4));
+  // the long way round to the same heading
+  EXPECT_FALSE(checker.isClear(costmap, 2.05, 2.05, 0.0, -M_PI_4, 1.0));
+
+  // the kept outlines see the costs as they are now
+  costmap.setCost(20, 23, costmap_2d::FREE_SPACE);
+  EXPECT_TRUE(checker.isClear(costmap, 2.05, 2.05, 0.0, M_PI_2));
+  costmap.setCost(20, 23, costmap_2d::NO_INFORMATION);
+  EXPECT_FALSE(checker.isClear(costmap, 2.05, 2.05, 0.0, M_PI_2));
+}
+
+TEST(InPlaceRotationCheckerTest, offMap) {
+  costmap_2d::Costmap2D costmap(40, 40, 0.1, 0.0, 0.0);
+  InPlaceRotationChecker checker;
+  checker.setFootprint(rectangle(0.3, 0.1));
+  EXPECT_TRUE(checker.isClear(costmap, 0.35, 0.15, 0.0, 0.0));
+  EXPECT_FALSE(checker.isClear(costmap, 0.35, 0.15, 0.0, M_PI_2));
+  EXPECT_FALSE(checker.isClear(costmap, -0.5, 0.15, 0.0, 0.0));
+}
+
+TEST(InPlaceRotationCheckerTest, circular) {
+  costmap_2d::Costmap2D costmap(40, 40, 0.1, 0.0, 0.0);
+  InPlaceRotationChecker checker;
+  checker.setFootprint(std::vector<geometry_msgs::Point>(1));
+  EXPECT_TRUE(checker.isClear(costmap, 2.05, 2.05, 0.0, M_PI));
+  costmap.setCost(20, 20, costmap_2d::INSCRIBED_INFLATED_OBSTACLE);
+  EXPECT_FALSE(checker.isClear(costmap, 2.05, 2.05, 0.0, M_PI));
+}
+
+}
@@ -5,11 +5,16 @@
  *      Author: tkruse
  */
 #include <queue>
+#include <vector>
 
 #include <gtest/gtest.h>
 
+#include <costmap_2d/cost_values.h>
+
 #include <base_local_planner/map_grid.h>
 #include <base_local_planner/map_cell.h>
+#include <base_local_planner/compact_map_grid.h>
+#include <base_local_planner/fused_map_grid_cost_function.h>
 
 #include "wavefront_map_accessor.h"
 
@@ -159,4 +164,159 @@ TEST(MapGridTest, distancePropagation){
   EXPECT_EQ(18.0, mg(9, 9).target_dist);
 }
 
+// obstacles come and go, the window moves and the plan shifts, for a while
+static void checkIncremental(bool local_goal) {
+  costmap_2d::Costmap2D costmap(40, 30, 0.1, 0.0, 0.0);
+  MapGrid full(40, 30), incremental(40, 30);
+  incremental.setIncremental(true);
+
+  unsigned int seed = 7;
+  double plan_x = 0.0;
+  for (int step = 0; step < 120; ++step) {
+    int changes = step % 40 == 20 ? 600 : 8;
+    for (int i = 0; i < changes; ++i) {
+      seed = seed * 1103515245 + 12345;
+      unsigned int cell = (seed >> 8) % (40 * 30);
+      unsigned char kinds[] = {costmap_2d::FREE_SPACE, costmap_2d::FREE_SPACE, costmap_2d::LETHAL_OBSTACLE,
+          costmap_2d::INSCRIBED_INFLATED_OBSTACLE, costmap_2d::NO_INFORMATION};
+      costmap.getCharMap()[cell] = kinds[(seed >> 20) % 5];
+    }
+    if (step % 3 == 0) {
+      seed = seed * 1103515245 + 12345;
+      costmap.updateOrigin(costmap.getOriginX() + 0.1 * ((int)((seed >> 8) % 5) - 2),
+          costmap.getOriginY() + 0.1 * ((int)((seed >> 12) % 5) - 2));
+    }
+    plan_x += 0.05;
+
+    std::vector<geometry_msgs::PoseStamped> plan(30);
+    for (unsigned int i = 0; i < plan.size(); ++i) {
+      plan[i].pose.position.x = costmap.getOriginX() + 0.5 + fmod(plan_x, 1.0) + i * 0.1;
+      plan[i].pose.position.y = costmap.getOriginY() + 1.5 + sin(i * 0.3 + plan_x);
+    }
+
+    full.resetPathDist();
+    if (local_goal) {
+      full.setLocalGoal(costmap, plan);
+      incremental.setLocalGoal(costmap, plan);
+    } else {
+      full.setTargetCells(costmap, plan);
+      incremental.setTargetCells(costmap, plan);
+    }
+    for (unsigned int y = 0; y < 30; ++y) {
+      for (unsigned int x = 0; x < 40; ++x) {
+        ASSERT_EQ(full(x, y).target_dist, incremental(x, y).target_dist) << "step " << step << " cell " << x << ", " << y;
+        ASSERT_EQ(full(x, y).target_mark, incremental(x, y).target_mark) << "step " << step << " cell " << x << ", " << y;
+      }
+    }
+  }
+}
+
+TEST(MapGridTest, incrementalTargetCells){
+  checkIncremental(false);
+}
+
+TEST(MapGridTest, incrementalLocalGoal){
+  checkIncremental(true);
+}
+
+TEST(MapGridTest, compactMatchesCells){
+  costmap_2d::Costmap2D costmap(40, 30, 0.1, 0.0, 0.0);
+  unsigned int seed = 11;
+  for (unsigned int i = 0; i < 40 * 30; ++i) {
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 8) % 4 == 0) {
+      costmap.getCharMap()[i] = costmap_2d::LETHAL_OBSTACLE;
+    }
+  }
+  std::vector<geometry_msgs::PoseStamped> plan(30);
+  for (unsigned int i = 0; i < plan.size(); ++i) {
+    plan[i].pose.position.x = 0.5 + i * 0.1;
+    plan[i].pose.position.y = 1.5 + sin(i * 0.3);
+  }
+
+  for (int local_goal = 0; local_goal < 2; ++local_goal) {
+    MapGrid cells(40, 30);
+    CompactMapGrid compact(40, 30);
+    cells.resetPathDist();
+    compact.resetPathDist();
+    if (local_goal) {
+      cells.setLocalGoal(costmap, plan);
+      compact.setLocalGoal(costmap, plan);
+      EXPECT_EQ(cells.goal_x_, compact.goal_x_);
+      EXPECT_EQ(cells.goal_y_, compact.goal_y_);
+    } else {
+      cells.setTargetCells(costmap, plan);
+      compact.setTargetCells(costmap, plan);
+    }
+    EXPECT_EQ(cells.obstacleCosts(), compact.obstacleCosts());
+    for (unsigned int y = 0; y < 30; ++y) {
+      for (unsigned int x = 0; x < 40; ++x) {
+        ASSERT_EQ(cells(x, y).target_dist, compact(x, y)) << "cell " << x << ", " << y;
+        ASSERT_EQ(cells(x, y).target_mark, compact.isMarked(x, y)) << "cell " << x << ", " << y;
+      }
+    }
+  }
+}
+
+TEST(MapGridTest, fusedMatchesSeparate){
+  costmap_2d::Costmap2D costmap(60, 60, 0.1, 0.0, 0.0);
+  unsigned int seed = 5;
+  for (unsigned int i = 0; i < 60 * 60; ++i) {
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 8) % 12 == 0) {
+      costmap.getCharMap()[i] = costmap_2d::LETHAL_OBSTACLE;
+    }
+  }
+  std::vector<geometry_msgs::PoseStamped> plan(40);
+  for (unsigned int i = 0; i < plan.size(); ++i) {
+    plan[i].pose.position.x = 1.0 + i * 0.1;
+    plan[i].pose.position.y = 3.0 + sin(i * 0.2);
+  }
+
+  // as the dwa planner sets them up, with the front critics shifted forward
+  MapGridCostFunction path(&costmap), goal(&costmap, 0.0, 0.0, true),
+      goal_front(&costmap, 0.3, 0.0, true), alignment(&costmap, 0.3);
+  goal_front.setStopOnFailure(false);
+  alignment.setStopOnFailure(false);
+  MapGridCostFunction* critics[] = {&goal_front, &alignment, &path, &goal};
+  FusedMapGridCostFunction fused(&costmap);
+  for (unsigned int c = 0; c < 4; ++c) {
+    critics[c]->setTargetPoses(plan);
+    critics[c]->setScale(0.1 * (c + 1));
+    EXPECT_TRUE(fused.addCritic(critics[c]));
+  }
+  alignment.setScale(0.0);
+  ASSERT_TRUE(fused.prepare());
+
+  int rejected = 0;
+  for (int k = 0; k < 400; ++k) {
+    Trajectory traj;
+    double x = 1.0 + (k % 20) * 0.15, y = 2.0 + (k / 20) * 0.1, th = 0.0;
+    for (int i = 0; i < 15; ++i) {
+      traj.addPoint(x, y, th);
+      x += 0.05 * cos(th);
+      y += 0.05 * sin(th);
+      th += ((k * 7) % 11 - 5) * 0.03;
+    }
+
+    double separate = 0.0;
+    for (unsigned int c = 0; c < 4 && separate >= 0; ++c) {
+      if (critics[c]->getScale() == 0) {
+        continue;
+      }
+      double cost = critics[c]->scoreTrajectory(traj);
+      separate = cost < 0 ? cost : separate + cost * critics[c]->getScale();
+    }
+    double cost = fused.scoreTrajectory(traj);
+    if (separate < 0) {
+      EXPECT_LT(cost, 0) << "trajectory " << k;
+      rejected++;
+    } else {
+      EXPECT_NEAR(separate, cost, 1e-9) << "trajectory " << k;
+    }
+  }
+  EXPECT_GT(rejected, 0);
+  EXPECT_LT(rejected, 400);
+}
+
 }
@@ -0,0 +1,347 @@
+/*
+ * scored_sampling_planner_test.cpp
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include <base_local_planner/simple_scored_sampling_planner.h>
+#include <base_local_planner/adaptive_trajectory_generator.h>
+
+namespace base_local_planner {
+
+// numbered trajectories, every seventh of which fails to generate
+class CountingGenerator : public TrajectorySampleGenerator {
+public:
+  CountingGenerator(int n) : next_(0), n_(n) {}
+
+  bool hasMoreTrajectories() {
+    return next_ < n_;
+  }
+
+  void reset() {
+    next_ = 0;
+  }
+
+  bool nextTrajectory(Trajectory &traj) {
+    int k = next_++;
+    if (k % 7 == 3) {
+      return false;
+    }
+    traj.resetPoints();
+    traj.xv_ = k;
+    traj.yv_ = traj.thetav_ = 0.0;
+    traj.addPoint(k, 0.0, 0.0);
+    return true;
+  }
+
+private:
+  int next_, n_;
+};
+
+// scrambled costs, with many ties, which reject some trajectories
+class HashCostFunction : public TrajectoryCostFunction {
+public:
+  HashCostFunction(unsigned int seed, bool thread_safe = true) : seed_(seed), thread_safe_(thread_safe) {}
+
+  bool prepare() {
+    return true;
+  }
+
+  double scoreTrajectory(Trajectory &traj) {
+    unsigned int h = ((unsigned int)traj.xv_ * 2654435761u) ^ seed_;
+    return h % 11 == 0 ? -1.0 : h % 97;
+  }
+
+  bool isThreadSafe() {
+    return thread_safe_;
+  }
+
+private:
+  unsigned int seed_;
+  bool thread_safe_;
+};
+
+// lowest near velocity (0.37, 0, 0.21)
+class VelocityCostFunction : public TrajectoryCostFunction {
+public:
+  bool prepare() {
+    return true;
+  }
+
+  double scoreTrajectory(Trajectory &traj) {
+    return fabs(traj.xv_ - 0.37) + fabs(traj.thetav_ - 0.21);
+  }
+
+  bool isThreadSafe() {
+    return true;
+  }
+};
+
+// counts its calls, and rejects the odd numbered trajectories if asked to
+class ParityCostFunction : public TrajectoryCostFunction {
+public:
+  ParityCostFunction(bool reject) : reject_(reject), calls_(0) {}
+
+  bool prepare() {
+    return true;
+  }
+
+  double scoreTrajectory(Trajectory &traj) {
+    calls_++;
+    if (reject_ && (int)traj.xv_ % 2 == 1) {
+      return -1.0;
+    }
+    return (int)traj.xv_ % 13;
+  }
+
+  bool isThreadSafe() {
+    return true;
+  }
+
+  bool reject_;
+  boost::atomic<int> calls_;
+};
+
+static void findBest(int threads, int max_samples, bool thread_safe, Trajectory& best,
+                     std::vector<Trajectory>& explored) {
+  CountingGenerator gen(500);
+  HashCostFunction a(1), b(2), c(3, thread_safe);
+  std::vector<TrajectorySampleGenerator*> gen_list(1, &gen);
+  std::vector<TrajectoryCostFunction*> critics;
+  critics.push_back(&a);
+  critics.push_back(&b);
+  critics.push_back(&c);
+  SimpleScoredSamplingPlanner planner(gen_list, critics, max_samples);
+  planner.setScoringThreads(threads);
+  EXPECT_TRUE(planner.findBestTrajectory(best, &explored));
+}
+
+TEST(ScoredSamplingPlannerTest, parallel_finds_same) {
+  for (int max_samples = -1; max_samples <= 100; max_samples += 101) {
+    Trajectory serial;
+    std::vector<Trajectory> serial_explored;
+    findBest(1, max_samples, true, serial, serial_explored);
+
+    for (int threads = 2; threads <= 4; threads++) {
+      Trajectory parallel;
+      std::vector<Trajectory> parallel_explored;
+      findBest(threads, max_samples, true, parallel, parallel_explored);
+      EXPECT_EQ(serial.xv_, parallel.xv_);
+      EXPECT_EQ(serial.cost_, parallel.cost_);
+      EXPECT_EQ(serial.getPointsSize(), parallel.getPointsSize());
+      EXPECT_EQ(serial_explored.size(), parallel_explored.size());
+    }
+  }
+}
+
+TEST(ScoredSamplingPlannerTest, serial_without_thread_safe_critics) {
+  Trajectory serial, fallback;
+  std::vector<Trajectory> serial_explored, fallback_explored;
+  findBest(1, -1, true, serial, serial_explored);
+  findBest(4, -1, false, fallback, fallback_explored);
+  EXPECT_EQ(serial.xv_, fallback.xv_);
+  EXPECT_EQ(serial.cost_, fallback.cost_);
+}
+
+TEST(ScoredSamplingPlannerTest, adaptive_critic_order) {
+  ParityCostFunction keep(false), reject(true);
+  std::vector<TrajectoryCostFunction*> critics;
+  critics.push_back(&keep);
+  critics.push_back(&reject);
+
+  Trajectory fixed_best;
+  {
+    CountingGenerator gen(500);
+    std::vector<TrajectorySampleGenerator*> gen_list(1, &gen);
+    SimpleScoredSamplingPlanner planner(gen_list, critics);
+    EXPECT_TRUE(planner.findBestTrajectory(fixed_best));
+  }
+
+  for (int threads = 1; threads <= 2; ++threads) {
+    CountingGenerator gen(500);
+    std::vector<TrajectorySampleGenerator*> gen_list(1, &gen);
+    SimpleScoredSamplingPlanner planner(gen_list, critics);
+    planner.setAdaptiveCriticOrder(true);
+    planner.setScoringThreads(threads);
+    Trajectory best;
+    EXPECT_TRUE(planner.findBestTrajectory(best));
+    EXPECT_EQ(fixed_best.xv_, best.xv_);
+    EXPECT_EQ(fixed_best.cost_, best.cost_);
+    ASSERT_EQ(2u, planner.getCriticStats().size());
+    EXPECT_EQ(0, planner.getCriticStats()[0].rejections);
+    EXPECT_GT(planner.getCriticStats()[1].rejections, 0);
+
+    // the critic that rejects runs first from then on, so the other sees only the even ones
+    gen.reset();
+    keep.calls_ = 0;
+    EXPECT_TRUE(planner.findBestTrajectory(best));
+    EXPECT_EQ(1u, planner.getCriticOrder()[0]);
+    EXPECT_LE(keep.calls_, 250);
+    EXPECT_EQ(keep.calls_, planner.getLastCriticStats()[0].calls);
+    EXPECT_EQ(429u, planner.getLastTrajectoryCount());
+    EXPECT_EQ(fixed_best.xv_, best.xv_);
+    EXPECT_EQ(fixed_best.cost_, best.cost_);
+  }
+}
+
+TEST(ScoredSamplingPlannerTest, warm_start_prunes) {
+  LocalPlannerLimits limits(0.55, 0.1, 0.55, 0.0, 0.0, 0.0, 1.0, 0.4, 2.5, 0.0, 3.2, -1, 0.1, 0.1);
+  Eigen::Vector3f pos(0, 0, 0), vel(0.3, 0, -0.3), goal(5, 0, 0), vsamples(20, 1, 40);
+  VelocityCostFunction a, b;
+  std::vector<TrajectoryCostFunction*> critics;
+  critics.push_back(&a);
+  critics.push_back(&b);
+
+  Trajectory best[2];
+  double calls[2];
+  for (int warm = 0; warm < 2; ++warm) {
+    SimpleTrajectoryGenerator gen;
+    gen.setParameters(1.0, 0.1, 0.1, true, 0.2);
+    gen.setWarmStart(warm);
+    std::vector<TrajectorySampleGenerator*> gen_list(1, &gen);
+    SimpleScoredSamplingPlanner planner(gen_list, critics);
+    planner.setMeasureCritics(true);
+    // the second cycle starts from the best of the first
+    for (int cycle = 0; cycle < 2; ++cycle) {
+      gen.initialise(pos, vel, goal, &limits, vsamples);
+      EXPECT_TRUE(planner.findBestTrajectory(best[warm]));
+    }
+    calls[warm] = planner.getLastCriticStats()[1].calls;
+  }
+  EXPECT_EQ(best[0].xv_, best[1].xv_);
+  EXPECT_EQ(best[0].thetav_, best[1].thetav_);
+  EXPECT_EQ(best[0].cost_, best[1].cost_);
+  // the second critic only sees the trajectories the first leaves below the best
+  EXPECT_LT(calls[1], calls[0] / 2);
+}
+
+TEST(ScoredSamplingPlannerTest, deadline_stops_at_first_valid) {
+  HashCostFunction a(1), b(2);
+  std::vector<TrajectoryCostFunction*> critics;
+  critics.push_back(&a);
+  critics.push_back(&b);
+
+  for (int threads = 1; threads <= 4; threads += 3) {
+    CountingGenerator gen(300);
+    std::vector<TrajectorySampleGenerator*> gen_list(1, &gen);
+    SimpleScoredSamplingPlanner planner(gen_list, critics);
+    planner.setScoringThreads(threads);
+    Trajectory best;
+    std::vector<Trajectory> explored;
+    EXPECT_TRUE(planner.findBestTrajectory(best, &explored));
+    EXPECT_FALSE(planner.lastSearchCutShort());
+    unsigned int all = explored.size();
+
+    // a deadline already past stops the search once a trajectory is valid
+    gen.reset();
+    explored.clear();
+    planner.setDeadline(ros::WallTime::now() - ros::WallDuration(1.0));
+    EXPECT_TRUE(planner.findBestTrajectory(best, &explored));
+    EXPECT_TRUE(planner.lastSearchCutShort());
+    EXPECT_GE(best.cost_, 0);
+    EXPECT_LT(explored.size(), all);
+    if (threads == 1) {
+      EXPECT_GE(explored.back().cost_, 0);
+    }
+  }
+}
+
+TEST(ScoredSamplingPlannerTest, deadline_keeps_warm_start) {
+  LocalPlannerLimits limits(0.55, 0.1, 0.55, 0.0, 0.0, 0.0, 1.0, 0.4, 2.5, 0.0, 3.2, -1, 0.1, 0.1);
+  Eigen::Vector3f pos(0, 0, 0), vel(0.3, 0, -0.3), goal(5, 0, 0), vsamples(20, 1, 40);
+  VelocityCostFunction a;
+  std::vector<TrajectoryCostFunction*> critics(1, &a);
+
+  SimpleTrajectoryGenerator gen;
+  gen.setParameters(1.0, 0.1, 0.1, true, 0.2);
+  gen.setWarmStart(true);
+  std::vector<TrajectorySampleGenerator*> gen_list(1, &gen);
+  SimpleScoredSamplingPlanner planner(gen_list, critics);
+  Trajectory full, cut;
+  gen.initialise(pos, vel, goal, &limits, vsamples);
+  EXPECT_TRUE(planner.findBestTrajectory(full));
+
+  // the next cycle samples the last best first, so stopping after it loses nothing
+  planner.setDeadline(ros::WallTime::now() - ros::WallDuration(1.0));
+  gen.initialise(pos, vel, goal, &limits, vsamples);
+  EXPECT_TRUE(planner.findBestTrajectory(cut));
+  EXPECT_TRUE(planner.lastSearchCutShort());
+  EXPECT_EQ(1u, planner.getLastTrajectoryCount());
+  EXPECT_EQ(full.xv_, cut.xv_);
+  EXPECT_EQ(full.thetav_, cut.thetav_);
+  EXPECT_EQ(full.cost_, cut.cost_);
+}
+
+TEST(ScoredSamplingPlannerTest, parallel_refines_same) {
+  LocalPlannerLimits limits(0.55, 0.1, 0.55, 0.0, 0.0, 0.0, 1.0, 0.4, 2.5, 0.0, 3.2, -1, 0.1, 0.1);
+  Eigen::Vector3f pos(0, 0, 0), vel(0.3, 0, -0.3), goal(5, 0, 0), vsamples(20, 1, 40);
+  VelocityCostFunction a, b;
+  std::vector<TrajectoryCostFunction*> critics;
+  critics.push_back(&a);
+  critics.push_back(&b);
+
+  Trajectory best[2];
+  std::vector<Trajectory> explored[2];
+  for (int parallel = 0; parallel < 2; ++parallel) {
+    AdaptiveTrajectoryGenerator gen;
+    gen.setParameters(1.0, 0.1, 0.1, true, 0.2);
+    // refining around the best alone, as early-out costs of the others differ by thread
+    gen.setAdaptiveParameters(3, 1, false);
+    gen.initialise(pos, vel, goal, &limits, vsamples);
+    std::vector<TrajectorySampleGenerator*> gen_list(1, &gen);
+    SimpleScoredSamplingPlanner planner(gen_list, critics);
+    planner.setScoringThreads(parallel ? 4 : 1);
+    EXPECT_TRUE(planner.findBestTrajectory(best[parallel], &explored[parallel]));
+  }
+  EXPECT_EQ(best[0].xv_, best[1].xv_);
+  EXPECT_EQ(best[0].thetav_, best[1].thetav_);
+  EXPECT_EQ(best[0].cost_, best[1].cost_);
+  EXPECT_EQ(explored[0].size(), explored[1].size());
+  // more than the coarse grid was sampled, far less than the full one
+  EXPECT_GT(explored[0].size(), 9u);
+  EXPECT_LT(explored[0].size(), 200u);
+}
+
+TEST(ScoredSamplingPlannerTest, batch_scores_each) {
+  CountingGenerator gen(300);
+  std::vector<Trajectory> trajs;
+  Trajectory traj;
+  while (gen.hasMoreTrajectories()) {
+    if (gen.nextTrajectory(traj)) {
+      trajs.push_back(traj);
+    }
+  }
+  HashCostFunction a(1), b(2);
+  ParityCostFunction reject(true);
+  std::vector<TrajectoryCostFunction*> critics;
+  critics.push_back(&a);
+  critics.push_back(&b);
+  critics.push_back(&reject);
+  std::vector<TrajectorySampleGenerator*> gen_list(1, &gen);
+
+  for (int threads = 1; threads <= 4; threads += 3) {
+    SimpleScoredSamplingPlanner planner(gen_list, critics);
+    planner.setScoringThreads(threads);
+    std::vector<double> costs;
+    std::vector<int> rejected_by;
+    planner.scoreTrajectories(trajs, costs, &rejected_by);
+    ASSERT_EQ(trajs.size(), costs.size());
+    ASSERT_EQ(trajs.size(), rejected_by.size());
+    for (unsigned int i = 0; i < trajs.size(); ++i) {
+      EXPECT_EQ(planner.scoreTrajectory(trajs[i], -1), costs[i]);
+      EXPECT_EQ(costs[i], trajs[i].cost_);
+      int expected = -1;
+      for (unsigned int c = 0; c < critics.size() && expected < 0; ++c) {
+        if (critics[c]->scoreTrajectory(trajs[i]) < 0) {
+          expected = c;
+        }
+      }
+      EXPECT_EQ(expected, rejected_by[i]) << "trajectory " << i;
+    }
+  }
+}
+
+}
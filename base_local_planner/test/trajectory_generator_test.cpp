@@ -7,9 +7,11 @@
 
 #include <gtest/gtest.h>
 
+#include <cmath>
 #include <vector>
 
 #include <base_local_planner/simple_trajectory_generator.h>
+#include <base_local_planner/adaptive_trajectory_generator.h>
 
 namespace base_local_planner {
 
@@ -22,5 +24,157 @@ public:
 
   virtual void TestBody(){}
 };
-  
+
+TEST(TrajectoryGeneratorTest, arcMatchesStepwise) {
+  Eigen::Vector3f pos(1.5, -0.5, 2.9);
+  for (int k = 0; k < 6; ++k) {
+    Eigen::Vector3f vel(0.1 * k, k % 3 == 0 ? 0.0 : 0.2 - 0.1 * k, 1.0 - 0.4 * k);
+    Trajectory traj;
+    SimpleTrajectoryGenerator::computeArcPositions(pos, vel, 0.025, 80, traj);
+    ASSERT_EQ(80u, traj.getPointsSize());
+
+    Eigen::Vector3f step = pos;
+    for (unsigned int i = 0; i < traj.getPointsSize(); ++i) {
+      double x, y, th;
+      traj.getPoint(i, x, y, th);
+      EXPECT_NEAR(step[0], x, 1e-4);
+      EXPECT_NEAR(step[1], y, 1e-4);
+      EXPECT_NEAR(step[2], th, 1e-4);
+      step = SimpleTrajectoryGenerator::computeNewPositions(step, vel, 0.025);
+    }
+  }
+}
+
+TEST(TrajectoryGeneratorTest, libraryLatticeValues) {
+  TrajectoryLibrary library;
+  library.setResolution(0.01);
+  std::vector<float> values;
+  library.latticeValues(-0.94, 0.345, 40, values);
+  ASSERT_GE(values.size(), 40u);
+  EXPECT_LE(values.size(), 41u);
+  EXPECT_NEAR(-0.94, values.front(), 1e-6);
+  EXPECT_NEAR(0.34, values.back(), 1e-6);
+  bool zero = false;
+  for (unsigned int i = 0; i < values.size(); ++i) {
+    EXPECT_NEAR(0, fabs(values[i] / 0.01 - floor(values[i] / 0.01 + 0.5)), 1e-3);
+    if (i > 0) {
+      EXPECT_LT(values[i - 1], values[i]);
+    }
+    zero = zero || values[i] == 0;
+  }
+  EXPECT_TRUE(zero);
+
+  // fewer lattice velocities than samples gives them all, none gives the even spread
+  library.latticeValues(0.0, 0.035, 20, values);
+  EXPECT_EQ(4u, values.size());
+  library.latticeValues(0.001, 0.009, 5, values);
+  ASSERT_EQ(5u, values.size());
+  EXPECT_NEAR(0.001, values.front(), 1e-6);
+  EXPECT_NEAR(0.009, values.back(), 1e-6);
+
+  // rollouts are kept for lattice velocities alone
+  Eigen::Vector3f on(0.3, 0.0, -0.2), off(0.305, 0.0, -0.2);
+  EXPECT_TRUE(library.get(off, 0.1, 10) == NULL);
+  const TrajectoryLibrary::Primitive* prim = library.get(on, 0.1, 10);
+  ASSERT_TRUE(prim != NULL);
+  EXPECT_EQ(prim, library.get(on, 0.1, 10));
+  EXPECT_EQ(1u, library.size());
+}
+
+TEST(TrajectoryGeneratorTest, libraryMatchesArc) {
+  LocalPlannerLimits limits(0.55, 0.1, 0.55, 0.0, 0.0, 0.0, 1.0, 0.4, 2.5, 0.0, 3.2, -1, 0.1, 0.1);
+  Eigen::Vector3f vel(0.3, 0, -0.3), goal(5, 0, 0), vsamples(20, 1, 40);
+  SimpleTrajectoryGenerator gen;
+  gen.setParameters(1.0, 0.1, 0.1, true, 0.2);
+  gen.setPrimitiveResolution(0.01);
+
+  // the second pose moves the rollouts kept from the first
+  for (int cycle = 0; cycle < 2; ++cycle) {
+    Eigen::Vector3f pos(1.5 * cycle, -0.5, 2.9 - 4 * cycle);
+    gen.initialise(pos, vel, goal, &limits, vsamples);
+    unsigned int count = 0;
+    Trajectory traj;
+    while (gen.hasMoreTrajectories()) {
+      if (!gen.nextTrajectory(traj)) {
+        continue;
+      }
+      count++;
+      EXPECT_NEAR(0, fabs(traj.xv_ / 0.01 - floor(traj.xv_ / 0.01 + 0.5)), 1e-3);
+      EXPECT_NEAR(0, fabs(traj.thetav_ / 0.01 - floor(traj.thetav_ / 0.01 + 0.5)), 1e-3);
+
+      Trajectory arc;
+      SimpleTrajectoryGenerator::computeArcPositions(pos, Eigen::Vector3f(traj.xv_, traj.yv_, traj.thetav_),
+                                                     traj.time_delta_, traj.getPointsSize(), arc);
+      for (unsigned int i = 0; i < traj.getPointsSize(); ++i) {
+        double x, y, th, ax, ay, ath;
+        traj.getPoint(i, x, y, th);
+        arc.getPoint(i, ax, ay, ath);
+        EXPECT_NEAR(ax, x, 1e-5);
+        EXPECT_NEAR(ay, y, 1e-5);
+        EXPECT_NEAR(ath, th, 1e-5);
+      }
+    }
+    EXPECT_GT(count, 400u);
+    EXPECT_LE(count, 20u * 41u);
+  }
+}
+
+// lowest at (0.37, 0.21), invalid at hard rotations, and away from x 0.37 with narrow
+static double bowlCost(const Trajectory& traj, bool narrow) {
+  if (traj.thetav_ < -0.8 || (narrow && fabs(traj.xv_ - 0.37) > 0.02)) {
+    return -1.0;
+  }
+  return fabs(traj.xv_ - 0.37) + 0.5 * fabs(traj.thetav_ - 0.21);
+}
+
+static double sampleBest(TrajectorySampleGenerator& gen, bool narrow, int& count) {
+  Trajectory traj;
+  double best = -1.0;
+  count = 0;
+  while (gen.hasMoreTrajectories()) {
+    if (!gen.nextTrajectory(traj)) {
+      continue;
+    }
+    double cost = bowlCost(traj, narrow);
+    gen.setTrajectoryCost(traj, cost);
+    count++;
+    if (cost >= 0 && (best < 0 || cost < best)) {
+      best = cost;
+    }
+  }
+  return best;
+}
+
+TEST(TrajectoryGeneratorTest, adaptiveSamplesFewer) {
+  LocalPlannerLimits limits(0.55, 0.1, 0.55, 0.0, 0.0, 0.0, 1.0, 0.4, 2.5, 0.0, 3.2, -1, 0.1, 0.1);
+  Eigen::Vector3f pos(0, 0, 0), vel(0.3, 0, -0.3), goal(5, 0, 0), vsamples(20, 1, 40);
+  SimpleTrajectoryGenerator full;
+  AdaptiveTrajectoryGenerator adaptive;
+  full.setParameters(1.0, 0.1, 0.1, true, 0.2);
+  adaptive.setParameters(1.0, 0.1, 0.1, true, 0.2);
+
+  // the window is x 0 to 0.55 and theta -0.94 to 0.34, refined to the full grid spacing,
+  // so the best sample is at most half a full grid step off the lowest cost either way
+  double bound = 0.5 * (0.55 / 19) + 0.5 * 0.5 * (1.28 / 39);
+  for (int narrow = 0; narrow < 2; ++narrow) {
+    full.initialise(pos, vel, goal, &limits, vsamples);
+    int full_count;
+    double full_best = sampleBest(full, narrow, full_count);
+    ASSERT_GE(full_best, 0);
+    EXPECT_LE(full_best, bound);
+
+    // the second cycle is seeded with the best of the first
+    for (int cycle = 0; cycle < 2; ++cycle) {
+      adaptive.initialise(pos, vel, goal, &limits, vsamples);
+      int adaptive_count;
+      double adaptive_best = sampleBest(adaptive, narrow, adaptive_count);
+      EXPECT_GE(adaptive_best, 0);
+      EXPECT_LE(adaptive_best, bound);
+      if (!narrow) {
+        EXPECT_LT(adaptive_count * 3, full_count);
+      }
+    }
+  }
+}
+
 }
@@ -100,7 +100,33 @@ namespace carrot_planner{
        */
       double footprintCost(double x_i, double y_i, double theta_i);
 
+      /**
+       * @brief  Checks the footprint like footprintCost(), from outlines rasterized ahead of time for a set of
+       * orientations, which are built again whenever the footprint or the resolution changes
+       * @param x_i The x position of the robot
+       * @param y_i The y position of the robot
+       * @param theta_i The orientation of the robot
+       * @return The highest cost under the outline, or negative if it touches an obstacle, unknown space or the edge of the map
+       */
+      double templateFootprintCost(double x_i, double y_i, double theta_i);
+
+      /**
+       * @brief  Checks a carrot through the configuration space of the costmap if it keeps one, or else like
+       * templateFootprintCost() or footprintCost()
+       * @return Negative if the footprint collides at the pose
+       */
+      double carrotCost(double x_i, double y_i, double theta_i);
+
+      /**
+       * @brief  Rasterizes the outline of the footprint into footprint_templates_
+       */
+      void buildFootprintTemplates(const std::vector<geometry_msgs::Point>& footprint);
+
       bool initialized_;
+      bool incremental_; ///< @brief Whether to check the footprint against templates, and bisect for the carrot
+      std::vector<geometry_msgs::Point> template_footprint_; ///< @brief The footprint the templates were built for
+      double template_resolution_;
+      std::vector<std::vector<std::pair<int, int> > > footprint_templates_; ///< @brief Cells of the outline relative to the center cell, per orientation
   };
 };  
 #endif
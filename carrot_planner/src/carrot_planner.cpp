@@ -35,7 +35,11 @@
 * Authors: Eitan Marder-Eppstein, Sachin Chitta
 *********************************************************************/
 #include <carrot_planner/carrot_planner.h>
+#include <base_local_planner/line_iterator.h>
+#include <costmap_2d/cost_values.h>
 #include <pluginlib/class_list_macros.h>
+#include <algorithm>
+#include <cmath>
 
 //register this planner as a BaseGlobalPlanner plugin
 PLUGINLIB_EXPORT_CLASS(carrot_planner::CarrotPlanner, nav_core::BaseGlobalPlanner)
@@ -43,10 +47,10 @@ PLUGINLIB_EXPORT_CLASS(carrot_planner::CarrotPlanner, nav_core::BaseGlobalPlanne
 namespace carrot_planner {
 
   CarrotPlanner::CarrotPlanner()
-  : costmap_ros_(NULL), initialized_(false){}
+  : costmap_ros_(NULL), initialized_(false), incremental_(false), template_resolution_(0.0){}
 
   CarrotPlanner::CarrotPlanner(std::string name, costmap_2d::Costmap2DROS* costmap_ros)
-  : costmap_ros_(NULL), initialized_(false){
+  : costmap_ros_(NULL), initialized_(false), incremental_(false), template_resolution_(0.0){
     initialize(name, costmap_ros);
   }
   
@@ -58,6 +62,7 @@ namespace carrot_planner {
       ros::NodeHandle private_nh("~/" + name);
       private_nh.param("step_size", step_size_, costmap_->getResolution());
       private_nh.param("min_dist_from_robot", min_dist_from_robot_, 0.10);
+      private_nh.param("incremental", incremental_, false);
       world_model_ = new base_local_planner::CostmapModel(*costmap_); 
 
       initialized_ = true;
@@ -84,6 +89,82 @@ namespace carrot_planner {
   }
 
 
+  double CarrotPlanner::templateFootprintCost(double x_i, double y_i, double theta_i){
+    std::vector<geometry_msgs::Point> footprint = costmap_ros_->getRobotFootprint();
+    //if we have no footprint... do nothing
+    if(footprint.size() < 3)
+      return -1.0;
+
+    bool changed = footprint.size() != template_footprint_.size() || costmap_->getResolution() != template_resolution_;
+    for(unsigned int i = 0; i < footprint.size() && !changed; ++i)
+      changed = footprint[i].x != template_footprint_[i].x || footprint[i].y != template_footprint_[i].y;
+    if(changed)
+      buildFootprintTemplates(footprint);
+
+    unsigned int cell_x, cell_y;
+    if(!costmap_->worldToMap(x_i, y_i, cell_x, cell_y))
+      return -1.0;
+
+    unsigned int bins = footprint_templates_.size();
+    unsigned int bin = (unsigned int)(angles::normalize_angle_positive(theta_i) / (2 * M_PI) * bins + 0.5) % bins;
+    const std::vector<std::pair<int, int> >& cells = footprint_templates_[bin];
+
+    int size_x = costmap_->getSizeInCellsX(), size_y = costmap_->getSizeInCellsY();
+    const unsigned char* grid = costmap_->getCharMap();
+    double footprint_cost = 0.0;
+    for(unsigned int i = 0; i < cells.size(); ++i){
+      int x = cell_x + cells[i].first, y = cell_y + cells[i].second;
+      if(x < 0 || y < 0 || x >= size_x || y >= size_y)
+        return -1.0;
+
+      unsigned char cost = grid[y * size_x + x];
+      if(cost == costmap_2d::LETHAL_OBSTACLE || cost == costmap_2d::NO_INFORMATION)
+        return -1.0;
+      footprint_cost = std::max(footprint_cost, (double)cost);
+    }
+    return footprint_cost;
+  }
+
+  void CarrotPlanner::buildFootprintTemplates(const std::vector<geometry_msgs::Point>& footprint){
+    template_footprint_ = footprint;
+    template_resolution_ = costmap_->getResolution();
+
+    //enough orientations that the outline moves by less than a cell from one to the next
+    double radius = 0.0;
+    for(unsigned int i = 0; i < footprint.size(); ++i)
+      radius = std::max(radius, hypot(footprint[i].x, footprint[i].y));
+    unsigned int bins = std::max(8, (int)ceil(2 * M_PI * radius / template_resolution_));
+
+    footprint_templates_.assign(bins, std::vector<std::pair<int, int> >());
+    std::vector<int> corner_x(footprint.size()), corner_y(footprint.size());
+    for(unsigned int b = 0; b < bins; ++b){
+      double theta = 2 * M_PI * b / bins;
+      double cos_th = cos(theta), sin_th = sin(theta);
+      for(unsigned int i = 0; i < footprint.size(); ++i){
+        corner_x[i] = (int)floor((footprint[i].x * cos_th - footprint[i].y * sin_th) / template_resolution_ + 0.5);
+        corner_y[i] = (int)floor((footprint[i].x * sin_th + footprint[i].y * cos_th) / template_resolution_ + 0.5);
+      }
+
+      std::vector<std::pair<int, int> >& cells = footprint_templates_[b];
+      for(unsigned int i = 0; i < footprint.size(); ++i){
+        unsigned int j = (i + 1) % footprint.size();
+        for(base_local_planner::LineIterator line(corner_x[i], corner_y[i], corner_x[j], corner_y[j]); line.isValid(); line.advance())
+          cells.push_back(std::make_pair(line.getX(), line.getY()));
+      }
+      std::sort(cells.begin(), cells.end());
+      cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    }
+    ROS_DEBUG("Built carrot planner footprint templates for %u orientations", bins);
+  }
+
+  double CarrotPlanner::carrotCost(double x_i, double y_i, double theta_i){
+    //the configuration space of the costmap, if it keeps one, answers with a single lookup
+    costmap_2d::ConfigurationSpace* cspace = costmap_ros_->getConfigurationSpace();
+    if(cspace != NULL)
+      return cspace->inCollision(x_i, y_i, theta_i) ? -1.0 : 0.0;
+    return incremental_ ? templateFootprintCost(x_i, y_i, theta_i) : footprintCost(x_i, y_i, theta_i);
+  }
+
   bool CarrotPlanner::makePlan(const geometry_msgs::PoseStamped& start, 
       const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan){
 
@@ -145,7 +226,7 @@ namespace carrot_planner {
       target_y = start_y + scale * diff_y;
       target_yaw = angles::normalize_angle(start_yaw + scale * diff_yaw);
       
-      double footprint_cost = footprintCost(target_x, target_y, target_yaw);
+      double footprint_cost = carrotCost(target_x, target_y, target_yaw);
       if(footprint_cost >= 0)
       {
           done = true;
@@ -153,6 +234,31 @@ namespace carrot_planner {
       scale -=dScale;
     }
 
+    //the steps are a share of the line, so bisect between the legal one and the blocked one before it, for
+    //a carrot to within a cell of the obstacle on long lines
+    double legal = scale + dScale;
+    if(done && (incremental_ || costmap_ros_->getConfigurationSpace() != NULL) && legal < 1.0 - dScale / 2)
+    {
+      double blocked = legal + dScale;
+      double length = hypot(diff_x, diff_y);
+      while((blocked - legal) * length > costmap_->getResolution())
+      {
+        double mid = (legal + blocked) / 2;
+        double mid_x = start_x + mid * diff_x;
+        double mid_y = start_y + mid * diff_y;
+        double mid_yaw = angles::normalize_angle(start_yaw + mid * diff_yaw);
+        if(carrotCost(mid_x, mid_y, mid_yaw) >= 0)
+        {
+          legal = mid;
+          target_x = mid_x;
+          target_y = mid_y;
+          target_yaw = mid_yaw;
+        }
+        else
+          blocked = mid;
+      }
+    }
+
     plan.push_back(start);
     geometry_msgs::PoseStamped new_goal = goal;
     tf::Quaternion goal_quat = tf::createQuaternionFromYaw(target_yaw);
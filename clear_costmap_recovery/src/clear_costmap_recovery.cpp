@@ -36,6 +36,7 @@
 *********************************************************************/
 #include <clear_costmap_recovery/clear_costmap_recovery.h>
 #include <pluginlib/class_list_macros.h>
+#include <algorithm>
 #include <vector>
 
 //register this planner as a RecoveryBehavior plugin
@@ -135,23 +136,27 @@ void ClearCostmapRecovery::clearMap(boost::shared_ptr<costmap_2d::CostmapLayer>
   costmap->worldToMapNoBounds(start_point_x, start_point_y, start_x, start_y);
   costmap->worldToMapNoBounds(end_point_x, end_point_y, end_x, end_y);
 
-  unsigned char* grid = costmap->getCharMap();
-  for(int x=0; x<(int)costmap->getSizeInCellsX(); x++){
-    bool xrange = x>start_x && x<end_x;
-                   
-    for(int y=0; y<(int)costmap->getSizeInCellsY(); y++){
-      if(xrange && y>start_y && y<end_y)
-        continue;
-      int index = costmap->getIndex(x,y);
-      if(grid[index]!=NO_INFORMATION){
-        grid[index] = NO_INFORMATION;
-      }
-    }
+  // the cells strictly between the corners are kept, everything around them is cleared row by row
+  int size_x = costmap->getSizeInCellsX(), size_y = costmap->getSizeInCellsY();
+  unsigned int keep_x0 = std::min(std::max(start_x + 1, 0), size_x);
+  unsigned int keep_xn = std::min(std::max(end_x, 0), size_x);
+  unsigned int keep_y0 = std::min(std::max(start_y + 1, 0), size_y);
+  unsigned int keep_yn = std::min(std::max(end_y, 0), size_y);
+  if(keep_x0 >= keep_xn || keep_y0 >= keep_yn)
+    keep_x0 = keep_xn = keep_y0 = keep_yn = 0;
+
+  std::vector<unsigned char> keep;
+  unsigned int x0 = size_x, xn = 0, y0 = size_y, yn = 0;
+  costmap->clearCells(0, 0, size_x, keep_y0, NO_INFORMATION, keep, &x0, &xn, &y0, &yn);
+  costmap->clearCells(0, keep_y0, keep_x0, keep_yn, NO_INFORMATION, keep, &x0, &xn, &y0, &yn);
+  costmap->clearCells(keep_xn, keep_y0, size_x, keep_yn, NO_INFORMATION, keep, &x0, &xn, &y0, &yn);
+  costmap->clearCells(0, keep_yn, size_x, size_y, NO_INFORMATION, keep, &x0, &xn, &y0, &yn);
+
+  // only the cells that changed need to be updated, and re-inflated
+  if(x0 < xn && y0 < yn){
+    double ox = costmap->getOriginX(), oy = costmap->getOriginY(), resolution = costmap->getResolution();
+    costmap->addExtraBounds(ox + x0 * resolution, oy + y0 * resolution, ox + xn * resolution, oy + yn * resolution);
   }
-
-  double ox = costmap->getOriginX(), oy = costmap->getOriginY();
-  double width = costmap->getSizeInMetersX(), height = costmap->getSizeInMetersY();
-  costmap->addExtraBounds(ox, oy, ox + width, oy + height);
   return;
 }
 
@@ -0,0 +1,133 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_BLOCKED_COSTMAP_H_
+#define COSTMAP_2D_BLOCKED_COSTMAP_H_
+#include <costmap_2d/costmap_2d.h>
+#include <vector>
+
+namespace costmap_2d
+{
+
+/**
+ * @class BlockedCostmap
+ * @brief A copy of a costmap whose cells are stored in blocks of BLOCK_SIZE x BLOCK_SIZE cells.
+ *
+ * In a row-major costmap the cells above and below a cell are a whole row away, so a wavefront or a
+ * vertical line over a wide map touches a new cache line at every step. Within a block they are
+ * BLOCK_SIZE cells apart, and a block is a few pages. The blocks are laid out row-major, and the cells
+ * of each block row-major within it; the blocks at the right and top edges are padded.
+ *
+ * getIndex() and getCharMap() have the meaning they have for Costmap2D, in the blocked layout, so code
+ * written against those two works with either. update() and copyTo() translate to and from the
+ * row-major layout.
+ */
+class BlockedCostmap
+{
+public:
+  static const unsigned int BLOCK_BITS = 5;
+  static const unsigned int BLOCK_SIZE = 1 << BLOCK_BITS;  ///< @brief Side of a block, in cells
+
+  BlockedCostmap();
+
+  /** @brief A blocked copy of a costmap */
+  explicit BlockedCostmap(const Costmap2D& costmap);
+
+  /** @brief Resize to a costmap and copy all of its cells. */
+  void rebuild(const Costmap2D& costmap);
+
+  /**
+   * @brief Copy the cells of a costmap in [x0, xn) by [y0, yn).  A costmap of another size is copied
+   * in full.
+   */
+  void update(const Costmap2D& costmap, unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn);
+
+  /**
+   * @brief Copy all cells back into a row-major costmap.
+   * @return False if the costmap is of another size, which is left alone
+   */
+  bool copyTo(Costmap2D& costmap) const;
+
+  /** @brief Copy n cells of row y, from cell x on, into row, row-major. */
+  void copyRow(unsigned int x, unsigned int y, unsigned int n, unsigned char* row) const;
+
+  inline unsigned int getIndex(unsigned int mx, unsigned int my) const
+  {
+    return ((((my >> BLOCK_BITS) * blocks_x_ + (mx >> BLOCK_BITS)) << BLOCK_BITS | (my & (BLOCK_SIZE - 1)))
+            << BLOCK_BITS) | (mx & (BLOCK_SIZE - 1));
+  }
+
+  inline unsigned char getCost(unsigned int mx, unsigned int my) const
+  {
+    return cells_[getIndex(mx, my)];
+  }
+
+  inline void setCost(unsigned int mx, unsigned int my, unsigned char cost)
+  {
+    cells_[getIndex(mx, my)] = cost;
+  }
+
+  /** @brief The cells in the blocked layout, getIndex() of them apart */
+  unsigned char* getCharMap()
+  {
+    return cells_.empty() ? NULL : &cells_[0];
+  }
+
+  const unsigned char* getCharMap() const
+  {
+    return cells_.empty() ? NULL : &cells_[0];
+  }
+
+  unsigned int getSizeInCellsX() const
+  {
+    return size_x_;
+  }
+
+  unsigned int getSizeInCellsY() const
+  {
+    return size_y_;
+  }
+
+private:
+  /** @brief Resize to size_x by size_y cells.  Returns false if the size is the same. */
+  bool resize(unsigned int size_x, unsigned int size_y);
+
+  std::vector<unsigned char> cells_;
+  unsigned int size_x_, size_y_;
+  unsigned int blocks_x_;  ///< @brief Blocks per row of blocks
+};
+
+}  // namespace costmap_2d
+
+#endif  // COSTMAP_2D_BLOCKED_COSTMAP_H_
@@ -0,0 +1,153 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_CONFIGURATION_SPACE_H_
+#define COSTMAP_2D_CONFIGURATION_SPACE_H_
+#include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/layered_costmap.h>
+#include <geometry_msgs/Point.h>
+#include <stdint.h>
+#include <vector>
+
+namespace costmap_2d
+{
+
+/** @brief The cells a footprint covers in one row, [lo, hi] to the sides of its center, dy above it */
+struct FootprintSpan
+{
+  int dy, lo, hi;
+};
+
+/**
+ * @brief The cells a footprint covers at any yaw within half_bin of yaw, as one span per row, in cells of the given
+ * resolution from the cell of its center.  A footprint covers every cell it touches, and one of fewer than three points
+ * covers only the center.
+ */
+void rasterizeFootprint(const std::vector<geometry_msgs::Point>& footprint, double resolution, double yaw,
+                        double half_bin, std::vector<FootprintSpan>* spans);
+
+/**
+ * @class ConfigurationSpace
+ * @brief For each of a number of discrete headings, which cells of a costmap the robot cannot stand on.
+ *
+ * A cell is in collision at a heading if the footprint, turned to that heading and centered on the cell,
+ * covers a cell that is LETHAL_OBSTACLE or NO_INFORMATION, or reaches off the map. The footprint is
+ * taken at the middle and both edges of each heading's bin, and covers every cell it touches, so the
+ * answer errs on the side of a collision. A footprint of fewer than three points covers only its cell.
+ *
+ * The collisions of a cell are kept as one bit per heading, and are worked out again only around the
+ * cells of the master that changed, from counts of the blocking cells along each row. The caller holds
+ * the mutex of the master costmap while updating or reading.
+ */
+class ConfigurationSpace
+{
+public:
+  /**
+   * @brief  Constructor
+   * @param  num_headings The number of headings, from 1 to 32, the first of which is yaw 0
+   */
+  explicit ConfigurationSpace(unsigned int num_headings = 16);
+
+  unsigned int getNumHeadings() const
+  {
+    return num_headings_;
+  }
+
+  /** @brief Set the footprint, in the frame of the robot.  The next update is in full. */
+  void setFootprint(const std::vector<geometry_msgs::Point>& footprint);
+
+  /** @brief Work out the collisions of all cells of a master costmap again. */
+  void rebuild(const Costmap2D& master);
+
+  /**
+   * @brief  Work out again the collisions the cells of the master in [x0, xn) by [y0, yn) take part in.
+   * A master of another size, resolution or origin than the last one is done in full.
+   */
+  void update(const Costmap2D& master, unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn);
+
+  /** @brief Work out again the collisions around the regions the last updateMap() changed. */
+  void update(LayeredCostmap& layered_costmap);
+
+  /** @brief The heading whose bin a yaw falls in */
+  unsigned int getHeading(double yaw) const;
+
+  /** @brief The headings at which cell (mx, my) is in collision, one bit each */
+  uint32_t getCollisions(unsigned int mx, unsigned int my) const
+  {
+    return collisions_[my * size_x_ + mx];
+  }
+
+  bool inCollision(unsigned int mx, unsigned int my, unsigned int heading) const
+  {
+    return (getCollisions(mx, my) >> heading) & 1;
+  }
+
+  /** @brief Whether the robot at a pose in the frame of the master is in collision; off the map it is. */
+  bool inCollision(double wx, double wy, double yaw) const;
+
+private:
+  typedef FootprintSpan Span;
+
+  /** @brief Resize to a master costmap.  Returns false if it already matches it. */
+  bool matchMaster(const Costmap2D& master);
+
+  /** @brief Work out the spans of the footprint at each heading, at the resolution of the master. */
+  void computeSpans();
+
+  /** @brief Count the blocking cells of row y of the master again, from cell x0 on. */
+  void countRow(const Costmap2D& master, unsigned int y, unsigned int x0);
+
+  /** @brief Work out the collisions of the cells in [x0, xn) by [y0, yn) again, clamped to the map. */
+  void recompute(int x0, int xn, int y0, int yn);
+
+  /** @brief The collisions of cell (x, y) at all headings */
+  uint32_t collisions(int x, int y) const;
+
+  unsigned int num_headings_;
+  std::vector<geometry_msgs::Point> footprint_;
+  bool stale_;  ///< @brief The footprint changed since the last update
+
+  std::vector<std::vector<Span> > spans_;  ///< @brief The spans of the footprint, by heading
+  int min_dy_, max_dy_, min_lo_, max_hi_;  ///< @brief How far the spans reach at any heading
+
+  std::vector<uint32_t> collisions_;  ///< @brief Bit h of a cell is set if it is in collision at heading h
+  std::vector<uint32_t> blocking_;  ///< @brief Blocking cells of each row left of x, at y * (size_x + 1) + x
+
+  unsigned int size_x_, size_y_;
+  double origin_x_, origin_y_, resolution_;
+};
+
+}  // namespace costmap_2d
+
+#endif  // COSTMAP_2D_CONFIGURATION_SPACE_H_
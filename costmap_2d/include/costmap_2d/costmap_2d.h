@@ -38,10 +38,16 @@
 #ifndef COSTMAP_2D_COSTMAP_2D_H_
 #define COSTMAP_2D_COSTMAP_2D_H_
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
 #include <vector>
 #include <queue>
 #include <geometry_msgs/Point.h>
 #include <boost/thread.hpp>
+#include <nav_executor/memory.h>
 
 namespace costmap_2d
 {
@@ -53,6 +59,15 @@ struct MapLocation
   unsigned int y;
 };
 
+// A box in world coordinates, as the area to update is passed between layers
+struct Bounds
+{
+  double min_x;
+  double min_y;
+  double max_x;
+  double max_y;
+};
+
 /**
  * @class Costmap2D
  * @brief A 2D costmap provides a mapping between points in the world and their associated "costs".
@@ -86,6 +101,14 @@ public:
    */
   Costmap2D& operator=(const Costmap2D& map);
 
+  /**
+   * @brief  Bring this copy of a costmap up to date with it, copying only the cells changed since the version
+   *         it was last brought up to if the size and origin are the same, and the whole map otherwise
+   * @param  map The costmap to copy, which the caller has locked
+   * @param  version The version of map this copy is of, updated
+   */
+  void updateCopy(const Costmap2D& map, unsigned long& version);
+
   /**
    * @brief  Turn this costmap into a copy of a window of a costmap passed in
    * @param  map The costmap to copy
@@ -191,6 +214,29 @@ public:
    */
   unsigned char* getCharMap() const;
 
+  /**
+   * @brief  Record that the cells [x0, xn) by [y0, yn) may have changed, for the users of the costs that keep
+   *         something computed from them.  The costmap records what its own functions change, but for
+   *         setCost(); cells written through setCost() or getCharMap() outside of a map update are
+   *         recorded by the writer.
+   */
+  void recordChange(unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn);
+
+  /**
+   * @brief  The number of changes recorded so far, which stands for the version of the costs
+   */
+  unsigned long getVersion() const
+  {
+    return version_;
+  }
+
+  /**
+   * @brief  Get the box of the cells changed since a version, [*x0, *xn) by [*y0, *yn); empty if none were
+   * @return False if the version is too old for the changes since to be known, and any cell may have changed
+   */
+  bool getChangesSince(unsigned long version, unsigned int* x0, unsigned int* xn, unsigned int* y0,
+                       unsigned int* yn) const;
+
   /**
    * @brief  Accessor for the x size of the costmap in cells
    * @return The x size of the costmap
@@ -238,6 +284,14 @@ public:
     default_value_ = c;
   }
 
+  /**
+   * @brief  Count the cells under the given component of the memory accounting, costmap_2d until set
+   */
+  void setMemoryComponent(const std::string& component)
+  {
+    memory_.setComponent(component);
+  }
+
   unsigned char getDefaultValue()
   {
     return default_value_;
@@ -251,6 +305,25 @@ public:
    */
   bool setConvexPolygonCost(const std::vector<geometry_msgs::Point>& polygon, unsigned char cost_value);
 
+  /**
+   * @brief  Sets the cells of a convex polygon to a value row by row, except for those holding one of the
+   *         costs to keep, e.g. LETHAL_OBSTACLE to clear all but the obstacles
+   * @param polygon The polygon in world coordinates, which must lie within the map
+   * @param value The value to set costs to
+   * @param keep The costs to leave alone
+   * @return True if the polygon was cleared... false if it lies outside the map
+   */
+  bool clearRegion(const std::vector<geometry_msgs::Point>& polygon, unsigned char value,
+                   const std::vector<unsigned char>& keep);
+
+  /**
+   * @brief  Sets the cells [x0, xn) by [y0, yn) to a value row by row, like clearRegion(), and widens the
+   *         given bounds of the changed cells, [*min_x, *max_x) by [*min_y, *max_y), by the cells it changed
+   */
+  void clearCells(unsigned int x0, unsigned int y0, unsigned int xn, unsigned int yn, unsigned char value,
+                  const std::vector<unsigned char>& keep, unsigned int* min_x, unsigned int* max_x,
+                  unsigned int* min_y, unsigned int* max_y);
+
   /**
    * @brief  Get the map cells that make up the outline of a polygon
    * @param polygon The polygon in map coordinates to rasterize
@@ -278,6 +351,29 @@ public:
    */
   bool saveMap(std::string file_name);
 
+  /** @brief Further costmaps of the same size to keep in a snapshot, by name, e.g. the planes of the layers */
+  typedef std::map<std::string, Costmap2D*> SnapshotPlanes;
+
+  /**
+   * @brief  Save the costmap, with its size, resolution and origin, to a compact binary snapshot.
+   *
+   * The costs are kept exactly, run length coded in square tiles, so that a mostly uniform map
+   * is small and quick to write.  The file is written under a temporary name and renamed into place.
+   * @param file_name The name of the file to save
+   * @param planes Further costmaps to save along, which must have the size of this one
+   * @return False if the file could not be written, or a plane does not fit
+   */
+  bool saveSnapshot(const std::string& file_name, const SnapshotPlanes& planes = SnapshotPlanes());
+
+  /**
+   * @brief  Restore a costmap saved by saveSnapshot(), resizing this one to it.
+   * @param file_name The name of the file to load
+   * @param planes Costmaps to restore the planes of the same name into; they are resized as well.
+   * Planes of the file that are not asked for are skipped, and asked for ones that are missing kept as they are.
+   * @return False if the file is missing or corrupt, in which case this costmap is unchanged
+   */
+  bool loadSnapshot(const std::string& file_name, const SnapshotPlanes& planes = SnapshotPlanes());
+
   void resizeMap(unsigned int size_x, unsigned int size_y, double resolution, double origin_x,
                  double origin_y);
 
@@ -330,6 +426,47 @@ protected:
       }
     }
 
+  /**
+   * @brief  Shift a map in place, so that each cell takes the value of the cell offset from it,
+   *         and fill the cells that have nothing to take over
+   * @param  map The map
+   * @param size_x The x size of the map
+   * @param size_y The y size of the map
+   * @param offset_x The x offset, in cells, of the cell whose value each cell takes
+   * @param offset_y The y offset, in cells, of the cell whose value each cell takes
+   * @param fill The value of the cells that have no counterpart on the map
+   */
+  template<typename data_type>
+    void shiftMapRegion(data_type* map, unsigned int size_x, unsigned int size_y, int offset_x, int offset_y,
+                        data_type fill)
+    {
+      int keep_x = std::max(0, int(size_x) - std::abs(offset_x));
+      int keep_y = std::max(0, int(size_y) - std::abs(offset_y));
+      if (keep_x == 0 || keep_y == 0)
+      {
+        std::fill(map, map + size_x * size_y, fill);
+        return;
+      }
+
+      int src_x = std::max(0, offset_x), dst_x = std::max(0, -offset_x);
+      int src_y = std::max(0, offset_y), dst_y = std::max(0, -offset_y);
+
+      // move the rows in the order that never overwrites a row still to be read, clearing
+      // the strips of them that are uncovered
+      for (int n = 0; n < keep_y; ++n)
+      {
+        int row = offset_y >= 0 ? n : keep_y - 1 - n;
+        data_type* dst = map + (dst_y + row) * size_x;
+        memmove(dst + dst_x, map + (src_y + row) * size_x + src_x, keep_x * sizeof(data_type));
+        std::fill(dst, dst + dst_x, fill);
+        std::fill(dst + dst_x + keep_x, dst + size_x, fill);
+      }
+
+      // and clear the rows that are uncovered as a whole
+      std::fill(map, map + dst_y * size_x, fill);
+      std::fill(map + (dst_y + keep_y) * size_x, map + size_x * size_y, fill);
+    }
+
   /**
    * @brief  Deletes the costmap, static_map, and markers data structures
    */
@@ -341,7 +478,10 @@ protected:
   virtual void resetMaps();
 
   /**
-   * @brief  Initializes the costmap, static_map, and markers data structures
+   * @brief  Initializes the costmap, static_map, and markers data structures.
+   * Maps of 16 MB of cells and more get them in pages that the system
+   * only allocates once written to, so that the parts of a large map
+   * that keep the default value take no memory.
    * @param size_x The x size to use for map initialization
    * @param size_y The y size to use for map initialization
    */
@@ -416,6 +556,37 @@ private:
     return x > 0 ? 1.0 : -1.0;
   }
 
+  /**
+   * @brief  The cells filled for a polygon by convexFillCells(), which only depend on the offsets
+   *         between its vertices, so they are kept relative to the first vertex
+   */
+  struct PolygonFill
+  {
+    std::vector<int> shape;  ///< @brief x and y offsets of each vertex from the first one
+    std::vector<int> cells;  ///< @brief x and y offsets of each filled cell from the first vertex
+  };
+
+  static const unsigned int POLYGON_FILL_CACHE_SIZE = 16;
+  std::vector<PolygonFill> polygon_fills_;  ///< @brief The fills of the polygons setConvexPolygonCost() saw last
+  unsigned int next_polygon_fill_;  ///< @brief The entry of polygon_fills_ to replace next
+
+  /** @brief Free the cells of costmap_, however they were allocated. */
+  void freeCells();
+
+  /** @brief clearCells() without recording the change, which is left to the caller. */
+  void clearRows(unsigned int x0, unsigned int y0, unsigned int xn, unsigned int yn, unsigned char value,
+                 const std::vector<unsigned char>& keep, unsigned int* min_x, unsigned int* max_x,
+                 unsigned int* min_y, unsigned int* max_y);
+
+  static const unsigned int CHANGE_HISTORY = 32;
+  unsigned long version_;  ///< @brief The number of changes recorded
+  unsigned int changes_[CHANGE_HISTORY][4];  ///< @brief The last changes recorded, x0, xn, y0, yn, by version
+
+  /** @brief Fill costmap_ with value by mapping it, if it was allocated lazily.  Returns false if not. */
+  bool mapUniformCells(unsigned char value);
+
+  size_t mapped_size_;  ///< @brief The bytes mapped for costmap_ if it was allocated lazily, else 0
+  nav_executor::MemoryCounter memory_;  ///< @brief Counts the bytes allocated for costmap_
   mutex_t* access_;
 protected:
   unsigned int size_x_;
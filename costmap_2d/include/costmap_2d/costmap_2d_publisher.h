@@ -42,6 +42,7 @@
 #include <nav_msgs/OccupancyGrid.h>
 #include <map_msgs/OccupancyGridUpdate.h>
 #include <tf/transform_datatypes.h>
+#include <vector>
 
 namespace costmap_2d
 {
@@ -87,9 +88,49 @@ public:
   }
 
 private:
-  /** @brief Prepare grid_ message for publication. */
+  /** @brief A rectangle of cells, [x0, xn) by [y0, yn). */
+  struct Region
+  {
+    unsigned int x0, xn, y0, yn;
+  };
+
+  /** @brief Prepare grid_ message for publication, and record the whole map as published. */
   void prepareGrid();
 
+  /**
+   * @brief  Fill in the header of a full grid message and take a copy of the costs; the
+   *         costmap must be locked
+   */
+  void fillGridInfo(nav_msgs::OccupancyGrid& grid, std::vector<unsigned char>& costs);
+
+  /**
+   * @brief  Copy the given bounds of the costmap, widened to whole tiles, into snapshot_; the
+   *         costmap must be locked
+   * @return False if the costmap no longer has the size of grid_
+   */
+  bool takeSnapshot(unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn);
+
+  /**
+   * @brief  Find the tiles in the given bounds of snapshot_ whose cells differ from the ones
+   *         last published, merged into as few rectangles as the tile layout allows
+   */
+  void findDirtyRegions(unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn,
+                        std::vector<Region>& regions);
+
+  /** @brief Check whether any cell of the given tile of snapshot_ differs from the one last published. */
+  bool isTileDirty(unsigned int tx, unsigned int ty);
+
+  /**
+   * @brief  Translate a region of snapshot_ into a message buffer, and record it as published
+   * @param  region The region of the costmap
+   * @param  data The message cell of the lower left corner of the region
+   * @param  data_size_x The x size of the message
+   */
+  void translateRegion(const Region& region, int8_t* data, unsigned int data_size_x);
+
+  /** @brief Translate n costs into message values. */
+  static void translateCosts(const unsigned char* costs, int8_t* data, unsigned int n);
+
   /** @brief Publish the latest full costmap to the new subscriber. */
   void onNewSubscription(const ros::SingleSubscriberPublisher& pub);
 
@@ -103,6 +144,10 @@ private:
   ros::Publisher costmap_pub_;
   ros::Publisher costmap_update_pub_;
   nav_msgs::OccupancyGrid grid_;
+  std::vector<unsigned char> published_;  ///< The costs as last published, to tell which tiles have changed since.
+  std::vector<unsigned char> snapshot_;  ///< The costs being published, copied so the costmap is not locked meanwhile.
+  static const unsigned int TILE_SIZE = 64;  ///< Side of the tiles changes are tracked in, in cells.
+  static const unsigned int MAX_UPDATES = 8;  ///< Most update messages sent per cycle before merging them into one.
   static char* cost_translation_table_;  ///< Translate from 0-255 values in costmap to -1 to 100 values in message.
 };
 }  // namespace costmap_2d
@@ -41,12 +41,20 @@
 #include <costmap_2d/layered_costmap.h>
 #include <costmap_2d/layer.h>
 #include <costmap_2d/costmap_2d_publisher.h>
+#include <costmap_2d/update_stats_publisher.h>
+#include <costmap_2d/costmap_pyramid.h>
+#include <costmap_2d/configuration_space.h>
+#include <costmap_2d/footprint_checker.h>
+#include <costmap_2d/shared_costmap.h>
 #include <costmap_2d/Costmap2DConfig.h>
+#include <costmap_2d/CheckFootprints.h>
 #include <costmap_2d/footprint.h>
 #include <geometry_msgs/Polygon.h>
 #include <geometry_msgs/PolygonStamped.h>
 #include <dynamic_reconfigure/server.h>
 #include <pluginlib/class_loader.h>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
 
 class SuperValue : public XmlRpc::XmlRpcValue
 {
@@ -104,6 +112,16 @@ public:
 
   void updateMap();
 
+  /**
+   * @brief  Lets the map update no more often than the given frequency, for while no one needs it fresh
+   * @param frequency The frequency in Hz to update at, when below update_frequency, or 0 to go back to
+   * update_frequency from the next cycle on
+   */
+  void throttleUpdates(double frequency)
+  {
+    throttle_frequency_ = frequency;
+  }
+
   /**
    * @brief Reset each individual layer
    */
@@ -116,7 +134,8 @@ public:
     }
 
   /**
-   * @brief Get the pose of the robot in the global frame of the costmap
+   * @brief Get the pose of the robot in the global frame of the costmap. With robot_pose_cache_time set, a
+   * pose looked up less than that long ago is handed out again without a tf lookup.
    * @param global_pose Will be set to the pose of the robot in the global frame of the costmap
    * @return True if the pose was set successfully, false otherwise
    */
@@ -130,6 +149,48 @@ public:
       return layered_costmap_->getCostmap();
     }
 
+  /**
+   * @brief  Return a read-only copy of the master costmap as of the last completed update.
+   *
+   * The copy is never written to while anyone holds on to it, so it can be read without
+   * taking its lock and without blocking the map update thread.  Copies are only made once
+   * this has been called; the first call takes its copy on the spot, and from then on a new
+   * one is published after each update.
+   */
+  boost::shared_ptr<const Costmap2D> getCostmapSnapshot();
+
+  /**
+   * @brief  Return the coarse levels of the master costmap, updated after each update of the map,
+   * or NULL unless the pyramid_levels parameter asked for them.  Lock the mutex of the pyramid to read it.
+   */
+  CostmapPyramid* getCostmapPyramid()
+    {
+      return pyramid_;
+    }
+
+  /**
+   * @brief  Return the cells the padded footprint collides on, by heading, updated after each update of the map,
+   * or NULL unless the cspace_headings parameter asked for them.  Lock the mutex of the master costmap to read it.
+   */
+  ConfigurationSpace* getConfigurationSpace()
+    {
+      return cspace_;
+    }
+
+  /**
+   * @brief  Check the padded footprint, or the footprints given, at each of a number of poses against the master
+   * costmap, as FootprintChecker::check() does.  The mutex of the master costmap is held for the check, which is
+   * also offered as the check_footprints service.
+   * @param poses The poses, in the global frame of the costmap
+   * @param footprints None, for the padded footprint at every pose, or one per pose, an empty one for the padded
+   * footprint
+   * @param max_clearance How far around each footprint to look for lethal cells, in meters
+   * @param results Set to one check per pose
+   */
+  void checkFootprints(const std::vector<geometry_msgs::Pose2D>& poses,
+                       const std::vector<std::vector<geometry_msgs::Point> >& footprints, double max_clearance,
+                       std::vector<FootprintCheck>* results);
+
   /**
    * @brief  Returns the global frame of the costmap
    * @return The global frame of the costmap
@@ -220,6 +281,10 @@ protected:
   std::string global_frame_;  ///< @brief The global frame for the costmap
   std::string robot_base_frame_;  ///< @brief The frame_id of the robot base
   double transform_tolerance_;  ///< timeout before transform errors
+  double pose_cache_time_;  ///< @brief How long a looked up robot pose is reused for, 0 for not at all
+  mutable boost::mutex pose_cache_mutex_;  ///< @brief Guards the cached pose, which getRobotPose() updates
+  mutable tf::Stamped<tf::Pose> cached_pose_;
+  mutable ros::Time cached_pose_time_;  ///< @brief When cached_pose_ was looked up, zero for never
 
 private:
   /** @brief Set the footprint from the new_config object.
@@ -233,19 +298,68 @@ private:
   void reconfigureCB(costmap_2d::Costmap2DConfig &config, uint32_t level);
   void movementCB(const ros::TimerEvent &event);
   void mapUpdateLoop(double frequency);
+
+  /**
+   * @brief In the event driven mode, wait until the map needs an update: a layer has new data, the
+   * robot moved or the map has gone max_update_staleness_ without one.
+   * @param period The shortest time between updates, which is also how often the robot pose is checked
+   * @return Whether to update now; false means to check again
+   */
+  bool waitForUpdate(double period);
+
+  /**
+   * @brief Whether the update is being held back, by throttleUpdates() or by the robot standing still,
+   * until the slower rate is due
+   */
+  bool updatesThrottled();
+
+  /** @brief Say which layer took longest in the last update, for when the loop misses its rate. */
+  void logSlowestLayer();
+
+  /** @brief Publish a copy of the master costmap for getCostmapSnapshot(). */
+  void updateSnapshot();
+
+  /**
+   * @brief  Add a function to run after each update of the map, with the mutex of the master costmap held, say to
+   * look at which cells the update changed through LayeredCostmap::getUpdatedRegions().  It runs on the map update
+   * thread, so it should be quick.
+   */
+  void addUpdateCallback(const boost::function<void(LayeredCostmap&)>& callback);
+
+  bool checkFootprintsService(CheckFootprints::Request& req, CheckFootprints::Response& resp);
+
   bool map_update_thread_shutdown_;
   bool stop_updates_, initialized_, stopped_, robot_stopped_;
   boost::thread* map_update_thread_;  ///< @brief A thread for updating the map
   ros::Timer timer_;
   ros::Time last_publish_;
   ros::Duration publish_cycle;
+  bool event_driven_;  ///< @brief Whether to update on new data rather than at a fixed rate
+  double max_update_staleness_;  ///< @brief Longest time without an update in the event driven mode, 0 for no limit
+  ros::Time last_update_time_;
+  boost::atomic<double> throttle_frequency_;  ///< @brief The rate set by throttleUpdates() from any thread, 0 for none
+  double stationary_update_frequency_;  ///< @brief The rate while the robot is stopped, 0 for none
+  ros::Time last_map_update_;  ///< @brief When updateMap() last ran in the update loop
+  tf::Stamped<tf::Pose> last_update_pose_;
   pluginlib::ClassLoader<Layer> plugin_loader_;
   tf::Stamped<tf::Pose> old_pose_;
   Costmap2DPublisher* publisher_;
+  UpdateStatsPublisher* stats_publisher_;
+  CostmapPyramid* pyramid_;  ///< @brief Coarse levels of the master costmap, if any
+  ConfigurationSpace* cspace_;  ///< @brief Collisions of the footprint by heading, if any
+  FootprintChecker footprint_checker_;  ///< @brief Guarded by the mutex of the master costmap
+  ros::ServiceServer check_footprints_srv_;
+  std::vector<boost::function<void(LayeredCostmap&)> > update_callbacks_;  ///< @brief Guarded by the mutex of the master costmap
+  SharedCostmapPublisher* shared_publisher_;  ///< @brief Shared-memory copy of the master costmap, if any
   dynamic_reconfigure::Server<costmap_2d::Costmap2DConfig> *dsrv_;
 
   boost::recursive_mutex configuration_mutex_;
 
+  boost::mutex snapshot_mutex_;  ///< @brief Guards the snapshot pointers, not the snapshots
+  bool snapshots_enabled_;
+  boost::shared_ptr<Costmap2D> snapshot_;  ///< @brief The latest copy, handed out by getCostmapSnapshot()
+  boost::shared_ptr<Costmap2D> spare_snapshot_;  ///< @brief The previous copy, reused once no reader holds it
+
   ros::Subscriber footprint_sub_;
   ros::Publisher footprint_pub_;
   bool got_footprint_;
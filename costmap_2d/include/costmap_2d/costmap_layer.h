@@ -69,6 +69,15 @@ public:
    */
   void addExtraBounds(double mx0, double my0, double mx1, double my1);
 
+  /*
+   * The rules of the update methods below for n cells of a row, from layer
+   * into master, for layers that merge their own way too. Cells of the master
+   * that keep their value are not written. With SSE2 they take 16 cells at a time.
+   */
+  static void maxRow(unsigned char* master, const unsigned char* layer, unsigned int n);
+  static void overwriteRow(unsigned char* master, const unsigned char* layer, unsigned int n);
+  static void additionRow(unsigned char* master, const unsigned char* layer, unsigned int n);
+
 protected:
   /*
    * Updates the master_grid within the specified
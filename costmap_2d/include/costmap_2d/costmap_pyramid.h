@@ -0,0 +1,111 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_COSTMAP_PYRAMID_H_
+#define COSTMAP_2D_COSTMAP_PYRAMID_H_
+#include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/layered_costmap.h>
+#include <vector>
+
+namespace costmap_2d
+{
+
+/**
+ * @class CostmapPyramid
+ * @brief Coarser copies of a costmap, each cell of a level pooling 2x2 cells of the level below.
+ *
+ * Level l has cells of 2^l x 2^l cells of the master costmap and the same origin. A pooled cell takes the
+ * highest cost of the cells it covers, except that LETHAL_OBSTACLE beats NO_INFORMATION, so a coarse cell is
+ * never less restrictive than any cell it covers. The pyramid itself is level 1; getLevel() returns the others.
+ * All levels are guarded by the mutex of the pyramid.
+ */
+class CostmapPyramid : public Costmap2D
+{
+public:
+  /**
+   * @brief  Constructor for a pyramid
+   * @param  num_levels The number of coarse levels, at least 1
+   */
+  explicit CostmapPyramid(unsigned int num_levels = 3);
+
+  virtual ~CostmapPyramid();
+
+  /** @brief The number of coarse levels; getLevel() takes 1 to getNumLevels(). */
+  unsigned int getNumLevels() const
+  {
+    return levels_.size();
+  }
+
+  /**
+   * @brief  Get a coarse level
+   * @param  level The level, whose cells are 2^level cells of the master wide
+   * @return The level, or NULL if there is no such level
+   */
+  Costmap2D* getLevel(unsigned int level);
+
+  /**
+   * @brief  Pool the cells of a master costmap again, e.g. after it was reset or resized.
+   * The caller holds the mutex of the master.
+   */
+  void rebuild(const Costmap2D& master);
+
+  /**
+   * @brief  Pool again the cells of the master costmap in [x0, xn) by [y0, yn). A master of another size,
+   * resolution or origin than the last one is pooled in full. The caller holds the mutex of the master.
+   */
+  void update(const Costmap2D& master, unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn);
+
+  /**
+   * @brief  Pool again the regions the last updateMap() of the layered costmap changed.
+   * The caller holds the mutex of its costmap.
+   */
+  void update(LayeredCostmap& layered_costmap);
+
+private:
+  /** @brief Resize the levels to a master costmap.  Returns false if they already match it. */
+  bool matchMaster(const Costmap2D& master);
+
+  /** @brief Pool [x0, xn) by [y0, yn) of the fine map into the coarse one, in the cells of the fine map. */
+  static void pool(const Costmap2D& fine, Costmap2D& coarse, unsigned int x0, unsigned int xn,
+                   unsigned int y0, unsigned int yn);
+
+  std::vector<Costmap2D*> levels_;  ///< @brief Level l + 1 is levels_[l]; levels_[0] is this pyramid
+  double master_origin_x_, master_origin_y_;
+  double master_resolution_;
+  unsigned int master_size_x_, master_size_y_;
+};
+
+}  // namespace costmap_2d
+
+#endif  // COSTMAP_2D_COSTMAP_PYRAMID_H_
@@ -0,0 +1,145 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_COSTMAP_SERVER_H_
+#define COSTMAP_2D_COSTMAP_SERVER_H_
+#include <costmap_2d/layered_costmap.h>
+#include <costmap_2d/layer.h>
+#include <costmap_2d/costmap_2d_publisher.h>
+#include <costmap_2d/shared_costmap.h>
+#include <pluginlib/class_loader.h>
+#include <tf/transform_listener.h>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+namespace costmap_2d
+{
+
+/**
+ * @class BaseCostmapLayer
+ * @brief A layer that copies in the cells another LayeredCostmap, of the same size, changed in its last update.
+ *
+ * The base is read under its mutex, after its updateMap() and before that of the costmap of this layer. The
+ * costmap of this layer is resized to the base by its owner; the next update then copies all of it.
+ */
+class BaseCostmapLayer : public Layer
+{
+public:
+  explicit BaseCostmapLayer(LayeredCostmap* base) : base_(base), full_(true) {}
+
+  virtual void updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds);
+  virtual void updateCosts(Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
+
+  virtual void matchSize()
+  {
+    full_ = true;
+  }
+
+  virtual void reset()
+  {
+    full_ = true;
+  }
+
+private:
+  LayeredCostmap* base_;
+  bool full_;  ///< @brief Copy the whole base on the next update
+};
+
+/**
+ * @class CostmapServer
+ * @brief One base costmap, e.g. of static and obstacle layers, shared by a view of it for each class of footprint,
+ * which adds its own layers, e.g. an inflation layer, for that footprint.
+ *
+ * Robots of the same footprint class subscribe to the view of their class, on the costmap and costmap_updates
+ * topics under ~<name>/<class>/, or read it through shared memory on the same host, rather than each keeping the same
+ * global costmap. The base is updated once per cycle and each view copies only the cells it changed, so the work
+ * grows with the number of footprint classes rather than of robots.
+ *
+ * Parameters, under ~<name>/:
+ *   global_frame, update_frequency, publish_frequency, track_unknown_space, always_send_full_costmap
+ *                   as for Costmap2DROS
+ *   base/plugins    the layers of the base, as the plugins of Costmap2DROS, with parameters under base/<layer>
+ *   footprint_classes  the names of the classes
+ *   <class>/footprint, <class>/robot_radius, <class>/footprint_padding  the footprint of a class
+ *   <class>/plugins    the layers of a view above the base, by default one costmap_2d::InflationLayer named
+ *                   inflation, with parameters under <class>/<layer>
+ *   <class>/shared_memory_name  share the view with SharedCostmapReader, or GlobalWindowLayer, if not empty
+ */
+class CostmapServer
+{
+public:
+  CostmapServer(const std::string& name, tf::TransformListener& tf);
+  ~CostmapServer();
+
+  /** @brief Update the base, then each view from it, and publish the views. */
+  void updateMap();
+
+  LayeredCostmap* getBase()
+  {
+    return base_;
+  }
+
+  /** @brief The view of a footprint class, or NULL if there is no such class */
+  LayeredCostmap* getView(const std::string& footprint_class);
+
+private:
+  /** @brief A view of the base for one footprint class */
+  struct View
+  {
+    std::string name;
+    LayeredCostmap* layers;
+    Costmap2DPublisher* publisher;
+    SharedCostmapPublisher* shared_publisher;
+  };
+
+  /** @brief Add the plugins listed in the plugins parameter of nh to layers, named under prefix. */
+  void loadPlugins(LayeredCostmap* layers, ros::NodeHandle& nh, const std::string& prefix, bool default_inflation);
+
+  void updateLoop(double frequency, double publish_frequency);
+
+  std::string name_;
+  tf::TransformListener& tf_;
+  std::string global_frame_;
+  pluginlib::ClassLoader<Layer> plugin_loader_;
+  LayeredCostmap* base_;
+  std::vector<View> views_;
+  ros::Time last_publish_;
+  boost::thread* update_thread_;
+  bool shutdown_;
+};
+
+}  // namespace costmap_2d
+
+#endif  // COSTMAP_2D_COSTMAP_SERVER_H_
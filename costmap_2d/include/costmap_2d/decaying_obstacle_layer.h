@@ -0,0 +1,104 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#ifndef COSTMAP_2D_DECAYING_OBSTACLE_LAYER_H_
+#define COSTMAP_2D_DECAYING_OBSTACLE_LAYER_H_
+
+#include <costmap_2d/obstacle_layer.h>
+#include <vector>
+
+namespace costmap_2d
+{
+
+/**
+ * @class DecayingObstacleLayer
+ * @brief An obstacle layer whose marks expire a while after they were last seen, for dense sensors that
+ * would cost far more to clear by raytracing than to mark.
+ *
+ * Sources flagged as clearing are still raytraced, but only at clearing_rate and through every
+ * clearing_subsample-th point. The work of expiring the marks is bounded by the number of cells marked.
+ */
+class DecayingObstacleLayer : public ObstacleLayer
+{
+public:
+  DecayingObstacleLayer() :
+      decay_time_(5.0), clearing_rate_(1.0), clearing_subsample_(4)
+  {
+    costmap_ = NULL;  // this is the unsigned char* member of parent class's parent class Costmap2D.
+  }
+
+  virtual void onInitialize();
+  virtual void matchSize();
+  virtual void updateOrigin(double new_origin_x, double new_origin_y);
+
+protected:
+  virtual void resetMaps();
+  virtual void collectBounds(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds);
+
+  /**
+   * @brief  Mark the points of an observation as obstacles, as ObstacleLayer::markObservation() does, noting when
+   * @param obs The observation
+   * @param seen When the cells are seen, in seconds since epoch_
+   * @param min_x
+   * @param min_y
+   * @param max_x
+   * @param max_y
+   */
+  void markAndStamp(const costmap_2d::Observation& obs, float seen, double* min_x, double* min_y, double* max_x,
+                    double* max_y);
+
+  /**
+   * @brief  Free the marked cells that have not been seen for decay_time_
+   * @param now The time, in seconds since epoch_
+   * @param min_x
+   * @param min_y
+   * @param max_x
+   * @param max_y
+   */
+  void expireMarks(float now, double* min_x, double* min_y, double* max_x, double* max_y);
+
+  double decay_time_;  ///< @brief Seconds after which a mark that has not been seen again is freed
+  double clearing_rate_;  ///< @brief How often the clearing sources are raytraced, in Hz, or 0 for never
+  int clearing_subsample_;  ///< @brief Every how many points of a clearing observation a ray is traced to
+
+  ros::Time epoch_;  ///< @brief What the stamps are relative to, moved on now and then to keep them precise
+  ros::Time last_clearing_;  ///< @brief When the clearing sources were last raytraced
+  std::vector<float> last_seen_;  ///< @brief When each cell was last marked, or negative if it is not
+  std::vector<unsigned int> marked_cells_;  ///< @brief The cells with a stamp, in no order
+};
+
+}  // namespace costmap_2d
+
+#endif  // COSTMAP_2D_DECAYING_OBSTACLE_LAYER_H_
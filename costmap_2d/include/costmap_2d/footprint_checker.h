@@ -0,0 +1,104 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_FOOTPRINT_CHECKER_H_
+#define COSTMAP_2D_FOOTPRINT_CHECKER_H_
+#include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/configuration_space.h>
+#include <geometry_msgs/Point.h>
+#include <geometry_msgs/Pose2D.h>
+#include <vector>
+
+namespace costmap_2d
+{
+
+/** @brief What a footprint covers at one pose */
+struct FootprintCheck
+{
+  unsigned char max_cost;  ///< @brief The highest cost under the footprint, NO_INFORMATION if it leaves the map
+  bool lethal;  ///< @brief Whether the footprint covers a LETHAL_OBSTACLE cell
+  double clearance;  ///< @brief Distance from the footprint to the nearest lethal cell, up to the limit asked for
+};
+
+/**
+ * @class FootprintChecker
+ * @brief Checks a footprint at many poses against a costmap at once, e.g. the candidate poses of a task scheduler.
+ *
+ * The footprint of the robot is rasterized once for each of a number of headings, as by ConfigurationSpace, so a pose
+ * costs one read per cell under it. A pose may also bring a footprint of its own, rasterized for it alone. The poses
+ * are checked in parallel on the shared executor, and the caller holds the mutex of the costmap throughout.
+ */
+class FootprintChecker
+{
+public:
+  /**
+   * @brief  Constructor
+   * @param  num_headings The number of headings the footprint of the robot is rasterized for
+   */
+  explicit FootprintChecker(unsigned int num_headings = 64);
+
+  /** @brief Set the footprint of the robot, in its own frame. */
+  void setFootprint(const std::vector<geometry_msgs::Point>& footprint);
+
+  /**
+   * @brief Check a footprint at each pose, in the frame of the costmap.
+   * @param footprints Either none, for the footprint of the robot at every pose, or one per pose, an empty one
+   * standing for the footprint of the robot
+   * @param max_clearance How far around the footprint to look for lethal cells, in meters
+   * @param results Set to one check per pose
+   */
+  void check(const Costmap2D& costmap, const std::vector<geometry_msgs::Pose2D>& poses,
+             const std::vector<std::vector<geometry_msgs::Point> >& footprints, double max_clearance,
+             std::vector<FootprintCheck>* results);
+
+private:
+  /** @brief Check a footprint, covering the cells of spans from the cell of the pose. */
+  static void checkPose(const Costmap2D& costmap, const geometry_msgs::Pose2D& pose,
+                        const std::vector<geometry_msgs::Point>& footprint, const std::vector<FootprintSpan>& spans,
+                        double max_clearance, FootprintCheck* result);
+
+  /** @brief Check the poses of one task of check() */
+  void checkRange(const Costmap2D* costmap, const std::vector<geometry_msgs::Pose2D>* poses,
+                  const std::vector<std::vector<geometry_msgs::Point> >* footprints, double max_clearance,
+                  std::vector<FootprintCheck>* results, unsigned int num_tasks, unsigned int task) const;
+
+  unsigned int num_headings_;
+  std::vector<geometry_msgs::Point> footprint_;
+  double templates_resolution_;  ///< @brief The resolution of templates_, 0 until they are built
+  std::vector<std::vector<FootprintSpan> > templates_;  ///< @brief The cells of the footprint, by heading
+};
+
+}  // namespace costmap_2d
+
+#endif  // COSTMAP_2D_FOOTPRINT_CHECKER_H_
@@ -0,0 +1,103 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#ifndef COSTMAP_2D_GLOBAL_WINDOW_LAYER_H_
+#define COSTMAP_2D_GLOBAL_WINDOW_LAYER_H_
+
+#include <costmap_2d/costmap_layer.h>
+#include <costmap_2d/shared_costmap.h>
+#include <costmap_2d/GenericPluginConfig.h>
+#include <dynamic_reconfigure/server.h>
+#include <string>
+#include <vector>
+
+namespace costmap_2d
+{
+
+/**
+ * @class GlobalWindowLayer
+ * @brief Copies in the part of another costmap under this one, as shared by the shared_memory_name of its
+ * Costmap2DROS, e.g. the window of the global costmap under a rolling local one, so that the local costmap
+ * need not interpret and inflate the static map again.
+ *
+ * Cells are only copied when the window moved, or the other costmap changed cells in it.  The costs copied are
+ * inflated already, which an InflationLayer above with static_base takes into account.
+ */
+class GlobalWindowLayer : public CostmapLayer
+{
+public:
+  GlobalWindowLayer();
+  virtual ~GlobalWindowLayer();
+
+  virtual void onInitialize();
+  virtual void matchSize();
+  virtual void reset();
+  virtual void updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
+                            double* max_x, double* max_y);
+  virtual void updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
+
+private:
+  /**
+   * @brief  Copy the cells [x0, xn) by [y0, yn) of this layer from the cells of the shared map under their centers,
+   * for a shared map in the frame of this one, into out, xn - x0 cells to a row
+   */
+  void copyAligned(const SharedCostmapHeader& info, const unsigned char* cells, int x0, int y0, int xn, int yn,
+                   unsigned char* out);
+
+  /**
+   * @brief  Copy every cell of this layer from the cell of the shared map under its center, through the transform,
+   * into out, laid out as the layer
+   */
+  void copyTransformed(const SharedCostmapHeader& info, const unsigned char* cells, const tf::Transform& transform,
+                       unsigned char* out);
+
+  void reconfigureCB(costmap_2d::GenericPluginConfig &config, uint32_t level);
+
+  SharedCostmapReader* reader_;
+  std::string global_frame_;
+  bool rolling_window_;
+  bool use_maximum_;
+  bool full_copy_;  ///< @brief Copy the whole window on the next update, rather than the cells that changed
+  uint64_t last_sequence_;  ///< @brief The sequence of the shared map last copied from
+  double last_origin_x_, last_origin_y_;  ///< @brief Where this layer was when last copied into
+  std::vector<int> columns_, rows_;  ///< @brief The column and row of the shared map under those of this layer
+  std::vector<unsigned char> scratch_;  ///< @brief A copy, kept out of the layer until the read is known to be whole
+
+  dynamic_reconfigure::Server<costmap_2d::GenericPluginConfig> *dsrv_;
+};
+
+}  // namespace costmap_2d
+
+#endif  // COSTMAP_2D_GLOBAL_WINDOW_LAYER_H_
@@ -44,10 +44,11 @@
 #include <costmap_2d/InflationPluginConfig.h>
 #include <dynamic_reconfigure/server.h>
 #include <boost/thread.hpp>
-#include <queue>
+#include <vector>
 
 namespace costmap_2d
 {
+class StaticLayer;
 /**
  * @class CellData
  * @brief Storage for cell information used during obstacle inflation
@@ -99,15 +100,45 @@ public:
   virtual void onInitialize();
   virtual void updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
                             double* max_x, double* max_y);
+  /** @brief Grows each box by the inflation radius, keeping the boxes apart as updateBounds() merges them. */
+  virtual void updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds);
   virtual void updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
   virtual bool isDiscretized()
   {
     return true;
   }
+
+  /**
+   * @brief The incremental mode keeps state for the whole grid, and the static base mode a plane over it, so only
+   * full inflation runs on tiles.  The distance transform splits itself over threads instead, and the stamped
+   * kernels are chosen for the whole bounds, so both only run from updateCosts().
+   */
+  virtual bool isTileSafe()
+  {
+    return !incremental_ && !static_base_ && !distance_transform_ && !kernel_stamping_;
+  }
+
+  /** @brief The boxes of the layers below need growing on every update, so this one never waits. */
+  virtual double getUpdatePeriod() const
+  {
+    return 0.0;
+  }
+
+  /**
+   * @brief Inflate one tile, from the obstacles inside it and within the inflation radius around it,
+   * with scratch state of its own.  Unlike updateCosts(), this only writes cells inside the tile.
+   */
+  virtual void updateTile(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
   virtual void matchSize();
 
   virtual void reset() { onInitialize(); }
 
+  /** @brief Distance from obstacles beyond which cells are left free, in meters. */
+  double getInflationRadius() const
+  {
+    return inflation_radius_;
+  }
+
   /** @brief  Given a distance, compute a cost.
    * @param  distance The distance from an obstacle in cells
    * @return A cost value for the distance */
@@ -152,7 +183,7 @@ private:
   {
     unsigned int dx = abs(mx - src_x);
     unsigned int dy = abs(my - src_y);
-    return cached_distances_[dx][dy];
+    return cached_distances_[dx * cache_stride_ + dy];
   }
 
   /**
@@ -167,13 +198,77 @@ private:
   {
     unsigned int dx = abs(mx - src_x);
     unsigned int dy = abs(my - src_y);
-    return cached_costs_[dx][dy];
+    return cached_costs_[dx * cache_stride_ + dy];
   }
 
   void computeCaches();
   void deleteKernels();
+
+  /** @brief Set memory_ to the bytes of the caches and of the arrays kept over the map */
+  void accountMemory();
   void inflate_area(int min_i, int min_j, int max_i, int max_j, unsigned char* master_grid);
 
+  /**
+   * @brief  Inflate the given (already expanded) bounds from the kept obstacle distances,
+   * after bringing those up to date with the lethal cells that changed since the last cycle
+   */
+  void updateCostsIncremental(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
+
+  /**
+   * @brief  Inflate the given (already expanded) bounds from an exact Euclidean distance transform of their
+   * lethal cells, writing only the cells of the inner bounds, which all obstacles in range of lie within the others
+   */
+  void updateCostsTransform(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j,
+                            int inner_min_i, int inner_min_j, int inner_max_i, int inner_max_j);
+
+  /**
+   * @brief  Inflate the given (already expanded) bounds by stamping the cost kernel around each of their lethal
+   * cells, taking the maximum, and write the cells of the inner bounds as updateCostsTransform() does
+   */
+  void updateCostsStamped(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j,
+                          int inner_min_i, int inner_min_j, int inner_max_i, int inner_max_j);
+
+  /**
+   * @brief  Write costs of the area being inflated into the inner bounds, keeping the higher of each and the old
+   * cost, unless that was unknown and the new one is at least inscribed
+   * @param  costs The costs over the area from min_i, min_j, width cells to a row, where 0 leaves a cell alone
+   */
+  void mergeCosts(costmap_2d::Costmap2D& master_grid, const unsigned char* costs, unsigned int width, int min_i,
+                  int min_j, int inner_min_i, int inner_min_j, int inner_max_i, int inner_max_j);
+
+  /**
+   * @brief  The costs inflated from the lethal cells of the static layers below, over the whole grid, brought up to
+   * date with their revisions
+   * @return NULL if there are no static layers below, or they do not line up with the master grid
+   */
+  const unsigned char* staticCosts(const costmap_2d::Costmap2D& master_grid);
+
+  /**
+   * @brief  The grid of the GlobalWindowLayer below, whose lethal cells come with their inflation already
+   * @return NULL if there is none, or it does not line up with the master grid
+   */
+  const unsigned char* windowCosts(const costmap_2d::Costmap2D& master_grid);
+
+  /** @brief  Fill static_costs_ by a wavefront from the lethal cells of the layers, over the whole grid */
+  void inflateStatic(const std::vector<const StaticLayer*>& layers, unsigned int size_x, unsigned int size_y);
+
+  /**
+   * @brief  Forget a lethal cell that went away: clear the cells inflated from it and queue them to be raised
+   */
+  void clearObstacle(unsigned int index, unsigned int mx, unsigned int my, unsigned int size_x, unsigned int size_y);
+
+  /**
+   * @brief  Propagate the queued obstacle changes through the kept distances, as in the
+   * dynamic brushfire of Lau et al.: raised (cleared) cells have their neighbors spread their obstacle
+   * back into them, and lower waves spread each obstacle over the cells it is now closest to
+   */
+  void propagateDistances(unsigned int size_x, unsigned int size_y);
+
+  /**
+   * @brief  Put a cell into the inflation buckets under the given squared distance
+   */
+  inline void queueCell(unsigned int bucket, unsigned int index, unsigned int mx, unsigned int my);
+
   unsigned int cellDistance(double world_dist)
   {
     return layered_costmap_->getCostmap()->cellDistance(world_dist);
@@ -182,24 +277,76 @@ private:
   inline void enqueue(unsigned int index, unsigned int mx, unsigned int my,
                       unsigned int src_x, unsigned int src_y);
 
+  /**
+   * @brief  Take the closest cell out of the inflation buckets
+   * @param  cell Set to the cell removed
+   * @return False once the buckets are empty
+   */
+  inline bool dequeue(CellData& cell);
+
   double inflation_radius_, inscribed_radius_, weight_;
   unsigned int cell_inflation_radius_;
   unsigned int cached_cell_inflation_radius_;
-  std::priority_queue<CellData> inflation_queue_;
+
+  /**
+   * Cells waiting to be inflated, bucketed by their squared cell distance to
+   * the obstacle they were reached from.  There are only (cell_inflation_radius_^2 + 1)
+   * possible keys, so this replaces a priority queue on the distance without
+   * the heap; inflation_bucket_ is the lowest bucket that may be non-empty.
+   */
+  std::vector<std::vector<CellData> > inflation_cells_;
+  unsigned int inflation_bucket_;
 
   double resolution_;
 
   bool* seen_;
   int seen_size_;
 
-  unsigned char** cached_costs_;
-  double** cached_distances_;
+  std::vector<unsigned char> cached_costs_;  ///< Cost by cell offset from the obstacle, cache_stride_ to a row.
+  std::vector<double> cached_distances_;  ///< Distance by cell offset from the obstacle, laid out as cached_costs_.
+  unsigned int cache_stride_;  ///< One more than the largest offset cached, cell_inflation_radius_ + 1.
   double last_min_x_, last_min_y_, last_max_x_, last_max_y_;
+  std::vector<Bounds> last_bounds_;  ///< The boxes updateBoundsList() was given last cycle.
 
   dynamic_reconfigure::Server<costmap_2d::InflationPluginConfig> *dsrv_;
   void reconfigureCB(costmap_2d::InflationPluginConfig &config, uint32_t level);
 
   bool need_reinflation_;  ///< Indicates that the entire costmap should be reinflated next time around.
+
+  bool incremental_;  ///< Update the inflation from the lethal cells that changed rather than from scratch.
+
+  /** State kept between cycles by the incremental mode, for every cell of the master grid */
+  std::vector<unsigned int> nearest_;  ///< Index of the closest lethal cell within the inflation radius, or NO_OBSTACLE.
+  std::vector<bool> lethal_;  ///< Whether the cell was lethal in the last cycle.
+  std::vector<bool> raise_;  ///< Whether the cell is waiting to be cleared by a raise wave.
+  bool distances_valid_;
+  unsigned int distances_cell_radius_;
+  double distances_origin_x_, distances_origin_y_;
+  static const unsigned int NO_OBSTACLE = 0xffffffff;
+
+  bool distance_transform_;  ///< Inflate from a distance transform rather than from a wavefront.
+  int distance_transform_threads_;  ///< Threads the passes of the distance transform are split over.
+  std::vector<float> transform_;  ///< Squared cell distance to the closest lethal cell, over the area being inflated.
+  std::vector<unsigned char> squared_costs_;  ///< Cost by squared cell distance, up to the inflation radius.
+
+  bool kernel_stamping_;  ///< Inflate by stamping stamp_kernel_ around each obstacle, when the radius allows.
+  std::vector<unsigned char> stamp_kernel_;  ///< The costs around an obstacle, 2 * cell_inflation_radius_ + 1 square.
+  std::vector<unsigned char> stamped_;  ///< The maximum of the kernels stamped, over the area being inflated.
+
+  bool static_base_;  ///< Keep the inflation of the static layers below, and only inflate the other obstacles.
+  std::vector<unsigned char> static_costs_;  ///< The costs inflated from the static layers, for every cell.
+  bool static_costs_valid_;
+  unsigned int static_revision_;  ///< The sum of the revisions of the static layers static_costs_ was inflated from.
+
+  /** Scratch state of updateTile(), one per thread running tiles */
+  struct TileScratch
+  {
+    std::vector<bool> seen;
+    std::vector<std::vector<CellData> > cells;
+  };
+  boost::thread_specific_ptr<TileScratch> tile_scratch_;
+
+  nav_executor::MemoryCounter memory_;  ///< Counts the caches and arrays, under the layer's name
 };
 
 }  // namespace costmap_2d
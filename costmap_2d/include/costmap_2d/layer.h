@@ -65,12 +65,79 @@ public:
   virtual void updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
                             double* max_x, double* max_y) {}
 
+  /**
+   * @brief Like updateBounds(), but with the area to update kept as a list
+   *        of boxes, so that changes far apart do not make the LayeredCostmap
+   *        update everything between them.  Each layer can add boxes, or grow
+   *        the ones there, and updateCosts() is then called once per box.
+   *
+   * The default is for layers that only implement updateBounds(): it merges
+   * the list into one box, and passes that to updateBounds().
+   */
+  virtual void updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds);
+
+  /**
+   * @brief Whether updateBoundsList() of this layer is independent of the
+   *        other layers, so that the LayeredCostmap may run it concurrently
+   *        with theirs.
+   *
+   * Such a layer only appends boxes of its own to the list, without reading
+   * or changing the ones there, and changes no state the other layers use in
+   * their updateBoundsList(), e.g. it marks and clears a private grid.
+   */
+  virtual bool isBoundsIndependent()
+  {
+    return false;
+  }
+
   /**
    * @brief Actually update the underlying costmap, only within the bounds
    *        calculated during UpdateBounds().
    */
   virtual void updateCosts(Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j) {}
 
+  /**
+   * @brief Whether the LayeredCostmap may update this layer one tile of the
+   *        bounds at a time, on several threads at once, through updateTile().
+   */
+  virtual bool isTileSafe()
+  {
+    return false;
+  }
+
+  /**
+   * @brief Update the costs of one tile of the bounds calculated during
+   *        UpdateBounds().
+   *
+   * Only called on tile-safe layers, concurrently for disjoint tiles, once
+   * every layer below has finished the whole bounds.  Cells of the master
+   * grid around the tile may be read, but only cells inside it written, and
+   * the layer must not change any state shared between the tiles.
+   */
+  virtual void updateTile(Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
+  {
+    updateCosts(master_grid, min_i, min_j, max_i, max_j);
+  }
+
+  /**
+   * @brief The shortest time between two runs of updateBoundsList(), in
+   *        seconds, or 0 to run it on every update of the costmap.
+   *
+   * In between, the LayeredCostmap takes what the layer put in the costmap
+   * to be unchanged: the layer adds no bounds, and updateCosts() only
+   * repaints the regions the other layers changed.  By default this is set
+   * from the update_frequency parameter of the layer.
+   */
+  virtual double getUpdatePeriod() const
+  {
+    return update_period_;
+  }
+
+  void setUpdatePeriod(double period)
+  {
+    update_period_ = period;
+  }
+
   /** @brief Stop publishers. */
   virtual void deactivate() {}
 
@@ -96,10 +163,19 @@ public:
     return current_;
   }
 
+  /**
+   * @brief The stamp of the newest sensor data that went into the last updateBounds(), for tracing how old the
+   *        data behind a velocity command is.  Layers that don't take in sensor data leave this at zero.
+   */
+  virtual ros::Time getNewestObservationTime() const
+  {
+    return ros::Time();
+  }
+
   /** @brief Implement this to make this layer match the size of the parent costmap. */
   virtual void matchSize() {}
 
-  std::string getName() const
+  const std::string& getName() const
   {
     return name_;
   }
@@ -119,11 +195,17 @@ protected:
    * tf_, name_, and layered_costmap_ will all be set already when this is called. */
   virtual void onInitialize() {}
 
+  /** @brief An updateBoundsList() for layers whose updateBounds() only grows
+   * the bounds by the area they changed themselves: that area is added to
+   * the list as a box of its own. */
+  void addOwnBounds(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds);
+
   LayeredCostmap* layered_costmap_;
   bool current_;
   bool enabled_;  ///< Currently this var is managed by subclasses. TODO: make this managed by this class and/or container class.
   std::string name_;
   tf::TransformListener* tf_;
+  double update_period_;
 
 private:
   std::vector<geometry_msgs::Point> footprint_spec_;
@@ -41,6 +41,8 @@
 #include <costmap_2d/cost_values.h>
 #include <costmap_2d/layer.h>
 #include <costmap_2d/costmap_2d.h>
+#include <nav_executor/executor.h>
+#include <boost/thread.hpp>
 #include <vector>
 #include <string>
 
@@ -48,6 +50,14 @@ namespace costmap_2d
 {
 class Layer;
 
+/** @brief What one layer did in the last LayeredCostmap::updateMap() */
+struct LayerUpdateStats
+{
+  double bounds_time;  ///< @brief Seconds spent in updateBounds()
+  double costs_time;  ///< @brief Seconds spent in updateCosts(), over all the regions
+  unsigned long bounds_cells;  ///< @brief Cells in the bounds once the layer added its own, overlaps counted twice
+};
+
 /**
  * @class LayeredCostmap
  * @brief Instantiates different layer plugins and aggregates them into one score
@@ -154,7 +164,113 @@ public:
    * This is updated by setFootprint(). */
   double getInscribedRadius() { return inscribed_radius_; }
 
+  /**
+   * @brief Update the tile-safe layers one square tile of the bounds at a
+   * time, with several threads working through the tiles.  The threads are those of the shared
+   * nav_executor::Executor, in the local costmap lane for a rolling window and the global planning lane otherwise.
+   * @param tile_size The side of a tile in cells, or 0 to update every layer over the whole bounds at once
+   * @param num_threads The most threads updating tiles, counting the one calling updateMap()
+   */
+  void setTiling(unsigned int tile_size, unsigned int num_threads);
+
+  /**
+   * @brief Run updateBoundsList() of the layers whose bounds are independent
+   * of the others on several threads at once.  Each such layer fills a list of
+   * its own, and the lists are added to the bounds in plugin order, so the
+   * result is the same as running them one by one.  The threads are those of
+   * the shared executor, as for setTiling().
+   * @param num_threads The number of threads, counting the one calling updateMap(), or below 2 to run them one by one
+   */
+  void setParallelBounds(unsigned int num_threads);
+
+  /**
+   * @brief Make the next updateMap() run updateBoundsList() of every layer, whatever its update period, e.g.
+   * once the layers were reset.
+   */
+  void forceFullUpdate()
+  {
+    force_full_update_ = true;
+  }
+
+  /**
+   * @brief Tell whoever runs updateMap() that a layer has new data for it.
+   * Safe to call from any thread, e.g. the subscriber callbacks of the layers.
+   */
+  void requestUpdate();
+
+  /**
+   * @brief Wait until requestUpdate() is called, or the timeout runs out.
+   * @param timeout The longest time to wait, in seconds
+   * @return Whether an update was requested since the last call; the request is cleared
+   */
+  bool waitForUpdateRequest(double timeout);
+
+  /** @brief Per layer timings of the last updateMap(), in the order of getPlugins(). */
+  const std::vector<LayerUpdateStats>& getLayerUpdateStats() const
+  {
+    return layer_stats_;
+  }
+
+  /** @brief Seconds the last updateMap() waited for the costmap mutex, e.g. while a planner held it. */
+  double getLockWaitTime() const
+  {
+    return lock_wait_time_;
+  }
+
+  /** @brief Seconds the last updateMap() took once it held the costmap mutex. */
+  double getUpdateTime() const
+  {
+    return update_time_;
+  }
+
+  /** @brief The stamp of the newest sensor data any layer took in during the last updateMap(), zero if none did. */
+  ros::Time getNewestObservationTime() const
+  {
+    return newest_observation_;
+  }
+
+  /** @brief When the last updateMap() started, once it held the costmap mutex. */
+  ros::Time getLastUpdateTime() const
+  {
+    return last_update_;
+  }
+
+  /** @brief The lane of the shared executor the updates of this costmap run on, for layers that split up work */
+  nav_executor::Lane getLane() const
+  {
+    return lane_;
+  }
+
+  /** @brief A box of cells to update, [x0, xn) by [y0, yn) */
+  struct Region
+  {
+    int x0, xn, y0, yn;
+  };
+
+  /** @brief The boxes of cells the last updateMap() changed, without overlaps; empty if it changed none. */
+  const std::vector<Region>& getUpdatedRegions() const
+  {
+    return regions_;
+  }
+
 private:
+  /** @brief Run updateTile() of the layer over every tile of the bounds, on all tile threads. */
+  void updateTiles(Layer* layer, int x0, int y0, int xn, int yn);
+
+  /**
+   * @brief Run updateBoundsList() of the independent layers that are due into layer_bounds_, on all worker threads.
+   * @return Whether they ran, which is when there are two of them or more
+   */
+  bool updateIndependentBounds(double robot_x, double robot_y, double robot_yaw);
+
+  /** @brief Take tiles, or independent layers, off the current run until there are none left. */
+  void runTiles(unsigned int task);
+
+  struct Tile
+  {
+    int x0, y0, xn, yn;
+  };
+
   Costmap2D costmap_;
   std::string global_frame_;
 
@@ -164,12 +280,40 @@ private:
   double minx_, miny_, maxx_, maxy_;
   unsigned int bx0_, bxn_, by0_, byn_;
 
+  std::vector<Bounds> bounds_;  ///< @brief The boxes the layers asked to update, in world coordinates
+  std::vector<Region> regions_;  ///< @brief The same boxes, in cells and without overlaps
+
+  /** @brief The cells of the box, clamped to the map.  Returns false if none are left. */
+  bool toRegion(const Bounds& bounds, Region* region) const;
+
+  std::vector<LayerUpdateStats> layer_stats_;
+  double lock_wait_time_, update_time_;
+  ros::Time newest_observation_, last_update_;
+  std::vector<char> bounds_due_;  ///< @brief Whether each layer's update period let it run in this updateMap()
+  std::vector<ros::Time> last_bounds_update_;  ///< @brief When each layer's updateBoundsList() last ran
+  bool force_full_update_;
+
   std::vector<boost::shared_ptr<Layer> > plugins_;
 
+  boost::mutex update_request_mutex_;
+  boost::condition_variable update_request_cond_;
+  bool update_requested_;
+
   bool initialized_;
   bool size_locked_;
   double circumscribed_radius_, inscribed_radius_;
   std::vector<geometry_msgs::Point> footprint_;
+
+  unsigned int tile_size_;
+  unsigned int tile_threads_, bounds_threads_;  ///< Threads asked for by setTiling() and setParallelBounds()
+  nav_executor::Lane lane_;  ///< Of the runs of tiles and of independent bounds on the shared executor
+  boost::mutex tile_mutex_;
+  Layer* tile_layer_;  ///< Layer of the current run of tiles, NULL during a run of independent bounds
+  std::vector<Tile> tiles_;
+  std::vector<unsigned int> bounds_jobs_;  ///< Plugins of the current run of independent bounds
+  std::vector<std::vector<Bounds> > layer_bounds_;  ///< The boxes each of those added, by plugin
+  double bounds_robot_x_, bounds_robot_y_, bounds_robot_yaw_;
+  unsigned int next_tile_;
 };
 
 }  // namespace costmap_2d
@@ -35,6 +35,7 @@
 #include <geometry_msgs/Point.h>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
+#include <boost/shared_ptr.hpp>
 
 namespace costmap_2d
 {
@@ -43,6 +44,9 @@ namespace costmap_2d
  * @brief Stores an observation in terms of a point cloud and the origin of the source
  * @note Tried to make members and constructor arguments const but the compiler would not accept the default
  * assignment operator for vector insertion!
+ * @note Copies share the cloud, which is never changed once the observation is handed out, so that
+ * passing observations to the layers on every update copies no points; the ObservationBuffer only
+ * reuses it for a later observation once no copy shares it any more
  */
 class Observation
 {
@@ -57,7 +61,15 @@ public:
 
   virtual ~Observation()
   {
-    delete cloud_;
+  }
+
+  /**
+   * @brief  Creates an observation of the given cloud, which it then shares
+   * @param cloud The point cloud of the observation
+   */
+  explicit Observation(const boost::shared_ptr<const pcl::PointCloud<pcl::PointXYZ> >& cloud) :
+      cloud_(cloud), obstacle_range_(0.0), raytrace_range_(0.0)
+  {
   }
 
   /**
@@ -74,16 +86,6 @@ public:
   {
   }
 
-  /**
-   * @brief  Copy constructor
-   * @param obs The observation to copy
-   */
-  Observation(const Observation& obs) :
-      origin_(obs.origin_), cloud_(new pcl::PointCloud<pcl::PointXYZ>(*(obs.cloud_))),
-      obstacle_range_(obs.obstacle_range_), raytrace_range_(obs.raytrace_range_)
-  {
-  }
-
   /**
    * @brief  Creates an observation from a point cloud
    * @param cloud The point cloud of the observation
@@ -95,7 +97,7 @@ public:
   }
 
   geometry_msgs::Point origin_;
-  pcl::PointCloud<pcl::PointXYZ>* cloud_;
+  boost::shared_ptr<const pcl::PointCloud<pcl::PointXYZ> > cloud_;
   double obstacle_range_, raytrace_range_;
 };
 
@@ -37,8 +37,8 @@
 #ifndef COSTMAP_2D_OBSERVATION_BUFFER_H_
 #define COSTMAP_2D_OBSERVATION_BUFFER_H_
 
+#include <stdint.h>
 #include <vector>
-#include <list>
 #include <string>
 #include <ros/time.h>
 #include <costmap_2d/observation.h>
@@ -48,9 +48,12 @@
 // PCL Stuff
 #include <pcl/point_cloud.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/LaserScan.h>
 
 // Thread support
 #include <boost/thread.hpp>
+#include <boost/circular_buffer.hpp>
+#include <nav_executor/memory.h>
 
 namespace costmap_2d
 {
@@ -74,11 +77,13 @@ public:
    * @param  global_frame The frame to transform PointClouds into
    * @param  sensor_frame The frame of the origin of the sensor, can be left blank to be read from the messages
    * @param  tf_tolerance The amount of time to wait for a transform to be available when setting a new global frame
+   * @param  downsample_resolution The size of the voxels observations are thinned to one point per, 0 keeps
+   * every point
    */
   ObservationBuffer(std::string topic_name, double observation_keep_time, double expected_update_rate,
                     double min_obstacle_height, double max_obstacle_height, double obstacle_range,
                     double raytrace_range, tf::TransformListener& tf, std::string global_frame,
-                    std::string sensor_frame, double tf_tolerance);
+                    std::string sensor_frame, double tf_tolerance, double downsample_resolution = 0.0);
 
   /**
    * @brief  Destructor... cleans up
@@ -108,6 +113,15 @@ public:
    */
   void bufferCloud(const pcl::PointCloud<pcl::PointXYZ>& cloud);
 
+  /**
+   * @brief  Transforms a laser scan to the global frame and buffers it, with the one transform at the
+   * stamp of the scan for all its beams rather than one for each, and no cloud in between
+   * <b>Note: The burden is on the user to make sure the transform is available... ie they should use a MessageNotifier</b>
+   * @param  scan The scan to be buffered, of which the ranges from range_min up to range_max are kept
+   * @param  inf_is_valid Whether ranges of +Inf are taken as just short of range_max
+   */
+  void bufferScan(const sensor_msgs::LaserScan& scan, bool inf_is_valid);
+
   /**
    * @brief  Pushes copies of all current observations onto the end of the vector passed in
    * @param  observations The vector to be filled
@@ -147,18 +161,71 @@ private:
    */
   void purgeStaleObservations();
 
+  /**
+   * @brief  Keep only the first point of the cloud in each voxel of downsample_resolution_
+   * @param  cloud The cloud to thin out, in place
+   */
+  void downsample(pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+  /**
+   * @brief  Set memory_ to the bytes of the observations held, of the clouds pooled and of the scratch arrays
+   */
+  void accountMemory();
+
+  /**
+   * @brief  Push a new observation to the front of the buffer, its cloud taken from the pool
+   * @return The cloud of the observation, to be filled in
+   */
+  pcl::PointCloud<pcl::PointXYZ>& pushObservation();
+
+  /**
+   * @brief  Drop the newest observation, returning its cloud to the pool
+   */
+  void popNewest();
+
+  /**
+   * @brief  Drop the oldest observation, returning its cloud to the pool
+   */
+  void popOldest();
+
+  /**
+   * @brief  A cloud from the pool that no observation handed out shares any more, or a new one if there is none
+   */
+  boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > takeCloud();
+
+  /**
+   * @brief  Keep the cloud of a dropped observation in the pool, if there is room
+   */
+  void recycleCloud(const boost::shared_ptr<const pcl::PointCloud<pcl::PointXYZ> >& cloud);
+
   tf::TransformListener& tf_;
   const ros::Duration observation_keep_time_;
   const ros::Duration expected_update_rate_;
   ros::Time last_updated_;
   std::string global_frame_;
   std::string sensor_frame_;
-  std::list<Observation> observation_list_;
+  boost::circular_buffer<Observation> observation_list_;  ///< @brief Newest first, grown when full
+  /**
+   * @brief  The clouds of dropped observations, reused with the capacity of their points once the observations
+   * handed out no longer share them, so that a buffer in steady state allocates nothing
+   */
+  std::vector<boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > > spare_clouds_;
+  pcl::PointCloud<pcl::PointXYZ> transformed_cloud_;  ///< @brief Scratch for the clouds buffered from pcl clouds
   std::string topic_name_;
   double min_obstacle_height_, max_obstacle_height_;
   boost::recursive_mutex lock_;  ///< @brief A lock for accessing data in callbacks safely
   double obstacle_range_, raytrace_range_;
   double tf_tolerance_;
+
+  double downsample_resolution_;
+  std::vector<uint64_t> voxel_keys_;  ///< @brief Open-addressed set of the voxels seen in the current cloud
+  std::vector<unsigned int> voxel_stamps_;  ///< @brief Which cloud each slot of voxel_keys_ was filled for
+  unsigned int voxel_stamp_;
+
+  std::vector<float> beam_cos_, beam_sin_;  ///< @brief Directions of the beams of the last scan in its frame
+  float beam_angle_min_, beam_angle_increment_;  ///< @brief And the angles they were computed for
+
+  nav_executor::MemoryCounter memory_;  ///< @brief Counts the observations held, under the buffer's topic
 };
 }  // namespace costmap_2d
 #endif  // COSTMAP_2D_OBSERVATION_BUFFER_H_
@@ -0,0 +1,102 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_OBSERVATION_HUB_H_
+#define COSTMAP_2D_OBSERVATION_HUB_H_
+#include <costmap_2d/observation_buffer.h>
+#include <ros/callback_queue.h>
+#include <ros/spinner.h>
+#include <tf/message_filter.h>
+#include <message_filters/subscriber.h>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace costmap_2d
+{
+class ObstacleLayer;
+
+/**
+ * @brief A sensor subscription and its buffer; through the ObservationHub, one is used by every layer
+ * in the process that reads the sensor the same way.
+ *
+ * Members are declared so that the spinner goes first on destruction, then the filter and the
+ * subscriber, and only then the queue and the buffer they feed.
+ */
+struct ObservationSource
+{
+  boost::shared_ptr<ObservationBuffer> buffer;
+  boost::shared_ptr<ros::CallbackQueue> queue;  ///< Set with separate_source_threads
+  boost::shared_ptr<message_filters::SubscriberBase> subscriber;
+  boost::shared_ptr<tf::MessageFilterBase> notifier;  ///< Makes sure that transforms are available for each message
+  boost::shared_ptr<ros::AsyncSpinner> spinner;  ///< Serves queue
+
+  boost::mutex consumers_mutex;  ///< Held while a message is handed to the consumers
+  std::vector<ObstacleLayer*> consumers;  ///< The layers reading a shared source; the first buffers each message
+};
+
+/**
+ * @class ObservationHub
+ * @brief Hands out the sources shared by the obstacle layers of a process, such as those of the
+ * global and local costmaps of move_base, so that each sensor is subscribed to and filtered once.
+ */
+class ObservationHub
+{
+public:
+  static ObservationHub& instance();
+
+  /**
+   * @brief  Get the source for a key, creating it if no layer holds it any more
+   * @param key Describes everything about how the source is read, so that equal keys can share
+   * @param create Fills in a new source; called with the hub locked, so no other layer sees it half done
+   * @return The source, which lives for as long as a layer holds it
+   */
+  boost::shared_ptr<ObservationSource> acquire(const std::string& key,
+                                                     const boost::function<void(ObservationSource&)>& create);
+
+private:
+  ObservationHub()
+  {
+  }
+
+  boost::mutex mutex_;
+  std::map<std::string, boost::weak_ptr<ObservationSource> > sources_;
+};
+
+}  // namespace costmap_2d
+#endif  // COSTMAP_2D_OBSERVATION_HUB_H_
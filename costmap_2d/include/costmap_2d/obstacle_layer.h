@@ -42,6 +42,7 @@
 #include <costmap_2d/costmap_layer.h>
 #include <costmap_2d/layered_costmap.h>
 #include <costmap_2d/observation_buffer.h>
+#include <costmap_2d/observation_hub.h>
 
 #include <nav_msgs/OccupancyGrid.h>
 
@@ -62,7 +63,8 @@ namespace costmap_2d
 class ObstacleLayer : public CostmapLayer
 {
 public:
-  ObstacleLayer()
+  ObstacleLayer() :
+      raytrace_threads_(1)
   {
     costmap_ = NULL;  // this is the unsigned char* member of parent class Costmap2D.
   }
@@ -71,7 +73,28 @@ public:
   virtual void onInitialize();
   virtual void updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
                             double* max_x, double* max_y);
+
+  /**
+   * @brief  Reports the area of each observation, and of the footprint, as a box of its own.
+   *
+   * Subclasses that override updateBounds() need to override this as well.
+   */
+  virtual void updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds);
   virtual void updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
+  virtual bool isTileSafe()
+  {
+    return true;
+  }
+
+  /**
+   * @brief  The observations are marked and cleared in the layer's own grid, so its bounds are independent.
+   *
+   * Subclasses that override updateBoundsList() need to check that this still holds.
+   */
+  virtual bool isBoundsIndependent()
+  {
+    return true;
+  }
 
   virtual void activate();
   virtual void deactivate();
@@ -93,6 +116,23 @@ public:
   void laserScanValidInfCallback(const sensor_msgs::LaserScanConstPtr& message,
                                  const boost::shared_ptr<ObservationBuffer>& buffer);
 
+  /**
+   * @brief  A callback to handle buffering LaserScan messages straight into the buffer, with one transform
+   * for the whole scan, see ObservationBuffer::bufferScan
+   * @param message The message returned from a message notifier
+   * @param buffer A pointer to the observation buffer to update
+   */
+  void laserScanDirectCallback(const sensor_msgs::LaserScanConstPtr& message,
+                               const boost::shared_ptr<costmap_2d::ObservationBuffer>& buffer);
+
+  /**
+   * @brief  laserScanDirectCallback() for LaserScan messages whose Inf values are taken as range_max
+   * @param message The message returned from a message notifier
+   * @param buffer A pointer to the observation buffer to update
+   */
+  void laserScanDirectValidInfCallback(const sensor_msgs::LaserScanConstPtr& message,
+                                       const boost::shared_ptr<costmap_2d::ObservationBuffer>& buffer);
+
   /**
    * @brief  A callback to handle buffering PointCloud messages
    * @param message The message returned from a message notifier
@@ -109,6 +149,11 @@ public:
   void pointCloud2Callback(const sensor_msgs::PointCloud2ConstPtr& message,
                            const boost::shared_ptr<costmap_2d::ObservationBuffer>& buffer);
 
+  virtual ros::Time getNewestObservationTime() const
+  {
+    return newest_observation_;
+  }
+
   // for testing purposes
   void addStaticObservation(costmap_2d::Observation& obs, bool marking, bool clearing);
   void clearStaticObservations(bool marking, bool clearing);
@@ -130,6 +175,15 @@ protected:
    */
   bool getClearingObservations(std::vector<costmap_2d::Observation>& clearing_observations) const;
 
+  /**
+   * @brief  Transform the observations of buffers shared with a layer of another global frame into ours
+   * @param observations The observations, less any that could not be transformed on return
+   */
+  void reexpressObservations(std::vector<costmap_2d::Observation>& observations) const;
+
+  /** @brief Keep the stamp of the newest of the observations in newest_observation_, if it is newer. */
+  void noteObservationTimes(const std::vector<costmap_2d::Observation>& observations);
+
   /**
    * @brief  Clear freespace based on one observation
    * @param clearing_observation The observation used to raytrace
@@ -144,8 +198,35 @@ protected:
   void updateRaytraceBounds(double ox, double oy, double wx, double wy, double range, double* min_x, double* min_y,
                             double* max_x, double* max_y);
 
+  /**
+   * @brief  Mark the points of an observation that are low and near enough as obstacles
+   * @param obs The observation
+   * @param min_x
+   * @param min_y
+   * @param max_x
+   * @param max_y
+   */
+  void markObservation(const costmap_2d::Observation& obs, double* min_x, double* min_y, double* max_x,
+                       double* max_y);
+
+  /** @brief The work of updateBounds(), adding a box for the area each observation and the footprint changed. */
+  virtual void collectBounds(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds);
+
+  /**
+   * @brief  Trace a share of the rays of raytraceFreespace() into its buffer, rather than into the costmap
+   * @param  x0 The x cell of the origin of the rays
+   * @param  y0 The y cell of the origin of the rays
+   * @param  max_length The length past which rays are cut off, in cells
+   * @param  start The map index of the first cell of the buffers
+   * @param  shares The number of shares ray_ends_ is split into, one per buffer of ray_buffers_
+   * @param  share The share to trace, into ray_buffers_[share], set for every cell cleared at map index less start
+   */
+  void raytraceRays(unsigned int x0, unsigned int y0, unsigned int max_length, unsigned int start,
+                    unsigned int shares, unsigned int share);
+
   std::vector<geometry_msgs::Point> transformed_footprint_;
   bool footprint_clearing_enabled_;
+  ros::Time newest_observation_;  ///< @brief The stamp of the newest observation in the last update
   void updateFootprint(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y, 
                        double* max_x, double* max_y);
 
@@ -154,8 +235,8 @@ protected:
 
   laser_geometry::LaserProjection projector_;  ///< @brief Used to project laser scans into point clouds
 
-  std::vector<boost::shared_ptr<message_filters::SubscriberBase> > observation_subscribers_;  ///< @brief Used for the observation message filters
-  std::vector<boost::shared_ptr<tf::MessageFilterBase> > observation_notifiers_;  ///< @brief Used to make sure that transforms are available for each sensor
+  std::vector<boost::shared_ptr<costmap_2d::ObservationSource> > observation_sources_;  ///< @brief The subscriptions of this layer alone
+  std::vector<boost::shared_ptr<costmap_2d::ObservationSource> > shared_sources_;  ///< @brief The subscriptions taken from the ObservationHub, with share_observations
   std::vector<boost::shared_ptr<costmap_2d::ObservationBuffer> > observation_buffers_;  ///< @brief Used to store observations from various sensors
   std::vector<boost::shared_ptr<costmap_2d::ObservationBuffer> > marking_buffers_;  ///< @brief Used to store observation buffers used for marking obstacles
   std::vector<boost::shared_ptr<costmap_2d::ObservationBuffer> > clearing_buffers_;  ///< @brief Used to store observation buffers used for clearing obstacles
@@ -168,7 +249,37 @@ protected:
 
   int combination_method_;
 
+  int raytrace_threads_;  ///< @brief Threads rays are traced on, 1 traces them in the update thread
+  std::vector<bool> ray_targets_;  ///< @brief Set on the cells that rays have already been traced to
+  std::vector<unsigned int> ray_ends_;  ///< @brief The distinct cells rays are traced to
+  std::vector<std::vector<unsigned char> > ray_buffers_;  ///< @brief The cells cleared by each thread
+
 private:
+  typedef void (ObstacleLayer::*LaserScanCallback)(const sensor_msgs::LaserScanConstPtr&,
+                                                   const boost::shared_ptr<costmap_2d::ObservationBuffer>&);
+
+  /**
+   * @brief  Subscribe to a source, buffering what it gets in a buffer
+   * @param source Gets the buffer, the subscription and the thread, if any
+   * @param buffer The observation buffer to update
+   * @param topic The topic of the source
+   * @param data_type LaserScan, PointCloud or PointCloud2
+   * @param sensor_frame The frame of the origin of the observations, or empty for that of the messages
+   * @param scan_callback The callback laser scans are buffered with
+   * @param separate_thread Whether the source gets a callback queue and thread of its own
+   * @param shared Whether the messages go to the consumers of the source rather than to this layer
+   */
+  void subscribeSource(costmap_2d::ObservationSource& source,
+                       const boost::shared_ptr<costmap_2d::ObservationBuffer>& buffer, const std::string& topic,
+                       const std::string& data_type, const std::string& sensor_frame, LaserScanCallback scan_callback,
+                       bool separate_thread, bool shared);
+
+  /** @brief Hand a message of a shared source to its first consumer and have the others update. */
+  template<class MessageT>
+  static void sharedCallback(const boost::shared_ptr<const MessageT>& message, costmap_2d::ObservationSource* source,
+                             void (ObstacleLayer::*callback)(const boost::shared_ptr<const MessageT>&,
+                                                             const boost::shared_ptr<costmap_2d::ObservationBuffer>&));
+
   void reconfigureCB(costmap_2d::ObstaclePluginConfig &config, uint32_t level);
 };
 
@@ -0,0 +1,188 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_SHARED_COSTMAP_H_
+#define COSTMAP_2D_SHARED_COSTMAP_H_
+#include <costmap_2d/costmap_2d.h>
+#include <stdint.h>
+#include <string>
+
+namespace costmap_2d
+{
+/**
+ * @brief The start of a shared-memory costmap segment; the cells follow at cells_offset.
+ *
+ * The writer makes sequence odd before it changes anything and even again after, so a reader that
+ * saw the same even sequence before and after reading got a consistent map.
+ */
+struct SharedCostmapHeader
+{
+  uint32_t magic;  ///< SHARED_COSTMAP_MAGIC once the segment is set up
+  uint32_t layout;  ///< SHARED_COSTMAP_LAYOUT of the writer
+  volatile uint64_t sequence;  ///< Odd while the writer changes the map
+  volatile uint32_t stale;  ///< Set when the writer moved to a new segment of the same name, which readers should map
+  uint32_t size_x, size_y;
+  double resolution, origin_x, origin_y;
+  double stamp;  ///< Seconds of the update the map is from
+  uint32_t x0, xn, y0, yn;  ///< The cells the last update changed, [x0, xn) by [y0, yn)
+  uint64_t capacity;  ///< Bytes available for the cells
+  uint64_t cells_offset;  ///< Offset of the cells from the start of the segment
+  char frame_id[64];
+};
+
+static const uint32_t SHARED_COSTMAP_MAGIC = 0x434d5032;  // "CMP2"
+static const uint32_t SHARED_COSTMAP_LAYOUT = 2;
+
+/**
+ * @class SharedCostmapPublisher
+ * @brief Publishes a Costmap2D into a named POSIX shared-memory segment, for processes on the same host
+ * that read it in place through a SharedCostmapReader instead of receiving an OccupancyGrid.
+ */
+class SharedCostmapPublisher
+{
+public:
+  /**
+   * @brief  Constructor for the SharedCostmapPublisher
+   * @param name The name of the segment, e.g. "/move_base_global_costmap"
+   */
+  SharedCostmapPublisher(Costmap2D* costmap, const std::string& global_frame, const std::string& name);
+
+  /**
+   * @brief  Destructor, which removes the segment
+   */
+  ~SharedCostmapPublisher();
+
+  /** @brief Include the given bounds in the cells copied by the next publish(). */
+  void updateBounds(unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn)
+  {
+    x0_ = std::min(x0, x0_);
+    xn_ = std::max(xn, xn_);
+    y0_ = std::min(y0, y0_);
+    yn_ = std::max(yn, yn_);
+  }
+
+  /**
+   * @brief  Copy the changed cells of the costmap into the segment, all of them if the map moved or
+   * was resized.  Locks the costmap.
+   * @param stamp The time of the update, in seconds
+   */
+  void publish(double stamp);
+
+  /**
+   * @brief Check whether the segment could be set up
+   */
+  bool active()
+  {
+    return header_ != NULL;
+  }
+
+private:
+  /** @brief Map a new segment with room for the given number of cells; false if that failed. */
+  bool createSegment(uint64_t cells);
+
+  /** @brief Unmap the segment, marking it stale for the readers. */
+  void releaseSegment();
+
+  Costmap2D* costmap_;
+  std::string global_frame_;
+  std::string name_;
+  SharedCostmapHeader* header_;
+  size_t segment_size_;
+  unsigned int x0_, xn_, y0_, yn_;
+};
+
+/**
+ * @class SharedCostmapReader
+ * @brief Maps the segment of a SharedCostmapPublisher read-only.
+ *
+ * Either copy the map out with read(), or read the cells in place between beginRead() and a
+ * successful endRead().
+ */
+class SharedCostmapReader
+{
+public:
+  /**
+   * @brief  Constructor for the SharedCostmapReader; the segment is mapped on the first read
+   * @param name The name the publisher was given
+   */
+  explicit SharedCostmapReader(const std::string& name);
+
+  /**
+   * @brief  Destructor
+   */
+  ~SharedCostmapReader();
+
+  /**
+   * @brief  Copy the map into costmap, resizing it as needed
+   * @param tries How often to retry when the writer got in the way
+   * @return False if there is no map to read, or no consistent copy was taken
+   */
+  bool read(Costmap2D& costmap, unsigned int tries = 100);
+
+  /**
+   * @brief  Start reading in place; the header and the cells stay valid until endRead()
+   * @return The header, or NULL if there is no map to read.  Do not trust the cells unless endRead()
+   * returns true.
+   */
+  const SharedCostmapHeader* beginRead();
+
+  /** @brief The cells of the header beginRead() returned. */
+  const unsigned char* cells() const
+  {
+    return reinterpret_cast<const unsigned char*>(header_) + header_->cells_offset;
+  }
+
+  /** @brief Whether the writer left the map alone since beginRead(). */
+  bool endRead() const;
+
+  /** @brief The sequence of the last map read, to tell whether it changed since. */
+  uint64_t getSequence() const
+  {
+    return sequence_;
+  }
+
+private:
+  /** @brief Map the segment, if it exists and is set up; false otherwise. */
+  bool map();
+
+  /** @brief Unmap the segment. */
+  void unmap();
+
+  std::string name_;
+  const SharedCostmapHeader* header_;
+  size_t segment_size_;
+  uint64_t sequence_;
+};
+}  // namespace costmap_2d
+#endif  // COSTMAP_2D_SHARED_COSTMAP_H_
@@ -62,10 +62,33 @@ public:
 
   virtual void updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
                             double* max_x, double* max_y);
+  /** @brief Reports each part of the map that changed as a box of its own. */
+  virtual void updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds);
   virtual void updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
 
+  /** @brief Tiles are only safe without a rolling window, which looks up a transform on every update. */
+  virtual bool isTileSafe()
+  {
+    return !layered_costmap_->isRolling();
+  }
+
   virtual void matchSize();
 
+  /**
+   * @brief Counts the updates that changed this layer's grid, so that layers above can tell when to redo what they
+   * work out from it.
+   */
+  unsigned int getRevision() const
+  {
+    return revision_;
+  }
+
+  /**
+   * @brief Copy the costs of n cells of a row, from cell (x, y) on, into row.  Unlike getCharMap(), this also
+   * reads the costs when they are packed.
+   */
+  void copyRow(unsigned int x, unsigned int y, unsigned int n, unsigned char* row) const;
+
 private:
   /**
    * @brief  Callback to update the costmap's map from the map_server
@@ -79,16 +102,82 @@ private:
 
   unsigned char interpretValue(unsigned char value);
 
+  /** @brief A rectangle of cells of this layer, [x, x + width) by [y, y + height) */
+  struct Rect
+  {
+    unsigned int x, y, width, height;
+  };
+
+  /**
+   * @brief Reinterpret only the tiles of the new map whose values differ from those of the last one,
+   * and mark them changed.
+   * @return False if the maps cannot be compared, e.g. because there was no last map
+   */
+  bool incomingMapChanges(const nav_msgs::OccupancyGrid& new_map);
+
+  /**
+   * @brief Resize the layered costmap, or only this layer if the size is locked or rolling, to a new map.
+   */
+  void matchMapGeometry(unsigned int size_x, unsigned int size_y, double resolution, double origin_x,
+                        double origin_y);
+
+  /**
+   * @brief Fill this layer from the snapshot saved with the last map, so it need not wait for the map.
+   * @return False if there is no usable snapshot
+   */
+  bool restoreSnapshot();
+
+  /** @brief Add a rectangle to those changed since the last updateBounds(). */
+  void addChangedRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+
+  /** @brief Merge the packed costs into the master grid, as updateWithTrueOverwrite() or updateWithMax() would. */
+  void updateWithPacked(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
+
+  /** @brief Switch the costs to or from the packed plane, carrying over those already held. */
+  void setPacked(bool packed);
+
+  /** @brief Fill the packed plane with the default value, at the size of this layer. */
+  void resetPacked();
+
+  /** @brief Set the cost of a cell, in the packed plane if the costs are packed. */
+  void setCell(unsigned int index, unsigned char cost);
+
+  /** @brief The cost of a cell, from the packed plane if the costs are packed. */
+  unsigned char cell(unsigned int index) const;
+
+  /** @brief Forget the last map, so the next is interpreted in full. */
+  void forgetLastMap();
+
+  /** @brief Save the costs to snapshot_file_. */
+  bool saveLayerSnapshot();
+
+  /** @brief Save the costs to snapshot_file_ if map updates changed them, at most once every snapshot_period_. */
+  void saveChangedSnapshot();
+
+  /** @brief Side of the square tiles that a new map is compared in, in cells */
+  static const unsigned int TILE_SIZE = 64;
+
+  std::vector<int8_t> map_data_;  ///< @brief The values of the last map, as the tiles of the next are compared to them
+  std::vector<unsigned char> packed_costs_;  ///< @brief With packed_, four 2-bit costs per byte, in place of costmap_
+  std::vector<Rect> changed_rects_;  ///< @brief The parts of x_, y_, width_, height_ that really changed, if known
+
+  std::string snapshot_file_;  ///< @brief Where the interpreted map is saved on arrival, and restored from on start
+  double snapshot_period_;  ///< @brief Least time between saves of the snapshot after map updates, in seconds
+  bool snapshot_stale_;  ///< @brief Map updates have changed the costs since the snapshot was saved
+  ros::WallTime last_snapshot_save_;
   std::string global_frame_;  ///< @brief The global frame for the costmap
   std::string map_frame_;  /// @brief frame that map is located in
   bool subscribe_to_updates_;
   bool map_received_;
   bool has_updated_data_;
   unsigned int x_, y_, width_, height_;
+  unsigned int revision_;
   bool track_unknown_space_;
   bool use_maximum_;
   bool first_map_only_;      ///< @brief Store the first static map and reuse it on reinitializing
   bool trinary_costmap_;
+  bool packed_;  ///< @brief The costs are held in packed_costs_, as trinary costs need only 2 bits
+  bool last_map_packed_;  ///< @brief packed_costs_ hold the last map, so the next is compared to them
   ros::Subscriber map_sub_, map_update_sub_;
 
   unsigned char lethal_threshold_, unknown_cost_value_;
@@ -0,0 +1,80 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_UPDATE_STATS_PUBLISHER_H_
+#define COSTMAP_2D_UPDATE_STATS_PUBLISHER_H_
+#include <ros/ros.h>
+#include <costmap_2d/layered_costmap.h>
+#include <costmap_2d/UpdateStats.h>
+#include <vector>
+
+namespace costmap_2d
+{
+/**
+ * @class UpdateStatsPublisher
+ * @brief Keeps the timings of the last few LayeredCostmap updates and publishes them, with a histogram
+ * per layer, so that a slow layer can be told apart from a busy costmap lock.
+ */
+class UpdateStatsPublisher
+{
+public:
+  /**
+   * @brief  Constructor for the UpdateStatsPublisher
+   * @param window The number of updates the histograms cover
+   */
+  UpdateStatsPublisher(ros::NodeHandle* ros_node, LayeredCostmap* layered_costmap, std::string topic_name,
+                       unsigned int window);
+
+  /**
+   * @brief  Add the timings of the last updateMap() to the window, and publish them if anyone listens
+   */
+  void publishStats();
+
+private:
+  /** @brief Count the samples of one series that fall into each bin. */
+  void fillHistogram(unsigned int series, std::vector<uint32_t>* histogram) const;
+
+  LayeredCostmap* layered_costmap_;
+  ros::Publisher stats_pub_;
+
+  unsigned int window_;
+  std::vector<double> bin_edges_;
+
+  /** Ring buffers of window_ samples: the update time, the lock wait, then the time of each layer */
+  std::vector<std::vector<double> > samples_;
+  unsigned int next_sample_;
+  unsigned int sample_count_;
+};
+}  // namespace costmap_2d
+#endif  // COSTMAP_2D_UPDATE_STATS_PUBLISHER_H_
@@ -43,6 +43,7 @@
 #include <costmap_2d/layered_costmap.h>
 #include <costmap_2d/observation_buffer.h>
 #include <costmap_2d/VoxelGrid.h>
+#include <costmap_2d/VoxelGridUpdate.h>
 #include <nav_msgs/OccupancyGrid.h>
 #include <sensor_msgs/LaserScan.h>
 #include <laser_geometry/laser_geometry.h>
@@ -54,7 +55,8 @@
 #include <dynamic_reconfigure/server.h>
 #include <costmap_2d/VoxelPluginConfig.h>
 #include <costmap_2d/obstacle_layer.h>
-#include <voxel_grid/voxel_grid.h>
+#include <costmap_2d/voxel_storage.h>
+#include <boost/scoped_ptr.hpp>
 
 namespace costmap_2d
 {
@@ -63,7 +65,9 @@ class VoxelLayer : public ObstacleLayer
 {
 public:
   VoxelLayer() :
-      voxel_grid_(0, 0, 0)
+      publish_voxel_updates_(false), voxel_keyframe_interval_(0), updates_since_keyframe_(0),
+      voxel_keyframe_needed_(true), voxel_shift_x_(0), voxel_shift_y_(0), voxel_memory_("costmap_2d/voxel_grid"), wide_columns_(false),
+      sparse_voxel_grid_(false)
   {
     costmap_ = NULL;  // this is the unsigned char* member of parent class's parent class Costmap2D.
   }
@@ -73,6 +77,11 @@ public:
   virtual void onInitialize();
   virtual void updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
                             double* max_x, double* max_y);
+  /** @brief The changes made by updateBounds() become a box of their own. */
+  virtual void updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds)
+  {
+    addOwnBounds(robot_x, robot_y, robot_yaw, bounds);
+  }
 
   void updateOrigin(double new_origin_x, double new_origin_y);
   bool isDiscretized()
@@ -94,11 +103,28 @@ private:
   virtual void raytraceFreespace(const costmap_2d::Observation& clearing_observation, double* min_x, double* min_y,
                                  double* max_x, double* max_y);
 
+  /** @brief Add the columns of the world bounds given to those changed since the last publishVoxels() */
+  void touchVoxelBounds(double min_x, double min_y, double max_x, double max_y);
+
+  /** @brief Publish the voxel grid, or only the columns changed since it was last published */
+  void publishVoxels();
+
   dynamic_reconfigure::Server<costmap_2d::VoxelPluginConfig> *voxel_dsrv_;
 
   bool publish_voxel_;
   ros::Publisher voxel_pub_;
-  voxel_grid::VoxelGrid voxel_grid_;
+  bool publish_voxel_updates_;  ///< Whether to publish the changed columns between full grids
+  int voxel_keyframe_interval_;  ///< The updates between full grids, 0 to send them only as the grid resizes
+  int updates_since_keyframe_;
+  bool voxel_keyframe_needed_;  ///< Whether the grid was resized, reset or moved past itself since the last full grid
+  int voxel_shift_x_, voxel_shift_y_;  ///< The cells the grid moved by since the last publishVoxels()
+  int dirty_min_x_, dirty_min_y_, dirty_max_x_, dirty_max_y_;  ///< The columns changed since the last publishVoxels()
+  ros::Publisher voxel_update_pub_;
+  boost::scoped_ptr<VoxelStorage> voxel_grid_;
+  nav_executor::MemoryCounter voxel_memory_;  ///< Counts the bytes of voxel_grid_, under the layer's name
+  bool wide_columns_;  ///< Whether the columns take 64 bits, for more than 16 z_voxels
+  bool sparse_voxel_grid_;  ///< Whether the columns are kept in blocks allocated as they are first written
+  std::vector<voxel_grid::LineEnd> clearing_ends_;  ///< The ends of the rays of the observation being cleared
   double z_resolution_, origin_z_;
   unsigned int unknown_threshold_, mark_threshold_, size_z_;
   ros::Publisher clearing_endpoints_pub_;
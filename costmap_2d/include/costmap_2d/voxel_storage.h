@@ -0,0 +1,178 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef COSTMAP_2D_VOXEL_STORAGE_H_
+#define COSTMAP_2D_VOXEL_STORAGE_H_
+#include <voxel_grid/voxel_grid.h>
+#include <voxel_grid/sparse_voxel_grid.h>
+#include <stdint.h>
+#include <vector>
+
+namespace costmap_2d
+{
+/**
+ * @brief The voxel grid of a VoxelLayer, whichever of the voxel_grid grids holds it.
+ */
+class VoxelStorage
+{
+public:
+  virtual ~VoxelStorage() {}
+
+  /** @brief The number of z levels a column holds */
+  virtual unsigned int levels() const = 0;
+
+  virtual void resize(unsigned int size_x, unsigned int size_y, unsigned int size_z) = 0;
+  virtual void reset() = 0;
+  virtual unsigned int sizeZ() const = 0;
+
+  /** @brief The bytes the grid has allocated */
+  virtual size_t memoryBytes() const = 0;
+
+  virtual bool markVoxelInMap(unsigned int x, unsigned int y, unsigned int z, unsigned int marked_threshold) = 0;
+  virtual void clearVoxelColumn(unsigned int index) = 0;
+  virtual void clearVoxelLinesInMap(double x0, double y0, double z0, const std::vector<voxel_grid::LineEnd>& ends,
+                                    unsigned char* map_2d, unsigned int unknown_threshold, unsigned int mark_threshold,
+                                    unsigned char free_cost, unsigned char unknown_cost, unsigned int max_length,
+                                    unsigned int num_threads, nav_executor::Lane lane) = 0;
+
+  /** @brief Move the columns so the one at (x, y) comes from (x + offset_x, y + offset_y) */
+  virtual void shift(int offset_x, int offset_y) = 0;
+
+  /** @brief Fill in data with the columns as costmap_2d/VoxelGrid lays them out */
+  virtual void getMessageData(std::vector<uint32_t>* data) = 0;
+
+  /** @brief Fill in data with the width by height columns at (x0, y0), as costmap_2d/VoxelGridUpdate lays them out */
+  virtual void getMessageData(std::vector<uint32_t>* data, unsigned int x0, unsigned int y0, unsigned int width,
+                              unsigned int height) = 0;
+};
+
+/**
+ * @brief A VoxelStorage holding a Grid of the voxel_grid package.
+ */
+template <class Grid>
+class VoxelStorageT : public VoxelStorage
+{
+public:
+  typedef typename Grid::ColumnType Column;
+
+  VoxelStorageT() : grid_(0, 0, 0), size_(0) {}
+
+  virtual unsigned int levels() const
+  {
+    return Grid::LEVELS;
+  }
+
+  virtual void resize(unsigned int size_x, unsigned int size_y, unsigned int size_z)
+  {
+    grid_.resize(size_x, size_y, size_z);
+    size_ = size_x * size_y;
+  }
+
+  virtual void reset()
+  {
+    grid_.reset();
+  }
+
+  virtual unsigned int sizeZ() const
+  {
+    return grid_.sizeZ();
+  }
+
+  virtual size_t memoryBytes() const
+  {
+    return grid_.memoryBytes();
+  }
+
+  virtual bool markVoxelInMap(unsigned int x, unsigned int y, unsigned int z, unsigned int marked_threshold)
+  {
+    return grid_.markVoxelInMap(x, y, z, marked_threshold);
+  }
+
+  virtual void clearVoxelColumn(unsigned int index)
+  {
+    grid_.clearVoxelColumn(index);
+  }
+
+  virtual void clearVoxelLinesInMap(double x0, double y0, double z0, const std::vector<voxel_grid::LineEnd>& ends,
+                                    unsigned char* map_2d, unsigned int unknown_threshold, unsigned int mark_threshold,
+                                    unsigned char free_cost, unsigned char unknown_cost, unsigned int max_length,
+                                    unsigned int num_threads, nav_executor::Lane lane)
+  {
+    grid_.clearVoxelLinesInMap(x0, y0, z0, ends, map_2d, unknown_threshold, mark_threshold, free_cost, unknown_cost,
+                               max_length, num_threads, lane);
+  }
+
+  virtual void shift(int offset_x, int offset_y)
+  {
+    grid_.shift(offset_x, offset_y);
+  }
+
+  virtual void getMessageData(std::vector<uint32_t>* data)
+  {
+    columns_.resize(size_);
+    if (size_ > 0)
+      grid_.copyColumns(&columns_[0]);
+    packColumns(data);
+  }
+
+  virtual void getMessageData(std::vector<uint32_t>* data, unsigned int x0, unsigned int y0, unsigned int width,
+                              unsigned int height)
+  {
+    columns_.resize(width * height);
+    if (!columns_.empty())
+      grid_.copyColumns(&columns_[0], x0, y0, width, height);
+    packColumns(data);
+  }
+
+private:
+  /** @brief Split columns_ into data, the words of a column wider than 32 bits low word first, see VoxelGrid.msg */
+  void packColumns(std::vector<uint32_t>* data) const
+  {
+    const unsigned int words = sizeof(Column) / sizeof(uint32_t);
+    data->resize(columns_.size() * words);
+    for (unsigned int i = 0; i < columns_.size(); ++i)
+    {
+      Column column = columns_[i];
+      for (unsigned int w = 0; w < words; ++w, column >>= 16, column >>= 16)
+        (*data)[i * words + w] = uint32_t(column);
+    }
+  }
+
+  Grid grid_;
+  unsigned int size_;  ///< The number of columns of the grid
+  std::vector<Column> columns_;  ///< The columns of the last message
+};
+
+}  // namespace costmap_2d
+#endif  // COSTMAP_2D_VOXEL_STORAGE_H_
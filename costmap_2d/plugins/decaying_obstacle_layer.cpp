@@ -0,0 +1,255 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#include <costmap_2d/decaying_obstacle_layer.h>
+#include <pluginlib/class_list_macros.h>
+
+#include <algorithm>
+
+PLUGINLIB_EXPORT_CLASS(costmap_2d::DecayingObstacleLayer, costmap_2d::Layer)
+
+using costmap_2d::LETHAL_OBSTACLE;
+using costmap_2d::FREE_SPACE;
+
+using costmap_2d::Observation;
+
+namespace costmap_2d
+{
+
+// Seconds after which the stamps are made relative to a newer epoch, well within the precision of a float
+static const double EPOCH_LENGTH = 3600.0;
+
+// add the box to the list if anything was touched
+static void addBounds(const Bounds& box, std::vector<Bounds>* bounds)
+{
+  if (box.min_x <= box.max_x && box.min_y <= box.max_y)
+    bounds->push_back(box);
+}
+
+void DecayingObstacleLayer::onInitialize()
+{
+  ros::NodeHandle private_nh("~/" + name_);
+  private_nh.param("decay_time", decay_time_, 5.0);
+  private_nh.param("clearing_rate", clearing_rate_, 1.0);
+  private_nh.param("clearing_subsample", clearing_subsample_, 4);
+  clearing_subsample_ = std::max(clearing_subsample_, 1);
+
+  epoch_ = last_clearing_ = ros::Time::now();
+  ObstacleLayer::onInitialize();
+
+  // the grid was sized by ObstacleLayer::matchSize() alone
+  last_seen_.assign(size_x_ * size_y_, -1.0f);
+}
+
+void DecayingObstacleLayer::matchSize()
+{
+  ObstacleLayer::matchSize();
+  last_seen_.assign(size_x_ * size_y_, -1.0f);
+  marked_cells_.clear();
+}
+
+void DecayingObstacleLayer::resetMaps()
+{
+  Costmap2D::resetMaps();
+  std::fill(last_seen_.begin(), last_seen_.end(), -1.0f);
+  marked_cells_.clear();
+}
+
+void DecayingObstacleLayer::updateOrigin(double new_origin_x, double new_origin_y)
+{
+  int cell_ox = int((new_origin_x - origin_x_) / resolution_);
+  int cell_oy = int((new_origin_y - origin_y_) / resolution_);
+  ObstacleLayer::updateOrigin(new_origin_x, new_origin_y);
+  if ((cell_ox == 0 && cell_oy == 0) || last_seen_.empty())
+    return;
+
+  // the stamps move with the cells, and the marked cells off the new window are forgotten
+  shiftMapRegion(&last_seen_[0], size_x_, size_y_, cell_ox, cell_oy, -1.0f);
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < marked_cells_.size(); ++i)
+  {
+    int mx = int(marked_cells_[i] % size_x_) - cell_ox, my = int(marked_cells_[i] / size_x_) - cell_oy;
+    if (mx >= 0 && my >= 0 && mx < int(size_x_) && my < int(size_y_))
+      marked_cells_[kept++] = getIndex(mx, my);
+  }
+  marked_cells_.resize(kept);
+}
+
+void DecayingObstacleLayer::collectBounds(double robot_x, double robot_y, double robot_yaw,
+                                          std::vector<Bounds>* bounds)
+{
+  if (rolling_window_)
+    updateOrigin(robot_x - getSizeInMetersX() / 2, robot_y - getSizeInMetersY() / 2);
+  if (!enabled_)
+    return;
+
+  Bounds empty;
+  empty.min_x = empty.min_y = 1e30;
+  empty.max_x = empty.max_y = -1e30;
+
+  Bounds box = empty;
+  useExtraBounds(&box.min_x, &box.min_y, &box.max_x, &box.max_y);
+  addBounds(box, bounds);
+
+  bool current = true;
+  std::vector<Observation> observations, clearing_observations;
+  current = current && getMarkingObservations(observations);
+  current = current && getClearingObservations(clearing_observations);
+  current_ = current;
+
+  newest_observation_ = ros::Time();
+  noteObservationTimes(observations);
+  noteObservationTimes(clearing_observations);
+
+  ros::Time now = ros::Time::now();
+  if (now < epoch_)
+  {
+    // time went back, as when a simulation restarts, so take the marks as seen now
+    for (unsigned int i = 0; i < marked_cells_.size(); ++i)
+      last_seen_[marked_cells_[i]] = 0.0f;
+    epoch_ = last_clearing_ = now;
+  }
+
+  box = empty;
+  expireMarks((now - epoch_).toSec(), &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+  addBounds(box, bounds);
+
+  // move the stamps on to a newer epoch before they lose precision; none left is older than decay_time_
+  if ((now - epoch_).toSec() > EPOCH_LENGTH + decay_time_)
+  {
+    ros::Time epoch = now - ros::Duration(decay_time_);
+    float shift = (epoch - epoch_).toSec();
+    for (unsigned int i = 0; i < marked_cells_.size(); ++i)
+      last_seen_[marked_cells_[i]] = std::max(last_seen_[marked_cells_[i]] - shift, 0.0f);
+    epoch_ = epoch;
+  }
+  float seconds = (now - epoch_).toSec();
+
+  // raytrace now and then, through a share of the points
+  if (clearing_rate_ > 0.0 && (now - last_clearing_).toSec() >= 1.0 / clearing_rate_)
+  {
+    last_clearing_ = now;
+    for (unsigned int i = 0; i < clearing_observations.size(); ++i)
+    {
+      Observation clearing = clearing_observations[i];
+      if (clearing_subsample_ > 1)
+      {
+        const pcl::PointCloud<pcl::PointXYZ>& full = *clearing.cloud_;
+        boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > cloud(new pcl::PointCloud<pcl::PointXYZ>());
+        cloud->header = full.header;
+        cloud->points.reserve(full.points.size() / clearing_subsample_ + 1);
+        for (unsigned int j = 0; j < full.points.size(); j += clearing_subsample_)
+          cloud->points.push_back(full.points[j]);
+        clearing.cloud_ = cloud;
+      }
+
+      box = empty;
+      raytraceFreespace(clearing, &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+      addBounds(box, bounds);
+    }
+  }
+
+  for (std::vector<Observation>::const_iterator it = observations.begin(); it != observations.end(); ++it)
+  {
+    box = empty;
+    markAndStamp(*it, seconds, &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+    addBounds(box, bounds);
+  }
+
+  box = empty;
+  updateFootprint(robot_x, robot_y, robot_yaw, &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+  addBounds(box, bounds);
+}
+
+void DecayingObstacleLayer::markAndStamp(const Observation& obs, float seen, double* min_x, double* min_y,
+                                         double* max_x, double* max_y)
+{
+  const pcl::PointCloud<pcl::PointXYZ>& cloud = *(obs.cloud_);
+  double sq_obstacle_range = obs.obstacle_range_ * obs.obstacle_range_;
+
+  for (unsigned int i = 0; i < cloud.points.size(); ++i)
+  {
+    double px = cloud.points[i].x, py = cloud.points[i].y, pz = cloud.points[i].z;
+
+    // if the obstacle is too high or too far away from the robot we won't add it
+    if (pz > max_obstacle_height_)
+      continue;
+
+    double sq_dist = (px - obs.origin_.x) * (px - obs.origin_.x) + (py - obs.origin_.y) * (py - obs.origin_.y)
+        + (pz - obs.origin_.z) * (pz - obs.origin_.z);
+    if (sq_dist >= sq_obstacle_range)
+      continue;
+
+    unsigned int mx, my;
+    if (!worldToMap(px, py, mx, my))
+      continue;
+
+    unsigned int index = getIndex(mx, my);
+    costmap_[index] = LETHAL_OBSTACLE;
+    if (last_seen_[index] < 0.0f)
+      marked_cells_.push_back(index);
+    last_seen_[index] = seen;
+    touch(px, py, min_x, min_y, max_x, max_y);
+  }
+}
+
+void DecayingObstacleLayer::expireMarks(float now, double* min_x, double* min_y, double* max_x, double* max_y)
+{
+  float oldest = now - decay_time_;
+  unsigned int i = 0;
+  while (i < marked_cells_.size())
+  {
+    unsigned int index = marked_cells_[i];
+    if (last_seen_[index] >= oldest)
+    {
+      ++i;
+      continue;
+    }
+
+    // free the cell, as raytracing would, and take it off the list
+    costmap_[index] = FREE_SPACE;
+    last_seen_[index] = -1.0f;
+    marked_cells_[i] = marked_cells_.back();
+    marked_cells_.pop_back();
+
+    unsigned int mx, my;
+    double wx, wy;
+    indexToCells(index, mx, my);
+    mapToWorld(mx, my, wx, wy);
+    touch(wx, wy, min_x, min_y, max_x, max_y);
+  }
+}
+
+}  // namespace costmap_2d
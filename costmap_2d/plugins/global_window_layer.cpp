@@ -0,0 +1,266 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#include <costmap_2d/global_window_layer.h>
+#include <pluginlib/class_list_macros.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+PLUGINLIB_EXPORT_CLASS(costmap_2d::GlobalWindowLayer, costmap_2d::Layer)
+
+using costmap_2d::NO_INFORMATION;
+using costmap_2d::FREE_SPACE;
+
+namespace costmap_2d
+{
+
+GlobalWindowLayer::GlobalWindowLayer() :
+    reader_(NULL), rolling_window_(false), use_maximum_(false), full_copy_(true), last_sequence_(0),
+    last_origin_x_(0.0), last_origin_y_(0.0), dsrv_(NULL)
+{
+}
+
+GlobalWindowLayer::~GlobalWindowLayer()
+{
+  delete reader_;
+  delete dsrv_;
+}
+
+void GlobalWindowLayer::onInitialize()
+{
+  ros::NodeHandle nh("~/" + name_);
+  current_ = false;
+  global_frame_ = layered_costmap_->getGlobalFrameID();
+  rolling_window_ = layered_costmap_->isRolling();
+
+  std::string shared_memory_name;
+  nh.param("shared_memory_name", shared_memory_name, std::string("/move_base_global_costmap"));
+  nh.param("use_maximum", use_maximum_, false);
+  delete reader_;
+  reader_ = new SharedCostmapReader(shared_memory_name);
+
+  setDefaultValue(layered_costmap_->isTrackingUnknown() ? NO_INFORMATION : FREE_SPACE);
+  matchSize();
+
+  if (dsrv_)
+  {
+    delete dsrv_;
+  }
+
+  dsrv_ = new dynamic_reconfigure::Server<costmap_2d::GenericPluginConfig>(nh);
+  dynamic_reconfigure::Server<costmap_2d::GenericPluginConfig>::CallbackType cb = boost::bind(
+      &GlobalWindowLayer::reconfigureCB, this, _1, _2);
+  dsrv_->setCallback(cb);
+}
+
+void GlobalWindowLayer::reconfigureCB(costmap_2d::GenericPluginConfig &config, uint32_t level)
+{
+  if (config.enabled != enabled_)
+  {
+    enabled_ = config.enabled;
+    full_copy_ = true;
+  }
+}
+
+void GlobalWindowLayer::matchSize()
+{
+  CostmapLayer::matchSize();
+  full_copy_ = true;
+}
+
+void GlobalWindowLayer::reset()
+{
+  resetMaps();
+  full_copy_ = true;
+}
+
+void GlobalWindowLayer::updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x,
+                                     double* min_y, double* max_x, double* max_y)
+{
+  if (rolling_window_)
+    updateOrigin(robot_x - getSizeInMetersX() / 2, robot_y - getSizeInMetersY() / 2);
+  if (!enabled_)
+    return;
+
+  useExtraBounds(min_x, min_y, max_x, max_y);
+
+  const SharedCostmapHeader* header = reader_->beginRead();
+  if (header == NULL)
+  {
+    current_ = false;
+    return;
+  }
+
+  // the writer is in the middle of an update, which the next cycle picks up
+  uint64_t sequence = reader_->getSequence();
+  if (sequence & 1)
+    return;
+
+  SharedCostmapHeader info = *header;
+  bool same_frame = global_frame_ == info.frame_id;
+  bool moved = origin_x_ != last_origin_x_ || origin_y_ != last_origin_y_;
+  if (same_frame && !full_copy_ && !moved && sequence == last_sequence_)
+    return;
+  if (uint64_t(info.size_x) * info.size_y > info.capacity)
+    return;
+
+  int x0 = 0, y0 = 0, xn = size_x_, yn = size_y_;
+  if (same_frame)
+  {
+    // after a single update of the shared map, only the cells it changed are copied again
+    if (!full_copy_ && !moved && sequence == last_sequence_ + 2)
+    {
+      double wx0 = info.origin_x + info.x0 * info.resolution, wy0 = info.origin_y + info.y0 * info.resolution;
+      double wxn = info.origin_x + info.xn * info.resolution, wyn = info.origin_y + info.yn * info.resolution;
+      x0 = std::max(0, int(floor((wx0 - origin_x_) / resolution_)));
+      y0 = std::max(0, int(floor((wy0 - origin_y_) / resolution_)));
+      xn = std::min(int(size_x_), int(ceil((wxn - origin_x_) / resolution_)));
+      yn = std::min(int(size_y_), int(ceil((wyn - origin_y_) / resolution_)));
+    }
+    if (x0 < xn && y0 < yn)
+    {
+      scratch_.resize(size_t(xn - x0) * (yn - y0));
+      copyAligned(info, reader_->cells(), x0, y0, xn, yn, &scratch_[0]);
+    }
+  }
+  else
+  {
+    // the frames may move against each other on every cycle, so everything is copied through the transform
+    tf::StampedTransform transform;
+    try
+    {
+      tf_->lookupTransform(info.frame_id, global_frame_, ros::Time(0), transform);
+    }
+    catch (tf::TransformException ex)
+    {
+      ROS_ERROR_THROTTLE(1.0, "%s", ex.what());
+      return;
+    }
+    scratch_.resize(size_t(size_x_) * size_y_);
+    copyTransformed(info, reader_->cells(), transform, &scratch_[0]);
+  }
+
+  // a copy the writer got in the way of is thrown away, and taken again in full
+  if (!reader_->endRead())
+  {
+    full_copy_ = true;
+    return;
+  }
+  for (int j = y0; j < yn; ++j)
+    memcpy(costmap_ + getIndex(x0, j), &scratch_[size_t(j - y0) * (xn - x0)], xn - x0);
+
+  full_copy_ = false;
+  last_sequence_ = sequence;
+  last_origin_x_ = origin_x_;
+  last_origin_y_ = origin_y_;
+  current_ = true;
+
+  if (x0 < xn && y0 < yn)
+  {
+    double wx, wy;
+    mapToWorld(x0, y0, wx, wy);
+    *min_x = std::min(wx - resolution_ / 2, *min_x);
+    *min_y = std::min(wy - resolution_ / 2, *min_y);
+    mapToWorld(xn - 1, yn - 1, wx, wy);
+    *max_x = std::max(wx + resolution_ / 2, *max_x);
+    *max_y = std::max(wy + resolution_ / 2, *max_y);
+  }
+}
+
+void GlobalWindowLayer::copyAligned(const SharedCostmapHeader& info, const unsigned char* cells, int x0, int y0,
+                                    int xn, int yn, unsigned char* out)
+{
+  columns_.resize(xn - x0);
+  for (int i = x0; i < xn; ++i)
+  {
+    int gx = int(floor((origin_x_ + (i + 0.5) * resolution_ - info.origin_x) / info.resolution));
+    columns_[i - x0] = gx >= 0 && gx < int(info.size_x) ? gx : -1;
+  }
+  rows_.resize(yn - y0);
+  for (int j = y0; j < yn; ++j)
+  {
+    int gy = int(floor((origin_y_ + (j + 0.5) * resolution_ - info.origin_y) / info.resolution));
+    rows_[j - y0] = gy >= 0 && gy < int(info.size_y) ? gy : -1;
+  }
+
+  for (int j = y0; j < yn; ++j)
+  {
+    unsigned char* row = out + size_t(j - y0) * (xn - x0);
+    if (rows_[j - y0] < 0)
+    {
+      memset(row, default_value_, xn - x0);
+      continue;
+    }
+    const unsigned char* in = cells + size_t(rows_[j - y0]) * info.size_x;
+    for (int i = 0; i < xn - x0; ++i)
+      row[i] = columns_[i] < 0 ? default_value_ : in[columns_[i]];
+  }
+}
+
+void GlobalWindowLayer::copyTransformed(const SharedCostmapHeader& info, const unsigned char* cells,
+                                        const tf::Transform& transform, unsigned char* out)
+{
+  for (unsigned int j = 0; j < size_y_; ++j)
+  {
+    for (unsigned int i = 0; i < size_x_; ++i)
+    {
+      double wx, wy;
+      mapToWorld(i, j, wx, wy);
+      tf::Point p = transform(tf::Point(wx, wy, 0));
+      int gx = int(floor((p.x() - info.origin_x) / info.resolution));
+      int gy = int(floor((p.y() - info.origin_y) / info.resolution));
+      if (gx >= 0 && gy >= 0 && gx < int(info.size_x) && gy < int(info.size_y))
+        out[getIndex(i, j)] = cells[size_t(gy) * info.size_x + gx];
+      else
+        out[getIndex(i, j)] = default_value_;
+    }
+  }
+}
+
+void GlobalWindowLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i,
+                                    int max_j)
+{
+  if (!enabled_)
+    return;
+
+  if (use_maximum_)
+    updateWithMax(master_grid, min_i, min_j, max_i, max_j);
+  else
+    updateWithTrueOverwrite(master_grid, min_i, min_j, max_i, max_j);
+}
+
+}  // namespace costmap_2d
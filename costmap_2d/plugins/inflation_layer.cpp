@@ -37,10 +37,22 @@
  *********************************************************************/
 #include <algorithm>
 #include <costmap_2d/inflation_layer.h>
+#include <costmap_2d/static_layer.h>
+#include <costmap_2d/global_window_layer.h>
 #include <costmap_2d/costmap_math.h>
 #include <costmap_2d/footprint.h>
 #include <boost/thread.hpp>
 #include <pluginlib/class_list_macros.h>
+#include <nav_executor/executor.h>
+#include <nav_executor/kernels.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INFLATION_KERNEL_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
 
 PLUGINLIB_EXPORT_CLASS(costmap_2d::InflationLayer, costmap_2d::Layer)
 
@@ -51,19 +63,33 @@ using costmap_2d::NO_INFORMATION;
 namespace costmap_2d
 {
 
+const unsigned int InflationLayer::NO_OBSTACLE;
+
 InflationLayer::InflationLayer()
   : inflation_radius_(0)
   , weight_(0)
   , cell_inflation_radius_(0)
   , cached_cell_inflation_radius_(0)
+  , inflation_bucket_(0)
   , dsrv_(NULL)
   , seen_(NULL)
-  , cached_costs_(NULL)
-  , cached_distances_(NULL)
+  , cache_stride_(0)
   , last_min_x_(-std::numeric_limits<float>::max())
   , last_min_y_(-std::numeric_limits<float>::max())
   , last_max_x_(std::numeric_limits<float>::max())
   , last_max_y_(std::numeric_limits<float>::max())
+  , incremental_(false)
+  , distances_valid_(false)
+  , distances_cell_radius_(0)
+  , distances_origin_x_(0)
+  , distances_origin_y_(0)
+  , distance_transform_(false)
+  , distance_transform_threads_(1)
+  , kernel_stamping_(false)
+  , static_base_(false)
+  , static_costs_valid_(false)
+  , static_revision_(0)
+  , memory_("costmap_2d/inflation")
 {
   inflation_access_ = new boost::recursive_mutex();
 }
@@ -73,12 +99,14 @@ void InflationLayer::onInitialize()
   {
     boost::unique_lock < boost::recursive_mutex > lock(*inflation_access_);
     ros::NodeHandle nh("~/" + name_), g_nh;
+    memory_.setComponent(name_);
     current_ = true;
     if (seen_)
       delete[] seen_;
     seen_ = NULL;
     seen_size_ = 0;
     need_reinflation_ = false;
+    distances_valid_ = false;
 
     dynamic_reconfigure::Server<costmap_2d::InflationPluginConfig>::CallbackType cb = boost::bind(
         &InflationLayer::reconfigureCB, this, _1, _2);
@@ -105,6 +133,34 @@ void InflationLayer::reconfigureCB(costmap_2d::InflationPluginConfig &config, ui
     enabled_ = config.enabled;
     need_reinflation_ = true;
   }
+
+  if (incremental_ != config.incremental) {
+    boost::unique_lock < boost::recursive_mutex > lock(*inflation_access_);
+    incremental_ = config.incremental;
+    distances_valid_ = false;
+    if (!incremental_)
+    {
+      // drop the kept distances, which can be large on a big map
+      std::vector<unsigned int>().swap(nearest_);
+      std::vector<bool>().swap(lethal_);
+      std::vector<bool>().swap(raise_);
+    }
+  }
+
+  {
+    boost::unique_lock < boost::recursive_mutex > lock(*inflation_access_);
+    distance_transform_ = config.distance_transform;
+    distance_transform_threads_ = config.distance_transform_threads;
+    if (!distance_transform_)
+      std::vector<float>().swap(transform_);
+    kernel_stamping_ = config.kernel_stamping;
+    if (!kernel_stamping_)
+      std::vector<unsigned char>().swap(stamped_);
+    static_base_ = config.static_base;
+    static_costs_valid_ = false;
+    if (!static_base_)
+      std::vector<unsigned char>().swap(static_costs_);
+  }
 }
 
 void InflationLayer::matchSize()
@@ -119,7 +175,9 @@ void InflationLayer::matchSize()
   if (seen_)
     delete[] seen_;
   seen_size_ = size_x * size_y;
-  seen_ = new bool[seen_size_];
+  seen_ = new bool[seen_size_]();
+  distances_valid_ = false;
+  accountMemory();
 }
 
 void InflationLayer::updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x,
@@ -157,6 +215,32 @@ void InflationLayer::updateBounds(double robot_x, double robot_y, double robot_y
   }
 }
 
+void InflationLayer::updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds)
+{
+  if (need_reinflation_)
+  {
+    last_bounds_ = *bounds;
+    Bounds all;
+    all.min_x = all.min_y = -std::numeric_limits<float>::max();
+    all.max_x = all.max_y = std::numeric_limits<float>::max();
+    bounds->assign(1, all);
+    need_reinflation_ = false;
+    return;
+  }
+
+  // as in updateBounds(), this cycle's changes and last cycle's both need reinflating
+  std::vector<Bounds> current = *bounds;
+  bounds->insert(bounds->end(), last_bounds_.begin(), last_bounds_.end());
+  last_bounds_.swap(current);
+  for (unsigned int i = 0; i < bounds->size(); ++i)
+  {
+    (*bounds)[i].min_x -= inflation_radius_;
+    (*bounds)[i].min_y -= inflation_radius_;
+    (*bounds)[i].max_x += inflation_radius_;
+    (*bounds)[i].max_y += inflation_radius_;
+  }
+}
+
 void InflationLayer::onFootprintChanged()
 {
   inscribed_radius_ = layered_costmap_->getInscribedRadius();
@@ -174,32 +258,23 @@ void InflationLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i,
 {
   boost::unique_lock < boost::recursive_mutex > lock(*inflation_access_);
   if (!enabled_)
+  {
+    // obstacle changes are not tracked while disabled
+    distances_valid_ = false;
     return;
+  }
 
-  // make sure the inflation queue is empty at the beginning of the cycle (should always be true)
-  ROS_ASSERT_MSG(inflation_queue_.empty(), "The inflation queue must be empty at the beginning of inflation");
+  // what the cycles before this one allocated
+  accountMemory();
 
   unsigned char* master_array = master_grid.getCharMap();
   unsigned int size_x = master_grid.getSizeInCellsX(), size_y = master_grid.getSizeInCellsY();
 
-  if (seen_ == NULL) {
-    ROS_WARN("InflationLayer::updateCosts(): seen_ array is NULL");
-    seen_size_ = size_x * size_y;
-    seen_ = new bool[seen_size_];
-  }
-  else if (seen_size_ != size_x * size_y)
-  {
-    ROS_WARN("InflationLayer::updateCosts(): seen_ array size is wrong");
-    delete[] seen_;
-    seen_size_ = size_x * size_y;
-    seen_ = new bool[seen_size_];
-  }
-  memset(seen_, false, size_x * size_y * sizeof(bool));
-
   // We need to include in the inflation cells outside the bounding
   // box min_i...max_j, by the amount cell_inflation_radius_.  Cells
   // up to that distance outside the box can still influence the costs
   // stored in cells inside the box.
+  int inner_min_i = min_i, inner_min_j = min_j, inner_max_i = max_i, inner_max_j = max_j;
   min_i -= cell_inflation_radius_;
   min_j -= cell_inflation_radius_;
   max_i += cell_inflation_radius_;
@@ -210,33 +285,86 @@ void InflationLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i,
   max_i = std::min(int(size_x), max_i);
   max_j = std::min(int(size_y), max_j);
 
+  if (incremental_)
+  {
+    updateCostsIncremental(master_grid, min_i, min_j, max_i, max_j);
+    return;
+  }
+
+  // the static walls are inflated once, and those of a global window come inflated, so only the other
+  // obstacles go through the wavefront below
+  const unsigned char* static_costs = static_base_ ? staticCosts(master_grid) : NULL;
+  const unsigned char* window_costs = static_base_ ? windowCosts(master_grid) : NULL;
+  bool split = static_costs != NULL || window_costs != NULL;
+
+  if (!split && kernel_stamping_ && !stamp_kernel_.empty())
+  {
+    updateCostsStamped(master_grid, min_i, min_j, max_i, max_j, std::max(0, inner_min_i),
+                       std::max(0, inner_min_j), std::min(int(size_x), inner_max_i),
+                       std::min(int(size_y), inner_max_j));
+    return;
+  }
+
+  if (!split && distance_transform_)
+  {
+    updateCostsTransform(master_grid, min_i, min_j, max_i, max_j, std::max(0, inner_min_i),
+                         std::max(0, inner_min_j), std::min(int(size_x), inner_max_i),
+                         std::min(int(size_y), inner_max_j));
+    return;
+  }
+
+  if (seen_ == NULL) {
+    ROS_WARN("InflationLayer::updateCosts(): seen_ array is NULL");
+    seen_size_ = size_x * size_y;
+    seen_ = new bool[seen_size_]();
+  }
+  else if (seen_size_ != size_x * size_y)
+  {
+    ROS_WARN("InflationLayer::updateCosts(): seen_ array size is wrong");
+    delete[] seen_;
+    seen_size_ = size_x * size_y;
+    seen_ = new bool[seen_size_]();
+  }
+
+  // Cells are only queued within cell_inflation_radius_ of the obstacles found
+  // below, so seen_ only needs clearing that far around the bounds.  Cells
+  // one further out may still be looked at, but a stale mark there only keeps
+  // out a cell that would be too far to queue anyway.
+  int seen_min_i = std::max(0, min_i - int(cell_inflation_radius_));
+  int seen_min_j = std::max(0, min_j - int(cell_inflation_radius_));
+  int seen_max_i = std::min(int(size_x), max_i + int(cell_inflation_radius_));
+  int seen_max_j = std::min(int(size_y), max_j + int(cell_inflation_radius_));
+  if (seen_min_i == 0 && seen_max_i == int(size_x))
+    memset(seen_ + seen_min_j * size_x, false, (seen_max_j - seen_min_j) * size_x * sizeof(bool));
+  else
+    for (int j = seen_min_j; j < seen_max_j; j++)
+      memset(seen_ + master_grid.getIndex(seen_min_i, j), false, (seen_max_i - seen_min_i) * sizeof(bool));
+
   for (int j = min_j; j < max_j; j++)
   {
     for (int i = min_i; i < max_i; i++)
     {
       int index = master_grid.getIndex(i, j);
       unsigned char cost = master_array[index];
-      if (cost == LETHAL_OBSTACLE)
+      if (cost == LETHAL_OBSTACLE && !(static_costs && static_costs[index] == LETHAL_OBSTACLE) &&
+          !(window_costs && window_costs[index] == LETHAL_OBSTACLE))
       {
         enqueue(index, i, j, i, j);
       }
     }
   }
 
-  while (!inflation_queue_.empty())
+  // Process the cells closest to an obstacle first
+  inflation_bucket_ = 0;
+  CellData current_cell(0, 0, 0, 0, 0, 0);
+  while (dequeue(current_cell))
   {
-    // get the highest priority cell and pop it off the priority queue
-    const CellData& current_cell = inflation_queue_.top();
-
     unsigned int index = current_cell.index_;
     unsigned int mx = current_cell.x_;
     unsigned int my = current_cell.y_;
     unsigned int sx = current_cell.src_x_;
     unsigned int sy = current_cell.src_y_;
 
-    // pop once we have our cell info
-    inflation_queue_.pop();
-
     // set the cost of the cell being inserted
     if (seen_[index])
     {
@@ -263,10 +391,111 @@ void InflationLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i,
     if (my < size_y - 1)
       enqueue(index + size_x, mx, my + 1, sx, sy);
   }
+
+  if (static_costs)
+    mergeCosts(master_grid, static_costs, size_x, 0, 0, std::max(0, inner_min_i), std::max(0, inner_min_j),
+               std::min(int(size_x), inner_max_i), std::min(int(size_y), inner_max_j));
+}
+
+const unsigned char* InflationLayer::staticCosts(const costmap_2d::Costmap2D& master_grid)
+{
+  // a rolling window does not line the static layers up with the master grid
+  if (layered_costmap_->isRolling())
+    return NULL;
+
+  unsigned int size_x = master_grid.getSizeInCellsX(), size_y = master_grid.getSizeInCellsY();
+  std::vector<const StaticLayer*> layers;
+  unsigned int revision = 0;
+  std::vector<boost::shared_ptr<Layer> >* plugins = layered_costmap_->getPlugins();
+  for (unsigned int p = 0; p < plugins->size() && (*plugins)[p].get() != this; ++p)
+  {
+    const StaticLayer* layer = dynamic_cast<const StaticLayer*>((*plugins)[p].get());
+    if (layer == NULL)
+      continue;
+    if (layer->getSizeInCellsX() != size_x || layer->getSizeInCellsY() != size_y)
+      return NULL;
+    layers.push_back(layer);
+    revision += layer->getRevision();
+  }
+  if (layers.empty())
+    return NULL;
+
+  if (!static_costs_valid_ || revision != static_revision_ || static_costs_.size() != size_x * size_y)
+  {
+    inflateStatic(layers, size_x, size_y);
+    static_costs_valid_ = true;
+    static_revision_ = revision;
+  }
+  return &static_costs_[0];
+}
+
+const unsigned char* InflationLayer::windowCosts(const costmap_2d::Costmap2D& master_grid)
+{
+  std::vector<boost::shared_ptr<Layer> >* plugins = layered_costmap_->getPlugins();
+  for (unsigned int p = 0; p < plugins->size() && (*plugins)[p].get() != this; ++p)
+  {
+    const GlobalWindowLayer* layer = dynamic_cast<const GlobalWindowLayer*>((*plugins)[p].get());
+    if (layer != NULL && layer->getSizeInCellsX() == master_grid.getSizeInCellsX() &&
+        layer->getSizeInCellsY() == master_grid.getSizeInCellsY())
+      return layer->getCharMap();
+  }
+  return NULL;
+}
+
+void InflationLayer::inflateStatic(const std::vector<const StaticLayer*>& layers, unsigned int size_x,
+                                   unsigned int size_y)
+{
+  static_costs_.assign(size_x * size_y, 0);
+  if (seen_ == NULL || seen_size_ != size_x * size_y)
+  {
+    delete[] seen_;
+    seen_size_ = size_x * size_y;
+    seen_ = new bool[seen_size_];
+  }
+  memset(seen_, false, seen_size_ * sizeof(bool));
+
+  // the layers are read a row at a time, as they may hold their costs packed
+  std::vector<unsigned char> row(size_x), lethal(size_x);
+  for (unsigned int j = 0; j < size_y; j++)
+  {
+    std::fill(lethal.begin(), lethal.end(), 0);
+    for (unsigned int l = 0; l < layers.size(); ++l)
+    {
+      layers[l]->copyRow(0, j, size_x, &row[0]);
+      for (unsigned int i = 0; i < size_x; i++)
+        lethal[i] |= row[i] == LETHAL_OBSTACLE;
+    }
+    for (unsigned int i = 0; i < size_x; i++)
+    {
+      if (lethal[i])
+        enqueue(j * size_x + i, i, j, i, j);
+    }
+  }
+
+  // the nearest obstacle reaches each cell first, so its cost is simply taken
+  inflation_bucket_ = 0;
+  CellData cell(0, 0, 0, 0, 0, 0);
+  while (dequeue(cell))
+  {
+    unsigned int index = cell.index_;
+    if (seen_[index])
+      continue;
+    seen_[index] = true;
+    static_costs_[index] = costLookup(cell.x_, cell.y_, cell.src_x_, cell.src_y_);
+
+    if (cell.x_ > 0)
+      enqueue(index - 1, cell.x_ - 1, cell.y_, cell.src_x_, cell.src_y_);
+    if (cell.y_ > 0)
+      enqueue(index - size_x, cell.x_, cell.y_ - 1, cell.src_x_, cell.src_y_);
+    if (cell.x_ < size_x - 1)
+      enqueue(index + 1, cell.x_ + 1, cell.y_, cell.src_x_, cell.src_y_);
+    if (cell.y_ < size_y - 1)
+      enqueue(index + size_x, cell.x_, cell.y_ + 1, cell.src_x_, cell.src_y_);
+  }
 }
 
 /**
- * @brief  Given an index of a cell in the costmap, place it into a priority queue for obstacle inflation
+ * @brief  Given an index of a cell in the costmap, place it into the inflation buckets for obstacle inflation
  * @param  grid The costmap
  * @param  index The index of the cell
  * @param  mx The x coordinate of the cell (can be computed from the index, but saves time to store it)
@@ -286,71 +515,631 @@ inline void InflationLayer::enqueue(unsigned int index, unsigned int mx, unsigne
     if (distance > cell_inflation_radius_)
       return;
 
-    // push the cell data onto the queue and mark
-    CellData data(distance, index, mx, my, src_x, src_y);
-    inflation_queue_.push(data);
+    // push the cell data into the bucket of its squared distance, which orders
+    // the cells exactly as their distance does
+    unsigned int dx = abs(int(mx) - int(src_x));
+    unsigned int dy = abs(int(my) - int(src_y));
+    unsigned int bucket = dx * dx + dy * dy;
+    inflation_cells_[bucket].push_back(CellData(distance, index, mx, my, src_x, src_y));
+    if (bucket < inflation_bucket_)
+      inflation_bucket_ = bucket;
   }
 }
 
-void InflationLayer::computeCaches()
+inline bool InflationLayer::dequeue(CellData& cell)
 {
-  if (cell_inflation_radius_ == 0)
+  while (inflation_bucket_ < inflation_cells_.size())
+  {
+    std::vector<CellData>& bucket = inflation_cells_[inflation_bucket_];
+    if (!bucket.empty())
+    {
+      cell = bucket.back();
+      bucket.pop_back();
+      return true;
+    }
+    ++inflation_bucket_;
+  }
+  return false;
+}
+
+void InflationLayer::updateTile(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
+{
+  // No lock here, the tiles run concurrently: the parameters and caches are only changed with
+  // the master grid locked, which the LayeredCostmap holds while it runs the tiles
+  if (!enabled_)
     return;
 
-  // based on the inflation radius... compute distance and cost caches
-  if (cell_inflation_radius_ != cached_cell_inflation_radius_)
+  unsigned char* master_array = master_grid.getCharMap();
+  int size_x = master_grid.getSizeInCellsX(), size_y = master_grid.getSizeInCellsY();
+  int radius = cell_inflation_radius_;
+
+  // Obstacles up to the inflation radius outside the tile can still raise the costs inside it,
+  // and the cells between them and the tile can lie up to twice that far out
+  int src_min_i = std::max(0, min_i - radius), src_min_j = std::max(0, min_j - radius);
+  int src_max_i = std::min(size_x, max_i + radius), src_max_j = std::min(size_y, max_j + radius);
+  int reach_min_i = std::max(0, min_i - 2 * radius), reach_min_j = std::max(0, min_j - 2 * radius);
+  int reach_max_i = std::min(size_x, max_i + 2 * radius), reach_max_j = std::min(size_y, max_j + 2 * radius);
+  int reach_x = reach_max_i - reach_min_i;
+
+  if (!tile_scratch_.get())
+    tile_scratch_.reset(new TileScratch());
+  std::vector<bool>& seen = tile_scratch_->seen;
+  std::vector<std::vector<CellData> >& cells = tile_scratch_->cells;
+  seen.assign(reach_x * (reach_max_j - reach_min_j), false);
+  cells.resize(inflation_cells_.size());
+  unsigned int bucket = 0;
+
+  for (int j = src_min_j; j < src_max_j; j++)
+    for (int i = src_min_i; i < src_max_i; i++)
+      if (master_array[master_grid.getIndex(i, j)] == LETHAL_OBSTACLE)
+        cells[0].push_back(CellData(0, master_grid.getIndex(i, j), i, j, i, j));
+
+  while (bucket < cells.size())
   {
-    deleteKernels();
+    if (cells[bucket].empty())
+    {
+      ++bucket;
+      continue;
+    }
+    CellData current_cell = cells[bucket].back();
+    cells[bucket].pop_back();
+
+    int mx = current_cell.x_, my = current_cell.y_;
+    int sx = current_cell.src_x_, sy = current_cell.src_y_;
+    int local = (my - reach_min_j) * reach_x + mx - reach_min_i;
+    if (seen[local])
+      continue;
+    seen[local] = true;
+
+    if (mx >= min_i && mx < max_i && my >= min_j && my < max_j)
+    {
+      unsigned int index = current_cell.index_;
+      unsigned char cost = costLookup(mx, my, sx, sy);
+      unsigned char old_cost = master_array[index];
+      if (old_cost == NO_INFORMATION && cost >= INSCRIBED_INFLATED_OBSTACLE)
+        master_array[index] = cost;
+      else
+        master_array[index] = std::max(old_cost, cost);
+    }
+
+    // attempt to put the neighbors of the current cell into the buckets, as enqueue() does
+    int neighbors[4][2] = {{mx - 1, my}, {mx, my - 1}, {mx + 1, my}, {mx, my + 1}};
+    for (int n = 0; n < 4; ++n)
+    {
+      int x = neighbors[n][0], y = neighbors[n][1];
+      if (x < reach_min_i || y < reach_min_j || x >= reach_max_i || y >= reach_max_j
+          || seen[(y - reach_min_j) * reach_x + x - reach_min_i])
+        continue;
+
+      double distance = distanceLookup(x, y, sx, sy);
+      if (distance > cell_inflation_radius_)
+        continue;
+
+      unsigned int dx = abs(x - sx), dy = abs(y - sy);
+      unsigned int key = dx * dx + dy * dy;
+      cells[key].push_back(CellData(distance, master_grid.getIndex(x, y), x, y, sx, sy));
+      if (key < bucket)
+        bucket = key;
+    }
+  }
+}
+
+void InflationLayer::updateCostsIncremental(costmap_2d::Costmap2D& master_grid, int min_i, int min_j,
+                                            int max_i, int max_j)
+{
+  unsigned char* master_array = master_grid.getCharMap();
+  unsigned int size_x = master_grid.getSizeInCellsX(), size_y = master_grid.getSizeInCellsY();
 
-    cached_costs_ = new unsigned char*[cell_inflation_radius_ + 2];
-    cached_distances_ = new double*[cell_inflation_radius_ + 2];
+  // The kept distances are only good for the grid and radius they were computed on, so start
+  // over (looking at the whole grid for obstacles) when either has changed
+  int scan_min_i = min_i, scan_min_j = min_j, scan_max_i = max_i, scan_max_j = max_j;
+  if (!distances_valid_ || nearest_.size() != size_x * size_y || distances_cell_radius_ != cell_inflation_radius_
+      || distances_origin_x_ != master_grid.getOriginX() || distances_origin_y_ != master_grid.getOriginY())
+  {
+    nearest_.assign(size_x * size_y, NO_OBSTACLE);
+    lethal_.assign(size_x * size_y, false);
+    raise_.assign(size_x * size_y, false);
+    distances_valid_ = true;
+    distances_cell_radius_ = cell_inflation_radius_;
+    distances_origin_x_ = master_grid.getOriginX();
+    distances_origin_y_ = master_grid.getOriginY();
+    scan_min_i = 0;
+    scan_min_j = 0;
+    scan_max_i = size_x;
+    scan_max_j = size_y;
+  }
 
-    for (unsigned int i = 0; i <= cell_inflation_radius_ + 1; ++i)
+  // Queue the lethal cells that appeared or went away.  Other layers only change cells inside
+  // the bounds, so cells outside them are as they were when last looked at.
+  inflation_bucket_ = 0;
+  for (int j = scan_min_j; j < scan_max_j; j++)
+  {
+    for (int i = scan_min_i; i < scan_max_i; i++)
     {
-      cached_costs_[i] = new unsigned char[cell_inflation_radius_ + 2];
-      cached_distances_[i] = new double[cell_inflation_radius_ + 2];
-      for (unsigned int j = 0; j <= cell_inflation_radius_ + 1; ++j)
+      int index = master_grid.getIndex(i, j);
+      bool lethal = master_array[index] == LETHAL_OBSTACLE;
+      if (lethal == lethal_[index])
+        continue;
+
+      lethal_[index] = lethal;
+      if (lethal)
       {
-        cached_distances_[i][j] = hypot(i, j);
+        nearest_[index] = index;
+        queueCell(0, index, i, j);
       }
+      else
+        clearObstacle(index, i, j, size_x, size_y);
     }
+  }
 
-    cached_cell_inflation_radius_ = cell_inflation_radius_;
+  propagateDistances(size_x, size_y);
+
+  // assign the cost associated with the distance from the closest obstacle to each cell
+  for (int j = min_j; j < max_j; j++)
+  {
+    for (int i = min_i; i < max_i; i++)
+    {
+      int index = master_grid.getIndex(i, j);
+      unsigned int src = nearest_[index];
+      if (src == NO_OBSTACLE)
+        continue;
+
+      unsigned char cost = costLookup(i, j, src % size_x, src / size_x);
+      unsigned char old_cost = master_array[index];
+      if (old_cost == NO_INFORMATION && cost >= INSCRIBED_INFLATED_OBSTACLE)
+        master_array[index] = cost;
+      else
+        master_array[index] = std::max(old_cost, cost);
+    }
   }
+}
+
+// Far enough for no parabola of the transform to reach the cells it leaves, yet finite as the passes need it
+static const float FAR_AWAY = 1e20f;
 
-  for (unsigned int i = 0; i <= cell_inflation_radius_ + 1; ++i)
+/**
+ * @brief  The squared Euclidean distance transform of Felzenszwalb and Huttenlocher along one line of a grid,
+ * in place: each sample becomes the lowest of the samples plus their squared distance from it
+ * @param  data The first sample
+ * @param  n The number of samples
+ * @param  stride The distance between samples in the grid
+ * @param  f Scratch for the samples
+ * @param  v Scratch for the samples whose parabolas make up the lower envelope
+ * @param  z Scratch for where each parabola of the envelope takes over
+ */
+static void transformLine(float* data, unsigned int n, unsigned int stride, std::vector<double>& f,
+                          std::vector<int>& v, std::vector<double>& z)
+{
+  f.resize(n);
+  v.resize(n);
+  z.resize(n + 1);
+  for (unsigned int q = 0; q < n; ++q)
+    f[q] = data[q * stride];
+
+  int k = 0;
+  v[0] = 0;
+  z[0] = -std::numeric_limits<double>::max();
+  z[1] = std::numeric_limits<double>::max();
+  for (int q = 1; q < int(n); ++q)
   {
-    for (unsigned int j = 0; j <= cell_inflation_radius_ + 1; ++j)
+    double s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0 * (q - v[k]));
+    while (s <= z[k])
     {
-      cached_costs_[i][j] = computeCost(cached_distances_[i][j]);
+      --k;
+      s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0 * (q - v[k]));
     }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = std::numeric_limits<double>::max();
+  }
+
+  k = 0;
+  for (int q = 0; q < int(n); ++q)
+  {
+    while (z[k + 1] < q)
+      ++k;
+    data[q * stride] = std::min<double>((q - v[k]) * (q - v[k]) + f[v[k]], FAR_AWAY);
   }
 }
 
-void InflationLayer::deleteKernels()
+// The first pass of the transform, down the columns from begin to end of a grid of the given size
+static void transformColumns(float* grid, unsigned int size_x, unsigned int size_y, unsigned int begin,
+                             unsigned int end)
+{
+  std::vector<double> f, z;
+  std::vector<int> v;
+  for (unsigned int i = begin; i < end; ++i)
+    transformLine(grid + i, size_y, size_x, f, v, z);
+}
+
+// The second pass of the transform, along the rows from begin to end of a grid of the given size
+static void transformRows(float* grid, unsigned int size_x, unsigned int begin, unsigned int end)
+{
+  std::vector<double> f, z;
+  std::vector<int> v;
+  for (unsigned int j = begin; j < end; ++j)
+    transformLine(grid + j * size_x, size_x, 1, f, v, z);
+}
+
+// transformColumns() over the band of the columns of a grid split into the given number of bands
+static void transformColumnBand(float* grid, unsigned int size_x, unsigned int size_y, unsigned int bands,
+                                unsigned int band)
+{
+  transformColumns(grid, size_x, size_y, size_x * band / bands, size_x * (band + 1) / bands);
+}
+
+// transformRows() over the band of the rows of a grid split into the given number of bands
+static void transformRowBand(float* grid, unsigned int size_x, unsigned int size_y, unsigned int bands,
+                             unsigned int band)
+{
+  transformRows(grid, size_x, size_y * band / bands, size_y * (band + 1) / bands);
+}
+
+void InflationLayer::updateCostsTransform(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i,
+                                          int max_j, int inner_min_i, int inner_min_j, int inner_max_i,
+                                          int inner_max_j)
+{
+  if (min_i >= max_i || min_j >= max_j || inner_min_i >= inner_max_i || inner_min_j >= inner_max_j ||
+      squared_costs_.empty())
+    return;
+
+  unsigned char* master_array = master_grid.getCharMap();
+  unsigned int width = max_i - min_i, height = max_j - min_j;
+  transform_.resize(width * height);
+  for (int j = min_j; j < max_j; j++)
+  {
+    const unsigned char* row = master_array + master_grid.getIndex(min_i, j);
+    float* out = &transform_[(j - min_j) * width];
+    for (unsigned int i = 0; i < width; i++)
+      out[i] = row[i] == LETHAL_OBSTACLE ? 0.0f : FAR_AWAY;
+  }
+
+  // each pass runs along independent lines, which the workers of the executor split between them
+  float* grid = &transform_[0];
+  unsigned int num_threads = std::max(distance_transform_threads_, 1);
+  if (num_threads == 1)
+  {
+    transformColumns(grid, width, height, 0, width);
+    transformRows(grid, width, 0, height);
+  }
+  else
+  {
+    nav_executor::Executor& executor = nav_executor::Executor::shared();
+    executor.run(layered_costmap_->getLane(), num_threads,
+                 boost::bind(transformColumnBand, grid, width, height, num_threads, _1));
+    executor.run(layered_costmap_->getLane(), num_threads,
+                 boost::bind(transformRowBand, grid, width, height, num_threads, _1));
+  }
+
+  // only the cells within the inflation radius of an obstacle change, as with the wavefront
+  float max_distance = cell_inflation_radius_ * cell_inflation_radius_;
+  for (int j = inner_min_j; j < inner_max_j; j++)
+  {
+    const float* distances = &transform_[(j - min_j) * width + (inner_min_i - min_i)];
+    unsigned char* row = master_array + master_grid.getIndex(inner_min_i, j);
+    for (int i = 0; i < inner_max_i - inner_min_i; i++)
+    {
+      if (distances[i] > max_distance)
+        continue;
+      unsigned char cost = squared_costs_[(unsigned int)distances[i]];
+      unsigned char old_cost = row[i];
+      if (old_cost == NO_INFORMATION && cost >= INSCRIBED_INFLATED_OBSTACLE)
+        row[i] = cost;
+      else
+        row[i] = std::max(old_cost, cost);
+    }
+  }
+}
+
+#ifdef __SSE2__
+// The cells of maxRow() from i on, 16 at a time, returning the first cell left
+static inline unsigned int maxRowSse2(unsigned char* dst, const unsigned char* src, unsigned int n, unsigned int i)
+{
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_max_epu8(a, b));
+  }
+  return i;
+}
+#endif
+
+#if INFLATION_KERNEL_AVX2
+// The same 32 at a time, run only where the CPU has AVX2
+__attribute__((target("avx2"))) static unsigned int maxRowAvx2(unsigned char* dst, const unsigned char* src,
+                                                               unsigned int n)
+{
+  unsigned int i = 0;
+  for (; i + 32 <= n; i += 32)
+  {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_max_epu8(a, b));
+  }
+  return maxRowSse2(dst, src, n, i);
+}
+#endif
+
+// The variant of maxRow() for this CPU, picked on first use
+static nav_executor::KernelVariant stampKernel()
+{
+  unsigned int compiled = 0;
+#ifdef __SSE2__
+  compiled |= nav_executor::kernelBit(nav_executor::KERNEL_SSE2);
+#endif
+#if INFLATION_KERNEL_AVX2
+  compiled |= nav_executor::kernelBit(nav_executor::KERNEL_AVX2);
+#endif
+  static const nav_executor::KernelVariant variant = nav_executor::selectKernel("costmap_2d/inflation_stamp", compiled);
+  return variant;
+}
+
+// Raise each of n cells of dst to the cell of src, if that is higher
+static inline void maxRow(unsigned char* dst, const unsigned char* src, unsigned int n,
+                          nav_executor::KernelVariant variant)
+{
+  unsigned int i = 0;
+  switch (variant)
+  {
+#if INFLATION_KERNEL_AVX2
+    case nav_executor::KERNEL_AVX2:
+      i = maxRowAvx2(dst, src, n);
+      break;
+#endif
+#ifdef __SSE2__
+    case nav_executor::KERNEL_SSE2:
+      i = maxRowSse2(dst, src, n, 0);
+      break;
+#endif
+    default:
+      break;
+  }
+  for (; i < n; ++i)
+    dst[i] = std::max(dst[i], src[i]);
+}
+
+void InflationLayer::updateCostsStamped(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i,
+                                        int max_j, int inner_min_i, int inner_min_j, int inner_max_i,
+                                        int inner_max_j)
+{
+  if (min_i >= max_i || min_j >= max_j || inner_min_i >= inner_max_i || inner_min_j >= inner_max_j)
+    return;
+
+  const unsigned char* master_array = master_grid.getCharMap();
+  int width = max_i - min_i, height = max_j - min_j;
+  stamped_.assign(width * height, 0);
+
+  // the cost of a cell is that of its closest obstacle, which is the highest any obstacle gives it
+  int r = cell_inflation_radius_, kernel_width = 2 * r + 1;
+  nav_executor::KernelVariant variant = stampKernel();
+  for (int j = min_j; j < max_j; j++)
+  {
+    const unsigned char* row = master_array + master_grid.getIndex(0, j);
+    for (int i = min_i; i < max_i; i++)
+    {
+      if (row[i] != LETHAL_OBSTACLE)
+        continue;
+
+      // the part of the kernel within the area
+      int x0 = std::max(i - r, min_i), x1 = std::min(i + r + 1, max_i);
+      int y0 = std::max(j - r, min_j), y1 = std::min(j + r + 1, max_j);
+      for (int y = y0; y < y1; y++)
+        maxRow(&stamped_[(y - min_j) * width + (x0 - min_i)],
+               &stamp_kernel_[(y - j + r) * kernel_width + (x0 - i + r)], x1 - x0, variant);
+    }
+  }
+
+  mergeCosts(master_grid, &stamped_[0], width, min_i, min_j, inner_min_i, inner_min_j, inner_max_i, inner_max_j);
+}
+
+void InflationLayer::mergeCosts(costmap_2d::Costmap2D& master_grid, const unsigned char* costs, unsigned int width,
+                                int min_i, int min_j, int inner_min_i, int inner_min_j, int inner_max_i,
+                                int inner_max_j)
+{
+  unsigned char* master_array = master_grid.getCharMap();
+  for (int j = inner_min_j; j < inner_max_j; j++)
+  {
+    const unsigned char* in = costs + (j - min_j) * width + (inner_min_i - min_i);
+    unsigned char* row = master_array + master_grid.getIndex(inner_min_i, j);
+    for (int i = 0; i < inner_max_i - inner_min_i; i++)
+    {
+      unsigned char cost = in[i], old_cost = row[i];
+      if (old_cost == NO_INFORMATION && cost >= INSCRIBED_INFLATED_OBSTACLE)
+        row[i] = cost;
+      else
+        row[i] = std::max(old_cost, cost);
+    }
+  }
+}
+
+void InflationLayer::clearObstacle(unsigned int index, unsigned int mx, unsigned int my,
+                                   unsigned int size_x, unsigned int size_y)
 {
-  if (cached_distances_ != NULL)
+  // Every cell inflated from the obstacle lies within the inflation radius of it.  Clearing them
+  // all here, rather than through a wave spreading out from the obstacle, also reaches the ones
+  // that are cut off from it by cells a closer obstacle has taken over.
+  unsigned int r = cell_inflation_radius_;
+  unsigned int x0 = mx > r ? mx - r : 0, y0 = my > r ? my - r : 0;
+  unsigned int x1 = std::min(mx + r, size_x - 1), y1 = std::min(my + r, size_y - 1);
+  for (unsigned int y = y0; y <= y1; ++y)
   {
-    for (unsigned int i = 0; i <= cached_cell_inflation_radius_ + 1; ++i)
+    for (unsigned int x = x0; x <= x1; ++x)
+    {
+      unsigned int cell = y * size_x + x;
+      if (nearest_[cell] != index)
+        continue;
+
+      unsigned int dx = abs(int(x) - int(mx)), dy = abs(int(y) - int(my));
+      nearest_[cell] = NO_OBSTACLE;
+      raise_[cell] = true;
+      queueCell(dx * dx + dy * dy, cell, x, y);
+    }
+  }
+}
+
+void InflationLayer::propagateDistances(unsigned int size_x, unsigned int size_y)
+{
+  CellData current_cell(0, 0, 0, 0, 0, 0);
+  while (dequeue(current_cell))
+  {
+    unsigned int index = current_cell.index_;
+    unsigned int mx = current_cell.x_;
+    unsigned int my = current_cell.y_;
+
+    // the four neighbors of the cell, as in the full inflation
+    unsigned int neighbors[4], neighbor_x[4], neighbor_y[4];
+    unsigned int count = 0;
+    if (mx > 0)
+    {
+      neighbors[count] = index - 1;
+      neighbor_x[count] = mx - 1;
+      neighbor_y[count++] = my;
+    }
+    if (my > 0)
+    {
+      neighbors[count] = index - size_x;
+      neighbor_x[count] = mx;
+      neighbor_y[count++] = my - 1;
+    }
+    if (mx < size_x - 1)
+    {
+      neighbors[count] = index + 1;
+      neighbor_x[count] = mx + 1;
+      neighbor_y[count++] = my;
+    }
+    if (my < size_y - 1)
+    {
+      neighbors[count] = index + size_x;
+      neighbor_x[count] = mx;
+      neighbor_y[count++] = my + 1;
+    }
+
+    if (raise_[index])
+    {
+      // Raise: queue the neighbors that still have an obstacle again, so that they spread it
+      // into the cleared cell
+      for (unsigned int n = 0; n < count; ++n)
+      {
+        unsigned int neighbor = neighbors[n];
+        unsigned int src = nearest_[neighbor];
+        if (src == NO_OBSTACLE || raise_[neighbor])
+          continue;
+
+        unsigned int dx = abs(int(neighbor_x[n]) - int(src % size_x));
+        unsigned int dy = abs(int(neighbor_y[n]) - int(src / size_x));
+        queueCell(dx * dx + dy * dy, neighbor, neighbor_x[n], neighbor_y[n]);
+      }
+      raise_[index] = false;
+      continue;
+    }
+
+    // Lower: skip entries that a closer obstacle has since replaced
+    unsigned int src = nearest_[index];
+    if (src == NO_OBSTACLE)
+      continue;
+    unsigned int sx = src % size_x, sy = src / size_x;
+    unsigned int dx = abs(int(mx) - int(sx)), dy = abs(int(my) - int(sy));
+    if (current_cell.distance_ != dx * dx + dy * dy)
+      continue;
+
+    for (unsigned int n = 0; n < count; ++n)
     {
-      if (cached_distances_[i])
-        delete[] cached_distances_[i];
+      unsigned int neighbor = neighbors[n];
+      if (raise_[neighbor] || distanceLookup(neighbor_x[n], neighbor_y[n], sx, sy) > cell_inflation_radius_)
+        continue;
+
+      dx = abs(int(neighbor_x[n]) - int(sx));
+      dy = abs(int(neighbor_y[n]) - int(sy));
+      unsigned int bucket = dx * dx + dy * dy;
+      unsigned int old_src = nearest_[neighbor];
+      if (old_src != NO_OBSTACLE)
+      {
+        unsigned int old_dx = abs(int(neighbor_x[n]) - int(old_src % size_x));
+        unsigned int old_dy = abs(int(neighbor_y[n]) - int(old_src / size_x));
+        if (old_dx * old_dx + old_dy * old_dy <= bucket)
+          continue;
+      }
+      nearest_[neighbor] = src;
+      queueCell(bucket, neighbor, neighbor_x[n], neighbor_y[n]);
     }
-    if (cached_distances_)
-      delete[] cached_distances_;
-    cached_distances_ = NULL;
   }
+}
+
+inline void InflationLayer::queueCell(unsigned int bucket, unsigned int index, unsigned int mx, unsigned int my)
+{
+  inflation_cells_[bucket].push_back(CellData(bucket, index, mx, my, mx, my));
+  if (bucket < inflation_bucket_)
+    inflation_bucket_ = bucket;
+}
+
+// Largest inflation radius, in cells, that the stamping kernel is kept for; 1.6 m at 5 cm
+static const unsigned int MAX_STAMP_RADIUS = 32;
+
+void InflationLayer::computeCaches()
+{
+  static_costs_valid_ = false;
+  if (cell_inflation_radius_ == 0)
+    return;
 
-  if (cached_costs_ != NULL)
+  // based on the inflation radius... compute distance and cost caches
+  if (cell_inflation_radius_ != cached_cell_inflation_radius_)
   {
-    for (unsigned int i = 0; i <= cached_cell_inflation_radius_ + 1; ++i)
+    cache_stride_ = cell_inflation_radius_ + 2;
+    cached_costs_.resize(cache_stride_ * cache_stride_);
+    cached_distances_.resize(cache_stride_ * cache_stride_);
+    for (unsigned int i = 0; i < cache_stride_; ++i)
     {
-      if (cached_costs_[i])
-        delete[] cached_costs_[i];
+      for (unsigned int j = 0; j < cache_stride_; ++j)
+      {
+        cached_distances_[i * cache_stride_ + j] = hypot(i, j);
+      }
     }
-    delete[] cached_costs_;
-    cached_costs_ = NULL;
+
+    cached_cell_inflation_radius_ = cell_inflation_radius_;
+    inflation_cells_.clear();
+    inflation_cells_.resize(cell_inflation_radius_ * cell_inflation_radius_ + 1);
   }
+
+  for (unsigned int i = 0; i < cached_costs_.size(); ++i)
+  {
+    cached_costs_[i] = computeCost(cached_distances_[i]);
+  }
+  squared_costs_.resize(cell_inflation_radius_ * cell_inflation_radius_ + 1);
+  for (unsigned int d = 0; d < squared_costs_.size(); ++d)
+    squared_costs_[d] = computeCost(sqrt(double(d)));
+
+  // the kernel leaves the cells past the radius at 0, which stamping takes as untouched
+  stamp_kernel_.clear();
+  if (cell_inflation_radius_ <= MAX_STAMP_RADIUS)
+  {
+    int r = cell_inflation_radius_, width = 2 * r + 1;
+    stamp_kernel_.assign(width * width, 0);
+    for (int dy = -r; dy <= r; ++dy)
+      for (int dx = -r; dx <= r; ++dx)
+        if (cached_distances_[abs(dx) * cache_stride_ + abs(dy)] <= cell_inflation_radius_)
+          stamp_kernel_[(dy + r) * width + dx + r] = cached_costs_[abs(dx) * cache_stride_ + abs(dy)];
+  }
+}
+
+void InflationLayer::deleteKernels()
+{
+  std::vector<unsigned char>().swap(cached_costs_);
+  std::vector<double>().swap(cached_distances_);
+  std::vector<unsigned char>().swap(stamp_kernel_);
+  cached_cell_inflation_radius_ = 0;
+}
+
+void InflationLayer::accountMemory()
+{
+  size_t bytes = seen_size_ * sizeof(bool) + cached_costs_.capacity()
+      + cached_distances_.capacity() * sizeof(double) + squared_costs_.capacity() + stamp_kernel_.capacity()
+      + nearest_.capacity() * sizeof(unsigned int) + (lethal_.capacity() + raise_.capacity()) / 8
+      + transform_.capacity() * sizeof(float) + stamped_.capacity() + static_costs_.capacity();
+  for (unsigned int i = 0; i < inflation_cells_.size(); ++i)
+    bytes += inflation_cells_[i].capacity() * sizeof(CellData);
+  memory_.set(bytes);
 }
 
 void InflationLayer::setInflationParameters(double inflation_radius, double cost_scaling_factor)
@@ -358,7 +1147,9 @@ void InflationLayer::setInflationParameters(double inflation_radius, double cost
   if (weight_ != cost_scaling_factor || inflation_radius_ != inflation_radius)
   {
     // Lock here so that reconfiguring the inflation radius doesn't cause segfaults
-    // when accessing the cached arrays
+    // when accessing the cached arrays.  Tiles are inflated without our own lock,
+    // so take the master grid's first as well.
+    boost::unique_lock < Costmap2D::mutex_t > grid_lock(*(layered_costmap_->getCostmap()->getMutex()));
     boost::unique_lock < boost::recursive_mutex > lock(*inflation_access_);
 
     inflation_radius_ = inflation_radius;
@@ -37,7 +37,16 @@
  *********************************************************************/
 #include <costmap_2d/obstacle_layer.h>
 #include <costmap_2d/costmap_math.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <pcl_ros/transforms.h>
 #include <pluginlib/class_list_macros.h>
+#include <nav_executor/executor.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
 
 PLUGINLIB_EXPORT_CLASS(costmap_2d::ObstacleLayer, costmap_2d::Layer)
 
@@ -51,9 +60,29 @@ using costmap_2d::Observation;
 namespace costmap_2d
 {
 
+// Fewest rays worth handing to a thread of their own
+static const unsigned int MIN_RAYS_PER_THREAD = 256;
+
+// Marks the cells a ray passes through in a buffer that starts at a given map index
+class MarkBufferCell
+{
+public:
+  MarkBufferCell(unsigned char* buffer, unsigned int start) :
+      buffer_(buffer), start_(start)
+  {
+  }
+  inline void operator()(unsigned int offset)
+  {
+    buffer_[offset - start_] = 1;
+  }
+private:
+  unsigned char* buffer_;
+  unsigned int start_;
+};
+
 void ObstacleLayer::onInitialize()
 {
-  ros::NodeHandle nh("~/" + name_), g_nh;
+  ros::NodeHandle nh("~/" + name_);
   rolling_window_ = layered_costmap_->isRolling();
 
   bool track_unknown_space;
@@ -69,6 +98,11 @@ void ObstacleLayer::onInitialize()
   global_frame_ = layered_costmap_->getGlobalFrameID();
   double transform_tolerance;
   nh.param("transform_tolerance", transform_tolerance, 0.2);
+  nh.param("raytrace_threads", raytrace_threads_, 1);
+  bool separate_source_threads;
+  nh.param("separate_source_threads", separate_source_threads, false);
+  bool share_observations;
+  nh.param("share_observations", share_observations, false);
 
   std::string topics_string;
   // get the topics that we'll subscribe to from the parameter server
@@ -89,8 +123,9 @@ void ObstacleLayer::onInitialize()
 
     // get the parameters for the specific topic
     double observation_keep_time, expected_update_rate, min_obstacle_height, max_obstacle_height;
+    double downsample_resolution;
     std::string topic, sensor_frame, data_type;
-    bool inf_is_valid, clearing, marking;
+    bool inf_is_valid, direct_scan, clearing, marking;
 
     source_node.param("topic", topic, source);
     source_node.param("sensor_frame", sensor_frame, std::string(""));
@@ -100,8 +135,10 @@ void ObstacleLayer::onInitialize()
     source_node.param("min_obstacle_height", min_obstacle_height, 0.0);
     source_node.param("max_obstacle_height", max_obstacle_height, 2.0);
     source_node.param("inf_is_valid", inf_is_valid, false);
+    source_node.param("direct_scan_projection", direct_scan, false);
     source_node.param("clearing", clearing, false);
     source_node.param("marking", marking, true);
+    source_node.param("downsample_resolution", downsample_resolution, 0.0);
 
     if (!sensor_frame.empty())
     {
@@ -114,6 +151,18 @@ void ObstacleLayer::onInitialize()
       throw std::runtime_error("Only topics that use point clouds or laser scans are currently supported");
     }
 
+    // how laser scans are buffered
+    LaserScanCallback scan_callback;
+    if (direct_scan)
+      scan_callback = inf_is_valid ? &ObstacleLayer::laserScanDirectValidInfCallback
+                                   : &ObstacleLayer::laserScanDirectCallback;
+    else
+      scan_callback = inf_is_valid ? &ObstacleLayer::laserScanValidInfCallback : &ObstacleLayer::laserScanCallback;
+    if (inf_is_valid && data_type != "LaserScan")
+    {
+     ROS_WARN("obstacle_layer: inf_is_valid option is not applicable to PointCloud observations.");
+    }
+
     std::string raytrace_range_param_name, obstacle_range_param_name;
 
     // get the obstacle range for the sensor
@@ -134,98 +183,151 @@ void ObstacleLayer::onInitialize()
               sensor_frame.c_str());
 
     // create an observation buffer
-    observation_buffers_.push_back(
-        boost::shared_ptr < ObservationBuffer
-            > (new ObservationBuffer(topic, observation_keep_time, expected_update_rate, min_obstacle_height,
-                                     max_obstacle_height, obstacle_range, raytrace_range, *tf_, global_frame_,
-                                     sensor_frame, transform_tolerance)));
+    boost::shared_ptr<ObservationBuffer> buffer(
+        new ObservationBuffer(topic, observation_keep_time, expected_update_rate, min_obstacle_height,
+                              max_obstacle_height, obstacle_range, raytrace_range, *tf_, global_frame_,
+                              sensor_frame, transform_tolerance, downsample_resolution));
+
+    if (share_observations)
+    {
+      // layers that read the source alike share it whatever their global frame; the buffer keeps using
+      // the tf listener of the layer that made it, so that is part of the key as well
+      std::stringstream key;
+      key << tf_ << ' ' << topic << ' ' << data_type << ' ' << sensor_frame << ' ' << observation_keep_time << ' '
+          << expected_update_rate << ' ' << min_obstacle_height << ' ' << max_obstacle_height << ' '
+          << obstacle_range << ' ' << raytrace_range << ' ' << transform_tolerance << ' '
+          << downsample_resolution << ' ' << inf_is_valid << ' ' << direct_scan << ' ' << separate_source_threads;
+      boost::shared_ptr<ObservationSource> shared = ObservationHub::instance().acquire(key.str(),
+          boost::bind(&ObstacleLayer::subscribeSource, this, _1, buffer, topic, data_type, sensor_frame,
+                      scan_callback, separate_source_threads, true));
+
+      boost::mutex::scoped_lock lock(shared->consumers_mutex);
+      shared->consumers.push_back(this);
+      shared_sources_.push_back(shared);
+      buffer = shared->buffer;
+    }
+    else
+    {
+      boost::shared_ptr<ObservationSource> own(new ObservationSource());
+      subscribeSource(*own, buffer, topic, data_type, sensor_frame, scan_callback, separate_source_threads, false);
+      observation_sources_.push_back(own);
+    }
+    observation_buffers_.push_back(buffer);
 
     // check if we'll add this buffer to our marking observation buffers
     if (marking)
-      marking_buffers_.push_back(observation_buffers_.back());
+      marking_buffers_.push_back(buffer);
 
     // check if we'll also add this buffer to our clearing observation buffers
     if (clearing)
-      clearing_buffers_.push_back(observation_buffers_.back());
+      clearing_buffers_.push_back(buffer);
 
     ROS_DEBUG(
         "Created an observation buffer for source %s, topic %s, global frame: %s, "
         "expected update rate: %.2f, observation persistence: %.2f",
         source.c_str(), topic.c_str(), global_frame_.c_str(), expected_update_rate, observation_keep_time);
+  }
 
-    // create a callback for the topic
-    if (data_type == "LaserScan")
-    {
-      boost::shared_ptr < message_filters::Subscriber<sensor_msgs::LaserScan>
-          > sub(new message_filters::Subscriber<sensor_msgs::LaserScan>(g_nh, topic, 50));
-
-      boost::shared_ptr < tf::MessageFilter<sensor_msgs::LaserScan>
-          > filter(new tf::MessageFilter<sensor_msgs::LaserScan>(*sub, *tf_, global_frame_, 50));
+  dsrv_ = NULL;
+  setupDynamicReconfigure(nh);
+}
 
-      if (inf_is_valid)
-      {
-        filter->registerCallback(
-            boost::bind(&ObstacleLayer::laserScanValidInfCallback, this, _1, observation_buffers_.back()));
-      }
-      else
-      {
-        filter->registerCallback(
-            boost::bind(&ObstacleLayer::laserScanCallback, this, _1, observation_buffers_.back()));
-      }
+void ObstacleLayer::subscribeSource(ObservationSource& source, const boost::shared_ptr<ObservationBuffer>& buffer,
+                                    const std::string& topic, const std::string& data_type,
+                                    const std::string& sensor_frame, LaserScanCallback scan_callback,
+                                    bool separate_thread, bool shared)
+{
+  ros::NodeHandle g_nh;
+  source.buffer = buffer;
 
-      observation_subscribers_.push_back(sub);
-      observation_notifiers_.push_back(filter);
+  // with a callback queue and thread of its own, a source that waits on tf holds up no other
+  ros::NodeHandle source_nh = g_nh;
+  if (separate_thread)
+  {
+    source.queue.reset(new ros::CallbackQueue());
+    source_nh.setCallbackQueue(source.queue.get());
+  }
 
-      observation_notifiers_.back()->setTolerance(ros::Duration(0.05));
-    }
-    else if (data_type == "PointCloud")
-    {
-      boost::shared_ptr < message_filters::Subscriber<sensor_msgs::PointCloud>
-          > sub(new message_filters::Subscriber<sensor_msgs::PointCloud>(g_nh, topic, 50));
+  // create a callback for the topic; a shared source hands each message to the first of its consumers
+  if (data_type == "LaserScan")
+  {
+    boost::shared_ptr < message_filters::Subscriber<sensor_msgs::LaserScan>
+        > sub(new message_filters::Subscriber<sensor_msgs::LaserScan>(source_nh, topic, 50));
 
-      if (inf_is_valid)
-      {
-       ROS_WARN("obstacle_layer: inf_is_valid option is not applicable to PointCloud observations.");
-      }
+    boost::shared_ptr < tf::MessageFilter<sensor_msgs::LaserScan>
+        > filter(new tf::MessageFilter<sensor_msgs::LaserScan>(*sub, *tf_, global_frame_, 50, source_nh));
 
-      boost::shared_ptr < tf::MessageFilter<sensor_msgs::PointCloud>
-          > filter(new tf::MessageFilter<sensor_msgs::PointCloud>(*sub, *tf_, global_frame_, 50));
-      filter->registerCallback(
-          boost::bind(&ObstacleLayer::pointCloudCallback, this, _1, observation_buffers_.back()));
+    if (shared)
+      filter->registerCallback(boost::bind(&ObstacleLayer::sharedCallback<sensor_msgs::LaserScan>, _1, &source,
+                                           scan_callback));
+    else
+      filter->registerCallback(boost::bind(scan_callback, this, _1, buffer));
 
-      observation_subscribers_.push_back(sub);
-      observation_notifiers_.push_back(filter);
-    }
+    filter->setTolerance(ros::Duration(0.05));
+    source.subscriber = sub;
+    source.notifier = filter;
+  }
+  else if (data_type == "PointCloud")
+  {
+    boost::shared_ptr < message_filters::Subscriber<sensor_msgs::PointCloud>
+        > sub(new message_filters::Subscriber<sensor_msgs::PointCloud>(source_nh, topic, 50));
+
+    boost::shared_ptr < tf::MessageFilter<sensor_msgs::PointCloud>
+        > filter(new tf::MessageFilter<sensor_msgs::PointCloud>(*sub, *tf_, global_frame_, 50, source_nh));
+    if (shared)
+      filter->registerCallback(boost::bind(&ObstacleLayer::sharedCallback<sensor_msgs::PointCloud>, _1, &source,
+                                           &ObstacleLayer::pointCloudCallback));
     else
-    {
-      boost::shared_ptr < message_filters::Subscriber<sensor_msgs::PointCloud2>
-          > sub(new message_filters::Subscriber<sensor_msgs::PointCloud2>(g_nh, topic, 50));
+      filter->registerCallback(boost::bind(&ObstacleLayer::pointCloudCallback, this, _1, buffer));
 
-      if (inf_is_valid)
-      {
-       ROS_WARN("obstacle_layer: inf_is_valid option is not applicable to PointCloud observations.");
-      }
+    source.subscriber = sub;
+    source.notifier = filter;
+  }
+  else
+  {
+    boost::shared_ptr < message_filters::Subscriber<sensor_msgs::PointCloud2>
+        > sub(new message_filters::Subscriber<sensor_msgs::PointCloud2>(source_nh, topic, 50));
+
+    boost::shared_ptr < tf::MessageFilter<sensor_msgs::PointCloud2>
+        > filter(new tf::MessageFilter<sensor_msgs::PointCloud2>(*sub, *tf_, global_frame_, 50, source_nh));
+    if (shared)
+      filter->registerCallback(boost::bind(&ObstacleLayer::sharedCallback<sensor_msgs::PointCloud2>, _1, &source,
+                                           &ObstacleLayer::pointCloud2Callback));
+    else
+      filter->registerCallback(boost::bind(&ObstacleLayer::pointCloud2Callback, this, _1, buffer));
 
-      boost::shared_ptr < tf::MessageFilter<sensor_msgs::PointCloud2>
-          > filter(new tf::MessageFilter<sensor_msgs::PointCloud2>(*sub, *tf_, global_frame_, 50));
-      filter->registerCallback(
-          boost::bind(&ObstacleLayer::pointCloud2Callback, this, _1, observation_buffers_.back()));
+    source.subscriber = sub;
+    source.notifier = filter;
+  }
 
-      observation_subscribers_.push_back(sub);
-      observation_notifiers_.push_back(filter);
-    }
+  if (sensor_frame != "")
+  {
+    std::vector < std::string > target_frames;
+    target_frames.push_back(global_frame_);
+    target_frames.push_back(sensor_frame);
+    source.notifier->setTargetFrames(target_frames);
+  }
 
-    if (sensor_frame != "")
-    {
-      std::vector < std::string > target_frames;
-      target_frames.push_back(global_frame_);
-      target_frames.push_back(sensor_frame);
-      observation_notifiers_.back()->setTargetFrames(target_frames);
-    }
+  if (separate_thread)
+  {
+    source.spinner.reset(new ros::AsyncSpinner(1, source.queue.get()));
+    source.spinner->start();
   }
+}
 
-  dsrv_ = NULL;
-  setupDynamicReconfigure(nh);
+template<class MessageT>
+void ObstacleLayer::sharedCallback(const boost::shared_ptr<const MessageT>& message, ObservationSource* source,
+                                   void (ObstacleLayer::*callback)(const boost::shared_ptr<const MessageT>&,
+                                                                   const boost::shared_ptr<ObservationBuffer>&))
+{
+  boost::mutex::scoped_lock lock(source->consumers_mutex);
+  if (source->consumers.empty())
+    return;
+
+  // the first consumer buffers the message for all of them, the others just need to update
+  (source->consumers[0]->*callback)(message, source->buffer);
+  for (unsigned int i = 1; i < source->consumers.size(); ++i)
+    source->consumers[i]->layered_costmap_->requestUpdate();
 }
 
 void ObstacleLayer::setupDynamicReconfigure(ros::NodeHandle& nh)
@@ -240,6 +342,23 @@ ObstacleLayer::~ObstacleLayer()
 {
     if (dsrv_)
         delete dsrv_;
+
+    // stop the source threads before what they call into goes away, and the filters before their queues
+    for (unsigned int i = 0; i < observation_sources_.size(); ++i)
+    {
+      if (observation_sources_[i]->spinner)
+        observation_sources_[i]->spinner->stop();
+    }
+    observation_sources_.clear();
+
+    // shared sources live on for the other layers, which are handed no message once we are gone
+    for (unsigned int i = 0; i < shared_sources_.size(); ++i)
+    {
+      ObservationSource& source = *shared_sources_[i];
+      boost::mutex::scoped_lock lock(source.consumers_mutex);
+      source.consumers.erase(std::find(source.consumers.begin(), source.consumers.end(), this));
+    }
+    shared_sources_.clear();
 }
 void ObstacleLayer::reconfigureCB(costmap_2d::ObstaclePluginConfig &config, uint32_t level)
 {
@@ -272,6 +391,7 @@ void ObstacleLayer::laserScanCallback(const sensor_msgs::LaserScanConstPtr& mess
   buffer->lock();
   buffer->bufferCloud(cloud);
   buffer->unlock();
+  layered_costmap_->requestUpdate();
 }
 
 void ObstacleLayer::laserScanValidInfCallback(const sensor_msgs::LaserScanConstPtr& raw_message,
@@ -309,6 +429,25 @@ void ObstacleLayer::laserScanValidInfCallback(const sensor_msgs::LaserScanConstP
   buffer->lock();
   buffer->bufferCloud(cloud);
   buffer->unlock();
+  layered_costmap_->requestUpdate();
+}
+
+void ObstacleLayer::laserScanDirectCallback(const sensor_msgs::LaserScanConstPtr& message,
+                                            const boost::shared_ptr<ObservationBuffer>& buffer)
+{
+  buffer->lock();
+  buffer->bufferScan(*message, false);
+  buffer->unlock();
+  layered_costmap_->requestUpdate();
+}
+
+void ObstacleLayer::laserScanDirectValidInfCallback(const sensor_msgs::LaserScanConstPtr& message,
+                                                    const boost::shared_ptr<ObservationBuffer>& buffer)
+{
+  buffer->lock();
+  buffer->bufferScan(*message, true);
+  buffer->unlock();
+  layered_costmap_->requestUpdate();
 }
 
 void ObstacleLayer::pointCloudCallback(const sensor_msgs::PointCloudConstPtr& message,
@@ -326,6 +465,7 @@ void ObstacleLayer::pointCloudCallback(const sensor_msgs::PointCloudConstPtr& me
   buffer->lock();
   buffer->bufferCloud(cloud2);
   buffer->unlock();
+  layered_costmap_->requestUpdate();
 }
 
 void ObstacleLayer::pointCloud2Callback(const sensor_msgs::PointCloud2ConstPtr& message,
@@ -335,16 +475,49 @@ void ObstacleLayer::pointCloud2Callback(const sensor_msgs::PointCloud2ConstPtr&
   buffer->lock();
   buffer->bufferCloud(*message);
   buffer->unlock();
+  layered_costmap_->requestUpdate();
 }
 
 void ObstacleLayer::updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x,
                                           double* min_y, double* max_x, double* max_y)
+{
+  std::vector<Bounds> bounds;
+  collectBounds(robot_x, robot_y, robot_yaw, &bounds);
+  for (unsigned int i = 0; i < bounds.size(); ++i)
+  {
+    *min_x = std::min(*min_x, bounds[i].min_x);
+    *min_y = std::min(*min_y, bounds[i].min_y);
+    *max_x = std::max(*max_x, bounds[i].max_x);
+    *max_y = std::max(*max_y, bounds[i].max_y);
+  }
+}
+
+void ObstacleLayer::updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds)
+{
+  collectBounds(robot_x, robot_y, robot_yaw, bounds);
+}
+
+// add the box to the list if anything was touched
+static void addBounds(const Bounds& box, std::vector<Bounds>* bounds)
+{
+  if (box.min_x <= box.max_x && box.min_y <= box.max_y)
+    bounds->push_back(box);
+}
+
+void ObstacleLayer::collectBounds(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds)
 {
   if (rolling_window_)
     updateOrigin(robot_x - getSizeInMetersX() / 2, robot_y - getSizeInMetersY() / 2);
   if (!enabled_)
     return;
-  useExtraBounds(min_x, min_y, max_x, max_y);
+
+  Bounds empty;
+  empty.min_x = empty.min_y = 1e30;
+  empty.max_x = empty.max_y = -1e30;
+
+  Bounds box = empty;
+  useExtraBounds(&box.min_x, &box.min_y, &box.max_x, &box.max_y);
+  addBounds(box, bounds);
 
   bool current = true;
   std::vector<Observation> observations, clearing_observations;
@@ -358,58 +531,115 @@ void ObstacleLayer::updateBounds(double robot_x, double robot_y, double robot_ya
   // update the global current status
   current_ = current;
 
-  // raytrace freespace
+  newest_observation_ = ros::Time();
+  noteObservationTimes(observations);
+  noteObservationTimes(clearing_observations);
+
+  // raytrace freespace, keeping the area of each observation apart
   for (unsigned int i = 0; i < clearing_observations.size(); ++i)
   {
-    raytraceFreespace(clearing_observations[i], min_x, min_y, max_x, max_y);
+    box = empty;
+    raytraceFreespace(clearing_observations[i], &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+    addBounds(box, bounds);
   }
 
   // place the new obstacles into a priority queue... each with a priority of zero to begin with
   for (std::vector<Observation>::const_iterator it = observations.begin(); it != observations.end(); ++it)
   {
-    const Observation& obs = *it;
+    box = empty;
+    markObservation(*it, &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+    addBounds(box, bounds);
+  }
 
-    const pcl::PointCloud<pcl::PointXYZ>& cloud = *(obs.cloud_);
+  box = empty;
+  updateFootprint(robot_x, robot_y, robot_yaw, &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+  addBounds(box, bounds);
+}
 
-    double sq_obstacle_range = obs.obstacle_range_ * obs.obstacle_range_;
+void ObstacleLayer::markObservation(const Observation& obs, double* min_x, double* min_y, double* max_x,
+                                    double* max_y)
+{
+  const pcl::PointCloud<pcl::PointXYZ>& cloud = *(obs.cloud_);
+
+  double sq_obstacle_range = obs.obstacle_range_ * obs.obstacle_range_;
+
+  unsigned int i = 0;
+#ifdef __SSE2__
+  // two points at a time, in double as below so that the same points pass: the height, range and map
+  // tests give a mask, and only the points it keeps are written, one at a time as SSE2 has no scatter
+  const __m128d max_z = _mm_set1_pd(max_obstacle_height_), range = _mm_set1_pd(sq_obstacle_range);
+  const __m128d ox = _mm_set1_pd(obs.origin_.x), oy = _mm_set1_pd(obs.origin_.y), oz = _mm_set1_pd(obs.origin_.z);
+  const __m128d map_x = _mm_set1_pd(origin_x_), map_y = _mm_set1_pd(origin_y_), res = _mm_set1_pd(resolution_);
+  const __m128i size_x = _mm_set1_epi32(size_x_), size_y = _mm_set1_epi32(size_y_), minus_one = _mm_set1_epi32(-1);
+  for (; i + 2 <= cloud.points.size(); i += 2)
+  {
+    const pcl::PointXYZ& p0 = cloud.points[i];
+    const pcl::PointXYZ& p1 = cloud.points[i + 1];
+    __m128d px = _mm_set_pd(p1.x, p0.x), py = _mm_set_pd(p1.y, p0.y), pz = _mm_set_pd(p1.z, p0.z);
+    __m128d dx = _mm_sub_pd(px, ox), dy = _mm_sub_pd(py, oy), dz = _mm_sub_pd(pz, oz);
+    __m128d sq_dist = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+    // the negated compares let through what the scalar tests do not turn away, a height of NaN included
+    __m128d keep = _mm_and_pd(_mm_cmpngt_pd(pz, max_z), _mm_cmpnge_pd(sq_dist, range));
+    keep = _mm_and_pd(keep, _mm_and_pd(_mm_cmpnlt_pd(px, map_x), _mm_cmpnlt_pd(py, map_y)));
+    int lanes = _mm_movemask_pd(keep);
+    if (lanes == 0)
+      continue;
 
-    for (unsigned int i = 0; i < cloud.points.size(); ++i)
+    // cells are truncated as in worldToMap(), and only come out negative when too far to convert
+    __m128i mx = _mm_cvttpd_epi32(_mm_div_pd(_mm_sub_pd(px, map_x), res));
+    __m128i my = _mm_cvttpd_epi32(_mm_div_pd(_mm_sub_pd(py, map_y), res));
+    __m128i inside = _mm_and_si128(_mm_cmplt_epi32(mx, size_x), _mm_cmplt_epi32(my, size_y));
+    inside = _mm_and_si128(inside, _mm_cmpgt_epi32(_mm_or_si128(mx, my), minus_one));
+    lanes &= _mm_movemask_ps(_mm_castsi128_ps(inside));
+
+    int cells_x[4], cells_y[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cells_x), mx);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cells_y), my);
+    for (unsigned int k = 0; k < 2; ++k)
     {
-      double px = cloud.points[i].x, py = cloud.points[i].y, pz = cloud.points[i].z;
-
-      // if the obstacle is too high or too far away from the robot we won't add it
-      if (pz > max_obstacle_height_)
-      {
-        ROS_DEBUG("The point is too high");
+      if (!(lanes & (1 << k)))
         continue;
-      }
+      const pcl::PointXYZ& p = k == 0 ? p0 : p1;
+      costmap_[getIndex(cells_x[k], cells_y[k])] = LETHAL_OBSTACLE;
+      touch(p.x, p.y, min_x, min_y, max_x, max_y);
+    }
+  }
+#endif
 
-      // compute the squared distance from the hitpoint to the pointcloud's origin
-      double sq_dist = (px - obs.origin_.x) * (px - obs.origin_.x) + (py - obs.origin_.y) * (py - obs.origin_.y)
-          + (pz - obs.origin_.z) * (pz - obs.origin_.z);
+  for (; i < cloud.points.size(); ++i)
+  {
+    double px = cloud.points[i].x, py = cloud.points[i].y, pz = cloud.points[i].z;
 
-      // if the point is far enough away... we won't consider it
-      if (sq_dist >= sq_obstacle_range)
-      {
-        ROS_DEBUG("The point is too far away");
-        continue;
-      }
+    // if the obstacle is too high or too far away from the robot we won't add it
+    if (pz > max_obstacle_height_)
+    {
+      ROS_DEBUG("The point is too high");
+      continue;
+    }
 
-      // now we need to compute the map coordinates for the observation
-      unsigned int mx, my;
-      if (!worldToMap(px, py, mx, my))
-      {
-        ROS_DEBUG("Computing map coords failed");
-        continue;
-      }
+    // compute the squared distance from the hitpoint to the pointcloud's origin
+    double sq_dist = (px - obs.origin_.x) * (px - obs.origin_.x) + (py - obs.origin_.y) * (py - obs.origin_.y)
+        + (pz - obs.origin_.z) * (pz - obs.origin_.z);
 
-      unsigned int index = getIndex(mx, my);
-      costmap_[index] = LETHAL_OBSTACLE;
-      touch(px, py, min_x, min_y, max_x, max_y);
+    // if the point is far enough away... we won't consider it
+    if (sq_dist >= sq_obstacle_range)
+    {
+      ROS_DEBUG("The point is too far away");
+      continue;
     }
-  }
 
-  updateFootprint(robot_x, robot_y, robot_yaw, min_x, min_y, max_x, max_y);
+    // now we need to compute the map coordinates for the observation
+    unsigned int mx, my;
+    if (!worldToMap(px, py, mx, my))
+    {
+      ROS_DEBUG("Computing map coords failed");
+      continue;
+    }
+
+    unsigned int index = getIndex(mx, my);
+    costmap_[index] = LETHAL_OBSTACLE;
+    touch(px, py, min_x, min_y, max_x, max_y);
+  }
 }
 
 void ObstacleLayer::updateFootprint(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
@@ -422,6 +652,9 @@ void ObstacleLayer::updateFootprint(double robot_x, double robot_y, double robot
     {
       touch(transformed_footprint_[i].x, transformed_footprint_[i].y, min_x, min_y, max_x, max_y);
     }
+
+    // clear the footprint here rather than in updateCosts(), which may run once per tile
+    setConvexPolygonCost(transformed_footprint_, costmap_2d::FREE_SPACE);
 }
 
 void ObstacleLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
@@ -429,11 +662,6 @@ void ObstacleLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, i
   if (!enabled_)
     return;
 
-  if (footprint_clearing_enabled_)
-  {
-    setConvexPolygonCost(transformed_footprint_, costmap_2d::FREE_SPACE);
-  }
-
   switch (combination_method_)
   {
     case 0:  // Overwrite
@@ -474,11 +702,61 @@ bool ObstacleLayer::getMarkingObservations(std::vector<Observation>& marking_obs
     current = marking_buffers_[i]->isCurrent() && current;
     marking_buffers_[i]->unlock();
   }
+  reexpressObservations(marking_observations);
   marking_observations.insert(marking_observations.end(),
                               static_marking_observations_.begin(), static_marking_observations_.end());
   return current;
 }
 
+void ObstacleLayer::reexpressObservations(std::vector<Observation>& observations) const
+{
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < observations.size(); ++i)
+  {
+    Observation& obs = observations[i];
+    const std::string& frame = obs.cloud_->header.frame_id;
+    if (!frame.empty() && frame != global_frame_)
+    {
+      // from a buffer shared with a layer of another global frame, which we copy rather than change
+      try
+      {
+        tf::StampedTransform transform;
+        tf_->lookupTransform(global_frame_, frame, pcl_conversions::fromPCL(obs.cloud_->header).stamp, transform);
+
+        tf::Vector3 origin = transform * tf::Vector3(obs.origin_.x, obs.origin_.y, obs.origin_.z);
+        obs.origin_.x = origin.x();
+        obs.origin_.y = origin.y();
+        obs.origin_.z = origin.z();
+
+        boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > cloud(new pcl::PointCloud<pcl::PointXYZ>());
+        pcl_ros::transformPointCloud(*obs.cloud_, *cloud, transform);
+        cloud->header.frame_id = global_frame_;
+        obs.cloud_ = cloud;
+      }
+      catch (tf::TransformException& ex)
+      {
+        ROS_WARN_THROTTLE(1.0, "Dropping an observation that could not be transformed from %s to %s: %s",
+                          frame.c_str(), global_frame_.c_str(), ex.what());
+        continue;
+      }
+    }
+    if (kept != i)
+      observations[kept] = obs;
+    ++kept;
+  }
+  observations.resize(kept);
+}
+
+void ObstacleLayer::noteObservationTimes(const std::vector<Observation>& observations)
+{
+  for (unsigned int i = 0; i < observations.size(); ++i)
+  {
+    ros::Time stamp = pcl_conversions::fromPCL(observations[i].cloud_->header).stamp;
+    if (stamp > newest_observation_)
+      newest_observation_ = stamp;
+  }
+}
+
 bool ObstacleLayer::getClearingObservations(std::vector<Observation>& clearing_observations) const
 {
   bool current = true;
@@ -490,6 +768,7 @@ bool ObstacleLayer::getClearingObservations(std::vector<Observation>& clearing_o
     current = clearing_buffers_[i]->isCurrent() && current;
     clearing_buffers_[i]->unlock();
   }
+  reexpressObservations(clearing_observations);
   clearing_observations.insert(clearing_observations.end(),
                               static_clearing_observations_.begin(), static_clearing_observations_.end());
   return current;
@@ -500,7 +779,7 @@ void ObstacleLayer::raytraceFreespace(const Observation& clearing_observation, d
 {
   double ox = clearing_observation.origin_.x;
   double oy = clearing_observation.origin_.y;
-  pcl::PointCloud < pcl::PointXYZ > cloud = *(clearing_observation.cloud_);
+  const pcl::PointCloud < pcl::PointXYZ > &cloud = *(clearing_observation.cloud_);
 
   // get the map coordinates of the origin of the sensor
   unsigned int x0, y0;
@@ -520,6 +799,13 @@ void ObstacleLayer::raytraceFreespace(const Observation& clearing_observation, d
 
   touch(ox, oy, min_x, min_y, max_x, max_y);
 
+  // rays from the same origin to the same cell clear the same cells, so only the first ray
+  // to each cell is traced; the others still count towards the bounds
+  if (ray_targets_.size() != size_x_ * size_y_)
+    ray_targets_.assign(size_x_ * size_y_, false);
+  ray_ends_.clear();
+  unsigned int min_cx = x0, max_cx = x0, min_cy = y0, max_cy = y0;
+
   // for each point in the cloud, we want to trace a line from the origin and clear obstacles along it
   for (unsigned int i = 0; i < cloud.points.size(); ++i)
   {
@@ -566,22 +852,86 @@ void ObstacleLayer::raytraceFreespace(const Observation& clearing_observation, d
     if (!worldToMap(wx, wy, x1, y1))
       continue;
 
-    unsigned int cell_raytrace_range = cellDistance(clearing_observation.raytrace_range_);
+    updateRaytraceBounds(ox, oy, wx, wy, clearing_observation.raytrace_range_, min_x, min_y, max_x, max_y);
+
+    unsigned int index = getIndex(x1, y1);
+    if (ray_targets_[index])
+      continue;
+    ray_targets_[index] = true;
+    ray_ends_.push_back(index);
+    min_cx = std::min(min_cx, x1);
+    max_cx = std::max(max_cx, x1);
+    min_cy = std::min(min_cy, y1);
+    max_cy = std::max(max_cy, y1);
+  }
+
+  for (unsigned int i = 0; i < ray_ends_.size(); ++i)
+    ray_targets_[ray_ends_[i]] = false;
+
+  unsigned int cell_raytrace_range = cellDistance(clearing_observation.raytrace_range_);
+  unsigned int num_threads = std::min<unsigned int>(std::max(raytrace_threads_, 1),
+                                                    ray_ends_.size() / MIN_RAYS_PER_THREAD);
+  if (num_threads <= 1)
+  {
     MarkCell marker(costmap_, FREE_SPACE);
-    // and finally... we can execute our trace to clear obstacles along that line
-    raytraceLine(marker, x0, y0, x1, y1, cell_raytrace_range);
+    for (unsigned int i = 0; i < ray_ends_.size(); ++i)
+    {
+      unsigned int x1, y1;
+      indexToCells(ray_ends_[i], x1, y1);
+      // and finally... we can execute our trace to clear obstacles along that line
+      raytraceLine(marker, x0, y0, x1, y1, cell_raytrace_range);
+    }
+    return;
+  }
 
-    updateRaytraceBounds(ox, oy, wx, wy, clearing_observation.raytrace_range_, min_x, min_y, max_x, max_y);
+  // every ray stays within the box around its origin and ends, so each thread clears into a
+  // buffer of the rows of that box, and the buffers are merged into the costmap after
+  unsigned int start = min_cy * size_x_;
+  unsigned int buffer_size = (max_cy - min_cy + 1) * size_x_;
+  ray_buffers_.resize(num_threads);
+  for (unsigned int t = 0; t < num_threads; ++t)
+    ray_buffers_[t].assign(buffer_size, 0);
+  nav_executor::Executor::shared().run(layered_costmap_->getLane(), num_threads,
+                                       boost::bind(&ObstacleLayer::raytraceRays, this, x0, y0, cell_raytrace_range,
+                                                   start, num_threads, _1));
+
+  for (unsigned int y = min_cy; y <= max_cy; ++y)
+  {
+    for (unsigned int x = min_cx; x <= max_cx; ++x)
+    {
+      unsigned int index = getIndex(x, y);
+      for (unsigned int t = 0; t < num_threads; ++t)
+      {
+        if (ray_buffers_[t][index - start])
+        {
+          costmap_[index] = FREE_SPACE;
+          break;
+        }
+      }
+    }
+  }
+}
+
+void ObstacleLayer::raytraceRays(unsigned int x0, unsigned int y0, unsigned int max_length, unsigned int start,
+                                 unsigned int shares, unsigned int share)
+{
+  MarkBufferCell marker(&ray_buffers_[share][0], start);
+  unsigned int end = ray_ends_.size() * (share + 1) / shares;
+  for (unsigned int i = ray_ends_.size() * share / shares; i < end; ++i)
+  {
+    unsigned int x1, y1;
+    indexToCells(ray_ends_[i], x1, y1);
+    raytraceLine(marker, x0, y0, x1, y1, max_length);
   }
 }
 
 void ObstacleLayer::activate()
 {
-  // if we're stopped we need to re-subscribe to topics
-  for (unsigned int i = 0; i < observation_subscribers_.size(); ++i)
+  // if we're stopped we need to re-subscribe to topics; shared ones stay subscribed for the other layers
+  for (unsigned int i = 0; i < observation_sources_.size(); ++i)
   {
-    if (observation_subscribers_[i] != NULL)
-      observation_subscribers_[i]->subscribe();
+    if (observation_sources_[i]->subscriber != NULL)
+      observation_sources_[i]->subscriber->subscribe();
   }
 
   for (unsigned int i = 0; i < observation_buffers_.size(); ++i)
@@ -592,10 +942,10 @@ void ObstacleLayer::activate()
 }
 void ObstacleLayer::deactivate()
 {
-  for (unsigned int i = 0; i < observation_subscribers_.size(); ++i)
+  for (unsigned int i = 0; i < observation_sources_.size(); ++i)
   {
-    if (observation_subscribers_[i] != NULL)
-      observation_subscribers_[i]->unsubscribe();
+    if (observation_sources_[i]->subscriber != NULL)
+      observation_sources_[i]->subscriber->unsubscribe();
   }
 }
 
@@ -39,6 +39,8 @@
 #include <costmap_2d/static_layer.h>
 #include <costmap_2d/costmap_math.h>
 #include <pluginlib/class_list_macros.h>
+#include <algorithm>
+#include <cstring>
 
 PLUGINLIB_EXPORT_CLASS(costmap_2d::StaticLayer, costmap_2d::Layer)
 
@@ -49,7 +51,31 @@ using costmap_2d::FREE_SPACE;
 namespace costmap_2d
 {
 
-StaticLayer::StaticLayer() : dsrv_(NULL) {}
+// The costs of the 2-bit codes of a packed plane
+static const unsigned char PACKED_COSTS[4] = { FREE_SPACE, LETHAL_OBSTACLE, NO_INFORMATION, FREE_SPACE };
+
+static inline unsigned char packedCode(unsigned char cost)
+{
+  return cost == LETHAL_OBSTACLE ? 1 : cost == NO_INFORMATION ? 2 : 0;
+}
+
+// The four costs of each byte of a packed plane, so that rows are decoded a byte at a time
+struct PackedDecoder
+{
+  unsigned char costs[256][4];
+
+  PackedDecoder()
+  {
+    for (unsigned int b = 0; b < 256; ++b)
+      for (unsigned int k = 0; k < 4; ++k)
+        costs[b][k] = PACKED_COSTS[(b >> (2 * k)) & 3];
+  }
+};
+
+static const PackedDecoder packed_decoder;
+
+StaticLayer::StaticLayer() : snapshot_period_(5.0), snapshot_stale_(false), packed_(false), last_map_packed_(false),
+    revision_(0), dsrv_(NULL) {}
 
 StaticLayer::~StaticLayer()
 {
@@ -68,6 +94,8 @@ void StaticLayer::onInitialize()
   nh.param("map_topic", map_topic, std::string("map"));
   nh.param("first_map_only", first_map_only_, false);
   nh.param("subscribe_to_updates", subscribe_to_updates_, false);
+  nh.param("snapshot_file", snapshot_file_, std::string(""));
+  nh.param("snapshot_period", snapshot_period_, 5.0);
 
   nh.param("track_unknown_space", track_unknown_space_, true);
   nh.param("use_maximum", use_maximum_, false);
@@ -77,9 +105,19 @@ void StaticLayer::onInitialize()
   nh.param("unknown_cost_value", temp_unknown_cost_value, int(-1));
   nh.param("trinary_costmap", trinary_costmap_, true);
 
+  // trinary costs fit in 2 bits, which shrinks a large map four times
+  bool packed_storage;
+  nh.param("packed_storage", packed_storage, false);
+  if (packed_storage && !trinary_costmap_)
+    ROS_WARN("The static layer only packs trinary costmaps, so packed_storage is ignored");
+
   lethal_threshold_ = std::max(std::min(temp_lethal_threshold, 100), 0);
   unknown_cost_value_ = temp_unknown_cost_value;
 
+  // the values may mean something else now, so the next map is interpreted in full
+  forgetLastMap();
+  setPacked(packed_storage && trinary_costmap_);
+
   // Only resubscribe if topic has changed
   if (map_sub_.getTopic() != ros::names::resolve(map_topic))
   {
@@ -89,14 +127,23 @@ void StaticLayer::onInitialize()
     map_received_ = false;
     has_updated_data_ = false;
 
-    ros::Rate r(10);
-    while (!map_received_ && g_nh.ok())
+    // a snapshot of the last map lets us start without waiting; the map replaces it when it arrives
+    if (restoreSnapshot())
     {
-      ros::spinOnce();
-      r.sleep();
+      ROS_INFO("Restored a %d X %d map at %f m/pix from %s", getSizeInCellsX(), getSizeInCellsY(), getResolution(),
+               snapshot_file_.c_str());
     }
+    else
+    {
+      ros::Rate r(10);
+      while (!map_received_ && g_nh.ok())
+      {
+        ros::spinOnce();
+        r.sleep();
+      }
 
-    ROS_INFO("Received a %d X %d map at %f m/pix", getSizeInCellsX(), getSizeInCellsY(), getResolution());
+      ROS_INFO("Received a %d X %d map at %f m/pix", getSizeInCellsX(), getSizeInCellsY(), getResolution());
+    }
 
     if (subscribe_to_updates_)
     {
@@ -130,6 +177,7 @@ void StaticLayer::reconfigureCB(costmap_2d::GenericPluginConfig &config, uint32_
     x_ = y_ = 0;
     width_ = size_x_;
     height_ = size_y_;
+    changed_rects_.clear();
   }
 }
 
@@ -142,7 +190,105 @@ void StaticLayer::matchSize()
     Costmap2D* master = layered_costmap_->getCostmap();
     resizeMap(master->getSizeInCellsX(), master->getSizeInCellsY(), master->getResolution(),
               master->getOriginX(), master->getOriginY());
+    resetPacked();
+    forgetLastMap();
+  }
+}
+
+void StaticLayer::forgetLastMap()
+{
+  map_data_.clear();
+  last_map_packed_ = false;
+}
+
+void StaticLayer::setPacked(bool packed)
+{
+  if (packed == packed_)
+    return;
+
+  unsigned int n = size_x_ * size_y_;
+  if (packed)
+  {
+    packed_costs_.assign((n + 3) / 4, 0);
+    packed_ = true;
+    for (unsigned int index = 0; index < n; ++index)
+      setCell(index, costmap_[index]);
+
+    // the cells are no longer read; a large map hands its pages back
+    resetMaps();
+  }
+  else
+  {
+    for (unsigned int y = 0; y < size_y_; ++y)
+      copyRow(0, y, size_x_, costmap_ + y * size_x_);
+    packed_ = false;
+    std::vector<unsigned char>().swap(packed_costs_);
+  }
+}
+
+void StaticLayer::resetPacked()
+{
+  if (packed_)
+    packed_costs_.assign((size_x_ * size_y_ + 3) / 4, packedCode(default_value_) * 0x55);
+}
+
+void StaticLayer::setCell(unsigned int index, unsigned char cost)
+{
+  if (!packed_)
+  {
+    costmap_[index] = cost;
+    return;
+  }
+  unsigned int shift = 2 * (index & 3);
+  unsigned char& byte = packed_costs_[index >> 2];
+  byte = (byte & ~(3 << shift)) | (packedCode(cost) << shift);
+}
+
+unsigned char StaticLayer::cell(unsigned int index) const
+{
+  if (!packed_)
+    return costmap_[index];
+  return PACKED_COSTS[(packed_costs_[index >> 2] >> (2 * (index & 3))) & 3];
+}
+
+void StaticLayer::copyRow(unsigned int x, unsigned int y, unsigned int n, unsigned char* row) const
+{
+  unsigned int index = y * size_x_ + x;
+  if (!packed_)
+  {
+    memcpy(row, costmap_ + index, n);
+    return;
   }
+
+  // the cells up to a byte boundary one by one, then whole bytes, then the rest
+  for (; n > 0 && (index & 3) != 0; --n)
+    *row++ = cell(index++);
+  for (; n >= 4; n -= 4, index += 4, row += 4)
+    memcpy(row, packed_decoder.costs[packed_costs_[index >> 2]], 4);
+  for (; n > 0; --n)
+    *row++ = cell(index++);
+}
+
+bool StaticLayer::saveLayerSnapshot()
+{
+  if (!packed_)
+    return saveSnapshot(snapshot_file_);
+
+  Costmap2D snapshot(size_x_, size_y_, resolution_, origin_x_, origin_y_, default_value_);
+  for (unsigned int y = 0; y < size_y_; ++y)
+    copyRow(0, y, size_x_, snapshot.getCharMap() + y * size_x_);
+  return snapshot.saveSnapshot(snapshot_file_);
+}
+
+void StaticLayer::saveChangedSnapshot()
+{
+  boost::unique_lock<mutex_t> lock(*getMutex());
+  if (!snapshot_stale_ || ros::WallTime::now() < last_snapshot_save_ + ros::WallDuration(snapshot_period_))
+    return;
+  if (!saveLayerSnapshot())
+    ROS_WARN("Could not save the static map snapshot to %s", snapshot_file_.c_str());
+  snapshot_stale_ = false;
+  last_snapshot_save_ = ros::WallTime::now();
 }
 
 unsigned char StaticLayer::interpretValue(unsigned char value)
@@ -167,58 +313,208 @@ void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
 
   ROS_DEBUG("Received a %d X %d map at %f m/pix", size_x, size_y, new_map->info.resolution);
 
+  matchMapGeometry(size_x, size_y, new_map->info.resolution, new_map->info.origin.position.x,
+                   new_map->info.origin.position.y);
+
+  size_t known_rects = changed_rects_.size();
+  bool changed = true;
+  if (incomingMapChanges(*new_map))
+  {
+    changed = changed_rects_.size() != known_rects;
+  }
+  else
+  {
+    if (packed_)
+    {
+      unsigned int n = size_x * size_y;
+      for (unsigned int index = 0; index < n; ++index)
+        setCell(index, interpretValue(new_map->data[index]));
+
+      // the interpreted costs tell the tiles of the next map apart as well as the values would
+      last_map_packed_ = true;
+    }
+    else
+    {
+      unsigned int index = 0;
+
+      // initialize the costmap with static data
+      for (unsigned int i = 0; i < size_y; ++i)
+      {
+        for (unsigned int j = 0; j < size_x; ++j)
+        {
+          // cells that already hold the cost are not written, so the untouched pages of a large map stay shared
+          unsigned char value = interpretValue(new_map->data[index]);
+          if (costmap_[index] != value)
+            costmap_[index] = value;
+          ++index;
+        }
+      }
+      map_data_ = new_map->data;
+    }
+    map_frame_ = new_map->header.frame_id;
+
+    // we have a new map, update full size of map
+    x_ = y_ = 0;
+    width_ = size_x_;
+    height_ = size_y_;
+    changed_rects_.clear();
+    has_updated_data_ = true;
+  }
+  map_received_ = true;
+  if (has_updated_data_)
+    layered_costmap_->requestUpdate();
+
+  if (changed && !snapshot_file_.empty())
+  {
+    boost::unique_lock<mutex_t> lock(*getMutex());
+    if (!saveLayerSnapshot())
+      ROS_WARN("Could not save the static map snapshot to %s", snapshot_file_.c_str());
+    snapshot_stale_ = false;
+    last_snapshot_save_ = ros::WallTime::now();
+  }
+
+  // shutdown the map subscrber if firt_map_only_ flag is on
+  if (first_map_only_)
+  {
+    ROS_INFO("Shutting down the map subscriber. first_map_only flag is on");
+    map_sub_.shutdown();
+  }
+}
+
+void StaticLayer::matchMapGeometry(unsigned int size_x, unsigned int size_y, double resolution,
+                                   double origin_x, double origin_y)
+{
   // resize costmap if size, resolution or origin do not match
   Costmap2D* master = layered_costmap_->getCostmap();
   if (!layered_costmap_->isRolling() && (master->getSizeInCellsX() != size_x ||
       master->getSizeInCellsY() != size_y ||
-      master->getResolution() != new_map->info.resolution ||
-      master->getOriginX() != new_map->info.origin.position.x ||
-      master->getOriginY() != new_map->info.origin.position.y ||
+      master->getResolution() != resolution ||
+      master->getOriginX() != origin_x ||
+      master->getOriginY() != origin_y ||
       !layered_costmap_->isSizeLocked()))
   {
     // Update the size of the layered costmap (and all layers, including this one)
-    ROS_INFO("Resizing costmap to %d X %d at %f m/pix", size_x, size_y, new_map->info.resolution);
-    layered_costmap_->resizeMap(size_x, size_y, new_map->info.resolution, new_map->info.origin.position.x,
-                                new_map->info.origin.position.y, true);
+    ROS_INFO("Resizing costmap to %d X %d at %f m/pix", size_x, size_y, resolution);
+    layered_costmap_->resizeMap(size_x, size_y, resolution, origin_x, origin_y, true);
   }
   else if (size_x_ != size_x || size_y_ != size_y ||
-           resolution_ != new_map->info.resolution ||
-           origin_x_ != new_map->info.origin.position.x ||
-           origin_y_ != new_map->info.origin.position.y)
+           resolution_ != resolution ||
+           origin_x_ != origin_x ||
+           origin_y_ != origin_y)
   {
     // only update the size of the costmap stored locally in this layer
-    ROS_INFO("Resizing static layer to %d X %d at %f m/pix", size_x, size_y, new_map->info.resolution);
-    resizeMap(size_x, size_y, new_map->info.resolution,
-              new_map->info.origin.position.x, new_map->info.origin.position.y);
+    ROS_INFO("Resizing static layer to %d X %d at %f m/pix", size_x, size_y, resolution);
+    resizeMap(size_x, size_y, resolution, origin_x, origin_y);
+    resetPacked();
+    forgetLastMap();
   }
+}
 
-  unsigned int index = 0;
-
-  // initialize the costmap with static data
-  for (unsigned int i = 0; i < size_y; ++i)
+bool StaticLayer::restoreSnapshot()
+{
+  // a rolling window needs the frame of the map, which the snapshot does not keep
+  if (snapshot_file_.empty() || layered_costmap_->isRolling())
+    return false;
+
+  // decode into a scratch map first, as resizing the layered costmap also resizes (and clears) this layer
+  Costmap2D snapshot;
+  if (!snapshot.loadSnapshot(snapshot_file_))
+    return false;
+
+  matchMapGeometry(snapshot.getSizeInCellsX(), snapshot.getSizeInCellsY(), snapshot.getResolution(),
+                   snapshot.getOriginX(), snapshot.getOriginY());
+  if (packed_)
   {
-    for (unsigned int j = 0; j < size_x; ++j)
-    {
-      unsigned char value = new_map->data[index];
-      costmap_[index] = interpretValue(value);
-      ++index;
-    }
+    for (unsigned int index = 0; index < size_x_ * size_y_; ++index)
+      setCell(index, snapshot.getCharMap()[index]);
   }
-  map_frame_ = new_map->header.frame_id;
+  else
+  {
+    memcpy(costmap_, snapshot.getCharMap(), size_x_ * size_y_ * sizeof(unsigned char));
+  }
+
+  // the costs are already interpreted, so the next map is interpreted in full
+  forgetLastMap();
+  map_frame_ = global_frame_;
 
-  // we have a new map, update full size of map
   x_ = y_ = 0;
   width_ = size_x_;
   height_ = size_y_;
-  map_received_ = true;
+  changed_rects_.clear();
   has_updated_data_ = true;
+  map_received_ = true;
+  return true;
+}
 
-  // shutdown the map subscrber if firt_map_only_ flag is on
-  if (first_map_only_)
+bool StaticLayer::incomingMapChanges(const nav_msgs::OccupancyGrid& new_map)
+{
+  // the cells are only comparable if the layer kept its size and the map its frame
+  unsigned int size_x = new_map.info.width, size_y = new_map.info.height;
+  bool known = packed_ ? last_map_packed_ : map_data_.size() == new_map.data.size();
+  if (size_x != size_x_ || size_y != size_y_ || !known || map_frame_ != new_map.header.frame_id)
+    return false;
+
+  for (unsigned int ty = 0; ty < size_y; ty += TILE_SIZE)
   {
-    ROS_INFO("Shutting down the map subscriber. first_map_only flag is on");
-    map_sub_.shutdown();
+    unsigned int height = std::min(TILE_SIZE, size_y - ty);
+    for (unsigned int tx = 0; tx < size_x; tx += TILE_SIZE)
+    {
+      unsigned int width = std::min(TILE_SIZE, size_x - tx);
+      bool changed = false;
+      for (unsigned int y = ty; y < ty + height && !changed; ++y)
+      {
+        unsigned int index = y * size_x + tx;
+        if (!packed_)
+        {
+          changed = memcmp(&new_map.data[index], &map_data_[index], width) != 0;
+          continue;
+        }
+        // packed costs keep no copy of the values, so the tiles are compared by their costs
+        for (unsigned int x = 0; x < width && !changed; ++x)
+          changed = cell(index + x) != interpretValue(new_map.data[index + x]);
+      }
+      if (!changed)
+        continue;
+
+      for (unsigned int y = ty; y < ty + height; ++y)
+      {
+        unsigned int index = y * size_x + tx;
+        for (unsigned int x = 0; x < width; ++x)
+          setCell(index + x, interpretValue(new_map.data[index + x]));
+        if (!packed_)
+          memcpy(&map_data_[index], &new_map.data[index], width);
+      }
+      addChangedRect(tx, ty, width, height);
+    }
   }
+  return true;
+}
+
+void StaticLayer::addChangedRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+  // a change whose parts are not known is already waiting, so keep it as one of them
+  if (has_updated_data_ && changed_rects_.empty())
+  {
+    Rect pending = { x_, y_, width_, height_ };
+    changed_rects_.push_back(pending);
+  }
+  Rect rect = { x, y, width, height };
+  changed_rects_.push_back(rect);
+
+  // x_, y_, width_ and height_ cover them all, for updateBounds()
+  unsigned int xn = x + width, yn = y + height;
+  for (unsigned int i = 0; i < changed_rects_.size(); ++i)
+  {
+    x = std::min(x, changed_rects_[i].x);
+    y = std::min(y, changed_rects_[i].y);
+    xn = std::max(xn, changed_rects_[i].x + changed_rects_[i].width);
+    yn = std::max(yn, changed_rects_[i].y + changed_rects_[i].height);
+  }
+  x_ = x;
+  y_ = y;
+  width_ = xn - x;
+  height_ = yn - y;
+  has_updated_data_ = true;
 }
 
 void StaticLayer::incomingUpdate(const map_msgs::OccupancyGridUpdateConstPtr& update)
@@ -230,14 +526,22 @@ void StaticLayer::incomingUpdate(const map_msgs::OccupancyGridUpdateConstPtr& up
     for (unsigned int x = 0; x < update->width ; x++)
     {
       unsigned int index = index_base + x + update->x;
-      costmap_[index] = interpretValue(update->data[di++]);
+      setCell(index, interpretValue(update->data[di]));
+      if (index < map_data_.size())
+        map_data_[index] = update->data[di];
+      ++di;
     }
   }
-  x_ = update->x;
-  y_ = update->y;
-  width_ = update->width;
-  height_ = update->height;
-  has_updated_data_ = true;
+  addChangedRect(update->x, update->y, update->width, update->height);
+  layered_costmap_->requestUpdate();
+
+  // the snapshot follows the updates too, though not on every one of a stream of them
+  if (!snapshot_file_.empty())
+  {
+    boost::unique_lock<mutex_t> lock(*getMutex());
+    snapshot_stale_ = true;
+    saveChangedSnapshot();
+  }
 }
 
 void StaticLayer::activate()
@@ -267,6 +571,8 @@ void StaticLayer::reset()
 void StaticLayer::updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
                                double* max_x, double* max_y)
 {
+  // the last of a stream of map updates is saved once the period is up
+  saveChangedSnapshot();
 
   if( !layered_costmap_->isRolling() ){
     if (!map_received_ || !(has_updated_data_ || has_extra_bounds_))
@@ -285,7 +591,42 @@ void StaticLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
   *max_x = std::max(wx, *max_x);
   *max_y = std::max(wy, *max_y);
 
+  if (has_updated_data_)
+    ++revision_;
+  has_updated_data_ = false;
+  changed_rects_.clear();
+}
+
+void StaticLayer::updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds)
+{
+  // a rolling window reports its own bounds on every cycle
+  if (layered_costmap_->isRolling() || changed_rects_.empty())
+  {
+    addOwnBounds(robot_x, robot_y, robot_yaw, bounds);
+    return;
+  }
+
+  Bounds box;
+  box.min_x = box.min_y = 1e30;
+  box.max_x = box.max_y = -1e30;
+  useExtraBounds(&box.min_x, &box.min_y, &box.max_x, &box.max_y);
+  if (box.min_x <= box.max_x && box.min_y <= box.max_y)
+    bounds->push_back(box);
+
+  if (has_updated_data_)
+  {
+    for (unsigned int i = 0; i < changed_rects_.size(); ++i)
+    {
+      const Rect& rect = changed_rects_[i];
+      mapToWorld(rect.x, rect.y, box.min_x, box.min_y);
+      mapToWorld(rect.x + rect.width, rect.y + rect.height, box.max_x, box.max_y);
+      bounds->push_back(box);
+    }
+    ++revision_;
+  }
+
   has_updated_data_ = false;
+  changed_rects_.clear();
 }
 
 void StaticLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
@@ -296,7 +637,9 @@ void StaticLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int
   if (!layered_costmap_->isRolling())
   {
     // if not rolling, the layered costmap (master_grid) has same coordinates as this layer
-    if (!use_maximum_)
+    if (packed_)
+      updateWithPacked(master_grid, min_i, min_j, max_i, max_j);
+    else if (!use_maximum_)
       updateWithTrueOverwrite(master_grid, min_i, min_j, max_i, max_j);
     else
       updateWithMax(master_grid, min_i, min_j, max_i, max_j);
@@ -330,14 +673,35 @@ void StaticLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int
         // Set master_grid with cell from map
         if (worldToMap(p.x(), p.y(), mx, my))
         {
+          unsigned char cost = cell(getIndex(mx, my));
           if (!use_maximum_)
-            master_grid.setCost(i, j, getCost(mx, my));
+            master_grid.setCost(i, j, cost);
           else
-            master_grid.setCost(i, j, std::max(getCost(mx, my), master_grid.getCost(i, j)));
+            master_grid.setCost(i, j, std::max(cost, master_grid.getCost(i, j)));
         }
       }
     }
   }
 }
 
+void StaticLayer::updateWithPacked(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
+{
+  if (!enabled_ || max_i <= min_i)
+    return;
+  unsigned char* master = master_grid.getCharMap();
+  unsigned int span = master_grid.getSizeInCellsX(), n = max_i - min_i;
+
+  // the row is decoded into scratch of this call, as tiles of the master may be merged at once
+  std::vector<unsigned char> row(n);
+  for (int j = min_j; j < max_j; j++)
+  {
+    unsigned int it = span * j + min_i;
+    copyRow(min_i, j, n, &row[0]);
+    if (use_maximum_)
+      maxRow(master + it, &row[0], n);
+    else if (memcmp(master + it, &row[0], n) != 0)
+      memcpy(master + it, &row[0], n);
+  }
+}
+
 }  // namespace costmap_2d
@@ -38,8 +38,10 @@
 #include <costmap_2d/voxel_layer.h>
 #include <pluginlib/class_list_macros.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 
-#define VOXEL_BITS 16
 PLUGINLIB_EXPORT_CLASS(costmap_2d::VoxelLayer, costmap_2d::Layer)
 
 using costmap_2d::NO_INFORMATION;
@@ -54,12 +56,21 @@ namespace costmap_2d
 
 void VoxelLayer::onInitialize()
 {
-  ObstacleLayer::onInitialize();
   ros::NodeHandle private_nh("~/" + name_);
+  voxel_memory_.setComponent(name_ + "/voxel_grid");
+  // the grid is made by the first reconfigure callback, from ObstacleLayer::onInitialize()
+  private_nh.param("sparse_voxel_grid", sparse_voxel_grid_, false);
+  ObstacleLayer::onInitialize();
 
   private_nh.param("publish_voxel_map", publish_voxel_, false);
+  private_nh.param("publish_voxel_updates", publish_voxel_updates_, false);
+  private_nh.param("voxel_keyframe_interval", voxel_keyframe_interval_, 50);
   if (publish_voxel_)
     voxel_pub_ = private_nh.advertise < costmap_2d::VoxelGrid > ("voxel_grid", 1);
+  if (publish_voxel_ && publish_voxel_updates_)
+    voxel_update_pub_ = private_nh.advertise < costmap_2d::VoxelGridUpdate > ("voxel_grid_updates", 1);
+  dirty_min_x_ = dirty_min_y_ = std::numeric_limits<int>::max();
+  dirty_max_x_ = dirty_max_y_ = -1;
 
   clearing_endpoints_pub_ = private_nh.advertise<sensor_msgs::PointCloud>("clearing_endpoints", 1);
 }
@@ -86,7 +97,19 @@ void VoxelLayer::reconfigureCB(costmap_2d::VoxelPluginConfig &config, uint32_t l
   size_z_ = config.z_voxels;
   origin_z_ = config.origin_z;
   z_resolution_ = config.z_resolution;
-  unknown_threshold_ = config.unknown_threshold + (VOXEL_BITS - size_z_);
+  // columns of up to 16 voxels fit 32 bits, taller ones take 64; the levels above size_z_ always read unknown
+  bool wide_columns = size_z_ > voxel_grid::VoxelGrid::LEVELS;
+  if (!voxel_grid_ || wide_columns != wide_columns_)
+  {
+    wide_columns_ = wide_columns;
+    if (sparse_voxel_grid_)
+      voxel_grid_.reset(wide_columns_ ? static_cast<VoxelStorage*>(new VoxelStorageT<voxel_grid::SparseVoxelGrid64>())
+                                      : new VoxelStorageT<voxel_grid::SparseVoxelGrid>());
+    else
+      voxel_grid_.reset(wide_columns_ ? static_cast<VoxelStorage*>(new VoxelStorageT<voxel_grid::VoxelGrid64>())
+                                      : new VoxelStorageT<voxel_grid::VoxelGrid>());
+  }
+  unknown_threshold_ = config.unknown_threshold + (voxel_grid_->levels() - size_z_);
   mark_threshold_ = config.mark_threshold;
   combination_method_ = config.combination_method;
   matchSize();
@@ -95,22 +118,27 @@ void VoxelLayer::reconfigureCB(costmap_2d::VoxelPluginConfig &config, uint32_t l
 void VoxelLayer::matchSize()
 {
   ObstacleLayer::matchSize();
-  voxel_grid_.resize(size_x_, size_y_, size_z_);
-  ROS_ASSERT(voxel_grid_.sizeX() == size_x_ && voxel_grid_.sizeY() == size_y_);
+  if (voxel_grid_)
+  {
+    voxel_grid_->resize(size_x_, size_y_, size_z_);
+    voxel_memory_.set(voxel_grid_->memoryBytes());
+  }
+  voxel_keyframe_needed_ = true;
 }
 
 void VoxelLayer::reset()
 {
   deactivate();
   resetMaps();
-  voxel_grid_.reset();
   activate();
 }
 
 void VoxelLayer::resetMaps()
 {
   Costmap2D::resetMaps();
-  voxel_grid_.reset();
+  if (voxel_grid_)
+    voxel_grid_->reset();
+  voxel_keyframe_needed_ = true;
 }
 
 void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x,
@@ -134,11 +162,17 @@ void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
   // update the global current status
   current_ = current;
 
+  newest_observation_ = ros::Time();
+  noteObservationTimes(observations);
+  noteObservationTimes(clearing_observations);
+
   // raytrace freespace
   for (unsigned int i = 0; i < clearing_observations.size(); ++i)
   {
     raytraceFreespace(clearing_observations[i], min_x, min_y, max_x, max_y);
   }
+  if (publish_voxel_updates_)
+    touchVoxelBounds(*min_x, *min_y, *max_x, *max_y);
 
   // place the new obstacles into a priority queue... each with a priority of zero to begin with
   for (std::vector<Observation>::const_iterator it = observations.begin(); it != observations.end(); ++it)
@@ -176,8 +210,17 @@ void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
         continue;
       }
 
+      // a voxel marked below the threshold still changes its column
+      if (publish_voxel_updates_)
+      {
+        dirty_min_x_ = std::min(dirty_min_x_, int(mx));
+        dirty_min_y_ = std::min(dirty_min_y_, int(my));
+        dirty_max_x_ = std::max(dirty_max_x_, int(mx));
+        dirty_max_y_ = std::max(dirty_max_y_, int(my));
+      }
+
       // mark the cell in the voxel grid and check if we should also mark it in the costmap
-      if (voxel_grid_.markVoxelInMap(mx, my, mz, mark_threshold_))
+      if (voxel_grid_->markVoxelInMap(mx, my, mz, mark_threshold_))
       {
         unsigned int index = getIndex(mx, my);
 
@@ -188,26 +231,11 @@ void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
   }
 
   if (publish_voxel_)
-  {
-    costmap_2d::VoxelGrid grid_msg;
-    unsigned int size = voxel_grid_.sizeX() * voxel_grid_.sizeY();
-    grid_msg.size_x = voxel_grid_.sizeX();
-    grid_msg.size_y = voxel_grid_.sizeY();
-    grid_msg.size_z = voxel_grid_.sizeZ();
-    grid_msg.data.resize(size);
-    memcpy(&grid_msg.data[0], voxel_grid_.getData(), size * sizeof(unsigned int));
+    publishVoxels();
 
-    grid_msg.origin.x = origin_x_;
-    grid_msg.origin.y = origin_y_;
-    grid_msg.origin.z = origin_z_;
-
-    grid_msg.resolutions.x = resolution_;
-    grid_msg.resolutions.y = resolution_;
-    grid_msg.resolutions.z = z_resolution_;
-    grid_msg.header.frame_id = global_frame_;
-    grid_msg.header.stamp = ros::Time::now();
-    voxel_pub_.publish(grid_msg);
-  }
+  // a sparse grid grows as its blocks are first written
+  if (sparse_voxel_grid_)
+    voxel_memory_.set(voxel_grid_->memoryBytes());
 
   updateFootprint(robot_x, robot_y, robot_yaw, min_x, min_y, max_x, max_y);
 }
@@ -252,7 +280,7 @@ void VoxelLayer::clearNonLethal(double wx, double wy, double w_size_x, double w_
         if (clear_no_info || *current != NO_INFORMATION)
         {
           *current = FREE_SPACE;
-          voxel_grid_.clearVoxelColumn(index);
+          voxel_grid_->clearVoxelColumn(index);
         }
       }
       current++;
@@ -294,6 +322,9 @@ void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, doub
   double map_end_x = origin_x_ + getSizeInMetersX();
   double map_end_y = origin_y_ + getSizeInMetersY();
 
+  // the rays are traced all together once their ends are known
+  clearing_ends_.clear();
+  clearing_ends_.reserve(clearing_observation.cloud_->points.size());
   for (unsigned int i = 0; i < clearing_observation.cloud_->points.size(); ++i)
   {
     double wpx = clearing_observation.cloud_->points[i].x;
@@ -349,15 +380,10 @@ void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, doub
     wpy = oy + b * t;
     wpz = oz + c * t;
 
-    double point_x, point_y, point_z;
-    if (worldToMap3DFloat(wpx, wpy, wpz, point_x, point_y, point_z))
+    voxel_grid::LineEnd end;
+    if (worldToMap3DFloat(wpx, wpy, wpz, end.x, end.y, end.z))
     {
-      unsigned int cell_raytrace_range = cellDistance(clearing_observation.raytrace_range_);
-
-      // voxel_grid_.markVoxelLine(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z);
-      voxel_grid_.clearVoxelLineInMap(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z, costmap_,
-                                      unknown_threshold_, mark_threshold_, FREE_SPACE, NO_INFORMATION,
-                                      cell_raytrace_range);
+      clearing_ends_.push_back(end);
 
       updateRaytraceBounds(ox, oy, wpx, wpy, clearing_observation.raytrace_range_, min_x, min_y, max_x, max_y);
 
@@ -372,6 +398,11 @@ void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, doub
     }
   }
 
+  unsigned int cell_raytrace_range = cellDistance(clearing_observation.raytrace_range_);
+  voxel_grid_->clearVoxelLinesInMap(sensor_x, sensor_y, sensor_z, clearing_ends_, costmap_, unknown_threshold_,
+                                    mark_threshold_, FREE_SPACE, NO_INFORMATION, cell_raytrace_range,
+                                    std::max(raytrace_threads_, 1), layered_costmap_->getLane());
+
   if (publish_clearing_points)
   {
     clearing_endpoints_.header.frame_id = global_frame_;
@@ -382,6 +413,76 @@ void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, doub
   }
 }
 
+void VoxelLayer::touchVoxelBounds(double min_x, double min_y, double max_x, double max_y)
+{
+  if (min_x > max_x || min_y > max_y)
+    return;
+  int x0, y0, x1, y1;
+  worldToMapEnforceBounds(min_x, min_y, x0, y0);
+  worldToMapEnforceBounds(max_x, max_y, x1, y1);
+  dirty_min_x_ = std::min(dirty_min_x_, x0);
+  dirty_min_y_ = std::min(dirty_min_y_, y0);
+  dirty_max_x_ = std::max(dirty_max_x_, x1);
+  dirty_max_y_ = std::max(dirty_max_y_, y1);
+}
+
+void VoxelLayer::publishVoxels()
+{
+  bool keyframe = !publish_voxel_updates_ || voxel_keyframe_needed_
+      || (voxel_keyframe_interval_ > 0 && updates_since_keyframe_ >= voxel_keyframe_interval_);
+  if (keyframe)
+  {
+    costmap_2d::VoxelGrid grid_msg;
+    grid_msg.size_x = size_x_;
+    grid_msg.size_y = size_y_;
+    grid_msg.size_z = voxel_grid_->sizeZ();
+    voxel_grid_->getMessageData(&grid_msg.data);
+
+    grid_msg.origin.x = origin_x_;
+    grid_msg.origin.y = origin_y_;
+    grid_msg.origin.z = origin_z_;
+
+    grid_msg.resolutions.x = resolution_;
+    grid_msg.resolutions.y = resolution_;
+    grid_msg.resolutions.z = z_resolution_;
+    grid_msg.header.frame_id = global_frame_;
+    grid_msg.header.stamp = ros::Time::now();
+    voxel_pub_.publish(grid_msg);
+
+    updates_since_keyframe_ = 0;
+    voxel_keyframe_needed_ = false;
+  }
+  else
+  {
+    ++updates_since_keyframe_;
+    bool dirty = dirty_min_x_ <= dirty_max_x_ && dirty_min_y_ <= dirty_max_y_;
+    if (dirty || voxel_shift_x_ != 0 || voxel_shift_y_ != 0)
+    {
+      costmap_2d::VoxelGridUpdate update;
+      update.header.frame_id = global_frame_;
+      update.header.stamp = ros::Time::now();
+      update.shift_x = voxel_shift_x_;
+      update.shift_y = voxel_shift_y_;
+      update.origin.x = origin_x_;
+      update.origin.y = origin_y_;
+      update.origin.z = origin_z_;
+      if (dirty)
+      {
+        update.x = dirty_min_x_;
+        update.y = dirty_min_y_;
+        update.width = dirty_max_x_ - dirty_min_x_ + 1;
+        update.height = dirty_max_y_ - dirty_min_y_ + 1;
+        voxel_grid_->getMessageData(&update.data, update.x, update.y, update.width, update.height);
+      }
+      voxel_update_pub_.publish(update);
+    }
+  }
+
+  voxel_shift_x_ = voxel_shift_y_ = 0;
+  dirty_min_x_ = dirty_min_y_ = std::numeric_limits<int>::max();
+  dirty_max_x_ = dirty_max_y_ = -1;
+}
+
 void VoxelLayer::updateOrigin(double new_origin_x, double new_origin_y)
 {
   // project the new origin into the grid
@@ -395,48 +496,32 @@ void VoxelLayer::updateOrigin(double new_origin_x, double new_origin_y)
   new_grid_ox = origin_x_ + cell_ox * resolution_;
   new_grid_oy = origin_y_ + cell_oy * resolution_;
 
-  // To save casting from unsigned int to int a bunch of times
-  int size_x = size_x_;
-  int size_y = size_y_;
-
-  // we need to compute the overlap of the new and existing windows
-  int lower_left_x, lower_left_y, upper_right_x, upper_right_y;
-  lower_left_x = std::min(std::max(cell_ox, 0), size_x);
-  lower_left_y = std::min(std::max(cell_oy, 0), size_y);
-  upper_right_x = std::min(std::max(cell_ox + size_x, 0), size_x);
-  upper_right_y = std::min(std::max(cell_oy + size_y, 0), size_y);
-
-  unsigned int cell_size_x = upper_right_x - lower_left_x;
-  unsigned int cell_size_y = upper_right_y - lower_left_y;
-
-  // we need a map to store the obstacles in the window temporarily
-  unsigned char* local_map = new unsigned char[cell_size_x * cell_size_y];
-  unsigned int* local_voxel_map = new unsigned int[cell_size_x * cell_size_y];
-  unsigned int* voxel_map = voxel_grid_.getData();
-
-  // copy the local window in the costmap to the local map
-  copyMapRegion(costmap_, lower_left_x, lower_left_y, size_x_, local_map, 0, 0, cell_size_x, cell_size_x, cell_size_y);
-  copyMapRegion(voxel_map, lower_left_x, lower_left_y, size_x_, local_voxel_map, 0, 0, cell_size_x, cell_size_x,
-                cell_size_y);
+  // move the overlap of the new and existing windows into its new location in
+  // place, in both the flattened and the voxel grid, setting the cells uncovered
+  // to unknown space as resetMaps() would
+  shiftMapRegion(costmap_, size_x_, size_y_, cell_ox, cell_oy, default_value_);
+  voxel_grid_->shift(cell_ox, cell_oy);
 
-  // we'll reset our maps to unknown space if appropriate
-  resetMaps();
+  // a move that keeps part of the grid goes out as a shift with the next update, the columns changed
+  // so far moving with the grid; only one past the grid's own size takes a full grid
+  if ((cell_ox != 0 || cell_oy != 0) && !voxel_keyframe_needed_)
+  {
+    voxel_shift_x_ += cell_ox;
+    voxel_shift_y_ += cell_oy;
+    if (std::abs(voxel_shift_x_) >= int(size_x_) || std::abs(voxel_shift_y_) >= int(size_y_))
+      voxel_keyframe_needed_ = true;
+    else if (dirty_min_x_ <= dirty_max_x_ && dirty_min_y_ <= dirty_max_y_)
+    {
+      dirty_min_x_ = std::max(dirty_min_x_ - cell_ox, 0);
+      dirty_max_x_ = std::min(dirty_max_x_ - cell_ox, int(size_x_) - 1);
+      dirty_min_y_ = std::max(dirty_min_y_ - cell_oy, 0);
+      dirty_max_y_ = std::min(dirty_max_y_ - cell_oy, int(size_y_) - 1);
+    }
+  }
 
   // update the origin with the appropriate world coordinates
   origin_x_ = new_grid_ox;
   origin_y_ = new_grid_oy;
-
-  // compute the starting cell location for copying data back in
-  int start_x = lower_left_x - cell_ox;
-  int start_y = lower_left_y - cell_oy;
-
-  // now we want to copy the overlapping information back into the map, but in its new location
-  copyMapRegion(local_map, 0, 0, cell_size_x, costmap_, start_x, start_y, size_x_, cell_size_x, cell_size_y);
-  copyMapRegion(local_voxel_map, 0, 0, cell_size_x, voxel_map, start_x, start_y, size_x_, cell_size_x, cell_size_y);
-
-  // make sure to clean up
-  delete[] local_map;
-  delete[] local_voxel_map;
 }
 
 }  // namespace costmap_2d
@@ -0,0 +1,118 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <costmap_2d/blocked_costmap.h>
+#include <algorithm>
+#include <cstring>
+
+namespace costmap_2d
+{
+
+const unsigned int BlockedCostmap::BLOCK_BITS;
+const unsigned int BlockedCostmap::BLOCK_SIZE;
+
+BlockedCostmap::BlockedCostmap() : size_x_(0), size_y_(0), blocks_x_(0) {}
+
+BlockedCostmap::BlockedCostmap(const Costmap2D& costmap) : size_x_(0), size_y_(0), blocks_x_(0)
+{
+  rebuild(costmap);
+}
+
+bool BlockedCostmap::resize(unsigned int size_x, unsigned int size_y)
+{
+  if (size_x == size_x_ && size_y == size_y_)
+    return false;
+
+  size_x_ = size_x;
+  size_y_ = size_y;
+  blocks_x_ = (size_x + BLOCK_SIZE - 1) >> BLOCK_BITS;
+  unsigned int blocks_y = (size_y + BLOCK_SIZE - 1) >> BLOCK_BITS;
+  cells_.assign(size_t(blocks_x_) * blocks_y * BLOCK_SIZE * BLOCK_SIZE, 0);
+  return true;
+}
+
+void BlockedCostmap::rebuild(const Costmap2D& costmap)
+{
+  resize(costmap.getSizeInCellsX(), costmap.getSizeInCellsY());
+  update(costmap, 0, size_x_, 0, size_y_);
+}
+
+void BlockedCostmap::update(const Costmap2D& costmap, unsigned int x0, unsigned int xn, unsigned int y0,
+                            unsigned int yn)
+{
+  if (resize(costmap.getSizeInCellsX(), costmap.getSizeInCellsY()))
+  {
+    x0 = y0 = 0;
+    xn = size_x_;
+    yn = size_y_;
+  }
+
+  xn = std::min(xn, size_x_);
+  yn = std::min(yn, size_y_);
+  const unsigned char* source = costmap.getCharMap();
+  for (unsigned int y = y0; y < yn; ++y)
+  {
+    // each piece of the row within a block is contiguous in both layouts
+    for (unsigned int x = x0; x < xn;)
+    {
+      unsigned int n = std::min(xn, (x | (BLOCK_SIZE - 1)) + 1) - x;
+      memcpy(&cells_[getIndex(x, y)], source + size_t(y) * size_x_ + x, n);
+      x += n;
+    }
+  }
+}
+
+void BlockedCostmap::copyRow(unsigned int x, unsigned int y, unsigned int n, unsigned char* row) const
+{
+  for (unsigned int xn = x + n; x < xn;)
+  {
+    unsigned int piece = std::min(xn, (x | (BLOCK_SIZE - 1)) + 1) - x;
+    memcpy(row, &cells_[getIndex(x, y)], piece);
+    row += piece;
+    x += piece;
+  }
+}
+
+bool BlockedCostmap::copyTo(Costmap2D& costmap) const
+{
+  if (costmap.getSizeInCellsX() != size_x_ || costmap.getSizeInCellsY() != size_y_)
+    return false;
+
+  unsigned char* target = costmap.getCharMap();
+  for (unsigned int y = 0; y < size_y_; ++y)
+    copyRow(0, y, size_x_, target + size_t(y) * size_x_);
+  return true;
+}
+
+}  // namespace costmap_2d
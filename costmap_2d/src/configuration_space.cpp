@@ -0,0 +1,288 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <costmap_2d/configuration_space.h>
+#include <costmap_2d/cost_values.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace costmap_2d
+{
+
+// The angle between the samples of the footprint within a heading's bin, in radians
+static const double SAMPLE_ANGLE = 0.05;
+
+static inline bool isBlocking(unsigned char cost)
+{
+  return cost == LETHAL_OBSTACLE || cost == NO_INFORMATION;
+}
+
+ConfigurationSpace::ConfigurationSpace(unsigned int num_headings) :
+    num_headings_(std::max(1u, std::min(num_headings, 32u))), stale_(true), min_dy_(0), max_dy_(0), min_lo_(0),
+    max_hi_(0), size_x_(0), size_y_(0), origin_x_(0.0), origin_y_(0.0), resolution_(0.0)
+{
+}
+
+void ConfigurationSpace::setFootprint(const std::vector<geometry_msgs::Point>& footprint)
+{
+  footprint_ = footprint;
+  stale_ = true;
+}
+
+unsigned int ConfigurationSpace::getHeading(double yaw) const
+{
+  int heading = (int)floor(yaw * num_headings_ / (2 * M_PI) + 0.5) % (int)num_headings_;
+  return heading < 0 ? heading + num_headings_ : heading;
+}
+
+bool ConfigurationSpace::inCollision(double wx, double wy, double yaw) const
+{
+  if (wx < origin_x_ || wy < origin_y_ || resolution_ <= 0.0)
+    return true;
+  unsigned int mx = (unsigned int)((wx - origin_x_) / resolution_), my = (unsigned int)((wy - origin_y_) / resolution_);
+  if (mx >= size_x_ || my >= size_y_)
+    return true;
+  return inCollision(mx, my, getHeading(yaw));
+}
+
+bool ConfigurationSpace::matchMaster(const Costmap2D& master)
+{
+  if (size_x_ == master.getSizeInCellsX() && size_y_ == master.getSizeInCellsY() &&
+      resolution_ == master.getResolution() && origin_x_ == master.getOriginX() && origin_y_ == master.getOriginY())
+    return false;
+
+  size_x_ = master.getSizeInCellsX();
+  size_y_ = master.getSizeInCellsY();
+  resolution_ = master.getResolution();
+  origin_x_ = master.getOriginX();
+  origin_y_ = master.getOriginY();
+  collisions_.assign(size_x_ * size_y_, 0);
+  blocking_.assign((size_x_ + 1) * size_y_, 0);
+  return true;
+}
+
+void rasterizeFootprint(const std::vector<geometry_msgs::Point>& footprint, double resolution, double yaw,
+                        double half_bin, std::vector<FootprintSpan>* spans)
+{
+  spans->clear();
+  if (footprint.size() < 3 || resolution <= 0.0)
+  {
+    FootprintSpan center = { 0, 0, 0 };
+    spans->push_back(center);
+    return;
+  }
+
+  // the widest the footprint gets in each row, anywhere within the bin
+  int samples = half_bin > 0.0 ? std::max(1, (int)ceil(half_bin / SAMPLE_ANGLE)) : 0;
+  std::map<int, std::pair<int, int> > rows;
+  for (int k = -samples; k <= samples; ++k)
+  {
+    double angle = yaw + k * half_bin / samples;
+    double cos_th = cos(angle), sin_th = sin(angle);
+    std::vector<double> xs(footprint.size()), ys(footprint.size());
+    double min_y = 1e30, max_y = -1e30;
+    for (unsigned int i = 0; i < footprint.size(); ++i)
+    {
+      xs[i] = (footprint[i].x * cos_th - footprint[i].y * sin_th) / resolution;
+      ys[i] = (footprint[i].x * sin_th + footprint[i].y * cos_th) / resolution;
+      min_y = std::min(min_y, ys[i]);
+      max_y = std::max(max_y, ys[i]);
+    }
+
+    // cell d covers [d - 0.5, d + 0.5) in cells from the center; clip each edge to the rows it crosses
+    for (int dy = (int)floor(min_y + 0.5); dy <= (int)floor(max_y + 0.5); ++dy)
+    {
+      double y_lo = dy - 0.5, y_hi = dy + 0.5, min_x = 1e30, max_x = -1e30;
+      for (unsigned int i = 0; i < xs.size(); ++i)
+      {
+        unsigned int j = (i + 1) % xs.size();
+        double t0 = 0.0, t1 = 1.0, dy_edge = ys[j] - ys[i];
+        if (dy_edge == 0.0)
+        {
+          if (ys[i] < y_lo || ys[i] > y_hi)
+            continue;
+        }
+        else
+        {
+          double ta = (y_lo - ys[i]) / dy_edge, tb = (y_hi - ys[i]) / dy_edge;
+          t0 = std::max(t0, std::min(ta, tb));
+          t1 = std::min(t1, std::max(ta, tb));
+          if (t0 > t1)
+            continue;
+        }
+        double xa = xs[i] + t0 * (xs[j] - xs[i]), xb = xs[i] + t1 * (xs[j] - xs[i]);
+        min_x = std::min(min_x, std::min(xa, xb));
+        max_x = std::max(max_x, std::max(xa, xb));
+      }
+      if (min_x > max_x)
+        continue;
+
+      int lo = (int)floor(min_x + 0.5), hi = (int)floor(max_x + 0.5);
+      std::map<int, std::pair<int, int> >::iterator row = rows.find(dy);
+      if (row == rows.end())
+        rows[dy] = std::make_pair(lo, hi);
+      else
+        row->second = std::make_pair(std::min(row->second.first, lo), std::max(row->second.second, hi));
+    }
+  }
+
+  for (std::map<int, std::pair<int, int> >::iterator row = rows.begin(); row != rows.end(); ++row)
+  {
+    FootprintSpan span = { row->first, row->second.first, row->second.second };
+    spans->push_back(span);
+  }
+}
+
+void ConfigurationSpace::computeSpans()
+{
+  spans_.resize(num_headings_);
+  min_dy_ = max_dy_ = min_lo_ = max_hi_ = 0;
+  double bin = 2 * M_PI / num_headings_;
+  for (unsigned int h = 0; h < num_headings_; ++h)
+  {
+    rasterizeFootprint(footprint_, resolution_, h * bin, bin / 2, &spans_[h]);
+    for (unsigned int i = 0; i < spans_[h].size(); ++i)
+    {
+      const Span& span = spans_[h][i];
+      min_dy_ = std::min(min_dy_, span.dy);
+      max_dy_ = std::max(max_dy_, span.dy);
+      min_lo_ = std::min(min_lo_, span.lo);
+      max_hi_ = std::max(max_hi_, span.hi);
+    }
+  }
+}
+
+void ConfigurationSpace::countRow(const Costmap2D& master, unsigned int y, unsigned int x0)
+{
+  uint32_t* row = &blocking_[y * (size_x_ + 1)];
+  const unsigned char* costs = master.getCharMap() + y * size_x_;
+  for (unsigned int x = x0; x < size_x_; ++x)
+    row[x + 1] = row[x] + isBlocking(costs[x]);
+}
+
+uint32_t ConfigurationSpace::collisions(int x, int y) const
+{
+  // the cells any heading covers hold nothing blocking, on most cells of most maps
+  if (y + min_dy_ >= 0 && y + max_dy_ < (int)size_y_ && x + min_lo_ >= 0 && x + max_hi_ < (int)size_x_)
+  {
+    uint32_t count = 0;
+    for (int yy = y + min_dy_; yy <= y + max_dy_ && count == 0; ++yy)
+    {
+      const uint32_t* row = &blocking_[yy * (size_x_ + 1)];
+      count = row[x + max_hi_ + 1] - row[x + min_lo_];
+    }
+    if (count == 0)
+      return 0;
+  }
+
+  uint32_t mask = 0;
+  for (unsigned int h = 0; h < num_headings_; ++h)
+  {
+    const std::vector<Span>& spans = spans_[h];
+    for (unsigned int s = 0; s < spans.size(); ++s)
+    {
+      int yy = y + spans[s].dy, lo = x + spans[s].lo, hi = x + spans[s].hi;
+      if (yy < 0 || yy >= (int)size_y_ || lo < 0 || hi >= (int)size_x_)
+      {
+        mask |= 1u << h;
+        break;
+      }
+      const uint32_t* row = &blocking_[yy * (size_x_ + 1)];
+      if (row[hi + 1] != row[lo])
+      {
+        mask |= 1u << h;
+        break;
+      }
+    }
+  }
+  return mask;
+}
+
+void ConfigurationSpace::recompute(int x0, int xn, int y0, int yn)
+{
+  x0 = std::max(x0, 0);
+  y0 = std::max(y0, 0);
+  xn = std::min(xn, (int)size_x_);
+  yn = std::min(yn, (int)size_y_);
+  for (int y = y0; y < yn; ++y)
+    for (int x = x0; x < xn; ++x)
+      collisions_[y * size_x_ + x] = collisions(x, y);
+}
+
+void ConfigurationSpace::rebuild(const Costmap2D& master)
+{
+  matchMaster(master);
+  computeSpans();
+  stale_ = false;
+  for (unsigned int y = 0; y < size_y_; ++y)
+    countRow(master, y, 0);
+  recompute(0, size_x_, 0, size_y_);
+}
+
+void ConfigurationSpace::update(const Costmap2D& master, unsigned int x0, unsigned int xn, unsigned int y0,
+                                unsigned int yn)
+{
+  if (matchMaster(master) || stale_)
+  {
+    rebuild(master);
+    return;
+  }
+
+  xn = std::min(xn, size_x_);
+  yn = std::min(yn, size_y_);
+  if (x0 >= xn || y0 >= yn)
+    return;
+
+  for (unsigned int y = y0; y < yn; ++y)
+    countRow(master, y, x0);
+
+  // the cells whose footprint, at some heading, covers a cell that changed
+  recompute((int)x0 - max_hi_, (int)xn - min_lo_, (int)y0 - max_dy_, (int)yn - min_dy_);
+}
+
+void ConfigurationSpace::update(LayeredCostmap& layered_costmap)
+{
+  const Costmap2D& master = *layered_costmap.getCostmap();
+  const std::vector<LayeredCostmap::Region>& regions = layered_costmap.getUpdatedRegions();
+  if (matchMaster(master) || stale_)
+  {
+    rebuild(master);
+    return;
+  }
+  for (unsigned int i = 0; i < regions.size(); ++i)
+    update(master, regions[i].x0, regions[i].xn, regions[i].y0, regions[i].yn);
+}
+
+}  // namespace costmap_2d
@@ -36,16 +36,103 @@
  *         David V. Lu!!
  *********************************************************************/
 #include <costmap_2d/costmap_2d.h>
+#include <cerrno>
 #include <cstdio>
+#include <limits>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
 namespace costmap_2d
 {
+const unsigned int Costmap2D::POLYGON_FILL_CACHE_SIZE;
+
+// Maps of at least this many cells are allocated lazily, see initMaps()
+static const size_t LAZY_MAP_BYTES = 1 << 24;
+
+// Size of the files of a single repeated value that lazy maps are mapped from
+static const size_t UNIFORM_CHUNK_BYTES = 1 << 24;
+
+// The files of uniformFile(), by value, closed when the program ends
+class UniformFiles
+{
+public:
+  ~UniformFiles()
+  {
+    for (std::map<unsigned char, int>::iterator it = files.begin(); it != files.end(); ++it)
+    {
+      if (it->second >= 0)
+        close(it->second);
+    }
+  }
+
+  boost::mutex mutex;
+  std::map<unsigned char, int> files;
+};
+
+// Fill the file with UNIFORM_CHUNK_BYTES of the value; false if it could not be written in full
+static bool fillUniformFile(int fd, unsigned char value)
+{
+  std::vector<unsigned char> chunk(1 << 20, value);
+  size_t written = 0;
+  while (written < UNIFORM_CHUNK_BYTES)
+  {
+    ssize_t n = write(fd, &chunk[0], std::min(chunk.size(), UNIFORM_CHUNK_BYTES - written));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+  return true;
+}
+
+// A file holding UNIFORM_CHUNK_BYTES of the value, shared by all the maps
+// filled with it, or -1 if none could be made.  The file has no name from
+// the moment it is made, so nothing is left behind in /dev/shm, and a file
+// that could not be filled is closed again.
+static int uniformFile(unsigned char value)
+{
+  static UniformFiles uniform;
+
+  boost::mutex::scoped_lock lock(uniform.mutex);
+  std::map<unsigned char, int>::iterator file = uniform.files.find(value);
+  if (file != uniform.files.end())
+    return file->second;
+
+  char name[] = "/dev/shm/costmap_2d_XXXXXX";
+  int fd = mkstemp(name);
+  if (fd >= 0)
+  {
+    unlink(name);
+    if (!fillUniformFile(fd, value))
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+  uniform.files[value] = fd;
+  return fd;
+}
+
+// Whether all n > 0 cells hold the value, without writing to them
+static inline bool isUniform(const unsigned char* cells, size_t n, unsigned char value)
+{
+  return cells[0] == value && memcmp(cells, cells + 1, n - 1) == 0;
+}
+
 Costmap2D::Costmap2D(unsigned int cells_size_x, unsigned int cells_size_y, double resolution,
                      double origin_x, double origin_y, unsigned char default_value) :
     size_x_(cells_size_x), size_y_(cells_size_y), resolution_(resolution), origin_x_(origin_x),
-    origin_y_(origin_y), costmap_(NULL), default_value_(default_value)
+    origin_y_(origin_y), costmap_(NULL), default_value_(default_value), next_polygon_fill_(0), version_(0),
+    mapped_size_(0), memory_("costmap_2d")
 {
   access_ = new mutex_t();
 
@@ -58,15 +145,73 @@ void Costmap2D::deleteMaps()
 {
   // clean up data
   boost::unique_lock<mutex_t> lock(*access_);
-  delete[] costmap_;
+  freeCells();
+}
+
+void Costmap2D::freeCells()
+{
+  if (mapped_size_ > 0)
+    munmap(costmap_, mapped_size_);
+  else
+    delete[] costmap_;
   costmap_ = NULL;
+  mapped_size_ = 0;
+  memory_.set(0);
 }
 
 void Costmap2D::initMaps(unsigned int size_x, unsigned int size_y)
 {
   boost::unique_lock<mutex_t> lock(*access_);
-  delete[] costmap_;
-  costmap_ = new unsigned char[size_x * size_y];
+  freeCells();
+
+  size_t size = size_t(size_x) * size_y;
+  if (size >= LAZY_MAP_BYTES)
+  {
+    // the system hands out zero pages on first write; resetMaps() maps other default values
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t mapped_size = (size + page - 1) / page * page;
+    void* cells = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                       -1, 0);
+    if (cells != MAP_FAILED)
+    {
+      costmap_ = static_cast<unsigned char*>(cells);
+      mapped_size_ = mapped_size;
+      memory_.set(mapped_size);
+      return;
+    }
+  }
+  costmap_ = new unsigned char[size];
+  memory_.set(size);
+}
+
+bool Costmap2D::mapUniformCells(unsigned char value)
+{
+  if (mapped_size_ == 0)
+    return false;
+
+  // mapping over the cells drops the pages written to so far
+  if (value == 0)
+    return mmap(costmap_, mapped_size_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) != MAP_FAILED;
+
+  // every chunk of the cells maps the same file, so its pages are shared until written to
+  int fd = uniformFile(value);
+  if (fd < 0)
+    return false;
+  for (size_t offset = 0; offset < mapped_size_; offset += UNIFORM_CHUNK_BYTES)
+  {
+    size_t length = std::min(UNIFORM_CHUNK_BYTES, mapped_size_ - offset);
+    if (mmap(costmap_ + offset, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+      // a failed fixed mapping may have dropped the pages it was to replace, so the cells are mapped afresh
+      // for the caller to fill; if even that fails there is nothing left to write to
+      if (mmap(costmap_, mapped_size_, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+        throw std::bad_alloc();
+      return false;
+    }
+  }
+  return true;
 }
 
 void Costmap2D::resizeMap(unsigned int size_x, unsigned int size_y, double resolution,
@@ -87,15 +232,28 @@ void Costmap2D::resizeMap(unsigned int size_x, unsigned int size_y, double resol
 void Costmap2D::resetMaps()
 {
   boost::unique_lock<mutex_t> lock(*access_);
-  memset(costmap_, default_value_, size_x_ * size_y_ * sizeof(unsigned char));
+  if (!mapUniformCells(default_value_))
+    memset(costmap_, default_value_, size_x_ * size_y_ * sizeof(unsigned char));
+  recordChange(0, size_x_, 0, size_y_);
 }
 
 void Costmap2D::resetMap(unsigned int x0, unsigned int y0, unsigned int xn, unsigned int yn)
 {
   boost::unique_lock<mutex_t> lock(*(access_));
   unsigned int len = xn - x0;
+  if (len == 0)
+    return;
+  recordChange(x0, xn, y0, yn);
+  if (mapped_size_ > 0 && x0 == 0 && y0 == 0 && xn == size_x_ && yn == size_y_ && mapUniformCells(default_value_))
+    return;
+
   for (unsigned int y = y0 * size_x_ + x0; y < yn * size_x_ + x0; y += size_x_)
+  {
+    // rows of a lazy map that already hold the default are left alone, so their pages stay shared
+    if (mapped_size_ > 0 && isUniform(costmap_ + y, len, default_value_))
+      continue;
     memset(costmap_ + y, default_value_, len * sizeof(unsigned char));
+  }
 }
 
 bool Costmap2D::copyCostmapWindow(const Costmap2D& map, double win_origin_x, double win_origin_y, double win_size_x,
@@ -131,6 +289,7 @@ bool Costmap2D::copyCostmapWindow(const Costmap2D& map, double win_origin_x, dou
 
   // copy the window of the static map and the costmap that we're taking
   copyMapRegion(map.costmap_, lower_left_x, lower_left_y, map.size_x_, costmap_, 0, 0, size_x_, size_x_, size_y_);
+  recordChange(0, size_x_, 0, size_y_);
   return true;
 }
 
@@ -140,8 +299,15 @@ Costmap2D& Costmap2D::operator=(const Costmap2D& map)
   if (this == &map)
     return *this;
 
-  // clean up old data
-  deleteMaps();
+  // only reallocate when the size changes, so that repeated copies of the same map are cheap
+  if (costmap_ == NULL || size_x_ != map.size_x_ || size_y_ != map.size_y_)
+  {
+    // clean up old data
+    deleteMaps();
+
+    // initialize our various maps
+    initMaps(map.size_x_, map.size_y_);
+  }
 
   size_x_ = map.size_x_;
   size_y_ = map.size_y_;
@@ -149,17 +315,31 @@ Costmap2D& Costmap2D::operator=(const Costmap2D& map)
   origin_x_ = map.origin_x_;
   origin_y_ = map.origin_y_;
 
-  // initialize our various maps
-  initMaps(size_x_, size_y_);
-
   // copy the cost map
   memcpy(costmap_, map.costmap_, size_x_ * size_y_ * sizeof(unsigned char));
+  recordChange(0, size_x_, 0, size_y_);
 
   return *this;
 }
 
+void Costmap2D::updateCopy(const Costmap2D& map, unsigned long& version)
+{
+  unsigned int x0, xn, y0, yn;
+  if (costmap_ == NULL || size_x_ != map.size_x_ || size_y_ != map.size_y_ || resolution_ != map.resolution_
+      || origin_x_ != map.origin_x_ || origin_y_ != map.origin_y_ || !map.getChangesSince(version, &x0, &xn, &y0, &yn))
+  {
+    *this = map;
+  }
+  else if (x0 < xn && y0 < yn)
+  {
+    copyMapRegion(map.costmap_, x0, y0, map.size_x_, costmap_, x0, y0, size_x_, xn - x0, yn - y0);
+    recordChange(x0, xn, y0, yn);
+  }
+  version = map.version_;
+}
+
 Costmap2D::Costmap2D(const Costmap2D& map) :
-    costmap_(NULL)
+    costmap_(NULL), next_polygon_fill_(0), version_(0), mapped_size_(0), memory_("costmap_2d")
 {
   access_ = new mutex_t();
   *this = map;
@@ -167,7 +347,8 @@ Costmap2D::Costmap2D(const Costmap2D& map) :
 
 // just initialize everything to NULL by default
 Costmap2D::Costmap2D() :
-    size_x_(0), size_y_(0), resolution_(0.0), origin_x_(0.0), origin_y_(0.0), costmap_(NULL)
+    size_x_(0), size_y_(0), resolution_(0.0), origin_x_(0.0), origin_y_(0.0), costmap_(NULL), next_polygon_fill_(0),
+    version_(0), mapped_size_(0), memory_("costmap_2d")
 {
   access_ = new mutex_t();
 }
@@ -184,6 +365,34 @@ unsigned int Costmap2D::cellDistance(double world_dist)
   return (unsigned int)cells_dist;
 }
 
+void Costmap2D::recordChange(unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn)
+{
+  unsigned int* change = changes_[++version_ % CHANGE_HISTORY];
+  change[0] = x0;
+  change[1] = xn;
+  change[2] = y0;
+  change[3] = yn;
+}
+
+bool Costmap2D::getChangesSince(unsigned long version, unsigned int* x0, unsigned int* xn, unsigned int* y0,
+                                unsigned int* yn) const
+{
+  *x0 = *y0 = std::numeric_limits<unsigned int>::max();
+  *xn = *yn = 0;
+  if (version > version_ || version_ - version > CHANGE_HISTORY)
+    return false;
+
+  for (unsigned long v = version + 1; v <= version_; ++v)
+  {
+    const unsigned int* change = changes_[v % CHANGE_HISTORY];
+    *x0 = std::min(*x0, change[0]);
+    *xn = std::max(*xn, change[1]);
+    *y0 = std::min(*y0, change[2]);
+    *yn = std::max(*yn, change[3]);
+  }
+  return true;
+}
+
 unsigned char* Costmap2D::getCharMap() const
 {
   return costmap_;
@@ -279,42 +488,16 @@ void Costmap2D::updateOrigin(double new_origin_x, double new_origin_y)
   new_grid_ox = origin_x_ + cell_ox * resolution_;
   new_grid_oy = origin_y_ + cell_oy * resolution_;
 
-  // To save casting from unsigned int to int a bunch of times
-  int size_x = size_x_;
-  int size_y = size_y_;
-
-  // we need to compute the overlap of the new and existing windows
-  int lower_left_x, lower_left_y, upper_right_x, upper_right_y;
-  lower_left_x = min(max(cell_ox, 0), size_x);
-  lower_left_y = min(max(cell_oy, 0), size_y);
-  upper_right_x = min(max(cell_ox + size_x, 0), size_x);
-  upper_right_y = min(max(cell_oy + size_y, 0), size_y);
-
-  unsigned int cell_size_x = upper_right_x - lower_left_x;
-  unsigned int cell_size_y = upper_right_y - lower_left_y;
-
-  // we need a map to store the obstacles in the window temporarily
-  unsigned char* local_map = new unsigned char[cell_size_x * cell_size_y];
-
-  // copy the local window in the costmap to the local map
-  copyMapRegion(costmap_, lower_left_x, lower_left_y, size_x_, local_map, 0, 0, cell_size_x, cell_size_x, cell_size_y);
-
-  // now we'll set the costmap to be completely unknown if we track unknown space
-  resetMaps();
+  // move the overlap of the new and existing windows into its new location in
+  // place, setting the cells uncovered to be unknown if we track unknown space
+  boost::unique_lock<mutex_t> lock(*access_);
+  shiftMapRegion(costmap_, size_x_, size_y_, cell_ox, cell_oy, default_value_);
+  if (cell_ox != 0 || cell_oy != 0)
+    recordChange(0, size_x_, 0, size_y_);
 
   // update the origin with the appropriate world coordinates
   origin_x_ = new_grid_ox;
   origin_y_ = new_grid_oy;
-
-  // compute the starting cell location for copying data back in
-  int start_x = lower_left_x - cell_ox;
-  int start_y = lower_left_y - cell_oy;
-
-  // now we want to copy the overlapping information back into the map, but in its new location
-  copyMapRegion(local_map, 0, 0, cell_size_x, costmap_, start_x, start_y, size_x_, cell_size_x, cell_size_y);
-
-  // make sure to clean up
-  delete[] local_map;
 }
 
 bool Costmap2D::setConvexPolygonCost(const std::vector<geometry_msgs::Point>& polygon, unsigned char cost_value)
@@ -332,20 +515,183 @@ bool Costmap2D::setConvexPolygonCost(const std::vector<geometry_msgs::Point>& po
     map_polygon.push_back(loc);
   }
 
-  std::vector<MapLocation> polygon_cells;
+  // we need a minimum polygon of a triangle
+  if (map_polygon.size() < 3)
+    return true;
 
-  // get the cells that fill the polygon
-  convexFillCells(map_polygon, polygon_cells);
+  // the same footprint comes in every cycle, mostly with the same shape in cells, so look the
+  // cells it fills up by its shape before rasterizing it again
+  std::vector<int> shape(2 * map_polygon.size());
+  for (unsigned int i = 0; i < map_polygon.size(); ++i)
+  {
+    shape[2 * i] = int(map_polygon[i].x) - int(map_polygon[0].x);
+    shape[2 * i + 1] = int(map_polygon[i].y) - int(map_polygon[0].y);
+  }
+
+  boost::unique_lock<mutex_t> lock(*access_);
+  unsigned int fill = 0;
+  while (fill < polygon_fills_.size() && polygon_fills_[fill].shape != shape)
+    ++fill;
+
+  if (fill == polygon_fills_.size())
+  {
+    std::vector<MapLocation> polygon_cells;
+
+    // get the cells that fill the polygon
+    convexFillCells(map_polygon, polygon_cells);
+
+    if (polygon_fills_.size() < POLYGON_FILL_CACHE_SIZE)
+      polygon_fills_.push_back(PolygonFill());
+    else
+      fill = next_polygon_fill_++ % POLYGON_FILL_CACHE_SIZE;
+
+    PolygonFill& entry = polygon_fills_[fill];
+    entry.shape.swap(shape);
+    entry.cells.resize(2 * polygon_cells.size());
+    for (unsigned int i = 0; i < polygon_cells.size(); ++i)
+    {
+      entry.cells[2 * i] = int(polygon_cells[i].x) - int(map_polygon[0].x);
+      entry.cells[2 * i + 1] = int(polygon_cells[i].y) - int(map_polygon[0].y);
+    }
+  }
 
   // set the cost of those cells
-  for (unsigned int i = 0; i < polygon_cells.size(); ++i)
+  const std::vector<int>& cells = polygon_fills_[fill].cells;
+  unsigned int x0 = size_x_, xn = 0, y0 = size_y_, yn = 0;
+  for (unsigned int i = 0; i < cells.size(); i += 2)
   {
-    unsigned int index = getIndex(polygon_cells[i].x, polygon_cells[i].y);
-    costmap_[index] = cost_value;
+    unsigned int x = map_polygon[0].x + cells[i], y = map_polygon[0].y + cells[i + 1];
+    costmap_[getIndex(x, y)] = cost_value;
+    x0 = std::min(x0, x);
+    xn = std::max(xn, x + 1);
+    y0 = std::min(y0, y);
+    yn = std::max(yn, y + 1);
   }
+  if (x0 < xn)
+    recordChange(x0, xn, y0, yn);
   return true;
 }
 
+// Set the n cells of a row to value, except those whose cost is kept, and return the first and one past
+// the last cell that changed as [*first, *last), with *first == n if none did
+static void clearRow(unsigned char* cells, unsigned int n, unsigned char value, const std::vector<unsigned char>& keep,
+                     const bool* kept, unsigned int* first, unsigned int* last)
+{
+  *first = n;
+  *last = 0;
+  unsigned int i = 0;
+#ifdef __SSE2__
+  // 16 cells at a time: a cell is kept if it already holds the value or a kept cost
+  const __m128i target = _mm_set1_epi8(static_cast<char>(value));
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells + i));
+    __m128i keep_mask = _mm_cmpeq_epi8(cost, target);
+    for (unsigned int k = 0; k < keep.size(); ++k)
+      keep_mask = _mm_or_si128(keep_mask, _mm_cmpeq_epi8(cost, _mm_set1_epi8(static_cast<char>(keep[k]))));
+    unsigned int changed = ~_mm_movemask_epi8(keep_mask) & 0xffff;
+    if (changed == 0)
+      continue;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cells + i),
+                     _mm_or_si128(_mm_and_si128(keep_mask, cost), _mm_andnot_si128(keep_mask, target)));
+    *first = std::min(*first, i + __builtin_ctz(changed));
+    *last = i + 32 - __builtin_clz(changed);
+  }
+#endif
+  for (; i < n; ++i)
+  {
+    if (cells[i] == value || kept[cells[i]])
+      continue;
+    cells[i] = value;
+    *first = std::min(*first, i);
+    *last = i + 1;
+  }
+}
+
+bool Costmap2D::clearRegion(const std::vector<geometry_msgs::Point>& polygon, unsigned char value,
+                            const std::vector<unsigned char>& keep)
+{
+  std::vector<MapLocation> map_polygon(polygon.size());
+  for (unsigned int i = 0; i < polygon.size(); ++i)
+  {
+    if (!worldToMap(polygon[i].x, polygon[i].y, map_polygon[i].x, map_polygon[i].y))
+      return false;
+  }
+  if (map_polygon.size() < 3)
+    return true;
+
+  // a convex polygon covers one span of each row, from the leftmost to the rightmost cell of its outline
+  boost::unique_lock<mutex_t> lock(*access_);
+  std::vector<MapLocation> outline;
+  polygonOutlineCells(map_polygon, outline);
+  unsigned int row0 = size_y_, rown = 0;
+  for (unsigned int i = 0; i < outline.size(); ++i)
+  {
+    row0 = std::min(row0, outline[i].y);
+    rown = std::max(rown, outline[i].y + 1);
+  }
+  std::vector<unsigned int> span_x0(rown - row0, size_x_), span_xn(rown - row0, 0);
+  for (unsigned int i = 0; i < outline.size(); ++i)
+  {
+    unsigned int row = outline[i].y - row0;
+    span_x0[row] = std::min(span_x0[row], outline[i].x);
+    span_xn[row] = std::max(span_xn[row], outline[i].x + 1);
+  }
+
+  unsigned int x0 = size_x_, xn = 0, y0 = size_y_, yn = 0;
+  for (unsigned int y = row0; y < rown; ++y)
+  {
+    if (span_x0[y - row0] < span_xn[y - row0])
+      clearRows(span_x0[y - row0], y, span_xn[y - row0], y + 1, value, keep, &x0, &xn, &y0, &yn);
+  }
+  if (x0 < xn)
+    recordChange(x0, xn, y0, yn);
+  return true;
+}
+
+void Costmap2D::clearCells(unsigned int x0, unsigned int y0, unsigned int xn, unsigned int yn, unsigned char value,
+                           const std::vector<unsigned char>& keep, unsigned int* min_x, unsigned int* max_x,
+                           unsigned int* min_y, unsigned int* max_y)
+{
+  boost::unique_lock<mutex_t> lock(*access_);
+  unsigned int cx0 = size_x_, cxn = 0, cy0 = size_y_, cyn = 0;
+  clearRows(x0, y0, xn, yn, value, keep, &cx0, &cxn, &cy0, &cyn);
+  if (cx0 < cxn)
+  {
+    recordChange(cx0, cxn, cy0, cyn);
+    *min_x = std::min(*min_x, cx0);
+    *max_x = std::max(*max_x, cxn);
+    *min_y = std::min(*min_y, cy0);
+    *max_y = std::max(*max_y, cyn);
+  }
+}
+
+void Costmap2D::clearRows(unsigned int x0, unsigned int y0, unsigned int xn, unsigned int yn, unsigned char value,
+                          const std::vector<unsigned char>& keep, unsigned int* min_x, unsigned int* max_x,
+                          unsigned int* min_y, unsigned int* max_y)
+{
+  xn = std::min(xn, size_x_);
+  yn = std::min(yn, size_y_);
+  if (x0 >= xn || y0 >= yn)
+    return;
+
+  bool kept[256] = { false };
+  for (unsigned int k = 0; k < keep.size(); ++k)
+    kept[keep[k]] = true;
+
+  for (unsigned int y = y0; y < yn; ++y)
+  {
+    unsigned int first, last;
+    clearRow(costmap_ + getIndex(x0, y), xn - x0, value, keep, kept, &first, &last);
+    if (first >= last)
+      continue;
+    *min_x = std::min(*min_x, x0 + first);
+    *max_x = std::max(*max_x, x0 + last);
+    *min_y = std::min(*min_y, y);
+    *max_y = std::max(*max_y, y + 1);
+  }
+}
+
 void Costmap2D::polygonOutlineCells(const std::vector<MapLocation>& polygon, std::vector<MapLocation>& polygon_cells)
 {
   PolygonOutlineCells cell_gatherer(*this, costmap_, polygon_cells);
@@ -490,4 +836,235 @@ bool Costmap2D::saveMap(std::string file_name)
   return true;
 }
 
+// Snapshot layout, in the byte order of the machine that wrote it:
+//   header: magic, version, size x and y, tile size, plane count (uint32),
+//           resolution, origin x and y (double), default value (uint8)
+//   per plane: name length (uint32) and name, then per tile in row-major order
+//              the coded length (uint32) and the runs, each as (length - 1, cost) bytes
+static const uint32_t SNAPSHOT_MAGIC = 0x4e534d43;  // "CMSN"
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const unsigned int SNAPSHOT_TILE_SIZE = 64;
+
+// Run length code one tile of the costs
+static void encodeTile(const unsigned char* costs, unsigned int size_x, unsigned int x0, unsigned int y0,
+                       unsigned int width, unsigned int height, std::vector<unsigned char>* runs)
+{
+  runs->clear();
+  unsigned int length = 0;
+  unsigned char value = 0;
+  for (unsigned int y = y0; y < y0 + height; ++y)
+  {
+    const unsigned char* row = costs + y * size_x + x0;
+    for (unsigned int x = 0; x < width; ++x)
+    {
+      if (length > 0 && (row[x] != value || length == 256))
+      {
+        runs->push_back(length - 1);
+        runs->push_back(value);
+        length = 0;
+      }
+      value = row[x];
+      ++length;
+    }
+  }
+  if (length > 0)
+  {
+    runs->push_back(length - 1);
+    runs->push_back(value);
+  }
+}
+
+// Expand the runs of one tile; false if they do not fill it exactly
+static bool decodeTile(const std::vector<unsigned char>& runs, unsigned char* costs, unsigned int size_x,
+                       unsigned int x0, unsigned int y0, unsigned int width, unsigned int height)
+{
+  unsigned int x = 0, y = 0;
+  for (unsigned int i = 0; i + 1 < runs.size(); i += 2)
+  {
+    unsigned int length = runs[i] + 1;
+    unsigned char value = runs[i + 1];
+    while (length > 0)
+    {
+      if (y == height)
+        return false;
+      unsigned int n = std::min(length, width - x);
+      memset(costs + (y0 + y) * size_x + x0 + x, value, n);
+      length -= n;
+      x += n;
+      if (x == width)
+      {
+        x = 0;
+        ++y;
+      }
+    }
+  }
+  return runs.size() % 2 == 0 && y == height && x == 0;
+}
+
+static bool writeValue(FILE* fp, const void* value, size_t size)
+{
+  return fwrite(value, size, 1, fp) == 1;
+}
+
+static bool readValue(FILE* fp, void* value, size_t size)
+{
+  return fread(value, size, 1, fp) == 1;
+}
+
+bool Costmap2D::saveSnapshot(const std::string& file_name, const SnapshotPlanes& planes)
+{
+  boost::unique_lock<mutex_t> lock(*access_);
+
+  // the map itself is the plane without a name
+  std::vector<std::pair<std::string, Costmap2D*> > all_planes(1, std::make_pair(std::string(), this));
+  for (SnapshotPlanes::const_iterator it = planes.begin(); it != planes.end(); ++it)
+  {
+    if (it->first.empty() || it->second->getSizeInCellsX() != size_x_ || it->second->getSizeInCellsY() != size_y_)
+      return false;
+    all_planes.push_back(*it);
+  }
+
+  // write to a temporary name and rename it into place, so that a reader never sees a partial file
+  char pid[32];
+  snprintf(pid, sizeof(pid), ".%d.tmp", int(getpid()));
+  std::string tmp_name = file_name + pid;
+  FILE* fp = fopen(tmp_name.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  uint32_t header[6] = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, size_x_, size_y_, SNAPSHOT_TILE_SIZE,
+                         uint32_t(all_planes.size()) };
+  double geometry[3] = { resolution_, origin_x_, origin_y_ };
+  bool ok = writeValue(fp, header, sizeof(header)) && writeValue(fp, geometry, sizeof(geometry))
+      && writeValue(fp, &default_value_, sizeof(default_value_));
+
+  std::vector<unsigned char> runs;
+  for (unsigned int p = 0; ok && p < all_planes.size(); ++p)
+  {
+    Costmap2D* plane = all_planes[p].second;
+    boost::unique_lock<mutex_t> plane_lock(*(plane->getMutex()));
+
+    uint32_t name_length = all_planes[p].first.size();
+    ok = writeValue(fp, &name_length, sizeof(name_length))
+        && fwrite(all_planes[p].first.data(), 1, name_length, fp) == name_length;
+    for (unsigned int y = 0; ok && y < size_y_; y += SNAPSHOT_TILE_SIZE)
+    {
+      for (unsigned int x = 0; ok && x < size_x_; x += SNAPSHOT_TILE_SIZE)
+      {
+        encodeTile(plane->costmap_, size_x_, x, y, std::min(SNAPSHOT_TILE_SIZE, size_x_ - x),
+                   std::min(SNAPSHOT_TILE_SIZE, size_y_ - y), &runs);
+        uint32_t length = runs.size();
+        ok = writeValue(fp, &length, sizeof(length)) && fwrite(&runs[0], 1, length, fp) == length;
+      }
+    }
+  }
+
+  if (fclose(fp) != 0)
+    ok = false;
+  if (ok)
+    ok = rename(tmp_name.c_str(), file_name.c_str()) == 0;
+  if (!ok)
+    unlink(tmp_name.c_str());
+  return ok;
+}
+
+bool Costmap2D::loadSnapshot(const std::string& file_name, const SnapshotPlanes& planes)
+{
+  FILE* fp = fopen(file_name.c_str(), "rb");
+  if (!fp)
+    return false;
+
+  uint32_t header[6];
+  double geometry[3];
+  unsigned char default_value;
+  if (!readValue(fp, header, sizeof(header)) || !readValue(fp, geometry, sizeof(geometry))
+      || !readValue(fp, &default_value, sizeof(default_value)) || header[0] != SNAPSHOT_MAGIC
+      || header[1] != SNAPSHOT_VERSION || header[4] == 0 || header[5] == 0)
+  {
+    fclose(fp);
+    return false;
+  }
+  unsigned int size_x = header[2], size_y = header[3], tile_size = header[4], plane_count = header[5];
+
+  // the size in the header is only trusted as far as the rest of the file can hold it: every tile of every plane
+  // takes at least its length, and every 256 cells at least one run
+  long data_start = ftell(fp);
+  long file_size = -1;
+  if (data_start >= 0 && fseek(fp, 0, SEEK_END) == 0)
+    file_size = ftell(fp);
+  uint64_t left = file_size > data_start ? file_size - data_start : 0;
+  uint64_t tiles = (((uint64_t)size_x + tile_size - 1) / tile_size) * (((uint64_t)size_y + tile_size - 1) / tile_size);
+  uint64_t cells = (uint64_t)size_x * size_y;
+  bool fits = tile_size <= 4096 && tiles <= left && cells / 128 <= left;
+  uint64_t plane_bytes = tiles * sizeof(uint32_t) + 2 * ((cells + 255) / 256);
+  fits = fits && (plane_bytes == 0 || plane_count <= left / plane_bytes);
+  if (file_size < data_start || fseek(fp, data_start, SEEK_SET) != 0 || !fits)
+  {
+    fclose(fp);
+    return false;
+  }
+
+  // decode everything before touching any costmap, so that a corrupt file changes nothing
+  std::vector<std::pair<Costmap2D*, std::vector<unsigned char> > > decoded;
+  std::vector<unsigned char> runs;
+  bool ok = true;
+  for (unsigned int p = 0; ok && p < plane_count; ++p)
+  {
+    uint32_t name_length;
+    ok = readValue(fp, &name_length, sizeof(name_length)) && name_length < 4096;
+    std::string name(ok ? name_length : 0, ' ');
+    ok = ok && (name_length == 0 || fread(&name[0], 1, name_length, fp) == name_length);
+    if (!ok || (p == 0) != name.empty())
+    {
+      ok = false;
+      break;
+    }
+
+    Costmap2D* target = this;
+    if (p > 0)
+    {
+      SnapshotPlanes::const_iterator it = planes.find(name);
+      target = it == planes.end() ? NULL : it->second;
+    }
+
+    // a plane that is not asked for is still read through, to get to the next one
+    std::vector<unsigned char> costs(target ? (size_t)size_x * size_y : 0);
+    for (unsigned int y = 0; ok && y < size_y; y += tile_size)
+    {
+      for (unsigned int x = 0; ok && x < size_x; x += tile_size)
+      {
+        uint32_t length;
+        ok = readValue(fp, &length, sizeof(length)) && length <= 2 * tile_size * tile_size;
+        if (!ok)
+          break;
+        runs.resize(length);
+        ok = length == 0 || fread(&runs[0], 1, length, fp) == length;
+        if (ok && target)
+          ok = decodeTile(runs, &costs[0], size_x, x, y, std::min(tile_size, size_x - x),
+                          std::min(tile_size, size_y - y));
+      }
+    }
+    if (ok && target)
+    {
+      decoded.push_back(std::make_pair(target, std::vector<unsigned char>()));
+      decoded.back().second.swap(costs);
+    }
+  }
+  fclose(fp);
+  if (!ok)
+    return false;
+
+  for (unsigned int i = 0; i < decoded.size(); ++i)
+  {
+    Costmap2D* target = decoded[i].first;
+    boost::unique_lock<mutex_t> lock(*(target->getMutex()));
+    if (target == this)
+      default_value_ = default_value;
+    target->resizeMap(size_x, size_y, geometry[0], geometry[1], geometry[2]);
+    if (!decoded[i].second.empty())
+      memcpy(target->costmap_, &decoded[i].second[0], decoded[i].second.size());
+  }
+  return true;
+}
+
 }  // namespace costmap_2d
@@ -0,0 +1,370 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * Times the pieces of a costmap update on synthetic maps and scans, at several map sizes and
+ * resolutions:
+ *
+ *   make costmap_2d_benchmark
+ *   rosrun costmap_2d costmap_2d_benchmark [filter] [min_seconds]
+ *
+ * Only the cases whose name contains filter are run, each for at least min_seconds (0.5 by default).
+ * It needs a master, as the layers read their parameters and the static layer subscribes to the
+ * map the benchmark publishes.
+ */
+#include <ros/ros.h>
+#include <costmap_2d/layered_costmap.h>
+#include <costmap_2d/static_layer.h>
+#include <costmap_2d/obstacle_layer.h>
+#include <costmap_2d/voxel_layer.h>
+#include <costmap_2d/inflation_layer.h>
+#include <costmap_2d/blocked_costmap.h>
+#include <costmap_2d/costmap_2d_publisher.h>
+#include <costmap_2d/footprint.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <tf/transform_listener.h>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace costmap_2d;
+
+namespace
+{
+
+std::string g_filter;
+double g_min_time = 0.5;
+
+/**
+ * @brief Run op until it has taken at least g_min_time, and print the time per call.
+ */
+void runBenchmark(const std::string& name, const boost::function<void()>& op)
+{
+  if (name.find(g_filter) == std::string::npos)
+    return;
+
+  // once untimed, so that caches and scratch buffers are warm
+  op();
+
+  unsigned long iterations = 1;
+  double elapsed;
+  while (true)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    for (unsigned long i = 0; i < iterations; ++i)
+      op();
+    elapsed = (ros::WallTime::now() - start).toSec();
+    if (elapsed >= g_min_time || iterations >= 1000000000ul)
+      break;
+
+    // aim a little past the minimum time for the next try
+    double factor = elapsed > 0 ? 1.2 * g_min_time / elapsed : 1000.0;
+    iterations = (unsigned long)(iterations * std::min(std::max(factor, 2.0), 1000.0));
+  }
+  printf("%-56s %14.0f ns %12lu\n", name.c_str(), elapsed / iterations * 1e9, iterations);
+  fflush(stdout);
+}
+
+/**
+ * @brief A map of size x size cells with walls around it, and boxes and unknown patches strewn over it.
+ */
+nav_msgs::OccupancyGrid makeMap(unsigned int size, double resolution)
+{
+  nav_msgs::OccupancyGrid map;
+  map.header.frame_id = "map";
+  map.header.stamp = ros::Time::now();
+  map.info.resolution = resolution;
+  map.info.width = map.info.height = size;
+  map.info.origin.orientation.w = 1.0;
+  map.data.assign(size * size, 0);
+
+  srand(size);
+  for (unsigned int i = 0; i < size; ++i)
+  {
+    map.data[i] = map.data[(size - 1) * size + i] = 100;
+    map.data[i * size] = map.data[i * size + size - 1] = 100;
+  }
+  for (unsigned int n = 0; n < size / 4; ++n)
+  {
+    unsigned int x = rand() % size, y = rand() % size, w = 1 + rand() % 20, h = 1 + rand() % 20;
+    int8_t value = n % 8 == 0 ? -1 : 100;
+    for (unsigned int j = y; j < std::min(size, y + h); ++j)
+      for (unsigned int i = x; i < std::min(size, x + w); ++i)
+        map.data[j * size + i] = value;
+  }
+  return map;
+}
+
+/**
+ * @brief What a 720 beam scanner in the middle of a room 8 m across would see, at a height of 0.5 m.
+ */
+Observation makeScan(double x, double y)
+{
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.points.resize(720);
+  for (unsigned int i = 0; i < cloud.points.size(); ++i)
+  {
+    double angle = 2 * M_PI * i / cloud.points.size();
+    double range = 4.0 + 0.5 * sin(7 * angle);
+    cloud.points[i].x = x + range * cos(angle);
+    cloud.points[i].y = y + range * sin(angle);
+    cloud.points[i].z = 0.5;
+  }
+
+  geometry_msgs::Point origin;
+  origin.x = x;
+  origin.y = y;
+  origin.z = 0.5;
+  return Observation(origin, cloud, 5.0, 6.0);
+}
+
+std::vector<geometry_msgs::Point> makeFootprint()
+{
+  std::vector<geometry_msgs::Point> footprint(4);
+  footprint[0].x = 0.35;
+  footprint[0].y = 0.25;
+  footprint[1].x = 0.35;
+  footprint[1].y = -0.25;
+  footprint[2].x = -0.35;
+  footprint[2].y = -0.25;
+  footprint[3].x = -0.35;
+  footprint[3].y = 0.25;
+  return footprint;
+}
+
+/**
+ * @brief A static, obstacle (or voxel) and inflation layer over the current map.
+ */
+class Stack
+{
+public:
+  Stack(tf::TransformListener& tf, bool voxels, double robot_x, double robot_y) :
+      layers_("map", false, true), robot_x_(robot_x), robot_y_(robot_y), yaw_(0.0)
+  {
+    StaticLayer* slayer = new StaticLayer();
+    layers_.addPlugin(boost::shared_ptr<Layer>(slayer));
+    slayer->initialize(&layers_, "static", &tf);
+
+    ObstacleLayer* olayer = voxels ? new VoxelLayer() : new ObstacleLayer();
+    olayer->initialize(&layers_, voxels ? "voxels" : "obstacles", &tf);
+    layers_.addPlugin(boost::shared_ptr<Layer>(olayer));
+    Observation scan = makeScan(robot_x, robot_y);
+    olayer->addStaticObservation(scan, true, true);
+
+    InflationLayer* ilayer = new InflationLayer();
+    ilayer->initialize(&layers_, "inflation", &tf);
+    layers_.addPlugin(boost::shared_ptr<Layer>(ilayer));
+
+    layers_.setFootprint(makeFootprint());
+    layers_.updateMap(robot_x_, robot_y_, yaw_);
+  }
+
+  void updateMap()
+  {
+    // turn on the spot, so that the footprint moves but the scan does not
+    yaw_ += 0.01;
+    layers_.updateMap(robot_x_, robot_y_, yaw_);
+  }
+
+  LayeredCostmap layers_;
+  double robot_x_, robot_y_, yaw_;
+};
+
+void shiftOrigin(Costmap2D* costmap, int* step)
+{
+  double shift = ((*step)++ % 2 ? -3 : 3) * costmap->getResolution();
+  costmap->updateOrigin(costmap->getOriginX() + shift, costmap->getOriginY() + shift);
+}
+
+void copyWindow(Costmap2D* window, const Costmap2D* costmap, double x, double y)
+{
+  window->copyCostmapWindow(*costmap, x - 3.0, y - 3.0, 6.0, 6.0);
+}
+
+void clearFootprint(Costmap2D* costmap, double x, double y, int* step)
+{
+  std::vector<geometry_msgs::Point> oriented_footprint;
+  transformFootprint(x, y, 0.01 * (*step)++, makeFootprint(), oriented_footprint);
+  costmap->setConvexPolygonCost(oriented_footprint, FREE_SPACE);
+}
+
+void publish(Costmap2DPublisher* publisher, unsigned int size)
+{
+  publisher->updateBounds(0, size, 0, size);
+  publisher->publishCostmap();
+}
+
+void ignoreCostmap(const nav_msgs::OccupancyGridConstPtr& grid) {}
+
+/**
+ * @brief Spread out from the lethal cells to radius cells, breadth first as inflation does, over a row-major
+ * or a blocked costmap.
+ */
+template <class Grid>
+void wavefront(const Grid* grid, unsigned char radius, std::vector<unsigned char>* distances)
+{
+  unsigned int size_x = grid->getSizeInCellsX(), size_y = grid->getSizeInCellsY();
+  const unsigned char* cells = grid->getCharMap();
+  distances->assign(grid->getIndex(size_x - 1, size_y - 1) + 1, 255);
+
+  std::vector<std::pair<unsigned int, unsigned int> > queue;
+  for (unsigned int y = 0; y < size_y; ++y)
+  {
+    for (unsigned int x = 0; x < size_x; ++x)
+    {
+      unsigned int index = grid->getIndex(x, y);
+      if (cells[index] == LETHAL_OBSTACLE)
+      {
+        (*distances)[index] = 0;
+        queue.push_back(std::make_pair(x, y));
+      }
+    }
+  }
+
+  for (size_t next = 0; next < queue.size(); ++next)
+  {
+    unsigned int x = queue[next].first, y = queue[next].second;
+    unsigned char distance = (*distances)[grid->getIndex(x, y)] + 1;
+    if (distance > radius)
+      continue;
+    const int dx[] = { -1, 1, 0, 0 }, dy[] = { 0, 0, -1, 1 };
+    for (unsigned int n = 0; n < 4; ++n)
+    {
+      unsigned int nx = x + dx[n], ny = y + dy[n];
+      if (nx >= size_x || ny >= size_y)
+        continue;
+      unsigned char& seen = (*distances)[grid->getIndex(nx, ny)];
+      if (seen != 255)
+        continue;
+      seen = distance;
+      queue.push_back(std::make_pair(nx, ny));
+    }
+  }
+}
+
+/**
+ * @brief Walk up every seventh column, as a raytrace along y would.
+ */
+template <class Grid>
+void walkColumns(const Grid* grid, unsigned int* sum)
+{
+  const unsigned char* cells = grid->getCharMap();
+  for (unsigned int x = 0; x < grid->getSizeInCellsX(); x += 7)
+    for (unsigned int y = 0; y < grid->getSizeInCellsY(); ++y)
+      *sum += cells[grid->getIndex(x, y)];
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "costmap_2d_benchmark");
+  if (argc > 1)
+    g_filter = argv[1];
+  if (argc > 2)
+    g_min_time = atof(argv[2]);
+
+  ros::NodeHandle nh;
+  tf::TransformListener tf(ros::Duration(10));
+  ros::Publisher map_pub = nh.advertise<nav_msgs::OccupancyGrid>("map", 1, true);
+
+  printf("%-56s %17s %12s\n", "Benchmark", "Time", "Iterations");
+
+  const double sizes[] = { 10.0, 50.0, 100.0 };
+  const double resolutions[] = { 0.05, 0.025 };
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && nh.ok(); ++s)
+  {
+    for (unsigned int r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]) && nh.ok(); ++r)
+    {
+      unsigned int cells = (unsigned int)(sizes[s] / resolutions[r]);
+      char suffix[64];
+      snprintf(suffix, sizeof(suffix), "/%ux%u@%.3f", cells, cells, resolutions[r]);
+      std::string size_name(suffix);
+
+      // the static layers pick this up as they start
+      map_pub.publish(makeMap(cells, resolutions[r]));
+      double x = sizes[s] / 2, y = sizes[s] / 2;
+
+      {
+        Stack stack(tf, false, x, y);
+        runBenchmark("updateMap/obstacle" + size_name, boost::bind(&Stack::updateMap, &stack));
+      }
+      {
+        Stack stack(tf, true, x, y);
+        runBenchmark("updateMap/voxel" + size_name, boost::bind(&Stack::updateMap, &stack));
+
+        Costmap2D costmap(*stack.layers_.getCostmap());
+        int step = 0;
+        runBenchmark("updateOrigin" + size_name, boost::bind(&shiftOrigin, &costmap, &step));
+
+        Costmap2D window;
+        runBenchmark("copyCostmapWindow/6m" + size_name, boost::bind(&copyWindow, &window, &costmap, x, y));
+
+        // the same walks over the row-major and the blocked layout
+        BlockedCostmap blocked(costmap);
+        std::vector<unsigned char> distances;
+        unsigned int sum = 0;
+        runBenchmark("layout/wavefront/row_major" + size_name,
+                     boost::bind(&wavefront<Costmap2D>, &costmap, 10, &distances));
+        runBenchmark("layout/wavefront/blocked" + size_name,
+                     boost::bind(&wavefront<BlockedCostmap>, &blocked, 10, &distances));
+        runBenchmark("layout/columns/row_major" + size_name, boost::bind(&walkColumns<Costmap2D>, &costmap, &sum));
+        runBenchmark("layout/columns/blocked" + size_name,
+                     boost::bind(&walkColumns<BlockedCostmap>, &blocked, &sum));
+        runBenchmark("layout/rebuild/blocked" + size_name,
+                     boost::bind(&BlockedCostmap::rebuild, &blocked, boost::cref(costmap)));
+
+        step = 0;
+        runBenchmark("setConvexPolygonCost/footprint" + size_name,
+                     boost::bind(&clearFootprint, &costmap, x, y, &step));
+
+        ros::NodeHandle private_nh("~");
+        Costmap2DPublisher publisher(&private_nh, &costmap, "map", "costmap", true);
+        ros::Subscriber sub = private_nh.subscribe("costmap", 1, &ignoreCostmap);
+        // publishCostmap() does nothing until someone listens
+        ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(2.0);
+        while (sub.getNumPublishers() == 0 && ros::WallTime::now() < deadline)
+          ros::WallDuration(0.01).sleep();
+        runBenchmark("publishCostmap/full" + size_name, boost::bind(&publish, &publisher, cells));
+      }
+    }
+  }
+  return 0;
+}
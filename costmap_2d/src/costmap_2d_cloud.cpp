@@ -26,37 +26,75 @@
  */
 
 #include <ros/ros.h>
-#include <sensor_msgs/PointCloud.h>
+#include <sensor_msgs/PointCloud2.h>
 #include <costmap_2d/VoxelGrid.h>
 #include <voxel_grid/voxel_grid.h>
+#include <vector>
 
-static inline void mapToWorld3D(const unsigned int mx, const unsigned int my, const unsigned int mz,
-                                      const double origin_x, const double origin_y, const double origin_z,
-                                      const double x_resolution, const double y_resolution, const double z_resolution,
-                                      double& wx, double& wy, double& wz)
+float g_colors_r[] = {0.0f, 0.0f, 1.0f};
+float g_colors_g[] = {0.0f, 0.0f, 0.0f};
+float g_colors_b[] = {0.0f, 1.0f, 0.0f};
+float g_colors_a[] = {0.0f, 0.5f, 1.0f};
+
+// the clouds are kept from one grid to the next, so their buffers only get allocated when they grow
+sensor_msgs::PointCloud2 g_marked;
+sensor_msgs::PointCloud2 g_unknown;
+
+// x, y and z floats followed by the color packed into a float
+void initCloud(sensor_msgs::PointCloud2& cloud)
 {
-  // returns the center point of the cell
-  wx = origin_x + (mx + 0.5) * x_resolution;
-  wy = origin_y + (my + 0.5) * y_resolution;
-  wz = origin_z + (mz + 0.5) * z_resolution;
+  const char* names[] = {"x", "y", "z", "rgb"};
+  cloud.fields.resize(4);
+  for (uint32_t i = 0; i < cloud.fields.size(); ++i)
+  {
+    cloud.fields[i].name = names[i];
+    cloud.fields[i].offset = i * sizeof(float);
+    cloud.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+    cloud.fields[i].count = 1;
+  }
+  cloud.height = 1;
+  cloud.point_step = 4 * sizeof(float);
+  cloud.is_bigendian = false;
+  cloud.is_dense = true;
 }
 
-struct Cell
+// size the clouds for the voxels of the grid and fill them in
+template <typename Column>
+void exportClouds(const Column* data, const costmap_2d::VoxelGrid& grid)
 {
-  double x;
-  double y;
-  double z;
-  voxel_grid::VoxelStatus status;
-};
-typedef std::vector<Cell> V_Cell;
+  uint32_t num_marked, num_unknown;
+  voxel_grid::VoxelGridT<Column>::countVoxels(data, grid.size_x * grid.size_y, grid.size_z, &num_marked, &num_unknown);
 
-float g_colors_r[] = {0.0f, 0.0f, 1.0f};
-float g_colors_g[] = {0.0f, 0.0f, 0.0f};
-float g_colors_b[] = {0.0f, 1.0f, 0.0f};
-float g_colors_a[] = {0.0f, 0.5f, 1.0f};
+  sensor_msgs::PointCloud2* clouds[] = {&g_marked, &g_unknown};
+  uint32_t sizes[] = {num_marked, num_unknown};
+  voxel_grid::PointBuffer buffers[2];
+  for (int c = 0; c < 2; ++c)
+  {
+    sensor_msgs::PointCloud2& cloud = *clouds[c];
+    voxel_grid::VoxelStatus status = c == 0 ? voxel_grid::MARKED : voxel_grid::UNKNOWN;
+
+    // only the points the cloud did not have yet need their color, the others keep theirs
+    uint32_t colored = cloud.data.size() / cloud.point_step;
+    cloud.data.resize(sizes[c] * cloud.point_step);
+    uint32_t r = g_colors_r[status] * 255.0;
+    uint32_t g = g_colors_g[status] * 255.0;
+    uint32_t b = g_colors_b[status] * 255.0;
+    uint32_t col = (r << 16) | (g << 8) | b;
+    for (uint32_t i = colored; i < sizes[c]; ++i)
+      memcpy(&cloud.data[i * cloud.point_step + 3 * sizeof(float)], &col, sizeof(col));
+
+    cloud.width = sizes[c];
+    cloud.row_step = cloud.width * cloud.point_step;
+    buffers[c].data = cloud.data.empty() ? NULL : &cloud.data[0];
+    buffers[c].point_step = cloud.point_step;
+    buffers[c].size = 0;
+  }
+
+  voxel_grid::VoxelGridT<Column>::exportVoxels(data, grid.size_x, grid.size_y, grid.size_z, grid.origin.x,
+                                               grid.origin.y, grid.origin.z, grid.resolutions.x, grid.resolutions.y,
+                                               grid.resolutions.z, &buffers[0], &buffers[1]);
+}
 
-V_Cell g_marked;
-V_Cell g_unknown;
 void voxelCallback(const ros::Publisher& pub_marked, const ros::Publisher& pub_unknown,
                    const costmap_2d::VoxelGridConstPtr& grid)
 {
@@ -69,124 +107,36 @@ void voxelCallback(const ros::Publisher& pub_marked, const ros::Publisher& pub_u
   ros::WallTime start = ros::WallTime::now();
 
   ROS_DEBUG("Received voxel grid");
-  const std::string frame_id = grid->header.frame_id;
-  const ros::Time stamp = grid->header.stamp;
   const uint32_t* data = &grid->data.front();
-  const double x_origin = grid->origin.x;
-  const double y_origin = grid->origin.y;
-  const double z_origin = grid->origin.z;
-  const double x_res = grid->resolutions.x;
-  const double y_res = grid->resolutions.y;
-  const double z_res = grid->resolutions.z;
   const uint32_t x_size = grid->size_x;
   const uint32_t y_size = grid->size_y;
   const uint32_t z_size = grid->size_z;
 
-  g_marked.clear();
-  g_unknown.clear();
-  uint32_t num_marked = 0;
-  uint32_t num_unknown = 0;
-  for (uint32_t y_grid = 0; y_grid < y_size; ++y_grid)
+  // columns of more than 16 voxels come as two words each, see VoxelGrid.msg
+  if (z_size > voxel_grid::VoxelGrid::LEVELS)
   {
-    for (uint32_t x_grid = 0; x_grid < x_size; ++x_grid)
+    if (grid->data.size() < 2 * x_size * y_size)
     {
-      for (uint32_t z_grid = 0; z_grid < z_size; ++z_grid)
-      {
-        voxel_grid::VoxelStatus status = voxel_grid::VoxelGrid::getVoxel(x_grid, y_grid, z_grid, x_size, y_size, z_size,
-                                                                         data);
-
-        if (status == voxel_grid::UNKNOWN)
-        {
-          Cell c;
-          c.status = status;
-          mapToWorld3D(x_grid, y_grid, z_grid, x_origin, y_origin, z_origin, x_res, y_res,
-                                                   z_res, c.x, c.y, c.z);
-
-          g_unknown.push_back(c);
-
-          ++num_unknown;
-        }
-        else if (status == voxel_grid::MARKED)
-        {
-          Cell c;
-          c.status = status;
-          mapToWorld3D(x_grid, y_grid, z_grid, x_origin, y_origin, z_origin, x_res, y_res,
-                                                   z_res, c.x, c.y, c.z);
-
-          g_marked.push_back(c);
-
-          ++num_marked;
-        }
-      }
+      ROS_ERROR("Received voxel grid with too few columns");
+      return;
     }
+    std::vector<uint64_t> wide_data(x_size * y_size);
+    for (uint32_t i = 0; i < wide_data.size(); ++i)
+      wide_data[i] = data[2 * i] | (uint64_t(data[2 * i + 1]) << 32);
+    exportClouds(&wide_data[0], *grid);
   }
-
+  else
   {
-    sensor_msgs::PointCloud cloud;
-    cloud.points.resize(num_marked);
-    cloud.channels.resize(1);
-    cloud.channels[0].values.resize(num_marked);
-    cloud.channels[0].name = "rgb";
-    cloud.header.frame_id = frame_id;
-    cloud.header.stamp = stamp;
-
-    sensor_msgs::ChannelFloat32& chan = cloud.channels[0];
-    for (uint32_t i = 0; i < num_marked; ++i)
-    {
-      geometry_msgs::Point32& p = cloud.points[i];
-      float& cval = chan.values[i];
-      Cell& c = g_marked[i];
-
-      p.x = c.x;
-      p.y = c.y;
-      p.z = c.z;
-
-      uint32_t r = g_colors_r[c.status] * 255.0;
-      uint32_t g = g_colors_g[c.status] * 255.0;
-      uint32_t b = g_colors_b[c.status] * 255.0;
-      // uint32_t a = g_colors_a[c.status] * 255.0;
-
-      uint32_t col = (r << 16) | (g << 8) | b;
-      cval = *reinterpret_cast<float*>(&col);
-    }
-
-    pub_marked.publish(cloud);
+    exportClouds(data, *grid);
   }
 
-  {
-    sensor_msgs::PointCloud cloud;
-    cloud.points.resize(num_unknown);
-    cloud.channels.resize(1);
-    cloud.channels[0].values.resize(num_unknown);
-    cloud.channels[0].name = "rgb";
-    cloud.header.frame_id = frame_id;
-    cloud.header.stamp = stamp;
-
-    sensor_msgs::ChannelFloat32& chan = cloud.channels[0];
-    for (uint32_t i = 0; i < num_unknown; ++i)
-    {
-      geometry_msgs::Point32& p = cloud.points[i];
-      float& cval = chan.values[i];
-      Cell& c = g_unknown[i];
-
-      p.x = c.x;
-      p.y = c.y;
-      p.z = c.z;
-
-      uint32_t r = g_colors_r[c.status] * 255.0;
-      uint32_t g = g_colors_g[c.status] * 255.0;
-      uint32_t b = g_colors_b[c.status] * 255.0;
-      // uint32_t a = g_colors_a[c.status] * 255.0;
-
-      uint32_t col = (r << 16) | (g << 8) | b;
-      cval = *reinterpret_cast<float*>(&col);
-    }
-
-    pub_unknown.publish(cloud);
-  }
+  g_marked.header = grid->header;
+  g_unknown.header = grid->header;
+  pub_marked.publish(g_marked);
+  pub_unknown.publish(g_unknown);
 
   ros::WallTime end = ros::WallTime::now();
-  ROS_DEBUG("Published %d points in %f seconds", num_marked + num_unknown, (end - start).toSec());
+  ROS_DEBUG("Published %d points in %f seconds", g_marked.width + g_unknown.width, (end - start).toSec());
 }
 
 int main(int argc, char** argv)
@@ -196,8 +146,11 @@ int main(int argc, char** argv)
 
   ROS_DEBUG("Startup");
 
-  ros::Publisher pub_marked = n.advertise < sensor_msgs::PointCloud > ("voxel_marked_cloud", 2);
-  ros::Publisher pub_unknown = n.advertise < sensor_msgs::PointCloud > ("voxel_unknown_cloud", 2);
+  initCloud(g_marked);
+  initCloud(g_unknown);
+
+  ros::Publisher pub_marked = n.advertise < sensor_msgs::PointCloud2 > ("voxel_marked_cloud", 2);
+  ros::Publisher pub_unknown = n.advertise < sensor_msgs::PointCloud2 > ("voxel_unknown_cloud", 2);
   ros::Subscriber sub = n.subscribe < costmap_2d::VoxelGrid
       > ("voxel_grid", 1, boost::bind(voxelCallback, pub_marked, pub_unknown, _1));
 
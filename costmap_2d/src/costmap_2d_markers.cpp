@@ -39,7 +39,10 @@
 #include <ros/ros.h>
 #include <visualization_msgs/MarkerArray.h>
 #include <costmap_2d/VoxelGrid.h>
+#include <costmap_2d/VoxelGridUpdate.h>
 #include <voxel_grid/voxel_grid.h>
+#include <algorithm>
+#include <vector>
 
 struct Cell
 {
@@ -57,17 +60,11 @@ float g_colors_a[] = {0.0f, 0.5f, 1.0f};
 
 std::string g_marker_ns;
 V_Cell g_cells;
-void voxelCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPtr& grid)
+costmap_2d::VoxelGrid g_grid;  // the last full grid, with the updates since applied
+void publishMarkers(const ros::Publisher& pub, const costmap_2d::VoxelGrid* grid)
 {
-  if (grid->data.empty())
-  {
-    ROS_ERROR("Received empty voxel grid");
-    return;
-  }
-
   ros::WallTime start = ros::WallTime::now();
 
-  ROS_DEBUG("Received voxel grid");
   const std::string frame_id = grid->header.frame_id;
   const ros::Time stamp = grid->header.stamp;
   const uint32_t* data = &grid->data.front();
@@ -81,6 +78,21 @@ void voxelCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPt
   const uint32_t y_size = grid->size_y;
   const uint32_t z_size = grid->size_z;
 
+  // columns of more than 16 voxels come as two words each, see VoxelGrid.msg
+  const bool wide = z_size > voxel_grid::VoxelGrid::LEVELS;
+  std::vector<uint64_t> wide_data;
+  if (wide)
+  {
+    if (grid->data.size() < 2 * x_size * y_size)
+    {
+      ROS_ERROR("Received voxel grid with too few columns");
+      return;
+    }
+    wide_data.resize(x_size * y_size);
+    for (uint32_t i = 0; i < wide_data.size(); ++i)
+      wide_data[i] = data[2 * i] | (uint64_t(data[2 * i + 1]) << 32);
+  }
+
   g_cells.clear();
   uint32_t num_markers = 0;
   for (uint32_t y_grid = 0; y_grid < y_size; ++y_grid)
@@ -89,8 +101,9 @@ void voxelCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPt
     {
       for (uint32_t z_grid = 0; z_grid < z_size; ++z_grid)
       {
-        voxel_grid::VoxelStatus status = voxel_grid::VoxelGrid::getVoxel(x_grid, y_grid, z_grid, x_size, y_size, z_size,
-                                                                         data);
+        voxel_grid::VoxelStatus status = wide ?
+            voxel_grid::VoxelGrid64::getVoxel(x_grid, y_grid, z_grid, x_size, y_size, z_size, &wide_data[0]) :
+            voxel_grid::VoxelGrid::getVoxel(x_grid, y_grid, z_grid, x_size, y_size, z_size, data);
 
         if (status == voxel_grid::MARKED)
         {
@@ -138,6 +151,71 @@ void voxelCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPt
   ROS_DEBUG("Published %d markers in %f seconds", num_markers, (end - start).toSec());
 }
 
+void voxelCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPtr& grid)
+{
+  if (grid->data.empty())
+  {
+    ROS_ERROR("Received empty voxel grid");
+    return;
+  }
+
+  ROS_DEBUG("Received voxel grid");
+  g_grid = *grid;
+  publishMarkers(pub, &g_grid);
+}
+
+void voxelUpdateCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridUpdateConstPtr& update)
+{
+  // updates before the first full grid have nothing to apply to
+  if (g_grid.data.empty())
+    return;
+
+  const uint32_t words = g_grid.size_z > voxel_grid::VoxelGrid::LEVELS ? 2 : 1;
+  if ((update->shift_x != 0 || update->shift_y != 0) && g_grid.data.size() >= g_grid.size_x * g_grid.size_y * words)
+  {
+    // move the grid as the layer did, the columns uncovered becoming unknown
+    const uint64_t unknown = words == 2 ? voxel_grid::VoxelGrid64::unknownColumn()
+                                        : voxel_grid::VoxelGrid::unknownColumn();
+    std::vector<uint32_t> shifted(g_grid.data.size());
+    for (uint32_t y = 0; y < g_grid.size_y; ++y)
+    {
+      for (uint32_t x = 0; x < g_grid.size_x; ++x)
+      {
+        int64_t src_x = int64_t(x) + update->shift_x, src_y = int64_t(y) + update->shift_y;
+        uint32_t* dst = &shifted[(y * g_grid.size_x + x) * words];
+        if (src_x < 0 || src_y < 0 || src_x >= g_grid.size_x || src_y >= g_grid.size_y)
+        {
+          dst[0] = uint32_t(unknown);
+          if (words == 2)
+            dst[1] = uint32_t(unknown >> 32);
+        }
+        else
+          std::copy(&g_grid.data[(src_y * g_grid.size_x + src_x) * words],
+                    &g_grid.data[(src_y * g_grid.size_x + src_x) * words] + words, dst);
+      }
+    }
+    g_grid.data.swap(shifted);
+    g_grid.origin = update->origin;
+  }
+
+  if (update->x < 0 || update->y < 0 || update->x + update->width > g_grid.size_x
+      || update->y + update->height > g_grid.size_y || update->data.size() < update->width * update->height * words)
+  {
+    ROS_WARN("Received voxel grid update outside of the grid, waiting for the next full grid");
+    return;
+  }
+
+  ROS_DEBUG("Received voxel grid update");
+  for (uint32_t y = 0; y < update->height; ++y)
+  {
+    std::vector<uint32_t>::const_iterator row = update->data.begin() + y * update->width * words;
+    std::copy(row, row + update->width * words,
+              g_grid.data.begin() + ((update->y + y) * g_grid.size_x + update->x) * words);
+  }
+  g_grid.header.stamp = update->header.stamp;
+  publishMarkers(pub, &g_grid);
+}
+
 int main(int argc, char** argv)
 {
   ros::init(argc, argv, "costmap_2d_markers");
@@ -147,6 +225,8 @@ int main(int argc, char** argv)
 
   ros::Publisher pub = n.advertise < visualization_msgs::Marker > ("visualization_marker", 1);
   ros::Subscriber sub = n.subscribe < costmap_2d::VoxelGrid > ("voxel_grid", 1, boost::bind(voxelCallback, pub, _1));
+  ros::Subscriber update_sub = n.subscribe < costmap_2d::VoxelGridUpdate
+      > ("voxel_grid_updates", 10, boost::bind(voxelUpdateCallback, pub, _1));
   g_marker_ns = n.resolveName("voxel_grid");
 
   ros::spin();
@@ -35,14 +35,25 @@
  * Author: Eitan Marder-Eppstein
  *         David V. Lu!!
  *********************************************************************/
+#include <cstring>
 #include <boost/bind.hpp>
 #include <costmap_2d/costmap_2d_publisher.h>
 #include <costmap_2d/cost_values.h>
+#include <nav_executor/kernels.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PUBLISHER_KERNEL_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
 
 namespace costmap_2d
 {
 
 char* Costmap2DPublisher::cost_translation_table_ = NULL;
+const unsigned int Costmap2DPublisher::TILE_SIZE;
+const unsigned int Costmap2DPublisher::MAX_UPDATES;
 
 Costmap2DPublisher::Costmap2DPublisher(ros::NodeHandle * ros_node, Costmap2D* costmap, std::string global_frame,
                                        std::string topic_name, bool always_send_full_costmap) :
@@ -51,7 +62,7 @@ Costmap2DPublisher::Costmap2DPublisher(ros::NodeHandle * ros_node, Costmap2D* co
 {
   costmap_pub_ = ros_node->advertise<nav_msgs::OccupancyGrid>(topic_name, 1,
                                                     boost::bind(&Costmap2DPublisher::onNewSubscription, this, _1));
-  costmap_update_pub_ = ros_node->advertise<map_msgs::OccupancyGridUpdate>(topic_name + "_updates", 1);
+  costmap_update_pub_ = ros_node->advertise<map_msgs::OccupancyGridUpdate>(topic_name + "_updates", MAX_UPDATES);
 
   if (cost_translation_table_ == NULL)
   {
@@ -82,38 +93,275 @@ Costmap2DPublisher::~Costmap2DPublisher()
 
 void Costmap2DPublisher::onNewSubscription(const ros::SingleSubscriberPublisher& pub)
 {
-  prepareGrid();
-  pub.publish(grid_);
+  // the existing subscribers keep getting updates against what they were last sent, so
+  // the new one gets its own copy of the map
+  nav_msgs::OccupancyGrid grid;
+  std::vector<unsigned char> costs;
+  {
+    boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_->getMutex()));
+    fillGridInfo(grid, costs);
+  }
+  grid.data.resize(costs.size());
+  translateCosts(&costs[0], &grid.data[0], costs.size());
+  pub.publish(grid);
 }
 
-// prepare grid_ message for publication.
-void Costmap2DPublisher::prepareGrid()
+void Costmap2DPublisher::fillGridInfo(nav_msgs::OccupancyGrid& grid, std::vector<unsigned char>& costs)
 {
-  boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_->getMutex()));
   double resolution = costmap_->getResolution();
 
-  grid_.header.frame_id = global_frame_;
-  grid_.header.stamp = ros::Time::now();
-  grid_.info.resolution = resolution;
+  grid.header.frame_id = global_frame_;
+  grid.header.stamp = ros::Time::now();
+  grid.info.resolution = resolution;
 
-  grid_.info.width = costmap_->getSizeInCellsX();
-  grid_.info.height = costmap_->getSizeInCellsY();
+  grid.info.width = costmap_->getSizeInCellsX();
+  grid.info.height = costmap_->getSizeInCellsY();
 
   double wx, wy;
   costmap_->mapToWorld(0, 0, wx, wy);
-  grid_.info.origin.position.x = wx - resolution / 2;
-  grid_.info.origin.position.y = wy - resolution / 2;
-  grid_.info.origin.position.z = 0.0;
-  grid_.info.origin.orientation.w = 1.0;
-  saved_origin_x_ = costmap_->getOriginX();
-  saved_origin_y_ = costmap_->getOriginY();
-
-  grid_.data.resize(grid_.info.width * grid_.info.height);
+  grid.info.origin.position.x = wx - resolution / 2;
+  grid.info.origin.position.y = wy - resolution / 2;
+  grid.info.origin.position.z = 0.0;
+  grid.info.origin.orientation.w = 1.0;
 
   unsigned char* data = costmap_->getCharMap();
-  for (unsigned int i = 0; i < grid_.data.size(); i++)
+  costs.assign(data, data + grid.info.width * grid.info.height);
+}
+
+// prepare grid_ message for publication.
+void Costmap2DPublisher::prepareGrid()
+{
+  {
+    boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_->getMutex()));
+    fillGridInfo(grid_, published_);
+    saved_origin_x_ = costmap_->getOriginX();
+    saved_origin_y_ = costmap_->getOriginY();
+  }
+  snapshot_.resize(published_.size());
+  grid_.data.resize(published_.size());
+  translateCosts(&published_[0], &grid_.data[0], published_.size());
+}
+
+bool Costmap2DPublisher::takeSnapshot(unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn)
+{
+  // the map may have been resized since the checks done without the lock
+  unsigned int size_x = grid_.info.width;
+  if (costmap_->getSizeInCellsX() != size_x || costmap_->getSizeInCellsY() != grid_.info.height)
+    return false;
+
+  x0 -= x0 % TILE_SIZE;
+  y0 -= y0 % TILE_SIZE;
+  xn = std::min(xn, size_x);
+  yn = std::min(yn, grid_.info.height);
+  if (x0 >= xn || y0 >= yn)
+    return true;
+
+  xn = std::min(xn + (TILE_SIZE - xn % TILE_SIZE) % TILE_SIZE, size_x);
+  yn = std::min(yn + (TILE_SIZE - yn % TILE_SIZE) % TILE_SIZE, grid_.info.height);
+  const unsigned char* costs = costmap_->getCharMap();
+  if (x0 == 0 && xn == size_x)
+  {
+    memcpy(&snapshot_[y0 * size_x], costs + y0 * size_x, (yn - y0) * size_x);
+    return true;
+  }
+  for (unsigned int y = y0; y < yn; ++y)
+  {
+    memcpy(&snapshot_[y * size_x + x0], costs + y * size_x + x0, xn - x0);
+  }
+  return true;
+}
+
+void Costmap2DPublisher::findDirtyRegions(unsigned int x0, unsigned int xn, unsigned int y0, unsigned int yn,
+                                          std::vector<Region>& regions)
+{
+  unsigned int size_x = grid_.info.width;
+  unsigned int size_y = grid_.info.height;
+  xn = std::min(xn, size_x);
+  yn = std::min(yn, size_y);
+  regions.clear();
+  if (x0 >= xn || y0 >= yn)
+    return;
+
+  unsigned int tx0 = x0 / TILE_SIZE, txn = (xn + TILE_SIZE - 1) / TILE_SIZE;
+  unsigned int ty0 = y0 / TILE_SIZE, tyn = (yn + TILE_SIZE - 1) / TILE_SIZE;
+
+  // regions that reached the previous row of tiles, which are grown when this row has a run
+  // of dirty tiles spanning the same columns
+  std::vector<size_t> open, still_open;
+  for (unsigned int ty = ty0; ty < tyn; ++ty)
+  {
+    unsigned int cy0 = ty * TILE_SIZE, cyn = std::min(cy0 + TILE_SIZE, size_y);
+    still_open.clear();
+    for (unsigned int tx = tx0; tx < txn; ++tx)
+    {
+      if (!isTileDirty(tx, ty))
+        continue;
+      unsigned int run_start = tx;
+      while (tx + 1 < txn && isTileDirty(tx + 1, ty))
+        ++tx;
+
+      Region run;
+      run.x0 = run_start * TILE_SIZE;
+      run.xn = std::min((tx + 1) * TILE_SIZE, size_x);
+      run.y0 = cy0;
+      run.yn = cyn;
+
+      size_t i = 0;
+      while (i < open.size() && (regions[open[i]].x0 != run.x0 || regions[open[i]].xn != run.xn))
+        ++i;
+      if (i < open.size())
+      {
+        regions[open[i]].yn = run.yn;
+        still_open.push_back(open[i]);
+      }
+      else
+      {
+        still_open.push_back(regions.size());
+        regions.push_back(run);
+      }
+    }
+    open.swap(still_open);
+  }
+}
+
+bool Costmap2DPublisher::isTileDirty(unsigned int tx, unsigned int ty)
+{
+  unsigned int size_x = grid_.info.width;
+  unsigned int x0 = tx * TILE_SIZE, xn = std::min(x0 + TILE_SIZE, size_x);
+  unsigned int y0 = ty * TILE_SIZE, yn = std::min(y0 + TILE_SIZE, grid_.info.height);
+  const unsigned char* costs = &snapshot_[0];
+  for (unsigned int y = y0; y < yn; ++y)
   {
-    grid_.data[i] = cost_translation_table_[ data[ i ]];
+    unsigned int index = y * size_x + x0;
+    if (memcmp(costs + index, &published_[index], xn - x0) != 0)
+      return true;
+  }
+  return false;
+}
+
+void Costmap2DPublisher::translateRegion(const Region& region, int8_t* data, unsigned int data_size_x)
+{
+  unsigned int size_x = grid_.info.width;
+  unsigned int width = region.xn - region.x0;
+  for (unsigned int y = region.y0; y < region.yn; ++y)
+  {
+    unsigned int index = y * size_x + region.x0;
+    translateCosts(&snapshot_[index], data + (y - region.y0) * data_size_x, width);
+    memcpy(&published_[index], &snapshot_[index], width);
+  }
+}
+
+#ifdef __SSE2__
+// The costs of translateCosts() from i on, 16 at a time, returning the first cost left
+static inline unsigned int translateCostsSse2(const unsigned char* costs, int8_t* data, unsigned int n, unsigned int i)
+{
+  // the regular costs are scaled as in the table, 1 + (97 * (cost - 1)) / 251, with the
+  // division done as a multiply by 2^22 / 251 (exact over this range) and a shift; the
+  // special values are then blended in
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i scale = _mm_set1_epi16(97);
+  const __m128i inverse = _mm_set1_epi16(16711);
+  const __m128i inscribed = _mm_set1_epi8(static_cast<char>(INSCRIBED_INFLATED_OBSTACLE));
+  const __m128i lethal = _mm_set1_epi8(static_cast<char>(LETHAL_OBSTACLE));
+  const __m128i unknown = _mm_set1_epi8(static_cast<char>(NO_INFORMATION));
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(costs + i));
+    __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(cost, zero), one);
+    __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(cost, zero), one);
+    lo = _mm_add_epi16(_mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(lo, scale), inverse), 6), one);
+    hi = _mm_add_epi16(_mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(hi, scale), inverse), 6), one);
+    __m128i value = _mm_packus_epi16(lo, hi);
+
+    __m128i is_free = _mm_cmpeq_epi8(cost, zero);
+    __m128i is_inscribed = _mm_cmpeq_epi8(cost, inscribed);
+    __m128i is_lethal = _mm_cmpeq_epi8(cost, lethal);
+    __m128i is_unknown = _mm_cmpeq_epi8(cost, unknown);
+    __m128i special = _mm_or_si128(_mm_or_si128(is_free, is_inscribed), _mm_or_si128(is_lethal, is_unknown));
+    value = _mm_andnot_si128(special, value);
+    value = _mm_or_si128(value, _mm_and_si128(is_inscribed, _mm_set1_epi8(99)));
+    value = _mm_or_si128(value, _mm_and_si128(is_lethal, _mm_set1_epi8(100)));
+    value = _mm_or_si128(value, is_unknown);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), value);
+  }
+  return i;
+}
+#endif
+
+#if PUBLISHER_KERNEL_AVX2
+// The same 32 at a time, run only where the CPU has AVX2.  The unpacks and the pack work within each 128 bit
+// half, so the costs come out in order.
+__attribute__((target("avx2"))) static unsigned int translateCostsAvx2(const unsigned char* costs, int8_t* data,
+                                                                       unsigned int n)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i scale = _mm256_set1_epi16(97);
+  const __m256i inverse = _mm256_set1_epi16(16711);
+  const __m256i inscribed = _mm256_set1_epi8(static_cast<char>(INSCRIBED_INFLATED_OBSTACLE));
+  const __m256i lethal = _mm256_set1_epi8(static_cast<char>(LETHAL_OBSTACLE));
+  const __m256i unknown = _mm256_set1_epi8(static_cast<char>(NO_INFORMATION));
+  unsigned int i = 0;
+  for (; i + 32 <= n; i += 32)
+  {
+    __m256i cost = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(costs + i));
+    __m256i lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(cost, zero), one);
+    __m256i hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(cost, zero), one);
+    lo = _mm256_add_epi16(_mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_mullo_epi16(lo, scale), inverse), 6), one);
+    hi = _mm256_add_epi16(_mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_mullo_epi16(hi, scale), inverse), 6), one);
+    __m256i value = _mm256_packus_epi16(lo, hi);
+
+    __m256i is_free = _mm256_cmpeq_epi8(cost, zero);
+    __m256i is_inscribed = _mm256_cmpeq_epi8(cost, inscribed);
+    __m256i is_lethal = _mm256_cmpeq_epi8(cost, lethal);
+    __m256i is_unknown = _mm256_cmpeq_epi8(cost, unknown);
+    __m256i special = _mm256_or_si256(_mm256_or_si256(is_free, is_inscribed), _mm256_or_si256(is_lethal, is_unknown));
+    value = _mm256_andnot_si256(special, value);
+    value = _mm256_or_si256(value, _mm256_and_si256(is_inscribed, _mm256_set1_epi8(99)));
+    value = _mm256_or_si256(value, _mm256_and_si256(is_lethal, _mm256_set1_epi8(100)));
+    value = _mm256_or_si256(value, is_unknown);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), value);
+  }
+  return translateCostsSse2(costs, data, n, i);
+}
+#endif
+
+// The variant of translateCosts() for this CPU, picked on first use
+static nav_executor::KernelVariant translateKernel()
+{
+  unsigned int compiled = 0;
+#ifdef __SSE2__
+  compiled |= nav_executor::kernelBit(nav_executor::KERNEL_SSE2);
+#endif
+#if PUBLISHER_KERNEL_AVX2
+  compiled |= nav_executor::kernelBit(nav_executor::KERNEL_AVX2);
+#endif
+  static const nav_executor::KernelVariant variant = nav_executor::selectKernel("costmap_2d/publish", compiled);
+  return variant;
+}
+
+void Costmap2DPublisher::translateCosts(const unsigned char* costs, int8_t* data, unsigned int n)
+{
+  unsigned int i = 0;
+  switch (translateKernel())
+  {
+#if PUBLISHER_KERNEL_AVX2
+    case nav_executor::KERNEL_AVX2:
+      i = translateCostsAvx2(costs, data, n);
+      break;
+#endif
+#ifdef __SSE2__
+    case nav_executor::KERNEL_SSE2:
+      i = translateCostsSse2(costs, data, n, 0);
+      break;
+#endif
+    default:
+      break;
+  }
+  for (; i < n; i++)
+  {
+    data[i] = cost_translation_table_[ costs[ i ]];
   }
 }
 
@@ -127,38 +375,75 @@ void Costmap2DPublisher::publishCostmap()
 
   float resolution = costmap_->getResolution();
 
-  if (always_send_full_costmap_ || grid_.info.resolution != resolution ||
+  bool full = grid_.info.resolution != resolution ||
       grid_.info.width != costmap_->getSizeInCellsX() ||
       grid_.info.height != costmap_->getSizeInCellsY() ||
       saved_origin_x_ != costmap_->getOriginX() ||
-      saved_origin_y_ != costmap_->getOriginY())
+      saved_origin_y_ != costmap_->getOriginY() ||
+      published_.size() != grid_.data.size();
+
+  // only hold the lock while copying the costs; they are compared and translated after
+  if (!full && (always_send_full_costmap_ || x0_ < xn_))
+  {
+    boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_->getMutex()));
+    if (always_send_full_costmap_)
+      full = !takeSnapshot(0, grid_.info.width, 0, grid_.info.height);
+    else
+      full = !takeSnapshot(x0_, xn_, y0_, yn_);
+  }
+
+  if (full)
   {
     prepareGrid();
     costmap_pub_.publish(grid_);
   }
+  else if (always_send_full_costmap_)
+  {
+    // only translate the tiles that changed, but still send the whole grid; the whole map
+    // is compared so that changes outside the reported bounds are not missed
+    std::vector<Region> regions;
+    findDirtyRegions(0, grid_.info.width, 0, grid_.info.height, regions);
+    for (unsigned int i = 0; i < regions.size(); ++i)
+    {
+      translateRegion(regions[i], &grid_.data[regions[i].y0 * grid_.info.width + regions[i].x0], grid_.info.width);
+    }
+    grid_.header.stamp = ros::Time::now();
+    costmap_pub_.publish(grid_);
+  }
   else if (x0_ < xn_)
   {
-    boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_->getMutex()));
-    // Publish Just an Update
-    map_msgs::OccupancyGridUpdate update;
-    update.header.stamp = ros::Time::now();
-    update.header.frame_id = global_frame_;
-    update.x = x0_;
-    update.y = y0_;
-    update.width = xn_ - x0_;
-    update.height = yn_ - y0_;
-    update.data.resize(update.width * update.height);
-
-    unsigned int i = 0;
-    for (unsigned int y = y0_; y < yn_; y++)
+    std::vector<Region> regions;
+    findDirtyRegions(x0_, xn_, y0_, yn_, regions);
+
+    // too many messages risk being dropped from the publisher queue, so past that send a
+    // single update covering them all
+    if (regions.size() > MAX_UPDATES)
     {
-      for (unsigned int x = x0_; x < xn_; x++)
+      Region bounds = regions[0];
+      for (unsigned int i = 1; i < regions.size(); ++i)
       {
-        unsigned char cost = costmap_->getCost(x, y);
-        update.data[i++] = cost_translation_table_[ cost ];
+        bounds.x0 = std::min(bounds.x0, regions[i].x0);
+        bounds.xn = std::max(bounds.xn, regions[i].xn);
+        bounds.y0 = std::min(bounds.y0, regions[i].y0);
+        bounds.yn = std::max(bounds.yn, regions[i].yn);
       }
+      regions.assign(1, bounds);
+    }
+
+    // Publish Just the Updates
+    for (unsigned int i = 0; i < regions.size(); ++i)
+    {
+      map_msgs::OccupancyGridUpdate update;
+      update.header.stamp = ros::Time::now();
+      update.header.frame_id = global_frame_;
+      update.x = regions[i].x0;
+      update.y = regions[i].y0;
+      update.width = regions[i].xn - regions[i].x0;
+      update.height = regions[i].yn - regions[i].y0;
+      update.data.resize(update.width * update.height);
+      translateRegion(regions[i], &update.data[0], update.width);
+      costmap_update_pub_.publish(update);
     }
-    costmap_update_pub_.publish(update);
   }
 
   xn_ = yn_ = 0;
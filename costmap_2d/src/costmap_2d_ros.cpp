@@ -37,6 +37,8 @@
  *********************************************************************/
 #include <costmap_2d/layered_costmap.h>
 #include <costmap_2d/costmap_2d_ros.h>
+#include <nav_executor/lockstep.h>
+#include <boost/scoped_ptr.hpp>
 #include <cstdio>
 #include <string>
 #include <algorithm>
@@ -60,9 +62,11 @@ void move_parameter(ros::NodeHandle& old_h, ros::NodeHandle& new_h, std::string
 }
 
 Costmap2DROS::Costmap2DROS(std::string name, tf::TransformListener& tf) :
-    layered_costmap_(NULL), name_(name), tf_(tf), stop_updates_(false), initialized_(true), stopped_(false),
+    layered_costmap_(NULL), name_(name), tf_(tf), pose_cache_time_(0.0), stop_updates_(false), initialized_(true), stopped_(false),
     robot_stopped_(false), map_update_thread_(NULL), last_publish_(0),
-    plugin_loader_("costmap_2d", "costmap_2d::Layer"), publisher_(NULL)
+    plugin_loader_("costmap_2d", "costmap_2d::Layer"), publisher_(NULL), stats_publisher_(NULL),
+    pyramid_(NULL), cspace_(NULL), shared_publisher_(NULL), event_driven_(false),
+    max_update_staleness_(0.0), throttle_frequency_(0.0), stationary_update_frequency_(0.0), snapshots_enabled_(false)
 {
   ros::NodeHandle private_nh("~/" + name);
   ros::NodeHandle g_nh;
@@ -105,6 +109,36 @@ Costmap2DROS::Costmap2DROS(std::string name, tf::TransformListener& tf) :
   private_nh.param("always_send_full_costmap", always_send_full_costmap, false);
 
   layered_costmap_ = new LayeredCostmap(global_frame_, rolling_window, track_unknown_space);
+  layered_costmap_->getCostmap()->setMemoryComponent(name + "/master");
+
+  // optionally update the tile-safe layers in tiles, on several threads
+  int tile_size, tile_threads;
+  private_nh.param("tile_size", tile_size, 0);
+  private_nh.param("tile_threads", tile_threads, 0);
+  if (tile_size > 0)
+  {
+    if (tile_threads <= 0)
+      tile_threads = boost::thread::hardware_concurrency();
+    layered_costmap_->setTiling(tile_size, tile_threads);
+  }
+
+  // optionally run the bounds of independent layers, e.g. several obstacle layers, on several threads
+  bool parallel_bounds;
+  private_nh.param("parallel_bounds", parallel_bounds, false);
+  if (parallel_bounds)
+    layered_costmap_->setParallelBounds(boost::thread::hardware_concurrency());
+
+  // optionally keep coarser copies of the master costmap, e.g. for coarse-to-fine planning
+  int pyramid_levels;
+  private_nh.param("pyramid_levels", pyramid_levels, 0);
+  if (pyramid_levels > 0)
+    pyramid_ = new CostmapPyramid(pyramid_levels);
+
+  // optionally keep, for each of a number of headings, the cells the footprint collides on
+  int cspace_headings;
+  private_nh.param("cspace_headings", cspace_headings, 0);
+  if (cspace_headings > 0)
+    cspace_ = new ConfigurationSpace(cspace_headings);
 
   if (!private_nh.hasParam("plugins"))
   {
@@ -123,6 +157,11 @@ Costmap2DROS::Costmap2DROS(std::string name, tf::TransformListener& tf) :
 
       boost::shared_ptr<Layer> plugin = plugin_loader_.createInstance(type);
       layered_costmap_->addPlugin(plugin);
+
+      // the grid of a costmap layer counts under the layer's name
+      Costmap2D* grid = dynamic_cast<Costmap2D*>(plugin.get());
+      if (grid)
+        grid->setMemoryComponent(name + "/" + pname);
       plugin->initialize(layered_costmap_, name + "/" + pname, &tf_);
     }
   }
@@ -146,10 +185,23 @@ Costmap2DROS::Costmap2DROS(std::string name, tf::TransformListener& tf) :
   footprint_pub_ = private_nh.advertise<geometry_msgs::PolygonStamped>("footprint", 1);
 
   setUnpaddedRobotFootprint(makeFootprintFromParams(private_nh));
+  check_footprints_srv_ = private_nh.advertiseService("check_footprints", &Costmap2DROS::checkFootprintsService, this);
 
   publisher_ = new Costmap2DPublisher(&private_nh, layered_costmap_->getCostmap(), global_frame_, "costmap",
                                       always_send_full_costmap);
 
+  // optionally share the master costmap with other processes on this host, see SharedCostmapReader
+  std::string shared_memory_name;
+  private_nh.param("shared_memory_name", shared_memory_name, std::string(""));
+  if (!shared_memory_name.empty())
+    shared_publisher_ = new SharedCostmapPublisher(layered_costmap_->getCostmap(), global_frame_,
+                                                   shared_memory_name);
+
+  int update_stats_window;
+  private_nh.param("update_stats_window", update_stats_window, 100);
+  stats_publisher_ = new UpdateStatsPublisher(&private_nh, layered_costmap_, "update_stats",
+                                              std::max(update_stats_window, 1));
+
   // create a thread to handle updating the map
   stop_updates_ = false;
   initialized_ = true;
@@ -180,6 +232,14 @@ Costmap2DROS::~Costmap2DROS()
   }
   if (publisher_ != NULL)
     delete publisher_;
+  if (stats_publisher_ != NULL)
+    delete stats_publisher_;
+  if (pyramid_ != NULL)
+    delete pyramid_;
+  if (cspace_ != NULL)
+    delete cspace_;
+  if (shared_publisher_ != NULL)
+    delete shared_publisher_;
 
   delete layered_costmap_;
   delete dsrv_;
@@ -261,6 +321,7 @@ void Costmap2DROS::resetOldParameters(ros::NodeHandle& nh)
 void Costmap2DROS::reconfigureCB(costmap_2d::Costmap2DConfig &config, uint32_t level)
 {
   transform_tolerance_ = config.transform_tolerance;
+  pose_cache_time_ = config.robot_pose_cache_time;
   if (map_update_thread_ != NULL)
   {
     map_update_thread_shutdown_ = true;
@@ -269,6 +330,9 @@ void Costmap2DROS::reconfigureCB(costmap_2d::Costmap2DConfig &config, uint32_t l
   }
   map_update_thread_shutdown_ = false;
   double map_update_frequency = config.update_frequency;
+  event_driven_ = config.event_driven;
+  max_update_staleness_ = config.max_update_staleness;
+  stationary_update_frequency_ = config.stationary_update_frequency;
 
   double map_publish_frequency = config.publish_frequency;
   if (map_publish_frequency > 0)
@@ -341,6 +405,45 @@ void Costmap2DROS::setUnpaddedRobotFootprint(const std::vector<geometry_msgs::Po
   padFootprint(padded_footprint_, footprint_padding_);
 
   layered_costmap_->setFootprint(padded_footprint_);
+  boost::unique_lock<Costmap2D::mutex_t> lock(*(layered_costmap_->getCostmap()->getMutex()));
+  if (cspace_ != NULL)
+    cspace_->setFootprint(padded_footprint_);
+  footprint_checker_.setFootprint(padded_footprint_);
+}
+
+void Costmap2DROS::checkFootprints(const std::vector<geometry_msgs::Pose2D>& poses,
+                                   const std::vector<std::vector<geometry_msgs::Point> >& footprints,
+                                   double max_clearance, std::vector<FootprintCheck>* results)
+{
+  Costmap2D* master = layered_costmap_->getCostmap();
+  boost::unique_lock<Costmap2D::mutex_t> lock(*(master->getMutex()));
+  footprint_checker_.check(*master, poses, footprints, max_clearance, results);
+}
+
+bool Costmap2DROS::checkFootprintsService(CheckFootprints::Request& req, CheckFootprints::Response& resp)
+{
+  if (!req.footprints.empty() && req.footprints.size() != req.poses.size())
+  {
+    ROS_ERROR("check_footprints was given %u footprints for %u poses", (unsigned int)req.footprints.size(),
+              (unsigned int)req.poses.size());
+    return false;
+  }
+  std::vector<std::vector<geometry_msgs::Point> > footprints(req.footprints.size());
+  for (unsigned int i = 0; i < req.footprints.size(); ++i)
+    footprints[i] = toPointVector(req.footprints[i]);
+
+  std::vector<FootprintCheck> results;
+  checkFootprints(req.poses, footprints, req.max_clearance, &results);
+  resp.max_costs.resize(results.size());
+  resp.lethal.resize(results.size());
+  resp.clearances.resize(results.size());
+  for (unsigned int i = 0; i < results.size(); ++i)
+  {
+    resp.max_costs[i] = results[i].max_cost;
+    resp.lethal[i] = results[i].lethal;
+    resp.clearances[i] = results[i].clearance;
+  }
+  return true;
 }
 
 void Costmap2DROS::movementCB(const ros::TimerEvent &event)
@@ -377,19 +480,55 @@ void Costmap2DROS::mapUpdateLoop(double frequency)
 
   ros::NodeHandle nh;
   ros::Rate r(frequency);
+  last_update_time_ = ros::Time(0);
+  last_update_pose_.setIdentity();
+  last_map_update_ = ros::Time(0);
+
+  // paced by the ticks of a lockstep stepper instead, one update per tick
+  boost::scoped_ptr<nav_executor::Lockstep::Loop> lockstep_loop;
+  if (nav_executor::Lockstep* lockstep = nav_executor::Lockstep::shared())
+    lockstep_loop.reset(new nav_executor::Lockstep::Loop(lockstep, name_ + "/update", nav_executor::PHASE_COSTMAP));
+
   while (nh.ok() && !map_update_thread_shutdown_)
   {
+    if (lockstep_loop)
+    {
+      if (!lockstep_loop->wait(&map_update_thread_shutdown_))
+        break;
+    }
+    // keep waking at the full rate, so that lifting the throttle takes effect within a cycle
+    else if (updatesThrottled())
+    {
+      r.sleep();
+      continue;
+    }
+    else if (event_driven_ && !waitForUpdate(1 / frequency))
+      continue;
+
     struct timeval start, end;
     double start_t, end_t, t_diff;
     gettimeofday(&start, NULL);
 
     updateMap();
+    last_map_update_ = ros::Time::now();
+    if (snapshots_enabled_)
+      updateSnapshot();
 
     gettimeofday(&end, NULL);
     start_t = start.tv_sec + double(start.tv_usec) / 1e6;
     end_t = end.tv_sec + double(end.tv_usec) / 1e6;
     t_diff = end_t - start_t;
     ROS_DEBUG("Map update time: %.9f", t_diff);
+    if (layered_costmap_->isInitialized())
+      stats_publisher_->publishStats();
+    if (shared_publisher_ != NULL && layered_costmap_->isInitialized())
+    {
+      // shared readers get every update, not just those at the publish frequency
+      unsigned int x0, y0, xn, yn;
+      layered_costmap_->getBounds(&x0, &xn, &y0, &yn);
+      shared_publisher_->updateBounds(x0, xn, y0, yn);
+      shared_publisher_->publish(ros::Time::now().toSec());
+    }
     if (publish_cycle.toSec() > 0 && layered_costmap_->isInitialized())
     {
       unsigned int x0, y0, xn, yn;
@@ -403,14 +542,81 @@ void Costmap2DROS::mapUpdateLoop(double frequency)
         last_publish_ = now;
       }
     }
+
+    // waitForUpdate() keeps the pace in the event driven mode, and the stepper in lockstep
+    if (event_driven_ || lockstep_loop)
+      continue;
+
     r.sleep();
     // make sure to sleep for the remainder of our cycle time
     if (r.cycleTime() > ros::Duration(1 / frequency))
+    {
       ROS_WARN("Map update loop missed its desired rate of %.4fHz... the loop actually took %.4f seconds", frequency,
                r.cycleTime().toSec());
+      logSlowestLayer();
+    }
   }
 }
 
+bool Costmap2DROS::updatesThrottled()
+{
+  double frequency = throttle_frequency_;
+  if (robot_stopped_ && stationary_update_frequency_ > 0
+      && (frequency <= 0 || stationary_update_frequency_ < frequency))
+    frequency = stationary_update_frequency_;
+  if (frequency <= 0 || last_map_update_.isZero())
+    return false;
+  return ros::Time::now() - last_map_update_ < ros::Duration(1 / frequency);
+}
+
+void Costmap2DROS::logSlowestLayer()
+{
+  const std::vector<LayerUpdateStats>& stats = layered_costmap_->getLayerUpdateStats();
+  std::vector<boost::shared_ptr<Layer> >* plugins = layered_costmap_->getPlugins();
+  unsigned int slowest = 0;
+  for (unsigned int i = 1; i < stats.size(); ++i)
+  {
+    if (stats[i].bounds_time + stats[i].costs_time > stats[slowest].bounds_time + stats[slowest].costs_time)
+      slowest = i;
+  }
+  if (slowest >= stats.size() || slowest >= plugins->size())
+    return;
+
+  ROS_WARN("The slowest layer was %s, with %.4f seconds in updateBounds() and %.4f in updateCosts(); "
+           "the update waited %.4f seconds for the costmap lock", (*plugins)[slowest]->getName().c_str(),
+           stats[slowest].bounds_time, stats[slowest].costs_time, layered_costmap_->getLockWaitTime());
+}
+
+bool Costmap2DROS::waitForUpdate(double period)
+{
+  // run no more often than update_frequency
+  ros::Duration since_update = ros::Time::now() - last_update_time_;
+  if (since_update < ros::Duration(period))
+    (ros::Duration(period) - since_update).sleep();
+
+  // wait for data for up to one cycle, then look at whether the robot moved
+  bool update = layered_costmap_->waitForUpdateRequest(period);
+
+  tf::Stamped < tf::Pose > pose;
+  bool got_pose = getRobotPose(pose);
+  if (got_pose && (fabs((last_update_pose_.getOrigin() - pose.getOrigin()).length()) >= 1e-3
+      || fabs(last_update_pose_.getRotation().angle(pose.getRotation())) >= 1e-3))
+    update = true;
+
+  ros::Time now = ros::Time::now();
+  if (last_update_time_.isZero()
+      || (max_update_staleness_ > 0 && now - last_update_time_ >= ros::Duration(max_update_staleness_)))
+    update = true;
+
+  if (update)
+  {
+    last_update_time_ = now;
+    if (got_pose)
+      last_update_pose_ = pose;
+  }
+  return update;
+}
+
 void Costmap2DROS::updateMap()
 {
   if (!stop_updates_)
@@ -424,6 +630,21 @@ void Costmap2DROS::updateMap()
              yaw = tf::getYaw(pose.getRotation());
 
       layered_costmap_->updateMap(x, y, yaw);
+      if (pyramid_ != NULL)
+      {
+        boost::unique_lock<Costmap2D::mutex_t> lock(*(layered_costmap_->getCostmap()->getMutex()));
+        pyramid_->update(*layered_costmap_);
+      }
+      if (cspace_ != NULL)
+      {
+        boost::unique_lock<Costmap2D::mutex_t> lock(*(layered_costmap_->getCostmap()->getMutex()));
+        cspace_->update(*layered_costmap_);
+      }
+      {
+        boost::unique_lock<Costmap2D::mutex_t> lock(*(layered_costmap_->getCostmap()->getMutex()));
+        for (unsigned int i = 0; i < update_callbacks_.size(); ++i)
+          update_callbacks_[i](*layered_costmap_);
+      }
 
       geometry_msgs::PolygonStamped footprint;
       footprint.header.frame_id = global_frame_;
@@ -436,6 +657,59 @@ void Costmap2DROS::updateMap()
   }
 }
 
+void Costmap2DROS::addUpdateCallback(const boost::function<void(LayeredCostmap&)>& callback)
+{
+  boost::unique_lock<Costmap2D::mutex_t> lock(*(layered_costmap_->getCostmap()->getMutex()));
+  update_callbacks_.push_back(callback);
+}
+
+boost::shared_ptr<const Costmap2D> Costmap2DROS::getCostmapSnapshot()
+{
+  {
+    boost::mutex::scoped_lock lock(snapshot_mutex_);
+    if (snapshot_)
+      return snapshot_;
+  }
+
+  // the updater only starts copying once asked to, so take the first copy here
+  boost::shared_ptr<Costmap2D> snapshot;
+  {
+    boost::unique_lock<Costmap2D::mutex_t> lock(*(layered_costmap_->getCostmap()->getMutex()));
+    snapshot.reset(new Costmap2D(*layered_costmap_->getCostmap()));
+  }
+
+  boost::mutex::scoped_lock lock(snapshot_mutex_);
+  if (!snapshot_)
+    snapshot_ = snapshot;
+  snapshots_enabled_ = true;
+  return snapshot_;
+}
+
+void Costmap2DROS::updateSnapshot()
+{
+  // reuse the copy from two updates ago unless a reader still holds on to it
+  boost::shared_ptr<Costmap2D> snapshot;
+  {
+    boost::mutex::scoped_lock lock(snapshot_mutex_);
+    if (spare_snapshot_ && spare_snapshot_.unique())
+      snapshot.swap(spare_snapshot_);
+    spare_snapshot_.reset();
+  }
+
+  Costmap2D* master = layered_costmap_->getCostmap();
+  {
+    boost::unique_lock<Costmap2D::mutex_t> lock(*(master->getMutex()));
+    if (snapshot)
+      *snapshot = *master;
+    else
+      snapshot.reset(new Costmap2D(*master));
+  }
+
+  boost::mutex::scoped_lock lock(snapshot_mutex_);
+  spare_snapshot_.swap(snapshot_);
+  snapshot_ = snapshot;
+}
+
 void Costmap2DROS::start()
 {
   std::vector < boost::shared_ptr<Layer> > *plugins = layered_costmap_->getPlugins();
@@ -499,16 +773,40 @@ void Costmap2DROS::resetLayers()
   {
     (*plugin)->reset();
   }
+  layered_costmap_->forceFullUpdate();
+  if (pyramid_ != NULL)
+  {
+    boost::unique_lock<Costmap2D::mutex_t> lock(*(top->getMutex()));
+    pyramid_->rebuild(*top);
+  }
+  if (cspace_ != NULL)
+  {
+    boost::unique_lock<Costmap2D::mutex_t> lock(*(top->getMutex()));
+    cspace_->rebuild(*top);
+  }
+  layered_costmap_->requestUpdate();
 }
 
 bool Costmap2DROS::getRobotPose(tf::Stamped<tf::Pose>& global_pose) const
 {
+  ros::Time current_time = ros::Time::now();  // save time for checking tf delay later
+  double cache_time = pose_cache_time_;
+  if (cache_time > 0)
+  {
+    boost::mutex::scoped_lock lock(pose_cache_mutex_);
+    if (!cached_pose_time_.isZero() && current_time >= cached_pose_time_
+        && current_time - cached_pose_time_ < ros::Duration(cache_time))
+    {
+      global_pose = cached_pose_;
+      return true;
+    }
+  }
+
   global_pose.setIdentity();
   tf::Stamped < tf::Pose > robot_pose;
   robot_pose.setIdentity();
   robot_pose.frame_id_ = robot_base_frame_;
   robot_pose.stamp_ = ros::Time();
-  ros::Time current_time = ros::Time::now();  // save time for checking tf delay later
 
   // get the global pose of the robot
   try
@@ -539,6 +837,12 @@ bool Costmap2DROS::getRobotPose(tf::Stamped<tf::Pose>& global_pose) const
     return false;
   }
 
+  if (cache_time > 0)
+  {
+    boost::mutex::scoped_lock lock(pose_cache_mutex_);
+    cached_pose_ = global_pose;
+    cached_pose_time_ = current_time;
+  }
   return true;
 }
 
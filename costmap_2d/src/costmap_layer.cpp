@@ -1,4 +1,14 @@
 #include<costmap_2d/costmap_layer.h>
+#include <nav_executor/kernels.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// built with a target attribute, and run only where the CPU has it
+#define COSTMAP_KERNEL_AVX2 1
+#define COSTMAP_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
 
 namespace costmap_2d
 {
@@ -43,9 +53,228 @@ void CostmapLayer::useExtraBounds(double* min_x, double* min_y, double* max_x, d
     has_extra_bounds_ = false;
 }
 
+#ifdef __SSE2__
+// a where mask is set, b elsewhere
+static inline __m128i blend(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// stores the 16 cells unless they already hold them
+static inline void storeChanged(unsigned char* master, __m128i old_cost, __m128i cost)
+{
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(old_cost, cost)) != 0xffff)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(master), cost);
+}
+
+// the rows from cell i on, 16 cells at a time, returning the first cell left
+static inline unsigned int maxRowSse2(unsigned char* master, const unsigned char* layer, unsigned int n,
+                                      unsigned int i)
+{
+  const __m128i unknown = _mm_set1_epi8(static_cast<char>(NO_INFORMATION));
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer + i));
+    __m128i old_cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(master + i));
+    __m128i merged = blend(_mm_cmpeq_epi8(old_cost, unknown), cost, _mm_max_epu8(old_cost, cost));
+    storeChanged(master + i, old_cost, blend(_mm_cmpeq_epi8(cost, unknown), old_cost, merged));
+  }
+  return i;
+}
+
+static inline unsigned int overwriteRowSse2(unsigned char* master, const unsigned char* layer, unsigned int n,
+                                            unsigned int i)
+{
+  const __m128i unknown = _mm_set1_epi8(static_cast<char>(NO_INFORMATION));
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer + i));
+    __m128i old_cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(master + i));
+    storeChanged(master + i, old_cost, blend(_mm_cmpeq_epi8(cost, unknown), old_cost, cost));
+  }
+  return i;
+}
+
+static inline unsigned int additionRowSse2(unsigned char* master, const unsigned char* layer, unsigned int n,
+                                           unsigned int i)
+{
+  // a sum that saturates is at least INSCRIBED_INFLATED_OBSTACLE too, so it is capped the same
+  const __m128i unknown = _mm_set1_epi8(static_cast<char>(NO_INFORMATION));
+  const __m128i cap = _mm_set1_epi8(static_cast<char>(INSCRIBED_INFLATED_OBSTACLE - 1));
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer + i));
+    __m128i old_cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(master + i));
+    __m128i sum = _mm_min_epu8(_mm_adds_epu8(old_cost, cost), cap);
+    __m128i merged = blend(_mm_cmpeq_epi8(old_cost, unknown), cost, sum);
+    storeChanged(master + i, old_cost, blend(_mm_cmpeq_epi8(cost, unknown), old_cost, merged));
+  }
+  return i;
+}
+#endif
+
+#if COSTMAP_KERNEL_AVX2
+// the same 32 cells at a time, leaving the rest to the SSE2 loops
+COSTMAP_AVX2 static inline void storeChangedAvx2(unsigned char* master, __m256i old_cost, __m256i cost)
+{
+  if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(old_cost, cost)) != -1)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(master), cost);
+}
+
+COSTMAP_AVX2 static unsigned int maxRowAvx2(unsigned char* master, const unsigned char* layer, unsigned int n)
+{
+  const __m256i unknown = _mm256_set1_epi8(static_cast<char>(NO_INFORMATION));
+  unsigned int i = 0;
+  for (; i + 32 <= n; i += 32)
+  {
+    __m256i cost = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(layer + i));
+    __m256i old_cost = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(master + i));
+    __m256i merged = _mm256_blendv_epi8(_mm256_max_epu8(old_cost, cost), cost, _mm256_cmpeq_epi8(old_cost, unknown));
+    storeChangedAvx2(master + i, old_cost, _mm256_blendv_epi8(merged, old_cost, _mm256_cmpeq_epi8(cost, unknown)));
+  }
+  return maxRowSse2(master, layer, n, i);
+}
+
+COSTMAP_AVX2 static unsigned int overwriteRowAvx2(unsigned char* master, const unsigned char* layer, unsigned int n)
+{
+  const __m256i unknown = _mm256_set1_epi8(static_cast<char>(NO_INFORMATION));
+  unsigned int i = 0;
+  for (; i + 32 <= n; i += 32)
+  {
+    __m256i cost = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(layer + i));
+    __m256i old_cost = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(master + i));
+    storeChangedAvx2(master + i, old_cost, _mm256_blendv_epi8(cost, old_cost, _mm256_cmpeq_epi8(cost, unknown)));
+  }
+  return overwriteRowSse2(master, layer, n, i);
+}
+
+COSTMAP_AVX2 static unsigned int additionRowAvx2(unsigned char* master, const unsigned char* layer, unsigned int n)
+{
+  const __m256i unknown = _mm256_set1_epi8(static_cast<char>(NO_INFORMATION));
+  const __m256i cap = _mm256_set1_epi8(static_cast<char>(INSCRIBED_INFLATED_OBSTACLE - 1));
+  unsigned int i = 0;
+  for (; i + 32 <= n; i += 32)
+  {
+    __m256i cost = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(layer + i));
+    __m256i old_cost = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(master + i));
+    __m256i sum = _mm256_min_epu8(_mm256_adds_epu8(old_cost, cost), cap);
+    __m256i merged = _mm256_blendv_epi8(sum, cost, _mm256_cmpeq_epi8(old_cost, unknown));
+    storeChangedAvx2(master + i, old_cost, _mm256_blendv_epi8(merged, old_cost, _mm256_cmpeq_epi8(cost, unknown)));
+  }
+  return additionRowSse2(master, layer, n, i);
+}
+#endif
+
+// the variant of the row kernels for this CPU, picked on first use
+static nav_executor::KernelVariant rowKernel()
+{
+  unsigned int compiled = 0;
+#ifdef __SSE2__
+  compiled |= nav_executor::kernelBit(nav_executor::KERNEL_SSE2);
+#endif
+#if COSTMAP_KERNEL_AVX2
+  compiled |= nav_executor::kernelBit(nav_executor::KERNEL_AVX2);
+#endif
+  static const nav_executor::KernelVariant variant = nav_executor::selectKernel("costmap_2d/combine_rows", compiled);
+  return variant;
+}
+
+void CostmapLayer::maxRow(unsigned char* master, const unsigned char* layer, unsigned int n)
+{
+  unsigned int i = 0;
+  switch (rowKernel())
+  {
+#if COSTMAP_KERNEL_AVX2
+    case nav_executor::KERNEL_AVX2:
+      i = maxRowAvx2(master, layer, n);
+      break;
+#endif
+#ifdef __SSE2__
+    case nav_executor::KERNEL_SSE2:
+      i = maxRowSse2(master, layer, n, 0);
+      break;
+#endif
+    default:
+      break;
+  }
+  for (; i < n; i++)
+  {
+    if (layer[i] == NO_INFORMATION)
+      continue;
+
+    unsigned char old_cost = master[i];
+    if (old_cost == NO_INFORMATION || old_cost < layer[i])
+      master[i] = layer[i];
+  }
+}
+
+void CostmapLayer::overwriteRow(unsigned char* master, const unsigned char* layer, unsigned int n)
+{
+  unsigned int i = 0;
+  switch (rowKernel())
+  {
+#if COSTMAP_KERNEL_AVX2
+    case nav_executor::KERNEL_AVX2:
+      i = overwriteRowAvx2(master, layer, n);
+      break;
+#endif
+#ifdef __SSE2__
+    case nav_executor::KERNEL_SSE2:
+      i = overwriteRowSse2(master, layer, n, 0);
+      break;
+#endif
+    default:
+      break;
+  }
+  for (; i < n; i++)
+  {
+    if (layer[i] != NO_INFORMATION && master[i] != layer[i])
+      master[i] = layer[i];
+  }
+}
+
+void CostmapLayer::additionRow(unsigned char* master, const unsigned char* layer, unsigned int n)
+{
+  unsigned int i = 0;
+  switch (rowKernel())
+  {
+#if COSTMAP_KERNEL_AVX2
+    case nav_executor::KERNEL_AVX2:
+      i = additionRowAvx2(master, layer, n);
+      break;
+#endif
+#ifdef __SSE2__
+    case nav_executor::KERNEL_SSE2:
+      i = additionRowSse2(master, layer, n, 0);
+      break;
+#endif
+    default:
+      break;
+  }
+  for (; i < n; i++)
+  {
+    if (layer[i] == NO_INFORMATION)
+      continue;
+
+    unsigned char old_cost = master[i], cost;
+    if (old_cost == NO_INFORMATION)
+      cost = layer[i];
+    else
+    {
+      int sum = old_cost + layer[i];
+      if (sum >= costmap_2d::INSCRIBED_INFLATED_OBSTACLE)
+          cost = costmap_2d::INSCRIBED_INFLATED_OBSTACLE - 1;
+      else
+          cost = sum;
+    }
+    if (cost != old_cost)
+      master[i] = cost;
+  }
+}
+
 void CostmapLayer::updateWithMax(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
 {
-  if (!enabled_)
+  if (!enabled_ || max_i <= min_i)
     return;
 
   unsigned char* master_array = master_grid.getCharMap();
@@ -54,18 +283,7 @@ void CostmapLayer::updateWithMax(costmap_2d::Costmap2D& master_grid, int min_i,
   for (int j = min_j; j < max_j; j++)
   {
     unsigned int it = j * span + min_i;
-    for (int i = min_i; i < max_i; i++)
-    {
-      if (costmap_[it] == NO_INFORMATION){
-        it++;
-        continue;
-      }
-
-      unsigned char old_cost = master_array[it];
-      if (old_cost == NO_INFORMATION || old_cost < costmap_[it])
-        master_array[it] = costmap_[it];
-      it++;
-    }
+    maxRow(master_array + it, costmap_ + it, max_i - min_i);
   }
 }
 
@@ -77,20 +295,20 @@ void CostmapLayer::updateWithTrueOverwrite(costmap_2d::Costmap2D& master_grid, i
   unsigned char* master = master_grid.getCharMap();
   unsigned int span = master_grid.getSizeInCellsX();
 
+  if (max_i <= min_i)
+    return;
   for (int j = min_j; j < max_j; j++)
   {
+    // rows that already match are not written, which keeps the untouched pages of a large map unallocated
     unsigned int it = span*j+min_i;
-    for (int i = min_i; i < max_i; i++)
-    {
-      master[it] = costmap_[it];
-      it++;
-    }
+    if (memcmp(master + it, costmap_ + it, max_i - min_i) != 0)
+      memcpy(master + it, costmap_ + it, max_i - min_i);
   }
 }
 
 void CostmapLayer::updateWithOverwrite(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
 {
-  if (!enabled_)
+  if (!enabled_ || max_i <= min_i)
     return;
   unsigned char* master = master_grid.getCharMap();
   unsigned int span = master_grid.getSizeInCellsX();
@@ -98,18 +316,13 @@ void CostmapLayer::updateWithOverwrite(costmap_2d::Costmap2D& master_grid, int m
   for (int j = min_j; j < max_j; j++)
   {
     unsigned int it = span*j+min_i;
-    for (int i = min_i; i < max_i; i++)
-    {
-      if (costmap_[it] != NO_INFORMATION)
-        master[it] = costmap_[it];
-      it++;
-    }
+    overwriteRow(master + it, costmap_ + it, max_i - min_i);
   }
 }
 
 void CostmapLayer::updateWithAddition(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
 {
-  if (!enabled_)
+  if (!enabled_ || max_i <= min_i)
     return;
   unsigned char* master_array = master_grid.getCharMap();
   unsigned int span = master_grid.getSizeInCellsX();
@@ -117,26 +330,7 @@ void CostmapLayer::updateWithAddition(costmap_2d::Costmap2D& master_grid, int mi
   for (int j = min_j; j < max_j; j++)
   {
     unsigned int it = j * span + min_i;
-    for (int i = min_i; i < max_i; i++)
-    {
-      if (costmap_[it] == NO_INFORMATION){
-        it++;
-        continue;
-      }
-
-      unsigned char old_cost = master_array[it];
-      if (old_cost == NO_INFORMATION)
-        master_array[it] = costmap_[it];
-      else
-      {
-        int sum = old_cost + costmap_[it];
-        if (sum >= costmap_2d::INSCRIBED_INFLATED_OBSTACLE)
-            master_array[it] = costmap_2d::INSCRIBED_INFLATED_OBSTACLE - 1;
-        else
-            master_array[it] = sum;
-      }
-      it++;
-    }
+    additionRow(master_array + it, costmap_ + it, max_i - min_i);
   }
 }
 }  // namespace costmap_2d
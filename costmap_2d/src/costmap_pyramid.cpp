@@ -0,0 +1,171 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <costmap_2d/costmap_pyramid.h>
+#include <costmap_2d/cost_values.h>
+#include <algorithm>
+
+namespace costmap_2d
+{
+
+CostmapPyramid::CostmapPyramid(unsigned int num_levels) :
+    master_origin_x_(0.0), master_origin_y_(0.0), master_resolution_(0.0), master_size_x_(0), master_size_y_(0)
+{
+  levels_.push_back(this);
+  for (unsigned int l = 1; l < num_levels; ++l)
+    levels_.push_back(new Costmap2D());
+}
+
+CostmapPyramid::~CostmapPyramid()
+{
+  for (unsigned int l = 1; l < levels_.size(); ++l)
+    delete levels_[l];
+}
+
+Costmap2D* CostmapPyramid::getLevel(unsigned int level)
+{
+  if (level == 0 || level > levels_.size())
+    return NULL;
+  return levels_[level - 1];
+}
+
+bool CostmapPyramid::matchMaster(const Costmap2D& master)
+{
+  if (master_size_x_ == master.getSizeInCellsX() && master_size_y_ == master.getSizeInCellsY() &&
+      master_resolution_ == master.getResolution() && master_origin_x_ == master.getOriginX() &&
+      master_origin_y_ == master.getOriginY())
+    return false;
+
+  master_size_x_ = master.getSizeInCellsX();
+  master_size_y_ = master.getSizeInCellsY();
+  master_resolution_ = master.getResolution();
+  master_origin_x_ = master.getOriginX();
+  master_origin_y_ = master.getOriginY();
+
+  unsigned int size_x = master_size_x_, size_y = master_size_y_;
+  double resolution = master_resolution_;
+  for (unsigned int l = 0; l < levels_.size(); ++l)
+  {
+    size_x = (size_x + 1) / 2;
+    size_y = (size_y + 1) / 2;
+    resolution *= 2;
+    levels_[l]->resizeMap(size_x, size_y, resolution, master_origin_x_, master_origin_y_);
+  }
+  return true;
+}
+
+void CostmapPyramid::rebuild(const Costmap2D& master)
+{
+  boost::unique_lock<mutex_t> lock(*getMutex());
+  matchMaster(master);
+
+  pool(master, *levels_[0], 0, master_size_x_, 0, master_size_y_);
+  for (unsigned int l = 1; l < levels_.size(); ++l)
+    pool(*levels_[l - 1], *levels_[l], 0, levels_[l - 1]->getSizeInCellsX(), 0, levels_[l - 1]->getSizeInCellsY());
+}
+
+void CostmapPyramid::update(const Costmap2D& master, unsigned int x0, unsigned int xn, unsigned int y0,
+                            unsigned int yn)
+{
+  boost::unique_lock<mutex_t> lock(*getMutex());
+  if (matchMaster(master))
+  {
+    // a new size or origin moves every cell, as with a rolling window
+    x0 = y0 = 0;
+    xn = master_size_x_;
+    yn = master_size_y_;
+  }
+
+  xn = std::min(xn, master_size_x_);
+  yn = std::min(yn, master_size_y_);
+  if (x0 >= xn || y0 >= yn)
+    return;
+
+  pool(master, *levels_[0], x0, xn, y0, yn);
+  for (unsigned int l = 1; l < levels_.size(); ++l)
+  {
+    // the cells of the level below that changed
+    x0 /= 2;
+    y0 /= 2;
+    xn = (xn + 1) / 2;
+    yn = (yn + 1) / 2;
+    pool(*levels_[l - 1], *levels_[l], x0, xn, y0, yn);
+  }
+}
+
+void CostmapPyramid::update(LayeredCostmap& layered_costmap)
+{
+  const Costmap2D& master = *layered_costmap.getCostmap();
+  const std::vector<LayeredCostmap::Region>& regions = layered_costmap.getUpdatedRegions();
+
+  boost::unique_lock<mutex_t> lock(*getMutex());
+  if (matchMaster(master))
+  {
+    update(master, 0, master_size_x_, 0, master_size_y_);
+    return;
+  }
+  for (unsigned int i = 0; i < regions.size(); ++i)
+    update(master, regions[i].x0, regions[i].xn, regions[i].y0, regions[i].yn);
+}
+
+void CostmapPyramid::pool(const Costmap2D& fine, Costmap2D& coarse, unsigned int x0, unsigned int xn,
+                          unsigned int y0, unsigned int yn)
+{
+  const unsigned char* fine_map = fine.getCharMap();
+  unsigned char* coarse_map = coarse.getCharMap();
+  unsigned int fine_size_x = fine.getSizeInCellsX(), fine_size_y = fine.getSizeInCellsY();
+  unsigned int coarse_size_x = coarse.getSizeInCellsX();
+
+  // whole 2x2 blocks, as a coarse cell depends on all four of them
+  x0 &= ~1u;
+  y0 &= ~1u;
+  for (unsigned int y = y0; y < yn; y += 2)
+  {
+    const unsigned char* row0 = fine_map + y * fine_size_x;
+    const unsigned char* row1 = y + 1 < fine_size_y ? row0 + fine_size_x : row0;
+    unsigned char* out = coarse_map + (y / 2) * coarse_size_x;
+    for (unsigned int x = x0; x < xn; x += 2)
+    {
+      unsigned int x1 = x + 1 < fine_size_x ? x + 1 : x;
+      unsigned char a = row0[x], b = row0[x1], c = row1[x], d = row1[x1];
+      unsigned char cost = std::max(std::max(a, b), std::max(c, d));
+      if (cost == NO_INFORMATION && (a == LETHAL_OBSTACLE || b == LETHAL_OBSTACLE || c == LETHAL_OBSTACLE ||
+                                     d == LETHAL_OBSTACLE))
+        cost = LETHAL_OBSTACLE;
+      out[x / 2] = cost;
+    }
+  }
+}
+
+}  // namespace costmap_2d
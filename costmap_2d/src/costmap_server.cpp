@@ -0,0 +1,262 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <costmap_2d/costmap_server.h>
+#include <costmap_2d/footprint.h>
+#include <nav_executor/lockstep.h>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace costmap_2d
+{
+
+void BaseCostmapLayer::updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds)
+{
+  boost::unique_lock<Costmap2D::mutex_t> lock(*(base_->getCostmap()->getMutex()));
+  const Costmap2D* base = base_->getCostmap();
+  Bounds box;
+  if (base->getSizeInCellsX() == 0 || base->getSizeInCellsY() == 0)
+    return;
+
+  // the bounds are cell centers, so each maps back to exactly its own cells
+  if (full_)
+  {
+    base->mapToWorld(0, 0, box.min_x, box.min_y);
+    base->mapToWorld(base->getSizeInCellsX() - 1, base->getSizeInCellsY() - 1, box.max_x, box.max_y);
+    bounds->push_back(box);
+    full_ = false;
+    return;
+  }
+
+  const std::vector<LayeredCostmap::Region>& regions = base_->getUpdatedRegions();
+  for (unsigned int i = 0; i < regions.size(); ++i)
+  {
+    base->mapToWorld(regions[i].x0, regions[i].y0, box.min_x, box.min_y);
+    base->mapToWorld(regions[i].xn - 1, regions[i].yn - 1, box.max_x, box.max_y);
+    bounds->push_back(box);
+  }
+}
+
+void BaseCostmapLayer::updateCosts(Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
+{
+  boost::unique_lock<Costmap2D::mutex_t> lock(*(base_->getCostmap()->getMutex()));
+  const Costmap2D* base = base_->getCostmap();
+  unsigned int size_x = master_grid.getSizeInCellsX();
+  if (!enabled_ || base->getSizeInCellsX() != size_x || base->getSizeInCellsY() != master_grid.getSizeInCellsY()
+      || max_i <= min_i)
+    return;
+
+  const unsigned char* source = base->getCharMap();
+  unsigned char* target = master_grid.getCharMap();
+  for (int j = min_j; j < max_j; ++j)
+    memcpy(target + j * size_x + min_i, source + j * size_x + min_i, max_i - min_i);
+}
+
+CostmapServer::CostmapServer(const std::string& name, tf::TransformListener& tf) :
+    name_(name), tf_(tf), plugin_loader_("costmap_2d", "costmap_2d::Layer"), base_(NULL), update_thread_(NULL),
+    shutdown_(false)
+{
+  ros::NodeHandle private_nh("~/" + name);
+  private_nh.param("global_frame", global_frame_, std::string("/map"));
+
+  bool track_unknown_space, always_send_full_costmap;
+  private_nh.param("track_unknown_space", track_unknown_space, false);
+  private_nh.param("always_send_full_costmap", always_send_full_costmap, false);
+
+  base_ = new LayeredCostmap(global_frame_, false, track_unknown_space);
+  ros::NodeHandle base_nh(private_nh, "base");
+  loadPlugins(base_, base_nh, name + "/base/", false);
+
+  XmlRpc::XmlRpcValue classes;
+  if (private_nh.getParam("footprint_classes", classes) && classes.getType() == XmlRpc::XmlRpcValue::TypeArray)
+  {
+    for (int32_t i = 0; i < classes.size(); ++i)
+    {
+      View view;
+      view.name = static_cast<std::string>(classes[i]);
+      ros::NodeHandle view_nh(private_nh, view.name);
+
+      view.layers = new LayeredCostmap(global_frame_, false, track_unknown_space);
+      view.layers->addPlugin(boost::shared_ptr<Layer>(new BaseCostmapLayer(base_)));
+      view.layers->getPlugins()->back()->initialize(view.layers, name + "/" + view.name + "/base", &tf_);
+      loadPlugins(view.layers, view_nh, name + "/" + view.name + "/", true);
+
+      double padding;
+      view_nh.param("footprint_padding", padding, 0.01);
+      std::vector<geometry_msgs::Point> footprint = makeFootprintFromParams(view_nh);
+      padFootprint(footprint, padding);
+      view.layers->setFootprint(footprint);
+
+      view.publisher = new Costmap2DPublisher(&view_nh, view.layers->getCostmap(), global_frame_, "costmap",
+                                              always_send_full_costmap);
+      std::string shared_memory_name;
+      view_nh.param("shared_memory_name", shared_memory_name, std::string(""));
+      view.shared_publisher = shared_memory_name.empty() ? NULL :
+          new SharedCostmapPublisher(view.layers->getCostmap(), global_frame_, shared_memory_name);
+
+      ROS_INFO("Serving the costmap of footprint class %s", view.name.c_str());
+      views_.push_back(view);
+    }
+  }
+  if (views_.empty())
+    ROS_WARN("The costmap server has no footprint_classes to serve");
+
+  double frequency, publish_frequency;
+  private_nh.param("update_frequency", frequency, 5.0);
+  private_nh.param("publish_frequency", publish_frequency, 1.0);
+  update_thread_ = new boost::thread(boost::bind(&CostmapServer::updateLoop, this, frequency, publish_frequency));
+}
+
+CostmapServer::~CostmapServer()
+{
+  shutdown_ = true;
+  if (update_thread_ != NULL)
+  {
+    update_thread_->join();
+    delete update_thread_;
+  }
+  for (unsigned int i = 0; i < views_.size(); ++i)
+  {
+    delete views_[i].publisher;
+    if (views_[i].shared_publisher != NULL)
+      delete views_[i].shared_publisher;
+    delete views_[i].layers;
+  }
+  delete base_;
+}
+
+LayeredCostmap* CostmapServer::getView(const std::string& footprint_class)
+{
+  for (unsigned int i = 0; i < views_.size(); ++i)
+  {
+    if (views_[i].name == footprint_class)
+      return views_[i].layers;
+  }
+  return NULL;
+}
+
+void CostmapServer::loadPlugins(LayeredCostmap* layers, ros::NodeHandle& nh, const std::string& prefix,
+                                bool default_inflation)
+{
+  XmlRpc::XmlRpcValue my_list;
+  if (!nh.getParam("plugins", my_list))
+  {
+    if (default_inflation)
+    {
+      boost::shared_ptr<Layer> plugin = plugin_loader_.createInstance("costmap_2d::InflationLayer");
+      layers->addPlugin(plugin);
+      plugin->initialize(layers, prefix + "inflation", &tf_);
+    }
+    return;
+  }
+
+  for (int32_t i = 0; i < my_list.size(); ++i)
+  {
+    std::string pname = static_cast<std::string>(my_list[i]["name"]);
+    std::string type = static_cast<std::string>(my_list[i]["type"]);
+    ROS_INFO("Using plugin \"%s%s\"", prefix.c_str(), pname.c_str());
+
+    boost::shared_ptr<Layer> plugin = plugin_loader_.createInstance(type);
+    layers->addPlugin(plugin);
+    plugin->initialize(layers, prefix + pname, &tf_);
+  }
+}
+
+void CostmapServer::updateMap()
+{
+  // the costmap is not rolling, so the layers need no robot pose
+  base_->updateMap(0.0, 0.0, 0.0);
+  if (!base_->isInitialized())
+    return;
+
+  Costmap2D* base = base_->getCostmap();
+  for (unsigned int i = 0; i < views_.size(); ++i)
+  {
+    LayeredCostmap* layers = views_[i].layers;
+    Costmap2D* costmap = layers->getCostmap();
+    {
+      // a view follows the size of the base, e.g. when the static layer gets a new map
+      boost::unique_lock<Costmap2D::mutex_t> lock(*(base->getMutex()));
+      if (costmap->getSizeInCellsX() != base->getSizeInCellsX() ||
+          costmap->getSizeInCellsY() != base->getSizeInCellsY() ||
+          costmap->getResolution() != base->getResolution() || costmap->getOriginX() != base->getOriginX() ||
+          costmap->getOriginY() != base->getOriginY())
+        layers->resizeMap(base->getSizeInCellsX(), base->getSizeInCellsY(), base->getResolution(),
+                          base->getOriginX(), base->getOriginY());
+    }
+    layers->updateMap(0.0, 0.0, 0.0);
+
+    unsigned int x0, xn, y0, yn;
+    layers->getBounds(&x0, &xn, &y0, &yn);
+    views_[i].publisher->updateBounds(x0, xn, y0, yn);
+    if (views_[i].shared_publisher != NULL)
+    {
+      views_[i].shared_publisher->updateBounds(x0, xn, y0, yn);
+      views_[i].shared_publisher->publish(ros::Time::now().toSec());
+    }
+  }
+}
+
+void CostmapServer::updateLoop(double frequency, double publish_frequency)
+{
+  ros::NodeHandle nh;
+  ros::Rate r(std::max(frequency, 0.01));
+  ros::Duration publish_cycle(publish_frequency > 0 ? 1.0 / publish_frequency : 0.0);
+
+  // paced by the ticks of a lockstep stepper instead, one update per tick
+  boost::scoped_ptr<nav_executor::Lockstep::Loop> lockstep_loop;
+  if (nav_executor::Lockstep* lockstep = nav_executor::Lockstep::shared())
+    lockstep_loop.reset(new nav_executor::Lockstep::Loop(lockstep, "costmap_server/update",
+                                                         nav_executor::PHASE_COSTMAP));
+
+  while (nh.ok() && !shutdown_)
+  {
+    if (lockstep_loop && !lockstep_loop->wait(&shutdown_))
+      break;
+    updateMap();
+
+    ros::Time now = ros::Time::now();
+    if (publish_frequency > 0 && last_publish_ + publish_cycle < now && base_->isInitialized())
+    {
+      for (unsigned int i = 0; i < views_.size(); ++i)
+        views_[i].publisher->publishCostmap();
+      last_publish_ = now;
+    }
+    if (!lockstep_loop)
+      r.sleep();
+  }
+}
+
+}  // namespace costmap_2d
@@ -0,0 +1,180 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <costmap_2d/footprint_checker.h>
+#include <costmap_2d/cost_values.h>
+#include <costmap_2d/costmap_math.h>
+#include <costmap_2d/footprint.h>
+#include <nav_executor/executor.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace costmap_2d
+{
+
+FootprintChecker::FootprintChecker(unsigned int num_headings) :
+    num_headings_(std::max(1u, num_headings)), templates_resolution_(0.0)
+{
+}
+
+void FootprintChecker::setFootprint(const std::vector<geometry_msgs::Point>& footprint)
+{
+  footprint_ = footprint;
+  templates_resolution_ = 0.0;
+}
+
+void FootprintChecker::check(const Costmap2D& costmap, const std::vector<geometry_msgs::Pose2D>& poses,
+                             const std::vector<std::vector<geometry_msgs::Point> >& footprints, double max_clearance,
+                             std::vector<FootprintCheck>* results)
+{
+  results->resize(poses.size());
+  if (poses.empty())
+    return;
+
+  if (templates_resolution_ != costmap.getResolution())
+  {
+    templates_resolution_ = costmap.getResolution();
+    templates_.resize(num_headings_);
+    double bin = 2 * M_PI / num_headings_;
+    for (unsigned int h = 0; h < num_headings_; ++h)
+      rasterizeFootprint(footprint_, templates_resolution_, h * bin, bin / 2, &templates_[h]);
+  }
+
+  nav_executor::Executor& executor = nav_executor::Executor::shared();
+  unsigned int num_tasks = std::min<unsigned int>(executor.size(), poses.size());
+  executor.run(nav_executor::LANE_GLOBAL_PLANNING, num_tasks,
+               boost::bind(&FootprintChecker::checkRange, this, &costmap, &poses, &footprints, max_clearance, results,
+                           num_tasks, _1));
+}
+
+void FootprintChecker::checkRange(const Costmap2D* costmap, const std::vector<geometry_msgs::Pose2D>* poses,
+                                  const std::vector<std::vector<geometry_msgs::Point> >* footprints,
+                                  double max_clearance, std::vector<FootprintCheck>* results, unsigned int num_tasks,
+                                  unsigned int task) const
+{
+  std::vector<FootprintSpan> own_spans;
+  unsigned int begin = poses->size() * task / num_tasks, end = poses->size() * (task + 1) / num_tasks;
+  for (unsigned int i = begin; i < end; ++i)
+  {
+    const geometry_msgs::Pose2D& pose = (*poses)[i];
+    if (i < footprints->size() && !(*footprints)[i].empty())
+    {
+      rasterizeFootprint((*footprints)[i], costmap->getResolution(), pose.theta, 0.0, &own_spans);
+      checkPose(*costmap, pose, (*footprints)[i], own_spans, max_clearance, &(*results)[i]);
+    }
+    else
+    {
+      int heading = (int)floor(pose.theta * num_headings_ / (2 * M_PI) + 0.5) % (int)num_headings_;
+      if (heading < 0)
+        heading += num_headings_;
+      checkPose(*costmap, pose, footprint_, templates_[heading], max_clearance, &(*results)[i]);
+    }
+  }
+}
+
+void FootprintChecker::checkPose(const Costmap2D& costmap, const geometry_msgs::Pose2D& pose,
+                                 const std::vector<geometry_msgs::Point>& footprint,
+                                 const std::vector<FootprintSpan>& spans, double max_clearance,
+                                 FootprintCheck* result)
+{
+  int size_x = costmap.getSizeInCellsX(), size_y = costmap.getSizeInCellsY();
+  const unsigned char* costs = costmap.getCharMap();
+  int cx, cy;
+  costmap.worldToMapNoBounds(pose.x, pose.y, cx, cy);
+
+  result->max_cost = FREE_SPACE;
+  result->lethal = false;
+  result->clearance = 0.0;
+  int min_x = cx, max_x = cx, min_y = cy, max_y = cy;
+  for (unsigned int s = 0; s < spans.size(); ++s)
+  {
+    int y = cy + spans[s].dy, x0 = cx + spans[s].lo, x1 = cx + spans[s].hi;
+    min_x = std::min(min_x, x0);
+    max_x = std::max(max_x, x1);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+    if (y < 0 || y >= size_y || x0 < 0 || x1 >= size_x)
+      result->max_cost = NO_INFORMATION;
+    if (y < 0 || y >= size_y)
+      continue;
+    const unsigned char* row = costs + y * size_x;
+    for (int x = std::max(x0, 0); x <= std::min(x1, size_x - 1); ++x)
+    {
+      if (row[x] == LETHAL_OBSTACLE)
+        result->lethal = true;
+      if (row[x] > result->max_cost)
+        result->max_cost = row[x];
+    }
+  }
+  if (result->lethal || max_clearance <= 0.0)
+    return;
+
+  // the nearest lethal cell within max_clearance of the footprint, measured from its outline
+  std::vector<geometry_msgs::Point> oriented;
+  transformFootprint(pose.x, pose.y, pose.theta, footprint, oriented);
+  double reach = 0.0;
+  for (unsigned int i = 0; i < oriented.size(); ++i)
+    reach = std::max(reach, hypot(oriented[i].x - pose.x, oriented[i].y - pose.y));
+  int margin = (int)ceil(max_clearance / costmap.getResolution());
+  double clearance = max_clearance;
+  for (int y = std::max(min_y - margin, 0); y <= std::min(max_y + margin, size_y - 1); ++y)
+  {
+    const unsigned char* row = costs + y * size_x;
+    for (int x = std::max(min_x - margin, 0); x <= std::min(max_x + margin, size_x - 1); ++x)
+    {
+      if (row[x] != LETHAL_OBSTACLE)
+        continue;
+      double wx, wy;
+      costmap.mapToWorld(x, y, wx, wy);
+      // no point of the outline is nearer than the center less the reach of the footprint
+      double distance = hypot(wx - pose.x, wy - pose.y);
+      if (distance - reach >= clearance)
+        continue;
+      if (oriented.size() >= 3)
+      {
+        for (unsigned int i = 0; i < oriented.size(); ++i)
+        {
+          const geometry_msgs::Point& a = oriented[i];
+          const geometry_msgs::Point& b = oriented[(i + 1) % oriented.size()];
+          distance = std::min(distance, distanceToLine(wx, wy, a.x, a.y, b.x, b.y));
+        }
+      }
+      clearance = std::min(clearance, distance);
+    }
+  }
+  result->clearance = clearance;
+}
+
+}  // namespace costmap_2d
@@ -29,6 +29,9 @@
 
 #include "costmap_2d/layer.h"
 
+#include <algorithm>
+#include <ros/console.h>
+
 namespace costmap_2d
 {
 
@@ -38,6 +41,7 @@ Layer::Layer()
   , enabled_(false)
   , name_()
   , tf_(NULL)
+  , update_period_(0.0)
 {}
 
 void Layer::initialize(LayeredCostmap* parent, std::string name, tf::TransformListener *tf)
@@ -45,9 +49,54 @@ void Layer::initialize(LayeredCostmap* parent, std::string name, tf::TransformLi
   layered_costmap_ = parent;
   name_ = name;
   tf_ = tf;
+
+  ros::NodeHandle nh("~/" + name_);
+  double update_frequency;
+  nh.param("update_frequency", update_frequency, 0.0);
+  update_period_ = update_frequency > 0.0 ? 1.0 / update_frequency : 0.0;
+
   onInitialize();
 }
 
+void Layer::updateBoundsList(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds)
+{
+  Bounds box;
+  box.min_x = box.min_y = 1e30;
+  box.max_x = box.max_y = -1e30;
+  for (unsigned int i = 0; i < bounds->size(); ++i)
+  {
+    box.min_x = std::min(box.min_x, (*bounds)[i].min_x);
+    box.min_y = std::min(box.min_y, (*bounds)[i].min_y);
+    box.max_x = std::max(box.max_x, (*bounds)[i].max_x);
+    box.max_y = std::max(box.max_y, (*bounds)[i].max_y);
+  }
+
+  Bounds prev = box;
+  updateBounds(robot_x, robot_y, robot_yaw, &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+  if (box.min_x > prev.min_x || box.min_y > prev.min_y || box.max_x < prev.max_x || box.max_y < prev.max_y)
+  {
+    ROS_WARN_THROTTLE(1.0, "Illegal bounds change, was [tl: (%f, %f), br: (%f, %f)], but "
+                      "is now [tl: (%f, %f), br: (%f, %f)]. The offending layer is %s",
+                      prev.min_x, prev.min_y, prev.max_x , prev.max_y,
+                      box.min_x, box.min_y, box.max_x , box.max_y,
+                      name_.c_str());
+  }
+
+  bounds->clear();
+  if (box.min_x <= box.max_x && box.min_y <= box.max_y)
+    bounds->push_back(box);
+}
+
+void Layer::addOwnBounds(double robot_x, double robot_y, double robot_yaw, std::vector<Bounds>* bounds)
+{
+  Bounds box;
+  box.min_x = box.min_y = 1e30;
+  box.max_x = box.max_y = -1e30;
+  updateBounds(robot_x, robot_y, robot_yaw, &box.min_x, &box.min_y, &box.max_x, &box.max_y);
+  if (box.min_x <= box.max_x && box.min_y <= box.max_y)
+    bounds->push_back(box);
+}
+
 const std::vector<geometry_msgs::Point>& Layer::getFootprint() const
 {
   return layered_costmap_->getFootprint();
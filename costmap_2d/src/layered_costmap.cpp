@@ -37,6 +37,8 @@
  *********************************************************************/
 #include <costmap_2d/layered_costmap.h>
 #include <costmap_2d/footprint.h>
+#include <nav_executor/trace.h>
+#include <boost/bind.hpp>
 #include <cstdio>
 #include <string>
 #include <algorithm>
@@ -48,7 +50,11 @@ namespace costmap_2d
 {
 
 LayeredCostmap::LayeredCostmap(std::string global_frame, bool rolling_window, bool track_unknown) :
-    costmap_(), global_frame_(global_frame), rolling_window_(rolling_window), initialized_(false), size_locked_(false)
+    costmap_(), global_frame_(global_frame), rolling_window_(rolling_window), lock_wait_time_(0.0),
+    update_time_(0.0), force_full_update_(false), update_requested_(false), initialized_(false), size_locked_(false),
+    tile_size_(0), tile_threads_(0), bounds_threads_(0),
+    lane_(rolling_window ? nav_executor::LANE_LOCAL_COSTMAP : nav_executor::LANE_GLOBAL_PLANNING), tile_layer_(NULL),
+    bounds_robot_x_(0.0), bounds_robot_y_(0.0), bounds_robot_yaw_(0.0), next_tile_(0)
 {
   if (track_unknown)
     costmap_.setDefaultValue(255);
@@ -76,63 +82,172 @@ void LayeredCostmap::resizeMap(unsigned int size_x, unsigned int size_y, double
   }
 }
 
+void LayeredCostmap::requestUpdate()
+{
+  boost::unique_lock<boost::mutex> lock(update_request_mutex_);
+  update_requested_ = true;
+  update_request_cond_.notify_all();
+}
+
+bool LayeredCostmap::waitForUpdateRequest(double timeout)
+{
+  boost::unique_lock<boost::mutex> lock(update_request_mutex_);
+  if (!update_requested_ && timeout > 0)
+    update_request_cond_.timed_wait(lock, boost::posix_time::microseconds(int64_t(timeout * 1e6)));
+
+  bool requested = update_requested_;
+  update_requested_ = false;
+  return requested;
+}
+
 void LayeredCostmap::updateMap(double robot_x, double robot_y, double robot_yaw)
 {
+  NAV_TRACE_SCOPE1(costmap_2d, update_map, global_frame_.c_str());
+
   // Lock for the remainder of this function, some plugins (e.g. VoxelLayer)
   // implement thread unsafe updateBounds() functions.
+  ros::WallTime lock_start = ros::WallTime::now();
   boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_.getMutex()));
+  ros::WallTime update_start = ros::WallTime::now();
+  lock_wait_time_ = (update_start - lock_start).toSec();
+  update_time_ = 0.0;
+  last_update_ = ros::Time::now();
+  newest_observation_ = ros::Time();
 
   // if we're using a rolling buffer costmap... we need to update the origin using the robot's position
+  bool rolled = false;
   if (rolling_window_)
   {
     double new_origin_x = robot_x - costmap_.getSizeInMetersX() / 2;
     double new_origin_y = robot_y - costmap_.getSizeInMetersY() / 2;
+    double old_origin_x = costmap_.getOriginX(), old_origin_y = costmap_.getOriginY();
     costmap_.updateOrigin(new_origin_x, new_origin_y);
+    rolled = costmap_.getOriginX() != old_origin_x || costmap_.getOriginY() != old_origin_y;
   }
 
   if (plugins_.size() == 0)
     return;
 
-  minx_ = miny_ = 1e30;
-  maxx_ = maxy_ = -1e30;
+  // layers with an update period skip their bounds until it has passed, unless every layer has to move with the
+  // window; until then, what they put in the costmap stays as it is
+  bounds_due_.resize(plugins_.size());
+  last_bounds_update_.resize(plugins_.size());
+  for (unsigned int p = 0; p < plugins_.size(); ++p)
+  {
+    double period = plugins_[p]->getUpdatePeriod();
+    ros::Time& last = last_bounds_update_[p];
+    bounds_due_[p] = force_full_update_ || rolled || period <= 0.0 || last.isZero() || last_update_ < last ||
+                     (last_update_ - last).toSec() >= period;
+    if (bounds_due_[p])
+      last = last_update_;
+  }
+  force_full_update_ = false;
 
-  for (vector<boost::shared_ptr<Layer> >::iterator plugin = plugins_.begin(); plugin != plugins_.end();
-       ++plugin)
+  layer_stats_.resize(plugins_.size());
+  bounds_.clear();
+  bool parallel = updateIndependentBounds(robot_x, robot_y, robot_yaw);
+  unsigned int job = 0;
+  for (unsigned int p = 0; p < plugins_.size(); ++p)
   {
-    double prev_minx = minx_;
-    double prev_miny = miny_;
-    double prev_maxx = maxx_;
-    double prev_maxy = maxy_;
-    (*plugin)->updateBounds(robot_x, robot_y, robot_yaw, &minx_, &miny_, &maxx_, &maxy_);
-    if (minx_ > prev_minx || miny_ > prev_miny || maxx_ < prev_maxx || maxy_ < prev_maxy)
+    if (!bounds_due_[p])
+    {
+      layer_stats_[p].bounds_time = 0.0;
+    }
+    // the independent layers have already run, their boxes go in at their place in the order
+    else if (parallel && job < bounds_jobs_.size() && bounds_jobs_[job] == p)
+    {
+      bounds_.insert(bounds_.end(), layer_bounds_[p].begin(), layer_bounds_[p].end());
+      ++job;
+    }
+    else
+    {
+      NAV_TRACE2(costmap_2d, layer_bounds_begin, global_frame_.c_str(), plugins_[p]->getName().c_str());
+      ros::WallTime start = ros::WallTime::now();
+      plugins_[p]->updateBoundsList(robot_x, robot_y, robot_yaw, &bounds_);
+      layer_stats_[p].bounds_time = (ros::WallTime::now() - start).toSec();
+      NAV_TRACE2(costmap_2d, layer_bounds_end, global_frame_.c_str(), plugins_[p]->getName().c_str());
+    }
+    layer_stats_[p].costs_time = 0.0;
+    newest_observation_ = std::max(newest_observation_, plugins_[p]->getNewestObservationTime());
+
+    layer_stats_[p].bounds_cells = 0;
+    Region region;
+    for (unsigned int i = 0; i < bounds_.size(); ++i)
     {
-      ROS_WARN_THROTTLE(1.0, "Illegal bounds change, was [tl: (%f, %f), br: (%f, %f)], but "
-                        "is now [tl: (%f, %f), br: (%f, %f)]. The offending layer is %s",
-                        prev_minx, prev_miny, prev_maxx , prev_maxy,
-                        minx_, miny_, maxx_ , maxy_,
-                        (*plugin)->getName().c_str());
+      if (toRegion(bounds_[i], &region))
+        layer_stats_[p].bounds_cells += (unsigned long)(region.xn - region.x0) * (region.yn - region.y0);
     }
   }
 
-  int x0, xn, y0, yn;
-  costmap_.worldToMapEnforceBounds(minx_, miny_, x0, y0);
-  costmap_.worldToMapEnforceBounds(maxx_, maxy_, xn, yn);
+  minx_ = miny_ = 1e30;
+  maxx_ = maxy_ = -1e30;
+  regions_.clear();
+  for (unsigned int i = 0; i < bounds_.size(); ++i)
+  {
+    minx_ = std::min(minx_, bounds_[i].min_x);
+    miny_ = std::min(miny_, bounds_[i].min_y);
+    maxx_ = std::max(maxx_, bounds_[i].max_x);
+    maxy_ = std::max(maxy_, bounds_[i].max_y);
+
+    Region region;
+    if (toRegion(bounds_[i], &region))
+      regions_.push_back(region);
+  }
 
-  x0 = std::max(0, x0);
-  xn = std::min(int(costmap_.getSizeInCellsX()), xn + 1);
-  y0 = std::max(0, y0);
-  yn = std::min(int(costmap_.getSizeInCellsY()), yn + 1);
+  // merge the regions that overlap, so that no cell is updated twice
+  for (unsigned int i = 0; i < regions_.size(); ++i)
+  {
+    for (unsigned int j = i + 1; j < regions_.size(); ++j)
+    {
+      Region& a = regions_[i];
+      const Region& b = regions_[j];
+      if (a.x0 < b.xn && b.x0 < a.xn && a.y0 < b.yn && b.y0 < a.yn)
+      {
+        a.x0 = std::min(a.x0, b.x0);
+        a.xn = std::max(a.xn, b.xn);
+        a.y0 = std::min(a.y0, b.y0);
+        a.yn = std::max(a.yn, b.yn);
+        regions_.erase(regions_.begin() + j);
 
-  ROS_DEBUG("Updating area x: [%d, %d] y: [%d, %d]", x0, xn, y0, yn);
+        // the grown region may now overlap ones already checked against it
+        j = i;
+      }
+    }
+  }
 
-  if (xn < x0 || yn < y0)
+  if (regions_.empty())
+  {
+    update_time_ = (ros::WallTime::now() - update_start).toSec();
     return;
+  }
 
-  costmap_.resetMap(x0, y0, xn, yn);
-  for (vector<boost::shared_ptr<Layer> >::iterator plugin = plugins_.begin(); plugin != plugins_.end();
-       ++plugin)
+  int x0 = regions_[0].x0, xn = regions_[0].xn, y0 = regions_[0].y0, yn = regions_[0].yn;
+  for (unsigned int i = 0; i < regions_.size(); ++i)
   {
-    (*plugin)->updateCosts(costmap_, x0, y0, xn, yn);
+    ROS_DEBUG("Updating area x: [%d, %d] y: [%d, %d]", regions_[i].x0, regions_[i].xn, regions_[i].y0,
+              regions_[i].yn);
+    costmap_.resetMap(regions_[i].x0, regions_[i].y0, regions_[i].xn, regions_[i].yn);
+    x0 = std::min(x0, regions_[i].x0);
+    xn = std::max(xn, regions_[i].xn);
+    y0 = std::min(y0, regions_[i].y0);
+    yn = std::max(yn, regions_[i].yn);
+  }
+
+  // every layer goes over all the regions before the next one starts, as with a single box
+  for (unsigned int p = 0; p < plugins_.size(); ++p)
+  {
+    NAV_TRACE2(costmap_2d, layer_costs_begin, global_frame_.c_str(), plugins_[p]->getName().c_str());
+    ros::WallTime start = ros::WallTime::now();
+    for (unsigned int i = 0; i < regions_.size(); ++i)
+    {
+      const Region& region = regions_[i];
+      if (tile_size_ > 0 && plugins_[p]->isTileSafe())
+        updateTiles(plugins_[p].get(), region.x0, region.y0, region.xn, region.yn);
+      else
+        plugins_[p]->updateCosts(costmap_, region.x0, region.y0, region.xn, region.yn);
+    }
+    layer_stats_[p].costs_time = (ros::WallTime::now() - start).toSec();
+    NAV_TRACE2(costmap_2d, layer_costs_end, global_frame_.c_str(), plugins_[p]->getName().c_str());
   }
 
   bx0_ = x0;
@@ -141,6 +256,109 @@ void LayeredCostmap::updateMap(double robot_x, double robot_y, double robot_yaw)
   byn_ = yn;
 
   initialized_ = true;
+  update_time_ = (ros::WallTime::now() - update_start).toSec();
+}
+
+bool LayeredCostmap::toRegion(const Bounds& bounds, Region* region) const
+{
+  costmap_.worldToMapEnforceBounds(bounds.min_x, bounds.min_y, region->x0, region->y0);
+  costmap_.worldToMapEnforceBounds(bounds.max_x, bounds.max_y, region->xn, region->yn);
+
+  region->x0 = std::max(0, region->x0);
+  region->xn = std::min(int(costmap_.getSizeInCellsX()), region->xn + 1);
+  region->y0 = std::max(0, region->y0);
+  region->yn = std::min(int(costmap_.getSizeInCellsY()), region->yn + 1);
+
+  return region->xn > region->x0 && region->yn > region->y0;
+}
+
+void LayeredCostmap::setTiling(unsigned int tile_size, unsigned int num_threads)
+{
+  boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_.getMutex()));
+  tile_size_ = tile_size;
+  tile_threads_ = tile_size_ > 0 ? num_threads : 0;
+}
+
+void LayeredCostmap::setParallelBounds(unsigned int num_threads)
+{
+  boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_.getMutex()));
+  bounds_threads_ = num_threads;
+}
+
+void LayeredCostmap::updateTiles(Layer* layer, int x0, int y0, int xn, int yn)
+{
+  tiles_.clear();
+  for (int y = y0; y < yn; y += tile_size_)
+  {
+    for (int x = x0; x < xn; x += tile_size_)
+    {
+      Tile tile;
+      tile.x0 = x;
+      tile.y0 = y;
+      tile.xn = std::min(xn, x + int(tile_size_));
+      tile.yn = std::min(yn, y + int(tile_size_));
+      tiles_.push_back(tile);
+    }
+  }
+
+  tile_layer_ = layer;
+  next_tile_ = 0;
+  nav_executor::Executor::shared().run(lane_, std::max(1u, std::min<unsigned int>(tile_threads_, tiles_.size())),
+                                       boost::bind(&LayeredCostmap::runTiles, this, _1));
+  tile_layer_ = NULL;
+}
+
+bool LayeredCostmap::updateIndependentBounds(double robot_x, double robot_y, double robot_yaw)
+{
+  if (bounds_threads_ < 2 || nav_executor::Executor::shared().size() < 2)
+    return false;
+
+  bounds_jobs_.clear();
+  for (unsigned int p = 0; p < plugins_.size(); ++p)
+  {
+    if (bounds_due_[p] && plugins_[p]->isBoundsIndependent())
+      bounds_jobs_.push_back(p);
+  }
+  if (bounds_jobs_.size() < 2)
+    return false;
+
+  layer_bounds_.resize(plugins_.size());
+  for (unsigned int i = 0; i < bounds_jobs_.size(); ++i)
+    layer_bounds_[bounds_jobs_[i]].clear();
+  bounds_robot_x_ = robot_x;
+  bounds_robot_y_ = robot_y;
+  bounds_robot_yaw_ = robot_yaw;
+
+  tile_layer_ = NULL;
+  next_tile_ = 0;
+  nav_executor::Executor::shared().run(lane_, std::min<unsigned int>(bounds_threads_, bounds_jobs_.size()),
+                                       boost::bind(&LayeredCostmap::runTiles, this, _1));
+  return true;
+}
+
+void LayeredCostmap::runTiles(unsigned int)
+{
+  boost::unique_lock<boost::mutex> lock(tile_mutex_);
+  while (next_tile_ < (tile_layer_ ? tiles_.size() : bounds_jobs_.size()))
+  {
+    unsigned int next = next_tile_++;
+    lock.unlock();
+    if (tile_layer_)
+    {
+      const Tile& tile = tiles_[next];
+      tile_layer_->updateTile(costmap_, tile.x0, tile.y0, tile.xn, tile.yn);
+    }
+    else
+    {
+      unsigned int p = bounds_jobs_[next];
+      NAV_TRACE2(costmap_2d, layer_bounds_begin, global_frame_.c_str(), plugins_[p]->getName().c_str());
+      ros::WallTime start = ros::WallTime::now();
+      plugins_[p]->updateBoundsList(bounds_robot_x_, bounds_robot_y_, bounds_robot_yaw_, &layer_bounds_[p]);
+      layer_stats_[p].bounds_time = (ros::WallTime::now() - start).toSec();
+      NAV_TRACE2(costmap_2d, layer_bounds_end, global_frame_.c_str(), plugins_[p]->getName().c_str());
+    }
+    lock.lock();
+  }
 }
 
 bool LayeredCostmap::isCurrent()
@@ -164,6 +382,7 @@ void LayeredCostmap::setFootprint(const std::vector<geometry_msgs::Point>& footp
   {
     (*plugin)->onFootprintChanged();
   }
+  requestUpdate();
 }
 
 }  // namespace costmap_2d
@@ -35,6 +35,7 @@
  * Author: Eitan Marder-Eppstein
  *********************************************************************/
 #include <costmap_2d/observation_buffer.h>
+#include <nav_executor/trace.h>
 
 #include <pcl/point_types.h>
 #include <pcl_ros/transforms.h>
@@ -43,20 +44,32 @@
 
 #include <pcl_conversions/pcl_conversions.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 using namespace std;
 using namespace tf;
 
 namespace costmap_2d
 {
+// The observations a buffer has room for at first, doubled whenever it is full
+static const size_t INITIAL_OBSERVATIONS = 8;
+
 ObservationBuffer::ObservationBuffer(string topic_name, double observation_keep_time, double expected_update_rate,
                                      double min_obstacle_height, double max_obstacle_height, double obstacle_range,
                                      double raytrace_range, TransformListener& tf, string global_frame,
-                                     string sensor_frame, double tf_tolerance) :
+                                     string sensor_frame, double tf_tolerance, double downsample_resolution) :
     tf_(tf), observation_keep_time_(observation_keep_time), expected_update_rate_(expected_update_rate),
     last_updated_(ros::Time::now()), global_frame_(global_frame), sensor_frame_(sensor_frame), topic_name_(topic_name),
     min_obstacle_height_(min_obstacle_height), max_obstacle_height_(max_obstacle_height),
-    obstacle_range_(obstacle_range), raytrace_range_(raytrace_range), tf_tolerance_(tf_tolerance)
+    obstacle_range_(obstacle_range), raytrace_range_(raytrace_range), tf_tolerance_(tf_tolerance),
+    downsample_resolution_(downsample_resolution), voxel_stamp_(0), beam_angle_min_(0.0f),
+    beam_angle_increment_(0.0f), observation_list_(INITIAL_OBSERVATIONS), memory_("observation_buffer")
 {
+  string topic = topic_name;
+  topic.erase(0, topic.find_first_not_of('/'));
+  memory_.setComponent("observation_buffer/" + topic);
 }
 
 ObservationBuffer::~ObservationBuffer()
@@ -76,7 +89,7 @@ bool ObservationBuffer::setGlobalFrame(const std::string new_global_frame)
     return false;
   }
 
-  list<Observation>::iterator obs_it;
+  boost::circular_buffer<Observation>::iterator obs_it;
   for (obs_it = observation_list_.begin(); obs_it != observation_list_.end(); ++obs_it)
   {
     try
@@ -92,8 +105,12 @@ bool ObservationBuffer::setGlobalFrame(const std::string new_global_frame)
       tf_.transformPoint(new_global_frame, origin, origin);
       obs.origin_ = origin.point;
 
-      // we also need to transform the cloud of the observation to the new global frame
-      pcl_ros::transformPointCloud(new_global_frame, *obs.cloud_, *obs.cloud_, tf_);
+      // we also need to transform the cloud of the observation to the new global frame, into
+      // another cloud, as the old one may still be shared
+      boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > cloud = takeCloud();
+      pcl_ros::transformPointCloud(new_global_frame, *obs.cloud_, *cloud, tf_);
+      recycleCloud(obs.cloud_);
+      obs.cloud_ = cloud;
     }
     catch (TransformException& ex)
     {
@@ -110,28 +127,231 @@ bool ObservationBuffer::setGlobalFrame(const std::string new_global_frame)
 
 void ObservationBuffer::bufferCloud(const sensor_msgs::PointCloud2& cloud)
 {
+  NAV_TRACE_SCOPE2(costmap_2d, buffer_cloud, topic_name_.c_str(), cloud.width * cloud.height);
+
+  // find the coordinates in the message, going through pcl for layouts we can't read directly
+  int offset_x = -1, offset_y = -1, offset_z = -1;
+  for (unsigned int i = 0; i < cloud.fields.size(); ++i)
+  {
+    const sensor_msgs::PointField& field = cloud.fields[i];
+    if (field.datatype != sensor_msgs::PointField::FLOAT32 || field.count != 1)
+      continue;
+    if (field.name == "x")
+      offset_x = field.offset;
+    else if (field.name == "y")
+      offset_y = field.offset;
+    else if (field.name == "z")
+      offset_z = field.offset;
+  }
+
+  if (offset_x < 0 || offset_y < 0 || offset_z < 0 || cloud.is_bigendian)
+  {
+    try
+    {
+      pcl::PCLPointCloud2 pcl_pc2;
+      pcl_conversions::toPCL(cloud, pcl_pc2);
+      // Actually convert the PointCloud2 message into a type we can reason about
+      pcl::PointCloud < pcl::PointXYZ > pcl_cloud;
+      pcl::fromPCLPointCloud2(pcl_pc2, pcl_cloud);
+      bufferCloud(pcl_cloud);
+    }
+    catch (pcl::PCLException& ex)
+    {
+      ROS_ERROR("Failed to convert a message to a pcl type, dropping observation: %s", ex.what());
+    }
+    return;
+  }
+
+  if ((size_t) cloud.row_step * cloud.height > cloud.data.size() ||
+      (size_t) cloud.point_step * cloud.width > cloud.row_step ||
+      (cloud.width > 0 && (unsigned int) std::max(offset_x, std::max(offset_y, offset_z)) + sizeof(float) >
+                              cloud.point_step))
+  {
+    ROS_ERROR("The point cloud on topic %s is smaller than its layout says, dropping observation", topic_name_.c_str());
+    return;
+  }
+
+  Stamped < tf::Vector3 > global_origin;
+
+  // create a new observation on the list to be populated
+  pcl::PointCloud<pcl::PointXYZ>& observation_cloud = pushObservation();
+
+  // check whether the origin frame has been set explicitly or whether we should get it from the cloud
+  string origin_frame = sensor_frame_ == "" ? cloud.header.frame_id : sensor_frame_;
+
+  try
+  {
+    // given these observations come from sensors... we'll need to store the origin pt of the sensor
+    Stamped < tf::Vector3 > local_origin(tf::Vector3(0, 0, 0), cloud.header.stamp, origin_frame);
+    tf_.waitForTransform(global_frame_, local_origin.frame_id_, local_origin.stamp_, ros::Duration(0.5));
+    tf_.transformPoint(global_frame_, local_origin, global_origin);
+    observation_list_.front().origin_.x = global_origin.getX();
+    observation_list_.front().origin_.y = global_origin.getY();
+    observation_list_.front().origin_.z = global_origin.getZ();
+
+    // make sure to pass on the raytrace/obstacle range of the observation buffer to the observations
+    observation_list_.front().raytrace_range_ = raytrace_range_;
+    observation_list_.front().obstacle_range_ = obstacle_range_;
+
+    tf::StampedTransform transform;
+    tf_.lookupTransform(global_frame_, cloud.header.frame_id, cloud.header.stamp, transform);
+    const tf::Matrix3x3& basis = transform.getBasis();
+    const tf::Vector3& offset = transform.getOrigin();
+
+    // transform the points straight out of the message, keeping the ones that are within our
+    // height bounds
+    observation_cloud.points.resize(cloud.width * cloud.height);
+    unsigned int point_count = 0;
+
+    for (unsigned int row = 0; row < cloud.height; ++row)
+    {
+      const unsigned char* point = &cloud.data[0] + row * cloud.row_step;
+      for (unsigned int col = 0; col < cloud.width; ++col, point += cloud.point_step)
+      {
+        float x, y, z;
+        memcpy(&x, point + offset_x, sizeof(float));
+        memcpy(&y, point + offset_y, sizeof(float));
+        memcpy(&z, point + offset_z, sizeof(float));
+
+        double global_z = basis[2].x() * x + basis[2].y() * y + basis[2].z() * z + offset.z();
+        if (global_z <= max_obstacle_height_ && global_z >= min_obstacle_height_)
+        {
+          pcl::PointXYZ& global_point = observation_cloud.points[point_count++];
+          global_point.x = basis[0].x() * x + basis[0].y() * y + basis[0].z() * z + offset.x();
+          global_point.y = basis[1].x() * x + basis[1].y() * y + basis[1].z() * z + offset.y();
+          global_point.z = global_z;
+        }
+      }
+    }
+
+    // resize the cloud for the number of legal points
+    observation_cloud.points.resize(point_count);
+    if (downsample_resolution_ > 0.0)
+      downsample(observation_cloud);
+    pcl_conversions::toPCL(cloud.header, observation_cloud.header);
+    observation_cloud.header.frame_id = global_frame_;
+  }
+  catch (TransformException& ex)
+  {
+    // if an exception occurs, we need to remove the empty observation from the list
+    popNewest();
+    ROS_ERROR("TF Exception that should never happen for sensor frame: %s, cloud frame: %s, %s", sensor_frame_.c_str(),
+              cloud.header.frame_id.c_str(), ex.what());
+    return;
+  }
+
+  // if the update was successful, we want to update the last updated time
+  last_updated_ = ros::Time::now();
+
+  // we'll also remove any stale observations from the list
+  purgeStaleObservations();
+  accountMemory();
+}
+
+void ObservationBuffer::bufferScan(const sensor_msgs::LaserScan& scan, bool inf_is_valid)
+{
+  NAV_TRACE_SCOPE2(costmap_2d, buffer_scan, topic_name_.c_str(), scan.ranges.size());
+
+  // the directions of the beams are the same from scan to scan
+  size_t beams = scan.ranges.size();
+  if (beam_cos_.size() != beams || beam_angle_min_ != scan.angle_min || beam_angle_increment_ != scan.angle_increment)
+  {
+    beam_cos_.resize(beams);
+    beam_sin_.resize(beams);
+    for (size_t i = 0; i < beams; ++i)
+    {
+      double angle = scan.angle_min + i * static_cast<double>(scan.angle_increment);
+      beam_cos_[i] = cos(angle);
+      beam_sin_[i] = sin(angle);
+    }
+    beam_angle_min_ = scan.angle_min;
+    beam_angle_increment_ = scan.angle_increment;
+  }
+
+  Stamped < tf::Vector3 > global_origin;
+
+  // create a new observation on the list to be populated
+  pcl::PointCloud<pcl::PointXYZ>& observation_cloud = pushObservation();
+
+  // check whether the origin frame has been set explicitly or whether we should get it from the scan
+  string origin_frame = sensor_frame_ == "" ? scan.header.frame_id : sensor_frame_;
+
   try
   {
-    pcl::PCLPointCloud2 pcl_pc2;
-    pcl_conversions::toPCL(cloud, pcl_pc2);
-    // Actually convert the PointCloud2 message into a type we can reason about
-    pcl::PointCloud < pcl::PointXYZ > pcl_cloud;
-    pcl::fromPCLPointCloud2(pcl_pc2, pcl_cloud);
-    bufferCloud(pcl_cloud);
+    // given these observations come from sensors... we'll need to store the origin pt of the sensor
+    Stamped < tf::Vector3 > local_origin(tf::Vector3(0, 0, 0), scan.header.stamp, origin_frame);
+    tf_.waitForTransform(global_frame_, local_origin.frame_id_, local_origin.stamp_, ros::Duration(0.5));
+    tf_.transformPoint(global_frame_, local_origin, global_origin);
+    observation_list_.front().origin_.x = global_origin.getX();
+    observation_list_.front().origin_.y = global_origin.getY();
+    observation_list_.front().origin_.z = global_origin.getZ();
+
+    // make sure to pass on the raytrace/obstacle range of the observation buffer to the observations
+    observation_list_.front().raytrace_range_ = raytrace_range_;
+    observation_list_.front().obstacle_range_ = obstacle_range_;
+
+    tf::StampedTransform transform;
+    tf_.lookupTransform(global_frame_, scan.header.frame_id, scan.header.stamp, transform);
+    const tf::Matrix3x3& basis = transform.getBasis();
+    const tf::Vector3& offset = transform.getOrigin();
+
+    // the beams lie in the scan's xy plane, so only the first two columns of the rotation are needed
+    observation_cloud.points.resize(beams);
+    unsigned int point_count = 0;
+
+    // as laser_geometry projects them: ranges below range_min, at or beyond range_max, and NaN are dropped
+    float epsilon = 0.0001;  // a tenth of a millimeter
+    for (size_t i = 0; i < beams; ++i)
+    {
+      float range = scan.ranges[i];
+      if (inf_is_valid && !std::isfinite(range) && range > 0)
+        range = scan.range_max - epsilon;
+      if (!(range >= scan.range_min && range < scan.range_max))
+        continue;
+
+      double x = range * beam_cos_[i], y = range * beam_sin_[i];
+      double global_z = basis[2].x() * x + basis[2].y() * y + offset.z();
+      if (global_z <= max_obstacle_height_ && global_z >= min_obstacle_height_)
+      {
+        pcl::PointXYZ& global_point = observation_cloud.points[point_count++];
+        global_point.x = basis[0].x() * x + basis[0].y() * y + offset.x();
+        global_point.y = basis[1].x() * x + basis[1].y() * y + offset.y();
+        global_point.z = global_z;
+      }
+    }
+
+    // resize the cloud for the number of legal points
+    observation_cloud.points.resize(point_count);
+    if (downsample_resolution_ > 0.0)
+      downsample(observation_cloud);
+    pcl_conversions::toPCL(scan.header, observation_cloud.header);
+    observation_cloud.header.frame_id = global_frame_;
   }
-  catch (pcl::PCLException& ex)
+  catch (TransformException& ex)
   {
-    ROS_ERROR("Failed to convert a message to a pcl type, dropping observation: %s", ex.what());
+    // if an exception occurs, we need to remove the empty observation from the list
+    popNewest();
+    ROS_ERROR("TF Exception that should never happen for sensor frame: %s, scan frame: %s, %s", sensor_frame_.c_str(),
+              scan.header.frame_id.c_str(), ex.what());
     return;
   }
+
+  // if the update was successful, we want to update the last updated time
+  last_updated_ = ros::Time::now();
+
+  // we'll also remove any stale observations from the list
+  purgeStaleObservations();
+  accountMemory();
 }
 
 void ObservationBuffer::bufferCloud(const pcl::PointCloud<pcl::PointXYZ>& cloud)
 {
+  NAV_TRACE_SCOPE2(costmap_2d, buffer_pcl_cloud, topic_name_.c_str(), cloud.points.size());
+
   Stamped < tf::Vector3 > global_origin;
 
   // create a new observation on the list to be populated
-  observation_list_.push_front(Observation());
+  pcl::PointCloud<pcl::PointXYZ>& observation_cloud = pushObservation();
 
   // check whether the origin frame has been set explicitly or whether we should get it from the cloud
   string origin_frame = sensor_frame_ == "" ? cloud.header.frame_id : sensor_frame_;
@@ -151,14 +371,13 @@ void ObservationBuffer::bufferCloud(const pcl::PointCloud<pcl::PointXYZ>& cloud)
     observation_list_.front().raytrace_range_ = raytrace_range_;
     observation_list_.front().obstacle_range_ = obstacle_range_;
 
-    pcl::PointCloud < pcl::PointXYZ > global_frame_cloud;
+    pcl::PointCloud < pcl::PointXYZ > &global_frame_cloud = transformed_cloud_;
 
     // transform the point cloud
     pcl_ros::transformPointCloud(global_frame_, cloud, global_frame_cloud, tf_);
     global_frame_cloud.header.stamp = cloud.header.stamp;
 
     // now we need to remove observations from the cloud that are below or above our height thresholds
-    pcl::PointCloud < pcl::PointXYZ > &observation_cloud = *(observation_list_.front().cloud_);
     unsigned int cloud_size = global_frame_cloud.points.size();
     observation_cloud.points.resize(cloud_size);
     unsigned int point_count = 0;
@@ -175,13 +394,15 @@ void ObservationBuffer::bufferCloud(const pcl::PointCloud<pcl::PointXYZ>& cloud)
 
     // resize the cloud for the number of legal points
     observation_cloud.points.resize(point_count);
+    if (downsample_resolution_ > 0.0)
+      downsample(observation_cloud);
     observation_cloud.header.stamp = cloud.header.stamp;
     observation_cloud.header.frame_id = global_frame_cloud.header.frame_id;
   }
   catch (TransformException& ex)
   {
     // if an exception occurs, we need to remove the empty observation from the list
-    observation_list_.pop_front();
+    popNewest();
     ROS_ERROR("TF Exception that should never happen for sensor frame: %s, cloud frame: %s, %s", sensor_frame_.c_str(),
               cloud.header.frame_id.c_str(), ex.what());
     return;
@@ -192,6 +413,54 @@ void ObservationBuffer::bufferCloud(const pcl::PointCloud<pcl::PointXYZ>& cloud)
 
   // we'll also remove any stale observations from the list
   purgeStaleObservations();
+  accountMemory();
+}
+
+void ObservationBuffer::downsample(pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  // size the table to at most half full, and start a new cloud by bumping the stamp rather
+  // than by clearing it
+  size_t size = 1024;
+  unsigned int bits = 10;
+  while (size < 2 * cloud.points.size())
+  {
+    size *= 2;
+    ++bits;
+  }
+  if (voxel_keys_.size() != size)
+  {
+    voxel_keys_.assign(size, 0);
+    voxel_stamps_.assign(size, 0);
+    voxel_stamp_ = 0;
+  }
+  if (++voxel_stamp_ == 0)
+  {
+    voxel_stamps_.assign(size, 0);
+    voxel_stamp_ = 1;
+  }
+
+  double scale = 1.0 / downsample_resolution_;
+  unsigned int point_count = 0;
+  for (unsigned int i = 0; i < cloud.points.size(); ++i)
+  {
+    const pcl::PointXYZ& point = cloud.points[i];
+
+    // 21 bits per axis, which wraps around far beyond any sensor's range
+    uint64_t key = (uint64_t(int64_t(floor(point.x * scale)) & 0x1fffff) << 42) |
+                   (uint64_t(int64_t(floor(point.y * scale)) & 0x1fffff) << 21) |
+                   uint64_t(int64_t(floor(point.z * scale)) & 0x1fffff);
+
+    size_t slot = (key * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+    while (voxel_stamps_[slot] == voxel_stamp_ && voxel_keys_[slot] != key)
+      slot = (slot + 1) & (size - 1);
+    if (voxel_stamps_[slot] == voxel_stamp_)
+      continue;
+
+    voxel_stamps_[slot] = voxel_stamp_;
+    voxel_keys_[slot] = key;
+    cloud.points[point_count++] = point;
+  }
+  cloud.points.resize(point_count);
 }
 
 // returns a copy of the observations
@@ -201,7 +470,7 @@ void ObservationBuffer::getObservations(vector<Observation>& observations)
   purgeStaleObservations();
 
   // now we'll just copy the observations for the caller
-  list<Observation>::iterator obs_it;
+  boost::circular_buffer<Observation>::iterator obs_it;
   for (obs_it = observation_list_.begin(); obs_it != observation_list_.end(); ++obs_it)
   {
     observations.push_back(*obs_it);
@@ -212,27 +481,88 @@ void ObservationBuffer::purgeStaleObservations()
 {
   if (!observation_list_.empty())
   {
-    list<Observation>::iterator obs_it = observation_list_.begin();
     // if we're keeping observations for no time... then we'll only keep one observation
     if (observation_keep_time_ == ros::Duration(0.0))
     {
-      observation_list_.erase(++obs_it, observation_list_.end());
+      while (observation_list_.size() > 1)
+        popOldest();
       return;
     }
 
-    // otherwise... we'll have to loop through the observations to see which ones are stale
-    for (obs_it = observation_list_.begin(); obs_it != observation_list_.end(); ++obs_it)
+    // otherwise... we'll have to loop through the observations to see which ones are stale, the observations
+    // being newest first, the first one out of date and those that follow it
+    size_t keep = 0;
+    while (keep < observation_list_.size()
+           && last_updated_ - pcl_conversions::fromPCL(observation_list_[keep].cloud_->header).stamp
+               <= observation_keep_time_)
+      ++keep;
+    while (observation_list_.size() > keep)
+      popOldest();
+  }
+}
+
+pcl::PointCloud<pcl::PointXYZ>& ObservationBuffer::pushObservation()
+{
+  if (observation_list_.full())
+    observation_list_.set_capacity(2 * observation_list_.capacity());
+  boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > cloud = takeCloud();
+  observation_list_.push_front(Observation(cloud));
+  return *cloud;
+}
+
+void ObservationBuffer::popNewest()
+{
+  recycleCloud(observation_list_.front().cloud_);
+  observation_list_.pop_front();
+}
+
+void ObservationBuffer::popOldest()
+{
+  recycleCloud(observation_list_.back().cloud_);
+  observation_list_.pop_back();
+}
+
+boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > ObservationBuffer::takeCloud()
+{
+  boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > cloud;
+  for (size_t i = 0; i < spare_clouds_.size(); ++i)
+  {
+    if (spare_clouds_[i].unique())
     {
-      Observation& obs = *obs_it;
-      // check if the observation is out of date... and if it is, remove it and those that follow from the list
-      ros::Duration time_diff = last_updated_ - pcl_conversions::fromPCL(obs.cloud_->header).stamp;
-      if ((last_updated_ - pcl_conversions::fromPCL(obs.cloud_->header).stamp) > observation_keep_time_)
-      {
-        observation_list_.erase(obs_it, observation_list_.end());
-        return;
-      }
+      cloud.swap(spare_clouds_[i]);
+      spare_clouds_[i].swap(spare_clouds_.back());
+      spare_clouds_.pop_back();
+
+      // as a new cloud, but for the capacity of its points
+      cloud->points.clear();
+      cloud->width = 0;
+      cloud->height = 0;
+      cloud->is_dense = true;
+      return cloud;
     }
   }
+  cloud.reset(new pcl::PointCloud<pcl::PointXYZ>());
+  return cloud;
+}
+
+void ObservationBuffer::recycleCloud(const boost::shared_ptr<const pcl::PointCloud<pcl::PointXYZ> >& cloud)
+{
+  // the clouds of the observations were all made here, by takeCloud()
+  if (spare_clouds_.size() < observation_list_.capacity())
+    spare_clouds_.push_back(boost::const_pointer_cast<pcl::PointCloud<pcl::PointXYZ> >(cloud));
+}
+
+void ObservationBuffer::accountMemory()
+{
+  size_t bytes = voxel_keys_.capacity() * sizeof(uint64_t) + voxel_stamps_.capacity() * sizeof(unsigned int)
+      + (beam_cos_.capacity() + beam_sin_.capacity()) * sizeof(float);
+  bytes += observation_list_.capacity() * sizeof(Observation)
+      + transformed_cloud_.points.capacity() * sizeof(pcl::PointXYZ);
+  for (size_t i = 0; i < observation_list_.size(); ++i)
+    bytes += observation_list_[i].cloud_->points.capacity() * sizeof(pcl::PointXYZ);
+  for (size_t i = 0; i < spare_clouds_.size(); ++i)
+    bytes += spare_clouds_[i]->points.capacity() * sizeof(pcl::PointXYZ);
+  memory_.set(bytes);
 }
 
 bool ObservationBuffer::isCurrent() const
@@ -0,0 +1,71 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#include <costmap_2d/observation_hub.h>
+
+namespace costmap_2d
+{
+
+ObservationHub& ObservationHub::instance()
+{
+  static ObservationHub hub;
+  return hub;
+}
+
+boost::shared_ptr<ObservationSource> ObservationHub::acquire(
+    const std::string& key, const boost::function<void(ObservationSource&)>& create)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  boost::shared_ptr<ObservationSource> source = sources_[key].lock();
+  if (!source)
+  {
+    // forget the sources no layer holds any more
+    std::map<std::string, boost::weak_ptr<ObservationSource> >::iterator it = sources_.begin();
+    while (it != sources_.end())
+    {
+      if (it->second.expired() && it->first != key)
+        sources_.erase(it++);
+      else
+        ++it;
+    }
+
+    source.reset(new ObservationSource());
+    create(*source);
+    sources_[key] = source;
+  }
+  return source;
+}
+
+}  // namespace costmap_2d
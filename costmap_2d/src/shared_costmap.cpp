@@ -0,0 +1,299 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <costmap_2d/shared_costmap.h>
+#include <ros/console.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace costmap_2d
+{
+
+// the cells start on a cache line of their own, and segments grow in steps of this many bytes
+static const uint64_t CELLS_ALIGNMENT = 64;
+static const uint64_t CAPACITY_STEP = 1 << 20;
+
+SharedCostmapPublisher::SharedCostmapPublisher(Costmap2D* costmap, const std::string& global_frame,
+                                               const std::string& name) :
+    costmap_(costmap), global_frame_(global_frame), name_(name), header_(NULL), segment_size_(0)
+{
+  // a segment left behind by a publisher that died is marked stale, so its readers let go of it
+  int fd = shm_open(name_.c_str(), O_RDWR, 0);
+  if (fd >= 0)
+  {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(SharedCostmapHeader))
+    {
+      void* old = mmap(NULL, sizeof(SharedCostmapHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (old != MAP_FAILED)
+      {
+        static_cast<SharedCostmapHeader*>(old)->stale = 1;
+        munmap(old, sizeof(SharedCostmapHeader));
+      }
+    }
+    close(fd);
+    shm_unlink(name_.c_str());
+  }
+
+  xn_ = yn_ = 0;
+  x0_ = costmap_->getSizeInCellsX();
+  y0_ = costmap_->getSizeInCellsY();
+}
+
+SharedCostmapPublisher::~SharedCostmapPublisher()
+{
+  releaseSegment();
+}
+
+bool SharedCostmapPublisher::createSegment(uint64_t cells)
+{
+  uint64_t capacity = std::max((cells + CAPACITY_STEP - 1) / CAPACITY_STEP, uint64_t(1)) * CAPACITY_STEP;
+  uint64_t cells_offset = (sizeof(SharedCostmapHeader) + CELLS_ALIGNMENT - 1) / CELLS_ALIGNMENT * CELLS_ALIGNMENT;
+  size_t size = cells_offset + capacity;
+
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+  {
+    ROS_ERROR("Could not create the shared costmap %s: %s", name_.c_str(), strerror(errno));
+    return false;
+  }
+  void* segment = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int error = errno;
+  close(fd);
+  if (segment == MAP_FAILED)
+  {
+    ROS_ERROR("Could not map the shared costmap %s: %s", name_.c_str(), strerror(error));
+    shm_unlink(name_.c_str());
+    return false;
+  }
+
+  // the new segment reads as zeros, so the magic is what tells readers it is set up
+  header_ = static_cast<SharedCostmapHeader*>(segment);
+  segment_size_ = size;
+  header_->layout = SHARED_COSTMAP_LAYOUT;
+  header_->capacity = capacity;
+  header_->cells_offset = cells_offset;
+  strncpy(header_->frame_id, global_frame_.c_str(), sizeof(header_->frame_id) - 1);
+  __sync_synchronize();
+  header_->magic = SHARED_COSTMAP_MAGIC;
+  return true;
+}
+
+void SharedCostmapPublisher::releaseSegment()
+{
+  if (header_ == NULL)
+    return;
+  header_->stale = 1;
+  munmap(header_, segment_size_);
+  shm_unlink(name_.c_str());
+  header_ = NULL;
+  segment_size_ = 0;
+}
+
+void SharedCostmapPublisher::publish(double stamp)
+{
+  boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap_->getMutex()));
+  unsigned int size_x = costmap_->getSizeInCellsX();
+  unsigned int size_y = costmap_->getSizeInCellsY();
+  uint64_t cells = uint64_t(size_x) * size_y;
+
+  // readers keep the old segment mapped, so a larger map gets a new one rather than a resized one
+  bool full = false;
+  if (header_ == NULL || cells > header_->capacity)
+  {
+    releaseSegment();
+    if (!createSegment(cells))
+      return;
+    full = true;
+  }
+  full = full || header_->size_x != size_x || header_->size_y != size_y
+      || header_->resolution != costmap_->getResolution() || header_->origin_x != costmap_->getOriginX()
+      || header_->origin_y != costmap_->getOriginY();
+
+  header_->sequence++;
+  __sync_synchronize();
+
+  header_->size_x = size_x;
+  header_->size_y = size_y;
+  header_->resolution = costmap_->getResolution();
+  header_->origin_x = costmap_->getOriginX();
+  header_->origin_y = costmap_->getOriginY();
+  header_->stamp = stamp;
+
+  unsigned char* target = reinterpret_cast<unsigned char*>(header_) + header_->cells_offset;
+  const unsigned char* costs = costmap_->getCharMap();
+  unsigned int xn = std::min(xn_, size_x), yn = std::min(yn_, size_y);
+  header_->x0 = header_->xn = header_->y0 = header_->yn = 0;
+  if (full || (x0_ == 0 && xn == size_x))
+  {
+    unsigned int y0 = full ? 0 : y0_;
+    if (full)
+      yn = size_y;
+    if (y0 < yn)
+    {
+      memcpy(target + size_t(y0) * size_x, costs + size_t(y0) * size_x, size_t(yn - y0) * size_x);
+      header_->xn = size_x;
+      header_->y0 = y0;
+      header_->yn = yn;
+    }
+  }
+  else if (x0_ < xn)
+  {
+    for (unsigned int y = y0_; y < yn; ++y)
+      memcpy(target + size_t(y) * size_x + x0_, costs + size_t(y) * size_x + x0_, xn - x0_);
+    if (y0_ < yn)
+    {
+      header_->x0 = x0_;
+      header_->xn = xn;
+      header_->y0 = y0_;
+      header_->yn = yn;
+    }
+  }
+
+  __sync_synchronize();
+  header_->sequence++;
+
+  xn_ = yn_ = 0;
+  x0_ = size_x;
+  y0_ = size_y;
+}
+
+SharedCostmapReader::SharedCostmapReader(const std::string& name) :
+    name_(name), header_(NULL), segment_size_(0), sequence_(0)
+{
+}
+
+SharedCostmapReader::~SharedCostmapReader()
+{
+  unmap();
+}
+
+bool SharedCostmapReader::map()
+{
+  int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void* segment = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(SharedCostmapHeader))
+    segment = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+    return false;
+
+  header_ = static_cast<const SharedCostmapHeader*>(segment);
+  segment_size_ = st.st_size;
+  __sync_synchronize();
+  if (header_->magic != SHARED_COSTMAP_MAGIC || header_->layout != SHARED_COSTMAP_LAYOUT
+      || header_->cells_offset + header_->capacity > segment_size_)
+  {
+    if (header_->magic == SHARED_COSTMAP_MAGIC && header_->layout != SHARED_COSTMAP_LAYOUT)
+      ROS_ERROR_ONCE("The shared costmap %s has layout %u, not %u", name_.c_str(), header_->layout,
+                     SHARED_COSTMAP_LAYOUT);
+    unmap();
+    return false;
+  }
+  return true;
+}
+
+void SharedCostmapReader::unmap()
+{
+  if (header_ == NULL)
+    return;
+  munmap(const_cast<SharedCostmapHeader*>(header_), segment_size_);
+  header_ = NULL;
+  segment_size_ = 0;
+}
+
+const SharedCostmapHeader* SharedCostmapReader::beginRead()
+{
+  if (header_ != NULL && header_->stale)
+    unmap();
+  if (header_ == NULL && !map())
+    return NULL;
+
+  sequence_ = header_->sequence;
+  __sync_synchronize();
+  return header_;
+}
+
+bool SharedCostmapReader::endRead() const
+{
+  __sync_synchronize();
+  return (sequence_ & 1) == 0 && header_->sequence == sequence_;
+}
+
+bool SharedCostmapReader::read(Costmap2D& costmap, unsigned int tries)
+{
+  std::vector<unsigned char> costs;
+  for (unsigned int i = 0; i < tries; ++i)
+  {
+    const SharedCostmapHeader* header = beginRead();
+    if (header == NULL)
+      return false;
+    if (sequence_ & 1)
+    {
+      sched_yield();
+      continue;
+    }
+
+    SharedCostmapHeader info = *header;
+    uint64_t cells = uint64_t(info.size_x) * info.size_y;
+    if (cells > info.capacity)
+      continue;
+    costs.assign(this->cells(), this->cells() + cells);
+    if (!endRead())
+      continue;
+
+    boost::unique_lock<Costmap2D::mutex_t> lock(*(costmap.getMutex()));
+    if (costmap.getSizeInCellsX() != info.size_x || costmap.getSizeInCellsY() != info.size_y
+        || costmap.getResolution() != info.resolution || costmap.getOriginX() != info.origin_x
+        || costmap.getOriginY() != info.origin_y)
+      costmap.resizeMap(info.size_x, info.size_y, info.resolution, info.origin_x, info.origin_y);
+    if (cells > 0)
+      memcpy(costmap.getCharMap(), &costs[0], cells);
+    return true;
+  }
+  return false;
+}
+
+}  // namespace costmap_2d
@@ -0,0 +1,116 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <costmap_2d/update_stats_publisher.h>
+#include <algorithm>
+
+namespace costmap_2d
+{
+
+UpdateStatsPublisher::UpdateStatsPublisher(ros::NodeHandle* ros_node, LayeredCostmap* layered_costmap,
+                                           std::string topic_name, unsigned int window) :
+    layered_costmap_(layered_costmap), window_(std::max(window, 1u)), next_sample_(0), sample_count_(0)
+{
+  stats_pub_ = ros_node->advertise<UpdateStats>(topic_name, 1);
+
+  // 0.1 ms to 1 s, in 1-2-5 steps
+  for (double decade = 1e-4; decade < 1.0; decade *= 10)
+  {
+    bin_edges_.push_back(decade);
+    bin_edges_.push_back(2 * decade);
+    bin_edges_.push_back(5 * decade);
+  }
+  bin_edges_.push_back(1.0);
+}
+
+void UpdateStatsPublisher::publishStats()
+{
+  const std::vector<LayerUpdateStats>& layer_stats = layered_costmap_->getLayerUpdateStats();
+
+  // start over if a layer came or went
+  if (samples_.size() != layer_stats.size() + 2)
+  {
+    samples_.assign(layer_stats.size() + 2, std::vector<double>(window_, 0.0));
+    next_sample_ = 0;
+    sample_count_ = 0;
+  }
+
+  samples_[0][next_sample_] = layered_costmap_->getUpdateTime();
+  samples_[1][next_sample_] = layered_costmap_->getLockWaitTime();
+  for (unsigned int i = 0; i < layer_stats.size(); ++i)
+    samples_[i + 2][next_sample_] = layer_stats[i].bounds_time + layer_stats[i].costs_time;
+  next_sample_ = (next_sample_ + 1) % window_;
+  sample_count_ = std::min(sample_count_ + 1, window_);
+
+  if (stats_pub_.getNumSubscribers() == 0)
+    return;
+
+  UpdateStats stats;
+  stats.header.stamp = ros::Time::now();
+  stats.header.frame_id = layered_costmap_->getGlobalFrameID();
+  stats.window = sample_count_;
+  stats.bin_edges = bin_edges_;
+  stats.update_time = layered_costmap_->getUpdateTime();
+  stats.lock_wait_time = layered_costmap_->getLockWaitTime();
+  fillHistogram(0, &stats.update_time_histogram);
+  fillHistogram(1, &stats.lock_wait_histogram);
+
+  std::vector<boost::shared_ptr<Layer> >* plugins = layered_costmap_->getPlugins();
+  stats.layers.resize(layer_stats.size());
+  for (unsigned int i = 0; i < layer_stats.size(); ++i)
+  {
+    LayerStats& layer = stats.layers[i];
+    if (i < plugins->size())
+      layer.name = (*plugins)[i]->getName();
+    layer.bounds_time = layer_stats[i].bounds_time;
+    layer.costs_time = layer_stats[i].costs_time;
+    layer.bounds_cells = layer_stats[i].bounds_cells;
+    fillHistogram(i + 2, &layer.time_histogram);
+  }
+
+  stats_pub_.publish(stats);
+}
+
+void UpdateStatsPublisher::fillHistogram(unsigned int series, std::vector<uint32_t>* histogram) const
+{
+  histogram->assign(bin_edges_.size() + 1, 0);
+  const std::vector<double>& samples = samples_[series];
+  for (unsigned int i = 0; i < sample_count_; ++i)
+  {
+    unsigned int bin = std::upper_bound(bin_edges_.begin(), bin_edges_.end(), samples[i]) - bin_edges_.begin();
+    ++(*histogram)[bin];
+  }
+}
+
+}  // namespace costmap_2d
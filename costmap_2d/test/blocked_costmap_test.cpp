@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "costmap_2d/blocked_costmap.h"
+
+using namespace costmap_2d;
+
+// a map whose sides are not multiples of the block size, with a cost of its own in each cell
+static void fill(Costmap2D& map)
+{
+  for (unsigned int y = 0; y < map.getSizeInCellsY(); ++y)
+    for (unsigned int x = 0; x < map.getSizeInCellsX(); ++x)
+      map.setCost(x, y, (x * 7 + y * 13) % 251);
+}
+
+TEST(blocked_costmap, round_trip)
+{
+  Costmap2D map(100, 45, 0.05, 0.0, 0.0);
+  fill(map);
+  BlockedCostmap blocked(map);
+  for (unsigned int y = 0; y < 45; ++y)
+    for (unsigned int x = 0; x < 100; ++x)
+      ASSERT_EQ(map.getCost(x, y), blocked.getCost(x, y));
+
+  Costmap2D copy(100, 45, 0.05, 0.0, 0.0);
+  EXPECT_TRUE(blocked.copyTo(copy));
+  EXPECT_EQ(0, memcmp(map.getCharMap(), copy.getCharMap(), 100 * 45));
+
+  Costmap2D other(10, 10, 0.05, 0.0, 0.0);
+  EXPECT_FALSE(blocked.copyTo(other));
+}
+
+TEST(blocked_costmap, neighbors_within_block)
+{
+  Costmap2D map(100, 100, 0.05, 0.0, 0.0);
+  BlockedCostmap blocked(map);
+  EXPECT_EQ(BlockedCostmap::BLOCK_SIZE, blocked.getIndex(3, 4) - blocked.getIndex(3, 3));
+  EXPECT_EQ(1u, blocked.getIndex(4, 3) - blocked.getIndex(3, 3));
+}
+
+TEST(blocked_costmap, update)
+{
+  Costmap2D map(70, 70, 0.05, 0.0, 0.0);
+  fill(map);
+  BlockedCostmap blocked(map);
+
+  // only the given cells are copied
+  map.setCost(30, 31, 1);
+  map.setCost(60, 60, 1);
+  blocked.update(map, 20, 40, 25, 35);
+  EXPECT_EQ(1, blocked.getCost(30, 31));
+  EXPECT_NE(1, blocked.getCost(60, 60));
+
+  unsigned char row[50];
+  blocked.copyRow(5, 31, 50, row);
+  EXPECT_EQ(0, memcmp(row, map.getCharMap() + 31 * 70 + 5, 50));
+
+  // another size is copied in full
+  Costmap2D larger(90, 33, 0.05, 0.0, 0.0);
+  fill(larger);
+  blocked.update(larger, 0, 0, 0, 0);
+  EXPECT_EQ(90u, blocked.getSizeInCellsX());
+  EXPECT_EQ(larger.getCost(89, 32), blocked.getCost(89, 32));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
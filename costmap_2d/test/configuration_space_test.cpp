@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "costmap_2d/configuration_space.h"
+#include "costmap_2d/cost_values.h"
+
+using namespace costmap_2d;
+
+// a robot 1.2 m long and 0.4 m wide
+static std::vector<geometry_msgs::Point> longFootprint()
+{
+  std::vector<geometry_msgs::Point> footprint(4);
+  footprint[0].x = 0.6;
+  footprint[0].y = 0.2;
+  footprint[1].x = 0.6;
+  footprint[1].y = -0.2;
+  footprint[2].x = -0.6;
+  footprint[2].y = -0.2;
+  footprint[3].x = -0.6;
+  footprint[3].y = 0.2;
+  return footprint;
+}
+
+TEST(configuration_space, heading_matters)
+{
+  Costmap2D map(40, 40, 0.1, 0.0, 0.0);
+  map.setCost(25, 20, LETHAL_OBSTACLE);
+  ConfigurationSpace cspace(16);
+  cspace.setFootprint(longFootprint());
+  cspace.rebuild(map);
+
+  // 0.5 m ahead of the center hits the obstacle lengthwise, not sideways
+  EXPECT_TRUE(cspace.inCollision(20u, 20u, cspace.getHeading(0.0)));
+  EXPECT_TRUE(cspace.inCollision(20u, 20u, cspace.getHeading(M_PI)));
+  EXPECT_FALSE(cspace.inCollision(20u, 20u, cspace.getHeading(M_PI / 2)));
+  EXPECT_TRUE(cspace.inCollision(2.05, 2.05, 0.01));
+  EXPECT_FALSE(cspace.inCollision(2.05, 2.05, -M_PI / 2));
+
+  // near the edge the footprint leaves the map
+  EXPECT_TRUE(cspace.inCollision(3u, 20u, cspace.getHeading(0.0)));
+  EXPECT_FALSE(cspace.inCollision(3u, 20u, cspace.getHeading(M_PI / 2)));
+  EXPECT_TRUE(cspace.inCollision(-1.0, 2.0, 0.0));
+}
+
+TEST(configuration_space, update_matches_rebuild)
+{
+  Costmap2D map(60, 50, 0.1, 0.0, 0.0);
+  ConfigurationSpace incremental(16), full(16);
+  incremental.setFootprint(longFootprint());
+  full.setFootprint(longFootprint());
+  incremental.rebuild(map);
+
+  srand(3);
+  for (unsigned int round = 0; round < 20; ++round)
+  {
+    unsigned int x0 = rand() % 55, y0 = rand() % 45, xn = x0 + 1 + rand() % 5, yn = y0 + 1 + rand() % 5;
+    for (unsigned int y = y0; y < yn; ++y)
+    {
+      for (unsigned int x = x0; x < xn; ++x)
+      {
+        int r = rand() % 4;
+        map.setCost(x, y, r == 0 ? LETHAL_OBSTACLE : r == 1 ? NO_INFORMATION : FREE_SPACE);
+      }
+    }
+    incremental.update(map, x0, xn, y0, yn);
+    full.rebuild(map);
+    for (unsigned int y = 0; y < 50; ++y)
+      for (unsigned int x = 0; x < 60; ++x)
+        ASSERT_EQ(full.getCollisions(x, y), incremental.getCollisions(x, y)) << x << ", " << y;
+  }
+}
+
+TEST(configuration_space, circular_robot)
+{
+  Costmap2D map(10, 10, 0.1, 0.0, 0.0);
+  map.setCost(4, 4, NO_INFORMATION);
+  ConfigurationSpace cspace(8);
+  cspace.rebuild(map);
+  EXPECT_EQ(0xffu, cspace.getCollisions(4, 4));
+  EXPECT_EQ(0u, cspace.getCollisions(5, 4));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "costmap_2d/costmap_2d.h"
+
+using namespace costmap_2d;
+
+TEST(costmap_copy, changes_only)
+{
+  Costmap2D map(100, 50, 0.05, 1.0, 2.0, 0);
+  map.setCost(3, 4, 254);
+  map.recordChange(3, 4, 4, 5);
+
+  Costmap2D copy;
+  unsigned long version = 0;
+  copy.updateCopy(map, version);
+  EXPECT_EQ(map.getVersion(), version);
+  EXPECT_EQ(100, copy.getSizeInCellsX());
+  EXPECT_EQ(2.0, copy.getOriginY());
+  EXPECT_EQ(254, copy.getCost(3, 4));
+
+  // only the recorded changes are copied, and recorded in the copy
+  unsigned long copy_version = copy.getVersion();
+  map.setCost(10, 10, 100);
+  map.recordChange(10, 11, 10, 11);
+  map.setCost(20, 20, 100);
+  copy.updateCopy(map, version);
+  EXPECT_EQ(100, copy.getCost(10, 10));
+  EXPECT_EQ(0, copy.getCost(20, 20));
+  unsigned int x0, xn, y0, yn;
+  ASSERT_TRUE(copy.getChangesSince(copy_version, &x0, &xn, &y0, &yn));
+  EXPECT_EQ(10u, x0);
+  EXPECT_EQ(11u, yn);
+
+  // a moved map is copied whole
+  map.updateOrigin(1.5, 2.0);
+  copy.updateCopy(map, version);
+  EXPECT_EQ(1.5, copy.getOriginX());
+  for (unsigned int i = 0; i < 100 * 50; ++i)
+    EXPECT_EQ(map.getCharMap()[i], copy.getCharMap()[i]);
+}
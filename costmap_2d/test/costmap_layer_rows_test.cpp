@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "costmap_2d/cost_values.h"
+#include "costmap_2d/costmap_layer.h"
+
+using namespace costmap_2d;
+
+// every pair of master and layer costs, in rows long and short enough for both the
+// vector and the cell by cell parts, at any offset
+static void checkRows(void (*row)(unsigned char*, const unsigned char*, unsigned int),
+                      unsigned char (*expected)(unsigned char, unsigned char))
+{
+  std::vector<unsigned char> master(256 * 256 + 64), layer(256 * 256 + 64);
+  for (unsigned int n = 1; n <= 40; n += 13)
+  {
+    for (unsigned int offset = 0; offset < 3; ++offset)
+    {
+      for (unsigned int k = 0; k < 256 * 256; ++k)
+      {
+        master[offset + k] = k / 256;
+        layer[offset + k] = k % 256;
+      }
+      for (unsigned int k = 0; k < 256 * 256; k += n)
+        row(&master[offset + k], &layer[offset + k], std::min(n, 256 * 256 - k));
+      for (unsigned int k = 0; k < 256 * 256; ++k)
+        ASSERT_EQ(expected(k / 256, k % 256), master[offset + k]) << "master " << k / 256 << " layer " << k % 256;
+    }
+  }
+}
+
+static unsigned char maxCost(unsigned char old_cost, unsigned char cost)
+{
+  if (cost == NO_INFORMATION)
+    return old_cost;
+  return old_cost == NO_INFORMATION || old_cost < cost ? cost : old_cost;
+}
+
+static unsigned char overwriteCost(unsigned char old_cost, unsigned char cost)
+{
+  return cost == NO_INFORMATION ? old_cost : cost;
+}
+
+static unsigned char additionCost(unsigned char old_cost, unsigned char cost)
+{
+  if (cost == NO_INFORMATION)
+    return old_cost;
+  if (old_cost == NO_INFORMATION)
+    return cost;
+  return old_cost + cost >= INSCRIBED_INFLATED_OBSTACLE ? INSCRIBED_INFLATED_OBSTACLE - 1 : old_cost + cost;
+}
+
+TEST(costmap_layer_rows, max)
+{
+  checkRows(&CostmapLayer::maxRow, &maxCost);
+}
+
+TEST(costmap_layer_rows, overwrite)
+{
+  checkRows(&CostmapLayer::overwriteRow, &overwriteCost);
+}
+
+TEST(costmap_layer_rows, addition)
+{
+  checkRows(&CostmapLayer::additionRow, &additionCost);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
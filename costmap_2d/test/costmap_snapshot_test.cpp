@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "costmap_2d/cost_values.h"
+#include "costmap_2d/costmap_2d.h"
+
+using namespace costmap_2d;
+
+static const char* SNAPSHOT_FILE = "/tmp/costmap_snapshot_test.cmsn";
+
+TEST(costmap_snapshot, round_trip)
+{
+  // a size that is not a multiple of the tiles, and runs longer than one byte can count
+  Costmap2D map(150, 70, 0.05, -3.0, 2.5, NO_INFORMATION);
+  Costmap2D plane(150, 70, 0.05, -3.0, 2.5, 0);
+  for (unsigned int y = 0; y < 70; ++y)
+  {
+    for (unsigned int x = 0; x < 150; ++x)
+    {
+      map.setCost(x, y, x < 100 ? FREE_SPACE : (x * 7 + y * 13) % 256);
+      plane.setCost(x, y, (x + y) % 3 == 0 ? LETHAL_OBSTACLE : 0);
+    }
+  }
+  Costmap2D::SnapshotPlanes planes;
+  planes["plane"] = &plane;
+  ASSERT_TRUE(map.saveSnapshot(SNAPSHOT_FILE, planes));
+
+  Costmap2D loaded, loaded_plane;
+  Costmap2D::SnapshotPlanes loaded_planes;
+  loaded_planes["plane"] = &loaded_plane;
+  ASSERT_TRUE(loaded.loadSnapshot(SNAPSHOT_FILE, loaded_planes));
+  EXPECT_EQ(150u, loaded.getSizeInCellsX());
+  EXPECT_EQ(70u, loaded.getSizeInCellsY());
+  EXPECT_EQ(0.05, loaded.getResolution());
+  EXPECT_EQ(-3.0, loaded.getOriginX());
+  EXPECT_EQ(2.5, loaded.getOriginY());
+  EXPECT_EQ(NO_INFORMATION, loaded.getDefaultValue());
+  ASSERT_EQ(150u, loaded_plane.getSizeInCellsX());
+  for (unsigned int i = 0; i < 150 * 70; ++i)
+  {
+    EXPECT_EQ(map.getCharMap()[i], loaded.getCharMap()[i]);
+    EXPECT_EQ(plane.getCharMap()[i], loaded_plane.getCharMap()[i]);
+  }
+
+  // a plane that is not asked for is skipped
+  Costmap2D map_only;
+  ASSERT_TRUE(map_only.loadSnapshot(SNAPSHOT_FILE));
+  EXPECT_EQ(map.getCharMap()[150 * 70 - 1], map_only.getCharMap()[150 * 70 - 1]);
+  remove(SNAPSHOT_FILE);
+}
+
+TEST(costmap_snapshot, corrupt_size)
+{
+  Costmap2D map(40, 30, 0.1, 0.0, 0.0, 0);
+  map.setCost(5, 6, LETHAL_OBSTACLE);
+  ASSERT_TRUE(map.saveSnapshot(SNAPSHOT_FILE));
+
+  // a header that claims a far bigger map than the file holds is rejected before anything is allocated, and
+  // leaves the costmap as it was
+  FILE* fp = fopen(SNAPSHOT_FILE, "r+b");
+  ASSERT_TRUE(fp != NULL);
+  uint32_t size[2] = { 0xffffffffu, 0xffffffffu };
+  ASSERT_EQ(0, fseek(fp, 2 * sizeof(uint32_t), SEEK_SET));
+  ASSERT_EQ(1u, fwrite(size, sizeof(size), 1, fp));
+  fclose(fp);
+
+  Costmap2D loaded(10, 10, 0.5, 1.0, 1.0, 0);
+  EXPECT_FALSE(loaded.loadSnapshot(SNAPSHOT_FILE));
+  EXPECT_EQ(10u, loaded.getSizeInCellsX());
+  EXPECT_EQ(0.5, loaded.getResolution());
+
+  // and so is a truncated file
+  ASSERT_TRUE(map.saveSnapshot(SNAPSHOT_FILE));
+  ASSERT_EQ(0, truncate(SNAPSHOT_FILE, 60));
+  EXPECT_FALSE(loaded.loadSnapshot(SNAPSHOT_FILE));
+  EXPECT_EQ(10u, loaded.getSizeInCellsX());
+  remove(SNAPSHOT_FILE);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "costmap_2d/footprint_checker.h"
+#include "costmap_2d/cost_values.h"
+
+using namespace costmap_2d;
+
+// a robot 1.2 m long and 0.4 m wide
+static std::vector<geometry_msgs::Point> longFootprint()
+{
+  std::vector<geometry_msgs::Point> footprint(4);
+  footprint[0].x = 0.6;
+  footprint[0].y = 0.2;
+  footprint[1].x = 0.6;
+  footprint[1].y = -0.2;
+  footprint[2].x = -0.6;
+  footprint[2].y = -0.2;
+  footprint[3].x = -0.6;
+  footprint[3].y = 0.2;
+  return footprint;
+}
+
+static geometry_msgs::Pose2D pose(double x, double y, double theta)
+{
+  geometry_msgs::Pose2D p;
+  p.x = x;
+  p.y = y;
+  p.theta = theta;
+  return p;
+}
+
+TEST(footprint_checker, cost_lethal_and_clearance)
+{
+  Costmap2D map(60, 60, 0.1, 0.0, 0.0);
+  map.setCost(35, 30, LETHAL_OBSTACLE);
+  map.setCost(30, 32, 100);
+  FootprintChecker checker(32);
+  checker.setFootprint(longFootprint());
+
+  std::vector<geometry_msgs::Pose2D> poses;
+  poses.push_back(pose(3.05, 3.05, 0.0));        // lengthwise over the obstacle
+  poses.push_back(pose(3.05, 3.05, M_PI / 2));   // across it, clear by 0.3 m
+  poses.push_back(pose(0.3, 3.05, 0.0));         // half off the map
+  poses.push_back(pose(1.05, 1.05, M_PI / 2));   // far from everything
+  std::vector<FootprintCheck> results;
+  checker.check(map, poses, std::vector<std::vector<geometry_msgs::Point> >(), 1.0, &results);
+  ASSERT_EQ(4u, results.size());
+
+  EXPECT_TRUE(results[0].lethal);
+  EXPECT_EQ(LETHAL_OBSTACLE, results[0].max_cost);
+  EXPECT_EQ(0.0, results[0].clearance);
+
+  EXPECT_FALSE(results[1].lethal);
+  EXPECT_EQ(100, results[1].max_cost);
+  EXPECT_NEAR(0.3, results[1].clearance, 1e-6);
+
+  EXPECT_FALSE(results[2].lethal);
+  EXPECT_EQ(NO_INFORMATION, results[2].max_cost);
+
+  EXPECT_FALSE(results[3].lethal);
+  EXPECT_EQ(FREE_SPACE, results[3].max_cost);
+  EXPECT_EQ(1.0, results[3].clearance);
+}
+
+TEST(footprint_checker, own_footprints)
+{
+  Costmap2D map(60, 60, 0.1, 0.0, 0.0);
+  map.setCost(35, 30, LETHAL_OBSTACLE);
+  FootprintChecker checker;
+  checker.setFootprint(longFootprint());
+
+  // the same pose is clear for a small robot, given by a footprint of its own, and not for the robot
+  std::vector<geometry_msgs::Point> small = longFootprint();
+  for (unsigned int i = 0; i < small.size(); ++i)
+    small[i].x /= 3;
+  std::vector<geometry_msgs::Pose2D> poses(2, pose(3.05, 3.05, 0.0));
+  std::vector<std::vector<geometry_msgs::Point> > footprints(2);
+  footprints[1] = small;
+  std::vector<FootprintCheck> results;
+  checker.check(map, poses, footprints, 0.5, &results);
+  EXPECT_TRUE(results[0].lethal);
+  EXPECT_FALSE(results[1].lethal);
+  EXPECT_NEAR(0.3, results[1].clearance, 1e-6);
+}
+
+TEST(footprint_checker, many_poses_match_one_by_one)
+{
+  Costmap2D map(80, 80, 0.05, 0.0, 0.0);
+  srand(5);
+  for (unsigned int i = 0; i < 200; ++i)
+    map.setCost(rand() % 80, rand() % 80, rand() % 3 ? LETHAL_OBSTACLE : 128);
+  FootprintChecker checker(16);
+  checker.setFootprint(longFootprint());
+
+  std::vector<geometry_msgs::Pose2D> poses;
+  for (unsigned int i = 0; i < 100; ++i)
+    poses.push_back(pose(4.0 * rand() / RAND_MAX, 4.0 * rand() / RAND_MAX, 2 * M_PI * rand() / RAND_MAX - M_PI));
+  std::vector<std::vector<geometry_msgs::Point> > none;
+  std::vector<FootprintCheck> all, one;
+  checker.check(map, poses, none, 0.5, &all);
+  for (unsigned int i = 0; i < poses.size(); ++i)
+  {
+    checker.check(map, std::vector<geometry_msgs::Pose2D>(1, poses[i]), none, 0.5, &one);
+    EXPECT_EQ(one[0].max_cost, all[i].max_cost);
+    EXPECT_EQ(one[0].lethal, all[i].lethal);
+    EXPECT_EQ(one[0].clearance, all[i].clearance);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -127,6 +127,42 @@ void validatePointInflation(unsigned int mx, unsigned int my, Costmap2D* costmap
   delete[] seen;
 }
 
+// Inflate the lethal cells of a map the way the inflation layer did before it
+// switched from a priority queue to distance buckets
+void inflateWithPriorityQueue(Costmap2D* costmap, InflationLayer* ilayer, unsigned int cell_inflation_radius)
+{
+  unsigned int size_x = costmap->getSizeInCellsX(), size_y = costmap->getSizeInCellsY();
+  unsigned char* master = costmap->getCharMap();
+  std::vector<bool> seen(size_x * size_y, false);
+  std::priority_queue<CellData> q;
+
+  for (unsigned int j = 0; j < size_y; j++)
+    for (unsigned int i = 0; i < size_x; i++)
+      if (master[costmap->getIndex(i, j)] == LETHAL_OBSTACLE)
+        q.push(CellData(0, costmap->getIndex(i, j), i, j, i, j));
+
+  while (!q.empty())
+  {
+    CellData cell = q.top();
+    q.pop();
+    if (seen[cell.index_])
+      continue;
+    seen[cell.index_] = true;
+    master[cell.index_] = std::max(master[cell.index_], ilayer->computeCost(cell.distance_));
+
+    int neighbors[4][2] = {{-1, 0}, {0, -1}, {1, 0}, {0, 1}};
+    for (int n = 0; n < 4; n++)
+    {
+      int x = int(cell.x_) + neighbors[n][0], y = int(cell.y_) + neighbors[n][1];
+      if (x < 0 || y < 0 || x >= int(size_x) || y >= int(size_y) || seen[costmap->getIndex(x, y)])
+        continue;
+      double dist = hypot(x - int(cell.src_x_), y - int(cell.src_y_));
+      if (dist <= cell_inflation_radius)
+        q.push(CellData(dist, costmap->getIndex(x, y), x, y, cell.src_x_, cell.src_y_));
+    }
+  }
+}
+
 TEST(costmap, testAdjacentToObstacleCanStillMove){
   tf::TransformListener tf;
   LayeredCostmap layers("frame", false, false);
@@ -402,6 +438,292 @@ TEST(costmap, testInflation3){
   ASSERT_EQ(countValues(*costmap, INSCRIBED_INFLATED_OBSTACLE), (unsigned int)4);
 }
 
+/**
+ * Test that the bucketed inflation gives the same costs as a priority queue
+ * on a map of well separated obstacles
+ */
+TEST(costmap, testBucketQueueMatchesPriorityQueue){
+  tf::TransformListener tf;
+  LayeredCostmap layers("frame", false, false);
+  layers.resizeMap(400, 400, 1, 0, 0);
+
+  const double inflation_radius = 10.5;
+  std::vector<Point> polygon = setRadii(layers, 2.1, 2.3, inflation_radius);
+
+  InflationLayer* ilayer = addInflationLayer(layers, tf);
+  layers.setFootprint(polygon);
+
+  // Obstacles further apart than twice the inflation radius, so that no cell
+  // is equally far from two of them and the order ties are taken in is moot
+  Costmap2D obstacles(400, 400, 1, 0, 0);
+  for (unsigned int j = 5; j < 400; j += 25)
+    for (unsigned int i = 5 + j % 7; i < 400; i += 25)
+      obstacles.setCost(i, j, LETHAL_OBSTACLE);
+
+  Costmap2D bucketed(obstacles), reference(obstacles);
+  ilayer->updateCosts(bucketed, 0, 0, 400, 400);
+  inflateWithPriorityQueue(&reference, ilayer, (unsigned int)ceil(inflation_radius));
+
+  for (unsigned int j = 0; j < 400; j++)
+    for (unsigned int i = 0; i < 400; i++)
+      ASSERT_EQ(reference.getCost(i, j), bucketed.getCost(i, j));
+}
+/**
+ * Test that the incremental mode follows obstacles being added and removed
+ * the same way as inflating from scratch
+ */
+TEST(costmap, testIncrementalInflation){
+  tf::TransformListener tf;
+  LayeredCostmap layers("frame", false, false);
+  layers.resizeMap(100, 100, 1, 0, 0);
+
+  const double inflation_radius = 6.5;
+  std::vector<Point> polygon = setRadii(layers, 2.1, 2.3, inflation_radius);
+
+  ros::NodeHandle nh;
+  nh.setParam("/inflation_tests/incremental_inflation/inflation_radius", inflation_radius);
+  nh.setParam("/inflation_tests/incremental_inflation/incremental", true);
+
+  InflationLayer* ilayer = addInflationLayer(layers, tf);
+  InflationLayer* incremental = new InflationLayer();
+  incremental->initialize(&layers, "incremental_inflation", &tf);
+  layers.addPlugin(boost::shared_ptr<Layer>(incremental));
+  layers.setFootprint(polygon);
+
+  // Obstacles further apart than twice the inflation radius, as above, which
+  // come and go over the cycles
+  Costmap2D obstacles(100, 100, 1, 0, 0);
+  for (int cycle = 0; cycle < 6; cycle++)
+  {
+    for (unsigned int j = 3; j < 100; j += 15)
+      for (unsigned int i = 3 + j % 4; i < 100; i += 15)
+        obstacles.setCost(i, j, (i + j + cycle) % 3 ? LETHAL_OBSTACLE : FREE_SPACE);
+
+    Costmap2D expected(obstacles), actual(obstacles);
+    ilayer->updateCosts(expected, 0, 0, 100, 100);
+    incremental->updateCosts(actual, 0, 0, 100, 100);
+
+    for (unsigned int j = 0; j < 100; j++)
+      for (unsigned int i = 0; i < 100; i++)
+        ASSERT_EQ(expected.getCost(i, j), actual.getCost(i, j));
+  }
+}
+/**
+ * Test that inflating from the distance transform, split over threads, gives the
+ * same costs as the wavefront
+ */
+TEST(costmap, testDistanceTransformInflation){
+  tf::TransformListener tf;
+  LayeredCostmap layers("frame", false, false);
+  layers.resizeMap(400, 400, 1, 0, 0);
+
+  const double inflation_radius = 10.5;
+  std::vector<Point> polygon = setRadii(layers, 2.1, 2.3, inflation_radius);
+
+  ros::NodeHandle nh;
+  nh.setParam("/inflation_tests/transform_inflation/inflation_radius", inflation_radius);
+  nh.setParam("/inflation_tests/transform_inflation/distance_transform", true);
+  nh.setParam("/inflation_tests/transform_inflation/distance_transform_threads", 3);
+
+  InflationLayer* ilayer = addInflationLayer(layers, tf);
+  InflationLayer* transform = new InflationLayer();
+  transform->initialize(&layers, "transform_inflation", &tf);
+  layers.addPlugin(boost::shared_ptr<Layer>(transform));
+  layers.setFootprint(polygon);
+
+  // Obstacles further apart than twice the inflation radius, as above
+  Costmap2D obstacles(400, 400, 1, 0, 0);
+  for (unsigned int j = 5; j < 400; j += 25)
+    for (unsigned int i = 5 + j % 7; i < 400; i += 25)
+      obstacles.setCost(i, j, LETHAL_OBSTACLE);
+
+  // the transform runs twice, on the same workers, to give the same costs again
+  Costmap2D expected(obstacles), actual(obstacles);
+  ilayer->updateCosts(expected, 0, 0, 400, 400);
+  for (int r = 0; r < 2; r++)
+  {
+    actual = obstacles;
+    transform->updateCosts(actual, 0, 0, 400, 400);
+  }
+
+  for (unsigned int j = 0; j < 400; j++)
+    for (unsigned int i = 0; i < 400; i++)
+      ASSERT_EQ(expected.getCost(i, j), actual.getCost(i, j));
+
+  // only the cells of the bounds given are written
+  actual = obstacles;
+  transform->updateCosts(actual, 100, 100, 200, 200);
+  ASSERT_NE(FREE_SPACE, expected.getCost(152, 153));
+  ASSERT_EQ(expected.getCost(152, 153), actual.getCost(152, 153));
+  ASSERT_NE(FREE_SPACE, expected.getCost(85, 80));
+  ASSERT_EQ(FREE_SPACE, actual.getCost(85, 80));
+}
+/**
+ * Test that stamping the cost kernel around the obstacles gives the same costs as the wavefront
+ */
+TEST(costmap, testKernelStampingInflation){
+  tf::TransformListener tf;
+  LayeredCostmap layers("frame", false, false);
+  layers.resizeMap(200, 200, 1, 0, 0);
+
+  const double inflation_radius = 10.5;
+  std::vector<Point> polygon = setRadii(layers, 2.1, 2.3, inflation_radius);
+
+  ros::NodeHandle nh;
+  nh.setParam("/inflation_tests/stamped_inflation/inflation_radius", inflation_radius);
+  nh.setParam("/inflation_tests/stamped_inflation/kernel_stamping", true);
+
+  InflationLayer* ilayer = addInflationLayer(layers, tf);
+  InflationLayer* stamped = new InflationLayer();
+  stamped->initialize(&layers, "stamped_inflation", &tf);
+  layers.addPlugin(boost::shared_ptr<Layer>(stamped));
+  layers.setFootprint(polygon);
+
+  // Obstacles further apart than twice the inflation radius, with unknown space between some
+  Costmap2D obstacles(200, 200, 1, 0, 0);
+  for (unsigned int j = 5; j < 200; j += 25)
+    for (unsigned int i = 5 + j % 7; i < 200; i += 25)
+      obstacles.setCost(i, j, LETHAL_OBSTACLE);
+  for (unsigned int j = 0; j < 200; j++)
+    obstacles.setCost(100, j, NO_INFORMATION);
+
+  Costmap2D expected(obstacles), actual(obstacles);
+  ilayer->updateCosts(expected, 0, 0, 200, 200);
+  stamped->updateCosts(actual, 0, 0, 200, 200);
+  for (unsigned int j = 0; j < 200; j++)
+    for (unsigned int i = 0; i < 200; i++)
+      ASSERT_EQ(expected.getCost(i, j), actual.getCost(i, j));
+
+  // tiles would run the wavefront rather than the stamping
+  ASSERT_TRUE(ilayer->isTileSafe());
+  ASSERT_FALSE(stamped->isTileSafe());
+}
+
+/**
+ * Test that keeping the inflation of the static map and only inflating the obstacles gives the same costs
+ */
+TEST(costmap, testStaticBaseInflation){
+  tf::TransformListener tf;
+  LayeredCostmap layers("frame", false, false), split("frame", false, false);
+  std::vector<Point> polygon = setRadii(layers, 1, 1, 3);
+
+  ros::NodeHandle nh;
+  nh.setParam("/inflation_tests/static_base_inflation/inflation_radius", 3.0);
+  nh.setParam("/inflation_tests/static_base_inflation/cost_scaling_factor", 1.0);
+  nh.setParam("/inflation_tests/static_base_inflation/static_base", true);
+
+  addStaticLayer(layers, tf);
+  ObstacleLayer* olayer = addObstacleLayer(layers, tf);
+  addInflationLayer(layers, tf);
+  layers.setFootprint(polygon);
+
+  addStaticLayer(split, tf);
+  ObstacleLayer* split_olayer = addObstacleLayer(split, tf);
+  InflationLayer* ilayer = new InflationLayer();
+  ilayer->initialize(&split, "static_base_inflation", &tf);
+  split.addPlugin(boost::shared_ptr<Layer>(ilayer));
+  split.setFootprint(polygon);
+
+  for (unsigned int k = 0; k < 4; k++)
+  {
+    double x = (k * 3) % 10, y = (k * 7) % 10;
+    addObservation(olayer, x, y, MAX_Z);
+    addObservation(split_olayer, x, y, MAX_Z);
+    layers.updateMap(0, 0, 0);
+    split.updateMap(0, 0, 0);
+
+    Costmap2D* expected = layers.getCostmap();
+    Costmap2D* actual = split.getCostmap();
+    for (unsigned int j = 0; j < expected->getSizeInCellsY(); j++)
+      for (unsigned int i = 0; i < expected->getSizeInCellsX(); i++)
+        ASSERT_EQ(expected->getCost(i, j), actual->getCost(i, j));
+  }
+}
+
+/**
+ * Test that updating the layers tile by tile on several threads gives the
+ * same costs as updating them over the whole bounds at once
+ */
+TEST(costmap, testTiledInflation){
+  tf::TransformListener tf;
+  LayeredCostmap serial("frame", false, false), tiled("frame", false, false);
+  serial.resizeMap(100, 100, 1, 0, 0);
+  tiled.resizeMap(100, 100, 1, 0, 0);
+  tiled.setTiling(16, 4);
+
+  std::vector<Point> polygon = setRadii(serial, 2.1, 2.3, 6.5);
+  tiled.setFootprint(polygon);
+
+  ObstacleLayer* serial_obstacles = addObstacleLayer(serial, tf);
+  addInflationLayer(serial, tf);
+  serial.setFootprint(polygon);
+  ObstacleLayer* tiled_obstacles = addObstacleLayer(tiled, tf);
+  addInflationLayer(tiled, tf);
+  tiled.setFootprint(polygon);
+
+  for (unsigned int k = 0; k < 40; k++)
+  {
+    double x = (k * 37) % 100, y = (k * 61) % 100;
+    addObservation(serial_obstacles, x, y, MAX_Z);
+    addObservation(tiled_obstacles, x, y, MAX_Z);
+  }
+
+  serial.updateMap(0, 0, 0);
+  tiled.updateMap(0, 0, 0);
+
+  unsigned int x0, xn, y0, yn;
+  serial.getBounds(&x0, &xn, &y0, &yn);
+  for (unsigned int j = y0; j < yn; j++)
+    for (unsigned int i = x0; i < xn; i++)
+      ASSERT_EQ(serial.getCostmap()->getCost(i, j), tiled.getCostmap()->getCost(i, j));
+}
+
+/**
+ * Test that a layer inflating from the distance transform is kept off the tiles, which would run the wavefront,
+ * and still gives the costs of the wavefront with tiling on
+ */
+TEST(costmap, testTiledDistanceTransform){
+  tf::TransformListener tf;
+  LayeredCostmap serial("frame", false, false), tiled("frame", false, false);
+  serial.resizeMap(100, 100, 1, 0, 0);
+  tiled.resizeMap(100, 100, 1, 0, 0);
+  tiled.setTiling(16, 4);
+
+  std::vector<Point> polygon = setRadii(serial, 2.1, 2.3, 6.5);
+  tiled.setFootprint(polygon);
+
+  ros::NodeHandle nh;
+  nh.setParam("/inflation_tests/tiled_transform_inflation/inflation_radius", 6.5);
+  nh.setParam("/inflation_tests/tiled_transform_inflation/distance_transform", true);
+
+  ObstacleLayer* serial_obstacles = addObstacleLayer(serial, tf);
+  InflationLayer* wavefront = addInflationLayer(serial, tf);
+  serial.setFootprint(polygon);
+  ObstacleLayer* tiled_obstacles = addObstacleLayer(tiled, tf);
+  InflationLayer* transform = new InflationLayer();
+  transform->initialize(&tiled, "tiled_transform_inflation", &tf);
+  tiled.addPlugin(boost::shared_ptr<Layer>(transform));
+  tiled.setFootprint(polygon);
+
+  ASSERT_TRUE(wavefront->isTileSafe());
+  ASSERT_FALSE(transform->isTileSafe());
+
+  for (unsigned int k = 0; k < 40; k++)
+  {
+    double x = (k * 37) % 100, y = (k * 61) % 100;
+    addObservation(serial_obstacles, x, y, MAX_Z);
+    addObservation(tiled_obstacles, x, y, MAX_Z);
+  }
+
+  serial.updateMap(0, 0, 0);
+  tiled.updateMap(0, 0, 0);
+
+  unsigned int x0, xn, y0, yn;
+  serial.getBounds(&x0, &xn, &y0, &yn);
+  for (unsigned int j = y0; j < yn; j++)
+    for (unsigned int i = x0; i < xn; i++)
+      ASSERT_EQ(serial.getCostmap()->getCost(i, j), tiled.getCostmap()->getCost(i, j));
+}
 
 int main(int argc, char** argv){
   ros::init(argc, argv, "inflation_tests");
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <string>
+
+#include "costmap_2d/cost_values.h"
+#include "costmap_2d/costmap_2d.h"
+
+using namespace costmap_2d;
+
+// How many entries there are in the directory whose names start with the prefix
+static int countEntries(const char* directory, const std::string& prefix)
+{
+  DIR* dir = opendir(directory);
+  if (!dir)
+    return -1;
+  int count = 0;
+  while (struct dirent* entry = readdir(dir))
+  {
+    if (std::string(entry->d_name).compare(0, prefix.size(), prefix) == 0)
+      ++count;
+  }
+  closedir(dir);
+  return count;
+}
+
+TEST(lazy_costmap, uniform_files)
+{
+  int fds = countEntries("/proc/self/fd", "");
+  int shm_files = countEntries("/dev/shm", "costmap_2d_");
+
+  // big enough to be mapped lazily, from the file of its default value
+  for (int i = 0; i < 4; ++i)
+  {
+    Costmap2D map(5000, 4000, 0.05, 0.0, 0.0, NO_INFORMATION);
+    EXPECT_EQ(NO_INFORMATION, map.getCost(0, 0));
+    EXPECT_EQ(NO_INFORMATION, map.getCost(4999, 3999));
+    map.setCost(4999, 3999, LETHAL_OBSTACLE);
+    EXPECT_EQ(LETHAL_OBSTACLE, map.getCost(4999, 3999));
+
+    // a reset maps the file over the written pages again
+    map.resetMap(0, 0, 5000, 4000);
+    EXPECT_EQ(NO_INFORMATION, map.getCost(4999, 3999));
+  }
+
+  // the maps of one value share one file, which leaves no name behind
+  if (fds >= 0)
+    EXPECT_LE(countEntries("/proc/self/fd", ""), fds + 1);
+  if (shm_files >= 0)
+    EXPECT_EQ(shm_files, countEntries("/dev/shm", "costmap_2d_"));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -33,9 +33,12 @@
  */
 
 #include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/decaying_obstacle_layer.h>
 #include <costmap_2d/layered_costmap.h>
 #include <costmap_2d/observation_buffer.h>
+#include <costmap_2d/observation_hub.h>
 #include <costmap_2d/testing_helper.h>
+#include <limits>
 #include <set>
 #include <gtest/gtest.h>
 #include <tf/transform_listener.h>
@@ -244,6 +247,277 @@ TEST(costmap, testMultipleAdditions){
 
 }
 
+/**
+ * Verify that running the bounds of several obstacle layers at once gives the same map as running them in turn
+ */
+TEST(costmap, testParallelBounds){
+  tf::TransformListener tf;
+  LayeredCostmap serial("frame", false, false), parallel("frame", false, false);
+  parallel.setParallelBounds(3);
+  addStaticLayer(serial, tf);
+  addStaticLayer(parallel, tf);
+
+  ObstacleLayer* serial_layers[3];
+  ObstacleLayer* parallel_layers[3];
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    serial_layers[i] = addObstacleLayer(serial, tf);
+    parallel_layers[i] = addObstacleLayer(parallel, tf);
+  }
+
+  for (unsigned int k = 0; k < 12; k++)
+  {
+    double x = (k * 3) % 10 + 0.5, y = (k * 7) % 10 + 0.5;
+    addObservation(serial_layers[k % 3], x, y, MAX_Z/2);
+    addObservation(parallel_layers[k % 3], x, y, MAX_Z/2);
+  }
+
+  serial.updateMap(0,0,0);
+  parallel.updateMap(0,0,0);
+
+  Costmap2D* a = serial.getCostmap();
+  Costmap2D* b = parallel.getCostmap();
+  for (unsigned int j = 0; j < a->getSizeInCellsY(); j++)
+    for (unsigned int i = 0; i < a->getSizeInCellsX(); i++)
+      ASSERT_EQ(a->getCost(i, j), b->getCost(i, j));
+
+  const std::vector<LayeredCostmap::Region>& ra = serial.getUpdatedRegions();
+  const std::vector<LayeredCostmap::Region>& rb = parallel.getUpdatedRegions();
+  ASSERT_EQ(ra.size(), rb.size());
+  for (unsigned int i = 0; i < ra.size(); i++)
+  {
+    ASSERT_EQ(ra[i].x0, rb[i].x0);
+    ASSERT_EQ(ra[i].xn, rb[i].xn);
+    ASSERT_EQ(ra[i].y0, rb[i].y0);
+    ASSERT_EQ(ra[i].yn, rb[i].yn);
+  }
+}
+
+/**
+ * Verify that a layer with an update period keeps what it put in the costmap until the period has passed
+ */
+TEST(costmap, testLayerUpdatePeriod){
+  tf::TransformListener tf;
+  LayeredCostmap layers("frame", false, true);
+  layers.resizeMap(10, 10, 1, 0, 0);
+  ObstacleLayer* olayer = addObstacleLayer(layers, tf);
+  olayer->setUpdatePeriod(1000.0);
+
+  addObservation(olayer, 7.0, 7.0);
+  layers.updateMap(0,0,0);
+  Costmap2D* costmap = layers.getCostmap();
+  ASSERT_EQ(1, countValues(*costmap, costmap_2d::LETHAL_OBSTACLE));
+
+  // not marked before the period is up, while the obstacle seen already stays
+  addObservation(olayer, 3.0, 5.0);
+  layers.updateMap(0,0,0);
+  ASSERT_EQ(1, countValues(*costmap, costmap_2d::LETHAL_OBSTACLE));
+
+  layers.forceFullUpdate();
+  layers.updateMap(0,0,0);
+  ASSERT_EQ(2, countValues(*costmap, costmap_2d::LETHAL_OBSTACLE));
+}
+
+/**
+ * Verify that a static layer with packed storage merges the same costs as one without
+ */
+TEST(costmap, testPackedStaticLayer){
+  tf::TransformListener tf;
+  LayeredCostmap plain("frame", false, false), packed("frame", false, false);
+  addStaticLayer(plain, tf);
+
+  ros::NodeHandle nh;
+  nh.setParam("/obstacle_tests/packed_static/packed_storage", true);
+  StaticLayer* slayer = new StaticLayer();
+  packed.addPlugin(boost::shared_ptr<Layer>(slayer));
+  slayer->initialize(&packed, "packed_static", &tf);
+
+  plain.updateMap(0,0,0);
+  packed.updateMap(0,0,0);
+  Costmap2D* expected = plain.getCostmap();
+  Costmap2D* costmap = packed.getCostmap();
+  ASSERT_EQ(expected->getSizeInCellsX(), costmap->getSizeInCellsX());
+  ASSERT_EQ(expected->getSizeInCellsY(), costmap->getSizeInCellsY());
+  for (unsigned int j = 0; j < costmap->getSizeInCellsY(); ++j)
+  {
+    for (unsigned int i = 0; i < costmap->getSizeInCellsX(); ++i)
+      ASSERT_EQ(expected->getCost(i, j), costmap->getCost(i, j));
+  }
+
+  // rows that start and end off a byte of the packed costs
+  unsigned char row[7];
+  slayer->copyRow(1, 3, 7, row);
+  for (unsigned int i = 0; i < 7; ++i)
+    ASSERT_EQ(expected->getCost(i + 1, 3), row[i]);
+}
+
+/**
+ * Verify that the stamp of the newest observation is carried through an update
+ */
+TEST(costmap, testNewestObservationTime){
+  tf::TransformListener tf;
+  LayeredCostmap layers("frame", false, false);
+  addStaticLayer(layers, tf);
+  ObstacleLayer* olayer = addObstacleLayer(layers, tf);
+
+  layers.updateMap(0,0,0);
+  ASSERT_TRUE(layers.getNewestObservationTime().isZero());
+
+  geometry_msgs::Point p;
+  p.z = MAX_Z;
+  for (int i = 0; i < 2; i++)
+  {
+    pcl::PointCloud<pcl::PointXYZ> cloud;
+    cloud.points.resize(1);
+    cloud.points[0].x = 4.5 + i;
+    cloud.points[0].y = 4.5;
+    cloud.header.stamp = (uint64_t)(12 - i) * 1000000;  // PCL stamps are in microseconds
+    Observation obs(p, cloud, 100.0, 100.0);
+    olayer->addStaticObservation(obs, true, false);
+  }
+
+  layers.updateMap(0,0,0);
+  ASSERT_EQ(12.0, olayer->getNewestObservationTime().toSec());
+  ASSERT_EQ(12.0, layers.getNewestObservationTime().toSec());
+}
+
+/**
+ * Verify that copies of an observation share its cloud rather than copying the points
+ */
+TEST(costmap, testObservationCopiesShareCloud){
+  geometry_msgs::Point p;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.points.resize(1000);
+  Observation obs(p, cloud, 100.0, 100.0);
+
+  std::vector<Observation> observations(3, obs);
+  Observation assigned;
+  assigned = observations[2];
+  ASSERT_EQ(obs.cloud_.get(), observations[0].cloud_.get());
+  ASSERT_EQ(obs.cloud_.get(), assigned.cloud_.get());
+  ASSERT_EQ(1000u, assigned.cloud_->points.size());
+}
+
+/**
+ * Verify that the decaying layer frees its marks once they have not been seen for the decay time
+ */
+TEST(costmap, testDecayingObstacles){
+  tf::TransformListener tf;
+  LayeredCostmap layers("frame", false, false);
+  layers.resizeMap(10, 10, 1, 0, 0);
+
+  ros::param::set("~decaying/decay_time", 0.5);
+  ros::param::set("~decaying/clearing_rate", 0.0);
+  DecayingObstacleLayer* dlayer = new DecayingObstacleLayer();
+  dlayer->initialize(&layers, "decaying", &tf);
+  layers.addPlugin(boost::shared_ptr<Layer>(dlayer));
+
+  geometry_msgs::Point p;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.points.resize(2);
+  cloud.points[0].x = 3.5;
+  cloud.points[0].y = 3.5;
+  cloud.points[1].x = 6.5;
+  cloud.points[1].y = 6.5;
+  Observation obs(p, cloud, 100.0, 100.0);
+  dlayer->addStaticObservation(obs, true, true);
+  layers.updateMap(0,0,0);
+  ASSERT_EQ(2, countValues(*(layers.getCostmap()), LETHAL_OBSTACLE));
+
+  // with clearing off, nothing clears the marks but their age
+  dlayer->clearStaticObservations(true, true);
+  layers.updateMap(0,0,0);
+  ASSERT_EQ(2, countValues(*(layers.getCostmap()), LETHAL_OBSTACLE));
+
+  ros::WallDuration(0.6).sleep();
+  layers.updateMap(0,0,0);
+  ASSERT_EQ(0, countValues(*(layers.getCostmap()), LETHAL_OBSTACLE));
+}
+
+/**
+ * Verify that marking the points of a cloud two at a time marks the same cells and bounds as marking them one by one,
+ * with points out of the map, too high, too far and not a number among them, and an odd point left over at the end
+ */
+TEST(costmap, testVectorMarkingMatchesScalar){
+  tf::TransformListener tf;
+  LayeredCostmap whole("frame", false, true), single("frame", false, true);
+  whole.resizeMap(40, 40, 0.25, -1.5, -2.0);
+  single.resizeMap(40, 40, 0.25, -1.5, -2.0);
+  ObstacleLayer* vector_layer = addObstacleLayer(whole, tf);
+  ObstacleLayer* scalar_layer = addObstacleLayer(single, tf);
+
+  geometry_msgs::Point origin;
+  origin.x = 4.0;
+  origin.y = 3.0;
+  origin.z = MAX_Z / 2;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.points.resize(1001);
+  srand(3);
+  for (unsigned int i = 0; i < cloud.points.size(); ++i)
+  {
+    // up to a few meters off every side of the map, and up to twice as high as the layer keeps
+    cloud.points[i].x = -4.0 + 16.0 * rand() / RAND_MAX;
+    cloud.points[i].y = -5.0 + 16.0 * rand() / RAND_MAX;
+    cloud.points[i].z = 2 * MAX_Z * rand() / RAND_MAX;
+    if (i % 97 == 0)
+      cloud.points[i].x = std::numeric_limits<float>::quiet_NaN();
+    if (i % 89 == 0)
+      cloud.points[i].z = std::numeric_limits<float>::quiet_NaN();
+  }
+
+  // a cloud of one point leaves nothing to pair up, so each of these is marked by the scalar loop
+  Observation obs(origin, cloud, 6.0, 6.0);
+  vector_layer->addStaticObservation(obs, true, false);
+  for (unsigned int i = 0; i < cloud.points.size(); ++i)
+  {
+    pcl::PointCloud<pcl::PointXYZ> point;
+    point.points.push_back(cloud.points[i]);
+    Observation point_obs(origin, point, 6.0, 6.0);
+    scalar_layer->addStaticObservation(point_obs, true, false);
+  }
+
+  double vector_bounds[4] = {1e30, 1e30, -1e30, -1e30}, scalar_bounds[4] = {1e30, 1e30, -1e30, -1e30};
+  vector_layer->updateBounds(0, 0, 0, &vector_bounds[0], &vector_bounds[1], &vector_bounds[2], &vector_bounds[3]);
+  scalar_layer->updateBounds(0, 0, 0, &scalar_bounds[0], &scalar_bounds[1], &scalar_bounds[2], &scalar_bounds[3]);
+  for (unsigned int i = 0; i < 4; ++i)
+    ASSERT_EQ(scalar_bounds[i], vector_bounds[i]);
+
+  unsigned int marked = 0;
+  for (unsigned int j = 0; j < scalar_layer->getSizeInCellsY(); ++j)
+  {
+    for (unsigned int i = 0; i < scalar_layer->getSizeInCellsX(); ++i)
+    {
+      ASSERT_EQ(scalar_layer->getCost(i, j), vector_layer->getCost(i, j)) << "cell " << i << ", " << j;
+      marked += scalar_layer->getCost(i, j) == LETHAL_OBSTACLE;
+    }
+  }
+  ASSERT_GT(marked, 0u);
+}
+
+static void countCreation(ObservationSource& source, int* created)
+{
+  ++*created;
+}
+
+/**
+ * Verify that layers asking for a source the same way share it, for as long as one of them holds it
+ */
+TEST(costmap, testObservationHubShares){
+  int created = 0;
+  ObservationHub& hub = ObservationHub::instance();
+  boost::shared_ptr<ObservationSource> a = hub.acquire("scan", boost::bind(countCreation, _1, &created));
+  boost::shared_ptr<ObservationSource> b = hub.acquire("scan", boost::bind(countCreation, _1, &created));
+  boost::shared_ptr<ObservationSource> c = hub.acquire("cloud", boost::bind(countCreation, _1, &created));
+  ASSERT_EQ(a.get(), b.get());
+  ASSERT_NE(a.get(), c.get());
+  ASSERT_EQ(2, created);
+
+  a.reset();
+  b.reset();
+  a = hub.acquire("scan", boost::bind(countCreation, _1, &created));
+  ASSERT_EQ(3, created);
+}
+
 
 int main(int argc, char** argv){
   ros::init(argc, argv, "obstacle_tests");
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "costmap_2d/shared_costmap.h"
+
+using namespace costmap_2d;
+
+TEST(shared_costmap, round_trip)
+{
+  Costmap2D map(100, 50, 0.05, 1.0, 2.0, 0);
+  map.setCost(3, 4, 254);
+  SharedCostmapPublisher publisher(&map, "map", "/costmap_2d_shared_costmap_test");
+  publisher.publish(1.0);
+  ASSERT_TRUE(publisher.active());
+
+  SharedCostmapReader reader("/costmap_2d_shared_costmap_test");
+  Costmap2D copy;
+  ASSERT_TRUE(reader.read(copy));
+  EXPECT_EQ(100, copy.getSizeInCellsX());
+  EXPECT_EQ(50, copy.getSizeInCellsY());
+  EXPECT_EQ(2.0, copy.getOriginY());
+  EXPECT_EQ(254, copy.getCost(3, 4));
+
+  // only the given bounds are copied
+  map.setCost(10, 10, 100);
+  map.setCost(20, 20, 100);
+  publisher.updateBounds(10, 11, 10, 11);
+  publisher.publish(2.0);
+  ASSERT_TRUE(reader.read(copy));
+  EXPECT_EQ(100, copy.getCost(10, 10));
+  EXPECT_EQ(0, copy.getCost(20, 20));
+
+  // the header records which cells changed
+  const SharedCostmapHeader* header = reader.beginRead();
+  ASSERT_TRUE(header != NULL);
+  EXPECT_EQ(10u, header->x0);
+  EXPECT_EQ(11u, header->xn);
+  EXPECT_EQ(10u, header->y0);
+  EXPECT_EQ(11u, header->yn);
+  EXPECT_TRUE(reader.endRead());
+}
+
+TEST(shared_costmap, grow)
+{
+  Costmap2D map(10, 10, 0.05, 0.0, 0.0, 0);
+  SharedCostmapPublisher publisher(&map, "map", "/costmap_2d_shared_costmap_test");
+  publisher.publish(1.0);
+  SharedCostmapReader reader("/costmap_2d_shared_costmap_test");
+  Costmap2D copy;
+  ASSERT_TRUE(reader.read(copy));
+
+  // a map larger than the segment moves to a new one, which the reader follows
+  map.resizeMap(3000, 1000, 0.05, 0.0, 0.0);
+  map.setCost(2999, 999, 7);
+  publisher.publish(2.0);
+  ASSERT_TRUE(reader.read(copy));
+  EXPECT_EQ(3000, copy.getSizeInCellsX());
+  EXPECT_EQ(7, copy.getCost(2999, 999));
+}
+
+TEST(shared_costmap, no_segment)
+{
+  SharedCostmapReader reader("/costmap_2d_shared_costmap_test_missing");
+  Costmap2D copy;
+  EXPECT_FALSE(reader.read(copy));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
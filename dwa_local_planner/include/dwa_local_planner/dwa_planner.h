@@ -45,7 +45,7 @@
 
 //for creating a local cost grid
 #include <base_local_planner/map_grid_visualizer.h>
-#include <pcl_ros/publisher.h>
+#include <base_local_planner/background_cloud_publisher.h>
 
 //for obstacle data access
 #include <costmap_2d/costmap_2d.h>
@@ -54,11 +54,16 @@
 #include <base_local_planner/local_planner_limits.h>
 #include <base_local_planner/local_planner_util.h>
 #include <base_local_planner/simple_trajectory_generator.h>
+#include <base_local_planner/adaptive_trajectory_generator.h>
 
 #include <base_local_planner/oscillation_cost_function.h>
 #include <base_local_planner/map_grid_cost_function.h>
+#include <base_local_planner/fused_map_grid_cost_function.h>
 #include <base_local_planner/obstacle_cost_function.h>
+#include <base_local_planner/clearance_cost_function.h>
+#include <base_local_planner/in_place_rotation_checker.h>
 #include <base_local_planner/simple_scored_sampling_planner.h>
+#include <base_local_planner/cycle_stats_publisher.h>
 
 #include <nav_msgs/Path.h>
 
@@ -99,6 +104,37 @@ namespace dwa_local_planner {
           const Eigen::Vector3f vel,
           const Eigen::Vector3f vel_samples);
 
+      /**
+       * @brief  checkTrajectory() for the stop and rotate controller, which with sweep_rotation_check set
+       * checks a turn in place towards the goal heading by sweeping the footprint to it instead
+       * @param pos The robot's position
+       * @param vel The robot's velocity
+       * @param vel_samples The desired velocity
+       * @param footprint_spec The footprint of the robot
+       * @return True if the trajectory is valid, false otherwise
+       */
+      bool checkRotation(
+          const Eigen::Vector3f pos,
+          const Eigen::Vector3f vel,
+          const Eigen::Vector3f vel_samples,
+          const std::vector<geometry_msgs::Point>& footprint_spec);
+
+      /**
+       * @brief  Score many desired velocities for one position/velocity pair at once, on the scoring threads
+       * @param pos The robot's position
+       * @param vel The robot's velocity
+       * @param vel_samples The desired velocities
+       * @param costs Set to the cost of each desired velocity, negative if its trajectory is not legal
+       * @param rejected_by Unless NULL, set to the name of the critic that found each trajectory illegal, or empty
+       * @return How many of the trajectories are legal
+       */
+      unsigned int checkTrajectories(
+          const Eigen::Vector3f pos,
+          const Eigen::Vector3f vel,
+          const std::vector<Eigen::Vector3f>& vel_samples,
+          std::vector<double>& costs,
+          std::vector<std::string>* rejected_by = NULL);
+
       /**
        * @brief Given the current position and velocity of the robot, find the best trajectory to exectue
        * @param global_pose The current position of the robot 
@@ -112,6 +148,35 @@ namespace dwa_local_planner {
           tf::Stamped<tf::Pose>& drive_velocities,
           std::vector<geometry_msgs::Point> footprint_spec);
 
+      /**
+       * @brief Lets the obstacle critic settle points from the center cell alone, see ObstacleCostFunction::setCircumscribedCost
+       * @param cost The inflation cost at the circumscribed radius, 0 to trace every point
+       */
+      void setCircumscribedCost(unsigned char cost) { obstacle_costs_.setCircumscribedCost(cost); }
+
+      /**
+       * @brief Measures the critics and the generation in findBestPath, see SimpleScoredSamplingPlanner::setMeasureCritics
+       */
+      void setMeasureCritics(bool measure) { scored_sampling_planner_.setMeasureCritics(measure); }
+
+      /**
+       * @brief Stops findBestPath at the deadline, see SimpleScoredSamplingPlanner::setDeadline
+       * @param deadline The wall time to stop sampling at, zero for none
+       */
+      void setDeadline(const ros::WallTime& deadline) { scored_sampling_planner_.setDeadline(deadline); }
+
+      /**
+       * @return Whether the deadline cut the last findBestPath short
+       */
+      bool lastSearchCutShort() const { return scored_sampling_planner_.lastSearchCutShort(); }
+
+      /**
+       * @brief Fills in the trajectories and critics of the last findBestPath
+       */
+      void getCycleStats(base_local_planner::CycleStatsPublisher* stats) {
+        stats->setPlannerStats(scored_sampling_planner_, critic_names_);
+      }
+
       /**
        * @brief  Take in a new global plan for the local planner to follow, and adjust local costmaps
        * @param  new_plan The new global plan
@@ -138,9 +203,9 @@ namespace dwa_local_planner {
       bool getCellCosts(int cx, int cy, float &path_cost, float &goal_cost, float &occ_cost, float &total_cost);
 
       /**
-       * sets new plan and resets state
+       * sets new plan, which is kept without copying it, and resets state
        */
-      bool setPlan(const std::vector<geometry_msgs::PoseStamped>& orig_global_plan);
+      bool setPlan(const nav_core::PlanConstPtr& orig_global_plan);
 
     private:
 
@@ -159,7 +224,7 @@ namespace dwa_local_planner {
 
       boost::mutex configuration_mutex_;
       pcl::PointCloud<base_local_planner::MapGridCostPoint>* traj_cloud_;
-      pcl_ros::Publisher<base_local_planner::MapGridCostPoint> traj_cloud_pub_;
+      base_local_planner::BackgroundCloudPublisher<base_local_planner::MapGridCostPoint> traj_cloud_pub_;
       bool publish_cost_grid_pc_; ///< @brief Whether or not to build and publish a PointCloud
       bool publish_traj_pc_;
 
@@ -169,14 +234,23 @@ namespace dwa_local_planner {
 
       // see constructor body for explanations
       base_local_planner::SimpleTrajectoryGenerator generator_;
+      base_local_planner::AdaptiveTrajectoryGenerator adaptive_generator_;
+      bool adaptive_sampling_; ///< @brief Whether adaptive_generator_ samples in place of generator_
       base_local_planner::OscillationCostFunction oscillation_costs_;
       base_local_planner::ObstacleCostFunction obstacle_costs_;
+      base_local_planner::ClearanceCostFunction clearance_costs_;
       base_local_planner::MapGridCostFunction path_costs_;
       base_local_planner::MapGridCostFunction goal_costs_;
       base_local_planner::MapGridCostFunction goal_front_costs_;
       base_local_planner::MapGridCostFunction alignment_costs_;
+      base_local_planner::FusedMapGridCostFunction map_grid_costs_; ///< @brief Scores the four map grid critics in one pass, when fused
 
       base_local_planner::SimpleScoredSamplingPlanner scored_sampling_planner_;
+      std::vector<std::string> critic_names_; ///< @brief The names of the critics, in the order the planner was given them
+      std::vector<base_local_planner::Trajectory> check_trajs_; ///< @brief The trajectories of checkTrajectories, kept for their storage
+      std::vector<int> check_rejected_by_;
+      bool sweep_rotation_check_;
+      base_local_planner::InPlaceRotationChecker rotation_checker_;
   };
 };
 #endif
@@ -92,6 +92,15 @@ namespace dwa_local_planner {
        */
       bool computeVelocityCommands(geometry_msgs::Twist& cmd_vel);
 
+      /**
+       * @brief  computeVelocityCommands, sampling until the deadline at most once a valid trajectory is found
+       * @param cmd_vel Will be filled with the velocity command to be passed to the robot base
+       * @param deadline The wall time by which to return, zero for none
+       * @param degraded Set to true if the deadline cut the sampling short
+       * @return True if a valid trajectory was found, false otherwise
+       */
+      bool computeVelocityCommands(geometry_msgs::Twist& cmd_vel, const ros::WallTime& deadline, bool& degraded);
+
 
       /**
        * @brief  Given the current position, orientation, and velocity of the robot,
@@ -108,12 +117,30 @@ namespace dwa_local_planner {
        */
       bool setPlan(const std::vector<geometry_msgs::PoseStamped>& orig_global_plan);
 
+      /**
+       * @brief  Set the plan that the controller is following, keeping it without copying it
+       * @param orig_global_plan The plan to pass to the controller
+       * @return True if the plan was updated successfully, false otherwise
+       */
+      bool setSharedPlan(const nav_core::PlanConstPtr& orig_global_plan);
+
       /**
        * @brief  Check if the goal pose has been achieved
        * @return True if achieved, false otherwise
        */
       bool isGoalReached();
 
+      /**
+       * @brief  Cap the speeds from the next cycle on, without reconfiguring the planner
+       * @param max_trans_vel The highest translational speed, 0 or less to lift the cap
+       * @param max_rot_vel The highest rotational speed, 0 or less to lift the cap
+       * @return True, the cap always being applied
+       */
+      bool setSpeedLimit(double max_trans_vel, double max_rot_vel) {
+        planner_util_.setSpeedLimit(max_trans_vel, max_rot_vel);
+        return true;
+      }
+
 
 
       bool isInitialized() {
@@ -130,6 +157,12 @@ namespace dwa_local_planner {
 
       void publishGlobalPlan(std::vector<geometry_msgs::PoseStamped>& path);
 
+      /**
+       * @brief The cost the inflation layer gives cells further than the circumscribed radius from any obstacle,
+       * with the slack of the robot and the obstacle being anywhere in their cells, or 0 without such a layer
+       */
+      unsigned char circumscribedCost();
+
       tf::TransformListener* tf_; ///< @brief Used for transforming point clouds
 
       // for visualisation, publishers of global and local plan
@@ -138,6 +171,7 @@ namespace dwa_local_planner {
       base_local_planner::LocalPlannerUtil planner_util_;
 
       boost::shared_ptr<DWAPlanner> dp_; ///< @brief The trajectory controller
+      boost::shared_ptr<base_local_planner::CycleStatsPublisher> cycle_stats_; ///< @brief Times the stages of computeVelocityCommands
 
       costmap_2d::Costmap2DROS* costmap_ros_;
 
@@ -150,6 +184,7 @@ namespace dwa_local_planner {
 
 
       bool initialized_;
+      bool circumscribed_fast_path_; ///< @brief Whether to settle footprints from the inflation at their center
 
 
       base_local_planner::OdometryHelperRos odom_helper_;
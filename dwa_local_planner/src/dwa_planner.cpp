@@ -60,6 +60,12 @@ namespace dwa_local_planner {
         config.angular_sim_granularity,
         config.use_dwa,
         sim_period_);
+    adaptive_generator_.setParameters(
+        config.sim_time,
+        config.sim_granularity,
+        config.angular_sim_granularity,
+        config.use_dwa,
+        sim_period_);
 
     double resolution = planner_util_->getCostmap()->getResolution();
     pdist_scale_ = config.path_distance_bias;
@@ -73,6 +79,8 @@ namespace dwa_local_planner {
 
     occdist_scale_ = config.occdist_scale;
     obstacle_costs_.setScale(resolution * occdist_scale_);
+    clearance_costs_.setScale(config.clearance_scale);
+    clearance_costs_.setMaxClearance(config.max_clearance);
 
     stop_time_buffer_ = config.stop_time_buffer;
     oscillation_costs_.setOscillationResetDist(config.oscillation_reset_dist, config.oscillation_reset_angle);
@@ -116,10 +124,12 @@ namespace dwa_local_planner {
   DWAPlanner::DWAPlanner(std::string name, base_local_planner::LocalPlannerUtil *planner_util) :
       planner_util_(planner_util),
       obstacle_costs_(planner_util->getCostmap()),
+      clearance_costs_(planner_util->getCostmap()),
       path_costs_(planner_util->getCostmap()),
       goal_costs_(planner_util->getCostmap(), 0.0, 0.0, true),
       goal_front_costs_(planner_util->getCostmap(), 0.0, 0.0, true),
-      alignment_costs_(planner_util->getCostmap())
+      alignment_costs_(planner_util->getCostmap()),
+      map_grid_costs_(planner_util->getCostmap())
   {
     ros::NodeHandle private_nh("~/" + name);
 
@@ -150,6 +160,23 @@ namespace dwa_local_planner {
     private_nh.param("sum_scores", sum_scores, false);
     obstacle_costs_.setSumScores(sum_scores);
 
+    int footprint_headings;
+    private_nh.param("footprint_headings", footprint_headings, 0);
+    obstacle_costs_.setFootprintHeadings(footprint_headings);
+
+    private_nh.param("sweep_rotation_check", sweep_rotation_check_, false);
+
+    int obstacle_coarse_stride;
+    private_nh.param("obstacle_coarse_stride", obstacle_coarse_stride, 0);
+    obstacle_costs_.setCoarseStride(obstacle_coarse_stride > 1 ? obstacle_coarse_stride : 0);
+
+    bool incremental_path_distance;
+    private_nh.param("incremental_path_distance", incremental_path_distance, false);
+    path_costs_.setIncremental(incremental_path_distance);
+    goal_costs_.setIncremental(incremental_path_distance);
+    goal_front_costs_.setIncremental(incremental_path_distance);
+    alignment_costs_.setIncremental(incremental_path_distance);
+
 
     private_nh.param("publish_cost_grid_pc", publish_cost_grid_pc_, false);
     map_viz_.initialize(name, planner_util->getGlobalFrame(), boost::bind(&DWAPlanner::getCellCosts, this, _1, _2, _3, _4, _5, _6));
@@ -159,7 +186,9 @@ namespace dwa_local_planner {
 
     traj_cloud_ = new pcl::PointCloud<base_local_planner::MapGridCostPoint>;
     traj_cloud_->header.frame_id = frame_id;
-    traj_cloud_pub_.advertise(private_nh, "trajectory_cloud", 1);
+    double traj_cloud_rate;
+    private_nh.param("traj_cloud_rate", traj_cloud_rate, 0.0);
+    traj_cloud_pub_.advertise(private_nh, "trajectory_cloud", traj_cloud_rate);
     private_nh.param("publish_traj_pc", publish_traj_pc_, false);
 
     // set up all the cost functions that will be applied in order
@@ -167,17 +196,65 @@ namespace dwa_local_planner {
     std::vector<base_local_planner::TrajectoryCostFunction*> critics;
     critics.push_back(&oscillation_costs_); // discards oscillating motions (assisgns cost -1)
     critics.push_back(&obstacle_costs_); // discards trajectories that move into obstacles
-    critics.push_back(&goal_front_costs_); // prefers trajectories that make the nose go towards (local) nose goal
-    critics.push_back(&alignment_costs_); // prefers trajectories that keep the robot nose on nose path
-    critics.push_back(&path_costs_); // prefers trajectories on global path
-    critics.push_back(&goal_costs_); // prefers trajectories that go towards (local) goal, based on wave propagation
+    critics.push_back(&clearance_costs_); // prefers trajectories that keep the footprint away from obstacles
+    // the map grid critics can share one walk over the points of a trajectory
+    bool fuse_map_grid_critics;
+    private_nh.param("fuse_map_grid_critics", fuse_map_grid_critics, false);
+    if (fuse_map_grid_critics) {
+      map_grid_costs_.addCritic(&goal_front_costs_);
+      map_grid_costs_.addCritic(&alignment_costs_);
+      map_grid_costs_.addCritic(&path_costs_);
+      map_grid_costs_.addCritic(&goal_costs_);
+      critics.push_back(&map_grid_costs_);
+      const char* critic_names[] = {"oscillation", "obstacle", "clearance", "map_grid"};
+      critic_names_.assign(critic_names, critic_names + critics.size());
+    } else {
+      critics.push_back(&goal_front_costs_); // prefers trajectories that make the nose go towards (local) nose goal
+      critics.push_back(&alignment_costs_); // prefers trajectories that keep the robot nose on nose path
+      critics.push_back(&path_costs_); // prefers trajectories on global path
+      critics.push_back(&goal_costs_); // prefers trajectories that go towards (local) goal, based on wave propagation
+      const char* critic_names[] = {"oscillation", "obstacle", "clearance", "goal_front", "alignment", "path", "goal"};
+      critic_names_.assign(critic_names, critic_names + critics.size());
+    }
 
     // trajectory generators
+    private_nh.param("adaptive_sampling", adaptive_sampling_, false);
+    int adaptive_coarse_samples, adaptive_refine_best;
+    bool adaptive_seed_last_best;
+    private_nh.param("adaptive_coarse_samples", adaptive_coarse_samples, 3);
+    private_nh.param("adaptive_refine_best", adaptive_refine_best, 3);
+    private_nh.param("adaptive_seed_last_best", adaptive_seed_last_best, true);
+    adaptive_generator_.setAdaptiveParameters(adaptive_coarse_samples, adaptive_refine_best, adaptive_seed_last_best);
+
+    // scoring the neighbourhood of the last best first lets the early out cut the rest short
+    bool warm_start;
+    private_nh.param("warm_start", warm_start, false);
+    generator_.setWarmStart(warm_start);
+
+    // with dwa, sampling velocities on a lattice lets each rollout be simulated once and then only moved
+    double primitive_resolution;
+    private_nh.param("primitive_resolution", primitive_resolution, 0.0);
+    generator_.setPrimitiveResolution(primitive_resolution);
+    adaptive_generator_.setPrimitiveResolution(primitive_resolution);
+
     std::vector<base_local_planner::TrajectorySampleGenerator*> generator_list;
-    generator_list.push_back(&generator_);
+    if (adaptive_sampling_) {
+      generator_list.push_back(&adaptive_generator_);
+    } else {
+      generator_list.push_back(&generator_);
+    }
 
     scored_sampling_planner_ = base_local_planner::SimpleScoredSamplingPlanner(generator_list, critics);
 
+    int scoring_threads;
+    private_nh.param("scoring_threads", scoring_threads, 1);
+    scored_sampling_planner_.setScoringThreads(scoring_threads);
+    clearance_costs_.setThreads(scoring_threads);
+
+    bool adaptive_critic_order;
+    private_nh.param("adaptive_critic_order", adaptive_critic_order, false);
+    scored_sampling_planner_.setAdaptiveCriticOrder(adaptive_critic_order);
+
     private_nh.param("cheat_factor", cheat_factor_, 1.0);
   }
 
@@ -201,9 +278,9 @@ namespace dwa_local_planner {
     return true;
   }
 
-  bool DWAPlanner::setPlan(const std::vector<geometry_msgs::PoseStamped>& orig_global_plan) {
+  bool DWAPlanner::setPlan(const nav_core::PlanConstPtr& orig_global_plan) {
     oscillation_costs_.resetOscillationFlags();
-    return planner_util_->setPlan(orig_global_plan);
+    return planner_util_->setSharedPlan(orig_global_plan);
   }
 
   /**
@@ -238,6 +315,66 @@ namespace dwa_local_planner {
     return false;
   }
 
+  bool DWAPlanner::checkRotation(
+      Eigen::Vector3f pos,
+      Eigen::Vector3f vel,
+      Eigen::Vector3f vel_samples,
+      const std::vector<geometry_msgs::Point>& footprint_spec)
+  {
+    if (sweep_rotation_check_ && vel_samples[0] == 0.0 && vel_samples[1] == 0.0 && vel_samples[2] != 0.0) {
+      rotation_checker_.setFootprint(footprint_spec);
+      double goal_th = tf::getYaw(global_plan_.back().pose.orientation);
+      // only a turn towards the goal heading, which it sweeps all of, rather than the simulated part
+      if (rotation_checker_.hasFootprint() &&
+          angles::shortest_angular_distance(pos[2], goal_th) * vel_samples[2] > 0) {
+        if (rotation_checker_.isClear(*planner_util_->getCostmap(), pos[0], pos[1], pos[2], goal_th, vel_samples[2])) {
+          return true;
+        }
+        ROS_WARN("Invalid rotation %f towards %f", vel_samples[2], goal_th);
+        return false;
+      }
+    }
+    return checkTrajectory(pos, vel, vel_samples);
+  }
+
+  unsigned int DWAPlanner::checkTrajectories(
+      Eigen::Vector3f pos,
+      Eigen::Vector3f vel,
+      const std::vector<Eigen::Vector3f>& vel_samples,
+      std::vector<double>& costs,
+      std::vector<std::string>* rejected_by)
+  {
+    oscillation_costs_.resetOscillationFlags();
+    geometry_msgs::PoseStamped goal_pose = global_plan_.back();
+    Eigen::Vector3f goal(goal_pose.pose.position.x, goal_pose.pose.position.y, tf::getYaw(goal_pose.pose.orientation));
+    base_local_planner::LocalPlannerLimits limits = planner_util_->getCurrentLimits();
+    // the generator is set up once for all of them
+    generator_.initialise(pos,
+        vel,
+        goal,
+        &limits,
+        vsamples_);
+    check_trajs_.resize(vel_samples.size());
+    for (unsigned int i = 0; i < vel_samples.size(); ++i) {
+      generator_.generateTrajectory(pos, vel, vel_samples[i], check_trajs_[i]);
+    }
+
+    scored_sampling_planner_.scoreTrajectories(check_trajs_, costs, rejected_by != NULL ? &check_rejected_by_ : NULL);
+
+    unsigned int legal = 0;
+    if (rejected_by != NULL) {
+      rejected_by->assign(vel_samples.size(), std::string());
+    }
+    for (unsigned int i = 0; i < vel_samples.size(); ++i) {
+      if (costs[i] >= 0) {
+        legal++;
+      } else if (rejected_by != NULL && check_rejected_by_[i] >= 0) {
+        (*rejected_by)[i] = critic_names_[check_rejected_by_[i]];
+      }
+    }
+    return legal;
+  }
+
 
   void DWAPlanner::updatePlanAndLocalCosts(
       tf::Stamped<tf::Pose> global_pose,
@@ -298,6 +435,7 @@ namespace dwa_local_planner {
       std::vector<geometry_msgs::Point> footprint_spec) {
 
     obstacle_costs_.setFootprint(footprint_spec);
+    clearance_costs_.setFootprint(footprint_spec);
 
     //make sure that our configuration doesn't change mid-run
     boost::mutex::scoped_lock l(configuration_mutex_);
@@ -309,18 +447,28 @@ namespace dwa_local_planner {
     base_local_planner::LocalPlannerLimits limits = planner_util_->getCurrentLimits();
 
     // prepare cost functions and generators for this run
-    generator_.initialise(pos,
-        vel,
-        goal,
-        &limits,
-        vsamples_);
+    if (adaptive_sampling_) {
+      adaptive_generator_.initialise(pos,
+          vel,
+          goal,
+          &limits,
+          vsamples_);
+    } else {
+      generator_.initialise(pos,
+          vel,
+          goal,
+          &limits,
+          vsamples_);
+    }
 
     result_traj_.cost_ = -7;
-    // find best trajectory by sampling and scoring the samples
+    // find best trajectory by sampling and scoring the samples, keeping them all only to publish them
+    // only while someone listens, and no more often than traj_cloud_rate
+    bool publish_traj_pc = publish_traj_pc_ && traj_cloud_pub_.ready();
     std::vector<base_local_planner::Trajectory> all_explored;
-    scored_sampling_planner_.findBestTrajectory(result_traj_, &all_explored);
+    scored_sampling_planner_.findBestTrajectory(result_traj_, publish_traj_pc ? &all_explored : NULL);
 
-    if(publish_traj_pc_)
+    if(publish_traj_pc)
     {
         base_local_planner::MapGridCostPoint pt;
         traj_cloud_->points.clear();
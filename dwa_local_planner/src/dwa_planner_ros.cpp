@@ -37,6 +37,7 @@
 
 #include <dwa_local_planner/dwa_planner_ros.h>
 #include <Eigen/Core>
+#include <algorithm>
 #include <cmath>
 
 #include <ros/console.h>
@@ -44,6 +45,7 @@
 #include <pluginlib/class_list_macros.h>
 
 #include <base_local_planner/goal_functions.h>
+#include <costmap_2d/inflation_layer.h>
 #include <nav_msgs/Path.h>
 
 //register this planner as a BaseLocalPlanner plugin
@@ -51,6 +53,19 @@ PLUGINLIB_EXPORT_CLASS(dwa_local_planner::DWAPlannerROS, nav_core::BaseLocalPlan
 
 namespace dwa_local_planner {
 
+  // stages of computeVelocityCommands timed for the cycle stats
+  enum {
+    STAGE_TRANSFORM_PLAN,
+    STAGE_UPDATE_COSTS,
+    STAGE_FIND_BEST_PATH,
+    STAGE_PUBLISH,
+    STAGE_COUNT
+  };
+
+  static const char* stage_names[STAGE_COUNT] = {
+    "transform global plan", "update plan and local costs", "find best path", "publish"
+  };
+
   void DWAPlannerROS::reconfigureCB(DWAPlannerConfig &config, uint32_t level) {
       if (setup_ && config.restore_defaults) {
         config = default_config_;
@@ -86,7 +101,7 @@ namespace dwa_local_planner {
       dp_->reconfigure(config);
   }
 
-  DWAPlannerROS::DWAPlannerROS() : initialized_(false),
+  DWAPlannerROS::DWAPlannerROS() : initialized_(false), circumscribed_fast_path_(false),
       odom_helper_("odom"), setup_(false) {
 
   }
@@ -116,6 +131,14 @@ namespace dwa_local_planner {
       {
         odom_helper_.setOdomTopic( odom_topic_ );
       }
+
+      private_nh.param("circumscribed_fast_path", circumscribed_fast_path_, false);
+
+      int cycle_stats_window;
+      private_nh.param("cycle_stats_window", cycle_stats_window, 100);
+      cycle_stats_ = boost::shared_ptr<base_local_planner::CycleStatsPublisher>(
+          new base_local_planner::CycleStatsPublisher(&private_nh, "cycle_stats",
+              std::vector<std::string>(stage_names, stage_names + STAGE_COUNT), std::max(cycle_stats_window, 1)));
       
       initialized_ = true;
 
@@ -129,6 +152,10 @@ namespace dwa_local_planner {
   }
   
   bool DWAPlannerROS::setPlan(const std::vector<geometry_msgs::PoseStamped>& orig_global_plan) {
+    return setSharedPlan(nav_core::PlanConstPtr(new std::vector<geometry_msgs::PoseStamped>(orig_global_plan)));
+  }
+
+  bool DWAPlannerROS::setSharedPlan(const nav_core::PlanConstPtr& orig_global_plan) {
     if (! isInitialized()) {
       ROS_ERROR("This planner has not been initialized, please call initialize() before using this planner");
       return false;
@@ -159,14 +186,32 @@ namespace dwa_local_planner {
   }
 
   void DWAPlannerROS::publishLocalPlan(std::vector<geometry_msgs::PoseStamped>& path) {
+    base_local_planner::CycleStatsPublisher::StageTimer timer(cycle_stats_.get(), STAGE_PUBLISH);
     base_local_planner::publishPlan(path, l_plan_pub_);
   }
 
 
   void DWAPlannerROS::publishGlobalPlan(std::vector<geometry_msgs::PoseStamped>& path) {
+    base_local_planner::CycleStatsPublisher::StageTimer timer(cycle_stats_.get(), STAGE_PUBLISH);
     base_local_planner::publishPlan(path, g_plan_pub_);
   }
 
+  unsigned char DWAPlannerROS::circumscribedCost() {
+    costmap_2d::LayeredCostmap* layered_costmap = costmap_ros_->getLayeredCostmap();
+    double resolution = layered_costmap->getCostmap()->getResolution();
+    double radius = layered_costmap->getCircumscribedRadius() + 1.5 * resolution;
+
+    std::vector<boost::shared_ptr<costmap_2d::Layer> >* plugins = layered_costmap->getPlugins();
+    for (std::vector<boost::shared_ptr<costmap_2d::Layer> >::iterator plugin = plugins->begin(); plugin != plugins->end(); ++plugin) {
+      boost::shared_ptr<costmap_2d::InflationLayer> inflation = boost::dynamic_pointer_cast<costmap_2d::InflationLayer>(*plugin);
+      // cells beyond the inflation radius are free however near the footprint reaches
+      if (inflation && inflation->getInflationRadius() >= radius) {
+        return inflation->computeCost(radius / resolution);
+      }
+    }
+    return 0;
+  }
+
   DWAPlannerROS::~DWAPlannerROS(){
     //make sure to clean things up
     delete dsrv_;
@@ -194,8 +239,19 @@ namespace dwa_local_planner {
     tf::Stamped<tf::Pose> drive_cmds;
     drive_cmds.frame_id_ = costmap_ros_->getBaseFrameID();
     
-    // call with updated footprint
-    base_local_planner::Trajectory path = dp_->findBestPath(global_pose, robot_vel, drive_cmds, costmap_ros_->getRobotFootprint());
+    // the inflation and the footprint may both have been reconfigured
+    if (circumscribed_fast_path_) {
+      dp_->setCircumscribedCost(circumscribedCost());
+    }
+
+    // call with updated footprint, measuring the critics only while anyone listens for them
+    dp_->setMeasureCritics(cycle_stats_->hasSubscribers());
+    base_local_planner::Trajectory path;
+    {
+      base_local_planner::CycleStatsPublisher::StageTimer timer(cycle_stats_.get(), STAGE_FIND_BEST_PATH);
+      path = dp_->findBestPath(global_pose, robot_vel, drive_cmds, costmap_ros_->getRobotFootprint());
+    }
+    dp_->getCycleStats(cycle_stats_.get());
     //ROS_ERROR("Best: %.2f, %.2f, %.2f, %.2f", path.xv_, path.yv_, path.thetav_, path.cost_);
 
     /* For timing uncomment
@@ -251,14 +307,18 @@ namespace dwa_local_planner {
 
   bool DWAPlannerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_vel) {
     // dispatches to either dwa sampling control or stop and rotate control, depending on whether we have been close enough to goal
+    base_local_planner::CycleStatsPublisher::CycleTimer cycle(cycle_stats_.get());
     if ( ! costmap_ros_->getRobotPose(current_pose_)) {
       ROS_ERROR("Could not get robot pose");
       return false;
     }
     std::vector<geometry_msgs::PoseStamped> transformed_plan;
-    if ( ! planner_util_.getLocalPlan(current_pose_, transformed_plan)) {
-      ROS_ERROR("Could not get local plan");
-      return false;
+    {
+      base_local_planner::CycleStatsPublisher::StageTimer timer(cycle_stats_.get(), STAGE_TRANSFORM_PLAN);
+      if ( ! planner_util_.getLocalPlan(current_pose_, transformed_plan)) {
+        ROS_ERROR("Could not get local plan");
+        return false;
+      }
     }
 
     //if the global plan passed in is empty... we won't do anything
@@ -269,7 +329,10 @@ namespace dwa_local_planner {
     ROS_DEBUG_NAMED("dwa_local_planner", "Received a transformed plan with %zu points.", transformed_plan.size());
 
     // update plan in dwa_planner even if we just stop and rotate, to allow checkTrajectory
-    dp_->updatePlanAndLocalCosts(current_pose_, transformed_plan);
+    {
+      base_local_planner::CycleStatsPublisher::StageTimer timer(cycle_stats_.get(), STAGE_UPDATE_COSTS);
+      dp_->updatePlanAndLocalCosts(current_pose_, transformed_plan);
+    }
 
     if (latchedStopRotateController_.isPositionReached(&planner_util_, current_pose_)) {
       //publish an empty plan because we've reached our goal position
@@ -285,7 +348,7 @@ namespace dwa_local_planner {
           &planner_util_,
           odom_helper_,
           current_pose_,
-          boost::bind(&DWAPlanner::checkTrajectory, dp_, _1, _2, _3));
+          boost::bind(&DWAPlanner::checkRotation, dp_, _1, _2, _3, costmap_ros_->getRobotFootprint()));
     } else {
       bool isOk = dwaComputeVelocityCommands(current_pose_, cmd_vel);
       if (isOk) {
@@ -299,5 +362,14 @@ namespace dwa_local_planner {
     }
   }
 
+  bool DWAPlannerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_vel, const ros::WallTime& deadline, bool& degraded) {
+    dp_->setDeadline(deadline);
+    bool isOk = computeVelocityCommands(cmd_vel);
+    // setting the deadline cleared the flag, which stays clear when the stop and rotate controller ran instead
+    degraded = dp_->lastSearchCutShort();
+    dp_->setDeadline(ros::WallTime());
+    return isOk;
+  }
+
 
 };
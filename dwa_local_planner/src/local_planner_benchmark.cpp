@@ -0,0 +1,454 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2009, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+/**
+ * Times the local planners and their pieces on local windows with a global plan through them:
+ *
+ *   make local_planner_benchmark
+ *   rosrun dwa_local_planner local_planner_benchmark [filter] [min_seconds] [windows_file]
+ *
+ * Only the cases whose name contains filter are run, each for at least min_seconds (0.5 by default).
+ * Without windows_file, three synthetic windows are used. A windows file holds any number of windows
+ * recorded from a local costmap, each written as
+ *
+ *   window <name> <cells_x> <cells_y> <resolution> <origin_x> <origin_y>
+ *   <cells_x * cells_y costs, row by row from the origin>
+ *   robot <x> <y> <theta> <vx> <vtheta>
+ *   plan <n>
+ *   <x> <y>, n times
+ *
+ * with lines starting with # skipped. It needs a master, as DWAPlanner reads its parameters and
+ * advertises its topics.
+ */
+#include <ros/ros.h>
+#include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/cost_values.h>
+#include <base_local_planner/costmap_model.h>
+#include <base_local_planner/local_planner_util.h>
+#include <base_local_planner/map_grid.h>
+#include <base_local_planner/map_grid_cost_function.h>
+#include <base_local_planner/obstacle_cost_function.h>
+#include <base_local_planner/oscillation_cost_function.h>
+#include <base_local_planner/prefer_forward_cost_function.h>
+#include <base_local_planner/clearance_cost_function.h>
+#include <base_local_planner/simple_trajectory_generator.h>
+#include <base_local_planner/trajectory_planner.h>
+#include <dwa_local_planner/dwa_planner.h>
+#include <tf/transform_datatypes.h>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace base_local_planner;
+
+namespace {
+
+std::string g_filter;
+double g_min_time = 0.5;
+
+/**
+ * @brief A local window with the robot in it and the global plan through it
+ */
+struct Window {
+  std::string name;
+  boost::shared_ptr<costmap_2d::Costmap2D> costmap;
+  double x, y, theta, vx, vtheta;
+  std::vector<geometry_msgs::PoseStamped> plan;
+};
+
+/**
+ * @brief Run op until it has taken at least g_min_time, and print the time per call, and the
+ * trajectories per second when each call goes through trajectories of them.
+ */
+void runBenchmark(const std::string& name, const boost::function<void()>& op, unsigned int trajectories) {
+  if (name.find(g_filter) == std::string::npos) {
+    return;
+  }
+
+  // once untimed, so that caches and scratch buffers are warm
+  op();
+
+  unsigned long iterations = 1;
+  double elapsed;
+  while (true) {
+    ros::WallTime start = ros::WallTime::now();
+    for (unsigned long i = 0; i < iterations; ++i) {
+      op();
+    }
+    elapsed = (ros::WallTime::now() - start).toSec();
+    if (elapsed >= g_min_time || iterations >= 1000000000ul) {
+      break;
+    }
+
+    // aim a little past the minimum time for the next try
+    double factor = elapsed > 0 ? 1.2 * g_min_time / elapsed : 1000.0;
+    iterations = (unsigned long)(iterations * std::min(std::max(factor, 2.0), 1000.0));
+  }
+  double per_call = elapsed / iterations;
+  if (trajectories > 0) {
+    printf("%-56s %12.1f us %14.0f traj/s %10lu\n", name.c_str(), per_call * 1e6, trajectories / per_call, iterations);
+  } else {
+    printf("%-56s %12.1f us %21s %10lu\n", name.c_str(), per_call * 1e6, "", iterations);
+  }
+  fflush(stdout);
+}
+
+geometry_msgs::PoseStamped makePose(double x, double y) {
+  geometry_msgs::PoseStamped pose;
+  pose.header.frame_id = "odom";
+  pose.pose.position.x = x;
+  pose.pose.position.y = y;
+  pose.pose.orientation.w = 1.0;
+  return pose;
+}
+
+/**
+ * @brief Inflates the lethal cells of costmap the way the inflation layer does, with a brute force
+ * search that is only fit for windows of a few meters
+ */
+void inflate(costmap_2d::Costmap2D& costmap, double inscribed_radius, double inflation_radius) {
+  unsigned int size_x = costmap.getSizeInCellsX(), size_y = costmap.getSizeInCellsY();
+  std::vector<unsigned int> lethal;
+  for (unsigned int i = 0; i < size_x * size_y; ++i) {
+    if (costmap.getCharMap()[i] == costmap_2d::LETHAL_OBSTACLE) {
+      lethal.push_back(i);
+    }
+  }
+  int reach = (int)ceil(inflation_radius / costmap.getResolution());
+  std::vector<double> dist(size_x * size_y, 1e9);
+  for (unsigned int k = 0; k < lethal.size(); ++k) {
+    int ox = lethal[k] % size_x, oy = lethal[k] / size_x;
+    for (int j = std::max(0, oy - reach); j <= std::min((int)size_y - 1, oy + reach); ++j) {
+      for (int i = std::max(0, ox - reach); i <= std::min((int)size_x - 1, ox + reach); ++i) {
+        double d = hypot(i - ox, j - oy) * costmap.getResolution();
+        dist[j * size_x + i] = std::min(dist[j * size_x + i], d);
+      }
+    }
+  }
+  for (unsigned int j = 0; j < size_y; ++j) {
+    for (unsigned int i = 0; i < size_x; ++i) {
+      double d = dist[j * size_x + i];
+      if (d == 0 || d > inflation_radius) {
+        continue;
+      }
+      unsigned char cost = d <= inscribed_radius ? costmap_2d::INSCRIBED_INFLATED_OBSTACLE :
+          (unsigned char)((costmap_2d::INSCRIBED_INFLATED_OBSTACLE - 1) * exp(-10.0 * (d - inscribed_radius)));
+      costmap.setCost(i, j, std::max(cost, costmap.getCost(i, j)));
+    }
+  }
+}
+
+/**
+ * @brief A size meter window at resolution around the robot, with boxes strewn over it unless open,
+ * and a plan bending by bend radians over its length
+ */
+Window makeWindow(const std::string& name, double size, double resolution, unsigned int boxes, double bend) {
+  Window w;
+  w.name = name;
+  unsigned int cells = (unsigned int)(size / resolution);
+  w.costmap.reset(new costmap_2d::Costmap2D(cells, cells, resolution, -size / 2, -size / 2));
+  w.x = w.y = w.theta = 0.0;
+  w.vx = 0.3;
+  w.vtheta = 0.1;
+
+  // boxes off the plan, which runs through the middle
+  srand(cells + boxes);
+  for (unsigned int n = 0; n < boxes; ++n) {
+    unsigned int bx = rand() % cells, by = rand() % cells, bw = 1 + rand() % 8, bh = 1 + rand() % 8;
+    if (abs((int)by - (int)cells / 2) < (int)(0.6 / resolution)) {
+      continue;
+    }
+    for (unsigned int j = by; j < std::min(cells, by + bh); ++j) {
+      for (unsigned int i = bx; i < std::min(cells, bx + bw); ++i) {
+        w.costmap->setCost(i, j, costmap_2d::LETHAL_OBSTACLE);
+      }
+    }
+  }
+  inflate(*w.costmap, 0.25, 0.55);
+
+  // a plan every 2.5 cm, on past the window as a global plan would go
+  double x = 0, y = 0, heading = 0, step = 0.025;
+  for (double s = 0; s < size; s += step) {
+    w.plan.push_back(makePose(x, y));
+    heading += bend * step / size;
+    x += step * cos(heading);
+    y += step * sin(heading);
+  }
+  return w;
+}
+
+/**
+ * @brief Reads the windows of the file described at the top, returns false if it cannot be read or a window has no plan
+ */
+bool loadWindows(const std::string& path, std::vector<Window>& windows) {
+  std::ifstream in(path.c_str());
+  if (!in) {
+    return false;
+  }
+  std::string word;
+  while (in >> word) {
+    if (word[0] == '#') {
+      std::getline(in, word);
+      continue;
+    }
+    if (word == "window") {
+      Window w;
+      unsigned int cells_x, cells_y;
+      double resolution, origin_x, origin_y;
+      in >> w.name >> cells_x >> cells_y >> resolution >> origin_x >> origin_y;
+      w.costmap.reset(new costmap_2d::Costmap2D(cells_x, cells_y, resolution, origin_x, origin_y));
+      for (unsigned int j = 0; j < cells_y; ++j) {
+        for (unsigned int i = 0; i < cells_x; ++i) {
+          int cost;
+          in >> cost;
+          w.costmap->setCost(i, j, cost);
+        }
+      }
+      w.x = w.y = w.theta = w.vx = w.vtheta = 0.0;
+      windows.push_back(w);
+    } else if (word == "robot" && !windows.empty()) {
+      Window& w = windows.back();
+      in >> w.x >> w.y >> w.theta >> w.vx >> w.vtheta;
+    } else if (word == "plan" && !windows.empty()) {
+      unsigned int n;
+      in >> n;
+      for (unsigned int i = 0; i < n; ++i) {
+        double x, y;
+        in >> x >> y;
+        windows.back().plan.push_back(makePose(x, y));
+      }
+    } else {
+      return false;
+    }
+    if (!in) {
+      return false;
+    }
+  }
+
+  // the critics and the planners head for the end of the plan, so every window needs one
+  for (unsigned int i = 0; i < windows.size(); ++i) {
+    if (windows[i].plan.empty()) {
+      fprintf(stderr, "Window %s has no plan\n", windows[i].name.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+tf::Stamped<tf::Pose> makeStamped(double x, double y, double theta) {
+  return tf::Stamped<tf::Pose>(tf::Pose(tf::createQuaternionFromYaw(theta), tf::Vector3(x, y, 0)), ros::Time(), "odom");
+}
+
+std::vector<geometry_msgs::Point> makeFootprint() {
+  std::vector<geometry_msgs::Point> footprint(4);
+  footprint[0].x = 0.3;
+  footprint[0].y = 0.2;
+  footprint[1].x = 0.3;
+  footprint[1].y = -0.2;
+  footprint[2].x = -0.2;
+  footprint[2].y = -0.2;
+  footprint[3].x = -0.2;
+  footprint[3].y = 0.2;
+  return footprint;
+}
+
+void trajectoryPlannerCycle(TrajectoryPlanner* tp, const Window* w) {
+  tf::Stamped<tf::Pose> drive;
+  tp->findBestPath(makeStamped(w->x, w->y, w->theta), makeStamped(w->vx, 0, w->vtheta), drive);
+}
+
+void dwaCycle(dwa_local_planner::DWAPlanner* dp, const Window* w, const std::vector<geometry_msgs::Point>* footprint) {
+  tf::Stamped<tf::Pose> pose = makeStamped(w->x, w->y, w->theta), drive;
+  dp->updatePlanAndLocalCosts(pose, w->plan);
+  dp->findBestPath(pose, makeStamped(w->vx, 0, w->vtheta), drive, *footprint);
+}
+
+void scoreAll(TrajectoryCostFunction* critic, std::vector<Trajectory>* trajs) {
+  for (unsigned int i = 0; i < trajs->size(); ++i) {
+    critic->scoreTrajectory((*trajs)[i]);
+  }
+}
+
+void setTargetCells(MapGrid* grid, const Window* w) {
+  grid->resetPathDist();
+  grid->setTargetCells(*w->costmap, w->plan);
+}
+
+void costmapModelFootprints(CostmapModel* model, const std::vector<Trajectory>* trajs,
+                            const std::vector<geometry_msgs::Point>* footprint) {
+  for (unsigned int i = 0; i < trajs->size(); ++i) {
+    const Trajectory& traj = (*trajs)[i];
+    for (unsigned int k = 0; k < traj.getPointsSize(); ++k) {
+      double x, y, th;
+      traj.getPoint(k, x, y, th);
+      model->footprintCost(x, y, th, *footprint, 0.2, 0.36);
+    }
+  }
+}
+
+void obstacleFootprints(costmap_2d::Costmap2D* costmap, CostmapModel* model, const std::vector<Trajectory>* trajs,
+                        const std::vector<geometry_msgs::Point>* footprint) {
+  for (unsigned int i = 0; i < trajs->size(); ++i) {
+    const Trajectory& traj = (*trajs)[i];
+    for (unsigned int k = 0; k < traj.getPointsSize(); ++k) {
+      double x, y, th;
+      traj.getPoint(k, x, y, th);
+      ObstacleCostFunction::footprintCost(x, y, th, 1.0, *footprint, costmap, model, 0.2, 0.36);
+    }
+  }
+}
+
+unsigned int countPoints(const std::vector<Trajectory>& trajs) {
+  unsigned int points = 0;
+  for (unsigned int i = 0; i < trajs.size(); ++i) {
+    points += trajs[i].getPointsSize();
+  }
+  return points;
+}
+
+void benchmarkWindow(Window& w) {
+  costmap_2d::Costmap2D* costmap = w.costmap.get();
+  std::vector<geometry_msgs::Point> footprint = makeFootprint();
+  CostmapModel model(*costmap);
+  LocalPlannerLimits limits(0.55, 0.1, 0.55, 0.0, 0.0, 0.0, 1.0, 0.4, 2.5, 0.0, 3.2, -1, 0.1, 0.1);
+
+  // the trajectories a dwa cycle scores, 20 by 20 over 1.7 s
+  SimpleTrajectoryGenerator gen;
+  gen.setParameters(1.7, 0.025, 0.1, true, 0.05);
+  Eigen::Vector3f pos(w.x, w.y, w.theta), vel(w.vx, 0, w.vtheta), vsamples(20, 1, 20);
+  Eigen::Vector3f goal(w.plan.back().pose.position.x, w.plan.back().pose.position.y, 0);
+  gen.initialise(pos, vel, goal, &limits, vsamples);
+  std::vector<Trajectory> trajs;
+  Trajectory traj;
+  while (gen.hasMoreTrajectories()) {
+    if (gen.nextTrajectory(traj)) {
+      trajs.push_back(traj);
+    }
+  }
+  unsigned int points = countPoints(trajs);
+  printf("%s: %u x %u cells at %.3f m, %u trajectories of %u points in all\n", w.name.c_str(),
+         costmap->getSizeInCellsX(), costmap->getSizeInCellsY(), costmap->getResolution(),
+         (unsigned int)trajs.size(), points);
+
+  // whole cycles, counting the nominal samples of each planner
+  {
+    TrajectoryPlanner tp(model, *costmap, footprint, 2.5, 2.5, 3.2, 1.7, 0.025, 20, 20);
+    tp.updatePlan(w.plan);
+    runBenchmark(w.name + "/trajectory_planner/find_best_path",
+                 boost::bind(&trajectoryPlannerCycle, &tp, &w), 20 * 20 + 20);
+  }
+  {
+    LocalPlannerUtil util;
+    util.initialize(NULL, costmap, "odom");
+    util.reconfigureCB(limits, false);
+    dwa_local_planner::DWAPlanner dp("DWAPlannerROS", &util);
+    dwa_local_planner::DWAPlannerConfig config = dwa_local_planner::DWAPlannerConfig::__getDefault__();
+    config.vx_samples = 20;
+    config.vth_samples = 20;
+    dp.reconfigure(config);
+    dp.setPlan(nav_core::PlanConstPtr(new std::vector<geometry_msgs::PoseStamped>(w.plan)));
+    runBenchmark(w.name + "/dwa/find_best_path", boost::bind(&dwaCycle, &dp, &w, &footprint), 20 * 20);
+  }
+
+  // each critic over the trajectories, prepared once as the planner does each cycle
+  MapGridCostFunction path_costs(costmap), goal_costs(costmap, 0.0, 0.0, true), alignment_costs(costmap, 0.325);
+  path_costs.setTargetPoses(w.plan);
+  goal_costs.setTargetPoses(w.plan);
+  alignment_costs.setTargetPoses(w.plan);
+  ObstacleCostFunction obstacle_costs(costmap);
+  obstacle_costs.setFootprint(footprint);
+  obstacle_costs.setParams(0.55, 0.2, 0.25);
+  ClearanceCostFunction clearance_costs(costmap);
+  clearance_costs.setFootprint(footprint);
+  clearance_costs.setMaxClearance(0.5);
+  OscillationCostFunction oscillation_costs;
+  PreferForwardCostFunction forward_costs(1.0);
+  const char* names[] = {"path", "goal", "alignment", "obstacle", "clearance", "oscillation", "prefer_forward"};
+  TrajectoryCostFunction* critics[] = {&path_costs, &goal_costs, &alignment_costs, &obstacle_costs,
+                                       &clearance_costs, &oscillation_costs, &forward_costs};
+  for (unsigned int i = 0; i < sizeof(critics) / sizeof(critics[0]); ++i) {
+    if (!critics[i]->prepare()) {
+      printf("%s/critic/%s failed to prepare\n", w.name.c_str(), names[i]);
+      continue;
+    }
+    runBenchmark(w.name + "/critic/" + names[i], boost::bind(&scoreAll, critics[i], &trajs), trajs.size());
+  }
+
+  MapGrid grid(costmap->getSizeInCellsX(), costmap->getSizeInCellsY());
+  runBenchmark(w.name + "/map_grid/set_target_cells", boost::bind(&setTargetCells, &grid, &w), 0);
+
+  // the footprint at every point of every trajectory
+  runBenchmark(w.name + "/footprint/costmap_model",
+               boost::bind(&costmapModelFootprints, &model, &trajs, &footprint), trajs.size());
+  runBenchmark(w.name + "/footprint/obstacle_cost_function",
+               boost::bind(&obstacleFootprints, costmap, &model, &trajs, &footprint), trajs.size());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ros::init(argc, argv, "local_planner_benchmark");
+  ros::NodeHandle nh;
+  if (argc > 1) {
+    g_filter = argv[1];
+  }
+  if (argc > 2) {
+    g_min_time = atof(argv[2]);
+  }
+
+  std::vector<Window> windows;
+  if (argc > 3) {
+    if (!loadWindows(argv[3], windows)) {
+      fprintf(stderr, "Could not read the windows in %s\n", argv[3]);
+      return 1;
+    }
+  } else {
+    windows.push_back(makeWindow("open_4m", 4.0, 0.05, 0, 0.0));
+    windows.push_back(makeWindow("cluttered_4m", 4.0, 0.05, 60, 1.0));
+    windows.push_back(makeWindow("cluttered_6m_fine", 6.0, 0.025, 240, 1.5));
+  }
+
+  printf("%-56s %15s %21s %10s\n", "case", "per call", "throughput", "calls");
+  for (unsigned int i = 0; i < windows.size(); ++i) {
+    benchmarkWindow(windows[i]);
+  }
+  return 0;
+}
@@ -67,6 +67,7 @@
   @section parameters ROS parameters
 
   - "~odom_frame_id" (string) : The odometry frame to be used, default: "odom"
+  - "~fast_mode" (bool) : Handle odometry directly when its transform is already available, and publish the particle cloud only to subscribers, default: false
 
  **/
 
@@ -76,6 +77,7 @@
 #include <nav_msgs/Odometry.h>
 #include <geometry_msgs/PoseArray.h>
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <geometry_msgs/TransformStamped.h>
 
 #include <angles/angles.h>
 
@@ -107,14 +109,21 @@ class FakeOdomNode
       private_nh.param("delta_y", delta_y_, 0.0);
       private_nh.param("delta_yaw", delta_yaw_, 0.0);      
       private_nh.param("transform_tolerance", transform_tolerance_, 0.1);      
+      private_nh.param("fast_mode", fast_mode_, false);
       m_particleCloud.header.stamp = ros::Time::now();
       m_particleCloud.header.frame_id = global_frame_id_;
+      m_currentPos.header.frame_id = global_frame_id_;
       m_particleCloud.poses.resize(1);
+      m_odomTrans.header.frame_id = global_frame_id_;
+      m_odomTrans.child_frame_id = odom_frame_id_;
       ros::NodeHandle nh;
 
       m_offsetTf = tf::Transform(tf::createQuaternionFromRPY(0, 0, -delta_yaw_ ), tf::Point(-delta_x_, -delta_y_, 0.0));
 
-      stuff_sub_ = nh.subscribe("base_pose_ground_truth", 100, &FakeOdomNode::stuffFilter, this);
+      if (fast_mode_)
+        stuff_sub_ = nh.subscribe("base_pose_ground_truth", 100, &FakeOdomNode::fastUpdate, this);
+      else
+        stuff_sub_ = nh.subscribe("base_pose_ground_truth", 100, &FakeOdomNode::stuffFilter, this);
       filter_sub_ = new message_filters::Subscriber<nav_msgs::Odometry>(nh, "", 100);
       filter_ = new tf::MessageFilter<nav_msgs::Odometry>(*filter_sub_, *m_tfListener, base_frame_id_, 100);
       filter_->registerCallback(boost::bind(&FakeOdomNode::update, this, _1));
@@ -147,10 +156,12 @@ class FakeOdomNode
     double                         delta_x_, delta_y_, delta_yaw_;
     bool                           m_base_pos_received;
     double transform_tolerance_;
+    bool fast_mode_;
 
     nav_msgs::Odometry  m_basePosMsg;
     geometry_msgs::PoseArray      m_particleCloud;
     geometry_msgs::PoseWithCovarianceStamped      m_currentPos;
+    geometry_msgs::TransformStamped m_odomTrans;
     tf::Transform m_offsetTf;
 
     //parameter for what odom to use
@@ -169,27 +180,40 @@ class FakeOdomNode
       filter_->add(stuff_msg);
     }
 
+    void fastUpdate(const nav_msgs::OdometryConstPtr& odom_msg){
+      //the transform from odom_frame_id_ to base_frame_id_ is usually there
+      //already, and then the message filter would only add a copy and a queue
+      if (m_tfListener->canTransform(odom_frame_id_, base_frame_id_, odom_msg->header.stamp))
+        updatePose(*odom_msg);
+      else
+        stuffFilter(odom_msg);
+    }
+
     void update(const nav_msgs::OdometryConstPtr& message){
+      updatePose(*message);
+    }
+
+    void updatePose(const nav_msgs::Odometry& message){
       tf::Pose txi;
-      tf::poseMsgToTF(message->pose.pose, txi);
+      tf::poseMsgToTF(message.pose.pose, txi);
       txi = m_offsetTf * txi;
 
       tf::Stamped<tf::Pose> odom_to_map;
       try
       {
-        m_tfListener->transformPose(odom_frame_id_, tf::Stamped<tf::Pose>(txi.inverse(), message->header.stamp, base_frame_id_), odom_to_map);
+        m_tfListener->transformPose(odom_frame_id_, tf::Stamped<tf::Pose>(txi.inverse(), message.header.stamp, base_frame_id_), odom_to_map);
       }
       catch(tf::TransformException &e)
       {
         ROS_ERROR("Failed to transform to %s from %s: %s\n", odom_frame_id_.c_str(), base_frame_id_.c_str(), e.what());
         return;
       }
-      m_tfServer->sendTransform(tf::StampedTransform(odom_to_map.inverse(),
-                                                     message->header.stamp + ros::Duration(transform_tolerance_),
-                                                     global_frame_id_, message->header.frame_id));
+      m_odomTrans.header.stamp = message.header.stamp + ros::Duration(transform_tolerance_);
+      tf::transformTFToMsg(odom_to_map.inverse(), m_odomTrans.transform);
+      m_tfServer->sendTransform(m_odomTrans);
 
       tf::Pose current;
-      tf::poseMsgToTF(message->pose.pose, current);
+      tf::poseMsgToTF(message.pose.pose, current);
 
       //also apply the offset to the pose
       current = m_offsetTf * current;
@@ -198,12 +222,14 @@ class FakeOdomNode
       tf::poseTFToMsg(current, current_msg);
 
       // Publish localized pose
-      m_currentPos.header = message->header;
-      m_currentPos.header.frame_id = global_frame_id_;
+      m_currentPos.header.seq = message.header.seq;
+      m_currentPos.header.stamp = message.header.stamp;
       m_currentPos.pose.pose = current_msg;
       m_posePub.publish(m_currentPos);
 
       // The particle cloud is the current position. Quite convenient.
+      if (fast_mode_ && m_particlecloudPub.getNumSubscribers() == 0)
+        return;
       m_particleCloud.header = m_currentPos.header;
       m_particleCloud.poses[0] = m_currentPos.pose.pose;
       m_particlecloudPub.publish(m_particleCloud);
@@ -40,6 +40,7 @@
 
 #include <global_planner/planner_core.h>
 #include <global_planner/expander.h>
+#include <costmap_2d/cost_values.h>
 #include <vector>
 #include <algorithm>
 
@@ -65,9 +66,66 @@ class AStarExpansion : public Expander {
         AStarExpansion(PotentialCalculator* p_calc, int nx, int ny);
         bool calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x, double end_y, int cycles,
                                 float* potential);
+
+        /**
+         * @brief  Sets or resets the size of the map
+         * @param nx The x size of the map
+         * @param ny The y size of the map
+         */
+        void setSize(int nx, int ny);
+
+        /**
+         * @brief  Keeps the open list in buckets of f-cost, one neutral cost wide, instead of a binary heap;
+         *         cells in the same bucket come out last in, first out
+         */
+        void setBucketQueue(bool buckets) {
+            buckets_ = buckets;
+        }
+
+        /**
+         * @brief  Expands to the diagonal neighbors too, with an octile distance heuristic; a cell then
+         *         takes a lower potential found before it is expanded, and its stale entries are skipped
+         */
+        void setEightConnected(bool eight) {
+            eight_connected_ = eight;
+        }
+
+        /**
+         * @brief  Weights the heuristic, for a weighted A* whose path costs at most that many times the best one
+         */
+        void setHeuristicWeight(float weight) {
+            weight_ = weight;
+        }
     private:
-        void add(unsigned char* costs, float* potential, float prev_potential, int next_i, int end_x, int end_y);
+        template <class Kernel>
+        bool searchWith(unsigned char* costs, int end_x, int end_y, int cycles, float* potential);
+        template <class Kernel, bool Unknown, bool Eight>
+        bool search(unsigned char* costs, int end_x, int end_y, int cycles, float* potential);
+        template <class Kernel, bool Unknown, bool Eight>
+        void add(unsigned char* costs, float* potential, float prev_potential, int next_i, int end_x, int end_y,
+                 bool diagonal = false);
+        void push(int i, float f);
+        bool pop(int& i);
+
+        template <bool Unknown>
+        inline bool isFree(unsigned char* costs, int i) {
+            return costs[i] < lethal_cost_ || (Unknown && costs[i] == costmap_2d::NO_INFORMATION);
+        }
+
+        inline bool isClosed(int i) {
+            return closed_[i >> 5] & (1u << (i & 31));
+        }
+
         std::vector<Index> queue_;
+        bool buckets_, eight_connected_;
+        float weight_;
+
+        std::vector<std::vector<int> > buckets_ring_; /**< open cells by quantized f-cost, from buckets_head_ */
+        int buckets_head_, buckets_base_; /**< first bucket and the quantized f-cost it holds */
+        size_t buckets_size_; /**< cells in the buckets */
+        float bucket_width_;
+
+        std::vector<unsigned int> closed_; /**< bitmap of the expanded cells */
 };
 
 } //end namespace global_planner
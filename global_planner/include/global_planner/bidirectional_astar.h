@@ -0,0 +1,126 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#ifndef _BIDIRECTIONAL_ASTAR_H
+#define _BIDIRECTIONAL_ASTAR_H
+
+#include <global_planner/planner_core.h>
+#include <global_planner/expander.h>
+#include <global_planner/astar.h>
+#include <costmap_2d/cost_values.h>
+#include <vector>
+
+namespace global_planner {
+
+/**
+ * @brief  A* from both ends at once: the start's search fills the potential array, the goal's an array
+ *         of its own, and the searches stop once neither open list can lead to a path cheaper than the
+ *         best cell they have both reached. The path is traced from that cell to both ends, see
+ *         BidirectionalPath.
+ */
+class BidirectionalAStarExpansion : public Expander {
+    public:
+        BidirectionalAStarExpansion(PotentialCalculator* p_calc, int nx, int ny);
+        bool calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x, double end_y, int cycles,
+                                float* potential);
+
+        /**
+         * @brief  Sets or resets the size of the map
+         * @param nx The x size of the map
+         * @param ny The y size of the map
+         */
+        void setSize(int nx, int ny);
+
+        /**
+         * @brief  Forgets the last search, its meeting cell included
+         */
+        void forgetPotential();
+
+        /**
+         * @brief  Whether the last search met between the given cells, filling the given potential array
+         */
+        bool hasMeeting(float* potential, int start_x, int start_y, int end_x, int end_y) const {
+            return meet_ >= 0 && potential == forward_ && start_i_ == start_x + nx_ * start_y
+                    && goal_i_ == end_x + nx_ * end_y;
+        }
+
+        /**
+         * @brief  The cell the last search met at, -1 if it did not
+         */
+        int getMeetingCell() const {
+            return meet_;
+        }
+
+        /**
+         * @brief  The potentials of the goal's search, from the goal
+         */
+        float* getBackwardPotential() {
+            return &backward_[0];
+        }
+    private:
+        template <class Kernel>
+        bool searchWith(unsigned char* costs, int cycles, float* potential);
+        template <class Kernel, bool Unknown>
+        bool search(unsigned char* costs, int cycles, float* potential);
+        template <class Kernel, bool Unknown>
+        void add(unsigned char* costs, int side, float* field, float* other, float prev_potential, int next_i);
+        void resetBackward();
+
+        template <bool Unknown>
+        inline bool isFree(unsigned char* costs, int i) {
+            return costs[i] < lethal_cost_ || (Unknown && costs[i] == costmap_2d::NO_INFORMATION);
+        }
+
+        inline bool isClosed(int side, int i) {
+            return closed_[side][i >> 5] & (1u << (i & 31));
+        }
+
+        std::vector<Index> queue_[2]; /**< open lists of the start's and the goal's search */
+        std::vector<unsigned int> closed_[2]; /**< bitmaps of the cells each search expanded */
+        int target_x_[2], target_y_[2]; /**< the cell each search heads for */
+
+        std::vector<float> backward_; /**< potentials from the goal */
+        std::vector<int> backward_touched_; /**< cells given one by the last search */
+
+        float* forward_; /**< the potential array of the last search */
+        int start_i_, goal_i_;
+        int meet_; /**< cell of the cheapest path through both searches, -1 if none */
+        float best_; /**< cost of that path */
+};
+
+} //end namespace global_planner
+#endif
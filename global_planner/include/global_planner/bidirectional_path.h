@@ -0,0 +1,72 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#ifndef _BIDIRECTIONAL_PATH_H
+#define _BIDIRECTIONAL_PATH_H
+
+#include<global_planner/traceback.h>
+#include<global_planner/bidirectional_astar.h>
+#include <vector>
+
+namespace global_planner {
+
+/**
+ * @brief  Traces the path of a bidirectional search with another traceback, from the meeting cell down
+ *         the potentials of each search to its end, and joins the two halves; the potentials of any other
+ *         search are traced by the other traceback alone
+ */
+class BidirectionalPath : public Traceback {
+    public:
+        /**
+         * @param inner The traceback to trace each half with, which this one deletes
+         * @param expander The bidirectional search the potentials come from
+         */
+        BidirectionalPath(Traceback* inner, BidirectionalAStarExpansion* expander);
+        ~BidirectionalPath();
+
+        void setSize(int xs, int ys);
+        void setLethalCost(unsigned char lethal_cost);
+
+        bool getPath(float* potential, double start_x, double start_y, double end_x, double end_y, std::vector<std::pair<float, float> >& path);
+    private:
+        Traceback* inner_;
+        BidirectionalAStarExpansion* expander_;
+        std::vector<std::pair<float, float> > half_; /**< the half of the path traced last */
+};
+
+} //end namespace global_planner
+#endif
@@ -0,0 +1,168 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#ifndef _CLUSTER_GRAPH_H
+#define _CLUSTER_GRAPH_H
+
+#include <global_planner/planner_core.h>
+#include <costmap_2d/cost_values.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace global_planner {
+
+/**
+ * @brief  The abstract graph of a hierarchical search: the map is cut into square clusters, the free cells on
+ *         either side of each stretch of their borders become entrance nodes, and the cheapest paths between the
+ *         entrances of a cluster are kept. A search over the graph picks the clusters a path runs through, after
+ *         which only those need to be searched cell by cell. Cells cost as they do in DijkstraExpansion.
+ */
+class ClusterGraph {
+    public:
+        ClusterGraph(int cluster_size);
+
+        /**
+         * @brief  Sets or resets the size of the map, after which every cluster is built again
+         * @param nx The x size of the map
+         * @param ny The y size of the map
+         */
+        void setSize(int nx, int ny);
+
+        void setClusterSize(int cluster_size);
+        void setLethalCost(unsigned char lethal_cost);
+        void setNeutralCost(unsigned char neutral_cost);
+        void setFactor(float factor);
+        void setHasUnknown(bool unknown);
+
+        /**
+         * @brief  Marks the clusters over the cells [x0, xn) by [y0, yn) as changed, to be built again before
+         *         the next search
+         */
+        void invalidate(int x0, int xn, int y0, int yn);
+
+        /**
+         * @brief  Finds the clusters of the cheapest path through the graph from the start cell to the goal cell
+         * @param costs The costs the graph was built over, with the changes since marked by invalidate()
+         * @param corridor Filled with the clusters of the path, from the start to the goal
+         * @return False if the graph has no path between them
+         */
+        bool findCorridor(unsigned char* costs, int start_x, int start_y, int goal_x, int goal_y,
+                          std::vector<int>& corridor);
+
+        /**
+         * @brief  The cells [*x0, *xn) by [*y0, *yn) of a cluster
+         */
+        void getClusterBounds(int cluster, int* x0, int* xn, int* y0, int* yn) const;
+
+    private:
+        struct Node {
+            int cell;
+            std::vector<int> across; /**< the entrance cells next to it in the neighboring clusters */
+        };
+
+        struct Cluster {
+            std::vector<Node> nodes;
+            std::vector<float> paths; /**< paths[a * nodes.size() + b], cost from node a to b inside the cluster */
+            bool dirty;
+        };
+
+        typedef std::vector<std::pair<int, int> > Entrances; /**< pairs of facing cells of two clusters */
+
+        void invalidateAll();
+        void refresh(unsigned char* costs);
+        bool findEntrances(unsigned char* costs, int a, bool next_x, Entrances& entrances);
+        void findNodes(unsigned char* costs, int c);
+        void searchCluster(unsigned char* costs, int c, int cell, bool reverse);
+        void relax(int node, float g, int parent, int cell, int goal_x, int goal_y);
+
+        /**
+         * @brief  Cost of entering a cell, negative if it can't be entered
+         */
+        inline float cellCost(unsigned char* costs, int i) {
+            float c = costs[i];
+            if (c < lethal_cost_ - 1 || (unknown_ && costs[i] == costmap_2d::NO_INFORMATION)) {
+                c = c * factor_ + neutral_cost_;
+                return c >= lethal_cost_ ? lethal_cost_ - 1 : c;
+            }
+            return -1;
+        }
+
+        inline int clusterOf(int cell) const {
+            return (cell / nx_) / size_ * cx_ + (cell % nx_) / size_;
+        }
+
+        /**
+         * @brief  Index of a cell among the cells of its cluster
+         */
+        inline int localIndex(int c, int cell) const {
+            int x0 = c % cx_ * size_, y0 = c / cx_ * size_;
+            return (cell / nx_ - y0) * (std::min(x0 + size_, nx_) - x0) + cell % nx_ - x0;
+        }
+
+        inline float heuristic(int cell, int goal_x, int goal_y) const {
+            return (abs(goal_x - cell % nx_) + abs(goal_y - cell / nx_)) * (float)neutral_cost_;
+        }
+
+        /**
+         * @brief  Index of the node at a cell of a cluster, -1 if there is none
+         */
+        int nodeAt(int c, int cell) const;
+
+        int nx_, ny_; /**< size of the map, in cells */
+        int size_, cx_, cy_; /**< size of the clusters, in cells, and of the map, in clusters */
+        bool unknown_;
+        unsigned char lethal_cost_, neutral_cost_;
+        float factor_;
+
+        std::vector<Cluster> clusters_;
+        std::vector<Entrances> next_x_, next_y_; /**< entrances from each cluster to the next one in x and in y */
+        bool dirty_;
+
+        std::vector<float> cell_costs_; /**< costs from a cell of the last cluster searched, over its cells */
+        std::vector<std::pair<float, int> > cell_queue_;
+        std::vector<float> to_goal_; /**< costs from the nodes of the goal's cluster to the goal */
+
+        std::vector<int> offsets_, node_cluster_; /**< graph node numbers of each cluster's first node, and back */
+        std::vector<float> g_;
+        std::vector<int> parents_;
+        std::vector<std::pair<float, int> > queue_;
+};
+
+} //end namespace global_planner
+#endif
@@ -49,8 +49,6 @@
 
 // inserting onto the priority blocks
 #define push_cur(n)  { if (n>=0 && n<ns_ && !pending_[n] && getCost(costs, n)<lethal_cost_ && currentEnd_<PRIORITYBUFSIZE){ currentBuffer_[currentEnd_++]=n; pending_[n]=true; }}
-#define push_next(n) { if (n>=0 && n<ns_ && !pending_[n] && getCost(costs, n)<lethal_cost_ &&    nextEnd_<PRIORITYBUFSIZE){    nextBuffer_[   nextEnd_++]=n; pending_[n]=true; }}
-#define push_over(n) { if (n>=0 && n<ns_ && !pending_[n] && getCost(costs, n)<lethal_cost_ &&    overEnd_<PRIORITYBUFSIZE){    overBuffer_[   overEnd_++]=n; pending_[n]=true; }}
 
 namespace global_planner {
 class DijkstraExpansion : public Expander {
@@ -60,6 +58,20 @@ class DijkstraExpansion : public Expander {
         bool calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x, double end_y, int cycles,
                                 float* potential);
 
+        /**
+         * @brief  Calculates the potentials from the start until each of the goal cells has one, in one expansion
+         * @param goals The indices of the goal cells
+         * @return True if every goal was reached
+         */
+        bool calculatePotentials(unsigned char* costs, double start_x, double start_y, const std::vector<int>& goals,
+                                 int cycles, float* potential);
+
+        /**
+         * @brief  Calculates the potential of every cell that can be reached from the start
+         * @return True if the expansion ran out of cells within the cycles
+         */
+        bool calculateAllPotentials(unsigned char* costs, double start_x, double start_y, int cycles, float* potential);
+
         /**
          * @brief  Sets or resets the size of the map
          * @param nx The x size of the map
@@ -73,6 +85,13 @@ class DijkstraExpansion : public Expander {
         }
 
         void setPreciseStart(bool precise){ precise_ = precise; }
+
+        /**
+         * @brief  Goes on propagating after the goals are reached, until the priority threshold passes their
+         *         potentials by margin, so that the potentials around them are settled for the gradient descent;
+         *         0 stops as soon as the last goal is reached
+         */
+        void setSettleMargin(float margin){ settle_margin_ = margin; }
     private:
 
         /**
@@ -81,11 +100,31 @@ class DijkstraExpansion : public Expander {
          * @param potential The potential array in which we are calculating
          * @param n The index to update
          */
+        template <class Kernel, bool Unknown>
         void updateCell(unsigned char* costs, float* potential, int n); /** updates the cell at index n */
 
-        float getCost(unsigned char* costs, int n) {
+        /**
+         * @brief  Resets the potentials and the priority blocks, and queues the neighbors of the start
+         */
+        void setupStart(unsigned char* costs, double start_x, double start_y, float* potential);
+
+        /**
+         * @brief  Runs the propagation instantiated for the calculator and the unknown space policy
+         */
+        bool propagateWith(unsigned char* costs, float* potential, int cycles, const int* goals, int ngoals);
+
+        /**
+         * @brief  Runs the propagation from the cells queued, calculating potentials with Kernel; with no goals,
+         *         until it runs out of cells
+         * @return True if every one of the ngoals cells in goals was reached
+         */
+        template <class Kernel, bool Unknown>
+        bool propagate(unsigned char* costs, float* potential, int cycles, const int* goals, int ngoals);
+
+        template <bool Unknown>
+        float cellCost(unsigned char* costs, int n) {
             float c = costs[n];
-            if (c < lethal_cost_ - 1 || (unknown_ && c==255)) {
+            if (c < lethal_cost_ - 1 || (Unknown && c==255)) {
                 c = c * factor_ + neutral_cost_;
                 if (c >= lethal_cost_)
                     c = lethal_cost_ - 1;
@@ -94,12 +133,26 @@ class DijkstraExpansion : public Expander {
             return lethal_cost_;
         }
 
+        float getCost(unsigned char* costs, int n) {
+            return unknown_ ? cellCost<true>(costs, n) : cellCost<false>(costs, n);
+        }
+
+        /** @brief  Inserts a cell into the priority block given, as push_cur() does into the current one */
+        template <bool Unknown>
+        void pushCell(unsigned char* costs, int* buffer, int& end, int n) {
+            if (n>=0 && n<ns_ && !pending_[n] && cellCost<Unknown>(costs, n)<lethal_cost_ && end<PRIORITYBUFSIZE) {
+                buffer[end++] = n;
+                pending_[n] = true;
+            }
+        }
+
         /** block priority buffers */
         int *buffer1_, *buffer2_, *buffer3_; /**< storage buffers for priority blocks */
         int *currentBuffer_, *nextBuffer_, *overBuffer_; /**< priority buffer block ptrs */
         int currentEnd_, nextEnd_, overEnd_; /**< end points of arrays */
         bool *pending_; /**< pending_ cells during propagation */
         bool precise_;
+        float settle_margin_;
 
         /** block priority thresholds */
         float threshold_; /**< current threshold */
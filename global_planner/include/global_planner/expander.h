@@ -39,15 +39,42 @@
 #define _EXPANDER_H
 #include <global_planner/potential_calculator.h>
 #include <global_planner/planner_core.h>
+#include <algorithm>
+#include <vector>
 
 namespace global_planner {
 
+/**
+ * @brief  Calculates potentials through the calculator's virtual function, for the calculators
+ *         the expanders are not specialized on
+ */
+struct VirtualPotential {
+    static inline float calculate(PotentialCalculator* p_calc, float* potential, unsigned char cost, int n, int nx,
+                                  float prev_potential = -1) {
+        return p_calc->calculatePotential(potential, cost, n, prev_potential);
+    }
+};
+
+/**
+ * @brief  Calculates potentials the way Calculator does, without the virtual call, so that the
+ *         expanders' loops instantiated on it inline the calculation
+ */
+template <class Calculator>
+struct InlinePotential {
+    static inline float calculate(PotentialCalculator* p_calc, float* potential, unsigned char cost, int n, int nx,
+                                  float prev_potential = -1) {
+        return Calculator::potentialOf(potential, cost, n, nx, prev_potential);
+    }
+};
+
 class Expander {
     public:
         Expander(PotentialCalculator* p_calc, int nx, int ny) :
-                unknown_(true), lethal_cost_(253), neutral_cost_(50), factor_(3.0), p_calc_(p_calc) {
+                unknown_(true), lethal_cost_(253), neutral_cost_(50), factor_(3.0), p_calc_(p_calc),
+                touched_potential_(NULL) {
             setSize(nx, ny);
         }
+        virtual ~Expander() {}
         virtual bool calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x, double end_y,
                                         int cycles, float* potential) = 0;
 
@@ -60,6 +87,8 @@ class Expander {
             nx_ = nx;
             ny_ = ny;
             ns_ = nx * ny;
+            touched_.clear();
+            touched_potential_ = NULL;
         } /**< sets or resets the size of the map */
         void setLethalCost(unsigned char lethal_cost) {
             lethal_cost_ = lethal_cost;
@@ -74,6 +103,15 @@ class Expander {
             unknown_ = unknown;
         }
 
+        /**
+         * @brief  Forgets which cells of the potential array the last search set, for when another expander
+         *         has written to the array since
+         */
+        virtual void forgetPotential() {
+            touched_.clear();
+            touched_potential_ = NULL;
+        }
+
         void clearEndpoint(unsigned char* costs, float* potential, int gx, int gy, int s){
             int startCell = toIndex(gx, gy);
             for(int i=-s;i<=s;i++){
@@ -84,6 +122,7 @@ class Expander {
                 float c = costs[n]+neutral_cost_;
                 float pot = p_calc_->calculatePotential(potential, c, n);
                 potential[n] = pot;
+                touched_.push_back(n);
             }
             }
         }
@@ -93,6 +132,21 @@ class Expander {
             return x + nx_ * y;
         }
 
+        /**
+         * @brief  Sets the potential array to POT_HIGH; when it is the array of the last search,
+         *         only the cells that search gave a potential are reset
+         * @param potential The potential array to reset
+         */
+        void resetPotential(float* potential) {
+            if (potential == touched_potential_ && touched_.size() < (size_t)ns_ / 4) {
+                for (size_t i = 0; i < touched_.size(); i++)
+                    potential[touched_[i]] = POT_HIGH;
+            } else
+                std::fill(potential, potential + ns_, POT_HIGH);
+            touched_.clear();
+            touched_potential_ = potential;
+        }
+
         int nx_, ny_, ns_; /**< size of grid, in pixels */
         bool unknown_;
         unsigned char lethal_cost_, neutral_cost_;
@@ -100,6 +154,9 @@ class Expander {
         float factor_;
         PotentialCalculator* p_calc_;
 
+        std::vector<int> touched_; /**< cells given a potential since the last resetPotential() */
+        float* touched_potential_; /**< the array they are in */
+
 };
 
 } //end namespace global_planner
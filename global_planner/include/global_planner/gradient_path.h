@@ -40,6 +40,7 @@
 
 #include<global_planner/traceback.h>
 #include <math.h>
+#include <vector>
 
 namespace global_planner {
 
@@ -69,6 +70,7 @@ class GradientPath : public Traceback {
         float gradCell(float* potential, int n);
 
         float *gradx_, *grady_; /**< gradient arrays, size of potential array */
+        std::vector<int> touched_; /**< cells given a gradient by the last getPath() */
 
         float pathStep_; /**< step size for following gradient */
 };
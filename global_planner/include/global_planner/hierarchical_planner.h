@@ -0,0 +1,94 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#ifndef _HIERARCHICAL_PLANNER_H
+#define _HIERARCHICAL_PLANNER_H
+
+#include <global_planner/planner_core.h>
+#include <global_planner/cluster_graph.h>
+#include <vector>
+
+namespace global_planner {
+
+/**
+ * @class HierarchicalPlanner
+ * @brief The global planner, searching the graph of the entrances between clusters of the costmap first, and then
+ *        the costmap only in the clusters of the route found through them
+ */
+class HierarchicalPlanner : public GlobalPlanner {
+    public:
+        /**
+         * @brief  Default constructor for the HierarchicalPlanner object
+         */
+        HierarchicalPlanner();
+
+        /**
+         * @brief  Constructor for the HierarchicalPlanner object
+         * @param  name The name of this planner
+         * @param  costmap A pointer to the costmap to use
+         * @param  frame_id Frame of the costmap
+         */
+        HierarchicalPlanner(std::string name, costmap_2d::Costmap2D* costmap, std::string frame_id);
+
+        /**
+         * @brief  Initialization function for the HierarchicalPlanner object
+         * @param  name The name of this planner
+         * @param  costmap_ros A pointer to the ROS wrapper of the costmap to use for planning
+         */
+        void initialize(std::string name, costmap_2d::Costmap2DROS* costmap_ros);
+
+        void initialize(std::string name, costmap_2d::Costmap2D* costmap, std::string frame_id);
+
+    protected:
+        /**
+         * @brief  The costs of the clusters of the route through the graph from the start cell to the goal cell,
+         *         lethal elsewhere, or the whole costmap if there is no route
+         */
+        costmap_2d::Costmap2D* getPlanningCostmap(unsigned int start_x, unsigned int start_y, unsigned int goal_x,
+                                                  unsigned int goal_y);
+
+        void reconfigureCB(global_planner::GlobalPlannerConfig &config, uint32_t level);
+
+    private:
+        ClusterGraph graph_;
+        unsigned long graph_version_; /**< version of the costmap the graph was last brought up to */
+        costmap_2d::Costmap2D corridor_costs_; /**< costs of the clusters of the last route, lethal elsewhere */
+        std::vector<int> corridor_; /**< and those clusters */
+};
+
+} //end namespace global_planner
+#endif
@@ -0,0 +1,122 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#ifndef _JUMP_POINT_H
+#define _JUMP_POINT_H
+
+#include <global_planner/planner_core.h>
+#include <global_planner/expander.h>
+#include <global_planner/astar.h>
+#include <costmap_2d/cost_values.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace global_planner {
+
+/**
+ * @brief  A* over jump points, in the 4-connected grid: runs of cells with the same cost are crossed in one
+ *         step from tables of how far each cell can move in each direction before something changes. Moving
+ *         into a cell costs its cost plus the neutral cost, and where the costs change from cell to cell, as
+ *         they do in the inflation, every cell is a jump point and the search is a plain A*.
+ */
+class JumpPointExpansion : public Expander {
+    public:
+        JumpPointExpansion(PotentialCalculator* p_calc, int nx, int ny);
+        bool calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x, double end_y, int cycles,
+                                float* potential);
+
+        /**
+         * @brief  Sets or resets the size of the map
+         * @param nx The x size of the map
+         * @param ny The y size of the map
+         */
+        void setSize(int nx, int ny);
+
+        /**
+         * @brief  Marks the cells [x0, xn) by [y0, yn) as changed since the last search, so that the jump tables
+         *         over them are rebuilt before the next one
+         */
+        void invalidate(int x0, int xn, int y0, int yn);
+    private:
+        enum { UP, DOWN, LEFT, RIGHT };
+
+        void buildTables(unsigned char* costs);
+        void jump(unsigned char* costs, float* potential, int i, int dir, int end_x, int end_y);
+
+        /**
+         * @brief  The jump table entry of a cell moving into its neighbor n, given the entry of n
+         */
+        inline short entry(unsigned char* costs, int i, int n, bool turn, short next) {
+            if (!isFree(costs, n))
+                return 0;
+            if (turn || costs[n] != costs[i])
+                return 1;
+            if (next > 0)
+                return next < JUMP_LIMIT ? next + 1 : 1;
+            return next > -JUMP_LIMIT ? next - 1 : 1;
+        }
+
+        /**
+         * @brief  Whether moving vertically into n, by step, has a free side cell that is reached no cheaper
+         *         through the side of the cell before
+         */
+        bool forced(unsigned char* costs, int n, int step);
+
+        inline bool isFree(unsigned char* costs, int i) {
+            return costs[i] < lethal_cost_ || (unknown_ && costs[i] == costmap_2d::NO_INFORMATION);
+        }
+
+        inline float heuristic(int i, int end_x, int end_y) {
+            return (abs(end_x - i % nx_) + abs(end_y - i / nx_)) * (float)neutral_cost_;
+        }
+
+        static const short JUMP_LIMIT = 32000;
+
+        /**
+         * for each direction and cell, v > 0 if the v-th cell that way is a jump point, and -v free cells
+         * that way followed by a dead end otherwise
+         */
+        std::vector<short> jumps_[4];
+        int dirty_x0_, dirty_xn_, dirty_y0_, dirty_yn_; /**< cells changed since the tables were built */
+        bool table_unknown_;
+        unsigned char table_lethal_; /**< what the tables were built with */
+
+        std::vector<Index> queue_;
+};
+
+} //end namespace global_planner
+#endif
@@ -43,8 +43,10 @@
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/Point.h>
 #include <nav_msgs/Path.h>
+#include <nav_msgs/OccupancyGrid.h>
 #include <tf/transform_datatypes.h>
 #include <vector>
+#include <boost/thread.hpp>
 #include <nav_core/base_global_planner.h>
 #include <nav_msgs/GetPlan.h>
 #include <dynamic_reconfigure/server.h>
@@ -53,10 +55,16 @@
 #include <global_planner/traceback.h>
 #include <global_planner/orientation_filter.h>
 #include <global_planner/GlobalPlannerConfig.h>
+#include <global_planner/MakePlans.h>
+#include <global_planner/GetPotentials.h>
+#include <nav_executor/memory.h>
 
 namespace global_planner {
 
 class Expander;
+class JumpPointExpansion;
+class BidirectionalAStarExpansion;
+class DijkstraExpansion;
 class GridPath;
 
 /**
@@ -93,6 +101,11 @@ class GlobalPlanner : public nav_core::BaseGlobalPlanner {
 
         void initialize(std::string name, costmap_2d::Costmap2D* costmap, std::string frame_id);
 
+        bool initializeOnCostmap(std::string name, costmap_2d::Costmap2D* costmap, std::string frame_id) {
+            initialize(name, costmap, frame_id);
+            return true;
+        }
+
         /**
          * @brief Given a goal pose in the world, compute a plan
          * @param start The start pose
@@ -114,6 +127,20 @@ class GlobalPlanner : public nav_core::BaseGlobalPlanner {
         bool makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, double tolerance,
                       std::vector<geometry_msgs::PoseStamped>& plan);
 
+        /**
+         * @brief Given a goal pose in the world, compute a plan by a deadline. With an A* planner and an
+         *        anytime_weight above 1, searches with a decreasing heuristic weight until the deadline,
+         *        and starts the next call to the same goal from the weight this one got down to
+         * @param start The start pose
+         * @param goal The goal pose
+         * @param deadline The time by which the plan is wanted
+         * @param plan The plan... filled by the planner
+         * @param quality The inverse of the weight of the search that found the plan
+         * @return True if a valid plan was found, false otherwise
+         */
+        bool makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+                      const ros::Time& deadline, std::vector<geometry_msgs::PoseStamped>& plan, double& quality);
+
         /**
          * @brief  Computes the full navigation function for the map given a point in the world to start from
          * @param world_point The point to use for seeding the navigation function
@@ -138,10 +165,19 @@ class GlobalPlanner : public nav_core::BaseGlobalPlanner {
         /**
          * @brief Get the potential, or naviagation cost, at a given point in the world (Note: You should call computePotential first)
          * @param world_point The point to get the potential for
-         * @return The navigation function's value at that point in the world
+         * @return The navigation function's value at that point in the world, or -1 if it has none there
          */
         double getPointPotential(const geometry_msgs::Point& world_point);
 
+        /**
+         * @brief  Get the potentials at points in the world, interpolated from the navigation function computePotential()
+         *         computed last, which holds until the costmap changes
+         * @param world_points The points to get the potentials for
+         * @param potentials For each point, its potential, or -1 if it is off the costmap or cannot reach the seed
+         * @return False, with no potentials, if there is no navigation function for the current costs
+         */
+        bool getPointPotentials(const std::vector<geometry_msgs::Point>& world_points, std::vector<double>& potentials);
+
         /**
          * @brief Check for a valid potential value at a given point in the world (Note: You should call computePotential first)
          * @param world_point The point to get the potential for
@@ -164,6 +200,22 @@ class GlobalPlanner : public nav_core::BaseGlobalPlanner {
 
         bool makePlanService(nav_msgs::GetPlan::Request& req, nav_msgs::GetPlan::Response& resp);
 
+        /**
+         * @brief Given a start pose and goal poses in the world, compute a plan to each goal out of one expansion
+         * @param start The start pose
+         * @param goals The goal poses
+         * @param plans The plan to each goal... filled by the planner, empty for the goals not reached
+         * @param costs The cost of each plan, the potential at its goal, or -1 for the goals not reached
+         * @return True if a plan was found to every goal, false otherwise
+         */
+        bool makePlans(const geometry_msgs::PoseStamped& start, const std::vector<geometry_msgs::PoseStamped>& goals,
+                       std::vector<std::vector<geometry_msgs::PoseStamped> >& plans, std::vector<double>& costs);
+
+        bool makePlansService(global_planner::MakePlans::Request& req, global_planner::MakePlans::Response& resp);
+
+        bool getPotentialsService(global_planner::GetPotentials::Request& req,
+                                  global_planner::GetPotentials::Response& resp);
+
     protected:
 
         /**
@@ -174,36 +226,167 @@ class GlobalPlanner : public nav_core::BaseGlobalPlanner {
         ros::Publisher plan_pub_;
         bool initialized_, allow_unknown_, visualize_potential_;
 
+        /**
+         * @brief  The costmap the expander searches from the start cell to the goal cell; the planner's own here, and
+         *         in planners that confine the search to part of it, a copy of that part with the rest lethal
+         */
+        virtual costmap_2d::Costmap2D* getPlanningCostmap(unsigned int start_x, unsigned int start_y,
+                                                          unsigned int goal_x, unsigned int goal_y);
+
+        virtual void reconfigureCB(global_planner::GlobalPlannerConfig &config, uint32_t level);
+
+        /**
+         * @brief  The costs the planner searches: the costmap's, with a lethal border and the robot's cell free, so
+         *         that planning only ever reads the costmap
+         */
+        costmap_2d::Costmap2D planning_costs_;
+
     private:
+        /**
+         * @brief  What one more makePlan() at once needs of its own: a search of the planner's kind, its potential
+         *         array, and a copy of the costs to clear its start cell in
+         */
+        struct Workspace {
+            explicit Workspace(const std::string& component);
+            ~Workspace();
+            void resize(int nx, int ny);
+
+            PotentialCalculator* p_calc;
+            Expander* planner;
+            JumpPointExpansion* jump_point; /**< planner, when it is a jump point search */
+            unsigned long jump_version; /**< version of costs the jump point search last saw */
+            Traceback* path_maker;
+            float* potential;
+            int nx, ny;
+            costmap_2d::Costmap2D costs;
+            unsigned long version; /**< version of costmap_ costs was last brought up to */
+            int robot_cell; /**< cell of costs last cleared for a start, -1 if none */
+            std::vector<std::pair<float, float> > path;
+            nav_executor::MemoryCounter memory; /**< counts potential */
+        };
+
+        /**
+         * @brief  Plan in a workspace of the pool, past the plan cache and getPlanningCostmap(), on a full copy of the
+         *         costs; what makePlan() does while the planner's own search is busy
+         */
+        bool makePlanInWorkspace(Workspace& workspace, const geometry_msgs::PoseStamped& start,
+                                 const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan);
+        Workspace* takeWorkspace(); /**< a free workspace of the pool, set up with the current costs, or NULL */
+        void returnWorkspace(Workspace* workspace);
+
+        /**
+         * @brief  Create the potential calculator, expander and traceback the parameters ask for
+         */
+        void createSearch(ros::NodeHandle& private_nh, unsigned int cx, unsigned int cy, PotentialCalculator*& p_calc,
+                          Expander*& planner, JumpPointExpansion*& jump_point,
+                          BidirectionalAStarExpansion*& bidirectional, Traceback*& path_maker);
+
         void mapToWorld(double mx, double my, double& wx, double& wy);
         bool worldToMap(double wx, double wy, double& mx, double& my);
-        void clearRobotCell(const tf::Stamped<tf::Pose>& global_pose, unsigned int mx, unsigned int my);
+        bool inGlobalFrame(const geometry_msgs::PoseStamped& pose, const char* which);
+        /**
+         * @brief  The cell of a point in the world, and its map coordinates as the planner takes them
+         */
+        bool toPlanningCell(double wx, double wy, unsigned int& mx_i, unsigned int& my_i, double& mx, double& my);
+        void clearRobotCell(costmap_2d::Costmap2D& copy, int& robot_cell, unsigned int mx, unsigned int my);
+
+        /**
+         * @brief  Copy the costs that changed in the costmap since version into a copy of it, and give the cell last
+         *         cleared in it for a start its cost back
+         */
+        void updatePlanningCosts(costmap_2d::Costmap2D& copy, unsigned long& version, int& robot_cell);
+
+        /**
+         * @brief  Trace a plan down the potential of a search, into path and then, in world coordinates, into plan
+         */
+        bool tracePlan(Traceback* path_maker, float* potential, std::vector<std::pair<float, float> >& path,
+                       double start_x, double start_y, double goal_x, double goal_y,
+                       const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan);
+        /**
+         * @brief  Hand a snapshot of the potential, reduced by publish_potential_decimation_, to the publishing
+         *         thread, if anyone is subscribed
+         */
         void publishPotential(float* potential);
+        void potentialThread();
+
+        /**
+         * @brief  The part of the cached plan ahead of the robot, when it is to the same goal, not due for a
+         *         refresh, and none of its cells changed to lethal since it was last checked
+         * @return True if the cached plan was handed back in plan
+         */
+        bool getCachedPlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+                           std::vector<geometry_msgs::PoseStamped>& plan);
+        void cachePlan(const geometry_msgs::PoseStamped& goal, const std::vector<geometry_msgs::PoseStamped>& plan);
 
         double planner_window_x_, planner_window_y_, default_tolerance_;
         std::string tf_prefix_;
         boost::mutex mutex_;
-        ros::ServiceServer make_plan_srv_;
+        ros::ServiceServer make_plan_srv_, make_plans_srv_, get_potentials_srv_;
 
         PotentialCalculator* p_calc_;
         Expander* planner_;
+        JumpPointExpansion* jump_point_; /**< planner_, when it is a jump point search, which is told the costs changed */
+        BidirectionalAStarExpansion* bidirectional_; /**< planner_, when it searches from both ends */
+        costmap_2d::Costmap2D* jump_costmap_; /**< costmap the jump point search last searched */
+        unsigned long costs_version_; /**< and the version of it that it saw */
+        DijkstraExpansion* batch_planner_; /**< expands to the goals of makePlans(), planner_ if it is a Dijkstra */
+        double anytime_weight_, anytime_step_; /**< first heuristic weight of a goal and how much it drops per search */
+        double anytime_reached_; /**< lowest weight a search to the anytime goal has finished at */
+        unsigned int anytime_goal_x_, anytime_goal_y_;
+        bool anytime_searching_; /**< the anytime searches plan afresh, past the cache */
+
+        bool use_plan_cache_;
+        double plan_cache_refresh_, plan_cache_tolerance_; /**< seconds before a full replan, meters off the plan */
+        std::vector<geometry_msgs::PoseStamped> cached_plan_; /**< last full plan, and the goal it went to */
+        geometry_msgs::PoseStamped cached_goal_;
+        ros::Time cached_time_; /**< when it was planned */
+        unsigned long cached_version_; /**< version of costmap_ it was last checked against */
+        size_t cached_index_; /**< pose of it the robot was nearest to at the last check */
+        unsigned char lethal_cost_, neutral_cost_;
+        float cost_factor_;
         Traceback* path_maker_;
+        std::vector<std::pair<float, float> > path_; /**< grid path of the last plan, kept for its storage */
         OrientationFilter* orientation_filter_;
 
         bool publish_potential_;
         ros::Publisher potential_pub_;
         int publish_scale_;
+        int publish_potential_decimation_; /**< cells of the potential per side of a published cell */
+        boost::thread* potential_thread_; /**< converts and publishes the snapshots off the planning thread */
+        boost::mutex potential_mutex_;
+        boost::condition_variable potential_cond_;
+        nav_msgs::OccupancyGrid potential_grid_; /**< header and info of the pending snapshot */
+        std::vector<float> potential_snapshot_; /**< pending snapshot, empty once taken by the thread */
+        bool potential_shutdown_;
 
         void outlineMap(unsigned char* costarr, int nx, int ny, unsigned char value);
+        void resizeWorkspace(int nx, int ny);
         unsigned char* cost_array_;
         float* potential_array_;
+        nav_executor::MemoryCounter potential_memory_; /**< counts potential_array_, under the planner's name */
+        int workspace_nx_, workspace_ny_; /**< size the planner's arrays were last set up for */
+        unsigned long planning_version_; /**< version of costmap_ planning_costs_ was last brought up to */
+        int robot_cell_; /**< cell of planning_costs_ last cleared for the robot, -1 if none */
+
+        std::vector<Workspace*> workspaces_; /**< the pool, planner_workspaces - 1 of them */
+        std::vector<Workspace*> free_workspaces_;
+        boost::mutex workspace_mutex_;
+
+        /**
+         * @brief  The navigation function of computePotential() interpolated at map coordinates, or -1
+         */
+        double interpolatePotential(double mx, double my);
+        bool hasNavigationFunction(); /**< whether the navigation function holds for the current costs */
+        std::vector<float> nav_potential_; /**< navigation function computePotential() computed last */
+        geometry_msgs::Point nav_seed_; /**< the point it was seeded at */
+        unsigned long nav_version_; /**< version of costmap_ it was computed on */
+        unsigned int nav_nx_, nav_ny_; /**< and the size of the costmap then, 0 if it was not computed */
         unsigned int start_x_, start_y_, end_x_, end_y_;
 
         bool old_navfn_behavior_;
         float convert_offset_;
 
         dynamic_reconfigure::Server<global_planner::GlobalPlannerConfig> *dsrv_;
-        void reconfigureCB(global_planner::GlobalPlannerConfig &config, uint32_t level);
 
 };
 
@@ -37,6 +37,8 @@
  *********************************************************************/
 #ifndef _POTENTIAL_CALCULATOR_H
 #define _POTENTIAL_CALCULATOR_H
+#include <algorithm>
+
 namespace global_planner {
 
 class PotentialCalculator {
@@ -46,10 +48,18 @@ class PotentialCalculator {
         }
 
         virtual float calculatePotential(float* potential, unsigned char cost, int n, float prev_potential=-1){
+            return potentialOf(potential, cost, n, nx_, prev_potential);
+        }
+
+        /**
+         * @brief  The potential calculatePotential() gives, inlined into the expanders specialized on it
+         * @param nx The x size of the map
+         */
+        static inline float potentialOf(const float* potential, unsigned char cost, int n, int nx, float prev_potential){
             if(prev_potential < 0){
                 // get min of neighbors
                 float min_h = std::min( potential[n - 1], potential[n + 1] ),
-                      min_v = std::min( potential[n - nx_], potential[n + nx_]);
+                      min_v = std::min( potential[n - nx], potential[n + nx]);
                 prev_potential = std::min(min_h, min_v);
             }
 
@@ -36,49 +36,93 @@
  *         David V. Lu!!
  *********************************************************************/
 #include<global_planner/astar.h>
+#include<global_planner/quadratic_calculator.h>
 #include<costmap_2d/cost_values.h>
+#include <math.h>
+#include <stdlib.h>
+#include <typeinfo>
 
 namespace global_planner {
 
 AStarExpansion::AStarExpansion(PotentialCalculator* p_calc, int xs, int ys) :
-        Expander(p_calc, xs, ys) {
+        Expander(p_calc, xs, ys), buckets_(false), eight_connected_(false), weight_(1.0), buckets_head_(0), buckets_base_(0),
+        buckets_size_(0), bucket_width_(1.0) {
+    closed_.resize((ns_ + 31) / 32);
 }
-/**
- * 计算所有的可行点
- * @param  costs     [description]
- * @param  start_x   [description]
- * @param  start_y   [description]
- * @param  end_x     [description]
- * @param  end_y     [description]
- * @param  cycles    [description]
- * @param  potential [description]
- * @return           [description]
- */
+
+void AStarExpansion::setSize(int xs, int ys) {
+    Expander::setSize(xs, ys);
+    closed_.resize((ns_ + 31) / 32);
+}
+
 bool AStarExpansion::calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x, double end_y,
                                         int cycles, float* potential) {
     queue_.clear();
+    for (size_t b = 0; b < buckets_ring_.size(); b++)
+        buckets_ring_[b].clear();
+    buckets_size_ = 0;
+    buckets_head_ = 0;
+    bucket_width_ = neutral_cost_;
+    buckets_base_ = 0;
+    std::fill(closed_.begin(), closed_.end(), 0);
+
     int start_i = toIndex(start_x, start_y);
-    queue_.push_back(Index(start_i, 0));
+    push(start_i, 0);
 
-    std::fill(potential, potential + ns_, POT_HIGH);
+    resetPotential(potential);
     potential[start_i] = 0;
+    touched_.push_back(start_i);
 
+    // the search is instantiated for the calculators, the unknown space policies and
+    // the neighborhoods there are, and picked once here instead of in every cell added
+    const std::type_info& calc = typeid(*p_calc_);
+    if (calc == typeid(QuadraticCalculator))
+        return searchWith<InlinePotential<QuadraticCalculator> >(costs, end_x, end_y, cycles, potential);
+    if (calc == typeid(PotentialCalculator))
+        return searchWith<InlinePotential<PotentialCalculator> >(costs, end_x, end_y, cycles, potential);
+    return searchWith<VirtualPotential>(costs, end_x, end_y, cycles, potential);
+}
+
+template <class Kernel>
+bool AStarExpansion::searchWith(unsigned char* costs, int end_x, int end_y, int cycles, float* potential) {
+    if (unknown_)
+        return eight_connected_ ? search<Kernel, true, true>(costs, end_x, end_y, cycles, potential)
+                                : search<Kernel, true, false>(costs, end_x, end_y, cycles, potential);
+    return eight_connected_ ? search<Kernel, false, true>(costs, end_x, end_y, cycles, potential)
+                            : search<Kernel, false, false>(costs, end_x, end_y, cycles, potential);
+}
+
+template <class Kernel, bool Unknown, bool Eight>
+bool AStarExpansion::search(unsigned char* costs, int end_x, int end_y, int cycles, float* potential) {
     int goal_i = toIndex(end_x, end_y);
     int cycle = 0;
 
-    while (queue_.size() > 0 && cycle < cycles) {
-        Index top = queue_[0];
-        std::pop_heap(queue_.begin(), queue_.end(), greater1());
-        queue_.pop_back();
+    int i;
+    while (cycle < cycles && pop(i)) {
+        if (isClosed(i))
+            continue;
+        closed_[i >> 5] |= 1u << (i & 31);
 
-        int i = top.i;
         if (i == goal_i)
             return true;
 
-        add(costs, potential, potential[i], i + 1, end_x, end_y);
-        add(costs, potential, potential[i], i - 1, end_x, end_y);
-        add(costs, potential, potential[i], i + nx_, end_x, end_y);
-        add(costs, potential, potential[i], i - nx_, end_x, end_y);
+        add<Kernel, Unknown, Eight>(costs, potential, potential[i], i + 1, end_x, end_y);
+        add<Kernel, Unknown, Eight>(costs, potential, potential[i], i - 1, end_x, end_y);
+        add<Kernel, Unknown, Eight>(costs, potential, potential[i], i + nx_, end_x, end_y);
+        add<Kernel, Unknown, Eight>(costs, potential, potential[i], i - nx_, end_x, end_y);
+        if (Eight) {
+            // no cutting the corner of an obstacle
+            bool right = isFree<Unknown>(costs, i + 1), left = isFree<Unknown>(costs, i - 1);
+            bool down = isFree<Unknown>(costs, i + nx_), up = isFree<Unknown>(costs, i - nx_);
+            if (down && right)
+                add<Kernel, Unknown, Eight>(costs, potential, potential[i], i + nx_ + 1, end_x, end_y, true);
+            if (down && left)
+                add<Kernel, Unknown, Eight>(costs, potential, potential[i], i + nx_ - 1, end_x, end_y, true);
+            if (up && right)
+                add<Kernel, Unknown, Eight>(costs, potential, potential[i], i - nx_ + 1, end_x, end_y, true);
+            if (up && left)
+                add<Kernel, Unknown, Eight>(costs, potential, potential[i], i - nx_ - 1, end_x, end_y, true);
+        }
 
         cycle++;
     }
@@ -86,23 +130,86 @@ bool AStarExpansion::calculatePotentials(unsigned char* costs, double start_x, d
     return false;
 }
 
-void AStarExpansion::add(unsigned char* costs, float* potential, float prev_potential, int next_i, int end_x,
-                         int end_y) {
+template <class Kernel, bool Unknown, bool Eight>
+inline void AStarExpansion::add(unsigned char* costs, float* potential, float prev_potential, int next_i, int end_x,
+                                int end_y, bool diagonal) {
     if (next_i < 0 || next_i >= ns_)
         return;
 
-    if (potential[next_i] < POT_HIGH)
+    if (potential[next_i] < POT_HIGH && (!Eight || isClosed(next_i)))
         return;
 
-    if(costs[next_i]>=lethal_cost_ && !(unknown_ && costs[next_i]==costmap_2d::NO_INFORMATION))
+    if (!isFree<Unknown>(costs, next_i))
         return;
 
-    potential[next_i] = p_calc_->calculatePotential(potential, costs[next_i] + neutral_cost_, next_i, prev_potential);
+    float pot;
+    if (diagonal)
+        pot = prev_potential + M_SQRT2 * (costs[next_i] + neutral_cost_);
+    else
+        pot = Kernel::calculate(p_calc_, potential, costs[next_i] + neutral_cost_, next_i, nx_, prev_potential);
+    if (pot >= potential[next_i])
+        return;
+    if (potential[next_i] >= POT_HIGH)
+        touched_.push_back(next_i);
+    potential[next_i] = pot;
+
     int x = next_i % nx_, y = next_i / nx_;
-    float distance = abs(end_x - x) + abs(end_y - y);
+    float distance;
+    if (Eight) {
+        int dx = abs(end_x - x), dy = abs(end_y - y);
+        distance = std::max(dx, dy) + (M_SQRT2 - 1.0) * std::min(dx, dy);
+    } else
+        distance = abs(end_x - x) + abs(end_y - y);
+
+    push(next_i, potential[next_i] + distance * neutral_cost_ * weight_);
+}
+
+void AStarExpansion::push(int i, float f) {
+    if (!buckets_) {
+        queue_.push_back(Index(i, f));
+        std::push_heap(queue_.begin(), queue_.end(), greater1());
+        return;
+    }
 
-    queue_.push_back(Index(next_i, potential[next_i] + distance * neutral_cost_));
-    std::push_heap(queue_.begin(), queue_.end(), greater1());
+    // a cell with an f-cost below the first bucket, which an inconsistent heuristic
+    // allows, goes into the first one
+    int offset = std::max((int)(f / bucket_width_) - buckets_base_, 0);
+    if (buckets_size_ == 0) {
+        buckets_base_ += offset;
+        offset = 0;
+    }
+    if (offset >= (int)buckets_ring_.size()) {
+        // unroll the ring from its head into a larger one
+        std::vector<std::vector<int> > ring(std::max(2 * buckets_ring_.size(), (size_t)offset + 1));
+        for (size_t b = 0; b < buckets_ring_.size(); b++)
+            ring[b].swap(buckets_ring_[(buckets_head_ + b) % buckets_ring_.size()]);
+        buckets_ring_.swap(ring);
+        buckets_head_ = 0;
+    }
+    buckets_ring_[(buckets_head_ + offset) % buckets_ring_.size()].push_back(i);
+    buckets_size_++;
+}
+
+bool AStarExpansion::pop(int& i) {
+    if (!buckets_) {
+        if (queue_.empty())
+            return false;
+        i = queue_[0].i;
+        std::pop_heap(queue_.begin(), queue_.end(), greater1());
+        queue_.pop_back();
+        return true;
+    }
+
+    if (buckets_size_ == 0)
+        return false;
+    while (buckets_ring_[buckets_head_].empty()) {
+        buckets_head_ = (buckets_head_ + 1) % buckets_ring_.size();
+        buckets_base_++;
+    }
+    i = buckets_ring_[buckets_head_].back();
+    buckets_ring_[buckets_head_].pop_back();
+    buckets_size_--;
+    return true;
 }
 
 } //end namespace global_planner
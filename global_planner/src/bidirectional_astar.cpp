@@ -0,0 +1,184 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#include<global_planner/bidirectional_astar.h>
+#include<global_planner/quadratic_calculator.h>
+#include<costmap_2d/cost_values.h>
+#include <stdlib.h>
+#include <typeinfo>
+
+namespace global_planner {
+
+BidirectionalAStarExpansion::BidirectionalAStarExpansion(PotentialCalculator* p_calc, int xs, int ys) :
+        Expander(p_calc, xs, ys), forward_(NULL), start_i_(-1), goal_i_(-1), meet_(-1), best_(POT_HIGH) {
+    setSize(xs, ys);
+}
+
+void BidirectionalAStarExpansion::setSize(int xs, int ys) {
+    Expander::setSize(xs, ys);
+    for (int side = 0; side < 2; side++)
+        closed_[side].resize((ns_ + 31) / 32);
+    backward_.assign(ns_, POT_HIGH);
+    backward_touched_.clear();
+    meet_ = -1;
+}
+
+void BidirectionalAStarExpansion::forgetPotential() {
+    Expander::forgetPotential();
+    meet_ = -1;
+}
+
+void BidirectionalAStarExpansion::resetBackward() {
+    if (backward_touched_.size() < (size_t)ns_ / 4) {
+        for (size_t i = 0; i < backward_touched_.size(); i++)
+            backward_[backward_touched_[i]] = POT_HIGH;
+    } else
+        std::fill(backward_.begin(), backward_.end(), POT_HIGH);
+    backward_touched_.clear();
+}
+
+bool BidirectionalAStarExpansion::calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x,
+                                                     double end_y, int cycles, float* potential) {
+    for (int side = 0; side < 2; side++) {
+        queue_[side].clear();
+        std::fill(closed_[side].begin(), closed_[side].end(), 0);
+    }
+    target_x_[0] = end_x;
+    target_y_[0] = end_y;
+    target_x_[1] = start_x;
+    target_y_[1] = start_y;
+
+    start_i_ = toIndex(start_x, start_y);
+    goal_i_ = toIndex(end_x, end_y);
+    forward_ = potential;
+    meet_ = -1;
+    best_ = POT_HIGH;
+
+    resetPotential(potential);
+    potential[start_i_] = 0;
+    touched_.push_back(start_i_);
+    resetBackward();
+    backward_[goal_i_] = 0;
+    backward_touched_.push_back(goal_i_);
+
+    if (start_i_ == goal_i_) {
+        meet_ = start_i_;
+        best_ = 0;
+        return true;
+    }
+    queue_[0].push_back(Index(start_i_, 0));
+    queue_[1].push_back(Index(goal_i_, 0));
+
+    const std::type_info& calc = typeid(*p_calc_);
+    if (calc == typeid(QuadraticCalculator))
+        return searchWith<InlinePotential<QuadraticCalculator> >(costs, cycles, potential);
+    if (calc == typeid(PotentialCalculator))
+        return searchWith<InlinePotential<PotentialCalculator> >(costs, cycles, potential);
+    return searchWith<VirtualPotential>(costs, cycles, potential);
+}
+
+template <class Kernel>
+bool BidirectionalAStarExpansion::searchWith(unsigned char* costs, int cycles, float* potential) {
+    if (unknown_)
+        return search<Kernel, true>(costs, cycles, potential);
+    return search<Kernel, false>(costs, cycles, potential);
+}
+
+template <class Kernel, bool Unknown>
+bool BidirectionalAStarExpansion::search(unsigned char* costs, int cycles, float* potential) {
+    float* fields[2] = { potential, &backward_[0] };
+    int cycle = 0;
+
+    while (cycle < cycles && !queue_[0].empty() && !queue_[1].empty()) {
+        //no path through a cell still open on either side is cheaper than the one through the meeting cell
+        if (queue_[0][0].cost >= best_ || queue_[1][0].cost >= best_)
+            break;
+
+        //the search with fewer open cells goes on, so that the two grow about as wide
+        int side = queue_[0].size() <= queue_[1].size() ? 0 : 1;
+        int i = queue_[side][0].i;
+        std::pop_heap(queue_[side].begin(), queue_[side].end(), greater1());
+        queue_[side].pop_back();
+        if (isClosed(side, i))
+            continue;
+        closed_[side][i >> 5] |= 1u << (i & 31);
+
+        float* field = fields[side];
+        float* other = fields[1 - side];
+        add<Kernel, Unknown>(costs, side, field, other, field[i], i + 1);
+        add<Kernel, Unknown>(costs, side, field, other, field[i], i - 1);
+        add<Kernel, Unknown>(costs, side, field, other, field[i], i + nx_);
+        add<Kernel, Unknown>(costs, side, field, other, field[i], i - nx_);
+
+        cycle++;
+    }
+
+    return meet_ >= 0;
+}
+
+template <class Kernel, bool Unknown>
+inline void BidirectionalAStarExpansion::add(unsigned char* costs, int side, float* field, float* other,
+                                             float prev_potential, int next_i) {
+    if (next_i < 0 || next_i >= ns_)
+        return;
+
+    if (field[next_i] < POT_HIGH)
+        return;
+
+    if (!isFree<Unknown>(costs, next_i))
+        return;
+
+    float pot = Kernel::calculate(p_calc_, field, costs[next_i] + neutral_cost_, next_i, nx_, prev_potential);
+    field[next_i] = pot;
+    if (side == 0)
+        touched_.push_back(next_i);
+    else
+        backward_touched_.push_back(next_i);
+
+    //reached from both ends
+    if (other[next_i] < POT_HIGH && pot + other[next_i] < best_) {
+        best_ = pot + other[next_i];
+        meet_ = next_i;
+    }
+
+    int x = next_i % nx_, y = next_i / nx_;
+    float distance = abs(target_x_[side] - x) + abs(target_y_[side] - y);
+    queue_[side].push_back(Index(next_i, pot + distance * neutral_cost_));
+    std::push_heap(queue_[side].begin(), queue_[side].end(), greater1());
+}
+
+} //end namespace global_planner
@@ -0,0 +1,84 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#include <global_planner/bidirectional_path.h>
+
+namespace global_planner {
+
+BidirectionalPath::BidirectionalPath(Traceback* inner, BidirectionalAStarExpansion* expander) :
+        Traceback(NULL), inner_(inner), expander_(expander) {
+}
+
+BidirectionalPath::~BidirectionalPath() {
+    delete inner_;
+}
+
+void BidirectionalPath::setSize(int xs, int ys) {
+    Traceback::setSize(xs, ys);
+    inner_->setSize(xs, ys);
+}
+
+void BidirectionalPath::setLethalCost(unsigned char lethal_cost) {
+    Traceback::setLethalCost(lethal_cost);
+    inner_->setLethalCost(lethal_cost);
+}
+
+bool BidirectionalPath::getPath(float* potential, double start_x, double start_y, double end_x, double end_y,
+                                std::vector<std::pair<float, float> >& path) {
+    if (!expander_->hasMeeting(potential, (int)start_x, (int)start_y, (int)end_x, (int)end_y))
+        return inner_->getPath(potential, start_x, start_y, end_x, end_y, path);
+
+    int meet = expander_->getMeetingCell();
+    double meet_x = meet % xs_, meet_y = meet / xs_;
+
+    //the path runs from the end to the start, so first from the end down to the meeting cell
+    path.clear();
+    half_.clear();
+    if (!inner_->getPath(expander_->getBackwardPotential(), end_x, end_y, meet_x, meet_y, half_))
+        return false;
+    path.insert(path.end(), half_.rbegin(), half_.rend());
+
+    //then on from the meeting cell, which both halves start with
+    half_.clear();
+    if (!inner_->getPath(potential, start_x, start_y, meet_x, meet_y, half_))
+        return false;
+    if (!half_.empty())
+        path.insert(path.end(), half_.begin() + 1, half_.end());
+    return true;
+}
+
+} //end namespace global_planner
@@ -0,0 +1,368 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#include <global_planner/cluster_graph.h>
+#include <functional>
+
+namespace global_planner {
+
+// an entrance up to this many cells wide is crossed at its middle, and a wider
+// one at both its ends
+static const int WIDE_ENTRANCE = 6;
+
+typedef std::greater<std::pair<float, int> > greater_first;
+
+ClusterGraph::ClusterGraph(int cluster_size) :
+        nx_(0), ny_(0), size_(std::max(cluster_size, 2)), cx_(0), cy_(0), unknown_(true), lethal_cost_(253),
+        neutral_cost_(50), factor_(3.0), dirty_(false) {
+}
+
+void ClusterGraph::setSize(int nx, int ny) {
+    nx_ = nx;
+    ny_ = ny;
+    cx_ = (nx + size_ - 1) / size_;
+    cy_ = (ny + size_ - 1) / size_;
+    clusters_.assign(cx_ * cy_, Cluster());
+    next_x_.assign(cx_ * cy_, Entrances());
+    next_y_.assign(cx_ * cy_, Entrances());
+    invalidateAll();
+}
+
+void ClusterGraph::setClusterSize(int cluster_size) {
+    cluster_size = std::max(cluster_size, 2);
+    if (cluster_size == size_)
+        return;
+    size_ = cluster_size;
+    setSize(nx_, ny_);
+}
+
+void ClusterGraph::setLethalCost(unsigned char lethal_cost) {
+    if (lethal_cost != lethal_cost_)
+        invalidateAll();
+    lethal_cost_ = lethal_cost;
+}
+
+void ClusterGraph::setNeutralCost(unsigned char neutral_cost) {
+    if (neutral_cost != neutral_cost_)
+        invalidateAll();
+    neutral_cost_ = neutral_cost;
+}
+
+void ClusterGraph::setFactor(float factor) {
+    if (factor != factor_)
+        invalidateAll();
+    factor_ = factor;
+}
+
+void ClusterGraph::setHasUnknown(bool unknown) {
+    if (unknown != unknown_)
+        invalidateAll();
+    unknown_ = unknown;
+}
+
+void ClusterGraph::invalidateAll() {
+    for (size_t c = 0; c < clusters_.size(); c++)
+        clusters_[c].dirty = true;
+    dirty_ = !clusters_.empty();
+}
+
+void ClusterGraph::invalidate(int x0, int xn, int y0, int yn) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    xn = std::min(xn, nx_);
+    yn = std::min(yn, ny_);
+    if (x0 >= xn || y0 >= yn)
+        return;
+    for (int y = y0 / size_; y <= (yn - 1) / size_; y++)
+        for (int x = x0 / size_; x <= (xn - 1) / size_; x++)
+            clusters_[y * cx_ + x].dirty = true;
+    dirty_ = true;
+}
+
+void ClusterGraph::getClusterBounds(int cluster, int* x0, int* xn, int* y0, int* yn) const {
+    *x0 = cluster % cx_ * size_;
+    *y0 = cluster / cx_ * size_;
+    *xn = std::min(*x0 + size_, nx_);
+    *yn = std::min(*y0 + size_, ny_);
+}
+
+int ClusterGraph::nodeAt(int c, int cell) const {
+    const std::vector<Node>& nodes = clusters_[c].nodes;
+    for (size_t n = 0; n < nodes.size(); n++)
+        if (nodes[n].cell == cell)
+            return n;
+    return -1;
+}
+
+void ClusterGraph::refresh(unsigned char* costs) {
+    if (!dirty_)
+        return;
+
+    // the borders of the changed clusters are searched for entrances again, and
+    // the clusters on a border whose entrances changed are built again too
+    std::vector<bool> rebuild(clusters_.size(), false);
+    for (int c = 0; c < (int)clusters_.size(); c++) {
+        if (!clusters_[c].dirty)
+            continue;
+        rebuild[c] = true;
+        int x = c % cx_, y = c / cx_;
+        if (x + 1 < cx_ && findEntrances(costs, c, true, next_x_[c]))
+            rebuild[c + 1] = true;
+        if (x > 0 && findEntrances(costs, c - 1, true, next_x_[c - 1]))
+            rebuild[c - 1] = true;
+        if (y + 1 < cy_ && findEntrances(costs, c, false, next_y_[c]))
+            rebuild[c + cx_] = true;
+        if (y > 0 && findEntrances(costs, c - cx_, false, next_y_[c - cx_]))
+            rebuild[c - cx_] = true;
+    }
+
+    for (int c = 0; c < (int)clusters_.size(); c++) {
+        if (!rebuild[c])
+            continue;
+        findNodes(costs, c);
+        clusters_[c].dirty = false;
+    }
+    dirty_ = false;
+}
+
+bool ClusterGraph::findEntrances(unsigned char* costs, int a, bool next_x, Entrances& entrances) {
+    // walk the last column or row of a, next to the first of the next cluster
+    int x0, xn, y0, yn;
+    getClusterBounds(a, &x0, &xn, &y0, &yn);
+    int first, across, along, length;
+    if (next_x) {
+        first = y0 * nx_ + xn - 1;
+        across = 1;
+        along = nx_;
+        length = yn - y0;
+    } else {
+        first = (yn - 1) * nx_ + x0;
+        across = nx_;
+        along = 1;
+        length = xn - x0;
+    }
+
+    Entrances found;
+    int run = 0;
+    for (int k = 0; k <= length; k++) {
+        int i = first + k * along;
+        if (k < length && cellCost(costs, i) >= 0 && cellCost(costs, i + across) >= 0) {
+            run++;
+            continue;
+        }
+        if (run > WIDE_ENTRANCE) {
+            int start = i - run * along, end = i - along;
+            found.push_back(std::make_pair(start, start + across));
+            found.push_back(std::make_pair(end, end + across));
+        } else if (run > 0) {
+            int middle = i - (run + 1) / 2 * along;
+            found.push_back(std::make_pair(middle, middle + across));
+        }
+        run = 0;
+    }
+
+    bool changed = found != entrances;
+    entrances.swap(found);
+    return changed;
+}
+
+void ClusterGraph::findNodes(unsigned char* costs, int c) {
+    Cluster& cluster = clusters_[c];
+    cluster.nodes.clear();
+
+    // its side of the entrances on each of its borders
+    int x = c % cx_, y = c / cx_;
+    const Entrances* borders[4] = { x + 1 < cx_ ? &next_x_[c] : NULL, y + 1 < cy_ ? &next_y_[c] : NULL,
+                                    x > 0 ? &next_x_[c - 1] : NULL, y > 0 ? &next_y_[c - cx_] : NULL };
+    for (int b = 0; b < 4; b++) {
+        if (!borders[b])
+            continue;
+        const Entrances& entrances = *borders[b];
+        for (size_t e = 0; e < entrances.size(); e++) {
+            int cell = b < 2 ? entrances[e].first : entrances[e].second;
+            int n = nodeAt(c, cell);
+            if (n < 0) {
+                n = cluster.nodes.size();
+                cluster.nodes.push_back(Node());
+                cluster.nodes[n].cell = cell;
+            }
+            cluster.nodes[n].across.push_back(b < 2 ? entrances[e].second : entrances[e].first);
+        }
+    }
+
+    size_t k = cluster.nodes.size();
+    cluster.paths.assign(k * k, POT_HIGH);
+    for (size_t a = 0; a < k; a++) {
+        searchCluster(costs, c, cluster.nodes[a].cell, false);
+        for (size_t b = 0; b < k; b++)
+            cluster.paths[a * k + b] = cell_costs_[localIndex(c, cluster.nodes[b].cell)];
+    }
+}
+
+void ClusterGraph::searchCluster(unsigned char* costs, int c, int cell, bool reverse) {
+    int x0, xn, y0, yn;
+    getClusterBounds(c, &x0, &xn, &y0, &yn);
+    int w = xn - x0, h = yn - y0;
+    cell_costs_.assign(w * h, POT_HIGH);
+    cell_queue_.clear();
+
+    int local = localIndex(c, cell);
+    cell_costs_[local] = 0;
+    cell_queue_.push_back(std::make_pair(0.0f, local));
+
+    // forward, the cost of a step is that of the cell entered; in reverse, toward
+    // the cell, that of the cell left
+    static const int dx[4] = { 1, -1, 0, 0 }, dy[4] = { 0, 0, 1, -1 };
+    while (!cell_queue_.empty()) {
+        std::pop_heap(cell_queue_.begin(), cell_queue_.end(), greater_first());
+        std::pair<float, int> top = cell_queue_.back();
+        cell_queue_.pop_back();
+        if (top.first > cell_costs_[top.second])
+            continue;
+
+        int lx = top.second % w, ly = top.second / w;
+        int i = (y0 + ly) * nx_ + x0 + lx;
+        float leave = cellCost(costs, i);
+        if (reverse && leave < 0)
+            continue;
+        for (int d = 0; d < 4; d++) {
+            if (lx + dx[d] < 0 || lx + dx[d] >= w || ly + dy[d] < 0 || ly + dy[d] >= h)
+                continue;
+            float enter = cellCost(costs, i + dx[d] + dy[d] * nx_);
+            if (enter < 0)
+                continue;
+            float g = top.first + (reverse ? leave : enter);
+            int n = top.second + dx[d] + dy[d] * w;
+            if (g < cell_costs_[n]) {
+                cell_costs_[n] = g;
+                cell_queue_.push_back(std::make_pair(g, n));
+                std::push_heap(cell_queue_.begin(), cell_queue_.end(), greater_first());
+            }
+        }
+    }
+}
+
+void ClusterGraph::relax(int node, float g, int parent, int cell, int goal_x, int goal_y) {
+    if (g >= g_[node])
+        return;
+    g_[node] = g;
+    parents_[node] = parent;
+    queue_.push_back(std::make_pair(g + heuristic(cell, goal_x, goal_y), node));
+    std::push_heap(queue_.begin(), queue_.end(), greater_first());
+}
+
+bool ClusterGraph::findCorridor(unsigned char* costs, int start_x, int start_y, int goal_x, int goal_y,
+                                std::vector<int>& corridor) {
+    corridor.clear();
+    if (clusters_.empty())
+        return false;
+    refresh(costs);
+
+    // the nodes are numbered cluster by cluster, and followed by the start and the goal
+    offsets_.resize(clusters_.size() + 1);
+    offsets_[0] = 0;
+    node_cluster_.clear();
+    for (size_t c = 0; c < clusters_.size(); c++) {
+        offsets_[c + 1] = offsets_[c] + clusters_[c].nodes.size();
+        node_cluster_.insert(node_cluster_.end(), clusters_[c].nodes.size(), c);
+    }
+    int start_node = offsets_.back(), goal_node = start_node + 1;
+    g_.assign(goal_node + 1, POT_HIGH);
+    parents_.assign(goal_node + 1, -1);
+    queue_.clear();
+
+    int start = start_y * nx_ + start_x, goal = goal_y * nx_ + goal_x;
+    int start_cluster = clusterOf(start), goal_cluster = clusterOf(goal);
+
+    // the goal is joined to the nodes of its cluster, and the start to those of
+    // its own, and to the goal when it is in the same one
+    const Cluster& last = clusters_[goal_cluster];
+    searchCluster(costs, goal_cluster, goal, true);
+    to_goal_.resize(last.nodes.size());
+    for (size_t n = 0; n < last.nodes.size(); n++)
+        to_goal_[n] = cell_costs_[localIndex(goal_cluster, last.nodes[n].cell)];
+
+    const Cluster& first = clusters_[start_cluster];
+    searchCluster(costs, start_cluster, start, false);
+    g_[start_node] = 0;
+    for (size_t n = 0; n < first.nodes.size(); n++)
+        relax(offsets_[start_cluster] + n, cell_costs_[localIndex(start_cluster, first.nodes[n].cell)], start_node,
+              first.nodes[n].cell, goal_x, goal_y);
+    if (start_cluster == goal_cluster)
+        relax(goal_node, cell_costs_[localIndex(goal_cluster, goal)], start_node, goal, goal_x, goal_y);
+
+    while (!queue_.empty()) {
+        std::pop_heap(queue_.begin(), queue_.end(), greater_first());
+        std::pair<float, int> top = queue_.back();
+        queue_.pop_back();
+        int node = top.second;
+        if (node == goal_node)
+            break;
+
+        int c = node_cluster_[node], a = node - offsets_[c];
+        const Cluster& cluster = clusters_[c];
+        float g = g_[node];
+        if (top.first > g + heuristic(cluster.nodes[a].cell, goal_x, goal_y))
+            continue;
+
+        size_t k = cluster.nodes.size();
+        for (size_t b = 0; b < k; b++)
+            if (cluster.paths[a * k + b] < POT_HIGH)
+                relax(offsets_[c] + b, g + cluster.paths[a * k + b], node, cluster.nodes[b].cell, goal_x, goal_y);
+        if (c == goal_cluster && to_goal_[a] < POT_HIGH)
+            relax(goal_node, g + to_goal_[a], node, goal, goal_x, goal_y);
+
+        const std::vector<int>& across = cluster.nodes[a].across;
+        for (size_t e = 0; e < across.size(); e++) {
+            int other = clusterOf(across[e]), b = nodeAt(other, across[e]);
+            if (b >= 0)
+                relax(offsets_[other] + b, g + cellCost(costs, across[e]), node, across[e], goal_x, goal_y);
+        }
+    }
+    if (g_[goal_node] >= POT_HIGH)
+        return false;
+
+    for (int node = goal_node; node >= 0; node = parents_[node]) {
+        int c = node == goal_node ? goal_cluster : node == start_node ? start_cluster : node_cluster_[node];
+        if (corridor.empty() || corridor.back() != c)
+            corridor.push_back(c);
+    }
+    std::reverse(corridor.begin(), corridor.end());
+    return true;
+}
+
+} //end namespace global_planner
@@ -36,15 +36,21 @@
  *         David V. Lu!!
  *********************************************************************/
 #include<global_planner/dijkstra.h>
+#include<global_planner/quadratic_calculator.h>
 #include <algorithm>
+#include <typeinfo>
 namespace global_planner {
 
 DijkstraExpansion::DijkstraExpansion(PotentialCalculator* p_calc, int nx, int ny) :
-        Expander(p_calc, nx, ny), pending_(NULL), precise_(false) {
+        Expander(p_calc, nx, ny), pending_(NULL), precise_(false), settle_margin_(0) {
     // priority buffers
     buffer1_ = new int[PRIORITYBUFSIZE];
     buffer2_ = new int[PRIORITYBUFSIZE];
     buffer3_ = new int[PRIORITYBUFSIZE];
+    currentBuffer_ = buffer1_;
+    nextBuffer_ = buffer2_;
+    overBuffer_ = buffer3_;
+    currentEnd_ = nextEnd_ = overEnd_ = 0;
 
     priorityIncrement_ = 2 * neutral_cost_;
 }
@@ -67,6 +73,7 @@ void DijkstraExpansion::setSize(int xs, int ys) {
 
     pending_ = new bool[ns_];
     memset(pending_, 0, ns_ * sizeof(bool));
+    currentEnd_ = nextEnd_ = overEnd_ = 0;
 }
 
 //
@@ -90,7 +97,36 @@ void DijkstraExpansion::setSize(int xs, int ys) {
  */
 bool DijkstraExpansion::calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x, double end_y,
                                            int cycles, float* potential) {
+    setupStart(costs, start_x, start_y, potential);
+
+    // set up start cell
+    int startCell = toIndex(end_x, end_y);
+    return propagateWith(costs, potential, cycles, &startCell, 1);
+}
+
+bool DijkstraExpansion::calculatePotentials(unsigned char* costs, double start_x, double start_y,
+                                           const std::vector<int>& goals, int cycles, float* potential) {
+    setupStart(costs, start_x, start_y, potential);
+    return goals.empty() || propagateWith(costs, potential, cycles, &goals[0], goals.size());
+}
+
+bool DijkstraExpansion::calculateAllPotentials(unsigned char* costs, double start_x, double start_y, int cycles,
+                                               float* potential) {
+    setupStart(costs, start_x, start_y, potential);
+    return propagateWith(costs, potential, cycles, NULL, 0);
+}
+
+void DijkstraExpansion::setupStart(unsigned char* costs, double start_x, double start_y, float* potential) {
     cells_visited_ = 0;
+    // the cells left in the priority blocks by the last call are the only pending ones
+    for (int i = 0; i < currentEnd_; i++)
+        pending_[currentBuffer_[i]] = false;
+    for (int i = 0; i < nextEnd_; i++)
+        pending_[nextBuffer_[i]] = false;
+    for (int i = 0; i < overEnd_; i++)
+        pending_[overBuffer_[i]] = false;
+    resetPotential(potential);
+
     // priority buffers
     threshold_ = lethal_cost_;
     currentBuffer_ = buffer1_;
@@ -99,8 +135,6 @@ bool DijkstraExpansion::calculatePotentials(unsigned char* costs, double start_x
     nextEnd_ = 0;
     overBuffer_ = buffer3_;
     overEnd_ = 0;
-    memset(pending_, 0, ns_ * sizeof(bool));
-    std::fill(potential, potential + ns_, POT_HIGH);
 
     // set goal
     // 设置目标点 x + nx_ * y; （nx_ 地图的宽度）
@@ -117,6 +151,10 @@ bool DijkstraExpansion::calculatePotentials(unsigned char* costs, double start_x
         potential[k+1] = neutral_cost_ * 2 * (1-dx)*dy;
         potential[k+nx_] = neutral_cost_*2*dx*(1-dy);
         potential[k+nx_+1] = neutral_cost_*2*(1-dx)*(1-dy);//*/
+        touched_.push_back(k);
+        touched_.push_back(k+1);
+        touched_.push_back(k+nx_);
+        touched_.push_back(k+nx_+1);
 
         push_cur(k+2);
         push_cur(k-1);
@@ -129,24 +167,41 @@ bool DijkstraExpansion::calculatePotentials(unsigned char* costs, double start_x
         push_cur(k+nx_*2+1);
     }else{
         potential[k] = 0;
+        touched_.push_back(k);
         push_cur(k+1);
         push_cur(k-1);
         push_cur(k-nx_);
         push_cur(k+nx_);
     }
+}
+
+bool DijkstraExpansion::propagateWith(unsigned char* costs, float* potential, int cycles, const int* goals, int ngoals) {
+    // the propagation is instantiated for the calculators and the unknown space
+    // policies there are, and picked once here instead of in every cell update
+    const std::type_info& calc = typeid(*p_calc_);
+    if (calc == typeid(QuadraticCalculator))
+        return unknown_ ? propagate<InlinePotential<QuadraticCalculator>, true>(costs, potential, cycles, goals, ngoals)
+                        : propagate<InlinePotential<QuadraticCalculator>, false>(costs, potential, cycles, goals, ngoals);
+    if (calc == typeid(PotentialCalculator))
+        return unknown_ ? propagate<InlinePotential<PotentialCalculator>, true>(costs, potential, cycles, goals, ngoals)
+                        : propagate<InlinePotential<PotentialCalculator>, false>(costs, potential, cycles, goals, ngoals);
+    return unknown_ ? propagate<VirtualPotential, true>(costs, potential, cycles, goals, ngoals)
+                    : propagate<VirtualPotential, false>(costs, potential, cycles, goals, ngoals);
+}
 
+template <class Kernel, bool Unknown>
+bool DijkstraExpansion::propagate(unsigned char* costs, float* potential, int cycles, const int* goals, int ngoals) {
     int nwv = 0;            // max priority block size
     int nc = 0;            // number of cells put into priority blocks
     int cycle = 0;        // which cycle we're on
-
-    // set up start cell
-    int startCell = toIndex(end_x, end_y);
+    int reached = 0;       // goals with a potential, in order
+    float settled = -1;    // threshold past which the goals' neighborhoods are settled
 
     for (; cycle < cycles; cycle++) // go for this many cycles, unless interrupted
             {
         // 
         if (currentEnd_ == 0 && nextEnd_ == 0) // priority blocks empty
-            return false;
+            return reached == ngoals;
 
         // stats
         nc += currentEnd_;
@@ -163,7 +218,7 @@ bool DijkstraExpansion::calculatePotentials(unsigned char* costs, double start_x
         pb = currentBuffer_;
         i = currentEnd_;
         while (i-- > 0)
-            updateCell(costs, potential, *pb++);
+            updateCell<Kernel, Unknown>(costs, potential, *pb++);
 
         // swap priority blocks currentBuffer_ <=> nextBuffer_
         currentEnd_ = nextEnd_;
@@ -182,9 +237,20 @@ bool DijkstraExpansion::calculatePotentials(unsigned char* costs, double start_x
             overBuffer_ = pb;
         }
 
-        // check if we've hit the Start cell
-        if (potential[startCell] < POT_HIGH)
-            break;
+        // check if we've hit the Start cell, or every goal
+        while (reached < ngoals && potential[goals[reached]] < POT_HIGH)
+            reached++;
+        if (ngoals > 0 && reached == ngoals) {
+            if (settle_margin_ <= 0)
+                break;
+            if (settled < 0) {
+                for (int g = 0; g < ngoals; g++)
+                    settled = std::max(settled, potential[goals[g]]);
+                settled += settle_margin_;
+            }
+            if (threshold_ > settled)
+                break;
+        }
     }
     //ROS_INFO("CYCLES %d/%d ", cycle, cycles);
     if (cycle < cycles)
@@ -203,45 +269,38 @@ bool DijkstraExpansion::calculatePotentials(unsigned char* costs, double start_x
 
 #define INVSQRT2 0.707106781
 
+template <class Kernel, bool Unknown>
 inline void DijkstraExpansion::updateCell(unsigned char* costs, float* potential, int n) {
     cells_visited_++;
 
     // do planar wave update
-    float c = getCost(costs, n);
+    float c = cellCost<Unknown>(costs, n);
     if (c >= lethal_cost_)    // don't propagate into obstacles
         return;
 
-    float pot = p_calc_->calculatePotential(potential, c, n);
+    float pot = Kernel::calculate(p_calc_, potential, c, n, nx_);
 
     // now add affected neighbors to priority blocks
     if (pot < potential[n]) {
-        float le = INVSQRT2 * (float)getCost(costs, n - 1);
-        float re = INVSQRT2 * (float)getCost(costs, n + 1);
-        float ue = INVSQRT2 * (float)getCost(costs, n - nx_);
-        float de = INVSQRT2 * (float)getCost(costs, n + nx_);
+        float le = INVSQRT2 * (float)cellCost<Unknown>(costs, n - 1);
+        float re = INVSQRT2 * (float)cellCost<Unknown>(costs, n + 1);
+        float ue = INVSQRT2 * (float)cellCost<Unknown>(costs, n - nx_);
+        float de = INVSQRT2 * (float)cellCost<Unknown>(costs, n + nx_);
+        if (potential[n] >= POT_HIGH)
+            touched_.push_back(n);
         potential[n] = pot;
         //ROS_INFO("UPDATE %d %d %d %f", n, n%nx, n/nx, potential[n]);
-        if (pot < threshold_)    // low-cost buffer block
-                {
-            if (potential[n - 1] > pot + le)
-                push_next(n-1);
-            if (potential[n + 1] > pot + re)
-                push_next(n+1);
-            if (potential[n - nx_] > pot + ue)
-                push_next(n-nx_);
-            if (potential[n + nx_] > pot + de)
-                push_next(n+nx_);
-        } else            // overflow block
-        {
-            if (potential[n - 1] > pot + le)
-                push_over(n-1);
-            if (potential[n + 1] > pot + re)
-                push_over(n+1);
-            if (potential[n - nx_] > pot + ue)
-                push_over(n-nx_);
-            if (potential[n + nx_] > pot + de)
-                push_over(n+nx_);
-        }
+        // low-cost buffer block, or overflow block
+        int* buffer = pot < threshold_ ? nextBuffer_ : overBuffer_;
+        int& end = pot < threshold_ ? nextEnd_ : overEnd_;
+        if (potential[n - 1] > pot + le)
+            pushCell<Unknown>(costs, buffer, end, n - 1);
+        if (potential[n + 1] > pot + re)
+            pushCell<Unknown>(costs, buffer, end, n + 1);
+        if (potential[n - nx_] > pot + ue)
+            pushCell<Unknown>(costs, buffer, end, n - nx_);
+        if (potential[n + nx_] > pot + de)
+            pushCell<Unknown>(costs, buffer, end, n + nx_);
     }
 }
 
@@ -63,6 +63,9 @@ void GradientPath::setSize(int xs, int ys) {
         delete[] grady_;
     gradx_ = new float[xs * ys];
     grady_ = new float[xs * ys];
+    memset(gradx_, 0, xs * ys * sizeof(float));
+    memset(grady_, 0, xs * ys * sizeof(float));
+    touched_.clear();
 }
 
 bool GradientPath::getPath(float* potential, double start_x, double start_y, double goal_x, double goal_y, std::vector<std::pair<float, float> >& path) {
@@ -73,8 +76,9 @@ bool GradientPath::getPath(float* potential, double start_x, double start_y, dou
     float dx = goal_x - (int)goal_x;
     float dy = goal_y - (int)goal_y;
     int ns = xs_ * ys_;
-    memset(gradx_, 0, ns * sizeof(float));
-    memset(grady_, 0, ns * sizeof(float));
+    for (size_t i = 0; i < touched_.size(); i++)
+        gradx_[touched_[i]] = grady_[touched_[i]] = 0.0;
+    touched_.clear();
 
     int c = 0;
     while (c++<ns*4) {
@@ -313,6 +317,7 @@ float GradientPath::gradCell(float* potential, int n) {
         norm = 1.0 / norm;
         gradx_[n] = norm * dx;
         grady_[n] = norm * dy;
+        touched_.push_back(n);
     }
     return norm;
 }
@@ -0,0 +1,133 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#include <global_planner/hierarchical_planner.h>
+#include <pluginlib/class_list_macros.h>
+#include <costmap_2d/cost_values.h>
+#include <string.h>
+
+//register this planner as a BaseGlobalPlanner plugin
+PLUGINLIB_EXPORT_CLASS(global_planner::HierarchicalPlanner, nav_core::BaseGlobalPlanner)
+
+namespace global_planner {
+
+HierarchicalPlanner::HierarchicalPlanner() :
+        graph_(64), graph_version_(0) {
+    corridor_costs_.setDefaultValue(costmap_2d::LETHAL_OBSTACLE);
+}
+
+HierarchicalPlanner::HierarchicalPlanner(std::string name, costmap_2d::Costmap2D* costmap, std::string frame_id) :
+        graph_(64), graph_version_(0) {
+    corridor_costs_.setDefaultValue(costmap_2d::LETHAL_OBSTACLE);
+    initialize(name, costmap, frame_id);
+}
+
+void HierarchicalPlanner::initialize(std::string name, costmap_2d::Costmap2DROS* costmap_ros) {
+    initialize(name, costmap_ros->getCostmap(), costmap_ros->getGlobalFrameID());
+}
+
+void HierarchicalPlanner::initialize(std::string name, costmap_2d::Costmap2D* costmap, std::string frame_id) {
+    bool initialized = initialized_;
+    GlobalPlanner::initialize(name, costmap, frame_id);
+    if (initialized)
+        return;
+
+    ros::NodeHandle private_nh("~/" + name);
+    int cluster_size;
+    private_nh.param("cluster_size", cluster_size, 64);
+    graph_.setClusterSize(cluster_size);
+    graph_.setHasUnknown(allow_unknown_);
+}
+
+void HierarchicalPlanner::reconfigureCB(global_planner::GlobalPlannerConfig& config, uint32_t level) {
+    GlobalPlanner::reconfigureCB(config, level);
+    graph_.setLethalCost(config.lethal_cost);
+    graph_.setNeutralCost(config.neutral_cost);
+    graph_.setFactor(config.cost_factor);
+}
+
+costmap_2d::Costmap2D* HierarchicalPlanner::getPlanningCostmap(unsigned int start_x, unsigned int start_y,
+                                                               unsigned int goal_x, unsigned int goal_y) {
+    unsigned int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+
+    //the graph is built again over the clusters whose costs changed since the last plan
+    unsigned int x0, xn, y0, yn;
+    if (nx != corridor_costs_.getSizeInCellsX() || ny != corridor_costs_.getSizeInCellsY()) {
+        corridor_costs_.resizeMap(nx, ny, costmap_->getResolution(), costmap_->getOriginX(), costmap_->getOriginY());
+        corridor_.clear();
+        graph_.setSize(nx, ny);
+    } else if (planning_costs_.getChangesSince(graph_version_, &x0, &xn, &y0, &yn))
+        graph_.invalidate(x0, xn, y0, yn);
+    else
+        graph_.invalidate(0, nx, 0, ny);
+    graph_version_ = planning_costs_.getVersion();
+
+    std::vector<int> corridor;
+    if (!graph_.findCorridor(planning_costs_.getCharMap(), start_x, start_y, goal_x, goal_y, corridor)) {
+        ROS_DEBUG("No route through the clusters of the costmap, searching all of it");
+        return &planning_costs_;
+    }
+
+    //the clusters of the last route are made lethal again, and the costs of this one's copied in
+    unsigned char* costs = planning_costs_.getCharMap();
+    unsigned char* corridor_costs = corridor_costs_.getCharMap();
+    unsigned int changed_x0 = nx, changed_xn = 0, changed_y0 = ny, changed_yn = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        const std::vector<int>& clusters = pass == 0 ? corridor_ : corridor;
+        for (size_t c = 0; c < clusters.size(); c++) {
+            int cx0, cxn, cy0, cyn;
+            graph_.getClusterBounds(clusters[c], &cx0, &cxn, &cy0, &cyn);
+            for (int y = cy0; y < cyn; y++) {
+                unsigned int row = y * nx + cx0;
+                if (pass == 0)
+                    memset(corridor_costs + row, costmap_2d::LETHAL_OBSTACLE, cxn - cx0);
+                else
+                    memcpy(corridor_costs + row, costs + row, cxn - cx0);
+            }
+            changed_x0 = std::min(changed_x0, (unsigned int)cx0);
+            changed_xn = std::max(changed_xn, (unsigned int)cxn);
+            changed_y0 = std::min(changed_y0, (unsigned int)cy0);
+            changed_yn = std::max(changed_yn, (unsigned int)cyn);
+        }
+    }
+    if (changed_x0 < changed_xn)
+        corridor_costs_.recordChange(changed_x0, changed_xn, changed_y0, changed_yn);
+    corridor_.swap(corridor);
+    return &corridor_costs_;
+}
+
+} //end namespace global_planner
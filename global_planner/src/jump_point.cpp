@@ -0,0 +1,220 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author: Eitan Marder-Eppstein
+ *         David V. Lu!!
+ *********************************************************************/
+#include <global_planner/jump_point.h>
+#include <algorithm>
+
+namespace global_planner {
+
+JumpPointExpansion::JumpPointExpansion(PotentialCalculator* p_calc, int xs, int ys) :
+        Expander(p_calc, xs, ys), table_unknown_(unknown_), table_lethal_(lethal_cost_) {
+    setSize(xs, ys);
+}
+
+void JumpPointExpansion::setSize(int xs, int ys) {
+    Expander::setSize(xs, ys);
+    for (int dir = 0; dir < 4; dir++)
+        jumps_[dir].assign(ns_, 0);
+    dirty_x0_ = dirty_y0_ = 0;
+    dirty_xn_ = xs;
+    dirty_yn_ = ys;
+}
+
+void JumpPointExpansion::invalidate(int x0, int xn, int y0, int yn) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    xn = std::min(xn, nx_);
+    yn = std::min(yn, ny_);
+    if (x0 >= xn || y0 >= yn)
+        return;
+    if (dirty_x0_ >= dirty_xn_) {
+        dirty_x0_ = x0;
+        dirty_xn_ = xn;
+        dirty_y0_ = y0;
+        dirty_yn_ = yn;
+        return;
+    }
+    dirty_x0_ = std::min(dirty_x0_, x0);
+    dirty_xn_ = std::max(dirty_xn_, xn);
+    dirty_y0_ = std::min(dirty_y0_, y0);
+    dirty_yn_ = std::max(dirty_yn_, yn);
+}
+
+bool JumpPointExpansion::forced(unsigned char* costs, int n, int step) {
+    int x = n % nx_;
+    for (int side = -1; side <= 1; side += 2) {
+        if (x + side < 0 || x + side >= nx_)
+            continue;
+        int a = n + side, b = a - step;
+        if (isFree(costs, a) && (!isFree(costs, b) || costs[b] != costs[n]))
+            return true;
+    }
+    return false;
+}
+
+void JumpPointExpansion::buildTables(unsigned char* costs) {
+    if (table_unknown_ != unknown_ || table_lethal_ != lethal_cost_) {
+        invalidate(0, nx_, 0, ny_);
+        table_unknown_ = unknown_;
+        table_lethal_ = lethal_cost_;
+    }
+    if (dirty_x0_ >= dirty_xn_)
+        return;
+
+    // a vertical entry depends on the columns to either side and on every cell
+    // ahead of it in its column, and a horizontal one on its row and on which
+    // cells of the row have vertical jump points
+    std::vector<bool> rows(ny_, false);
+    std::fill(rows.begin() + dirty_y0_, rows.begin() + dirty_yn_, true);
+    int x0 = std::max(dirty_x0_ - 1, 0), xn = std::min(dirty_xn_ + 1, nx_);
+    std::vector<short>& up = jumps_[UP];
+    std::vector<short>& down = jumps_[DOWN];
+    for (int y = std::max(dirty_y0_, 1); y < ny_; y++)
+        for (int i = toIndex(x0, y); i < toIndex(xn, y); i++) {
+            short e = entry(costs, i, i - nx_, forced(costs, i - nx_, -nx_), up[i - nx_]);
+            if ((e > 0) != (up[i] > 0))
+                rows[y] = true;
+            up[i] = e;
+        }
+    for (int y = std::min(dirty_yn_, ny_ - 1) - 1; y >= 0; y--)
+        for (int i = toIndex(x0, y); i < toIndex(xn, y); i++) {
+            short e = entry(costs, i, i + nx_, forced(costs, i + nx_, nx_), down[i + nx_]);
+            if ((e > 0) != (down[i] > 0))
+                rows[y] = true;
+            down[i] = e;
+        }
+
+    std::vector<short>& left = jumps_[LEFT];
+    std::vector<short>& right = jumps_[RIGHT];
+    for (int y = 0; y < ny_; y++) {
+        if (!rows[y])
+            continue;
+        int row = toIndex(0, y);
+        for (int i = row + nx_ - 2; i >= row; i--)
+            right[i] = entry(costs, i, i + 1, up[i + 1] > 0 || down[i + 1] > 0, right[i + 1]);
+        for (int i = row + 1; i < row + nx_; i++)
+            left[i] = entry(costs, i, i - 1, up[i - 1] > 0 || down[i - 1] > 0, left[i - 1]);
+    }
+
+    dirty_x0_ = dirty_y0_ = 0;
+    dirty_xn_ = dirty_yn_ = 0;
+}
+
+bool JumpPointExpansion::calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x,
+                                            double end_y, int cycles, float* potential) {
+    buildTables(costs);
+    queue_.clear();
+
+    int start_i = toIndex(start_x, start_y);
+    resetPotential(potential);
+    potential[start_i] = 0;
+    touched_.push_back(start_i);
+    queue_.push_back(Index(start_i, heuristic(start_i, end_x, end_y)));
+
+    int goal_i = toIndex(end_x, end_y);
+    int cycle = 0;
+    while (cycle < cycles && !queue_.empty()) {
+        Index top = queue_[0];
+        std::pop_heap(queue_.begin(), queue_.end(), greater1());
+        queue_.pop_back();
+
+        // a cell is left in the queue at every potential it was given before its lowest
+        if (top.cost > potential[top.i] + heuristic(top.i, end_x, end_y))
+            continue;
+        if (top.i == goal_i)
+            return true;
+
+        for (int dir = 0; dir < 4; dir++)
+            jump(costs, potential, top.i, dir, end_x, end_y);
+        cycle++;
+    }
+
+    return false;
+}
+
+void JumpPointExpansion::jump(unsigned char* costs, float* potential, int i, int dir, int end_x, int end_y) {
+    int steps = jumps_[dir][i];
+    bool found = steps > 0;
+    steps = abs(steps);
+    if (steps == 0)
+        return;
+
+    // the goal ends a jump that passes it, and so does the cell of a horizontal
+    // jump from which the goal is straight up or down
+    int x = i % nx_, y = i / nx_, step;
+    if (dir == UP || dir == DOWN) {
+        step = dir == UP ? -nx_ : nx_;
+        int to_goal = dir == UP ? y - end_y : end_y - y;
+        if (x == end_x && to_goal > 0 && to_goal <= steps) {
+            steps = to_goal;
+            found = true;
+        }
+    } else {
+        step = dir == LEFT ? -1 : 1;
+        int to_goal = dir == LEFT ? x - end_x : end_x - x;
+        if (to_goal > 0 && to_goal <= steps) {
+            int turn = i + to_goal * step;
+            if (y == end_y || abs(jumps_[end_y < y ? UP : DOWN][turn]) >= abs(end_y - y)) {
+                steps = to_goal;
+                found = true;
+            }
+        }
+    }
+    if (!found)
+        return;
+
+    // the cells jumped over get their potentials too, for the path to be traced back through them
+    float pot = potential[i];
+    int n = i;
+    bool better = false;
+    for (int k = 0; k < steps; k++) {
+        n += step;
+        pot += costs[n] + neutral_cost_;
+        better = pot < potential[n];
+        if (better) {
+            if (potential[n] >= POT_HIGH)
+                touched_.push_back(n);
+            potential[n] = pot;
+        }
+    }
+    if (better) {
+        queue_.push_back(Index(n, potential[n] + heuristic(n, end_x, end_y)));
+        std::push_heap(queue_.begin(), queue_.end(), greater1());
+    }
+}
+
+} //end namespace global_planner
@@ -45,7 +45,7 @@ void set_angle(geometry_msgs::PoseStamped* pose, double angle)
     pose->pose.orientation = tf::createQuaternionMsgFromYaw(angle); 
 }
 
-double getYaw(geometry_msgs::PoseStamped pose)
+double getYaw(const geometry_msgs::PoseStamped& pose)
 {
     return tf::getYaw(pose.pose.orientation);
 }
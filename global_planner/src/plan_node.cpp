@@ -113,7 +113,14 @@ int main(int argc, char** argv) {
 
     global_planner::PlannerWithCostmap pppp("planner", &lcr);
 
-    ros::spin();
+    //with a pool of planner workspaces, as many make_plan requests are served at once
+    int planner_workspaces;
+    ros::NodeHandle("~/planner").param("planner_workspaces", planner_workspaces, 1);
+    if (planner_workspaces > 1) {
+        ros::MultiThreadedSpinner spinner(planner_workspaces);
+        spinner.spin();
+    } else
+        ros::spin();
     return 0;
 }
 
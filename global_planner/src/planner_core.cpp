@@ -36,6 +36,9 @@
  *         David V. Lu!!
  *********************************************************************/
 #include <global_planner/planner_core.h>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
 #include <pluginlib/class_list_macros.h>
 #include <tf/transform_listener.h>
 #include <costmap_2d/cost_values.h>
@@ -43,6 +46,9 @@
 
 #include <global_planner/dijkstra.h>
 #include <global_planner/astar.h>
+#include <global_planner/jump_point.h>
+#include <global_planner/bidirectional_astar.h>
+#include <global_planner/bidirectional_path.h>
 #include <global_planner/grid_path.h>
 #include <global_planner/gradient_path.h>
 #include <global_planner/quadratic_calculator.h>
@@ -75,24 +81,129 @@ void GlobalPlanner::outlineMap(unsigned char* costarr, int nx, int ny, unsigned
 }
 
 GlobalPlanner::GlobalPlanner() :
-        costmap_(NULL), initialized_(false), allow_unknown_(true) {
+        costmap_(NULL), initialized_(false), allow_unknown_(true), jump_point_(NULL), bidirectional_(NULL), jump_costmap_(NULL),
+        costs_version_(0), batch_planner_(NULL), cached_version_(0), cached_index_(0), lethal_cost_(253),
+        neutral_cost_(50), cost_factor_(3.0), potential_array_(NULL),
+        potential_memory_("global_planner/potential_array"), workspace_nx_(0), workspace_ny_(0),
+        publish_potential_decimation_(1), potential_thread_(NULL), potential_shutdown_(false),
+        planning_version_(0), robot_cell_(-1), nav_version_(0), nav_nx_(0), nav_ny_(0) {
 }
 
 GlobalPlanner::GlobalPlanner(std::string name, costmap_2d::Costmap2D* costmap, std::string frame_id) :
-        costmap_(NULL), initialized_(false), allow_unknown_(true) {
+        costmap_(NULL), initialized_(false), allow_unknown_(true), jump_point_(NULL), bidirectional_(NULL), jump_costmap_(NULL),
+        costs_version_(0), batch_planner_(NULL), cached_version_(0), cached_index_(0), lethal_cost_(253),
+        neutral_cost_(50), cost_factor_(3.0), potential_array_(NULL),
+        potential_memory_("global_planner/potential_array"), workspace_nx_(0), workspace_ny_(0),
+        publish_potential_decimation_(1), potential_thread_(NULL), potential_shutdown_(false),
+        planning_version_(0), robot_cell_(-1), nav_version_(0), nav_nx_(0), nav_ny_(0) {
     //initialize the planner
     initialize(name, costmap, frame_id);
 }
 
 GlobalPlanner::~GlobalPlanner() {
+    if (potential_thread_) {
+        {
+            boost::mutex::scoped_lock lock(potential_mutex_);
+            potential_shutdown_ = true;
+        }
+        potential_cond_.notify_one();
+        potential_thread_->join();
+        delete potential_thread_;
+    }
     if (p_calc_)
         delete p_calc_;
+    if (batch_planner_ && batch_planner_ != planner_)
+        delete batch_planner_;
     if (planner_)
         delete planner_;
     if (path_maker_)
         delete path_maker_;
     if (dsrv_)
         delete dsrv_;
+    delete[] potential_array_;
+    for (size_t i = 0; i < workspaces_.size(); i++)
+        delete workspaces_[i];
+}
+
+GlobalPlanner::Workspace::Workspace(const std::string& component) :
+        p_calc(NULL), planner(NULL), jump_point(NULL), jump_version(0), path_maker(NULL), potential(NULL), nx(0),
+        ny(0), version(0), robot_cell(-1), memory(component) {
+    costs.setMemoryComponent(component);
+}
+
+GlobalPlanner::Workspace::~Workspace() {
+    delete planner;
+    delete path_maker;
+    delete p_calc;
+    delete[] potential;
+}
+
+void GlobalPlanner::Workspace::resize(int size_x, int size_y) {
+    if (size_x == nx && size_y == ny)
+        return;
+    p_calc->setSize(size_x, size_y);
+    planner->setSize(size_x, size_y);
+    path_maker->setSize(size_x, size_y);
+    delete[] potential;
+    potential = new float[size_x * size_y];
+    memory.set(size_t(size_x) * size_y * sizeof(float));
+    nx = size_x;
+    ny = size_y;
+}
+
+void GlobalPlanner::createSearch(ros::NodeHandle& private_nh, unsigned int cx, unsigned int cy,
+                                 PotentialCalculator*& p_calc, Expander*& planner, JumpPointExpansion*& jump_point,
+                                 BidirectionalAStarExpansion*& bidirectional, Traceback*& path_maker) {
+    bool use_quadratic;
+    private_nh.param("use_quadratic", use_quadratic, true);
+    if (use_quadratic)
+        p_calc = new QuadraticCalculator(cx, cy);
+    else
+        p_calc = new PotentialCalculator(cx, cy);
+
+    bool use_dijkstra, use_jump_point, use_bidirectional;
+    private_nh.param("use_dijkstra", use_dijkstra, true);
+    private_nh.param("use_jump_point", use_jump_point, false);
+    private_nh.param("use_bidirectional", use_bidirectional, false);
+    jump_point = NULL;
+    bidirectional = NULL;
+    if (use_jump_point)
+    {
+        jump_point = new JumpPointExpansion(p_calc, cx, cy);
+        planner = jump_point;
+    }
+    else if (use_dijkstra)
+    {
+        DijkstraExpansion* de = new DijkstraExpansion(p_calc, cx, cy);
+        if(!old_navfn_behavior_)
+            de->setPreciseStart(true);
+        planner = de;
+    }
+    else if (use_bidirectional)
+    {
+        bidirectional = new BidirectionalAStarExpansion(p_calc, cx, cy);
+        planner = bidirectional;
+    }
+    else
+    {
+        AStarExpansion* ae = new AStarExpansion(p_calc, cx, cy);
+        bool use_bucket_queue, use_eight_connected;
+        private_nh.param("use_bucket_queue", use_bucket_queue, false);
+        private_nh.param("use_eight_connected", use_eight_connected, false);
+        ae->setBucketQueue(use_bucket_queue);
+        ae->setEightConnected(use_eight_connected);
+        planner = ae;
+    }
+
+    bool use_grid_path;
+    private_nh.param("use_grid_path", use_grid_path, false);
+    if (use_grid_path)
+        path_maker = new GridPath(p_calc);
+    else
+        path_maker = new GradientPath(p_calc);
+    //the bidirectional search's path is traced from where its two halves met
+    if (bidirectional)
+        path_maker = new BidirectionalPath(path_maker, bidirectional);
 }
 
 void GlobalPlanner::initialize(std::string name, costmap_2d::Costmap2DROS* costmap_ros) {
@@ -104,6 +215,8 @@ void GlobalPlanner::initialize(std::string name, costmap_2d::Costmap2D* costmap,
         ros::NodeHandle private_nh("~/" + name);
         costmap_ = costmap;
         frame_id_ = frame_id;
+        potential_memory_.setComponent(name + "/potential_array");
+        planning_costs_.setMemoryComponent(name + "/planning_costs");
 
         unsigned int cx = costmap->getSizeInCellsX(), cy = costmap->getSizeInCellsY();
 
@@ -113,32 +226,44 @@ void GlobalPlanner::initialize(std::string name, costmap_2d::Costmap2D* costmap,
         else
             convert_offset_ = 0.0;
 
-        bool use_quadratic;
-        private_nh.param("use_quadratic", use_quadratic, true);
-        if (use_quadratic)
-            p_calc_ = new QuadraticCalculator(cx, cy);
-        else
-            p_calc_ = new PotentialCalculator(cx, cy);
+        createSearch(private_nh, cx, cy, p_calc_, planner_, jump_point_, bidirectional_, path_maker_);
+
+        //each workspace past the first lets one more makePlan() run while the others are busy
+        int planner_workspaces;
+        private_nh.param("planner_workspaces", planner_workspaces, 1);
+        for (int i = 1; i < planner_workspaces; i++) {
+            Workspace* workspace = new Workspace(name + "/workspaces");
+            BidirectionalAStarExpansion* bidirectional;
+            createSearch(private_nh, cx, cy, workspace->p_calc, workspace->planner, workspace->jump_point,
+                         bidirectional, workspace->path_maker);
+            workspaces_.push_back(workspace);
+            free_workspaces_.push_back(workspace);
+        }
 
-        bool use_dijkstra;
-        private_nh.param("use_dijkstra", use_dijkstra, true);
-        if (use_dijkstra)
+        private_nh.param("anytime_weight", anytime_weight_, 1.0);
+        private_nh.param("anytime_weight_step", anytime_step_, 0.5);
+        anytime_reached_ = anytime_weight_;
+        anytime_goal_x_ = anytime_goal_y_ = 0;
+
+        //plans to several goals always come out of one Dijkstra expansion
+        batch_planner_ = dynamic_cast<DijkstraExpansion*>(planner_);
+        if (!batch_planner_)
         {
-            DijkstraExpansion* de = new DijkstraExpansion(p_calc_, cx, cy);
+            batch_planner_ = new DijkstraExpansion(p_calc_, cx, cy);
             if(!old_navfn_behavior_)
-                de->setPreciseStart(true);
-            planner_ = de;
+                batch_planner_->setPreciseStart(true);
         }
-        else
-            planner_ = new AStarExpansion(p_calc_, cx, cy);
 
-        bool use_grid_path;
-        private_nh.param("use_grid_path", use_grid_path, false);
-        if (use_grid_path)
-            path_maker_ = new GridPath(p_calc_);
-        else
-            path_maker_ = new GradientPath(p_calc_);
-            
+        private_nh.param("use_plan_cache", use_plan_cache_, false);
+        private_nh.param("plan_cache_refresh", plan_cache_refresh_, 5.0);
+        private_nh.param("plan_cache_tolerance", plan_cache_tolerance_, 0.25);
+        cached_plan_.clear();
+        anytime_searching_ = false;
+
+        double goal_settle_margin;
+        private_nh.param("goal_settle_margin", goal_settle_margin, 0.0);
+        batch_planner_->setSettleMargin(goal_settle_margin);
+
         orientation_filter_ = new OrientationFilter();
 
         plan_pub_ = private_nh.advertise<nav_msgs::Path>("plan", 1);
@@ -146,10 +271,12 @@ void GlobalPlanner::initialize(std::string name, costmap_2d::Costmap2D* costmap,
 
         private_nh.param("allow_unknown", allow_unknown_, true);
         planner_->setHasUnknown(allow_unknown_);
+        batch_planner_->setHasUnknown(allow_unknown_);
         private_nh.param("planner_window_x", planner_window_x_, 0.0);
         private_nh.param("planner_window_y", planner_window_y_, 0.0);
         private_nh.param("default_tolerance", default_tolerance_, 0.0);
         private_nh.param("publish_scale", publish_scale_, 100);
+        potential_thread_ = new boost::thread(boost::bind(&GlobalPlanner::potentialThread, this));
 
         double costmap_pub_freq;
         private_nh.param("planner_costmap_publish_frequency", costmap_pub_freq, 0.0);
@@ -159,6 +286,8 @@ void GlobalPlanner::initialize(std::string name, costmap_2d::Costmap2D* costmap,
         tf_prefix_ = tf::getPrefixParam(prefix_nh);
 
         make_plan_srv_ = private_nh.advertiseService("make_plan", &GlobalPlanner::makePlanService, this);
+        make_plans_srv_ = private_nh.advertiseService("make_plans", &GlobalPlanner::makePlansService, this);
+        get_potentials_srv_ = private_nh.advertiseService("get_potentials", &GlobalPlanner::getPotentialsService, this);
 
         dsrv_ = new dynamic_reconfigure::Server<global_planner::GlobalPlannerConfig>(ros::NodeHandle("~/" + name));
         dynamic_reconfigure::Server<global_planner::GlobalPlannerConfig>::CallbackType cb = boost::bind(
@@ -172,23 +301,98 @@ void GlobalPlanner::initialize(std::string name, costmap_2d::Costmap2D* costmap,
 }
 
 void GlobalPlanner::reconfigureCB(global_planner::GlobalPlannerConfig& config, uint32_t level) {
-    planner_->setLethalCost(config.lethal_cost);
-    path_maker_->setLethalCost(config.lethal_cost);
-    planner_->setNeutralCost(config.neutral_cost);
-    planner_->setFactor(config.cost_factor);
+    {
+        //not under a plan on the planner's own search
+        boost::mutex::scoped_lock lock(mutex_);
+        planner_->setLethalCost(config.lethal_cost);
+        path_maker_->setLethalCost(config.lethal_cost);
+        planner_->setNeutralCost(config.neutral_cost);
+        planner_->setFactor(config.cost_factor);
+        batch_planner_->setLethalCost(config.lethal_cost);
+        batch_planner_->setNeutralCost(config.neutral_cost);
+        batch_planner_->setFactor(config.cost_factor);
+    }
+    {
+        //the workspaces of the pool take them when they are next taken
+        boost::mutex::scoped_lock lock(workspace_mutex_);
+        lethal_cost_ = config.lethal_cost;
+        neutral_cost_ = config.neutral_cost;
+        cost_factor_ = config.cost_factor;
+    }
     publish_potential_ = config.publish_potential;
+    publish_potential_decimation_ = config.publish_potential_decimation;
     orientation_filter_->setMode(config.orientation_mode);
 }
 
-void GlobalPlanner::clearRobotCell(const tf::Stamped<tf::Pose>& global_pose, unsigned int mx, unsigned int my) {
+costmap_2d::Costmap2D* GlobalPlanner::getPlanningCostmap(unsigned int start_x, unsigned int start_y,
+                                                         unsigned int goal_x, unsigned int goal_y) {
+    return &planning_costs_;
+}
+
+void GlobalPlanner::clearRobotCell(costmap_2d::Costmap2D& copy, int& robot_cell, unsigned int mx, unsigned int my) {
     if (!initialized_) {
         ROS_ERROR(
                 "This planner has not been initialized yet, but it is being used, please call initialize() before use");
         return;
     }
 
-    //set the associated costs in the cost map to be free
-    costmap_->setCost(mx, my, costmap_2d::FREE_SPACE);
+    //set the associated costs in the planner's copy of the costmap to be free
+    robot_cell = copy.getIndex(mx, my);
+    unsigned char* planning = copy.getCharMap();
+    if (planning[robot_cell] != costmap_2d::FREE_SPACE) {
+        planning[robot_cell] = costmap_2d::FREE_SPACE;
+        copy.recordChange(mx, mx + 1, my, my + 1);
+    }
+}
+
+void GlobalPlanner::updatePlanningCosts(costmap_2d::Costmap2D& copy, unsigned long& version, int& robot_cell) {
+    unsigned int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    unsigned char* costs = costmap_->getCharMap();
+
+    //only the box of cells the costmap changed in since the last plan, if it is known, is copied again
+    unsigned int x0, xn, y0, yn;
+    if (nx != copy.getSizeInCellsX() || ny != copy.getSizeInCellsY()) {
+        copy.resizeMap(nx, ny, costmap_->getResolution(), costmap_->getOriginX(), costmap_->getOriginY());
+        robot_cell = -1;
+        x0 = y0 = 0;
+        xn = nx;
+        yn = ny;
+    } else if (!costmap_->getChangesSince(version, &x0, &xn, &y0, &yn)) {
+        x0 = y0 = 0;
+        xn = nx;
+        yn = ny;
+    }
+    version = costmap_->getVersion();
+
+    unsigned char* planning = copy.getCharMap();
+    if (robot_cell >= 0 && planning[robot_cell] != costs[robot_cell]) {
+        planning[robot_cell] = costs[robot_cell];
+        copy.recordChange(robot_cell % nx, robot_cell % nx + 1, robot_cell / nx, robot_cell / nx + 1);
+    }
+    robot_cell = -1;
+
+    if (x0 < xn && y0 < yn) {
+        for (unsigned int y = y0; y < yn; y++)
+            memcpy(planning + y * nx + x0, costs + y * nx + x0, xn - x0);
+        copy.recordChange(x0, xn, y0, yn);
+    }
+}
+
+void GlobalPlanner::resizeWorkspace(int nx, int ny) {
+    //make sure to resize the underlying array that Navfn uses, which is kept between plans
+    //on a costmap of the same size so that the expander only resets what the last plan set
+    if (nx == workspace_nx_ && ny == workspace_ny_)
+        return;
+    p_calc_->setSize(nx, ny);
+    planner_->setSize(nx, ny);
+    if (batch_planner_ != planner_)
+        batch_planner_->setSize(nx, ny);
+    path_maker_->setSize(nx, ny);
+    delete[] potential_array_;
+    potential_array_ = new float[nx * ny];
+    potential_memory_.set(size_t(nx) * ny * sizeof(float));
+    workspace_nx_ = nx;
+    workspace_ny_ = ny;
 }
 
 bool GlobalPlanner::makePlanService(nav_msgs::GetPlan::Request& req, nav_msgs::GetPlan::Response& resp) {
@@ -200,6 +404,56 @@ bool GlobalPlanner::makePlanService(nav_msgs::GetPlan::Request& req, nav_msgs::G
     return true;
 }
 
+bool GlobalPlanner::makePlansService(global_planner::MakePlans::Request& req,
+                                     global_planner::MakePlans::Response& resp) {
+    std::vector<std::vector<geometry_msgs::PoseStamped> > plans;
+    makePlans(req.start, req.goals, plans, resp.costs);
+
+    resp.plans.resize(plans.size());
+    for (size_t i = 0; i < plans.size(); i++) {
+        resp.plans[i].header.stamp = ros::Time::now();
+        resp.plans[i].header.frame_id = frame_id_;
+        resp.plans[i].poses.swap(plans[i]);
+    }
+
+    return true;
+}
+
+bool GlobalPlanner::getPotentialsService(global_planner::GetPotentials::Request& req,
+                                         global_planner::GetPotentials::Response& resp) {
+    std::string global_frame = tf::resolve(tf_prefix_, frame_id_);
+    resp.costs.assign(req.poses.size(), -1.0);
+    if (tf::resolve(tf_prefix_, req.goal.header.frame_id) != global_frame) {
+        ROS_ERROR("The goal pose passed to this planner must be in the %s frame.  It is instead in the %s frame.",
+                  global_frame.c_str(), tf::resolve(tf_prefix_, req.goal.header.frame_id).c_str());
+        return true;
+    }
+
+    //the expansion from the goal is done again only once the goal or the costs changed
+    const geometry_msgs::Point& goal = req.goal.pose.position;
+    bool same_goal;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        same_goal = hasNavigationFunction() && nav_seed_.x == goal.x && nav_seed_.y == goal.y;
+    }
+    if (!same_goal && !computePotential(goal))
+        return true;
+
+    std::vector<geometry_msgs::Point> points;
+    std::vector<size_t> in_frame;
+    for (size_t i = 0; i < req.poses.size(); i++) {
+        if (tf::resolve(tf_prefix_, req.poses[i].header.frame_id) != global_frame)
+            continue;
+        points.push_back(req.poses[i].pose.position);
+        in_frame.push_back(i);
+    }
+    std::vector<double> potentials;
+    if (getPointPotentials(points, potentials))
+        for (size_t k = 0; k < in_frame.size(); k++)
+            resp.costs[in_frame[k]] = potentials[k];
+    return true;
+}
+
 void GlobalPlanner::mapToWorld(double mx, double my, double& wx, double& wy) {
     wx = costmap_->getOriginX() + (mx+convert_offset_) * costmap_->getResolution();
     wy = costmap_->getOriginY() + (my+convert_offset_) * costmap_->getResolution();
@@ -236,7 +490,17 @@ bool GlobalPlanner::makePlan(const geometry_msgs::PoseStamped& start, const geom
 */
 bool GlobalPlanner::makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
                            double tolerance, std::vector<geometry_msgs::PoseStamped>& plan) {
-    boost::mutex::scoped_lock lock(mutex_);
+    //while the planner's own search is busy, the plan is made in a workspace of the pool, if one is free
+    boost::mutex::scoped_lock lock(mutex_, boost::try_to_lock);
+    if (!lock.owns_lock()) {
+        Workspace* workspace = takeWorkspace();
+        if (workspace) {
+            bool found = makePlanInWorkspace(*workspace, start, goal, plan);
+            returnWorkspace(workspace);
+            return found;
+        }
+        lock.lock();
+    }
     if (!initialized_) {
         ROS_ERROR(
                 "This planner has not been initialized yet, but it is being used, please call initialize() before use");
@@ -246,80 +510,62 @@ bool GlobalPlanner::makePlan(const geometry_msgs::PoseStamped& start, const geom
     //clear the plan, just in case
     plan.clear();
 
-    ros::NodeHandle n;
-    std::string global_frame = frame_id_;
-
     //until tf can handle transforming things that are way in the past... we'll require the goal to be in our global frame
     // 确定goal是否是在全局坐标系中
-    if (tf::resolve(tf_prefix_, goal.header.frame_id) != tf::resolve(tf_prefix_, global_frame)) {
-        ROS_ERROR(
-                "The goal pose passed to this planner must be in the %s frame.  It is instead in the %s frame.", tf::resolve(tf_prefix_, global_frame).c_str(), tf::resolve(tf_prefix_, goal.header.frame_id).c_str());
+    if (!inGlobalFrame(goal, "goal") || !inGlobalFrame(start, "start"))
         return false;
-    }
 
-    if (tf::resolve(tf_prefix_, start.header.frame_id) != tf::resolve(tf_prefix_, global_frame)) {
-        ROS_ERROR(
-                "The start pose passed to this planner must be in the %s frame.  It is instead in the %s frame.", tf::resolve(tf_prefix_, global_frame).c_str(), tf::resolve(tf_prefix_, start.header.frame_id).c_str());
-        return false;
+    //replanning to the same goal hands back what is left of the last plan while nothing blocks it
+    if (use_plan_cache_ && !anytime_searching_ && getCachedPlan(start, goal, plan)) {
+        publishPlan(plan);
+        return true;
     }
 
-    double wx = start.pose.position.x;
-    double wy = start.pose.position.y;
-
     unsigned int start_x_i, start_y_i, goal_x_i, goal_y_i;
     double start_x, start_y, goal_x, goal_y;
 
     // 将世界坐标系转换到地图坐标系
-    if (!costmap_->worldToMap(wx, wy, start_x_i, start_y_i)) {
+    if (!toPlanningCell(start.pose.position.x, start.pose.position.y, start_x_i, start_y_i, start_x, start_y)) {
         ROS_WARN(
                 "The robot's start position is off the global costmap. Planning will always fail, are you sure the robot has been properly localized?");
         return false;
     }
 
-    //
-    if(old_navfn_behavior_){
-        start_x = start_x_i;
-        start_y = start_y_i;
-    }else{
-        worldToMap(wx, wy, start_x, start_y);
-    }
-
-    wx = goal.pose.position.x;
-    wy = goal.pose.position.y;
-
-    if (!costmap_->worldToMap(wx, wy, goal_x_i, goal_y_i)) {
+    if (!toPlanningCell(goal.pose.position.x, goal.pose.position.y, goal_x_i, goal_y_i, goal_x, goal_y)) {
         ROS_WARN_THROTTLE(1.0,
                 "The goal sent to the global planner is off the global costmap. Planning will always fail to this goal.");
         return false;
     }
-    if(old_navfn_behavior_){
-        goal_x = goal_x_i;
-        goal_y = goal_y_i;
-    }else{
-        worldToMap(wx, wy, goal_x, goal_y);
-    }
 
-    //clear the starting cell within the costmap because we know it can't be an obstacle
+    int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    resizeWorkspace(nx, ny);
+    updatePlanningCosts(planning_costs_, planning_version_, robot_cell_);
+
+    //clear the starting cell within the planner's copy of the costmap because we know it can't be an obstacle
     // 在costmap中，清除机器人原点处障碍物
-    tf::Stamped<tf::Pose> start_pose;
-    tf::poseStampedMsgToTF(start, start_pose);
-    clearRobotCell(start_pose, start_x_i, start_y_i);
+    clearRobotCell(planning_costs_, robot_cell_, start_x_i, start_y_i);
 
-    int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    //the border is lethal in the copy from its first outline on, so it is not recorded as a change
+    outlineMap(planning_costs_.getCharMap(), nx, ny, costmap_2d::LETHAL_OBSTACLE);
 
-    //make sure to resize the underlying array that Navfn uses
-    p_calc_->setSize(nx, ny);
-    planner_->setSize(nx, ny);
-    path_maker_->setSize(nx, ny);
-    potential_array_ = new float[nx * ny];
+    costmap_2d::Costmap2D* costs = getPlanningCostmap(start_x_i, start_y_i, goal_x_i, goal_y_i);
 
-    outlineMap(costmap_->getCharMap(), nx, ny, costmap_2d::LETHAL_OBSTACLE);
+    //the jump point search keeps tables of the costs, rebuilt where they changed
+    if (jump_point_) {
+        unsigned int x0, xn, y0, yn;
+        if (costs == jump_costmap_ && costs->getChangesSince(costs_version_, &x0, &xn, &y0, &yn))
+            jump_point_->invalidate(x0, xn, y0, yn);
+        else
+            jump_point_->invalidate(0, nx, 0, ny);
+        jump_costmap_ = costs;
+        costs_version_ = costs->getVersion();
+    }
 
-    bool found_legal = planner_->calculatePotentials(costmap_->getCharMap(), start_x, start_y, goal_x, goal_y,
+    bool found_legal = planner_->calculatePotentials(costs->getCharMap(), start_x, start_y, goal_x, goal_y,
                                                     nx * ny * 2, potential_array_);
 
     if(!old_navfn_behavior_)
-        planner_->clearEndpoint(costmap_->getCharMap(), potential_array_, goal_x_i, goal_y_i, 2);
+        planner_->clearEndpoint(costs->getCharMap(), potential_array_, goal_x_i, goal_y_i, 2);
     if(publish_potential_)
         publishPotential(potential_array_);
 
@@ -339,13 +585,328 @@ bool GlobalPlanner::makePlan(const geometry_msgs::PoseStamped& start, const geom
 
     // add orientations if needed
     orientation_filter_->processPath(start, plan);
+
+    if (use_plan_cache_)
+        cachePlan(goal, plan);
     
     //publish the plan for visualization purposes
     publishPlan(plan);
-    delete potential_array_;
     return !plan.empty();
 } 
 
+bool GlobalPlanner::makePlanInWorkspace(Workspace& workspace, const geometry_msgs::PoseStamped& start,
+                                        const geometry_msgs::PoseStamped& goal,
+                                        std::vector<geometry_msgs::PoseStamped>& plan) {
+    plan.clear();
+    if (!inGlobalFrame(goal, "goal") || !inGlobalFrame(start, "start"))
+        return false;
+
+    unsigned int start_x_i, start_y_i, goal_x_i, goal_y_i;
+    double start_x, start_y, goal_x, goal_y;
+    if (!toPlanningCell(start.pose.position.x, start.pose.position.y, start_x_i, start_y_i, start_x, start_y)) {
+        ROS_WARN("The start position is off the global costmap. Planning will always fail from it.");
+        return false;
+    }
+    if (!toPlanningCell(goal.pose.position.x, goal.pose.position.y, goal_x_i, goal_y_i, goal_x, goal_y)) {
+        ROS_WARN_THROTTLE(1.0,
+                "The goal sent to the global planner is off the global costmap. Planning will always fail to this goal.");
+        return false;
+    }
+
+    //the workspace's copy of the costs is brought up to date and cleared at this start, as the planner's own is
+    int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    workspace.resize(nx, ny);
+    updatePlanningCosts(workspace.costs, workspace.version, workspace.robot_cell);
+    clearRobotCell(workspace.costs, workspace.robot_cell, start_x_i, start_y_i);
+    outlineMap(workspace.costs.getCharMap(), nx, ny, costmap_2d::LETHAL_OBSTACLE);
+
+    if (workspace.jump_point) {
+        unsigned int x0, xn, y0, yn;
+        if (workspace.costs.getChangesSince(workspace.jump_version, &x0, &xn, &y0, &yn))
+            workspace.jump_point->invalidate(x0, xn, y0, yn);
+        else
+            workspace.jump_point->invalidate(0, nx, 0, ny);
+        workspace.jump_version = workspace.costs.getVersion();
+    }
+
+    unsigned char* costs = workspace.costs.getCharMap();
+    bool found_legal = workspace.planner->calculatePotentials(costs, start_x, start_y, goal_x, goal_y, nx * ny * 2,
+                                                              workspace.potential);
+    if(!old_navfn_behavior_)
+        workspace.planner->clearEndpoint(costs, workspace.potential, goal_x_i, goal_y_i, 2);
+    if(publish_potential_)
+        publishPotential(workspace.potential);
+
+    if (found_legal) {
+        if (tracePlan(workspace.path_maker, workspace.potential, workspace.path, start_x, start_y, goal_x, goal_y,
+                      goal, plan)) {
+            geometry_msgs::PoseStamped goal_copy = goal;
+            goal_copy.header.stamp = ros::Time::now();
+            plan.push_back(goal_copy);
+        } else {
+            ROS_ERROR("Failed to get a plan from potential when a legal potential was found. This shouldn't happen.");
+        }
+    }else{
+        ROS_ERROR("Failed to get a plan.");
+    }
+
+    orientation_filter_->processPath(start, plan);
+    publishPlan(plan);
+    return !plan.empty();
+}
+
+GlobalPlanner::Workspace* GlobalPlanner::takeWorkspace() {
+    boost::mutex::scoped_lock lock(workspace_mutex_);
+    if (free_workspaces_.empty())
+        return NULL;
+    Workspace* workspace = free_workspaces_.back();
+    free_workspaces_.pop_back();
+    workspace->planner->setHasUnknown(allow_unknown_);
+    workspace->planner->setLethalCost(lethal_cost_);
+    workspace->planner->setNeutralCost(neutral_cost_);
+    workspace->planner->setFactor(cost_factor_);
+    workspace->path_maker->setLethalCost(lethal_cost_);
+    return workspace;
+}
+
+void GlobalPlanner::returnWorkspace(Workspace* workspace) {
+    boost::mutex::scoped_lock lock(workspace_mutex_);
+    free_workspaces_.push_back(workspace);
+}
+
+bool GlobalPlanner::inGlobalFrame(const geometry_msgs::PoseStamped& pose, const char* which) {
+    std::string global_frame = tf::resolve(tf_prefix_, frame_id_);
+    if (tf::resolve(tf_prefix_, pose.header.frame_id) == global_frame)
+        return true;
+    ROS_ERROR("The %s pose passed to this planner must be in the %s frame.  It is instead in the %s frame.", which,
+              global_frame.c_str(), tf::resolve(tf_prefix_, pose.header.frame_id).c_str());
+    return false;
+}
+
+bool GlobalPlanner::toPlanningCell(double wx, double wy, unsigned int& mx_i, unsigned int& my_i, double& mx,
+                                   double& my) {
+    if (!costmap_->worldToMap(wx, wy, mx_i, my_i))
+        return false;
+    if(old_navfn_behavior_){
+        mx = mx_i;
+        my = my_i;
+    }else{
+        worldToMap(wx, wy, mx, my);
+    }
+    return true;
+}
+
+bool GlobalPlanner::getCachedPlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+                                  std::vector<geometry_msgs::PoseStamped>& plan) {
+    if (cached_plan_.empty() || goal.pose.position.x != cached_goal_.pose.position.x
+            || goal.pose.position.y != cached_goal_.pose.position.y
+            || goal.pose.orientation.z != cached_goal_.pose.orientation.z
+            || goal.pose.orientation.w != cached_goal_.pose.orientation.w
+            || ros::Time::now() - cached_time_ > ros::Duration(plan_cache_refresh_))
+        return false;
+
+    //the robot has to be on the plan, looked for from where it was last time
+    double dist_sq = plan_cache_tolerance_ * plan_cache_tolerance_;
+    size_t nearest = cached_plan_.size();
+    for (size_t i = cached_index_; i < cached_plan_.size(); i++) {
+        double dx = cached_plan_[i].pose.position.x - start.pose.position.x;
+        double dy = cached_plan_[i].pose.position.y - start.pose.position.y;
+        if (dx * dx + dy * dy <= dist_sq) {
+            dist_sq = dx * dx + dy * dy;
+            nearest = i;
+        }
+    }
+    if (nearest == cached_plan_.size())
+        return false;
+
+    //only the cells that changed since the last check, if those are known, can have blocked it
+    unsigned int x0, xn, y0, yn;
+    if (!costmap_->getChangesSince(cached_version_, &x0, &xn, &y0, &yn)) {
+        x0 = y0 = 0;
+        xn = costmap_->getSizeInCellsX();
+        yn = costmap_->getSizeInCellsY();
+    }
+    unsigned char* costs = costmap_->getCharMap();
+    for (size_t i = nearest; i < cached_plan_.size(); i++) {
+        unsigned int mx, my;
+        if (!costmap_->worldToMap(cached_plan_[i].pose.position.x, cached_plan_[i].pose.position.y, mx, my))
+            return false;
+        if (mx < x0 || mx >= xn || my < y0 || my >= yn)
+            continue;
+        unsigned char cost = costs[costmap_->getIndex(mx, my)];
+        if (cost >= lethal_cost_ && !(allow_unknown_ && cost == costmap_2d::NO_INFORMATION))
+            return false;
+    }
+    cached_version_ = costmap_->getVersion();
+    cached_index_ = nearest;
+
+    ros::Time plan_time = ros::Time::now();
+    plan.assign(cached_plan_.begin() + nearest, cached_plan_.end());
+    for (size_t i = 0; i < plan.size(); i++)
+        plan[i].header.stamp = plan_time;
+    return true;
+}
+
+void GlobalPlanner::cachePlan(const geometry_msgs::PoseStamped& goal, const std::vector<geometry_msgs::PoseStamped>& plan) {
+    cached_plan_ = plan;
+    cached_goal_ = goal;
+    cached_time_ = ros::Time::now();
+    cached_version_ = costmap_->getVersion();
+    cached_index_ = 0;
+}
+
+bool GlobalPlanner::makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+                             const ros::Time& deadline, std::vector<geometry_msgs::PoseStamped>& plan,
+                             double& quality) {
+    quality = 1.0;
+    AStarExpansion* astar = dynamic_cast<AStarExpansion*>(planner_);
+    if (!astar || anytime_weight_ <= 1.0)
+        return makePlan(start, goal, plan);
+
+    plan.clear();
+
+    //a new goal starts over from the first weight
+    unsigned int goal_x_i, goal_y_i;
+    if (!costmap_->worldToMap(goal.pose.position.x, goal.pose.position.y, goal_x_i, goal_y_i)
+            || goal_x_i != anytime_goal_x_ || goal_y_i != anytime_goal_y_) {
+        anytime_goal_x_ = goal_x_i;
+        anytime_goal_y_ = goal_y_i;
+        anytime_reached_ = anytime_weight_;
+    }
+
+    //the first search always runs; the next, at a lower weight, only if the deadline leaves
+    //it as long as the last one took
+    bool found = false;
+    std::vector<geometry_msgs::PoseStamped> attempt;
+    double weight = anytime_reached_;
+    anytime_searching_ = true;
+    while (true) {
+        ros::Time search_start = ros::Time::now();
+        astar->setHeuristicWeight(weight);
+        if (!makePlan(start, goal, attempt))
+            break;
+        plan.swap(attempt);
+        quality = 1.0 / weight;
+        anytime_reached_ = weight;
+        found = true;
+
+        ros::Time now = ros::Time::now();
+        if (weight <= 1.0 || now + (now - search_start) > deadline)
+            break;
+        weight = std::max(weight - anytime_step_, 1.0);
+    }
+    astar->setHeuristicWeight(1.0);
+    anytime_searching_ = false;
+
+    return found;
+}
+
+bool GlobalPlanner::makePlans(const geometry_msgs::PoseStamped& start,
+                              const std::vector<geometry_msgs::PoseStamped>& goals,
+                              std::vector<std::vector<geometry_msgs::PoseStamped> >& plans, std::vector<double>& costs) {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!initialized_) {
+        ROS_ERROR(
+                "This planner has not been initialized yet, but it is being used, please call initialize() before use");
+        return false;
+    }
+
+    //clear the plans, just in case
+    plans.assign(goals.size(), std::vector<geometry_msgs::PoseStamped>());
+    costs.assign(goals.size(), -1.0);
+
+    std::string global_frame = tf::resolve(tf_prefix_, frame_id_);
+    if (tf::resolve(tf_prefix_, start.header.frame_id) != global_frame) {
+        ROS_ERROR(
+                "The start pose passed to this planner must be in the %s frame.  It is instead in the %s frame.", global_frame.c_str(), tf::resolve(tf_prefix_, start.header.frame_id).c_str());
+        return false;
+    }
+
+    double wx = start.pose.position.x;
+    double wy = start.pose.position.y;
+
+    unsigned int start_x_i, start_y_i;
+    double start_x, start_y;
+    if (!costmap_->worldToMap(wx, wy, start_x_i, start_y_i)) {
+        ROS_WARN(
+                "The robot's start position is off the global costmap. Planning will always fail, are you sure the robot has been properly localized?");
+        return false;
+    }
+    if(old_navfn_behavior_){
+        start_x = start_x_i;
+        start_y = start_y_i;
+    }else{
+        worldToMap(wx, wy, start_x, start_y);
+    }
+
+    //the goals off the costmap, or in another frame, get no plan
+    int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    std::vector<size_t> planned;
+    std::vector<double> goal_x, goal_y;
+    std::vector<int> goal_cells;
+    for (size_t i = 0; i < goals.size(); i++) {
+        wx = goals[i].pose.position.x;
+        wy = goals[i].pose.position.y;
+        unsigned int goal_x_i, goal_y_i;
+        if (tf::resolve(tf_prefix_, goals[i].header.frame_id) != global_frame
+                || !costmap_->worldToMap(wx, wy, goal_x_i, goal_y_i)) {
+            ROS_WARN("Goal %d is off the global costmap or not in the %s frame, and gets no plan.", (int)i,
+                     global_frame.c_str());
+            continue;
+        }
+        double x = goal_x_i, y = goal_y_i;
+        if(!old_navfn_behavior_)
+            worldToMap(wx, wy, x, y);
+        planned.push_back(i);
+        goal_x.push_back(x);
+        goal_y.push_back(y);
+        goal_cells.push_back((int)x + nx * (int)y);
+    }
+
+    resizeWorkspace(nx, ny);
+    updatePlanningCosts(planning_costs_, planning_version_, robot_cell_);
+
+    //clear the starting cell within the planner's copy of the costmap because we know it can't be an obstacle
+    clearRobotCell(planning_costs_, robot_cell_, start_x_i, start_y_i);
+
+    //the border is lethal in the copy from its first outline on, so it is not recorded as a change
+    outlineMap(planning_costs_.getCharMap(), nx, ny, costmap_2d::LETHAL_OBSTACLE);
+
+    //one expansion, until every goal has a potential; the expanders forget what they
+    //last set in the potential array when the other one has written to it since
+    if (batch_planner_ != planner_)
+        batch_planner_->forgetPotential();
+    batch_planner_->calculatePotentials(planning_costs_.getCharMap(), start_x, start_y, goal_cells, nx * ny * 2,
+                                        potential_array_);
+    if (batch_planner_ != planner_)
+        planner_->forgetPotential();
+
+    if(!old_navfn_behavior_)
+        for (size_t k = 0; k < planned.size(); k++)
+            batch_planner_->clearEndpoint(planning_costs_.getCharMap(), potential_array_, goal_cells[k] % nx,
+                                          goal_cells[k] / nx, 2);
+    if(publish_potential_)
+        publishPotential(potential_array_);
+
+    size_t found = 0;
+    for (size_t k = 0; k < planned.size(); k++) {
+        size_t i = planned[k];
+        if (potential_array_[goal_cells[k]] >= POT_HIGH
+                || !getPlanFromPotential(start_x, start_y, goal_x[k], goal_y[k], goals[i], plans[i]))
+            continue;
+
+        //make sure the goal we push on has the same timestamp as the rest of the plan
+        geometry_msgs::PoseStamped goal_copy = goals[i];
+        goal_copy.header.stamp = ros::Time::now();
+        plans[i].push_back(goal_copy);
+        orientation_filter_->processPath(start, plans[i]);
+        costs[i] = potential_array_[goal_cells[k]];
+        found++;
+    }
+
+    return found == goals.size();
+}
+
 void GlobalPlanner::publishPlan(const std::vector<geometry_msgs::PoseStamped>& path) {
     if (!initialized_) {
         ROS_ERROR(
@@ -377,35 +938,34 @@ bool GlobalPlanner::getPlanFromPotential(double start_x, double start_y, double
         return false;
     }
 
-    std::string global_frame = frame_id_;
+    return tracePlan(path_maker_, potential_array_, path_, start_x, start_y, goal_x, goal_y, goal, plan);
+}
 
+bool GlobalPlanner::tracePlan(Traceback* path_maker, float* potential, std::vector<std::pair<float, float> >& path,
+                              double start_x, double start_y, double goal_x, double goal_y,
+                              const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan) {
     //clear the plan, just in case
     plan.clear();
 
-    std::vector<std::pair<float, float> > path;
-
-    if (!path_maker_->getPath(potential_array_, start_x, start_y, goal_x, goal_y, path)) {
+    path.clear();
+    if (!path_maker->getPath(potential, start_x, start_y, goal_x, goal_y, path)) {
         ROS_ERROR("NO PATH!");
         return false;
     }
 
-    ros::Time plan_time = ros::Time::now();
+    //every pose shares the header, set up once; room is made for the goal the callers push on
+    geometry_msgs::PoseStamped pose;
+    pose.header.stamp = ros::Time::now();
+    pose.header.frame_id = frame_id_;
+    pose.pose.position.z = 0.0;
+    pose.pose.orientation.x = 0.0;
+    pose.pose.orientation.y = 0.0;
+    pose.pose.orientation.z = 0.0;
+    pose.pose.orientation.w = 1.0;
+    plan.reserve(path.size() + 2);
     for (int i = path.size() -1; i>=0; i--) {
-        std::pair<float, float> point = path[i];
         //convert the plan to world coordinates
-        double world_x, world_y;
-        mapToWorld(point.first, point.second, world_x, world_y);
-
-        geometry_msgs::PoseStamped pose;
-        pose.header.stamp = plan_time;
-        pose.header.frame_id = global_frame;
-        pose.pose.position.x = world_x;
-        pose.pose.position.y = world_y;
-        pose.pose.position.z = 0.0;
-        pose.pose.orientation.x = 0.0;
-        pose.pose.orientation.y = 0.0;
-        pose.pose.orientation.z = 0.0;
-        pose.pose.orientation.w = 1.0;
+        mapToWorld(path[i].first, path[i].second, pose.pose.position.x, pose.pose.position.y);
         plan.push_back(pose);
     }
     if(old_navfn_behavior_){
@@ -414,18 +974,146 @@ bool GlobalPlanner::getPlanFromPotential(double start_x, double start_y, double
     return !plan.empty();
 }
 
+bool GlobalPlanner::computePotential(const geometry_msgs::Point& world_point) {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!initialized_) {
+        ROS_ERROR(
+                "This planner has not been initialized yet, but it is being used, please call initialize() before use");
+        return false;
+    }
+
+    double seed_x, seed_y;
+    unsigned int seed_x_i, seed_y_i;
+    if (!costmap_->worldToMap(world_point.x, world_point.y, seed_x_i, seed_y_i))
+        return false;
+    if(old_navfn_behavior_){
+        seed_x = seed_x_i;
+        seed_y = seed_y_i;
+    }else{
+        worldToMap(world_point.x, world_point.y, seed_x, seed_y);
+    }
+
+    int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    resizeWorkspace(nx, ny);
+    updatePlanningCosts(planning_costs_, planning_version_, robot_cell_);
+    outlineMap(planning_costs_.getCharMap(), nx, ny, costmap_2d::LETHAL_OBSTACLE);
+
+    //the whole map is expanded into an array of its own, which the plans leave alone
+    nav_potential_.resize(nx * ny);
+    batch_planner_->forgetPotential();
+    bool done = batch_planner_->calculateAllPotentials(planning_costs_.getCharMap(), seed_x, seed_y, nx * ny * 2,
+                                                       &nav_potential_[0]);
+    batch_planner_->forgetPotential();
+
+    nav_seed_ = world_point;
+    nav_version_ = costmap_->getVersion();
+    nav_nx_ = done ? nx : 0;
+    nav_ny_ = done ? ny : 0;
+    return done;
+}
+
+bool GlobalPlanner::hasNavigationFunction() {
+    return nav_nx_ > 0 && nav_nx_ == costmap_->getSizeInCellsX() && nav_ny_ == costmap_->getSizeInCellsY()
+            && nav_version_ == costmap_->getVersion();
+}
+
+double GlobalPlanner::interpolatePotential(double mx, double my) {
+    //bilinear, over those of the four cells around the point that have a potential
+    int x0 = (int)floor(mx), y0 = (int)floor(my);
+    double fx = mx - x0, fy = my - y0;
+    double sum = 0.0, weight = 0.0;
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 2; i++) {
+            int x = x0 + i, y = y0 + j;
+            if (x < 0 || y < 0 || x >= (int)nav_nx_ || y >= (int)nav_ny_)
+                continue;
+            float potential = nav_potential_[y * nav_nx_ + x];
+            if (potential >= POT_HIGH)
+                continue;
+            double w = (i ? fx : 1.0 - fx) * (j ? fy : 1.0 - fy);
+            sum += w * potential;
+            weight += w;
+        }
+    }
+    return weight > 0.0 ? sum / weight : -1.0;
+}
+
+bool GlobalPlanner::getPointPotentials(const std::vector<geometry_msgs::Point>& world_points,
+                                       std::vector<double>& potentials) {
+    boost::mutex::scoped_lock lock(mutex_);
+    potentials.clear();
+    if (!hasNavigationFunction())
+        return false;
+
+    potentials.resize(world_points.size(), -1.0);
+    for (size_t i = 0; i < world_points.size(); i++) {
+        double mx, my;
+        if (worldToMap(world_points[i].x, world_points[i].y, mx, my))
+            potentials[i] = interpolatePotential(mx, my);
+    }
+    return true;
+}
+
+double GlobalPlanner::getPointPotential(const geometry_msgs::Point& world_point) {
+    std::vector<double> potentials;
+    if (!getPointPotentials(std::vector<geometry_msgs::Point>(1, world_point), potentials))
+        return -1.0;
+    return potentials[0];
+}
+
+bool GlobalPlanner::validPointPotential(const geometry_msgs::Point& world_point) {
+    return validPointPotential(world_point, default_tolerance_);
+}
+
+bool GlobalPlanner::validPointPotential(const geometry_msgs::Point& world_point, double tolerance) {
+    double resolution = costmap_->getResolution();
+    std::vector<geometry_msgs::Point> points;
+    geometry_msgs::Point p = world_point;
+    for (p.y = world_point.y - tolerance; p.y <= world_point.y + tolerance; p.y += resolution)
+        for (p.x = world_point.x - tolerance; p.x <= world_point.x + tolerance; p.x += resolution)
+            points.push_back(p);
+
+    std::vector<double> potentials;
+    if (!getPointPotentials(points, potentials))
+        return false;
+    for (size_t i = 0; i < potentials.size(); i++)
+        if (potentials[i] >= 0.0)
+            return true;
+    return false;
+}
+
 void GlobalPlanner::publishPotential(float* potential)
 {
+    if (potential_pub_.getNumSubscribers() == 0)
+        return;
+
     int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    int d = std::max(publish_potential_decimation_, 1);
+    int gx = (nx + d - 1) / d, gy = (ny + d - 1) / d;
     double resolution = costmap_->getResolution();
-    nav_msgs::OccupancyGrid grid;
-    // Publish Whole Grid
+
+    // Each published cell takes the lowest potential of the cells it covers
+    std::vector<float> snapshot;
+    if (d == 1)
+        snapshot.assign(potential, potential + nx * ny);
+    else {
+        snapshot.assign(gx * gy, POT_HIGH);
+        for (int y = 0; y < ny; y++) {
+            float* row = &snapshot[(y / d) * gx];
+            const float* src = potential + y * nx;
+            for (int x = 0; x < nx; x++)
+                row[x / d] = std::min(row[x / d], src[x]);
+        }
+    }
+
+    boost::mutex::scoped_lock lock(potential_mutex_);
+    nav_msgs::OccupancyGrid& grid = potential_grid_;
     grid.header.frame_id = frame_id_;
     grid.header.stamp = ros::Time::now();
-    grid.info.resolution = resolution;
+    grid.info.resolution = resolution * d;
 
-    grid.info.width = nx;
-    grid.info.height = ny;
+    grid.info.width = gx;
+    grid.info.height = gy;
 
     double wx, wy;
     costmap_->mapToWorld(0, 0, wx, wy);
@@ -434,25 +1122,44 @@ void GlobalPlanner::publishPotential(float* potential)
     grid.info.origin.position.z = 0.0;
     grid.info.origin.orientation.w = 1.0;
 
-    grid.data.resize(nx * ny);
+    // A snapshot the thread has not got to yet is simply replaced
+    potential_snapshot_.swap(snapshot);
+    potential_cond_.notify_one();
+}
+
+void GlobalPlanner::potentialThread()
+{
+    nav_msgs::OccupancyGrid grid;
+    std::vector<float> potential;
+    while (true) {
+        {
+            boost::mutex::scoped_lock lock(potential_mutex_);
+            while (potential_snapshot_.empty() && !potential_shutdown_)
+                potential_cond_.wait(lock);
+            if (potential_shutdown_)
+                return;
+            potential.swap(potential_snapshot_);
+            potential_snapshot_.clear();
+            grid.header = potential_grid_.header;
+            grid.info = potential_grid_.info;
+        }
+
+        grid.data.resize(potential.size());
 
-    float max = 0.0;
-    for (unsigned int i = 0; i < grid.data.size(); i++) {
-        float potential = potential_array_[i];
-        if (potential < POT_HIGH) {
-            if (potential > max) {
-                max = potential;
-            }
+        float max = 0.0;
+        for (unsigned int i = 0; i < potential.size(); i++) {
+            if (potential[i] < POT_HIGH && potential[i] > max)
+                max = potential[i];
         }
-    }
 
-    for (unsigned int i = 0; i < grid.data.size(); i++) {
-        if (potential_array_[i] >= POT_HIGH) {
-            grid.data[i] = -1;
-        } else
-            grid.data[i] = potential_array_[i] * publish_scale_ / max;
+        for (unsigned int i = 0; i < potential.size(); i++) {
+            if (potential[i] >= POT_HIGH) {
+                grid.data[i] = -1;
+            } else
+                grid.data[i] = potential[i] * publish_scale_ / max;
+        }
+        potential_pub_.publish(grid);
     }
-    potential_pub_.publish(grid);
 }
 
 } //end namespace global_planner
@@ -0,0 +1,137 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+/**
+ * Test that plans made at once, on the planner's own search and on its
+ * workspaces, come out the same as the plans made one at a time.
+ */
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <boost/thread.hpp>
+#include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/cost_values.h>
+#include <global_planner/planner_core.h>
+
+namespace {
+
+const unsigned int GOALS = 6;
+const unsigned int THREADS = 4;
+const unsigned int ROUNDS = 20;
+
+geometry_msgs::PoseStamped pose(double x, double y)
+{
+  geometry_msgs::PoseStamped p;
+  p.header.frame_id = "map";
+  p.pose.position.x = x;
+  p.pose.position.y = y;
+  p.pose.orientation.w = 1.0;
+  return p;
+}
+
+// a 5 m square at 0.05 m, with a wall across the middle that has a gap at either end
+void buildMap(costmap_2d::Costmap2D& costmap)
+{
+  for (unsigned int i = 10; i < 90; i++)
+  {
+    costmap.setCost(i, 50, costmap_2d::LETHAL_OBSTACLE);
+    costmap.setCost(30, i / 2, costmap_2d::LETHAL_OBSTACLE);
+  }
+}
+
+geometry_msgs::PoseStamped goal(unsigned int i)
+{
+  return pose(0.5 + 0.7 * i, 4.0 - 0.2 * i);
+}
+
+bool samePlan(const std::vector<geometry_msgs::PoseStamped>& a,
+              const std::vector<geometry_msgs::PoseStamped>& b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (unsigned int i = 0; i < a.size(); i++)
+  {
+    if (a[i].pose.position.x != b[i].pose.position.x || a[i].pose.position.y != b[i].pose.position.y)
+      return false;
+  }
+  return true;
+}
+
+void planner(global_planner::GlobalPlanner* gp, const std::vector<std::vector<geometry_msgs::PoseStamped> >* reference,
+             unsigned int offset, unsigned int* mismatches)
+{
+  geometry_msgs::PoseStamped start = pose(2.5, 0.5);
+  for (unsigned int round = 0; round < ROUNDS; round++)
+  {
+    unsigned int g = (offset + round) % GOALS;
+    std::vector<geometry_msgs::PoseStamped> plan;
+    if (!gp->makePlan(start, goal(g), plan) || !samePlan(plan, (*reference)[g]))
+      (*mismatches)++;
+  }
+}
+
+}  // namespace
+
+TEST(GlobalPlanner, concurrentPlansMatchSerial)
+{
+  ros::NodeHandle private_nh("~/planner");
+  private_nh.setParam("planner_workspaces", static_cast<int>(THREADS));
+
+  costmap_2d::Costmap2D costmap(100, 100, 0.05, 0.0, 0.0);
+  buildMap(costmap);
+  global_planner::GlobalPlanner gp("planner", &costmap, "map");
+
+  std::vector<std::vector<geometry_msgs::PoseStamped> > reference(GOALS);
+  for (unsigned int g = 0; g < GOALS; g++)
+  {
+    ASSERT_TRUE(gp.makePlan(pose(2.5, 0.5), goal(g), reference[g]));
+    ASSERT_FALSE(reference[g].empty());
+  }
+
+  std::vector<unsigned int> mismatches(THREADS, 0);
+  boost::thread_group threads;
+  for (unsigned int t = 0; t < THREADS; t++)
+    threads.create_thread(boost::bind(&planner, &gp, &reference, t, &mismatches[t]));
+  threads.join_all();
+
+  for (unsigned int t = 0; t < THREADS; t++)
+    EXPECT_EQ(0u, mismatches[t]) << "thread " << t;
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "concurrent_plans_test");
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
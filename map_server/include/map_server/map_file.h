@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2008, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef MAP_SERVER_MAP_FILE_H
+#define MAP_SERVER_MAP_FILE_H
+
+#include "nav_msgs/GetMap.h"
+
+namespace map_server
+{
+
+/** Write the map to a binary map file, which holds the occupancy as it is,
+ * rows in ROS order, and the geometry of the map, so that loading it takes
+ * no decoding.  The data starts on a page boundary, ready to be mapped
+ * into memory.
+ *
+ * @param map The map to write
+ * @param fname The file to write
+ * @param run_length If true, the data is run length coded, which makes the
+ *                   file much smaller but means expanding it on loading
+ * @return False if the file could not be written
+ */
+bool saveMapToBinaryFile(const nav_msgs::OccupancyGrid& map, const char* fname,
+                         bool run_length=false);
+
+/** Read a binary map file written by saveMapToBinaryFile() into resp.
+ *
+ * @param resp The map will be written into here
+ * @param fname The file to read from
+ * @throws std::runtime_error If the file can't be read, or isn't a binary map file
+ */
+void loadMapFromBinaryFile(nav_msgs::GetMap::Response* resp, const char* fname);
+
+/** Write the map as an 8-bit PGM image, free cells white (254), occupied
+ * ones black (0) and the rest gray (205), as map_saver always has.  Rows
+ * are converted through a table a block at a time, the block split across
+ * threads, and written with one call each.
+ *
+ * @param map The map to write
+ * @param fname The file to write
+ * @return False if the file could not be written
+ */
+bool saveMapToPGMFile(const nav_msgs::OccupancyGrid& map, const char* fname);
+
+/** @return True if the file is a binary map file */
+bool isBinaryMapFile(const char* fname);
+}
+
+#endif
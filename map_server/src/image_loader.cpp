@@ -33,15 +33,25 @@
  * Author: Brian Gerkey
  */
 
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <stdexcept>
+#include <vector>
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // We use SDL_image to load the image from disk
 #include <SDL/SDL_image.h>
 
+#include <boost/bind.hpp>
+#include <nav_executor/executor.h>
+
 #include "map_server/image_loader.h"
 #include <tf/tf.h>
 
@@ -51,36 +61,121 @@
 namespace map_server
 {
 
-void
-loadMapFromFile(nav_msgs::GetMap::Response* resp,
-                const char* fname, double res, bool negate,
-                double occ_th, double free_th, double* origin,
-                MapMode mode)
+// The map value of every sum of the averaged channels of a pixel, which is
+// all a pixel's value depends on, bar a transparent pixel in between the
+// thresholds.  Worked out the way a pixel at a time always was, so the map
+// comes out the same.
+struct PixelTable
 {
-  SDL_Surface* img;
+  std::vector<unsigned char> value;
+  std::vector<unsigned char> transparent;   // the value when the alpha is 0
+};
 
-  unsigned char* pixels;
-  unsigned char* p;
-  unsigned char value;
-  int rowstride, n_channels, avg_channels;
-  unsigned int i,j;
-  int k;
-  double occ;
-  int alpha;
-  int color_sum;
-  double color_avg;
+static void
+buildPixelTable(PixelTable& table, int avg_channels, bool negate,
+                double occ_th, double free_th, MapMode mode)
+{
+  int sums = 255 * avg_channels + 1;
+  table.value.resize(sums);
+  table.transparent.resize(sums);
+  for (int color_sum = 0; color_sum < sums; color_sum++)
+  {
+    double color_avg = color_sum / (double)avg_channels;
+    if (negate)
+      color_avg = 255 - color_avg;
 
-  // Load the image using SDL.  If we get NULL back, the image load failed.
-  if(!(img = IMG_Load(fname)))
+    if (mode == RAW)
+    {
+      table.value[color_sum] = table.transparent[color_sum] = color_avg;
+      continue;
+    }
+
+    // If negate is true, we consider blacker pixels free, and whiter
+    // pixels free.  Otherwise, it's vice versa.
+    double occ = (255 - color_avg) / 255.0;
+
+    // Apply thresholds to RGB means to determine occupancy values for
+    // map.
+    unsigned char value;
+    if (occ > occ_th)
+      value = +100;
+    else if (occ < free_th)
+      value = 0;
+    else if (mode == TRINARY)
+      value = -1;
+    else
+    {
+      double ratio = (occ - free_th) / (occ_th - free_th);
+      value = 99 * ratio;
+    }
+    table.value[color_sum] = value;
+    table.transparent[color_sum] = (occ > occ_th || occ < free_th) ? value : (unsigned char)-1;
+  }
+}
+
+// Convert rows [j0, j1) of the image.  We invert the graphics-ordering of
+// the pixels to produce a map with cell (0,0) in the lower-left corner.
+static void
+convertRows(const unsigned char* pixels, int rowstride, int n_channels,
+            int avg_channels, const PixelTable* table,
+            nav_msgs::GetMap::Response* resp, unsigned int j0, unsigned int j1)
+{
+  unsigned int width = resp->map.info.width, height = resp->map.info.height;
+  for (unsigned int j = j0; j < j1; j++)
   {
-    std::string errmsg = std::string("failed to open image file \"") +
-            std::string(fname) + std::string("\"");
-    throw std::runtime_error(errmsg);
+    const unsigned char* p = pixels + (size_t)j * rowstride;
+    int8_t* row = &resp->map.data[MAP_IDX(width, 0, height - j - 1)];
+    if (n_channels == 1)
+    {
+      for (unsigned int i = 0; i < width; i++)
+        row[i] = table->value[p[i]];
+      continue;
+    }
+
+    for (unsigned int i = 0; i < width; i++, p += n_channels)
+    {
+      int color_sum = 0;
+      for (int k = 0; k < avg_channels; k++)
+        color_sum += p[k];
+      row[i] = p[n_channels - 1] ? table->value[color_sum] : table->transparent[color_sum];
+    }
   }
+}
 
-  // Copy the image data into the map structure
-  resp->map.info.width = img->w;
-  resp->map.info.height = img->h;
+// Convert band t of bands equal bands of the rows of the image
+static void
+convertBand(const unsigned char* pixels, int rowstride, int n_channels,
+            int avg_channels, const PixelTable* table,
+            nav_msgs::GetMap::Response* resp, unsigned int bands, unsigned int t)
+{
+  unsigned int height = resp->map.info.height;
+  convertRows(pixels, rowstride, n_channels, avg_channels, table, resp,
+              height * t / bands, height * (t + 1) / bands);
+}
+
+// Convert the whole image, in bands of rows on the shared executor.
+static void
+convertPixels(const unsigned char* pixels, int rowstride, int n_channels,
+              int avg_channels, bool negate, double occ_th, double free_th,
+              MapMode mode, nav_msgs::GetMap::Response* resp)
+{
+  PixelTable table;
+  buildPixelTable(table, avg_channels, negate, occ_th, free_th, mode);
+
+  unsigned int height = resp->map.info.height;
+  nav_executor::Executor& executor = nav_executor::Executor::shared();
+  unsigned int bands = std::max(1u, std::min(executor.size(), height / 64));
+  executor.run(nav_executor::LANE_GLOBAL_PLANNING, bands,
+               boost::bind(&convertBand, pixels, rowstride, n_channels, avg_channels, &table,
+                           resp, bands, _1));
+}
+
+static void
+setMapInfo(nav_msgs::GetMap::Response* resp, unsigned int width,
+           unsigned int height, double res, double* origin)
+{
+  resp->map.info.width = width;
+  resp->map.info.height = height;
   resp->map.info.resolution = res;
   resp->map.info.origin.position.x = *(origin);
   resp->map.info.origin.position.y = *(origin+1);
@@ -93,10 +188,96 @@ loadMapFromFile(nav_msgs::GetMap::Response* resp,
   resp->map.info.origin.orientation.w = q.w();
 
   // Allocate space to hold the data
-  resp->map.data.resize(resp->map.info.width * resp->map.info.height);
+  resp->map.data.resize((size_t)width * height);
+}
+
+// Read a header field of a PGM file, skipping whitespace and comments.
+static bool
+readPGMField(const unsigned char* data, size_t size, size_t& pos, unsigned int& field)
+{
+  while (pos < size && (isspace(data[pos]) || data[pos] == '#'))
+  {
+    if (data[pos] == '#')
+      while (pos < size && data[pos] != '\n')
+        pos++;
+    else
+      pos++;
+  }
+  if (pos == size || !isdigit(data[pos]))
+    return false;
+  field = 0;
+  while (pos < size && isdigit(data[pos]) && field < 100000000)
+    field = field * 10 + (data[pos++] - '0');
+  return true;
+}
+
+// Load a binary 8-bit grayscale PGM straight from the file, mapped into
+// memory.  Returns false, having left resp alone, for anything else, which
+// is left to SDL.
+static bool
+loadPGM(nav_msgs::GetMap::Response* resp, const char* fname, double res,
+        bool negate, double occ_th, double free_th, double* origin, MapMode mode)
+{
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < 2)
+  {
+    close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+
+  const unsigned char* data = (const unsigned char*)mapped;
+  size_t pos = 2;
+  unsigned int width, height, maxval;
+  bool native = data[0] == 'P' && data[1] == '5' &&
+                readPGMField(data, size, pos, width) &&
+                readPGMField(data, size, pos, height) &&
+                readPGMField(data, size, pos, maxval) &&
+                maxval == 255 && width > 0 && height > 0 &&
+                pos < size && isspace(data[pos]) &&
+                size - pos - 1 >= (size_t)width * height;
+  if (native)
+  {
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    setMapInfo(resp, width, height, res, origin);
+    convertPixels(data + pos + 1, width, 1, 1, negate, occ_th, free_th, mode, resp);
+  }
+  munmap(mapped, size);
+  return native;
+}
+
+void
+loadMapFromFile(nav_msgs::GetMap::Response* resp,
+                const char* fname, double res, bool negate,
+                double occ_th, double free_th, double* origin,
+                MapMode mode)
+{
+  SDL_Surface* img;
+  int n_channels, avg_channels;
+
+  // 8-bit grayscale PGMs, as map_saver writes them, are read without SDL
+  if (loadPGM(resp, fname, res, negate, occ_th, free_th, origin, mode))
+    return;
+
+  // Load the image using SDL.  If we get NULL back, the image load failed.
+  if(!(img = IMG_Load(fname)))
+  {
+    std::string errmsg = std::string("failed to open image file \"") +
+            std::string(fname) + std::string("\"");
+    throw std::runtime_error(errmsg);
+  }
+
+  // Copy the image data into the map structure
+  setMapInfo(resp, img->w, img->h, res, origin);
 
   // Get values that we'll need to iterate through the pixels
-  rowstride = img->pitch;
   n_channels = img->format->BytesPerPixel;
 
   // NOTE: Trinary mode still overrides here to preserve existing behavior.
@@ -107,54 +288,8 @@ loadMapFromFile(nav_msgs::GetMap::Response* resp,
     avg_channels = n_channels - 1;
 
   // Copy pixel data into the map structure
-  pixels = (unsigned char*)(img->pixels);
-  for(j = 0; j < resp->map.info.height; j++)
-  {
-    for (i = 0; i < resp->map.info.width; i++)
-    {
-      // Compute mean of RGB for this pixel
-      p = pixels + j*rowstride + i*n_channels;
-      color_sum = 0;
-      for(k=0;k<avg_channels;k++)
-        color_sum += *(p + (k));
-      color_avg = color_sum / (double)avg_channels;
-
-      if (n_channels == 1)
-          alpha = 1;
-      else
-          alpha = *(p+n_channels-1);
-
-      if(negate)
-        color_avg = 255 - color_avg;
-
-      if(mode==RAW){
-          value = color_avg;
-          resp->map.data[MAP_IDX(resp->map.info.width,i,resp->map.info.height - j - 1)] = value;
-          continue;
-      }
-
-
-      // If negate is true, we consider blacker pixels free, and whiter
-      // pixels free.  Otherwise, it's vice versa.
-      occ = (255 - color_avg) / 255.0;
-
-      // Apply thresholds to RGB means to determine occupancy values for
-      // map.  Note that we invert the graphics-ordering of the pixels to
-      // produce a map with cell (0,0) in the lower-left corner.
-      if(occ > occ_th)
-        value = +100;
-      else if(occ < free_th)
-        value = 0;
-      else if(mode==TRINARY || alpha < 1.0)
-        value = -1;
-      else {
-        double ratio = (occ - free_th) / (occ_th - free_th);
-        value = 99 * ratio;
-      }
-
-      resp->map.data[MAP_IDX(resp->map.info.width,i,resp->map.info.height - j - 1)] = value;
-    }
-  }
+  convertPixels((unsigned char*)(img->pixels), img->pitch, n_channels, avg_channels,
+                negate, occ_th, free_th, mode, resp);
 
   SDL_FreeSurface(img);
 }
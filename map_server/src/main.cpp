@@ -31,6 +31,8 @@
 
 #define USAGE "\nUSAGE: map_server <map.yaml>\n" \
               "  map.yaml: map description file\n" \
+              "USAGE: map_server <map.rmap>\n" \
+              "  map.rmap: binary map file written by map_saver -b\n" \
               "DEPRECATED USAGE: map_server <map> <resolution>\n" \
               "  map: image file to load\n"\
               "  resolution: map resolution [meters/pixel]"
@@ -38,13 +40,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <libgen.h>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "ros/ros.h"
 #include "ros/console.h"
 #include "map_server/image_loader.h"
+#include "map_server/map_file.h"
+#include "map_server/map_pyramid.h"
 #include "nav_msgs/MapMetaData.h"
+#include "map_msgs/GetMapROI.h"
+#include "map_msgs/OccupancyGridUpdate.h"
+#include "map_server/SwitchMap.h"
 #include "yaml-cpp/yaml.h"
+#ifdef MAP_SERVER_NODELET
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#endif
 
 #ifdef HAVE_NEW_YAMLCPP
 // The >> operator disappeared in yaml-cpp 0.5, so this function is
@@ -59,19 +78,107 @@ void operator >> (const YAML::Node& node, T& i)
 class MapServer
 {
   public:
-    /** Trivial constructor */
-    MapServer(const std::string& fname, double res)
+    /** Trivial constructor; a nodelet passes in its own node handles */
+    MapServer(const std::string& fname, double res,
+              const ros::NodeHandle& nh = ros::NodeHandle(),
+              const ros::NodeHandle& private_nh = ros::NodeHandle("~"))
+      : n(nh), map_resp_(new nav_msgs::GetMap::Response)
+    {
+      std::string frame_id;
+      private_nh.param("frame_id", frame_id, std::string("map"));
+      // large maps can be served in tiles and regions alone, rather than
+      // latched whole on the map topic
+      private_nh.param("publish_full_map", publish_full_map_, true);
+      private_nh.param("tile_size", tile_size_, 0);
+      int pyramid_levels;
+      private_nh.param("pyramid_levels", pyramid_levels, 0);
+      loadMap(fname, res, frame_id, private_nh, *map_resp_);
+      meta_data_message_ = map_resp_->map.info;
+
+      // The maps of the maps parameter, e.g. the other floors of a building,
+      // are loaded now too, so that switch_map serves one of them at once
+      active_ = mapName(fname);
+      resident_[active_].resp = map_resp_;
+      std::vector<std::string> maps;
+      private_nh.param("maps", maps, std::vector<std::string>());
+      for (unsigned int i = 0; i < maps.size(); i++) {
+        ResidentMap& resident = resident_[mapName(maps[i])];
+        if (resident.resp)
+          continue;
+        resident.resp.reset(new nav_msgs::GetMap::Response);
+        loadMap(maps[i], 0.0, frame_id, private_nh, *resident.resp);
+      }
+
+      // Each level halves the resolution of the one before, built once here
+      for (std::map<std::string, ResidentMap>::iterator it = resident_.begin(); it != resident_.end(); ++it) {
+        const nav_msgs::OccupancyGrid* finer = &it->second.resp->map;
+        it->second.pyramid.resize(std::max(pyramid_levels, 0));
+        for (unsigned int level = 0; level < it->second.pyramid.size(); level++) {
+          map_server::downsampleMap(*finer, it->second.pyramid[level]);
+          finer = &it->second.pyramid[level];
+        }
+      }
+
+      service = n.advertiseService("static_map", &MapServer::mapCallback, this);
+      //pub = n.advertise<nav_msgs::MapMetaData>("map_metadata", 1,
+
+      // Latched publisher for metadata
+      metadata_pub= n.advertise<nav_msgs::MapMetaData>("map_metadata", 1, true);
+      metadata_pub.publish( meta_data_message_ );
+
+      roi_service = n.advertiseService("static_map_roi", &MapServer::roiCallback, this);
+      if (resident_.size() > 1)
+        switch_service = n.advertiseService("switch_map", &MapServer::switchCallback, this);
+
+      // Latched publisher for data
+      // published by pointer, so subscribers in the same process, e.g.
+      // nodelets, share the map instead of copying it
+      if (publish_full_map_) {
+        map_pub = n.advertise<nav_msgs::OccupancyGrid>("map", 1, true);
+        map_pub.publish(nav_msgs::OccupancyGridConstPtr(map_resp_, &map_resp_->map));
+      }
+
+      // Every subscriber to the tiles is sent all of them as it connects,
+      // which a latched topic, keeping only the last message, can't do.
+      // They go out back to back, so the queue holds a whole map of them.
+      if (tile_size_ > 0) {
+        unsigned int tiles = 1;
+        for (std::map<std::string, ResidentMap>::iterator it = resident_.begin(); it != resident_.end(); ++it)
+          tiles = std::max(tiles, tileCount(it->second.resp->map.info));
+        tile_pub = n.advertise<map_msgs::OccupancyGridUpdate>("map_tiles", tiles,
+            boost::bind(&MapServer::tileSubscriberCallback, this, _1));
+      }
+
+      // and the levels of the pyramid are latched on map_level_<n> for
+      // consumers that don't need the detail
+      const std::vector<nav_msgs::OccupancyGrid>& pyramid = resident_[active_].pyramid;
+      for (unsigned int level = 0; level < pyramid.size(); level++) {
+        std::stringstream topic;
+        topic << "map_level_" << level + 1;
+        pyramid_pubs_.push_back(n.advertise<nav_msgs::OccupancyGrid>(topic.str(), 1, true));
+        pyramid_pubs_.back().publish(pyramid[level]);
+        ROS_INFO("Pyramid level %u is %d X %d @ %.3lf m/cell", level + 1,
+                 pyramid[level].info.width, pyramid[level].info.height, pyramid[level].info.resolution);
+      }
+    }
+
+  private:
+    /** Load the map of a map description or binary map file, or of an
+     * image at res for the deprecated interface, into resp */
+    void loadMap(const std::string& fname, double res, const std::string& frame_id,
+                 const ros::NodeHandle& private_nh, nav_msgs::GetMap::Response& resp)
     {
       std::string mapfname = "";
       double origin[3];
       int negate;
       double occ_th, free_th;
       MapMode mode = TRINARY;
-      std::string frame_id;
-      ros::NodeHandle private_nh("~");
-      private_nh.param("frame_id", frame_id, std::string("map"));
-      deprecated = (res != 0);
-      if (!deprecated) {
+      bool deprecated = (res != 0);
+      // a binary map file holds its own resolution and origin
+      bool binary = !deprecated && map_server::isBinaryMapFile(fname.c_str());
+      if (binary) {
+        mapfname = fname;
+      } else if (!deprecated) {
         //mapfname = fname + ".pgm";
         //std::ifstream fin((fname + ".yaml").c_str());
         std::ifstream fin(fname.c_str());
@@ -164,35 +271,79 @@ class MapServer
         origin[0] = origin[1] = origin[2] = 0.0;
       }
 
-      ROS_INFO("Loading map from image \"%s\"", mapfname.c_str());
-      map_server::loadMapFromFile(&map_resp_,mapfname.c_str(),res,negate,occ_th,free_th, origin, mode);
-      map_resp_.map.info.map_load_time = ros::Time::now();
-      map_resp_.map.header.frame_id = frame_id;
-      map_resp_.map.header.stamp = ros::Time::now();
+      if (binary || map_server::isBinaryMapFile(mapfname.c_str())) {
+        ROS_INFO("Loading map from binary map file \"%s\"", mapfname.c_str());
+        map_server::loadMapFromBinaryFile(&resp, mapfname.c_str());
+      } else {
+        ROS_INFO("Loading map from image \"%s\"", mapfname.c_str());
+        map_server::loadMapFromFile(&resp,mapfname.c_str(),res,negate,occ_th,free_th, origin, mode);
+      }
+      resp.map.info.map_load_time = ros::Time::now();
+      resp.map.header.frame_id = frame_id;
+      resp.map.header.stamp = ros::Time::now();
       ROS_INFO("Read a %d X %d map @ %.3lf m/cell",
-               map_resp_.map.info.width,
-               map_resp_.map.info.height,
-               map_resp_.map.info.resolution);
-      meta_data_message_ = map_resp_.map.info;
-
-      service = n.advertiseService("static_map", &MapServer::mapCallback, this);
-      //pub = n.advertise<nav_msgs::MapMetaData>("map_metadata", 1,
-
-      // Latched publisher for metadata
-      metadata_pub= n.advertise<nav_msgs::MapMetaData>("map_metadata", 1, true);
-      metadata_pub.publish( meta_data_message_ );
-
-      // Latched publisher for data
-      map_pub = n.advertise<nav_msgs::OccupancyGrid>("map", 1, true);
-      map_pub.publish( map_resp_.map );
+               resp.map.info.width,
+               resp.map.info.height,
+               resp.map.info.resolution);
     }
 
-  private:
     ros::NodeHandle n;
     ros::Publisher map_pub;
     ros::Publisher metadata_pub;
+    ros::Publisher tile_pub;
     ros::ServiceServer service;
-    bool deprecated;
+    ros::ServiceServer roi_service;
+    ros::ServiceServer switch_service;
+    bool publish_full_map_;
+    int tile_size_;
+    std::vector<ros::Publisher> pyramid_pubs_;
+
+    /** A map kept loaded, with its pyramid, to be switched to */
+    struct ResidentMap
+    {
+      boost::shared_ptr<nav_msgs::GetMap::Response> resp;
+      std::vector<nav_msgs::OccupancyGrid> pyramid;
+    };
+    std::map<std::string, ResidentMap> resident_;
+    std::string active_;
+
+    /** The name a map is switched to by, the name of its file without the
+     * directory or extension */
+    static std::string mapName(const std::string& fname)
+    {
+      std::string name = fname.substr(fname.find_last_of('/') + 1);
+      return name.substr(0, name.find_last_of('.'));
+    }
+
+    /** Callback invoked when someone switches the map served; the map and
+     * its pyramid were loaded at startup, so they are only published again */
+    bool switchCallback(map_server::SwitchMap::Request  &req,
+                        map_server::SwitchMap::Response &res )
+    {
+      boost::mutex::scoped_lock lock(switch_mutex_);
+      std::map<std::string, ResidentMap>::iterator it = resident_.find(req.name);
+      res.success = (it != resident_.end());
+      if (!res.success) {
+        ROS_WARN("No map named \"%s\" is loaded; still serving \"%s\"", req.name.c_str(), active_.c_str());
+        return true;
+      }
+      if (req.name == active_)
+        return true;
+
+      active_ = req.name;
+      const boost::shared_ptr<nav_msgs::GetMap::Response>& resp = it->second.resp;
+      boost::atomic_store(&map_resp_, resp);
+      meta_data_message_ = resp->map.info;
+      metadata_pub.publish( meta_data_message_ );
+      if (publish_full_map_)
+        map_pub.publish(nav_msgs::OccupancyGridConstPtr(resp, &resp->map));
+      if (tile_size_ > 0)
+        publishTiles(tile_pub, resp->map);
+      for (unsigned int level = 0; level < pyramid_pubs_.size(); level++)
+        pyramid_pubs_[level].publish(it->second.pyramid[level]);
+      ROS_INFO("Switched to map \"%s\"", active_.c_str());
+      return true;
+    }
 
     /** Callback invoked when someone requests our service */
     bool mapCallback(nav_msgs::GetMap::Request  &req,
@@ -201,16 +352,99 @@ class MapServer
       // request is empty; we ignore it
 
       // = operator is overloaded to make deep copy (tricky!)
-      res = map_resp_;
+      res = *boost::atomic_load(&map_resp_);
       ROS_INFO("Sending map");
 
       return true;
     }
 
-    /** The map data is cached here, to be sent out to service callers
+    /** Callback invoked when someone requests a region of the map, x and
+     * y being its center and l_x and l_y its size, in meters, along the axes
+     * of the map.  The region is clipped to the map, and may come back empty;
+     * a negative size is refused. */
+    bool roiCallback(map_msgs::GetMapROI::Request  &req,
+                     map_msgs::GetMapROI::Response &res )
+    {
+      if (!(req.l_x >= 0 && req.l_y >= 0)) {
+        ROS_WARN("Refusing a region of the map of size %f X %f", req.l_x, req.l_y);
+        return false;
+      }
+      boost::shared_ptr<nav_msgs::GetMap::Response> resp = boost::atomic_load(&map_resp_);
+      const nav_msgs::MapMetaData& info = resp->map.info;
+      int x0 = cellIndex(req.x - req.l_x / 2, info.origin.position.x, info.width, info.resolution, false);
+      int y0 = cellIndex(req.y - req.l_y / 2, info.origin.position.y, info.height, info.resolution, false);
+      int xn = cellIndex(req.x + req.l_x / 2, info.origin.position.x, info.width, info.resolution, true);
+      int yn = cellIndex(req.y + req.l_y / 2, info.origin.position.y, info.height, info.resolution, true);
+
+      res.sub_map.header = resp->map.header;
+      res.sub_map.info = info;
+      res.sub_map.info.width = xn - x0;
+      res.sub_map.info.height = yn - y0;
+      res.sub_map.info.origin.position.x += x0 * info.resolution;
+      res.sub_map.info.origin.position.y += y0 * info.resolution;
+      copyRegion(resp->map, x0, y0, xn - x0, yn - y0, res.sub_map.data);
+      ROS_DEBUG("Sending a %d X %d region of the map", xn - x0, yn - y0);
+      return true;
+    }
+
+    /** Send the whole map to a new subscriber to the tiles, a tile at a time */
+    void tileSubscriberCallback(const ros::SingleSubscriberPublisher& pub)
+    {
+      boost::shared_ptr<nav_msgs::GetMap::Response> resp = boost::atomic_load(&map_resp_);
+      publishTiles(pub, resp->map);
+    }
+
+    /** The number of tiles publishTiles() sends for a map */
+    unsigned int tileCount(const nav_msgs::MapMetaData& info) const
+    {
+      return ((info.width + tile_size_ - 1) / tile_size_) * ((info.height + tile_size_ - 1) / tile_size_);
+    }
+
+    template <class Publisher>
+    void publishTiles(const Publisher& pub, const nav_msgs::OccupancyGrid& map)
+    {
+      const nav_msgs::MapMetaData& info = map.info;
+      map_msgs::OccupancyGridUpdate tile;
+      tile.header = map.header;
+      for (unsigned int y = 0; y < info.height; y += tile_size_) {
+        for (unsigned int x = 0; x < info.width; x += tile_size_) {
+          tile.x = x;
+          tile.y = y;
+          tile.width = std::min(info.width - x, (unsigned int)tile_size_);
+          tile.height = std::min(info.height - y, (unsigned int)tile_size_);
+          copyRegion(map, x, y, tile.width, tile.height, tile.data);
+          pub.publish(tile);
+        }
+      }
+    }
+
+    /** The cell, clamped to [0, size], that a coordinate falls into, or
+     * the one after it for the end of a region */
+    int cellIndex(double coordinate, double origin, unsigned int size, double resolution, bool end)
+    {
+      double cell = (coordinate - origin) / resolution;
+      cell = end ? ceil(cell) : floor(cell);
+      return std::max(0.0, std::min(cell, (double)size));
+    }
+
+    void copyRegion(const nav_msgs::OccupancyGrid& map, unsigned int x0, unsigned int y0,
+                    unsigned int width, unsigned int height, std::vector<int8_t>& data)
+    {
+      data.resize(width * height);
+      for (unsigned int y = 0; y < height; y++) {
+        const int8_t* row = &map.data[(size_t)(y0 + y) * map.info.width + x0];
+        std::copy(row, row + width, data.begin() + y * width);
+      }
+    }
+
+    /** The map data is cached here, to be sent out to service callers.
+     * The callbacks of a nodelet may run at once, so map_resp_ is read
+     * with atomic_load, and swapped by switchCallback() alone, under
+     * switch_mutex_
      */
     nav_msgs::MapMetaData meta_data_message_;
-    nav_msgs::GetMap::Response map_resp_;
+    boost::shared_ptr<nav_msgs::GetMap::Response> map_resp_;
+    boost::mutex switch_mutex_;
 
     /*
     void metadataSubscriptionCallback(const ros::SingleSubscriberPublisher& pub)
@@ -221,6 +455,34 @@ class MapServer
 
 };
 
+#ifdef MAP_SERVER_NODELET
+namespace map_server
+{
+
+/** The map server as a nodelet, given the same arguments as the node, so
+ * nodelets in the same manager, e.g. amcl, receive the map without a copy */
+class MapServerNodelet : public nodelet::Nodelet
+{
+  private:
+    virtual void onInit()
+    {
+      const std::vector<std::string>& argv = getMyArgv();
+      if (argv.size() != 1 && argv.size() != 2)
+      {
+        NODELET_ERROR("%s", USAGE);
+        return;
+      }
+      double res = (argv.size() == 1) ? 0.0 : atof(argv[1].c_str());
+      server_.reset(new MapServer(argv[0], res, getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    boost::shared_ptr<MapServer> server_;
+};
+
+}  // namespace map_server
+
+PLUGINLIB_EXPORT_CLASS(map_server::MapServerNodelet, nodelet::Nodelet)
+#else
 int main(int argc, char **argv)
 {
   ros::init(argc, argv, "map_server", ros::init_options::AnonymousName);
@@ -248,4 +510,4 @@ int main(int argc, char **argv)
 
   return 0;
 }
-
+#endif
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2008, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Binary map files, which load at the speed of a copy, and writing maps
+ * out as images.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <nav_executor/executor.h>
+
+#include "map_server/map_file.h"
+
+namespace map_server
+{
+
+// File layout, in the byte order of the machine that wrote it:
+//   header: magic, version, width, height, flags, 0 (uint32),
+//           resolution, origin position x, y and z, origin orientation
+//           x, y, z and w (double), data length in bytes (uint64)
+//   data:   from DATA_OFFSET on, the occupancy as in OccupancyGrid::data,
+//           or with FLAG_RUN_LENGTH as (length - 1, value) byte pairs
+static const uint32_t MAGIC = 0x50414d52;  // "RMAP"
+static const uint32_t VERSION = 1;
+static const uint32_t FLAG_RUN_LENGTH = 1;
+static const size_t DATA_OFFSET = 4096;
+
+struct Header
+{
+  uint32_t magic, version, width, height, flags, reserved;
+  double resolution;
+  double position[3];
+  double orientation[4];
+  uint64_t length;
+};
+
+bool
+saveMapToBinaryFile(const nav_msgs::OccupancyGrid& map, const char* fname,
+                    bool run_length)
+{
+  const nav_msgs::MapMetaData& info = map.info;
+  if (map.data.size() != (size_t)info.width * info.height)
+    return false;
+
+  std::vector<unsigned char> runs;
+  if (run_length)
+  {
+    unsigned int length = 0;
+    int8_t value = 0;
+    for (size_t i = 0; i < map.data.size(); i++)
+    {
+      if (length > 0 && (map.data[i] != value || length == 256))
+      {
+        runs.push_back(length - 1);
+        runs.push_back(value);
+        length = 0;
+      }
+      value = map.data[i];
+      length++;
+    }
+    if (length > 0)
+    {
+      runs.push_back(length - 1);
+      runs.push_back(value);
+    }
+  }
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.width = info.width;
+  header.height = info.height;
+  header.flags = run_length ? FLAG_RUN_LENGTH : 0;
+  header.resolution = info.resolution;
+  header.position[0] = info.origin.position.x;
+  header.position[1] = info.origin.position.y;
+  header.position[2] = info.origin.position.z;
+  header.orientation[0] = info.origin.orientation.x;
+  header.orientation[1] = info.origin.orientation.y;
+  header.orientation[2] = info.origin.orientation.z;
+  header.orientation[3] = info.origin.orientation.w;
+  header.length = run_length ? runs.size() : map.data.size();
+
+  // write to a temporary name and rename it into place, so that a reader
+  // never sees a partial file
+  char pid[32];
+  snprintf(pid, sizeof(pid), ".%d.tmp", int(getpid()));
+  std::string tmp_name = std::string(fname) + pid;
+  FILE* fp = fopen(tmp_name.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  std::vector<char> header_block(DATA_OFFSET, 0);
+  memcpy(&header_block[0], &header, sizeof(header));
+  const void* data = run_length ? (const void*)&runs[0] : (const void*)&map.data[0];
+  bool ok = fwrite(&header_block[0], DATA_OFFSET, 1, fp) == 1 &&
+            (header.length == 0 || fwrite(data, header.length, 1, fp) == 1);
+  if (fclose(fp) != 0)
+    ok = false;
+  if (ok)
+    ok = rename(tmp_name.c_str(), fname) == 0;
+  if (!ok)
+    unlink(tmp_name.c_str());
+  return ok;
+}
+
+void
+loadMapFromBinaryFile(nav_msgs::GetMap::Response* resp, const char* fname)
+{
+  std::string errmsg = std::string("failed to read binary map file \"") +
+          std::string(fname) + std::string("\"");
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(errmsg);
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < DATA_OFFSET)
+  {
+    close(fd);
+    throw std::runtime_error(errmsg);
+  }
+  size_t size = st.st_size;
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    throw std::runtime_error(errmsg);
+
+  // the size in the header is only trusted as far as the data in the file
+  // can fill it, so a corrupt one cannot ask for more than 128 cells a byte
+  Header header;
+  memcpy(&header, mapped, sizeof(header));
+  uint64_t cells = (uint64_t)header.width * header.height;
+  bool ok = header.magic == MAGIC && header.version == VERSION &&
+            header.length <= size - DATA_OFFSET &&
+            (header.flags & FLAG_RUN_LENGTH ? cells <= header.length / 2 * 256 : header.length == cells);
+  if (ok)
+  {
+    resp->map.info.width = header.width;
+    resp->map.info.height = header.height;
+    resp->map.info.resolution = header.resolution;
+    resp->map.info.origin.position.x = header.position[0];
+    resp->map.info.origin.position.y = header.position[1];
+    resp->map.info.origin.position.z = header.position[2];
+    resp->map.info.origin.orientation.x = header.orientation[0];
+    resp->map.info.origin.orientation.y = header.orientation[1];
+    resp->map.info.origin.orientation.z = header.orientation[2];
+    resp->map.info.origin.orientation.w = header.orientation[3];
+    resp->map.data.resize(cells);
+
+    const unsigned char* data = (const unsigned char*)mapped + DATA_OFFSET;
+    if (!(header.flags & FLAG_RUN_LENGTH))
+    {
+      madvise(mapped, size, MADV_SEQUENTIAL);
+      if (cells > 0)
+        memcpy(&resp->map.data[0], data, cells);
+    }
+    else
+    {
+      // the runs have to fill the map exactly
+      size_t i = 0;
+      for (size_t r = 0; ok && r + 1 < header.length; r += 2)
+      {
+        size_t length = data[r] + 1;
+        ok = i + length <= cells;
+        if (ok)
+          memset(&resp->map.data[i], (int8_t)data[r + 1], length);
+        i += length;
+      }
+      ok = ok && i == cells;
+    }
+  }
+  munmap(mapped, size);
+  if (!ok)
+    throw std::runtime_error(errmsg);
+}
+
+// Convert rows [y0, y1) of the map, counted from the top of the image, into
+// the buffer, which holds the image from row y_begin
+static void
+convertRowsToPGM(const nav_msgs::OccupancyGrid* map, const unsigned char* table,
+                 unsigned char* buffer, unsigned int y_begin, unsigned int y0,
+                 unsigned int y1)
+{
+  unsigned int width = map->info.width, height = map->info.height;
+  for (unsigned int y = y0; y < y1; y++)
+  {
+    const int8_t* in = &map->data[(size_t)(height - y - 1) * width];
+    unsigned char* out = buffer + (size_t)(y - y_begin) * width;
+    for (unsigned int x = 0; x < width; x++)
+      out[x] = table[(unsigned char)in[x]];
+  }
+}
+
+// Convert band t of bands equal bands of the rows rows from y0
+static void
+convertBandToPGM(const nav_msgs::OccupancyGrid* map, const unsigned char* table,
+                 unsigned char* buffer, unsigned int y0, unsigned int rows,
+                 unsigned int bands, unsigned int t)
+{
+  convertRowsToPGM(map, table, buffer, y0, y0 + rows * t / bands, y0 + rows * (t + 1) / bands);
+}
+
+bool
+saveMapToPGMFile(const nav_msgs::OccupancyGrid& map, const char* fname)
+{
+  const nav_msgs::MapMetaData& info = map.info;
+  if (map.data.size() != (size_t)info.width * info.height)
+    return false;
+  FILE* fp = fopen(fname, "wb");
+  if (!fp)
+    return false;
+
+  unsigned char table[256];
+  memset(table, 205, sizeof(table));  // occ [0.1,0.65]
+  table[0] = 254;                     // occ [0,0.1)
+  table[100] = 0;                     // occ (0.65,1]
+
+  bool ok = fprintf(fp, "P5\n# CREATOR: Map_generator.cpp %.3f m/pix\n%d %d\n255\n",
+                    info.resolution, info.width, info.height) > 0;
+
+  // a block of about 4MB at a time, so the buffer stays small for any map
+  unsigned int block_rows = std::max(1u, (4u << 20) / std::max(1u, info.width));
+  std::vector<unsigned char> buffer((size_t)std::min(block_rows, info.height) * info.width);
+  nav_executor::Executor& executor = nav_executor::Executor::shared();
+  for (unsigned int y = 0; ok && y < info.height && info.width > 0; y += block_rows)
+  {
+    unsigned int rows = std::min(block_rows, info.height - y);
+    unsigned int bands = std::max(1u, std::min(executor.size(), rows / 64));
+    executor.run(nav_executor::LANE_GLOBAL_PLANNING, bands,
+                 boost::bind(&convertBandToPGM, &map, table, &buffer[0], y, rows, bands, _1));
+    ok = fwrite(&buffer[0], (size_t)rows * info.width, 1, fp) == 1;
+  }
+  if (fclose(fp) != 0)
+    ok = false;
+  return ok;
+}
+
+bool
+isBinaryMapFile(const char* fname)
+{
+  FILE* fp = fopen(fname, "rb");
+  if (!fp)
+    return false;
+  uint32_t magic = 0;
+  bool binary = fread(&magic, sizeof(magic), 1, fp) == 1 && magic == MAGIC;
+  fclose(fp);
+  return binary;
+}
+
+}
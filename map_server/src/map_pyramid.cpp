@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2008, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Coarser copies of a map, for consumers that don't need its full resolution.
+ */
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <nav_executor/executor.h>
+
+#include "map_server/map_pyramid.h"
+
+namespace map_server
+{
+
+// Reduce rows [y0, y1) of the coarse map
+static void
+downsampleRows(const nav_msgs::OccupancyGrid* map, nav_msgs::OccupancyGrid* coarse,
+               unsigned int y0, unsigned int y1)
+{
+  unsigned int width = map->info.width, height = map->info.height;
+  unsigned int coarse_width = coarse->info.width;
+  for (unsigned int y = y0; y < y1; y++)
+  {
+    for (unsigned int x = 0; x < coarse_width; x++)
+    {
+      int8_t highest = 0;
+      bool unknown = false;
+      for (unsigned int j = 2 * y; j < std::min(2 * y + 2, height); j++)
+      {
+        for (unsigned int i = 2 * x; i < std::min(2 * x + 2, width); i++)
+        {
+          int8_t value = map->data[(size_t)j * width + i];
+          if (value < 0)
+            unknown = true;
+          else
+            highest = std::max(highest, value);
+        }
+      }
+      coarse->data[(size_t)y * coarse_width + x] = (unknown && highest < 100) ? -1 : highest;
+    }
+  }
+}
+
+// Reduce band t of bands equal bands of the rows of the coarse map
+static void
+downsampleBand(const nav_msgs::OccupancyGrid* map, nav_msgs::OccupancyGrid* coarse,
+               unsigned int bands, unsigned int t)
+{
+  unsigned int height = coarse->info.height;
+  downsampleRows(map, coarse, height * t / bands, height * (t + 1) / bands);
+}
+
+void
+downsampleMap(const nav_msgs::OccupancyGrid& map, nav_msgs::OccupancyGrid& coarse)
+{
+  coarse.header = map.header;
+  coarse.info = map.info;
+  coarse.info.resolution = map.info.resolution * 2;
+  coarse.info.width = (map.info.width + 1) / 2;
+  coarse.info.height = (map.info.height + 1) / 2;
+  coarse.data.resize((size_t)coarse.info.width * coarse.info.height);
+
+  unsigned int height = coarse.info.height;
+  nav_executor::Executor& executor = nav_executor::Executor::shared();
+  unsigned int bands = std::max(1u, std::min(executor.size(), height / 64));
+  executor.run(nav_executor::LANE_GLOBAL_PLANNING, bands,
+               boost::bind(&downsampleBand, &map, &coarse, bands, _1));
+}
+
+}
@@ -32,6 +32,7 @@
 #include "ros/ros.h"
 #include "ros/console.h"
 #include "nav_msgs/GetMap.h"
+#include "map_server/map_file.h"
 #include "tf/LinearMath/Matrix3x3.h"
 #include "geometry_msgs/Quaternion.h"
 
@@ -44,7 +45,7 @@ class MapGenerator
 {
 
   public:
-    MapGenerator(const std::string& mapname) : mapname_(mapname), saved_map_(false)
+    MapGenerator(const std::string& mapname, int binary) : mapname_(mapname), binary_(binary), saved_map_(false)
     {
       ros::NodeHandle n;
       ROS_INFO("Waiting for the map");
@@ -58,33 +59,29 @@ class MapGenerator
                map->info.height,
                map->info.resolution);
 
+      // the binary map keeps the occupancy as it is, and needs no YAML
+      if (binary_)
+      {
+        std::string mapfile = mapname_ + ".rmap";
+        ROS_INFO("Writing binary map to %s", mapfile.c_str());
+        if (!map_server::saveMapToBinaryFile(*map, mapfile.c_str(), binary_ > 1))
+        {
+          ROS_ERROR("Couldn't save map file to %s", mapfile.c_str());
+          return;
+        }
+        ROS_INFO("Done\n");
+        saved_map_ = true;
+        return;
+      }
 
       std::string mapdatafile = mapname_ + ".pgm";
       ROS_INFO("Writing map occupancy data to %s", mapdatafile.c_str());
-      FILE* out = fopen(mapdatafile.c_str(), "w");
-      if (!out)
+      if (!map_server::saveMapToPGMFile(*map, mapdatafile.c_str()))
       {
         ROS_ERROR("Couldn't save map file to %s", mapdatafile.c_str());
         return;
       }
 
-      fprintf(out, "P5\n# CREATOR: Map_generator.cpp %.3f m/pix\n%d %d\n255\n",
-              map->info.resolution, map->info.width, map->info.height);
-      for(unsigned int y = 0; y < map->info.height; y++) {
-        for(unsigned int x = 0; x < map->info.width; x++) {
-          unsigned int i = x + (map->info.height - y - 1) * map->info.width;
-          if (map->data[i] == 0) { //occ [0,0.1)
-            fputc(254, out);
-          } else if (map->data[i] == +100) { //occ (0.65,1]
-            fputc(000, out);
-          } else { //occ [0.1,0.65]
-            fputc(205, out);
-          }
-        }
-      }
-
-      fclose(out);
-
 
       std::string mapmetadatafile = mapname_ + ".yaml";
       ROS_INFO("Writing map occupancy data to %s", mapmetadatafile.c_str());
@@ -116,6 +113,7 @@ free_thresh: 0.196
     }
 
     std::string mapname_;
+    int binary_;  // 1 for a binary map, 2 for a run length coded one
     ros::Subscriber map_sub_;
     bool saved_map_;
 
@@ -123,12 +121,15 @@ free_thresh: 0.196
 
 #define USAGE "Usage: \n" \
               "  map_saver -h\n"\
-              "  map_saver [-f <mapname>] [ROS remapping args]"
+              "  map_saver [-f <mapname>] [-b|-B] [ROS remapping args]\n"\
+              "  -b: save a binary map, <mapname>.rmap, rather than an image and YAML\n"\
+              "  -B: save a run length coded binary map"
 
 int main(int argc, char** argv)
 {
   ros::init(argc, argv, "map_saver");
   std::string mapname = "map";
+  int binary = 0;
 
   for(int i=1; i<argc; i++)
   {
@@ -137,6 +138,10 @@ int main(int argc, char** argv)
       puts(USAGE);
       return 0;
     }
+    else if(!strcmp(argv[i], "-b"))
+      binary = 1;
+    else if(!strcmp(argv[i], "-B"))
+      binary = 2;
     else if(!strcmp(argv[i], "-f"))
     {
       if(++i < argc)
@@ -154,7 +159,7 @@ int main(int argc, char** argv)
     }
   }
 
-  MapGenerator mg(mapname);
+  MapGenerator mg(mapname, binary);
 
   while(!mg.saved_map_ && ros::ok())
     ros::spinOnce();
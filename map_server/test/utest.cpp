@@ -29,9 +29,14 @@
 
 /* Author: Brian Gerkey */
 
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
 #include <stdexcept> // for std::runtime_error
 #include <gtest/gtest.h>
 #include "map_server/image_loader.h"
+#include "map_server/map_file.h"
+#include "map_server/map_pyramid.h"
 #include "test_constants.h"
 
 /* Try to load a valid PNG file.  Succeeds if no exception is thrown, and if
@@ -79,6 +84,179 @@ TEST(MapServer, loadValidBMP)
   }
 }
 
+/* Load a PGM of every gray level, which is read without SDL, in each mode.
+ * Succeeds if every cell matches the value worked out a pixel at a time. */
+TEST(MapServer, loadPGMEveryLevel)
+{
+  const char* fname = "/tmp/map_server_utest.pgm";
+  const unsigned int width = 256, height = 3;
+  FILE* f = fopen(fname, "wb");
+  ASSERT_TRUE(f != NULL);
+  fprintf(f, "P5\n# every gray level\n%u %u\n255\n", width, height);
+  for(unsigned int j=0; j < height; j++)
+    for(unsigned int i=0; i < width; i++)
+      fputc((i + 85 * j) % 256, f);
+  fclose(f);
+
+  double origin[3] = { 0.0, 0.0, 0.0 };
+  const double occ_th = 0.65, free_th = 0.196;
+  MapMode modes[3] = { TRINARY, SCALE, RAW };
+  for(int m=0; m < 3; m++)
+  {
+    for(int negate=0; negate < 2; negate++)
+    {
+      nav_msgs::GetMap::Response map_resp;
+      map_server::loadMapFromFile(&map_resp, fname, 0.1, negate, occ_th, free_th, origin, modes[m]);
+      ASSERT_EQ(width, map_resp.map.info.width);
+      ASSERT_EQ(height, map_resp.map.info.height);
+      for(unsigned int j=0; j < height; j++)
+      {
+        for(unsigned int i=0; i < width; i++)
+        {
+          double color_avg = (i + 85 * j) % 256;
+          if(negate)
+            color_avg = 255 - color_avg;
+          double occ = (255 - color_avg) / 255.0;
+          unsigned char value;
+          if(modes[m] == RAW)
+            value = color_avg;
+          else if(occ > occ_th)
+            value = +100;
+          else if(occ < free_th)
+            value = 0;
+          else if(modes[m] == TRINARY)
+            value = -1;
+          else
+          {
+            double ratio = (occ - free_th) / (occ_th - free_th);
+            value = 99 * ratio;
+          }
+          EXPECT_EQ((int8_t)value, map_resp.map.data[(height - j - 1) * width + i]);
+        }
+      }
+    }
+  }
+  remove(fname);
+}
+
+/* Save a map as a binary map file, plain and run length coded, and load it
+ * back.  Succeeds if the map comes back as it was, and a truncated file or
+ * one with a corrupt size throws a std::runtime_error. */
+TEST(MapServer, binaryMapRoundTrip)
+{
+  const char* fname = "/tmp/map_server_utest.rmap";
+  nav_msgs::OccupancyGrid map;
+  map.info.width = 300;
+  map.info.height = 7;
+  map.info.resolution = 0.05;
+  map.info.origin.position.x = -12.5;
+  map.info.origin.position.y = 3.25;
+  map.info.origin.orientation.z = 0.6;
+  map.info.origin.orientation.w = 0.8;
+  for(unsigned int i=0; i < map.info.width * map.info.height; i++)
+    map.data.push_back(i % 700 < 400 ? -1 : (i * 7) % 101);
+
+  for(int run_length=0; run_length < 2; run_length++)
+  {
+    ASSERT_TRUE(map_server::saveMapToBinaryFile(map, fname, run_length));
+    ASSERT_TRUE(map_server::isBinaryMapFile(fname));
+    nav_msgs::GetMap::Response map_resp;
+    map_server::loadMapFromBinaryFile(&map_resp, fname);
+    EXPECT_EQ(map.info.width, map_resp.map.info.width);
+    EXPECT_EQ(map.info.height, map_resp.map.info.height);
+    EXPECT_EQ(map.info.resolution, map_resp.map.info.resolution);
+    EXPECT_EQ(map.info.origin.position.x, map_resp.map.info.origin.position.x);
+    EXPECT_EQ(map.info.origin.position.y, map_resp.map.info.origin.position.y);
+    EXPECT_EQ(map.info.origin.orientation.z, map_resp.map.info.origin.orientation.z);
+    EXPECT_EQ(map.info.origin.orientation.w, map_resp.map.info.origin.orientation.w);
+    EXPECT_TRUE(map.data == map_resp.map.data);
+  }
+
+  ASSERT_EQ(0, truncate(fname, 5000));
+  nav_msgs::GetMap::Response map_resp;
+  EXPECT_THROW(map_server::loadMapFromBinaryFile(&map_resp, fname), std::runtime_error);
+
+  // a run length coded file whose header claims far more cells than its
+  // runs can hold is rejected before anything is allocated for them
+  ASSERT_TRUE(map_server::saveMapToBinaryFile(map, fname, true));
+  FILE* fp = fopen(fname, "r+b");
+  ASSERT_TRUE(fp != NULL);
+  uint32_t size[2] = {0xffffffffu, 0xffffffffu};
+  ASSERT_EQ(0, fseek(fp, 8, SEEK_SET));
+  ASSERT_EQ(1u, fwrite(size, sizeof(size), 1, fp));
+  fclose(fp);
+  EXPECT_THROW(map_server::loadMapFromBinaryFile(&map_resp, fname), std::runtime_error);
+  remove(fname);
+  EXPECT_FALSE(map_server::isBinaryMapFile(fname));
+}
+
+/* Save a map as a PGM and load it back in trinary mode.  Succeeds if free
+ * and occupied cells come back as they were, and every other cell as
+ * unknown. */
+TEST(MapServer, savePGMRoundTrip)
+{
+  const char* fname = "/tmp/map_server_utest_saved.pgm";
+  nav_msgs::OccupancyGrid map;
+  map.info.width = 517;
+  map.info.height = 301;
+  map.info.resolution = 0.05;
+  for(unsigned int i=0; i < map.info.width * map.info.height; i++)
+    map.data.push_back(i % 5 == 0 ? -1 : (i * 7) % 3 == 0 ? 100 : (i * 11) % 4 == 0 ? 0 : i % 99);
+
+  ASSERT_TRUE(map_server::saveMapToPGMFile(map, fname));
+  nav_msgs::GetMap::Response map_resp;
+  double origin[3] = { 0.0, 0.0, 0.0 };
+  map_server::loadMapFromFile(&map_resp, fname, 0.05, false, 0.65, 0.196, origin, TRINARY);
+  remove(fname);
+  ASSERT_EQ(map.info.width, map_resp.map.info.width);
+  ASSERT_EQ(map.info.height, map_resp.map.info.height);
+  for(unsigned int i=0; i < map.info.width * map.info.height; i++)
+  {
+    int expected = map.data[i] == 0 || map.data[i] == 100 ? map.data[i] : -1;
+    EXPECT_EQ(expected, map_resp.map.data[i]) << "cell " << i;
+  }
+}
+
+/* Halve a map with odd dimensions.  Succeeds if each coarse cell is
+ * occupied wherever one of its cells is, else unknown wherever one is, else
+ * the highest of its cells. */
+TEST(MapServer, downsampleMap)
+{
+  nav_msgs::OccupancyGrid map;
+  map.info.width = 301;
+  map.info.height = 257;
+  map.info.resolution = 0.05;
+  map.info.origin.position.x = -2.0;
+  for(unsigned int i=0; i < map.info.width * map.info.height; i++)
+    map.data.push_back(i % 13 == 0 ? -1 : (i * 7) % 101);
+
+  nav_msgs::OccupancyGrid coarse;
+  map_server::downsampleMap(map, coarse);
+  ASSERT_EQ(151u, coarse.info.width);
+  ASSERT_EQ(129u, coarse.info.height);
+  EXPECT_FLOAT_EQ(0.1, coarse.info.resolution);
+  EXPECT_EQ(-2.0, coarse.info.origin.position.x);
+  ASSERT_EQ(151u * 129u, coarse.data.size());
+  for(unsigned int y=0; y < coarse.info.height; y++)
+  {
+    for(unsigned int x=0; x < coarse.info.width; x++)
+    {
+      int highest = 0;
+      bool unknown = false;
+      for(unsigned int j=2*y; j < 2*y+2 && j < map.info.height; j++)
+      {
+        for(unsigned int i=2*x; i < 2*x+2 && i < map.info.width; i++)
+        {
+          int value = map.data[j * map.info.width + i];
+          unknown |= value < 0;
+          highest = std::max(highest, value);
+        }
+      }
+      EXPECT_EQ(unknown && highest < 100 ? -1 : highest, coarse.data[y * coarse.info.width + x]);
+    }
+  }
+}
+
 /* Try to load an invalid file.  Succeeds if a std::runtime_error exception
  * is thrown. */
 TEST(MapServer, loadInvalidFile)
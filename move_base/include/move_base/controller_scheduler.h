@@ -0,0 +1,163 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#ifndef MOVE_BASE_CONTROLLER_SCHEDULER_H_
+#define MOVE_BASE_CONTROLLER_SCHEDULER_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace move_base {
+  /**
+   * @class ControllerScheduler
+   * @brief Paces the control loop against absolute deadlines, and keeps histograms of how long its cycles and
+   * their stages took and how late they started. A cycle that overruns its deadline moves the following ones
+   * back rather than having them run back to back to catch up.
+   */
+  class ControllerScheduler {
+    public:
+      /** @brief The stages of a control cycle that are timed on their own */
+      enum Stage { COSTMAP_WAIT, TF_LOOKUP, CONTROLLER, NUM_STAGES };
+
+      /** @brief The series there are histograms of: the cycle time, the start jitter, then each stage */
+      enum Series { CYCLE_TIME, JITTER, STAGE_TIMES };
+
+      /**
+       * @brief  Times one stage of the current cycle until it goes out of scope
+       */
+      class StageTimer {
+        public:
+          StageTimer(ControllerScheduler* scheduler, Stage stage)
+            : scheduler_(scheduler), stage_(stage), start_(monotonicNow()) {}
+          ~StageTimer() {
+            scheduler_->addStageTime(stage_, monotonicNow() - start_);
+          }
+        private:
+          ControllerScheduler* scheduler_;
+          Stage stage_;
+          double start_;
+      };
+
+      /**
+       * @param  window The number of cycles the histograms cover, and are logged after
+       */
+      ControllerScheduler(unsigned int window = 200);
+
+      /**
+       * @brief  Sets the rate of the loop, which takes effect from the next deadline on
+       */
+      void setFrequency(double frequency);
+
+      /**
+       * @brief  Whether to pace the loop on the monotonic clock, rather than on ROS time, which follows
+       * the simulator's clock
+       */
+      void setMonotonic(bool monotonic) { monotonic_ = monotonic; }
+
+      /**
+       * @brief  Starts the loop, with the first cycle due now
+       */
+      void start();
+
+      /**
+       * @brief  Marks the start of a cycle, and how late it started
+       */
+      void startCycle();
+
+      void addStageTime(Stage stage, double seconds);
+
+      /**
+       * @brief  Ends the cycle, and sleeps until the next one is due
+       * @return False if the cycle overran its deadline, in which case the next one starts right away
+       */
+      bool sleep();
+
+      /**
+       * @brief  The time the current cycle has left until a fraction of the period after it was due, negative once past
+       */
+      double timeLeft(double fraction) const;
+
+      /** @brief The length of the last cycle, without the sleep */
+      double lastCycleTime() const { return last_cycle_time_; }
+
+      /** @brief The number of cycles in a row that have overrun their deadlines */
+      unsigned int missedCycles() const { return missed_; }
+
+      /**
+       * @brief  Counts the samples of a series in the window that fall into each bin
+       * @param  series CYCLE_TIME, JITTER, or STAGE_TIMES plus a stage
+       * @param  histogram Filled with a count per bin, the last of which has no upper edge
+       */
+      void getHistogram(unsigned int series, std::vector<uint32_t>& histogram) const;
+
+      /** @brief The upper edges in seconds of the histogram bins */
+      const std::vector<double>& getBinEdges() const { return bin_edges_; }
+
+      /**
+       * @brief  Gives the calling thread a SCHED_FIFO priority, and pins it to some CPUs
+       * @param  priority The real-time priority, or zero to leave the scheduling policy as it is
+       * @param  cpus The CPUs to run on, or none to leave the affinity as it is
+       * @return False if either could not be set, which usually takes CAP_SYS_NICE or an rtprio limit
+       */
+      static bool setRealtime(int priority, const std::vector<int>& cpus);
+
+      static double monotonicNow();
+
+    private:
+      double now() const;
+
+      /** @brief Log the histograms of the window, at debug level */
+      void logHistograms() const;
+
+      bool monotonic_;
+      double period_;
+      double due_; ///< @brief When the current cycle was due to start, on the clock the loop is paced on
+      double late_by_; ///< @brief How far past its deadline the last cycle overran, which the next started late by
+      double cycle_start_; ///< @brief On the monotonic clock, which the cycle and its stages are always timed on
+      double jitter_; ///< @brief How late the current cycle started
+      double last_cycle_time_;
+      unsigned int missed_;
+
+      std::vector<double> bin_edges_;
+      unsigned int window_;
+      /** Ring buffers of window_ samples of each series */
+      std::vector<std::vector<double> > samples_;
+      std::vector<double> stage_times_; ///< @brief The times of the stages in the current cycle
+      unsigned int next_sample_;
+      unsigned int sample_count_;
+  };
+};
+#endif
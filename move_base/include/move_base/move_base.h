@@ -39,19 +39,29 @@
 
 #include <vector>
 #include <string>
+#include <deque>
 
 #include <ros/ros.h>
 
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
 #include <actionlib/server/simple_action_server.h>
 #include <move_base_msgs/MoveBaseAction.h>
 
 #include <nav_core/base_local_planner.h>
 #include <nav_core/base_global_planner.h>
 #include <nav_core/recovery_behavior.h>
+#include <move_base/planner_portfolio.h>
+#include <move_base/controller_scheduler.h>
+#include <move_base/replan_trigger.h>
+#include <nav_executor/lockstep.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <costmap_2d/costmap_2d_ros.h>
 #include <costmap_2d/costmap_2d.h>
 #include <nav_msgs/GetPlan.h>
+#include <nav_msgs/Path.h>
 
 #include <pluginlib/class_loader.h>
 #include <std_srvs/Empty.h>
@@ -76,6 +86,13 @@ namespace move_base {
     OSCILLATION_R
   };
 
+  enum DeadlinePolicy
+  {
+    DEADLINE_IGNORE,  ///< compute a command every cycle, however late
+    DEADLINE_HOLD,    ///< after a cycle that overran, republish the last command instead of computing one
+    DEADLINE_DEGRADE  ///< after a cycle that overran, publish the last command scaled down instead
+  };
+
   /**
    * @class MoveBase
    * @brief A class that uses the actionlib::ActionServer interface that moves the robot base to a goal location.
@@ -127,6 +144,16 @@ namespace move_base {
        */
       bool makePlan(const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan);
 
+      /**
+       * @brief  Make a new global plan from a given start, rather than from the robot
+       * @param  start The pose to plan from
+       * @param  goal The goal to plan to
+       * @param  plan Will be filled in with the plan made by the planner
+       * @return  True if planning succeeds, false otherwise
+       */
+      bool makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+          std::vector<geometry_msgs::PoseStamped>& plan);
+
       /**
        * @brief  Load the recovery behaviors for the navigation stack from the parameter server
        * @param node The ros::NodeHandle to be used for loading parameters 
@@ -139,6 +166,32 @@ namespace move_base {
        */
       void loadDefaultRecoveryBehaviors();
 
+      /**
+       * @brief  Loads the recovery behaviors from the parameter server, or the defaults, unless they are already loaded
+       */
+      void loadRecoveryBehaviorsOnce();
+
+      /**
+       * @brief  How long each part of the startup took, in wall seconds
+       */
+      struct StartupTimes {
+        double global_costmap, global_planner, local_costmap, local_planner, recovery_behaviors;
+      };
+
+      /**
+       * @brief  Creates the planner costmap, paused, and the global planner on it, and the planner portfolio if set
+       * @param global_planner The name of the global planner plugin
+       * @param times Set to how long the costmap and the planners took
+       */
+      void setupGlobalPlanning(const std::string& global_planner, StartupTimes* times);
+
+      /**
+       * @brief  Creates the controller costmap, paused, and the local planner on it
+       * @param local_planner The name of the local planner plugin
+       * @param times Set to how long the costmap and the planner took
+       */
+      void setupLocalPlanning(const std::string& local_planner, StartupTimes* times);
+
       /**
        * @brief  Clears obstacles within a window around the robot
        * @param size_x The x size of the window
@@ -158,6 +211,19 @@ namespace move_base {
 
       void goalCB(const geometry_msgs::PoseStamped::ConstPtr& goal);
 
+      /**
+       * @brief  Replaces the waypoints queued after the current goal, an empty path clears them; a goal that preempts the current one drops them too
+       */
+      void waypointsCB(const nav_msgs::Path::ConstPtr& waypoints);
+
+      /**
+       * @brief  Makes the next queued waypoint the goal, handing the controller the plan made ahead to it if there is one
+       * @param  goal Set to the new goal
+       * @param  need_plan Only go on if the plan to the next waypoint is ready
+       * @return True if there was a waypoint to go on to, false otherwise
+       */
+      bool advanceWaypoint(geometry_msgs::PoseStamped& goal, bool need_plan);
+
       void planThread();
 
       void executeCb(const move_base_msgs::MoveBaseGoalConstPtr& move_base_goal);
@@ -173,6 +239,34 @@ namespace move_base {
        */
       void wakePlanner(const ros::TimerEvent& event);
 
+      /**
+       * @brief  Run after each update of the planner costmap, under its lock, if replan_on_change is set: wakes the
+       * planner when the update changed cells near the plan being followed and the plan got blocked or costlier
+       */
+      void plannerCostmapUpdated(costmap_2d::LayeredCostmap& layered_costmap);
+
+      /**
+       * @brief  Initializes planner_ on planner_snapshot_ if plan_on_costmap_snapshot is set and the planner
+       * supports it, and on the planner costmap otherwise
+       */
+      void initializePlanner(const std::string& name);
+
+      /**
+       * @brief  Brings planner_snapshot_ up to date with the planner costmap, under the costmap's lock, once no plan
+       * is reading it
+       */
+      void updatePlannerSnapshot();
+
+      /**
+       * @brief  Stops the recovery behavior running without blocking, if there is one, and the robot with it
+       */
+      void cancelRecovery();
+
+      /**
+       * @brief  Slows the costmap updates down to the idle rates while there is no goal, and back up to full rate
+       */
+      void setCostmapsIdle(bool idle);
+
       tf::TransformListener& tf_;
 
       MoveBaseActionServer* as_;
@@ -181,22 +275,46 @@ namespace move_base {
       costmap_2d::Costmap2DROS* planner_costmap_ros_, *controller_costmap_ros_;
 
       boost::shared_ptr<nav_core::BaseGlobalPlanner> planner_;
+      bool plan_on_costmap_snapshot_, planner_on_snapshot_;
+      costmap_2d::Costmap2D planner_snapshot_; ///< @brief The copy of the planner costmap the planner reads, if planner_on_snapshot_
+      unsigned long planner_snapshot_version_;
+      boost::shared_mutex planner_snapshot_mutex_; ///< @brief Shared by the plans on planner_snapshot_, owned while it is updated
+      PlannerPortfolio* portfolio_; ///< @brief Plans in place of planner_ in the plan thread, if planner_portfolio is set
       std::string robot_base_frame_, global_frame_;
 
       std::vector<boost::shared_ptr<nav_core::RecoveryBehavior> > recovery_behaviors_;
       unsigned int recovery_index_;
+      bool asynchronous_recovery_;
+      bool lazy_recovery_behaviors_; ///< @brief Whether the recovery behaviors are loaded when first needed rather than at startup
+      bool recovery_behaviors_loaded_;
+      boost::shared_ptr<nav_core::RecoveryBehavior> running_recovery_; ///< @brief The recovery behavior being ticked by executeCycle, if any
 
       tf::Stamped<tf::Pose> global_pose_;
       double planner_frequency_, controller_frequency_, inscribed_radius_, circumscribed_radius_;
-      double planner_patience_, controller_patience_;
+      double planner_patience_, controller_patience_, planner_deadline_;
+      double controller_time_budget_; ///< @brief The fraction of the control period the local planner may take, 0 for no limit
       double conservative_reset_dist_, clearing_radius_;
+      double idle_planner_costmap_frequency_, idle_controller_costmap_frequency_;
       ros::Publisher current_goal_pub_, vel_pub_, action_goal_pub_;
-      ros::Subscriber goal_sub_;
+      ros::Subscriber goal_sub_, waypoints_sub_;
       ros::ServiceServer make_plan_srv_, clear_costmaps_srv_;
       bool shutdown_costmaps_, clearing_rotation_allowed_, recovery_behavior_enabled_;
       double oscillation_timeout_, oscillation_distance_;
 
-      MoveBaseState state_;
+      ControllerScheduler scheduler_; ///< @brief Paces the control loop, and keeps the histograms of its cycle times
+      bool controller_monotonic_clock_, controller_thread_setup_;
+      boost::scoped_ptr<nav_executor::Lockstep::Loop> controller_lockstep_loop_; ///< @brief The control loop's part in the lockstep, kept from goal to goal
+      int controller_priority_;
+      std::vector<int> controller_cpus_;
+      DeadlinePolicy deadline_policy_;
+      double degraded_scale_;
+      bool controller_overran_; ///< @brief Whether the last control cycle overran its deadline
+      bool have_last_cmd_vel_;
+      geometry_msgs::Twist last_cmd_vel_; ///< @brief The last command computed by the local planner, since the last stop
+      bool trace_latency_; ///< @brief Whether to publish how old the sensor data behind each velocity command is
+      ros::Publisher latency_pub_;
+
+      boost::atomic<MoveBaseState> state_; ///< @brief Also read by the costmap's update thread
       RecoveryTrigger recovery_trigger_;
 
       ros::Time last_valid_plan_, last_valid_control_, last_oscillation_reset_;
@@ -205,16 +323,31 @@ namespace move_base {
       pluginlib::ClassLoader<nav_core::BaseLocalPlanner> blp_loader_;
       pluginlib::ClassLoader<nav_core::RecoveryBehavior> recovery_loader_;
 
-      //set up plan triple buffer
+      //the plan being made, the latest one made, published with atomic_store(), and the one being followed
       std::vector<geometry_msgs::PoseStamped>* planner_plan_;
-      std::vector<geometry_msgs::PoseStamped>* latest_plan_;
-      std::vector<geometry_msgs::PoseStamped>* controller_plan_;
+      nav_core::PlanConstPtr latest_plan_;
+      nav_core::PlanConstPtr controller_plan_;
+      boost::atomic<unsigned long> latest_plan_version_; ///< @brief Counts the plans published to latest_plan_
+      unsigned long controller_plan_version_; ///< @brief The version of controller_plan_
 
       //set up the planner's thread
       bool runPlanner_;
       boost::mutex planner_mutex_;
       boost::condition_variable planner_cond_;
       geometry_msgs::PoseStamped planner_goal_;
+
+      //the waypoints to go on to after planner_goal_, and the plan made ahead from it to the first of them
+      std::deque<geometry_msgs::PoseStamped> waypoints_;
+      nav_core::PlanConstPtr next_plan_;
+      geometry_msgs::PoseStamped next_plan_start_; ///< @brief The goal next_plan_ was made from
+      unsigned long next_plan_version_; ///< @brief The waypoints_version_ next_plan_ was made for
+      unsigned long waypoints_version_; ///< @brief Counts the changes to waypoints_, so a plan made ahead to an old one is dropped
+      double waypoint_switch_distance_; ///< @brief How close to a waypoint the controller goes on to the next without stopping
+
+      //replanning when the planner costmap changes near the plan, rather than only at planner_frequency; both are
+      //also read by the costmap's update thread
+      boost::atomic<bool> replan_on_change_;
+      ReplanTrigger replan_trigger_;
       boost::thread* planner_thread_;
 
 
@@ -226,7 +359,6 @@ namespace move_base {
       move_base::MoveBaseConfig last_config_;
       move_base::MoveBaseConfig default_config_;
       bool setup_, p_freq_change_, c_freq_change_;
-      bool new_global_plan_;
   };
 };
 #endif
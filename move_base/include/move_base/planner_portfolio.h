@@ -0,0 +1,120 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#ifndef MOVE_BASE_PLANNER_PORTFOLIO_H_
+#define MOVE_BASE_PLANNER_PORTFOLIO_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/costmap_2d_ros.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <nav_core/base_global_planner.h>
+#include <pluginlib/class_loader.h>
+
+namespace move_base {
+  /**
+   * @class PlannerPortfolio
+   * @brief Races several global planners, each on a thread and a copy of the costmap of its own, and takes
+   * the first plan found, or the shortest found by a deadline. nav_core has no way to interrupt a planner, so
+   * one still planning when the race is decided is left to finish, and sits out the races until it has.
+   */
+  class PlannerPortfolio {
+    public:
+      PlannerPortfolio();
+
+      /**
+       * @brief  Waits for the planners still planning, and stops their threads
+       */
+      ~PlannerPortfolio();
+
+      /**
+       * @brief  Loads the planners and initializes them on copies of the costmap, leaving out those that can't
+       * plan on one
+       * @param  planners The class names of the planners
+       * @param  loader The loader of the planners, which must outlive them
+       * @param  costmap_ros The costmap to copy
+       * @return The number of planners in the portfolio
+       */
+      unsigned int initialize(const std::vector<std::string>& planners,
+          pluginlib::ClassLoader<nav_core::BaseGlobalPlanner>& loader, costmap_2d::Costmap2DROS* costmap_ros);
+
+      /**
+       * @brief  Plans with each planner not still busy with an earlier race, on costs copied under a brief lock
+       * of the costmap
+       * @param  start The start pose
+       * @param  goal The goal pose
+       * @param  deadline Zero to take the first plan found, else the time to take the shortest found by, or the
+       * first found after if none was
+       * @param  plan The plan... filled by the planner that won
+       * @return True if a valid plan was found, false otherwise
+       */
+      bool makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+          const ros::Time& deadline, std::vector<geometry_msgs::PoseStamped>& plan);
+
+      bool empty() const { return members_.empty(); }
+
+    private:
+      struct Member {
+        std::string name;
+        boost::shared_ptr<nav_core::BaseGlobalPlanner> planner;
+        costmap_2d::Costmap2D costmap; ///< @brief The copy the planner plans on, written only while it is idle
+        unsigned long version; ///< @brief The version of the costmap the copy is of
+        boost::thread* thread;
+
+        // guarded by mutex_
+        bool busy;
+        unsigned long race; ///< @brief The last race the planner was entered in
+        geometry_msgs::PoseStamped start, goal;
+        ros::Time deadline;
+        bool found;
+        std::vector<geometry_msgs::PoseStamped> plan;
+      };
+
+      void memberThread(Member* member);
+
+      costmap_2d::Costmap2DROS* costmap_ros_;
+      std::vector<Member*> members_;
+      boost::mutex mutex_;
+      boost::condition_variable race_cond_, done_cond_;
+      unsigned long race_;
+      bool shutdown_;
+  };
+};
+#endif
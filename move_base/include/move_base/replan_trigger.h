@@ -0,0 +1,97 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#ifndef MOVE_BASE_REPLAN_TRIGGER_H_
+#define MOVE_BASE_REPLAN_TRIGGER_H_
+
+#include <vector>
+
+#include <ros/time.h>
+#include <boost/atomic.hpp>
+#include <geometry_msgs/PoseStamped.h>
+#include <costmap_2d/layered_costmap.h>
+
+namespace move_base {
+  /**
+   * @class ReplanTrigger
+   * @brief Decides from the updates of the planner costmap when to replan: when an update changes cells near the
+   * plan being followed, and the plan has got blocked or costlier since it was made. The parameters may be set from
+   * any thread; the rest is for the costmap's update thread alone.
+   */
+  class ReplanTrigger {
+    public:
+      ReplanTrigger();
+
+      /**
+       * @param  corridor How far from the plan a changed cell counts, in meters
+       * @param  cost_increase How far the mean cost of the cells of the plan may rise before replanning
+       * @param  max_frequency The most replans per second the changes may cause, 0 for no limit
+       */
+      void setParameters(double corridor, double cost_increase, double max_frequency);
+
+      /**
+       * @brief  Looks at an update of the costmap, with its mutex held
+       * @param  costmap The costmap after the update
+       * @param  regions The boxes of cells the update changed
+       * @param  plan The plan being followed
+       * @param  version The version of plan, a new one of which is measured against itself
+       * @param  now The time of the update
+       * @return True if a replan is due now, which stays pending until replanned() or clearPending() is called
+       */
+      bool check(const costmap_2d::Costmap2D& costmap, const std::vector<costmap_2d::LayeredCostmap::Region>& regions,
+                 const std::vector<geometry_msgs::PoseStamped>& plan, unsigned long version, const ros::Time& now);
+
+      /** @brief Whether a replan is held back, by max_frequency or by the caller */
+      bool pending() const { return pending_; }
+
+      /** @brief Drops the pending replan, say as there is no plan being followed to replace */
+      void clearPending() { pending_ = false; }
+
+      /** @brief Notes that the replan was started at now, which the next is held back from by max_frequency */
+      void replanned(const ros::Time& now);
+
+      /** @brief The mean cost of the cells of the plan when first looked at, and at the last check */
+      double planCost() const { return plan_cost_; }
+      double lastCost() const { return last_cost_; }
+
+    private:
+      boost::atomic<double> corridor_, cost_increase_, max_frequency_;
+      unsigned long plan_version_; ///< @brief The plan plan_cost_ is of
+      double plan_cost_;
+      double last_cost_;
+      bool pending_;
+      ros::Time last_replan_;
+  };
+};
+#endif
@@ -0,0 +1,197 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <move_base/controller_scheduler.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <ros/console.h>
+#include <ros/time.h>
+
+namespace move_base {
+
+  static const char* series_names[] = { "cycle", "jitter", "costmap_wait", "tf_lookup", "controller" };
+
+  ControllerScheduler::ControllerScheduler(unsigned int window)
+    : monotonic_(false), period_(0.05), due_(0.0), late_by_(0.0), cycle_start_(0.0), jitter_(0.0),
+      last_cycle_time_(0.0), missed_(0), window_(std::max(window, 1u)), next_sample_(0), sample_count_(0) {
+    // 0.1 ms to 1 s, in 1-2-5 steps
+    for(double decade = 1e-4; decade < 1.0; decade *= 10){
+      bin_edges_.push_back(decade);
+      bin_edges_.push_back(2 * decade);
+      bin_edges_.push_back(5 * decade);
+    }
+    bin_edges_.push_back(1.0);
+
+    samples_.assign(STAGE_TIMES + NUM_STAGES, std::vector<double>(window_, 0.0));
+    stage_times_.assign(NUM_STAGES, 0.0);
+  }
+
+  void ControllerScheduler::setFrequency(double frequency){
+    if(frequency > 0.0)
+      period_ = 1.0 / frequency;
+  }
+
+  double ControllerScheduler::monotonicNow(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  double ControllerScheduler::now() const {
+    return monotonic_ ? monotonicNow() : ros::Time::now().toSec();
+  }
+
+  void ControllerScheduler::start(){
+    due_ = now();
+    late_by_ = 0.0;
+    missed_ = 0;
+  }
+
+  void ControllerScheduler::startCycle(){
+    cycle_start_ = monotonicNow();
+    jitter_ = std::max(now() - due_, 0.0) + late_by_;
+    std::fill(stage_times_.begin(), stage_times_.end(), 0.0);
+  }
+
+  void ControllerScheduler::addStageTime(Stage stage, double seconds){
+    if(stage < NUM_STAGES)
+      stage_times_[stage] += seconds;
+  }
+
+  double ControllerScheduler::timeLeft(double fraction) const {
+    return fraction * period_ - jitter_ - (monotonicNow() - cycle_start_);
+  }
+
+  bool ControllerScheduler::sleep(){
+    last_cycle_time_ = monotonicNow() - cycle_start_;
+    samples_[CYCLE_TIME][next_sample_] = last_cycle_time_;
+    samples_[JITTER][next_sample_] = jitter_;
+    for(unsigned int i = 0; i < NUM_STAGES; ++i)
+      samples_[STAGE_TIMES + i][next_sample_] = stage_times_[i];
+    next_sample_ = (next_sample_ + 1) % window_;
+    sample_count_ = std::min(sample_count_ + 1, window_);
+    if(next_sample_ == 0)
+      logHistograms();
+
+    double next = due_ + period_;
+    double t = now();
+    if(t > next){
+      //start the next cycle right away, rather than the ones after back to back to catch up
+      late_by_ = t - next;
+      due_ = t;
+      ++missed_;
+      return false;
+    }
+
+    if(monotonic_){
+      timespec ts;
+      ts.tv_sec = (time_t)next;
+      ts.tv_nsec = (long)((next - ts.tv_sec) * 1e9);
+      while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+    }
+    else
+      ros::Time::sleepUntil(ros::Time(next));
+
+    late_by_ = 0.0;
+    due_ = next;
+    missed_ = 0;
+    return true;
+  }
+
+  void ControllerScheduler::getHistogram(unsigned int series, std::vector<uint32_t>& histogram) const {
+    histogram.assign(bin_edges_.size() + 1, 0);
+    if(series >= samples_.size())
+      return;
+    const std::vector<double>& samples = samples_[series];
+    for(unsigned int i = 0; i < sample_count_; ++i){
+      unsigned int bin = std::upper_bound(bin_edges_.begin(), bin_edges_.end(), samples[i]) - bin_edges_.begin();
+      ++histogram[bin];
+    }
+  }
+
+  void ControllerScheduler::logHistograms() const {
+    std::vector<uint32_t> histogram;
+    for(unsigned int series = 0; series < samples_.size(); ++series){
+      getHistogram(series, histogram);
+      std::string counts;
+      char bin[32];
+      for(unsigned int i = 0; i < histogram.size(); ++i){
+        if(histogram[i] == 0)
+          continue;
+        if(i < bin_edges_.size())
+          snprintf(bin, sizeof(bin), " <%gms:%u", bin_edges_[i] * 1e3, histogram[i]);
+        else
+          snprintf(bin, sizeof(bin), " >%gms:%u", bin_edges_.back() * 1e3, histogram[i]);
+        counts += bin;
+      }
+      ROS_DEBUG_NAMED("move_base_scheduler", "Last %u control cycles, %s:%s", sample_count_, series_names[series], counts.c_str());
+    }
+  }
+
+  bool ControllerScheduler::setRealtime(int priority, const std::vector<int>& cpus){
+    bool ok = true;
+    if(priority > 0){
+      sched_param param;
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = std::min(std::max(priority, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+      int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      if(err != 0){
+        ROS_WARN("Could not give the control loop SCHED_FIFO priority %d: %s", param.sched_priority, strerror(err));
+        ok = false;
+      }
+    }
+
+    if(!cpus.empty()){
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for(unsigned int i = 0; i < cpus.size(); ++i){
+        if(cpus[i] >= 0 && cpus[i] < CPU_SETSIZE)
+          CPU_SET(cpus[i], &set);
+      }
+      int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      if(err != 0){
+        ROS_WARN("Could not pin the control loop to its CPUs: %s", strerror(err));
+        ok = false;
+      }
+    }
+    return ok;
+  }
+};
@@ -36,12 +36,18 @@
 *         Mike Phillips (put the planner in its own thread)
 *********************************************************************/
 #include <move_base/move_base.h>
+#include <nav_executor/lockstep.h>
+#include <nav_executor/trace.h>
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include <geometry_msgs/Twist.h>
+#include <std_msgs/Float64.h>
 
 namespace move_base {
 
@@ -50,11 +56,15 @@ namespace move_base {
     tf_(tf),
     as_(NULL),
     planner_costmap_ros_(NULL), controller_costmap_ros_(NULL),
+    planner_on_snapshot_(false), planner_snapshot_version_(0), portfolio_(NULL),
+    lazy_recovery_behaviors_(false), recovery_behaviors_loaded_(false),
+    controller_thread_setup_(false), controller_overran_(false), have_last_cmd_vel_(false),
     bgp_loader_("nav_core", "nav_core::BaseGlobalPlanner"), // 全局导航的地图
     blp_loader_("nav_core", "nav_core::BaseLocalPlanner"),  // 局部导航的地图
     recovery_loader_("nav_core", "nav_core::RecoveryBehavior"),
-    planner_plan_(NULL), latest_plan_(NULL), controller_plan_(NULL),
-    runPlanner_(false), setup_(false), p_freq_change_(false), c_freq_change_(false), new_global_plan_(false) 
+    planner_plan_(NULL), latest_plan_version_(0), controller_plan_version_(0),
+    runPlanner_(false), next_plan_version_(0), waypoints_version_(0), replan_on_change_(false),
+    setup_(false), p_freq_change_(false), c_freq_change_(false) 
 	{
 
     as_ = new MoveBaseActionServer(ros::NodeHandle(), "move_base", boost::bind(&MoveBase::executeCb, this, _1), false);
@@ -76,16 +86,54 @@ namespace move_base {
     private_nh.param("planner_frequency", planner_frequency_, 0.0);
     private_nh.param("controller_frequency", controller_frequency_, 20.0);
     private_nh.param("planner_patience", planner_patience_, 5.0);
+    private_nh.param("planner_deadline", planner_deadline_, 0.0);
+    private_nh.param("plan_on_costmap_snapshot", plan_on_costmap_snapshot_, false);
     private_nh.param("controller_patience", controller_patience_, 15.0);
+    private_nh.param("controller_time_budget", controller_time_budget_, 0.0);
+
+    //replanning on changes to the planner costmap near the plan
+    bool replan_on_change;
+    double replan_corridor, replan_cost_increase, replan_max_frequency;
+    private_nh.param("replan_on_change", replan_on_change, false);
+    private_nh.param("replan_corridor", replan_corridor, 0.5);
+    private_nh.param("replan_cost_increase", replan_cost_increase, 10.0);
+    private_nh.param("replan_max_frequency", replan_max_frequency, 1.0);
+    replan_on_change_ = replan_on_change;
+    replan_trigger_.setParameters(replan_corridor, replan_cost_increase, replan_max_frequency);
+
+    //pacing of the control loop, and what to do after a cycle overruns its deadline
+    std::string deadline_policy, controller_cpus;
+    private_nh.param("controller_monotonic_clock", controller_monotonic_clock_, false);
+    private_nh.param("controller_priority", controller_priority_, 0);
+    private_nh.param("controller_cpus", controller_cpus, std::string(""));
+    private_nh.param("controller_deadline_policy", deadline_policy, std::string("ignore"));
+    private_nh.param("controller_degraded_scale", degraded_scale_, 0.5);
+    boost::trim(controller_cpus);
+    if(!controller_cpus.empty()){
+      std::vector<std::string> cpus;
+      boost::split(cpus, controller_cpus, boost::is_any_of(" "), boost::token_compress_on);
+      for(unsigned int i = 0; i < cpus.size(); ++i)
+        controller_cpus_.push_back(atoi(cpus[i].c_str()));
+    }
+    if(deadline_policy == "hold")
+      deadline_policy_ = DEADLINE_HOLD;
+    else if(deadline_policy == "degrade")
+      deadline_policy_ = DEADLINE_DEGRADE;
+    else{
+      if(deadline_policy != "ignore")
+        ROS_WARN("Unknown controller_deadline_policy %s, using ignore", deadline_policy.c_str());
+      deadline_policy_ = DEADLINE_IGNORE;
+    }
+    scheduler_.setMonotonic(controller_monotonic_clock_);
 
     private_nh.param("oscillation_timeout", oscillation_timeout_, 0.0);
     private_nh.param("oscillation_distance", oscillation_distance_, 0.5);
 
-    //set up plan triple buffer
-	// 设置路径规划三个buffer
+    //set up the plan buffers
+	// 设置路径规划buffer
     planner_plan_ = new std::vector<geometry_msgs::PoseStamped>();
-    latest_plan_ = new std::vector<geometry_msgs::PoseStamped>();
-    controller_plan_ = new std::vector<geometry_msgs::PoseStamped>();
+    latest_plan_.reset(new std::vector<geometry_msgs::PoseStamped>());
+    controller_plan_ = latest_plan_;
 
     //set up the planner's thread
 	// 设置路径规划器进程
@@ -99,12 +147,21 @@ namespace move_base {
     ros::NodeHandle action_nh("move_base");
     action_goal_pub_ = action_nh.advertise<move_base_msgs::MoveBaseActionGoal>("goal", 1);
 
+    //the age of the newest sensor reading in the controller costmap when each velocity command goes out
+    private_nh.param("trace_latency", trace_latency_, false);
+    if(trace_latency_)
+      latency_pub_ = private_nh.advertise<std_msgs::Float64>("sensor_latency", 10);
+
     //we'll provide a mechanism for some people to send goals as PoseStamped messages over a topic
     //they won't get any useful information back about its status, but this is useful for tools
     //like nav_view and rviz
     ros::NodeHandle simple_nh("move_base_simple");
     goal_sub_ = simple_nh.subscribe<geometry_msgs::PoseStamped>("goal", 1, boost::bind(&MoveBase::goalCB, this, _1));
 
+    //waypoints to go on to after the goal, the next planned while driving to the current one
+    private_nh.param("waypoint_switch_distance", waypoint_switch_distance_, 0.0);
+    waypoints_sub_ = private_nh.subscribe<nav_msgs::Path>("waypoints", 1, boost::bind(&MoveBase::waypointsCB, this, _1));
+
     //we'll assume the radius of the robot to be consistent with what's specified for the costmaps
     private_nh.param("local_costmap/inscribed_radius", inscribed_radius_, 0.325);
     private_nh.param("local_costmap/circumscribed_radius", circumscribed_radius_, 0.46);
@@ -112,42 +169,34 @@ namespace move_base {
     private_nh.param("conservative_reset_dist", conservative_reset_dist_, 3.0);
 
     private_nh.param("shutdown_costmaps", shutdown_costmaps_, false);
+    private_nh.param("idle_planner_costmap_frequency", idle_planner_costmap_frequency_, 0.0);
+    private_nh.param("idle_controller_costmap_frequency", idle_controller_costmap_frequency_, 0.0);
     private_nh.param("clearing_rotation_allowed", clearing_rotation_allowed_, true);
     private_nh.param("recovery_behavior_enabled", recovery_behavior_enabled_, true);
-
-    //create the ros wrapper for the planner's costmap... and initializer a pointer we'll use with the underlying map
-    planner_costmap_ros_ = new costmap_2d::Costmap2DROS("global_costmap", tf_);
-    planner_costmap_ros_->pause();
-
-    //initialize the global planner
-	// 初始化global planner planner_
-    try {
-      planner_ = bgp_loader_.createInstance(global_planner);
-      planner_->initialize(bgp_loader_.getName(global_planner), planner_costmap_ros_);
-    } catch (const pluginlib::PluginlibException& ex) {
-      ROS_FATAL("Failed to create the %s planner, are you sure it is properly registered and that the containing library is built? Exception: %s", global_planner.c_str(), ex.what());
-      exit(1);
+    private_nh.param("asynchronous_recovery", asynchronous_recovery_, false);
+
+    //the two sides, each a costmap and a planner, wait on data of their own, the map say, so they can be set up at
+    //the same time, and the recovery behaviors, wanted only once the robot is stuck, loaded then
+    bool parallel_startup;
+    private_nh.param("parallel_startup", parallel_startup, false);
+    private_nh.param("lazy_recovery_behaviors", lazy_recovery_behaviors_, false);
+    ros::WallTime startup_begin = ros::WallTime::now();
+    StartupTimes times;
+    if(parallel_startup){
+      boost::thread global_setup(boost::bind(&MoveBase::setupGlobalPlanning, this, global_planner, &times));
+      setupLocalPlanning(local_planner, &times);
+      global_setup.join();
     }
-
-    //create the ros wrapper for the controller's costmap... and initializer a pointer we'll use with the underlying map
-    controller_costmap_ros_ = new costmap_2d::Costmap2DROS("local_costmap", tf_);
-    controller_costmap_ros_->pause();
-
-    //create a local planner
-	// 创建 local planner tc_
-    try {
-      tc_ = blp_loader_.createInstance(local_planner);
-      ROS_INFO("Created local_planner %s", local_planner.c_str());
-      tc_->initialize(blp_loader_.getName(local_planner), &tf_, controller_costmap_ros_);
-    } catch (const pluginlib::PluginlibException& ex) {
-      ROS_FATAL("Failed to create the %s planner, are you sure it is properly registered and that the containing library is built? Exception: %s", local_planner.c_str(), ex.what());
-      exit(1);
+    else{
+      setupGlobalPlanning(global_planner, &times);
+      setupLocalPlanning(local_planner, &times);
     }
 
     // Start actively updating costmaps based on sensor data
 	// 开启costmap基于传感器数据的更新
     planner_costmap_ros_->start(); // 全局
     controller_costmap_ros_->start(); // 局部
+    setCostmapsIdle(true);
 
     //advertise a service for getting a plan
     make_plan_srv_ = private_nh.advertiseService("make_plan", &MoveBase::planService, this);
@@ -163,8 +212,11 @@ namespace move_base {
     }
 
     //load any user specified recovery behaviors, and if that fails load the defaults
-    if(!loadRecoveryBehaviors(private_nh)){
-      loadDefaultRecoveryBehaviors();
+    times.recovery_behaviors = 0.0;
+    if(!lazy_recovery_behaviors_){
+      ros::WallTime recovery_begin = ros::WallTime::now();
+      loadRecoveryBehaviorsOnce();
+      times.recovery_behaviors = (ros::WallTime::now() - recovery_begin).toSec();
     }
 
     //initially, we'll need to make a plan
@@ -180,6 +232,75 @@ namespace move_base {
     dsrv_ = new dynamic_reconfigure::Server<move_base::MoveBaseConfig>(ros::NodeHandle("~"));
     dynamic_reconfigure::Server<move_base::MoveBaseConfig>::CallbackType cb = boost::bind(&MoveBase::reconfigureCB, this, _1, _2);
     dsrv_->setCallback(cb);
+
+    ROS_INFO("move_base is ready after %.3f s: global costmap %.3f s, global planner %.3f s, local costmap %.3f s, "
+             "local planner %.3f s, recovery behaviors %.3f s%s%s", (ros::WallTime::now() - startup_begin).toSec(),
+             times.global_costmap, times.global_planner, times.local_costmap, times.local_planner,
+             times.recovery_behaviors, parallel_startup ? ", the global and local sides at once" : "",
+             lazy_recovery_behaviors_ ? ", recovery behaviors on first use" : "");
+  }
+
+  void MoveBase::setupGlobalPlanning(const std::string& global_planner, StartupTimes* times){
+    ros::WallTime begin = ros::WallTime::now();
+    //create the ros wrapper for the planner's costmap... and initializer a pointer we'll use with the underlying map
+    planner_costmap_ros_ = new costmap_2d::Costmap2DROS("global_costmap", tf_);
+    planner_costmap_ros_->pause();
+    planner_costmap_ros_->addUpdateCallback(boost::bind(&MoveBase::plannerCostmapUpdated, this, _1));
+
+    ros::WallTime costmap_ready = ros::WallTime::now();
+    times->global_costmap = (costmap_ready - begin).toSec();
+
+    //initialize the global planner
+	// 初始化global planner planner_
+    try {
+      planner_ = bgp_loader_.createInstance(global_planner);
+      initializePlanner(bgp_loader_.getName(global_planner));
+    } catch (const pluginlib::PluginlibException& ex) {
+      ROS_FATAL("Failed to create the %s planner, are you sure it is properly registered and that the containing library is built? Exception: %s", global_planner.c_str(), ex.what());
+      exit(1);
+    }
+
+    //planners to race against each other for the plans of the plan thread, separated by spaces
+    std::string planner_portfolio;
+    ros::NodeHandle private_nh("~");
+    private_nh.param("planner_portfolio", planner_portfolio, std::string(""));
+    boost::trim(planner_portfolio);
+    if(!planner_portfolio.empty()){
+      std::vector<std::string> planners;
+      boost::split(planners, planner_portfolio, boost::is_any_of(" "), boost::token_compress_on);
+      portfolio_ = new PlannerPortfolio();
+      if(portfolio_->initialize(planners, bgp_loader_, planner_costmap_ros_) < 2)
+        ROS_WARN("The planner portfolio has fewer than two planners to race");
+      if(portfolio_->empty()){
+        delete portfolio_;
+        portfolio_ = NULL;
+      }
+    }
+
+    times->global_planner = (ros::WallTime::now() - costmap_ready).toSec();
+  }
+
+  void MoveBase::setupLocalPlanning(const std::string& local_planner, StartupTimes* times){
+    ros::WallTime begin = ros::WallTime::now();
+
+    //create the ros wrapper for the controller's costmap... and initializer a pointer we'll use with the underlying map
+    controller_costmap_ros_ = new costmap_2d::Costmap2DROS("local_costmap", tf_);
+    controller_costmap_ros_->pause();
+
+    ros::WallTime costmap_ready = ros::WallTime::now();
+    times->local_costmap = (costmap_ready - begin).toSec();
+
+    //create a local planner
+	// 创建 local planner tc_
+    try {
+      tc_ = blp_loader_.createInstance(local_planner);
+      ROS_INFO("Created local_planner %s", local_planner.c_str());
+      tc_->initialize(blp_loader_.getName(local_planner), &tf_, controller_costmap_ros_);
+    } catch (const pluginlib::PluginlibException& ex) {
+      ROS_FATAL("Failed to create the %s planner, are you sure it is properly registered and that the containing library is built? Exception: %s", local_planner.c_str(), ex.what());
+      exit(1);
+    }
+    times->local_planner = (ros::WallTime::now() - costmap_ready).toSec();
   }
 
   void MoveBase::reconfigureCB(move_base::MoveBaseConfig &config, uint32_t level){
@@ -214,6 +335,10 @@ namespace move_base {
     }
 
     planner_patience_ = config.planner_patience;
+    planner_deadline_ = config.planner_deadline;
+    controller_time_budget_ = config.controller_time_budget;
+    replan_on_change_ = config.replan_on_change;
+    replan_trigger_.setParameters(config.replan_corridor, config.replan_cost_increase, config.replan_max_frequency);
     controller_patience_ = config.controller_patience;
     conservative_reset_dist_ = config.conservative_reset_dist;
 
@@ -235,10 +360,10 @@ namespace move_base {
 
         // Clean up before initializing the new planner
         planner_plan_->clear();
-        latest_plan_->clear();
-        controller_plan_->clear();
+        boost::atomic_store(&latest_plan_, nav_core::PlanConstPtr(new std::vector<geometry_msgs::PoseStamped>()));
+        controller_plan_.reset(new std::vector<geometry_msgs::PoseStamped>());
         resetState();
-        planner_->initialize(bgp_loader_.getName(config.base_global_planner), planner_costmap_ros_);
+        initializePlanner(bgp_loader_.getName(config.base_global_planner));
 
         lock.unlock();
       } catch (const pluginlib::PluginlibException& ex) {
@@ -256,8 +381,8 @@ namespace move_base {
         tc_ = blp_loader_.createInstance(config.base_local_planner);
         // Clean up before initializing the new planner
         planner_plan_->clear();
-        latest_plan_->clear();
-        controller_plan_->clear();
+        boost::atomic_store(&latest_plan_, nav_core::PlanConstPtr(new std::vector<geometry_msgs::PoseStamped>()));
+        controller_plan_.reset(new std::vector<geometry_msgs::PoseStamped>());
         resetState();
         tc_->initialize(blp_loader_.getName(config.base_local_planner), &tf_, controller_costmap_ros_);
       } catch (const pluginlib::PluginlibException& ex) {
@@ -280,6 +405,30 @@ namespace move_base {
     action_goal_pub_.publish(action_goal);
   }
 
+  void MoveBase::waypointsCB(const nav_msgs::Path::ConstPtr& waypoints){
+    std::deque<geometry_msgs::PoseStamped> queue;
+    for(unsigned int i = 0; i < waypoints->poses.size(); ++i){
+      geometry_msgs::PoseStamped waypoint = waypoints->poses[i];
+      if(waypoint.header.frame_id.empty())
+        waypoint.header.frame_id = waypoints->header.frame_id;
+      if(!isQuaternionValid(waypoint.pose.orientation)){
+        ROS_ERROR("Discarding the waypoints because waypoint %u has an invalid quaternion", i);
+        return;
+      }
+      queue.push_back(goalToGlobalFrame(waypoint));
+    }
+
+    ROS_DEBUG_NAMED("move_base","Queued %zu waypoints after the current goal", queue.size());
+    boost::unique_lock<boost::mutex> lock(planner_mutex_);
+    waypoints_.swap(queue);
+    next_plan_.reset();
+    ++waypoints_version_;
+
+    //plan ahead to the first of them now, if there is a goal
+    if(runPlanner_ && !waypoints_.empty())
+      planner_cond_.notify_one();
+  }
+
   void MoveBase::clearCostmapWindows(double size_x, double size_y){
     tf::Stamped<tf::Pose> global_pose;
 
@@ -310,7 +459,8 @@ namespace move_base {
     clear_poly.push_back(pt);
 
 	// 设置机器人多边形区域为自由空间
-    planner_costmap_ros_->getCostmap()->setConvexPolygonCost(clear_poly, costmap_2d::FREE_SPACE);
+    std::vector<unsigned char> keep;
+    planner_costmap_ros_->getCostmap()->clearRegion(clear_poly, costmap_2d::FREE_SPACE, keep);
 
     //clear the controller's costmap
 	// 局部地图
@@ -336,7 +486,7 @@ namespace move_base {
     pt.y = y + size_y / 2;
     clear_poly.push_back(pt);
 	
-    controller_costmap_ros_->getCostmap()->setConvexPolygonCost(clear_poly, costmap_2d::FREE_SPACE);
+    controller_costmap_ros_->getCostmap()->clearRegion(clear_poly, costmap_2d::FREE_SPACE, keep);
   }
 
   bool MoveBase::clearCostmapsService(std_srvs::Empty::Request &req, std_srvs::Empty::Response &resp){
@@ -373,6 +523,11 @@ namespace move_base {
 
     //update the copy of the costmap the planner uses
     clearCostmapWindows(2 * clearing_radius_, 2 * clearing_radius_);
+    boost::shared_lock<boost::shared_mutex> snapshot_lock(planner_snapshot_mutex_, boost::defer_lock);
+    if(planner_on_snapshot_){
+      updatePlannerSnapshot();
+      snapshot_lock.lock();
+    }
 
     //first try to make a plan to the exact desired goal
     std::vector<geometry_msgs::PoseStamped> global_plan;
@@ -457,9 +612,9 @@ namespace move_base {
 
     delete planner_thread_;
 
+    delete portfolio_;
+
     delete planner_plan_;
-    delete latest_plan_;
-    delete controller_plan_;
 
     planner_.reset();
     tc_.reset();
@@ -473,8 +628,6 @@ namespace move_base {
    * @return  True if planning succeeds, false otherwise
    */
   bool MoveBase::makePlan(const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan){
-    boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(planner_costmap_ros_->getCostmap()->getMutex()));
-
     //make sure to set the plan to be empty initially
     plan.clear();
 
@@ -494,10 +647,42 @@ namespace move_base {
 
     geometry_msgs::PoseStamped start;
     tf::poseStampedTFToMsg(global_pose, start);
+    return makePlan(start, goal, plan);
+  }
+
+  bool MoveBase::makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+      std::vector<geometry_msgs::PoseStamped>& plan){
+    //on a snapshot, or with the portfolio, the costmap is locked only while it is copied and keeps updating during long plans
+    boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(planner_costmap_ros_->getCostmap()->getMutex()), boost::defer_lock);
+    //the snapshot isn't brought up to date under a plan that is reading it, from planService() say
+    boost::shared_lock<boost::shared_mutex> snapshot_lock(planner_snapshot_mutex_, boost::defer_lock);
+    if(portfolio_ == NULL){
+      if(planner_on_snapshot_){
+        updatePlannerSnapshot();
+        snapshot_lock.lock();
+      }
+      else
+        lock.lock();
+    }
+
+    plan.clear();
 
     //if the planner fails or returns a zero length plan, planning failed
     // 使用路径规划器设计路径(这个路径规划器nav_core::BaseGlobalPlanner)
-    if(!planner_->makePlan(start, goal, plan) || plan.empty()){
+    //with a deadline, an anytime planner hands back the best plan it has by then
+    bool found;
+    if(portfolio_ != NULL)
+      found = portfolio_->makePlan(start, goal, planner_deadline_ > 0 ? ros::Time::now() + ros::Duration(planner_deadline_) : ros::Time(), plan);
+    else if(planner_deadline_ > 0){
+      double quality;
+      found = planner_->makePlan(start, goal, ros::Time::now() + ros::Duration(planner_deadline_), plan, quality);
+      if(found)
+        ROS_DEBUG_NAMED("move_base", "Got a plan of quality %.2f within the planner deadline", quality);
+    }
+    else
+      found = planner_->makePlan(start, goal, plan);
+
+    if(!found || plan.empty()){
       ROS_DEBUG_NAMED("move_base","Failed to find a  plan to point (%.2f, %.2f)", goal.pose.position.x, goal.pose.position.y);
       return false;
     }
@@ -505,12 +690,33 @@ namespace move_base {
     return true;
   }
 
+  void MoveBase::initializePlanner(const std::string& name){
+    if(plan_on_costmap_snapshot_){
+      updatePlannerSnapshot();
+      planner_on_snapshot_ = planner_->initializeOnCostmap(name, &planner_snapshot_, planner_costmap_ros_->getGlobalFrameID());
+      if(planner_on_snapshot_)
+        return;
+      ROS_WARN("The global planner %s can't plan on a costmap snapshot, so the costmap is locked while it plans", name.c_str());
+    }
+    planner_on_snapshot_ = false;
+    planner_->initialize(name, planner_costmap_ros_);
+  }
+
+  void MoveBase::updatePlannerSnapshot(){
+    boost::unique_lock<boost::shared_mutex> update_lock(planner_snapshot_mutex_);
+    costmap_2d::Costmap2D* costmap = planner_costmap_ros_->getCostmap();
+    boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(costmap->getMutex()));
+    boost::unique_lock<costmap_2d::Costmap2D::mutex_t> snapshot_lock(*(planner_snapshot_.getMutex()));
+    planner_snapshot_.updateCopy(*costmap, planner_snapshot_version_);
+  }
+
   void MoveBase::publishZeroVelocity(){
     geometry_msgs::Twist cmd_vel;
     cmd_vel.linear.x = 0.0;
     cmd_vel.linear.y = 0.0;
     cmd_vel.angular.z = 0.0;
     vel_pub_.publish(cmd_vel);
+    have_last_cmd_vel_ = false;
   }
 
   bool MoveBase::isQuaternionValid(const geometry_msgs::Quaternion& q){
@@ -572,12 +778,50 @@ namespace move_base {
     planner_cond_.notify_one();
   }
 
+  void MoveBase::plannerCostmapUpdated(costmap_2d::LayeredCostmap& layered_costmap)
+  {
+    if(!replan_on_change_)
+      return;
+
+    //the version first, so a plan published in between is looked at again on the next update
+    unsigned long version = latest_plan_version_;
+    nav_core::PlanConstPtr plan = boost::atomic_load(&latest_plan_);
+    ros::Time now = ros::Time::now();
+    if(!replan_trigger_.check(*layered_costmap.getCostmap(), layered_costmap.getUpdatedRegions(), *plan, version, now))
+      return;
+
+    //only an update that does not find the planner mutex taken fires the replan, as it is taken before the
+    //costmap's elsewhere
+    boost::unique_lock<boost::mutex> lock(planner_mutex_, boost::try_to_lock);
+    if(!lock.owns_lock())
+      return;
+
+    //this also cuts short the sleep of a planner running at planner_frequency
+    if(state_ != CONTROLLING){
+      replan_trigger_.clearPending();
+      return;
+    }
+
+    ROS_DEBUG_NAMED("move_base_plan_thread", "The planner costmap changed near the plan (mean cost %.1f, was %.1f), replanning",
+                    replan_trigger_.lastCost(), replan_trigger_.planCost());
+    replan_trigger_.replanned(now);
+    runPlanner_ = true;
+    planner_cond_.notify_one();
+  }
+
   // plan线程
   void MoveBase::planThread(){
     ROS_DEBUG_NAMED("move_base_plan_thread","Starting planner thread...");
     ros::NodeHandle n;
     ros::Timer timer;
     bool wait_for_wake = false;
+
+    //in lockstep the planner runs in the planning phase of a tick, after the costmap updates and before the control
+    //cycle, once per tick while it is to plan at a frequency
+    boost::scoped_ptr<nav_executor::Lockstep::Loop> lockstep_loop;
+    if(nav_executor::Lockstep* lockstep = nav_executor::Lockstep::shared())
+      lockstep_loop.reset(new nav_executor::Lockstep::Loop(lockstep, "move_base/plan", nav_executor::PHASE_PLANNING));
+
     boost::unique_lock<boost::mutex> lock(planner_mutex_);
     while(n.ok()){
 	
@@ -586,9 +830,21 @@ namespace move_base {
       while(wait_for_wake || !runPlanner_){
         //if we should not be running the planner then suspend this thread
         ROS_DEBUG_NAMED("move_base_plan_thread","Planner thread is suspending");
+        if(lockstep_loop)
+          lockstep_loop->leave();
         planner_cond_.wait(lock);
         wait_for_wake = false;
       }
+      if(lockstep_loop){
+        lock.unlock();
+        bool ticked = lockstep_loop->wait();
+        lock.lock();
+        //the lockstep only stops the wait as ROS shuts down
+        if(!ticked)
+          break;
+        if(!runPlanner_)
+          continue;
+      }
       ros::Time start_time = ros::Time::now();
 
       //time to plan! get a copy of the goal and unlock the mutex
@@ -599,19 +855,28 @@ namespace move_base {
       //run planner
 	  // 运行全局路径规划
       planner_plan_->clear();
+      NAV_TRACE(move_base, plan_begin);
       bool gotPlan = n.ok() && makePlan(temp_goal, *planner_plan_);
+      NAV_TRACE1(move_base, plan_end, gotPlan);
 
       if(gotPlan)
 	  {
         ROS_DEBUG_NAMED("move_base_plan_thread","Got Plan with %zu points!", planner_plan_->size());
-        //pointer swap the plans under mutex (the controller will pull from latest_plan_)
-        std::vector<geometry_msgs::PoseStamped>* temp_plan = planner_plan_;
-
         lock.lock();
-        planner_plan_ = latest_plan_;
-        latest_plan_ = temp_plan;
+
+        //drop a plan to a goal the controller has gone on from, to the next waypoint say, and plan again
+        if(planner_goal_.header.frame_id != temp_goal.header.frame_id || distance(planner_goal_, temp_goal) != 0.0){
+          ROS_DEBUG_NAMED("move_base_plan_thread","The goal changed while planning, dropping the plan");
+          continue;
+        }
+
+        //hand the plan over to a shared one that is never modified again, for the controller to pull from
+        //latest_plan_ without a lock or a copy
+        boost::shared_ptr<std::vector<geometry_msgs::PoseStamped> > plan(new std::vector<geometry_msgs::PoseStamped>());
+        plan->swap(*planner_plan_);
+        boost::atomic_store(&latest_plan_, nav_core::PlanConstPtr(plan));
         last_valid_plan_ = ros::Time::now();
-        new_global_plan_ = true;
+        ++latest_plan_version_;
 
         ROS_DEBUG_NAMED("move_base_plan_thread","Generated a plan from the base_global_planner");
 
@@ -620,7 +885,32 @@ namespace move_base {
           state_ = CONTROLLING;
         if(planner_frequency_ <= 0)
           runPlanner_ = false;
+
+        //plan ahead from the goal to the next waypoint, so the controller can go on to it without stopping,
+        //unless a replan to the same goal finds that done already
+        bool plan_ahead = !waypoints_.empty() && waypoints_.front().header.frame_id == temp_goal.header.frame_id;
+        if(plan_ahead && next_plan_ && next_plan_version_ == waypoints_version_ &&
+           next_plan_start_.header.frame_id == temp_goal.header.frame_id && distance(next_plan_start_, temp_goal) == 0.0)
+          plan_ahead = false;
+        geometry_msgs::PoseStamped next_goal = plan_ahead ? waypoints_.front() : temp_goal;
+        unsigned long version = waypoints_version_;
         lock.unlock();
+
+        if(plan_ahead && n.ok()){
+          boost::shared_ptr<std::vector<geometry_msgs::PoseStamped> > next_plan(new std::vector<geometry_msgs::PoseStamped>());
+          NAV_TRACE(move_base, plan_begin);
+          bool got_next_plan = makePlan(temp_goal, next_goal, *next_plan);
+          NAV_TRACE1(move_base, plan_end, got_next_plan);
+          if(got_next_plan){
+            lock.lock();
+            if(version == waypoints_version_){
+              next_plan_ = next_plan;
+              next_plan_start_ = temp_goal;
+              next_plan_version_ = version;
+            }
+            lock.unlock();
+          }
+        }
       }
       //if we didn't get a plan and we are in the planning state (the robot isn't moving)
       else if(state_==PLANNING){
@@ -643,7 +933,7 @@ namespace move_base {
 
       //setup sleep interface if needed
 	  // 定时器，多久没有规划路径，就通知一次规划路径
-      if(planner_frequency_ > 0){
+      if(planner_frequency_ > 0 && !lockstep_loop){
         ros::Duration sleep_time = (start_time + ros::Duration(1.0/planner_frequency_)) - ros::Time::now();
         if (sleep_time > ros::Duration(0.0)){
           wait_for_wake = true;
@@ -677,25 +967,47 @@ namespace move_base {
     current_goal_pub_.publish(goal);
     std::vector<geometry_msgs::PoseStamped> global_plan;
 
-    ros::Rate r(controller_frequency_);
+    //the action server runs every goal on the same thread, so it only needs setting up once, and in lockstep
+    //takes part as one loop from goal to goal
+    if(!controller_thread_setup_){
+      ControllerScheduler::setRealtime(controller_priority_, controller_cpus_);
+      if(nav_executor::Lockstep* lockstep = nav_executor::Lockstep::shared())
+        controller_lockstep_loop_.reset(new nav_executor::Lockstep::Loop(lockstep, "move_base/control", nav_executor::PHASE_CONTROL));
+      controller_thread_setup_ = true;
+    }
+
+    scheduler_.setFrequency(controller_frequency_);
     if(shutdown_costmaps_){
       ROS_DEBUG_NAMED("move_base","Starting up costmaps that were shut down previously");
       planner_costmap_ros_->start();
       controller_costmap_ros_->start();
     }
+    setCostmapsIdle(false);
 
     //we want to make sure that we reset the last time we had a valid plan and control
     last_valid_control_ = ros::Time::now();
     last_valid_plan_ = ros::Time::now();
     last_oscillation_reset_ = ros::Time::now();
 
+    scheduler_.start();
+    controller_overran_ = false;
+
+    //in lockstep, one control cycle per tick of the stepper, after the costmaps and the planner have had theirs,
+    //leaving the lockstep however the goal ends so that it isn't held up between goals
+    nav_executor::Lockstep::Loop* lockstep_loop = controller_lockstep_loop_.get();
+    struct LeaveLockstep {
+      nav_executor::Lockstep::Loop* loop;
+      ~LeaveLockstep(){ if(loop) loop->leave(); }
+    } leave_lockstep = { lockstep_loop };
+    bool ticked = !lockstep_loop || lockstep_loop->wait();
+
     ros::NodeHandle n;
-    while(n.ok())
+    while(ticked && n.ok())
     {
       if(c_freq_change_)
       {
         ROS_INFO("Setting controller frequency to %.2f", controller_frequency_);
-        r = ros::Rate(controller_frequency_);
+        scheduler_.setFrequency(controller_frequency_);
         c_freq_change_ = false;
       }
 
@@ -712,12 +1024,16 @@ namespace move_base {
           goal = goalToGlobalFrame(new_goal.target_pose);
 
           //we'll make sure that we reset our state for the next execution cycle
+          cancelRecovery();
           recovery_index_ = 0;
           state_ = PLANNING;
 
-          //we have a new goal so make sure the planner is awake
+          //we have a new goal so make sure the planner is awake, and drop the waypoints queued after the old one
           lock.lock();
           planner_goal_ = goal;
+          waypoints_.clear();
+          next_plan_.reset();
+          ++waypoints_version_;
           runPlanner_ = true;
           planner_cond_.notify_one();
           lock.unlock();
@@ -751,6 +1067,7 @@ namespace move_base {
         goal = goalToGlobalFrame(goal);
 
         //we want to go back to the planning state for the next execution cycle
+        cancelRecovery();
         recovery_index_ = 0;
         state_ = PLANNING;
 
@@ -771,26 +1088,29 @@ namespace move_base {
         last_oscillation_reset_ = ros::Time::now();
       }
 
-      //for timing that gives real time even in simulation
-      ros::WallTime start = ros::WallTime::now();
+      scheduler_.startCycle();
 
       //the real work on pursuing a goal is done here
 	  // 真正工作的代码
+      NAV_TRACE(move_base, cycle_begin);
       bool done = executeCycle(goal, global_plan);
+      NAV_TRACE1(move_base, cycle_end, done);
 
       //if we're done, then we'll return from execute
       if(done)
         return;
 
-      //check if execution of the goal has completed in some way
-
-      ros::WallDuration t_diff = ros::WallTime::now() - start;
-      ROS_DEBUG_NAMED("move_base","Full control cycle time: %.9f\n", t_diff.toSec());
+      if(lockstep_loop){
+        if(!lockstep_loop->wait())
+          break;
+        continue;
+      }
 
-      r.sleep();
       //make sure to sleep for the remainder of our cycle time
-      if(r.cycleTime() > ros::Duration(1 / controller_frequency_) && state_ == CONTROLLING)
-        ROS_WARN("Control loop missed its desired rate of %.4fHz... the loop actually took %.4f seconds", controller_frequency_, r.cycleTime().toSec());
+      controller_overran_ = !scheduler_.sleep();
+      ROS_DEBUG_NAMED("move_base","Full control cycle time: %.9f\n", scheduler_.lastCycleTime());
+      if(controller_overran_ && state_ == CONTROLLING)
+        ROS_WARN("Control loop missed its desired rate of %.4fHz... the loop actually took %.4f seconds", controller_frequency_, scheduler_.lastCycleTime());
     }
 
     //wake up the planner thread so that it can exit cleanly
@@ -830,7 +1150,10 @@ namespace move_base {
     //update feedback to correspond to our curent position
     // 获得全局下的机器人位置数据，然后通过tf坐标系转换为msg消息
     tf::Stamped<tf::Pose> global_pose;
-    planner_costmap_ros_->getRobotPose(global_pose);
+    {
+      ControllerScheduler::StageTimer timer(&scheduler_, ControllerScheduler::TF_LOOKUP);
+      planner_costmap_ros_->getRobotPose(global_pose);
+    }
     geometry_msgs::PoseStamped current_position;
     tf::poseStampedTFToMsg(global_pose, current_position);
 
@@ -861,31 +1184,24 @@ namespace move_base {
 
     //if we have a new plan then grab it and give it to the controller
     // 如果有新的计划，则添加这个计划
-    if(new_global_plan_)
+    unsigned long plan_version = latest_plan_version_;
+    if(plan_version != controller_plan_version_)
 	{
-      //make sure to set the new plan flag to false
-      new_global_plan_ = false;
-
-      ROS_DEBUG_NAMED("move_base","Got a new plan...swap pointers");
+      controller_plan_version_ = plan_version;
 
-      //do a pointer swap under mutex
-      std::vector<geometry_msgs::PoseStamped>* temp_plan = controller_plan_;
-
-      boost::unique_lock<boost::mutex> lock(planner_mutex_);
-      controller_plan_ = latest_plan_;
-      latest_plan_ = temp_plan;
-      lock.unlock();
-      ROS_DEBUG_NAMED("move_base","pointers swapped!");
+      //the plan is loaded after its version, so it is at least as new
+      ROS_DEBUG_NAMED("move_base","Got a new plan...taking it");
+      controller_plan_ = boost::atomic_load(&latest_plan_);
 
 	  // 这是local planner的规划
 	  // 把全局路径规划传递给局部路径规划
-      if(!tc_->setPlan(*controller_plan_)){
+      if(!tc_->setSharedPlan(controller_plan_)){
         //ABORT and SHUTDOWN COSTMAPS
         ROS_ERROR("Failed to pass global plan to the controller, aborting.");
         resetState();
 
         //disable the planner thread
-        lock.lock();
+        boost::unique_lock<boost::mutex> lock(planner_mutex_);
         runPlanner_ = false;
         lock.unlock();
 
@@ -898,6 +1214,18 @@ namespace move_base {
         recovery_index_ = 0;
     }
 
+    //a recovery behavior started without blocking runs to its end, as it would have blocking, unless the goal changes
+    if(running_recovery_){
+      if(running_recovery_->tick())
+        return false;
+
+      running_recovery_.reset();
+      last_oscillation_reset_ = ros::Time::now();
+      ROS_DEBUG_NAMED("move_base_recovery","Going back to planning state");
+      state_ = PLANNING;
+      return false;
+    }
+
     //the move_base state machine, handles the control logic for navigation
     // move_base 状态机，处理导航的控制逻辑 状态机根据两个变量实现状态表示：{state_， recovery_trigger_}
     // PLANNING 
@@ -922,10 +1250,17 @@ namespace move_base {
       case CONTROLLING:
         ROS_DEBUG_NAMED("move_base","In controlling state.");
 
+        //with waypoints queued, go on to the next one close to the goal if its plan is ready, rather than stopping
+        if(waypoint_switch_distance_ > 0 && distance(current_position, goal) <= waypoint_switch_distance_ &&
+            advanceWaypoint(goal, true))
+          break;
+
         //check to see if we've reached our goal
         // 检测是否到达了目的地
         if(tc_->isGoalReached()){
           ROS_DEBUG_NAMED("move_base","Goal reached!");
+          if(advanceWaypoint(goal, false))
+            break;
           resetState();
 
           //disable the planner thread
@@ -950,16 +1285,64 @@ namespace move_base {
           recovery_trigger_ = OSCILLATION_R;
         }
         
+        //a cycle that overran leaves this one short, so stand in for the local planner with the last command
+        if(controller_overran_ && have_last_cmd_vel_ && deadline_policy_ != DEADLINE_IGNORE && state_ == CONTROLLING){
+          cmd_vel = last_cmd_vel_;
+          if(deadline_policy_ == DEADLINE_DEGRADE){
+            cmd_vel.linear.x *= degraded_scale_;
+            cmd_vel.linear.y *= degraded_scale_;
+            cmd_vel.angular.z *= degraded_scale_;
+          }
+          ROS_DEBUG_NAMED("move_base", "Skipping the local planner after a missed deadline: %.3lf, %.3lf, %.3lf",
+                          cmd_vel.linear.x, cmd_vel.linear.y, cmd_vel.angular.z);
+          vel_pub_.publish(cmd_vel);
+          break;
+        }
+
         {
-         boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(controller_costmap_ros_->getCostmap()->getMutex()));
-        
+         boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(controller_costmap_ros_->getCostmap()->getMutex()), boost::defer_lock);
+         {
+           ControllerScheduler::StageTimer timer(&scheduler_, ControllerScheduler::COSTMAP_WAIT);
+           lock.lock();
+         }
+
+        //the local planner sees the costmap as the last update left it, under the same lock
+        costmap_2d::LayeredCostmap* layers = controller_costmap_ros_->getLayeredCostmap();
+        ros::Time observation_time = layers->getNewestObservationTime(), update_time = layers->getLastUpdateTime();
+
         // 计算当前时刻的速度,看是否能找到一个有效的路径
-        if(tc_->computeVelocityCommands(cmd_vel)){
+        //with a time budget, the local planner commands the best velocity it has found by the end of it
+        bool got_command, degraded = false;
+        {
+          ControllerScheduler::StageTimer timer(&scheduler_, ControllerScheduler::CONTROLLER);
+          NAV_TRACE(move_base, compute_velocity_begin);
+          if(controller_time_budget_ > 0){
+            ros::WallTime deadline = ros::WallTime::now() +
+                ros::WallDuration(std::max(scheduler_.timeLeft(controller_time_budget_), 0.0));
+            got_command = tc_->computeVelocityCommands(cmd_vel, deadline, degraded);
+          }
+          else
+            got_command = tc_->computeVelocityCommands(cmd_vel);
+          NAV_TRACE1(move_base, compute_velocity_end, got_command);
+        }
+        if(got_command){
           ROS_DEBUG_NAMED( "move_base", "Got a valid command from the local planner: %.3lf, %.3lf, %.3lf",
                            cmd_vel.linear.x, cmd_vel.linear.y, cmd_vel.angular.z );
+          if(degraded)
+            ROS_WARN_THROTTLE(5.0, "The local planner ran out of its time budget of %.0f%% of the control period, and commanded the best velocity it had found by then",
+                              100.0 * controller_time_budget_);
           last_valid_control_ = ros::Time::now();
           //make sure that we send the velocity command to the base
           vel_pub_.publish(cmd_vel);
+          if(trace_latency_ && !observation_time.isZero()){
+            std_msgs::Float64 latency;
+            latency.data = (last_valid_control_ - observation_time).toSec();
+            latency_pub_.publish(latency);
+            ROS_DEBUG_NAMED("move_base_latency", "Sensor to cmd_vel %.3f s: %.3f s to the costmap update, %.3f s from it",
+                            latency.data, (update_time - observation_time).toSec(), (last_valid_control_ - update_time).toSec());
+          }
+          last_cmd_vel_ = cmd_vel;
+          have_last_cmd_vel_ = true;
           if(recovery_trigger_ == CONTROLLING_R)
             recovery_index_ = 0;
         }
@@ -998,8 +1381,25 @@ namespace move_base {
         ROS_DEBUG_NAMED("move_base","In clearing/recovery state");
 
         //we'll invoke whatever recovery behavior we're currently on if they're enabled
+        if(recovery_behavior_enabled_ && !recovery_behaviors_loaded_){
+          ros::WallTime recovery_begin = ros::WallTime::now();
+          loadRecoveryBehaviorsOnce();
+          ROS_INFO("Loaded %zu recovery behaviors on first use in %.3f s", recovery_behaviors_.size(),
+                   (ros::WallTime::now() - recovery_begin).toSec());
+        }
         if(recovery_behavior_enabled_ && recovery_index_ < recovery_behaviors_.size()){
           ROS_DEBUG_NAMED("move_base_recovery","Executing behavior %u of %zu", recovery_index_, recovery_behaviors_.size());
+
+          recovery_behaviors_[recovery_index_]->setLocalPlanner(tc_);
+
+          //keep servicing goals, preemption and feedback while the behavior runs, if it can be run that way,
+          //ticking it from the next cycle on
+          if(asynchronous_recovery_ && recovery_behaviors_[recovery_index_]->start()){
+            running_recovery_ = recovery_behaviors_[recovery_index_];
+            recovery_index_++;
+            break;
+          }
+
           recovery_behaviors_[recovery_index_]->runBehavior();
 
           //we at least want to give the robot some time to stop oscillating after executing the behavior
@@ -1136,6 +1536,16 @@ namespace move_base {
     return true;
   }
 
+  //load the recovery behaviors from the parameter server the first time they are needed, or the defaults without any
+  void MoveBase::loadRecoveryBehaviorsOnce(){
+    if(recovery_behaviors_loaded_)
+      return;
+    if(!loadRecoveryBehaviors(ros::NodeHandle("~"))){
+      loadDefaultRecoveryBehaviors();
+    }
+    recovery_behaviors_loaded_ = true;
+  }
+
   //we'll load our default recovery behaviors here
   void MoveBase::loadDefaultRecoveryBehaviors(){
     recovery_behaviors_.clear();
@@ -1173,10 +1583,72 @@ namespace move_base {
     return;
   }
 
+  void MoveBase::cancelRecovery(){
+    if(running_recovery_){
+      ROS_DEBUG_NAMED("move_base_recovery","Cancelling the running recovery behavior");
+      running_recovery_->cancel();
+      running_recovery_.reset();
+      publishZeroVelocity();
+    }
+  }
+
+  void MoveBase::setCostmapsIdle(bool idle){
+    planner_costmap_ros_->throttleUpdates(idle ? idle_planner_costmap_frequency_ : 0.0);
+    controller_costmap_ros_->throttleUpdates(idle ? idle_controller_costmap_frequency_ : 0.0);
+  }
+
+  bool MoveBase::advanceWaypoint(geometry_msgs::PoseStamped& goal, bool need_plan){
+    boost::unique_lock<boost::mutex> lock(planner_mutex_);
+    if(waypoints_.empty())
+      return false;
+
+    //the plan made ahead only counts if it starts from the goal being left
+    nav_core::PlanConstPtr next_plan;
+    if(next_plan_ && next_plan_start_.header.frame_id == goal.header.frame_id && distance(next_plan_start_, goal) == 0.0)
+      next_plan = next_plan_;
+    if(need_plan && !next_plan)
+      return false;
+
+    goal = waypoints_.front();
+    waypoints_.pop_front();
+    next_plan_.reset();
+    ++waypoints_version_;
+    if(goal.header.frame_id != planner_costmap_ros_->getGlobalFrameID())
+      goal = goalToGlobalFrame(goal);
+
+    planner_goal_ = goal;
+    runPlanner_ = true;
+    last_valid_plan_ = ros::Time::now();
+    planner_cond_.notify_one();
+    lock.unlock();
+
+    ROS_DEBUG_NAMED("move_base","Going on to the next waypoint, x: %.2f, y: %.2f", goal.pose.position.x, goal.pose.position.y);
+    current_goal_pub_.publish(goal);
+    recovery_index_ = 0;
+    last_valid_control_ = ros::Time::now();
+    last_oscillation_reset_ = ros::Time::now();
+
+    //the controller takes the plan made ahead next cycle, as it would one from the planner, and keeps moving
+    if(next_plan){
+      boost::atomic_store(&latest_plan_, next_plan);
+      ++latest_plan_version_;
+    }
+    else{
+      publishZeroVelocity();
+      state_ = PLANNING;
+    }
+    return true;
+  }
+
   void MoveBase::resetState(){
-    // Disable the planner thread
+    cancelRecovery();
+
+    // Disable the planner thread, and drop any waypoints left
     boost::unique_lock<boost::mutex> lock(planner_mutex_);
     runPlanner_ = false;
+    waypoints_.clear();
+    next_plan_.reset();
+    ++waypoints_version_;
     lock.unlock();
 
     // Reset statemachine
@@ -1184,6 +1656,7 @@ namespace move_base {
     recovery_index_ = 0;
     recovery_trigger_ = PLANNING_R;
     publishZeroVelocity();
+    setCostmapsIdle(true);
 
     //if we shutdown our costmaps when we're deactivated... we'll do that now
     if(shutdown_costmaps_){
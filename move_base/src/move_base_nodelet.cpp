@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2013, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <move_base/move_base.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+namespace move_base {
+  /**
+   * @class MoveBaseNodelet
+   * @brief move_base as a nodelet, so the costmaps receive the map, scans and
+   * clouds published by nodelets in the same manager without a copy.
+   *
+   * MoveBase, its costmaps and its plugins read their parameters from the
+   * private namespace of the process, ~, rather than of the nodelet, so the
+   * manager is to be started under the name move_base would have had.
+   */
+  class MoveBaseNodelet : public nodelet::Nodelet {
+    public:
+      virtual ~MoveBaseNodelet(){
+        move_base_.reset();
+        tf_.reset();
+      }
+
+    private:
+      virtual void onInit(){
+        tf_.reset(new tf::TransformListener(ros::Duration(10)));
+        move_base_.reset(new MoveBase(*tf_));
+      }
+
+      boost::shared_ptr<tf::TransformListener> tf_;
+      boost::shared_ptr<MoveBase> move_base_;
+  };
+};
+
+PLUGINLIB_EXPORT_CLASS(move_base::MoveBaseNodelet, nodelet::Nodelet)
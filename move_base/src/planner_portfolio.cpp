@@ -0,0 +1,198 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <move_base/planner_portfolio.h>
+
+#include <cmath>
+
+namespace move_base {
+
+  static double planLength(const std::vector<geometry_msgs::PoseStamped>& plan){
+    double length = 0.0;
+    for(unsigned int i = 1; i < plan.size(); ++i){
+      length += hypot(plan[i].pose.position.x - plan[i - 1].pose.position.x,
+          plan[i].pose.position.y - plan[i - 1].pose.position.y);
+    }
+    return length;
+  }
+
+  PlannerPortfolio::PlannerPortfolio() : costmap_ros_(NULL), race_(0), shutdown_(false) {}
+
+  PlannerPortfolio::~PlannerPortfolio(){
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      shutdown_ = true;
+      race_cond_.notify_all();
+    }
+    for(unsigned int i = 0; i < members_.size(); ++i){
+      members_[i]->thread->join();
+      delete members_[i]->thread;
+      delete members_[i];
+    }
+  }
+
+  unsigned int PlannerPortfolio::initialize(const std::vector<std::string>& planners,
+      pluginlib::ClassLoader<nav_core::BaseGlobalPlanner>& loader, costmap_2d::Costmap2DROS* costmap_ros){
+    costmap_ros_ = costmap_ros;
+    costmap_2d::Costmap2D* costmap = costmap_ros->getCostmap();
+    for(unsigned int i = 0; i < planners.size(); ++i){
+      Member* member = new Member();
+      member->name = loader.getName(planners[i]);
+      member->version = 0;
+      member->busy = false;
+      member->race = 0;
+      member->found = false;
+      try {
+        member->planner = loader.createInstance(planners[i]);
+        {
+          boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(costmap->getMutex()));
+          member->costmap.updateCopy(*costmap, member->version);
+        }
+        if(!member->planner->initializeOnCostmap(member->name, &member->costmap, costmap_ros->getGlobalFrameID())){
+          ROS_WARN("The planner %s can't plan on a copy of the costmap, leaving it out of the portfolio", member->name.c_str());
+          delete member;
+          continue;
+        }
+      } catch (const pluginlib::PluginlibException& ex) {
+        ROS_ERROR("Failed to create the %s planner for the portfolio: %s", planners[i].c_str(), ex.what());
+        delete member;
+        continue;
+      }
+      member->thread = new boost::thread(boost::bind(&PlannerPortfolio::memberThread, this, member));
+      members_.push_back(member);
+    }
+    return members_.size();
+  }
+
+  void PlannerPortfolio::memberThread(Member* member){
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    unsigned long done = 0;
+    while(true){
+      while(!shutdown_ && member->race == done)
+        race_cond_.wait(lock);
+      if(shutdown_)
+        return;
+      done = member->race;
+      geometry_msgs::PoseStamped start = member->start, goal = member->goal;
+      ros::Time deadline = member->deadline;
+      lock.unlock();
+
+      std::vector<geometry_msgs::PoseStamped> plan;
+      bool found;
+      if(!deadline.isZero()){
+        double quality;
+        found = member->planner->makePlan(start, goal, deadline, plan, quality);
+      }
+      else
+        found = member->planner->makePlan(start, goal, plan);
+
+      lock.lock();
+      member->found = found && !plan.empty();
+      member->plan.swap(plan);
+      member->busy = false;
+      done_cond_.notify_all();
+    }
+  }
+
+  bool PlannerPortfolio::makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+      const ros::Time& deadline, std::vector<geometry_msgs::PoseStamped>& plan){
+    plan.clear();
+    std::vector<Member*> racing;
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      for(unsigned int i = 0; i < members_.size(); ++i){
+        if(!members_[i]->busy)
+          racing.push_back(members_[i]);
+      }
+    }
+    if(racing.empty()){
+      ROS_WARN("Every planner of the portfolio is still busy with an earlier plan");
+      return false;
+    }
+
+    //the copies of idle planners are theirs to update
+    {
+      costmap_2d::Costmap2D* costmap = costmap_ros_->getCostmap();
+      boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(costmap->getMutex()));
+      for(unsigned int i = 0; i < racing.size(); ++i)
+        racing[i]->costmap.updateCopy(*costmap, racing[i]->version);
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    ++race_;
+    for(unsigned int i = 0; i < racing.size(); ++i){
+      Member* member = racing[i];
+      member->busy = true;
+      member->race = race_;
+      member->start = start;
+      member->goal = goal;
+      member->deadline = deadline;
+      member->found = false;
+    }
+    race_cond_.notify_all();
+
+    Member* best = NULL;
+    while(true){
+      unsigned int pending = 0;
+      double best_length = 0.0;
+      best = NULL;
+      for(unsigned int i = 0; i < racing.size(); ++i){
+        Member* member = racing[i];
+        if(member->busy)
+          ++pending;
+        else if(member->found){
+          double length = planLength(member->plan);
+          if(best == NULL || length < best_length){
+            best = member;
+            best_length = length;
+          }
+        }
+      }
+
+      ros::Duration left = deadline - ros::Time::now();
+      if(pending == 0 || (best != NULL && (deadline.isZero() || left <= ros::Duration(0))))
+        break;
+      if(best == NULL || left <= ros::Duration(0))
+        done_cond_.wait(lock);
+      else
+        done_cond_.timed_wait(lock, boost::posix_time::microseconds(left.toNSec() / 1000));
+    }
+
+    if(best == NULL)
+      return false;
+    ROS_DEBUG_NAMED("move_base", "The %s planner won the race with a plan of %zu poses", best->name.c_str(), best->plan.size());
+    plan = best->plan;
+    return true;
+  }
+};
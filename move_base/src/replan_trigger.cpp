@@ -0,0 +1,121 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <move_base/replan_trigger.h>
+
+#include <cmath>
+#include <utility>
+
+#include <costmap_2d/cost_values.h>
+
+namespace move_base {
+
+  ReplanTrigger::ReplanTrigger()
+    : corridor_(0.5), cost_increase_(10.0), max_frequency_(1.0), plan_version_(0), plan_cost_(0.0),
+      last_cost_(0.0), pending_(false) {}
+
+  void ReplanTrigger::setParameters(double corridor, double cost_increase, double max_frequency){
+    corridor_ = corridor;
+    cost_increase_ = cost_increase;
+    max_frequency_ = max_frequency;
+  }
+
+  bool ReplanTrigger::check(const costmap_2d::Costmap2D& costmap,
+                            const std::vector<costmap_2d::LayeredCostmap::Region>& regions,
+                            const std::vector<geometry_msgs::PoseStamped>& plan, unsigned long version,
+                            const ros::Time& now){
+    if((regions.empty() && !pending_) || plan.empty())
+      return false;
+
+    int corridor = (int)std::ceil(corridor_ / costmap.getResolution());
+
+    //the cells of the plan, and whether the update changed any near them
+    std::vector<std::pair<unsigned int, unsigned int> > cells;
+    cells.reserve(plan.size());
+    bool changed = pending_;
+    for(unsigned int i = 0; i < plan.size(); ++i){
+      unsigned int mx, my;
+      if(!costmap.worldToMap(plan[i].pose.position.x, plan[i].pose.position.y, mx, my))
+        continue;
+      if(!cells.empty() && cells.back().first == mx && cells.back().second == my)
+        continue;
+      cells.push_back(std::make_pair(mx, my));
+      for(unsigned int r = 0; r < regions.size() && !changed; ++r){
+        const costmap_2d::LayeredCostmap::Region& region = regions[r];
+        changed = (int)mx >= region.x0 - corridor && (int)mx < region.xn + corridor &&
+                  (int)my >= region.y0 - corridor && (int)my < region.yn + corridor;
+      }
+    }
+    if(cells.empty() || (!changed && version == plan_version_))
+      return false;
+
+    //the mean cost of the cells of the plan, leaving out unknown ones, and whether any is in collision
+    double cost = 0.0;
+    unsigned int known = 0;
+    bool blocked = false;
+    for(unsigned int i = 0; i < cells.size(); ++i){
+      unsigned char c = costmap.getCost(cells[i].first, cells[i].second);
+      if(c == costmap_2d::NO_INFORMATION)
+        continue;
+      blocked = blocked || c >= costmap_2d::INSCRIBED_INFLATED_OBSTACLE;
+      cost += c;
+      ++known;
+    }
+    if(known > 0)
+      cost /= known;
+    last_cost_ = cost;
+
+    //a new plan is measured against itself as the first update after it found it
+    if(version != plan_version_){
+      plan_version_ = version;
+      plan_cost_ = cost;
+      pending_ = false;
+      return false;
+    }
+
+    if(!pending_ && !blocked && cost <= plan_cost_ + cost_increase_)
+      return false;
+
+    //hold the replan back to max_frequency
+    pending_ = true;
+    double max_frequency = max_frequency_;
+    return max_frequency <= 0 || now >= last_replan_ + ros::Duration(1.0 / max_frequency);
+  }
+
+  void ReplanTrigger::replanned(const ros::Time& now){
+    pending_ = false;
+    last_replan_ = now;
+  }
+
+};
@@ -0,0 +1,674 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*
+*********************************************************************/
+/**
+ * Replays a bag through the costmaps and planners of move_base in bag time, as fast as they run,
+ * and reports what each of them cost:
+ *
+ *   make move_base_replay_benchmark
+ *   rosrun move_base move_base_replay_benchmark <bag> [output.json]
+ *
+ * The node is called move_base and reads move_base's parameters, so load the same parameter files:
+ * the global_costmap and local_costmap, base_global_planner, base_local_planner, planner_frequency
+ * and controller_frequency.  Each costmap is updated at its update_frequency of bag time (which is
+ * set to 0 on the parameter server so that its own update thread stays idle), or just before its
+ * planner runs if that is 0.  TF, map to odom included, comes from the bag and goes straight into the
+ * listener; the goals are the geometry_msgs/PoseStamped on ~goal_topic (move_base_simple/goal), and
+ * every other topic is published, latched, in this process for the layers and the local planner,
+ * so the map has to be in the bag too.  The stack is built once the transforms and the first map
+ * are in, on a clock that moves until it is, so that the static layer's wait for the map ends.  It
+ * needs a master for the parameters and topics, and must not share it with a running move_base.
+ *
+ * Everything runs on this thread, bar the executor's workers, in bag order: a scan or cloud is
+ * handed over only once the transforms it needs are in, and dropped if they aren't within
+ * ~transform_tolerance of bag time, so two runs of a bag do the same work.  The report, one JSON
+ * object, gives for each component its calls, failures, process CPU time, p50/p99/max latency, how
+ * far the peak RSS rose during its calls, and an FNV-1a checksum of its outputs (the costmap cells,
+ * the plans, the velocity commands), so runs can be compared for speed and for sameness.  Keep the
+ * observation hub's separate_source_threads off, or the layers see the data in varying order.
+ * AMCL has its own, amcl --benchmark-from-bag, which reports the same figures for its scans.
+ */
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <costmap_2d/costmap_2d_ros.h>
+#include <nav_core/base_global_planner.h>
+#include <nav_core/base_local_planner.h>
+#include <pluginlib/class_loader.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <topic_tools/shape_shifter.h>
+#include <tf/transform_listener.h>
+#include <tf2_msgs/TFMessage.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/Twist.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <time.h>
+
+namespace {
+
+  // Gives access to the tf2 buffer inside the listener, so that the bag's
+  // transforms go in without a round trip through /tf
+  struct BagTransformListener : public tf::TransformListener {
+    tf2_ros::Buffer& getBuffer() { return tf2_buffer_; }
+  };
+
+  // CPU time of the whole process, workers included, in seconds
+  double processCpuTime(){
+    timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+  }
+
+  // Peak resident set size of the process, in kB
+  long peakRss(){
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+  }
+
+  // Value at fraction p of the way through a sorted sample
+  double percentile(const std::vector<double>& sorted, double p){
+    if(sorted.empty())
+      return 0.0;
+    return sorted[std::min(sorted.size() - 1, (size_t) (p * sorted.size()))];
+  }
+
+  // A JSON string body for s, with quotes, backslashes and control characters escaped
+  std::string jsonEscape(const std::string& s){
+    std::string e;
+    for(size_t i = 0; i < s.size(); ++i){
+      unsigned char c = s[i];
+      if(c == '"' || c == '\\'){
+        e += '\\';
+        e += c;
+      }
+      else if(c < 0x20){
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        e += buf;
+      }
+      else
+        e += c;
+    }
+    return e;
+  }
+
+  // FNV-1a over the outputs of a component
+  class Checksum {
+    public:
+      Checksum() : hash_(14695981039346656037ULL) {}
+
+      void add(const void* data, size_t size){
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for(size_t i = 0; i < size; ++i)
+          hash_ = (hash_ ^ bytes[i]) * 1099511628211ULL;
+      }
+
+      void add(double value){ add(&value, sizeof(value)); }
+
+      uint64_t value() const { return hash_; }
+
+    private:
+      uint64_t hash_;
+  };
+
+  // What one component cost over the run
+  struct Component {
+    explicit Component(const std::string& name) : name(name), failures(0), cpu_time(0.0), rss_growth(0) {}
+
+    std::string name;
+    std::vector<double> latencies;
+    int failures;
+    double cpu_time;
+    long rss_growth;  // kB the peak RSS rose by during the calls
+    Checksum outputs;
+  };
+
+  // Charges one call, from construction to destruction, to a component
+  class CallTimer {
+    public:
+      explicit CallTimer(Component* component) :
+        component_(component), wall_start_(ros::WallTime::now()), cpu_start_(processCpuTime()), rss_start_(peakRss()) {}
+
+      ~CallTimer(){
+        component_->latencies.push_back((ros::WallTime::now() - wall_start_).toSec());
+        component_->cpu_time += processCpuTime() - cpu_start_;
+        component_->rss_growth += peakRss() - rss_start_;
+      }
+
+    private:
+      Component* component_;
+      ros::WallTime wall_start_;
+      double cpu_start_;
+      long rss_start_;
+  };
+
+  // Moves the clock on while it lives, so that a plugin that waits on a
+  // ros::Rate while it is set up, as the static layer does for its first map,
+  // isn't stuck on a clock that only the bag moves; bag time is back after
+  class ClockAdvancer {
+    public:
+      ClockAdvancer() : start_(ros::Time::now()), done_(false),
+        thread_(boost::bind(&ClockAdvancer::advance, this)) {}
+
+      ~ClockAdvancer(){
+        done_ = true;
+        thread_.join();
+        ros::Time::setNow(start_);
+      }
+
+    private:
+      void advance(){
+        // ten times as fast as the wall clock
+        for(ros::Time now = start_; !done_; boost::this_thread::sleep(boost::posix_time::milliseconds(1))){
+          now += ros::Duration(0.01);
+          ros::Time::setNow(now);
+        }
+      }
+
+      ros::Time start_;
+      boost::atomic<bool> done_;
+      boost::thread thread_;
+  };
+
+  // A costmap and when it is next due for an update
+  struct ReplayCostmap {
+    explicit ReplayCostmap(const std::string& name) : name(name), costmap_ros(NULL), stats(name) {}
+
+    std::string name;
+    costmap_2d::Costmap2DROS* costmap_ros;
+    std::string global_frame;
+    std::string robot_base_frame;
+    ros::Duration period;  // zero to update just before the planner runs
+    ros::Time due;
+    Component stats;
+  };
+
+  // A scan or cloud waiting for its transforms
+  struct PendingMessage {
+    std::string topic;
+    topic_tools::ShapeShifter::ConstPtr message;
+    std::string frame_id;
+    ros::Time stamp;
+  };
+
+  class ReplayBenchmark {
+    public:
+      ReplayBenchmark(BagTransformListener& tf);
+      ~ReplayBenchmark();
+
+      void run(const rosbag::View& view);
+      void report(const std::string& bag_file, const std::string& output_file);
+
+    private:
+      // The costmaps and planners are made once the transforms they wait for are in
+      bool transformsReady();
+      void buildStack();
+
+      void handleMessage(const rosbag::MessageInstance& msg);
+      void publishReady();
+      void publish(const std::string& topic, const topic_tools::ShapeShifter& message);
+
+      // Runs whatever is due up to now, in order of due time
+      void runDue(const ros::Time& now);
+      void updateCostmap(ReplayCostmap& costmap);
+      void plan();
+      void control();
+
+      BagTransformListener& tf_;
+      ros::NodeHandle nh_, private_nh_;
+      std::string goal_topic_;
+      ros::Duration transform_tolerance_;
+
+      pluginlib::ClassLoader<nav_core::BaseGlobalPlanner> bgp_loader_;
+      pluginlib::ClassLoader<nav_core::BaseLocalPlanner> blp_loader_;
+      boost::shared_ptr<nav_core::BaseGlobalPlanner> planner_;
+      boost::shared_ptr<nav_core::BaseLocalPlanner> tc_;
+      std::vector<ReplayCostmap*> costmaps_;  // the global costmap, then the local one
+      bool built_;
+      bool map_pending_;  // a map in the bag hasn't been published yet
+
+      std::map<std::string, ros::Publisher> publishers_;
+      std::deque<PendingMessage> pending_;
+      int dropped_messages_;
+
+      ros::Duration planner_period_, controller_period_;  // zero planner period: plan once per goal
+      ros::Time plan_due_, control_due_;  // zero when nothing is due
+      bool have_goal_;
+      geometry_msgs::PoseStamped goal_;
+      int goals_;
+      int goals_reached_;
+
+      Component callbacks_, planner_stats_, controller_stats_;
+      ros::WallTime start_;
+      ros::Duration bag_duration_;
+  };
+
+  ReplayBenchmark::ReplayBenchmark(BagTransformListener& tf) :
+    tf_(tf), private_nh_("~"),
+    bgp_loader_("nav_core", "nav_core::BaseGlobalPlanner"),
+    blp_loader_("nav_core", "nav_core::BaseLocalPlanner"),
+    built_(false), map_pending_(false), dropped_messages_(0), have_goal_(false), goals_(0), goals_reached_(0),
+    callbacks_("callbacks"), planner_stats_("global_planner"), controller_stats_("local_planner") {
+    private_nh_.param("goal_topic", goal_topic_, std::string("move_base_simple/goal"));
+    goal_topic_ = ros::names::resolve(goal_topic_);
+    double transform_tolerance;
+    private_nh_.param("transform_tolerance", transform_tolerance, 0.5);
+    transform_tolerance_ = ros::Duration(transform_tolerance);
+
+    double planner_frequency, controller_frequency;
+    private_nh_.param("planner_frequency", planner_frequency, 0.0);
+    private_nh_.param("controller_frequency", controller_frequency, 20.0);
+    if(planner_frequency > 0.0)
+      planner_period_ = ros::Duration(1.0 / planner_frequency);
+    controller_period_ = ros::Duration(1.0 / std::max(controller_frequency, 1e-3));
+
+    // Take over the costmaps' update rates, so that their update threads
+    // don't run when the Costmap2DROS reads them
+    const char* names[] = {"global_costmap", "local_costmap"};
+    for(unsigned int i = 0; i < 2; ++i){
+      ReplayCostmap* costmap = new ReplayCostmap(names[i]);
+      ros::NodeHandle costmap_nh(private_nh_, costmap->name);
+      double update_frequency;
+      costmap_nh.param("update_frequency", update_frequency, 5.0);
+      costmap_nh.setParam("update_frequency", 0.0);
+      if(update_frequency > 0.0)
+        costmap->period = ros::Duration(1.0 / update_frequency);
+      costmap_nh.param("global_frame", costmap->global_frame, std::string("/map"));
+      costmap_nh.param("robot_base_frame", costmap->robot_base_frame, std::string("base_link"));
+      costmaps_.push_back(costmap);
+    }
+  }
+
+  ReplayBenchmark::~ReplayBenchmark(){
+    tc_.reset();
+    planner_.reset();
+    for(unsigned int i = 0; i < costmaps_.size(); ++i){
+      delete costmaps_[i]->costmap_ros;
+      delete costmaps_[i];
+    }
+  }
+
+  bool ReplayBenchmark::transformsReady(){
+    for(unsigned int i = 0; i < costmaps_.size(); ++i){
+      if(!tf_.canTransform(costmaps_[i]->global_frame, costmaps_[i]->robot_base_frame, ros::Time()))
+        return false;
+    }
+    return true;
+  }
+
+  void ReplayBenchmark::buildStack(){
+    ReplayCostmap& global = *costmaps_[0];
+    ReplayCostmap& local = *costmaps_[1];
+    std::string global_planner, local_planner;
+    private_nh_.param("base_global_planner", global_planner, std::string("navfn/NavfnROS"));
+    private_nh_.param("base_local_planner", local_planner, std::string("base_local_planner/TrajectoryPlannerROS"));
+    {
+      ClockAdvancer advancer;
+      global.costmap_ros = new costmap_2d::Costmap2DROS(global.name, tf_);
+      local.costmap_ros = new costmap_2d::Costmap2DROS(local.name, tf_);
+
+      planner_ = bgp_loader_.createInstance(global_planner);
+      planner_->initialize(bgp_loader_.getName(global_planner), global.costmap_ros);
+      tc_ = blp_loader_.createInstance(local_planner);
+      tc_->initialize(blp_loader_.getName(local_planner), &tf_, local.costmap_ros);
+    }
+
+    ros::Time now = ros::Time::now();
+    for(unsigned int i = 0; i < costmaps_.size(); ++i){
+      if(!costmaps_[i]->period.isZero())
+        costmaps_[i]->due = now;
+    }
+    built_ = true;
+    ROS_INFO("Replaying into %s and %s from %.3f", global_planner.c_str(), local_planner.c_str(), now.toSec());
+  }
+
+  void ReplayBenchmark::run(const rosbag::View& view){
+    start_ = ros::WallTime::now();
+    bag_duration_ = view.getEndTime() - view.getBeginTime();
+
+    // the static layers wait for the map while they are built, so it goes out first
+    std::vector<const rosbag::ConnectionInfo*> connections = view.getConnections();
+    for(unsigned int i = 0; i < connections.size(); ++i)
+      map_pending_ = map_pending_ || connections[i]->datatype == "nav_msgs/OccupancyGrid";
+
+    BOOST_FOREACH(rosbag::MessageInstance const msg, view){
+      if(!ros::ok())
+        break;
+      if(built_)
+        runDue(msg.getTime());
+      ros::Time::setNow(msg.getTime());
+      handleMessage(msg);
+      if(!built_ && !map_pending_ && transformsReady())
+        buildStack();
+      if(built_)
+        publishReady();
+    }
+    dropped_messages_ += pending_.size();
+    pending_.clear();
+  }
+
+  void ReplayBenchmark::handleMessage(const rosbag::MessageInstance& msg){
+    tf2_msgs::TFMessage::ConstPtr tf_msg = msg.instantiate<tf2_msgs::TFMessage>();
+    if(tf_msg != NULL){
+      bool is_static = msg.getTopic() == "/tf_static";
+      for(unsigned int i = 0; i < tf_msg->transforms.size(); ++i)
+        tf_.getBuffer().setTransform(tf_msg->transforms[i], "rosbag_authority", is_static);
+      return;
+    }
+
+    if(msg.getTopic() == goal_topic_){
+      geometry_msgs::PoseStamped::ConstPtr goal = msg.instantiate<geometry_msgs::PoseStamped>();
+      if(goal == NULL)
+        return;
+      goal_ = *goal;
+      have_goal_ = true;
+      plan_due_ = msg.getTime();
+      ++goals_;
+      return;
+    }
+
+    // Scans and clouds wait for the transforms into every costmap's frame;
+    // anything else goes out now
+    PendingMessage pending;
+    pending.topic = msg.getTopic();
+    pending.message = msg.instantiate<topic_tools::ShapeShifter>();
+    const std::string& type = msg.getDataType();
+    if(type == "sensor_msgs/LaserScan"){
+      sensor_msgs::LaserScan::ConstPtr scan = msg.instantiate<sensor_msgs::LaserScan>();
+      pending.frame_id = scan->header.frame_id;
+      pending.stamp = scan->header.stamp;
+    }
+    else if(type == "sensor_msgs/PointCloud2"){
+      sensor_msgs::PointCloud2::ConstPtr cloud = msg.instantiate<sensor_msgs::PointCloud2>();
+      pending.frame_id = cloud->header.frame_id;
+      pending.stamp = cloud->header.stamp;
+    }
+    else if(type == "sensor_msgs/PointCloud"){
+      sensor_msgs::PointCloud::ConstPtr cloud = msg.instantiate<sensor_msgs::PointCloud>();
+      pending.frame_id = cloud->header.frame_id;
+      pending.stamp = cloud->header.stamp;
+    }
+    else {
+      if(type == "nav_msgs/OccupancyGrid")
+        map_pending_ = false;
+      publish(pending.topic, *pending.message);
+      return;
+    }
+    pending_.push_back(pending);
+  }
+
+  void ReplayBenchmark::publishReady(){
+    // Each topic keeps its own order: a message waits behind an earlier one
+    // on its topic, but not behind other topics
+    std::vector<std::string> waiting;
+    ros::Time now = ros::Time::now();
+    for(std::deque<PendingMessage>::iterator it = pending_.begin(); it != pending_.end();){
+      if(std::find(waiting.begin(), waiting.end(), it->topic) != waiting.end()){
+        ++it;
+        continue;
+      }
+
+      bool ready = true;
+      for(unsigned int i = 0; i < costmaps_.size() && ready; ++i)
+        ready = tf_.canTransform(costmaps_[i]->global_frame, it->frame_id, it->stamp);
+      if(ready)
+        publish(it->topic, *it->message);
+      else if(now - it->stamp > transform_tolerance_)
+        ++dropped_messages_;
+      else {
+        waiting.push_back(it->topic);
+        ++it;
+        continue;
+      }
+      it = pending_.erase(it);
+    }
+  }
+
+  void ReplayBenchmark::publish(const std::string& topic, const topic_tools::ShapeShifter& message){
+    std::map<std::string, ros::Publisher>::iterator it = publishers_.find(topic);
+    if(it == publishers_.end())
+      it = publishers_.insert(std::make_pair(topic, message.advertise(nh_, topic, 100, true))).first;
+    it->second.publish(message);
+
+    // The subscribers run now, in this thread, and are charged to callbacks
+    CallTimer timer(&callbacks_);
+    ros::getGlobalCallbackQueue()->callAvailable();
+  }
+
+  void ReplayBenchmark::runDue(const ros::Time& now){
+    while(ros::ok()){
+      // The earliest of the costmap updates, the plan and the control cycle
+      ros::Time next;
+      int which = -1;
+      for(unsigned int i = 0; i < costmaps_.size(); ++i){
+        if(!costmaps_[i]->due.isZero() && (which < 0 || costmaps_[i]->due < next)){
+          next = costmaps_[i]->due;
+          which = i;
+        }
+      }
+      if(!plan_due_.isZero() && (which < 0 || plan_due_ < next)){
+        next = plan_due_;
+        which = costmaps_.size();
+      }
+      if(!control_due_.isZero() && (which < 0 || control_due_ < next)){
+        next = control_due_;
+        which = costmaps_.size() + 1;
+      }
+      if(which < 0 || next > now)
+        return;
+
+      ros::Time::setNow(next);
+      if(which < (int) costmaps_.size()){
+        ReplayCostmap& costmap = *costmaps_[which];
+        updateCostmap(costmap);
+        costmap.due += costmap.period;
+      }
+      else if(which == (int) costmaps_.size()){
+        plan();
+        plan_due_ = planner_period_.isZero() || !have_goal_ ? ros::Time() : plan_due_ + planner_period_;
+      }
+      else {
+        control();
+        control_due_ = have_goal_ ? control_due_ + controller_period_ : ros::Time();
+      }
+    }
+  }
+
+  void ReplayBenchmark::updateCostmap(ReplayCostmap& costmap){
+    {
+      CallTimer timer(&costmap.stats);
+      costmap.costmap_ros->updateMap();
+    }
+    costmap_2d::Costmap2D* grid = costmap.costmap_ros->getCostmap();
+    costmap.stats.outputs.add(grid->getCharMap(), grid->getSizeInCellsX() * grid->getSizeInCellsY());
+  }
+
+  void ReplayBenchmark::plan(){
+    if(!have_goal_)
+      return;
+    ReplayCostmap& global = *costmaps_[0];
+    if(global.period.isZero())
+      updateCostmap(global);
+
+    tf::Stamped<tf::Pose> global_pose;
+    if(!global.costmap_ros->getLayeredCostmap()->isInitialized() || !global.costmap_ros->getRobotPose(global_pose)){
+      ++planner_stats_.failures;
+      return;
+    }
+    geometry_msgs::PoseStamped start, goal;
+    tf::poseStampedTFToMsg(global_pose, start);
+
+    // as move_base does, plan to the goal in the costmap's frame
+    tf::Stamped<tf::Pose> goal_pose, global_goal;
+    tf::poseStampedMsgToTF(goal_, goal_pose);
+    goal_pose.stamp_ = ros::Time();
+    try {
+      tf_.transformPose(global.costmap_ros->getGlobalFrameID(), goal_pose, global_goal);
+    }
+    catch(tf::TransformException&){
+      ++planner_stats_.failures;
+      return;
+    }
+    tf::poseStampedTFToMsg(global_goal, goal);
+
+    std::vector<geometry_msgs::PoseStamped> plan;
+    bool got_plan;
+    {
+      CallTimer timer(&planner_stats_);
+      got_plan = planner_->makePlan(start, goal, plan) && !plan.empty();
+    }
+    if(!got_plan){
+      ++planner_stats_.failures;
+      return;
+    }
+    for(unsigned int i = 0; i < plan.size(); ++i){
+      planner_stats_.outputs.add(plan[i].pose.position.x);
+      planner_stats_.outputs.add(plan[i].pose.position.y);
+      planner_stats_.outputs.add(tf::getYaw(plan[i].pose.orientation));
+    }
+    tc_->setPlan(plan);
+    if(control_due_.isZero())
+      control_due_ = ros::Time::now();
+  }
+
+  void ReplayBenchmark::control(){
+    ReplayCostmap& local = *costmaps_[1];
+    if(local.period.isZero())
+      updateCostmap(local);
+
+    if(tc_->isGoalReached()){
+      have_goal_ = false;
+      ++goals_reached_;
+      return;
+    }
+
+    geometry_msgs::Twist cmd_vel;
+    bool got_command;
+    {
+      CallTimer timer(&controller_stats_);
+      got_command = tc_->computeVelocityCommands(cmd_vel);
+    }
+    if(!got_command)
+      ++controller_stats_.failures;
+    controller_stats_.outputs.add(got_command ? 1.0 : 0.0);
+    controller_stats_.outputs.add(cmd_vel.linear.x);
+    controller_stats_.outputs.add(cmd_vel.linear.y);
+    controller_stats_.outputs.add(cmd_vel.angular.z);
+  }
+
+  void ReplayBenchmark::report(const std::string& bag_file, const std::string& output_file){
+    double replay_time = (ros::WallTime::now() - start_).toSec();
+    std::vector<const Component*> components;
+    components.push_back(&callbacks_);
+    for(unsigned int i = 0; i < costmaps_.size(); ++i)
+      components.push_back(&costmaps_[i]->stats);
+    components.push_back(&planner_stats_);
+    components.push_back(&controller_stats_);
+
+    ROS_INFO("Replayed %.1f s of bag in %.3f s: %d goals, %d reached, %d messages dropped, peak RSS %ld kB",
+             bag_duration_.toSec(), replay_time, goals_, goals_reached_, dropped_messages_, peakRss());
+
+    // One JSON object, so that runs can be compared by a script
+    FILE* out = output_file.empty() ? stdout : fopen(output_file.c_str(), "w");
+    if(out == NULL){
+      ROS_ERROR("Couldn't open benchmark output %s", output_file.c_str());
+      return;
+    }
+    fprintf(out, "{\"bag\": \"%s\", \"bag_duration\": %.6f, \"replay_time\": %.6f, \"goals\": %d, "
+            "\"goals_reached\": %d, \"dropped_messages\": %d, \"max_rss_kb\": %ld, \"components\": [",
+            jsonEscape(bag_file).c_str(), bag_duration_.toSec(), replay_time, goals_, goals_reached_,
+            dropped_messages_, peakRss());
+    for(unsigned int i = 0; i < components.size(); ++i){
+      const Component& c = *components[i];
+      std::vector<double> sorted(c.latencies);
+      std::sort(sorted.begin(), sorted.end());
+      ROS_INFO("%s: %d calls (%d failed), %.3f s CPU, p50 %.3f ms, p99 %.3f ms, max %.3f ms, "
+               "peak RSS +%ld kB, checksum %016llx", c.name.c_str(), (int) sorted.size(), c.failures,
+               c.cpu_time, 1e3 * percentile(sorted, 0.5), 1e3 * percentile(sorted, 0.99),
+               1e3 * percentile(sorted, 1.0), c.rss_growth, (unsigned long long) c.outputs.value());
+      fprintf(out, "%s{\"name\": \"%s\", \"calls\": %d, \"failures\": %d, \"cpu_time\": %.6f, "
+              "\"latency_p50\": %.6f, \"latency_p99\": %.6f, \"latency_max\": %.6f, "
+              "\"rss_growth_kb\": %ld, \"checksum\": \"%016llx\"}", i == 0 ? "" : ", ",
+              jsonEscape(c.name).c_str(), (int) sorted.size(), c.failures, c.cpu_time,
+              percentile(sorted, 0.5), percentile(sorted, 0.99), percentile(sorted, 1.0), c.rss_growth,
+              (unsigned long long) c.outputs.value());
+    }
+    fprintf(out, "]}\n");
+    if(out != stdout)
+      fclose(out);
+  }
+
+}
+
+int main(int argc, char** argv){
+  ros::init(argc, argv, "move_base");
+  if(argc < 2){
+    fprintf(stderr, "usage: %s <bag> [output.json]\n", argv[0]);
+    return 1;
+  }
+
+  rosbag::Bag bag;
+  bag.open(argv[1], rosbag::bagmode::Read);
+  rosbag::View view(bag);
+  if(view.size() == 0){
+    ROS_ERROR("%s is empty", argv[1]);
+    return 1;
+  }
+
+  // Bag time from here on; only the building of the stack sleeps on it, on a clock of its own
+  ros::Time::setNow(view.getBeginTime());
+  BagTransformListener tf;
+  ReplayBenchmark benchmark(tf);
+  benchmark.run(view);
+  benchmark.report(argv[1], argc > 2 ? argv[2] : "");
+  bag.close();
+  return 0;
+}
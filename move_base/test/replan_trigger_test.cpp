@@ -0,0 +1,147 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <costmap_2d/cost_values.h>
+#include <move_base/replan_trigger.h>
+
+using namespace move_base;
+
+typedef std::vector<costmap_2d::LayeredCostmap::Region> Regions;
+
+// a straight plan along y = 1 m, across a 10 x 4 m costmap at 0.1 m
+static std::vector<geometry_msgs::PoseStamped> straightPlan()
+{
+  std::vector<geometry_msgs::PoseStamped> plan(50);
+  for(unsigned int i = 0; i < plan.size(); ++i){
+    plan[i].pose.position.x = 0.05 + i * 0.2;
+    plan[i].pose.position.y = 1.05;
+    plan[i].pose.orientation.w = 1.0;
+  }
+  return plan;
+}
+
+static Regions region(int x0, int xn, int y0, int yn)
+{
+  costmap_2d::LayeredCostmap::Region r;
+  r.x0 = x0;
+  r.xn = xn;
+  r.y0 = y0;
+  r.yn = yn;
+  return Regions(1, r);
+}
+
+// a plan is only measured on the first update after it was made, then fires once blocked, but not when the cells
+// that changed are away from it
+TEST(ReplanTrigger, firesWhenPlanBlocked){
+  costmap_2d::Costmap2D costmap(100, 40, 0.1, 0.0, 0.0, costmap_2d::FREE_SPACE);
+  std::vector<geometry_msgs::PoseStamped> plan = straightPlan();
+  ReplanTrigger trigger;
+  trigger.setParameters(0.5, 10.0, 0.0);
+
+  ros::Time now(100.0);
+  ASSERT_FALSE(trigger.check(costmap, region(0, 100, 0, 40), plan, 1, now));
+  ASSERT_EQ(0.0, trigger.planCost());
+
+  // an obstacle 2 m off the plan, out of the corridor
+  costmap.setCost(50, 30, costmap_2d::LETHAL_OBSTACLE);
+  ASSERT_FALSE(trigger.check(costmap, region(50, 51, 30, 31), plan, 1, now));
+
+  // an obstacle on the plan, but with no update near it
+  costmap.setCost(40, 10, costmap_2d::LETHAL_OBSTACLE);
+  ASSERT_FALSE(trigger.check(costmap, region(50, 51, 30, 31), plan, 1, now));
+  ASSERT_FALSE(trigger.check(costmap, Regions(), plan, 1, now));
+
+  ASSERT_TRUE(trigger.check(costmap, region(40, 41, 10, 11), plan, 1, now));
+  trigger.replanned(now);
+  ASSERT_FALSE(trigger.pending());
+
+  // the new plan is measured against itself, blocked or not
+  ASSERT_FALSE(trigger.check(costmap, region(40, 41, 10, 11), plan, 2, now));
+  ASSERT_GT(trigger.planCost(), 0.0);
+}
+
+// a rise of the mean cost of the plan fires past cost_increase only
+TEST(ReplanTrigger, firesOnCostIncrease){
+  costmap_2d::Costmap2D costmap(100, 40, 0.1, 0.0, 0.0, costmap_2d::FREE_SPACE);
+  std::vector<geometry_msgs::PoseStamped> plan = straightPlan();
+  ReplanTrigger trigger;
+  trigger.setParameters(0.5, 10.0, 0.0);
+  ros::Time now(100.0);
+  ASSERT_FALSE(trigger.check(costmap, region(0, 100, 0, 40), plan, 1, now));
+
+  // 5 of the 50 cells of the plan go to 50, a mean of 5
+  for(int i = 0; i < 5; ++i)
+    costmap.setCost(40 + 2 * i, 10, 50);
+  ASSERT_FALSE(trigger.check(costmap, region(40, 50, 10, 11), plan, 1, now));
+  ASSERT_DOUBLE_EQ(5.0, trigger.lastCost());
+
+  // 10 more, a mean of 15
+  for(int i = 0; i < 10; ++i)
+    costmap.setCost(60 + 2 * i, 10, 50);
+  ASSERT_TRUE(trigger.check(costmap, region(60, 80, 10, 11), plan, 1, now));
+  ASSERT_DOUBLE_EQ(15.0, trigger.lastCost());
+}
+
+// a replan held back by max_frequency stays pending, and fires on a later update once it is due, wherever that
+// update changed cells
+TEST(ReplanTrigger, holdsBackToMaxFrequency){
+  costmap_2d::Costmap2D costmap(100, 40, 0.1, 0.0, 0.0, costmap_2d::FREE_SPACE);
+  std::vector<geometry_msgs::PoseStamped> plan = straightPlan();
+  ReplanTrigger trigger;
+  trigger.setParameters(0.5, 10.0, 2.0);
+  ros::Time now(100.0);
+  ASSERT_FALSE(trigger.check(costmap, region(0, 100, 0, 40), plan, 1, now));
+
+  costmap.setCost(40, 10, costmap_2d::LETHAL_OBSTACLE);
+  ASSERT_TRUE(trigger.check(costmap, region(40, 41, 10, 11), plan, 1, now));
+  trigger.replanned(now);
+
+  costmap.setCost(60, 10, costmap_2d::LETHAL_OBSTACLE);
+  ASSERT_FALSE(trigger.check(costmap, region(60, 61, 10, 11), plan, 1, now + ros::Duration(0.2)));
+  ASSERT_TRUE(trigger.pending());
+  ASSERT_TRUE(trigger.check(costmap, region(0, 1, 39, 40), plan, 1, now + ros::Duration(0.6)));
+
+  // dropped, it waits for another change near the plan
+  trigger.clearPending();
+  ASSERT_FALSE(trigger.check(costmap, region(0, 1, 39, 40), plan, 1, now + ros::Duration(2.0)));
+}
+
+int main(int argc, char** argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+
+import json
+import os
+import shutil
+import subprocess
+import tempfile
+import time
+import unittest
+
+import rosbag
+import rospy
+import rostest
+from roslib.packages import find_node
+from geometry_msgs.msg import PoseStamped, TransformStamped
+from nav_msgs.msg import OccupancyGrid
+from tf2_msgs.msg import TFMessage
+
+PKG = 'move_base'
+
+
+def transform(parent, child, stamp):
+    t = TransformStamped()
+    t.header.frame_id = parent
+    t.header.stamp = stamp
+    t.child_frame_id = child
+    t.transform.rotation.w = 1.0
+    return t
+
+
+def write_bag(path):
+    # three seconds of a robot standing in an empty 3 m square, with one goal
+    start = rospy.Time(100)
+    bag = rosbag.Bag(path, 'w')
+    try:
+        bag.write('/tf_static', TFMessage([transform('map', 'odom', start)]), start)
+
+        grid = OccupancyGrid()
+        grid.header.frame_id = 'map'
+        grid.header.stamp = start
+        grid.info.resolution = 0.05
+        grid.info.width = 60
+        grid.info.height = 60
+        grid.info.origin.position.x = -1.5
+        grid.info.origin.position.y = -1.5
+        grid.info.origin.orientation.w = 1.0
+        grid.data = [0] * (60 * 60)
+        bag.write('/map', grid, start)
+
+        for i in range(30):
+            stamp = start + rospy.Duration(0.1 * i)
+            bag.write('/tf', TFMessage([transform('odom', 'base_link', stamp)]), stamp)
+
+        goal = PoseStamped()
+        goal.header.frame_id = 'map'
+        goal.header.stamp = start + rospy.Duration(0.5)
+        goal.pose.position.x = 0.5
+        goal.pose.orientation.w = 1.0
+        bag.write('/move_base_simple/goal', goal, goal.header.stamp)
+    finally:
+        bag.close()
+
+
+class TestReplayBenchmark(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def test_replay_small_bag(self):
+        nodes = find_node(PKG, 'move_base_replay_benchmark')
+        self.assertTrue(nodes, 'move_base_replay_benchmark is not built')
+        bag = os.path.join(self.dir, 'small.bag')
+        report = os.path.join(self.dir, 'report.json')
+        write_bag(bag)
+
+        # the stack used to wait forever for the map on the stopped clock
+        process = subprocess.Popen([nodes[0], bag, report])
+        deadline = time.time() + 60.0
+        while process.poll() is None and time.time() < deadline:
+            time.sleep(0.1)
+        if process.poll() is None:
+            process.kill()
+            process.wait()
+            self.fail('the replay did not finish within 60 s')
+        self.assertEqual(process.returncode, 0)
+
+        with open(report) as f:
+            result = json.load(f)
+        self.assertEqual(result['goals'], 1)
+        calls = dict((c['name'], c['calls']) for c in result['components'])
+        self.assertGreater(calls['global_costmap'], 0)
+        self.assertGreater(calls['local_costmap'], 0)
+        self.assertGreater(calls['global_planner'], 0)
+
+
+if __name__ == '__main__':
+    rostest.rosrun(PKG, 'replay_benchmark', TestReplayBenchmark)
@@ -41,6 +41,7 @@
 #include <nav_core/recovery_behavior.h>
 #include <costmap_2d/costmap_2d_ros.h>
 #include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
 #include <dynamic_reconfigure/Reconfigure.h>
 
 namespace move_slow_and_clear 
@@ -59,6 +60,9 @@ namespace move_slow_and_clear
       /// Run the behavior
       void runBehavior();
 
+      /// Keep the local planner, to limit its speed directly if it can be
+      void setLocalPlanner(const boost::shared_ptr<nav_core::BaseLocalPlanner>& local_planner);
+
     private:
       void setRobotSpeed(double trans_speed, double rot_speed);
       void distanceCheck(const ros::TimerEvent& e);
@@ -77,6 +81,8 @@ namespace move_slow_and_clear
       boost::thread* remove_limit_thread_;
       boost::mutex mutex_;
       bool limit_set_;
+      bool direct_limit_;  ///< Whether the limit was set through the local planner rather than dynamic_reconfigure
+      boost::weak_ptr<nav_core::BaseLocalPlanner> local_planner_;
       ros::ServiceClient planner_dynamic_reconfigure_service_;
   };
 };
@@ -44,7 +44,8 @@ PLUGINLIB_DECLARE_CLASS(move_slow_and_clear, MoveSlowAndClear, move_slow_and_cle
 namespace move_slow_and_clear
 {
   MoveSlowAndClear::MoveSlowAndClear():global_costmap_(NULL), local_costmap_(NULL), 
-                                       initialized_(false), remove_limit_thread_(NULL), limit_set_(false){}
+                                       initialized_(false), remove_limit_thread_(NULL), limit_set_(false),
+                                       direct_limit_(false){}
 
   MoveSlowAndClear::~MoveSlowAndClear()
   {
@@ -71,6 +72,11 @@ namespace move_slow_and_clear
     initialized_ = true;
   }
 
+  void MoveSlowAndClear::setLocalPlanner(const boost::shared_ptr<nav_core::BaseLocalPlanner>& local_planner)
+  {
+    local_planner_ = local_planner;
+  }
+
   void MoveSlowAndClear::runBehavior()
   {
     if(!initialized_)
@@ -129,8 +135,12 @@ namespace move_slow_and_clear
     //lock... just in case we're already speed limited
     boost::mutex::scoped_lock l(mutex_);
 
+    //a planner that takes a speed limit directly needs neither a reconfigure nor its old speeds
+    boost::shared_ptr<nav_core::BaseLocalPlanner> local_planner = local_planner_.lock();
+    direct_limit_ = local_planner && local_planner->setSpeedLimit(limited_trans_speed_, limited_rot_speed_);
+
     //get the old maximum speed for the robot... we'll want to set it back
-    if(!limit_set_)
+    if(!limit_set_ && !direct_limit_)
     {
       if(!planner_nh_.getParam("max_trans_vel", old_trans_speed_))
       {
@@ -147,7 +157,10 @@ namespace move_slow_and_clear
     speed_limit_pose_ = global_pose;
 
     //limit the speed of the robot until it moves a certain distance
-    setRobotSpeed(limited_trans_speed_, limited_rot_speed_);
+    if(direct_limit_)
+      ROS_INFO_STREAM("Recovery limiting the speed to " << limited_trans_speed_ << ", " << limited_rot_speed_);
+    else
+      setRobotSpeed(limited_trans_speed_, limited_rot_speed_);
     limit_set_ = true;
     distance_check_timer_ = private_nh_.createTimer(ros::Duration(0.1), &MoveSlowAndClear::distanceCheck, this);
   }
@@ -170,6 +183,19 @@ namespace move_slow_and_clear
     if(limited_distance_ * limited_distance_ <= getSqDistance())
     {
       ROS_INFO("Moved far enough, removing speed limit.");
+      distance_check_timer_.stop();
+
+      //lifting a direct limit takes effect on the planner's next cycle, without a service call
+      if(direct_limit_)
+      {
+        boost::mutex::scoped_lock l(mutex_);
+        boost::shared_ptr<nav_core::BaseLocalPlanner> local_planner = local_planner_.lock();
+        if(local_planner)
+          local_planner->setSpeedLimit(0.0, 0.0);
+        limit_set_ = false;
+        return;
+      }
+
       //have to do this because a system call within a timer cb does not seem to play nice
       if(remove_limit_thread_)
       {
@@ -177,8 +203,6 @@ namespace move_slow_and_clear
         delete remove_limit_thread_;
       }
       remove_limit_thread_ = new boost::thread(boost::bind(&MoveSlowAndClear::removeSpeedLimit, this));
-
-      distance_check_timer_.stop();
     }
   }
 
@@ -38,6 +38,7 @@
 #define NAV_CORE_BASE_GLOBAL_PLANNER_H
 
 #include <geometry_msgs/PoseStamped.h>
+#include <ros/time.h>
 #include <costmap_2d/costmap_2d_ros.h>
 
 namespace nav_core {
@@ -73,6 +74,24 @@ namespace nav_core {
         return makePlan(start, goal, plan);
       }
 
+      /**
+       * @brief Given a goal pose in the world, compute a plan by a deadline. Anytime planners
+       * return the best plan they have when it passes, and may improve it on later calls
+       * @param start The start pose 
+       * @param goal The goal pose 
+       * @param deadline The time by which the plan is wanted
+       * @param plan The plan... filled by the planner
+       * @param quality How close the plan is to the best the planner can do, from 0 to 1
+       * @return True if a valid plan was found, false otherwise
+       */
+      virtual bool makePlan(const geometry_msgs::PoseStamped& start, 
+                            const geometry_msgs::PoseStamped& goal, const ros::Time& deadline,
+                            std::vector<geometry_msgs::PoseStamped>& plan, double& quality)
+      {
+        quality = 1.0;
+        return makePlan(start, goal, plan);
+      }
+
       /**
        * @brief  Initialization function for the BaseGlobalPlanner
        * @param  name The name of this planner
@@ -80,6 +99,19 @@ namespace nav_core {
        */
       virtual void initialize(std::string name, costmap_2d::Costmap2DROS* costmap_ros) = 0;
 
+      /**
+       * @brief  Initialization on a costmap without its ROS wrapper, which lets the caller plan on a copy
+       * of the costmap that it keeps up to date itself
+       * @param  name The name of this planner
+       * @param  costmap A pointer to the costmap to use for planning
+       * @param  global_frame The global frame of the costmap
+       * @return False if the planner needs the ROS wrapper, and was not initialized
+       */
+      virtual bool initializeOnCostmap(std::string name, costmap_2d::Costmap2D* costmap, std::string global_frame)
+      {
+        return false;
+      }
+
       /**
        * @brief  Virtual destructor for the interface
        */
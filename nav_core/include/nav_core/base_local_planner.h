@@ -41,8 +41,15 @@
 #include <geometry_msgs/Twist.h>
 #include <costmap_2d/costmap_2d_ros.h>
 #include <tf/transform_listener.h>
+#include <ros/time.h>
+#include <boost/shared_ptr.hpp>
 
 namespace nav_core {
+  /**
+   * @brief A plan shared between threads, which no one modifies once it has been handed out
+   */
+  typedef boost::shared_ptr<const std::vector<geometry_msgs::PoseStamped> > PlanConstPtr;
+
   /**
    * @class BaseLocalPlanner
    * @brief Provides an interface for local planners used in navigation. All local planners written as plugins for the navigation stack must adhere to this interface.
@@ -56,6 +63,19 @@ namespace nav_core {
        */
       virtual bool computeVelocityCommands(geometry_msgs::Twist& cmd_vel) = 0;
 
+      /**
+       * @brief  Compute velocity commands within a time budget: planners that support it stop searching at the deadline
+       * and command the best velocity found by then
+       * @param cmd_vel Will be filled with the velocity command to be passed to the robot base
+       * @param deadline The wall time by which to return, zero for none
+       * @param degraded Set to true if the deadline cut the search short, false otherwise, which is the default
+       * @return True if a valid velocity command was found, false otherwise
+       */
+      virtual bool computeVelocityCommands(geometry_msgs::Twist& cmd_vel, const ros::WallTime& deadline, bool& degraded) {
+        degraded = false;
+        return computeVelocityCommands(cmd_vel);
+      }
+
       /**
        * @brief  Check if the goal pose has been achieved by the local planner
        * @return True if achieved, false otherwise
@@ -69,6 +89,22 @@ namespace nav_core {
        */
       virtual bool setPlan(const std::vector<geometry_msgs::PoseStamped>& plan) = 0;
 
+      /**
+       * @brief  Set the plan that the local planner is following, which planners that can follow it in place
+       * keep without copying it
+       * @param plan The plan to pass to the local planner
+       * @return True if the plan was updated successfully, false otherwise
+       */
+      virtual bool setSharedPlan(const PlanConstPtr& plan) { return setPlan(*plan); }
+
+      /**
+       * @brief  Cap the speeds the local planner commands from its next cycle on, below those it is configured with
+       * @param max_trans_vel The highest translational speed, 0 or less to lift the cap
+       * @param max_rot_vel The highest rotational speed, 0 or less to lift the cap
+       * @return False if the local planner can only be slowed down by reconfiguring it, which is the default
+       */
+      virtual bool setSpeedLimit(double max_trans_vel, double max_rot_vel) { return false; }
+
       /**
        * @brief  Constructs the local planner
        * @param name The name to give this instance of the local planner
@@ -39,6 +39,8 @@
 
 #include <costmap_2d/costmap_2d_ros.h>
 #include <tf/transform_listener.h>
+#include <nav_core/base_local_planner.h>
+#include <boost/shared_ptr.hpp>
 
 namespace nav_core {
   /**
@@ -60,6 +62,29 @@ namespace nav_core {
        */
       virtual void runBehavior() = 0;
 
+      /**
+       * @brief  Starts the RecoveryBehavior without blocking, to be advanced with tick() until it is done
+       * @return False if the behavior can only be run by runBehavior(), which is the default
+       */
+      virtual bool start() { return false; }
+
+      /**
+       * @brief  Advances a behavior started by start() by one step, which should not block for long
+       * @return True while the behavior is still running
+       */
+      virtual bool tick() { return false; }
+
+      /**
+       * @brief  Stops a behavior started by start() before it is done
+       */
+      virtual void cancel() {}
+
+      /**
+       * @brief  Hands the behavior the local planner in use before it is run, for behaviors that act on it
+       * @param local_planner The local planner controlling the robot
+       */
+      virtual void setLocalPlanner(const boost::shared_ptr<BaseLocalPlanner>& local_planner) {}
+
       /**
        * @brief  Virtual destructor for the interface
        */
@@ -0,0 +1,133 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef NAV_EXECUTOR_EXECUTOR_H
+#define NAV_EXECUTOR_EXECUTOR_H
+
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+#include <vector>
+
+namespace nav_executor
+{
+
+/**
+ * @brief The lanes of the executor, most urgent first.  A free worker always takes work from the most urgent lane
+ * that has any.
+ */
+enum Lane
+{
+  LANE_CONTROL = 0,      ///< e.g. scoring the trajectories of the local planner
+  LANE_LOCAL_COSTMAP,    ///< updates of a rolling costmap
+  LANE_LOCALIZATION,     ///< e.g. the sensor models of amcl
+  LANE_GLOBAL_PLANNING,  ///< updates of a static costmap, and the global planners
+  NUM_LANES
+};
+
+/**
+ * @class Executor
+ * @brief A fixed set of worker threads that runs the parallel parts of the navigation stack.
+ *
+ * Each run is a parallel loop, task(0) .. task(width - 1), and the thread asking for it takes part, so the workers
+ * only ever add to it.  A run therefore completes even while every worker is busy with other runs, and a task may
+ * itself start a run.  In one process the planners, costmaps and localization share the workers of shared(),
+ * rather than each starting threads of its own, so that together they use no more cores than it has.
+ *
+ * Running tasks are not preempted: the lanes order only which run a worker joins next.
+ */
+class Executor
+{
+public:
+  /**
+   * @param num_workers The number of threads to start, besides the callers of run()
+   * @param cpus The CPUs the workers may run on, e.g. to keep them off a core of the control loop, or empty for any
+   */
+  explicit Executor(unsigned int num_workers, const std::vector<int>& cpus = std::vector<int>());
+  ~Executor();
+
+  /**
+   * @brief The executor of the process, created on first use.
+   *
+   * Its size comes from the private parameters of the node, if ROS is initialized by then:
+   * executor/num_threads, the workers to start, by default one less than the hardware threads, and
+   * executor/cpu_affinity, the list of CPUs they may run on, by default any.
+   */
+  static Executor& shared();
+
+  /** @brief The most tasks of one run that can run at once, counting the caller of run() */
+  unsigned int size() const
+  {
+    return workers_.size() + 1;
+  }
+
+  /**
+   * @brief Run task(0) .. task(width - 1), each once, and return when all of them have.
+   *
+   * The caller runs the tasks no worker has taken, so with no workers free, or none at all, they run one after the
+   * other on the caller.  Tasks must not wait on each other.
+   */
+  void run(Lane lane, unsigned int width, const boost::function<void (unsigned int)>& task);
+
+private:
+  /** @brief A run in progress */
+  struct Job
+  {
+    const boost::function<void (unsigned int)>* task;
+    unsigned int width;
+    unsigned int next;  ///< The next task to hand out
+    unsigned int done;  ///< The tasks that have returned
+    boost::condition_variable finished;
+  };
+
+  /** @brief Hand out the next task of the job, taking the job off its lane once all are.  Called with mutex_ held. */
+  unsigned int take(Lane lane, Job* job);
+
+  /** @brief The most urgent lane with jobs, or NUM_LANES if there are none.  Called with mutex_ held. */
+  int firstLane() const;
+
+  void worker(const std::vector<int>& cpus);
+
+  boost::thread_group workers_;
+  boost::mutex mutex_;
+  boost::condition_variable work_;
+  std::deque<Job*> lanes_[NUM_LANES];  ///< The jobs with tasks not yet handed out, oldest first
+  bool shutdown_;
+};
+
+}  // namespace nav_executor
+
+#endif  // NAV_EXECUTOR_EXECUTOR_H
@@ -0,0 +1,89 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef NAV_EXECUTOR_KERNELS_H
+#define NAV_EXECUTOR_KERNELS_H
+
+namespace nav_executor
+{
+
+/**
+ * @brief The instruction sets a vector kernel of the navigation stack may be built for, worst first.
+ *
+ * Kernels for other than the baseline of the build, i.e. AVX2, are compiled with a target attribute and only run
+ * where the CPU has the instructions, so one binary runs everywhere and still uses them where it can.
+ */
+enum KernelVariant
+{
+  KERNEL_SCALAR = 0,  ///< one element at a time, always available
+  KERNEL_SSE2,        ///< 16 bytes at a time, the x86-64 baseline
+  KERNEL_NEON,        ///< 16 bytes at a time, the ARMv8 baseline
+  KERNEL_AVX2,        ///< 32 bytes at a time, with FMA
+  NUM_KERNEL_VARIANTS
+};
+
+/** @brief The bit of a variant in a set of them */
+inline unsigned int kernelBit(KernelVariant variant)
+{
+  return 1u << variant;
+}
+
+/** @brief The name of a variant, for logging */
+const char* kernelVariantName(KernelVariant variant);
+
+/** @brief The set of variants this CPU can run, which always includes KERNEL_SCALAR */
+unsigned int supportedKernels();
+
+/**
+ * @brief Whether only scalar kernels are to run, set by the private parameter kernels/force_scalar of the node, if
+ * ROS is initialized on the first call, e.g. to compare against the vector kernels or to rule them out of a bug.
+ */
+bool forceScalarKernels();
+
+/** @brief The best variant in both sets, or KERNEL_SCALAR if there is none */
+KernelVariant bestKernel(unsigned int compiled, unsigned int supported);
+
+/**
+ * @brief Choose among the variants a kernel was compiled with, and log the choice.
+ *
+ * This is meant to be called once per kernel, with the result kept in a function-local static, so that the
+ * variants are picked, and reported, on first use.
+ * @param name The name of the kernel in the log, e.g. "costmap_2d/max_row"
+ * @param compiled The set of variants the kernel has, with or without KERNEL_SCALAR
+ */
+KernelVariant selectKernel(const char* name, unsigned int compiled);
+
+}  // namespace nav_executor
+
+#endif  // NAV_EXECUTOR_KERNELS_H
@@ -0,0 +1,175 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef NAV_EXECUTOR_LOCKSTEP_H
+#define NAV_EXECUTOR_LOCKSTEP_H
+
+#include <ros/callback_queue_interface.h>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace nav_executor
+{
+
+/**
+ * @brief The order the loops of a process run in within a tick: all loops of one phase finish theirs before the
+ * loops of the next phase start, and loops of the same phase run at once.
+ */
+enum Phase
+{
+  PHASE_ESTIMATION = 0,  ///< e.g. the filter of robot_pose_ekf
+  PHASE_COSTMAP,         ///< costmap updates
+  PHASE_PLANNING,        ///< the global planner
+  PHASE_CONTROL,         ///< the control loop
+  NUM_PHASES
+};
+
+/**
+ * @class Lockstep
+ * @brief Paces the loops of a process by an external stepper rather than by the clock, one cycle of each per tick.
+ *
+ * When the global parameter /lockstep/enabled is set, the costmap update loops, the planner and control loops of
+ * move_base and the filter of robot_pose_ekf stop sleeping on the clock or waiting on timers.  Each waits instead for a tick, a
+ * std_msgs/Header on /lockstep/tick whose seq numbers it and whose stamp is the simulated time it is for, runs one
+ * cycle in its phase, and once every loop of the process has, the process acks the tick on /lockstep/done with a
+ * Header of the same seq and its node name as frame_id.  A stepper that waits for the acks of every process before
+ * the next tick, such as lockstep_stepper, so runs a simulation as fast as its slowest loop allows, and in the
+ * same order of cycles every time.  A process with no loops taking part acks each tick as it comes.
+ *
+ * Loops that start, or go idle, between goals join and leave as they do; a loop joins from the tick after the one
+ * in progress.
+ */
+class Lockstep
+{
+public:
+  /**
+   * @param ack Called with each tick, once every loop taking part has run it, with the lock of the lockstep held
+   */
+  explicit Lockstep(const boost::function<void (uint32_t)>& ack);
+
+  /**
+   * @brief The lockstep of the process, or NULL if /lockstep/enabled is not set or ROS is not initialized.
+   *
+   * It is created on the first call once ROS is initialized, and takes its ticks on a thread of its own.
+   */
+  static Lockstep* shared();
+
+  /** @brief Start tick n, which the stepper numbers from 1.  A repeat of the last tick is acked again if it has been. */
+  void tick(uint32_t n);
+
+  /**
+   * @class Loop
+   * @brief One loop taking part, from its first wait() until leave() or its destruction.  A thread that runs its
+   * loop again and again, such as the control loop of move_base once per goal, keeps one Loop throughout; the slot
+   * of a Loop destroyed is taken by the next one made.
+   */
+  class Loop
+  {
+  public:
+    Loop(Lockstep* lockstep, const std::string& name, Phase phase);
+    ~Loop();
+
+    /**
+     * @brief End the cycle of the loop, if it is in one, and wait for its turn in the next tick.
+     * @param abort Polled while waiting, e.g. a shutdown flag of the loop's thread
+     * @return False if *abort was set or ROS is shutting down, in which case the loop has left
+     */
+    bool wait(const bool* abort = NULL);
+
+    /** @brief End the cycle of the loop, if it is in one, and stop taking part until the next wait() */
+    void leave();
+
+  private:
+    Lockstep* lockstep_;
+    unsigned int id_;
+  };
+
+private:
+  struct LoopState
+  {
+    std::string name;
+    Phase phase;
+    bool registered;  ///< Whether a Loop holds the slot
+    bool joined;
+    bool running;
+    uint32_t done;  ///< The last tick the loop ran, or the one it joined during
+  };
+
+  /** @brief Whether the loops of earlier phases than the given one are done with the current tick.  Called with mutex_ held. */
+  bool earlierPhasesDone(Phase phase) const;
+
+  /** @brief Ack the current tick if every loop taking part is done with it.  Called with mutex_ held. */
+  void ackIfComplete();
+
+  boost::function<void (uint32_t)> ack_;
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  uint32_t tick_;   ///< The tick in progress, or the last one
+  uint32_t acked_;  ///< The last tick acked
+  std::vector<LoopState> loops_;
+};
+
+/**
+ * @class LockstepTimer
+ * @brief In place of a ros::Timer, calls a function once per tick, in its phase, on a callback queue, so that it
+ * stays serialized with the other callbacks of the node, as the timer's callback was.
+ */
+class LockstepTimer
+{
+public:
+  LockstepTimer(Lockstep* lockstep, const std::string& name, Phase phase, const boost::function<void ()>& callback,
+                ros::CallbackQueueInterface* queue);
+  ~LockstepTimer();
+
+private:
+  void run();
+
+  Lockstep* lockstep_;
+  std::string name_;
+  Phase phase_;
+  boost::function<void ()> callback_;
+  ros::CallbackQueueInterface* queue_;
+  bool shutdown_;
+  boost::thread thread_;
+};
+
+}  // namespace nav_executor
+
+#endif  // NAV_EXECUTOR_LOCKSTEP_H
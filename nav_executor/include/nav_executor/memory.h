@@ -0,0 +1,102 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef NAV_EXECUTOR_MEMORY_H
+#define NAV_EXECUTOR_MEMORY_H
+
+#include <boost/noncopyable.hpp>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+
+namespace nav_executor
+{
+
+/**
+ * @brief What the counters of one component hold, and the most they have held at once.
+ */
+struct MemoryUsage
+{
+  std::string component;
+  size_t bytes;
+  size_t peak_bytes;
+};
+
+/**
+ * @class MemoryCounter
+ * @brief Counts the bytes one owner, e.g. a costmap layer or a planner, holds for a component of the process.
+ *
+ * The counters of a component, named e.g. global_costmap/obstacle_layer, add up, and the component keeps the most
+ * they held at once.  The owner sets the counter as it allocates and frees, so the counts are of what the owner
+ * asked for; pages of lazily allocated grids that were never written count all the same.
+ *
+ * When the global parameter /memory_accounting/period is set, every process publishes the components it has, with
+ * the whole process as "total", as a diagnostic_msgs/DiagnosticArray on ~memory at that period in seconds, one
+ * status to a component with its bytes and peak_bytes.
+ */
+class MemoryCounter : boost::noncopyable
+{
+public:
+  explicit MemoryCounter(const std::string& component);
+
+  /** @brief Gives back the bytes the counter holds */
+  ~MemoryCounter();
+
+  /** @brief Move the counter, and the bytes it holds, to another component */
+  void setComponent(const std::string& component);
+
+  /** @brief Set the bytes the owner holds */
+  void set(size_t bytes);
+
+  size_t bytes() const
+  {
+    return bytes_;
+  }
+
+  struct Component;  ///< What the counters of a component hold, kept by memory.cpp
+
+private:
+  Component* component_;
+  size_t bytes_;
+};
+
+/**
+ * @brief What each component of the process holds, and has held at most, by name, and the process as "total".
+ */
+std::vector<MemoryUsage> memoryUsage();
+
+}  // namespace nav_executor
+
+#endif  // NAV_EXECUTOR_MEMORY_H
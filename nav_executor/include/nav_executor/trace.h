@@ -0,0 +1,90 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef NAV_EXECUTOR_TRACE_H
+#define NAV_EXECUTOR_TRACE_H
+
+/**
+ * Static tracepoints (USDT probes) on the hot paths of the navigation stack.
+ *
+ * Where <sys/sdt.h> is found at build time (systemtap-sdt-dev on Debian and Ubuntu), each probe is a single nop
+ * with a note in the binary, so it costs next to nothing until a tracer attaches.  They can then be listed and
+ * traced on a running robot without rebuilding, e.g.
+ *
+ *   bpftrace -l 'usdt:/opt/ros/.../libcostmap_2d.so:*'
+ *   bpftrace -e 'usdt:.../libcostmap_2d.so:costmap_2d:layer_costs_begin { @start[tid] = nsecs; }
+ *                usdt:.../libcostmap_2d.so:costmap_2d:layer_costs_end
+ *                { @us[str(arg1)] = hist((nsecs - @start[tid]) / 1000); }'
+ *
+ * or with LTTng as userspace probes (lttng enable-event --userspace-probe=sdt:...).  Without the header, or with
+ * NAV_EXECUTOR_NO_TRACE defined, the macros expand to nothing.
+ *
+ * The probes come in begin and end pairs on the same thread, with their arguments; the provider is the package:
+ *   costmap_2d:update_map_begin/end (global frame)
+ *   costmap_2d:layer_bounds_begin/end, layer_costs_begin/end (global frame, layer name)
+ *   costmap_2d:buffer_cloud_begin, buffer_pcl_cloud_begin, buffer_scan_begin (topic, points) and their ends
+ *   amcl:stage_begin/end (stage of laserReceived, in the order of the timing diagnostics)
+ *   move_base:cycle_begin/end, plan_begin/end, compute_velocity_begin/end (end: whether it succeeded)
+ */
+
+#if !defined(NAV_EXECUTOR_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NAV_EXECUTOR_HAVE_TRACE 1
+#endif
+#endif
+
+#if NAV_EXECUTOR_HAVE_TRACE
+#define NAV_TRACE(provider, name) DTRACE_PROBE(provider, name)
+#define NAV_TRACE1(provider, name, a1) DTRACE_PROBE1(provider, name, a1)
+#define NAV_TRACE2(provider, name, a1, a2) DTRACE_PROBE2(provider, name, a1, a2)
+#define NAV_TRACE3(provider, name, a1, a2, a3) DTRACE_PROBE3(provider, name, a1, a2, a3)
+
+/** @brief Fire provider:name_begin here, and provider:name_end when the scope is left, by whichever path */
+#define NAV_TRACE_SCOPE1(provider, name, a1) \
+  NAV_TRACE1(provider, name##_begin, a1); \
+  struct NavTraceScope_##name { ~NavTraceScope_##name() { NAV_TRACE(provider, name##_end); } } nav_trace_scope_##name
+#define NAV_TRACE_SCOPE2(provider, name, a1, a2) \
+  NAV_TRACE2(provider, name##_begin, a1, a2); \
+  struct NavTraceScope_##name { ~NavTraceScope_##name() { NAV_TRACE(provider, name##_end); } } nav_trace_scope_##name
+#else
+#define NAV_TRACE(provider, name) do {} while (0)
+#define NAV_TRACE1(provider, name, a1) do {} while (0)
+#define NAV_TRACE2(provider, name, a1, a2) do {} while (0)
+#define NAV_TRACE3(provider, name, a1, a2, a3) do {} while (0)
+#define NAV_TRACE_SCOPE1(provider, name, a1) do {} while (0)
+#define NAV_TRACE_SCOPE2(provider, name, a1, a2) do {} while (0)
+#endif
+
+#endif  // NAV_EXECUTOR_TRACE_H
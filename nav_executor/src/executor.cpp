@@ -0,0 +1,167 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <nav_executor/executor.h>
+#include <ros/ros.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace nav_executor
+{
+
+Executor::Executor(unsigned int num_workers, const std::vector<int>& cpus) :
+    shutdown_(false)
+{
+  for (unsigned int i = 0; i < num_workers; ++i)
+    workers_.create_thread(boost::bind(&Executor::worker, this, cpus));
+}
+
+Executor::~Executor()
+{
+  {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  work_.notify_all();
+  workers_.join_all();
+}
+
+Executor& Executor::shared()
+{
+  static Executor* executor = NULL;
+  static boost::mutex executor_mutex;
+  boost::unique_lock<boost::mutex> lock(executor_mutex);
+  if (executor == NULL)
+  {
+    int num_threads = std::max(int(boost::thread::hardware_concurrency()) - 1, 0);
+    std::vector<int> cpus;
+    if (ros::isInitialized())
+    {
+      ros::NodeHandle private_nh("~/executor");
+      private_nh.param("num_threads", num_threads, num_threads);
+      private_nh.param("cpu_affinity", cpus, cpus);
+    }
+    ROS_DEBUG("Starting %d navigation executor threads", std::max(num_threads, 0));
+    // never destroyed, so that it outlives the static objects that may use it
+    executor = new Executor(std::max(num_threads, 0), cpus);
+  }
+  return *executor;
+}
+
+void Executor::run(Lane lane, unsigned int width, const boost::function<void (unsigned int)>& task)
+{
+  if (width < 2 || workers_.size() == 0)
+  {
+    for (unsigned int i = 0; i < width; ++i)
+      task(i);
+    return;
+  }
+
+  Job job;
+  job.task = &task;
+  job.width = width;
+  job.next = 0;
+  job.done = 0;
+
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  lanes_[lane].push_back(&job);
+  for (unsigned int i = 1; i < width && i <= workers_.size(); ++i)
+    work_.notify_one();
+
+  while (job.next < job.width)
+  {
+    unsigned int i = take(lane, &job);
+    lock.unlock();
+    task(i);
+    lock.lock();
+    ++job.done;
+  }
+  while (job.done < job.width)
+    job.finished.wait(lock);
+}
+
+unsigned int Executor::take(Lane lane, Job* job)
+{
+  unsigned int i = job->next++;
+  if (job->next == job->width)
+    lanes_[lane].erase(std::find(lanes_[lane].begin(), lanes_[lane].end(), job));
+  return i;
+}
+
+int Executor::firstLane() const
+{
+  int lane = 0;
+  while (lane < NUM_LANES && lanes_[lane].empty())
+    ++lane;
+  return lane;
+}
+
+void Executor::worker(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+  if (!cpus.empty())
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned int i = 0; i < cpus.size(); ++i)
+      CPU_SET(cpus[i], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+      ROS_WARN("Could not restrict a navigation executor thread to the given CPUs");
+  }
+#endif
+
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (true)
+  {
+    int lane = NUM_LANES;
+    while (!shutdown_ && (lane = firstLane()) == NUM_LANES)
+      work_.wait(lock);
+    if (shutdown_)
+      return;
+
+    Job* job = lanes_[lane].front();
+    unsigned int i = take(Lane(lane), job);
+    lock.unlock();
+    (*job->task)(i);
+    lock.lock();
+    if (++job->done == job->width)
+      job->finished.notify_all();
+  }
+}
+
+}  // namespace nav_executor
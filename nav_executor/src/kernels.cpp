@@ -0,0 +1,119 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <nav_executor/kernels.h>
+#include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
+namespace nav_executor
+{
+
+const char* kernelVariantName(KernelVariant variant)
+{
+  switch (variant)
+  {
+    case KERNEL_SSE2:
+      return "sse2";
+    case KERNEL_NEON:
+      return "neon";
+    case KERNEL_AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+static unsigned int detectKernels()
+{
+  unsigned int supported = kernelBit(KERNEL_SCALAR);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    supported |= kernelBit(KERNEL_SSE2);
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    supported |= kernelBit(KERNEL_AVX2);
+#elif defined(__aarch64__) && defined(__linux__)
+  if (getauxval(AT_HWCAP) & HWCAP_ASIMD)
+    supported |= kernelBit(KERNEL_NEON);
+#elif defined(__ARM_NEON)
+  supported |= kernelBit(KERNEL_NEON);
+#endif
+  return supported;
+}
+
+unsigned int supportedKernels()
+{
+  static const unsigned int supported = detectKernels();
+  return supported;
+}
+
+bool forceScalarKernels()
+{
+  static bool read = false, force = false;
+  static boost::mutex force_mutex;
+  boost::unique_lock<boost::mutex> lock(force_mutex);
+  if (!read)
+  {
+    if (ros::isInitialized())
+    {
+      ros::NodeHandle private_nh("~/kernels");
+      private_nh.param("force_scalar", force, false);
+    }
+    read = true;
+  }
+  return force;
+}
+
+KernelVariant bestKernel(unsigned int compiled, unsigned int supported)
+{
+  for (int variant = NUM_KERNEL_VARIANTS - 1; variant > KERNEL_SCALAR; --variant)
+  {
+    if (compiled & supported & kernelBit(KernelVariant(variant)))
+      return KernelVariant(variant);
+  }
+  return KERNEL_SCALAR;
+}
+
+KernelVariant selectKernel(const char* name, unsigned int compiled)
+{
+  unsigned int supported = forceScalarKernels() ? kernelBit(KERNEL_SCALAR) : supportedKernels();
+  KernelVariant variant = bestKernel(compiled, supported);
+  ROS_INFO("Using the %s variant of the %s kernel", kernelVariantName(variant), name);
+  return variant;
+}
+
+}  // namespace nav_executor
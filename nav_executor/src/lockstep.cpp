@@ -0,0 +1,290 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <nav_executor/lockstep.h>
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <std_msgs/Header.h>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+namespace nav_executor
+{
+
+namespace
+{
+
+/** @brief The ROS end of the lockstep of the process: takes the ticks on a queue and thread of its own */
+class LockstepNode
+{
+public:
+  LockstepNode() : lockstep(boost::bind(&LockstepNode::ack, this, _1)), spinner(1, &queue)
+  {
+    nh.setCallbackQueue(&queue);
+    done_pub = nh.advertise<std_msgs::Header>("/lockstep/done", 10);
+    tick_sub = nh.subscribe("/lockstep/tick", 10, &LockstepNode::tick, this);
+    spinner.start();
+  }
+
+  Lockstep lockstep;
+
+private:
+  void tick(const std_msgs::Header::ConstPtr& msg)
+  {
+    // the loops see the time of their tick, even if /clock comes later
+    if (ros::Time::isSimTime() && !msg->stamp.isZero())
+      ros::Time::setNow(msg->stamp);
+    lockstep.tick(msg->seq);
+  }
+
+  void ack(uint32_t n)
+  {
+    std_msgs::Header done;
+    done.seq = n;
+    done.stamp = ros::Time::now();
+    done.frame_id = ros::this_node::getName();
+    done_pub.publish(done);
+  }
+
+  ros::CallbackQueue queue;
+  ros::NodeHandle nh;
+  ros::Publisher done_pub;
+  ros::Subscriber tick_sub;
+  ros::AsyncSpinner spinner;
+};
+
+/** @brief Runs a function on a callback queue, and tells when it has */
+class TickCallback : public ros::CallbackInterface
+{
+public:
+  explicit TickCallback(const boost::function<void ()>& callback) : callback_(callback), done_(false) {}
+
+  virtual CallResult call()
+  {
+    callback_();
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    done_ = true;
+    cond_.notify_all();
+    return Success;
+  }
+
+  /** @brief Wait until the function has run, or shutdown is set; false in the latter case */
+  bool wait(const bool* shutdown)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while (!done_)
+    {
+      if (*shutdown || ros::isShuttingDown())
+        return false;
+      cond_.timed_wait(lock, boost::posix_time::milliseconds(100));
+    }
+    return true;
+  }
+
+private:
+  boost::function<void ()> callback_;
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  bool done_;
+};
+
+}  // namespace
+
+Lockstep::Lockstep(const boost::function<void (uint32_t)>& ack) : ack_(ack), tick_(0), acked_(0)
+{
+}
+
+Lockstep* Lockstep::shared()
+{
+  static LockstepNode* node = NULL;
+  static bool checked = false;
+  static boost::mutex lockstep_mutex;
+  boost::unique_lock<boost::mutex> lock(lockstep_mutex);
+  if (!checked && ros::isInitialized())
+  {
+    checked = true;
+    bool enabled = false;
+    ros::param::param("/lockstep/enabled", enabled, false);
+    if (enabled)
+    {
+      ROS_INFO("Pacing the navigation loops by the ticks on /lockstep/tick");
+      // never destroyed, so that it outlives the loops that may use it
+      node = new LockstepNode();
+    }
+  }
+  return node == NULL ? NULL : &node->lockstep;
+}
+
+void Lockstep::tick(uint32_t n)
+{
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  if (n == tick_ && acked_ == n && ack_)
+  {
+    // the stepper didn't hear the ack, e.g. as it started after this process
+    ack_(n);
+    return;
+  }
+  if (n <= tick_)
+    return;
+  tick_ = n;
+  cond_.notify_all();
+  ackIfComplete();
+}
+
+bool Lockstep::earlierPhasesDone(Phase phase) const
+{
+  for (unsigned int i = 0; i < loops_.size(); ++i)
+  {
+    if (loops_[i].joined && loops_[i].phase < phase && loops_[i].done < tick_)
+      return false;
+  }
+  return true;
+}
+
+void Lockstep::ackIfComplete()
+{
+  if (acked_ >= tick_)
+    return;
+  for (unsigned int i = 0; i < loops_.size(); ++i)
+  {
+    if (loops_[i].joined && loops_[i].done < tick_)
+      return;
+  }
+  acked_ = tick_;
+  if (ack_)
+    ack_(tick_);
+}
+
+Lockstep::Loop::Loop(Lockstep* lockstep, const std::string& name, Phase phase) : lockstep_(lockstep)
+{
+  LoopState state;
+  state.name = name;
+  state.phase = phase;
+  state.registered = true;
+  state.joined = false;
+  state.running = false;
+  state.done = 0;
+  boost::unique_lock<boost::mutex> lock(lockstep_->mutex_);
+  id_ = 0;
+  while (id_ < lockstep_->loops_.size() && lockstep_->loops_[id_].registered)
+    ++id_;
+  if (id_ < lockstep_->loops_.size())
+    lockstep_->loops_[id_] = state;
+  else
+    lockstep_->loops_.push_back(state);
+}
+
+Lockstep::Loop::~Loop()
+{
+  leave();
+  boost::unique_lock<boost::mutex> lock(lockstep_->mutex_);
+  lockstep_->loops_[id_].registered = false;
+}
+
+bool Lockstep::Loop::wait(const bool* abort)
+{
+  boost::unique_lock<boost::mutex> lock(lockstep_->mutex_);
+  LoopState* state = &lockstep_->loops_[id_];
+  if (state->running)
+  {
+    state->running = false;
+    state->done = lockstep_->tick_;
+    lockstep_->cond_.notify_all();
+    lockstep_->ackIfComplete();
+  }
+  else if (!state->joined)
+  {
+    // from the next tick on, so as not to hold up the one in progress
+    state->joined = true;
+    state->done = lockstep_->tick_;
+  }
+
+  while (true)
+  {
+    if ((abort != NULL && *abort) || ros::isShuttingDown())
+    {
+      state->joined = false;
+      lockstep_->cond_.notify_all();
+      lockstep_->ackIfComplete();
+      return false;
+    }
+    if (lockstep_->tick_ > state->done && lockstep_->earlierPhasesDone(state->phase))
+      break;
+    lockstep_->cond_.timed_wait(lock, boost::posix_time::milliseconds(100));
+    // loops_ may have grown, and moved
+    state = &lockstep_->loops_[id_];
+  }
+  state->running = true;
+  return true;
+}
+
+void Lockstep::Loop::leave()
+{
+  boost::unique_lock<boost::mutex> lock(lockstep_->mutex_);
+  LoopState& state = lockstep_->loops_[id_];
+  if (!state.joined)
+    return;
+  state.joined = false;
+  state.running = false;
+  lockstep_->cond_.notify_all();
+  lockstep_->ackIfComplete();
+}
+
+LockstepTimer::LockstepTimer(Lockstep* lockstep, const std::string& name, Phase phase,
+                             const boost::function<void ()>& callback, ros::CallbackQueueInterface* queue)
+  : lockstep_(lockstep), name_(name), phase_(phase), callback_(callback), queue_(queue), shutdown_(false),
+    thread_(boost::bind(&LockstepTimer::run, this))
+{
+}
+
+LockstepTimer::~LockstepTimer()
+{
+  shutdown_ = true;
+  thread_.join();
+  queue_->removeByID(reinterpret_cast<uint64_t>(this));
+}
+
+void LockstepTimer::run()
+{
+  Lockstep::Loop loop(lockstep_, name_, phase_);
+  while (loop.wait(&shutdown_))
+  {
+    boost::shared_ptr<TickCallback> callback = boost::make_shared<TickCallback>(callback_);
+    queue_->addCallback(callback, reinterpret_cast<uint64_t>(this));
+    if (!callback->wait(&shutdown_))
+      break;
+  }
+}
+
+}  // namespace nav_executor
@@ -0,0 +1,140 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * A stepper for the lockstep mode of the navigation loops (see nav_executor/lockstep.h), which runs a simulation
+ * as fast as they allow:
+ *
+ *   rosparam set /use_sim_time true
+ *   rosparam set /lockstep/enabled true
+ *   rosrun nav_executor lockstep_stepper _step:=0.05 _processes:=2
+ *
+ * Each tick advances /clock by ~step seconds (0.05 by default) from ~start (the wall time at startup), publishes
+ * the tick, and waits for every process that has acked a tick before to ack it too.  The first tick is repeated
+ * until ~processes of them (1 by default) have, so that the simulation starts with them; a process that doesn't
+ * ack within ~timeout seconds of wall time (10 by default) is taken to have gone.  It stops after ~ticks ticks, if
+ * that is set.  The simulator advances its own state on the /clock it publishes, or drives the ticks itself in
+ * the same way.
+ */
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <rosgraph_msgs/Clock.h>
+#include <std_msgs/Header.h>
+#include <algorithm>
+#include <map>
+#include <string>
+
+namespace
+{
+
+std::map<std::string, uint32_t> g_acked;  ///< The last tick acked by each process
+
+void done(const std_msgs::Header::ConstPtr& msg)
+{
+  uint32_t& acked = g_acked[msg->frame_id];
+  acked = std::max(acked, msg->seq);
+}
+
+/** @brief The processes that have acked tick n, dropping those that haven't past the deadline, if any */
+unsigned int ackedBy(uint32_t n, const ros::WallTime* deadline)
+{
+  unsigned int count = 0;
+  for (std::map<std::string, uint32_t>::iterator it = g_acked.begin(); it != g_acked.end();)
+  {
+    if (it->second >= n)
+      ++count;
+    else if (deadline != NULL && ros::WallTime::now() > *deadline)
+    {
+      ROS_WARN("%s didn't ack tick %u, no longer waiting for it", it->first.c_str(), n);
+      g_acked.erase(it++);
+      continue;
+    }
+    ++it;
+  }
+  return count;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "lockstep_stepper");
+  ros::NodeHandle nh, private_nh("~");
+  double step, start, timeout;
+  int processes, ticks;
+  private_nh.param("step", step, 0.05);
+  private_nh.param("start", start, ros::WallTime::now().toSec());
+  private_nh.param("timeout", timeout, 10.0);
+  private_nh.param("processes", processes, 1);
+  private_nh.param("ticks", ticks, 0);
+
+  ros::Publisher clock_pub = nh.advertise<rosgraph_msgs::Clock>("/clock", 10);
+  ros::Publisher tick_pub = nh.advertise<std_msgs::Header>("/lockstep/tick", 10);
+  ros::Subscriber done_sub = nh.subscribe("/lockstep/done", 100, done);
+
+  rosgraph_msgs::Clock clock;
+  clock.clock = ros::Time(start);
+  std_msgs::Header tick;
+  ros::WallTime wall_start = ros::WallTime::now();
+  for (uint32_t n = 1; nh.ok() && (ticks <= 0 || n <= (uint32_t) ticks); ++n)
+  {
+    clock.clock += ros::Duration(step);
+    tick.seq = n;
+    tick.stamp = clock.clock;
+    clock_pub.publish(clock);
+    tick_pub.publish(tick);
+
+    ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(timeout);
+    ros::WallTime resend = ros::WallTime::now() + ros::WallDuration(0.1);
+    while (nh.ok())
+    {
+      ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration(0.001));
+      unsigned int acked = ackedBy(n, n == 1 ? NULL : &deadline);
+      if (acked == g_acked.size() && (n > 1 || (int) acked >= processes))
+        break;
+      // until everyone is up, and in case a tick was lost
+      if (ros::WallTime::now() > resend)
+      {
+        clock_pub.publish(clock);
+        tick_pub.publish(tick);
+        resend = ros::WallTime::now() + ros::WallDuration(0.1);
+      }
+    }
+
+    if (n % 1000 == 0)
+      ROS_INFO("Tick %u, %.1f s simulated, %.2fx real time", n, n * step,
+               n * step / std::max((ros::WallTime::now() - wall_start).toSec(), 1e-9));
+  }
+  return 0;
+}
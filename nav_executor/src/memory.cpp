@@ -0,0 +1,196 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <nav_executor/memory.h>
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <map>
+
+namespace nav_executor
+{
+
+struct MemoryCounter::Component
+{
+  Component() : bytes(0), peak_bytes(0) {}
+
+  size_t bytes;
+  size_t peak_bytes;
+};
+
+namespace
+{
+
+/** @brief The components of the process by name, never freed, so counters of static objects can outlive it */
+struct Registry
+{
+  boost::mutex mutex;
+  std::map<std::string, MemoryCounter::Component*> components;
+  MemoryCounter::Component total;
+};
+
+Registry& registry()
+{
+  static Registry* registry = new Registry();
+  return *registry;
+}
+
+/** @brief Add to or take from a component, and the total, with the registry's mutex held */
+void account(MemoryCounter::Component* component, size_t add, size_t take)
+{
+  Registry& r = registry();
+  component->bytes += add - take;
+  component->peak_bytes = std::max(component->peak_bytes, component->bytes);
+  r.total.bytes += add - take;
+  r.total.peak_bytes = std::max(r.total.peak_bytes, r.total.bytes);
+}
+
+/** @brief Publishes memoryUsage() on ~memory from a queue and thread of its own */
+class MemoryReport
+{
+public:
+  explicit MemoryReport(double period) : nh("~"), spinner(1, &queue)
+  {
+    nh.setCallbackQueue(&queue);
+    pub = nh.advertise<diagnostic_msgs::DiagnosticArray>("memory", 1, true);
+    timer = nh.createWallTimer(ros::WallDuration(period), &MemoryReport::publish, this);
+    spinner.start();
+  }
+
+  /** @brief Start the report of the process if /memory_accounting/period is set, once ROS is initialized */
+  static void startIfEnabled()
+  {
+    static bool checked = false;
+    static boost::mutex report_mutex;
+    boost::unique_lock<boost::mutex> lock(report_mutex);
+    if (checked || !ros::isInitialized())
+      return;
+    checked = true;
+    double period = 0.0;
+    ros::param::param("/memory_accounting/period", period, 0.0);
+    if (period > 0.0)
+      new MemoryReport(period);
+  }
+
+private:
+  void publish(const ros::WallTimerEvent&)
+  {
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = ros::Time::now();
+    std::vector<MemoryUsage> usage = memoryUsage();
+    msg.status.resize(usage.size());
+    for (unsigned int i = 0; i < usage.size(); ++i)
+    {
+      diagnostic_msgs::DiagnosticStatus& status = msg.status[i];
+      status.level = diagnostic_msgs::DiagnosticStatus::OK;
+      status.name = usage[i].component;
+      status.hardware_id = ros::this_node::getName();
+      status.values.resize(2);
+      status.values[0].key = "bytes";
+      status.values[0].value = boost::lexical_cast<std::string>(usage[i].bytes);
+      status.values[1].key = "peak_bytes";
+      status.values[1].value = boost::lexical_cast<std::string>(usage[i].peak_bytes);
+    }
+    pub.publish(msg);
+  }
+
+  ros::CallbackQueue queue;
+  ros::NodeHandle nh;
+  ros::Publisher pub;
+  ros::WallTimer timer;
+  ros::AsyncSpinner spinner;
+};
+
+}  // namespace
+
+MemoryCounter::MemoryCounter(const std::string& component) : component_(NULL), bytes_(0)
+{
+  setComponent(component);
+}
+
+MemoryCounter::~MemoryCounter()
+{
+  Registry& r = registry();
+  boost::unique_lock<boost::mutex> lock(r.mutex);
+  account(component_, 0, bytes_);
+}
+
+void MemoryCounter::setComponent(const std::string& component)
+{
+  Registry& r = registry();
+  boost::unique_lock<boost::mutex> lock(r.mutex);
+  Component*& to = r.components[component];
+  if (to == NULL)
+    to = new Component();
+  if (to == component_)
+    return;
+  if (component_ != NULL)
+  {
+    account(component_, 0, bytes_);
+    account(to, bytes_, 0);
+  }
+  component_ = to;
+}
+
+void MemoryCounter::set(size_t bytes)
+{
+  MemoryReport::startIfEnabled();
+  if (bytes == bytes_)
+    return;
+  Registry& r = registry();
+  boost::unique_lock<boost::mutex> lock(r.mutex);
+  account(component_, bytes, bytes_);
+  bytes_ = bytes;
+}
+
+std::vector<MemoryUsage> memoryUsage()
+{
+  Registry& r = registry();
+  boost::unique_lock<boost::mutex> lock(r.mutex);
+  std::vector<MemoryUsage> usage;
+  for (std::map<std::string, MemoryCounter::Component*>::const_iterator it = r.components.begin();
+       it != r.components.end(); ++it)
+  {
+    MemoryUsage component = {it->first, it->second->bytes, it->second->peak_bytes};
+    usage.push_back(component);
+  }
+  MemoryUsage total = {"total", r.total.bytes, r.total.peak_bytes};
+  usage.push_back(total);
+  return usage;
+}
+
+}  // namespace nav_executor
@@ -0,0 +1,135 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <nav_executor/executor.h>
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <vector>
+
+using nav_executor::Executor;
+
+namespace
+{
+
+void count(std::vector<int>* calls, boost::mutex* mutex, unsigned int i)
+{
+  boost::unique_lock<boost::mutex> lock(*mutex);
+  ++(*calls)[i];
+}
+
+void nested(Executor* executor, std::vector<int>* calls, boost::mutex* mutex, unsigned int i)
+{
+  executor->run(nav_executor::LANE_LOCALIZATION, 4, boost::bind(count, calls, mutex, _1));
+  count(calls, mutex, 4 + i);
+}
+
+void wait(boost::mutex* mutex, boost::condition_variable* cond, bool* go, unsigned int)
+{
+  boost::unique_lock<boost::mutex> lock(*mutex);
+  while (!*go)
+    cond->wait(lock);
+}
+
+void runBusy(Executor* executor, boost::mutex* mutex, boost::condition_variable* cond, bool* go)
+{
+  executor->run(nav_executor::LANE_GLOBAL_PLANNING, executor->size(), boost::bind(wait, mutex, cond, go, _1));
+}
+
+}  // namespace
+
+TEST(executor, every_task_runs_once)
+{
+  Executor executor(3);
+  EXPECT_EQ(4u, executor.size());
+
+  boost::mutex mutex;
+  std::vector<int> calls(100, 0);
+  executor.run(nav_executor::LANE_CONTROL, 100, boost::bind(count, &calls, &mutex, _1));
+  for (unsigned int i = 0; i < calls.size(); ++i)
+    EXPECT_EQ(1, calls[i]);
+}
+
+TEST(executor, no_workers)
+{
+  // the caller runs every task itself
+  Executor executor(0);
+  EXPECT_EQ(1u, executor.size());
+
+  boost::mutex mutex;
+  std::vector<int> calls(5, 0);
+  executor.run(nav_executor::LANE_CONTROL, 5, boost::bind(count, &calls, &mutex, _1));
+  for (unsigned int i = 0; i < calls.size(); ++i)
+    EXPECT_EQ(1, calls[i]);
+}
+
+TEST(executor, nested_runs)
+{
+  Executor executor(2);
+  boost::mutex mutex;
+  std::vector<int> calls(7, 0);
+  executor.run(nav_executor::LANE_LOCAL_COSTMAP, 3, boost::bind(nested, &executor, &calls, &mutex, _1));
+  for (unsigned int i = 0; i < 4; ++i)
+    EXPECT_EQ(3, calls[i]);
+  for (unsigned int i = 4; i < 7; ++i)
+    EXPECT_EQ(1, calls[i]);
+}
+
+TEST(executor, busy_workers)
+{
+  // while the workers and another caller are held up, a run completes on its caller alone
+  Executor executor(2);
+  boost::mutex mutex;
+  boost::condition_variable cond;
+  bool go = false;
+  boost::thread busy(boost::bind(runBusy, &executor, &mutex, &cond, &go));
+
+  boost::mutex count_mutex;
+  std::vector<int> calls(10, 0);
+  executor.run(nav_executor::LANE_CONTROL, 10, boost::bind(count, &calls, &count_mutex, _1));
+  for (unsigned int i = 0; i < calls.size(); ++i)
+    EXPECT_EQ(1, calls[i]);
+
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    go = true;
+  }
+  cond.notify_all();
+  busy.join();
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
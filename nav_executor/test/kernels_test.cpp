@@ -0,0 +1,63 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <nav_executor/kernels.h>
+#include <gtest/gtest.h>
+
+using namespace nav_executor;
+
+TEST(kernels, best)
+{
+  unsigned int all = kernelBit(KERNEL_SCALAR) | kernelBit(KERNEL_SSE2) | kernelBit(KERNEL_AVX2);
+  EXPECT_EQ(KERNEL_AVX2, bestKernel(all, all));
+  EXPECT_EQ(KERNEL_SSE2, bestKernel(all, kernelBit(KERNEL_SCALAR) | kernelBit(KERNEL_SSE2)));
+  EXPECT_EQ(KERNEL_SSE2, bestKernel(kernelBit(KERNEL_SSE2), all));
+  EXPECT_EQ(KERNEL_SCALAR, bestKernel(kernelBit(KERNEL_NEON), all));
+  EXPECT_EQ(KERNEL_SCALAR, bestKernel(all, kernelBit(KERNEL_SCALAR)));
+}
+
+TEST(kernels, supported)
+{
+  EXPECT_TRUE(supportedKernels() & kernelBit(KERNEL_SCALAR));
+  // without ROS nothing forces the scalar kernels, so the best supported one is chosen
+  EXPECT_FALSE(forceScalarKernels());
+  EXPECT_EQ(bestKernel(kernelBit(KERNEL_SSE2), supportedKernels()),
+            selectKernel("nav_executor/test", kernelBit(KERNEL_SSE2)));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
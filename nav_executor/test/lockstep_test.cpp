@@ -0,0 +1,222 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <nav_executor/lockstep.h>
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <string>
+#include <vector>
+
+using nav_executor::Lockstep;
+
+namespace
+{
+
+/** @brief Collects the acks of a lockstep, and waits for them */
+class Acks
+{
+public:
+  Acks() : last(0), count(0) {}
+
+  void ack(uint32_t n)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    last = n;
+    ++count;
+    cond.notify_all();
+  }
+
+  bool waitFor(uint32_t n)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(5);
+    while (last < n)
+    {
+      if (!cond.timed_wait(lock, deadline))
+        return false;
+    }
+    return true;
+  }
+
+  boost::mutex mutex;
+  boost::condition_variable cond;
+  uint32_t last;
+  int count;
+};
+
+/** @brief Records the cycles of the loops, in the order they ran */
+struct Cycles
+{
+  void add(const std::string& name)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    names.push_back(name);
+  }
+
+  boost::mutex mutex;
+  std::vector<std::string> names;
+};
+
+void runLoop(Lockstep* lockstep, std::string name, nav_executor::Phase phase, int cycles, Cycles* record,
+             bool* ready, boost::mutex* ready_mutex, boost::condition_variable* ready_cond)
+{
+  Lockstep::Loop loop(lockstep, name, phase);
+  for (int i = 0; i < cycles; ++i)
+  {
+    if (i == 0)
+    {
+      // join before the first tick
+      boost::unique_lock<boost::mutex> lock(*ready_mutex);
+      *ready = true;
+      ready_cond->notify_all();
+    }
+    if (!loop.wait())
+      return;
+    // the later phases must not overtake a slow earlier one
+    if (phase == nav_executor::PHASE_ESTIMATION)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    record->add(name);
+  }
+}
+
+}  // namespace
+
+TEST(lockstep, no_loops)
+{
+  // a process with nothing taking part acks each tick as it comes, and again if asked
+  Acks acks;
+  Lockstep lockstep(boost::bind(&Acks::ack, &acks, _1));
+  lockstep.tick(1);
+  EXPECT_EQ(1u, acks.last);
+  lockstep.tick(2);
+  EXPECT_EQ(2u, acks.last);
+  lockstep.tick(2);
+  EXPECT_EQ(3, acks.count);
+  lockstep.tick(1);
+  EXPECT_EQ(3, acks.count);
+}
+
+TEST(lockstep, phases_in_order)
+{
+  Acks acks;
+  Lockstep lockstep(boost::bind(&Acks::ack, &acks, _1));
+  Cycles cycles;
+  const int ticks = 3;
+
+  const char* names[] = {"control", "costmap", "ekf"};
+  nav_executor::Phase phases[] = {nav_executor::PHASE_CONTROL, nav_executor::PHASE_COSTMAP,
+                                  nav_executor::PHASE_ESTIMATION};
+  boost::thread_group threads;
+  for (int i = 0; i < 3; ++i)
+  {
+    boost::mutex ready_mutex;
+    boost::condition_variable ready_cond;
+    bool ready = false;
+    // each loop ends its last cycle by leaving, so runs one wait() more than it has cycles
+    threads.create_thread(boost::bind(runLoop, &lockstep, std::string(names[i]), phases[i], ticks, &cycles, &ready,
+                                      &ready_mutex, &ready_cond));
+    boost::unique_lock<boost::mutex> lock(ready_mutex);
+    while (!ready)
+      ready_cond.wait(lock);
+    // let it get into wait() and join
+    lock.unlock();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+  }
+
+  for (uint32_t n = 1; n <= ticks; ++n)
+  {
+    lockstep.tick(n);
+    ASSERT_TRUE(acks.waitFor(n));
+    // one cycle of each loop per tick, in phase order
+    boost::unique_lock<boost::mutex> lock(cycles.mutex);
+    ASSERT_EQ(3u * n, cycles.names.size());
+    EXPECT_EQ("ekf", cycles.names[3 * (n - 1)]);
+    EXPECT_EQ("costmap", cycles.names[3 * (n - 1) + 1]);
+    EXPECT_EQ("control", cycles.names[3 * (n - 1) + 2]);
+  }
+  threads.join_all();
+  EXPECT_EQ(ticks, acks.count);
+}
+
+TEST(lockstep, join_and_leave)
+{
+  Acks acks;
+  Lockstep lockstep(boost::bind(&Acks::ack, &acks, _1));
+  lockstep.tick(1);
+
+  // a loop joining during a tick takes part from the next one, and holds it up until it leaves
+  Lockstep::Loop loop(&lockstep, "planner", nav_executor::PHASE_PLANNING);
+  bool abort = true;
+  EXPECT_FALSE(loop.wait(&abort));
+  lockstep.tick(2);
+  EXPECT_EQ(2u, acks.last);
+
+  Lockstep::Loop other(&lockstep, "control", nav_executor::PHASE_CONTROL);
+  boost::thread waiter(boost::bind(&Lockstep::Loop::wait, &other, static_cast<const bool*>(NULL)));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  lockstep.tick(3);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  waiter.join();
+  EXPECT_EQ(2u, acks.last);
+  other.leave();
+  EXPECT_EQ(3u, acks.last);
+}
+
+TEST(lockstep, loops_come_and_go)
+{
+  Acks acks;
+  Lockstep lockstep(boost::bind(&Acks::ack, &acks, _1));
+
+  // a loop made for each goal and destroyed after it, while joined, doesn't hold up the ticks that follow
+  for (uint32_t n = 1; n <= 5; ++n)
+  {
+    {
+      Lockstep::Loop loop(&lockstep, "control", nav_executor::PHASE_CONTROL);
+      boost::thread waiter(boost::bind(&Lockstep::Loop::wait, &loop, static_cast<const bool*>(NULL)));
+      boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+      lockstep.tick(n);
+      waiter.join();
+      EXPECT_EQ(n - 1, acks.last);
+    }
+    EXPECT_EQ(n, acks.last);
+  }
+  lockstep.tick(6);
+  EXPECT_EQ(6u, acks.last);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
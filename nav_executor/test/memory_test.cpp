@@ -0,0 +1,103 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <nav_executor/memory.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using nav_executor::MemoryCounter;
+using nav_executor::MemoryUsage;
+
+namespace
+{
+
+/** @brief The usage of the named component, or of "total" */
+MemoryUsage usageOf(const std::string& component)
+{
+  std::vector<MemoryUsage> usage = nav_executor::memoryUsage();
+  for (unsigned int i = 0; i < usage.size(); ++i)
+  {
+    if (usage[i].component == component)
+      return usage[i];
+  }
+  MemoryUsage none = {component, 0, 0};
+  return none;
+}
+
+}  // namespace
+
+TEST(memory, counters_of_a_component_add_up)
+{
+  size_t total = usageOf("total").bytes;
+  {
+    MemoryCounter a("test/grid");
+    MemoryCounter b("test/grid");
+    a.set(100);
+    b.set(50);
+    EXPECT_EQ(150u, usageOf("test/grid").bytes);
+    EXPECT_EQ(total + 150, usageOf("total").bytes);
+
+    a.set(10);
+    EXPECT_EQ(60u, usageOf("test/grid").bytes);
+    EXPECT_EQ(150u, usageOf("test/grid").peak_bytes);
+  }
+
+  // the counters give their bytes back, the peak stays
+  EXPECT_EQ(0u, usageOf("test/grid").bytes);
+  EXPECT_EQ(150u, usageOf("test/grid").peak_bytes);
+  EXPECT_EQ(total, usageOf("total").bytes);
+  EXPECT_LE(total + 150, usageOf("total").peak_bytes);
+}
+
+TEST(memory, set_component_moves_the_bytes)
+{
+  MemoryCounter counter("test/unnamed");
+  counter.set(64);
+  counter.setComponent("test/named");
+  EXPECT_EQ(0u, usageOf("test/unnamed").bytes);
+  EXPECT_EQ(64u, usageOf("test/unnamed").peak_bytes);
+  EXPECT_EQ(64u, usageOf("test/named").bytes);
+  EXPECT_EQ(64u, counter.bytes());
+
+  counter.set(32);
+  EXPECT_EQ(32u, usageOf("test/named").bytes);
+  EXPECT_EQ(64u, usageOf("test/named").peak_bytes);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
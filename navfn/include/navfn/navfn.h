@@ -45,6 +45,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <nav_executor/memory.h>
 
 // cost defs
 #define COST_UNKNOWN_ROS 255		// 255 is unknown cost
@@ -97,6 +98,8 @@ positions at about 1/2 cell resolution; else returns 0.
       int* goal, int* start,
       float *plan, int nplan);
 
+  struct PropWorkers;
+
 
 
   /**
@@ -122,14 +125,34 @@ positions at about 1/2 cell resolution; else returns 0.
        */
       void setNavArr(int nx, int ny); /**< sets or resets the size of the map */
       int nx, ny, ns;		/**< size of grid, in pixels */
+      nav_executor::MemoryCounter memory;	/**< counts the cell arrays and buffers, under navfn until set */
+
+      /**
+       * @brief  Keep the cell arrays between plans, so that setupNavFn() only resets the cells
+       * the last propagation and path touched instead of the whole map
+       * @param keep Whether or not to keep the arrays
+       */
+      void setPersistentWorkspace(bool keep);
+      bool persistent;		/**< whether the cell arrays are kept between plans */
+      int touchedLo, touchedHi;	/**< cells [touchedLo, touchedHi) were written since the last reset */
 
       /**
        * @brief  Set up the cost array for the planner, usually from ROS  
        * @param cmap The costmap 
        * @param isROS Whether or not the costmap is coming in in ROS format
        * @param allow_unknown Whether or not the planner should be allowed to plan through unknown space
+       * @param stride The row length of cmap, if it is wider than the planner's map; 0 for nx
+       */
+      void setCostmap(const COSTTYPE *cmap, bool isROS=true, bool allow_unknown = true, int stride = 0); /**< sets up the cost map */
+
+      /**
+       * @brief  Translates again the ROS costs of the cells [x0, x1) by [y0, y1), leaving the rest as
+       * the last setCostmap() left them; the cells found changed are kept for calcNavFnIncremental()
+       * @param cmap The costmap, from the same origin as for setCostmap()
+       * @param allow_unknown Whether or not the planner should be allowed to plan through unknown space
+       * @param stride The row length of cmap, if it is wider than the planner's map; 0 for nx
        */
-      void setCostmap(const COSTTYPE *cmap, bool isROS=true, bool allow_unknown = true); /**< sets up the cost map */
+      void updateCostmap(const COSTTYPE *cmap, int x0, int y0, int x1, int y1, bool allow_unknown = true, int stride = 0);
 
       /**
        * @brief  Calculates a plan using the A* heuristic, returns true if one is found
@@ -142,6 +165,26 @@ positions at about 1/2 cell resolution; else returns 0.
        */
       bool calcNavFnDijkstra(bool atStart = false);	/**< calculates the full navigation function */
 
+      /**
+       * @brief  Calculates a plan keeping the potential field of the last call when the goal is the same:
+       * only the potentials that may depend on the cells setCostmap() found changed are propagated again,
+       * and the propagation goes on from where it stopped if it has not reached the start yet
+       * @return True if a plan is found, false otherwise
+       */
+      bool calcNavFnIncremental();
+      bool fieldValid;		/**< whether potarr holds a field calcNavFnIncremental() can repair */
+      int fieldGoal[2];		/**< goal of that field */
+      int changedBox[4];	/**< cells setCostmap() or updateCostmap() found changed, x0,y0,x1,y1 inclusive; empty when x0 > x1 */
+
+      /**
+       * @brief  Clears the potentials at or above a threshold and queues the cells on the edge
+       * of what is kept, so that propNavFnDijkstra() rebuilds the cleared part
+       * @param thresh The lowest potential that may depend on a changed cell
+       * @return False if the edge does not fit in a priority buffer
+       */
+      bool repairNavFn(float thresh);
+      void setCostBorder();	/**< sets the outer cells of the cost array to obstacles */
+
       /**
        * @brief  Accessor for the x-coordinates of a path
        * @return The x-coordinates of a path
@@ -166,6 +209,12 @@ positions at about 1/2 cell resolution; else returns 0.
        */
       float getLastPathCost();      /**< Return cost of path found the last time A* was called */
 
+      /**
+       * @brief  Gets the number of cells the last propagation put into the priority blocks
+       * @return The number of cells visited, counting a cell each time it was queued
+       */
+      int getLastCellsVisited();
+
       /** cell arrays */
       COSTTYPE *costarr;	/**< cost array in 2D configuration space */
       float   *potarr;		/**< potential array, navigation function potential */
@@ -220,6 +269,23 @@ positions at about 1/2 cell resolution; else returns 0.
        */
       void updateCellAstar(int n);	/**< updates the cell at index <n>, uses A* heuristic */
 
+      /**
+       * @brief  Update each priority block as a whole in the propagation: the new potentials of its cells
+       * all come from the ones the cycle started with, so they can be computed several cells at a time
+       * @param on Whether or not to update blocks as a whole
+       */
+      void setBlockUpdate(bool on);
+      bool blockUpdate;		/**< whether priority blocks are updated as a whole */
+
+      /**
+       * @brief  Updates all the cells of the current priority block, as updateCell() or updateCellAstar()
+       * would from the potentials the block started with
+       * @param astar Whether or not to queue by the A* heuristic
+       */
+      void updateBlock(bool astar);
+      float *blockPot, *blockKey;	/**< new potential of each cell of the block, and the one it is queued by */
+      unsigned char *blockAct;	/**< whether to store it, and which neighbors to queue */
+
       void setupNavFn(bool keepit = false); /**< resets all nav fn arrays for propagation */
 
       /**
@@ -229,6 +295,15 @@ positions at about 1/2 cell resolution; else returns 0.
        * @return true if the start point is reached
        */
       bool propNavFnDijkstra(int cycles, bool atStart = false); /**< returns true if start point found or full prop */
+
+      /**
+       * @brief  Share the large priority blocks of propNavFnDijkstra() between threads. The cells of such a
+       * block are then all updated from the potentials the cycle started with, rather than one after another.
+       * @param n The number of threads, counting the calling one; 1 propagates serially
+       */
+      void setPropagationThreads(int n);
+      PropWorkers *propWorkers;	/**< the threads helping propNavFnDijkstra(), NULL when serial */
+
       /**
        * @brief  Run propagation for <cycles> iterations, or until start is reached using the best-first A* method with Euclidean distance heuristic
        * @param cycles The maximum number of iterations to run for
@@ -236,13 +311,13 @@ positions at about 1/2 cell resolution; else returns 0.
        */
       bool propNavFnAstar(int cycles); /**< returns true if start point found */
 
-      /** gradient and paths */
-      float *gradx, *grady;		/**< gradient arrays, size of potential array */
+      /** paths */
       float *pathx, *pathy;		/**< path points, as subpixel cell coordinates */
       int npath;			/**< number of path points */
       int npathbuf;			/**< size of pathx, pathy buffers */
 
       float last_path_cost_; /**< Holds the cost of the path found the last time A* was called */
+      int last_cells_visited_; /**< Holds the number of cells the last propagation queued */
 
 
       /**
@@ -252,7 +327,7 @@ positions at about 1/2 cell resolution; else returns 0.
        */
       int calcPath(int n, int *st = NULL); /**< calculates path for at most <n> cycles, returns path length, 0 if none */
 
-      float gradCell(int n);	/**< calculates gradient at cell <n>, returns norm */
+      float gradCell(int n, float &gx, float &gy); /**< calculates the unit gradient at cell <n> into <gx>, <gy>, returns norm */
       float pathStep;		/**< step size for following gradient */
 
       /** display callback */
@@ -92,6 +92,11 @@ namespace navfn {
        */
       void initialize(std::string name, costmap_2d::Costmap2D* costmap, std::string global_frame);
 
+      bool initializeOnCostmap(std::string name, costmap_2d::Costmap2D* costmap, std::string global_frame) {
+        initialize(name, costmap, global_frame);
+        return true;
+      }
+
       /**
        * @brief Given a goal pose in the world, compute a plan
        * @param start The start pose 
@@ -169,6 +174,7 @@ namespace navfn {
       ros::Publisher plan_pub_;
       pcl_ros::Publisher<PotarrPoint> potarr_pub_;
       bool initialized_, allow_unknown_, visualize_potential_;
+      bool incremental_;
 
 
     private:
@@ -179,8 +185,17 @@ namespace navfn {
       }
 
       void mapToWorld(double mx, double my, double& wx, double& wy);
+      void getPlanFromPath(bool reverse, std::vector<geometry_msgs::PoseStamped>& plan);
+      bool setPlannerWindow(int x0, int y0, int x1, int y1);
+      bool findLegalGoal(const geometry_msgs::PoseStamped& goal, double tolerance, geometry_msgs::PoseStamped& best_pose);
+      void publishPotential();
       void clearRobotCell(const tf::Stamped<tf::Pose>& global_pose, unsigned int mx, unsigned int my);
       double planner_window_x_, planner_window_y_, default_tolerance_;
+      double window_margin_;
+      int window_x0_, window_y0_;
+      bool cache_costs_, costs_valid_;
+      unsigned long costs_version_;
+      int costs_window_[4], costs_stride_;
       std::string tf_prefix_;
       boost::mutex mutex_;
       ros::ServiceServer make_plan_srv_;
@@ -0,0 +1,255 @@
+//
+// headless timing benchmark of the nav fn planner
+//
+// Reads scenario files with one plan per line,
+//   <map.pgm> <start x> <start y> <goal x> <goal y>
+// where the map is a raw ROS costmap, relative to the scenario file, and
+// '#' starts a comment. Each plan is run in every mode and reported as CSV,
+// or JSON with -json, on stdout or to the file given with -o, which keeps them
+// apart from what readPGM() prints. Times are the best of the -r repeats.
+//
+//   navbench [-json] [-r repeats] [-t threads] [-o file] scenarios.txt...
+//
+
+#include <navfn/navfn.h>
+#include <navfn/read_pgm_costmap.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace navfn;
+
+static double get_ms()
+{
+  struct timeval t0;
+  gettimeofday(&t0,NULL);
+  double ret = t0.tv_sec * 1000.0;
+  ret += ((double)t0.tv_usec)*0.001;
+  return ret;
+}
+
+// a JSON string body for s, with quotes, backslashes and control characters escaped
+static std::string
+jsonEscape(const std::string &s)
+{
+  std::string e;
+  for (size_t i = 0; i < s.size(); i++)
+  {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\')
+    {
+      e += '\\';
+      e += c;
+    }
+    else if (c < 0x20)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      e += buf;
+    }
+    else
+      e += c;
+  }
+  return e;
+}
+
+struct Scenario
+{
+  std::string map;
+  int start[2];
+  int goal[2];
+};
+
+struct Result
+{
+  bool found;
+  int cells;			// cells put into the priority blocks
+  double prop_ms;		// setup and propagation
+  double path_ms;		// gradient descent from the start
+  float cost;			// potential at the start
+  int length;			// path points
+};
+
+static const char *modes[] = { "dijkstra", "astar", "threads", "block", "incremental" };
+static const int nmodes = sizeof(modes)/sizeof(modes[0]);
+
+// one plan in one mode; the incremental mode times the repair after a patch
+// of obstacles is dropped on the middle of the path of a first plan
+static Result
+runPlan(const COSTTYPE *cmap, int sx, int sy, const Scenario &sc, int mode, int threads)
+{
+  Result r;
+  NavFn nav(sx,sy);
+  nav.setCostmap(cmap, true, true);
+  nav.setGoal(const_cast<int *>(sc.goal));
+  nav.setStart(const_cast<int *>(sc.start));
+  if (mode == 2)
+    nav.setPropagationThreads(threads);
+  nav.setBlockUpdate(mode == 3);
+  int startCell = sc.start[1]*sx + sc.start[0];
+  int cycles = std::max(sx*sy/20, sx+sy);
+
+  double t0, t1, t2;
+  if (mode == 4)
+  {
+    std::vector<COSTTYPE> changed(cmap, cmap + sx*sy);
+    if (nav.calcNavFnIncremental() && nav.npath > 0)
+    {
+      int px = (int)nav.pathx[nav.npath/2], py = (int)nav.pathy[nav.npath/2];
+      for (int y = std::max(py-3, 1); y <= std::min(py+3, sy-2); y++)
+        for (int x = std::max(px-3, 1); x <= std::min(px+3, sx-2); x++)
+          changed[y*sx + x] = COST_OBS;
+    }
+    nav.setCostmap(&changed[0], true, true);
+
+    // the repair runs calcPath() itself, which is timed again on its own
+    t0 = get_ms();
+    r.found = nav.calcNavFnIncremental();
+    t2 = get_ms();
+    nav.calcPath(sx*sy/2);
+    t1 = t2 - (get_ms() - t2);
+  }
+  else
+  {
+    t0 = get_ms();
+    nav.setupNavFn(true);
+    if (mode == 1)
+      nav.propNavFnAstar(cycles);
+    else
+      nav.propNavFnDijkstra(cycles, true);
+    t1 = get_ms();
+    r.found = nav.calcPath(mode == 1 ? sx*4 : sx*sy/2) > 0;
+    t2 = get_ms();
+  }
+
+  r.cells = nav.getLastCellsVisited();
+  r.prop_ms = t1 - t0;
+  r.path_ms = t2 - t1;
+  r.cost = nav.potarr[startCell];
+  r.length = r.found ? nav.npath : 0;
+  return r;
+}
+
+static bool
+readScenarios(const char *fname, std::vector<Scenario> &scenarios)
+{
+  std::ifstream in(fname);
+  if (!in)
+    return false;
+
+  std::string dir(fname);
+  size_t slash = dir.rfind('/');
+  dir = slash == std::string::npos ? "" : dir.substr(0, slash+1);
+
+  std::string line;
+  while (std::getline(in, line))
+  {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    Scenario sc;
+    if (!(fields >> sc.map >> sc.start[0] >> sc.start[1] >> sc.goal[0] >> sc.goal[1]))
+      continue;
+    if (sc.map[0] != '/')
+      sc.map = dir + sc.map;
+    scenarios.push_back(sc);
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  bool json = false;
+  int repeats = 5;
+  int threads = 4;
+  FILE *out = stdout;
+  std::vector<Scenario> scenarios;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-json"))
+      json = true;
+    else if (!strcmp(argv[i], "-r") && i+1 < argc)
+      repeats = std::max(atoi(argv[++i]), 1);
+    else if (!strcmp(argv[i], "-t") && i+1 < argc)
+      threads = std::max(atoi(argv[++i]), 1);
+    else if (!strcmp(argv[i], "-o") && i+1 < argc)
+    {
+      out = fopen(argv[++i], "w");
+      if (!out)
+      {
+        fprintf(stderr, "[NavBench] Can't write %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (!readScenarios(argv[i], scenarios))
+    {
+      fprintf(stderr, "[NavBench] Can't read scenario file %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (scenarios.empty())
+  {
+    fprintf(stderr, "usage: %s [-json] [-r repeats] [-t threads] [-o file] scenarios.txt...\n", argv[0]);
+    return 1;
+  }
+
+  if (json)
+    fprintf(out, "[\n");
+  else
+    fprintf(out, "map,start_x,start_y,goal_x,goal_y,mode,found,cells,propagation_ms,path_ms,path_cost,path_length\n");
+
+  bool first = true;
+  for (size_t s = 0; s < scenarios.size(); s++)
+  {
+    const Scenario &sc = scenarios[s];
+    int sx, sy;
+    COSTTYPE *cmap = readPGM(sc.map.c_str(), &sx, &sy, true);
+    if (!cmap)
+      continue;
+    if (sc.start[0] < 1 || sc.start[0] >= sx-1 || sc.start[1] < 1 || sc.start[1] >= sy-1 ||
+        sc.goal[0] < 1 || sc.goal[0] >= sx-1 || sc.goal[1] < 1 || sc.goal[1] >= sy-1)
+    {
+      fprintf(stderr, "[NavBench] Start or goal off %s\n", sc.map.c_str());
+      free(cmap);
+      continue;
+    }
+
+    for (int m = 0; m < nmodes; m++)
+    {
+      Result best = runPlan(cmap, sx, sy, sc, m, threads);
+      for (int i = 1; i < repeats; i++)
+      {
+        Result r = runPlan(cmap, sx, sy, sc, m, threads);
+        best.prop_ms = std::min(best.prop_ms, r.prop_ms);
+        best.path_ms = std::min(best.path_ms, r.path_ms);
+      }
+
+      if (json)
+        fprintf(out, "%s  {\"map\": \"%s\", \"start\": [%d, %d], \"goal\": [%d, %d], \"mode\": \"%s\", "
+                "\"found\": %s, \"cells\": %d, \"propagation_ms\": %.3f, \"path_ms\": %.3f, "
+                "\"path_cost\": %.1f, \"path_length\": %d}",
+                first ? "" : ",\n", jsonEscape(sc.map).c_str(), sc.start[0], sc.start[1], sc.goal[0], sc.goal[1],
+                modes[m], best.found ? "true" : "false", best.cells, best.prop_ms, best.path_ms,
+                best.found ? best.cost : -1.0, best.length);
+      else
+        fprintf(out, "%s,%d,%d,%d,%d,%s,%d,%d,%.3f,%.3f,%.1f,%d\n",
+                sc.map.c_str(), sc.start[0], sc.start[1], sc.goal[0], sc.goal[1], modes[m],
+                best.found, best.cells, best.prop_ms, best.path_ms, best.found ? best.cost : -1.0, best.length);
+      first = false;
+    }
+    free(cmap);
+  }
+
+  if (json)
+    fprintf(out, "\n]\n");
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
@@ -45,9 +45,34 @@
 
 #include <navfn/navfn.h>
 #include <ros/console.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace navfn {
 
+  //
+  // cell arrays start on a cache line
+  //
+
+  template <typename T>
+    static T *allocCells(int n)
+    {
+      void *p = NULL;
+      if (posix_memalign(&p, 64, n*sizeof(T)) != 0)
+        throw std::bad_alloc();
+      return static_cast<T *>(p);
+    }
+
   //
   // function to perform nav fn calculation
   // keeps track of internal buffers, will be more efficient
@@ -107,13 +132,16 @@ namespace navfn {
   // create nav fn buffers 
   //
 
-  NavFn::NavFn(int xs, int ys)
+  NavFn::NavFn(int xs, int ys) : memory("navfn")
   {  
     // create cell arrays
     costarr = NULL;
     potarr = NULL;
     pending = NULL;
-    gradx = grady = NULL;
+    nx = ny = ns = 0;
+    persistent = false;
+    propWorkers = NULL;
+    fieldValid = false;
     setNavArr(xs,ys);
 
     // priority buffers
@@ -121,9 +149,16 @@ namespace navfn {
     pb2 = new int[PRIORITYBUFSIZE];
     pb3 = new int[PRIORITYBUFSIZE];
 
+    // whole block updates
+    blockUpdate = false;
+    blockPot = new float[PRIORITYBUFSIZE];
+    blockKey = new float[PRIORITYBUFSIZE];
+    blockAct = new unsigned char[PRIORITYBUFSIZE];
+
     // for Dijkstra (breadth-first), set to COST_NEUTRAL
     // for A* (best-first), set to COST_NEUTRAL
     priInc = 2*COST_NEUTRAL;	
+    last_cells_visited_ = 0;
 
     // goal and start
     goal[0] = goal[1] = 0;
@@ -142,16 +177,10 @@ namespace navfn {
 
   NavFn::~NavFn()
   {
-    if(costarr)
-      delete[] costarr;
-    if(potarr)
-      delete[] potarr;
-    if(pending)
-      delete[] pending;
-    if(gradx)
-      delete[] gradx;
-    if(grady)
-      delete[] grady;
+    setPropagationThreads(1);
+    free(costarr);
+    free(potarr);
+    free(pending);
     if(pathx)
       delete[] pathx;
     if(pathy)
@@ -162,6 +191,9 @@ namespace navfn {
       delete[] pb2;
     if(pb3)
       delete[] pb3;
+    delete[] blockPot;
+    delete[] blockKey;
+    delete[] blockAct;
   }
 
 
@@ -200,41 +232,74 @@ namespace navfn {
     {
       ROS_DEBUG("[NavFn] Array is %d x %d\n", xs, ys);
 
+      if (costarr && xs == nx && ys == ny)
+        return;			// same size, the arrays can be reused
+
       nx = xs;
       ny = ys;
       ns = nx*ny;
 
-      if(costarr)
-        delete[] costarr;
-      if(potarr)
-        delete[] potarr;
-      if(pending)
-        delete[] pending;
-
-      if(gradx)
-        delete[] gradx;
-      if(grady)
-        delete[] grady;
+      free(costarr);
+      free(potarr);
+      free(pending);
 
-      costarr = new COSTTYPE[ns]; // cost array, 2d config space
+      costarr = allocCells<COSTTYPE>(ns); // cost array, 2d config space
       memset(costarr, 0, ns*sizeof(COSTTYPE));
-      potarr = new float[ns];	// navigation potential array
-      pending = new bool[ns];
+      potarr = allocCells<float>(ns);	// navigation potential array
+      pending = allocCells<bool>(ns);
       memset(pending, 0, ns*sizeof(bool));
-      gradx = new float[ns];
-      grady = new float[ns];
+      memory.set(size_t(ns)*(sizeof(COSTTYPE) + sizeof(float) + sizeof(bool))
+                 + PRIORITYBUFSIZE*(3*sizeof(int) + 2*sizeof(float) + sizeof(unsigned char)));
+
+      // nothing has been reset yet
+      touchedLo = 0;
+      touchedHi = ns;
+      fieldValid = false;
+    }
+
+  void
+    NavFn::setPersistentWorkspace(bool keep)
+    {
+      persistent = keep;
     }
 
 
+  // widening the box of changed cells; the border is always an obstacle to the propagation,
+  // so a change there does not count
+#define markChanged(x, y) { if (y>0 && y<ny-1 && x>0 && x<nx-1) { \
+    changedBox[0] = std::min(changedBox[0], x); changedBox[1] = std::min(changedBox[1], y); \
+    changedBox[2] = std::max(changedBox[2], x); changedBox[3] = std::max(changedBox[3], y); }}
+
+  // This transforms the incoming ROS cost values:
+  // COST_OBS                 -> COST_OBS (incoming "lethal obstacle")
+  // COST_OBS_ROS             -> COST_OBS (incoming "inscribed inflated obstacle")
+  // values in range 0 to 252 -> values from COST_NEUTRAL to COST_OBS_ROS.
+  static inline COSTTYPE
+    translateCost(int v, bool allow_unknown)
+    {
+      if (v < COST_OBS_ROS)
+      {
+        v = COST_NEUTRAL+COST_FACTOR*v;
+        return v >= COST_OBS ? COST_OBS-1 : v;
+      }
+      if (v == COST_UNKNOWN_ROS && allow_unknown)
+        return COST_OBS-1;
+      return COST_OBS;
+    }
+
   //
   // set up cost array, usually from ROS
   // 通过costmap地图来设置cost array
   // v = COST_NEUTRAL + COST_FACTOR * v
   // #define COSTYPE unsigned char
   void
-    NavFn::setCostmap(const COSTTYPE *cmap, bool isROS, bool allow_unknown)
+    NavFn::setCostmap(const COSTTYPE *cmap, bool isROS, bool allow_unknown, int stride)
     {
       COSTTYPE *cm = costarr;
+      int skip = stride > nx ? stride-nx : 0;	// rest of each row of a wider cmap
+      int ntot = 0;		// number of obstacle cells, for setupNavFn() to skip counting them
+      changedBox[0] = changedBox[1] = INT_MAX;
+      changedBox[2] = changedBox[3] = -1;
       if (isROS)			// ROS-type cost array
       {
         for (int i=0; i<ny; i++)
@@ -242,25 +307,14 @@ namespace navfn {
           int k=i*nx;
           for (int j=0; j<nx; j++, k++, cmap++, cm++)
           {
-            // This transforms the incoming cost values:
-            // COST_OBS                 -> COST_OBS (incoming "lethal obstacle")
-            // COST_OBS_ROS             -> COST_OBS (incoming "inscribed inflated obstacle")
-            // values in range 0 to 252 -> values from COST_NEUTRAL to COST_OBS_ROS.
-            *cm = COST_OBS;
-            int v = *cmap;
-            if (v < COST_OBS_ROS)
-            {
-              v = COST_NEUTRAL+COST_FACTOR*v;
-              if (v >= COST_OBS)
-                v = COST_OBS-1;
-              *cm = v;
-            }
-            else if(v == COST_UNKNOWN_ROS && allow_unknown)
-            {
-              v = COST_OBS-1;
-              *cm = v;
-            }
+            COSTTYPE c = translateCost(*cmap, allow_unknown);
+            if (c == COST_OBS)
+              ntot++;
+            if (c != *cm)
+              markChanged(j, i);
+            *cm = c;
           }
+          cmap += skip;
         }
       }
       else // not a ROS map, just a PGM
@@ -270,26 +324,64 @@ namespace navfn {
           int k=i*nx;
           for (int j=0; j<nx; j++, k++, cmap++, cm++)
           {
-            *cm = COST_OBS;
-            if (i<7 || i > ny-8 || j<7 || j > nx-8)
-              continue;	// don't do borders
+            COSTTYPE c = COST_OBS;
+            ntot++;
             int v = *cmap;
-            if (v < COST_OBS_ROS)
+            if (i<7 || i > ny-8 || j<7 || j > nx-8)
+              ;			// don't do borders
+            else if (v < COST_OBS_ROS)
             {
               v = COST_NEUTRAL+COST_FACTOR*v;
               if (v >= COST_OBS)
                 v = COST_OBS-1;
-              *cm = v;
+              c = v;
+              ntot--;
             }
             else if(v == COST_UNKNOWN_ROS)
             {
               v = COST_OBS-1;
-              *cm = v;
+              c = v;
+              ntot--;
             }
+            if (c != *cm)
+              markChanged(j, i);
+            *cm = c;
           }
+          cmap += skip;
         }
 
       }
+      nobs = ntot;
+    }
+
+  //
+  // translate again only the ROS costs of a box that changed since setCostmap()
+  //
+  void
+    NavFn::updateCostmap(const COSTTYPE *cmap, int x0, int y0, int x1, int y1, bool allow_unknown, int stride)
+    {
+      if (stride < nx)
+        stride = nx;
+      changedBox[0] = changedBox[1] = INT_MAX;
+      changedBox[2] = changedBox[3] = -1;
+      x0 = std::max(x0, 0);
+      y0 = std::max(y0, 0);
+      x1 = std::min(x1, nx);
+      y1 = std::min(y1, ny);
+      for (int i=y0; i<y1; i++)
+      {
+        const COSTTYPE *cp = cmap + i*stride + x0;
+        COSTTYPE *cm = costarr + i*nx + x0;
+        for (int j=x0; j<x1; j++, cp++, cm++)
+        {
+          COSTTYPE c = translateCost(*cp, allow_unknown);
+          if (c == *cm)
+            continue;
+          nobs += (c == COST_OBS) - (*cm == COST_OBS);
+          markChanged(j, i);
+          *cm = c;
+        }
+      }
     }
 
   bool
@@ -324,6 +416,107 @@ namespace navfn {
     }
 
 
+  //
+  // repair the navigation function of the last call after the costmap changed
+  //
+
+  bool
+    NavFn::calcNavFnIncremental()
+    {
+      bool repair = fieldValid && goal[0] == fieldGoal[0] && goal[1] == fieldGoal[1];
+      setCostBorder();		// setCostmap() has written over it
+
+      if (repair && changedBox[0] <= changedBox[2])
+      {
+        // a potential below the lowest one next to a changed cell was
+        // propagated without passing through any of them
+        int x0 = std::max(changedBox[0]-1, 0), x1 = std::min(changedBox[2]+1, nx-1);
+        int y0 = std::max(changedBox[1]-1, 0), y1 = std::min(changedBox[3]+1, ny-1);
+        float thresh = POT_HIGH;
+        for (int y=y0; y<=y1; y++)
+          for (int k=y*nx+x0; k<=y*nx+x1; k++)
+            if (potarr[k] < thresh)
+              thresh = potarr[k];
+
+        if (thresh <= 0 || (thresh < POT_HIGH && !repairNavFn(thresh)))
+        {
+          ROS_DEBUG("[NavFn] Change too close to the goal, replanning from scratch\n");
+          repair = false;
+        }
+      }
+
+      if (!repair)
+      {
+        bool found = calcNavFnDijkstra(true);
+        fieldValid = true;
+        fieldGoal[0] = goal[0];
+        fieldGoal[1] = goal[1];
+        return found;
+      }
+
+      // go on with the propagation if the start is not reached yet
+      int startCell = start[1]*nx + start[0];
+      if (potarr[startCell] >= POT_HIGH)
+        propNavFnDijkstra(std::max(nx*ny/20,nx+ny),true);
+
+      int len = calcPath(nx*ny/2);
+
+      if (len > 0)			// found plan
+      {
+        ROS_DEBUG("[NavFn] Path found, %d steps\n", len);
+        return true;
+      }
+      else
+      {
+        ROS_DEBUG("[NavFn] No path found\n");
+        return false;
+      }
+    }
+
+  bool
+    NavFn::repairNavFn(float thresh)
+    {
+      // only the cells written since the last reset hold potentials, and
+      // only their neighbors can be pending
+      int lo = touchedLo, hi = touchedHi;
+      int plo = std::max(0, lo-nx-1), phi = std::min(ns, hi+nx+1);
+
+      for (int i=lo; i<hi; i++)
+      {
+        if (potarr[i] >= thresh)
+          potarr[i] = POT_HIGH;
+      }
+
+      // the cells without a potential next to one with a potential are the new
+      // wavefront, along with the cells the last propagation left queued
+      curT = thresh + priInc;
+      curP = pb1;
+      curPe = 0;
+      nextP = pb2;
+      nextPe = 0;
+      overP = pb3;
+      overPe = 0;
+      for (int k=plo; k<phi; k++)
+      {
+        bool queued = pending[k];
+        pending[k] = false;
+        if (costarr[k] >= COST_OBS)
+          continue;		// border cells are obstacles, so the neighbors are on the map
+        if (queued || (potarr[k] >= POT_HIGH &&
+              (potarr[k-1] < POT_HIGH || potarr[k+1] < POT_HIGH ||
+               potarr[k-nx] < POT_HIGH || potarr[k+nx] < POT_HIGH)))
+        {
+          if (curPe >= PRIORITYBUFSIZE)
+            return false;
+          curP[curPe++] = k;
+          pending[k] = true;
+        }
+      }
+
+      return true;
+    }
+
+
   //
   // calculate navigation function, given a costmap, goal, and start
   //
@@ -404,21 +597,15 @@ namespace navfn {
     costarr[n]<COST_OBS && overPe<PRIORITYBUFSIZE) \
   { overP[overPe++]=n; pending[n]=true; }}
 
+  // widening the range of cells written since the last reset
+#define touch(n) { if (n<touchedLo) touchedLo=n; if (n>=touchedHi) touchedHi=n+1; }
 
-  // Set up navigation potential arrays for new propagation
+
+  // outer bounds of cost array
 
   void
-    NavFn::setupNavFn(bool keepit)
+    NavFn::setCostBorder()
     {
-      // reset values in propagation arrays
-      for (int i=0; i<ns; i++)
-      {
-        potarr[i] = POT_HIGH;
-        if (!keepit) costarr[i] = COST_NEUTRAL;
-        gradx[i] = grady[i] = 0.0;
-      }
-
-      // outer bounds of cost array
       COSTTYPE *pc;
       pc = costarr;
       for (int i=0; i<nx; i++)
@@ -432,6 +619,35 @@ namespace navfn {
       pc = costarr + nx - 1;
       for (int i=0; i<ny; i++, pc+=nx)
         *pc = COST_OBS;
+    }
+
+
+  // Set up navigation potential arrays for new propagation
+
+  void
+    NavFn::setupNavFn(bool keepit)
+    {
+      // reset values in propagation arrays; a kept workspace only needs the cells
+      // the last run wrote, and the neighbors it queued, reset
+      bool partial = persistent && keepit;
+      int lo = 0, hi = ns;
+      if (partial)
+      {
+        lo = std::max(0, touchedLo-nx-1);
+        hi = std::min(ns, touchedHi+nx+1);
+      }
+      for (int i=lo; i<hi; i++)
+      {
+        potarr[i] = POT_HIGH;
+        if (!keepit) costarr[i] = COST_NEUTRAL;
+      }
+      touchedLo = ns;
+      touchedHi = 0;
+      fieldValid = false;
+
+      // outer bounds of cost array
+      setCostBorder();
+      COSTTYPE *pc;
 
       // priority buffers
       curT = COST_OBS;
@@ -441,22 +657,26 @@ namespace navfn {
       nextPe = 0;
       overP = pb3;
       overPe = 0;
-      memset(pending, 0, ns*sizeof(bool));
+      if (lo < hi)
+        memset(pending+lo, 0, (hi-lo)*sizeof(bool));
 
       // set goal
       // 设置目标
       int k = goal[0] + goal[1]*nx;
       initCost(k,0);
 
-      // find # of obstacle cells
-      pc = costarr;
-      int ntot = 0;
-      for (int i=0; i<ns; i++, pc++)
+      // find # of obstacle cells, which setCostmap() has counted for a kept workspace
+      if (!partial)
       {
-        if (*pc >= COST_OBS)
-          ntot++;			// number of cells that are obstacles
+        pc = costarr;
+        int ntot = 0;
+        for (int i=0; i<ns; i++, pc++)
+        {
+          if (*pc >= COST_OBS)
+            ntot++;			// number of cells that are obstacles
+        }
+        nobs = ntot;
       }
-      nobs = ntot;
     }
 
 
@@ -470,6 +690,7 @@ namespace navfn {
     NavFn::initCost(int k, float v)
     {
       potarr[k] = v;
+      touch(k);
       push_cur(k+1);
       push_cur(k-1);
       push_cur(k-nx);
@@ -562,6 +783,7 @@ namespace navfn {
 		  
 		  // potential 代价值
           potarr[n] = pot;
+          touch(n);
           if (pot < curT)	// low-cost buffer block 
           {
             if (l > pot+le) push_next(n-1);
@@ -653,6 +875,7 @@ namespace navfn {
           float dist = hypot(x-start[0], y-start[1])*(float)COST_NEUTRAL;
 
           potarr[n] = pot;
+          touch(n);
           pot += dist;
           if (pot < curT)	// low-cost buffer block 
           {
@@ -676,6 +899,390 @@ namespace navfn {
 
 
 
+  //
+  // whole block updates
+  // the new potentials of a range of a priority block are computed from the potentials
+  // the cycle started with, as updateCell() would: the neighbors of a number of cells are
+  // gathered into lanes, and the planar wave update is done on all of them at once
+  //
+
+#define BLOCK_LANES 64		// cells gathered at a time
+
+  // pot gets the new potential of each cell, key the one it is queued by (adding the A*
+  // distance to start, if given), and act bit 4 if the potential is lower than the cell's,
+  // then bits 0-3 if its left, right, upper, lower neighbor is worth queueing
+  static void
+    blockPotentials(const NavFn *nav, const int *cells, int begin, int end, const int *start,
+        float *pot, float *key, unsigned char *act)
+    {
+      const float *potarr = nav->potarr;
+      const COSTTYPE *costarr = nav->costarr;
+      int nx = nav->nx;
+      float l[BLOCK_LANES], r[BLOCK_LANES], u[BLOCK_LANES], d[BLOCK_LANES];
+      float hf[BLOCK_LANES], old[BLOCK_LANES], dist[BLOCK_LANES], q[BLOCK_LANES];
+      unsigned char lower[BLOCK_LANES];
+
+      for (int b=begin; b<end; b+=BLOCK_LANES)
+      {
+        int m = std::min(BLOCK_LANES, end-b);
+        for (int j=0; j<m; j++)
+        {
+          int k = cells[b+j];
+          l[j] = potarr[k-1];
+          r[j] = potarr[k+1];
+          u[j] = potarr[k-nx];
+          d[j] = potarr[k+nx];
+          hf[j] = (float)costarr[k];
+          old[j] = potarr[k];
+        }
+        if (start)
+          for (int j=0; j<m; j++)
+          {
+            int k = cells[b+j];
+            float dx = k%nx - start[0], dy = k/nx - start[1];
+            dist[j] = dx*dx + dy*dy;
+          }
+
+        float *bp = pot + b;
+        int j = 0;
+#if defined(__SSE2__)
+        // 4 cells at a time
+        const __m128 obs = _mm_set1_ps(COST_OBS), neutral = _mm_set1_ps(COST_NEUTRAL);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 c2 = _mm_set1_ps(-0.2301f), c1 = _mm_set1_ps(0.5307f), c0 = _mm_set1_ps(0.7040f);
+        for (; j+4 <= m; j+=4)
+        {
+          __m128 h = _mm_loadu_ps(hf+j);
+          __m128 ta = _mm_min_ps(_mm_loadu_ps(u+j), _mm_loadu_ps(d+j));
+          __m128 tc = _mm_min_ps(_mm_loadu_ps(l+j), _mm_loadu_ps(r+j));
+          __m128 lo = _mm_min_ps(ta, tc);
+          __m128 dc = _mm_andnot_ps(sign, _mm_sub_ps(tc, ta));
+          __m128 dd = _mm_div_ps(dc, h);
+          __m128 v = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c2, dd), c1), dd), c0);
+          __m128 far = _mm_cmpge_ps(dc, h);	// too large, ta-only update
+          __m128 p = _mm_add_ps(lo, _mm_or_ps(_mm_and_ps(far, h), _mm_andnot_ps(far, _mm_mul_ps(h, v))));
+          _mm_storeu_ps(bp+j, p);
+          _mm_storeu_ps(q+j, start ? _mm_add_ps(p, _mm_mul_ps(_mm_sqrt_ps(_mm_loadu_ps(dist+j)), neutral)) : p);
+          int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(p, _mm_loadu_ps(old+j)), _mm_cmplt_ps(h, obs)));
+          for (int t=0; t<4; t++)
+            lower[j+t] = mask >> t & 1;
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        // 4 cells at a time
+        const float32x4_t obs = vdupq_n_f32(COST_OBS), neutral = vdupq_n_f32(COST_NEUTRAL);
+        const float32x4_t c2 = vdupq_n_f32(-0.2301f), c1 = vdupq_n_f32(0.5307f), c0 = vdupq_n_f32(0.7040f);
+        for (; j+4 <= m; j+=4)
+        {
+          float32x4_t h = vld1q_f32(hf+j);
+          float32x4_t ta = vminq_f32(vld1q_f32(u+j), vld1q_f32(d+j));
+          float32x4_t tc = vminq_f32(vld1q_f32(l+j), vld1q_f32(r+j));
+          float32x4_t lo = vminq_f32(ta, tc);
+          float32x4_t dc = vabdq_f32(tc, ta);
+          float32x4_t dd = vdivq_f32(dc, h);
+          float32x4_t v = vfmaq_f32(c0, vfmaq_f32(c1, c2, dd), dd);
+          uint32x4_t far = vcgeq_f32(dc, h);	// too large, ta-only update
+          float32x4_t p = vaddq_f32(lo, vbslq_f32(far, h, vmulq_f32(h, v)));
+          vst1q_f32(bp+j, p);
+          vst1q_f32(q+j, start ? vfmaq_f32(p, vsqrtq_f32(vld1q_f32(dist+j)), neutral) : p);
+          uint32_t mask[4];
+          vst1q_u32(mask, vandq_u32(vcltq_f32(p, vld1q_f32(old+j)), vcltq_f32(h, obs)));
+          for (int t=0; t<4; t++)
+            lower[j+t] = mask[t] & 1;
+        }
+#endif
+        for (; j<m; j++)
+        {
+          float ta = u[j]<d[j] ? u[j] : d[j], tc = l[j]<r[j] ? l[j] : r[j];
+          float dc = tc-ta;
+          if (dc < 0)
+          {
+            dc = -dc;
+            ta = tc;
+          }
+          float p;
+          if (dc >= hf[j])
+            p = ta+hf[j];
+          else
+          {
+            float dd = dc/hf[j];
+            p = ta + hf[j]*((-0.2301f*dd + 0.5307f)*dd + 0.7040f);
+          }
+          bp[j] = p;
+          q[j] = start ? p + sqrtf(dist[j])*(float)COST_NEUTRAL : p;
+          lower[j] = p < old[j] && hf[j] < COST_OBS;
+        }
+
+        // the neighbors of the cells whose potential goes down are looked at one by one
+        for (j=0; j<m; j++)
+        {
+          if (key)
+            key[b+j] = q[j];
+          act[b+j] = 0;
+          if (!lower[j])
+            continue;
+          int k = cells[b+j];
+          float p = q[j];
+          act[b+j] = 16 |
+            (l[j] > p + INVSQRT2*(float)costarr[k-1]) |
+            (r[j] > p + INVSQRT2*(float)costarr[k+1]) << 1 |
+            (u[j] > p + INVSQRT2*(float)costarr[k-nx]) << 2 |
+            (d[j] > p + INVSQRT2*(float)costarr[k+nx]) << 3;
+        }
+      }
+    }
+
+  void
+    NavFn::setBlockUpdate(bool on)
+    {
+      blockUpdate = on;
+    }
+
+  void
+    NavFn::updateBlock(bool astar)
+    {
+      blockPotentials(this, curP, 0, curPe, astar ? start : NULL, blockPot, blockKey, blockAct);
+
+      // store the potentials and queue the neighbors, in the order of the block
+      for (int i=0; i<curPe; i++)
+      {
+        unsigned char a = blockAct[i];
+        if (!a)
+          continue;
+        int n = curP[i];
+        potarr[n] = blockPot[i];
+        touch(n);
+        if (blockKey[i] < curT)	// low-cost buffer block
+        {
+          if (a & 1) push_next(n-1);
+          if (a & 2) push_next(n+1);
+          if (a & 4) push_next(n-nx);
+          if (a & 8) push_next(n+nx);
+        }
+        else			// overflow block
+        {
+          if (a & 1) push_over(n-1);
+          if (a & 2) push_over(n+1);
+          if (a & 4) push_over(n-nx);
+          if (a & 8) push_over(n+nx);
+        }
+      }
+    }
+
+
+  //
+  // parallel propagation
+  // each cycle that is large enough is done in two phases, split between the threads
+  // by ranges of the current priority block: first the new potentials of all its cells
+  // are computed from the potentials the cycle started with, as updateCell() would,
+  // then each thread stores those of its cells and queues their neighbors into buffers
+  // of its own, which are appended to the priority blocks in thread order
+  //
+
+#define PROP_MIN_CELLS 256	// cells per thread below which a cycle runs serially
+#define PROP_SPINS 1000		// busy waits before yielding
+
+  struct PropWorkers
+  {
+    NavFn *nav;
+    int n;			// threads, counting the caller
+    boost::thread_group threads;
+
+    // runs: the workers sleep between them
+    boost::mutex mutex;
+    boost::condition_variable wake;
+    int run;			// number of runs started
+    int runGo;			// go when the last one started
+    bool stop;
+
+    // cycles: the caller starts one by bumping go, the workers count themselves done
+    volatile int go;
+    volatile int done;
+    volatile int arrived;	// at the barrier between the phases
+    volatile int phase;
+    volatile bool finished;	// the run is over
+
+    std::vector<float> pot;	// new potential of each cell of the block
+    std::vector<unsigned char> act; // whether to store it, and which neighbors to queue
+    std::vector<std::vector<int> > next, over;
+    std::vector<int> lo, hi;	// range of cells each thread wrote
+
+    PropWorkers(NavFn *nav, int n)
+      : nav(nav), n(n), run(0), runGo(0), stop(false), go(0), done(0), arrived(0), phase(0), finished(false),
+        pot(PRIORITYBUFSIZE), act(PRIORITYBUFSIZE), next(n), over(n), lo(n), hi(n)
+    {
+      for (int t=1; t<n; t++)
+        threads.create_thread(boost::bind(&PropWorkers::work, this, t));
+    }
+
+    ~PropWorkers()
+    {
+      {
+        boost::mutex::scoped_lock lock(mutex);
+        stop = true;
+      }
+      wake.notify_all();
+      threads.join_all();
+    }
+
+    static void spin(int &spins)
+    {
+      if (++spins > PROP_SPINS)
+        boost::this_thread::yield();
+    }
+
+    // all threads meet here between the two phases of a cycle
+    void barrier()
+    {
+      int p = phase;
+      if (__sync_add_and_fetch(&arrived, 1) == n)
+      {
+        arrived = 0;
+        __sync_synchronize();
+        phase = p + 1;
+      }
+      else
+        for (int spins = 0; phase == p;)
+          spin(spins);
+    }
+
+    void work(int t)
+    {
+      int seen = 0;
+      for (;;)
+      {
+        int cycle;
+        {
+          boost::mutex::scoped_lock lock(mutex);
+          while (run == seen && !stop)
+            wake.wait(lock);
+          if (stop)
+            return;
+          seen = run;
+          cycle = runGo;
+        }
+        for (;;)
+        {
+          for (int spins = 0; go == cycle;)
+            spin(spins);
+          cycle = go;
+          __sync_synchronize();
+          bool last = finished;
+          if (!last)
+            doCycle(t);
+          __sync_add_and_fetch(&done, 1);
+          if (last)
+            break;
+        }
+      }
+    }
+
+    void start()
+    {
+      finished = false;
+      boost::mutex::scoped_lock lock(mutex);
+      run++;
+      runGo = go;
+      wake.notify_all();
+    }
+
+    // let the workers know the run is over, and wait for them to go back to sleep
+    void finish()
+    {
+      finished = true;
+      release();
+    }
+
+    // start the workers on the next cycle, or out of the run, and wait for them to be done
+    void release(bool work = false)
+    {
+      done = 0;
+      __sync_synchronize();
+      go++;
+      if (work)
+        doCycle(0);
+      for (int spins = 0; done < n-1;)
+        spin(spins);
+      __sync_synchronize();
+    }
+
+    // one cycle over the current priority block
+    void cycle()
+    {
+      release(true);
+
+      // append the queued cells in thread order, dropping those that do not fit as the push macros do
+      for (int t=0; t<n; t++)
+      {
+        if (lo[t] < nav->touchedLo) nav->touchedLo = lo[t];
+        if (hi[t] > nav->touchedHi) nav->touchedHi = hi[t];
+        append(next[t], nav->nextP, nav->nextPe);
+        append(over[t], nav->overP, nav->overPe);
+      }
+    }
+
+    void append(const std::vector<int> &cells, int *block, int &end)
+    {
+      for (size_t i=0; i<cells.size(); i++)
+      {
+        if (end < PRIORITYBUFSIZE)
+          block[end++] = cells[i];
+        else
+          nav->pending[cells[i]] = false;
+      }
+    }
+
+    void doCycle(int t)
+    {
+      int begin = (long)nav->curPe * t / n;
+      int end = (long)nav->curPe * (t+1) / n;
+      const int *cells = nav->curP;
+      const COSTTYPE *costarr = nav->costarr;
+      int nx = nav->nx;
+
+      // new potentials, from the values the cycle started with
+      blockPotentials(nav, cells, begin, end, NULL, &pot[0], NULL, &act[0]);
+
+      barrier();
+
+      // store them and queue the neighbors; a cell is only in the block once, so each
+      // potential has one writer, and the pending flags are claimed atomically
+      next[t].clear();
+      over[t].clear();
+      lo[t] = nav->ns;
+      hi[t] = 0;
+      int ns = nav->ns;
+      bool *pending = nav->pending;
+      const int offsets[4] = { -1, 1, -nx, nx };
+      for (int i=begin; i<end; i++)
+      {
+        if (!act[i])
+          continue;
+        int k = cells[i];
+        nav->potarr[k] = pot[i];
+        if (k < lo[t]) lo[t] = k;
+        if (k >= hi[t]) hi[t] = k+1;
+        std::vector<int> &queue = pot[i] < nav->curT ? next[t] : over[t];
+        for (int j=0; j<4; j++)
+        {
+          int m = k + offsets[j];
+          if ((act[i] & (1 << j)) && m >= 0 && m < ns && !pending[m] && costarr[m] < COST_OBS &&
+              !__sync_lock_test_and_set(&pending[m], true))
+            queue.push_back(m);
+        }
+      }
+    }
+  };
+
+  void
+    NavFn::setPropagationThreads(int n)
+    {
+      delete propWorkers;
+      propWorkers = NULL;
+      if (n > 1)
+        propWorkers = new PropWorkers(this, n);
+    }
+
+
   //
   // main propagation function
   // Dijkstra method, breadth-first
@@ -700,6 +1307,9 @@ namespace navfn {
       // set up start cell
       int startCell = start[1]*nx + start[0];
 
+      if (propWorkers)
+        propWorkers->start();
+
       // cycles 迭代次数
       for (; cycle < cycles; cycle++) // go for this many cycles, unless interrupted
       {
@@ -721,10 +1331,17 @@ namespace navfn {
 
         // process current priority buffer
 		// 处理current priority缓冲区
-        pb = curP; 
-        i = curPe;
-        while (i-- > 0)		
-          updateCell(*pb++);
+        if (propWorkers && curPe >= PROP_MIN_CELLS*propWorkers->n)
+          propWorkers->cycle();
+        else if (blockUpdate)
+          updateBlock(false);
+        else
+        {
+          pb = curP; 
+          i = curPe;
+          while (i-- > 0)		
+            updateCell(*pb++);
+        }
 
         if (displayInt > 0 &&  (cycle % displayInt) == 0)
           displayFn(this);
@@ -757,6 +1374,10 @@ namespace navfn {
           if (potarr[startCell] < POT_HIGH)
             break;
       }
+
+      if (propWorkers)
+        propWorkers->finish();
+      last_cells_visited_ = nc;
 	
 	  // 经过多少次循环，多少个单元被访问
       ROS_DEBUG("[NavFn] Used %d cycles, %d cells visited (%d%%), priority buf max %d\n", 
@@ -810,10 +1431,15 @@ namespace navfn {
           pending[*(pb++)] = false;
 
         // process current priority buffer
-        pb = curP; 
-        i = curPe;
-        while (i-- > 0)		
-          updateCellAstar(*pb++);
+        if (blockUpdate)
+          updateBlock(true);
+        else
+        {
+          pb = curP; 
+          i = curPe;
+          while (i-- > 0)		
+            updateCellAstar(*pb++);
+        }
 
         if (displayInt > 0 &&  (cycle % displayInt) == 0)
           displayFn(this);
@@ -843,6 +1469,7 @@ namespace navfn {
       }
 
       last_path_cost_ = potarr[startCell];
+      last_cells_visited_ = nc;
 
       ROS_DEBUG("[NavFn] Used %d cycles, %d cells visited (%d%%), priority buf max %d\n", 
           cycle,nc,(int)((nc*100.0)/(ns-nobs)),nwv);
@@ -858,6 +1485,11 @@ namespace navfn {
     return last_path_cost_;
   }
 
+  int NavFn::getLastCellsVisited()
+  {
+    return last_cells_visited_;
+  }
+
 
   //
   // Path construction
@@ -997,28 +1629,27 @@ namespace navfn {
         else // have a good gradient here			
         {
 
-          // get grad at four positions near cell
-          gradCell(stc);
-          gradCell(stc+1);
-          gradCell(stcnx);
-          gradCell(stcnx+1);
+          // get grad at four positions near cell, only ever needed along the path
+          float gx[4], gy[4];
+          gradCell(stc, gx[0], gy[0]);
+          gradCell(stc+1, gx[1], gy[1]);
+          gradCell(stcnx, gx[2], gy[2]);
+          gradCell(stcnx+1, gx[3], gy[3]);
 
 
           // get interpolated gradient
           // 得到插值梯度
-		  // x = (1 - dy) * ((1 - dx) * gradx[stc]  + dx * gradx[stc+1]) + dy * ((1 - dx) * gradx[stcnx] + dx * gradx[stcnx + 1]) 
-          float x1 = (1.0-dx)*gradx[stc] + dx*gradx[stc+1];
-          float x2 = (1.0-dx)*gradx[stcnx] + dx*gradx[stcnx+1];
+		  // x = (1 - dy) * ((1 - dx) * gx[0]  + dx * gx[1]) + dy * ((1 - dx) * gx[2] + dx * gx[3])
+          float x1 = (1.0-dx)*gx[0] + dx*gx[1];
+          float x2 = (1.0-dx)*gx[2] + dx*gx[3];
           float x = (1.0-dy)*x1 + dy*x2; // interpolated x
-          float y1 = (1.0-dx)*grady[stc] + dx*grady[stc+1];
-          float y2 = (1.0-dx)*grady[stcnx] + dx*grady[stcnx+1];
+          float y1 = (1.0-dx)*gy[0] + dx*gy[1];
+          float y2 = (1.0-dx)*gy[2] + dx*gy[3];
           float y = (1.0-dy)*y1 + dy*y2; // interpolated y
 
           // show gradients
           ROS_DEBUG("[Path] %0.2f,%0.2f  %0.2f,%0.2f  %0.2f,%0.2f  %0.2f,%0.2f; final x=%.3f, y=%.3f\n",
-                    gradx[stc], grady[stc], gradx[stc+1], grady[stc+1], 
-                    gradx[stcnx], grady[stcnx], gradx[stcnx+1], grady[stcnx+1],
-                    x, y);
+                    gx[0], gy[0], gx[1], gy[1], gx[2], gy[2], gx[3], gy[3], x, y);
 
           // check for zero gradient, failed
           if (x == 0.0 && y == 0.0)
@@ -1059,12 +1690,11 @@ namespace navfn {
 
   // calculate gradient at a cell
   // positive value are to the right and down
+  // it is not kept, the path asks for a cell's gradient no more than a few times
   float				
-    NavFn::gradCell(int n)
+    NavFn::gradCell(int n, float &gx, float &gy)
     {
-      if (gradx[n]+grady[n] > 0.0)	// check this cell
-        return 1.0;			
-
+      gx = gy = 0.0;
       if (n < nx || n > ns-nx)	// would be out of bounds
         return 0.0;
 
@@ -1107,8 +1737,8 @@ namespace navfn {
       if (norm > 0)
       {
         norm = 1.0/norm;
-        gradx[n] = norm*dx;
-        grady[n] = norm*dy;
+        gx = norm*dx;
+        gy = norm*dy;
       }
       return norm;
     }
@@ -39,6 +39,7 @@
 #include <tf/transform_listener.h>
 #include <costmap_2d/cost_values.h>
 #include <costmap_2d/costmap_2d.h>
+#include <algorithm>
 
 #include <pcl_conversions/pcl_conversions.h>
 
@@ -67,6 +68,7 @@ namespace navfn {
       costmap_ = costmap;
       global_frame_ = global_frame;
       planner_ = boost::shared_ptr<NavFn>(new NavFn(costmap_->getSizeInCellsX(), costmap_->getSizeInCellsY()));
+      planner_->memory.setComponent(name);
 
       ros::NodeHandle private_nh("~/" + name);
 
@@ -83,6 +85,32 @@ namespace navfn {
       private_nh.param("planner_window_y", planner_window_y_, 0.0);
       private_nh.param("default_tolerance", default_tolerance_, 0.0);
 
+      //keeping the planner's arrays between plans saves resetting all of them for each one
+      bool persistent_workspace;
+      private_nh.param("persistent_workspace", persistent_workspace, false);
+      planner_->setPersistentWorkspace(persistent_workspace);
+
+      int propagation_threads;
+      private_nh.param("propagation_threads", propagation_threads, 1);
+      planner_->setPropagationThreads(propagation_threads);
+
+      bool block_update;
+      private_nh.param("block_update", block_update, false);
+      planner_->setBlockUpdate(block_update);
+
+      //repairing the potential of the last plan to the same goal instead of computing it again
+      private_nh.param("incremental", incremental_, false);
+
+      //planning over a window around the start and the goal, padded by this margin in meters, which
+      //doubles each time no plan is found in it until it takes in the whole costmap; 0 plans over all of it
+      private_nh.param("planning_window_margin", window_margin_, 0.0);
+      window_x0_ = window_y0_ = 0;
+
+      //translating again only the costs the costmap records as changed since the last plan, which
+      //needs whoever writes to the costmap outside of its own functions to record what it wrote
+      private_nh.param("cache_costs", cache_costs_, false);
+      costs_valid_ = false;
+
       //get the tf prefix
       ros::NodeHandle prefix_nh;
       tf_prefix_ = tf::getPrefixParam(prefix_nh);
@@ -140,7 +168,11 @@ namespace navfn {
     if(!costmap_->worldToMap(world_point.x, world_point.y, mx, my))
       return DBL_MAX;
 
-    unsigned int index = my * planner_->nx + mx;
+    int x = (int)mx - window_x0_, y = (int)my - window_y0_;
+    if(x < 0 || y < 0 || x >= planner_->nx || y >= planner_->ny)
+      return DBL_MAX;
+
+    unsigned int index = y * planner_->nx + x;
     return planner_->potarr[index];
   }
 
@@ -150,9 +182,7 @@ namespace navfn {
       return false;
     }
 
-    //make sure to resize the underlying array that Navfn uses
-    planner_->setNavArr(costmap_->getSizeInCellsX(), costmap_->getSizeInCellsY());
-    planner_->setCostmap(costmap_->getCharMap(), true, allow_unknown_);
+    setPlannerWindow(0, 0, costmap_->getSizeInCellsX(), costmap_->getSizeInCellsY());
 
     unsigned int mx, my;
     if(!costmap_->worldToMap(world_point.x, world_point.y, mx, my))
@@ -181,6 +211,7 @@ namespace navfn {
 
     //set the associated costs in the cost map to be free
     costmap_->setCost(mx, my, costmap_2d::FREE_SPACE);
+    costmap_->recordChange(mx, mx + 1, my, my + 1);
   }
 
   bool NavfnROS::makePlanService(nav_msgs::GetPlan::Request& req, nav_msgs::GetPlan::Response& resp)
@@ -194,8 +225,40 @@ namespace navfn {
   } 
 
   void NavfnROS::mapToWorld(double mx, double my, double& wx, double& wy) {
-    wx = costmap_->getOriginX() + mx * costmap_->getResolution();
-    wy = costmap_->getOriginY() + my * costmap_->getResolution();
+    wx = costmap_->getOriginX() + (mx + window_x0_) * costmap_->getResolution();
+    wy = costmap_->getOriginY() + (my + window_y0_) * costmap_->getResolution();
+  }
+
+  bool NavfnROS::setPlannerWindow(int x0, int y0, int x1, int y1){
+    int size_x = costmap_->getSizeInCellsX(), size_y = costmap_->getSizeInCellsY();
+    window_x0_ = std::max(x0, 0);
+    window_y0_ = std::max(y0, 0);
+    x1 = std::min(x1, size_x);
+    y1 = std::min(y1, size_y);
+
+    //the costs of the last window need translating again only where the costmap changed
+    const unsigned char* costs = costmap_->getCharMap() + window_y0_ * size_x + window_x0_;
+    unsigned int cx0, cxn, cy0, cyn;
+    if(cache_costs_ && costs_valid_ && costs_window_[0] == window_x0_ && costs_window_[1] == window_y0_ &&
+        costs_window_[2] == x1 && costs_window_[3] == y1 && costs_stride_ == size_x &&
+        costmap_->getChangesSince(costs_version_, &cx0, &cxn, &cy0, &cyn)){
+      planner_->updateCostmap(costs, (int)cx0 - window_x0_, (int)cy0 - window_y0_,
+          (int)std::min(cxn, (unsigned int)x1) - window_x0_, (int)std::min(cyn, (unsigned int)y1) - window_y0_,
+          allow_unknown_, size_x);
+    }
+    else {
+      //make sure to resize the underlying array that Navfn uses
+      planner_->setNavArr(x1 - window_x0_, y1 - window_y0_);
+      planner_->setCostmap(costs, true, allow_unknown_, size_x);
+    }
+    costs_valid_ = true;
+    costs_version_ = costmap_->getVersion();
+    costs_window_[0] = window_x0_;
+    costs_window_[1] = window_y0_;
+    costs_window_[2] = x1;
+    costs_window_[3] = y1;
+    costs_stride_ = size_x;
+    return window_x0_ == 0 && window_y0_ == 0 && x1 == size_x && y1 == size_y;
   }
 
   bool NavfnROS::makePlan(const geometry_msgs::PoseStamped& start, 
@@ -262,19 +325,6 @@ namespace navfn {
     }
 #endif
 
-    //make sure to resize the underlying array that Navfn uses
-    planner_->setNavArr(costmap_->getSizeInCellsX(), costmap_->getSizeInCellsY());
-    planner_->setCostmap(costmap_->getCharMap(), true, allow_unknown_);
-
-#if 0
-    {
-      static int n = 0;
-      static char filename[1000];
-      snprintf( filename, 1000, "navfnros-makeplan-costmapC-%04d", n++ );
-      planner_->savemap( filename );
-    }
-#endif
-
     int map_start[2];
     map_start[0] = mx;
     map_start[1] = my;
@@ -282,7 +332,8 @@ namespace navfn {
     wx = goal.pose.position.x;
     wy = goal.pose.position.y;
 
-    if(!costmap_->worldToMap(wx, wy, mx, my)){
+    bool goal_on_map = costmap_->worldToMap(wx, wy, mx, my);
+    if(!goal_on_map){
       if(tolerance <= 0.0){
         ROS_WARN_THROTTLE(1.0, "The goal sent to the navfn planner is off the global costmap. Planning will always fail to this goal.");
         return false;
@@ -294,16 +345,96 @@ namespace navfn {
     int map_goal[2];
     map_goal[0] = mx;
     map_goal[1] = my;
+
+    bool windowed = window_margin_ > 0.0 && goal_on_map && !incremental_;
+    if(!windowed)
+      setPlannerWindow(0, 0, costmap_->getSizeInCellsX(), costmap_->getSizeInCellsY());
+
+#if 0
+    {
+      static int n = 0;
+      static char filename[1000];
+      snprintf( filename, 1000, "navfnros-makeplan-costmapC-%04d", n++ );
+      planner_->savemap( filename );
+    }
+#endif
+
+    if(incremental_ && goal_on_map){
+      //the potential grows from the goal here rather than from the robot, so it stays valid
+      //while the robot moves and only the part behind a change of the costmap is propagated again
+      planner_->setStart(map_start);
+      planner_->setGoal(map_goal);
+
+      if(planner_->calcNavFnIncremental()){
+        getPlanFromPath(false, plan);
+        geometry_msgs::PoseStamped goal_copy = goal;
+        goal_copy.header.stamp = ros::Time::now();
+        plan.push_back(goal_copy);
+      }
+
+      if(visualize_potential_)
+        publishPotential();
+      publishPlan(plan, 0.0, 1.0, 0.0, 0.0);
+      return !plan.empty();
+    }
 	
-	// 设置路径规划器的目标点和起始点
-    planner_->setStart(map_goal);
-    planner_->setGoal(map_start);
+    double resolution = costmap_->getResolution();
+    geometry_msgs::PoseStamped best_pose;
+    bool found_legal = false;
+    double margin = window_margin_ + std::max(tolerance, 0.0);
+    for(;;){
+      bool whole_map = true;
+      if(windowed){
+        int pad = (int)(margin / resolution) + 1;
+        whole_map = setPlannerWindow(std::min(map_start[0], map_goal[0]) - pad, std::min(map_start[1], map_goal[1]) - pad,
+            std::max(map_start[0], map_goal[0]) + pad + 1, std::max(map_start[1], map_goal[1]) + pad + 1);
+      }
+
+      int window_start[2] = { map_start[0] - window_x0_, map_start[1] - window_y0_ };
+      int window_goal[2] = { map_goal[0] - window_x0_, map_goal[1] - window_y0_ };
 
-    //bool success = planner_->calcNavFnAstar();
-    planner_->calcNavFnDijkstra(true);
+	  // 设置路径规划器的目标点和起始点
+      planner_->setStart(window_goal);
+      planner_->setGoal(window_start);
 
+      //bool success = planner_->calcNavFnAstar();
+      planner_->calcNavFnDijkstra(true);
+
+      found_legal = findLegalGoal(goal, tolerance, best_pose);
+      if(found_legal || whole_map)
+        break;
+
+      ROS_DEBUG("No plan found within %.2f m of the start and the goal, widening the planning window", margin);
+      margin *= 2;
+    }
+
+    if(found_legal){
+      //extract the plan
+	  // 提取路径
+	  // goal ==> best_pose
+      if(getPlanFromPotential(best_pose, plan)){
+        //make sure the goal we push on has the same timestamp as the rest of the plan
+        geometry_msgs::PoseStamped goal_copy = best_pose;
+        goal_copy.header.stamp = ros::Time::now();
+        plan.push_back(goal_copy);
+      }
+      else{
+        ROS_ERROR("Failed to get a plan from potential when a legal potential was found. This shouldn't happen.");
+      }
+    }
+
+    if (visualize_potential_)
+      publishPotential();
+
+    //publish the plan for visualization purposes
+    publishPlan(plan, 0.0, 1.0, 0.0, 0.0);
+
+    return !plan.empty();
+  }
+
+  bool NavfnROS::findLegalGoal(const geometry_msgs::PoseStamped& goal, double tolerance, geometry_msgs::PoseStamped& best_pose){
     double resolution = costmap_->getResolution();
-    geometry_msgs::PoseStamped p, best_pose;
+    geometry_msgs::PoseStamped p;
     p = goal;
 
     bool found_legal = false;
@@ -334,53 +465,35 @@ namespace navfn {
       p.pose.position.y += resolution;
     }
 
-    if(found_legal){
-      //extract the plan
-	  // 提取路径
-	  // goal ==> best_pose
-      if(getPlanFromPotential(best_pose, plan)){
-        //make sure the goal we push on has the same timestamp as the rest of the plan
-        geometry_msgs::PoseStamped goal_copy = best_pose;
-        goal_copy.header.stamp = ros::Time::now();
-        plan.push_back(goal_copy);
-      }
-      else{
-        ROS_ERROR("Failed to get a plan from potential when a legal potential was found. This shouldn't happen.");
-      }
-    }
+    return found_legal;
+  }
 
-    if (visualize_potential_){
-      //publish potential array
-      pcl::PointCloud<PotarrPoint> pot_area;
-      pot_area.header.frame_id = global_frame_;
-      pot_area.points.clear();
-      std_msgs::Header header;
-      pcl_conversions::fromPCL(pot_area.header, header);
-      header.stamp = ros::Time::now();
-      pot_area.header = pcl_conversions::toPCL(header);
-
-      PotarrPoint pt;
-      float *pp = planner_->potarr;
-      double pot_x, pot_y;
-      for (unsigned int i = 0; i < (unsigned int)planner_->ny*planner_->nx ; i++)
+  void NavfnROS::publishPotential(){
+    //publish potential array
+    pcl::PointCloud<PotarrPoint> pot_area;
+    pot_area.header.frame_id = global_frame_;
+    pot_area.points.clear();
+    std_msgs::Header header;
+    pcl_conversions::fromPCL(pot_area.header, header);
+    header.stamp = ros::Time::now();
+    pot_area.header = pcl_conversions::toPCL(header);
+
+    PotarrPoint pt;
+    float *pp = planner_->potarr;
+    double pot_x, pot_y;
+    for (unsigned int i = 0; i < (unsigned int)planner_->ny*planner_->nx ; i++)
+    {
+      if (pp[i] < 10e7)
       {
-        if (pp[i] < 10e7)
-        {
-          mapToWorld(i%planner_->nx, i/planner_->nx, pot_x, pot_y);
-          pt.x = pot_x;
-          pt.y = pot_y;
-          pt.z = pp[i]/pp[planner_->start[1]*planner_->nx + planner_->start[0]]*20;
-          pt.pot_value = pp[i];
-          pot_area.push_back(pt);
-        }
+        mapToWorld(i%planner_->nx, i/planner_->nx, pot_x, pot_y);
+        pt.x = pot_x;
+        pt.y = pot_y;
+        pt.z = pp[i]/pp[planner_->start[1]*planner_->nx + planner_->start[0]]*20;
+        pt.pot_value = pp[i];
+        pot_area.push_back(pt);
       }
-      potarr_pub_.publish(pot_area);
     }
-
-    //publish the plan for visualization purposes
-    publishPlan(plan, 0.0, 1.0, 0.0, 0.0);
-
-    return !plan.empty();
+    potarr_pub_.publish(pot_area);
   }
 
   /**
@@ -446,8 +559,12 @@ namespace navfn {
     }
 
     int map_goal[2];
-    map_goal[0] = mx;
-    map_goal[1] = my;
+    map_goal[0] = (int)mx - window_x0_;
+    map_goal[1] = (int)my - window_y0_;
+    if(map_goal[0] < 0 || map_goal[1] < 0 || map_goal[0] >= planner_->nx || map_goal[1] >= planner_->ny){
+      ROS_WARN_THROTTLE(1.0, "The goal sent to the navfn planner is outside the window the potential was computed over.");
+      return false;
+    }
 
 	// 把goal送到start？？？
     planner_->setStart(map_goal);
@@ -455,12 +572,22 @@ namespace navfn {
     planner_->calcPath(costmap_->getSizeInCellsX() * 4);
 
     //extract the plan
+    getPlanFromPath(true, plan);
+
+    //publish the plan for visualization purposes
+    publishPlan(plan, 0.0, 1.0, 0.0, 0.0);
+    return !plan.empty();
+  }
+
+  void NavfnROS::getPlanFromPath(bool reverse, std::vector<geometry_msgs::PoseStamped>& plan){
     float *x = planner_->getPathX();
     float *y = planner_->getPathY();
     int len = planner_->getPathLen();
     ros::Time plan_time = ros::Time::now();
 
-    for(int i = len - 1; i >= 0; --i){
+    for(int j = 0; j < len; ++j){
+      int i = reverse ? len - 1 - j : j;
+
       //convert the plan to world coordinates
       double world_x, world_y;
       mapToWorld(x[i], y[i], world_x, world_y);
@@ -477,9 +604,5 @@ namespace navfn {
       pose.pose.orientation.w = 1.0;
       plan.push_back(pose);
     }
-
-    //publish the plan for visualization purposes
-    publishPlan(plan, 0.0, 1.0, 0.0, 0.0);
-    return !plan.empty();
   }
 };
@@ -92,17 +92,23 @@ void print_neighborhood_of_last_path_entry( navfn::NavFn* nav )
 
   for( int y = yf - 2; y <= yf + 2; y++ )
   {
-    printf( "%5d x:", y );
+    float gx[5], gy[5];
     for( int x = xf - 2; x <= xf + 2; x++ )
     {
-      printf( " %5.1f", nav->gradx[ y * nav->nx + x ] );
+      nav->gradCell( y * nav->nx + x, gx[ x - xf + 2 ], gy[ x - xf + 2 ] );
+    }
+
+    printf( "%5d x:", y );
+    for( int i = 0; i < 5; i++ )
+    {
+      printf( " %5.1f", gx[ i ] );
     }
     printf( "\n" );
 
     printf( "      y:" );
-    for( int x = xf - 2; x <= xf + 2; x++ )
+    for( int i = 0; i < 5; i++ )
     {
-      printf( " %5.1f", nav->grady[ y * nav->nx + x ] );
+      printf( " %5.1f", gy[ i ] );
     }
     printf( "\n" );
   }
@@ -153,6 +159,185 @@ TEST(PathCalc, easy_nav_should_always_work)
   EXPECT_TRUE( nav->calcNavFnDijkstra( true ));
 }
 
+TEST(PathCalc, persistent_workspace_matches_fresh_plan)
+{
+  navfn::NavFn* kept = make_willow_nav();
+  navfn::NavFn* fresh = make_willow_nav();
+  ASSERT_TRUE( kept != NULL && fresh != NULL );
+  kept->setPersistentWorkspace( true );
+
+  int goal[2] = { 350, 450 };
+  int start[2] = { 428, 746 };
+  kept->setGoal( goal );
+  kept->setStart( start );
+  EXPECT_TRUE( kept->calcNavFnDijkstra( true ));
+
+  // a second plan elsewhere only resets what the first one touched, and has to come out the same
+  int goal2[2] = { 350, 400 };
+  int start2[2] = { 350, 450 };
+  kept->setGoal( goal2 );
+  kept->setStart( start2 );
+  fresh->setGoal( goal2 );
+  fresh->setStart( start2 );
+  EXPECT_TRUE( kept->calcNavFnDijkstra( true ));
+  EXPECT_TRUE( fresh->calcNavFnDijkstra( true ));
+
+  for( int i = 0; i < kept->ns; i++ )
+  {
+    ASSERT_EQ( fresh->potarr[ i ], kept->potarr[ i ] );
+  }
+  ASSERT_EQ( fresh->npath, kept->npath );
+  for( int i = 0; i < kept->npath; i++ )
+  {
+    ASSERT_EQ( fresh->pathx[ i ], kept->pathx[ i ] );
+    ASSERT_EQ( fresh->pathy[ i ], kept->pathy[ i ] );
+  }
+  delete kept;
+  delete fresh;
+}
+
+TEST(PathCalc, incremental_repair_matches_fresh_plan)
+{
+  int sx,sy;
+  std::string path = ros::package::getPath( ROS_PACKAGE_NAME ) + "/test/willow_costmap.pgm";
+  COSTTYPE *cmap = readPGM( path.c_str(), &sx, &sy, true );
+  ASSERT_TRUE( cmap != NULL );
+  navfn::NavFn inc( sx, sy );
+  navfn::NavFn fresh( sx, sy );
+
+  int goal[2] = { 350, 450 };
+  int start[2] = { 750, 216 };
+  inc.setCostmap( cmap );
+  inc.setGoal( goal );
+  inc.setStart( start );
+  EXPECT_TRUE( inc.calcNavFnIncremental() );
+
+  // block the path half way, then move the start onto it, in turns; each repaired
+  // plan has to keep out of the blocks and cost about what a fresh one does
+  for( int step = 0; step < 4; step++ )
+  {
+    int px = inc.pathx[ inc.npath / 2 ];
+    int py = inc.pathy[ inc.npath / 2 ];
+    if( step % 2 == 0 )
+    {
+      for( int y = py - 3; y <= py + 3; y++ )
+        for( int x = px - 3; x <= px + 3; x++ )
+          cmap[ y * sx + x ] = COST_OBS;
+    }
+    else
+    {
+      start[0] = px;
+      start[1] = py;
+    }
+
+    inc.setCostmap( cmap );
+    inc.setStart( start );
+    fresh.setCostmap( cmap );
+    fresh.setGoal( goal );
+    fresh.setStart( start );
+    EXPECT_TRUE( inc.calcNavFnIncremental() );
+    EXPECT_TRUE( fresh.calcNavFnDijkstra( true ));
+
+    float pot = fresh.potarr[ start[1] * sx + start[0] ];
+    EXPECT_NEAR( pot, inc.potarr[ start[1] * sx + start[0] ], 0.01 * pot );
+    for( int i = 0; i < inc.npath; i++ )
+    {
+      int k = int( inc.pathy[ i ] + 0.5 ) * sx + int( inc.pathx[ i ] + 0.5 );
+      ASSERT_LT( cmap[ k ], COST_OBS_ROS );
+    }
+  }
+  free( cmap );
+}
+
+TEST(PathCalc, parallel_propagation_finds_the_same_path)
+{
+  navfn::NavFn* serial = make_willow_nav();
+  navfn::NavFn* parallel = make_willow_nav();
+  ASSERT_TRUE( serial != NULL && parallel != NULL );
+  parallel->setPropagationThreads( 4 );
+
+  int goal[2] = { 350, 450 };
+  int start[2] = { 428, 746 };
+  serial->setGoal( goal );
+  serial->setStart( start );
+  parallel->setGoal( goal );
+  parallel->setStart( start );
+  EXPECT_TRUE( serial->calcNavFnDijkstra());
+  EXPECT_TRUE( parallel->calcNavFnDijkstra());
+
+  // the cells of a block see each other's potentials a cycle later, which changes them only slightly
+  for( int i = 0; i < serial->ns; i++ )
+  {
+    ASSERT_EQ( serial->potarr[ i ] < POT_HIGH, parallel->potarr[ i ] < POT_HIGH );
+    if( serial->potarr[ i ] < POT_HIGH )
+      ASSERT_NEAR( serial->potarr[ i ], parallel->potarr[ i ], 0.01 * serial->potarr[ i ] + 1.0 );
+  }
+  EXPECT_NEAR( serial->npath, parallel->npath, serial->npath / 20 + 2 );
+  delete serial;
+  delete parallel;
+}
+
+TEST(PathCalc, block_update_finds_the_same_path)
+{
+  navfn::NavFn* cells = make_willow_nav();
+  navfn::NavFn* blocks = make_willow_nav();
+  ASSERT_TRUE( cells != NULL && blocks != NULL );
+  blocks->setBlockUpdate( true );
+
+  int goal[2] = { 350, 450 };
+  int start[2] = { 428, 746 };
+  cells->setGoal( goal );
+  cells->setStart( start );
+  blocks->setGoal( goal );
+  blocks->setStart( start );
+  EXPECT_TRUE( cells->calcNavFnDijkstra());
+  EXPECT_TRUE( blocks->calcNavFnDijkstra());
+
+  // as with threads, the cells of a block see each other's potentials a cycle later, but
+  // here in every block rather than only in large ones
+  for( int i = 0; i < cells->ns; i++ )
+  {
+    ASSERT_EQ( cells->potarr[ i ] < POT_HIGH, blocks->potarr[ i ] < POT_HIGH );
+    if( cells->potarr[ i ] < POT_HIGH )
+      ASSERT_NEAR( cells->potarr[ i ], blocks->potarr[ i ], 0.03 * cells->potarr[ i ] + 1.0 );
+  }
+  EXPECT_NEAR( cells->npath, blocks->npath, cells->npath / 20 + 2 );
+
+  EXPECT_TRUE( cells->calcNavFnAstar());
+  EXPECT_TRUE( blocks->calcNavFnAstar());
+  EXPECT_NEAR( cells->getLastPathCost(), blocks->getLastPathCost(), 0.03 * cells->getLastPathCost() );
+  delete cells;
+  delete blocks;
+}
+
+TEST(PathCalc, box_update_matches_full_translation)
+{
+  int sx,sy;
+  std::string path = ros::package::getPath( ROS_PACKAGE_NAME ) + "/test/willow_costmap.pgm";
+  COSTTYPE *cmap = readPGM( path.c_str(), &sx, &sy, true );
+  ASSERT_TRUE( cmap != NULL );
+  navfn::NavFn boxed( sx, sy );
+  navfn::NavFn full( sx, sy );
+  boxed.setCostmap( cmap );
+
+  // a window of the map, as NavfnROS hands it over
+  int x0 = 100, y0 = 50, nx = sx - 200, ny = sy - 100;
+  boxed.setNavArr( nx, ny );
+  boxed.setCostmap( cmap + y0 * sx + x0, true, true, sx );
+  for( int y = 300; y < 310; y++ )
+    for( int x = 400; x < 420; x++ )
+      cmap[ y * sx + x ] = ( x + y ) % 2 ? COST_OBS : COST_UNKNOWN_ROS;
+  boxed.updateCostmap( cmap + y0 * sx + x0, 400 - x0, 300 - y0, 420 - x0, 310 - y0, true, sx );
+
+  full.setNavArr( nx, ny );
+  full.setCostmap( cmap + y0 * sx + x0, true, true, sx );
+  for( int i = 0; i < nx * ny; i++ )
+    ASSERT_EQ( full.costarr[ i ], boxed.costarr[ i ] );
+  EXPECT_EQ( 400 - x0, boxed.changedBox[ 0 ] );
+  EXPECT_EQ( 309 - y0, boxed.changedBox[ 3 ] );
+  free( cmap );
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
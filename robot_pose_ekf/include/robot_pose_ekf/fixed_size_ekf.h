@@ -0,0 +1,97 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/* Author: Wim Meeussen */
+#ifndef __FIXED_SIZE_EKF__
+#define __FIXED_SIZE_EKF__
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+namespace estimation
+{
+
+/** Kalman filter on the 6d pose (x, y, z, roll, pitch, yaw) with matrices
+ * sized at compile time, so that an update allocates nothing.  It does what
+ * OdomEstimation asks of BFL's ExtendedKalmanFilter: the system model with
+ * no velocity input leaves the state as it is and only adds noise, and all
+ * measurement models are linear.
+ */
+class FixedSizeEkf
+{
+public:
+  typedef Eigen::Matrix<double, 6, 1> State;
+  typedef Eigen::Matrix<double, 6, 6> Covariance;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /// set the prior
+  void initialize(const State& mean, const Covariance& covariance)
+  {
+    mean_ = mean;
+    covariance_ = covariance;
+  }
+
+  /// system update, adding the system noise
+  void predict(const Covariance& noise)
+  {
+    covariance_ += noise;
+  }
+
+  /** measurement update with a linear model
+   * \param H maps the state onto the measurement
+   * \param z the measurement
+   * \param R the covariance of the measurement noise
+   */
+  template <int M>
+  void update(const Eigen::Matrix<double, M, 6>& H, const Eigen::Matrix<double, M, 1>& z,
+              const Eigen::Matrix<double, M, M>& R)
+  {
+    Eigen::Matrix<double, 6, M> PHt = covariance_ * H.transpose();
+    Eigen::Matrix<double, M, M> S = H * PHt + R;
+    Eigen::Matrix<double, 6, M> K = PHt * S.inverse();
+    mean_ += K * (z - H * mean_);
+    covariance_ -= K * H * covariance_;
+  }
+
+  const State& mean() const {return mean_;};
+  const Covariance& covariance() const {return covariance_;};
+
+private:
+  State mean_;
+  Covariance covariance_;
+};
+
+}; // namespace
+
+#endif
@@ -0,0 +1,93 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/* Author: Wim Meeussen */
+#ifndef __MEASUREMENT_BUFFER__
+#define __MEASUREMENT_BUFFER__
+
+#include <vector>
+#include <tf/tf.h>
+
+namespace estimation
+{
+
+/** Time ordered ring of the poses of one sensor, of fixed capacity, in
+ * which the pose at a time between two measurements is interpolated, as
+ * tf::Transformer does for a single pair of frames.  Once full, each new
+ * measurement replaces the oldest one.
+ */
+class MeasurementBuffer
+{
+public:
+  /// constructor
+  MeasurementBuffer(unsigned int capacity = 2048);
+
+  /// forget all measurements
+  void clear();
+
+  /** add a measurement, in time order even if it arrives out of order
+   * \param meas the pose of the sensor
+   * \param stamp the time of the measurement
+   */
+  void add(const tf::Transform& meas, const ros::Time& stamp);
+
+  /** get the pose at a time
+   * \param time the time, or zero for the newest measurement
+   * \param meas the pose, interpolated between the measurements around time
+   * \param stamp the time of the pose returned
+   * returns false if time is outside of the measurements buffered
+   */
+  bool get(const ros::Time& time, tf::Transform& meas, ros::Time& stamp) const;
+
+  /// returns true if get() would succeed for time
+  bool covers(const ros::Time& time) const;
+
+private:
+  struct Entry
+  {
+    ros::Time stamp;
+    tf::Vector3 origin;
+    tf::Quaternion rotation;
+  };
+
+  // the i'th oldest measurement
+  const Entry& at(unsigned int i) const {return entries_[(first_ + i) % entries_.size()];};
+  Entry& at(unsigned int i) {return entries_[(first_ + i) % entries_.size()];};
+
+  std::vector<Entry> entries_;
+  unsigned int first_, size_;
+};
+
+}; // namespace
+
+#endif
@@ -44,6 +44,8 @@
 #include <bfl/pdf/analyticconditionalgaussian.h>
 #include <bfl/pdf/linearanalyticconditionalgaussian.h>
 #include "nonlinearanalyticconditionalgaussianodo.h"
+#include "fixed_size_ekf.h"
+#include "measurement_buffer.h"
 
 // TF
 #include <tf/tf.h>
@@ -60,6 +62,8 @@ namespace estimation
 class OdomEstimation
 {
 public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   /// constructor
   OdomEstimation();
 
@@ -110,6 +114,13 @@ public:
    */
   void getEstimate(geometry_msgs::PoseWithCovarianceStamped& estimate);
 
+  /** get the most recent filter posterior both ways, looking it up only once
+   * \param estimate the filter posterior as a stamped tf transform
+   * \param pose the filter posterior as a pose with covariance, which is filled in place
+   * returns false if there is no posterior yet
+   */
+  bool getEstimate(tf::StampedTransform& estimate, geometry_msgs::PoseWithCovarianceStamped& pose);
+
   /** Add a sensor measurement to the measurement buffer
    * \param meas the measurement to add
    */
@@ -131,6 +142,12 @@ public:
    */
   void setBaseFootprintFrame(const std::string& base_frame);
 
+  /** run the filter on fixed size matrices rather than on BFL, which allocates
+   * on every update; it has to be chosen before the filter is initialized
+   * \param fixed_size true to use the fixed size filter
+   */
+  void setFixedSizeFilter(bool fixed_size);
+
 private:
   /// correct for angle overflow
   void angleOverflowCorrect(double& a, double ref);
@@ -142,6 +159,14 @@ private:
 			  double& x, double& y, double&z, double&Rx, double& Ry, double& Rz);
 
 
+  // update either filter with a linear measurement model
+  template <int M>
+  void measurementUpdate(const Eigen::Matrix<double, M, 1>& z, const Eigen::Matrix<double, M, 6>& H,
+                         const Eigen::Matrix<double, M, M>& covariance, double dt,
+                         BFL::LinearAnalyticConditionalGaussian* meas_pdf,
+                         BFL::LinearAnalyticMeasurementModelGaussianUncertainty* meas_model,
+                         const MatrixWrapper::SymmetricMatrix& meas_covariance);
+
   // pdf / model / filter
   BFL::AnalyticSystemModelGaussianUncertainty*            sys_model_;
   BFL::NonLinearAnalyticConditionalGaussianOdo*           sys_pdf_;
@@ -157,6 +182,14 @@ private:
   BFL::ExtendedKalmanFilter*                              filter_;
   MatrixWrapper::SymmetricMatrix                          odom_covariance_, imu_covariance_, vo_covariance_, gps_covariance_;
 
+  // fixed size filter, used instead of the above if fixed_size_
+  bool fixed_size_;
+  FixedSizeEkf fixed_filter_;
+  FixedSizeEkf::Covariance sys_noise_;
+  Eigen::Matrix<double, 6, 6> odom_H_, vo_H_, odom_covariance_fixed_, vo_covariance_fixed_;
+  Eigen::Matrix<double, 3, 6> imu_H_, gps_H_;
+  Eigen::Matrix<double, 3, 3> imu_covariance_fixed_, gps_covariance_fixed_;
+
   // vars
   MatrixWrapper::ColumnVector vel_desi_, filter_estimate_old_vec_;
   tf::Transform filter_estimate_old_;
@@ -167,8 +200,8 @@ private:
   // diagnostics
   double diagnostics_odom_rot_rel_, diagnostics_imu_rot_rel_;
 
-  // tf transformer
-  tf::Transformer transformer_;
+  // measurements of each sensor, and the filter posteriors
+  MeasurementBuffer odom_buffer_, imu_buffer_, vo_buffer_, gps_buffer_, estimate_buffer_;
 
   std::string output_frame_;
   std::string base_footprint_frame_;
@@ -41,6 +41,7 @@
 #include <tf/tf.h>
 #include <tf/transform_listener.h>
 #include <tf/transform_broadcaster.h>
+#include <nav_executor/lockstep.h>
 #include "odom_estimation.h"
 #include <robot_pose_ekf/GetStatus.h>
 
@@ -50,8 +51,10 @@
 #include "sensor_msgs/Imu.h"
 #include "geometry_msgs/PoseStamped.h"
 #include "geometry_msgs/PoseWithCovarianceStamped.h"
+#include "geometry_msgs/TransformStamped.h"
 
 #include <boost/thread/mutex.hpp>
+#include <boost/scoped_ptr.hpp>
 
 // log files
 #include <fstream>
@@ -77,8 +80,9 @@ typedef boost::shared_ptr<geometry_msgs::Twist const> VelConstPtr;
 class OdomEstimationNode
 {
 public:
-  /// constructor
-  OdomEstimationNode();
+  /// constructor; a nodelet passes in its own node handles
+  OdomEstimationNode(ros::NodeHandle nh = ros::NodeHandle(),
+                     ros::NodeHandle nh_private = ros::NodeHandle("~"));
 
   /// destructor
   virtual ~OdomEstimationNode();
@@ -99,6 +103,9 @@ private:
   /// callback function for vo data
   void gpsCallback(const GpsConstPtr& gps);
 
+  /// the stamp to keep for a sensor after a message with stamp arrives
+  ros::Time latestStamp(const ros::Time& current, const ros::Time& stamp);
+
 
   /// get the status of the filter
   bool getStatus(robot_pose_ekf::GetStatus::Request& req, robot_pose_ekf::GetStatus::Response& resp);
@@ -114,6 +121,7 @@ private:
 
   // estimated robot pose message to send
   geometry_msgs::PoseWithCovarianceStamped  output_; 
+  geometry_msgs::TransformStamped odom_trans_;
 
   // robot state
   tf::TransformListener    robot_state_;
@@ -133,6 +141,7 @@ private:
   double timeout_;
   MatrixWrapper::SymmetricMatrix odom_covariance_, imu_covariance_, vo_covariance_, gps_covariance_;
   bool debug_, self_diagnose_;
+  bool event_driven_;  // update the filter from every callback, not only from the timer
   std::string output_frame_, base_footprint_frame_, tf_prefix_;
 
   // log files for debugging
@@ -141,6 +150,9 @@ private:
   // counters
   unsigned int odom_callback_counter_, imu_callback_counter_, vo_callback_counter_,gps_callback_counter_, ekf_sent_counter_;
 
+  // runs the filter loop once per tick in lockstep, in place of timer_; stopped first, before the filter goes
+  boost::scoped_ptr<nav_executor::LockstepTimer> lockstep_timer_;
+
 }; // class
 
 }; // namespace
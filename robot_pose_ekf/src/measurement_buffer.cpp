@@ -0,0 +1,116 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <algorithm>
+#include <robot_pose_ekf/measurement_buffer.h>
+
+namespace estimation
+{
+  // constructor
+  MeasurementBuffer::MeasurementBuffer(unsigned int capacity):
+    entries_(std::max(capacity, 1u)),
+    first_(0),
+    size_(0)
+  {};
+
+  void MeasurementBuffer::clear()
+  {
+    first_ = 0;
+    size_ = 0;
+  };
+
+  void MeasurementBuffer::add(const tf::Transform& meas, const ros::Time& stamp)
+  {
+    // a measurement older than all of a full buffer would be dropped first
+    if (size_ == entries_.size() && stamp < at(0).stamp)
+      return;
+
+    // find where it goes, from the newest end, where nearly all of them go
+    unsigned int i = size_;
+    while (i > 0 && stamp < at(i-1).stamp) i--;
+    if (i > 0 && at(i-1).stamp == stamp){
+      at(i-1).origin = meas.getOrigin();
+      at(i-1).rotation = meas.getRotation();
+      return;
+    }
+
+    // make room, replacing the oldest if full
+    if (size_ == entries_.size()){
+      first_ = (first_ + 1) % entries_.size();
+      i--;
+    }
+    else
+      size_++;
+    for (unsigned int j = size_-1; j > i; j--)
+      at(j) = at(j-1);
+
+    Entry& entry = at(i);
+    entry.stamp = stamp;
+    entry.origin = meas.getOrigin();
+    entry.rotation = meas.getRotation();
+  };
+
+  bool MeasurementBuffer::covers(const ros::Time& time) const
+  {
+    if (size_ == 0) return false;
+    if (time.isZero()) return true;
+    return at(0).stamp <= time && time <= at(size_-1).stamp;
+  };
+
+  bool MeasurementBuffer::get(const ros::Time& time, tf::Transform& meas, ros::Time& stamp) const
+  {
+    if (!covers(time)) return false;
+
+    // newest first, where the filter usually asks
+    unsigned int i = size_-1;
+    if (!time.isZero())
+      while (i > 0 && time < at(i).stamp) i--;
+    const Entry& before = at(i);
+    if (time.isZero() || time == before.stamp || i+1 == size_){
+      meas.setOrigin(before.origin);
+      meas.setRotation(before.rotation);
+      stamp = before.stamp;
+      return true;
+    }
+
+    // interpolate as tf does, linearly in position and spherically in rotation
+    const Entry& after = at(i+1);
+    tfScalar ratio = (time - before.stamp).toSec() / (after.stamp - before.stamp).toSec();
+    meas.setOrigin(before.origin.lerp(after.origin, ratio));
+    meas.setRotation(tf::slerp(before.rotation, after.rotation, ratio));
+    stamp = time;
+    return true;
+  };
+
+}; // namespace
@@ -45,6 +45,19 @@ using namespace ros;
 
 namespace estimation
 {
+  // copy a covariance into a fixed size matrix of the same size
+  template <int M>
+  static void copyCovariance(const SymmetricMatrix& covar, Eigen::Matrix<double, M, M>& fixed)
+  {
+    if (covar.rows() != M){
+      ROS_ERROR("Covariance of size %d where %d was expected", (int)covar.rows(), M);
+      return;
+    }
+    for (unsigned int i=0; i<M; i++)
+      for (unsigned int j=0; j<M; j++)
+        fixed(i,j) = covar(i+1,j+1);
+  }
+
   // constructor
   OdomEstimation::OdomEstimation():
     prior_(NULL),
@@ -54,6 +67,7 @@ namespace estimation
     imu_initialized_(false),
     vo_initialized_(false),
     gps_initialized_(false),
+    fixed_size_(false),
     output_frame_(std::string("odom_combined")),
     base_footprint_frame_(std::string("base_footprint"))
   {
@@ -104,6 +118,20 @@ namespace estimation
     Hgps(1,1) = 1;    Hgps(2,2) = 1;    Hgps(3,3) = 1;    
     gps_meas_pdf_   = new LinearAnalyticConditionalGaussian(Hgps, measurement_Uncertainty_GPS);
     gps_meas_model_ = new LinearAnalyticMeasurementModelGaussianUncertainty(gps_meas_pdf_);
+
+    // the same models for the fixed size filter
+    sys_noise_ = FixedSizeEkf::Covariance::Identity() * pow(1000.0,2);
+    odom_H_.setZero();
+    odom_H_(0,0) = 1;    odom_H_(1,1) = 1;    odom_H_(5,5) = 1;
+    imu_H_.setZero();
+    imu_H_(0,3) = 1;    imu_H_(1,4) = 1;    imu_H_(2,5) = 1;
+    vo_H_.setIdentity();
+    gps_H_.setZero();
+    gps_H_(0,0) = 1;    gps_H_(1,1) = 1;    gps_H_(2,2) = 1;
+    odom_covariance_fixed_.setZero();
+    imu_covariance_fixed_.setZero();
+    vo_covariance_fixed_.setZero();
+    gps_covariance_fixed_.setZero();
   };
 
 
@@ -138,8 +166,15 @@ namespace estimation
 	else prior_Cov(i,j) = 0;
       }
     }
-    prior_  = new Gaussian(prior_Mu,prior_Cov);
-    filter_ = new ExtendedKalmanFilter(prior_);
+    if (fixed_size_){
+      FixedSizeEkf::State mean;
+      for (unsigned int i=0; i<6; i++) mean(i) = prior_Mu(i+1);
+      fixed_filter_.initialize(mean, FixedSizeEkf::Covariance::Identity() * pow(0.001,2));
+    }
+    else{
+      prior_  = new Gaussian(prior_Mu,prior_Cov);
+      filter_ = new ExtendedKalmanFilter(prior_);
+    }
 
     // remember prior
     addMeasurement(StampedTransform(prior, time, output_frame_, base_footprint_frame_));
@@ -177,33 +212,34 @@ namespace estimation
     // system update filter
     // --------------------
     // for now only add system noise
-    ColumnVector vel_desi(2); vel_desi = 0;
-    filter_->Update(sys_model_, vel_desi);
+    if (fixed_size_)
+      fixed_filter_.predict(sys_noise_);
+    else{
+      ColumnVector vel_desi(2); vel_desi = 0;
+      filter_->Update(sys_model_, vel_desi);
+    }
 
     
     // process odom measurement
     // ------------------------
     ROS_DEBUG("Process odom meas");
     if (odom_active){
-      if (!transformer_.canTransform(base_footprint_frame_,"wheelodom", filter_time)){
+      if (!odom_buffer_.get(filter_time, odom_meas_, odom_meas_.stamp_)){
         ROS_ERROR("filter time older than odom message buffer");
         return false;
       }
-      transformer_.lookupTransform("wheelodom", base_footprint_frame_, filter_time, odom_meas_);
       if (odom_initialized_){
 	// convert absolute odom measurements to relative odom measurements in horizontal plane
 	Transform odom_rel_frame =  Transform(tf::createQuaternionFromYaw(filter_estimate_old_vec_(6)), 
 					      filter_estimate_old_.getOrigin()) * odom_meas_old_.inverse() * odom_meas_;
-	ColumnVector odom_rel(6); 
-	decomposeTransform(odom_rel_frame, odom_rel(1), odom_rel(2), odom_rel(3), odom_rel(4), odom_rel(5), odom_rel(6));
-	angleOverflowCorrect(odom_rel(6), filter_estimate_old_vec_(6));
+	Eigen::Matrix<double, 6, 1> odom_rel;
+	decomposeTransform(odom_rel_frame, odom_rel(0), odom_rel(1), odom_rel(2), odom_rel(3), odom_rel(4), odom_rel(5));
+	angleOverflowCorrect(odom_rel(5), filter_estimate_old_vec_(6));
 	// update filter
-	odom_meas_pdf_->AdditiveNoiseSigmaSet(odom_covariance_ * pow(dt,2));
-
         ROS_DEBUG("Update filter with odom measurement %f %f %f %f %f %f", 
-                  odom_rel(1), odom_rel(2), odom_rel(3), odom_rel(4), odom_rel(5), odom_rel(6));
-	filter_->Update(odom_meas_model_, odom_rel);
-	diagnostics_odom_rot_rel_ = odom_rel(6);
+                  odom_rel(0), odom_rel(1), odom_rel(2), odom_rel(3), odom_rel(4), odom_rel(5));
+	measurementUpdate<6>(odom_rel, odom_H_, odom_covariance_fixed_, dt, odom_meas_pdf_, odom_meas_model_, odom_covariance_);
+	diagnostics_odom_rot_rel_ = odom_rel(5);
       }
       else{
 	odom_initialized_ = true;
@@ -218,22 +254,20 @@ namespace estimation
     // process imu measurement
     // -----------------------
     if (imu_active){
-      if (!transformer_.canTransform(base_footprint_frame_,"imu", filter_time)){
+      if (!imu_buffer_.get(filter_time, imu_meas_, imu_meas_.stamp_)){
         ROS_ERROR("filter time older than imu message buffer");
         return false;
       }
-      transformer_.lookupTransform("imu", base_footprint_frame_, filter_time, imu_meas_);
       if (imu_initialized_){
 	// convert absolute imu yaw measurement to relative imu yaw measurement 
 	Transform imu_rel_frame =  filter_estimate_old_ * imu_meas_old_.inverse() * imu_meas_;
-	ColumnVector imu_rel(3); double tmp;
-	decomposeTransform(imu_rel_frame, tmp, tmp, tmp, tmp, tmp, imu_rel(3));
-	decomposeTransform(imu_meas_,     tmp, tmp, tmp, imu_rel(1), imu_rel(2), tmp);
-	angleOverflowCorrect(imu_rel(3), filter_estimate_old_vec_(6));
-	diagnostics_imu_rot_rel_ = imu_rel(3);
+	Eigen::Matrix<double, 3, 1> imu_rel; double tmp;
+	decomposeTransform(imu_rel_frame, tmp, tmp, tmp, tmp, tmp, imu_rel(2));
+	decomposeTransform(imu_meas_,     tmp, tmp, tmp, imu_rel(0), imu_rel(1), tmp);
+	angleOverflowCorrect(imu_rel(2), filter_estimate_old_vec_(6));
+	diagnostics_imu_rot_rel_ = imu_rel(2);
 	// update filter
-	imu_meas_pdf_->AdditiveNoiseSigmaSet(imu_covariance_ * pow(dt,2));
-	filter_->Update(imu_meas_model_,  imu_rel);
+	measurementUpdate<3>(imu_rel, imu_H_, imu_covariance_fixed_, dt, imu_meas_pdf_, imu_meas_model_, imu_covariance_);
       }
       else{
 	imu_initialized_ = true;
@@ -249,20 +283,18 @@ namespace estimation
     // process vo measurement
     // ----------------------
     if (vo_active){
-      if (!transformer_.canTransform(base_footprint_frame_,"vo", filter_time)){
+      if (!vo_buffer_.get(filter_time, vo_meas_, vo_meas_.stamp_)){
         ROS_ERROR("filter time older than vo message buffer");
         return false;
       }
-      transformer_.lookupTransform("vo", base_footprint_frame_, filter_time, vo_meas_);
       if (vo_initialized_){
 	// convert absolute vo measurements to relative vo measurements
 	Transform vo_rel_frame =  filter_estimate_old_ * vo_meas_old_.inverse() * vo_meas_;
-	ColumnVector vo_rel(6);
-	decomposeTransform(vo_rel_frame, vo_rel(1),  vo_rel(2), vo_rel(3), vo_rel(4), vo_rel(5), vo_rel(6));
-	angleOverflowCorrect(vo_rel(6), filter_estimate_old_vec_(6));
+	Eigen::Matrix<double, 6, 1> vo_rel;
+	decomposeTransform(vo_rel_frame, vo_rel(0),  vo_rel(1), vo_rel(2), vo_rel(3), vo_rel(4), vo_rel(5));
+	angleOverflowCorrect(vo_rel(5), filter_estimate_old_vec_(6));
 	// update filter
-        vo_meas_pdf_->AdditiveNoiseSigmaSet(vo_covariance_ * pow(dt,2));
-        filter_->Update(vo_meas_model_,  vo_rel);
+        measurementUpdate<6>(vo_rel, vo_H_, vo_covariance_fixed_, dt, vo_meas_pdf_, vo_meas_model_, vo_covariance_);
       }
       else vo_initialized_ = true;
       vo_meas_old_ = vo_meas_;
@@ -275,18 +307,16 @@ namespace estimation
     // process gps measurement
     // ----------------------
     if (gps_active){
-      if (!transformer_.canTransform(base_footprint_frame_,"gps", filter_time)){
+      if (!gps_buffer_.get(filter_time, gps_meas_, gps_meas_.stamp_)){
         ROS_ERROR("filter time older than gps message buffer");
         return false;
       }
-      transformer_.lookupTransform("gps", base_footprint_frame_, filter_time, gps_meas_);
       if (gps_initialized_){
-        gps_meas_pdf_->AdditiveNoiseSigmaSet(gps_covariance_ * pow(dt,2));
-        ColumnVector gps_vec(3);
+        Eigen::Matrix<double, 3, 1> gps_vec;
         double tmp;
         //Take gps as an absolute measurement, do not convert to relative measurement
-        decomposeTransform(gps_meas_, gps_vec(1), gps_vec(2), gps_vec(3), tmp, tmp, tmp);
-        filter_->Update(gps_meas_model_,  gps_vec);
+        decomposeTransform(gps_meas_, gps_vec(0), gps_vec(1), gps_vec(2), tmp, tmp, tmp);
+        measurementUpdate<3>(gps_vec, gps_H_, gps_covariance_fixed_, dt, gps_meas_pdf_, gps_meas_model_, gps_covariance_);
       }
       else {
         gps_initialized_ = true;
@@ -299,7 +329,10 @@ namespace estimation
   
     
     // remember last estimate
-    filter_estimate_old_vec_ = filter_->PostGet()->ExpectedValueGet();
+    if (fixed_size_)
+      for (unsigned int i=0; i<6; i++) filter_estimate_old_vec_(i+1) = fixed_filter_.mean()(i);
+    else
+      filter_estimate_old_vec_ = filter_->PostGet()->ExpectedValueGet();
     tf::Quaternion q;
     q.setRPY(filter_estimate_old_vec_(4), filter_estimate_old_vec_(5), filter_estimate_old_vec_(6));
     filter_estimate_old_ = Transform(q,
@@ -319,6 +352,23 @@ namespace estimation
     return true;
   };
 
+  template <int M>
+  void OdomEstimation::measurementUpdate(const Eigen::Matrix<double, M, 1>& z, const Eigen::Matrix<double, M, 6>& H,
+                                         const Eigen::Matrix<double, M, M>& covariance, double dt,
+                                         LinearAnalyticConditionalGaussian* meas_pdf,
+                                         LinearAnalyticMeasurementModelGaussianUncertainty* meas_model,
+                                         const SymmetricMatrix& meas_covariance)
+  {
+    if (fixed_size_){
+      fixed_filter_.update<M>(H, z, covariance * pow(dt,2));
+      return;
+    }
+    ColumnVector meas(M);
+    for (unsigned int i=0; i<M; i++) meas(i+1) = z(i);
+    meas_pdf->AdditiveNoiseSigmaSet(meas_covariance * pow(dt,2));
+    filter_->Update(meas_model, meas);
+  }
+
   void OdomEstimation::addMeasurement(const StampedTransform& meas)
   {
     ROS_DEBUG("AddMeasurement from %s to %s:  (%f, %f, %f)  (%f, %f, %f, %f)",
@@ -326,7 +376,13 @@ namespace estimation
               meas.getOrigin().x(), meas.getOrigin().y(), meas.getOrigin().z(),
               meas.getRotation().x(),  meas.getRotation().y(), 
               meas.getRotation().z(), meas.getRotation().w());
-    transformer_.setTransform( meas );
+    // sensors are stored as the pose of the sensor, the inverse of meas
+    if (meas.child_frame_id_ == base_footprint_frame_) estimate_buffer_.add(meas, meas.stamp_);
+    else if (meas.child_frame_id_ == "wheelodom") odom_buffer_.add(meas.inverse(), meas.stamp_);
+    else if (meas.child_frame_id_ == "imu")       imu_buffer_.add(meas.inverse(), meas.stamp_);
+    else if (meas.child_frame_id_ == "vo")        vo_buffer_.add(meas.inverse(), meas.stamp_);
+    else if (meas.child_frame_id_ == "gps")       gps_buffer_.add(meas.inverse(), meas.stamp_);
+    else ROS_ERROR("Adding a measurement for an unknown sensor %s", meas.child_frame_id_.c_str());
   }
 
   void OdomEstimation::addMeasurement(const StampedTransform& meas, const MatrixWrapper::SymmetricMatrix& covar)
@@ -345,6 +401,12 @@ namespace estimation
     else if (meas.child_frame_id_ == "vo")   vo_covariance_   = covar;
     else if (meas.child_frame_id_ == "gps")  gps_covariance_  = covar;
     else ROS_ERROR("Adding a measurement for an unknown sensor %s", meas.child_frame_id_.c_str());
+
+    // keep a copy for the fixed size filter
+    if (meas.child_frame_id_ == "wheelodom") copyCovariance(covar, odom_covariance_fixed_);
+    else if (meas.child_frame_id_ == "imu")  copyCovariance(covar, imu_covariance_fixed_);
+    else if (meas.child_frame_id_ == "vo")   copyCovariance(covar, vo_covariance_fixed_);
+    else if (meas.child_frame_id_ == "gps")  copyCovariance(covar, gps_covariance_fixed_);
   };
 
 
@@ -357,46 +419,59 @@ namespace estimation
   // get filter posterior at time 'time' as Transform
   void OdomEstimation::getEstimate(Time time, Transform& estimate)
   {
-    StampedTransform tmp;
-    if (!transformer_.canTransform(base_footprint_frame_,output_frame_, time)){
+    Time stamp;
+    if (!estimate_buffer_.get(time, estimate, stamp)){
       ROS_ERROR("Cannot get transform at time %f", time.toSec());
       return;
     }
-    transformer_.lookupTransform(output_frame_, base_footprint_frame_, time, tmp);
-    estimate = tmp;
   };
 
   // get filter posterior at time 'time' as Stamped Transform
   void OdomEstimation::getEstimate(Time time, StampedTransform& estimate)
   {
-    if (!transformer_.canTransform(output_frame_, base_footprint_frame_, time)){
+    if (!estimate_buffer_.get(time, estimate, estimate.stamp_)){
       ROS_ERROR("Cannot get transform at time %f", time.toSec());
       return;
     }
-    transformer_.lookupTransform(output_frame_, base_footprint_frame_, time, estimate);
+    estimate.frame_id_ = output_frame_;
+    estimate.child_frame_id_ = base_footprint_frame_;
   };
 
   // get most recent filter posterior as PoseWithCovarianceStamped
   void OdomEstimation::getEstimate(geometry_msgs::PoseWithCovarianceStamped& estimate)
   {
-    // pose
     StampedTransform tmp;
-    if (!transformer_.canTransform(output_frame_, base_footprint_frame_, ros::Time())){
+    getEstimate(tmp, estimate);
+  };
+
+  // get most recent filter posterior as Stamped Transform and PoseWithCovarianceStamped
+  bool OdomEstimation::getEstimate(StampedTransform& estimate, geometry_msgs::PoseWithCovarianceStamped& pose)
+  {
+    // pose
+    if (!estimate_buffer_.get(ros::Time(), estimate, estimate.stamp_)){
       ROS_ERROR("Cannot get transform at time %f", 0.0);
-      return;
+      return false;
     }
-    transformer_.lookupTransform(output_frame_, base_footprint_frame_, ros::Time(), tmp);
-    poseTFToMsg(tmp, estimate.pose.pose);
+    estimate.frame_id_ = output_frame_;
+    estimate.child_frame_id_ = base_footprint_frame_;
+    poseTFToMsg(estimate, pose.pose.pose);
 
     // header
-    estimate.header.stamp = tmp.stamp_;
-    estimate.header.frame_id = "odom";
+    pose.header.stamp = estimate.stamp_;
+    pose.header.frame_id = "odom";
 
     // covariance
+    if (fixed_size_){
+      for (unsigned int i=0; i<6; i++)
+        for (unsigned int j=0; j<6; j++)
+          pose.pose.covariance[6*i+j] = fixed_filter_.covariance()(i,j);
+      return true;
+    }
     SymmetricMatrix covar =  filter_->PostGet()->CovarianceGet();
     for (unsigned int i=0; i<6; i++)
       for (unsigned int j=0; j<6; j++)
-	estimate.pose.covariance[6*i+j] = covar(i+1,j+1);
+	pose.pose.covariance[6*i+j] = covar(i+1,j+1);
+    return true;
   };
 
   // correct for angle overflow
@@ -432,4 +507,12 @@ namespace estimation
 	base_footprint_frame_ = base_frame;
   };
 
+  void OdomEstimation::setFixedSizeFilter(bool fixed_size){
+    if (filter_initialized_){
+      ROS_ERROR("Cannot change the filter once it is initialized");
+      return;
+    }
+    fixed_size_ = fixed_size;
+  };
+
 }; // namespace
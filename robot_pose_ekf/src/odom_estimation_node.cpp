@@ -35,6 +35,10 @@
 /* Author: Wim Meeussen */
 
 #include <robot_pose_ekf/odom_estimation_node.h>
+#ifdef ROBOT_POSE_EKF_NODELET
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#endif
 
 
 using namespace MatrixWrapper;
@@ -51,7 +55,7 @@ static const double EPS = 1e-5;
 namespace estimation
 {
   // constructor
-  OdomEstimationNode::OdomEstimationNode()
+  OdomEstimationNode::OdomEstimationNode(ros::NodeHandle nh, ros::NodeHandle nh_private)
     : odom_active_(false),
       imu_active_(false),
       vo_active_(false),
@@ -70,9 +74,6 @@ namespace estimation
       gps_callback_counter_(0),
       ekf_sent_counter_(0)
   {
-    ros::NodeHandle nh_private("~");
-    ros::NodeHandle nh;
-
     // paramters
     nh_private.param("output_frame", output_frame_, std::string("odom_combined"));
     nh_private.param("base_footprint_frame", base_footprint_frame_, std::string("base_footprint"));
@@ -83,6 +84,9 @@ namespace estimation
     nh_private.param("gps_used",   gps_used_, false);
     nh_private.param("debug",   debug_, false);
     nh_private.param("self_diagnose",  self_diagnose_, false);
+    bool fixed_size_filter;
+    nh_private.param("fixed_size_filter", fixed_size_filter, false);
+    nh_private.param("event_driven", event_driven_, false);
     double freq;
     nh_private.param("freq", freq, 30.0);
 
@@ -97,8 +101,15 @@ namespace estimation
     // so that user-defined tf frames are respected
     my_filter_.setOutputFrame(output_frame_);
     my_filter_.setBaseFootprintFrame(base_footprint_frame_);
+    my_filter_.setFixedSizeFilter(fixed_size_filter);
 
-    timer_ = nh_private.createTimer(ros::Duration(1.0/max(freq,1.0)), &OdomEstimationNode::spin, this);
+    // in lockstep the filter runs once per tick of the stepper, before the costmaps and planners have theirs
+    if (nav_executor::Lockstep* lockstep = nav_executor::Lockstep::shared())
+      lockstep_timer_.reset(new nav_executor::LockstepTimer(lockstep, "robot_pose_ekf", nav_executor::PHASE_ESTIMATION,
+                                                            boost::bind(&OdomEstimationNode::spin, this, ros::TimerEvent()),
+                                                            nh_private.getCallbackQueue()));
+    else
+      timer_ = nh_private.createTimer(ros::Duration(1.0/max(freq,1.0)), &OdomEstimationNode::spin, this);
 
     // advertise our estimation
     pose_pub_ = nh_private.advertise<geometry_msgs::PoseWithCovarianceStamped>("odom_combined", 10);
@@ -169,6 +180,18 @@ namespace estimation
 
 
 
+  // stamp of the newest measurement of a sensor; in event driven mode a
+  // message that arrives out of order only fills the measurement buffer, as
+  // the filter has usually moved past it already
+  ros::Time OdomEstimationNode::latestStamp(const ros::Time& current, const ros::Time& stamp)
+  {
+    if (event_driven_ && stamp < current) return current;
+    return stamp;
+  };
+
+
+
+
   // callback function for odom data
   void OdomEstimationNode::odomCallback(const OdomConstPtr& odom)
   {
@@ -178,7 +201,7 @@ namespace estimation
     assert(odom_used_);
 
     // receive data 
-    odom_stamp_ = odom->header.stamp;
+    odom_stamp_ = latestStamp(odom_stamp_, odom->header.stamp);
     odom_time_  = Time::now();
     Quaternion q;
     tf::quaternionMsgToTF(odom->pose.pose.orientation, q);
@@ -211,6 +234,8 @@ namespace estimation
       odom_meas_.getBasis().getEulerYPR(yaw, tmp, tmp);
       odom_file_<< fixed <<setprecision(5) << ros::Time::now().toSec() << " " << odom_meas_.getOrigin().x() << " " << odom_meas_.getOrigin().y() << "  " << yaw << "  " << endl;
     }
+
+    if (event_driven_) spin(ros::TimerEvent());
   };
 
 
@@ -224,7 +249,7 @@ namespace estimation
     assert(imu_used_);
 
     // receive data 
-    imu_stamp_ = imu->header.stamp;
+    imu_stamp_ = latestStamp(imu_stamp_, imu->header.stamp);
     tf::Quaternion orientation;
     quaternionMsgToTF(imu->orientation, orientation);
     imu_meas_ = tf::Transform(orientation, tf::Vector3(0,0,0));
@@ -282,6 +307,8 @@ namespace estimation
       imu_meas_.getBasis().getEulerYPR(yaw, tmp, tmp); 
       imu_file_ <<fixed<<setprecision(5)<<ros::Time::now().toSec()<<" "<< yaw << endl;
     }
+
+    if (event_driven_) spin(ros::TimerEvent());
   };
 
 
@@ -295,7 +322,7 @@ namespace estimation
     assert(vo_used_);
 
     // get data
-    vo_stamp_ = vo->header.stamp;
+    vo_stamp_ = latestStamp(vo_stamp_, vo->header.stamp);
     vo_time_  = Time::now();
     poseMsgToTF(vo->pose.pose, vo_meas_);
     for (unsigned int i=0; i<6; i++)
@@ -326,6 +353,8 @@ namespace estimation
       vo_file_ <<fixed<<setprecision(5)<<ros::Time::now().toSec()<<" "<< vo_meas_.getOrigin().x() << " " << vo_meas_.getOrigin().y() << " " << vo_meas_.getOrigin().z() << " "
                << Rx << " " << Ry << " " << Rz << endl;
     }
+
+    if (event_driven_) spin(ros::TimerEvent());
   };
 
 
@@ -336,7 +365,7 @@ namespace estimation
     assert(gps_used_);
 
     // get data
-    gps_stamp_ = gps->header.stamp;
+    gps_stamp_ = latestStamp(gps_stamp_, gps->header.stamp);
     gps_time_  = Time::now();
     poseMsgToTF(gps->pose.pose, gps_meas_);
     for (unsigned int i=0; i<3; i++)
@@ -364,6 +393,8 @@ namespace estimation
       // write to file
       gps_file_ <<fixed<<setprecision(5)<<ros::Time::now().toSec()<<" "<< gps_meas_.getOrigin().x() << " " << gps_meas_.getOrigin().y() << " " << gps_meas_.getOrigin().z() <<endl;
     }
+
+    if (event_driven_) spin(ros::TimerEvent());
   };
 
 
@@ -421,17 +452,19 @@ namespace estimation
         bool diagnostics = true;
         if (my_filter_.update(odom_active_, imu_active_,gps_active_, vo_active_,  filter_stamp_, diagnostics)){
           
-          // output most recent estimate and relative covariance
-          my_filter_.getEstimate(output_);
-          pose_pub_.publish(output_);
+          // output most recent estimate and relative covariance, looked up
+          // once for both the message and tf, into messages that are reused
+          StampedTransform tmp;
+          my_filter_.getEstimate(tmp, output_);
+          if (pose_pub_.getNumSubscribers() > 0)
+            pose_pub_.publish(output_);
           ekf_sent_counter_++;
           
           // broadcast most recent estimate to TransformArray
-          StampedTransform tmp;
-          my_filter_.getEstimate(ros::Time(), tmp);
           if(!vo_active_ && !gps_active_)
             tmp.getOrigin().setZ(0.0);
-          odom_broadcaster_.sendTransform(StampedTransform(tmp, tmp.stamp_, output_frame_, base_footprint_frame_));
+          tf::transformStampedTFToMsg(tmp, odom_trans_);
+          odom_broadcaster_.sendTransform(odom_trans_);
           
           if (debug_){
             // write to file
@@ -509,6 +542,24 @@ bool OdomEstimationNode::getStatus(robot_pose_ekf::GetStatus::Request& req, robo
 
 
 
+#ifdef ROBOT_POSE_EKF_NODELET
+namespace estimation
+{
+  // the filter as a nodelet, to share a process with the odometry and imu drivers
+  class OdomEstimationNodelet : public nodelet::Nodelet
+  {
+  private:
+    virtual void onInit()
+    {
+      filter_node_.reset(new OdomEstimationNode(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    boost::shared_ptr<OdomEstimationNode> filter_node_;
+  };
+}; // namespace
+
+PLUGINLIB_EXPORT_CLASS(estimation::OdomEstimationNodelet, nodelet::Nodelet)
+#else
 // ----------
 // -- MAIN --
 // ----------
@@ -525,3 +576,4 @@ int main(int argc, char **argv)
   
   return 0;
 }
+#endif
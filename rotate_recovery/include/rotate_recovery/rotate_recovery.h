@@ -44,6 +44,7 @@
 #include <geometry_msgs/Twist.h>
 #include <geometry_msgs/Point.h>
 #include <angles/angles.h>
+#include <vector>
 
 namespace rotate_recovery{
   /**
@@ -73,12 +74,41 @@ namespace rotate_recovery{
        */
       void runBehavior();
 
+      /**
+       * @brief  Start the rotation without blocking, to be advanced by tick()
+       * @return True, as the rotation can always be run this way
+       */
+      bool start();
+
+      /**
+       * @brief  Check the rest of the rotation for collisions and command the velocity for the next step
+       * @return True while the rotation is still under way
+       */
+      bool tick();
+
+      /**
+       * @brief  Stop advancing the rotation, leaving it to the caller to stop the robot
+       */
+      void cancel();
+
       /**
        * @brief  Destructor for the rotate recovery behavior
        */
       ~RotateRecovery();
 
     private:
+      /**
+       * @brief  Rasterize the outline of the footprint at each step of a full turn from yaw, as cells relative to the robot's
+       * @return False if the footprint is not a polygon, leaving the steps to be simulated one by one
+       */
+      bool computeSweep(double x, double y, double yaw);
+
+      /**
+       * @brief  Find the first step of the rotation by dist_left from yaw that puts the outline on an obstacle or unknown space
+       * @return The angle of that step from yaw, or a negative value if there is none
+       */
+      double sweepCollision(double x, double y, double yaw, double dist_left);
+
       costmap_2d::Costmap2DROS* global_costmap_, *local_costmap_;
       costmap_2d::Costmap2D costmap_;
       std::string name_;
@@ -86,6 +116,16 @@ namespace rotate_recovery{
       bool initialized_;
       double sim_granularity_, min_rotational_vel_, max_rotational_vel_, acc_lim_th_, tolerance_, frequency_;
       base_local_planner::CostmapModel* world_model_;
+      ros::Publisher vel_pub_;
+      bool running_, got_180_;
+      double start_offset_;
+
+      double sweep_yaw_, sweep_step_;  ///< The heading of the first step of the sweep, and the angle between steps
+      unsigned int sweep_steps_;  ///< The steps of the sweep, 0 if there is none
+      std::vector<int> sweep_dx_, sweep_dy_;  ///< The cells swept, relative to the robot's
+      std::vector<unsigned int> sweep_begin_;  ///< Where the steps covering each cell start in sweep_cell_steps_
+      std::vector<unsigned int> sweep_cell_steps_;
+      std::vector<unsigned char> step_blocked_;
   };
 };
 #endif  
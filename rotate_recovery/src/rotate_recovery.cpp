@@ -36,13 +36,19 @@
 *********************************************************************/
 #include <rotate_recovery/rotate_recovery.h>
 #include <pluginlib/class_list_macros.h>
+#include <base_local_planner/line_iterator.h>
+#include <costmap_2d/cost_values.h>
+#include <costmap_2d/footprint.h>
+#include <algorithm>
+#include <map>
 
 //register this planner as a RecoveryBehavior plugin
 PLUGINLIB_DECLARE_CLASS(rotate_recovery, RotateRecovery, rotate_recovery::RotateRecovery, nav_core::RecoveryBehavior)
 
 namespace rotate_recovery {
 RotateRecovery::RotateRecovery(): global_costmap_(NULL), local_costmap_(NULL), 
-  tf_(NULL), initialized_(false), world_model_(NULL) {} 
+  tf_(NULL), initialized_(false), world_model_(NULL), running_(false), got_180_(false), start_offset_(0.0),
+  sweep_yaw_(0.0), sweep_step_(0.0), sweep_steps_(0) {}
 
 void RotateRecovery::initialize(std::string name, tf::TransformListener* tf,
     costmap_2d::Costmap2DROS* global_costmap, costmap_2d::Costmap2DROS* local_costmap){
@@ -79,41 +85,153 @@ RotateRecovery::~RotateRecovery(){
 }
 
 void RotateRecovery::runBehavior(){
+  start();
+
+  ros::Rate r(frequency_);
+  ros::NodeHandle n;
+  while(n.ok() && tick())
+    r.sleep();
+}
+
+bool RotateRecovery::start(){
+  running_ = false;
   if(!initialized_){
     ROS_ERROR("This object must be initialized before runBehavior is called");
-    return;
+    return true;
   }
 
   if(global_costmap_ == NULL || local_costmap_ == NULL){
     ROS_ERROR("The costmaps passed to the RotateRecovery object cannot be NULL. Doing nothing.");
-    return;
+    return true;
   }
   ROS_WARN("Rotate recovery behavior started.");
 
-  ros::Rate r(frequency_);
-  ros::NodeHandle n;
-  ros::Publisher vel_pub = n.advertise<geometry_msgs::Twist>("cmd_vel", 10);
+  if(!vel_pub_){
+    ros::NodeHandle n;
+    vel_pub_ = n.advertise<geometry_msgs::Twist>("cmd_vel", 10);
+  }
 
   tf::Stamped<tf::Pose> global_pose;
   local_costmap_->getRobotPose(global_pose);
 
-  double current_angle = -1.0 * M_PI;
+  got_180_ = false;
+  start_offset_ = 0 - angles::normalize_angle(tf::getYaw(global_pose.getRotation()));
+  computeSweep(global_pose.getOrigin().x(), global_pose.getOrigin().y(), tf::getYaw(global_pose.getRotation()));
+  running_ = true;
+  return true;
+}
+
+bool RotateRecovery::computeSweep(double x, double y, double yaw){
+  sweep_steps_ = 0;
+  std::vector<geometry_msgs::Point> footprint = local_costmap_->getRobotFootprint();
+  if(footprint.size() < 3 || sim_granularity_ <= 0.0)
+    return false;
+
+  costmap_2d::Costmap2D* costmap = local_costmap_->getCostmap();
+  int robot_x, robot_y;
+  costmap->worldToMapNoBounds(x, y, robot_x, robot_y);
+
+  //the steps of each cell the outline crosses, over a full turn
+  unsigned int steps = (unsigned int)ceil(2 * M_PI / sim_granularity_);
+  std::map<std::pair<int, int>, std::vector<unsigned int> > cells;
+  std::vector<geometry_msgs::Point> oriented;
+  for(unsigned int k = 0; k < steps; ++k){
+    costmap_2d::transformFootprint(x, y, yaw + k * 2 * M_PI / steps, footprint, oriented);
+    for(unsigned int i = 0; i < oriented.size(); ++i){
+      const geometry_msgs::Point& a = oriented[i];
+      const geometry_msgs::Point& b = oriented[(i + 1) % oriented.size()];
+      int x0, y0, x1, y1;
+      costmap->worldToMapNoBounds(a.x, a.y, x0, y0);
+      costmap->worldToMapNoBounds(b.x, b.y, x1, y1);
+      for(base_local_planner::LineIterator line(x0, y0, x1, y1); line.isValid(); line.advance()){
+        std::vector<unsigned int>& cell_steps = cells[std::make_pair(line.getX() - robot_x, line.getY() - robot_y)];
+        if(cell_steps.empty() || cell_steps.back() != k)
+          cell_steps.push_back(k);
+      }
+    }
+  }
+
+  sweep_dx_.clear();
+  sweep_dy_.clear();
+  sweep_begin_.clear();
+  sweep_cell_steps_.clear();
+  for(std::map<std::pair<int, int>, std::vector<unsigned int> >::const_iterator it = cells.begin(); it != cells.end(); ++it){
+    sweep_dx_.push_back(it->first.first);
+    sweep_dy_.push_back(it->first.second);
+    sweep_begin_.push_back(sweep_cell_steps_.size());
+    sweep_cell_steps_.insert(sweep_cell_steps_.end(), it->second.begin(), it->second.end());
+  }
+  sweep_begin_.push_back(sweep_cell_steps_.size());
+  step_blocked_.resize(steps);
+
+  sweep_yaw_ = yaw;
+  sweep_step_ = 2 * M_PI / steps;
+  sweep_steps_ = steps;
+  return true;
+}
+
+double RotateRecovery::sweepCollision(double x, double y, double yaw, double dist_left){
+  costmap_2d::Costmap2D* costmap = local_costmap_->getCostmap();
+  int robot_x, robot_y;
+  costmap->worldToMapNoBounds(x, y, robot_x, robot_y);
+  int size_x = costmap->getSizeInCellsX(), size_y = costmap->getSizeInCellsY();
 
-  bool got_180 = false;
+  //each cell swept is looked up once, blocking every step whose outline crosses it
+  std::fill(step_blocked_.begin(), step_blocked_.end(), 0);
+  for(unsigned int i = 0; i < sweep_dx_.size(); ++i){
+    int cx = robot_x + sweep_dx_[i], cy = robot_y + sweep_dy_[i];
+    bool blocked = cx < 0 || cy < 0 || cx >= size_x || cy >= size_y;
+    if(!blocked){
+      unsigned char cost = costmap->getCost(cx, cy);
+      blocked = cost == costmap_2d::LETHAL_OBSTACLE || cost == costmap_2d::NO_INFORMATION;
+    }
+    if(blocked){
+      for(unsigned int j = sweep_begin_[i]; j < sweep_begin_[i + 1]; ++j)
+        step_blocked_[sweep_cell_steps_[j]] = 1;
+    }
+  }
 
-  double start_offset = 0 - angles::normalize_angle(tf::getYaw(global_pose.getRotation()));
-  while(n.ok()){
-    local_costmap_->getRobotPose(global_pose);
+  //the rest of the rotation, from the step nearest the current heading
+  double offset = yaw - sweep_yaw_;
+  offset -= 2 * M_PI * floor(offset / (2 * M_PI));
+  unsigned int first = (unsigned int)(offset / sweep_step_ + 0.5);
+  for(unsigned int n = 0; n * sweep_step_ < dist_left; ++n){
+    if(step_blocked_[(first + n) % sweep_steps_])
+      return n * sweep_step_;
+  }
+  return -1.0;
+}
 
-    double norm_angle = angles::normalize_angle(tf::getYaw(global_pose.getRotation()));
-    current_angle = angles::normalize_angle(norm_angle + start_offset);
+void RotateRecovery::cancel(){
+  running_ = false;
+}
 
-    //compute the distance left to rotate
-    double dist_left = M_PI - current_angle;
+bool RotateRecovery::tick(){
+  if(!running_)
+    return false;
 
-    double x = global_pose.getOrigin().x(), y = global_pose.getOrigin().y();
+  tf::Stamped<tf::Pose> global_pose;
+  local_costmap_->getRobotPose(global_pose);
 
-    //check if that velocity is legal by forward simulating
+  double norm_angle = angles::normalize_angle(tf::getYaw(global_pose.getRotation()));
+  double current_angle = angles::normalize_angle(norm_angle + start_offset_);
+
+  //compute the distance left to rotate
+  double dist_left = M_PI - current_angle;
+
+  double x = global_pose.getOrigin().x(), y = global_pose.getOrigin().y();
+
+  //check if that velocity is legal by looking the rest of the rotation up in the sweep
+  if(sweep_steps_ > 0){
+    double collision_angle = sweepCollision(x, y, tf::getYaw(global_pose.getRotation()), dist_left);
+    if(collision_angle >= 0.0){
+      ROS_ERROR("Rotate recovery can't rotate in place because there is a potential collision %.2f rad ahead", collision_angle);
+      running_ = false;
+      return false;
+    }
+  }
+  else{
+    //or by forward simulating, for robots without a footprint polygon
     double sim_angle = 0.0;
     while(sim_angle < dist_left){
       double theta = tf::getYaw(global_pose.getRotation()) + sim_angle;
@@ -122,34 +240,36 @@ void RotateRecovery::runBehavior(){
       double footprint_cost = world_model_->footprintCost(x, y, theta, local_costmap_->getRobotFootprint(), 0.0, 0.0);
       if(footprint_cost < 0.0){
         ROS_ERROR("Rotate recovery can't rotate in place because there is a potential collision. Cost: %.2f", footprint_cost);
-        return;
+        running_ = false;
+        return false;
       }
 
       sim_angle += sim_granularity_;
     }
+  }
 
-    //compute the velocity that will let us stop by the time we reach the goal
-    double vel = sqrt(2 * acc_lim_th_ * dist_left);
-
-    //make sure that this velocity falls within the specified limits
-    vel = std::min(std::max(vel, min_rotational_vel_), max_rotational_vel_);
+  //compute the velocity that will let us stop by the time we reach the goal
+  double vel = sqrt(2 * acc_lim_th_ * dist_left);
 
-    geometry_msgs::Twist cmd_vel;
-    cmd_vel.linear.x = 0.0;
-    cmd_vel.linear.y = 0.0;
-    cmd_vel.angular.z = vel;
+  //make sure that this velocity falls within the specified limits
+  vel = std::min(std::max(vel, min_rotational_vel_), max_rotational_vel_);
 
-    vel_pub.publish(cmd_vel);
+  geometry_msgs::Twist cmd_vel;
+  cmd_vel.linear.x = 0.0;
+  cmd_vel.linear.y = 0.0;
+  cmd_vel.angular.z = vel;
 
-    //makes sure that we won't decide we're done right after we start
-    if(current_angle < 0.0)
-      got_180 = true;
+  vel_pub_.publish(cmd_vel);
 
-    //if we're done with our in-place rotation... then return
-    if(got_180 && current_angle >= (0.0 - tolerance_))
-      return;
+  //makes sure that we won't decide we're done right after we start
+  if(current_angle < 0.0)
+    got_180_ = true;
 
-    r.sleep();
+  //if we're done with our in-place rotation... then return
+  if(got_180_ && current_angle >= (0.0 - tolerance_)){
+    running_ = false;
+    return false;
   }
+  return true;
 }
 };
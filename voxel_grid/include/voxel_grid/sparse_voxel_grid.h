@@ -0,0 +1,298 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef VOXEL_GRID_SPARSE_VOXEL_GRID_H
+#define VOXEL_GRID_SPARSE_VOXEL_GRID_H
+
+#include <voxel_grid/voxel_grid.h>
+
+namespace voxel_grid
+{
+
+/**
+ * @class SparseVoxelGridT
+ * @brief A voxel grid with the columns of VoxelGridT, stored in blocks of BLOCK_SIZE by BLOCK_SIZE
+ *        columns that are only allocated once one of their columns is written.  The blocks never
+ *        written read as unknown, so a large grid that sees little takes little memory.  Blocks come
+ *        from a pool of chunks that reset() and shift() keep for reuse.
+ */
+template <typename Column>
+class SparseVoxelGridT
+{
+public:
+  typedef Column ColumnType;
+
+  static const unsigned int LEVELS = VoxelGridT<Column>::LEVELS;
+  static const unsigned int BLOCK_SIZE = 8;  ///< The side of a block, in columns
+  static const unsigned int BLOCKS_PER_CHUNK = 64;  ///< The number of blocks the pool allocates at a time
+
+  /**
+   * @brief  Constructor for a sparse voxel grid
+   * @param size_x The x size of the grid
+   * @param size_y The y size of the grid
+   * @param size_z The z size of the grid, only sizes <= LEVELS are supported
+   */
+  SparseVoxelGridT(unsigned int size_x, unsigned int size_y, unsigned int size_z);
+
+  ~SparseVoxelGridT();
+
+  /** @brief Resizes the grid to the desired size, leaving it all unknown */
+  void resize(unsigned int size_x, unsigned int size_y, unsigned int size_z);
+
+  /** @brief Make the whole grid unknown, returning all blocks to the pool */
+  void reset();
+
+  /** @brief The column at (x, y), which must be in bounds */
+  inline Column getColumn(unsigned int x, unsigned int y) const
+  {
+    uint32_t block = blocks_[(y / BLOCK_SIZE) * blocks_x_ + x / BLOCK_SIZE];
+    if (block == 0)
+      return VoxelGridT<Column>::unknownColumn();
+    return blockData(chunks_, block)[(y % BLOCK_SIZE) * BLOCK_SIZE + x % BLOCK_SIZE];
+  }
+
+  inline void markVoxel(unsigned int x, unsigned int y, unsigned int z)
+  {
+    if (x >= size_x_ || y >= size_y_ || z >= size_z_)
+    {
+      ROS_DEBUG("Error, voxel out of bounds.\n");
+      return;
+    }
+    *column(x, y) |= VoxelGridT<Column>::fullMask(z); //clear unknown and mark cell
+  }
+
+  inline bool markVoxelInMap(unsigned int x, unsigned int y, unsigned int z, unsigned int marked_threshold)
+  {
+    if (x >= size_x_ || y >= size_y_ || z >= size_z_)
+    {
+      ROS_DEBUG("Error, voxel out of bounds.\n");
+      return false;
+    }
+
+    Column* col = column(x, y);
+    *col |= VoxelGridT<Column>::fullMask(z); //clear unknown and mark cell
+
+    //make sure the number of bits in each is below our thesholds
+    return !VoxelGridT<Column>::bitsBelowThreshold(VoxelGridT<Column>::markedBits(*col), marked_threshold);
+  }
+
+  inline void clearVoxel(unsigned int x, unsigned int y, unsigned int z)
+  {
+    if (x >= size_x_ || y >= size_y_ || z >= size_z_)
+    {
+      ROS_DEBUG("Error, voxel out of bounds.\n");
+      return;
+    }
+    *column(x, y) &= ~(VoxelGridT<Column>::fullMask(z)); //clear unknown and clear cell
+  }
+
+  /** @brief Clear the column at index y * size_x + x */
+  inline void clearVoxelColumn(unsigned int index)
+  {
+    ROS_ASSERT(index < size_x_ * size_y_);
+    *column(index % size_x_, index / size_x_) = 0;
+  }
+
+  void markVoxelLine(double x0, double y0, double z0, double x1, double y1, double z1, unsigned int max_length = UINT_MAX);
+  void clearVoxelLine(double x0, double y0, double z0, double x1, double y1, double z1, unsigned int max_length = UINT_MAX);
+  void clearVoxelLineInMap(double x0, double y0, double z0, double x1, double y1, double z1, unsigned char *map_2d,
+                           unsigned int unknown_threshold, unsigned int mark_threshold,
+                           unsigned char free_cost = 0, unsigned char unknown_cost = 255, unsigned int max_length = UINT_MAX);
+
+  /**
+   * @brief  Clear many lines from one origin as clearVoxelLineInMap() would for each of them in turn.
+   *         The lines are cleared one by one: num_threads and lane are only there to match VoxelGridT.
+   */
+  void clearVoxelLinesInMap(double x0, double y0, double z0, const std::vector<LineEnd>& ends, unsigned char *map_2d,
+                            unsigned int unknown_threshold, unsigned int mark_threshold,
+                            unsigned char free_cost = 0, unsigned char unknown_cost = 255,
+                            unsigned int max_length = UINT_MAX, unsigned int num_threads = 1,
+                            nav_executor::Lane lane = nav_executor::LANE_LOCAL_COSTMAP);
+
+  VoxelStatus getVoxel(unsigned int x, unsigned int y, unsigned int z) const;
+
+  //Are there any obstacles at that (x, y) location in the grid?
+  VoxelStatus getVoxelColumn(unsigned int x, unsigned int y,
+                             unsigned int unknown_threshold = 0, unsigned int marked_threshold = 0) const;
+
+  /** @brief Copy the size_x by size_y columns of the grid, row by row, to out. */
+  void copyColumns(Column* out) const;
+
+  /** @brief Copy the width by height columns starting at (x0, y0), row by row, to out. */
+  void copyColumns(Column* out, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height) const;
+
+  /**
+   * @brief  Move the columns of the grid by offset_x and offset_y cells, so the column at (x, y) comes
+   *         from (x + offset_x, y + offset_y), the columns uncovered becoming unknown.  Only the
+   *         columns of allocated blocks are moved.
+   */
+  void shift(int offset_x, int offset_y);
+
+  /** @brief The number of blocks in use */
+  unsigned int allocatedBlocks() const
+  {
+    return used_blocks_;
+  }
+
+  /** @brief The bytes the grid has allocated, for the block ids and the pool, whether or not its blocks are in use */
+  size_t memoryBytes() const
+  {
+    return blocks_.capacity() * sizeof(uint32_t)
+        + (chunks_.size() + spare_chunks_.size()) * size_t(BLOCKS_PER_CHUNK) * BLOCK_CELLS * sizeof(Column);
+  }
+
+  unsigned int sizeX() const
+  {
+    return size_x_;
+  }
+  unsigned int sizeY() const
+  {
+    return size_y_;
+  }
+  unsigned int sizeZ() const
+  {
+    return size_z_;
+  }
+
+private:
+  static const unsigned int BLOCK_CELLS = BLOCK_SIZE * BLOCK_SIZE;
+
+  /** @brief The columns of block id, counting from 1, in the pool of chunks */
+  static inline Column* blockData(const std::vector<Column*>& chunks, uint32_t id)
+  {
+    return chunks[(id - 1) / BLOCKS_PER_CHUNK] + ((id - 1) % BLOCKS_PER_CHUNK) * BLOCK_CELLS;
+  }
+
+  /** @brief The column at (x, y) to write to, allocating its block if need be */
+  inline Column* column(unsigned int x, unsigned int y)
+  {
+    uint32_t& block = blocks_[(y / BLOCK_SIZE) * blocks_x_ + x / BLOCK_SIZE];
+    if (block == 0)
+      block = allocateBlock();
+    return blockData(chunks_, block) + (y % BLOCK_SIZE) * BLOCK_SIZE + x % BLOCK_SIZE;
+  }
+
+  /** @brief Take an unknown block from the pool, returning its id */
+  uint32_t allocateBlock();
+
+  /** @brief Size blocks_ to the grid, with no blocks allocated */
+  void allocate();
+
+  unsigned int size_x_, size_y_, size_z_;
+  unsigned int blocks_x_, blocks_y_;
+  unsigned int row_shift_;  ///< Lines are traced in rows of 1 << row_shift_ columns, at least size_x_
+  std::vector<uint32_t> blocks_;  ///< The id of each block of the grid, row by row, 0 for blocks not allocated
+  std::vector<Column*> chunks_;  ///< The pool, BLOCKS_PER_CHUNK blocks per chunk
+  std::vector<Column*> spare_chunks_;  ///< The chunks shift() moves the blocks into next
+  uint32_t used_blocks_;  ///< The blocks of chunks_ handed out, which are the first ones
+
+  //the functors of VoxelGridT, for the offsets of traceLine() with a stride of 1 << row_shift_
+  class MarkVoxel
+  {
+  public:
+    MarkVoxel(SparseVoxelGridT* grid): grid_(grid){}
+    inline void operator()(unsigned int offset, Column z_mask)
+    {
+      *grid_->column(offset & ((1u << grid_->row_shift_) - 1), offset >> grid_->row_shift_) |= z_mask;
+    }
+  private:
+    SparseVoxelGridT* grid_;
+  };
+
+  class ClearVoxel
+  {
+  public:
+    ClearVoxel(SparseVoxelGridT* grid): grid_(grid){}
+    inline void operator()(unsigned int offset, Column z_mask)
+    {
+      *grid_->column(offset & ((1u << grid_->row_shift_) - 1), offset >> grid_->row_shift_) &= ~(z_mask);
+    }
+  private:
+    SparseVoxelGridT* grid_;
+  };
+
+  class ClearVoxelInMap
+  {
+  public:
+    ClearVoxelInMap(
+      SparseVoxelGridT* grid, unsigned char *costmap,
+      unsigned int unknown_clear_threshold, unsigned int marked_clear_threshold,
+      unsigned char free_cost = 0, unsigned char unknown_cost = 255): grid_(grid), costmap_(costmap),
+      unknown_clear_threshold_(unknown_clear_threshold), marked_clear_threshold_(marked_clear_threshold),
+      free_cost_(free_cost), unknown_cost_(unknown_cost)
+    {
+    }
+
+    inline void operator()(unsigned int offset, Column z_mask)
+    {
+      unsigned int x = offset & ((1u << grid_->row_shift_) - 1), y = offset >> grid_->row_shift_;
+      Column* col = grid_->column(x, y);
+      *col &= ~(z_mask); //clear unknown and clear cell
+
+      //make sure the number of bits in each is below our thesholds
+      if (VoxelGridT<Column>::bitsBelowThreshold(VoxelGridT<Column>::markedBits(*col), marked_clear_threshold_))
+      {
+        if (VoxelGridT<Column>::bitsBelowThreshold(VoxelGridT<Column>::unknownBits(*col), unknown_clear_threshold_))
+        {
+          costmap_[y * grid_->size_x_ + x] = free_cost_;
+        }
+        else
+        {
+          costmap_[y * grid_->size_x_ + x] = unknown_cost_;
+        }
+      }
+    }
+  private:
+    SparseVoxelGridT* grid_;
+    unsigned char *costmap_;
+    unsigned int unknown_clear_threshold_, marked_clear_threshold_;
+    unsigned char free_cost_, unknown_cost_;
+  };
+};
+
+template <typename Column>
+const unsigned int SparseVoxelGridT<Column>::LEVELS;
+template <typename Column>
+const unsigned int SparseVoxelGridT<Column>::BLOCK_SIZE;
+template <typename Column>
+const unsigned int SparseVoxelGridT<Column>::BLOCKS_PER_CHUNK;
+template <typename Column>
+const unsigned int SparseVoxelGridT<Column>::BLOCK_CELLS;
+
+typedef SparseVoxelGridT<uint32_t> SparseVoxelGrid;
+typedef SparseVoxelGridT<uint64_t> SparseVoxelGrid64;
+
+}  // namespace voxel_grid
+
+#endif  // VOXEL_GRID_SPARSE_VOXEL_GRID_H
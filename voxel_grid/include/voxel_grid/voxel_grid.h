@@ -44,14 +44,18 @@
 #include <math.h>
 #include <limits.h>
 #include <algorithm>
+#include <vector>
 #include <ros/console.h>
 #include <ros/assert.h>
+#include <nav_executor/executor.h>
 
 /**
- * @class VoxelGrid
+ * @class VoxelGridT
  * @brief A 3D grid structure that stores points as an integer array.
  *        X and Y index the array and Z selects which bit of the integer
- *        is used giving a limit of 16 vertical cells.
+ *        is used.  The Column integer holds two bits per z level, giving
+ *        a limit of 16 vertical cells for uint32_t (VoxelGrid), 32 for
+ *        uint64_t (VoxelGrid64) and 64 for __uint128_t (VoxelGrid128).
  */
 namespace voxel_grid
 {
@@ -62,29 +66,86 @@ enum VoxelStatus {
   MARKED = 2,
 };
 
-class VoxelGrid
+/** @brief The end of a line to trace, in grid coordinates. */
+struct LineEnd
+{
+  double x, y, z;
+};
+
+/** @brief Points that VoxelGridT::exportVoxels() writes into, x, y and z floats at the start of each. */
+struct PointBuffer
+{
+  uint8_t* data;  ///< Room for as many points as VoxelGridT::countVoxels() counts
+  unsigned int point_step;  ///< The bytes from the start of one point to the next
+  unsigned int size;  ///< The number of points written so far
+};
+
+template <typename Column>
+class VoxelGridT
 {
 public:
+  /** @brief The number of z levels a column holds: the low half of its bits are set for voxels that are
+   *  not free, the high half for voxels that are marked */
+  static const unsigned int LEVELS = sizeof(Column) * 4;
+
   /**
    * @brief  Constructor for a voxel grid
    * @param size_x The x size of the grid
    * @param size_y The y size of the grid
-   * @param size_z The z size of the grid, only sizes <= 16 are supported
+   * @param size_z The z size of the grid, only sizes <= LEVELS are supported
    */
-  VoxelGrid(unsigned int size_x, unsigned int size_y, unsigned int size_z);
+  VoxelGridT(unsigned int size_x, unsigned int size_y, unsigned int size_z);
 
-  ~VoxelGrid();
+  ~VoxelGridT();
 
   /**
    * @brief  Resizes a voxel grid to the desired size
    * @param size_x The x size of the grid
    * @param size_y The y size of the grid
-   * @param size_z The z size of the grid, only sizes <= 16 are supported
+   * @param size_z The z size of the grid, only sizes <= LEVELS are supported
    */
   void resize(unsigned int size_x, unsigned int size_y, unsigned int size_z);
 
+  typedef Column ColumnType;
+
   void reset();
-  uint32_t* getData() { return data_; }
+  Column* getData() { return data_; }
+
+  /** @brief Copy the size_x by size_y columns of the grid, row by row, to out. */
+  void copyColumns(Column* out) const;
+
+  /** @brief Copy the width by height columns starting at (x0, y0), row by row, to out. */
+  void copyColumns(Column* out, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height) const;
+
+  /**
+   * @brief  Move the columns of the grid by offset_x and offset_y cells, so the column at (x, y) comes
+   *         from (x + offset_x, y + offset_y), the columns uncovered becoming unknown
+   */
+  void shift(int offset_x, int offset_y);
+
+  /** @brief A column with all its voxels unknown. */
+  static inline Column unknownColumn()
+  {
+    return ~((Column)0) >> LEVELS;
+  }
+
+  /** @brief The bits of voxel z in a column. */
+  static inline Column fullMask(unsigned int z)
+  {
+    return ((Column)1 << z << LEVELS) | ((Column)1 << z);
+  }
+
+  /** @brief The marked voxels of a column, one bit per level. */
+  static inline Column markedBits(Column col)
+  {
+    return col >> LEVELS;
+  }
+
+  /** @brief The unknown voxels of a column, one bit per level. */
+  static inline Column unknownBits(Column col)
+  {
+    return (col >> LEVELS) ^ (col & unknownColumn());
+  }
 
   inline void markVoxel(unsigned int x, unsigned int y, unsigned int z)
   {
@@ -93,8 +154,7 @@ public:
       ROS_DEBUG("Error, voxel out of bounds.\n");
       return;
     }
-    uint32_t full_mask = ((uint32_t)1<<z<<16) | (1<<z);
-    data_[y * size_x_ + x] |= full_mask; //clear unknown and mark cell
+    data_[y * size_x_ + x] |= fullMask(z); //clear unknown and mark cell
   }
 
   inline bool markVoxelInMap(unsigned int x, unsigned int y, unsigned int z, unsigned int marked_threshold)
@@ -106,11 +166,10 @@ public:
     }
 
     int index = y * size_x_ + x;
-    uint32_t* col = &data_[index];
-    uint32_t full_mask = ((uint32_t)1<<z<<16) | (1<<z);
-    *col |= full_mask; //clear unknown and mark cell
+    Column* col = &data_[index];
+    *col |= fullMask(z); //clear unknown and mark cell
 
-    unsigned int marked_bits = *col>>16;
+    Column marked_bits = markedBits(*col);
 
     //make sure the number of bits in each is below our thesholds
     return !bitsBelowThreshold(marked_bits, marked_threshold);
@@ -123,8 +182,7 @@ public:
       ROS_DEBUG("Error, voxel out of bounds.\n");
       return;
     }
-    uint32_t full_mask = ((uint32_t)1<<z<<16) | (1<<z);
-    data_[y * size_x_ + x] &= ~(full_mask); //clear unknown and clear cell
+    data_[y * size_x_ + x] &= ~(fullMask(z)); //clear unknown and clear cell
   }
 
   inline void clearVoxelColumn(unsigned int index)
@@ -141,12 +199,11 @@ public:
       return;
     }
     int index = y * size_x_ + x;
-    uint32_t* col = &data_[index];
-    uint32_t full_mask = ((uint32_t)1<<z<<16) | (1<<z);
-    *col &= ~(full_mask); //clear unknown and clear cell
+    Column* col = &data_[index];
+    *col &= ~(fullMask(z)); //clear unknown and clear cell
 
-    unsigned int unknown_bits = uint16_t(*col>>16) ^ uint16_t(*col);
-    unsigned int marked_bits = *col>>16;
+    Column unknown_bits = unknownBits(*col);
+    Column marked_bits = markedBits(*col);
 
     //make sure the number of bits in each is below our thesholds
     if (bitsBelowThreshold(unknown_bits, 1) && bitsBelowThreshold(marked_bits, 1))
@@ -155,7 +212,7 @@ public:
     }
   }
 
-  inline bool bitsBelowThreshold(unsigned int n, unsigned int bit_threshold)
+  static inline bool bitsBelowThreshold(Column n, unsigned int bit_threshold)
   {
     unsigned int bit_count;
     for (bit_count = 0; n;)
@@ -170,7 +227,7 @@ public:
     return true;
   }
 
-  static inline unsigned int numBits(unsigned int n)
+  static inline unsigned int numBits(Column n)
   {
     unsigned int bit_count;
     for (bit_count = 0; n; ++bit_count)
@@ -182,15 +239,14 @@ public:
 
   static VoxelStatus getVoxel(
     unsigned int x, unsigned int y, unsigned int z,
-    unsigned int size_x, unsigned int size_y, unsigned int size_z, const uint32_t* data)
+    unsigned int size_x, unsigned int size_y, unsigned int size_z, const Column* data)
   {
     if (x >= size_x || y >= size_y || z >= size_z)
     {
       ROS_DEBUG("Error, voxel out of bounds. (%d, %d, %d)\n", x, y, z);
       return UNKNOWN;
     }
-    uint32_t full_mask = ((uint32_t)1<<z<<16) | (1<<z);
-    uint32_t result = data[y * size_x + x] & full_mask;
+    Column result = data[y * size_x + x] & fullMask(z);
     unsigned int bits = numBits(result);
 
     // known marked: 11 = 2 bits, unknown: 01 = 1 bit, known free: 00 = 0 bits
@@ -211,22 +267,93 @@ public:
                            unsigned int unknown_threshold, unsigned int mark_threshold,
                            unsigned char free_cost = 0, unsigned char unknown_cost = 255, unsigned int max_length = UINT_MAX);
 
+  /**
+   * @brief  Clear many lines from one origin, leaving the grid and the map as clearVoxelLineInMap() would for each
+   *         of them in turn.  The lines are binned by direction and split between the threads, which collect the
+   *         voxels to clear in masks of their own; the masks are then merged and applied in disjoint stripes of rows.
+   * @param ends The ends of the lines; those out of bounds are skipped
+   * @param num_threads The most tasks to split the lines between on the shared executor, each given at least
+   *        MIN_LINES_PER_THREAD of them
+   * @param lane The lane of the executor to run the tasks on
+   */
+  void clearVoxelLinesInMap(double x0, double y0, double z0, const std::vector<LineEnd>& ends, unsigned char *map_2d,
+                            unsigned int unknown_threshold, unsigned int mark_threshold,
+                            unsigned char free_cost = 0, unsigned char unknown_cost = 255,
+                            unsigned int max_length = UINT_MAX, unsigned int num_threads = 1,
+                            nav_executor::Lane lane = nav_executor::LANE_LOCAL_COSTMAP);
+
+  /** @brief The fewest lines clearVoxelLinesInMap() hands a task, below which more tasks cost more than they save */
+  static const unsigned int MIN_LINES_PER_THREAD = 256;
+
   VoxelStatus getVoxel(unsigned int x, unsigned int y, unsigned int z);
 
   //Are there any obstacles at that (x, y) location in the grid?
   VoxelStatus getVoxelColumn(unsigned int x, unsigned int y,
                              unsigned int unknown_threshold = 0, unsigned int marked_threshold = 0);
 
+  /**
+   * @brief  Count the marked and the unknown voxels of n columns, several columns at a time where
+   *         the CPU allows
+   * @param data The columns
+   * @param n The number of columns
+   * @param marked Set to the number of marked voxels of each column
+   * @param unknown Set to the number of unknown voxels of each column
+   */
+  static void countColumnBits(const Column* data, unsigned int n, uint8_t* marked, uint8_t* unknown);
+
+  /**
+   * @brief  Project the whole grid into a 2D map of size_x by size_y cells, as getVoxelColumn() would
+   *         classify each column
+   * @param costmap The map to fill in
+   * @param marked_threshold Columns with more marked voxels than this get marked_cost
+   * @param unknown_threshold Other columns with more unknown voxels than this get unknown_cost, the rest free_cost
+   */
+  void updateCostmap(unsigned char* costmap, unsigned int marked_threshold, unsigned int unknown_threshold,
+                     unsigned char marked_cost = 254, unsigned char free_cost = 0, unsigned char unknown_cost = 255);
+
+  /**
+   * @brief  Count the marked and the unknown voxels in the lowest size_z levels of n columns
+   */
+  static void countVoxels(const Column* data, unsigned int n, unsigned int size_z,
+                          unsigned int* num_marked, unsigned int* num_unknown);
+
+  /**
+   * @brief  Append the centers of the marked and of the unknown voxels in the lowest size_z levels of
+   *         size_x by size_y columns to marked and unknown, column by column and from the bottom up.
+   *         Only the voxels there are get visited, by scanning the bits set in each column.
+   * @param origin_x The world x coordinate of the corner of the grid, likewise origin_y and origin_z
+   * @param resolution_x The size of a voxel along x, likewise resolution_y and resolution_z
+   */
+  static void exportVoxels(const Column* data, unsigned int size_x, unsigned int size_y, unsigned int size_z,
+                           double origin_x, double origin_y, double origin_z,
+                           double resolution_x, double resolution_y, double resolution_z,
+                           PointBuffer* marked, PointBuffer* unknown);
+
   void printVoxelGrid();
   void printColumnGrid();
-  unsigned int sizeX();
-  unsigned int sizeY();
-  unsigned int sizeZ();
+  unsigned int sizeX() const;
+  unsigned int sizeY() const;
+  unsigned int sizeZ() const;
+
+  /** @brief The bytes the grid has allocated for its columns */
+  size_t memoryBytes() const;
 
   template <class ActionType>
   inline void raytraceLine(
     ActionType at, double x0, double y0, double z0,
     double x1, double y1, double z1, unsigned int max_length = UINT_MAX)
+  {
+    traceLine(at, size_x_, x0, y0, z0, x1, y1, z1, max_length);
+  }
+
+  /**
+   * @brief  Trace a line through columns laid out in rows of stride columns, calling at with the offset
+   *         y * stride + x of each column the line crosses and the bits of the voxel it crosses in it
+   */
+  template <class ActionType>
+  static inline void traceLine(
+    ActionType at, unsigned int stride, double x0, double y0, double z0,
+    double x1, double y1, double z1, unsigned int max_length = UINT_MAX)
   {
     int dx = int(x1) - int(x0);
     int dy = int(y1) - int(y0);
@@ -237,11 +364,11 @@ public:
     unsigned int abs_dz = abs(dz);
 
     int offset_dx = sign(dx);
-    int offset_dy = sign(dy) * size_x_;
+    int offset_dy = sign(dy) * stride;
     int offset_dz = sign(dz);
 
-    unsigned int z_mask = ((1 << 16) | 1) << (unsigned int)z0;
-    unsigned int offset = (unsigned int)y0 * size_x_ + (unsigned int)x0;
+    Column z_mask = fullMask((unsigned int)z0);
+    unsigned int offset = (unsigned int)y0 * stride + (unsigned int)x0;
 
     GridOffset grid_off(offset);
     ZOffset z_off(z_mask);
@@ -280,11 +407,11 @@ public:
 private:
   //the real work is done here... 3D bresenham implementation
   template <class ActionType, class OffA, class OffB, class OffC>
-  inline void bresenham3D(
+  static inline void bresenham3D(
     ActionType at, OffA off_a, OffB off_b, OffC off_c,
     unsigned int abs_da, unsigned int abs_db, unsigned int abs_dc,
     int error_b, int error_c, int offset_a, int offset_b, int offset_c, unsigned int &offset,
-    unsigned int &z_mask, unsigned int max_length = UINT_MAX)
+    Column &z_mask, unsigned int max_length = UINT_MAX)
   {
     unsigned int end = std::min(max_length, abs_da);
     for (unsigned int i = 0; i < end; ++i)
@@ -307,50 +434,79 @@ private:
     at(offset, z_mask);
   }
 
-  inline int sign(int i)
+  static inline int sign(int i)
   {
     return i > 0 ? 1 : -1;
   }
 
-  inline unsigned int max(unsigned int x, unsigned int y)
+  static inline unsigned int max(unsigned int x, unsigned int y)
   {
     return x > y ? x : y;
   }
 
+  /** @brief Allocate size_x_ by size_y_ unknown columns, capping size_z_ at LEVELS. */
+  void allocate();
+
   unsigned int size_x_, size_y_, size_z_;
-  uint32_t *data_;
+  Column *data_;
   unsigned char *costmap;
 
   //Aren't functors so much fun... used to recreate the Bresenham macro Eric wrote in the original version, but in "proper" c++
   class MarkVoxel
   {
   public:
-    MarkVoxel(uint32_t* data): data_(data){}
-    inline void operator()(unsigned int offset, unsigned int z_mask)
+    MarkVoxel(Column* data): data_(data){}
+    inline void operator()(unsigned int offset, Column z_mask)
     {
       data_[offset] |= z_mask; //clear unknown and mark cell
     }
   private:
-    uint32_t* data_;
+    Column* data_;
   };
 
   class ClearVoxel
   {
   public:
-    ClearVoxel(uint32_t* data): data_(data){}
-    inline void operator()(unsigned int offset, unsigned int z_mask)
+    ClearVoxel(Column* data): data_(data){}
+    inline void operator()(unsigned int offset, Column z_mask)
     {
       data_[offset] &= ~(z_mask); //clear unknown and clear cell
     }
   private:
-    uint32_t* data_;
+    Column* data_;
+  };
+
+  class AccumulateMask
+  {
+  public:
+    AccumulateMask(Column* masks, unsigned int first_offset): masks_(masks), first_offset_(first_offset){}
+    inline void operator()(unsigned int offset, Column z_mask)
+    {
+      masks_[offset - first_offset_] |= z_mask; //remember to clear unknown and clear cell
+    }
+  private:
+    Column* masks_;
+    unsigned int first_offset_;
   };
 
+  /** @brief Trace the lines [begins[t], begins[t + 1]) of lines from origin into masks[t], which cover the rows from
+   *  first_rows[t] on. */
+  void accumulateLines(LineEnd origin, const std::vector<LineEnd>* lines, const std::vector<unsigned int>* begins,
+                       const std::vector<unsigned int>* first_rows, unsigned int max_length,
+                       std::vector<std::vector<Column> >* masks, unsigned int t);
+
+  /** @brief Merge the masks of all tasks over rows [stripes[t], stripes[t + 1]) and columns [col0, coln), and apply
+   *  them with at. */
+  template <class ActionType>
+  void applyMasks(const std::vector<std::vector<Column> >* masks, const std::vector<unsigned int>* first_rows,
+                  const std::vector<unsigned int>* stripes, unsigned int col0, unsigned int coln, ActionType at,
+                  unsigned int t);
+
   class ClearVoxelInMap
   {
   public:
     ClearVoxelInMap(
-      uint32_t* data, unsigned char *costmap,
+      Column* data, unsigned char *costmap,
       unsigned int unknown_clear_threshold, unsigned int marked_clear_threshold,
       unsigned char free_cost = 0, unsigned char unknown_cost = 255): data_(data), costmap_(costmap),
       unknown_clear_threshold_(unknown_clear_threshold), marked_clear_threshold_(marked_clear_threshold),
@@ -358,13 +514,13 @@ private:
     {
     }
 
-    inline void operator()(unsigned int offset, unsigned int z_mask)
+    inline void operator()(unsigned int offset, Column z_mask)
     {
-      uint32_t* col = &data_[offset];
+      Column* col = &data_[offset];
       *col &= ~(z_mask); //clear unknown and clear cell
 
-      unsigned int unknown_bits = uint16_t(*col>>16) ^ uint16_t(*col);
-      unsigned int marked_bits = *col>>16;
+      Column unknown_bits = unknownBits(*col);
+      Column marked_bits = markedBits(*col);
 
       //make sure the number of bits in each is below our thesholds
       if (bitsBelowThreshold(marked_bits, marked_clear_threshold_))
@@ -380,22 +536,7 @@ private:
       }
     }
   private:
-    inline bool bitsBelowThreshold(unsigned int n, unsigned int bit_threshold)
-    {
-      unsigned int bit_count;
-      for (bit_count = 0; n;)
-      {
-        ++bit_count;
-        if (bit_count > bit_threshold)
-        {
-          return false;
-        }
-        n &= n - 1; //clear the least significant bit set
-      }
-      return true;
-    }
-
-    uint32_t* data_;
+    Column* data_;
     unsigned char *costmap_;
     unsigned int unknown_clear_threshold_, marked_clear_threshold_;
     unsigned char free_cost_, unknown_cost_;
@@ -416,16 +557,25 @@ private:
   class ZOffset
   {
   public:
-    ZOffset(unsigned int &z_mask) : z_mask_(z_mask) {}
+    ZOffset(Column &z_mask) : z_mask_(z_mask) {}
     inline void operator()(int offset_val)
     {
       offset_val > 0 ? z_mask_ <<= 1 : z_mask_ >>= 1;
     }
   private:
-    unsigned int & z_mask_;
+    Column & z_mask_;
   };
 };
 
+template <typename Column>
+const unsigned int VoxelGridT<Column>::LEVELS;
+
+typedef VoxelGridT<uint32_t> VoxelGrid;
+typedef VoxelGridT<uint64_t> VoxelGrid64;
+#ifdef __SIZEOF_INT128__
+typedef VoxelGridT<__uint128_t> VoxelGrid128;
+#endif
+
 }  // namespace voxel_grid
 
 #endif  // VOXEL_GRID_VOXEL_GRID_H
\ No newline at end of file
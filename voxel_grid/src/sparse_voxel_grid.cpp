@@ -0,0 +1,270 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <voxel_grid/sparse_voxel_grid.h>
+
+namespace voxel_grid {
+  template <typename Column>
+  SparseVoxelGridT<Column>::SparseVoxelGridT(unsigned int size_x, unsigned int size_y, unsigned int size_z)
+  {
+    size_x_ = size_x;
+    size_y_ = size_y;
+    size_z_ = size_z;
+    allocate();
+  }
+
+  template <typename Column>
+  SparseVoxelGridT<Column>::~SparseVoxelGridT()
+  {
+    for(unsigned int i = 0; i < chunks_.size(); ++i)
+      delete[] chunks_[i];
+    for(unsigned int i = 0; i < spare_chunks_.size(); ++i)
+      delete[] spare_chunks_[i];
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::resize(unsigned int size_x, unsigned int size_y, unsigned int size_z)
+  {
+    size_x_ = size_x;
+    size_y_ = size_y;
+    size_z_ = size_z;
+    allocate();
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::allocate()
+  {
+    if(size_z_ > LEVELS){
+      ROS_INFO("Error, this implementation can only support up to %u z values (%d)", LEVELS, size_z_);
+      size_z_ = LEVELS;
+    }
+
+    blocks_x_ = (size_x_ + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    blocks_y_ = (size_y_ + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    row_shift_ = 0;
+    while((1u << row_shift_) < size_x_)
+      ++row_shift_;
+    blocks_.assign(blocks_x_ * blocks_y_, 0);
+    used_blocks_ = 0;
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::reset(){
+    std::fill(blocks_.begin(), blocks_.end(), 0);
+    used_blocks_ = 0;
+  }
+
+  template <typename Column>
+  uint32_t SparseVoxelGridT<Column>::allocateBlock(){
+    uint32_t id = ++used_blocks_;
+    if((id - 1) / BLOCKS_PER_CHUNK >= chunks_.size())
+      chunks_.push_back(new Column[BLOCKS_PER_CHUNK * BLOCK_CELLS]);
+    Column* data = blockData(chunks_, id);
+    std::fill(data, data + BLOCK_CELLS, VoxelGridT<Column>::unknownColumn());
+    return id;
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::copyColumns(Column* out) const
+  {
+    for(unsigned int y = 0; y < size_y_; ++y){
+      const uint32_t* blocks = &blocks_[(y / BLOCK_SIZE) * blocks_x_];
+      for(unsigned int bx = 0; bx < blocks_x_; ++bx){
+        unsigned int x0 = bx * BLOCK_SIZE;
+        unsigned int n = std::min(BLOCK_SIZE, size_x_ - x0);
+        Column* dst = out + y * size_x_ + x0;
+        if(blocks[bx] == 0)
+          std::fill(dst, dst + n, VoxelGridT<Column>::unknownColumn());
+        else
+          memcpy(dst, blockData(chunks_, blocks[bx]) + (y % BLOCK_SIZE) * BLOCK_SIZE, n * sizeof(Column));
+      }
+    }
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::copyColumns(Column* out, unsigned int x0, unsigned int y0,
+                                             unsigned int width, unsigned int height) const
+  {
+    for(unsigned int y = y0; y < y0 + height; ++y){
+      const uint32_t* blocks = &blocks_[(y / BLOCK_SIZE) * blocks_x_];
+      for(unsigned int x = x0; x < x0 + width;){
+        //the run of columns up to the end of the block
+        unsigned int n = std::min(BLOCK_SIZE - x % BLOCK_SIZE, x0 + width - x);
+        uint32_t block = blocks[x / BLOCK_SIZE];
+        if(block == 0)
+          std::fill(out, out + n, VoxelGridT<Column>::unknownColumn());
+        else
+          memcpy(out, blockData(chunks_, block) + (y % BLOCK_SIZE) * BLOCK_SIZE + x % BLOCK_SIZE, n * sizeof(Column));
+        out += n;
+        x += n;
+      }
+    }
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::shift(int offset_x, int offset_y)
+  {
+    if(abs(offset_x) >= (int)size_x_ || abs(offset_y) >= (int)size_y_){
+      reset();
+      return;
+    }
+
+    //the blocks are rebuilt from the spare chunks, and the chunks they leave become the spare ones
+    std::vector<uint32_t> old_blocks(blocks_.size(), 0);
+    old_blocks.swap(blocks_);
+    chunks_.swap(spare_chunks_);
+    used_blocks_ = 0;
+
+    Column unknown_col = VoxelGridT<Column>::unknownColumn();
+    for(unsigned int by = 0; by < blocks_y_; ++by){
+      for(unsigned int bx = 0; bx < blocks_x_; ++bx){
+        uint32_t id = old_blocks[by * blocks_x_ + bx];
+        if(id == 0)
+          continue;
+        const Column* data = blockData(spare_chunks_, id);
+        for(unsigned int cy = 0; cy < BLOCK_SIZE; ++cy){
+          int y = int(by * BLOCK_SIZE + cy) - offset_y;
+          if(y < 0 || y >= (int)size_y_ || by * BLOCK_SIZE + cy >= size_y_)
+            continue;
+          for(unsigned int cx = 0; cx < BLOCK_SIZE; ++cx){
+            int x = int(bx * BLOCK_SIZE + cx) - offset_x;
+            if(x < 0 || x >= (int)size_x_ || bx * BLOCK_SIZE + cx >= size_x_)
+              continue;
+            //unknown columns need no block
+            Column col = data[cy * BLOCK_SIZE + cx];
+            if(col != unknown_col)
+              *column(x, y) = col;
+          }
+        }
+      }
+    }
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::markVoxelLine(double x0, double y0, double z0, double x1, double y1, double z1, unsigned int max_length){
+    if(x0 >= size_x_ || y0 >= size_y_ || z0 >= size_z_ || x1>=size_x_ || y1>=size_y_ || z1>=size_z_){
+      ROS_DEBUG("Error, line endpoint out of bounds. (%.2f, %.2f, %.2f) to (%.2f, %.2f, %.2f),  size: (%d, %d, %d)", x0, y0, z0, x1, y1, z1,
+          size_x_, size_y_, size_z_);
+      return;
+    }
+
+    MarkVoxel mv(this);
+    VoxelGridT<Column>::traceLine(mv, 1u << row_shift_, x0, y0, z0, x1, y1, z1, max_length);
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::clearVoxelLine(double x0, double y0, double z0, double x1, double y1, double z1, unsigned int max_length){
+    if(x0 >= size_x_ || y0 >= size_y_ || z0 >= size_z_ || x1>=size_x_ || y1>=size_y_ || z1>=size_z_){
+      ROS_DEBUG("Error, line endpoint out of bounds. (%.2f, %.2f, %.2f) to (%.2f, %.2f, %.2f),  size: (%d, %d, %d)", x0, y0, z0, x1, y1, z1,
+          size_x_, size_y_, size_z_);
+      return;
+    }
+
+    ClearVoxel cv(this);
+    VoxelGridT<Column>::traceLine(cv, 1u << row_shift_, x0, y0, z0, x1, y1, z1, max_length);
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::clearVoxelLineInMap(double x0, double y0, double z0, double x1, double y1, double z1, unsigned char *map_2d,
+      unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost, unsigned char unknown_cost, unsigned int max_length){
+    if(map_2d == NULL){
+      clearVoxelLine(x0, y0, z0, x1, y1, z1, max_length);
+      return;
+    }
+
+    if(x0 >= size_x_ || y0 >= size_y_ || z0 >= size_z_ || x1>=size_x_ || y1>=size_y_ || z1>=size_z_){
+      ROS_DEBUG("Error, line endpoint out of bounds. (%.2f, %.2f, %.2f) to (%.2f, %.2f, %.2f),  size: (%d, %d, %d)", x0, y0, z0, x1, y1, z1,
+          size_x_, size_y_, size_z_);
+      return;
+    }
+
+    ClearVoxelInMap cvm(this, map_2d, unknown_threshold, mark_threshold, free_cost, unknown_cost);
+    VoxelGridT<Column>::traceLine(cvm, 1u << row_shift_, x0, y0, z0, x1, y1, z1, max_length);
+  }
+
+  template <typename Column>
+  void SparseVoxelGridT<Column>::clearVoxelLinesInMap(double x0, double y0, double z0, const std::vector<LineEnd>& ends,
+      unsigned char *map_2d, unsigned int unknown_threshold, unsigned int mark_threshold,
+      unsigned char free_cost, unsigned char unknown_cost, unsigned int max_length, unsigned int /* num_threads */,
+      nav_executor::Lane /* lane */){
+    for(unsigned int i = 0; i < ends.size(); ++i)
+      clearVoxelLineInMap(x0, y0, z0, ends[i].x, ends[i].y, ends[i].z, map_2d, unknown_threshold, mark_threshold,
+                          free_cost, unknown_cost, max_length);
+  }
+
+  template <typename Column>
+  VoxelStatus SparseVoxelGridT<Column>::getVoxel(unsigned int x, unsigned int y, unsigned int z) const
+  {
+    if(x >= size_x_ || y >= size_y_ || z >= size_z_){
+      ROS_DEBUG("Error, voxel out of bounds. (%d, %d, %d)\n", x, y, z);
+      return UNKNOWN;
+    }
+    unsigned int bits = VoxelGridT<Column>::numBits(getColumn(x, y) & VoxelGridT<Column>::fullMask(z));
+
+    // known marked: 11 = 2 bits, unknown: 01 = 1 bit, known free: 00 = 0 bits
+    if(bits < 2){
+      if(bits < 1)
+        return FREE;
+
+      return UNKNOWN;
+    }
+
+    return MARKED;
+  }
+
+  template <typename Column>
+  VoxelStatus SparseVoxelGridT<Column>::getVoxelColumn(unsigned int x, unsigned int y, unsigned int unknown_threshold,
+      unsigned int marked_threshold) const
+  {
+    if(x >= size_x_ || y >= size_y_){
+      ROS_DEBUG("Error, voxel out of bounds. (%d, %d)\n", x, y);
+      return UNKNOWN;
+    }
+
+    Column col = getColumn(x, y);
+
+    //check if the number of marked bits qualifies the col as marked
+    if(!VoxelGridT<Column>::bitsBelowThreshold(VoxelGridT<Column>::markedBits(col), marked_threshold))
+      return MARKED;
+
+    //check if the number of unkown bits qualifies the col as unknown
+    if(!VoxelGridT<Column>::bitsBelowThreshold(VoxelGridT<Column>::unknownBits(col), unknown_threshold))
+      return UNKNOWN;
+
+    return FREE;
+  }
+
+  template class SparseVoxelGridT<uint32_t>;
+  template class SparseVoxelGridT<uint64_t>;
+};
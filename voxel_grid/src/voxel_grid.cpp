@@ -36,30 +36,252 @@
 *********************************************************************/
 #include <voxel_grid/voxel_grid.h>
 #include <sys/time.h>
+#include <boost/bind.hpp>
 #include <ros/console.h>
+#include <nav_executor/kernels.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VOXEL_KERNEL_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace voxel_grid {
-  VoxelGrid::VoxelGrid(unsigned int size_x, unsigned int size_y, unsigned int size_z)
+#if defined(__SSE2__)
+  // The columns of columnCounts() from i on, 4 at a time, returning the first column left
+  static inline unsigned int columnCountsSse2(const uint32_t* data, unsigned int n, uint16_t* counts, unsigned int i)
   {
-    size_x_ = size_x; 
-    size_y_ = size_y; 
-    size_z_ = size_z; 
+    const __m128i low_half = _mm_set1_epi32(0xffff);
+    const __m128i m1 = _mm_set1_epi16(0x5555), m2 = _mm_set1_epi16(0x3333);
+    const __m128i m4 = _mm_set1_epi16(0x0f0f), m8 = _mm_set1_epi16(0x001f);
+    for(; i + 4 <= n; i += 4){
+      __m128i col = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      __m128i marked = _mm_srli_epi32(col, 16);
+      __m128i unknown = _mm_xor_si128(marked, _mm_and_si128(col, low_half));
+      __m128i v = _mm_or_si128(_mm_slli_epi32(marked, 16), unknown);
+      v = _mm_sub_epi16(v, _mm_and_si128(_mm_srli_epi16(v, 1), m1));
+      v = _mm_add_epi16(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi16(v, 2), m2));
+      v = _mm_and_si128(_mm_add_epi16(v, _mm_srli_epi16(v, 4)), m4);
+      v = _mm_and_si128(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), m8);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(counts + 2 * i), v);
+    }
+    return i;
+  }
+#endif
+
+#if VOXEL_KERNEL_AVX2
+  // The same 8 at a time, run only where the CPU has AVX2
+  __attribute__((target("avx2"))) static unsigned int columnCountsAvx2(const uint32_t* data, unsigned int n,
+                                                                       uint16_t* counts)
+  {
+    const __m256i low_half = _mm256_set1_epi32(0xffff);
+    const __m256i m1 = _mm256_set1_epi16(0x5555), m2 = _mm256_set1_epi16(0x3333);
+    const __m256i m4 = _mm256_set1_epi16(0x0f0f), m8 = _mm256_set1_epi16(0x001f);
+    unsigned int i = 0;
+    for(; i + 8 <= n; i += 8){
+      __m256i col = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      __m256i marked = _mm256_srli_epi32(col, 16);
+      __m256i unknown = _mm256_xor_si256(marked, _mm256_and_si256(col, low_half));
+      __m256i v = _mm256_or_si256(_mm256_slli_epi32(marked, 16), unknown);
+      v = _mm256_sub_epi16(v, _mm256_and_si256(_mm256_srli_epi16(v, 1), m1));
+      v = _mm256_add_epi16(_mm256_and_si256(v, m2), _mm256_and_si256(_mm256_srli_epi16(v, 2), m2));
+      v = _mm256_and_si256(_mm256_add_epi16(v, _mm256_srli_epi16(v, 4)), m4);
+      v = _mm256_and_si256(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), m8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(counts + 2 * i), v);
+    }
+    return columnCountsSse2(data, n, counts, i);
+  }
+#endif
 
-    if(size_z_ > 16){
-      ROS_INFO("Error, this implementation can only support up to 16 z values (%d)", size_z_); 
-      size_z_ = 16;
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+  // 4 at a time, counting bytes and adding them pairwise into the two halves
+  static inline unsigned int columnCountsNeon(const uint32_t* data, unsigned int n, uint16_t* counts)
+  {
+    const uint32x4_t low_half = vdupq_n_u32(0xffff);
+    unsigned int i = 0;
+    for(; i + 4 <= n; i += 4){
+      uint32x4_t col = vld1q_u32(data + i);
+      uint32x4_t marked = vshrq_n_u32(col, 16);
+      uint32x4_t unknown = veorq_u32(marked, vandq_u32(col, low_half));
+      uint32x4_t v = vorrq_u32(vshlq_n_u32(marked, 16), unknown);
+      vst1q_u16(counts + 2 * i, vpaddlq_u8(vcntq_u8(vreinterpretq_u8_u32(v))));
     }
+    return i;
+  }
+#endif
 
-    data_ = new uint32_t[size_x_ * size_y_];
-    uint32_t unknown_col = ~((uint32_t)0)>>16;
-    uint32_t* col = data_;
-    for(unsigned int i = 0; i < size_x_ * size_y_; ++i){
-      *col = unknown_col;
-      ++col;
+  // The variant of columnCounts() for this CPU, picked on first use
+  static nav_executor::KernelVariant countKernel()
+  {
+    unsigned int compiled = 0;
+#if defined(__SSE2__)
+    compiled |= nav_executor::kernelBit(nav_executor::KERNEL_SSE2);
+#elif defined(__ARM_NEON)
+    compiled |= nav_executor::kernelBit(nav_executor::KERNEL_NEON);
+#endif
+#if VOXEL_KERNEL_AVX2
+    compiled |= nav_executor::kernelBit(nav_executor::KERNEL_AVX2);
+#endif
+    static const nav_executor::KernelVariant variant = nav_executor::selectKernel("voxel_grid/column_counts",
+                                                                                  compiled);
+    return variant;
+  }
+
+  // Count the unknown and the marked voxels of n 32 bit columns into counts, two 16 bit counts per
+  // column in that order.  Each column is rearranged into the unknown bits in its low half and
+  // the marked bits in its high half, and both halves are counted at once.
+  static void columnCounts(const uint32_t* data, unsigned int n, uint16_t* counts)
+  {
+    unsigned int i = 0;
+    switch(countKernel()){
+#if VOXEL_KERNEL_AVX2
+      case nav_executor::KERNEL_AVX2:
+        i = columnCountsAvx2(data, n, counts);
+        break;
+#endif
+#if defined(__SSE2__)
+      case nav_executor::KERNEL_SSE2:
+        i = columnCountsSse2(data, n, counts, 0);
+        break;
+#elif defined(__ARM_NEON)
+      case nav_executor::KERNEL_NEON:
+        i = columnCountsNeon(data, n, counts);
+        break;
+#endif
+      default:
+        break;
+    }
+    for(; i < n; ++i){
+      counts[2 * i] = VoxelGrid::numBits(VoxelGrid::unknownBits(data[i]));
+      counts[2 * i + 1] = VoxelGrid::numBits(VoxelGrid::markedBits(data[i]));
+    }
+  }
+
+  // the same for wider columns, one column at a time
+  template <typename Column>
+  static void columnCounts(const Column* data, unsigned int n, uint16_t* counts)
+  {
+    for(unsigned int i = 0; i < n; ++i){
+      counts[2 * i] = VoxelGridT<Column>::numBits(VoxelGridT<Column>::unknownBits(data[i]));
+      counts[2 * i + 1] = VoxelGridT<Column>::numBits(VoxelGridT<Column>::markedBits(data[i]));
+    }
+  }
+
+  // the columns are counted in blocks of this many, so the counts stay in the cache
+  static const unsigned int COUNT_BLOCK = 256;
+
+  template <typename Column>
+  void VoxelGridT<Column>::countColumnBits(const Column* data, unsigned int n, uint8_t* marked, uint8_t* unknown)
+  {
+    uint16_t counts[2 * COUNT_BLOCK];
+    for(unsigned int start = 0; start < n; start += COUNT_BLOCK){
+      unsigned int block = std::min(COUNT_BLOCK, n - start);
+      columnCounts(data + start, block, counts);
+      for(unsigned int i = 0; i < block; ++i){
+        unknown[start + i] = counts[2 * i];
+        marked[start + i] = counts[2 * i + 1];
+      }
+    }
+  }
+
+  template <typename Column>
+  void VoxelGridT<Column>::updateCostmap(unsigned char* costmap, unsigned int marked_threshold, unsigned int unknown_threshold,
+                                unsigned char marked_cost, unsigned char free_cost, unsigned char unknown_cost)
+  {
+    uint16_t counts[2 * COUNT_BLOCK];
+    unsigned int n = size_x_ * size_y_;
+    for(unsigned int start = 0; start < n; start += COUNT_BLOCK){
+      unsigned int block = std::min(COUNT_BLOCK, n - start);
+      columnCounts(data_ + start, block, counts);
+      for(unsigned int i = 0; i < block; ++i){
+        if(counts[2 * i + 1] > marked_threshold)
+          costmap[start + i] = marked_cost;
+        else if(counts[2 * i] > unknown_threshold)
+          costmap[start + i] = unknown_cost;
+        else
+          costmap[start + i] = free_cost;
+      }
     }
   }
 
-  void VoxelGrid::resize(unsigned int size_x, unsigned int size_y, unsigned int size_z)
+  static inline unsigned int popCount(uint32_t n){ return __builtin_popcount(n); }
+  static inline unsigned int popCount(uint64_t n){ return __builtin_popcountll(n); }
+  static inline unsigned int lowestBit(uint32_t n){ return __builtin_ctz(n); }
+  static inline unsigned int lowestBit(uint64_t n){ return __builtin_ctzll(n); }
+#ifdef __SIZEOF_INT128__
+  static inline unsigned int popCount(__uint128_t n){ return popCount(uint64_t(n)) + popCount(uint64_t(n >> 64)); }
+  static inline unsigned int lowestBit(__uint128_t n){
+    return uint64_t(n) ? lowestBit(uint64_t(n)) : 64 + lowestBit(uint64_t(n >> 64));
+  }
+#endif
+
+  template <typename Column>
+  void VoxelGridT<Column>::countVoxels(const Column* data, unsigned int n, unsigned int size_z,
+                                       unsigned int* num_marked, unsigned int* num_unknown)
+  {
+    Column levels = size_z >= LEVELS ? unknownColumn() : ((Column)1 << size_z) - 1;
+    *num_marked = 0;
+    *num_unknown = 0;
+    for(unsigned int i = 0; i < n; ++i){
+      *num_marked += popCount(markedBits(data[i]) & levels);
+      *num_unknown += popCount(unknownBits(data[i]) & levels);
+    }
+  }
+
+  //write the voxel centers of one column at (x, y) for each bit set in bits
+  template <typename Column>
+  static inline void appendPoints(Column bits, float x, float y, const float* z, PointBuffer* points)
+  {
+    uint8_t* point = points->data + points->size * points->point_step;
+    while(bits){
+      float xyz[3] = { x, y, z[lowestBit(bits)] };
+      memcpy(point, xyz, sizeof(xyz));
+      point += points->point_step;
+      ++points->size;
+      bits &= bits - 1; //clear the least significant bit set
+    }
+  }
+
+  template <typename Column>
+  void VoxelGridT<Column>::exportVoxels(const Column* data, unsigned int size_x, unsigned int size_y,
+                                        unsigned int size_z, double origin_x, double origin_y, double origin_z,
+                                        double resolution_x, double resolution_y, double resolution_z,
+                                        PointBuffer* marked, PointBuffer* unknown)
+  {
+    Column levels = size_z >= LEVELS ? unknownColumn() : ((Column)1 << size_z) - 1;
+    float z[LEVELS];
+    for(unsigned int i = 0; i < LEVELS; ++i)
+      z[i] = origin_z + (i + 0.5) * resolution_z;
+
+    for(unsigned int y = 0; y < size_y; ++y){
+      float wy = origin_y + (y + 0.5) * resolution_y;
+      const Column* row = data + y * size_x;
+      for(unsigned int x = 0; x < size_x; ++x){
+        Column marked_bits = markedBits(row[x]) & levels;
+        Column unknown_bits = unknownBits(row[x]) & levels;
+        if(!(marked_bits | unknown_bits))
+          continue;
+        float wx = origin_x + (x + 0.5) * resolution_x;
+        appendPoints(marked_bits, wx, wy, z, marked);
+        appendPoints(unknown_bits, wx, wy, z, unknown);
+      }
+    }
+  }
+
+  template <typename Column>
+  VoxelGridT<Column>::VoxelGridT(unsigned int size_x, unsigned int size_y, unsigned int size_z)
+  {
+    size_x_ = size_x; 
+    size_y_ = size_y; 
+    size_z_ = size_z; 
+    allocate();
+  }
+
+  template <typename Column>
+  void VoxelGridT<Column>::resize(unsigned int size_x, unsigned int size_y, unsigned int size_z)
   {
     //if we're not actually changing the size, we can just reset things
     if(size_x == size_x_ && size_y == size_y_ && size_z == size_z_){
@@ -71,36 +293,79 @@ namespace voxel_grid {
     size_x_ = size_x; 
     size_y_ = size_y; 
     size_z_ = size_z; 
+    allocate();
+  }
 
-    if(size_z_ > 16){
-      ROS_INFO("Error, this implementation can only support up to 16 z values (%d)", size_z); 
-      size_z_ = 16;
+  template <typename Column>
+  void VoxelGridT<Column>::allocate()
+  {
+    if(size_z_ > LEVELS){
+      ROS_INFO("Error, this implementation can only support up to %u z values (%d)", LEVELS, size_z_); 
+      size_z_ = LEVELS;
     }
 
-    data_ = new uint32_t[size_x_ * size_y_];
-    uint32_t unknown_col = ~((uint32_t)0)>>16;
-    uint32_t* col = data_;
-    for(unsigned int i = 0; i < size_x_ * size_y_; ++i){
-      *col = unknown_col;
-      ++col;
-    }
+    data_ = new Column[size_x_ * size_y_];
+    reset();
   }
 
-  VoxelGrid::~VoxelGrid()
+  template <typename Column>
+  VoxelGridT<Column>::~VoxelGridT()
   {
     delete [] data_;
   }
 
-  void VoxelGrid::reset(){
-    uint32_t unknown_col = ~((uint32_t)0)>>16;
-    uint32_t* col = data_;
+  template <typename Column>
+  void VoxelGridT<Column>::reset(){
+    Column unknown_col = unknownColumn();
+    Column* col = data_;
     for(unsigned int i = 0; i < size_x_ * size_y_; ++i){
       *col = unknown_col;
       ++col;
     }
   }
 
-  void VoxelGrid::markVoxelLine(double x0, double y0, double z0, double x1, double y1, double z1, unsigned int max_length){
+  template <typename Column>
+  void VoxelGridT<Column>::copyColumns(Column* out) const
+  {
+    memcpy(out, data_, size_x_ * size_y_ * sizeof(Column));
+  }
+
+  template <typename Column>
+  void VoxelGridT<Column>::copyColumns(Column* out, unsigned int x0, unsigned int y0,
+                                       unsigned int width, unsigned int height) const
+  {
+    for(unsigned int y = 0; y < height; ++y)
+      memcpy(out + y * width, data_ + (y0 + y) * size_x_ + x0, width * sizeof(Column));
+  }
+
+  template <typename Column>
+  void VoxelGridT<Column>::shift(int offset_x, int offset_y)
+  {
+    Column unknown_col = unknownColumn();
+    int keep_x = std::max(0, int(size_x_) - abs(offset_x));
+    int keep_y = std::max(0, int(size_y_) - abs(offset_y));
+    if(keep_x == 0 || keep_y == 0){
+      reset();
+      return;
+    }
+
+    int src_x = std::max(0, offset_x), dst_x = std::max(0, -offset_x);
+    int src_y = std::max(0, offset_y), dst_y = std::max(0, -offset_y);
+
+    //move the rows in the order that never overwrites a row still to be read
+    for(int n = 0; n < keep_y; ++n){
+      int row = offset_y >= 0 ? n : keep_y - 1 - n;
+      Column* dst = data_ + (dst_y + row) * size_x_;
+      memmove(dst + dst_x, data_ + (src_y + row) * size_x_ + src_x, keep_x * sizeof(Column));
+      std::fill(dst, dst + dst_x, unknown_col);
+      std::fill(dst + dst_x + keep_x, dst + size_x_, unknown_col);
+    }
+    std::fill(data_, data_ + dst_y * size_x_, unknown_col);
+    std::fill(data_ + (dst_y + keep_y) * size_x_, data_ + size_x_ * size_y_, unknown_col);
+  }
+
+  template <typename Column>
+  void VoxelGridT<Column>::markVoxelLine(double x0, double y0, double z0, double x1, double y1, double z1, unsigned int max_length){
     if(x0 >= size_x_ || y0 >= size_y_ || z0 >= size_z_ || x1>=size_x_ || y1>=size_y_ || z1>=size_z_){
       ROS_DEBUG("Error, line endpoint out of bounds. (%.2f, %.2f, %.2f) to (%.2f, %.2f, %.2f),  size: (%d, %d, %d)", x0, y0, z0, x1, y1, z1, 
           size_x_, size_y_, size_z_);
@@ -111,7 +376,8 @@ namespace voxel_grid {
     raytraceLine(mv, x0, y0, z0, x1, y1, z1, max_length);
   }
 
-  void VoxelGrid::clearVoxelLine(double x0, double y0, double z0, double x1, double y1, double z1, unsigned int max_length){
+  template <typename Column>
+  void VoxelGridT<Column>::clearVoxelLine(double x0, double y0, double z0, double x1, double y1, double z1, unsigned int max_length){
     if(x0 >= size_x_ || y0 >= size_y_ || z0 >= size_z_ || x1>=size_x_ || y1>=size_y_ || z1>=size_z_){
       ROS_DEBUG("Error, line endpoint out of bounds. (%.2f, %.2f, %.2f) to (%.2f, %.2f, %.2f),  size: (%d, %d, %d)", x0, y0, z0, x1, y1, z1, 
           size_x_, size_y_, size_z_);
@@ -122,7 +388,8 @@ namespace voxel_grid {
     raytraceLine(cv, x0, y0, z0, x1, y1, z1, max_length);
   }
 
-  void VoxelGrid::clearVoxelLineInMap(double x0, double y0, double z0, double x1, double y1, double z1, unsigned char *map_2d, 
+  template <typename Column>
+  void VoxelGridT<Column>::clearVoxelLineInMap(double x0, double y0, double z0, double x1, double y1, double z1, unsigned char *map_2d, 
       unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost, unsigned char unknown_cost, unsigned int max_length){
     costmap = map_2d;
     if(map_2d == NULL){
@@ -140,14 +407,135 @@ namespace voxel_grid {
     raytraceLine(cvm, x0, y0, z0, x1, y1, z1, max_length);
   }
 
-  VoxelStatus VoxelGrid::getVoxel(unsigned int x, unsigned int y, unsigned int z)
+  // the lines of a batch are binned into this many directions, so each thread gets a wedge of them
+  static const unsigned int DIRECTION_BINS = 64;
+
+  template <typename Column>
+  void VoxelGridT<Column>::clearVoxelLinesInMap(double x0, double y0, double z0, const std::vector<LineEnd>& ends,
+      unsigned char *map_2d, unsigned int unknown_threshold, unsigned int mark_threshold,
+      unsigned char free_cost, unsigned char unknown_cost, unsigned int max_length, unsigned int num_threads,
+      nav_executor::Lane lane){
+    if(x0 >= size_x_ || y0 >= size_y_ || z0 >= size_z_){
+      ROS_DEBUG("Error, line origin out of bounds. (%.2f, %.2f, %.2f),  size: (%d, %d, %d)", x0, y0, z0,
+          size_x_, size_y_, size_z_);
+      return;
+    }
+
+    num_threads = std::min<unsigned int>(num_threads, ends.size() / MIN_LINES_PER_THREAD);
+    if(num_threads <= 1){
+      for(unsigned int i = 0; i < ends.size(); ++i)
+        clearVoxelLineInMap(x0, y0, z0, ends[i].x, ends[i].y, ends[i].z, map_2d, unknown_threshold, mark_threshold,
+                            free_cost, unknown_cost, max_length);
+      return;
+    }
+
+    //bin the lines in bounds by direction, a counting sort on the angle about the origin
+    std::vector<unsigned int> bins(ends.size());
+    std::vector<unsigned int> starts(DIRECTION_BINS + 1, 0);
+    for(unsigned int i = 0; i < ends.size(); ++i){
+      const LineEnd& e = ends[i];
+      if(e.x >= size_x_ || e.y >= size_y_ || e.z >= size_z_){
+        bins[i] = DIRECTION_BINS;
+        continue;
+      }
+      double angle = atan2(e.y - y0, e.x - x0) + M_PI;
+      bins[i] = std::min((unsigned int)(angle * DIRECTION_BINS / (2 * M_PI)), DIRECTION_BINS - 1);
+      ++starts[bins[i] + 1];
+    }
+    for(unsigned int b = 0; b < DIRECTION_BINS; ++b)
+      starts[b + 1] += starts[b];
+    std::vector<LineEnd> lines(starts[DIRECTION_BINS]);
+    for(unsigned int i = 0; i < ends.size(); ++i){
+      if(bins[i] < DIRECTION_BINS)
+        lines[starts[bins[i]]++] = ends[i];
+    }
+    if(lines.empty())
+      return;
+
+    //each thread traces a run of lines into masks spanning the rows those lines cross
+    unsigned int origin_row = (unsigned int)y0, origin_col = (unsigned int)x0;
+    unsigned int row0 = origin_row, rown = origin_row + 1, col0 = origin_col, coln = origin_col + 1;
+    std::vector<std::vector<Column> > masks(num_threads);
+    std::vector<unsigned int> first_rows(num_threads), begins(num_threads + 1);
+    for(unsigned int t = 0; t <= num_threads; ++t)
+      begins[t] = (unsigned long)lines.size() * t / num_threads;
+    for(unsigned int t = 0; t < num_threads; ++t){
+      unsigned int first = origin_row, last = origin_row;
+      for(unsigned int i = begins[t]; i < begins[t + 1]; ++i){
+        first = std::min(first, (unsigned int)lines[i].y);
+        last = std::max(last, (unsigned int)lines[i].y);
+        col0 = std::min(col0, (unsigned int)lines[i].x);
+        coln = std::max(coln, (unsigned int)lines[i].x + 1);
+      }
+      first_rows[t] = first;
+      masks[t].assign((last - first + 1) * size_x_, 0);
+      row0 = std::min(row0, first);
+      rown = std::max(rown, last + 1);
+    }
+
+    LineEnd origin = { x0, y0, z0 };
+    nav_executor::Executor& executor = nav_executor::Executor::shared();
+    executor.run(lane, num_threads, boost::bind(&VoxelGridT::accumulateLines, this, origin, &lines, &begins,
+                                                &first_rows, max_length, &masks, _1));
+
+    //then each task merges and applies the masks of a stripe of rows, so no two write to the same cell
+    std::vector<unsigned int> stripes(num_threads + 1);
+    for(unsigned int t = 0; t <= num_threads; ++t)
+      stripes[t] = row0 + (rown - row0) * t / num_threads;
+    costmap = map_2d;
+    if(map_2d == NULL)
+      executor.run(lane, num_threads, boost::bind(&VoxelGridT::template applyMasks<ClearVoxel>, this, &masks,
+                                                  &first_rows, &stripes, col0, coln, ClearVoxel(data_), _1));
+    else
+      executor.run(lane, num_threads, boost::bind(&VoxelGridT::template applyMasks<ClearVoxelInMap>, this, &masks,
+                                                  &first_rows, &stripes, col0, coln,
+                                                  ClearVoxelInMap(data_, costmap, unknown_threshold, mark_threshold,
+                                                                  free_cost, unknown_cost), _1));
+  }
+
+  template <typename Column>
+  void VoxelGridT<Column>::accumulateLines(LineEnd origin, const std::vector<LineEnd>* lines,
+      const std::vector<unsigned int>* begins, const std::vector<unsigned int>* first_rows, unsigned int max_length,
+      std::vector<std::vector<Column> >* masks, unsigned int t){
+    AccumulateMask am(&(*masks)[t][0], (*first_rows)[t] * size_x_);
+    for(unsigned int i = (*begins)[t]; i < (*begins)[t + 1]; ++i){
+      const LineEnd& e = (*lines)[i];
+      raytraceLine(am, origin.x, origin.y, origin.z, e.x, e.y, e.z, max_length);
+    }
+  }
+
+  template <typename Column>
+  template <class ActionType>
+  void VoxelGridT<Column>::applyMasks(const std::vector<std::vector<Column> >* masks,
+      const std::vector<unsigned int>* first_rows, const std::vector<unsigned int>* stripes, unsigned int col0,
+      unsigned int coln, ActionType at, unsigned int t){
+    std::vector<Column> merged(coln - col0);
+    for(unsigned int y = (*stripes)[t]; y < (*stripes)[t + 1]; ++y){
+      std::fill(merged.begin(), merged.end(), 0);
+      for(unsigned int m = 0; m < masks->size(); ++m){
+        unsigned int first = (*first_rows)[m];
+        if(y < first || (y - first + 1) * size_x_ > (*masks)[m].size())
+          continue;
+        const Column* row = &(*masks)[m][(y - first) * size_x_];
+        for(unsigned int x = col0; x < coln; ++x)
+          merged[x - col0] |= row[x];
+      }
+      //a column only loses bits, so clearing it once with all its masks leaves what clearing it per line would
+      for(unsigned int x = col0; x < coln; ++x){
+        if(merged[x - col0])
+          at(y * size_x_ + x, merged[x - col0]);
+      }
+    }
+  }
+
+  template <typename Column>
+  VoxelStatus VoxelGridT<Column>::getVoxel(unsigned int x, unsigned int y, unsigned int z)
   {
     if(x >= size_x_ || y >= size_y_ || z >= size_z_){
       ROS_DEBUG("Error, voxel out of bounds. (%d, %d, %d)\n", x, y, z);
       return UNKNOWN;
     }
-    uint32_t full_mask = ((uint32_t)1<<z<<16) | (1<<z);
-    uint32_t result = data_[y * size_x_ + x] & full_mask; 
+    Column result = data_[y * size_x_ + x] & fullMask(z);
     unsigned int bits = numBits(result);
 
     // known marked: 11 = 2 bits, unknown: 01 = 1 bit, known free: 00 = 0 bits
@@ -161,17 +549,18 @@ namespace voxel_grid {
     return MARKED;
   }
 
-  VoxelStatus VoxelGrid::getVoxelColumn(unsigned int x, unsigned int y, unsigned int unknown_threshold, unsigned int marked_threshold)
+  template <typename Column>
+  VoxelStatus VoxelGridT<Column>::getVoxelColumn(unsigned int x, unsigned int y, unsigned int unknown_threshold, unsigned int marked_threshold)
   {
     if(x >= size_x_ || y >= size_y_){
       ROS_DEBUG("Error, voxel out of bounds. (%d, %d)\n", x, y);
       return UNKNOWN;
     }
     
-    uint32_t* col = &data_[y * size_x_ + x];
+    Column* col = &data_[y * size_x_ + x];
 
-    unsigned int unknown_bits = uint16_t(*col>>16) ^ uint16_t(*col);
-    unsigned int marked_bits = *col>>16;
+    Column unknown_bits = unknownBits(*col);
+    Column marked_bits = markedBits(*col);
 
     //check if the number of marked bits qualifies the col as marked
     if(!bitsBelowThreshold(marked_bits, marked_threshold)){
@@ -185,19 +574,28 @@ namespace voxel_grid {
     return FREE;
   }
 
-  unsigned int VoxelGrid::sizeX(){
+  template <typename Column>
+  unsigned int VoxelGridT<Column>::sizeX() const{
     return size_x_;
   }
 
-  unsigned int VoxelGrid::sizeY(){
+  template <typename Column>
+  unsigned int VoxelGridT<Column>::sizeY() const{
     return size_y_;
   }
 
-  unsigned int VoxelGrid::sizeZ(){
+  template <typename Column>
+  unsigned int VoxelGridT<Column>::sizeZ() const{
     return size_z_;
   }
 
-  void VoxelGrid::printVoxelGrid(){
+  template <typename Column>
+  size_t VoxelGridT<Column>::memoryBytes() const{
+    return size_t(size_x_) * size_y_ * sizeof(Column);
+  }
+
+  template <typename Column>
+  void VoxelGridT<Column>::printVoxelGrid(){
     for(unsigned int z = 0; z < size_z_; z++){
       printf("Layer z = %u:\n",z);
       for(unsigned int y = 0; y < size_y_; y++){
@@ -209,13 +607,20 @@ namespace voxel_grid {
     }
   }
 
-  void VoxelGrid::printColumnGrid(){
+  template <typename Column>
+  void VoxelGridT<Column>::printColumnGrid(){
     printf("Column view:\n");
     for(unsigned int y = 0; y < size_y_; y++){
       for(unsigned int x = 0 ; x < size_x_; x++){
-        printf((getVoxelColumn(x, y, 16, 0) == voxel_grid::MARKED)? "#" : " ");
+        printf((getVoxelColumn(x, y, LEVELS, 0) == voxel_grid::MARKED)? "#" : " ");
       }
       printf("|\n");
     } 
   }
+
+  template class VoxelGridT<uint32_t>;
+  template class VoxelGridT<uint64_t>;
+#ifdef __SIZEOF_INT128__
+  template class VoxelGridT<__uint128_t>;
+#endif
 };
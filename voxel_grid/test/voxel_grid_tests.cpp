@@ -35,7 +35,9 @@
 * Author: Eitan Marder-Eppstein
 *********************************************************************/
 #include <voxel_grid/voxel_grid.h>
+#include <voxel_grid/sparse_voxel_grid.h>
 #include <gtest/gtest.h>
+#include <vector>
 
 TEST(voxel_grid, basicMarkingAndClearing){
   int size_x = 50, size_y = 10, size_z = 16;
@@ -140,6 +142,194 @@ TEST(voxel_grid, basicMarkingAndClearing){
      */
 }
 
+TEST(voxel_grid, bulkColumnProjection){
+  //an odd number of columns, so the vectorized and the scalar paths are both used
+  int size_x = 37, size_y = 23, size_z = 10;
+  voxel_grid::VoxelGrid vg(size_x, size_y, size_z);
+  srand(1);
+  for(int i = 0; i < 200; ++i){
+    vg.markVoxel(rand() % size_x, rand() % size_y, rand() % size_z);
+    vg.clearVoxel(rand() % size_x, rand() % size_y, rand() % size_z);
+  }
+
+  std::vector<uint8_t> marked(size_x * size_y), unknown(size_x * size_y);
+  voxel_grid::VoxelGrid::countColumnBits(vg.getData(), size_x * size_y, &marked[0], &unknown[0]);
+  for(int i = 0; i < size_x * size_y; ++i){
+    uint32_t col = vg.getData()[i];
+    ASSERT_EQ(voxel_grid::VoxelGrid::numBits(col >> 16), marked[i]);
+    ASSERT_EQ(voxel_grid::VoxelGrid::numBits(uint16_t(col >> 16) ^ uint16_t(col)), unknown[i]);
+  }
+
+  //the projection has to agree with getVoxelColumn() for any thresholds
+  std::vector<unsigned char> costmap(size_x * size_y);
+  for(unsigned int marked_threshold = 0; marked_threshold < 3; ++marked_threshold){
+    for(unsigned int unknown_threshold = 6; unknown_threshold < 16; unknown_threshold += 3){
+      vg.updateCostmap(&costmap[0], marked_threshold, unknown_threshold, 254, 0, 255);
+      for(int y = 0; y < size_y; ++y){
+        for(int x = 0; x < size_x; ++x){
+          voxel_grid::VoxelStatus status = vg.getVoxelColumn(x, y, unknown_threshold, marked_threshold);
+          unsigned char expected = status == voxel_grid::MARKED ? 254 : (status == voxel_grid::UNKNOWN ? 255 : 0);
+          ASSERT_EQ(expected, costmap[y * size_x + x]);
+        }
+      }
+    }
+  }
+}
+
+TEST(voxel_grid, wideColumns){
+  //32 levels in 64 bit columns
+  int size_x = 20, size_y = 10, size_z = 32;
+  voxel_grid::VoxelGrid64 vg(size_x, size_y, size_z);
+  ASSERT_EQ(32u, vg.sizeZ());
+  ASSERT_EQ(voxel_grid::UNKNOWN, vg.getVoxel(3, 4, 31));
+
+  vg.markVoxelLine(0, 2, 30, 19, 2, 30);
+  for(int x = 0; x < size_x; ++x){
+    ASSERT_EQ(voxel_grid::MARKED, vg.getVoxel(x, 2, 30));
+    ASSERT_EQ(voxel_grid::UNKNOWN, vg.getVoxel(x, 2, 31));
+    ASSERT_EQ(voxel_grid::MARKED, vg.getVoxelColumn(x, 2));
+  }
+
+  //a clearing ray that climbs through all the levels
+  std::vector<unsigned char> costmap(size_x * size_y, 255);
+  vg.clearVoxelLineInMap(0, 5, 0, 19, 5, 31, &costmap[0], 32, 0);
+  ASSERT_EQ(voxel_grid::FREE, vg.getVoxel(0, 5, 0));
+  ASSERT_EQ(voxel_grid::FREE, vg.getVoxel(19, 5, 31));
+  ASSERT_EQ(0, costmap[5 * size_x + 19]);
+
+  std::vector<uint8_t> marked(size_x * size_y), unknown(size_x * size_y);
+  voxel_grid::VoxelGrid64::countColumnBits(vg.getData(), size_x * size_y, &marked[0], &unknown[0]);
+  ASSERT_EQ(1, marked[2 * size_x]);
+  ASSERT_EQ(31, unknown[2 * size_x]);
+  ASSERT_EQ(0, marked[0]);
+  ASSERT_EQ(32, unknown[0]);
+}
+
+TEST(voxel_grid, batchedClearing){
+  //clearing a batch of lines on several threads has to leave what clearing them one by one does
+  int size_x = 120, size_y = 80, size_z = 10;
+  voxel_grid::VoxelGrid one_by_one(size_x, size_y, size_z), batched(size_x, size_y, size_z);
+  std::vector<unsigned char> one_by_one_map(size_x * size_y, 255), batched_map(size_x * size_y, 255);
+  srand(2);
+  for(int i = 0; i < 2000; ++i){
+    int x = rand() % size_x, y = rand() % size_y, z = rand() % size_z;
+    one_by_one.markVoxel(x, y, z);
+    batched.markVoxel(x, y, z);
+  }
+
+  std::vector<voxel_grid::LineEnd> ends(5000);
+  for(unsigned int i = 0; i < ends.size(); ++i){
+    ends[i].x = (rand() % (size_x * 10)) / 10.0;
+    ends[i].y = (rand() % (size_y * 10)) / 10.0;
+    ends[i].z = (rand() % (size_z * 10)) / 10.0;
+  }
+  double x0 = 60.3, y0 = 40.7, z0 = 1.5;
+  for(unsigned int i = 0; i < ends.size(); ++i){
+    one_by_one.clearVoxelLineInMap(x0, y0, z0, ends[i].x, ends[i].y, ends[i].z, &one_by_one_map[0], 2, 0, 0, 255, 50);
+  }
+  batched.clearVoxelLinesInMap(x0, y0, z0, ends, &batched_map[0], 2, 0, 0, 255, 50, 4);
+
+  for(int i = 0; i < size_x * size_y; ++i){
+    ASSERT_EQ(one_by_one.getData()[i], batched.getData()[i]);
+    ASSERT_EQ(one_by_one_map[i], batched_map[i]);
+  }
+}
+
+TEST(voxel_grid, sparseMatchesDense){
+  //the sparse grid has to read as the dense one after the same updates, with only the blocks written allocated
+  int size_x = 203, size_y = 77, size_z = 10;
+  voxel_grid::VoxelGrid dense(size_x, size_y, size_z);
+  voxel_grid::SparseVoxelGrid sparse(size_x, size_y, size_z);
+  std::vector<unsigned char> dense_map(size_x * size_y, 255), sparse_map(size_x * size_y, 255);
+  EXPECT_EQ(0u, sparse.allocatedBlocks());
+  srand(3);
+  for(int i = 0; i < 300; ++i){
+    int x = 100 + rand() % 60, y = 10 + rand() % 30, z = rand() % size_z;
+    EXPECT_EQ(dense.markVoxelInMap(x, y, z, 0), sparse.markVoxelInMap(x, y, z, 0));
+  }
+  for(int i = 0; i < 200; ++i){
+    double x1 = 100 + (rand() % 600) / 10.0, y1 = 10 + (rand() % 300) / 10.0, z1 = (rand() % 100) / 10.0;
+    dense.clearVoxelLineInMap(130.5, 25.5, 2.5, x1, y1, z1, &dense_map[0], 2, 0);
+    sparse.clearVoxelLineInMap(130.5, 25.5, 2.5, x1, y1, z1, &sparse_map[0], 2, 0);
+  }
+  sparse.clearVoxelColumn(20 * size_x + 120);
+  dense.clearVoxelColumn(20 * size_x + 120);
+  EXPECT_LT(sparse.allocatedBlocks(), 80u);
+
+  //the dense grid holds every column, the sparse one only the ids of its blocks and the chunks it has used
+  EXPECT_EQ(size_t(size_x * size_y) * sizeof(uint32_t), dense.memoryBytes());
+  EXPECT_LT(sparse.memoryBytes(), dense.memoryBytes());
+
+  std::vector<uint32_t> columns(size_x * size_y);
+  sparse.copyColumns(&columns[0]);
+  for(int i = 0; i < size_x * size_y; ++i){
+    ASSERT_EQ(dense.getData()[i], columns[i]);
+    ASSERT_EQ(dense_map[i], sparse_map[i]);
+  }
+  EXPECT_EQ(dense.getVoxel(120, 20, 3), sparse.getVoxel(120, 20, 3));
+  EXPECT_EQ(dense.getVoxelColumn(120, 20), sparse.getVoxelColumn(120, 20));
+
+  //shifting moves the columns as the dense grid does
+  dense.shift(37, -11);
+  sparse.shift(37, -11);
+  sparse.copyColumns(&columns[0]);
+  for(int i = 0; i < size_x * size_y; ++i)
+    ASSERT_EQ(dense.getData()[i], columns[i]);
+
+  //and so does a region of them, across the edges of the blocks
+  std::vector<uint32_t> region(29 * 13), dense_region(29 * 13);
+  sparse.copyColumns(&region[0], 101, 5, 29, 13);
+  dense.copyColumns(&dense_region[0], 101, 5, 29, 13);
+  for(int y = 0; y < 13; ++y)
+    for(int x = 0; x < 29; ++x){
+      ASSERT_EQ(dense.getData()[(5 + y) * size_x + 101 + x], region[y * 29 + x]);
+      ASSERT_EQ(region[y * 29 + x], dense_region[y * 29 + x]);
+    }
+
+  sparse.reset();
+  EXPECT_EQ(0u, sparse.allocatedBlocks());
+  EXPECT_EQ(voxel_grid::UNKNOWN, sparse.getVoxel(120, 20, 3));
+}
+
+TEST(voxel_grid, voxelExport){
+  //the exported points have to be the centers of the voxels getVoxel() reports, in the same order
+  int size_x = 31, size_y = 17, size_z = 12;
+  voxel_grid::VoxelGrid vg(size_x, size_y, size_z);
+  srand(4);
+  for(int i = 0; i < 500; ++i){
+    vg.markVoxel(rand() % size_x, rand() % size_y, rand() % size_z);
+    vg.clearVoxel(rand() % size_x, rand() % size_y, rand() % size_z);
+  }
+  vg.clearVoxelColumn(5 * size_x + 3);
+
+  unsigned int num_marked, num_unknown;
+  voxel_grid::VoxelGrid::countVoxels(vg.getData(), size_x * size_y, size_z, &num_marked, &num_unknown);
+  std::vector<float> marked_points(4 * num_marked), unknown_points(4 * num_unknown);
+  voxel_grid::PointBuffer marked = { reinterpret_cast<uint8_t*>(&marked_points[0]), 4 * sizeof(float), 0 };
+  voxel_grid::PointBuffer unknown = { reinterpret_cast<uint8_t*>(&unknown_points[0]), 4 * sizeof(float), 0 };
+  voxel_grid::VoxelGrid::exportVoxels(vg.getData(), size_x, size_y, size_z, 1.0, 2.0, 0.5, 0.1, 0.1, 0.25,
+                                      &marked, &unknown);
+  ASSERT_EQ(num_marked, marked.size);
+  ASSERT_EQ(num_unknown, unknown.size);
+
+  unsigned int m = 0, u = 0;
+  for(int y = 0; y < size_y; ++y){
+    for(int x = 0; x < size_x; ++x){
+      for(int z = 0; z < size_z; ++z){
+        voxel_grid::VoxelStatus status = vg.getVoxel(x, y, z);
+        if(status == voxel_grid::FREE)
+          continue;
+        const float* p = status == voxel_grid::MARKED ? &marked_points[4 * m++] : &unknown_points[4 * u++];
+        EXPECT_FLOAT_EQ(1.0 + (x + 0.5) * 0.1, p[0]);
+        EXPECT_FLOAT_EQ(2.0 + (y + 0.5) * 0.1, p[1]);
+        EXPECT_FLOAT_EQ(0.5 + (z + 0.5) * 0.25, p[2]);
+      }
+    }
+  }
+  EXPECT_EQ(num_marked, m);
+  EXPECT_EQ(num_unknown, u);
+}
+
 int main(int argc, char** argv){
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();